@@ -440,3 +440,647 @@ err_out:
 
     return err;
 }
+
+/**
+ * struct kvdb_event - fields of a cn event as rendered by "hse kvdb events"
+ */
+struct kvdb_event {
+    u64  seq;
+    u64  time;
+    char type[16];
+    char rule[24];
+    u64  cnid;
+    u64  level;
+    u64  offset;
+    u64  kvsets_in;
+    u64  kvsets_out;
+    u64  bytes_in;
+    u64  bytes_out;
+    u64  queue_ns;
+    u64  run_ns;
+    u64  throttle_ns;
+    u64  errnum;
+};
+
+static void
+kvdb_event_print(const struct kvdb_event *ev)
+{
+    printf(
+        "%8lu %12.3f %-9s %-12s %6lu %3lu,%-4lu %3lu->%-3lu %9.1f %9.1f %9.1f %9.1f %9.1f %s\n",
+        ev->seq,
+        ev->time / 1e9,
+        ev->type,
+        ev->rule,
+        ev->cnid,
+        ev->level,
+        ev->offset,
+        ev->kvsets_in,
+        ev->kvsets_out,
+        ev->bytes_in / 1048576.0,
+        ev->bytes_out / 1048576.0,
+        ev->queue_ns / 1e6,
+        ev->run_ns / 1e6,
+        ev->throttle_ns / 1e6,
+        ev->errnum ? strerror(ev->errnum) : "");
+}
+
+/**
+ * kvdb_events_parse() - render the events returned by the REST url
+ *                       mpool/<mp>/cn/events
+ * @buf:      yaml returned by the url
+ * @last_seq: (in/out) number of the last event rendered
+ */
+static void
+kvdb_events_parse(char *buf, u64 *last_seq)
+{
+    struct kvdb_event ev;
+    bool              have = false;
+    char *            line, *next;
+
+    /* Example contents of 'buf':
+     *
+     *   events:
+     *     - seq: 42
+     *       time: 123456789
+     *       type: spill
+     *       ...
+     */
+    memset(&ev, 0, sizeof(ev));
+
+    for (next = buf; (line = strsep(&next, "\n")) != NULL;) {
+        char key[32], val[32];
+
+        if (sscanf(line, " - %31[^:]: %31s", key, val) == 2) {
+            if (have)
+                kvdb_event_print(&ev);
+            memset(&ev, 0, sizeof(ev));
+            have = true;
+        } else if (sscanf(line, " %31[^:]: %31s", key, val) != 2 || !have) {
+            continue;
+        }
+
+        if (!strcmp(key, "seq"))
+            ev.seq = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "time"))
+            ev.time = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "type"))
+            snprintf(ev.type, sizeof(ev.type), "%s", val);
+        else if (!strcmp(key, "rule"))
+            snprintf(ev.rule, sizeof(ev.rule), "%s", val);
+        else if (!strcmp(key, "cnid"))
+            ev.cnid = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "level"))
+            ev.level = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "offset"))
+            ev.offset = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "kvsets_in"))
+            ev.kvsets_in = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "kvsets_out"))
+            ev.kvsets_out = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "bytes_in"))
+            ev.bytes_in = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "bytes_out"))
+            ev.bytes_out = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "queue_ns"))
+            ev.queue_ns = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "run_ns"))
+            ev.run_ns = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "throttle_ns"))
+            ev.throttle_ns = strtoull(val, NULL, 0);
+        else if (!strcmp(key, "errno"))
+            ev.errnum = strtoull(val, NULL, 0);
+
+        if (ev.seq > *last_seq)
+            *last_seq = ev.seq;
+    }
+
+    if (have)
+        kvdb_event_print(&ev);
+}
+
+int
+kvdb_events_print(const char *mpool, bool follow, unsigned interval_secs)
+{
+    struct merr_info info;
+    char             sock[PATH_MAX];
+    char             url[PATH_MAX];
+    size_t           bufsz = (1024 * 1024);
+    char *           buf;
+    u64              last_seq = 0;
+    merr_t           err;
+
+    snprintf(sock, sizeof(sock), "%s/%s/%s.sock", REST_SOCK_ROOT, mpool, mpool);
+
+    buf = malloc(bufsz);
+    if (!buf)
+        return merr(ENOMEM);
+
+    printf(
+        "%8s %12s %-9s %-12s %6s %8s %8s %9s %9s %9s %9s %9s %s\n",
+        "SEQ",
+        "TIME",
+        "TYPE",
+        "RULE",
+        "CNID",
+        "NODE",
+        "KVSETS",
+        "IN_MB",
+        "OUT_MB",
+        "QUEUE_MS",
+        "RUN_MS",
+        "THROT_MS",
+        "ERROR");
+
+    do {
+        snprintf(url, sizeof(url), "mpool/%s/cn/events?since=%lu", mpool, last_seq);
+
+        memset(buf, 0, bufsz);
+        err = curl_get(url, sock, buf, bufsz);
+        if (err) {
+            fprintf(stderr, "unable to get %s events: %s\n", mpool, merr_info(err, &info));
+            break;
+        }
+
+        kvdb_events_parse(buf, &last_seq);
+        fflush(stdout);
+
+        if (follow)
+            sleep(interval_secs);
+    } while (follow);
+
+    free(buf);
+
+    return err;
+}
+
+/* "hse kvdb top" polls the OpenMetrics exposition of the perf counters
+ * (REST url "metrics") and renders the change between successive polls.
+ * Counters that are not enabled at the kvdb's perfc level are not emitted
+ * and are shown as "-".
+ */
+
+#define TOP_FAMILIES "pkvsl,kvdbmetrics,c0sking,sts,cnshape,memacct,c1"
+#define TOP_KVS_MAX  64
+
+/**
+ * struct top_sample - one sample of the metrics text
+ * @name: metric name and labels, e.g. hse_c0sking_qlen{component="c0sk",...}
+ * @val:  sample value
+ */
+struct top_sample {
+    const char *name;
+    u64         val;
+};
+
+/**
+ * struct top_snap - one poll of the metrics url
+ * @buf: metrics text, @v points into it
+ * @v:   samples sorted by name
+ * @c:   number of samples
+ * @ns:  time of the poll
+ */
+struct top_snap {
+    char *             buf;
+    struct top_sample *v;
+    uint               c;
+    u64                ns;
+};
+
+static int
+top_sample_cmp(const void *lhs, const void *rhs)
+{
+    const struct top_sample *l = lhs;
+    const struct top_sample *r = rhs;
+
+    return strcmp(l->name, r->name);
+}
+
+static merr_t
+top_snap_parse(struct top_snap *snap)
+{
+    char *line, *next, *val;
+    uint  max = 0;
+
+    snap->c = 0;
+
+    for (next = snap->buf; (line = strsep(&next, "\n")) != NULL;) {
+        if (!*line || *line == '#')
+            continue;
+
+        val = strrchr(line, ' ');
+        if (!val)
+            continue;
+
+        *val++ = '\000';
+
+        if (snap->c >= max) {
+            struct top_sample *v;
+
+            max = max * 2 + 1024;
+            v = realloc(snap->v, max * sizeof(*v));
+            if (!v)
+                return merr(ENOMEM);
+
+            snap->v = v;
+        }
+
+        snap->v[snap->c].name = line;
+        snap->v[snap->c].val = strtoull(val, NULL, 0);
+        snap->c++;
+    }
+
+    qsort(snap->v, snap->c, sizeof(*snap->v), top_sample_cmp);
+
+    return 0;
+}
+
+/* Index of the first sample whose name is not less than @key.
+ */
+static uint
+top_lower_bound(const struct top_snap *snap, const char *key)
+{
+    uint lo = 0, hi = snap->c;
+
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+
+        if (strcmp(snap->v[mid].name, key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * top_sum() - sum the samples of a metric
+ * @snap:   poll
+ * @metric: metric name, e.g. "hse_c0sking_qlen"
+ * @match:  labels substring the samples must contain (see top_match())
+ * @le:     bucket bound for "_bucket" metrics, else NULL
+ * @found:  (output) set to true if any sample matched
+ */
+static u64
+top_sum(
+    const struct top_snap *snap,
+    const char *           metric,
+    const char *           match,
+    const char *           le,
+    bool *                 found)
+{
+    char   prefix[128];
+    size_t len;
+    u64    sum = 0;
+    uint   i;
+
+    len = snprintf(prefix, sizeof(prefix), "%s{", metric);
+
+    for (i = top_lower_bound(snap, prefix); i < snap->c; ++i) {
+        const char *name = snap->v[i].name;
+        const char *p;
+
+        if (strncmp(name, prefix, len))
+            break;
+
+        if (!strstr(name + len, match))
+            continue;
+
+        if (le) {
+            p = strstr(name + len, ",le=\"");
+            if (!p || strncmp(p + 5, le, strlen(le)) || p[5 + strlen(le)] != '"')
+                continue;
+        }
+
+        sum += snap->v[i].val;
+        *found = true;
+    }
+
+    return sum;
+}
+
+/* Labels substring that selects the counter sets of @kvs in @mpool, or the
+ * kvdb wide sets of @mpool if @kvs is NULL.
+ */
+static void
+top_match(char *buf, size_t bufsz, const char *mpool, const char *kvs)
+{
+    if (kvs)
+        snprintf(buf, bufsz, "kvdb=\"%s\",kvs=\"%s\",set=", mpool, kvs);
+    else
+        snprintf(buf, bufsz, "kvdb=\"%s\",set=", mpool);
+}
+
+/* Change of a metric between two polls, false if it is not in @cur.
+ */
+static bool
+top_delta(
+    const struct top_snap *prev,
+    const struct top_snap *cur,
+    const char *           metric,
+    const char *           match,
+    const char *           le,
+    u64 *                  delta)
+{
+    bool found = false, pfound = false;
+    u64  c, p;
+
+    c = top_sum(cur, metric, match, le, &found);
+    p = top_sum(prev, metric, match, le, &pfound);
+
+    *delta = c > p ? c - p : 0;
+
+    return found;
+}
+
+/**
+ * top_pct() - percentile of the samples recorded between two polls
+ * @metric: histogram metric name (without "_bucket")
+ * @pct:    percentile, e.g. 0.99
+ *
+ * Return: upper bound of the bucket holding the percentile, U64_MAX if
+ * it is in the overflow bucket, 0 if there were no samples.
+ */
+static u64
+top_pct(
+    const struct top_snap *prev,
+    const struct top_snap *cur,
+    const char *           metric,
+    const char *           match,
+    double                 pct)
+{
+    char   name[128], key[128], le[32];
+    u64    total, target, cum, bound, best = U64_MAX;
+    size_t len;
+    uint   i;
+
+    snprintf(name, sizeof(name), "%s_bucket", metric);
+    len = snprintf(key, sizeof(key), "%s{", name);
+
+    if (!top_delta(prev, cur, name, match, "+Inf", &total) || !total)
+        return 0;
+
+    target = total * pct;
+    if (target < 1)
+        target = 1;
+
+    /* Buckets are cumulative, so the percentile is in the smallest bucket
+     * whose count over the interval reaches the target.
+     */
+    for (i = top_lower_bound(cur, key); i < cur->c; ++i) {
+        const char *p = cur->v[i].name;
+
+        if (strncmp(p, key, len))
+            break;
+
+        if (!strstr(p + len, match))
+            continue;
+
+        p = strstr(p + len, ",le=\"");
+        if (!p || p[5] == '+')
+            continue;
+
+        bound = strtoull(p + 5, NULL, 10);
+        if (bound >= best)
+            continue;
+
+        snprintf(le, sizeof(le), "%lu", bound);
+        top_delta(prev, cur, name, match, le, &cum);
+
+        if (cum >= target)
+            best = bound;
+    }
+
+    return best;
+}
+
+/* Names of the kvses of @mpool that have counter sets in @snap.
+ */
+static uint
+top_kvs_names(const struct top_snap *snap, const char *mpool, char namev[][64], uint max)
+{
+    char   pat[128];
+    size_t len;
+    uint   i, j, n = 0;
+
+    len = snprintf(pat, sizeof(pat), "kvdb=\"%s\",kvs=\"", mpool);
+
+    for (i = 0; i < snap->c && n < max; ++i) {
+        const char *p = strstr(snap->v[i].name, pat);
+        const char *end;
+
+        if (!p)
+            continue;
+
+        p += len;
+        end = strchr(p, '"');
+        if (!end || end - p >= sizeof(namev[0]))
+            continue;
+
+        for (j = 0; j < n; ++j)
+            if (!strncmp(namev[j], p, end - p) && !namev[j][end - p])
+                break;
+
+        if (j == n) {
+            memcpy(namev[n], p, end - p);
+            namev[n++][end - p] = '\000';
+        }
+    }
+
+    return n;
+}
+
+static const char *
+top_fmt(char *buf, size_t bufsz, bool found, u64 val)
+{
+    if (!found)
+        return "-";
+
+    snprintf(buf, bufsz, "%lu", val);
+
+    return buf;
+}
+
+/* Format a latency percentile (ns) in microseconds.
+ */
+static const char *
+top_fmt_lat(char *buf, size_t bufsz, u64 ns)
+{
+    if (!ns)
+        return "-";
+
+    if (ns == U64_MAX)
+        return "max";
+
+    snprintf(buf, bufsz, "%lu", (ns + 999) / 1000);
+
+    return buf;
+}
+
+static void
+top_render(
+    const char *           mpool,
+    const struct top_snap *prev,
+    const struct top_snap *cur,
+    bool                   clear)
+{
+    static const char *opv[] = { "put", "get", "del" };
+
+    char   match[256], metric[64], kvsv[TOP_KVS_MAX][64];
+    char   b1[32], b2[32], b3[32];
+    double secs;
+    bool   f1, f2, f3, f4;
+    u64    v1, v2, v3, v4;
+    uint   kvsc, i, j;
+
+    secs = (cur->ns - prev->ns) / 1e9;
+    if (secs <= 0)
+        secs = 1;
+
+    if (clear)
+        printf("\033[H\033[2J");
+
+    printf("kvdb %s, interval %.1fs\n\n", mpool, secs);
+
+    top_match(match, sizeof(match), mpool, NULL);
+
+    f1 = f2 = f3 = f4 = false;
+    v1 = top_sum(cur, "hse_kvdbmetrics_memc0", match, NULL, &f1);
+    v2 = top_sum(cur, "hse_kvdbmetrics_membudget", match, NULL, &f2);
+    v3 = top_sum(cur, "hse_c0sking_qlen", match, NULL, &f3);
+    v4 = top_sum(cur, "hse_sts_qdepth", match, NULL, &f4);
+
+    printf("c0 MiB      %s", top_fmt(b1, sizeof(b1), f1, v1));
+    if (f1 && f2 && v2)
+        printf(" / %lu (%.1f%%)", v2, v1 * 100.0 / v2);
+    printf("\ningest qlen %s\n", top_fmt(b1, sizeof(b1), f3, v3));
+    printf("compact q   %s\n", top_fmt(b1, sizeof(b1), f4, v4));
+
+    f1 = top_delta(prev, cur, "hse_kvdbmetrics_throttle_count", match, NULL, &v1);
+    f2 = top_delta(prev, cur, "hse_kvdbmetrics_throttle_sum", match, NULL, &v2);
+    if (f1 && f2)
+        printf(
+            "throttle    %.0f sleeps/s, avg %lu us, %.1f%% of one thread\n",
+            v1 / secs,
+            v1 ? v2 / v1 / 1000 : 0,
+            v2 / secs / 1e7);
+    else
+        printf("throttle    -\n");
+
+    f1 = f2 = false;
+    v1 = top_sum(cur, "hse_memacct_c1_live", match, NULL, &f1);
+    v2 = top_sum(cur, "hse_c1_tactive", match, NULL, &f2);
+    printf("c1 MiB      %s", top_fmt(b1, sizeof(b1), f1, v1 >> 20));
+    printf(", trees active %s\n\n", top_fmt(b2, sizeof(b2), f2, v2));
+
+    printf(
+        "%-20s %9s %9s %9s %8s %8s %8s %8s %6s %6s %6s\n",
+        "KVS",
+        "PUT/s",
+        "GET/s",
+        "DEL/s",
+        "PUT50us",
+        "PUT99us",
+        "GET50us",
+        "GET99us",
+        "NODES",
+        "MAXLEN",
+        "AVGLEN");
+
+    kvsc = top_kvs_names(cur, mpool, kvsv, TOP_KVS_MAX);
+
+    for (i = 0; i < kvsc; ++i) {
+        printf("%-20s", kvsv[i]);
+
+        top_match(match, sizeof(match), mpool, kvsv[i]);
+
+        for (j = 0; j < NELEM(opv); ++j) {
+            snprintf(metric, sizeof(metric), "hse_pkvsl_kvs_%s_count", opv[j]);
+            if (top_delta(prev, cur, metric, match, NULL, &v1))
+                printf(" %9.0f", v1 / secs);
+            else
+                printf(" %9s", "-");
+        }
+
+        for (j = 0; j < 2; ++j) {
+            snprintf(metric, sizeof(metric), "hse_pkvsl_kvs_%s", opv[j]);
+            v1 = top_pct(prev, cur, metric, match, 0.5);
+            v2 = top_pct(prev, cur, metric, match, 0.99);
+            printf(
+                " %8s %8s",
+                top_fmt_lat(b1, sizeof(b1), v1),
+                top_fmt_lat(b2, sizeof(b2), v2));
+        }
+
+        f1 = f2 = f3 = false;
+        v1 = top_sum(cur, "hse_cnshape_nodes", match, NULL, &f1);
+        v2 = top_sum(cur, "hse_cnshape_maxlen", match, NULL, &f2);
+        v3 = top_sum(cur, "hse_cnshape_avglen", match, NULL, &f3);
+        printf(
+            " %6s %6s %6s\n",
+            top_fmt(b1, sizeof(b1), f1, v1),
+            top_fmt(b2, sizeof(b2), f2, v2),
+            top_fmt(b3, sizeof(b3), f3, v3));
+    }
+
+    fflush(stdout);
+}
+
+int
+kvdb_top_print(const char *mpool, unsigned interval_secs, unsigned count)
+{
+    struct merr_info info;
+    struct top_snap  snapv[2] = { { 0 } };
+    struct top_snap *prev = &snapv[0], *cur = &snapv[1], *tmp;
+    char             sock[PATH_MAX];
+    char             url[PATH_MAX];
+    size_t           bufsz = (8 * 1024 * 1024);
+    bool             clear = isatty(STDOUT_FILENO);
+    unsigned         i;
+    merr_t           err = 0;
+
+    snprintf(sock, sizeof(sock), "%s/%s/%s.sock", REST_SOCK_ROOT, mpool, mpool);
+    snprintf(url, sizeof(url), "metrics?family=%s", TOP_FAMILIES);
+
+    snapv[0].buf = malloc(bufsz);
+    snapv[1].buf = malloc(bufsz);
+    if (!snapv[0].buf || !snapv[1].buf) {
+        err = merr(ENOMEM);
+        goto out;
+    }
+
+    /* The first poll only establishes the baseline for the rates.
+     */
+    for (i = 0; !count || i <= count; ++i) {
+        memset(cur->buf, 0, bufsz);
+        cur->ns = get_time_ns();
+
+        err = curl_get(url, sock, cur->buf, bufsz);
+        if (err) {
+            fprintf(stderr, "unable to get %s metrics: %s\n", mpool, merr_info(err, &info));
+            break;
+        }
+
+        err = top_snap_parse(cur);
+        if (err)
+            break;
+
+        if (i > 0)
+            top_render(mpool, prev, cur, clear);
+
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+
+        if (!count || i < count)
+            sleep(interval_secs);
+    }
+
+out:
+    for (i = 0; i < NELEM(snapv); ++i) {
+        free(snapv[i].buf);
+        free(snapv[i].v);
+    }
+
+    return err;
+}
@@ -22,4 +22,10 @@ kvdb_compact_request(
     struct hse_params *params,
     const char *       request_type,
     unsigned           timeout_sec);
+
+int
+kvdb_events_print(const char *mpool, bool follow, unsigned interval_secs);
+
+int
+kvdb_top_print(const char *mpool, unsigned interval_secs, unsigned count);
 #endif
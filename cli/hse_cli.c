@@ -143,14 +143,20 @@ struct cli {
  *    hse kvdb create
  *    hse kvdb list
  *    hse kvdb compact
+ *    hse kvdb events
+ *    hse kvdb top
  */
 static cli_cmd_func_t cli_hse_kvdb_create;
 static cli_cmd_func_t cli_hse_kvdb_list;
 static cli_cmd_func_t cli_hse_kvdb_compact;
+static cli_cmd_func_t cli_hse_kvdb_events;
+static cli_cmd_func_t cli_hse_kvdb_top;
 struct cli_cmd        cli_hse_kvdb_commands[] = {
     { "create", "Create a KVDB", cli_hse_kvdb_create, 0 },
     { "list", "List KVDBs", cli_hse_kvdb_list, 0 },
     { "compact", "Compact a KVDB", cli_hse_kvdb_compact, 0 },
+    { "events", "Show ingest and compaction events", cli_hse_kvdb_events, 0 },
+    { "top", "Show live KVDB performance", cli_hse_kvdb_top, 0 },
     { 0 },
 };
 
@@ -1068,6 +1074,173 @@ cli_hse_kvdb_compact(struct cli_cmd *self, struct cli *cli)
     return cli_hse_kvdb_compact_impl(cli, cfile, kvdb, compact, status, cancel, timeout_secs);
 }
 
+int
+cli_hse_kvdb_events(struct cli_cmd *self, struct cli *cli)
+{
+    const struct cmd_spec spec = {
+        .usagev =
+            {
+                "[options] <kvdb>", NULL,
+            },
+        .optionv =
+            {
+                OPTION_HELP,
+                { "[-f|--follow]", "Keep polling for new events" },
+                { "[-i|--interval SECS]", "Set the polling interval in seconds (default: 1)" },
+                { NULL },
+            },
+        .longoptv =
+            {
+                { "help", no_argument, 0, 'h' },
+                { "follow", no_argument, 0, 'f' },
+                { "interval", required_argument, 0, 'i' },
+                { NULL },
+            },
+        .configv =
+            {
+                { NULL },
+            },
+    };
+
+    const char *kvdb = 0;
+    uint32_t    interval_secs = 1;
+    bool        follow = false;
+    bool        help = false;
+    int         c;
+
+    if (cli_hook(cli, self, &spec))
+        return 0;
+
+    while (-1 != (c = cli_getopt(cli))) {
+
+        switch (c) {
+            case 'h':
+                help = true;
+                break;
+            case 'f':
+                follow = true;
+                break;
+
+            case 'i':
+                if (parse_u32(optarg, &interval_secs) || interval_secs == 0) {
+                    fprintf(
+                        stderr,
+                        STR("%s: unable to parse"
+                            " '%s' as a positive 32-bit"
+                            " scalar value\n"),
+                        self->cmd_path,
+                        optarg);
+                    return EX_USAGE;
+                }
+                break;
+
+            default:
+                return EX_USAGE;
+        }
+    }
+
+    if (help) {
+        cmd_print_help(self, help_style_usage, stdout);
+        return EX_USAGE;
+    }
+
+    kvdb = cli_next_arg(cli);
+    if (!kvdb) {
+        fprintf(stderr, "%s: missing kvdb name, use -h for help\n", self->cmd_path);
+        return EX_USAGE;
+    }
+
+    return kvdb_events_print(kvdb, follow, interval_secs) ? -1 : 0;
+}
+
+int
+cli_hse_kvdb_top(struct cli_cmd *self, struct cli *cli)
+{
+    const struct cmd_spec spec = {
+        .usagev =
+            {
+                "[options] <kvdb>", NULL,
+            },
+        .optionv =
+            {
+                OPTION_HELP,
+                { "[-i|--interval SECS]", "Set the refresh interval in seconds (default: 1)" },
+                { "[-n|--iterations N]", "Exit after N refreshes (default: run until killed)" },
+                { NULL },
+            },
+        .longoptv =
+            {
+                { "help", no_argument, 0, 'h' },
+                { "interval", required_argument, 0, 'i' },
+                { "iterations", required_argument, 0, 'n' },
+                { NULL },
+            },
+        .configv =
+            {
+                { NULL },
+            },
+    };
+
+    const char *kvdb = 0;
+    uint32_t    interval_secs = 1;
+    uint32_t    iterations = 0;
+    bool        help = false;
+    int         c;
+
+    if (cli_hook(cli, self, &spec))
+        return 0;
+
+    while (-1 != (c = cli_getopt(cli))) {
+
+        switch (c) {
+            case 'h':
+                help = true;
+                break;
+            case 'n':
+                if (parse_u32(optarg, &iterations)) {
+                    fprintf(
+                        stderr,
+                        STR("%s: unable to parse"
+                            " '%s' as a 32-bit"
+                            " scalar value\n"),
+                        self->cmd_path,
+                        optarg);
+                    return EX_USAGE;
+                }
+                break;
+
+            case 'i':
+                if (parse_u32(optarg, &interval_secs) || interval_secs == 0) {
+                    fprintf(
+                        stderr,
+                        STR("%s: unable to parse"
+                            " '%s' as a positive 32-bit"
+                            " scalar value\n"),
+                        self->cmd_path,
+                        optarg);
+                    return EX_USAGE;
+                }
+                break;
+
+            default:
+                return EX_USAGE;
+        }
+    }
+
+    if (help) {
+        cmd_print_help(self, help_style_usage, stdout);
+        return EX_USAGE;
+    }
+
+    kvdb = cli_next_arg(cli);
+    if (!kvdb) {
+        fprintf(stderr, "%s: missing kvdb name, use -h for help\n", self->cmd_path);
+        return EX_USAGE;
+    }
+
+    return kvdb_top_print(kvdb, interval_secs, iterations) ? -1 : 0;
+}
+
 int
 cli_hse_kvs_create_impl(struct cli *cli, const char *cfile, const char *kvdb, const char *kvs)
 {
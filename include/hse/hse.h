@@ -86,6 +86,10 @@
  * @typedef hse_kvdb_txn
  * @brief Opaque structure, a pointer to which is a handle to a transaction
  *        within a KVDB.
+ *
+ * @typedef hse_kvdb_snapshot
+ * @brief Opaque structure, a pointer to which is a handle to a read-only
+ *        view of a KVDB.
  */
 
 typedef uint64_t hse_err_t;
@@ -94,6 +98,7 @@ struct hse_kvdb;
 struct hse_kvs;
 struct hse_kvs_cursor;
 struct hse_kvdb_txn;
+struct hse_kvdb_snapshot;
 
 /**
  * @typedef hse_kvdb_opspec
@@ -102,8 +107,8 @@ struct hse_kvdb_txn;
  *
  * This structure may evolve as the HSE API grows. Failure to use the macro
  * HSE_KVDB_OPSPEC_INIT() to initialize an hse_kvdb_opspec will cause calls using it to
- * fail. Once init'd the programmer can freely manipulate the kop_flags and kop_txn
- * fields. Modifying kop_opaque or relying in any way on its structure will result in
+ * fail. Once init'd the programmer can freely manipulate the kop_flags, kop_txn
+ * and kop_snap fields. Modifying kop_opaque or relying in any way on its structure will result in
  * undefined behavior.
  */
 
@@ -111,6 +116,10 @@ struct hse_kvdb_opspec {
     unsigned int         kop_opaque; /**< opaque data */
     unsigned int         kop_flags;  /**< opspec flags */
     struct hse_kvdb_txn *kop_txn;    /**< transaction context */
+
+    struct hse_kvdb_snapshot *kop_snap; /**< read view, if kop_txn is NULL */
+
+    uint64_t kop_seqno; /**< view seqno, if HSE_KVDB_KOP_FLAG_SEQNO */
 };
 
 #define HSE_KVDB_OPSPEC_INIT(os)       \
@@ -118,12 +127,18 @@ struct hse_kvdb_opspec {
         (os)->kop_opaque = 0xb0de0001; \
         (os)->kop_flags = 0x00000000;  \
         (os)->kop_txn = NULL;          \
+        (os)->kop_snap = NULL;         \
+        (os)->kop_seqno = 0;           \
     } while (0)
 
 #define HSE_KVDB_KOP_FLAG_REVERSE 0x01     /**< reverse cursor */
 #define HSE_KVDB_KOP_FLAG_BIND_TXN 0x02    /**< cursor bound to transaction */
 #define HSE_KVDB_KOP_FLAG_STATIC_VIEW 0x04 /**< bound cursor's view is static */
 #define HSE_KVDB_KOP_FLAG_PRIORITY 0x08    /**< op won't be throttled @see, hse_kvs_put */
+#define HSE_KVDB_KOP_FLAG_KEYS_ONLY 0x10   /**< cursor returns keys and value lengths only */
+#define HSE_KVDB_KOP_FLAG_DIRECT 0x20      /**< cursor bypasses the page cache */
+#define HSE_KVDB_KOP_FLAG_ATOMIC 0x40      /**< write batch becomes visible at once */
+#define HSE_KVDB_KOP_FLAG_SEQNO 0x80       /**< read as of kop_seqno */
 
 /**@}*/
 
@@ -385,6 +400,218 @@ hse_kvs_put(
     const void *            val,
     size_t                  val_len);
 
+/**
+ * Merge function of a KVS
+ *
+ * Combines the merge operand "operand" with the current value "base" of key "key" into
+ * the buffer "result" and returns the length of the combined value in "result_len".
+ * If the key has no value then "base" is NULL. If the combined value is longer than
+ * "result_max" then it must not be written, the function is called again with a buffer
+ * of at least "result_len" bytes. The function may be called with the KVS's internal
+ * locks held, so it must be quick and must not call into HSE. A non-zero return aborts
+ * the merge and is returned by hse_kvs_merge().
+ */
+typedef hse_err_t
+hse_kvs_merge_fn(
+    const void *key,
+    size_t      key_len,
+    const void *base,
+    size_t      base_len,
+    const void *operand,
+    size_t      operand_len,
+    void *      result,
+    size_t      result_max,
+    size_t *    result_len);
+
+/**
+ * Register the merge function of a KVS
+ *
+ * The merge function is used by hse_kvs_merge() until the KVS is closed. It must be
+ * registered before the first hse_kvs_merge() call and is not persisted. This
+ * function is not thread safe.
+ *
+ * @param kvs: KVS handle from hse_kvdb_kvs_open()
+ * @param fn:  Merge function
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_merge_register(struct hse_kvs *kvs, hse_kvs_merge_fn *fn);
+
+/**
+ * Merge an operand into the value of a key in KVS
+ *
+ * Replaces the value of the key by the result of the KVS's merge function applied to
+ * its current value and "operand", which allows read-modify-write updates such as
+ * counters and appends without a get. Outside of a transaction the merge does not read
+ * the key from media if the key was recently updated, and concurrent merges and puts
+ * of the key outside of transactions are never lost. Within a transaction the merge
+ * is based on the transaction's view and conflicts like a put. The operand length must
+ * be in the range [0, HSE_KVS_VLEN_MAX]. This function is thread safe.
+ *
+ * @param kvs:         KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:      Specification for merge operation
+ * @param key:         Key to update
+ * @param key_len:     Length of key
+ * @param operand:     Merge operand
+ * @param operand_len: Length of operand
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_merge(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    const void *            operand,
+    size_t                  operand_len);
+
+/**
+ * Overwrite a range of bytes of the value of a key in KVS
+ *
+ * Writes "data" into the value of the key at byte "offset", without a get and without
+ * resending the rest of the value. The value is extended if the range ends past its end,
+ * a gap between the end of the value and "offset" is zero-filled, and a key without a
+ * value is treated as having an empty value. The update is applied like hse_kvs_merge(),
+ * so concurrent updates and puts of the key outside of transactions are never lost. The
+ * resulting value length must not exceed HSE_KVS_VLEN_MAX. This function is thread safe.
+ *
+ * @param kvs:      KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:   Specification for update operation
+ * @param key:      Key to update
+ * @param key_len:  Length of key
+ * @param offset:   Offset in the value of the first byte to overwrite
+ * @param data:     Bytes to write
+ * @param data_len: Length of data
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_update_range(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    size_t                  offset,
+    const void *            data,
+    size_t                  data_len);
+
+/**
+ * Append bytes to the value of a key in KVS
+ *
+ * Same as hse_kvs_update_range() at an offset equal to the current length of the value.
+ * This function is thread safe.
+ *
+ * @param kvs:      KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:   Specification for append operation
+ * @param key:      Key to update
+ * @param key_len:  Length of key
+ * @param data:     Bytes to append
+ * @param data_len: Length of data
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_append(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    const void *            data,
+    size_t                  data_len);
+
+/**
+ * Actions of a compaction filter, see hse_kvs_compact_filter_fn
+ */
+enum hse_kvs_cfilter_action {
+    HSE_KVS_CFILTER_KEEP = 0,    /**< keep the value */
+    HSE_KVS_CFILTER_DROP = 1,    /**< delete the key */
+    HSE_KVS_CFILTER_REPLACE = 2, /**< replace the value by the result */
+};
+
+/**
+ * Compaction filter of a KVS
+ *
+ * Called by compaction with the newest value of a key that is visible to every snapshot
+ * and transaction. Returns HSE_KVS_CFILTER_KEEP to keep the value, HSE_KVS_CFILTER_DROP
+ * to delete the key, or HSE_KVS_CFILTER_REPLACE after writing a new value of at most
+ * "result_max" bytes to "result" and its length to "result_len". Any other return keeps
+ * the value. The function runs on compaction threads, possibly concurrently, so it must
+ * be thread safe and quick, and must not call into HSE.
+ */
+typedef int
+hse_kvs_compact_filter_fn(
+    void *      arg,
+    const void *key,
+    size_t      key_len,
+    const void *val,
+    size_t      val_len,
+    void *      result,
+    size_t      result_max,
+    size_t *    result_len);
+
+/**
+ * Register the compaction filter of a KVS
+ *
+ * The filter applies to the compactions that start after the call, until the KVS is
+ * closed, and is not persisted. A NULL "fn" removes the filter. Compaction reaches each
+ * key at its own pace, so the filter reclaims space lazily: a key remains readable until
+ * a compaction filters it. K-compactions filter only the values they read anyway, those
+ * that are stored inline with their key or whose value blocks are garbage collected. This
+ * function is thread safe.
+ *
+ * @param kvs: KVS handle from hse_kvdb_kvs_open()
+ * @param fn:  Compaction filter, or NULL
+ * @param arg: Passed to every call of "fn"
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_compact_filter_register(struct hse_kvs *kvs, hse_kvs_compact_filter_fn *fn, void *arg);
+
+/**
+ * Key extractor of a secondary index
+ *
+ * Writes the index key of value "val" of key "key", of at most "index_key_max" bytes, to
+ * "index_key" and its length to "index_key_len", and returns zero. A non-zero return
+ * means the value has no index entry. The function is called by puts and by compaction
+ * threads, possibly concurrently, so it must be thread safe and quick, and must not call
+ * into HSE.
+ */
+typedef int
+hse_kvs_index_fn(
+    void *      arg,
+    const void *key,
+    size_t      key_len,
+    const void *val,
+    size_t      val_len,
+    void *      index_key,
+    size_t      index_key_max,
+    size_t *    index_key_len);
+
+/**
+ * Maintain a secondary index of a KVS in another KVS
+ *
+ * Every hse_kvs_put() into "kvs" then also puts an entry into "index", in the same atomic
+ * write: the key returned by "fn" for the value followed by the put's key, with the put's
+ * key as value. A prefix scan of "index" thus finds the keys of "kvs" by index key. Entries
+ * are not removed by puts and deletes of "kvs", compaction of "index" drops those whose key
+ * no longer has the value they were made from, so an entry may be stale until then and
+ * readers must check the value they get from "kvs". Write batches and merges do not
+ * maintain the index. The registration lasts until either KVS is closed, "index" cannot be
+ * closed before "kvs", and it replaces the compaction filter of "index". Neither KVS may
+ * be part of another index. A NULL "fn" removes the index. This function is not thread
+ * safe with respect to puts into "kvs".
+ *
+ * @param kvs:   KVS handle from hse_kvdb_kvs_open()
+ * @param index: KVS handle of the index, from the same KVDB
+ * @param fn:    Index key extractor, or NULL
+ * @param arg:   Passed to every call of "fn"
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_index_register(
+    struct hse_kvs *  kvs,
+    struct hse_kvs *  index,
+    hse_kvs_index_fn *fn,
+    void *            arg);
+
 /**
  * Retrieve the value for a given key from KVS
  *
@@ -416,6 +643,371 @@ hse_kvs_get(
     size_t                  buf_len,
     size_t *                val_len);
 
+/**
+ * struct hse_kvs_get_req - one key lookup within an hse_kvs_get_batch() call
+ */
+struct hse_kvs_get_req {
+    const void *kgr_key;     /**< key to get */
+    size_t      kgr_key_len; /**< length of key */
+    void *      kgr_buf;     /**< buffer into which the value is copied */
+    size_t      kgr_buf_len; /**< length of buffer */
+    size_t      kgr_val_len; /**< [out] actual length of value if key was found */
+    bool        kgr_found;   /**< [out] whether or not key was found */
+};
+
+/**
+ * Retrieve the values for a batch of keys from KVS
+ *
+ * This function behaves as if hse_kvs_get() were called once for each request in
+ * "reqv", with all lookups performed at the same snapshot view. It is considerably
+ * cheaper than the equivalent sequence of hse_kvs_get() calls because the lookups
+ * share a single traversal of the KVS's in-memory and on-media structures. The order
+ * of the requests in "reqv" has no effect on the results. The number of requests must
+ * be in the range [1, HSE_KVS_GET_BATCH_MAX]. If any request is invalid then no
+ * lookups are performed and an error is returned. This function is thread safe.
+ *
+ * @param kvs:    KVS handle from hse_kvdb_kvs_open()
+ * @param opspec: Specification for get operation
+ * @param reqv:   Vector of get requests
+ * @param reqc:   Number of get requests in "reqv"
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_get_batch(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct hse_kvs_get_req *reqv,
+    unsigned int            reqc);
+
+/**
+ * Prefetch the values of a batch of keys from KVS ahead of their gets
+ *
+ * This function returns without waiting for any media access. HSE worker threads
+ * (see hse_kvs_get_async()) then look up each key and start reading the pages that
+ * hold its value into the page cache, such that a subsequent hse_kvs_get() or
+ * hse_kvs_get_batch() of the key completes without waiting for media. Only the
+ * "kgr_key" and "kgr_key_len" fields of each request are read, the keys are copied
+ * and the requests may be reused as soon as this function returns. The number of
+ * requests must be in the range [1, HSE_KVS_GET_BATCH_MAX]. A prefetch is only a
+ * hint: it has no effect on the results of later operations, and keys that do not
+ * exist are ignored. This function is thread safe.
+ *
+ * @param kvs:    KVS handle from hse_kvdb_kvs_open()
+ * @param opspec: Specification for get operation (a transaction is ignored)
+ * @param reqv:   Vector of get requests naming the keys to prefetch
+ * @param reqc:   Number of get requests in "reqv"
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_prefetch(
+    struct hse_kvs *              kvs,
+    struct hse_kvdb_opspec *      opspec,
+    const struct hse_kvs_get_req *reqv,
+    unsigned int                  reqc);
+
+struct hse_kvs_async_req;
+
+/**
+ * Completion callback for hse_kvs_get_async() and hse_kvs_put_async()
+ *
+ * The callback is invoked from an HSE worker thread once the request has completed,
+ * after which HSE no longer accesses the request. It should not block for long.
+ */
+typedef void
+hse_kvs_async_cb(struct hse_kvs_async_req *req);
+
+/**
+ * struct hse_kvs_async_req - an asynchronous get or put request
+ *
+ * The request, its key and its buffer must remain valid until the callback is invoked.
+ */
+struct hse_kvs_async_req {
+    hse_kvs_async_cb *kar_cb;      /**< completion callback */
+    void *            kar_arg;     /**< caller's private context, not used by HSE */
+    const void *      kar_key;     /**< key to get or put */
+    size_t            kar_key_len; /**< length of key */
+    void *            kar_buf;     /**< get: buffer for value, put: value to put */
+    size_t            kar_buf_len; /**< get: length of buffer, put: length of value */
+    size_t            kar_val_len; /**< [out] get: actual length of value if found */
+    bool              kar_found;   /**< [out] get: whether or not key was found */
+    hse_err_t         kar_err;     /**< [out] completion status of the request */
+};
+
+/**
+ * Asynchronously retrieve the value for a given key from KVS
+ *
+ * The request is queued to a pool of HSE worker threads (sized by the "async_threads"
+ * KVDB run-time parameter) which performs the equivalent of hse_kvs_get() and then
+ * invokes "req->kar_cb". This allows an event-driven caller to keep many reads in
+ * flight without blocking its own threads on media access. The request may not be
+ * part of a transaction. If this function returns an error then the callback will not
+ * be invoked. All outstanding requests complete before hse_kvdb_close() returns, but
+ * the caller must not close the KVS while it has requests outstanding against it.
+ * This function is thread safe.
+ *
+ * @param kvs:    KVS handle from hse_kvdb_kvs_open()
+ * @param opspec: Specification for get operation (copied, need not remain valid)
+ * @param req:    Request to submit
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_get_async(
+    struct hse_kvs *          kvs,
+    struct hse_kvdb_opspec *  opspec,
+    struct hse_kvs_async_req *req);
+
+/**
+ * Asynchronously put a key-value pair into KVS
+ *
+ * The asynchronous counterpart of hse_kvs_put(). See hse_kvs_get_async() for the
+ * completion semantics. The value is "req->kar_buf" of length "req->kar_buf_len".
+ * This function is thread safe.
+ *
+ * @param kvs:    KVS handle from hse_kvdb_kvs_open()
+ * @param opspec: Specification for put operation (copied, need not remain valid)
+ * @param req:    Request to submit
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_put_async(
+    struct hse_kvs *          kvs,
+    struct hse_kvdb_opspec *  opspec,
+    struct hse_kvs_async_req *req);
+
+/**
+ * struct hse_kvs_lease - opaque handle for a value returned by hse_kvs_get_lease()
+ */
+struct hse_kvs_lease;
+
+/**
+ * Retrieve a read-only reference to the value for a given key from KVS
+ *
+ * This function behaves like hse_kvs_get() except that, rather than copying the value
+ * into a caller supplied buffer, it returns a pointer to the value and a lease which
+ * keeps the value valid until released by hse_kvs_lease_release(). Values which reside
+ * in media are returned in place, which avoids a copy that dominates the cost of gets
+ * on large values. Values still resident in memory are returned in a private copy. If
+ * the key is not found then "*lease" is set to NULL. The value must not be modified,
+ * and leases should be released promptly as they prevent the space used by the value
+ * from being reclaimed. This function is thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:  Specification for get operation
+ * @param key:     Key to get from KVS
+ * @param key_len: Length of key
+ * @param[out] found:   Whether or not key was found
+ * @param[out] val:     Pointer to the value if found
+ * @param[out] val_len: Length of value if found
+ * @param[out] lease:   Lease to release once done with the value (NULL if not found)
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_get_lease(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    const void **           val,
+    size_t *                val_len,
+    struct hse_kvs_lease ** lease);
+
+/**
+ * Release a lease obtained from hse_kvs_get_lease()
+ *
+ * The value referenced by the lease must not be accessed after this call. It is safe
+ * to pass a NULL lease. This function is thread safe.
+ *
+ * @param lease: Lease from hse_kvs_get_lease()
+ */
+/* MTF_MOCK */
+void
+hse_kvs_lease_release(struct hse_kvs_lease *lease);
+
+/**
+ * Reallocation callback of hse_kvs_get_grow()
+ *
+ * Must behave like realloc(3): return a buffer of at least "size" bytes which
+ * preserves the contents of "buf" (which may be NULL), or NULL on failure in
+ * which case "buf" must remain valid.
+ */
+typedef void *
+hse_kvs_realloc_fn(void *arg, void *buf, size_t size);
+
+/**
+ * Retrieve the value for a given key from KVS into a growable buffer
+ *
+ * This function behaves like hse_kvs_get() except that if the value does not fit
+ * into "*valbuf" then the buffer is grown via "realloc_fn" (or realloc(3) if NULL)
+ * and the value is copied in the same lookup, with "*valbuf" and "*valbuf_sz"
+ * updated to describe the new buffer. The buffer is never shrunk, so that a caller
+ * which reuses it across gets of variable size values settles on a buffer large
+ * enough for all of them. "*valbuf" may be NULL if "*valbuf_sz" is zero. This
+ * function is thread safe.
+ *
+ * @param kvs:        KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:     Specification for get operation
+ * @param key:        Key to get from KVS
+ * @param key_len:    Length of key
+ * @param[out] found: Whether or not key was found
+ * @param[in,out] valbuf:    Buffer into which the value is copied
+ * @param[in,out] valbuf_sz: Size of "*valbuf"
+ * @param realloc_fn: Function to grow the buffer, or NULL for realloc(3)
+ * @param arg:        Argument passed to "realloc_fn"
+ * @param[out] val_len:      Length of value if found
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_get_grow(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    void **                 valbuf,
+    size_t *                valbuf_sz,
+    hse_kvs_realloc_fn *    realloc_fn,
+    void *                  arg,
+    size_t *                val_len);
+
+/**
+ * Retrieve the length of the value for a given key from KVS
+ *
+ * This function behaves like hse_kvs_get() with a zero length buffer: the length
+ * of the value is resolved from the key's metadata without reading the value
+ * itself, which makes it suitable for sizing a buffer before a get. This
+ * function is thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:  Specification for get operation
+ * @param key:     Key to get from KVS
+ * @param key_len: Length of key
+ * @param[out] found:   Whether or not key was found
+ * @param[out] val_len: Length of value if found
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_get_len(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    size_t *                val_len);
+
+/**
+ * struct hse_kvs_stream - opaque handle for a value written by hse_kvs_stream_write()
+ */
+struct hse_kvs_stream;
+
+/**
+ * Start writing the value of a key in pieces
+ *
+ * The value is appended to by hse_kvs_stream_write() and replaces the current value
+ * of the key once hse_kvs_stream_commit() returns. A value longer than
+ * HSE_KVS_VLEN_MAX is stored in chunks under keys formed by appending a 12 byte
+ * suffix to "key", so the key must be at least 12 bytes shorter than
+ * HSE_KVS_KLEN_MAX, and other keys of the KVS should not be prefixed by it. Such a
+ * value is only read by hse_kvs_stream_read(). Streams cannot be written within a
+ * transaction nor to a KVS with a secondary index. This function is thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:  Specification for the puts of the stream (copied)
+ * @param key:     Key of the value
+ * @param key_len: Length of key
+ * @param[out] stream: Stream to write to
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_stream_open(
+    struct hse_kvs *         kvs,
+    struct hse_kvdb_opspec * opspec,
+    const void *             key,
+    size_t                   key_len,
+    struct hse_kvs_stream ** stream);
+
+/**
+ * Append data to the value of a stream
+ *
+ * Data is buffered until a chunk of HSE_KVS_VLEN_MAX bytes is filled, so writes
+ * may be of any size. A stream must not be written concurrently by several threads.
+ *
+ * @param stream: Stream from hse_kvs_stream_open()
+ * @param data:   Data to append
+ * @param len:    Length of data
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_stream_write(struct hse_kvs_stream *stream, const void *data, size_t len);
+
+/**
+ * Publish the value of a stream
+ *
+ * The value replaces the current value of the key atomically, and the chunks of a
+ * replaced streamed value are deleted. On success the stream is freed. On error it
+ * must be committed again or aborted.
+ *
+ * @param stream: Stream from hse_kvs_stream_open()
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_stream_commit(struct hse_kvs_stream *stream);
+
+/**
+ * Discard the value of a stream and free the stream
+ *
+ * The chunks written so far are deleted. It is safe to pass a NULL stream.
+ *
+ * @param stream: Stream from hse_kvs_stream_open()
+ */
+/* MTF_MOCK */
+void
+hse_kvs_stream_abort(struct hse_kvs_stream *stream);
+
+/**
+ * Read part of the value of a key
+ *
+ * Copies up to "buf_len" bytes of the value at offset "off" into "buf". Only the
+ * chunks of a streamed value which overlap the range are read, each by reference as
+ * with hse_kvs_get_lease(). The value need not have been streamed. This function is
+ * thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:  Specification for get operation
+ * @param key:     Key of the value
+ * @param key_len: Length of key
+ * @param off:     Offset within the value of the first byte to read
+ * @param buf:     Buffer into which the range is copied
+ * @param buf_len: Length of buffer
+ * @param[out] found:    Whether or not key was found
+ * @param[out] read_len: Number of bytes copied, zero if "off" is past the end
+ * @param[out] val_len:  Length of the whole value if found
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_stream_read(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            key,
+    size_t                  key_len,
+    uint64_t                off,
+    void *                  buf,
+    size_t                  buf_len,
+    bool *                  found,
+    size_t *                read_len,
+    uint64_t *              val_len);
+
 /**
  * Delete the key and its associated value from KVS
  *
@@ -437,6 +1029,54 @@ hse_kvs_delete(
     const void *            key,
     size_t                  key_len);
 
+/**
+ * struct hse_kvs_write_req - one put or delete within an hse_kvs_write_batch() call
+ */
+struct hse_kvs_write_req {
+    struct hse_kvs *kwr_kvs;     /**< KVS to which the op applies */
+    bool            kwr_delete;  /**< true to delete the key, false to put it */
+    const void *    kwr_key;     /**< key to put or delete */
+    size_t          kwr_key_len; /**< length of key */
+    const void *    kwr_val;     /**< value to put (ignored for a delete) */
+    size_t          kwr_val_len; /**< length of value (ignored for a delete) */
+};
+
+/**
+ * Apply a batch of puts and deletes to one or more KVSes in a KVDB
+ *
+ * This function behaves as if hse_kvs_put() or hse_kvs_delete() were called once for
+ * each request in "reqv", in vector order. All the KVSes named by the requests must
+ * belong to "kvdb". Outside of a transaction the batch is throttled once and inserted
+ * into memory as a unit, which considerably reduces the per-operation overhead for small
+ * key-value pairs. The batch is not atomic: on error some of the requests may have been
+ * applied. The number of requests must be in the range [1, HSE_KVS_WRITE_BATCH_MAX].
+ * This function is thread safe.
+ *
+ * If HSE_KVDB_KOP_FLAG_ATOMIC is set (outside of a transaction) the whole batch, across
+ * all its KVSes, is given one sequence number: readers see either all of the requests or
+ * none of them, and the batch is logged as a single transaction record. No write locks
+ * are taken, so the batch is not isolated from concurrent transactions writing the same
+ * keys, and a request within the batch cannot read the effect of an earlier one. Use a
+ * transaction if isolation is required. An atomic batch is also inserted into memory all
+ * at once, so its size is limited: the requests whose keys hash to the same in-memory
+ * partition must fit in one partition (kvdb.c0_heap_sz bytes, at least 8 MiB), which
+ * only large values or many requests on one key can exceed. Such a batch fails with
+ * EFBIG and none of it is applied; split it, or use a transaction.
+ *
+ * @param kvdb:   KVDB handle from hse_kvdb_open()
+ * @param opspec: Specification for write operation
+ * @param reqv:   Vector of write requests
+ * @param reqc:   Number of write requests in "reqv"
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_write_batch(
+    struct hse_kvdb *         kvdb,
+    struct hse_kvdb_opspec *  opspec,
+    struct hse_kvs_write_req *reqv,
+    unsigned int              reqc);
+
 /**
  * Delete all KV pairs matching the key prefix from a KVS storing multi-segment keys
  *
@@ -604,6 +1244,56 @@ hse_kvdb_txn_abort(struct hse_kvdb *kvdb, struct hse_kvdb_txn *txn);
 enum hse_kvdb_txn_state
 hse_kvdb_txn_get_state(struct hse_kvdb *kvdb, struct hse_kvdb_txn *txn);
 
+/**
+ * Acquire a read snapshot of a KVDB
+ *
+ * A snapshot is a transaction's read view without the transaction: gets,
+ * prefix probes and cursors whose opspec has kop_snap set (and kop_txn not
+ * set) all read the KVDB as of the same point in time.  It is much cheaper
+ * than hse_kvdb_txn_alloc() plus hse_kvdb_txn_begin(), and holds back the
+ * KVDB's garbage collection horizon in the same way until released.
+ *
+ * This function is thread safe.
+ *
+ * @param kvdb: KVDB handle from hse_kvdb_open()
+ * @param snap: [out] Snapshot handle
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvdb_snapshot_acquire(struct hse_kvdb *kvdb, struct hse_kvdb_snapshot **snap);
+
+/**
+ * Release a read snapshot
+ *
+ * Cursors created with the snapshot keep their view after the release.
+ *
+ * This function is thread safe with different snapshots.
+ *
+ * @param kvdb: KVDB handle from hse_kvdb_open()
+ * @param snap: Snapshot handle from hse_kvdb_snapshot_acquire()
+ */
+void
+hse_kvdb_snapshot_release(struct hse_kvdb *kvdb, struct hse_kvdb_snapshot *snap);
+
+/**
+ * Get the current view sequence number of a KVDB
+ *
+ * Gets, prefix probes and cursors whose opspec has HSE_KVDB_KOP_FLAG_SEQNO
+ * set (and kop_txn not set) read the KVDB as of the view seqno in kop_seqno,
+ * as obtained from this function at some earlier point in time.  Unlike a
+ * snapshot such a read needs nothing to be held, but the seqno must be one
+ * of the last seqno_retain (a KVDB runtime parameter) seqnos, whose views
+ * compaction preserves.  Reads at an older seqno fail with ESTALE.
+ *
+ * This function is thread safe.
+ *
+ * @param kvdb:  KVDB handle from hse_kvdb_open()
+ * @param seqno: [out] Current view sequence number
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvdb_seqno_get(struct hse_kvdb *kvdb, uint64_t *seqno);
+
 /**@}*/
 
 
@@ -625,6 +1315,16 @@ hse_kvdb_txn_get_state(struct hse_kvdb *kvdb, struct hse_kvdb_txn *txn);
  * HSE_KVDB_KOP_FLAG_REVERSE set, then a backwards (reverse sort order) iterating cursor
  * is created. A cursor's direction is determined when it is created and is immutable.
  *
+ * If HSE_KVDB_KOP_FLAG_KEYS_ONLY is set, the cursor returns each key together with the
+ * length of its value, but never reads the value itself. Such a cursor does no value
+ * block I/O or read-ahead, which makes key enumeration considerably cheaper over a KVS
+ * with large values. Like direction, this is determined at creation and is immutable.
+ *
+ * If HSE_KVDB_KOP_FLAG_DIRECT is set, the cursor reads the media through private
+ * buffers instead of through the page cache, so that a large scan does not evict the
+ * data that serves point lookups. Only forward cursors may be direct, and this too is
+ * determined at creation and is immutable.
+ *
  * Cursors are of one of three types: (1) free, (2) transaction snapshot, and (3)
  * transaction bound. A cursor of type (1) is based on an ephemeral snapshot view of the
  * KVS at the time it is created. New data is not visible to the cursor until
@@ -771,7 +1471,7 @@ hse_kvs_cursor_seek_range(
  * @param opspec:  Ignored; may be zero
  * @param key:     [out] Next key in sequence
  * @param key_len: [out] Length of key
- * @param val:     [out] Next value in sequence
+ * @param val:     [out] Next value in sequence, NULL for a key-only cursor
  * @param val_len: [out] Length of value
  * @param eof:     [out] If true, no more key/value pairs in sequence
  * @return The function's error status
@@ -787,6 +1487,52 @@ hse_kvs_cursor_read(
     size_t *                val_len,
     bool *                  eof);
 
+/**
+ * struct hse_kvs_cursor_rec - location of one KV pair within an hse_kvs_cursor_read_many() buffer
+ */
+struct hse_kvs_cursor_rec {
+    size_t kcr_key_off; /**< offset of key from start of buffer */
+    size_t kcr_key_len; /**< length of key */
+    size_t kcr_val_off; /**< offset of value from start of buffer */
+    size_t kcr_val_len; /**< length of value */
+};
+
+/**
+ * Read many KV pairs from the cursor into a caller supplied buffer
+ *
+ * This function behaves as if hse_kvs_cursor_read() were called repeatedly, with each
+ * key and value copied into "buf" and described by successive entries of "recv", until
+ * either "recc" pairs have been read, the next pair does not fit into the remainder of
+ * "buf", or the cursor reaches EOF. A pair which does not fit remains unread and will
+ * be returned by the next read. The function is considerably cheaper per pair than
+ * hse_kvs_cursor_read() for scans over many small pairs. "eof" is set only by a call
+ * which reads no pairs because none remain. It is an error (EMSGSIZE) if the very first
+ * pair does not fit into an empty buffer. For a key-only cursor no value bytes are
+ * copied into "buf" and only kcr_val_len is meaningful. This function is thread safe
+ * across disparate cursors.
+ *
+ * @param cursor: Cursor handle from hse_kvs_cursor_create()
+ * @param opspec: Ignored; may be zero
+ * @param buf:    Buffer into which keys and values are copied
+ * @param buf_sz: Size of buffer
+ * @param recv:   Vector of records describing each pair read
+ * @param recc:   Maximum number of pairs to read (number of entries in "recv")
+ * @param[out] nread: Number of pairs read
+ * @param[out] eof:   If true, no more key/value pairs in sequence
+ * @return The function's error status
+ */
+/* MTF_MOCK */
+hse_err_t
+hse_kvs_cursor_read_many(
+    struct hse_kvs_cursor *    cursor,
+    struct hse_kvdb_opspec *   opspec,
+    void *                     buf,
+    size_t                     buf_sz,
+    struct hse_kvs_cursor_rec *recv,
+    unsigned int               recc,
+    unsigned int *             nread,
+    bool *                     eof);
+
 /**
  * Destroy cursor
  *
@@ -799,6 +1545,159 @@ hse_kvs_cursor_read(
 hse_err_t
 hse_kvs_cursor_destroy(struct hse_kvs_cursor *cursor);
 
+/**
+ * Filter predicate of a cursor, see hse_kvs_cursor_filter()
+ *
+ * Returns non-zero if the key (and value) is to be returned by the cursor. "val" is NULL
+ * when only the key is filtered, "val_len" is always the length of the value.
+ */
+typedef int
+hse_kvs_cursor_filter_fn(
+    void *      arg,
+    const void *key,
+    size_t      key_len,
+    const void *val,
+    size_t      val_len);
+
+/**
+ * Set (or clear) the filter predicates of a cursor
+ *
+ * The predicates run inside the cursor's merge of the KVS's storage layers, and a key
+ * they reject is skipped by hse_kvs_cursor_seek(), hse_kvs_cursor_read() and
+ * hse_kvs_cursor_read_many() as though it were not in the KVS. "key_fn" is called
+ * before the value is read from media, so a key-only predicate saves both the copy and
+ * the I/O of each value it rejects. "val_fn" is called with the value for each key that
+ * passes "key_fn", before the value is copied out of the cursor; it is not allowed on a
+ * key-only cursor. Either predicate may be NULL, passing NULL for both clears the
+ * filter. The predicates must not call back into HSE. A pair already buffered by the
+ * cursor may still be returned, so set the filter before the first read or follow it
+ * with a seek. The filter is cleared when the cursor is destroyed. This function is not
+ * thread safe with respect to other operations on the same cursor.
+ *
+ * @param cursor: Cursor handle from hse_kvs_cursor_create()
+ * @param key_fn: Optional key predicate, may be NULL
+ * @param val_fn: Optional key and value predicate, may be NULL
+ * @param arg:    Argument passed to "key_fn" and "val_fn"
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_cursor_filter(
+    struct hse_kvs_cursor *   cursor,
+    hse_kvs_cursor_filter_fn *key_fn,
+    hse_kvs_cursor_filter_fn *val_fn,
+    void *                    arg);
+
+/**
+ * struct hse_kvs_split_key - one key returned by hse_kvs_range_split()
+ */
+struct hse_kvs_split_key {
+    size_t ksk_len;                   /**< length of the split key */
+    char   ksk_key[HSE_KVS_KLEN_MAX]; /**< split key */
+};
+
+/**
+ * Compute keys that split a KVS (or the keys with a prefix) into ranges of equal size
+ *
+ * The split keys are returned in ascending order and are estimated from the persistent
+ * layout of the KVS: range i runs from split key i-1 (or the start of the prefix) up to
+ * but excluding split key i (or the end of the prefix). Fewer than "rangec" - 1 keys are
+ * returned when the KVS is too small to tell that many ranges apart. This function is
+ * thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param pfx:     Optional prefix of the keys to split, may be NULL
+ * @param pfx_len: Length of "pfx"
+ * @param rangec:  Number of ranges wanted
+ * @param keyv:    [out] Vector of at least "rangec" - 1 split keys
+ * @param keyc:    [out] Number of split keys returned in "keyv"
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_range_split(
+    struct hse_kvs *          kvs,
+    const void *              pfx,
+    size_t                    pfx_len,
+    unsigned int              rangec,
+    struct hse_kvs_split_key *keyv,
+    unsigned int *            keyc);
+
+/**
+ * struct hse_kvs_range_est - estimate returned by hse_kvs_range_estimate()
+ */
+struct hse_kvs_range_est {
+    uint64_t kre_keys;     /**< estimated number of keys in the range */
+    uint64_t kre_keys_lo;  /**< lower bound of kre_keys */
+    uint64_t kre_keys_hi;  /**< upper bound of kre_keys */
+    uint64_t kre_bytes;    /**< estimated key and value bytes in the range */
+    uint64_t kre_bytes_hi; /**< upper bound of kre_bytes */
+};
+
+/**
+ * Estimate the number of keys and bytes in a key range of a KVS without scanning it
+ *
+ * The estimate is computed from the metadata of the persistent layout of the KVS: the
+ * key range and key count of each kblock, and the cardinality sketches of the kvsets
+ * that overlap the range. Keys that have not yet been ingested from memory are only
+ * reflected in the upper bounds, and deleted keys that have not yet been compacted away
+ * may be counted. The range runs from "lo" to "hi", both inclusive; either may be NULL
+ * for an open end. This function is thread safe.
+ *
+ * @param kvs:    KVS handle from hse_kvdb_kvs_open()
+ * @param lo:     Optional smallest key of the range, may be NULL
+ * @param lo_len: Length of "lo"
+ * @param hi:     Optional largest key of the range, may be NULL
+ * @param hi_len: Length of "hi"
+ * @param est:    [out] The estimate
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_range_estimate(
+    struct hse_kvs *          kvs,
+    const void *              lo,
+    size_t                    lo_len,
+    const void *              hi,
+    size_t                    hi_len,
+    struct hse_kvs_range_est *est);
+
+/**
+ * Callback of hse_kvs_scan_parallel(), called once for each key-value pair scanned
+ *
+ * The key and value are only valid for the duration of the call. A non-zero return
+ * stops the scan of all ranges.
+ */
+typedef int
+hse_kvs_scan_fn(void *arg, const void *key, size_t key_len, const void *val, size_t val_len);
+
+/**
+ * Scan a KVS (or the keys with a prefix) with several threads
+ *
+ * The keys are split into up to "threadc" ranges with hse_kvs_range_split(), and each
+ * range is read in key order by its own cursor on its own thread, which passes each
+ * key-value pair to "fn". The callback is thus called concurrently for different ranges
+ * and must be thread safe. All the ranges are read at the same view: that of the snapshot
+ * in "opspec" if there is one, otherwise a snapshot taken at the start of the scan.
+ * Transactions and reverse cursors are not supported. Returns ECANCELED if "fn" stopped
+ * the scan. This function is thread safe.
+ *
+ * @param kvs:     KVS handle from hse_kvdb_kvs_open()
+ * @param opspec:  Specification for the cursors of the scan
+ * @param pfx:     Optional prefix of the keys to scan, may be NULL
+ * @param pfx_len: Length of "pfx"
+ * @param threadc: Max number of threads (and ranges)
+ * @param fn:      Callback for each key-value pair
+ * @param arg:     Argument passed to "fn"
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvs_scan_parallel(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    const void *            pfx,
+    size_t                  pfx_len,
+    unsigned int            threadc,
+    hse_kvs_scan_fn *       fn,
+    void *                  arg);
+
 /**@}*/
 
 
@@ -817,6 +1716,40 @@ hse_kvs_cursor_destroy(struct hse_kvs_cursor *cursor);
 hse_err_t
 hse_kvdb_sync(struct hse_kvdb *kvdb);
 
+/**
+ * Get a durability ticket for the calling thread's writes
+ *
+ * The ticket covers every put, delete and transaction commit the calling
+ * thread completed before this call.  Pass it to hse_kvdb_sync_wait() to
+ * learn when those writes are on stable media, without forcing a flush
+ * the way hse_kvdb_sync() does.  Requires durability to be enabled.
+ *
+ * This function is thread safe.
+ *
+ * @param kvdb:   KVDB handle from hse_kvdb_open()
+ * @param ticket: [out] Durability ticket
+ * @return The function's error status
+ */
+hse_err_t
+hse_kvdb_sync_ticket(struct hse_kvdb *kvdb, uint64_t *ticket);
+
+/**
+ * Wait until the writes covered by a durability ticket are on stable media
+ *
+ * The writes become durable on the periodic durability interval
+ * (dur_intvl_ms) or on an hse_kvdb_sync() by any thread, this function
+ * only waits for that to happen.
+ *
+ * This function is thread safe.
+ *
+ * @param kvdb:       KVDB handle from hse_kvdb_open()
+ * @param ticket:     Ticket from hse_kvdb_sync_ticket()
+ * @param timeout_ms: Zero to poll, negative to wait without a timeout
+ * @return The function's error status, EAGAIN if the writes are not durable yet
+ */
+hse_err_t
+hse_kvdb_sync_wait(struct hse_kvdb *kvdb, uint64_t ticket, int timeout_ms);
+
 /**
  * Initiate data flush in all of the referenced KVDB's KVSs
  *
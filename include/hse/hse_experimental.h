@@ -61,7 +61,7 @@ enum hse_kvs_pfx_probe_cnt {
 /**
  * hse_kvs_prefix_probe_exp() - probe for prefix. Outputs how many matches were
  *                              encountered - zero, one or multiple.
- * @kvs:       KVS handle
+ * @kvs:  KVS handle
  * @opspec:    specification for delete operation
  * @pfx:       prefix to be probed
  * @pfx_len:   length of @pfx
@@ -87,6 +87,167 @@ hse_kvs_prefix_probe_exp(
     size_t                      valbuf_sz,
     size_t *                    val_len);
 
+/**
+ * struct hse_kvs_pfx_probe_req - one prefix of a hse_kvs_prefix_probe_batch_exp() call
+ * @kpr_pfx:       prefix to be probed
+ * @kpr_pfx_len:   length of @kpr_pfx
+ * @kpr_keybuf:    buffer of HSE_KVS_KLEN_MAX bytes for the first seen key
+ * @kpr_valbuf:    buffer for the value of the first seen key
+ * @kpr_valbuf_sz: size of @kpr_valbuf
+ * @kpr_found:     (output) zero, one or multiple matches seen
+ * @kpr_key_len:   (output) length of the first seen key
+ * @kpr_val_len:   (output) length of the value seen
+ */
+struct hse_kvs_pfx_probe_req {
+    const void *               kpr_pfx;
+    size_t                     kpr_pfx_len;
+    void *                     kpr_keybuf;
+    void *                     kpr_valbuf;
+    size_t                     kpr_valbuf_sz;
+    enum hse_kvs_pfx_probe_cnt kpr_found;
+    size_t                     kpr_key_len;
+    size_t                     kpr_val_len;
+};
+
+/**
+ * hse_kvs_prefix_probe_batch_exp() - probe for a batch of prefixes
+ * @kvs:    KVS handle
+ * @opspec: specification for the probes
+ * @reqv:   vector of probe requests
+ * @reqc:   number of requests in @reqv, at most HSE_KVS_PFX_PROBE_BATCH_MAX
+ *
+ * Behaves as if hse_kvs_prefix_probe_exp() were called for each request,
+ * with all probes at the same view, but c0 and cn are each traversed once
+ * for the whole batch, which is much cheaper for large batches.
+ */
+hse_err_t
+hse_kvs_prefix_probe_batch_exp(
+    struct hse_kvs *              kvs,
+    struct hse_kvdb_opspec *      os,
+    struct hse_kvs_pfx_probe_req *reqv,
+    unsigned int                  reqc);
+
+/**
+ * struct hse_kvs_bulk - opaque handle of a bulk load
+ */
+struct hse_kvs_bulk;
+struct hse_kvdb_ckpt;
+
+/**
+ * hse_kvs_bulk_begin_exp() - start a bulk load of a kvs
+ * @kvs:   KVS handle
+ * @bulkp: (output) bulk load handle
+ *
+ * A bulk load writes key/value pairs given in ascending key order directly
+ * into the KVS's media, without going through the write path taken by
+ * hse_kvs_put(), and makes them all visible at once when committed.  While
+ * the load is in progress, puts and deletes in the KVS fail with EBUSY,
+ * and the KVS must not be closed.  Transactions that updated the KVS
+ * should be committed or aborted before the load begins.
+ *
+ * A loaded key/value pair replaces any pair with the same key that was in
+ * the KVS when the load began.
+ */
+hse_err_t
+hse_kvs_bulk_begin_exp(struct hse_kvs *kvs, struct hse_kvs_bulk **bulkp);
+
+/**
+ * hse_kvs_bulk_put_exp() - add a key/value pair to a bulk load
+ * @bulk:    bulk load handle
+ * @key:     key, greater than the key of the previous put
+ * @key_len: length of @key
+ * @val:     value
+ * @val_len: length of @val
+ *
+ * A key out of order fails with EINVAL and may be skipped, any other
+ * error leaves the load able only to be aborted.
+ */
+hse_err_t
+hse_kvs_bulk_put_exp(
+    struct hse_kvs_bulk *bulk,
+    const void *         key,
+    size_t               key_len,
+    const void *         val,
+    size_t               val_len);
+
+/**
+ * hse_kvs_bulk_commit_exp() - make the loaded key/value pairs visible
+ * @bulk: bulk load handle, destroyed whether the commit succeeds or not
+ *
+ * Views (snapshots, transactions, cursors) created before the load began
+ * do not see the loaded pairs.
+ */
+hse_err_t
+hse_kvs_bulk_commit_exp(struct hse_kvs_bulk *bulk);
+
+/**
+ * hse_kvs_bulk_abort_exp() - discard a bulk load
+ * @bulk: bulk load handle, destroyed
+ */
+void
+hse_kvs_bulk_abort_exp(struct hse_kvs_bulk *bulk);
+
+/**
+ * hse_kvs_attach_exp() - add kvsets built elsewhere to a kvs
+ * @kvs:  KVS handle
+ * @dirv: directories of kvset images, oldest kvset first
+ * @dirc: number of directories
+ *
+ * Each directory holds the kblock and vblock images of one kvset, as
+ * written by "cn_kbdump -w" from another KVDB and then uncompressed.
+ * The images are checked and copied into the KVS's media, and the kvsets
+ * then become visible all at once.  While they are being copied, puts
+ * and deletes in the KVS fail with EBUSY.
+ *
+ * The kvsets keep the sequence numbers they were built with.  They can be
+ * attached to a KVS that is empty, or else fail with ERANGE unless all
+ * their sequence numbers are greater than those of the data in the KVS.
+ * Images whose format or key distribution (prefix and suffix lengths)
+ * does not match the KVS fail with EINVAL or EILSEQ.
+ */
+hse_err_t
+hse_kvs_attach_exp(struct hse_kvs *kvs, const char *const *dirv, size_t dirc);
+
+/**
+ * hse_kvdb_ckpt_create_exp() - pin the data of all open KVSes for a backup
+ * @kvdb:  KVDB handle
+ * @ckptp: (output) checkpoint handle
+ *
+ * Flushes the KVDB and then pins the media of every open KVS as of one
+ * point in time; a transaction is either entirely in the checkpoint or not
+ * at all.  Puts, compaction and the like go on unhindered, but media that
+ * compaction frees is kept until the checkpoint is destroyed, and closing
+ * a KVS blocks until then.  A checkpoint does not survive a restart.
+ */
+hse_err_t
+hse_kvdb_ckpt_create_exp(struct hse_kvdb *kvdb, struct hse_kvdb_ckpt **ckptp);
+
+/**
+ * hse_kvdb_ckpt_export_exp() - copy a checkpoint into a directory
+ * @ckpt:    checkpoint handle
+ * @dir:     directory to create
+ * @base:    checkpoint of an earlier export, or NULL for a full export
+ * @basedir: directory of the earlier export of @base
+ *
+ * Writes a subdirectory per KVS with a subdirectory per kvset that can be
+ * restored with hse_kvs_attach_exp(), oldest first.  Given a base, only
+ * the media written since the base checkpoint is copied, the rest is
+ * symlinked into @basedir, which must then be kept.
+ */
+hse_err_t
+hse_kvdb_ckpt_export_exp(
+    struct hse_kvdb_ckpt *ckpt,
+    const char *          dir,
+    struct hse_kvdb_ckpt *base,
+    const char *          basedir);
+
+/**
+ * hse_kvdb_ckpt_destroy_exp() - release a checkpoint
+ * @ckpt: checkpoint handle, may be NULL
+ */
+void
+hse_kvdb_ckpt_destroy_exp(struct hse_kvdb_ckpt *ckpt);
+
 /**
  * hse_params_err_exp() - retrieve last error message
  * @params: configuration parameters
@@ -31,6 +31,15 @@
 /* Max key prefix length */
 #define HSE_KVS_MAX_PFXLEN 32
 
+/* Max number of keys in one hse_kvs_get_batch() call */
+#define HSE_KVS_GET_BATCH_MAX 1024
+
+/* Max number of prefixes in one hse_kvs_prefix_probe_batch_exp() call */
+#define HSE_KVS_PFX_PROBE_BATCH_MAX 1024
+
+/* Max number of requests in one hse_kvs_write_batch() call */
+#define HSE_KVS_WRITE_BATCH_MAX 1024
+
 /* Max KVS name lengths */
 #define HSE_KVS_NAME_LEN_MAX 32
 
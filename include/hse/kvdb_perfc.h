@@ -64,15 +64,37 @@ enum kvdb_perfc_sidx_c0skop {
 enum kvdb_perfc_sidx_c0sking {
     PERFC_BA_C0SKING_QLEN,
     PERFC_BA_C0SKING_WIDTH,
+    PERFC_BA_C0SKING_KVMSSZ,
     PERFC_DI_C0SKING_KVMSDSIZE,
     PERFC_DI_C0SKING_PREP,
     PERFC_DI_C0SKING_FIN,
     PERFC_DI_C0SKING_THRSR,
     PERFC_DI_C0SKING_MEM,
+    PERFC_DI_C0SKING_RCU,
+    PERFC_DI_C0SKING_COALESCE,
+    PERFC_DI_C0SKING_QUEUE,
+    PERFC_DI_C0SKING_FINWAIT,
+    PERFC_DI_C0SKING_MERGE,
+    PERFC_DI_C0SKING_KBUILD,
+    PERFC_DI_C0SKING_KWRITE,
+    PERFC_DI_C0SKING_VWRITE,
+    PERFC_DI_C0SKING_ORDER,
+    PERFC_DI_C0SKING_MBCOMMIT,
+    PERFC_DI_C0SKING_CNDB,
+    PERFC_DI_C0SKING_CNINSERT,
+    PERFC_DI_C0SKING_KBYTES,
+    PERFC_DI_C0SKING_VBYTES,
     PERFC_EN_C0SKING
 };
 
-enum kvdb_perfc_sidx_c0metrics { PERFC_BA_C0METRICS_KVMS_CNT, PERFC_EN_C0METRICS };
+enum kvdb_perfc_sidx_c0metrics {
+    PERFC_BA_C0METRICS_KVMS_CNT,
+    PERFC_BA_C0METRICS_HUGE_CNT,
+    PERFC_BA_C0METRICS_HUGE_FALLBACK,
+    PERFC_RA_C0METRICS_NUMA_LOCAL,
+    PERFC_RA_C0METRICS_NUMA_REMOTE,
+    PERFC_EN_C0METRICS
+};
 
 enum kvdb_perfc_sidx_ctxnop {
     PERFC_BA_CTXNOP_ACTIVE,
@@ -84,6 +106,9 @@ enum kvdb_perfc_sidx_ctxnop {
     PERFC_RA_CTXNOP_FREE,
     PERFC_RA_CTXNOP_ABORT,
     PERFC_RA_CTXNOP_LOCK_FAILED,
+    PERFC_RA_CTXNOP_LOCK_INHERIT,
+    PERFC_LT_CTXNOP_LOCK_HOLD,
+    PERFC_DI_CTXNOP_LOCKS,
     PERFC_EN_CTXNOP
 };
 
@@ -115,6 +140,11 @@ enum kvdb_perfc_sidx_cnget {
     PERFC_RA_CNGET_MISS,
     PERFC_LT_CNGET_MISS,
     PERFC_RA_CNGET_TOMB,
+    PERFC_RA_CNGET_ICHIT,
+    PERFC_RA_CNGET_ICMISS,
+    PERFC_RA_CNGET_ICEVICT,
+    PERFC_RA_CNGET_FENCE,
+    PERFC_RA_CNGET_SEQSKIP,
     PERFC_EN_CNGET
 };
 
@@ -124,9 +154,37 @@ enum kvdb_perfc_sidx_kvdb_metrics {
     PERFC_BA_KVDBMETRICS_HORIZON,
     PERFC_BA_KVDBMETRICS_CURCNT,
     PERFC_DI_KVDBMETRICS_THROTTLE,
+    PERFC_BA_KVDBMETRICS_MEMBUDGET,
+    PERFC_BA_KVDBMETRICS_MEMC0,
+    PERFC_BA_KVDBMETRICS_MEMCACHE,
+    PERFC_BA_KVDBMETRICS_MEMPSI,
     PERFC_EN_KVDBMETRICS
 };
 
+enum kvdb_perfc_sidx_memacct {
+    PERFC_BA_MEMACCT_C0_LIVE,
+    PERFC_BA_MEMACCT_C0_HWM,
+    PERFC_RA_MEMACCT_C0_ALLOC,
+    PERFC_RA_MEMACCT_C0_FREE,
+    PERFC_BA_MEMACCT_CN_LIVE,
+    PERFC_BA_MEMACCT_CN_HWM,
+    PERFC_RA_MEMACCT_CN_ALLOC,
+    PERFC_RA_MEMACCT_CN_FREE,
+    PERFC_BA_MEMACCT_CURSOR_LIVE,
+    PERFC_BA_MEMACCT_CURSOR_HWM,
+    PERFC_RA_MEMACCT_CURSOR_ALLOC,
+    PERFC_RA_MEMACCT_CURSOR_FREE,
+    PERFC_BA_MEMACCT_TXN_LIVE,
+    PERFC_BA_MEMACCT_TXN_HWM,
+    PERFC_RA_MEMACCT_TXN_ALLOC,
+    PERFC_RA_MEMACCT_TXN_FREE,
+    PERFC_BA_MEMACCT_C1_LIVE,
+    PERFC_BA_MEMACCT_C1_HWM,
+    PERFC_RA_MEMACCT_C1_ALLOC,
+    PERFC_RA_MEMACCT_C1_FREE,
+    PERFC_EN_MEMACCT
+};
+
 enum kvdb_perfc_sidx_api_throttle {
     PERFC_DI_THSR_CSCHED,
     PERFC_DI_THSR_C0SK,
@@ -174,6 +232,19 @@ enum kvdb_perfc_cncapped {
     PERFC_EN_CNCAPPED,
 };
 
+enum kvdb_perfc_cnamp {
+    PERFC_RA_CNAMP_UBYTES,
+    PERFC_RA_CNAMP_C1BYTES,
+    PERFC_RA_CNAMP_INGEST,
+    PERFC_RA_CNAMP_SPILL,
+    PERFC_RA_CNAMP_KCOMPACT,
+    PERFC_RA_CNAMP_KVCOMPACT,
+    PERFC_RA_CNAMP_RBYTES,
+    PERFC_RA_CNAMP_GETS,
+    PERFC_RA_CNAMP_KVSETS,
+    PERFC_EN_CNAMP,
+};
+
 enum kvdb_perfc_sidx_cursorcache {
     PERFC_BA_CC_RETIRE_C0,
     PERFC_BA_CC_RETIRE_CN,
@@ -207,9 +278,19 @@ enum kvdb_perfc_sidx_cursorcache {
     PERFC_BA_CC_TOMB_SKIPLEN,
     PERFC_BA_CC_TOMB_SPAN_ADD,
     PERFC_BA_CC_TOMB_SPAN_TIME,
+    PERFC_BA_CC_RESTORE_POOL,
     PERFC_EN_CC
 };
 
+enum kvdb_perfc_sidx_vcache {
+    PERFC_BA_VC_HIT,
+    PERFC_BA_VC_MISS,
+    PERFC_BA_VC_INSERT,
+    PERFC_BA_VC_EVICT,
+    PERFC_BA_VC_INVAL,
+    PERFC_EN_VC
+};
+
 enum kvdb_perfc_sidx_cursordist {
     PERFC_LT_CD_CREATE_CN,
     PERFC_LT_CD_UPDATE_CN,
@@ -231,6 +312,8 @@ enum kvdb_perfc_sidx_cursordist {
 enum kvdb_perfc_sidx_pkvsl {
     PERFC_LT_PKVSL_KVS_PUT,
     PERFC_LT_PKVSL_KVS_GET,
+    PERFC_LT_PKVSL_KVS_GET_BATCH,
+    PERFC_LT_PKVSL_KVS_GET_LEASE,
     PERFC_LT_PKVSL_KVS_DEL,
 
     PERFC_LT_PKVSL_KVS_PFX_PROBE,
@@ -241,6 +324,7 @@ enum kvdb_perfc_sidx_pkvsl {
     PERFC_LT_PKVSL_KVS_CURSOR_SEEK,
     PERFC_LT_PKVSL_KVS_CURSOR_READFWD,
     PERFC_LT_PKVSL_KVS_CURSOR_READREV,
+    PERFC_LT_PKVSL_KVS_CURSOR_READMANY,
     PERFC_LT_PKVSL_KVS_CURSOR_DESTROY,
 
     PERFC_EN_PKVSL,
@@ -350,6 +434,7 @@ enum kvdb_perfc_sidx_c1io {
     PERFC_LT_C1_MB1FL,
     PERFC_LT_C1_MB2FL,
     PERFC_DI_C1_IOVSZ,
+    PERFC_DI_C1_APPSZ,
     PERFC_EN_C1IO,
 };
 
@@ -360,6 +445,7 @@ enum kvdb_perfc_sidx_c1tree {
     PERFC_BA_C1_TINVAL,
     PERFC_BA_C1_TREPL,
     PERFC_BA_C1_TFLUSH,
+    PERFC_BA_C1_TFREE,
     PERFC_EN_C1TREE,
 };
 
@@ -374,6 +460,9 @@ enum kvdb_perfc_sidx_sts_queues {
     PERFC_BA_STS_WORKERS,
     PERFC_BA_STS_WORKERS_IDLE,
 
+    PERFC_RA_STS_STEALS,
+    PERFC_RA_STS_ASSISTS,
+
     PERFC_EN_STS,
 };
 
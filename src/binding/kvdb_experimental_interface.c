@@ -171,6 +171,208 @@ hse_kvs_prefix_probe_exp(
     return 0UL;
 }
 
+uint64_t
+hse_kvs_prefix_probe_batch_exp(
+    struct hse_kvs *              handle,
+    struct hse_kvdb_opspec *      os,
+    struct hse_kvs_pfx_probe_req *reqv,
+    unsigned int                  reqc)
+{
+    struct kvs_ktuple *  ktv;
+    struct kvs_buf *     kbufv, *vbufv;
+    enum key_lookup_res *resv;
+    merr_t               err = 0;
+    u64                  sum;
+    unsigned int         i;
+
+    if (!handle || !reqv || reqc == 0)
+        err = merr(EINVAL);
+    else if (reqc > HSE_KVS_PFX_PROBE_BATCH_MAX)
+        err = merr(E2BIG);
+
+    for (i = 0; !err && i < reqc; ++i) {
+        const struct hse_kvs_pfx_probe_req *req = reqv + i;
+
+        if (!req->kpr_pfx || !req->kpr_pfx_len || !req->kpr_keybuf)
+            err = merr(EINVAL);
+        else if (!req->kpr_valbuf && req->kpr_valbuf_sz > 0)
+            err = merr(EINVAL);
+        else if (req->kpr_pfx_len > HSE_KVS_KLEN_MAX)
+            err = merr(ENAMETOOLONG);
+    }
+
+    if (ev(err))
+        return err;
+
+    ktv = malloc(reqc * (sizeof(*ktv) + 2 * sizeof(*kbufv) + sizeof(*resv)));
+    if (ev(!ktv))
+        return merr(ENOMEM);
+
+    kbufv = (void *)(ktv + reqc);
+    vbufv = kbufv + reqc;
+    resv = (void *)(vbufv + reqc);
+
+    for (i = 0; i < reqc; ++i) {
+        struct hse_kvs_pfx_probe_req *req = reqv + i;
+        void *                        valbuf = req->kpr_valbuf;
+
+        /* See hse_kvs_prefix_probe_exp() regarding a NULL valbuf.
+         */
+        if (!valbuf && req->kpr_valbuf_sz == 0)
+            valbuf = (void *)-1;
+
+        kvs_ktuple_init_nohash(ktv + i, req->kpr_pfx, req->kpr_pfx_len);
+        kvs_buf_init(kbufv + i, req->kpr_keybuf, HSE_KVS_KLEN_MAX);
+        kvs_buf_init(vbufv + i, valbuf, req->kpr_valbuf_sz);
+    }
+
+    err = ikvdb_kvs_pfx_probe_batch(handle, os, ktv, resv, kbufv, vbufv, reqc);
+    if (ev(err))
+        goto out;
+
+    for (i = sum = 0; i < reqc; ++i) {
+        struct hse_kvs_pfx_probe_req *req = reqv + i;
+
+        req->kpr_found = HSE_KVS_PFX_FOUND_ZERO;
+        if (resv[i] != FOUND_VAL && resv[i] != FOUND_MULTIPLE)
+            continue;
+
+        req->kpr_found =
+            resv[i] == FOUND_VAL ? HSE_KVS_PFX_FOUND_ONE : HSE_KVS_PFX_FOUND_MUL;
+        req->kpr_key_len = kbufv[i].b_len;
+        req->kpr_val_len = vbufv[i].b_len;
+        sum += req->kpr_key_len + req->kpr_val_len;
+    }
+
+    PERFC_INCADD_RU(
+        &kvdb_pc, PERFC_RA_KVDBOP_KVS_PFXPROBE, PERFC_BA_KVDBOP_KVS_GETB, sum, 1024);
+
+out:
+    free(ktv);
+
+    return err;
+}
+
+uint64_t
+hse_kvs_bulk_begin_exp(struct hse_kvs *handle, struct hse_kvs_bulk **bulkp)
+{
+    merr_t err;
+
+    if (ev(!handle || !bulkp))
+        return merr(EINVAL);
+
+    err = ikvdb_kvs_bulk_begin(handle, (struct ikvdb_bulk **)bulkp);
+    if (ev(err))
+        return err;
+
+    return 0UL;
+}
+
+uint64_t
+hse_kvs_bulk_put_exp(
+    struct hse_kvs_bulk *bulk,
+    const void *         key,
+    size_t               key_len,
+    const void *         val,
+    size_t               val_len)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    merr_t            err = 0;
+
+    if (!bulk || !key || (val_len > 0 && !val))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+    else if (val_len > HSE_KVS_VLEN_MAX)
+        err = merr(EMSGSIZE);
+
+    if (ev(err))
+        return err;
+
+    PERFC_INCADD_RU(
+        &kvdb_pc, PERFC_RA_KVDBOP_KVS_PUT, PERFC_BA_KVDBOP_KVS_PUTB, key_len + val_len, 1024);
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+    kvs_vtuple_init(&vt, (void *)val, val_len);
+
+    return ikvdb_kvs_bulk_put((struct ikvdb_bulk *)bulk, &kt, &vt);
+}
+
+uint64_t
+hse_kvs_bulk_commit_exp(struct hse_kvs_bulk *bulk)
+{
+    if (ev(!bulk))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_bulk_end((struct ikvdb_bulk *)bulk, true);
+}
+
+void
+hse_kvs_bulk_abort_exp(struct hse_kvs_bulk *bulk)
+{
+    if (bulk)
+        ikvdb_kvs_bulk_end((struct ikvdb_bulk *)bulk, false);
+}
+
+uint64_t
+hse_kvs_attach_exp(struct hse_kvs *handle, const char *const *dirv, size_t dirc)
+{
+    merr_t err;
+
+    if (ev(!handle || !dirv || !dirc || dirc > UINT_MAX))
+        return merr(EINVAL);
+
+    err = ikvdb_kvs_attach(handle, dirv, dirc);
+    if (ev(err))
+        return err;
+
+    return 0UL;
+}
+
+uint64_t
+hse_kvdb_ckpt_create_exp(struct hse_kvdb *handle, struct hse_kvdb_ckpt **ckptp)
+{
+    merr_t err;
+
+    if (ev(!handle || !ckptp))
+        return merr(EINVAL);
+
+    err = ikvdb_ckpt_create((struct ikvdb *)handle, (struct cn_snap **)ckptp);
+    if (ev(err))
+        return err;
+
+    return 0UL;
+}
+
+uint64_t
+hse_kvdb_ckpt_export_exp(
+    struct hse_kvdb_ckpt *ckpt,
+    const char *          dir,
+    struct hse_kvdb_ckpt *base,
+    const char *          basedir)
+{
+    merr_t err;
+
+    if (ev(!ckpt || !dir || (base && !basedir)))
+        return merr(EINVAL);
+
+    err = ikvdb_ckpt_export(
+        (struct cn_snap *)ckpt, dir, (struct cn_snap *)base, base ? basedir : NULL);
+    if (ev(err))
+        return err;
+
+    return 0UL;
+}
+
+void
+hse_kvdb_ckpt_destroy_exp(struct hse_kvdb_ckpt *ckpt)
+{
+    ikvdb_ckpt_destroy((struct cn_snap *)ckpt);
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "hse_experimental_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -12,11 +12,13 @@
 #include <hse/kvdb_perfc.h>
 
 #include <hse_ikvdb/ikvdb.h>
+#include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/kvdb_ctxn.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/kvdb_perfc.h>
 #include <hse_ikvdb/wp.h>
 #include <hse_ikvdb/hse_params_internal.h>
+#include <hse_ikvdb/optrace.h>
 
 #include <hse_version.h>
 
@@ -40,6 +42,20 @@ kvdb_lat_record(const u32 cidx, const u64 start)
     perfc_lat_record(&kvdb_pkvdbl_pc, cidx, start);
 }
 
+static __always_inline void
+kvs_optrace(
+    enum optrace_op         op,
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  klen,
+    size_t                  vlen,
+    uint                    flags)
+{
+    if (unlikely(optrace_enabled))
+        optrace_kvs_op(op, kvs, os ? os->kop_txn : NULL, key, klen, vlen, flags);
+}
+
 /* Accessing hse_initialized is not thread safe, but it is only used
  * in hse_kvdb_init() and hse_kvdb_fini(), which must be serialized
  * with all other HSE APIs.
@@ -169,7 +185,7 @@ hse_kvdb_open(
     struct ikvdb *      ikvdb;
     struct mpool *      kvdb_ds;
     struct kvdb_rparams rparams;
-    u64                 tstart;
+    u64                 tstart, tmpool;
     int                 flags;
     u64                 rc;
 
@@ -197,18 +213,27 @@ hse_kvdb_open(
     if (rparams.excl)
         flags |= O_EXCL;
 
+    tmpool = get_time_ns();
+
     err = mpool_open(mpool_name, flags, &kvdb_ds, NULL);
     if (ev(err))
         return err;
 
+    tmpool = get_time_ns() - tmpool;
+
     err = ikvdb_open(mpool_name, kvdb_ds, params, &ikvdb);
     if (ev(err))
         goto close_ds;
 
+    ikvdb_open_report(ikvdb, tmpool);
     ikvdb_aio_params_set(ikvdb, &rparams);
 
     *handle = (struct hse_kvdb *)ikvdb;
 
+    /* A trace that cannot be created is logged, but does not fail the open. */
+    if (rparams.optrace_path[0])
+        optrace_start(*handle, rparams.optrace_path, rparams.optrace_keys);
+
     if (rparams.read_only == 0) {
         char   sock[PATH_MAX];
         size_t n;
@@ -251,6 +276,8 @@ hse_kvdb_close(struct hse_kvdb *handle)
 
     perfc_inc(&kvdb_pc, PERFC_RA_KVDBOP_KVDB_CLOSE);
 
+    optrace_stop(handle);
+
     /* Retrieve mpool descriptor before ikvdb_impl is free'd */
     ds = ikvdb_mpool_get((struct ikvdb *)handle);
 
@@ -337,6 +364,9 @@ hse_kvdb_kvs_open(
     err = ikvdb_kvs_open((struct ikvdb *)handle, kvs_name, params, IKVS_OFLAG_NONE, kvs_out);
     perfc_lat_record(&kvdb_pkvdbl_pc, PERFC_LT_PKVDBL_KVS_OPEN, tstart);
 
+    if (!err && optrace_enabled)
+        optrace_kvs_open(handle, *kvs_out, kvs_name);
+
     return err;
 }
 
@@ -385,6 +415,8 @@ hse_kvs_put(
     PERFC_INCADD_RU(
         &kvdb_pc, PERFC_RA_KVDBOP_KVS_PUT, PERFC_BA_KVDBOP_KVS_PUTB, key_len + val_len, 1024);
 
+    kvs_optrace(OPTRACE_OP_PUT, handle, os, key, key_len, val_len, 0);
+
     kvs_ktuple_init_nohash(&kt, key, key_len);
     kvs_vtuple_init(&vt, (void *)val, val_len);
 
@@ -393,6 +425,140 @@ hse_kvs_put(
     return err;
 }
 
+hse_err_t
+hse_kvs_merge_register(struct hse_kvs *handle, hse_kvs_merge_fn *fn)
+{
+    if (ev(!handle || !fn))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_merge_register(handle, (kvs_merge_fn *)fn);
+}
+
+hse_err_t
+hse_kvs_compact_filter_register(struct hse_kvs *handle, hse_kvs_compact_filter_fn *fn, void *arg)
+{
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_compact_filter_register(handle, (kvs_cfilter_fn *)fn, arg);
+}
+
+hse_err_t
+hse_kvs_index_register(
+    struct hse_kvs *  handle,
+    struct hse_kvs *  index,
+    hse_kvs_index_fn *fn,
+    void *            arg)
+{
+    if (ev(!handle || (fn && !index)))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_index_register(handle, index, (kvs_index_fn *)fn, arg);
+}
+
+hse_err_t
+hse_kvs_merge(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    const void *            operand,
+    size_t                  operand_len)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    merr_t            err = 0;
+
+    if (!handle || !key || (operand_len > 0 && !operand))
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+    else if (operand_len > HSE_KVS_VLEN_MAX)
+        err = merr(EMSGSIZE);
+
+    if (ev(err))
+        return err;
+
+    PERFC_INCADD_RU(
+        &kvdb_pc, PERFC_RA_KVDBOP_KVS_PUT, PERFC_BA_KVDBOP_KVS_PUTB, key_len + operand_len, 1024);
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+    kvs_vtuple_init(&vt, (void *)operand, operand_len);
+
+    return ikvdb_kvs_merge(handle, os, &kt, &vt);
+}
+
+static hse_err_t
+kvs_patch(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    u64                     offset,
+    const void *            data,
+    size_t                  data_len)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    merr_t            err = 0;
+
+    if (!handle || !key || (data_len > 0 && !data))
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+    else if (data_len > HSE_KVS_VLEN_MAX)
+        err = merr(EMSGSIZE);
+    else if (offset != KVS_PATCH_APPEND && offset > HSE_KVS_VLEN_MAX - data_len)
+        err = merr(EMSGSIZE);
+
+    if (ev(err))
+        return err;
+
+    PERFC_INCADD_RU(
+        &kvdb_pc, PERFC_RA_KVDBOP_KVS_PUT, PERFC_BA_KVDBOP_KVS_PUTB, key_len + data_len, 1024);
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+    kvs_vtuple_init(&vt, (void *)data, data_len);
+
+    return ikvdb_kvs_patch(handle, os, &kt, offset, &vt);
+}
+
+hse_err_t
+hse_kvs_update_range(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    size_t                  offset,
+    const void *            data,
+    size_t                  data_len)
+{
+    if (ev(offset > HSE_KVS_VLEN_MAX))
+        return merr(EMSGSIZE);
+
+    return kvs_patch(handle, os, key, key_len, offset, data, data_len);
+}
+
+hse_err_t
+hse_kvs_append(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    const void *            data,
+    size_t                  data_len)
+{
+    return kvs_patch(handle, os, key, key_len, KVS_PATCH_APPEND, data, data_len);
+}
+
 hse_err_t
 hse_kvs_get(
     struct hse_kvs *        handle,
@@ -447,12 +613,457 @@ hse_kvs_get(
     if (ev(res == FOUND_MULTIPLE))
         return merr(EPROTO);
 
+    kvs_optrace(
+        OPTRACE_OP_GET, handle, os, key, key_len, *found ? *val_len : 0,
+        *found ? OPTRACE_RF_FOUND : 0);
+
     PERFC_INCADD_RU(
         &kvdb_pc, PERFC_RA_KVDBOP_KVS_GET, PERFC_BA_KVDBOP_KVS_GETB, *found ? *val_len : 0, 1024);
 
     return 0UL;
 }
 
+hse_err_t
+hse_kvs_get_batch(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct hse_kvs_get_req *reqv,
+    unsigned int            reqc)
+{
+    struct kvs_ktuple *  ktv;
+    struct kvs_buf *     vbufv;
+    enum key_lookup_res *resv;
+    merr_t               err = 0;
+    u64                  sum;
+    unsigned int         i;
+
+    if (!handle || !reqv || reqc == 0)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (reqc > HSE_KVS_GET_BATCH_MAX)
+        err = merr(E2BIG);
+
+    for (i = 0; !err && i < reqc; ++i) {
+        const struct hse_kvs_get_req *req = reqv + i;
+
+        if (!req->kgr_key || (!req->kgr_buf && req->kgr_buf_len > 0))
+            err = merr(EINVAL);
+        else if (req->kgr_key_len > HSE_KVS_KLEN_MAX)
+            err = merr(ENAMETOOLONG);
+        else if (req->kgr_key_len == 0)
+            err = merr(ENOENT);
+    }
+
+    if (ev(err))
+        return err;
+
+    ktv = malloc(reqc * (sizeof(*ktv) + sizeof(*vbufv) + sizeof(*resv)));
+    if (ev(!ktv))
+        return merr(ENOMEM);
+
+    vbufv = (void *)(ktv + reqc);
+    resv = (void *)(vbufv + reqc);
+
+    for (i = 0; i < reqc; ++i) {
+        struct hse_kvs_get_req *req = reqv + i;
+        void *                  valbuf = req->kgr_buf;
+
+        /* See hse_kvs_get() regarding a NULL valbuf of size zero.
+         */
+        if (!valbuf && req->kgr_buf_len == 0)
+            valbuf = (void *)-1;
+
+        kvs_ktuple_init_nohash(ktv + i, req->kgr_key, req->kgr_key_len);
+        kvs_buf_init(vbufv + i, valbuf, req->kgr_buf_len);
+    }
+
+    err = ikvdb_kvs_get_batch(handle, os, ktv, resv, vbufv, reqc);
+    if (ev(err))
+        goto out;
+
+    for (i = sum = 0; i < reqc; ++i) {
+        struct hse_kvs_get_req *req = reqv + i;
+
+        if (ev(resv[i] == FOUND_MULTIPLE)) {
+            err = merr(EPROTO);
+            goto out;
+        }
+
+        req->kgr_found = (resv[i] == FOUND_VAL);
+        req->kgr_val_len = vbufv[i].b_len;
+
+        if (req->kgr_found)
+            sum += req->kgr_val_len;
+    }
+
+    PERFC_INCADD_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVS_GET, PERFC_BA_KVDBOP_KVS_GETB, sum, 1024);
+
+out:
+    free(ktv);
+
+    return err;
+}
+
+hse_err_t
+hse_kvs_prefetch(
+    struct hse_kvs *              handle,
+    struct hse_kvdb_opspec *      os,
+    const struct hse_kvs_get_req *reqv,
+    unsigned int                  reqc)
+{
+    struct kvs_ktuple *ktv;
+    merr_t             err = 0;
+    unsigned int       i;
+
+    if (!handle || !reqv || reqc == 0)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (reqc > HSE_KVS_GET_BATCH_MAX)
+        err = merr(E2BIG);
+
+    for (i = 0; !err && i < reqc; ++i) {
+        const struct hse_kvs_get_req *req = reqv + i;
+
+        if (!req->kgr_key)
+            err = merr(EINVAL);
+        else if (req->kgr_key_len > HSE_KVS_KLEN_MAX)
+            err = merr(ENAMETOOLONG);
+        else if (req->kgr_key_len == 0)
+            err = merr(ENOENT);
+    }
+
+    if (ev(err))
+        return err;
+
+    ktv = malloc(reqc * sizeof(*ktv));
+    if (ev(!ktv))
+        return merr(ENOMEM);
+
+    for (i = 0; i < reqc; ++i)
+        kvs_ktuple_init_nohash(ktv + i, reqv[i].kgr_key, reqv[i].kgr_key_len);
+
+    err = ikvdb_kvs_prefetch(handle, os, ktv, reqc);
+
+    free(ktv);
+
+    return err;
+}
+
+hse_err_t
+hse_kvs_get_async(
+    struct hse_kvs *          handle,
+    struct hse_kvdb_opspec *  os,
+    struct hse_kvs_async_req *req)
+{
+    merr_t err = 0;
+
+    if (!handle || !req || !req->kar_cb || !req->kar_key)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (!req->kar_buf && req->kar_buf_len > 0)
+        err = merr(EINVAL);
+    else if (req->kar_key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (req->kar_key_len == 0)
+        err = merr(ENOENT);
+
+    if (ev(err))
+        return err;
+
+    perfc_inc(&kvdb_pc, PERFC_RA_KVDBOP_KVS_GET);
+
+    return ikvdb_kvs_async_submit(handle, os, req, false);
+}
+
+hse_err_t
+hse_kvs_put_async(
+    struct hse_kvs *          handle,
+    struct hse_kvdb_opspec *  os,
+    struct hse_kvs_async_req *req)
+{
+    merr_t err = 0;
+
+    if (!handle || !req || !req->kar_cb || !req->kar_key)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (!req->kar_buf && req->kar_buf_len > 0)
+        err = merr(EINVAL);
+    else if (req->kar_key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (req->kar_key_len == 0)
+        err = merr(ENOENT);
+    else if (req->kar_buf_len > HSE_KVS_VLEN_MAX)
+        err = merr(EMSGSIZE);
+
+    if (ev(err))
+        return err;
+
+    PERFC_INCADD_RU(
+        &kvdb_pc,
+        PERFC_RA_KVDBOP_KVS_PUT,
+        PERFC_BA_KVDBOP_KVS_PUTB,
+        req->kar_key_len + req->kar_buf_len,
+        1024);
+
+    return ikvdb_kvs_async_submit(handle, os, req, true);
+}
+
+hse_err_t
+hse_kvs_get_lease(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    const void **           val,
+    size_t *                val_len,
+    struct hse_kvs_lease ** leasep)
+{
+    struct kvs_ktuple   kt;
+    struct kvs_vlease * lease;
+    enum key_lookup_res res;
+    merr_t              err = 0;
+
+    if (!handle || !key || !found || !val || !val_len || !leasep)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+
+    if (ev(err))
+        return err;
+
+    *leasep = NULL;
+
+    lease = malloc(sizeof(*lease));
+    if (ev(!lease))
+        return merr(ENOMEM);
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+
+    err = ikvdb_kvs_get_lease(handle, os, &kt, &res, lease);
+    if (ev(err)) {
+        free(lease);
+        return err;
+    }
+
+    *found = (res == FOUND_VAL);
+
+    if (!*found) {
+        free(lease);
+
+        if (ev(res == FOUND_MULTIPLE))
+            return merr(EPROTO);
+
+        *val = NULL;
+        *val_len = 0;
+
+        return 0UL;
+    }
+
+    *val = lease->vl_data;
+    *val_len = lease->vl_len;
+    *leasep = (struct hse_kvs_lease *)lease;
+
+    PERFC_INCADD_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVS_GET, PERFC_BA_KVDBOP_KVS_GETB, *val_len, 1024);
+
+    return 0UL;
+}
+
+void
+hse_kvs_lease_release(struct hse_kvs_lease *lease)
+{
+    if (!lease)
+        return;
+
+    ikvdb_kvs_lease_release((struct kvs_vlease *)lease);
+    free(lease);
+}
+
+static void *
+hse_kvs_realloc(void *arg, void *buf, size_t size)
+{
+    return realloc(buf, size);
+}
+
+hse_err_t
+hse_kvs_get_grow(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    void **                 valbuf,
+    size_t *                valbuf_sz,
+    hse_kvs_realloc_fn *    realloc_fn,
+    void *                  arg,
+    size_t *                val_len)
+{
+    struct kvs_ktuple   kt;
+    struct kvs_vlease   lease;
+    enum key_lookup_res res;
+    merr_t              err = 0;
+
+    if (!handle || !key || !found || !valbuf || !valbuf_sz || !val_len)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (!*valbuf && *valbuf_sz > 0)
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+
+    if (ev(err))
+        return err;
+
+    if (!realloc_fn)
+        realloc_fn = hse_kvs_realloc;
+
+    /* A lease resolves the value in place, so that we need only size
+     * the buffer before copying the value into it.
+     */
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+
+    err = ikvdb_kvs_get_lease(handle, os, &kt, &res, &lease);
+    if (ev(err))
+        return err;
+
+    *found = (res == FOUND_VAL);
+    *val_len = 0;
+
+    if (!*found)
+        return (res == FOUND_MULTIPLE) ? merr(ev(EPROTO)) : 0UL;
+
+    if (lease.vl_len > *valbuf_sz) {
+        void *buf;
+
+        buf = realloc_fn(arg, *valbuf, lease.vl_len);
+        if (ev(!buf)) {
+            ikvdb_kvs_lease_release(&lease);
+            return merr(ENOMEM);
+        }
+
+        *valbuf = buf;
+        *valbuf_sz = lease.vl_len;
+    }
+
+    memcpy(*valbuf, lease.vl_data, lease.vl_len);
+    *val_len = lease.vl_len;
+
+    ikvdb_kvs_lease_release(&lease);
+
+    PERFC_INCADD_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVS_GET, PERFC_BA_KVDBOP_KVS_GETB, *val_len, 1024);
+
+    return 0UL;
+}
+
+hse_err_t
+hse_kvs_get_len(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    bool *                  found,
+    size_t *                val_len)
+{
+    return hse_kvs_get(handle, os, key, key_len, found, NULL, 0, val_len);
+}
+
+hse_err_t
+hse_kvs_stream_open(
+    struct hse_kvs *         handle,
+    struct hse_kvdb_opspec * os,
+    const void *             key,
+    size_t                   key_len,
+    struct hse_kvs_stream ** streamp)
+{
+    struct kvs_ktuple kt;
+    merr_t            err = 0;
+
+    if (!handle || !key || !streamp)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+
+    if (ev(err))
+        return err;
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+
+    return ikvdb_kvs_stream_open(handle, os, &kt, (struct ikvdb_stream **)streamp);
+}
+
+hse_err_t
+hse_kvs_stream_write(struct hse_kvs_stream *stream, const void *data, size_t len)
+{
+    return ikvdb_kvs_stream_write((struct ikvdb_stream *)stream, data, len);
+}
+
+hse_err_t
+hse_kvs_stream_commit(struct hse_kvs_stream *stream)
+{
+    return ikvdb_kvs_stream_commit((struct ikvdb_stream *)stream);
+}
+
+void
+hse_kvs_stream_abort(struct hse_kvs_stream *stream)
+{
+    ikvdb_kvs_stream_abort((struct ikvdb_stream *)stream);
+}
+
+hse_err_t
+hse_kvs_stream_read(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            key,
+    size_t                  key_len,
+    uint64_t                off,
+    void *                  buf,
+    size_t                  buf_len,
+    bool *                  found,
+    size_t *                read_len,
+    uint64_t *              val_len)
+{
+    struct kvs_ktuple   kt;
+    enum key_lookup_res res;
+    merr_t              err = 0;
+
+    if (!handle || !key || !found || !read_len || !val_len || (buf_len > 0 && !buf))
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (key_len > HSE_KVS_KLEN_MAX)
+        err = merr(ENAMETOOLONG);
+    else if (key_len == 0)
+        err = merr(ENOENT);
+
+    if (ev(err))
+        return err;
+
+    kvs_ktuple_init_nohash(&kt, key, key_len);
+
+    err = ikvdb_kvs_stream_read(handle, os, &kt, off, buf, buf_len, &res, read_len, val_len);
+    if (ev(err))
+        return err;
+
+    *found = res == FOUND_VAL;
+
+    return 0;
+}
+
 /**
  * hse_kvs_delete() - remove the supplied key and associated value from the KVS
  */
@@ -476,6 +1087,8 @@ hse_kvs_delete(struct hse_kvs *handle, struct hse_kvdb_opspec *os, const void *k
 
     perfc_inc(&kvdb_pc, PERFC_RA_KVDBOP_KVS_DEL);
 
+    kvs_optrace(OPTRACE_OP_DEL, handle, os, key, key_len, 0, 0);
+
     kvs_ktuple_init_nohash(&kt, key, key_len);
 
     err = ikvdb_kvs_del(handle, os, &kt);
@@ -483,6 +1096,83 @@ hse_kvs_delete(struct hse_kvs *handle, struct hse_kvdb_opspec *os, const void *k
     return err;
 }
 
+hse_err_t
+hse_kvs_write_batch(
+    struct hse_kvdb *         handle,
+    struct hse_kvdb_opspec *  os,
+    struct hse_kvs_write_req *reqv,
+    unsigned int              reqc)
+{
+    struct kvs_wbatch_op *opv;
+    struct hse_kvs **     kvsv;
+    merr_t                err = 0;
+    u64                   putb, ndel;
+    unsigned int          i;
+
+    if (!handle || !reqv || reqc == 0)
+        err = merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        err = merr(EINVAL);
+    else if (reqc > HSE_KVS_WRITE_BATCH_MAX)
+        err = merr(E2BIG);
+
+    for (i = 0; !err && i < reqc; ++i) {
+        const struct hse_kvs_write_req *req = reqv + i;
+
+        if (!req->kwr_kvs || !req->kwr_key)
+            err = merr(EINVAL);
+        else if (!req->kwr_delete && req->kwr_val_len > 0 && !req->kwr_val)
+            err = merr(EINVAL);
+        else if (req->kwr_key_len > HSE_KVS_KLEN_MAX)
+            err = merr(ENAMETOOLONG);
+        else if (req->kwr_key_len == 0)
+            err = merr(ENOENT);
+        else if (!req->kwr_delete && req->kwr_val_len > HSE_KVS_VLEN_MAX)
+            err = merr(EMSGSIZE);
+    }
+
+    if (ev(err))
+        return err;
+
+    opv = malloc(reqc * (sizeof(*opv) + sizeof(*kvsv)));
+    if (ev(!opv))
+        return merr(ENOMEM);
+
+    kvsv = (void *)(opv + reqc);
+
+    for (i = putb = ndel = 0; i < reqc; ++i) {
+        const struct hse_kvs_write_req *req = reqv + i;
+        struct kvs_wbatch_op *          op = opv + i;
+
+        kvsv[i] = req->kwr_kvs;
+
+        kvs_optrace(
+            req->kwr_delete ? OPTRACE_OP_DEL : OPTRACE_OP_PUT, req->kwr_kvs, os, req->kwr_key,
+            req->kwr_key_len, req->kwr_delete ? 0 : req->kwr_val_len, 0);
+
+        kvs_ktuple_init_nohash(&op->wbo_kt, req->kwr_key, req->kwr_key_len);
+        op->wbo_tomb = req->kwr_delete;
+        op->wbo_skidx = 0;
+
+        if (op->wbo_tomb) {
+            kvs_vtuple_init(&op->wbo_vt, NULL, 0);
+            ++ndel;
+        } else {
+            kvs_vtuple_init(&op->wbo_vt, (void *)req->kwr_val, req->kwr_val_len);
+            putb += req->kwr_key_len + req->kwr_val_len;
+        }
+    }
+
+    perfc_add2(&kvdb_pc, PERFC_RA_KVDBOP_KVS_PUT, reqc - ndel, PERFC_BA_KVDBOP_KVS_PUTB, putb);
+    perfc_add(&kvdb_pc, PERFC_RA_KVDBOP_KVS_DEL, ndel);
+
+    err = ikvdb_kvs_write_batch((struct ikvdb *)handle, os, kvsv, opv, reqc);
+
+    free(opv);
+
+    return err;
+}
+
 hse_err_t
 hse_kvs_prefix_delete(
     struct hse_kvs *        handle,
@@ -503,6 +1193,8 @@ hse_kvs_prefix_delete(
 
     perfc_inc(&kvdb_pc, PERFC_RA_KVDBOP_KVS_PFX_DEL);
 
+    kvs_optrace(OPTRACE_OP_PFX_DEL, handle, os, prefix_key, key_len, 0, 0);
+
     kvs_ktuple_init(&kt, prefix_key, key_len);
 
     err = ikvdb_kvs_prefix_delete(handle, os, &kt, kvs_pfx_len);
@@ -529,6 +1221,24 @@ hse_kvdb_sync(struct hse_kvdb *handle)
     return err;
 }
 
+hse_err_t
+hse_kvdb_sync_ticket(struct hse_kvdb *handle, uint64_t *ticket)
+{
+    if (ev(!handle || !ticket))
+        return merr(EINVAL);
+
+    return ikvdb_sync_ticket((struct ikvdb *)handle, ticket);
+}
+
+hse_err_t
+hse_kvdb_sync_wait(struct hse_kvdb *handle, uint64_t ticket, int timeout_ms)
+{
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    return ikvdb_sync_wait((struct ikvdb *)handle, ticket, timeout_ms);
+}
+
 hse_err_t
 hse_kvdb_flush(struct hse_kvdb *handle)
 {
@@ -576,6 +1286,9 @@ hse_kvdb_txn_begin(struct hse_kvdb *handle, struct hse_kvdb_txn *txn)
     tstart = kvdb_lat_startu(PERFC_LT_PKVDBL_KVDB_TXN_BEGIN);
     PERFC_INC_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVDB_TXN_BEGIN, 128);
 
+    if (unlikely(optrace_enabled))
+        optrace_txn_op(OPTRACE_OP_TXN_BEGIN, handle, txn);
+
     err = ikvdb_txn_begin((struct ikvdb *)handle, txn);
 
     kvdb_lat_record(PERFC_LT_PKVDBL_KVDB_TXN_BEGIN, tstart);
@@ -592,6 +1305,9 @@ hse_kvdb_txn_commit(struct hse_kvdb *handle, struct hse_kvdb_txn *txn)
     tstart = kvdb_lat_startu(PERFC_LT_PKVDBL_KVDB_TXN_COMMIT);
     PERFC_INC_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVDB_TXN_COMMIT, 128);
 
+    if (unlikely(optrace_enabled))
+        optrace_txn_op(OPTRACE_OP_TXN_COMMIT, handle, txn);
+
     err = ikvdb_txn_commit((struct ikvdb *)handle, txn);
 
     kvdb_lat_record(PERFC_LT_PKVDBL_KVDB_TXN_COMMIT, tstart);
@@ -608,6 +1324,9 @@ hse_kvdb_txn_abort(struct hse_kvdb *handle, struct hse_kvdb_txn *txn)
     tstart = kvdb_lat_startu(PERFC_LT_PKVDBL_KVDB_TXN_ABORT);
     PERFC_INC_RU(&kvdb_pc, PERFC_RA_KVDBOP_KVDB_TXN_ABORT, 128);
 
+    if (unlikely(optrace_enabled))
+        optrace_txn_op(OPTRACE_OP_TXN_ABORT, handle, txn);
+
     err = ikvdb_txn_abort((struct ikvdb *)handle, txn);
 
     kvdb_lat_record(PERFC_LT_PKVDBL_KVDB_TXN_ABORT, tstart);
@@ -647,6 +1366,35 @@ hse_kvdb_txn_get_state(struct hse_kvdb *handle, struct hse_kvdb_txn *txn)
     return state;
 }
 
+hse_err_t
+hse_kvdb_snapshot_acquire(struct hse_kvdb *handle, struct hse_kvdb_snapshot **snap)
+{
+    if (ev(!handle || !snap))
+        return merr(EINVAL);
+
+    return ikvdb_snapshot_acquire((struct ikvdb *)handle, snap);
+}
+
+void
+hse_kvdb_snapshot_release(struct hse_kvdb *handle, struct hse_kvdb_snapshot *snap)
+{
+    if (ev(!handle || !snap))
+        return;
+
+    ikvdb_snapshot_release((struct ikvdb *)handle, snap);
+}
+
+hse_err_t
+hse_kvdb_seqno_get(struct hse_kvdb *handle, uint64_t *seqno)
+{
+    if (ev(!handle || !seqno))
+        return merr(EINVAL);
+
+    *seqno = ikvdb_seqno_get((struct ikvdb *)handle);
+
+    return 0;
+}
+
 hse_err_t
 hse_kvs_cursor_create(
     struct hse_kvs *        handle,
@@ -777,6 +1525,38 @@ hse_kvs_cursor_read(
     return err;
 }
 
+hse_err_t
+hse_kvs_cursor_read_many(
+    struct hse_kvs_cursor *    cursor,
+    struct hse_kvdb_opspec *   os,
+    void *                     buf,
+    size_t                     buf_sz,
+    struct hse_kvs_cursor_rec *recv,
+    unsigned int               recc,
+    unsigned int *             nread,
+    bool *                     eof)
+{
+    merr_t       err;
+    u64          sum;
+    unsigned int i;
+
+    if (ev(!cursor || (!buf && buf_sz > 0) || (!recv && recc > 0) || !nread || !eof))
+        return merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        return merr(EINVAL);
+
+    err = ikvdb_kvs_cursor_read_many(cursor, os, buf, buf_sz, recv, recc, nread, eof);
+
+    if (!err && *nread > 0) {
+        for (i = sum = 0; i < *nread; ++i)
+            sum += recv[i].kcr_key_len + recv[i].kcr_val_len;
+
+        perfc_add2(&kvdb_pc, PERFC_RA_KVDBOP_KVS_CURSOR_READ, *nread, PERFC_BA_KVDBOP_KVS_GETB, sum);
+    }
+
+    return err;
+}
+
 hse_err_t
 hse_kvs_cursor_destroy(struct hse_kvs_cursor *cursor)
 {
@@ -792,6 +1572,113 @@ hse_kvs_cursor_destroy(struct hse_kvs_cursor *cursor)
     return err;
 }
 
+hse_err_t
+hse_kvs_cursor_filter(
+    struct hse_kvs_cursor *   cursor,
+    hse_kvs_cursor_filter_fn *key_fn,
+    hse_kvs_cursor_filter_fn *val_fn,
+    void *                    arg)
+{
+    if (ev(!cursor))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_cursor_filter(cursor, key_fn, val_fn, arg);
+}
+
+hse_err_t
+hse_kvs_range_split(
+    struct hse_kvs *          handle,
+    const void *              pfx,
+    size_t                    pfx_len,
+    unsigned int              rangec,
+    struct hse_kvs_split_key *keyv,
+    unsigned int *            keyc)
+{
+    struct cn_split_key *splitv;
+    merr_t               err;
+    u32                  i, n;
+
+    if (ev(!handle || !keyv || !keyc || rangec == 0 || (pfx_len > 0 && !pfx)))
+        return merr(EINVAL);
+
+    if (ev(pfx_len > HSE_KVS_KLEN_MAX))
+        return merr(ENAMETOOLONG);
+
+    *keyc = 0;
+
+    if (rangec < 2)
+        return 0;
+
+    splitv = malloc(sizeof(*splitv) * (rangec - 1));
+    if (ev(!splitv))
+        return merr(ENOMEM);
+
+    err = ikvdb_kvs_range_split(handle, pfx, pfx_len, rangec, splitv, &n);
+    if (!ev(err)) {
+        for (i = 0; i < n; ++i) {
+            memcpy(keyv[i].ksk_key, splitv[i].csk_key, splitv[i].csk_len);
+            keyv[i].ksk_len = splitv[i].csk_len;
+        }
+
+        *keyc = n;
+    }
+
+    free(splitv);
+
+    return err;
+}
+
+hse_err_t
+hse_kvs_range_estimate(
+    struct hse_kvs *          handle,
+    const void *              lo,
+    size_t                    lo_len,
+    const void *              hi,
+    size_t                    hi_len,
+    struct hse_kvs_range_est *est)
+{
+    struct cn_range_est cre;
+    merr_t              err;
+
+    if (ev(!handle || !est || (lo_len > 0 && !lo) || (hi_len > 0 && !hi)))
+        return merr(EINVAL);
+
+    if (ev(lo_len > HSE_KVS_KLEN_MAX || hi_len > HSE_KVS_KLEN_MAX))
+        return merr(ENAMETOOLONG);
+
+    err = ikvdb_kvs_range_estimate(handle, lo, lo_len, hi, hi_len, &cre);
+    if (ev(err))
+        return err;
+
+    est->kre_keys = cre.cre_keys;
+    est->kre_keys_lo = cre.cre_keys_lo;
+    est->kre_keys_hi = cre.cre_keys_hi;
+    est->kre_bytes = cre.cre_bytes;
+    est->kre_bytes_hi = cre.cre_bytes_hi;
+
+    return 0;
+}
+
+hse_err_t
+hse_kvs_scan_parallel(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    const void *            pfx,
+    size_t                  pfx_len,
+    unsigned int            threadc,
+    hse_kvs_scan_fn *       fn,
+    void *                  arg)
+{
+    if (ev(!handle || !fn || threadc == 0 || (pfx_len > 0 && !pfx)))
+        return merr(EINVAL);
+    else if (os && (((os->kop_opaque >> 16) != 0xb0de) || ((os->kop_opaque & 0x0000ffff) != 1)))
+        return merr(EINVAL);
+    else if (ev(pfx_len > HSE_KVS_KLEN_MAX))
+        return merr(ENAMETOOLONG);
+
+    return ikvdb_kvs_scan_parallel(handle, os, pfx, pfx_len, threadc, fn, arg);
+}
+
 hse_err_t
 hse_kvdb_compact(struct hse_kvdb *handle, int flags)
 {
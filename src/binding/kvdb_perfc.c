@@ -6,6 +6,7 @@
 #include <hse_util/platform.h>
 
 #include <hse_ikvdb/c0sk_perfc.h>
+#include <hse_ikvdb/kvdb_perfc.h>
 
 /*
  * The NE() macro string-izes the enum.
@@ -79,6 +80,10 @@ NE_CHECK(kvdb_perfc_pkvdbl_op, PERFC_EN_PKVDBL, "kvdb_perfc_pkvdbl_op table/enum
 
 struct perfc_name c0_metrics_perfc[] = {
     NE(PERFC_BA_C0METRICS_KVMS_CNT, 2, "Instances of c0_kvmultiset", "c_kvmultiset"),
+    NE(PERFC_BA_C0METRICS_HUGE_CNT, 2, "c0_kvsets with a hugetlb arena", "c_kvset_huge"),
+    NE(PERFC_BA_C0METRICS_HUGE_FALLBACK, 2, "c0_kvset hugetlb fallbacks", "c_kvset_huge_fb"),
+    NE(PERFC_RA_C0METRICS_NUMA_LOCAL, 3, "c0_kvset updates from its numa node", "c_numa_local"),
+    NE(PERFC_RA_C0METRICS_NUMA_REMOTE, 3, "c0_kvset updates from remote nodes", "c_numa_remote"),
 };
 
 NE_CHECK(c0_metrics_perfc, PERFC_EN_C0METRICS, "c0_metrics_perfc table/enum mismatch");
@@ -90,10 +95,39 @@ struct perfc_name kvdb_metrics_perfc[] = {
     NE(PERFC_BA_KVDBMETRICS_CURHORIZON, 3, "Cursor kvdb horizon", "cur_horizon"),
     NE(PERFC_BA_KVDBMETRICS_HORIZON, 3, "Current kvdb horizon", "horizon"),
     NE(PERFC_DI_KVDBMETRICS_THROTTLE, 3, "Put/get/del throttle (ns)", "api_throttle", 10),
+    NE(PERFC_BA_KVDBMETRICS_MEMBUDGET, 2, "Memory budget in effect (MiB)", "mem_budget"),
+    NE(PERFC_BA_KVDBMETRICS_MEMC0, 2, "Memory used by c0 (MiB)", "mem_c0"),
+    NE(PERFC_BA_KVDBMETRICS_MEMCACHE, 2, "Memory used by kvs caches (MiB)", "mem_cache"),
+    NE(PERFC_BA_KVDBMETRICS_MEMPSI, 3, "Memory pressure (avg10 %, x100)", "mem_psi"),
 };
 
 NE_CHECK(kvdb_metrics_perfc, PERFC_EN_KVDBMETRICS, "kvdb_metrics_perfc table/enum mismatch");
 
+struct perfc_name kvdb_memacct_perfc[] = {
+    NE(PERFC_BA_MEMACCT_C0_LIVE, 2, "Bytes held by c0 kvsets", "c0_live"),
+    NE(PERFC_BA_MEMACCT_C0_HWM, 2, "Bytes held by c0 kvsets (high-water)", "c0_hwm"),
+    NE(PERFC_RA_MEMACCT_C0_ALLOC, 2, "Allocations by c0 kvsets", "c0_alloc(/s)"),
+    NE(PERFC_RA_MEMACCT_C0_FREE, 2, "Frees by c0 kvsets", "c0_free(/s)"),
+    NE(PERFC_BA_MEMACCT_CN_LIVE, 2, "Bytes held by cn kvsets", "cn_live"),
+    NE(PERFC_BA_MEMACCT_CN_HWM, 2, "Bytes held by cn kvsets (high-water)", "cn_hwm"),
+    NE(PERFC_RA_MEMACCT_CN_ALLOC, 2, "Allocations by cn kvsets", "cn_alloc(/s)"),
+    NE(PERFC_RA_MEMACCT_CN_FREE, 2, "Frees by cn kvsets", "cn_free(/s)"),
+    NE(PERFC_BA_MEMACCT_CURSOR_LIVE, 2, "Bytes held by kvs cursors", "cursor_live"),
+    NE(PERFC_BA_MEMACCT_CURSOR_HWM, 2, "Bytes held by kvs cursors (high-water)", "cursor_hwm"),
+    NE(PERFC_RA_MEMACCT_CURSOR_ALLOC, 2, "Allocations by kvs cursors", "cursor_alloc(/s)"),
+    NE(PERFC_RA_MEMACCT_CURSOR_FREE, 2, "Frees by kvs cursors", "cursor_free(/s)"),
+    NE(PERFC_BA_MEMACCT_TXN_LIVE, 2, "Bytes held by txn locks", "txn_live"),
+    NE(PERFC_BA_MEMACCT_TXN_HWM, 2, "Bytes held by txn locks (high-water)", "txn_hwm"),
+    NE(PERFC_RA_MEMACCT_TXN_ALLOC, 2, "Allocations by txn locks", "txn_alloc(/s)"),
+    NE(PERFC_RA_MEMACCT_TXN_FREE, 2, "Frees by txn locks", "txn_free(/s)"),
+    NE(PERFC_BA_MEMACCT_C1_LIVE, 2, "Bytes held by c1 kv caches", "c1_live"),
+    NE(PERFC_BA_MEMACCT_C1_HWM, 2, "Bytes held by c1 kv caches (high-water)", "c1_hwm"),
+    NE(PERFC_RA_MEMACCT_C1_ALLOC, 2, "Allocations by c1 kv caches", "c1_alloc(/s)"),
+    NE(PERFC_RA_MEMACCT_C1_FREE, 2, "Frees by c1 kv caches", "c1_free(/s)"),
+};
+
+NE_CHECK(kvdb_memacct_perfc, PERFC_EN_MEMACCT, "kvdb_memacct_perfc table/enum mismatch");
+
 struct perfc_name csched_sp3_perfc[] = {
     NE(PERFC_BA_SP3_SAMP, 2, "spaceamp", "c_samp"),
     NE(PERFC_BA_SP3_REDUCE, 2, "reduce flag", "c_reduce"),
@@ -137,6 +171,22 @@ kvdb_perfc_init(void)
     }
 }
 
+void
+kvdb_memacct_update(void)
+{
+    static u64 hwmv[KVDB_MEMACCT_MAX];
+    uint       i;
+
+    for (i = 0; i < KVDB_MEMACCT_MAX; ++i) {
+        u64 live = perfc_read(&kvdb_memacct_pc, KVDB_MEMACCT_CIDX(i, PERFC_BA_MEMACCT_C0_LIVE));
+
+        if (live > hwmv[i]) {
+            hwmv[i] = live;
+            perfc_set(&kvdb_memacct_pc, KVDB_MEMACCT_CIDX(i, PERFC_BA_MEMACCT_C0_HWM), live);
+        }
+    }
+}
+
 void
 kvdb_perfc_fini(void)
 {
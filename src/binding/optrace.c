@@ -0,0 +1,476 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/atomic.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/hash.h>
+#include <hse_util/list.h>
+#include <hse_util/logging.h>
+#include <hse_util/mutex.h>
+#include <hse_util/rcu.h>
+#include <hse_util/time.h>
+#include <hse_util/timing.h>
+#include <hse_util/workqueue.h>
+
+#include <hse_ikvdb/optrace.h>
+
+#include <fcntl.h>
+
+/* Max number of idle buffers kept for reuse. */
+#define OPTRACE_BUF_FREE_MAX (8)
+
+/**
+ * struct optrace_buf - a buffer of records
+ * @ob_work: write of the buffer by the writer thread
+ * @ob_link: link on optrace_bufl or optrace_freel
+ * @ob_len:  length of the records in @ob_data
+ * @ob_size: size of @ob_data
+ * @ob_data: the records
+ *
+ * Each thread appends its records to a buffer of its own, without a lock.
+ * A buffer that fills is handed to the writer thread (optrace_wq) and the
+ * thread takes another, so optrace_lock is taken once every OPTRACE_BUFSZ
+ * bytes of a thread's records and nobody but the writer waits on write(2).
+ * The buffers owned by threads are on optrace_bufl, optrace_stop() waits
+ * for an rcu grace period and then writes them out.  The records of each
+ * thread are thus in order in the trace, those of different threads are
+ * interleaved by buffer.
+ */
+struct optrace_buf {
+    struct work_struct ob_work;
+    struct list_head   ob_link;
+    size_t             ob_len;
+    size_t             ob_size;
+    char               ob_data[];
+};
+
+/* optrace_lock protects all of the state below but optrace_enabled, which
+ * is read without it to keep capture off the hot path when not tracing,
+ * and the state that appenders read under rcu once the trace is started
+ * (optrace_gen, optrace_keys, optrace_t0, optrace_kvsv and optrace_kvsc).
+ */
+static DEFINE_MUTEX(optrace_lock);
+
+bool optrace_enabled;
+
+static struct hse_kvdb *        optrace_kvdb;
+static bool                     optrace_stopping;
+static int                      optrace_fd = -1;
+static merr_t                   optrace_err;
+static struct workqueue_struct *optrace_wq;
+static struct list_head         optrace_bufl;
+static struct list_head         optrace_freel;
+static uint                     optrace_freec;
+static atomic64_t               optrace_gen;
+static bool                     optrace_keys;
+static u64                      optrace_t0;
+static struct hse_kvs *         optrace_kvsv[OPTRACE_KVS_MAX];
+static atomic_t                 optrace_kvsc;
+static atomic_t                 optrace_threads;
+
+static __thread u16                 optrace_thread;
+static __thread struct optrace_buf *optrace_tbuf;
+static __thread u64                 optrace_tgen;
+
+static merr_t
+optrace_write(const void *buf, size_t len)
+{
+    ssize_t cc;
+
+    while (len > 0) {
+        cc = write(optrace_fd, buf, len);
+        if (cc == -1) {
+            if (errno == EINTR)
+                continue;
+
+            return merr(errno);
+        }
+
+        buf += cc;
+        len -= cc;
+    }
+
+    return 0;
+}
+
+/* Return a buffer the writer is done with to the free list.
+ */
+static void
+optrace_buf_put(struct optrace_buf *ob)
+{
+    mutex_lock(&optrace_lock);
+    if (ob->ob_size == OPTRACE_BUFSZ && optrace_freec < OPTRACE_BUF_FREE_MAX) {
+        list_add(&ob->ob_link, &optrace_freel);
+        optrace_freec++;
+        ob = NULL;
+    }
+    mutex_unlock(&optrace_lock);
+
+    free(ob);
+}
+
+/* Write out a buffer, in the writer thread.  On error, tracing stops and
+ * the trace is left as written so far.
+ */
+static void
+optrace_buf_write(struct work_struct *work)
+{
+    struct optrace_buf *ob = container_of(work, struct optrace_buf, ob_work);
+    merr_t              err;
+
+    if (ob->ob_len > 0 && !optrace_err) {
+        err = optrace_write(ob->ob_data, ob->ob_len);
+        if (ev(err)) {
+            hse_elog(HSE_ERR "optrace: cannot write trace: @@e, tracing stopped", err);
+
+            mutex_lock(&optrace_lock);
+            optrace_err = err;
+            optrace_enabled = false;
+            mutex_unlock(&optrace_lock);
+        }
+    }
+
+    optrace_buf_put(ob);
+}
+
+/* Hand a buffer to the writer.  Caller holds optrace_lock.
+ */
+static void
+optrace_buf_queue(struct optrace_buf *ob)
+{
+    list_del(&ob->ob_link);
+    queue_work(optrace_wq, &ob->ob_work);
+}
+
+/* Hand the calling thread's buffer @full (if any) to the writer and give
+ * the thread a new buffer for the trace of generation @gen.  Caller is in
+ * an rcu read-side critical section.
+ */
+static struct optrace_buf *
+optrace_buf_next(struct optrace_buf *full, u64 gen)
+{
+    struct optrace_buf *ob = NULL;
+
+    mutex_lock(&optrace_lock);
+    if (!optrace_enabled || atomic64_read(&optrace_gen) != gen)
+        goto out;
+
+    if (full)
+        optrace_buf_queue(full);
+
+    if (!list_empty(&optrace_freel)) {
+        ob = list_first_entry(&optrace_freel, typeof(*ob), ob_link);
+        list_del(&ob->ob_link);
+        optrace_freec--;
+    } else {
+        ob = malloc(sizeof(*ob) + OPTRACE_BUFSZ);
+        if (ev(!ob))
+            goto out;
+
+        ob->ob_size = OPTRACE_BUFSZ;
+    }
+
+    INIT_WORK(&ob->ob_work, optrace_buf_write);
+    ob->ob_len = 0;
+    list_add_tail(&ob->ob_link, &optrace_bufl);
+
+out:
+    mutex_unlock(&optrace_lock);
+
+    optrace_tbuf = ob;
+    optrace_tgen = gen;
+
+    return ob;
+}
+
+merr_t
+optrace_start(struct hse_kvdb *kvdb, const char *path, bool keys)
+{
+    struct optrace_hdr hdr;
+    struct timespec    ts;
+    merr_t             err;
+
+    mutex_lock(&optrace_lock);
+
+    if (optrace_kvdb) {
+        mutex_unlock(&optrace_lock);
+        hse_log(HSE_WARNING "optrace: another kvdb is being traced, not tracing to %s", path);
+        return merr(ev(EBUSY));
+    }
+
+    optrace_wq = alloc_workqueue("optrace", 0, 1);
+    if (ev(!optrace_wq)) {
+        mutex_unlock(&optrace_lock);
+        return merr(ENOMEM);
+    }
+
+    optrace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (optrace_fd == -1) {
+        err = merr(errno);
+        goto errout;
+    }
+
+    get_realtime(&ts);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.oh_magic = OPTRACE_MAGIC;
+    hdr.oh_version = OPTRACE_VERSION;
+    hdr.oh_flags = keys ? OPTRACE_F_KEYS : 0;
+    hdr.oh_recsz = sizeof(struct optrace_rec);
+    hdr.oh_start = (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+
+    err = optrace_write(&hdr, sizeof(hdr));
+    if (err) {
+        close(optrace_fd);
+        optrace_fd = -1;
+        goto errout;
+    }
+
+    optrace_kvdb = kvdb;
+    optrace_keys = keys;
+    optrace_t0 = get_time_ns();
+    optrace_err = 0;
+    INIT_LIST_HEAD(&optrace_bufl);
+    INIT_LIST_HEAD(&optrace_freel);
+    optrace_freec = 0;
+    atomic_set(&optrace_kvsc, 0);
+
+    /* A new generation invalidates the buffers threads kept from the
+     * previous trace.
+     */
+    atomic64_inc_rel(&optrace_gen);
+    optrace_enabled = true;
+
+    mutex_unlock(&optrace_lock);
+
+    hse_log(HSE_NOTICE "optrace: tracing to %s", path);
+
+    return 0;
+
+errout:
+    destroy_workqueue(optrace_wq);
+    optrace_wq = NULL;
+    mutex_unlock(&optrace_lock);
+
+    hse_elog(HSE_ERR "optrace: cannot create trace %s: @@e", err, path);
+
+    return err;
+}
+
+void
+optrace_stop(struct hse_kvdb *kvdb)
+{
+    struct optrace_buf *ob, *next;
+
+    mutex_lock(&optrace_lock);
+    if (optrace_kvdb != kvdb || optrace_stopping) {
+        mutex_unlock(&optrace_lock);
+        return;
+    }
+
+    optrace_stopping = true;
+    optrace_enabled = false;
+    atomic64_inc_rel(&optrace_gen);
+    mutex_unlock(&optrace_lock);
+
+    /* Once the threads appending to their buffers are done, the buffers
+     * are ours to write out.
+     */
+    synchronize_rcu();
+
+    mutex_lock(&optrace_lock);
+    list_for_each_entry_safe (ob, next, &optrace_bufl, ob_link)
+        optrace_buf_queue(ob);
+    mutex_unlock(&optrace_lock);
+
+    /* Waits for the writer to finish. */
+    destroy_workqueue(optrace_wq);
+    optrace_wq = NULL;
+
+    mutex_lock(&optrace_lock);
+    list_for_each_entry_safe (ob, next, &optrace_freel, ob_link)
+        free(ob);
+
+    close(optrace_fd);
+    optrace_fd = -1;
+
+    optrace_kvdb = NULL;
+    optrace_stopping = false;
+    mutex_unlock(&optrace_lock);
+}
+
+/* Copy a record, and its key if @key is not NULL, to @buf.
+ */
+static void
+optrace_rec_copy(char *buf, const struct optrace_rec *rec, size_t len, const void *key)
+{
+    memcpy(buf, rec, sizeof(*rec));
+    if (key) {
+        memset(buf + len - 8, 0, 8);
+        memcpy(buf + sizeof(*rec), key, rec->or_klen);
+    }
+}
+
+/* Append a record, and its key if @key is not NULL, to the buffer of the
+ * calling thread.  Caller is in an rcu read-side critical section, and
+ * read @gen in it.
+ */
+static void
+optrace_append(struct optrace_rec *rec, const void *key, u64 gen)
+{
+    struct optrace_buf *ob;
+    size_t              len;
+
+    if (key)
+        rec->or_flags |= OPTRACE_RF_KEY;
+
+    len = optrace_rec_len(rec);
+
+    ob = (optrace_tgen == gen) ? optrace_tbuf : NULL;
+    if (!ob || ob->ob_len + len > ob->ob_size) {
+        ob = optrace_buf_next(ob, gen);
+        if (!ob)
+            return;
+    }
+
+    optrace_rec_copy(ob->ob_data + ob->ob_len, rec, len, key);
+    ob->ob_len += len;
+}
+
+static void
+optrace_rec_init(struct optrace_rec *rec, enum optrace_op op)
+{
+    memset(rec, 0, sizeof(*rec));
+
+    if (unlikely(!optrace_thread))
+        optrace_thread = 1 + (atomic_inc_return(&optrace_threads) - 1) % U16_MAX;
+
+    rec->or_op = op;
+    rec->or_thread = optrace_thread;
+}
+
+void
+optrace_kvs_open(struct hse_kvdb *kvdb, struct hse_kvs *kvs, const char *name)
+{
+    struct optrace_rec  rec;
+    struct optrace_buf *ob;
+    size_t              len;
+    uint                i, kvsc;
+
+    optrace_rec_init(&rec, OPTRACE_OP_KVS_OPEN);
+    rec.or_klen = strlen(name);
+    rec.or_hash = hse_hash64(name, rec.or_klen);
+    rec.or_flags = OPTRACE_RF_KEY;
+
+    /* A kvs open is written in a buffer of its own, handed to the writer
+     * before the kvs can be looked up, so that it precedes the records of
+     * every thread on the kvs.
+     */
+    len = optrace_rec_len(&rec);
+
+    ob = malloc(sizeof(*ob) + len);
+    if (ev(!ob))
+        return;
+
+    INIT_LIST_HEAD(&ob->ob_link);
+    INIT_WORK(&ob->ob_work, optrace_buf_write);
+    ob->ob_len = ob->ob_size = len;
+
+    rcu_read_lock();
+    mutex_lock(&optrace_lock);
+    kvsc = atomic_read(&optrace_kvsc);
+
+    if (optrace_enabled && kvdb == optrace_kvdb && kvsc < OPTRACE_KVS_MAX) {
+        /* The handle of a closed kvs may be reused by this open. */
+        for (i = 0; i < kvsc; i++)
+            if (optrace_kvsv[i] == kvs)
+                optrace_kvsv[i] = NULL;
+
+        /* The records of this thread precede the open. */
+        if (optrace_tgen == atomic64_read(&optrace_gen) && optrace_tbuf &&
+            optrace_tbuf->ob_len > 0) {
+            optrace_buf_queue(optrace_tbuf);
+            optrace_tbuf = NULL;
+        }
+
+        rec.or_kvs = kvsc;
+        rec.or_time = get_time_ns() - optrace_t0;
+
+        optrace_rec_copy(ob->ob_data, &rec, len, name);
+        queue_work(optrace_wq, &ob->ob_work);
+        ob = NULL;
+
+        optrace_kvsv[kvsc] = kvs;
+        atomic_set_rel(&optrace_kvsc, kvsc + 1);
+    }
+    mutex_unlock(&optrace_lock);
+    rcu_read_unlock();
+
+    free(ob);
+}
+
+void
+optrace_kvs_op(
+    enum optrace_op      op,
+    struct hse_kvs *     kvs,
+    struct hse_kvdb_txn *txn,
+    const void *         key,
+    size_t               klen,
+    size_t               vlen,
+    uint                 flags)
+{
+    struct optrace_rec rec;
+    uint               i, kvsc;
+    u64                gen;
+
+    optrace_rec_init(&rec, op);
+    rec.or_hash = hse_hash64(key, klen);
+    rec.or_txn = (uintptr_t)txn;
+    rec.or_vlen = vlen;
+    rec.or_klen = klen;
+    rec.or_flags = flags;
+
+    rcu_read_lock();
+    gen = atomic64_read_acq(&optrace_gen);
+    if (!optrace_enabled)
+        goto out;
+
+    /* A kvdb has a handful of kvses, a linear search is cheap. */
+    kvsc = atomic_read_acq(&optrace_kvsc);
+    for (i = 0; i < kvsc; i++)
+        if (optrace_kvsv[i] == kvs)
+            break;
+
+    if (i < kvsc) {
+        rec.or_kvs = i;
+        rec.or_time = get_time_ns() - optrace_t0;
+
+        optrace_append(&rec, optrace_keys ? key : NULL, gen);
+    }
+
+out:
+    rcu_read_unlock();
+}
+
+void
+optrace_txn_op(enum optrace_op op, struct hse_kvdb *kvdb, struct hse_kvdb_txn *txn)
+{
+    struct optrace_rec rec;
+    u64                gen;
+
+    optrace_rec_init(&rec, op);
+    rec.or_txn = (uintptr_t)txn;
+
+    rcu_read_lock();
+    gen = atomic64_read_acq(&optrace_gen);
+    if (optrace_enabled && kvdb == optrace_kvdb) {
+        rec.or_time = get_time_ns() - optrace_t0;
+
+        optrace_append(&rec, NULL, gen);
+    }
+    rcu_read_unlock();
+}
@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/hash.h>
+
+#include <hse_ikvdb/optrace.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+static char path[64];
+static char buf[4096];
+
+/* Fake handles, optrace never dereferences them. */
+static struct hse_kvdb *    kvdb = (void *)0x1000;
+static struct hse_kvs *     kvs = (void *)0x2000;
+static struct hse_kvdb_txn *txn = (void *)0x3000;
+
+static int
+test_collection_setup(struct mtf_test_info *info)
+{
+    int fd;
+
+    snprintf(path, sizeof(path), "/tmp/optrace_test.XXXXXX");
+
+    fd = mkstemp(path);
+    if (fd == -1)
+        return -1;
+
+    close(fd);
+
+    return 0;
+}
+
+static int
+test_collection_teardown(struct mtf_test_info *info)
+{
+    unlink(path);
+
+    return 0;
+}
+
+/* Read the trace into buf, return its length. */
+static ssize_t
+trace_read(void)
+{
+    ssize_t cc;
+    int     fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    cc = read(fd, buf, sizeof(buf));
+    close(fd);
+
+    return cc;
+}
+
+/* Read the whole trace into a buffer the caller frees. */
+static char *
+trace_load(size_t *lenp)
+{
+    struct stat st;
+    char *      data;
+    ssize_t     cc;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    data = NULL;
+    if (!fstat(fd, &st))
+        data = malloc(st.st_size);
+
+    cc = data ? read(fd, data, st.st_size) : -1;
+    close(fd);
+
+    if (cc != (data ? st.st_size : -1)) {
+        free(data);
+        return NULL;
+    }
+
+    *lenp = cc;
+
+    return data;
+}
+
+#define THREADS_MAX  (4)
+#define THREAD_RECS  (3 * OPTRACE_BUFSZ / sizeof(struct optrace_rec))
+
+/* Put THREAD_RECS keys, the value length of each is its sequence number. */
+static void *
+thread_puts(void *arg)
+{
+    uint i;
+
+    for (i = 0; i < THREAD_RECS; i++)
+        optrace_kvs_op(OPTRACE_OP_PUT, kvs, NULL, &i, sizeof(i), i, 0);
+
+    return NULL;
+}
+
+MTF_BEGIN_UTEST_COLLECTION_PREPOST(optrace, test_collection_setup, test_collection_teardown)
+
+MTF_DEFINE_UTEST(optrace, capture)
+{
+    const struct optrace_hdr *hdr = (void *)buf;
+    const struct optrace_rec *rec;
+    const char *              key = "key01";
+    ssize_t                   len;
+    size_t                    off;
+    merr_t                    err;
+
+    err = optrace_start(kvdb, path, false);
+    ASSERT_EQ(0, err);
+    ASSERT_TRUE(optrace_enabled);
+
+    /* Only one kvdb is traced at a time. */
+    err = optrace_start((void *)0x1001, path, false);
+    ASSERT_EQ(EBUSY, merr_errno(err));
+
+    optrace_kvs_open(kvdb, kvs, "kvs0");
+    optrace_txn_op(OPTRACE_OP_TXN_BEGIN, kvdb, txn);
+    optrace_kvs_op(OPTRACE_OP_PUT, kvs, txn, key, 5, 100, 0);
+    optrace_txn_op(OPTRACE_OP_TXN_COMMIT, kvdb, txn);
+    optrace_kvs_op(OPTRACE_OP_GET, kvs, NULL, key, 5, 100, OPTRACE_RF_FOUND);
+
+    /* Operations on kvses opened before the trace started, or of other
+     * kvdbs, are not traced.
+     */
+    optrace_kvs_op(OPTRACE_OP_DEL, (void *)0x2001, NULL, key, 5, 0, 0);
+    optrace_kvs_open((void *)0x1001, (void *)0x2002, "kvs1");
+
+    /* Stopping another kvdb leaves the trace running. */
+    optrace_stop((void *)0x1001);
+    ASSERT_TRUE(optrace_enabled);
+
+    optrace_stop(kvdb);
+    ASSERT_FALSE(optrace_enabled);
+
+    len = trace_read();
+    ASSERT_EQ(sizeof(*hdr) + 5 * sizeof(*rec) + 8, len);
+
+    ASSERT_EQ(OPTRACE_MAGIC, hdr->oh_magic);
+    ASSERT_EQ(OPTRACE_VERSION, hdr->oh_version);
+    ASSERT_EQ(0, hdr->oh_flags);
+    ASSERT_EQ(sizeof(*rec), hdr->oh_recsz);
+
+    /* The kvs open is followed by the kvs name. */
+    off = sizeof(*hdr);
+    rec = (void *)(buf + off);
+    ASSERT_EQ(OPTRACE_OP_KVS_OPEN, rec->or_op);
+    ASSERT_EQ(0, rec->or_kvs);
+    ASSERT_EQ(4, rec->or_klen);
+    ASSERT_EQ(OPTRACE_RF_KEY, rec->or_flags);
+    ASSERT_EQ(0, memcmp(rec + 1, "kvs0", 4));
+    ASSERT_NE(0, rec->or_thread);
+    off += optrace_rec_len(rec);
+
+    rec = (void *)(buf + off);
+    ASSERT_EQ(OPTRACE_OP_TXN_BEGIN, rec->or_op);
+    ASSERT_EQ((uintptr_t)txn, rec->or_txn);
+    off += optrace_rec_len(rec);
+
+    rec = (void *)(buf + off);
+    ASSERT_EQ(OPTRACE_OP_PUT, rec->or_op);
+    ASSERT_EQ((uintptr_t)txn, rec->or_txn);
+    ASSERT_EQ(hse_hash64(key, 5), rec->or_hash);
+    ASSERT_EQ(5, rec->or_klen);
+    ASSERT_EQ(100, rec->or_vlen);
+    ASSERT_EQ(0, rec->or_flags);
+    ASSERT_EQ(sizeof(*rec), optrace_rec_len(rec));
+    off += optrace_rec_len(rec);
+
+    rec = (void *)(buf + off);
+    ASSERT_EQ(OPTRACE_OP_TXN_COMMIT, rec->or_op);
+    off += optrace_rec_len(rec);
+
+    rec = (void *)(buf + off);
+    ASSERT_EQ(OPTRACE_OP_GET, rec->or_op);
+    ASSERT_EQ(0, rec->or_txn);
+    ASSERT_EQ(OPTRACE_RF_FOUND, rec->or_flags);
+    ASSERT_GE(rec->or_time, ((struct optrace_rec *)(buf + sizeof(*hdr)))->or_time);
+}
+
+MTF_DEFINE_UTEST(optrace, keys)
+{
+    const struct optrace_hdr *hdr = (void *)buf;
+    const struct optrace_rec *rec;
+    const char *              key = "a-key-of-11";
+    ssize_t                   len;
+    merr_t                    err;
+
+    err = optrace_start(kvdb, path, true);
+    ASSERT_EQ(0, err);
+
+    optrace_kvs_open(kvdb, kvs, "kvs0");
+    optrace_kvs_op(OPTRACE_OP_PFX_DEL, kvs, NULL, key, 11, 0, 0);
+
+    /* A new kvs with the handle of a closed one gets an index of its own. */
+    optrace_kvs_open(kvdb, kvs, "kvs1");
+    optrace_kvs_op(OPTRACE_OP_DEL, kvs, NULL, key, 3, 0, 0);
+
+    optrace_stop(kvdb);
+
+    len = trace_read();
+    ASSERT_EQ(sizeof(*hdr) + 4 * sizeof(*rec) + 3 * 8 + 16, len);
+    ASSERT_EQ(OPTRACE_F_KEYS, hdr->oh_flags);
+
+    rec = (void *)(buf + sizeof(*hdr) + sizeof(*rec) + 8);
+    ASSERT_EQ(OPTRACE_OP_PFX_DEL, rec->or_op);
+    ASSERT_EQ(OPTRACE_RF_KEY, rec->or_flags);
+    ASSERT_EQ(sizeof(*rec) + 16, optrace_rec_len(rec));
+    ASSERT_EQ(0, memcmp(rec + 1, key, 11));
+    ASSERT_EQ(0, ((char *)(rec + 1))[11]);
+
+    rec = (void *)((char *)rec + optrace_rec_len(rec) + sizeof(*rec) + 8);
+    ASSERT_EQ(OPTRACE_OP_DEL, rec->or_op);
+    ASSERT_EQ(1, rec->or_kvs);
+    ASSERT_EQ(0, memcmp(rec + 1, key, 3));
+}
+
+MTF_DEFINE_UTEST(optrace, threads)
+{
+    const struct optrace_rec *rec;
+    pthread_t                 tidv[THREADS_MAX];
+    u16                       threadv[THREADS_MAX];
+    u32                       nextv[THREADS_MAX];
+    size_t                    len, off;
+    char *                    data;
+    merr_t                    err;
+    int                       i, j, rc;
+
+    err = optrace_start(kvdb, path, false);
+    ASSERT_EQ(0, err);
+
+    optrace_kvs_open(kvdb, kvs, "kvs0");
+
+    for (i = 0; i < THREADS_MAX; i++) {
+        rc = pthread_create(tidv + i, NULL, thread_puts, NULL);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < THREADS_MAX; i++)
+        pthread_join(tidv[i], NULL);
+
+    optrace_stop(kvdb);
+
+    data = trace_load(&len);
+    ASSERT_NE(NULL, data);
+    ASSERT_EQ(sizeof(struct optrace_hdr) + (1 + THREADS_MAX * THREAD_RECS) * sizeof(*rec) + 8, len);
+
+    /* Each buffer-full of records is written whole, the records of each
+     * thread are all there and in the order they were issued.
+     */
+    memset(threadv, 0, sizeof(threadv));
+    memset(nextv, 0, sizeof(nextv));
+
+    off = sizeof(struct optrace_hdr);
+    rec = (void *)(data + off);
+    ASSERT_EQ(OPTRACE_OP_KVS_OPEN, rec->or_op);
+    off += optrace_rec_len(rec);
+
+    for (; off < len; off += optrace_rec_len(rec)) {
+        rec = (void *)(data + off);
+        ASSERT_EQ(OPTRACE_OP_PUT, rec->or_op);
+
+        for (j = 0; j < THREADS_MAX; j++) {
+            if (!threadv[j])
+                threadv[j] = rec->or_thread;
+            if (threadv[j] == rec->or_thread)
+                break;
+        }
+
+        ASSERT_LT(j, THREADS_MAX);
+        ASSERT_EQ(nextv[j], rec->or_vlen);
+        nextv[j]++;
+    }
+
+    for (j = 0; j < THREADS_MAX; j++)
+        ASSERT_EQ(THREAD_RECS, nextv[j]);
+
+    free(data);
+}
+
+MTF_DEFINE_UTEST(optrace, bad_path)
+{
+    merr_t err;
+
+    err = optrace_start(kvdb, "/nonexistent/dir/trace", false);
+    ASSERT_EQ(ENOENT, merr_errno(err));
+    ASSERT_FALSE(optrace_enabled);
+
+    /* A failed start leaves the tracer free for the next. */
+    err = optrace_start(kvdb, path, false);
+    ASSERT_EQ(0, err);
+
+    optrace_stop(kvdb);
+}
+
+MTF_END_UTEST_COLLECTION(optrace)
@@ -50,6 +50,7 @@ struct c0_impl {
     struct c0sk *       c0_c0sk;
     u32                 c0_index;
     s32                 c0_pfx_len;
+    u32                 c0_sfx_len;
     u64                 c0_hash;
     struct cn *         c0_cn;
     struct kvs_rparams *c0_rp; /* not owned by c0 */
@@ -111,6 +112,15 @@ c0_prefix_del(struct c0 *handle, struct kvs_ktuple *kt, u64 seqno)
     return c0sk_prefix_del(self->c0_c0sk, self->c0_index, kt, seqno);
 }
 
+merr_t
+c0_fold(struct c0 *handle, const struct kvs_ktuple *kt, const struct kvs_vtuple *oper, kvs_merge_fn *fn)
+{
+    struct c0_impl *self = c0_h2r(handle);
+
+    assert(self->c0_index < HSE_KVS_COUNT_MAX);
+    return c0sk_fold(self->c0_c0sk, self->c0_index, self->c0_pfx_len, kt, oper, fn);
+}
+
 /*
  * Tombstone indicated by:
  *     return value == 0 && res == FOUND_TOMB
@@ -162,6 +172,39 @@ c0_pfx_probe(
         vbuf);
 }
 
+merr_t
+c0_pfx_probe_batch(
+    struct c0 *              handle,
+    const struct kvs_ktuple *ktv,
+    u64                      view_seqno,
+    uintptr_t                seqnoref,
+    enum key_lookup_res *    resv,
+    struct query_ctx *       qctxv,
+    struct kvs_buf *         kbufv,
+    struct kvs_buf *         vbufv,
+    const u32 *              lookupv,
+    u32                      lookupc)
+{
+    struct c0_impl *self;
+
+    self = c0_h2r(handle);
+
+    assert(self->c0_index < HSE_KVS_COUNT_MAX);
+    return c0sk_pfx_probe_batch(
+        self->c0_c0sk,
+        self->c0_index,
+        self->c0_pfx_len,
+        ktv,
+        view_seqno,
+        seqnoref,
+        resv,
+        qctxv,
+        kbufv,
+        vbufv,
+        lookupv,
+        lookupc);
+}
+
 merr_t
 c0_open(
     struct ikvdb *      kvdb,
@@ -184,6 +227,7 @@ c0_open(
 
     assert(cn);
     new_c0->c0_pfx_len = cp->cp_pfx_len;
+    new_c0->c0_sfx_len = cp->cp_sfx_len;
     new_c0->c0_cn = cn;
     new_c0->c0_rp = rp;
 
@@ -221,7 +265,9 @@ c0_close(struct c0 *handle)
 
     self = c0_h2r(handle);
 
-    tmp_err = c0_sync(handle);
+    /* A checkpointed c0 is already in c1 and is not ingested.
+     */
+    tmp_err = c0sk_checkpointed(self->c0_c0sk) ? 0 : c0_sync(handle);
 
     if (ev(tmp_err))
         err = tmp_err;
@@ -379,6 +425,14 @@ c0_hash_get(struct c0 *handle)
     return self->c0_hash;
 }
 
+u32
+c0_get_sfx_len(struct c0 *handle)
+{
+    struct c0_impl *self = c0_h2r(handle);
+
+    return self->c0_sfx_len;
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "c0_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -16,6 +16,7 @@
 #include <hse_ikvdb/c0_kvmultiset.h>
 #include <hse_ikvdb/c0_kvset_iterator.h>
 #include <hse_ikvdb/sched_sts.h>
+#include <hse_ikvdb/c0sk.h>
 
 /**
  * struct c0_ingest_work - description of ingest work to be performed
@@ -33,7 +34,9 @@
  * @c0iw_tenqueued:
  * @c0iw_coalescec:
  * @c0iw_tingesting:    time of most recent call to c0kvms_ingesting()
+ * @c0iw_tfinalized:    time at which the kvms was finalized
  * @c0iw_usage:         finalized usage metrics
+ * @c0iw_ev:            ingest event filled in by c0sk_ingest_worker()
  *
  * [HSE_REVISIT]
  */
@@ -60,6 +63,9 @@ struct c0_ingest_work {
     struct c0_usage c0iw_usage;
     u64             c0iw_tenqueued;
     u64             c0iw_tingesting;
+    u64             c0iw_tfinalized;
+
+    struct c0sk_ingest_event c0iw_ev;
 
     /* Debug stats produced by c0_ingest_worker().
      */
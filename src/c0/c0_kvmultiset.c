@@ -11,6 +11,7 @@
 #include <hse_util/perfc.h>
 #include <hse_util/fmt.h>
 #include <hse_util/rcu.h>
+#include <hse_util/log2.h>
 
 #include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/c0_kvmultiset.h>
@@ -37,6 +38,7 @@
  * @c0ms_ingesting:     kvms is being ingested (no longer active)
  * @c0ms_ingested:
  * @c0ms_finalized:     kvms guaranteed to be frozen (no more updates)
+ * @c0ms_frozen:        all c0kvsets reject updates (see c0kvms_freeze())
  * @c0ms_txn_thresh_lo:
  * @c0ms_txn_thresh_hi:
  * @c0ms_ingest_work:   data used to orchestrate c0+cn ingest
@@ -54,6 +56,8 @@
  * @c0ms_mutating:      used if c0ms_ingesting > 0
  * @c0ms_mut_tracked:   mutations tracked or not
  * @c0ms_mut_sz:        mutation size (in bytes)
+ * @c0ms_filter:        negative-lookup filter of the keys in the kvms
+ * @c0ms_filter_mask:   number of words in %c0ms_filter minus one
  * @c0ms_num_sets:      the number of c0 kvsets
  * @c0ms_resetsz:       size used by fully set up c0kvms
  * @c0ms_sets:          vector of c0 kvset pointers
@@ -68,6 +72,7 @@ struct c0_kvmultiset_impl {
     __aligned(SMP_CACHE_BYTES) atomic_t c0ms_ingesting;
     bool                     c0ms_ingested;
     bool                     c0ms_finalized;
+    bool                     c0ms_frozen;
     bool                     c0ms_mutating;
     bool                     c0ms_mut_tracked;
     size_t                   c0ms_txn_thresh_lo;
@@ -95,6 +100,8 @@ struct c0_kvmultiset_impl {
 
     __aligned(SMP_CACHE_BYTES) u32 c0ms_num_sets;
     u32              c0ms_resetsz;
+    u64 *            c0ms_filter;
+    u32              c0ms_filter_mask;
     struct c0_kvset *c0ms_sets[HSE_C0_INGEST_WIDTH_MAX];
 };
 
@@ -131,6 +138,49 @@ c0kvms_get_hashed_c0kvset(struct c0_kvmultiset *handle, u64 hash)
     return self->c0ms_sets[set_idx];
 }
 
+bool
+c0kvms_may_contain(struct c0_kvmultiset *handle, u64 hash)
+{
+    struct c0_kvmultiset_impl *self = c0_kvmultiset_h2r(handle);
+    u64                        bits, word;
+
+    if (!self->c0ms_filter)
+        return true;
+
+    bits = c0kvs_filter_bits(hash);
+    word = __atomic_load_n(self->c0ms_filter + ((hash >> 32) & self->c0ms_filter_mask),
+                           __ATOMIC_ACQUIRE);
+
+    return (word & bits) == bits;
+}
+
+struct c0_kvset *
+c0kvms_get_affine_c0kvset(struct c0_kvmultiset *handle)
+{
+    struct c0_kvmultiset_impl *self = c0_kvmultiset_h2r(handle);
+    u32                        set_idx, n, i;
+    int                        node;
+
+    /* skip ptomb c0kvset - c0ms_sets[0] */
+    n = self->c0ms_num_sets - 1;
+    set_idx = raw_smp_processor_id() % n;
+
+    /* In numa mode prefer the nearest c0kvset homed on the caller's node.
+     */
+    if (c0kvs_node(self->c0ms_sets[1 + set_idx]) >= 0) {
+        node = raw_smp_processor_node();
+
+        for (i = 0; i < n; ++i) {
+            if (c0kvs_node(self->c0ms_sets[1 + (set_idx + i) % n]) == node) {
+                set_idx = (set_idx + i) % n;
+                break;
+            }
+        }
+    }
+
+    return self->c0ms_sets[1 + set_idx];
+}
+
 struct c0_kvset *
 c0kvms_get_c0kvset(struct c0_kvmultiset *handle, u32 index)
 {
@@ -153,6 +203,27 @@ c0kvms_finalize(struct c0_kvmultiset *handle, struct workqueue_struct *wq)
         c0kvs_finalize(self->c0ms_sets[i]);
 
     self->c0ms_wq = wq;
+    self->c0ms_ingest_work->c0iw_tfinalized = get_time_ns();
+}
+
+void
+c0kvms_freeze(struct c0_kvmultiset *handle)
+{
+    struct c0_kvmultiset_impl *self = c0_kvmultiset_h2r(handle);
+    int                        i;
+
+    for (i = 0; i < self->c0ms_num_sets; ++i)
+        c0kvs_freeze(self->c0ms_sets[i]);
+
+    self->c0ms_frozen = true;
+}
+
+bool
+c0kvms_is_frozen(struct c0_kvmultiset *handle)
+{
+    struct c0_kvmultiset_impl *self = c0_kvmultiset_h2r(handle);
+
+    return self->c0ms_frozen;
 }
 
 bool
@@ -868,7 +939,7 @@ c0kvms_create(
     struct c0_kvmultiset_impl *kvms;
     merr_t                     err;
     size_t                     kvms_sz, sz;
-    size_t                     priv_sz, iw_sz;
+    size_t                     priv_sz, iw_sz, filter_sz;
     int                        i;
     u32                        max_sets;
 
@@ -923,9 +994,16 @@ c0kvms_create(
     priv_sz = sizeof(*kvms->c0ms_priv_base) * HSE_C0KVMS_PRIV_MAX;
     iw_sz = sizeof(*kvms->c0ms_ingest_work);
 
+    /* The negative-lookup filter gets one bit for every 32 bytes of
+     * the kvms, which is roughly eight bits per key for small values.
+     */
+    filter_sz = roundup_pow_of_two(((num_sets - 1) * alloc_sz) / 256);
+    filter_sz = clamp_t(size_t, filter_sz, PAGE_SIZE, HSE_C0KVMS_FILTER_MAX);
+
     sz = HSE_C0_CHEAP_SZ_MIN * 2 + priv_sz + iw_sz;
     if (sz < alloc_sz)
         sz = alloc_sz;
+    sz += filter_sz;
 
     for (i = 0; i < num_sets; ++i) {
         err = c0kvs_create(sz, kvdb_seq, &kvms->c0ms_seqno, tracked, &kvms->c0ms_sets[i]);
@@ -966,6 +1044,18 @@ c0kvms_create(
         goto errout;
     }
 
+    /* Allocate the filter from the ptomb c0kvset, should the allocation
+     * fail the kvms works without it.
+     */
+    kvms->c0ms_filter = c0kvs_alloc(kvms->c0ms_sets[0], SMP_CACHE_BYTES, filter_sz);
+    if (kvms->c0ms_filter) {
+        memset(kvms->c0ms_filter, 0, filter_sz);
+        kvms->c0ms_filter_mask = filter_sz / sizeof(*kvms->c0ms_filter) - 1;
+
+        for (i = 1; i < kvms->c0ms_num_sets; ++i)
+            c0kvs_filter_init(kvms->c0ms_sets[i], kvms->c0ms_filter, kvms->c0ms_filter_mask);
+    }
+
     /* Remember the size of the ptomb c0kvs for c0kvs_reset().
      */
     kvms->c0ms_resetsz = c0kvs_used(kvms->c0ms_sets[0]);
@@ -1038,6 +1128,7 @@ c0kvms_reset(struct c0_kvmultiset *handle)
     atomic_set(&self->c0ms_priv_cur, 0);
 
     self->c0ms_finalized = false;
+    self->c0ms_frozen = false;
     self->c0ms_ingested = false;
     self->c0ms_mutating = true;
 
@@ -1048,9 +1139,14 @@ c0kvms_reset(struct c0_kvmultiset *handle)
 
         c0kvs_reset(c0kvs, resetsz);
         c0kvs_ingesting_init(c0kvs, &self->c0ms_ingesting);
+        if (i > 0 && self->c0ms_filter)
+            c0kvs_filter_init(c0kvs, self->c0ms_filter, self->c0ms_filter_mask);
         resetsz = 0;
     }
 
+    if (self->c0ms_filter)
+        memset(self->c0ms_filter, 0, (self->c0ms_filter_mask + 1) * sizeof(*self->c0ms_filter));
+
     c0_ingest_work_reset(self->c0ms_ingest_work);
 }
 
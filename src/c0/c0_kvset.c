@@ -9,8 +9,10 @@
 #include <hse_ikvdb/limits.h>
 #include <hse_util/log2.h>
 #include <hse_util/fmt.h>
+#include <hse_util/perfc.h>
 #include <hse_ikvdb/c0_kvset.h>
 #include <hse_ikvdb/c0_kvset_iterator.h>
+#include <hse_ikvdb/kvdb_perfc.h>
 
 #include "c0_kvset_internal.h"
 #include "c0_cursor.h"
@@ -64,27 +66,78 @@ struct c0kvs_ccache {
 
 static struct c0kvs_ccache c0kvs_ccache;
 static atomic_t            c0kvs_init_ref;
+static enum bonsai_index   c0kvs_index;
+static uint                c0kvs_cheap_flags;
+static uint                c0kvs_numa_nodes;
+static atomic_t            c0kvs_numa_next;
 
 #define C0KVS_CBKT_MAX NELEM(c0kvs_ccache.cc_bktv)
 
+/* Non-txn puts copy values of up to C0KVS_STAGE_MAX bytes into a private
+ * per-thread reservation of C0KVS_STAGE_CHUNK bytes carved from the c0kvs
+ * cheap, such that the copy requires neither c0s_mutex nor a trip through
+ * the cheap allocator.  Larger values are staged directly into the cheap.
+ * Either way, the value copy is performed before c0s_mutex is acquired,
+ * leaving only the tree update itself within the critical section.
+ */
+#define C0KVS_STAGE_CHUNK (8 * 1024)
+#define C0KVS_STAGE_MAX (C0KVS_STAGE_CHUNK / 4)
+#define C0KVS_STAGE_SLOTS (64)
+
+/**
+ * struct c0kvs_stage - a thread's value staging reservation
+ * @cs_gen:  generation of the c0kvs from which the reservation was carved
+ * @cs_cur:  next free byte in the reservation
+ * @cs_end:  end of the reservation
+ *
+ * Each thread keeps one reservation for each of the kvsets it recently
+ * put to, indexed by the kvset's generation.  Generations are unique
+ * and renewed on reset, so a reservation in a kvset that was since
+ * ingested and recycled can never be mistaken for a current one.
+ */
+struct c0kvs_stage {
+    u64   cs_gen;
+    char *cs_cur;
+    char *cs_end;
+};
+
+static __thread struct c0kvs_stage c0kvs_stagev[C0KVS_STAGE_SLOTS];
+static atomic64_t                  c0kvs_gen;
+
+/* A cached c0kvset retains at most its arena or HSE_C0_CCACHE_TRIMSZ bytes
+ * of resident memory, whichever is larger.
+ */
+static inline size_t
+c0kvs_ccache_sz(struct c0_kvset_impl *set)
+{
+    return max_t(size_t, HSE_C0_CCACHE_TRIMSZ, set->c0s_cheap->arena);
+}
+
+/* In numa mode the cache is bucketed by numa node rather than by cpu,
+ * and only c0kvsets homed on the requested node may be reused.
+ */
 static struct c0_kvset_impl *
-c0kvs_ccache_alloc(size_t sz)
+c0kvs_ccache_alloc(size_t sz, int node)
 {
-    struct c0_kvset_impl *set = NULL;
+    struct c0_kvset_impl *set = NULL, **pp;
     struct c0kvs_cbkt *   bkt;
     uint                  idx;
     int                   i;
 
-    idx = raw_smp_processor_id() / 4;
+    idx = (node < 0) ? raw_smp_processor_id() / 4 : node;
 
     for (i = 0; i < C0KVS_CBKT_MAX + 1; ++i, ++idx) {
         bkt = c0kvs_ccache.cc_bktv + (idx % C0KVS_CBKT_MAX);
 
         spin_lock(&bkt->cb_lock);
-        set = bkt->cb_head;
+        for (pp = &bkt->cb_head; (set = *pp); pp = &set->c0s_next) {
+            if (set->c0s_node == node)
+                break;
+        }
+
         if (set) {
-            bkt->cb_size -= HSE_C0_CCACHE_TRIMSZ;
-            bkt->cb_head = set->c0s_next;
+            bkt->cb_size -= c0kvs_ccache_sz(set);
+            *pp = set->c0s_next;
 
             set->c0s_alloc_sz = sz;
         }
@@ -107,14 +160,14 @@ c0kvs_ccache_free(struct c0_kvset_impl *set)
     c0kvs_reset(&set->c0s_handle, 0);
     cheap_trim(set->c0s_cheap, HSE_C0_CCACHE_TRIMSZ);
 
-    idx = raw_smp_processor_id() / 4;
+    idx = (set->c0s_node < 0) ? raw_smp_processor_id() / 4 : set->c0s_node;
 
     for (i = 0; i < C0KVS_CBKT_MAX + 1; ++i, ++idx) {
         bkt = c0kvs_ccache.cc_bktv + (idx % C0KVS_CBKT_MAX);
 
         spin_lock(&bkt->cb_lock);
-        if (bkt->cb_size + HSE_C0_CCACHE_TRIMSZ < bkt->cb_max) {
-            bkt->cb_size += HSE_C0_CCACHE_TRIMSZ;
+        if (bkt->cb_size + c0kvs_ccache_sz(set) < bkt->cb_max) {
+            bkt->cb_size += c0kvs_ccache_sz(set);
             set->c0s_next = bkt->cb_head;
             bkt->cb_head = set;
             set = NULL;
@@ -661,20 +714,37 @@ c0kvs_create(
     struct c0_kvset_impl *set;
     struct cheap *        cheap;
     merr_t                err;
+    uint                  flags;
+    int                   node;
 
     *handlep = NULL;
 
     alloc_sz = max_t(size_t, alloc_sz, HSE_C0_CHEAP_SZ_MIN);
     alloc_sz = min_t(size_t, alloc_sz, HSE_C0_CHEAP_SZ_MAX);
 
-    set = c0kvs_ccache_alloc(alloc_sz);
+    /* In numa mode new c0kvsets are homed round-robin on all nodes,
+     * such that the c0kvsets of each kvms are spread evenly.
+     */
+    node = -1;
+    flags = c0kvs_cheap_flags;
+    if (c0kvs_numa_nodes > 1) {
+        node = atomic_inc_return(&c0kvs_numa_next) % c0kvs_numa_nodes;
+        flags |= CHEAP_F_NODEID(node);
+    }
+
+    set = c0kvs_ccache_alloc(alloc_sz, node);
     if (set)
         goto created;
 
-    cheap = cheap_create(sizeof(void *) * 2, HSE_C0_CHEAP_SZ_MAX);
+    cheap = cheap_create_ext(sizeof(void *) * 2, HSE_C0_CHEAP_SZ_MAX, alloc_sz, flags);
     if (ev(!cheap))
         return merr(ENOMEM);
 
+    if (cheap_hugetlb(cheap))
+        perfc_inc(&c0_metrics_pc, PERFC_BA_C0METRICS_HUGE_CNT);
+    else if (c0kvs_cheap_flags & (CHEAP_F_HUGE2M | CHEAP_F_HUGE1G))
+        perfc_inc(&c0_metrics_pc, PERFC_BA_C0METRICS_HUGE_FALLBACK);
+
     set = cheap_memalign(cheap, __alignof(*set), sizeof(*set));
     if (ev(!set)) {
         cheap_destroy(cheap);
@@ -683,6 +753,7 @@ c0kvs_create(
 
     set->c0s_alloc_sz = alloc_sz;
     set->c0s_cheap = cheap;
+    set->c0s_node = node;
     set->c0s_ingesting = &c0kvs_ingesting;
     atomic_set(&set->c0s_finalized, 0);
     mutex_init(&set->c0s_mutex);
@@ -697,10 +768,20 @@ c0kvs_create(
     set->c0s_reset_sz = cheap_used(cheap);
 
 created:
+    bn_set_index(set->c0s_broot, c0kvs_index);
+
+    set->c0s_frozen = false;
+    set->c0s_filter = NULL;
+    set->c0s_filter_mask = 0;
+
+    set->c0s_gen = atomic64_inc_return(&c0kvs_gen);
+
     set->c0s_kvdb_seqno = kvdb_seqno;
     set->c0s_kvms_seqno = kvms_seqno;
     set->c0s_mut_tracked = tracked;
 
+    kvdb_memacct_alloc(KVDB_MEMACCT_C0, set->c0s_alloc_sz);
+
     *handlep = &set->c0s_handle;
 
     c0kvsm_init(*handlep);
@@ -714,6 +795,9 @@ c0kvs_destroy_impl(struct c0_kvset_impl *set)
     mutex_destroy(&set->c0s_mutex);
     mutex_destroy(&set->c0s_mlock);
 
+    if (cheap_hugetlb(set->c0s_cheap))
+        perfc_dec(&c0_metrics_pc, PERFC_BA_C0METRICS_HUGE_CNT);
+
     cheap_destroy(set->c0s_cheap);
 }
 
@@ -727,6 +811,8 @@ c0kvs_destroy(struct c0_kvset *handle)
 
     set = c0_kvset_h2r(handle);
 
+    kvdb_memacct_free(KVDB_MEMACCT_C0, set->c0s_alloc_sz);
+
     c0kvs_ccache_free(set);
 }
 
@@ -763,8 +849,13 @@ c0kvs_reset(struct c0_kvset *handle, size_t sz)
 
     bn_reset(set->c0s_broot);
 
+    set->c0s_gen = atomic64_inc_return(&c0kvs_gen);
+
     atomic_set(&set->c0s_finalized, 0);
+    set->c0s_frozen = false;
     set->c0s_ingesting = &c0kvs_ingesting;
+    set->c0s_filter = NULL;
+    set->c0s_filter_mask = 0;
     set->c0s_num_entries = 0;
     set->c0s_num_tombstones = 0;
     set->c0s_total_key_bytes = 0;
@@ -782,6 +873,35 @@ c0kvs_ingesting_init(struct c0_kvset *handle, atomic_t *ingesting)
     self->c0s_ingesting = ingesting;
 }
 
+void
+c0kvs_filter_init(struct c0_kvset *handle, u64 *filter, u32 mask)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+
+    self->c0s_filter = filter;
+    self->c0s_filter_mask = mask;
+}
+
+/* Add a key hash to the kvms filter.  The bits are set before the key
+ * is inserted so that a reader never sees the key without its bits,
+ * and are left set if the insert fails (a false positive is harmless).
+ * The load avoids dirtying the cache line if the bits are already set.
+ */
+static __always_inline void
+c0kvs_filter_add(struct c0_kvset_impl *self, u64 hash)
+{
+    u64 *word, bits;
+
+    if (!self->c0s_filter)
+        return;
+
+    word = self->c0s_filter + ((hash >> 32) & self->c0s_filter_mask);
+    bits = c0kvs_filter_bits(hash);
+
+    if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bits) != bits)
+        __atomic_fetch_or(word, bits, __ATOMIC_RELEASE);
+}
+
 static __always_inline void
 c0kvs_lock(struct c0_kvset_impl *self)
 {
@@ -807,6 +927,61 @@ c0kvs_alloc(struct c0_kvset *handle, size_t align, size_t sz)
     return mem;
 }
 
+/* Obtain memory in which to stage a value of sz bytes.  The caller must be
+ * within the RCU read-side critical section that protects the c0kvs from
+ * being finalized.  Returns NULL if the c0kvs is too full to stage into,
+ * in which case the caller should let the tree update copy the value.
+ */
+static void *
+c0kvs_stage_alloc(struct c0_kvset_impl *self, size_t sz)
+{
+    struct c0kvs_stage *stage;
+    void *              mem;
+
+    sz = ALIGN(sz, sizeof(void *) * 2);
+
+    if (c0kvs_avail(&self->c0s_handle) < sz + C0KVS_STAGE_CHUNK + PAGE_SIZE)
+        return NULL;
+
+    if (sz > C0KVS_STAGE_MAX)
+        return c0kvs_alloc(&self->c0s_handle, sizeof(void *) * 2, sz);
+
+    stage = c0kvs_stagev + (self->c0s_gen % C0KVS_STAGE_SLOTS);
+
+    if (stage->cs_gen != self->c0s_gen || stage->cs_cur + sz > stage->cs_end) {
+        mem = c0kvs_alloc(&self->c0s_handle, sizeof(void *) * 2, C0KVS_STAGE_CHUNK);
+        if (ev(!mem))
+            return NULL;
+
+        stage->cs_gen = self->c0s_gen;
+        stage->cs_cur = mem;
+        stage->cs_end = stage->cs_cur + C0KVS_STAGE_CHUNK;
+    }
+
+    mem = stage->cs_cur;
+    stage->cs_cur += sz;
+
+    return mem;
+}
+
+/* Account an update of a c0kvset homed on a numa node as local or
+ * remote w.r.t. the calling cpu.
+ */
+static __always_inline void
+c0kvs_numa_account(struct c0_kvset_impl *self)
+{
+    uint node;
+
+    if (likely(self->c0s_node < 0))
+        return;
+
+    node = raw_smp_processor_node();
+
+    perfc_inc(
+        &c0_metrics_pc,
+        (node == self->c0s_node) ? PERFC_RA_C0METRICS_NUMA_LOCAL : PERFC_RA_C0METRICS_NUMA_REMOTE);
+}
+
 static merr_t
 c0kvs_putdel(
     struct c0_kvset_impl *self,
@@ -820,10 +995,17 @@ c0kvs_putdel(
 
     sz += HSE_C0_BNODE_SLAB_SZ + PAGE_SIZE;
 
+    c0kvs_numa_account(self);
+
     c0kvs_lock(self);
     avail = c0kvs_avail(&self->c0s_handle);
 
-    if (likely(sz < avail))
+    /* A c0kvset frozen by c0kvs_freeze() rejects the update with
+     * ENOMEM, which sends the caller to retry in the new active kvms.
+     */
+    if (unlikely(self->c0s_frozen))
+        err = merr(ENOMEM);
+    else if (likely(sz < avail))
         err = bn_insert_or_replace(self->c0s_broot, skey, sval, tomb);
     else
         err = (sz > self->c0s_alloc_sz) ? merr(EFBIG) : merr(ENOMEM);
@@ -833,9 +1015,10 @@ c0kvs_putdel(
      * RCU read lock.  As such, a c0kvset undergoing ingest will
      * be finalized (i.e., frozen) the end of the grace period,
      * after which c0 ingest may proceed.  It is a grievous error
-     * for a caller to insert a new key into a frozen c0kvset.
+     * for a caller to insert a new key into a finalized c0kvset
+     * that was not first frozen via c0kvs_freeze().
      */
-    assert(atomic_read(&self->c0s_finalized) == 0);
+    assert(self->c0s_frozen || atomic_read(&self->c0s_finalized) == 0);
 
     return err;
 }
@@ -851,11 +1034,29 @@ c0kvs_put(
     struct c0_kvset_impl *self = c0_kvset_h2r(handle);
     struct bonsai_skey    skey;
     struct bonsai_sval    sval;
+    size_t                sz;
 
     bn_skey_init(key->kt_data, key->kt_len, skidx, &skey);
     bn_sval_init(value->vt_data, value->vt_len, seqnoref, &sval);
 
-    return c0kvs_putdel(self, &skey, &sval, key->kt_len + value->vt_len, false);
+    sz = key->kt_len + value->vt_len;
+
+    c0kvs_filter_add(self, key->kt_hash);
+
+    /* Stage the value copy of non-txn puts outside of c0s_mutex.
+     * Should the put fail the staged memory is simply abandoned,
+     * as is any cheap allocation.
+     */
+    if (HSE_SQNREF_ORDNL_P(seqnoref) && value->vt_len > 0) {
+        void *mem = c0kvs_stage_alloc(self, bn_val_stage_sz(value->vt_len));
+
+        if (mem) {
+            bn_val_stage(mem, &sval);
+            sz = key->kt_len;
+        }
+    }
+
+    return c0kvs_putdel(self, &skey, &sval, sz, false);
 }
 
 merr_t
@@ -868,9 +1069,191 @@ c0kvs_del(struct c0_kvset *handle, u16 skidx, const struct kvs_ktuple *key, uint
     bn_skey_init(key->kt_data, key->kt_len, skidx, &skey);
     bn_sval_init(HSE_CORE_TOMB_REG, 0, seqnoref, &sval);
 
+    c0kvs_filter_add(self, key->kt_hash);
+
     return c0kvs_putdel(self, &skey, &sval, key->kt_len, true);
 }
 
+merr_t
+c0kvs_fold(
+    struct c0_kvset *             handle,
+    u16                           skidx,
+    const struct kvs_ktuple *     key,
+    const struct kvs_vtuple *     oper,
+    const struct c0kvs_fold_base *base,
+    kvs_merge_fn *                fn,
+    struct kvs_buf *              rbuf,
+    uintptr_t                     seqnoref)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+    struct bonsai_val *   val = NULL;
+    struct bonsai_skey    skey;
+    struct bonsai_sval    sval;
+    struct bonsai_kv *    kv;
+    const void *          bdata;
+    size_t                blen, rlen;
+    u64                   seq;
+    merr_t                err;
+
+    bn_skey_init(key->kt_data, key->kt_len, skidx, &skey);
+
+    c0kvs_numa_account(self);
+    c0kvs_filter_add(self, key->kt_hash);
+
+    c0kvs_lock(self);
+
+    /* See c0kvs_putdel() regarding frozen c0kvsets.
+     */
+    if (unlikely(self->c0s_frozen)) {
+        err = merr(ENOMEM);
+        goto unlock;
+    }
+
+    /* Values of active txns are not visible, the fold lands behind
+     * them just as a put would.
+     */
+    if (bn_find(self->c0s_broot, &skey, &kv))
+        val = c0kvs_findval(handle, kv, U64_MAX, 0);
+
+    if (val && seqnoref_to_seqno(val->bv_seqnoref, &seq) == HSE_SQNREF_STATE_DEFINED &&
+        (!base->fb_valid || seq >= base->fb_seq)) {
+        bdata = HSE_CORE_IS_TOMB(val->bv_valuep) ? NULL : val->bv_value;
+        blen = bdata ? val->bv_vlen : 0;
+    } else if (base->fb_valid) {
+        bdata = base->fb_data;
+        blen = base->fb_len;
+    } else {
+        err = merr(ENOENT);
+        goto unlock;
+    }
+
+    rlen = 0;
+    err = fn(key->kt_data, key->kt_len, bdata, blen, oper->vt_data, oper->vt_len,
+             rbuf->b_buf, rbuf->b_buf_sz, &rlen);
+    if (err)
+        goto unlock;
+
+    if (ev(rlen > HSE_KVS_VLEN_MAX)) {
+        err = merr(EMSGSIZE);
+        goto unlock;
+    }
+
+    if (rlen > rbuf->b_buf_sz) {
+        rbuf->b_len = rlen;
+        err = merr(EOVERFLOW);
+        goto unlock;
+    }
+
+    rbuf->b_len = rlen;
+    bn_sval_init(rbuf->b_buf, rlen, seqnoref, &sval);
+
+    rlen += key->kt_len + HSE_C0_BNODE_SLAB_SZ + PAGE_SIZE;
+
+    if (likely(rlen < c0kvs_avail(handle)))
+        err = bn_insert_or_replace(self->c0s_broot, &skey, &sval, false);
+    else
+        err = (rlen > self->c0s_alloc_sz) ? merr(EFBIG) : merr(ENOMEM);
+
+unlock:
+    c0kvs_unlock(self);
+
+    assert(self->c0s_frozen || atomic_read(&self->c0s_finalized) == 0);
+
+    return err;
+}
+
+static inline size_t
+c0kvs_putdel_batch_opsz(const struct kvs_wbatch_op *op)
+{
+    return op->wbo_kt.kt_len + (op->wbo_tomb ? 0 : op->wbo_vt.vt_len) + HSE_C0_BNODE_SLAB_SZ;
+}
+
+u32
+c0kvs_putdel_batch_chunk(
+    struct c0_kvset *           handle,
+    const struct kvs_wbatch_op *opv,
+    const u32 *                 idxv,
+    u32                         idxc)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+    size_t                sz, max;
+    u32                   i;
+
+    max = self->c0s_alloc_sz / 4;
+
+    sz = c0kvs_putdel_batch_opsz(opv + idxv[0]);
+
+    for (i = 1; i < idxc; ++i) {
+        sz += c0kvs_putdel_batch_opsz(opv + idxv[i]);
+        if (sz > max)
+            break;
+    }
+
+    return i;
+}
+
+merr_t
+c0kvs_putdel_batch(
+    struct c0_kvset *           handle,
+    const struct kvs_wbatch_op *opv,
+    const u32 *                 idxv,
+    u32                         idxc,
+    uintptr_t                   seqnoref)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+    struct bonsai_skey    skey;
+    struct bonsai_sval    sval;
+    merr_t                err = 0;
+    size_t                sz;
+    u64                   avail;
+    u32                   i;
+
+    for (i = sz = 0; i < idxc; ++i)
+        sz += c0kvs_putdel_batch_opsz(opv + idxv[i]);
+
+    sz += PAGE_SIZE;
+
+    c0kvs_numa_account(self);
+
+    c0kvs_lock(self);
+    avail = c0kvs_avail(&self->c0s_handle);
+
+    if (unlikely(self->c0s_frozen)) {
+        err = merr(ENOMEM);
+        goto unlock;
+    }
+
+    if (unlikely(sz >= avail)) {
+        err = (sz > self->c0s_alloc_sz) ? merr(EFBIG) : merr(ENOMEM);
+        goto unlock;
+    }
+
+    for (i = 0; i < idxc; ++i) {
+        const struct kvs_wbatch_op *op = opv + idxv[i];
+
+        bn_skey_init(op->wbo_kt.kt_data, op->wbo_kt.kt_len, op->wbo_skidx, &skey);
+        c0kvs_filter_add(self, op->wbo_kt.kt_hash);
+
+        if (op->wbo_tomb)
+            bn_sval_init(HSE_CORE_TOMB_REG, 0, seqnoref, &sval);
+        else
+            bn_sval_init(op->wbo_vt.vt_data, op->wbo_vt.vt_len, seqnoref, &sval);
+
+        err = bn_insert_or_replace(self->c0s_broot, &skey, &sval, op->wbo_tomb);
+        if (ev(err))
+            break;
+    }
+
+unlock:
+    c0kvs_unlock(self);
+
+    /* See c0kvs_putdel() regarding frozen c0kvsets.
+     */
+    assert(self->c0s_frozen || atomic_read(&self->c0s_finalized) == 0);
+
+    return err;
+}
+
 merr_t
 c0kvs_prefix_del(
     struct c0_kvset *        handle,
@@ -1142,6 +1525,32 @@ c0kvs_prefix_get(
     rcu_read_unlock();
 }
 
+void
+c0kvs_freeze(struct c0_kvset *handle)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+
+    c0kvs_lock(self);
+    self->c0s_frozen = true;
+    c0kvs_unlock(self);
+}
+
+bool
+c0kvs_is_frozen(struct c0_kvset *handle)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+
+    return self->c0s_frozen;
+}
+
+int
+c0kvs_node(struct c0_kvset *handle)
+{
+    struct c0_kvset_impl *self = c0_kvset_h2r(handle);
+
+    return self->c0s_node;
+}
+
 void
 c0kvs_finalize(struct c0_kvset *handle)
 {
@@ -1203,7 +1612,7 @@ BullseyeCoverageSaveOff
 BullseyeCoverageRestore
 
     void
-    c0kvs_reinit(size_t cb_max)
+    c0kvs_reinit(size_t cb_max, uint index, uint hugepage, bool prefault, bool numa)
 {
     struct c0_kvset_impl *head, *next;
     struct c0kvs_cbkt *   bkt;
@@ -1212,6 +1621,22 @@ BullseyeCoverageRestore
     if (!c0kvs_ccache.cc_init)
         return;
 
+    /* Applies to c0kvsets created or reused from the cache hereafter.
+     */
+    c0kvs_index = index ? BN_INDEX_ART : BN_INDEX_BONSAI;
+
+    /* Applies to c0kvsets created hereafter, as the cache is drained below.
+     */
+    c0kvs_cheap_flags = 0;
+    if (hugepage == 1)
+        c0kvs_cheap_flags |= CHEAP_F_HUGE2M;
+    else if (hugepage == 2)
+        c0kvs_cheap_flags |= CHEAP_F_HUGE1G;
+    if (prefault)
+        c0kvs_cheap_flags |= CHEAP_F_PREFAULT | CHEAP_F_LOCAL;
+
+    c0kvs_numa_nodes = numa ? cheap_numa_nodes() : 0;
+
     cb_max = cb_max / C0KVS_CBKT_MAX;
 
     for (i = 0; i < C0KVS_CBKT_MAX; ++i) {
@@ -1256,7 +1681,7 @@ c0kvs_fini(void)
     if (atomic_dec_return(&c0kvs_init_ref) > 0)
         return;
 
-    c0kvs_reinit(0);
+    c0kvs_reinit(0, 0, 0, false, false);
 }
 
 bool
@@ -21,6 +21,10 @@
  * @c0s_finalized:         kvset is frozen and undergoing c0 ingest
  * @c0s_reset_sz:          size of cheap used by fully setup c0kkvs
  * @c0s_next:              cheap cache linkage
+ * @c0s_gen:               unique generation, renewed on each reset
+ * @c0s_node:              preferred numa node of the cheap (-1: none)
+ * @c0s_filter:            negative-lookup filter of the kvms (may be nil)
+ * @c0s_filter_mask:       number of words in %c0s_filter minus one
  * @c0s_kvdb_seqno:        pointer to kvdb seqno
  * @c0s_kvms_seqno:        pointer to kvms seqno
  * @c0s_total_key_bytes:   total # of key bytes
@@ -28,6 +32,7 @@
  * @c0s_num_entries:       how many entries (doesn't include tombstones)
  * @c0s_num_keys:          how many keys (includes tombstones)
  * @c0s_num_tombstones:    how many tombstones
+ * @c0s_frozen:            kvset no longer accepts updates (protected by c0s_mutex)
  * @c0s_mutex:             mutex for bonsai tree updates
  * @c0s_mlock:             lock protecting the mutation list
  * @c0s_m:                 pair of non-tx mutation list
@@ -54,6 +59,10 @@ struct c0_kvset_impl {
     atomic_t              c0s_finalized;
     u32                   c0s_reset_sz;
     struct c0_kvset_impl *c0s_next;
+    u64                   c0s_gen;
+    int                   c0s_node;
+    u64 *                 c0s_filter;
+    u32                   c0s_filter_mask;
 
     /* these apply only to non-txn operations. */
     atomic64_t *c0s_kvdb_seqno;
@@ -64,7 +73,7 @@ struct c0_kvset_impl {
     u32          c0s_num_entries;
     u32          c0s_num_keys;
     u32          c0s_num_tombstones;
-    u64          c0s_pad;
+    bool         c0s_frozen;
     struct mutex c0s_mutex;
 
     __aligned(SMP_CACHE_BYTES) struct mutex c0s_mlock;
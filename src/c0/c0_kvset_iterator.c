@@ -31,7 +31,7 @@ c0_kvset_iterator_next(struct element_source *source, void **element)
 
     bkv = iter->c0it_next;
 
-    if (bkv == &iter->c0it_root->br_kv ||
+    if (bkv == iter->c0it_end ||
         ((iter->c0it_flags & C0_KVSET_ITER_FLAG_INDEX) &&
          key_immediate_index(&bkv->bkv_key_imm) > iter->c0it_index)) {
         source->es_eof = true;
@@ -151,6 +151,7 @@ c0_kvset_iterator_init(
     int                       index)
 {
     iter->c0it_root = root;
+    iter->c0it_end = &root->br_kv;
     iter->c0it_flags = flags;
     iter->c0it_index = index;
 
@@ -165,6 +166,36 @@ c0_kvset_iterator_init(
     }
 }
 
+void
+c0_kvset_iterator_range(
+    struct c0_kvset_iterator *iter,
+    const struct bonsai_skey *lo,
+    const struct bonsai_skey *hi)
+{
+    struct bonsai_root *root = iter->c0it_root;
+    struct bonsai_kv *  kv;
+
+    assert(!(iter->c0it_flags & C0_KVSET_ITER_FLAG_REVERSE));
+
+    rcu_read_lock();
+
+    kv = root->br_kv.bkv_next;
+    if (lo && !bn_findGE(root, lo, &kv))
+        kv = &root->br_kv;
+
+    iter->c0it_next = kv;
+    iter->c0it_prev = kv->bkv_prev;
+
+    kv = &root->br_kv;
+    if (hi && !bn_findGE(root, hi, &kv))
+        kv = &root->br_kv;
+
+    iter->c0it_end = kv;
+    iter->c0it_handle.es_eof = false;
+
+    rcu_read_unlock();
+}
+
 void
 c0_kvset_iterator_seek(
     struct c0_kvset_iterator *iter,
@@ -252,6 +283,9 @@ c0_kvset_iterator_empty(struct c0_kvset_iterator *iter)
     if (next == &iter->c0it_root->br_kv)
         return true;
 
+    if (next == iter->c0it_end && !(iter->c0it_flags & C0_KVSET_ITER_FLAG_REVERSE))
+        return true;
+
     if (iter->c0it_flags & C0_KVSET_ITER_FLAG_INDEX) {
         int index = key_immediate_index(&next->bkv_key_imm);
 
@@ -18,6 +18,7 @@
 #include <hse_util/rcu.h>
 #include <hse_util/cds_list.h>
 #include <hse_util/bonsai_tree.h>
+#include <hse_util/usdt.h>
 
 #define MTF_MOCK_IMPL_c0sk
 
@@ -34,6 +35,7 @@
 #include <hse_ikvdb/cursor.h>
 #include <hse_ikvdb/kvdb_rparams.h>
 #include <hse_ikvdb/rparam_debug_flags.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include "c0sk_internal.h"
 #include "c0skm_internal.h"
@@ -250,10 +252,11 @@ c0sk_put(
     u64                      seqno)
 {
     struct c0sk_impl *self = c0sk_h2r(handle);
-    u64               start;
+    u64               start, usdt;
     merr_t            err;
 
     start = perfc_lat_startu(&self->c0sk_pc_op, PERFC_LT_C0SKOP_PUT);
+    usdt = HSE_USDT_START(c0sk_put);
 
     err = c0sk_putdel(self, skidx, C0SK_OP_PUT, kt, vt, seqno);
 
@@ -262,6 +265,9 @@ c0sk_put(
         perfc_inc(&self->c0sk_pc_op, PERFC_RA_C0SKOP_PUT);
     }
 
+    if (usdt)
+        HSE_USDT(c0sk_put, skidx, kt->kt_len, vt->vt_len, seqno, get_time_ns() - usdt);
+
     return err;
 }
 
@@ -284,6 +290,56 @@ c0sk_del(struct c0sk *handle, u16 skidx, const struct kvs_ktuple *kt, u64 seqno)
     return err;
 }
 
+merr_t
+c0sk_write_batch(struct c0sk *handle, const struct kvs_wbatch_op *opv, u32 opc, u64 seqno)
+{
+    struct c0sk_impl *self = c0sk_h2r(handle);
+    merr_t            err;
+    u32               ndel, i;
+
+    err = c0sk_putdel_batch(self, opv, opc, seqno);
+    if (ev(err))
+        return err;
+
+    for (i = ndel = 0; i < opc; ++i)
+        ndel += opv[i].wbo_tomb;
+
+    perfc_add(&self->c0sk_pc_op, PERFC_RA_C0SKOP_PUT, opc - ndel);
+    perfc_add(&self->c0sk_pc_op, PERFC_RA_C0SKOP_DEL, ndel);
+
+    return 0;
+}
+
+merr_t
+c0sk_write_batch_priv(
+    struct c0sk *               handle,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    struct c0_kvmultiset **     dstp,
+    uintptr_t **                privp)
+{
+    struct c0sk_impl *self;
+    merr_t            err;
+    u32               ndel, i;
+
+    if (ev(!handle || !dstp || !privp))
+        return merr(EINVAL);
+
+    self = c0sk_h2r(handle);
+
+    err = c0sk_putdel_batch_priv(self, opv, opc, dstp, privp);
+    if (err)
+        return err;
+
+    for (i = ndel = 0; i < opc; ++i)
+        ndel += opv[i].wbo_tomb;
+
+    perfc_add(&self->c0sk_pc_op, PERFC_RA_C0SKOP_PUT, opc - ndel);
+    perfc_add(&self->c0sk_pc_op, PERFC_RA_C0SKOP_DEL, ndel);
+
+    return 0;
+}
+
 merr_t
 c0sk_prefix_del(struct c0sk *handle, u16 skidx, const struct kvs_ktuple *kt, u64 seqno)
 {
@@ -292,6 +348,73 @@ c0sk_prefix_del(struct c0sk *handle, u16 skidx, const struct kvs_ktuple *kt, u64
     return c0sk_putdel(self, skidx, C0SK_OP_PREFIX_DEL, kt, NULL, seqno);
 }
 
+/* Order two values of a key found in different c0_kvsets of a kvms.
+ * Values without an ordinal are the caller's own and thus the newest.
+ */
+static inline bool
+c0sk_seqnoref_newer(uintptr_t ref, uintptr_t than)
+{
+    u64 seq, tseq;
+
+    if (seqnoref_to_seqno(ref, &seq) != HSE_SQNREF_STATE_DEFINED)
+        return true;
+    if (seqnoref_to_seqno(than, &tseq) != HSE_SQNREF_STATE_DEFINED)
+        return false;
+
+    return seq > tseq;
+}
+
+/* With c0_affinity a txn is merged into the c0_kvset of the committing
+ * cpu, so a kvms may hold values of a key in any of its c0_kvsets.  Probe
+ * them all and retrieve the newest visible value.
+ */
+static merr_t
+c0sk_get_affine(
+    struct c0_kvmultiset *   c0kvms,
+    u16                      skidx,
+    const struct kvs_ktuple *kt,
+    u64                      view_seq,
+    uintptr_t                seqref,
+    enum key_lookup_res *    res,
+    struct kvs_buf *         vbuf,
+    uintptr_t *              oseqref)
+{
+    struct kvs_buf      probe;
+    enum key_lookup_res pres;
+    uintptr_t           pref, best_ref = 0;
+    u32                 i, width, best = 0;
+    merr_t              err;
+
+    *res = NOT_FOUND;
+    *oseqref = HSE_ORDNL_TO_SQNREF(0);
+
+    kvs_buf_init(&probe, NULL, 0);
+    width = c0kvms_width(c0kvms);
+
+    /* skip ptomb c0kvset - c0ms_sets[0] */
+    for (i = 1; i < width; ++i) {
+        struct c0_kvset *c0kvs = c0kvms_get_c0kvset(c0kvms, i);
+
+        err = c0kvs_get(c0kvs, skidx, kt, view_seq, seqref, &pres, &probe, &pref);
+        if (ev(err))
+            return err;
+
+        if (pres == NOT_FOUND)
+            continue;
+
+        if (!best || c0sk_seqnoref_newer(pref, best_ref)) {
+            best = i;
+            best_ref = pref;
+        }
+    }
+
+    if (!best)
+        return 0;
+
+    return c0kvs_get(
+        c0kvms_get_c0kvset(c0kvms, best), skidx, kt, view_seq, seqref, res, vbuf, oseqref);
+}
+
 /*
  * Tombstone indicated by:
  *     return value == 0 && res == FOUND_TOMB
@@ -310,15 +433,21 @@ c0sk_get(
     struct c0_kvmultiset *c0kvms;
     struct c0sk_impl *    self;
     uintptr_t             key_seqref = 0, ptomb_seqref = 0;
-    u64                   start;
+    u64                   start, usdt;
     u64                   pfx_seq = 0, val_seq = 0;
     u64                   seq;
     merr_t                err = 0;
+    bool                  affine;
 
     self = c0sk_h2r(handle);
     *res = NOT_FOUND;
 
     start = perfc_lat_startl(&self->c0sk_pc_op, PERFC_LT_C0SKOP_GET);
+    usdt = HSE_USDT_START(c0sk_get);
+
+    /* Keys of a kvs with suffixes are always hashed by prefix.
+     */
+    affine = self->c0sk_kvdb_rp->c0_affinity && cn_get_sfx_len(self->c0sk_cnv[skidx]) == 0;
 
     /* Disable ptomb searching if the key has no prefix.
      */
@@ -332,6 +461,8 @@ c0sk_get(
     {
         struct c0_kvset *c0kvs;
 
+        KVS_TRACE_INC(kt_c0kvms);
+
         /* Search for ptomb if key is prefixed.
          * [HSE_REVISIT] Can we skip this search when (pfx_seq > 0) ???
          */
@@ -344,9 +475,21 @@ c0sk_get(
                 pfx_seq = seq;
         }
 
+        /* Skip the key search if the kvms filter rules out the key,
+         * ptombs are not in the filter and were searched above.
+         */
+        if (!c0kvms_may_contain(c0kvms, kt->kt_hash)) {
+            KVS_TRACE_INC(kt_c0_neg);
+            continue;
+        }
+
         /* Search for latest value of key w/ seqno <= iseqno. */
-        c0kvs = c0kvms_get_hashed_c0kvset(c0kvms, kt->kt_hash);
-        err = c0kvs_get(c0kvs, skidx, kt, view_seq, seqref, res, vbuf, &key_seqref);
+        if (affine) {
+            err = c0sk_get_affine(c0kvms, skidx, kt, view_seq, seqref, res, vbuf, &key_seqref);
+        } else {
+            c0kvs = c0kvms_get_hashed_c0kvset(c0kvms, kt->kt_hash);
+            err = c0kvs_get(c0kvs, skidx, kt, view_seq, seqref, res, vbuf, &key_seqref);
+        }
         if (ev(err))
             break;
 
@@ -367,6 +510,200 @@ c0sk_get(
         perfc_inc(&self->c0sk_pc_op, PERFC_RA_C0SKOP_GET);
     }
 
+    if (usdt)
+        HSE_USDT(c0sk_get, skidx, kt->kt_len, view_seq, *res, get_time_ns() - usdt);
+
+    return err;
+}
+
+#define C0SK_FOLD_STACK 256
+
+/* Replace the buffer of %buf with one of %len bytes, %stack is the
+ * initial on-stack buffer (which is not freed).
+ */
+static merr_t
+c0sk_fold_grow(struct kvs_buf *buf, void *stack, u32 len)
+{
+    if (buf->b_buf != stack)
+        free(buf->b_buf);
+
+    kvs_buf_init(buf, malloc(len), len);
+
+    return buf->b_buf ? 0 : merr(ENOMEM);
+}
+
+/* Look up the current value of a key for c0sk_fold(), the caller must
+ * have seen every kvms but the active one frozen.
+ */
+static merr_t
+c0sk_fold_base(
+    struct c0sk_impl *       self,
+    u16                      skidx,
+    u32                      pfx_len,
+    const struct kvs_ktuple *kt,
+    struct kvs_buf *         bbuf,
+    void *                   bstack,
+    struct c0kvs_fold_base * base)
+{
+    enum key_lookup_res res;
+    u64                 seq;
+    merr_t              err;
+
+    seq = atomic64_read(self->c0sk_kvdb_seq);
+
+    while (1) {
+        err = c0sk_get(&self->c0sk_handle, skidx, pfx_len, kt, seq, 0, &res, bbuf);
+        if (!err && res == NOT_FOUND)
+            err = cn_get(self->c0sk_cnv[skidx], (struct kvs_ktuple *)kt, seq, &res, bbuf);
+        if (ev(err))
+            return err;
+
+        if (res != FOUND_VAL || bbuf->b_len <= bbuf->b_buf_sz)
+            break;
+
+        err = c0sk_fold_grow(bbuf, bstack, bbuf->b_len);
+        if (ev(err))
+            return err;
+    }
+
+    base->fb_data = (res == FOUND_VAL) ? bbuf->b_buf : NULL;
+    base->fb_len = (res == FOUND_VAL) ? bbuf->b_len : 0;
+    base->fb_seq = seq;
+    base->fb_valid = true;
+
+    return 0;
+}
+
+merr_t
+c0sk_fold(
+    struct c0sk *            handle,
+    u16                      skidx,
+    u32                      pfx_len,
+    const struct kvs_ktuple *kt,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn)
+{
+    struct c0sk_impl *     self = c0sk_h2r(handle);
+    struct c0_kvmultiset * base_kvms = NULL;
+    struct c0kvs_fold_base base;
+    struct kvs_buf         rbuf, bbuf;
+    char                   rstack[C0SK_FOLD_STACK];
+    char                   bstack[C0SK_FOLD_STACK];
+    u64                    coalescesz, start = 0;
+    bool                   affine;
+    merr_t                 err;
+
+    coalescesz = self->c0sk_kvdb_rp->c0_coalesce_sz;
+
+    /* With c0_affinity committed txns may leave newer values of the key
+     * in any c0kvset of a kvms, so the base is always looked up.
+     */
+    affine = self->c0sk_kvdb_rp->c0_affinity && cn_get_sfx_len(self->c0sk_cnv[skidx]) == 0;
+
+    if (kt->kt_len < pfx_len)
+        pfx_len = 0;
+
+    kvs_buf_init(&rbuf, rstack, sizeof(rstack));
+    kvs_buf_init(&bbuf, bstack, sizeof(bstack));
+
+    while (1) {
+        struct c0_kvmultiset *dst, *kvms;
+        struct c0_kvset *     c0kvs;
+        uintptr_t             ptomb_seqref;
+
+        rcu_read_lock();
+        dst = c0sk_get_first_c0kvms(handle);
+        if (ev(!dst, HSE_WARNING)) {
+            rcu_read_unlock();
+            err = merr(EINVAL);
+            break;
+        }
+
+        /* A base looked up before the active kvms changed may miss
+         * puts that were still in flight to the old kvms.  Absent a
+         * base, a prefix tombstone in the active kvms hides all the
+         * older values of the key.
+         */
+        if (dst != base_kvms) {
+            memset(&base, 0, sizeof(base));
+
+            if (pfx_len > 0 && !affine) {
+                c0kvs = c0kvms_ptomb_c0kvset_get(dst);
+                c0kvs_prefix_get(
+                    c0kvs, skidx, kt, atomic64_read(self->c0sk_kvdb_seq), pfx_len, &ptomb_seqref);
+
+                base.fb_seq = HSE_SQNREF_TO_ORDNL(ptomb_seqref);
+                base.fb_valid = base.fb_seq > 0;
+            }
+        }
+
+        if (ev(c0kvms_should_ingest(dst, coalescesz))) {
+            err = merr(ENOMEM);
+        } else if (affine && !base.fb_valid) {
+            err = merr(ENOENT);
+        } else {
+            if (c0kvms_is_tracked(dst))
+                start = get_time_ns();
+
+            c0kvs = c0kvms_get_hashed_c0kvset(dst, kt->kt_hash);
+            err = c0kvs_fold(c0kvs, skidx, kt, oper, &base, fn, &rbuf, HSE_SQNREF_SINGLE);
+        }
+
+        /* The key is not in the active kvms.  Puts to the older kvmses
+         * are fenced by c0kvms_freeze(), which immediately follows the
+         * install of a new active kvms.
+         */
+        if (merr_errno(err) == ENOENT) {
+            cds_list_for_each_entry_rcu(kvms, &self->c0sk_kvmultisets, c0ms_link)
+            {
+                while (kvms != dst && !c0kvms_is_frozen(kvms))
+                    __builtin_ia32_pause();
+            }
+        }
+
+        if (merr_errno(err) == ENOMEM || merr_errno(err) == ENOENT)
+            c0kvms_getref(dst);
+
+        rcu_read_unlock();
+
+        if (merr_errno(err) == ENOMEM) {
+            c0sk_queue_ingest(self, dst, NULL);
+            c0kvms_putref(dst);
+            continue;
+        }
+
+        if (merr_errno(err) == ENOENT) {
+            if (base_kvms)
+                c0kvms_putref(base_kvms);
+            base_kvms = dst;
+
+            err = c0sk_fold_base(self, skidx, pfx_len, kt, &bbuf, bstack, &base);
+            if (ev(err))
+                break;
+            continue;
+        }
+
+        if (merr_errno(err) == EOVERFLOW) {
+            err = c0sk_fold_grow(&rbuf, rstack, rbuf.b_len);
+            if (ev(err))
+                break;
+            continue;
+        }
+
+        break;
+    }
+
+    if (base_kvms)
+        c0kvms_putref(base_kvms);
+
+    if (rbuf.b_buf != rstack)
+        free(rbuf.b_buf);
+    if (bbuf.b_buf != bstack)
+        free(bbuf.b_buf);
+
+    if (!err && start > 0)
+        c0skm_reqtime_set(&self->c0sk_handle, start);
+
     return err;
 }
 
@@ -429,6 +766,74 @@ c0sk_pfx_probe(
     return err;
 }
 
+merr_t
+c0sk_pfx_probe_batch(
+    struct c0sk *            handle,
+    u16                      skidx,
+    u32                      pfx_len,
+    const struct kvs_ktuple *ktv,
+    u64                      view_seq,
+    uintptr_t                seqref,
+    enum key_lookup_res *    resv,
+    struct query_ctx *       qctxv,
+    struct kvs_buf *         kbufv,
+    struct kvs_buf *         vbufv,
+    const u32 *              lookupv,
+    u32                      lookupc)
+{
+    struct c0_kvmultiset *c0kvms;
+    merr_t                err = 0;
+    u32                   pending, i;
+
+    for (i = 0; i < lookupc; ++i)
+        resv[lookupv[i]] = NOT_FOUND;
+
+    /* Probe each c0_kvmultiset for all the prefixes still pending before
+     * moving on to the next (older) one, with the same per-prefix stop
+     * conditions as c0sk_pfx_probe().
+     */
+    rcu_read_lock();
+    cds_list_for_each_entry_rcu(c0kvms, &c0sk_h2r(handle)->c0sk_kvmultisets, c0ms_link)
+    {
+        struct c0_kvset *ptkvs = pfx_len > 0 ? c0kvms_ptomb_c0kvset_get(c0kvms) : NULL;
+
+        for (i = pending = 0; i < lookupc; ++i) {
+            const struct kvs_ktuple *kt = ktv + lookupv[i];
+            u32                      k = lookupv[i];
+            uintptr_t                ptomb_seqref;
+            u64                      pfx_seq = 0;
+
+            if (resv[k] == FOUND_PTMB || qctxv[k].seen > 1)
+                continue;
+
+            if (ptkvs && kt->kt_len >= pfx_len) {
+                c0kvs_prefix_get(ptkvs, skidx, kt, view_seq, pfx_len, &ptomb_seqref);
+
+                pfx_seq = HSE_SQNREF_TO_ORDNL(ptomb_seqref);
+            }
+
+            err = c0kvms_pfx_probe(
+                c0kvms, skidx, kt, view_seq, seqref, resv + k, qctxv + k, kbufv + k, vbufv + k,
+                pfx_seq);
+            if (ev(err))
+                goto out;
+
+            if (pfx_seq)
+                resv[k] = FOUND_PTMB;
+            else if (qctxv[k].seen <= 1)
+                ++pending;
+        }
+
+        if (pending == 0)
+            break;
+    }
+
+out:
+    rcu_read_unlock();
+
+    return err;
+}
+
 /**
  * c0sk_calibrate - measure overhead of calling nanosleep()
  * @self:   ptr to c0sk
@@ -555,6 +960,8 @@ c0sk_open(
     INIT_LIST_HEAD(&c0sk->c0sk_rcu_pending);
     c0sk->c0sk_rcu_active = false;
 
+    spin_lock_init(&c0sk->c0sk_ievlock);
+
     atomic_set(&c0sk->c0sk_replaying, 0);
 
     err = c0sk_initialize_concurrency_control(c0sk);
@@ -574,6 +981,23 @@ c0sk_open(
         goto errout;
     }
 
+    workqueue_set_cpus(c0sk->c0sk_wq_ingest, kvdb_rp->c0_cpus);
+
+    /* Each ingest thread runs the first of its ingest streams itself and
+     * hands the others off to the istream workqueue.
+     */
+    if (kvdb_rp->c0_ingest_streams > 1) {
+        tdmax *= min_t(u64, kvdb_rp->c0_ingest_streams, HSE_C0_INGEST_STREAMS_MAX) - 1;
+
+        c0sk->c0sk_wq_istream = alloc_workqueue("c0sk_istream", 0, tdmax);
+        if (!c0sk->c0sk_wq_istream) {
+            err = merr(ev(ENOMEM));
+            goto errout;
+        }
+
+        workqueue_set_cpus(c0sk->c0sk_wq_istream, kvdb_rp->c0_cpus);
+    }
+
     tdmax = min_t(u64, kvdb_rp->c0_maint_threads, HSE_C0_MAINT_THREADS_MAX);
     tdmax = max_t(int, tdmax, 1);
 
@@ -583,10 +1007,14 @@ c0sk_open(
         goto errout;
     }
 
+    workqueue_set_cpus(c0sk->c0sk_wq_maint, kvdb_rp->c0_cpus);
+
     c0sk->c0sk_ingest_width_max = HSE_C0_INGEST_WIDTH_MAX - 18;
     if (kvdb_rp->c0_ingest_width == 0)
         c0sk->c0sk_ingest_width = c0sk->c0sk_ingest_width_max / 2;
 
+    c0sk->c0sk_tune_ns = get_time_ns();
+
     err = c0kvms_create(
         c0sk->c0sk_ingest_width,
         kvdb_rp->c0_heap_sz,
@@ -616,6 +1044,8 @@ errout:
 
         if (c0sk) {
             destroy_workqueue(c0sk->c0sk_wq_ingest);
+            if (c0sk->c0sk_wq_istream)
+                destroy_workqueue(c0sk->c0sk_wq_istream);
             destroy_workqueue(c0sk->c0sk_wq_maint);
             c0sk_free_concurrency_control(c0sk);
             free_aligned(c0sk);
@@ -638,11 +1068,24 @@ c0sk_close(struct c0sk *handle)
     self->c0sk_cheap_sz = 0;
     self->c0sk_closing = true;
 
-    c0sk_sync(handle);
+    if (!self->c0sk_checkpoint)
+        c0sk_sync(handle);
     c0skm_close(handle);
 
-    /* There should be only one (empty) kvms on the list after
-     * calling c0sk_sync() and waiting for ingest to complete.
+    /* A checkpointed c0 is in c1, so the active kvms is dropped rather
+     * than ingested.  Kvms already frozen are still ingested, wait for
+     * them to be released.
+     */
+    if (self->c0sk_checkpoint) {
+        mutex_lock(&self->c0sk_kvms_mutex);
+        while (self->c0sk_kvmultisets_cnt > 1)
+            cv_timedwait(&self->c0sk_kvms_cv, &self->c0sk_kvms_mutex, 1000);
+        mutex_unlock(&self->c0sk_kvms_mutex);
+    }
+
+    /* There should be only one kvms on the list after calling
+     * c0sk_sync() and waiting for ingest to complete. It is empty
+     * unless c0 was checkpointed.
      */
     while (1) {
         struct c0_kvmultiset *first;
@@ -655,9 +1098,9 @@ c0sk_close(struct c0sk *handle)
             perfc_set(
                 &self->c0sk_pc_ingest, PERFC_BA_C0SKING_QLEN, (u64)self->c0sk_kvmultisets_cnt);
 
-            assert(c0kvms_get_element_count(first) == 0);
+            assert(self->c0sk_checkpoint || c0kvms_get_element_count(first) == 0);
             assert(self->c0sk_kvmultisets_cnt == 0);
-            assert(self->c0sk_kvmultisets_sz == 0);
+            assert(self->c0sk_checkpoint || self->c0sk_kvmultisets_sz == 0);
         }
         mutex_unlock(&self->c0sk_kvms_mutex);
 
@@ -668,6 +1111,8 @@ c0sk_close(struct c0sk *handle)
     }
 
     destroy_workqueue(self->c0sk_wq_ingest);
+    if (self->c0sk_wq_istream)
+        destroy_workqueue(self->c0sk_wq_istream);
     destroy_workqueue(self->c0sk_wq_maint);
     c0sk_free_concurrency_control(self);
     c0sk_perfc_free(self);
@@ -677,6 +1122,35 @@ c0sk_close(struct c0sk *handle)
     return 0;
 }
 
+merr_t
+c0sk_checkpoint(struct c0sk *handle)
+{
+    struct c0sk_impl *self;
+    merr_t            err;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    self = c0sk_h2r(handle);
+
+    if (self->c0sk_kvdb_rp->read_only)
+        return merr(ev(EROFS));
+
+    err = c0skm_checkpoint(handle);
+    if (ev(err))
+        return err;
+
+    self->c0sk_checkpoint = true;
+
+    return 0;
+}
+
+bool
+c0sk_checkpointed(struct c0sk *handle)
+{
+    return handle && c0sk_h2r(handle)->c0sk_checkpoint;
+}
+
 void
 c0sk_throttle_sensor(struct c0sk *handle, struct throttle_sensor *sensor)
 {
@@ -697,6 +1171,35 @@ c0sk_rparams(struct c0sk *handle)
     return self->c0sk_kvdb_rp;
 }
 
+void
+c0sk_usage(struct c0sk *handle, u64 *keysp, u64 *bytesp)
+{
+    struct c0_kvmultiset *c0kvms;
+    struct c0sk_impl *    self;
+    u64                   keys = 0, bytes = 0;
+
+    self = c0sk_h2r(handle);
+
+    rcu_read_lock();
+    cds_list_for_each_entry_rcu(c0kvms, &self->c0sk_kvmultisets, c0ms_link)
+    {
+        keys += c0kvms_get_element_count(c0kvms);
+        bytes += c0kvms_used(c0kvms);
+    }
+    rcu_read_unlock();
+
+    *keysp = keys;
+    *bytesp = bytes;
+}
+
+void
+c0sk_mem_budget_set(struct c0sk *handle, size_t budget)
+{
+    struct c0sk_impl *self = c0sk_h2r(handle);
+
+    self->c0sk_mem_budget = budget;
+}
+
 merr_t
 c0sk_flush(struct c0sk *handle, struct c0_kvmultiset *new)
 {
@@ -1433,6 +1936,11 @@ c0sk_cursor_bind_txn(struct c0_cursor *cur, struct kvdb_ctxn *ctxn)
      * a txn KVMS, it would prevent the txn from reusing it until the
      * cursor is destroyed.
      */
+    if (ev(kvdb_ctxn_spilled(ctxn))) {
+        cur->c0cur_merr = merr(EFBIG);
+        return cur->c0cur_merr;
+    }
+
     kvms = kvdb_ctxn_get_kvms(ctxn);
     if (!kvms)
         return 0;
@@ -1580,11 +2088,46 @@ c0sk_cursor_skip_pfx(struct c0_cursor *cur, struct bonsai_kv *bkv)
  *         If ptomb is cached, that means it was from a regular kvms. Output
  *         according to seqnos.
  */
+/* With c0_affinity a kvms may hold values of a key in several of its
+ * c0_kvsets, which the bin heap yields as consecutive dups from the same
+ * kvms source.  Consume them, leaving the newest visible value in *bkvp
+ * and *valp.  Stops at a ptomb dup, which the caller must still see.
+ */
+static void
+c0sk_cursor_newest(
+    struct c0_cursor *  cur,
+    uintptr_t           seqnoref,
+    struct bonsai_kv ** bkvp,
+    struct bonsai_val **valp)
+{
+    struct bonsai_kv *bkv = *bkvp, *dup;
+    u32               klen = bkv->bkv_key_imm.ki_klen;
+
+    while (bin_heap2_peek(cur->c0cur_bh, (void **)&dup)) {
+        struct bonsai_val *dupv;
+
+        if (dup->bkv_es != bkv->bkv_es || (dup->bkv_flags & BKV_FLAG_PTOMB))
+            break;
+
+        if (klen != dup->bkv_key_imm.ki_klen || memcmp(bkv->bkv_key, dup->bkv_key, klen))
+            break;
+
+        dupv = c0kvs_findval(NULL, dup, cur->c0cur_seqno, seqnoref);
+        if (dupv && c0sk_seqnoref_newer(dupv->bv_seqnoref, (*valp)->bv_seqnoref)) {
+            *bkvp = dup;
+            *valp = dupv;
+        }
+
+        bin_heap2_pop(cur->c0cur_bh, (void **)&dup);
+    }
+}
+
 merr_t
 c0sk_cursor_read(struct c0_cursor *cur, struct kvs_kvtuple *kvt, bool *eof)
 {
     struct bonsai_kv *bkv, *dup;
     uintptr_t         seqnoref;
+    bool              affine;
 
     if (cur->c0cur_state != C0CUR_STATE_READY) {
         char * last = cur->c0cur_buf;
@@ -1602,6 +2145,7 @@ c0sk_cursor_read(struct c0_cursor *cur, struct kvs_kvtuple *kvt, bool *eof)
     }
 
     seqnoref = kvdb_ctxn_get_seqnoref(cur->c0cur_ctxn);
+    affine = c0sk_h2r(cur->c0cur_c0sk)->c0sk_kvdb_rp->c0_affinity;
 
     while (bin_heap2_pop(cur->c0cur_bh, (void **)&bkv)) {
         struct key_immediate *imm = &bkv->bkv_key_imm;
@@ -1643,6 +2187,11 @@ c0sk_cursor_read(struct c0_cursor *cur, struct kvs_kvtuple *kvt, bool *eof)
 
         assert(!HSE_CORE_IS_PTOMB(val->bv_valuep) || is_ptomb);
 
+        if (affine && !is_ptomb) {
+            c0sk_cursor_newest(cur, seqnoref, &bkv, &val);
+            imm = &bkv->bkv_key_imm;
+        }
+
         if (cur->c0cur_ptomb_key) {
             if (keycmp_prefix(
                     cur->c0cur_ptomb_key, cur->c0cur_ct_pfx_len, bkv->bkv_key, imm->ki_klen) == 0) {
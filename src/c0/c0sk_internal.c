@@ -13,6 +13,7 @@
 #include <hse_util/table.h>
 #include <hse_util/cds_list.h>
 #include <hse_util/bonsai_tree.h>
+#include <hse_util/usdt.h>
 
 #include <hse/hse.h>
 
@@ -22,6 +23,7 @@
 #include <hse_ikvdb/c0sk_perfc.h>
 #include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/cndb.h>
+#include <hse_ikvdb/csched.h>
 #include <hse_ikvdb/c1.h>
 #include <hse_ikvdb/kvset_builder.h>
 #include <hse_ikvdb/c0_kvmultiset.h>
@@ -30,6 +32,7 @@
 #include <hse_ikvdb/throttle.h>
 #include <hse_ikvdb/kvdb_rparams.h>
 #include <hse_ikvdb/rparam_debug_flags.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include "c0sk_internal.h"
 #include "c0skm_internal.h"
@@ -397,7 +400,7 @@ c0sk_builder_add(
         }
 
         err = kvset_builder_add_val(
-            bldr, seqno, val->bv_vlen ? val->bv_value : val->bv_valuep, val->bv_vlen, vbb);
+            bldr, seqno, val->bv_vlen ? val->bv_value : val->bv_valuep, val->bv_vlen, 0, vbb);
         if (err)
             return ev(err);
     }
@@ -442,6 +445,97 @@ c0sk_ingest_rec_perfc(struct perfc_set *perfc, u32 sidx, u64 cycles)
     perfc_rec_sample(perfc, sidx, cycles);
 }
 
+_Static_assert(
+    PERFC_DI_C0SKING_RCU + C0SK_IST_MAX == PERFC_DI_C0SKING_KBYTES,
+    "c0sking stage counters out of sync with enum c0sk_ingest_stage");
+
+/* Time from @start to @end (ns), 0 if either was not recorded.
+ */
+static inline u64
+c0sk_ingest_ival(u64 start, u64 end)
+{
+    return (start && end > start) ? end - start : 0;
+}
+
+/* Add the kblock and vblock writes of an ingest's builders to its event.
+ */
+static void
+c0sk_ingest_ev_wstats(struct c0sk_ingest_event *iev, struct kvset_builder **bldrs)
+{
+    int i;
+
+    for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
+        u64 kns = 0, kbytes = 0, vns = 0, vbytes = 0;
+
+        if (!bldrs[i])
+            continue;
+
+        kvset_builder_get_wstats(bldrs[i], &kns, &kbytes, &vns, &vbytes);
+
+        iev->cie_stagev[C0SK_IST_KWRITE] += kns;
+        iev->cie_stagev[C0SK_IST_VWRITE] += vns;
+        iev->cie_kbytes += kbytes;
+        iev->cie_vbytes += vbytes;
+    }
+}
+
+/* Record a finished ingest's stages in the c0sking distributions and
+ * append its event to the ingest event log.
+ */
+static void
+c0sk_ingest_ev_log(struct c0sk_impl *c0sk, struct c0sk_ingest_event *iev)
+{
+    struct perfc_set *pc = &c0sk->c0sk_pc_ingest;
+    int               i;
+
+    if (PERFC_ISON(pc)) {
+        for (i = 0; i < C0SK_IST_MAX; ++i)
+            perfc_rec_sample(pc, PERFC_DI_C0SKING_RCU + i, iev->cie_stagev[i] / 1000);
+
+        perfc_rec_sample(pc, PERFC_DI_C0SKING_KBYTES, iev->cie_kbytes >> 10);
+        perfc_rec_sample(pc, PERFC_DI_C0SKING_VBYTES, iev->cie_vbytes >> 10);
+    }
+
+    iev->cie_time = get_time_ns();
+
+    spin_lock(&c0sk->c0sk_ievlock);
+    iev->cie_seq = ++c0sk->c0sk_ievseq;
+    c0sk->c0sk_ievv[iev->cie_seq % C0SK_IEVLOG_SZ] = *iev;
+    spin_unlock(&c0sk->c0sk_ievlock);
+}
+
+uint
+c0sk_ingest_events(struct c0sk *handle, u64 since, struct c0sk_ingest_event *evv, uint evc)
+{
+    struct c0sk_impl *c0sk = c0sk_h2r(handle);
+    u64               first;
+    uint              i, n;
+
+    spin_lock(&c0sk->c0sk_ievlock);
+    since = min_t(u64, since, c0sk->c0sk_ievseq);
+    n = min_t(u64, c0sk->c0sk_ievseq - since, min_t(uint, evc, C0SK_IEVLOG_SZ));
+    first = c0sk->c0sk_ievseq - n + 1;
+
+    for (i = 0; i < n; ++i)
+        evv[i] = c0sk->c0sk_ievv[(first + i) % C0SK_IEVLOG_SZ];
+    spin_unlock(&c0sk->c0sk_ievlock);
+
+    return n;
+}
+
+const char *
+c0sk_ingest_stage2str(enum c0sk_ingest_stage stage)
+{
+    static const char *const namev[] = {
+        "rcu",    "coalesce", "queue", "finwait",  "merge", "kbuild",
+        "kwrite", "vwrite",   "order", "mbcommit", "cndb",  "cninsert",
+    };
+
+    _Static_assert(NELEM(namev) == C0SK_IST_MAX, "c0sk ingest stage names out of sync");
+
+    return stage < NELEM(namev) ? namev[stage] : "unknown";
+}
+
 static merr_t
 c0sk_ingest_merge_bldrs(
     struct c0sk_impl *     c0sk,
@@ -472,7 +566,7 @@ c0sk_ingest_merge_bldrs(
                 break;
 
             mclassp = c0sk->c0sk_kvdb_rp->staging_policy;
-            kvset_builder_set_mclass(dstbldr, mclassp);
+            kvset_builder_set_mclass_lvl(dstbldr, cn_get_rp(cn), 0, mclassp);
 
             dst[i] = dstbldr;
         }
@@ -611,103 +705,52 @@ c0sk_ingest_bldr_get(struct c0_ingest_work *ingest)
     return err;
 }
 
-void
-c0sk_ingest_worker(struct work_struct *work)
+/**
+ * c0sk_ingest_merge() - merge c0 kvsets into per-kvs kvset builders
+ * @c0sk:       c0sk handle
+ * @kvms:       kvms being ingested
+ * @minheap:    bin heap prepared over the c0 kvset iterators to merge
+ * @bldrs:      vector of per-kvs kvset builders (created as needed)
+ * @ext_bldr:   %true if @bldrs are c1's vblock builders
+ * @last_skidx: (output) skidx of the last key merged
+ * @last_key:   (output) last key merged
+ * @last_klen:  (output) length of @last_key
+ */
+static merr_t
+c0sk_ingest_merge(
+    struct c0sk_impl *     c0sk,
+    struct c0_kvmultiset * kvms,
+    struct bin_heap2 *     minheap,
+    struct kvset_builder **bldrs,
+    bool                   ext_bldr,
+    u64 *                  last_skidx,
+    const void **          last_key,
+    u16 *                  last_klen)
 {
-    struct bin_heap2 *minheap __aligned(64);
-    struct bonsai_kv *        bkv_prev;
-    struct bonsai_kv *        bkv;
-    struct kvset_builder *    bldr;
-    struct kvset_builder **   bldrs;
-    const void *              last_key = NULL;
-    u16                       last_klen = 0;
-    struct bonsai_val *       val_head;
-    struct bonsai_val **      val_tailp;
-    struct bonsai_val **      val_prevp;
-    struct bonsai_val *       val;
-    u64                       seqno;
-    u64                       last_skidx = 0;
-    u16                       unsorted;
-    s16                       debug;
-    u16                       skidx_prev;
-    u16                       skidx;
-    merr_t                    err;
-    struct cn *               cn;
-    u64                       c0_vlen;
-    u64                       c1_vlen;
-    u64                       go = 0;
+    struct bonsai_kv *    bkv_prev;
+    struct bonsai_kv *    bkv;
+    struct kvset_builder *bldr;
+    struct bonsai_val *   val_head;
+    struct bonsai_val **  val_tailp;
+    struct bonsai_val **  val_prevp;
+    struct bonsai_val *   val;
+    u64                   seqno;
+    u16                   unsorted;
+    u16                   skidx_prev;
+    u16                   skidx;
+    merr_t                err;
+    struct cn *           cn;
+    enum mp_media_classp  mclassp;
 
     /* Maintain separate ptomb seqno prev to distinguish b/w a key and a
      * ptomb from different KVMSes that have the same seqno.
      */
     u64 seqno_prev, pt_seqno_prev;
 
-    struct c0_ingest_work *ingest;
-    struct kvset_mblocks * mblocks;
-    struct c0_kvmultiset * kvms;
-    struct c0sk_impl *     c0sk;
-    u32                    iterc;
-    int                    i;
-    int *                  mbc;
-    struct kvset_mblocks **mbv;
-    u32 *                  cmtv;
-    bool                   do_cn_ingest = false;
-    bool                   ext_bldr = false;
-    u64                    ingestid;
-    enum mp_media_classp   mclassp;
-
-    ingest = container_of(work, struct c0_ingest_work, c0iw_work);
-
-    minheap = ingest->c0iw_minheap;
-    bldrs = ingest->c0iw_bldrs;
-    mblocks = ingest->c0iw_mblocks;
-    iterc = ingest->c0iw_iterc;
-    kvms = ingest->c0iw_c0kvms;
-    mbc = ingest->c0iw_mbc;
-    mbv = ingest->c0iw_mbv;
-    cmtv = ingest->c0iw_cmtv;
-
     val_tailp = &val_head;
     val_prevp = NULL;
     val_head = NULL;
 
-    c0sk = c0sk_h2r(ingest->c0iw_c0);
-    debug = c0sk->c0sk_kvdb_rp->c0_debug & C0_DEBUG_INGSPILL;
-    ingestid = CNDB_DFLT_INGESTID;
-    err = 0;
-
-    assert(c0sk->c0sk_kvdb_health);
-
-    if (debug)
-        ingest->t0 = get_time_ns();
-
-    c0kvms_priv_wait(kvms);
-
-    if (ev(iterc == 0))
-        goto exit_err;
-
-    if (c0sk->c0sk_kvdb_rp->c0_diag_mode)
-        goto exit_err;
-
-    while (unlikely((c0sk->c0sk_kvdb_rp->c0_debug & C0_DEBUG_ACCUMULATE) && !c0sk->c0sk_syncing))
-        __builtin_ia32_pause();
-
-    /* ingests do not stop on block deletion failures. */
-    err = kvdb_health_check(
-        c0sk->c0sk_kvdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
-    if (ev(err))
-        goto exit_err;
-
-    go = perfc_lat_start(&c0sk->c0sk_pc_ingest);
-
-    /* this logic error cannot result in WA, not kvdb_health recordable */
-    err = bin_heap2_prepare(minheap, iterc, ingest->c0iw_sourcev + HSE_C0_KVSET_ITER_MAX - iterc);
-    if (ev(err))
-        goto exit_err;
-
-    if (debug)
-        ingest->t3 = get_time_ns();
-
     seqno_prev = U64_MAX;
     pt_seqno_prev = U64_MAX;
     bkv_prev = NULL;
@@ -715,18 +758,7 @@ c0sk_ingest_worker(struct work_struct *work)
     unsorted = 0;
     bldr = NULL;
     seqno = 0;
-
-    ingestid = c0kvms_rsvd_sn_get(kvms);
-
-    /*
-     */
-    if (ingestid == HSE_SQNREF_INVALID)
-        ingestid = CNDB_DFLT_INGESTID;
-
-    if (ingest->c0iw_ext_bldrs) {
-        bldrs = ingest->c0iw_ext_bldrs;
-        ext_bldr = true;
-    }
+    err = 0;
 
     /* Due to how sourcev[] is constructed by c0sk_coalesce(), the bin
      * heap returns identicals keys in order of youngest to oldest
@@ -747,14 +779,14 @@ c0sk_ingest_worker(struct work_struct *work)
     while (bin_heap2_pop(minheap, (void **)&bkv)) {
         bool have_val = false;
 
-        last_skidx = skidx = key_immediate_index(&bkv->bkv_key_imm);
+        *last_skidx = skidx = key_immediate_index(&bkv->bkv_key_imm);
 
         if (val_head && (bn_kv_cmp(bkv, bkv_prev) || skidx != skidx_prev)) {
             *val_tailp = NULL;
 
             err = c0sk_builder_add(bldr, kvms, bkv_prev, val_head, unsorted, ext_bldr);
             if (ev(err))
-                goto health_err;
+                goto errout;
 
             seqno_prev = U64_MAX;
             pt_seqno_prev = U64_MAX;
@@ -765,8 +797,8 @@ c0sk_ingest_worker(struct work_struct *work)
         }
 
         bkv_prev = bkv;
-        last_klen = bkv->bkv_key_imm.ki_klen;
-        last_key = bkv->bkv_key;
+        *last_klen = bkv->bkv_key_imm.ki_klen;
+        *last_key = bkv->bkv_key;
 
         /* Append values from the current key to the list of values
          * from previous identical keys.  Swap adjacent values that
@@ -835,42 +867,594 @@ c0sk_ingest_worker(struct work_struct *work)
                     get_time_ns(),
                     KVSET_BUILDER_FLAGS_INGEST);
                 if (ev(err))
-                    goto health_err;
+                    goto errout;
+
+                mclassp = c0sk->c0sk_kvdb_rp->staging_policy;
+                kvset_builder_set_mclass_lvl(bldr, cn_get_rp(cn), 0, mclassp);
+
+                bldrs[skidx] = bldr;
+            }
+        }
+    }
+
+    if (val_head) {
+        *val_tailp = NULL;
+
+        err = c0sk_builder_add(bldr, kvms, bkv_prev, val_head, unsorted, ext_bldr);
+        if (ev(err))
+            goto errout;
+
+        val_head = NULL;
+    }
+
+errout:
+    if (err) {
+        *val_tailp = NULL;
+
+        while ((val = val_head)) {
+            val_head = val->bv_free;
+            val->bv_free = NULL;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * struct c0sk_isync - completion tracking for the streams of an ingest
+ * @cs_lock:    protects @cs_pending
+ * @cs_cv:      signaled when @cs_pending drops to zero
+ * @cs_pending: number of queued streams not yet complete
+ */
+struct c0sk_isync {
+    struct mutex cs_lock;
+    struct cv    cs_cv;
+    int          cs_pending;
+};
+
+/**
+ * struct c0sk_istream - one key range of a range-partitioned c0 ingest
+ * @cis_work:        work struct for running the stream on c0sk_wq_istream
+ * @cis_c0sk:        c0sk handle
+ * @cis_kvms:        kvms being ingested
+ * @cis_sync:        completion tracking shared by all streams of the ingest
+ * @cis_minheap:     bin heap over @cis_sourcev
+ * @cis_err:         stream status
+ * @cis_iterc:       number of c0 kvset iterators in @cis_iterv
+ * @cis_last_skidx:  skidx of @cis_last_key
+ * @cis_last_key:    last key merged by this stream (NULL if none)
+ * @cis_last_klen:   length of @cis_last_key
+ * @cis_bldrs:       per-kvs kvset builders for this stream's range
+ * @cis_mblocks:     mblocks produced by @cis_bldrs
+ * @cis_iterv:       c0 kvset iterators restricted to this stream's range
+ * @cis_sourcev:     element sources for @cis_iterv
+ *
+ * Streams cover disjoint, ascending key ranges so that each stream's
+ * builders produce kvsets that may be ingested side-by-side into cn.
+ */
+struct c0sk_istream {
+    struct work_struct       cis_work;
+    struct c0sk_impl *       cis_c0sk;
+    struct c0_kvmultiset *   cis_kvms;
+    struct c0sk_isync *      cis_sync;
+    struct bin_heap2 *       cis_minheap;
+    merr_t                   cis_err;
+    u32                      cis_iterc;
+    u64                      cis_last_skidx;
+    const void *             cis_last_key;
+    u16                      cis_last_klen;
+    u64                      cis_merge_ns;
+    u64                      cis_kbuild_ns;
+    struct kvset_builder *   cis_bldrs[HSE_KVS_COUNT_MAX];
+    struct kvset_mblocks     cis_mblocks[HSE_KVS_COUNT_MAX];
+    struct c0_kvset_iterator cis_iterv[HSE_C0_KVSET_ITER_MAX];
+    struct element_source *  cis_sourcev[HSE_C0_KVSET_ITER_MAX];
+};
+
+static void
+c0sk_istream_run(struct c0sk_istream *cis)
+{
+    merr_t err;
+    u64    tstart;
+    int    i;
+
+    err = bin_heap2_prepare(cis->cis_minheap, cis->cis_iterc, cis->cis_sourcev);
+    if (ev(err))
+        goto errout;
+
+    tstart = get_time_ns();
+    err = c0sk_ingest_merge(
+        cis->cis_c0sk,
+        cis->cis_kvms,
+        cis->cis_minheap,
+        cis->cis_bldrs,
+        false,
+        &cis->cis_last_skidx,
+        &cis->cis_last_key,
+        &cis->cis_last_klen);
+    if (ev(err))
+        goto errout;
+
+    cis->cis_merge_ns = get_time_ns() - tstart;
+    tstart = get_time_ns();
+
+    for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
+        if (!cis->cis_bldrs[i])
+            continue;
+
+        err = kvset_builder_get_mblocks(cis->cis_bldrs[i], &cis->cis_mblocks[i]);
+        if (ev(err))
+            goto errout;
+    }
+
+    cis->cis_kbuild_ns = get_time_ns() - tstart;
+
+errout:
+    cis->cis_err = err;
+}
+
+static void
+c0sk_istream_worker(struct work_struct *work)
+{
+    struct c0sk_istream *cis = container_of(work, struct c0sk_istream, cis_work);
+    struct c0sk_isync *  sync = cis->cis_sync;
+
+    c0sk_istream_run(cis);
+
+    mutex_lock(&sync->cs_lock);
+    if (--sync->cs_pending == 0)
+        cv_broadcast(&sync->cs_cv);
+    mutex_unlock(&sync->cs_lock);
+}
+
+static void
+c0sk_istream_destroy(struct c0sk_istream *cis)
+{
+    int i;
+
+    if (!cis)
+        return;
+
+    for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
+        kvset_mblocks_destroy(&cis->cis_mblocks[i]);
+        if (cis->cis_bldrs[i])
+            kvset_builder_destroy(cis->cis_bldrs[i]);
+    }
+
+    bin_heap2_destroy(cis->cis_minheap);
+    free(cis);
+}
+
+/**
+ * c0sk_istream_splitters() - choose the key ranges of a partitioned ingest
+ * @c0sk:    c0sk handle
+ * @ingest:  ingest work
+ * @skeyv:   (output) vector of splitter keys, in ascending order
+ * @keybuf:  buffer for the splitter key data (@skeyc * HSE_KVS_KLEN_MAX)
+ * @skeyc:   max number of splitters
+ *
+ * Splitters are sampled from the index of the largest (non-ptomb) c0 kvset
+ * being ingested.  Splitters are truncated to the kvs prefix length so that
+ * a prefix tombstone lands in the same range as all the keys it covers.
+ *
+ * Return: the number of splitters
+ */
+static uint
+c0sk_istream_splitters(
+    struct c0sk_impl *     c0sk,
+    struct c0_ingest_work *ingest,
+    struct bonsai_skey *   skeyv,
+    char *                 keybuf,
+    uint                   skeyc)
+{
+    struct c0_kvset_iterator *iterv;
+    struct bonsai_kv *        kvv[BN_SAMPLE_MAX];
+    struct bonsai_root *      root = NULL;
+    uint                      kvc, n, i;
+    int                       height = -1;
+
+    iterv = ingest->c0iw_iterv + HSE_C0_KVSET_ITER_MAX - ingest->c0iw_iterc;
+
+    rcu_read_lock();
+    for (i = 0; i < ingest->c0iw_iterc; ++i) {
+        struct bonsai_root *r = iterv[i].c0it_root;
+        struct bonsai_node *node;
+
+        if (iterv[i].c0it_flags & C0_KVSET_ITER_FLAG_PTOMB)
+            continue;
+
+        if (r->br_index == BN_INDEX_ART) {
+            root = r;
+            break;
+        }
+
+        node = rcu_dereference(r->br_root);
+        if (node && node->bn_height > height) {
+            height = node->bn_height;
+            root = r;
+        }
+    }
+
+    kvc = root ? bn_sample(root, kvv, skeyc) : 0;
+
+    for (i = n = 0; i < kvc; ++i) {
+        struct bonsai_kv *kv = kvv[i];
+        struct cn *       cn;
+        char *            key = keybuf + n * HSE_KVS_KLEN_MAX;
+        u16               skidx;
+        u32               klen, pfx_len;
+
+        skidx = key_immediate_index(&kv->bkv_key_imm);
+        klen = kv->bkv_key_imm.ki_klen;
+
+        cn = c0sk->c0sk_cnv[skidx];
+        if (ev(!cn))
+            continue;
+
+        pfx_len = cn_get_cparams(cn)->cp_pfx_len;
+        if (pfx_len > 0 && klen > pfx_len)
+            klen = pfx_len;
+
+        memcpy(key, kv->bkv_key, klen);
+        bn_skey_init(key, klen, skidx, &skeyv[n]);
+
+        /* Truncation may collapse adjacent splitters.
+         */
+        if (n > 0 && key_full_cmp(
+                         &skeyv[n - 1].bsk_key_imm,
+                         skeyv[n - 1].bsk_key,
+                         &skeyv[n].bsk_key_imm,
+                         skeyv[n].bsk_key) >= 0)
+            continue;
+
+        ++n;
+    }
+    rcu_read_unlock();
+
+    return n;
+}
+
+/**
+ * c0sk_ingest_streams() - merge an ingest as several parallel range streams
+ * @c0sk:       c0sk handle
+ * @ingest:     ingest work
+ * @nstreams:   max number of streams
+ * @combp:      (output) kvset_mblocks vector referenced by the ingest's mbv[]
+ * @last_skidx: (output) skidx of the last key merged
+ * @last_key:   (output) last key merged
+ * @last_klen:  (output) length of @last_key
+ *
+ * The first stream is merged by the calling thread, the others by the
+ * c0sk_wq_istream workqueue.  On success, the ingest's mbv[i] and mbc[i]
+ * describe the mbc[i] kvsets built for kvs i, in ascending key order, and
+ * the caller must free *@combp once done with them.
+ *
+ * Return: ENOENT if no splitters could be chosen (nothing done)
+ */
+static merr_t
+c0sk_ingest_streams(
+    struct c0sk_impl *     c0sk,
+    struct c0_ingest_work *ingest,
+    uint                   nstreams,
+    struct kvset_mblocks **combp,
+    u64 *                  last_skidx,
+    const void **          last_key,
+    u16 *                  last_klen)
+{
+    struct c0sk_istream *     cisv[HSE_C0_INGEST_STREAMS_MAX] = {};
+    struct bonsai_skey        skeyv[HSE_C0_INGEST_STREAMS_MAX - 1];
+    struct c0_kvset_iterator *iterv;
+    struct kvset_mblocks *    comb;
+    struct c0sk_isync         sync;
+    char *                    keybuf;
+    merr_t                    err = 0;
+    uint                      nsplit, i, j, n;
+
+    keybuf = malloc((HSE_C0_INGEST_STREAMS_MAX - 1) * HSE_KVS_KLEN_MAX);
+    if (ev(!keybuf))
+        return merr(ENOMEM);
+
+    nstreams = min_t(uint, nstreams, HSE_C0_INGEST_STREAMS_MAX);
+
+    nsplit = c0sk_istream_splitters(c0sk, ingest, skeyv, keybuf, nstreams - 1);
+    if (nsplit == 0) {
+        free(keybuf);
+        return merr(ENOENT);
+    }
+
+    nstreams = nsplit + 1;
+
+    iterv = ingest->c0iw_iterv + HSE_C0_KVSET_ITER_MAX - ingest->c0iw_iterc;
+
+    for (i = 0; i < nstreams; ++i) {
+        struct c0sk_istream *cis;
+
+        cis = calloc(1, sizeof(*cis));
+        if (ev(!cis)) {
+            err = merr(ENOMEM);
+            goto errout;
+        }
+
+        cisv[i] = cis;
+
+        err = bin_heap2_create(HSE_C0_KVSET_ITER_MAX, bn_kv_cmp, &cis->cis_minheap);
+        if (ev(err))
+            goto errout;
+
+        cis->cis_c0sk = c0sk;
+        cis->cis_kvms = ingest->c0iw_c0kvms;
+        cis->cis_sync = &sync;
+
+        /* Each stream has its own copy of every iterator, restricted to
+         * the stream's range and skipped if empty in that range.
+         */
+        for (j = 0; j < ingest->c0iw_iterc; ++j) {
+            struct c0_kvset_iterator *iter = &cis->cis_iterv[cis->cis_iterc];
+
+            *iter = iterv[j];
+            c0_kvset_iterator_range(
+                iter, i > 0 ? &skeyv[i - 1] : NULL, i < nsplit ? &skeyv[i] : NULL);
+
+            if (c0_kvset_iterator_empty(iter))
+                continue;
+
+            cis->cis_sourcev[cis->cis_iterc++] = c0_kvset_iterator_get_es(iter);
+        }
+    }
+
+    mutex_init(&sync.cs_lock);
+    cv_init(&sync.cs_cv, "c0sk_istream");
+    sync.cs_pending = nstreams - 1;
+
+    for (i = 1; i < nstreams; ++i) {
+        INIT_WORK(&cisv[i]->cis_work, c0sk_istream_worker);
+        queue_work(c0sk->c0sk_wq_istream, &cisv[i]->cis_work);
+    }
+
+    c0sk_istream_run(cisv[0]);
+
+    mutex_lock(&sync.cs_lock);
+    while (sync.cs_pending > 0)
+        cv_wait(&sync.cs_cv, &sync.cs_lock);
+    mutex_unlock(&sync.cs_lock);
+
+    cv_destroy(&sync.cs_cv);
+    mutex_destroy(&sync.cs_lock);
+
+    for (i = 0; i < nstreams; ++i) {
+        struct c0sk_ingest_event *iev = &ingest->c0iw_ev;
+
+        err = cisv[i]->cis_err;
+        if (ev(err))
+            goto errout;
+
+        iev->cie_stagev[C0SK_IST_MERGE] =
+            max_t(u64, iev->cie_stagev[C0SK_IST_MERGE], cisv[i]->cis_merge_ns);
+        iev->cie_stagev[C0SK_IST_KBUILD] =
+            max_t(u64, iev->cie_stagev[C0SK_IST_KBUILD], cisv[i]->cis_kbuild_ns);
+        c0sk_ingest_ev_wstats(iev, cisv[i]->cis_bldrs);
+
+        if (cisv[i]->cis_last_key) {
+            *last_skidx = cisv[i]->cis_last_skidx;
+            *last_key = cisv[i]->cis_last_key;
+            *last_klen = cisv[i]->cis_last_klen;
+        }
+    }
+
+    /* Gather each kvs' kvsets from all the streams, in stream (i.e.,
+     * ascending key) order.
+     */
+    for (i = n = 0; i < HSE_KVS_COUNT_MAX; ++i)
+        for (j = 0; j < nstreams; ++j)
+            n += !!cisv[j]->cis_bldrs[i];
+
+    comb = calloc(max_t(uint, n, 1), sizeof(*comb));
+    if (ev(!comb)) {
+        err = merr(ENOMEM);
+        goto errout;
+    }
+
+    for (i = n = 0; i < HSE_KVS_COUNT_MAX; ++i) {
+        ingest->c0iw_mbv[i] = comb + n;
+
+        for (j = 0; j < nstreams; ++j) {
+            struct c0sk_istream *cis = cisv[j];
+
+            if (!cis->cis_bldrs[i])
+                continue;
+
+            comb[n++] = cis->cis_mblocks[i];
+            memset(&cis->cis_mblocks[i], 0, sizeof(cis->cis_mblocks[i]));
+        }
+
+        ingest->c0iw_mbc[i] = (comb + n) - ingest->c0iw_mbv[i];
+        if (!ingest->c0iw_mbc[i])
+            ingest->c0iw_mbv[i] = NULL;
+        ingest->c0iw_cmtv[i] = 0;
+    }
+
+    ingest->c0iw_ev.cie_streams = nstreams;
+    *combp = comb;
+
+errout:
+    for (i = 0; i < nstreams; ++i)
+        c0sk_istream_destroy(cisv[i]);
+
+    free(keybuf);
+
+    return err;
+}
+
+void
+c0sk_ingest_worker(struct work_struct *work)
+{
+    struct bin_heap2 *minheap __aligned(64);
+    struct kvset_builder **   bldrs;
+    const void *              last_key = NULL;
+    u16                       last_klen = 0;
+    u64                       last_skidx = 0;
+    s16                       debug;
+    merr_t                    err;
+    u64                       c0_vlen;
+    u64                       c1_vlen;
+    u64                       go = 0;
+
+    struct c0_ingest_work *ingest;
+    struct kvset_mblocks * mblocks;
+    struct kvset_mblocks * comb = NULL;
+    struct c0_kvmultiset * kvms;
+    struct c0sk_impl *     c0sk;
+    u32                    iterc;
+    int                    i, j;
+    int *                  mbc;
+    struct kvset_mblocks **mbv;
+    u32 *                  cmtv;
+    bool                   do_cn_ingest = false;
+    bool                   ext_bldr = false;
+    bool                   log_iev = false;
+    u64                    ingestid;
+    u64                    usdt;
+    u64                    tstart;
+
+    struct c0sk_ingest_event *iev;
+    struct cn_ingest_stats    cnst = {};
+
+    tstart = get_time_ns();
+
+    ingest = container_of(work, struct c0_ingest_work, c0iw_work);
+
+    minheap = ingest->c0iw_minheap;
+    bldrs = ingest->c0iw_bldrs;
+    mblocks = ingest->c0iw_mblocks;
+    iterc = ingest->c0iw_iterc;
+    kvms = ingest->c0iw_c0kvms;
+    mbc = ingest->c0iw_mbc;
+    mbv = ingest->c0iw_mbv;
+    cmtv = ingest->c0iw_cmtv;
+
+    c0sk = c0sk_h2r(ingest->c0iw_c0);
+    debug = c0sk->c0sk_kvdb_rp->c0_debug & C0_DEBUG_INGSPILL;
+    ingestid = CNDB_DFLT_INGESTID;
+    err = 0;
+
+    assert(c0sk->c0sk_kvdb_health);
+
+    if (debug)
+        ingest->t0 = get_time_ns();
+
+    atomic_inc(&kvs_flight_env.kfe_ingests);
+
+    usdt = HSE_USDT_START(c0sk_ingest_start);
+    if (usdt)
+        HSE_USDT(c0sk_ingest_start, c0kvms_gen_read(kvms), usdt - ingest->c0iw_tenqueued);
+
+    usdt = HSE_USDT_START(c0sk_ingest_end);
+
+    iev = &ingest->c0iw_ev;
+    memset(iev, 0, sizeof(*iev));
+
+    iev->cie_stagev[C0SK_IST_RCU] =
+        c0sk_ingest_ival(ingest->c0iw_tingesting, ingest->c0iw_tfinalized);
+    iev->cie_stagev[C0SK_IST_COALESCE] =
+        c0sk_ingest_ival(ingest->c0iw_tfinalized, ingest->c0iw_tenqueued);
+    iev->cie_stagev[C0SK_IST_QUEUE] = c0sk_ingest_ival(ingest->c0iw_tenqueued, tstart);
+
+    c0kvms_priv_wait(kvms);
+
+    iev->cie_stagev[C0SK_IST_FINWAIT] = get_time_ns() - tstart;
+
+    if (ev(iterc == 0))
+        goto exit_err;
+
+    if (c0sk->c0sk_kvdb_rp->c0_diag_mode)
+        goto exit_err;
+
+    iev->cie_gen = c0kvms_gen_read(kvms);
+    iev->cie_width = iterc;
+    iev->cie_kvms = ingest->c0iw_coalescec;
+    iev->cie_streams = 1;
+    log_iev = true;
+
+    while (unlikely((c0sk->c0sk_kvdb_rp->c0_debug & C0_DEBUG_ACCUMULATE) && !c0sk->c0sk_syncing))
+        __builtin_ia32_pause();
 
-                mclassp = c0sk->c0sk_kvdb_rp->staging_policy;
-                kvset_builder_set_mclass(bldr, mclassp);
+    /* ingests do not stop on block deletion failures. */
+    err = kvdb_health_check(
+        c0sk->c0sk_kvdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
+    if (ev(err))
+        goto exit_err;
 
-                bldrs[skidx] = bldr;
-            }
-        }
-    }
+    go = perfc_lat_start(&c0sk->c0sk_pc_ingest);
 
-    if (val_head) {
-        *val_tailp = NULL;
+    ingestid = c0kvms_rsvd_sn_get(kvms);
 
-        err = c0sk_builder_add(bldr, kvms, bkv_prev, val_head, unsorted, ext_bldr);
-        if (ev(err))
-            goto health_err;
+    /*
+     */
+    if (ingestid == HSE_SQNREF_INVALID)
+        ingestid = CNDB_DFLT_INGESTID;
 
-        val_head = NULL;
+    if (ingest->c0iw_ext_bldrs) {
+        bldrs = ingest->c0iw_ext_bldrs;
+        ext_bldr = true;
     }
 
-    if (debug)
-        ingest->t4 = get_time_ns();
+    /* c1's vblock builders cannot be shared by several streams, so only
+     * ingests without them are range-partitioned.
+     */
+    if (!ext_bldr && c0sk->c0sk_wq_istream) {
+        err = c0sk_ingest_streams(
+            c0sk,
+            ingest,
+            c0sk->c0sk_kvdb_rp->c0_ingest_streams,
+            &comb,
+            &last_skidx,
+            &last_key,
+            &last_klen);
+        if (err && merr_errno(err) != ENOENT)
+            goto health_err;
 
-    for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
-        if (bldrs[i] == 0)
-            continue;
+        err = 0;
+    }
 
-        err = c0sk_vset_builder_get_committed_vblocks(bldrs[i], ext_bldr, &cmtv[i]);
+    if (!comb) {
+        /* this logic error cannot result in WA, not kvdb_health recordable */
+        err = bin_heap2_prepare(
+            minheap, iterc, ingest->c0iw_sourcev + HSE_C0_KVSET_ITER_MAX - iterc);
         if (ev(err))
-            goto health_err;
+            goto exit_err;
+
+        if (debug)
+            ingest->t3 = get_time_ns();
 
-        mbc[i] = 1;
-        mbv[i] = &mblocks[i];
-        err = kvset_builder_get_mblocks(bldrs[i], &mblocks[i]);
+        tstart = get_time_ns();
+
+        err = c0sk_ingest_merge(
+            c0sk, kvms, minheap, bldrs, ext_bldr, &last_skidx, &last_key, &last_klen);
         if (ev(err))
             goto health_err;
+
+        iev->cie_stagev[C0SK_IST_MERGE] = get_time_ns() - tstart;
+        tstart = get_time_ns();
+
+        if (debug)
+            ingest->t4 = get_time_ns();
+
+        for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
+            if (bldrs[i] == 0)
+                continue;
+
+            err = c0sk_vset_builder_get_committed_vblocks(bldrs[i], ext_bldr, &cmtv[i]);
+            if (ev(err))
+                goto health_err;
+
+            mbc[i] = 1;
+            mbv[i] = &mblocks[i];
+            err = kvset_builder_get_mblocks(bldrs[i], &mblocks[i]);
+            if (ev(err))
+                goto health_err;
+        }
+
+        iev->cie_stagev[C0SK_IST_KBUILD] = get_time_ns() - tstart;
     }
 
     if (debug)
@@ -883,14 +1467,7 @@ health_err:
         kvdb_health_error(c0sk->c0sk_kvdb_health, err);
 
 exit_err:
-    if (err) {
-        *val_tailp = NULL;
-
-        while ((val = val_head)) {
-            val_head = val->bv_free;
-            val->bv_free = NULL;
-        }
-    }
+    tstart = get_time_ns();
 
     mutex_lock(&c0sk->c0sk_kvms_mutex);
     while (1) {
@@ -901,6 +1478,8 @@ exit_err:
     }
     mutex_unlock(&c0sk->c0sk_kvms_mutex);
 
+    iev->cie_stagev[C0SK_IST_ORDER] = get_time_ns() - tstart;
+
     if (do_cn_ingest) {
         bool ingested;
         u64  seqno_max;
@@ -910,12 +1489,33 @@ exit_err:
         go = perfc_lat_start(&c0sk->c0sk_pc_ingest);
 
         err = cn_ingestv(
-            c0sk->c0sk_cnv, mbv, mbc, cmtv, ingestid, HSE_KVS_COUNT_MAX, &ingested, &seqno_max);
+            c0sk->c0sk_cnv,
+            mbv,
+            mbc,
+            cmtv,
+            ingestid,
+            HSE_KVS_COUNT_MAX,
+            &ingested,
+            &seqno_max,
+            &cnst);
 
         c0sk_ingest_rec_perfc(&c0sk->c0sk_pc_ingest, PERFC_DI_C0SKING_FIN, go);
+
+        iev->cie_stagev[C0SK_IST_MBCOMMIT] = cnst.cis_commit_ns;
+        iev->cie_stagev[C0SK_IST_CNDB] = cnst.cis_cndb_ns;
+        iev->cie_stagev[C0SK_IST_CNINSERT] = cnst.cis_insert_ns;
         if (ev(err))
             kvdb_health_error(c0sk->c0sk_kvdb_health, err);
 
+        /* Track the average enqueue-to-cn latency for the autotuner.
+         */
+        if (c0sk->c0sk_kvdb_rp->c0_autotune_mem || c0sk->c0sk_mem_budget) {
+            u64 avg = atomic64_read(&c0sk->c0sk_ingest_avg);
+            u64 lat = get_time_ns() - ingest->c0iw_tenqueued;
+
+            atomic64_set(&c0sk->c0sk_ingest_avg, avg ? (avg * 3 + lat) / 4 : lat);
+        }
+
         if (ingested)
             c0sk_cn_ingest_callback(c0sk, seqno_max, err, last_skidx, last_key, last_klen);
     }
@@ -929,6 +1529,12 @@ exit_err:
     c0_vlen = 0;
     c1_vlen = 0;
 
+    if (log_iev) {
+        c0sk_ingest_ev_wstats(iev, bldrs);
+        iev->cie_errno = merr_errno(err);
+        c0sk_ingest_ev_log(c0sk, iev);
+    }
+
     for (i = 0; i < HSE_KVS_COUNT_MAX; ++i) {
         u64 c0, c1;
 
@@ -947,6 +1553,14 @@ exit_err:
         bldrs[i] = NULL;
     }
 
+    if (comb) {
+        for (i = 0; i < HSE_KVS_COUNT_MAX; ++i)
+            for (j = 0; j < mbc[i]; ++j)
+                kvset_mblocks_destroy(&mbv[i][j]);
+
+        free(comb);
+    }
+
     if (debug) {
         ingest->t7 = get_time_ns();
 
@@ -954,6 +1568,17 @@ exit_err:
         ingest->gencur = c0kvms_gen_current(kvms);
     }
 
+    if (usdt)
+        HSE_USDT(
+            c0sk_ingest_end,
+            c0kvms_gen_read(kvms),
+            merr_errno(err),
+            c0_vlen,
+            c1_vlen,
+            get_time_ns() - usdt);
+
+    atomic_dec(&kvs_flight_env.kfe_ingests);
+
     c0sk_ingest_bldr_put(ingest, c0_vlen, c1_vlen, ext_bldr);
     c0sk_kvmultiset_ingest_completion(c0sk, kvms);
 }
@@ -1116,7 +1741,8 @@ c0sk_coalesce(struct c0sk_impl *self, struct c0_kvmultiset *kvms)
  *
  * c0sk_rcu_sync_cb() moves the requests from the c0sk pending queue to a
  * local pending queue, waits until the end of the current RCU grace period,
- * then processes each kvmultiset on the local pending queue.
+ * then processes each kvmultiset on the local pending queue.  Frozen
+ * kvmultisets at the head of the queue are processed before the wait.
  *
  * kvmultisets in the finalized state are simply discarded (they likely
  * arrived here via c0sk_release_multiset()).  kvmultisets that are not
@@ -1130,13 +1756,14 @@ static void
 c0sk_rcu_sync_cb(struct work_struct *work)
 {
     struct c0_kvmultiset *kvms, *next;
-    struct list_head      pending, done;
+    struct list_head      pending, early, done;
     struct c0sk_impl *    self;
     bool                  more;
 
     self = container_of(work, struct c0sk_impl, c0sk_rcu_work);
 
     INIT_LIST_HEAD(&pending);
+    INIT_LIST_HEAD(&early);
     INIT_LIST_HEAD(&done);
 
     mutex_lock(&self->c0sk_kvms_mutex);
@@ -1144,7 +1771,28 @@ c0sk_rcu_sync_cb(struct work_struct *work)
     INIT_LIST_HEAD(&self->c0sk_rcu_pending);
     mutex_unlock(&self->c0sk_kvms_mutex);
 
-    synchronize_rcu();
+    /* A frozen kvms no longer admits updates, so it can be finalized
+     * and handed off to ingest without waiting for the grace period.
+     * This lets the ingest worker build and write mblocks while the
+     * grace period elapses.  Finalized kvms are merely awaiting their
+     * release and may be skipped, but ingest order must be preserved,
+     * so stop at the first kvms that is not frozen.
+     */
+    list_for_each_entry_safe (kvms, next, &pending, c0ms_rcu) {
+        if (c0kvms_is_finalized(kvms))
+            continue;
+
+        if (!c0kvms_is_frozen(kvms))
+            break;
+
+        list_del(&kvms->c0ms_rcu);
+        list_add_tail(&kvms->c0ms_rcu, &early);
+        c0kvms_finalize(kvms, self->c0sk_wq_maint);
+        c0sk_coalesce(self, kvms);
+    }
+
+    if (!list_empty(&pending))
+        synchronize_rcu();
 
     list_for_each_entry_safe (kvms, next, &pending, c0ms_rcu) {
         if (c0kvms_is_finalized(kvms)) {
@@ -1289,6 +1937,105 @@ conc2width(struct c0sk_impl *self, uint conc)
     return min_t(uint, cwtab[conc], self->c0sk_ingest_width_max);
 }
 
+/* Root node lengths (in kvsets) beyond which, or below which, the
+ * autotuner considers cn compaction to be behind, or caught up.
+ */
+#define C0SK_TUNE_RLEN_HI (12)
+#define C0SK_TUNE_RLEN_LO (4)
+
+/**
+ * c0sk_ingest_autotune() - closed-loop sizing of the next kvms
+ * @self:   ptr to c0sk_impl
+ * @usage:  usage statistics of most recently ingested kvms
+ * @widthp: (in/out) ingest width hint for the next kvms
+ * @sizep:  (out) cheap size for each c0kvs of the next kvms (bytes)
+ *
+ * Compare the time it took to fill the most recent kvms (i.e., the put
+ * rate) with the average time recent kvms took to land in cn, and take
+ * into account the spill backlog in the cn root nodes as reported by
+ * csched.  Grow the kvms if either ingest or compaction can't keep up
+ * (fewer, larger ingests amortize the per-ingest costs), and shrink it
+ * to release memory when both are comfortably ahead.  The footprint of
+ * all in-flight kvms is bounded by the budget given by the kvdb memory
+ * governor, else by rp->c0_autotune_mem.
+ */
+static void
+c0sk_ingest_autotune(struct c0sk_impl *self, struct c0_usage *usage, uint *widthp, size_t *sizep)
+{
+    struct kvdb_rparams *rp = self->c0sk_kvdb_rp;
+
+    size_t kvmssz, budget, used, cheapsz;
+    u64    now, fill_ns, ingest_ns;
+    uint   width, rlen, kvmsc;
+
+    now = get_time_ns();
+    fill_ns = now - self->c0sk_tune_ns;
+    self->c0sk_tune_ns = now;
+
+    ingest_ns = atomic64_read(&self->c0sk_ingest_avg);
+    rlen = csched_root_len(self->c0sk_csched);
+    used = usage->u_alloc - usage->u_free;
+
+    width = *widthp;
+    kvmssz = self->c0sk_tune_sz;
+    if (kvmssz == 0)
+        kvmssz = width * (self->c0sk_cheap_sz ?: HSE_C0_CHEAP_SZ_DFLT);
+
+    /* Only a kvms that was filled to capacity (as opposed to one that
+     * was flushed by sync or the ingest delay timer) says anything
+     * about whether it was too small.
+     */
+    if (used * 4 >= kvmssz * 3 && (ingest_ns > fill_ns || rlen > C0SK_TUNE_RLEN_HI))
+        kvmssz += kvmssz / 4;
+    else if (ingest_ns * 4 < fill_ns && rlen < C0SK_TUNE_RLEN_LO)
+        kvmssz -= kvmssz / 8;
+
+    /* The active kvms and every kvms pending ingest must fit within
+     * the memory budget.
+     */
+    kvmsc = max_t(uint, self->c0sk_kvmultisets_cnt, 2);
+    budget = self->c0sk_mem_budget ?: rp->c0_autotune_mem * 1048576;
+
+    kvmssz = min_t(size_t, kvmssz, budget / kvmsc);
+    kvmssz = min_t(size_t, kvmssz, HSE_C0_INGEST_SZ_MAX * 1048576ul);
+    kvmssz = max_t(size_t, kvmssz, HSE_C0_INGEST_WIDTH_MIN * HSE_C0_CHEAP_SZ_MIN);
+
+    /* Keep the width suggested by ingest concurrency if possible, else
+     * trade width for cheap size to stay within the cheap size limits.
+     */
+    if (rp->c0_ingest_width == 0) {
+        if (kvmssz / width < HSE_C0_CHEAP_SZ_MIN)
+            width = kvmssz / HSE_C0_CHEAP_SZ_MIN;
+        else if (kvmssz / width > HSE_C0_CHEAP_SZ_MAX)
+            width = kvmssz / HSE_C0_CHEAP_SZ_MAX;
+
+        width = min_t(uint, width, self->c0sk_ingest_width_max);
+        width = max_t(uint, width, HSE_C0_INGEST_WIDTH_MIN);
+    }
+
+    cheapsz = kvmssz / width;
+    cheapsz = min_t(size_t, cheapsz, HSE_C0_CHEAP_SZ_MAX);
+    cheapsz = max_t(size_t, cheapsz, HSE_C0_CHEAP_SZ_MIN);
+
+    self->c0sk_tune_sz = kvmssz;
+
+    if (rp->c0_debug & C0_DEBUG_INGTUNE)
+        hse_log(
+            HSE_NOTICE "%s: fill %lums ingest %lums rlen %u kvmsc %u, "
+                       "kvms %zu -> %zuMiB width %u",
+            __func__,
+            (ulong)(fill_ns / 1000000),
+            (ulong)(ingest_ns / 1000000),
+            rlen,
+            kvmsc,
+            used / 1048576,
+            kvmssz / 1048576,
+            width);
+
+    *widthp = width;
+    *sizep = cheapsz;
+}
+
 /**
  * c0sk_ingest_tune() - dynamically tune c0sk for next ingest buffer size
  * @self:       ptr to c0sk_impl
@@ -1351,7 +2098,9 @@ c0sk_ingest_tune(struct c0sk_impl *self, struct c0_usage *usage)
      * to achieve something close to 95% utilization.
      */
     newsz = rp->c0_heap_sz;
-    if (newsz == 0) {
+    if (newsz == 0 && (rp->c0_autotune_mem || self->c0sk_mem_budget)) {
+        c0sk_ingest_autotune(self, usage, &width, &newsz);
+    } else if (newsz == 0) {
         size_t diff = usage->u_used_max - usage->u_used_min;
         size_t used = usage->u_alloc - usage->u_free;
 
@@ -1388,6 +2137,8 @@ errout:
     self->c0sk_ingest_width = width;
     self->c0sk_cheap_sz = newsz;
 
+    perfc_set(&self->c0sk_pc_ingest, PERFC_BA_C0SKING_KVMSSZ, (width * newsz) >> 20);
+
     if (rp->c0_debug & C0_DEBUG_INGTUNE && changed)
         hse_log(
             HSE_NOTICE "%s: used %zu%% diff %zu%%, %zu -> %zu (%zu) "
@@ -1497,6 +2248,7 @@ genchk:
 
     if (new) {
         if (c0sk_install_c0kvms(self, old, new)) {
+            c0kvms_freeze(old);
             c0sk_rcu_sync(self, old, true);
         } else {
             if (created)
@@ -1566,6 +2318,7 @@ c0sk_merge_bkv(
     struct c0sk_impl *    self,
     struct bonsai_kv *    bkv,
     struct c0_kvmultiset *dst,
+    struct c0_kvset *     affine,
     uintptr_t             seqnoref)
 {
     struct kvs_ktuple  kt;
@@ -1581,7 +2334,13 @@ c0sk_merge_bkv(
     sfx_len = cn_get_sfx_len(self->c0sk_cnv[skidx]);
     kt.kt_hash = key_hash64(kt.kt_data, kt.kt_len - sfx_len);
 
-    c0kvs = c0kvms_get_hashed_c0kvset(dst, kt.kt_hash);
+    /* Keys of a kvs with suffixes must remain hashed by prefix so that
+     * c0kvms_pfx_probe() need search only one c0kvs.
+     */
+    if (affine && sfx_len == 0)
+        c0kvs = affine;
+    else
+        c0kvs = c0kvms_get_hashed_c0kvset(dst, kt.kt_hash);
     err = 0;
 
     bv = bkv->bkv_values;
@@ -1626,7 +2385,7 @@ c0sk_merge_impl(
 {
     struct c0_kvset_iterator *iterv;
     struct c0_kvmultiset *    dst;
-    struct c0_kvset *         kvs;
+    struct c0_kvset *         kvs, *affine;
 
     uintptr_t seqnoref, *priv;
     uint      flags, i, iterc;
@@ -1696,6 +2455,15 @@ c0sk_merge_impl(
         goto unlock;
     }
 
+    /* With c0_affinity the whole txn lands in the committing cpu's c0kvs,
+     * so that concurrent commits from different cpus do not contend on
+     * the same bonsai trees.  Readers search all c0kvs of a kvms and
+     * order the values by their commit ordinals.
+     */
+    affine = NULL;
+    if (self->c0sk_kvdb_rp->c0_affinity)
+        affine = c0kvms_get_affine_c0kvset(dst);
+
     for (i = 0; i < iterc; ++i) {
         struct c0_kvmultiset * first;
         struct element_source *es;
@@ -1704,7 +2472,7 @@ c0sk_merge_impl(
         es = c0_kvset_iterator_get_es(&iterv[i]);
 
         while (es->es_get_next(es, (void *)&bkv)) {
-            err = c0sk_merge_bkv(self, bkv, dst, seqnoref);
+            err = c0sk_merge_bkv(self, bkv, dst, affine, seqnoref);
             if (ev(err))
                 goto unlock;
         }
@@ -1716,7 +2484,7 @@ c0sk_merge_impl(
         }
     }
 
-    assert(!c0kvms_is_finalized(dst)); /* See c0kvs_putdel() */
+    assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst)); /* See c0kvs_putdel() */
 
 unlock:
     rcu_read_unlock();
@@ -1803,7 +2571,142 @@ c0sk_putdel(
             err = c0kvs_prefix_del(kvs, skidx, kt, seqnoref);
         }
 
-        assert(!c0kvms_is_finalized(dst)); /* See c0kvs_putdel() */
+        assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst)); /* See c0kvs_putdel() */
+
+    unlock:
+        if (merr_errno(err) == ENOMEM)
+            c0kvms_getref(dst);
+
+        rcu_read_unlock();
+
+        if (merr_errno(err) != ENOMEM)
+            break;
+
+        c0sk_queue_ingest(self, dst, NULL);
+        c0kvms_putref(dst);
+    }
+
+    if (start > 0)
+        c0skm_reqtime_set(&self->c0sk_handle, start);
+
+    return err;
+}
+
+#define C0SK_WBATCH_STACK 64
+
+/* Peel off all the pending ops which map to the same c0kvset as the
+ * first pending op and insert them under one lock.  Relative order
+ * within each c0kvset is preserved, and since all ops on a given key
+ * map to the same c0kvset the batch is applied as if in vector order.
+ * With %split the ops of a c0kvset are inserted in chunks that each fit
+ * in an empty c0kvset, else all at once.  On return *npendp is the
+ * number of ops not yet inserted, which are left at the front of pendv,
+ * those of the c0kvset that failed first.
+ */
+static merr_t
+c0sk_putdel_batch_kvms(
+    struct c0_kvmultiset *      dst,
+    const struct kvs_wbatch_op *opv,
+    u32 *                       pendv,
+    u32 *                       npendp,
+    u32 *                       idxv,
+    u32 *                       restv,
+    uintptr_t                   seqnoref,
+    bool                        split)
+{
+    u32    npend = *npendp;
+    merr_t err = 0;
+    u32    i;
+
+    while (npend > 0) {
+        struct c0_kvset *kvs;
+        u32              idxc = 0, restc = 0, done, n;
+
+        kvs = c0kvms_get_hashed_c0kvset(dst, opv[pendv[0]].wbo_kt.kt_hash);
+
+        for (i = 0; i < npend; ++i) {
+            if (c0kvms_get_hashed_c0kvset(dst, opv[pendv[i]].wbo_kt.kt_hash) == kvs)
+                idxv[idxc++] = pendv[i];
+            else
+                restv[restc++] = pendv[i];
+        }
+
+        for (done = 0; done < idxc; done += n) {
+            n = idxc - done;
+            if (split)
+                n = c0kvs_putdel_batch_chunk(kvs, opv, idxv + done, n);
+
+            err = c0kvs_putdel_batch(kvs, opv, idxv + done, n, seqnoref);
+            if (err)
+                break;
+        }
+
+        if (err) {
+            memmove(pendv, idxv + done, sizeof(*pendv) * (idxc - done));
+            memcpy(pendv + idxc - done, restv, sizeof(*pendv) * restc);
+            npend = idxc - done + restc;
+            break;
+        }
+
+        memcpy(pendv, restv, sizeof(*pendv) * restc);
+        npend = restc;
+    }
+
+    *npendp = npend;
+
+    return err;
+}
+
+merr_t
+c0sk_putdel_batch(
+    struct c0sk_impl *          self,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    uintptr_t                   seqnoref)
+{
+    u32    idxbuf[C0SK_WBATCH_STACK * 3];
+    u32 *  pendv, *idxv, *restv;
+    u32    npend, i;
+    u64    start = 0;
+    merr_t err = 0;
+    u64    coalescesz = self->c0sk_kvdb_rp->c0_coalesce_sz;
+
+    pendv = idxbuf;
+    if (opc > C0SK_WBATCH_STACK) {
+        pendv = malloc(sizeof(*pendv) * opc * 3);
+        if (ev(!pendv))
+            return merr(ENOMEM);
+    }
+
+    idxv = pendv + opc;
+    restv = idxv + opc;
+
+    for (i = 0; i < opc; ++i)
+        pendv[i] = i;
+    npend = opc;
+
+    while (npend > 0) {
+        struct c0_kvmultiset *dst;
+
+        rcu_read_lock();
+        dst = c0sk_get_first_c0kvms(&self->c0sk_handle);
+        if (ev(!dst, HSE_WARNING)) {
+            rcu_read_unlock();
+            err = merr(EINVAL);
+            break;
+        }
+
+        if (ev(c0kvms_should_ingest(dst, coalescesz))) {
+            err = merr(ENOMEM);
+            goto unlock;
+        }
+
+        if (c0kvms_is_tracked(dst) && !start)
+            start = get_time_ns();
+
+        err = c0sk_putdel_batch_kvms(dst, opv, pendv, &npend, idxv, restv, seqnoref, true);
+
+        assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst));
 
     unlock:
         if (merr_errno(err) == ENOMEM)
@@ -1814,13 +2717,121 @@ c0sk_putdel(
         if (merr_errno(err) != ENOMEM)
             break;
 
+        /* The ops already inserted remain in the old kvms, only
+         * the pending ops are retried in the new one.
+         */
         c0sk_queue_ingest(self, dst, NULL);
         c0kvms_putref(dst);
+        err = 0;
+    }
+
+    if (start > 0)
+        c0skm_reqtime_set(&self->c0sk_handle, start);
+
+    if (pendv != idxbuf)
+        free(pendv);
+
+    return err;
+}
+
+merr_t
+c0sk_putdel_batch_priv(
+    struct c0sk_impl *          self,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    struct c0_kvmultiset **     dstp,
+    uintptr_t **                privp)
+{
+    struct c0_kvmultiset *dst;
+
+    u32       idxbuf[C0SK_WBATCH_STACK * 3];
+    u32 *     pendv, *idxv, *restv;
+    u32       npend, i;
+    uintptr_t seqnoref, *priv;
+    u64       start;
+    merr_t    err;
+
+    pendv = idxbuf;
+    if (opc > C0SK_WBATCH_STACK) {
+        pendv = malloc(sizeof(*pendv) * opc * 3);
+        if (ev(!pendv))
+            return merr(ENOMEM);
+    }
+
+    idxv = pendv + opc;
+    restv = idxv + opc;
+
+    for (i = 0; i < opc; ++i)
+        pendv[i] = i;
+    npend = opc;
+
+    priv = NULL;
+    start = 0;
+    err = 0;
+
+    /* As in c0sk_merge_impl(), the caller needs a ref on dst to keep
+     * it alive until it has updated *priv.
+     */
+    rcu_read_lock();
+    dst = c0sk_get_first_c0kvms(&self->c0sk_handle);
+    if (ev(!dst, HSE_WARNING)) {
+        rcu_read_unlock();
+        err = merr(EINVAL);
+        goto errout;
+    }
+
+    c0kvms_getref(dst);
+
+    priv = c0kvms_priv_alloc(dst);
+    if (ev(!priv)) {
+        err = merr(ENOMEM);
+        goto unlock;
+    }
+
+    *priv = HSE_SQNREF_UNDEFINED;
+    seqnoref = HSE_REF_TO_SQNREF(priv);
+
+    if (c0kvms_is_tracked(dst))
+        start = get_time_ns();
+
+    if (ev(c0kvms_should_ingest(dst, self->c0sk_kvdb_rp->c0_coalesce_sz), HSE_INFO)) {
+        err = merr(ENOMEM);
+        goto unlock;
+    }
+
+    /* The ops are invisible until the caller publishes *priv, so
+     * unlike c0sk_putdel_batch() the batch cannot be split across
+     * kvmses.  The ops already inserted in a full kvms are abandoned
+     * with *priv undefined, and the caller retries the whole batch.
+     */
+    err = c0sk_putdel_batch_kvms(dst, opv, pendv, &npend, idxv, restv, seqnoref, false);
+
+    assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst));
+
+unlock:
+    rcu_read_unlock();
+
+    if (err) {
+        if (priv)
+            c0kvms_priv_release(dst);
+
+        if (merr_errno(err) == ENOMEM)
+            (void)c0sk_queue_ingest(self, dst, NULL);
+
+        c0kvms_putref(dst);
+        goto errout;
     }
 
     if (start > 0)
         c0skm_reqtime_set(&self->c0sk_handle, start);
 
+    *privp = priv;
+    *dstp = dst;
+
+errout:
+    if (pendv != idxbuf)
+        free(pendv);
+
     return err;
 }
 
@@ -1846,7 +2857,7 @@ c0sk_kvset_builder_create(struct c0sk *c0sk, u32 skidx, struct kvset_builder **b
         return err;
 
     mclassp = self->c0sk_kvdb_rp->staging_policy;
-    kvset_builder_set_mclass(*bldrout, mclassp);
+    kvset_builder_set_mclass_lvl(*bldrout, cn_get_rp(cn), 0, mclassp);
 
     return 0;
 }
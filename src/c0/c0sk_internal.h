@@ -10,9 +10,12 @@
 
 #include <hse_util/arch.h>
 #include <hse_util/mtx_pool.h>
+#include <hse_util/spinlock.h>
 
 #include <mpool/mpool.h>
 
+#include <hse_ikvdb/c0sk.h>
+
 /* MTF_MOCK_DECL(c0sk_internal) */
 
 struct rcu_head;
@@ -31,6 +34,7 @@ struct c0sk {
  * @c0sk_kvdb_rp:         configuration data
  * @c0sk_ds:              mpool dataset
  * @c0sk_wq_ingest        workqueue for ingest processing (one thread)
+ * @c0sk_wq_istream       workqueue for parallel ingest streams (may be NULL)
  * @c0sk_wq_maint         workqueue for concurrent maintenance tasks
  * @c0sk_mtx_pool:        mutex/condvar pool for ingest synchronization
  * @c0sk_kvms_mutex:      mutex protecting the list of c0_kvmultisets
@@ -46,12 +50,16 @@ struct c0sk {
  * @c0sk_sync_waiters:    list of waiters for specific c0_kvmultisets
  * @c0sk_ingest_gen:      ingest generation count
  * @c0sk_ingest_ldr:      used to elect ingest leader
- * @c0sk_ingest_avg:      average ingest time
+ * @c0sk_ingest_avg:      average ingest time, from enqueue to cn ingest (nsecs)
  * @c0sk_ingest_start:    leader start time (nsecs)
  * @c0sk_ingest_conc:     number of waiters for last ingest
  * @c0sk_ingest_width:    ingest width hint/suggestion to use for next kvms
  * @c0sk_cheap_sz:        ingest cheap size hint to use for next kvms create
+ * @c0sk_tune_ns:         time of the most recent ingest tuning (nsecs)
+ * @c0sk_tune_sz:         kvms size most recently chosen by the autotuner
+ * @c0sk_mem_budget:      autotuner memory budget set by the kvdb (bytes)
  * @c0sk_closing:         set to %true when c0sk is closing
+ * @c0sk_checkpoint:      set to %true when c0 is left in c1 at close
  * @c0sk_release_gen:     generation count of most recently released multiset
  * @c0sk_mpname:          mpool name
  * @c0sk_dbname:          kvdb name
@@ -59,6 +67,9 @@ struct c0sk {
  * @c0sk_mhandle:         mutation handle
  * @c0sk_pc_op:           perf counter for c0sk
  * @c0sk_pc_ingest:       perf counter for c0sk ingests
+ * @c0sk_ievlock:         protects c0sk_ievseq and c0sk_ievv
+ * @c0sk_ievseq:          number of the most recent ingest event (from 1)
+ * @c0sk_ievv:            ingest events, event n is in slot n modulo C0SK_IEVLOG_SZ
  *
  * [HSE_REVISIT]
  */
@@ -67,6 +78,7 @@ struct c0sk_impl {
     struct kvdb_rparams *    c0sk_kvdb_rp; /* not owned by c0sk */
     struct mpool *           c0sk_ds;      /* not owned by c0sk */
     struct workqueue_struct *c0sk_wq_ingest;
+    struct workqueue_struct *c0sk_wq_istream;
     struct workqueue_struct *c0sk_wq_maint;
     struct mtx_pool *        c0sk_mtx_pool;
     struct kvdb_health *     c0sk_kvdb_health;
@@ -99,19 +111,28 @@ struct c0sk_impl {
     u32      c0sk_cheap_sz;
     int      c0sk_nslpmin;
     u64      c0sk_release_gen;
+    u64      c0sk_tune_ns;
+    size_t   c0sk_tune_sz;
+    size_t   c0sk_mem_budget;
 
     atomic64_t *          c0sk_kvdb_seq;
     struct c0sk_mutation *c0sk_mhandle;
     atomic_t              c0sk_replaying;
     bool                  c0sk_closing;
     bool                  c0sk_syncing;
+    bool                  c0sk_checkpoint;
 
     __aligned(SMP_CACHE_BYTES) atomic64_t c0sk_c0ing_bldrs;
+    atomic64_t c0sk_ingest_avg;
 
     /* perf counters*/
     struct perfc_set c0sk_pc_op;
     struct perfc_set c0sk_pc_ingest;
 
+    __aligned(SMP_CACHE_BYTES) spinlock_t c0sk_ievlock;
+    u64                      c0sk_ievseq;
+    struct c0sk_ingest_event c0sk_ievv[C0SK_IEVLOG_SZ];
+
     char c0sk_mpname[MPOOL_NAMESZ_MAX + 1];
 
     /* HSE_REVISIT: must track ALL c0sk cursors, so can invalidate them */
@@ -232,6 +253,48 @@ c0sk_putdel(
     const struct kvs_vtuple *vt,
     uintptr_t                seqnoref);
 
+/**
+ * c0sk_putdel_batch() - put a batch of key/values and tombstones
+ * @self:        struct c0sk_impl in which to put
+ * @opv:         vector of write batch ops
+ * @opc:         number of ops in %opv
+ * @seqnoref:    seqnoref for all ops in the batch
+ *
+ * Like c0sk_putdel(), but the ops are grouped by the hashed c0_kvset
+ * to which they map such that each c0_kvset lock is acquired only
+ * once per batch.  Ops on the same key are applied in vector order.
+ *
+ * Return: [HSE_REVISIT]
+ */
+merr_t
+c0sk_putdel_batch(
+    struct c0sk_impl *          self,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    uintptr_t                   seqnoref);
+
+/**
+ * c0sk_putdel_batch_priv() - insert a batch under a private seqnoref
+ * @self:   c0sk into which to insert
+ * @opv:    vector of write batch ops (key hashes must be set)
+ * @opc:    number of ops in %opv
+ * @dstp:   (output) kvms into which the batch was inserted
+ * @privp:  (output) kvms priv storage referenced by the batch's values
+ *
+ * Like c0sk_merge_impl(), the whole batch lands in one kvms with an
+ * undefined seqnoref, and on success the caller must publish *@privp
+ * and then release both its priv and kvms references.
+ *
+ * Return: ENOMEM if the active kvms filled up (retry), or other error.
+ */
+merr_t
+c0sk_putdel_batch_priv(
+    struct c0sk_impl *          self,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    struct c0_kvmultiset **     dstp,
+    uintptr_t **                privp);
+
 struct cn *
 c0sk_get_cn(struct c0sk_impl *c0sk, u64 skidx);
 
@@ -32,8 +32,23 @@ struct perfc_name c0sk_perfc_ingest[] = {
     NE(PERFC_DI_C0SKING_KVMSDSIZE, 2, "kvms size", "c_kvmsdsz(mb)"),
 
     NE(PERFC_BA_C0SKING_WIDTH, 3, "Ingest width", "d_width"),
+    NE(PERFC_BA_C0SKING_KVMSSZ, 3, "Ingest kvms size", "d_kvmssz(mb)"),
     NE(PERFC_DI_C0SKING_THRSR, 3, "Throttle sensor", "c_thrsr", 10),
     NE(PERFC_DI_C0SKING_MEM, 3, "Ingest memory limit", "c_ingmem"),
+    NE(PERFC_DI_C0SKING_RCU, 3, "Ingest RCU wait", "d_ingrcu(us)"),
+    NE(PERFC_DI_C0SKING_COALESCE, 3, "Ingest coalesce wait", "d_ingcoal(us)"),
+    NE(PERFC_DI_C0SKING_QUEUE, 3, "Ingest queue wait", "d_ingq(us)"),
+    NE(PERFC_DI_C0SKING_FINWAIT, 3, "Ingest updater wait", "d_ingfinw(us)"),
+    NE(PERFC_DI_C0SKING_MERGE, 3, "Ingest merge time", "d_ingmerge(us)"),
+    NE(PERFC_DI_C0SKING_KBUILD, 3, "Ingest kblock build time", "d_ingkbld(us)"),
+    NE(PERFC_DI_C0SKING_KWRITE, 3, "Ingest kblock write time", "d_ingkwr(us)"),
+    NE(PERFC_DI_C0SKING_VWRITE, 3, "Ingest vblock write time", "d_ingvwr(us)"),
+    NE(PERFC_DI_C0SKING_ORDER, 3, "Ingest order wait", "d_ingord(us)"),
+    NE(PERFC_DI_C0SKING_MBCOMMIT, 3, "Ingest mblock commit time", "d_ingmbc(us)"),
+    NE(PERFC_DI_C0SKING_CNDB, 3, "Ingest cndb log time", "d_ingcndb(us)"),
+    NE(PERFC_DI_C0SKING_CNINSERT, 3, "Ingest cn insert time", "d_ingcnins(us)"),
+    NE(PERFC_DI_C0SKING_KBYTES, 3, "Ingest kblock bytes", "d_ingkb(kb)"),
+    NE(PERFC_DI_C0SKING_VBYTES, 3, "Ingest vblock bytes", "d_ingvb(kb)"),
 };
 
 NE_CHECK(c0sk_perfc_op, PERFC_EN_C0SKOP, "c0sk_perfc_op table/enum mismatch");
@@ -66,6 +81,9 @@ c0sk_perfc_init(void)
     c0sk_perfc_ingest[PERFC_DI_C0SKING_MEM].pcn_ivl = ivl;
     c0sk_perfc_ingest[PERFC_DI_C0SKING_KVMSDSIZE].pcn_ivl = ivl;
 
+    for (i = PERFC_DI_C0SKING_RCU; i <= PERFC_DI_C0SKING_VBYTES; i++)
+        c0sk_perfc_ingest[i].pcn_ivl = ivl;
+
     c0sk_perfc_op[PERFC_LT_C0SKOP_GET].pcn_samplepct = 3;
     c0sk_perfc_op[PERFC_LT_C0SKOP_PUT].pcn_samplepct = 3;
     c0sk_perfc_op[PERFC_LT_C0SKOP_DEL].pcn_samplepct = 3;
@@ -24,6 +24,7 @@
 #include <hse_ikvdb/c0_kvset.h>
 #include <hse_ikvdb/throttle.h>
 #include <hse_ikvdb/kvdb_rparams.h>
+#include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/rparam_debug_flags.h>
 #include <hse_ikvdb/kvset_builder.h>
 
@@ -101,6 +102,7 @@ c0skm_open(struct c0sk *handle, struct kvdb_rparams *rp, struct c1 *c1h, const c
     c0skm->c0skm_dsize = info.c1_dsize; /* in bytes */
 
     atomic64_set(&c0skm->c0skm_mutgen, 1);
+    atomic64_set(&c0skm->c0skm_durgen, 0);
     atomic64_set(&c0skm->c0skm_err, 0);
     atomic_set(&c0skm->c0skm_flushing, 0);
     atomic_set(&c0skm->c0skm_syncing, 0);
@@ -222,6 +224,92 @@ c0skm_sync(struct c0sk *handle)
     return waiter.c0skw_err;
 }
 
+merr_t
+c0skm_checkpoint(struct c0sk *handle)
+{
+    struct c0sk_mutation *c0skm;
+    int                   i;
+
+    c0skm = c0sk_h2r(handle)->c0sk_mhandle;
+    if (!c0skm)
+        return merr(ev(ENOTSUP));
+
+    /* A kvs that stays out of c1 would lose its c0 contents.
+     */
+    for (i = 0; i < HSE_KVS_COUNT_MAX; i++)
+        if (c0skm->c0skm_cnid[i] && c0skm->c0skm_nondurable[i])
+            return merr(ev(EPERM));
+
+    return c0skm_sync(handle);
+}
+
+u64
+c0skm_ticket(struct c0sk *handle)
+{
+    struct c0sk_mutation *c0skm;
+
+    c0skm = c0sk_h2r(handle)->c0sk_mhandle;
+
+    return c0skm ? atomic64_read(&c0skm->c0skm_mutgen) : 0;
+}
+
+merr_t
+c0skm_ticket_wait(struct c0sk *handle, u64 ticket, int timeout_ms)
+{
+    struct c0sk_waiter    waiter = {};
+    struct c0sk_mutation *c0skm;
+
+    merr_t err = 0;
+    u64    deadline;
+    u64    now;
+
+    c0skm = c0sk_h2r(handle)->c0sk_mhandle;
+    if (!c0skm || ticket <= atomic64_read(&c0skm->c0skm_durgen))
+        return 0;
+
+    err = atomic64_read(&c0skm->c0skm_err);
+    if (ev(err))
+        return err;
+
+    if (timeout_ms == 0)
+        return merr(EAGAIN);
+
+    deadline = get_time_ns() + MSEC_TO_NSEC((u64)timeout_ms);
+
+    cv_init(&waiter.c0skw_cv, __func__);
+    waiter.c0skw_gen = ticket;
+
+    /* Not a sync request, this waits for the timer driven syncs to
+     * catch up with the ticket.
+     */
+    mutex_lock(&c0skm->c0skm_sync_mutex);
+    list_add_tail(&waiter.c0skw_link, &c0skm->c0skm_sync_waiters);
+    while (ticket > atomic64_read(&c0skm->c0skm_durgen) && waiter.c0skw_err == 0) {
+        if (timeout_ms < 0) {
+            cv_wait(&waiter.c0skw_cv, &c0skm->c0skm_sync_mutex);
+            continue;
+        }
+
+        now = get_time_ns();
+        if (now >= deadline) {
+            err = merr(EAGAIN);
+            break;
+        }
+
+        cv_timedwait(
+            &waiter.c0skw_cv,
+            &c0skm->c0skm_sync_mutex,
+            NSEC_TO_MSEC(deadline - now) + 1);
+    }
+
+    list_del(&waiter.c0skw_link);
+    mutex_unlock(&c0skm->c0skm_sync_mutex);
+
+    cv_destroy(&waiter.c0skw_cv);
+
+    return err ?: waiter.c0skw_err;
+}
+
 /* Implements external flush request (hse_kvdb_flush) */
 merr_t
 c0skm_flush(struct c0sk *handle)
@@ -301,10 +389,30 @@ c0skm_get_cnid(struct c0sk_mutation *c0skm, u32 skidx)
     return c0skm->c0skm_cnid[skidx];
 }
 
+struct cn *
+c0skm_get_cn(struct c0sk_mutation *c0skm, u32 skidx)
+{
+    assert(skidx < HSE_KVS_COUNT_MAX);
+
+    if (!c0skm || !c0skm->c0skm_c0skh)
+        return NULL;
+
+    return c0skm->c0skm_c0skh->c0sk_cnv[skidx];
+}
+
+bool
+c0skm_skidx_durable(struct c0sk_mutation *c0skm, u32 skidx)
+{
+    assert(skidx < HSE_KVS_COUNT_MAX);
+
+    return !c0skm || !c0skm->c0skm_nondurable[skidx];
+}
+
 void
 c0skm_skidx_register(struct c0sk_impl *self, u32 skidx, struct cn *cn)
 {
     struct c0sk_mutation *c0skm;
+    struct kvs_rparams *  rp;
 
     u64 cnid;
 
@@ -316,6 +424,8 @@ c0skm_skidx_register(struct c0sk_impl *self, u32 skidx, struct cn *cn)
 
     cnid = cn_get_cnid(cn);
     assert(c0skm->c0skm_cnid[skidx] == 0);
+    rp = cn_get_rp(cn);
+    c0skm->c0skm_nondurable[skidx] = rp && !rp->kvs_durable;
     c0skm->c0skm_cnid[skidx] = cnid;
 }
 
@@ -331,6 +441,7 @@ c0skm_skidx_deregister(struct c0sk_impl *self, u32 skidx)
         return;
 
     c0skm->c0skm_cnid[skidx] = 0;
+    c0skm->c0skm_nondurable[skidx] = false;
 }
 
 static void
@@ -400,6 +511,18 @@ c0skm_signal_waiters(struct c0sk_mutation *c0skm, u64 gen, merr_t err)
     }
 }
 
+/* All mutations of the gens up to @gen are durable unless @err is set,
+ * either way wake up who waits on them.  Caller holds c0skm_sync_mutex.
+ */
+static void
+c0skm_durgen_set(struct c0sk_mutation *c0skm, u64 gen, merr_t err)
+{
+    if (!err && gen > atomic64_read(&c0skm->c0skm_durgen))
+        atomic64_set(&c0skm->c0skm_durgen, gen);
+
+    c0skm_signal_waiters(c0skm, gen, err);
+}
+
 static merr_t
 c0skm_ingest(struct c0sk_mutation *c0skm, u8 itype, u64 *gen)
 {
@@ -523,9 +646,6 @@ c0skm_ingest(struct c0sk_mutation *c0skm, u8 itype, u64 *gen)
      */
     c0skm_reqtime_reset(c0skm);
 
-    /* Max. seqno to be used for transaction mutations. */
-    tseqno = atomic64_read(&c0skm->c0skm_tseqno);
-
     /* Increase the mutation gen. and store the old gen. Post c1
      * ingest, all mutations corresponding to this old gen. would
      * have been persisted. Any sync threads waiting on this old gen.
@@ -533,6 +653,12 @@ c0skm_ingest(struct c0sk_mutation *c0skm, u8 itype, u64 *gen)
      */
     old_gen = atomic64_fetch_add(1, &c0skm->c0skm_mutgen);
 
+    /* Max. seqno to be used for transaction mutations.  Read after the
+     * gen. bump so that a txn committed before c0skm_ticket() returned
+     * old_gen is part of this ingest.
+     */
+    tseqno = atomic64_read(&c0skm->c0skm_tseqno);
+
     /* Switch the mutation list for all the KVMSes, from newest to
      * oldest
      */
@@ -796,6 +922,7 @@ c0skm_tsync_or_flush_work(struct c0sk_mutation *c0skm, enum c0skm_ingest_type it
 
     merr_t err;
     bool   tsync;
+    u64    gen = 0;
     u64    start = c0skm_reqtime_get(c0skm);
 
     if (unlikely(!start))
@@ -816,7 +943,7 @@ c0skm_tsync_or_flush_work(struct c0sk_mutation *c0skm, enum c0skm_ingest_type it
     /* Ensure ingest start time is visible before updating end. */
     smp_wmb();
 
-    err = c0skm_ingest(c0skm, tsync ? C1_INGEST_SYNC : C1_INGEST_FLUSH, NULL);
+    err = c0skm_ingest(c0skm, tsync ? C1_INGEST_SYNC : C1_INGEST_FLUSH, &gen);
     if (ev(err)) {
         atomic64_set(&c0skm->c0skm_err, err);
         kvdb_health_error(c0sk->c0sk_kvdb_health, err);
@@ -824,9 +951,17 @@ c0skm_tsync_or_flush_work(struct c0sk_mutation *c0skm, enum c0skm_ingest_type it
         perfc_rec_lat(&c0skm->c0skm_pcset_op, PERFC_LT_C0SKM_INGEST, start);
     }
 
-    if (tsync)
+    if (tsync) {
         atomic64_set(&c0skm->c0skm_ingest_end, get_time_ns());
 
+        if (err)
+            gen = atomic64_read(&c0skm->c0skm_mutgen);
+
+        mutex_lock(&c0skm->c0skm_sync_mutex);
+        c0skm_durgen_set(c0skm, gen, err);
+        mutex_unlock(&c0skm->c0skm_sync_mutex);
+    }
+
     c0skm_tsync_or_flush_reset(c0skm, tsync);
 }
 
@@ -873,7 +1008,7 @@ c0skm_sync_work(struct c0sk_mutation *c0skm)
      */
     mutex_lock(&c0skm->c0skm_sync_mutex);
     c0skm->c0skm_syncgen = gen;
-    c0skm_signal_waiters(c0skm, gen, err);
+    c0skm_durgen_set(c0skm, gen, err);
 
     /* If there are pending sync requests from the application,
      * process them by queueing a sync work.
@@ -102,6 +102,7 @@ struct c0sk_mutation {
     __aligned(SMP_CACHE_BYTES) struct list_head c0skm_sync_waiters;
     struct mutex c0skm_sync_mutex;
     u64          c0skm_syncgen;
+    atomic64_t   c0skm_durgen;
     bool         c0skm_syncpend;
     atomic_t     c0skm_syncing;
     atomic_t     c0skm_tsyncing;
@@ -114,6 +115,7 @@ struct c0sk_mutation {
     u32          c0skm_tmax;
 
     __aligned(SMP_CACHE_BYTES) u64 c0skm_cnid[HSE_KVS_COUNT_MAX];
+    bool c0skm_nondurable[HSE_KVS_COUNT_MAX];
 
     struct perfc_set c0skm_pcset_op;
     struct perfc_set c0skm_pcset_kv;
@@ -239,6 +241,25 @@ c0skm_skidx_deregister(struct c0sk_impl *self, u32 skidx);
 u64
 c0skm_get_cnid(struct c0sk_mutation *c0skm, u32 skidx);
 
+/**
+ * c0skm_get_cn() - Returns the cn for the specified skidx.
+ * @c0skm: c0sk mutation handle
+ * @skidx:
+ */
+struct cn *
+c0skm_get_cn(struct c0sk_mutation *c0skm, u32 skidx);
+
+/**
+ * c0skm_skidx_durable() - Returns false if the kvs of skidx skips c1
+ * @c0skm: c0sk mutation handle
+ * @skidx:
+ *
+ * The mutations of a kvs opened with kvs_durable=0 are not written to c1,
+ * after a crash the kvs has only what was ingested into its cn tree.
+ */
+bool
+c0skm_skidx_durable(struct c0sk_mutation *c0skm, u32 skidx);
+
 /**
  * c0skm_dtime_throttle_set_sensor() - Retain c0skm throttle delay
  * @c0skm: c0sk mutation handle
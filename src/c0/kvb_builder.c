@@ -11,6 +11,7 @@
 #include <hse_ikvdb/c0_kvset.h>
 #include <hse_ikvdb/kvb_builder.h>
 #include <hse_ikvdb/kvdb_perfc.h>
+#include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/c1.h>
 
 #include "c0skm_internal.h"
@@ -302,6 +303,10 @@ kvb_builder_kvtuple_add(
         return merr(ev(ENOENT));
     }
 
+    /* Keys of a non-durable kvs never make it to c1. */
+    if (!c0skm_skidx_durable(iter->kvbi_c0skm, skidx))
+        return 0;
+
     /* Allocate kv tuple */
     err = c1_kvtuple_alloc(kvc, &kvt);
     if (ev(err))
@@ -329,6 +334,9 @@ kvb_builder_kvtuple_add(
 
     *kvlen = klen + vlen;
 
+    perfc_add(
+        cn_get_amp_perfc(c0skm_get_cn(iter->kvbi_c0skm, skidx)), PERFC_RA_CNAMP_C1BYTES, *kvlen);
+
     *ckvt = kvt;
 
     return 0;
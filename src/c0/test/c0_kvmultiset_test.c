@@ -115,6 +115,34 @@ MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, basic_create, no_fail_pre, no_fail_
     c0kvms_putref(kvms);
 }
 
+MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, affine_c0kvset, no_fail_pre, no_fail_post)
+{
+    struct c0_kvmultiset *kvms = 0;
+    struct c0_kvset *     p;
+    merr_t                err;
+    int                   i;
+
+    const int WIDTH = 8;
+
+    err = c0kvms_create(WIDTH, HSE_C0_CHEAP_SZ_DFLT, 0, 0, true, &kvms);
+    ASSERT_EQ(0, err);
+    ASSERT_NE((struct c0_kvmultiset *)0, kvms);
+
+    /* The affine c0kvset is never the ptomb c0kvset, and is one of the
+     * sets a hashed lookup may return.
+     */
+    p = c0kvms_get_affine_c0kvset(kvms);
+    ASSERT_NE((struct c0_kvset *)0, p);
+    ASSERT_NE(c0kvms_ptomb_c0kvset_get(kvms), p);
+
+    for (i = 1; i < c0kvms_width(kvms); ++i)
+        if (p == c0kvms_get_c0kvset(kvms, i))
+            break;
+    ASSERT_LT(i, c0kvms_width(kvms));
+
+    c0kvms_putref(kvms);
+}
+
 MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, limit_create, no_fail_pre, no_fail_post)
 {
     struct c0_kvmultiset *kvms = 0;
@@ -213,6 +241,55 @@ MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, create_insert_check, no_fail_pre, n
     c0kvms_putref(kvms);
 }
 
+MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, filter, no_fail_pre, no_fail_post)
+{
+    struct c0_kvmultiset *kvms = 0;
+    struct kvs_ktuple     kt;
+    struct kvs_vtuple     vt;
+    merr_t                err;
+    u32                   i, fp;
+    u64                   key;
+
+    const u32 NKEYS = 10000;
+
+    err = c0kvms_create(8, HSE_C0_CHEAP_SZ_DFLT, 0, 0, true, &kvms);
+    ASSERT_EQ(0, err);
+
+    kvs_vtuple_init(&vt, &key, sizeof(key));
+
+    for (key = 0; key < NKEYS; ++key) {
+        kvs_ktuple_init(&kt, &key, sizeof(key));
+
+        err = c0kvs_put(
+            c0kvms_get_hashed_c0kvset(kvms, kt.kt_hash), 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(0));
+        ASSERT_EQ(0, err);
+    }
+
+    /* No false negatives, and few false positives.
+     */
+    for (key = fp = 0; key < NKEYS * 2; ++key) {
+        kvs_ktuple_init(&kt, &key, sizeof(key));
+
+        if (key < NKEYS)
+            ASSERT_TRUE(c0kvms_may_contain(kvms, kt.kt_hash));
+        else if (c0kvms_may_contain(kvms, kt.kt_hash))
+            ++fp;
+    }
+    ASSERT_LT(fp, NKEYS / 20);
+
+    /* A reset kvms starts with an empty filter.
+     */
+    c0kvms_reset(kvms);
+
+    for (i = 0; i < NKEYS; ++i) {
+        key = i;
+        kvs_ktuple_init(&kt, &key, sizeof(key));
+        ASSERT_FALSE(c0kvms_may_contain(kvms, kt.kt_hash));
+    }
+
+    c0kvms_putref(kvms);
+}
+
 MTF_DEFINE_UTEST_PREPOST(c0_kvmultiset_test, ingest_sk, no_fail_pre, no_fail_post)
 {
     struct c0_kvmultiset *kvms = 0;
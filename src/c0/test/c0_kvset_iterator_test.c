@@ -13,6 +13,7 @@
 #include <hse_util/platform.h>
 #include <hse_util/seqno.h>
 #include <hse_util/bonsai_tree.h>
+#include <hse_util/byteorder.h>
 
 #include <hse_test_support/random_buffer.h>
 #include <hse_ikvdb/limits.h>
@@ -480,4 +481,81 @@ MTF_DEFINE_UTEST(c0_kvset_iterator_test, skip)
     call_rcu_data_free(rcu_thrd);
 }
 
+MTF_DEFINE_UTEST(c0_kvset_iterator_test, range)
+{
+    merr_t                   err = 0;
+    struct call_rcu_data *   rcu_thrd;
+    struct c0_kvset *        kvs;
+    struct c0_kvset_impl *   kvs_impl;
+    struct c0_kvset_iterator iter;
+    const u32                insert_count = 10000;
+    u32                      kbuf[1], vbuf[1];
+    struct kvs_ktuple        kt;
+    struct kvs_vtuple        vt;
+    struct bonsai_kv *       kvv[BN_SAMPLE_MAX];
+    struct bonsai_skey       skeyv[BN_SAMPLE_MAX];
+    struct element_source *  es;
+    struct bonsai_kv *       bkv;
+    uint                     kvc, total;
+    int                      i;
+
+    rcu_thrd = create_call_rcu_data(0, -1);
+    ASSERT_TRUE(rcu_thrd);
+    set_thread_call_rcu_data(rcu_thrd);
+
+    err = c0kvs_create(HSE_C0_CHEAP_SZ_DFLT, 0, 0, false, &kvs);
+    ASSERT_NE((struct c0_kvset *)0, kvs);
+    kvs_impl = c0_kvset_h2r(kvs);
+
+    kt.kt_data = kbuf;
+    kt.kt_len = sizeof(kbuf);
+    vt.vt_data = vbuf;
+    vt.vt_len = sizeof(vbuf);
+
+    for (i = 0; i < insert_count; ++i) {
+        kbuf[0] = cpu_to_be32(i);
+        vbuf[0] = i;
+        err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(117));
+        ASSERT_EQ(0, err);
+    }
+
+    c0kvs_finalize(&kvs_impl->c0s_handle);
+
+    rcu_read_lock();
+    kvc = bn_sample(kvs_impl->c0s_broot, kvv, 7);
+    ASSERT_EQ(7, kvc);
+    for (i = 0; i < kvc; ++i)
+        bn_skey_init(kvv[i]->bkv_key, kvv[i]->bkv_key_imm.ki_klen, 0, &skeyv[i]);
+    rcu_read_unlock();
+
+    /* The ranges [-inf, s0), [s0, s1), ..., [sN, inf) must visit every
+     * key exactly once, in order, and each range must be nonempty.
+     */
+    total = 0;
+    for (i = 0; i <= kvc; ++i) {
+        uint cnt = 0;
+
+        c0_kvset_iterator_init(&iter, kvs_impl->c0s_broot, 0, 0);
+        c0_kvset_iterator_range(&iter, i > 0 ? &skeyv[i - 1] : NULL, i < kvc ? &skeyv[i] : NULL);
+        ASSERT_FALSE(c0_kvset_iterator_empty(&iter));
+
+        es = c0_kvset_iterator_get_es(&iter);
+        while (es->es_get_next(es, (void **)&bkv)) {
+            ASSERT_EQ(total, be32_to_cpu(*(u32 *)bkv->bkv_key));
+            ++total;
+            ++cnt;
+        }
+
+        /* Sampling from the top of a balanced tree is roughly even. */
+        ASSERT_GT(cnt, insert_count / (kvc + 1) / 4);
+    }
+    ASSERT_EQ(insert_count, total);
+
+    c0kvs_destroy(kvs);
+
+    rcu_barrier();
+    set_thread_call_rcu_data(NULL);
+    call_rcu_data_free(rcu_thrd);
+}
+
 MTF_END_UTEST_COLLECTION(c0_kvset_iterator_test);
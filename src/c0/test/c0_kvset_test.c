@@ -190,6 +190,68 @@ MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, basic_put_get, no_fail_pre, no_fail_post
     c0kvs_destroy(kvs);
 }
 
+/* Exercise both value staging paths (per-thread reservation and direct
+ * cheap allocation) across a reset, which must invalidate reservations.
+ */
+MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, staged_put_get, no_fail_pre, no_fail_post)
+{
+    const u32        vlenv[] = { 1, 100, 2000, 2100, 9000, 20000 };
+    struct c0_kvset *kvs;
+    merr_t           err;
+    char             kbuf[32];
+    char *           vbuf, *obuf;
+    uintptr_t        oseqnoref;
+    int              pass, i;
+
+    vbuf = malloc(HSE_KVS_VLEN_MAX);
+    obuf = malloc(HSE_KVS_VLEN_MAX);
+    ASSERT_TRUE(vbuf && obuf);
+
+    err = c0kvs_create(HSE_C0_CHEAP_SZ_DFLT, 0, 0, false, &kvs);
+    ASSERT_EQ(0, err);
+
+    for (pass = 0; pass < 2; ++pass) {
+        for (i = 0; i < 64; ++i) {
+            struct kvs_ktuple kt;
+            struct kvs_vtuple vt;
+
+            snprintf(kbuf, sizeof(kbuf), "staged%03d", i);
+            kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+            memset(vbuf, 'a' + (i + pass) % 26, vlenv[i % NELEM(vlenv)]);
+            kvs_vtuple_init(&vt, vbuf, vlenv[i % NELEM(vlenv)]);
+
+            err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(i + 1));
+            ASSERT_EQ(0, err);
+        }
+
+        for (i = 0; i < 64; ++i) {
+            struct kvs_ktuple   kt;
+            struct kvs_buf      vb;
+            enum key_lookup_res res;
+
+            snprintf(kbuf, sizeof(kbuf), "staged%03d", i);
+            kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+            kvs_buf_init(&vb, obuf, HSE_KVS_VLEN_MAX);
+            memset(vbuf, 'a' + (i + pass) % 26, vlenv[i % NELEM(vlenv)]);
+
+            err = c0kvs_get(kvs, 0, &kt, 64, 0, &res, &vb, &oseqnoref);
+            ASSERT_EQ(0, err);
+            ASSERT_EQ(FOUND_VAL, res);
+            ASSERT_EQ(vlenv[i % NELEM(vlenv)], vb.b_len);
+            ASSERT_EQ(0, memcmp(obuf, vbuf, vb.b_len));
+        }
+
+        synchronize_rcu();
+        c0kvs_reset(kvs, 0);
+    }
+
+    rcu_barrier();
+    c0kvs_destroy(kvs);
+
+    free(obuf);
+    free(vbuf);
+}
+
 MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, basic_put_get_fail, no_fail_pre, no_fail_post)
 {
     struct c0_kvset * kvs;
@@ -934,6 +996,79 @@ MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, finalize, no_fail_pre, no_fail_post)
     c0kvs_destroy(kvs);
 }
 
+MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, freeze, no_fail_pre, no_fail_post)
+{
+    struct c0_kvset *   kvs;
+    merr_t              err;
+    char                kbuf[32], vbuf[100];
+    struct kvs_ktuple   kt;
+    struct kvs_vtuple   vt;
+    struct kvs_buf      vb;
+    enum key_lookup_res res;
+    uintptr_t           oseqno;
+    int                 i;
+
+    err = c0kvs_create(HSE_C0_CHEAP_SZ_DFLT, 0, 0, false, &kvs);
+    ASSERT_EQ(0, err);
+
+    memset(vbuf, 'x', sizeof(vbuf));
+    kvs_vtuple_init(&vt, vbuf, sizeof(vbuf));
+
+    for (i = 0; i < 10; ++i) {
+        snprintf(kbuf, sizeof(kbuf), "frozen%03d", i);
+        kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+
+        err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(1));
+        ASSERT_EQ(0, err);
+    }
+
+    ASSERT_FALSE(c0kvs_is_frozen(kvs));
+    c0kvs_freeze(kvs);
+    ASSERT_TRUE(c0kvs_is_frozen(kvs));
+
+    /* A frozen kvset rejects updates with ENOMEM, both before and
+     * after it is finalized.
+     */
+    for (i = 0; i < 2; ++i) {
+        snprintf(kbuf, sizeof(kbuf), "frozen%03d", 20 + i);
+        kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+
+        err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(2));
+        ASSERT_EQ(ENOMEM, merr_errno(err));
+
+        err = c0kvs_del(kvs, 0, &kt, HSE_ORDNL_TO_SQNREF(2));
+        ASSERT_EQ(ENOMEM, merr_errno(err));
+
+        err = c0kvs_prefix_del(kvs, 0, &kt, HSE_ORDNL_TO_SQNREF(2));
+        ASSERT_EQ(ENOMEM, merr_errno(err));
+
+        c0kvs_finalize(kvs);
+    }
+
+    ASSERT_EQ(10, c0kvs_get_element_count(kvs));
+
+    for (i = 0; i < 10; ++i) {
+        snprintf(kbuf, sizeof(kbuf), "frozen%03d", i);
+        kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+        kvs_buf_init(&vb, vbuf, sizeof(vbuf));
+
+        err = c0kvs_get(kvs, 0, &kt, 2, 0, &res, &vb, &oseqno);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(FOUND_VAL, res);
+        ASSERT_EQ(sizeof(vbuf), vb.b_len);
+    }
+
+    synchronize_rcu();
+    c0kvs_reset(kvs, 0);
+    ASSERT_FALSE(c0kvs_is_frozen(kvs));
+
+    err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(0, err);
+
+    rcu_barrier();
+    c0kvs_destroy(kvs);
+}
+
 /* Test that finalizing the kvset produces a fixated linked list
  * of cb_kv nodes in the correct order.
  */
@@ -1025,4 +1160,215 @@ MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, iterator, no_fail_pre, no_fail_post)
     c0kvs_destroy(kvs);
 }
 
+/* Test that a write batch larger than the kvset is inserted chunk by
+ * chunk, and that only a single op larger than the kvset gets EFBIG.
+ */
+MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, putdel_batch_chunk, no_fail_pre, no_fail_post)
+{
+    struct kvs_wbatch_op opv[32];
+    struct c0_kvset *    kvs;
+    char                 kbuf[32][16];
+    char *               vbuf;
+    u32                  idxv[32];
+    u32                  done, n;
+    size_t               vlen = 512 * 1024;
+    merr_t               err;
+    int                  i;
+
+    vbuf = malloc(HSE_C0_CHEAP_SZ_DFLT + 1);
+    ASSERT_NE(NULL, vbuf);
+    memset(vbuf, 'v', HSE_C0_CHEAP_SZ_DFLT + 1);
+
+    err = c0kvs_create(HSE_C0_CHEAP_SZ_DFLT, 0, 0, false, &kvs);
+    ASSERT_EQ(0, err);
+
+    memset(opv, 0, sizeof(opv));
+
+    for (i = 0; i < 32; ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "chunk%03d", i);
+        kvs_ktuple_init(&opv[i].wbo_kt, kbuf[i], strlen(kbuf[i]));
+        kvs_vtuple_init(&opv[i].wbo_vt, vbuf, vlen);
+        idxv[i] = i;
+    }
+
+    /* 16MB of values can never fit all at once...
+     */
+    err = c0kvs_putdel_batch(kvs, opv, idxv, 32, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(EFBIG, merr_errno(err));
+    ASSERT_EQ(0, c0kvs_get_element_count(kvs));
+
+    /* ...but in chunks of at most a quarter of the kvset they fill it
+     * until it runs out of room.
+     */
+    for (done = 0; done < 32; done += n) {
+        n = c0kvs_putdel_batch_chunk(kvs, opv, idxv + done, 32 - done);
+        ASSERT_GE(n, 1);
+        ASSERT_LE(n, 4);
+
+        err = c0kvs_putdel_batch(kvs, opv, idxv + done, n, HSE_ORDNL_TO_SQNREF(1));
+        if (err)
+            break;
+    }
+
+    ASSERT_EQ(ENOMEM, merr_errno(err));
+    ASSERT_GE(done, 8);
+    ASSERT_EQ(done, c0kvs_get_element_count(kvs));
+
+    synchronize_rcu();
+    c0kvs_reset(kvs, 0);
+
+    /* A chunk always takes at least one op, and an op larger than the
+     * kvset fails on its own.
+     */
+    kvs_vtuple_init(&opv[0].wbo_vt, vbuf, HSE_C0_CHEAP_SZ_DFLT + 1);
+
+    n = c0kvs_putdel_batch_chunk(kvs, opv, idxv, 32);
+    ASSERT_EQ(1, n);
+
+    err = c0kvs_putdel_batch(kvs, opv, idxv, n, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(EFBIG, merr_errno(err));
+
+    n = c0kvs_putdel_batch_chunk(kvs, opv, idxv + 1, 31);
+    err = c0kvs_putdel_batch(kvs, opv, idxv + 1, n, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(n, c0kvs_get_element_count(kvs));
+
+    rcu_barrier();
+    c0kvs_destroy(kvs);
+    free(vbuf);
+}
+
+/* Add a u64 operand to a u64 counter, a missing counter counts from 0. */
+static merr_t
+fold_add_u64(
+    const void *key,
+    size_t      klen,
+    const void *base,
+    size_t      blen,
+    const void *oper,
+    size_t      olen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    u64 sum = 0, inc;
+
+    if (base)
+        memcpy(&sum, base, sizeof(sum));
+
+    memcpy(&inc, oper, sizeof(inc));
+    sum += inc;
+
+    *rlen = sizeof(sum);
+    if (rmax >= sizeof(sum))
+        memcpy(result, &sum, sizeof(sum));
+
+    return 0;
+}
+
+static u64
+fold_get_u64(struct c0_kvset *kvs, struct kvs_ktuple *kt)
+{
+    enum key_lookup_res res;
+    struct kvs_buf      vb;
+    uintptr_t           oseqnoref;
+    u64                 val;
+    merr_t              err;
+
+    kvs_buf_init(&vb, &val, sizeof(val));
+
+    err = c0kvs_get(kvs, 0, kt, U64_MAX, 0, &res, &vb, &oseqnoref);
+    if (err || res != FOUND_VAL)
+        return U64_MAX;
+
+    return val;
+}
+
+MTF_DEFINE_UTEST_PREPOST(c0_kvset_test, fold, no_fail_pre, no_fail_post)
+{
+    struct c0kvs_fold_base base;
+    struct c0_kvset *      kvs;
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      ot, vt;
+    struct kvs_buf         rbuf;
+    u64                    inc = 1, bval = 10, val, rval;
+    merr_t                 err;
+    int                    i;
+
+    err = c0kvs_create(HSE_C0_CHEAP_SZ_DFLT, 0, 0, false, &kvs);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init(&kt, "counter", 7);
+    kvs_vtuple_init(&ot, &inc, sizeof(inc));
+    kvs_buf_init(&rbuf, &rval, sizeof(rval));
+    memset(&base, 0, sizeof(base));
+
+    /* Without the key in the set the caller must supply the base. */
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(ENOENT, merr_errno(err));
+
+    base.fb_data = &bval;
+    base.fb_len = sizeof(bval);
+    base.fb_seq = 1;
+    base.fb_valid = true;
+
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(1));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(11, fold_get_u64(kvs, &kt));
+
+    /* Later folds are based on the key's newest value in the set. */
+    memset(&base, 0, sizeof(base));
+
+    for (i = 0; i < 100; i++) {
+        err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf,
+                         HSE_ORDNL_TO_SQNREF(2 + i));
+        ASSERT_EQ(0, err);
+    }
+    ASSERT_EQ(111, fold_get_u64(kvs, &kt));
+
+    /* A base looked up at a newer view than the key's newest value
+     * in the set wins, it saw a put the set did not.
+     */
+    base.fb_data = &bval;
+    base.fb_len = sizeof(bval);
+    base.fb_seq = 200;
+    base.fb_valid = true;
+
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(200));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(11, fold_get_u64(kvs, &kt));
+
+    /* A tombstone folds as no value. */
+    memset(&base, 0, sizeof(base));
+
+    err = c0kvs_del(kvs, 0, &kt, HSE_ORDNL_TO_SQNREF(201));
+    ASSERT_EQ(0, err);
+
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(202));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(1, fold_get_u64(kvs, &kt));
+
+    /* A result that doesn't fit is reported by its length. */
+    kvs_buf_init(&rbuf, &rval, sizeof(rval) - 1);
+
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(203));
+    ASSERT_EQ(EOVERFLOW, merr_errno(err));
+    ASSERT_EQ(sizeof(rval), rbuf.b_len);
+    ASSERT_EQ(1, fold_get_u64(kvs, &kt));
+
+    /* A put lands behind, and is the base of, the next fold. */
+    val = 40;
+    kvs_vtuple_init(&vt, &val, sizeof(val));
+    kvs_buf_init(&rbuf, &rval, sizeof(rval));
+
+    err = c0kvs_put(kvs, 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(204));
+    ASSERT_EQ(0, err);
+
+    err = c0kvs_fold(kvs, 0, &kt, &ot, &base, fold_add_u64, &rbuf, HSE_ORDNL_TO_SQNREF(205));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(41, fold_get_u64(kvs, &kt));
+
+    c0kvs_destroy(kvs);
+}
+
 MTF_END_UTEST_COLLECTION(c0_kvset_test)
@@ -0,0 +1,605 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/*
+ * c0 scalability benchmark.
+ *
+ * Runs writers and readers concurrently against a single c0_kvset
+ * (c0kvs_put/c0kvs_get, i.e., one bonsai tree behind one mutex) and
+ * against a c0_kvmultiset (puts and gets spread over its kvsets by key
+ * hash), doubling the thread count from 1 up to the requested maximum.
+ * Each step reports the aggregate and per-thread throughput of puts and
+ * gets along with their latency percentiles, such that c0 index,
+ * allocator or sharding changes can be compared against a baseline.
+ *
+ * The defaults are small such that ctest runs quickly.  For meaningful
+ * numbers use a release build and something like:
+ *
+ *   c0_perf -t 128 -n 1000000 -k 16 -v 64 -r 50 -z 90 -d 2000
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_test_support/mwc_rand.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/atomic.h>
+#include <hse_util/byteorder.h>
+#include <hse_util/lathist.h>
+#include <hse_util/logging.h>
+#include <hse_util/rcu.h>
+#include <hse_util/seqno.h>
+#include <hse_util/timing.h>
+
+#include <hse/hse_limits.h>
+
+#include <hse_ikvdb/limits.h>
+#include <hse_ikvdb/tuple.h>
+#include <hse_ikvdb/c0_kvset.h>
+#include <hse_ikvdb/c0_kvmultiset.h>
+
+#include <getopt.h>
+#include <pthread.h>
+
+#define CP_KLEN_MIN sizeof(u64)
+
+enum cp_target {
+    CP_C0KVS,
+    CP_C0KVMS,
+};
+
+static struct cp_params {
+    uint   thr_max;
+    u64    keys;
+    uint   klen;
+    uint   vlen;
+    uint   read_pct;
+    uint   hot_pct;
+    uint   dur_ms;
+    uint   width;
+    size_t alloc_sz;
+    bool   c0kvs;
+    bool   c0kvms;
+    bool   lat;
+    bool   verbose;
+    u32    seed;
+
+    u8 *vbuf;
+} cp;
+
+/* One run is a fixed number of threads against a fresh c0kvs or c0kvms.
+ */
+struct cp_run {
+    enum cp_target        target;
+    struct c0_kvset *     kvs;
+    struct c0_kvmultiset *kvms;
+    atomic64_t            seqno;
+    atomic_t              stop;
+    atomic_t              full;
+    pthread_barrier_t     barrier;
+};
+
+struct cp_thr {
+    struct cp_run * run;
+    pthread_t       tid;
+    uint            idx;
+    bool            writer;
+    struct lathist *lh;
+    u64             ops;
+    u64             hits;
+    u64             nsecs;
+    merr_t          err;
+};
+
+static inline struct c0_kvset *
+cp_kvset(struct cp_run *run, const struct kvs_ktuple *kt)
+{
+    if (run->target == CP_C0KVS)
+        return run->kvs;
+
+    return c0kvms_get_hashed_c0kvset(run->kvms, kt->kt_hash);
+}
+
+/* Keys are the big-endian key index followed by filler up to klen.
+ * With hot_pct set, that percentage of the operations hits the first
+ * tenth of the keyspace.
+ */
+static inline u64
+cp_key_pick(struct mwc_rand *mwc)
+{
+    u64 hot = max_t(u64, cp.keys / 10, 1);
+
+    if (cp.hot_pct && mwc_rand32(mwc) % 100 < cp.hot_pct)
+        return mwc_rand64(mwc) % hot;
+
+    return mwc_rand64(mwc) % cp.keys;
+}
+
+static inline void
+cp_key_set(u8 *kbuf, u64 idx)
+{
+    *(u64 *)kbuf = cpu_to_be64(idx);
+}
+
+static merr_t
+cp_put(struct cp_run *run, const u8 *kbuf)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    u64               seqno;
+
+    kvs_ktuple_init(&kt, kbuf, cp.klen);
+    kvs_vtuple_init(&vt, cp.vbuf, cp.vlen);
+
+    seqno = atomic64_inc_return(&run->seqno);
+
+    return c0kvs_put(cp_kvset(run, &kt), 0, &kt, &vt, HSE_ORDNL_TO_SQNREF(seqno));
+}
+
+static merr_t
+cp_get(struct cp_run *run, const u8 *kbuf, void *vbuf, bool *found)
+{
+    struct kvs_ktuple   kt;
+    struct kvs_buf      vb;
+    enum key_lookup_res res;
+    uintptr_t           oseqnoref;
+    merr_t              err;
+
+    kvs_ktuple_init(&kt, kbuf, cp.klen);
+    kvs_buf_init(&vb, vbuf, cp.vlen);
+
+    err = c0kvs_get(cp_kvset(run, &kt), 0, &kt, U64_MAX, 0, &res, &vb, &oseqnoref);
+
+    *found = !err && res == FOUND_VAL;
+
+    return err;
+}
+
+static void *
+cp_worker(void *arg)
+{
+    struct cp_thr * thr = arg;
+    struct cp_run * run = thr->run;
+    struct mwc_rand mwc;
+    u8              kbuf[HSE_KVS_KLEN_MAX];
+    void *          vbuf;
+    u64             start, t;
+    bool            found;
+
+    mwc_rand_init(&mwc, cp.seed + thr->idx);
+    memset(kbuf, 'k', sizeof(kbuf));
+
+    vbuf = malloc(cp.vlen ?: 1);
+    if (!vbuf) {
+        thr->err = merr(ENOMEM);
+        return NULL;
+    }
+
+    pthread_barrier_wait(&run->barrier);
+
+    start = get_time_ns();
+
+    while (!atomic_read(&run->stop)) {
+        cp_key_set(kbuf, cp_key_pick(&mwc));
+
+        t = lathist_start(thr->lh);
+
+        if (thr->writer) {
+            thr->err = cp_put(run, kbuf);
+            if (thr->err) {
+                /* A full c0kvs ends the run for everyone. */
+                if (merr_errno(thr->err) == ENOMEM) {
+                    atomic_set(&run->full, 1);
+                    thr->err = 0;
+                }
+                atomic_set(&run->stop, 1);
+                break;
+            }
+        } else {
+            thr->err = cp_get(run, kbuf, vbuf, &found);
+            if (thr->err) {
+                atomic_set(&run->stop, 1);
+                break;
+            }
+            thr->hits += found;
+        }
+
+        lathist_record(thr->lh, t);
+        thr->ops++;
+    }
+
+    thr->nsecs = get_time_ns() - start;
+
+    free(vbuf);
+
+    return NULL;
+}
+
+static merr_t
+cp_run_create(struct cp_run *run, enum cp_target target)
+{
+    u8     kbuf[HSE_KVS_KLEN_MAX];
+    merr_t err;
+    u64    i;
+
+    memset(run, 0, sizeof(*run));
+    run->target = target;
+
+    if (target == CP_C0KVS)
+        err = c0kvs_create(cp.alloc_sz, NULL, NULL, false, &run->kvs);
+    else
+        err = c0kvms_create(cp.width, cp.alloc_sz, 0, &run->seqno, false, &run->kvms);
+    if (err)
+        return err;
+
+    /* Preload every key such that readers always find a value. */
+    memset(kbuf, 'k', sizeof(kbuf));
+
+    for (i = 0; i < cp.keys; i++) {
+        cp_key_set(kbuf, i);
+
+        err = cp_put(run, kbuf);
+        if (err)
+            return err;
+    }
+
+    return 0;
+}
+
+static void
+cp_run_destroy(struct cp_run *run)
+{
+    if (run->kvs)
+        c0kvs_destroy(run->kvs);
+    if (run->kvms)
+        c0kvms_putref(run->kvms);
+
+    synchronize_rcu();
+    rcu_barrier();
+}
+
+struct cp_sum {
+    u64                 ops;
+    u64                 hits;
+    double              rate;
+    double              rate_min;
+    double              rate_max;
+    struct lathist_snap snap;
+};
+
+static void
+cp_sum_add(struct cp_sum *sum, const struct cp_thr *thr)
+{
+    double rate = thr->nsecs ? thr->ops * 1e9 / thr->nsecs : 0;
+
+    if (sum->ops == 0 || rate < sum->rate_min)
+        sum->rate_min = rate;
+    if (rate > sum->rate_max)
+        sum->rate_max = rate;
+
+    sum->ops += thr->ops;
+    sum->hits += thr->hits;
+    sum->rate += rate;
+
+    if (thr->lh)
+        lathist_snap(thr->lh, &sum->snap);
+}
+
+static void
+cp_report_hdr(void)
+{
+    printf(
+        "\n# c0 scalability (rates in thousands of ops/s, latencies in ns)\n"
+        "# keys %lu klen %u vlen %u read %u%% hot %u%% duration %ums width %u seed %u\n",
+        (ulong)cp.keys,
+        cp.klen,
+        cp.vlen,
+        cp.read_pct,
+        cp.hot_pct,
+        cp.dur_ms,
+        cp.width,
+        cp.seed);
+
+    printf(
+        "%-6s %4s %4s %4s  %9s %9s %7s %7s %7s  %9s %9s %7s %7s %7s\n",
+        "Target",
+        "Thr",
+        "Wr",
+        "Rd",
+        "put/s",
+        "put/s/thr",
+        "p50",
+        "p99",
+        "p99.9",
+        "get/s",
+        "get/s/thr",
+        "p50",
+        "p99",
+        "p99.9");
+}
+
+static void
+cp_report_row(
+    const char *         name,
+    uint                 wrc,
+    uint                 rdc,
+    const struct cp_sum *put,
+    const struct cp_sum *get,
+    bool                 full)
+{
+    printf(
+        "%-6s %4u %4u %4u  %9.1f %9.1f %7lu %7lu %7lu  %9.1f %9.1f %7lu %7lu %7lu%s\n",
+        name,
+        wrc + rdc,
+        wrc,
+        rdc,
+        put->rate / 1000,
+        wrc ? put->rate / wrc / 1000 : 0,
+        (ulong)lathist_snap_pct(&put->snap, 50),
+        (ulong)lathist_snap_pct(&put->snap, 99),
+        (ulong)lathist_snap_pct(&put->snap, 99.9),
+        get->rate / 1000,
+        rdc ? get->rate / rdc / 1000 : 0,
+        (ulong)lathist_snap_pct(&get->snap, 50),
+        (ulong)lathist_snap_pct(&get->snap, 99),
+        (ulong)lathist_snap_pct(&get->snap, 99.9),
+        full ? "  (c0kvs full)" : "");
+
+    if (cp.verbose) {
+        printf(
+            "%-6s %4s %4s %4s  put/s/thr min %.1f max %.1f  get/s/thr min %.1f max %.1f"
+            "  hits %lu/%lu\n",
+            "",
+            "",
+            "",
+            "",
+            put->rate_min / 1000,
+            put->rate_max / 1000,
+            get->rate_min / 1000,
+            get->rate_max / 1000,
+            (ulong)get->hits,
+            (ulong)get->ops);
+    }
+}
+
+static void
+cp_step(struct mtf_test_info *lcl_ti, enum cp_target target, uint thrc)
+{
+    struct cp_run *run;
+    struct cp_thr *thrv;
+    struct cp_sum  put, get;
+    uint           rdc, wrc, i;
+    merr_t         err;
+    int            rc;
+
+    rdc = thrc * cp.read_pct / 100;
+    if (cp.read_pct > 0 && cp.read_pct < 100 && thrc > 1)
+        rdc = clamp_t(uint, rdc, 1, thrc - 1);
+    wrc = thrc - rdc;
+
+    run = calloc(1, sizeof(*run));
+    thrv = calloc(thrc, sizeof(*thrv));
+    ASSERT_TRUE(run && thrv);
+
+    err = cp_run_create(run, target);
+    ASSERT_EQ(0, err);
+
+    rc = pthread_barrier_init(&run->barrier, NULL, thrc + 1);
+    ASSERT_EQ(0, rc);
+
+    for (i = 0; i < thrc; i++) {
+        struct cp_thr *thr = thrv + i;
+
+        thr->run = run;
+        thr->idx = i;
+        thr->writer = i < wrc;
+
+        if (cp.lat) {
+            err = lathist_create(&thr->lh);
+            ASSERT_EQ(0, err);
+        }
+
+        rc = pthread_create(&thr->tid, NULL, cp_worker, thr);
+        ASSERT_EQ(0, rc);
+    }
+
+    pthread_barrier_wait(&run->barrier);
+    usleep(cp.dur_ms * 1000);
+    atomic_set(&run->stop, 1);
+
+    memset(&put, 0, sizeof(put));
+    memset(&get, 0, sizeof(get));
+
+    for (i = 0; i < thrc; i++) {
+        struct cp_thr *thr = thrv + i;
+
+        pthread_join(thr->tid, NULL);
+        ASSERT_EQ(0, thr->err);
+
+        cp_sum_add(thr->writer ? &put : &get, thr);
+        lathist_destroy(thr->lh);
+    }
+
+    cp_report_row(
+        target == CP_C0KVS ? "c0kvs" : "c0kvms", wrc, rdc, &put, &get, atomic_read(&run->full));
+
+    /* Readers hit preloaded keys only. */
+    ASSERT_EQ(get.ops, get.hits);
+
+    pthread_barrier_destroy(&run->barrier);
+    cp_run_destroy(run);
+    free(thrv);
+    free(run);
+}
+
+static void
+cp_sweep(struct mtf_test_info *lcl_ti, enum cp_target target)
+{
+    uint thrc;
+
+    cp_report_hdr();
+
+    for (thrc = 1; thrc < cp.thr_max; thrc *= 2)
+        cp_step(lcl_ti, target, thrc);
+
+    cp_step(lcl_ti, target, cp.thr_max);
+}
+
+#define HELP                                                               \
+    "Usage: c0_perf [ options ]\n"                                         \
+    "\n"                                                                   \
+    "This utility measures c0kvs and c0kvms put/get scalability,\n"        \
+    "doubling the number of threads from 1 to the given maximum.\n"        \
+    "\n"                                                                   \
+    "Options:\n"                                                           \
+    "  -H        // show help\n"                                           \
+    "  -t thrs   // maximum number of threads (default: 4)\n"              \
+    "  -n keys   // number of distinct keys (default: 10000)\n"            \
+    "  -k klen   // key length, at least 8 (default: 16)\n"                \
+    "  -v vlen   // value length (default: 32)\n"                          \
+    "  -r pct    // percent of threads that read (default: 50)\n"          \
+    "  -z pct    // percent of ops that hit the hottest 10% of keys\n"     \
+    "            //   (default: 0, uniform)\n"                             \
+    "  -d msecs  // duration of each step (default: 200)\n"                \
+    "  -w width  // number of c0kvsets in a c0kvms (default: 8)\n"         \
+    "  -a MiB    // cheap size of each c0kvset (default: 256)\n"           \
+    "  -m target // c0kvs, c0kvms or all (default: all)\n"                 \
+    "  -L        // do not measure latency\n"                              \
+    "  -V        // report per-thread min/max rates\n"                     \
+    "  -S seed   // random seed (default: 1)\n"
+
+static void
+help(FILE *fp, int code)
+{
+    fprintf(fp, "%s", HELP);
+    exit(code);
+}
+
+int
+test_collection_setup(struct mtf_test_info *info)
+{
+    int    argc = info->ti_coll->tci_argc;
+    char **argv = info->ti_coll->tci_argv;
+    int    opt;
+    uint   i;
+
+    hse_openlog("c0_perf", true);
+
+    cp.thr_max = 4;
+    cp.keys = 10000;
+    cp.klen = 16;
+    cp.vlen = 32;
+    cp.read_pct = 50;
+    cp.dur_ms = 200;
+    cp.width = HSE_C0_INGEST_WIDTH_DFLT;
+    cp.alloc_sz = HSE_C0_CHEAP_SZ_MAX;
+    cp.c0kvs = cp.c0kvms = true;
+    cp.lat = true;
+    cp.seed = 1;
+
+    while ((opt = getopt(argc, argv, "Ht:n:k:v:r:z:d:w:a:m:LVS:")) != -1) {
+        switch (opt) {
+            case 'H':
+                help(stdout, 0);
+                break;
+            case 't':
+                cp.thr_max = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                cp.keys = strtoull(optarg, NULL, 0);
+                break;
+            case 'k':
+                cp.klen = strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                cp.vlen = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                cp.read_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'z':
+                cp.hot_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                cp.dur_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                cp.width = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                cp.alloc_sz = strtoul(optarg, NULL, 0) << 20;
+                break;
+            case 'm':
+                cp.c0kvs = !strcmp(optarg, "c0kvs") || !strcmp(optarg, "all");
+                cp.c0kvms = !strcmp(optarg, "c0kvms") || !strcmp(optarg, "all");
+                if (!cp.c0kvs && !cp.c0kvms)
+                    help(stderr, 1);
+                break;
+            case 'L':
+                cp.lat = false;
+                break;
+            case 'V':
+                cp.verbose = true;
+                break;
+            case 'S':
+                cp.seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                help(stderr, 1);
+                break;
+        }
+    }
+
+    if (cp.thr_max < 1 || cp.keys < 1 || cp.read_pct > 100 || cp.hot_pct > 100)
+        help(stderr, 1);
+
+    if (cp.klen < CP_KLEN_MIN || cp.klen > HSE_KVS_KLEN_MAX || cp.vlen > HSE_KVS_VLEN_MAX)
+        help(stderr, 1);
+
+    if (cp.width < 1 || cp.width > HSE_C0_INGEST_WIDTH_MAX)
+        help(stderr, 1);
+
+    if (cp.alloc_sz < HSE_C0_CHEAP_SZ_MIN || cp.alloc_sz > HSE_C0_CHEAP_SZ_MAX)
+        help(stderr, 1);
+
+    cp.vbuf = malloc(cp.vlen ?: 1);
+    if (!cp.vbuf)
+        return -1;
+
+    for (i = 0; i < cp.vlen; i++)
+        cp.vbuf[i] = i;
+
+    c0kvs_init();
+
+    return 0;
+}
+
+int
+test_collection_teardown(struct mtf_test_info *info)
+{
+    c0kvs_fini();
+    free(cp.vbuf);
+
+#ifndef NDEBUG
+    printf("\nNote: this is a debug build. "
+           "Use a release build for better performance.\n\n");
+#endif
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION_PREPOST(c0_perf, test_collection_setup, test_collection_teardown);
+
+MTF_DEFINE_UTEST(c0_perf, c0kvs_perf)
+{
+    if (cp.c0kvs)
+        cp_sweep(lcl_ti, CP_C0KVS);
+}
+
+MTF_DEFINE_UTEST(c0_perf, c0kvms_perf)
+{
+    if (cp.c0kvms)
+        cp_sweep(lcl_ti, CP_C0KVMS);
+}
+
+MTF_END_UTEST_COLLECTION(c0_perf)
@@ -69,6 +69,15 @@ _kvset_builder_set_mclass(struct kvset_builder *bldr, enum mp_media_classp mclas
 {
 }
 
+void
+_kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    bldr,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+}
+
 struct mock_kvdb {
     struct c0sk *ikdb_c0sk;
 };
@@ -96,8 +105,10 @@ mocks_set(struct mtf_test_info *info)
     MOCK_SET(ikvdb, _ikvdb_get_c0sk);
     MOCK_SET(kvset_builder, _kvset_builder_create);
     MOCK_SET(kvset_builder, _kvset_builder_set_mclass);
+    MOCK_SET(kvset_builder, _kvset_builder_set_mclass_lvl);
 
     mapi_inject(mapi_idx_kvset_builder_get_mblocks, 0);
+    mapi_inject(mapi_idx_kvset_builder_get_wstats, 0);
     mapi_inject(mapi_idx_kvset_builder_add_key, 0);
     mapi_inject(mapi_idx_kvset_builder_add_val, 0);
     mapi_inject(mapi_idx_kvset_builder_add_nonval, 0);
@@ -375,6 +386,89 @@ MTF_DEFINE_UTEST_PREPOST(c0sk_test, t_sync, no_fail_pre, no_fail_post)
     destroy_mock_cn(mock_cn);
 }
 
+MTF_DEFINE_UTEST_PREPOST(c0sk_test, ingest_events, no_fail_pre, no_fail_post)
+{
+    struct c0sk_ingest_event evv[4];
+    struct kvdb_rparams      kvdb_rp;
+    struct kvs_rparams       kvs_rp;
+    struct c0 *              test_c0 = 0;
+    struct kvs_ktuple        kt = { 0 };
+    struct mock_kvdb         mkvdb;
+    struct cn *              mock_cn;
+    atomic64_t               seqno;
+    merr_t                   err;
+    uint                     evc;
+    u64                      last;
+
+    kvdb_rp = kvdb_rparams_defaults();
+    kvs_rp = kvs_rparams_defaults();
+
+    atomic64_set(&seqno, 0);
+    err = c0sk_open(&kvdb_rp, 0, "mock_mp", &mock_health, csched, &seqno, &mkvdb.ikdb_c0sk);
+    ASSERT_EQ(0, err);
+
+    err = create_mock_cn(&mock_cn, false, false, &kvs_rp, 0);
+    ASSERT_EQ(0, err);
+
+    err = c0_open((struct ikvdb *)&mkvdb, &kvs_rp, mock_cn, 0, &test_c0);
+    ASSERT_EQ(0, err);
+
+    evc = c0sk_ingest_events(mkvdb.ikdb_c0sk, 0, evv, NELEM(evv));
+    ASSERT_EQ(0, evc);
+
+    kt.kt_len = 3;
+    kt.kt_data = "foo";
+
+    err = c0_del(test_c0, &kt, HSE_SQNREF_SINGLE);
+    ASSERT_EQ(0, err);
+
+    err = c0_sync(test_c0);
+    ASSERT_EQ(0, err);
+
+    evc = c0sk_ingest_events(mkvdb.ikdb_c0sk, 0, evv, NELEM(evv));
+    ASSERT_GE(evc, 1);
+
+    last = evv[evc - 1].cie_seq;
+    ASSERT_EQ(evc, last);
+    ASSERT_GE(evv[evc - 1].cie_width, 1);
+    ASSERT_GE(evv[evc - 1].cie_kvms, 1);
+    ASSERT_GE(evv[evc - 1].cie_streams, 1);
+    ASSERT_EQ(0, evv[evc - 1].cie_errno);
+    ASSERT_NE(0, evv[evc - 1].cie_time);
+
+    /* Only the events that follow "since" are returned. */
+    evc = c0sk_ingest_events(mkvdb.ikdb_c0sk, last, evv, NELEM(evv));
+    ASSERT_EQ(0, evc);
+
+    err = c0_del(test_c0, &kt, HSE_SQNREF_SINGLE);
+    ASSERT_EQ(0, err);
+
+    err = c0_sync(test_c0);
+    ASSERT_EQ(0, err);
+
+    evc = c0sk_ingest_events(mkvdb.ikdb_c0sk, last, evv, NELEM(evv));
+    ASSERT_GE(evc, 1);
+    ASSERT_EQ(last + 1, evv[0].cie_seq);
+
+    /* A short vector gets the most recent events. */
+    last = evv[evc - 1].cie_seq;
+    evc = c0sk_ingest_events(mkvdb.ikdb_c0sk, 0, evv, 1);
+    ASSERT_EQ(1, evc);
+    ASSERT_EQ(last, evv[0].cie_seq);
+
+    ASSERT_STREQ("rcu", c0sk_ingest_stage2str(C0SK_IST_RCU));
+    ASSERT_STREQ("cninsert", c0sk_ingest_stage2str(C0SK_IST_CNINSERT));
+    ASSERT_STREQ("unknown", c0sk_ingest_stage2str(C0SK_IST_MAX));
+
+    err = c0_close(test_c0);
+    ASSERT_EQ(0, err);
+
+    err = c0sk_close(mkvdb.ikdb_c0sk);
+    ASSERT_EQ(0, err);
+
+    destroy_mock_cn(mock_cn);
+}
+
 MTF_DEFINE_UTEST_PREPOST(c0sk_test, various, no_fail_pre, no_fail_post)
 {
     struct kvdb_rparams kvdb_rp;
@@ -56,14 +56,15 @@ _cn_ingest(struct cn *cn, struct kvset_mblocks *childv, unsigned int childc, u64
 
 merr_t
 _cn_ingestv(
-    struct cn **           cn,
-    struct kvset_mblocks **mbv,
-    int *                  mbc,
-    u32 *                  vcommitted,
-    u64                    ingestid,
-    int                    ingestc,
-    bool *                 ingested,
-    u64 *                  seqno)
+    struct cn **            cn,
+    struct kvset_mblocks ** mbv,
+    int *                   mbc,
+    u32 *                   vcommitted,
+    u64                     ingestid,
+    int                     ingestc,
+    bool *                  ingested,
+    u64 *                   seqno,
+    struct cn_ingest_stats *stats)
 {
     int    i;
     merr_t err = 0;
@@ -128,6 +129,7 @@ create_mock_cn(
     mapi_inject(mapi_idx_cn_get_cnid, 1);
     mapi_inject(mapi_idx_cn_get_rp, 0);
     mapi_inject(mapi_idx_cn_get_tbkt_maint, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_vgc, 0);
 
     mapi_inject(mapi_idx_cn_disable_maint, 0);
 
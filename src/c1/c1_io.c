@@ -5,7 +5,11 @@
 
 #include <hse_ikvdb/kvb_builder.h>
 #include <hse_util/barrier.h>
+#include <hse_util/delay.h>
+#include <hse_util/rwsem.h>
+#include <hse_util/spinlock.h>
 #include <hse_ikvdb/throttle.h>
+#include <hse_ikvdb/io_sched.h>
 
 #include "c1_private.h"
 #include "c1_io_internal.h"
@@ -16,39 +20,81 @@ struct c1_ioslave;
 
 #define C1LOG_TIME (600UL * NSEC_PER_SEC)
 
+/* A group commit leader waits for up to half the average flush latency,
+ * but no more than C1_SYNC_WINDOW_MAX, for other syncs to join its flush.
+ */
+#define C1_SYNC_WINDOW_MAX (200UL * 1000)
+
+/* Number of slots in each slave's submission ring (must be a power of 2).
+ */
+#define C1_IO_RING_SIZE (1u << 10)
+
 struct c1_io {
     struct c1_thread **      c1io_thr;
     struct perfc_set         c1io_pcset;
     struct c1_tree *         c1io_tree;
     merr_t                   c1io_err;
-    atomic_t                 c1io_wakeup;
     int                      c1io_threads;
     atomic_t                 c1io_start;
     atomic_t                 c1io_stop;
     atomic_t                 c1io_stop_slave;
     u64                      c1io_dtimens;
-    struct list_head         c1io_list;
-    struct mutex             c1io_space_mtx;
-    struct mutex             c1io_sleep_mtx;
-    struct mutex             c1io_queue_mtx;
-    atomic64_t               c1io_queued_reqs;
+    struct rw_semaphore      c1io_space_rwsem;
     atomic64_t               c1io_pending_reqs;
     atomic64_t               c1io_log_time;
     atomic64_t               c1io_cumlat;
     atomic64_t               c1io_cumbytes;
     atomic64_t               c1io_maxlat;
     atomic64_t               c1io_samples;
-    struct cv                c1io_cv;
     struct c1_kvset_builder *c1io_bldr;
     struct c1_ioarg *        c1io_arg;
     struct c1_ioslave *      c1io_slave;
     struct throttle_sensor * c1io_sensor;
+    struct io_sched *        c1io_ios;
+    bool                     c1io_compress;
+
+    /* Waiters for the slaves to drain their rings, see c1_io_drain().
+     */
+    atomic_t     c1io_drain_waiters;
+    struct mutex c1io_drain_mtx;
+    struct cv    c1io_drain_cv;
+
+    /* Group commit of syncs, see c1_issue_sync().
+     */
+    struct mutex c1io_sync_mtx;
+    struct cv    c1io_sync_cv;
+    u64          c1io_sync_req;
+    u64          c1io_sync_done;
+    merr_t       c1io_sync_err;
+    bool         c1io_sync_busy;
+    uint         c1io_sync_grp;
+    u64          c1io_sync_lat;
 };
 
+struct c1_io_slot {
+    atomic64_t          c1s_seq;
+    struct c1_io_queue *c1s_q;
+};
+
+/* Each slave owns a bounded multi-producer, single-consumer ring.
+ * Producers take the mutation number of their request and claim a
+ * ticket from c1io_slave_head together under c1io_slave_lock, such that
+ * tickets follow mutation order on each mlog as replay requires.  They
+ * then publish their request into slot (ticket % C1_IO_RING_SIZE) by
+ * advancing the slot's sequence number, without the lock. The slave
+ * retires tickets in order, and c1io_slave_done counts the requests it
+ * has finished processing. c1io_slave_idle is set while the slave
+ * sleeps on c1io_slave_cv waiting for its next slot to be published.
+ */
 struct c1_ioslave {
-    struct list_head c1io_slave_list;
-    struct mutex     c1io_slave_mtx;
-    struct cv        c1io_slave_cv;
+    spinlock_t         c1io_slave_lock __aligned(SMP_CACHE_BYTES);
+    atomic64_t         c1io_slave_head;
+    atomic64_t         c1io_slave_tail __aligned(SMP_CACHE_BYTES);
+    atomic64_t         c1io_slave_done;
+    atomic_t           c1io_slave_idle;
+    struct c1_io_slot *c1io_slave_ring;
+    struct mutex       c1io_slave_mtx;
+    struct cv          c1io_slave_cv;
 };
 
 struct c1_ioarg {
@@ -60,7 +106,6 @@ struct c1_ioarg {
  * only by the c1_io_txn_* APIs.
  */
 struct c1_io_queue {
-    struct list_head         c1q_list;
     struct c1_tree *         c1q_tree;
     struct kvb_builder_iter *c1q_iter;
     struct c1_ttxn *         c1q_txn;
@@ -69,8 +114,6 @@ struct c1_io_queue {
     u64                      c1q_stime;
     int                      c1q_idx;
     int                      c1q_sync;
-    struct mutex             c1q_mtx;
-    struct cv                c1q_cv;
 };
 
 merr_t
@@ -79,9 +122,8 @@ c1_io_create(struct c1 *c1, u64 dtime, const char *mpname, int threads)
     struct c1_thread **thr = NULL;
     struct c1_io *     io;
     merr_t             err;
-    int                i;
+    int                i, j;
     struct c1_ioarg *  arg;
-    int                slavethreads = threads;
     struct c1_ioslave *slave;
 
     arg = malloc_array(threads, sizeof(*arg));
@@ -104,9 +146,6 @@ c1_io_create(struct c1 *c1, u64 dtime, const char *mpname, int threads)
         return err;
     }
 
-    /* Increment by 1 to include the master thread. */
-    ++threads;
-
     thr = malloc_array(threads, sizeof(*thr));
     if (!thr) {
         free(arg);
@@ -115,7 +154,7 @@ c1_io_create(struct c1 *c1, u64 dtime, const char *mpname, int threads)
         return merr(ev(ENOMEM));
     }
 
-    io->c1io_slave = malloc_array(slavethreads, sizeof(*io->c1io_slave));
+    io->c1io_slave = alloc_aligned(threads * sizeof(*io->c1io_slave), SMP_CACHE_BYTES, 0);
     if (!io->c1io_slave) {
         free(arg);
         c1_kvset_builder_destroy(io->c1io_bldr);
@@ -125,26 +164,20 @@ c1_io_create(struct c1 *c1, u64 dtime, const char *mpname, int threads)
     }
 
     memset(thr, 0, threads * sizeof(*thr));
+    memset(io->c1io_slave, 0, threads * sizeof(*io->c1io_slave));
 
     c1_perfc_io_alloc(&io->c1io_pcset, mpname);
 
-    /* Setting up structure per-thread structure for slave threads
-     */
-    for (i = 0; i < slavethreads; i++) {
-        arg[i].c1ioa_idx = i;
-        arg[i].c1ioa_io = io;
-    }
-
     io->c1io_dtimens = dtime * 1000UL * 1000;
     io->c1io_threads = threads;
     io->c1io_thr = thr;
     io->c1io_err = 0;
     io->c1io_tree = NULL;
+    io->c1io_compress = c1->c1_compress;
     atomic_set(&io->c1io_start, 0);
     atomic_set(&io->c1io_stop, 0);
     atomic_set(&io->c1io_stop_slave, 0);
-    atomic_set(&io->c1io_wakeup, 1);
-    atomic64_set(&io->c1io_queued_reqs, 0);
+    atomic_set(&io->c1io_drain_waiters, 0);
     atomic64_set(&io->c1io_pending_reqs, 0);
     atomic64_set(&io->c1io_log_time, get_time_ns() + C1LOG_TIME);
     atomic64_set(&io->c1io_maxlat, 0);
@@ -152,40 +185,53 @@ c1_io_create(struct c1 *c1, u64 dtime, const char *mpname, int threads)
     atomic64_set(&io->c1io_cumbytes, 0);
     atomic64_set(&io->c1io_samples, 0);
 
-    /* [HSE_REVISIT] Successive code changes made the scope of master
-     * thread to be very shallow. Consider removing it entirely in
-     * a future revision.
-     */
-    err = c1_thread_create("c1iomaster", c1_io_thread_master, io, &thr[0]);
-    if (ev(err))
-        goto err_exit;
+    init_rwsem(&io->c1io_space_rwsem);
+    mutex_init(&io->c1io_drain_mtx);
+    cv_init(&io->c1io_drain_cv, "c1io_drain_cv");
+    mutex_init(&io->c1io_sync_mtx);
+    cv_init(&io->c1io_sync_cv, "c1io_sync_cv");
 
-    /*  The structures are initiatized if master thread is created. The
-     *  thread however is executed only after c1_thread_run below. This
-     *  order helps in the cleanups.
+    /* Set up the per-slave rings before any slave thread exists so
+     * that c1_io_shutdown_threads() can tear all of them down.
      */
-    INIT_LIST_HEAD(&io->c1io_list);
-    mutex_init(&io->c1io_space_mtx);
-    mutex_init(&io->c1io_sleep_mtx);
-    mutex_init(&io->c1io_queue_mtx);
-    cv_init(&io->c1io_cv, "c1io_master_cv");
-
-    for (i = 1; i < threads; i++) {
-        err = c1_thread_create("c1ioslave", c1_io_thread_slave, &arg[i - 1], &thr[i]);
-        if (ev(err))
-            goto err_exit;
+    for (i = 0; i < threads; i++) {
+        arg[i].c1ioa_idx = i;
+        arg[i].c1ioa_io = io;
 
-        /* Initialize per-slave structure after successful
-         * thread creation
-         */
-        slave = &io->c1io_slave[i - 1];
-        INIT_LIST_HEAD(&slave->c1io_slave_list);
+        slave = &io->c1io_slave[i];
+        spin_lock_init(&slave->c1io_slave_lock);
+        atomic64_set(&slave->c1io_slave_head, 0);
+        atomic64_set(&slave->c1io_slave_tail, 0);
+        atomic64_set(&slave->c1io_slave_done, 0);
+        atomic_set(&slave->c1io_slave_idle, 0);
         mutex_init(&slave->c1io_slave_mtx);
         cv_init(&slave->c1io_slave_cv, "c1io_slave_cv");
     }
 
-    /* Barrier for per-thread structures before spawing master
-     * and slave threads.
+    for (i = 0; i < threads; i++) {
+        slave = &io->c1io_slave[i];
+
+        slave->c1io_slave_ring = malloc_array(C1_IO_RING_SIZE, sizeof(*slave->c1io_slave_ring));
+        if (!slave->c1io_slave_ring) {
+            err = merr(ev(ENOMEM));
+            goto err_exit;
+        }
+
+        for (j = 0; j < C1_IO_RING_SIZE; j++) {
+            atomic64_set(&slave->c1io_slave_ring[j].c1s_seq, j);
+            slave->c1io_slave_ring[j].c1s_q = NULL;
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        err = c1_thread_create("c1ioslave", c1_io_thread_slave, &arg[i], &thr[i]);
+        if (ev(err))
+            goto err_exit;
+
+        c1_thread_set_cpus(thr[i], c1->c1_cpus);
+    }
+
+    /* Barrier for per-thread structures before spawing slave threads.
      */
     smp_mb();
 
@@ -208,7 +254,7 @@ err_exit:
 
     c1_kvset_builder_destroy(io->c1io_bldr);
 
-    free(io->c1io_slave);
+    free_aligned(io->c1io_slave);
     free(io->c1io_arg);
     free(io);
     free(thr);
@@ -224,14 +270,14 @@ c1_io_destroy(struct c1 *c1)
     assert(!atomic_read(&io->c1io_stop));
     atomic_inc(&io->c1io_stop);
 
-    /* Stop master and slave threads
+    /* Stop slave threads
      */
     c1_io_shutdown_threads(io);
 
     c1_kvset_builder_destroy(io->c1io_bldr);
 
     free(io->c1io_thr);
-    free(io->c1io_slave);
+    free_aligned(io->c1io_slave);
     free(io->c1io_arg);
 
     c1_perfc_io_free(&io->c1io_pcset);
@@ -239,95 +285,169 @@ c1_io_destroy(struct c1 *c1)
 }
 
 void
-c1_io_thread_master(void *arg)
+c1_io_sched(struct c1 *c1, struct io_sched *ios)
 {
-    struct c1_io *      io = arg;
-    struct list_head    list;
-    u64                 cycles = 0;
-    bool                need_lock;
-    u64                 queued_reqs;
-    struct c1_io_queue *q;
-    struct c1_io_queue *qtmp;
-    struct c1_ioslave * slave;
+    if (c1 && c1->c1_io)
+        c1->c1_io->c1io_ios = ios;
+}
 
-    assert(io);
+/**
+ * c1_io_enqueue() - submit a request to the slave that owns its mlog
+ * @io: c1 io handle
+ * @q:  request, c1q_idx selects the slave
+ *
+ * Assigns the mutation number of @q.  The slave's lock is held only to
+ * pair the mutation with a ticket.  If the slave's ring is full, the
+ * caller backs off until the slave retires the slot it needs.
+ */
+static void
+c1_io_enqueue(struct c1_io *io, struct c1_io_queue *q)
+{
+    struct c1_ioslave *slave;
+    struct c1_io_slot *slot;
+    u64                ticket;
+    u64                cycles;
 
-    /* Barrier for ensuring per-thread structures are initialized
-     * by the parent thread.
+    assert(q->c1q_idx < io->c1io_threads);
+    slave = &io->c1io_slave[q->c1q_idx];
+
+    spin_lock(&slave->c1io_slave_lock);
+    q->c1q_mutation = c1_tree_next_mutation(q->c1q_tree);
+    ticket = atomic64_fetch_add(1, &slave->c1io_slave_head);
+    spin_unlock(&slave->c1io_slave_lock);
+
+    slot = &slave->c1io_slave_ring[ticket & (C1_IO_RING_SIZE - 1)];
+
+    if (atomic64_read_acq(&slot->c1s_seq) != ticket) {
+        cycles = perfc_lat_start(&io->c1io_pcset);
+
+        while (atomic64_read_acq(&slot->c1s_seq) != ticket)
+            usleep(10);
+
+        perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
+    }
+
+    atomic64_inc(&io->c1io_pending_reqs);
+    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
+
+    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
+    slot->c1s_q = q;
+    smp_wmb();
+    atomic64_set(&slot->c1s_seq, ticket + 1);
+
+    /* Pairs with the barrier in c1_io_slave_wait().
      */
     smp_mb();
 
-    assert(atomic_read(&io->c1io_start) == 1);
+    if (atomic_read(&slave->c1io_slave_idle)) {
+        mutex_lock(&slave->c1io_slave_mtx);
+        cv_signal(&slave->c1io_slave_cv);
+        mutex_unlock(&slave->c1io_slave_mtx);
+    }
+}
 
-    hse_log(HSE_DEBUG "c1 io thread starts");
+static struct c1_io_queue *
+c1_io_dequeue(struct c1_ioslave *slave)
+{
+    struct c1_io_queue *q;
+    struct c1_io_slot * slot;
+    u64                 tail;
 
-    while (1) {
-        INIT_LIST_HEAD(&list);
+    tail = atomic64_read(&slave->c1io_slave_tail);
+    slot = &slave->c1io_slave_ring[tail & (C1_IO_RING_SIZE - 1)];
 
-        need_lock = true;
-        if (!atomic64_read(&io->c1io_queued_reqs)) {
-            cycles = perfc_lat_start(&io->c1io_pcset);
-            mutex_lock(&io->c1io_queue_mtx);
+    if (atomic64_read_acq(&slot->c1s_seq) != tail + 1)
+        return NULL;
 
-            perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-            need_lock = false;
+    q = slot->c1s_q;
+    slot->c1s_q = NULL;
+    atomic64_set(&slave->c1io_slave_tail, tail + 1);
 
-            if (list_empty(&io->c1io_list)) {
-                if (atomic_read(&io->c1io_stop)) {
-                    mutex_unlock(&io->c1io_queue_mtx);
-                    hse_log(HSE_DEBUG "c1 io thread stops");
-                    return;
-                }
+    /* Hand the slot to the producer that holds the ticket one lap ahead.
+     */
+    smp_mb();
+    atomic64_set(&slot->c1s_seq, tail + C1_IO_RING_SIZE);
 
-                mutex_lock(&io->c1io_sleep_mtx);
-                atomic_set(&io->c1io_wakeup, 1);
-                mutex_unlock(&io->c1io_queue_mtx);
+    return q;
+}
 
-                cv_wait(&io->c1io_cv, &io->c1io_sleep_mtx);
+static bool
+c1_io_slave_ready(struct c1_ioslave *slave)
+{
+    struct c1_io_slot *slot;
+    u64                tail;
 
-                mutex_unlock(&io->c1io_sleep_mtx);
-                need_lock = true;
-            }
-        }
+    tail = atomic64_read(&slave->c1io_slave_tail);
+    slot = &slave->c1io_slave_ring[tail & (C1_IO_RING_SIZE - 1)];
 
-        if (need_lock) {
-            cycles = perfc_lat_start(&io->c1io_pcset);
-            mutex_lock(&io->c1io_queue_mtx);
+    return atomic64_read_acq(&slot->c1s_seq) == tail + 1;
+}
 
-            perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-        }
+static void
+c1_io_slave_wait(struct c1_io *io, struct c1_ioslave *slave)
+{
+    mutex_lock(&slave->c1io_slave_mtx);
+    atomic_set(&slave->c1io_slave_idle, 1);
 
-        atomic_set(&io->c1io_wakeup, 0);
+    /* Pairs with the barrier in c1_io_enqueue().
+     */
+    smp_mb();
 
-        if (!list_empty(&io->c1io_list)) {
-            queued_reqs = atomic64_read(&io->c1io_queued_reqs);
+    if (!c1_io_slave_ready(slave) && !atomic_read(&io->c1io_stop_slave))
+        cv_timedwait(&slave->c1io_slave_cv, &slave->c1io_slave_mtx, 100);
 
-            list_splice_tail(&io->c1io_list, &list);
-            INIT_LIST_HEAD(&io->c1io_list);
+    atomic_set(&slave->c1io_slave_idle, 0);
+    mutex_unlock(&slave->c1io_slave_mtx);
+}
 
-            atomic64_add(queued_reqs, &io->c1io_pending_reqs);
-            atomic64_sub(queued_reqs, &io->c1io_queued_reqs);
-        }
+static void
+c1_io_slave_done(struct c1_io *io, struct c1_ioslave *slave)
+{
+    atomic64_dec(&io->c1io_pending_reqs);
+    atomic64_inc(&slave->c1io_slave_done);
 
-        mutex_unlock(&io->c1io_queue_mtx);
+    /* Pairs with the barrier in c1_io_drain().
+     */
+    smp_mb();
 
-        /* Take out each request and queue them to per-slave list
-         */
-        list_for_each_entry_safe (q, qtmp, &list, c1q_list) {
-            u8 idx;
+    if (atomic_read(&io->c1io_drain_waiters)) {
+        mutex_lock(&io->c1io_drain_mtx);
+        cv_broadcast(&io->c1io_drain_cv);
+        mutex_unlock(&io->c1io_drain_mtx);
+    }
+}
 
-            idx = q->c1q_idx;
-            assert(idx < (io->c1io_threads - 1));
-            list_del_init(&q->c1q_list);
+/**
+ * c1_io_drain() - wait for all requests submitted so far to be processed
+ * @io: c1 io handle
+ *
+ * Each slave retires its tickets in order, so it suffices to wait for
+ * its done count to reach the head of its ring as sampled here.
+ */
+static void
+c1_io_drain(struct c1_io *io)
+{
+    struct c1_ioslave *slave;
+    u64                target;
+    int                i;
 
-            slave = &io->c1io_slave[idx];
+    atomic_inc(&io->c1io_drain_waiters);
 
-            mutex_lock(&slave->c1io_slave_mtx);
-            list_add_tail(&q->c1q_list, &slave->c1io_slave_list);
-            cv_signal(&slave->c1io_slave_cv);
-            mutex_unlock(&slave->c1io_slave_mtx);
-        }
+    /* Pairs with the barrier in c1_io_slave_done().
+     */
+    smp_mb();
+
+    mutex_lock(&io->c1io_drain_mtx);
+    for (i = 0; i < io->c1io_threads; i++) {
+        slave = &io->c1io_slave[i];
+        target = atomic64_read(&slave->c1io_slave_head);
+
+        while (atomic64_read(&slave->c1io_slave_done) < target)
+            cv_timedwait(&io->c1io_drain_cv, &io->c1io_drain_mtx, 10);
     }
+    mutex_unlock(&io->c1io_drain_mtx);
+
+    atomic_dec(&io->c1io_drain_waiters);
 }
 
 void
@@ -346,7 +466,7 @@ c1_io_thread_slave(void *arg)
     ioarg = arg;
     io = ioarg->c1ioa_io;
     tidx = ioarg->c1ioa_idx;
-    assert(tidx < (io->c1io_threads - 1));
+    assert(tidx < io->c1io_threads);
 
     /* Barrier for ensuring per-thread structures are initialized
      * by the parent thread.
@@ -359,26 +479,21 @@ c1_io_thread_slave(void *arg)
     hse_log(HSE_DEBUG "c1 io thread slave %d starts", tidx);
 
     while (1) {
-        mutex_lock(&slave->c1io_slave_mtx);
-
-        while (list_empty(&slave->c1io_slave_list)) {
-            if (atomic_read(&io->c1io_stop_slave)) {
-                mutex_unlock(&slave->c1io_slave_mtx);
+        q = c1_io_dequeue(slave);
+        if (!q) {
+            if (atomic_read(&io->c1io_stop_slave) &&
+                atomic64_read(&slave->c1io_slave_tail) ==
+                    atomic64_read(&slave->c1io_slave_head)) {
                 hse_log(HSE_DEBUG "c1 io thread slave %d stops", tidx);
                 return;
             }
 
-            cv_wait(&slave->c1io_slave_cv, &slave->c1io_slave_mtx);
+            c1_io_slave_wait(io, slave);
+            continue;
         }
 
-        q = list_first_entry_or_null(&slave->c1io_slave_list, struct c1_io_queue, c1q_list);
-        assert(q);
-
-        list_del(&q->c1q_list);
         err = ev(io->c1io_err);
 
-        mutex_unlock(&slave->c1io_slave_mtx);
-
         assert(tidx == q->c1q_idx);
 
         assert(atomic64_read(&io->c1io_pending_reqs) > 0);
@@ -390,33 +505,29 @@ c1_io_thread_slave(void *arg)
         }
 
         if (q->c1q_txn) {
+            int mclass = q->c1q_tree->c1t_mclass;
+
+            io_sched_enter(io->c1io_ios, mclass, IOS_C1, sizeof(*q->c1q_txn));
             err = c1_tree_issue_txn(
                 q->c1q_tree, q->c1q_idx, q->c1q_mutation, q->c1q_txn, q->c1q_sync);
+            io_sched_exit(io->c1io_ios, mclass);
             if (err) {
                 hse_elog(HSE_ERR "%s: c1 log failed : @@e", err, __func__);
                 io->c1io_err = err;
                 perfc_inc(&io->c1io_pcset, PERFC_BA_C1_IOERR);
             }
 
-            atomic64_dec(&io->c1io_pending_reqs);
-
             c1_io_rec_perf(io, q, start, err);
 
             free(q->c1q_txn);
             free(q);
 
+            c1_io_slave_done(io, slave);
             continue;
         }
 
         iter = q->c1q_iter;
-        if (c1_sync_or_flush_command(iter)) {
-
-            mutex_lock(&q->c1q_mtx);
-            cv_signal(&q->c1q_cv);
-            mutex_unlock(&q->c1q_mtx);
-            atomic64_dec(&io->c1io_pending_reqs);
-            continue;
-        }
+        assert(!c1_sync_or_flush_command(iter));
 
         if (!err) {
             c1_io_iter_kvbtxn(io, q, tidx);
@@ -428,8 +539,8 @@ c1_io_thread_slave(void *arg)
             iter->put(iter);
         }
 
-        atomic64_dec(&io->c1io_pending_reqs);
         free(q);
+        c1_io_slave_done(io, slave);
     }
 }
 
@@ -466,15 +577,49 @@ c1_io_next_tree(struct c1 *c1, struct c1_tree *cur)
     return 0;
 }
 
+/**
+ * c1_io_switch_tree() - replace an exhausted c1 tree
+ * @c1:  c1 handle
+ * @cur: tree on which the caller's reservation failed
+ *
+ * Called with the space lock held for read, and returns with it held
+ * for read.  Reservations run concurrently under the read lock, so many
+ * callers can find @cur exhausted at once.  They serialize on the write
+ * lock, and only the first of them allocates the next tree.
+ */
+static merr_t
+c1_io_switch_tree(struct c1 *c1, struct c1_tree *cur)
+{
+    struct c1_io *io = c1->c1_io;
+    merr_t        err = 0;
+    u64           ns;
+
+    up_read(&io->c1io_space_rwsem);
+    down_write(&io->c1io_space_rwsem);
+
+    if (c1_current_tree(c1) == cur) {
+        ns = perfc_lat_start(&io->c1io_pcset);
+        err = c1_io_next_tree(c1, cur);
+        if (!ev(err)) {
+            ns = perfc_lat_start(&io->c1io_pcset) - ns;
+            perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_TREE, ns);
+        }
+    }
+
+    up_write(&io->c1io_space_rwsem);
+    down_read(&io->c1io_space_rwsem);
+
+    return err;
+}
+
 merr_t
-c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx, u64 *mutation)
+c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx)
 {
     struct c1_tree *tree;
     struct c1_io *  io;
 
     merr_t err = 0;
     u32    recsz;
-    u64    ns;
 
     io = c1->c1_io;
 
@@ -498,7 +643,7 @@ c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx, u64
             /* If space was successfully reserved from c1 tree,
              * then reserve it from mlog for the tx records.
              */
-            err = c1_tree_reserve_space(tree, recsz, idx, mutation, true);
+            err = c1_tree_reserve_space(tree, recsz, idx, true);
             if (!err)
                 break;
 
@@ -510,32 +655,29 @@ c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx, u64
              */
         }
 
-        ns = perfc_lat_start(&io->c1io_pcset);
-
         /* If either c1 tree or mlog reservation fails, retry with
          * the next c1 tree.
          */
-        err = c1_io_next_tree(c1, tree);
+        err = c1_io_switch_tree(c1, tree);
         if (ev(err))
             return err;
-        ns = perfc_lat_start(&io->c1io_pcset) - ns;
-        perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_TREE, ns);
     }
 
     *out = tree;
     io->c1io_tree = tree;
 
+    c1_throttle_update(c1, tree);
+
     return 0;
 }
 
 merr_t
-c1_io_get_tree(struct c1 *c1, u64 size, bool txn, struct c1_tree **out, int *idx, u64 *mutation)
+c1_io_get_tree(struct c1 *c1, u64 size, bool txn, struct c1_tree **out, int *idx)
 {
     struct c1_tree *tree;
     struct c1_io *  io;
 
     merr_t err;
-    u64    ns;
 
     io = c1->c1_io;
 
@@ -545,41 +687,30 @@ c1_io_get_tree(struct c1 *c1, u64 size, bool txn, struct c1_tree **out, int *idx
         assert(tree != NULL);
 
         /* Reserve space from mlog. */
-        err = c1_tree_reserve_space(tree, size, idx, mutation, txn);
+        err = c1_tree_reserve_space(tree, size, idx, txn);
         if (!err)
             break;
 
         if (ev(merr_errno(err) != ENOMEM))
             return err;
 
-        ns = perfc_lat_start(&io->c1io_pcset);
-        err = c1_io_next_tree(c1, tree);
+        err = c1_io_switch_tree(c1, tree);
         if (ev(err))
             return err;
-        ns = perfc_lat_start(&io->c1io_pcset) - ns;
-        perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_TREE, ns);
     }
 
     *out = tree;
     io->c1io_tree = tree;
 
+    c1_throttle_update(c1, tree);
+
     return 0;
 }
 
 bool
 c1_io_pending_reqs(struct c1_io *io)
 {
-    return (atomic64_read(&io->c1io_queued_reqs) || atomic64_read(&io->c1io_pending_reqs));
-}
-
-void
-c1_io_wakeup(struct c1_io *io)
-{
-    if (atomic_read(&io->c1io_wakeup)) {
-        mutex_lock(&io->c1io_sleep_mtx);
-        cv_signal(&io->c1io_cv);
-        mutex_unlock(&io->c1io_sleep_mtx);
-    }
+    return atomic64_read(&io->c1io_pending_reqs);
 }
 
 void
@@ -620,6 +751,7 @@ c1_io_iter_kvbtxn(struct c1_io *io, struct c1_io_queue *q, u8 tidx)
         if (iter->kvbi_bldrelm)
             assert(c1_kvset_builder_elem_valid(iter->kvbi_bldrelm, iter->kvbi_ingestid));
 
+        io_sched_enter(io->c1io_ios, q->c1q_tree->c1t_mclass, IOS_C1, kvb->c1kvb_size);
         err = c1_tree_issue_kvb(
             q->c1q_tree,
             iter->kvbi_bldrelm,
@@ -630,8 +762,10 @@ c1_io_iter_kvbtxn(struct c1_io *io, struct c1_io_queue *q, u8 tidx)
             q->c1q_mutation,
             kvb,
             q->c1q_sync,
+            io->c1io_compress,
             tidx,
             statsp);
+        io_sched_exit(io->c1io_ios, q->c1q_tree->c1t_mclass);
         if (ev(err)) {
             iter->put(iter);
             io->c1io_err = err;
@@ -651,76 +785,108 @@ c1_sync_or_flush_command(struct kvb_builder_iter *iter)
     return iter == NULL;
 }
 
-merr_t
-c1_issue_sync(struct c1 *c1, int sync)
+static merr_t
+c1_io_log_flush(struct c1 *c1)
 {
-    struct c1_io_queue *q;
-    struct c1_io *      io;
-    merr_t              err;
-    u64                 cycles = 0;
-
-    io = c1->c1_io;
+    struct c1_io *io = c1->c1_io;
+    merr_t        err;
+    u64           cycles;
 
-    if (sync == C1_INGEST_FLUSH)
-        return io->c1io_err;
+    down_write(&io->c1io_space_rwsem);
+    cycles = perfc_lat_start(&io->c1io_pcset);
+    err = c1_tree_flush(c1_current_tree(c1));
+    if (!ev(err)) {
+        perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_MLGFL, cycles);
+        cycles = perfc_lat_start(&io->c1io_pcset);
+        err = c1_kvset_builder_flush(io->c1io_bldr);
+        if (merr_errno(err) == ENOENT)
+            err = 0;
+        if (!ev(err))
+            perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_MB2FL, cycles);
+    }
+    up_write(&io->c1io_space_rwsem);
 
-    if (!c1_io_pending_reqs(io))
-        goto log_flush;
+    return err;
+}
 
-    q = malloc(sizeof(*q));
-    if (!q)
-        return merr(ev(ENOMEM));
+/**
+ * c1_io_group_flush() - make everything logged so far durable
+ * @c1: c1 handle
+ *
+ * Each caller takes a ticket.  The first caller to find no flush in
+ * progress leads a group: it waits a short window sized from the
+ * observed flush latency for other callers to join, then issues one
+ * flush on behalf of all tickets taken before it started.  Callers
+ * are released once a flush that started after their ticket completes.
+ */
+static merr_t
+c1_io_group_flush(struct c1 *c1)
+{
+    struct c1_io *io = c1->c1_io;
+    u64           ticket, target, window, start;
+    merr_t        err;
 
-    INIT_LIST_HEAD(&q->c1q_list);
-    q->c1q_sync = sync;
-    q->c1q_iter = NULL;
-    q->c1q_txn = NULL;
-    q->c1q_idx = 0;
+    mutex_lock(&io->c1io_sync_mtx);
+    ticket = ++io->c1io_sync_req;
 
-    mutex_init(&q->c1q_mtx);
-    cv_init(&q->c1q_cv, "c1synccv");
+    while (io->c1io_sync_done < ticket) {
+        if (io->c1io_sync_busy) {
+            cv_wait(&io->c1io_sync_cv, &io->c1io_sync_mtx);
+            continue;
+        }
 
-    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
+        io->c1io_sync_busy = true;
 
-    mutex_lock(&io->c1io_queue_mtx);
-    perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, q->c1q_stime);
+        /* Only wait for joiners if the previous group had any.
+         */
+        window = 0;
+        if (io->c1io_sync_grp > 1)
+            window = min_t(u64, io->c1io_sync_lat / 2, C1_SYNC_WINDOW_MAX);
+        mutex_unlock(&io->c1io_sync_mtx);
+
+        if (window > 0)
+            usleep(window / 1000);
+
+        mutex_lock(&io->c1io_sync_mtx);
+        target = io->c1io_sync_req;
+        mutex_unlock(&io->c1io_sync_mtx);
+
+        start = get_time_ns();
+        err = c1_io_log_flush(c1);
+        start = get_time_ns() - start;
+
+        mutex_lock(&io->c1io_sync_mtx);
+        io->c1io_sync_grp = target - io->c1io_sync_done;
+        io->c1io_sync_done = target;
+        io->c1io_sync_err = err;
+        io->c1io_sync_lat = (io->c1io_sync_lat * 7 + start) / 8;
+        io->c1io_sync_busy = false;
+        cv_broadcast(&io->c1io_sync_cv);
+    }
 
-    list_add_tail(&q->c1q_list, &io->c1io_list);
-    atomic64_inc(&io->c1io_queued_reqs);
-    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
+    err = io->c1io_sync_err;
+    mutex_unlock(&io->c1io_sync_mtx);
 
-    mutex_lock(&q->c1q_mtx);
+    return err;
+}
 
-    mutex_unlock(&io->c1io_queue_mtx);
-    c1_io_wakeup(io);
+merr_t
+c1_issue_sync(struct c1 *c1, int sync)
+{
+    struct c1_io *io;
 
-    cv_wait(&q->c1q_cv, &q->c1q_mtx);
-    mutex_unlock(&q->c1q_mtx);
+    io = c1->c1_io;
 
-    cv_destroy(&q->c1q_cv);
-    mutex_destroy(&q->c1q_mtx);
+    if (sync == C1_INGEST_FLUSH)
+        return io->c1io_err;
 
-    free(q);
+    if (c1_io_pending_reqs(io))
+        c1_io_drain(io);
 
     if (ev(io->c1io_err))
         return io->c1io_err;
 
-log_flush:
-    mutex_lock(&io->c1io_space_mtx);
-    cycles = perfc_lat_start(&io->c1io_pcset);
-    err = c1_tree_flush(c1_current_tree(c1));
-    if (!ev(err)) {
-        perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_MLGFL, cycles);
-        cycles = perfc_lat_start(&io->c1io_pcset);
-        err = c1_kvset_builder_flush(io->c1io_bldr);
-        if (merr_errno(err) == ENOENT)
-            err = 0;
-        if (!ev(err))
-            perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_MB2FL, cycles);
-    }
-    mutex_unlock(&io->c1io_space_mtx);
-
-    return err;
+    return c1_io_group_flush(c1);
 }
 
 merr_t
@@ -753,7 +919,6 @@ c1_issue_iter(struct c1 *c1, struct kvb_builder_iter *iter, u64 txnid, u64 size,
     if (!q)
         return merr(ev(ENOMEM));
 
-    INIT_LIST_HEAD(&q->c1q_list);
     q->c1q_sync = sync;
     q->c1q_iter = iter;
     q->c1q_txnid = txnid;
@@ -761,12 +926,12 @@ c1_issue_iter(struct c1 *c1, struct kvb_builder_iter *iter, u64 txnid, u64 size,
     q->c1q_idx = 0;
 
     cycles = perfc_lat_startu(&io->c1io_pcset, PERFC_LT_C1_IOSLK);
-    mutex_lock(&io->c1io_space_mtx);
+    down_read(&io->c1io_space_rwsem);
     perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOSLK, cycles);
 
-    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx, &q->c1q_mutation);
+    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx);
     if (ev(err)) {
-        mutex_unlock(&io->c1io_space_mtx);
+        up_read(&io->c1io_space_rwsem);
         free(q);
 
         if (bldr)
@@ -776,14 +941,8 @@ c1_issue_iter(struct c1 *c1, struct kvb_builder_iter *iter, u64 txnid, u64 size,
         return err;
     }
 
-    cycles = perfc_lat_startu(&io->c1io_pcset, PERFC_LT_C1_IOQLK);
-    mutex_lock(&io->c1io_queue_mtx);
-    perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-
-    mutex_unlock(&io->c1io_space_mtx);
-
     if (ev(io->c1io_err)) {
-        mutex_unlock(&io->c1io_queue_mtx);
+        up_read(&io->c1io_space_rwsem);
 
         free(q);
 
@@ -794,13 +953,8 @@ c1_issue_iter(struct c1 *c1, struct kvb_builder_iter *iter, u64 txnid, u64 size,
         return io->c1io_err;
     }
 
-    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
-    list_add_tail(&q->c1q_list, &io->c1io_list);
-    atomic64_inc(&io->c1io_queued_reqs);
-    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
-    mutex_unlock(&io->c1io_queue_mtx);
-
-    c1_io_wakeup(io);
+    c1_io_enqueue(io, q);
+    up_read(&io->c1io_space_rwsem);
 
     return 0;
 }
@@ -830,45 +984,33 @@ c1_io_txn_begin(struct c1 *c1, u64 txnid, u64 size, int sync)
     txn->c1t_cmd = C1_TYPE_TXN_BEGIN;
     txn->c1t_flag = sync;
 
-    INIT_LIST_HEAD(&q->c1q_list);
     q->c1q_sync = sync;
     q->c1q_txn = txn;
     q->c1q_iter = NULL;
     q->c1q_idx = 0;
 
-    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
-
     cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_space_mtx);
+    down_read(&io->c1io_space_rwsem);
     perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOSLK, cycles);
 
-    err = c1_io_get_tree_txn(c1, size, &q->c1q_tree, &q->c1q_idx, &q->c1q_mutation);
+    err = c1_io_get_tree_txn(c1, size, &q->c1q_tree, &q->c1q_idx);
     if (ev(err)) {
-        mutex_unlock(&io->c1io_space_mtx);
+        up_read(&io->c1io_space_rwsem);
         goto err_exit;
     }
 
     txn->c1t_segno = q->c1q_tree->c1t_seqno;
     txn->c1t_gen = q->c1q_tree->c1t_gen;
 
-    cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_queue_mtx);
-    perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-
-    mutex_unlock(&io->c1io_space_mtx);
-
     if (ev(io->c1io_err)) {
-        mutex_unlock(&io->c1io_queue_mtx);
+        up_read(&io->c1io_space_rwsem);
         err = io->c1io_err;
         goto err_exit;
     }
 
-    list_add_tail(&q->c1q_list, &io->c1io_list);
-    atomic64_inc(&io->c1io_queued_reqs);
-    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
+    c1_io_enqueue(io, q);
     perfc_inc(&c1->c1_pcset_op, PERFC_RA_C1_TXBEG);
-    mutex_unlock(&io->c1io_queue_mtx);
-    c1_io_wakeup(io);
+    up_read(&io->c1io_space_rwsem);
 
     return 0;
 
@@ -910,19 +1052,18 @@ c1_io_txn_commit(struct c1 *c1, u64 txnid, u64 seqno, int sync)
     txn->c1t_cmd = C1_TYPE_TXN_COMMIT;
     txn->c1t_flag = sync;
 
-    INIT_LIST_HEAD(&q->c1q_list);
     q->c1q_sync = sync;
     q->c1q_txn = txn;
     q->c1q_iter = NULL;
     q->c1q_idx = 0;
 
     cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_space_mtx);
+    down_read(&io->c1io_space_rwsem);
     perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOSLK, cycles);
 
-    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx, &q->c1q_mutation);
+    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx);
     if (ev(err)) {
-        mutex_unlock(&io->c1io_space_mtx);
+        up_read(&io->c1io_space_rwsem);
         free(txn);
         free(q);
         return err;
@@ -931,27 +1072,17 @@ c1_io_txn_commit(struct c1 *c1, u64 txnid, u64 seqno, int sync)
     txn->c1t_segno = q->c1q_tree->c1t_seqno;
     txn->c1t_gen = q->c1q_tree->c1t_gen;
 
-    cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_queue_mtx);
-    perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-
-    mutex_unlock(&io->c1io_space_mtx);
-
     if (ev(io->c1io_err)) {
-        mutex_unlock(&io->c1io_queue_mtx);
+        up_read(&io->c1io_space_rwsem);
 
         free(txn);
         free(q);
         return io->c1io_err;
     }
 
-    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
-    list_add_tail(&q->c1q_list, &io->c1io_list);
-    atomic64_inc(&io->c1io_queued_reqs);
-    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
+    c1_io_enqueue(io, q);
     perfc_inc(&c1->c1_pcset_op, PERFC_RA_C1_TXCOM);
-    mutex_unlock(&io->c1io_queue_mtx);
-    c1_io_wakeup(io);
+    up_read(&io->c1io_space_rwsem);
 
     if (sync != C1_TXN_SYNC)
         return 0;
@@ -965,51 +1096,39 @@ c1_io_shutdown_threads(struct c1_io *io)
     struct c1_ioslave *slave;
     int                i;
 
-    /* If there is no master thread, there will be no slaves either.
-     */
-    if (!io->c1io_thr || !io->c1io_thr[0])
+    if (!io->c1io_thr)
         return;
 
     assert(io->c1io_slave);
 
-    /* Stop master thread
-     */
-    mutex_lock(&io->c1io_sleep_mtx);
-    cv_broadcast(&io->c1io_cv);
-    mutex_unlock(&io->c1io_sleep_mtx);
-    c1_thread_destroy(io->c1io_thr[0]);
-
-    /* Master thread is stopped. It must have transferred the last
-     * request (if any) to slaves' queue. This will avoid a case
-     * where the slaves are stopped with master having pending
-     * requests in its queue.
+    /* Slaves drain their rings before they stop.
      */
     atomic_inc(&io->c1io_stop_slave);
 
-    /* Stop slave threads
-     */
-    for (i = 1; i < io->c1io_threads; i++) {
+    for (i = 0; i < io->c1io_threads; i++) {
         if (io->c1io_thr[i]) {
-            slave = &io->c1io_slave[i - 1];
+            slave = &io->c1io_slave[i];
             mutex_lock(&slave->c1io_slave_mtx);
             cv_signal(&slave->c1io_slave_cv);
             mutex_unlock(&slave->c1io_slave_mtx);
         }
     }
 
-    for (i = 1; i < io->c1io_threads; i++) {
-        if (io->c1io_thr[i]) {
-            slave = &io->c1io_slave[i - 1];
+    for (i = 0; i < io->c1io_threads; i++) {
+        slave = &io->c1io_slave[i];
+
+        if (io->c1io_thr[i])
             c1_thread_destroy(io->c1io_thr[i]);
-            mutex_destroy(&slave->c1io_slave_mtx);
-            cv_destroy(&slave->c1io_slave_cv);
-        }
+
+        mutex_destroy(&slave->c1io_slave_mtx);
+        cv_destroy(&slave->c1io_slave_cv);
+        free(slave->c1io_slave_ring);
     }
 
-    mutex_destroy(&io->c1io_space_mtx);
-    mutex_destroy(&io->c1io_sleep_mtx);
-    mutex_destroy(&io->c1io_queue_mtx);
-    cv_destroy(&io->c1io_cv);
+    mutex_destroy(&io->c1io_drain_mtx);
+    cv_destroy(&io->c1io_drain_cv);
+    mutex_destroy(&io->c1io_sync_mtx);
+    cv_destroy(&io->c1io_sync_cv);
 }
 
 BullseyeCoverageSaveOff merr_t
@@ -1044,19 +1163,18 @@ c1_io_txn_abort(struct c1 *c1, u64 txnid)
     txn->c1t_cmd = C1_TYPE_TXN_ABORT;
     txn->c1t_flag = C1_TXN_NONE;
 
-    INIT_LIST_HEAD(&q->c1q_list);
     q->c1q_sync = 0;
     q->c1q_txn = txn;
     q->c1q_iter = NULL;
     q->c1q_idx = 0;
 
     cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_space_mtx);
+    down_read(&io->c1io_space_rwsem);
     perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOSLK, cycles);
 
-    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx, &q->c1q_mutation);
+    err = c1_io_get_tree(c1, size, (txnid != 0), &q->c1q_tree, &q->c1q_idx);
     if (ev(err)) {
-        mutex_unlock(&io->c1io_space_mtx);
+        up_read(&io->c1io_space_rwsem);
 
         free(txn);
         free(q);
@@ -1066,27 +1184,17 @@ c1_io_txn_abort(struct c1 *c1, u64 txnid)
     txn->c1t_segno = q->c1q_tree->c1t_seqno;
     txn->c1t_gen = q->c1q_tree->c1t_gen;
 
-    cycles = perfc_lat_start(&io->c1io_pcset);
-    mutex_lock(&io->c1io_queue_mtx);
-    perfc_rec_lat(&io->c1io_pcset, PERFC_LT_C1_IOQLK, cycles);
-
-    mutex_unlock(&io->c1io_space_mtx);
     if (ev(io->c1io_err)) {
-        mutex_unlock(&io->c1io_queue_mtx);
+        up_read(&io->c1io_space_rwsem);
 
         free(txn);
         free(q);
         return io->c1io_err;
     }
 
-    q->c1q_stime = perfc_lat_start(&io->c1io_pcset);
-    list_add_tail(&q->c1q_list, &io->c1io_list);
-    atomic64_inc(&io->c1io_queued_reqs);
-    perfc_inc(&io->c1io_pcset, PERFC_RA_C1_IOQUE);
+    c1_io_enqueue(io, q);
     perfc_inc(&c1->c1_pcset_op, PERFC_RA_C1_TXABT);
-    mutex_unlock(&io->c1io_queue_mtx);
-
-    c1_io_wakeup(io);
+    up_read(&io->c1io_space_rwsem);
 
     return 0;
 }
@@ -1157,6 +1265,7 @@ ci_io_iter_update_stats(struct c1_io *io, struct c1_log_stats *statsp, u64 size)
         perfc_add(&io->c1io_pcset, PERFC_BA_C1_IOMLG, statsp->c1log_mlwrites);
         perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_IOMLG, statsp->c1log_mllatency);
         perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_IOVSZ, statsp->c1log_vsize);
+        perfc_rec_sample(&io->c1io_pcset, PERFC_DI_C1_APPSZ, statsp->c1log_appbytes);
     }
 
     latency = max_t(u64, statsp->c1log_mblatency, statsp->c1log_mllatency);
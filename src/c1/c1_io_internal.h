@@ -6,9 +6,6 @@
 #ifndef HSE_C1_IO_INTERNAL_H
 #define HSE_C1_IO_INTERNAL_H
 
-void
-c1_io_thread_master(void *arg);
-
 void
 c1_io_thread_slave(void *arg);
 
@@ -16,10 +13,10 @@ void
 c1_io_shutdown_threads(struct c1_io *io);
 
 merr_t
-c1_io_get_tree(struct c1 *c1, u64 size, bool txn, struct c1_tree **out, int *idx, u64 *mutation);
+c1_io_get_tree(struct c1 *c1, u64 size, bool txn, struct c1_tree **out, int *idx);
 
 merr_t
-c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx, u64 *mutation);
+c1_io_get_tree_txn(struct c1 *c1, u64 size, struct c1_tree **out, int *idx);
 
 void
 c1_io_iter_kvbtxn(struct c1_io *io, struct c1_io_queue *q, u8 tidx);
@@ -6,6 +6,8 @@
 #include "c1_private.h"
 #include "c1_kv_internal.h"
 
+#include <hse_ikvdb/kvdb_perfc.h>
+
 _Static_assert(
     (HSE_C1_CACHE_SIZE / HSE_C1_DEFAULT_STRIPE_WIDTH) >=
         (sizeof(struct c1_kvbundle) +
@@ -26,6 +28,8 @@ c1_kvcache_create_internal(struct c1_kvcache *cc, size_t alloc_sz)
 
     cc->c1kvc_cheap = cheap;
 
+    kvdb_memacct_alloc(KVDB_MEMACCT_C1, alloc_sz);
+
     return 0;
 }
 
@@ -55,6 +59,8 @@ c1_kvcache_destroy_internal(struct c1_kvcache *cc)
 {
     mutex_destroy(&cc->c1kvc_lock);
     cheap_destroy(cc->c1kvc_cheap);
+
+    kvdb_memacct_free(KVDB_MEMACCT_C1, HSE_C1_CACHE_SIZE / HSE_C1_DEFAULT_STRIPE_WIDTH);
 }
 BullseyeCoverageRestore
 
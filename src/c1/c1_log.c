@@ -3,9 +3,12 @@
  * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
  */
 
+#include <hse_util/compression.h>
+
 #include <mpool/mpool.h>
 
 #include "c1_private.h"
+#include "c1_pmem.h"
 #include "../cn/cn_metrics.h"
 
 static merr_t
@@ -14,6 +17,61 @@ c1_log_open_impl(struct c1_log *log);
 static merr_t
 c1_log_close_impl(struct c1_log *log);
 
+static merr_t
+c1_log_appendv(struct c1_log *log, struct iovec *iov, size_t buflen, bool sync)
+{
+    if (log->c1l_pmem)
+        return c1_pmem_append(log->c1l_pmem, iov, buflen, sync);
+
+    return mpool_mlog_append_datav(log->c1l_ds, log->c1l_mlh, iov, buflen, sync);
+}
+
+static merr_t
+c1_log_append(struct c1_log *log, void *data, size_t len, bool sync)
+{
+    struct iovec iov;
+
+    if (log->c1l_pmem) {
+        iov.iov_base = data;
+        iov.iov_len = len;
+
+        return c1_pmem_append(log->c1l_pmem, &iov, len, sync);
+    }
+
+    return mpool_mlog_append_data(log->c1l_ds, log->c1l_mlh, data, len, sync);
+}
+
+static merr_t
+c1_log_len(struct c1_log *log, size_t *len)
+{
+    if (log->c1l_pmem) {
+        *len = c1_pmem_len(log->c1l_pmem);
+        return 0;
+    }
+
+    return mpool_mlog_len(log->c1l_ds, log->c1l_mlh, len);
+}
+
+merr_t
+c1_log_read_init(struct c1_log *log)
+{
+    if (log->c1l_pmem) {
+        c1_pmem_read_init(log->c1l_pmem);
+        return 0;
+    }
+
+    return mpool_mlog_read_data_init(log->c1l_ds, log->c1l_mlh);
+}
+
+merr_t
+c1_log_read_next(struct c1_log *log, u64 seek, void *data, size_t len, size_t *len_read)
+{
+    if (log->c1l_pmem)
+        return c1_pmem_read_next(log->c1l_pmem, seek, data, len, len_read);
+
+    return mpool_mlog_seek_read_data_next(log->c1l_ds, log->c1l_mlh, seek, data, len, len_read);
+}
+
 merr_t
 c1_log_create(struct mpool *ds, u64 capacity, int *mclass, struct c1_log_desc *desc)
 {
@@ -79,6 +137,8 @@ c1_log_abort(struct mpool *ds, struct c1_log_desc *desc)
         return err;
     }
 
+    c1_pmem_destroy(ds, oid);
+
     return 0;
 }
 
@@ -107,6 +167,8 @@ c1_log_destroy(struct mpool *ds, struct c1_log_desc *desc)
         return err;
     }
 
+    c1_pmem_destroy(ds, oid);
+
     return 0;
 }
 
@@ -140,6 +202,7 @@ c1_log_alloc(
     log->c1l_space = capacity;
     log->c1l_ds = ds;
     log->c1l_mlh = NULL;
+    log->c1l_pmem = NULL;
     log->c1l_maxkv_seqno = C1_INVALID_SEQNO;
     log->c1l_repbuf = 0;
     log->c1l_repbuflen = 0;
@@ -197,9 +260,9 @@ c1_log_format(struct c1_log *log)
     omf_set_c1kvlog_size(&kv, log->c1l_space);
     omf_set_c1kvlog_seqno(&kv, log->c1l_seqno);
 
-    err = mpool_mlog_append_data(log->c1l_ds, log->c1l_mlh, &kv, sizeof(kv), true);
+    err = c1_log_append(log, &kv, sizeof(kv), true);
     if (ev(err))
-        hse_elog(HSE_ERR "%s: mpool_mlog_append_data failed: @@e", err, __func__);
+        hse_elog(HSE_ERR "%s: log append failed: @@e", err, __func__);
 
     return err;
 }
@@ -214,8 +277,9 @@ c1_log_make(
     struct c1_log_desc *desc,
     u64                 capacity)
 {
-    merr_t         err;
-    struct c1_log *log = NULL;
+    merr_t          err;
+    struct c1_log * log = NULL;
+    struct c1_pmem *pm;
 
     err = mpool_mlog_commit(ds, desc->c1_mlh);
     if (ev(err)) {
@@ -234,6 +298,14 @@ c1_log_make(
 
     desc->c1_mlh = NULL;
 
+    /* The log's records go to pmem from now on if configured for @ds.
+     */
+    err = c1_pmem_open(ds, desc->c1_oid, capacity, true, &pm);
+    if (ev(err))
+        return err;
+
+    c1_pmem_close(pm);
+
     /* logs are allocated and freed as part of c1_tree_create() and c1_tree_destroy() */
     err = c1_log_alloc(ds, seqno, gen, mdcoid1, mdcoid2, desc->c1_oid, capacity, &log);
     if (ev(err))
@@ -305,6 +377,14 @@ c1_log_open_impl(struct c1_log *log)
         return err;
     }
 
+    err = c1_pmem_open(log->c1l_ds, log->c1l_oid, 0, false, &log->c1l_pmem);
+    if (ev(err)) {
+        mpool_mlog_close(log->c1l_ds, mlh);
+        mpool_mlog_put(log->c1l_ds, mlh);
+        log->c1l_mlh = NULL;
+        return err;
+    }
+
     return 0;
 }
 
@@ -331,6 +411,9 @@ c1_log_close_impl(struct c1_log *log)
     if (log->c1l_mlh == NULL)
         return 0;
 
+    c1_pmem_close(log->c1l_pmem);
+    log->c1l_pmem = NULL;
+
     err = mpool_mlog_close(log->c1l_ds, log->c1l_mlh);
     if (ev(err)) {
         hse_elog(HSE_ERR "%s: mpool_mlog_close failed: @@e", err, __func__);
@@ -352,7 +435,10 @@ c1_log_reset(struct c1_log *log, u64 newseqno, u64 newgen)
     merr_t err;
     int    i;
 
-    err = mpool_mlog_erase(log->c1l_ds, log->c1l_mlh, 0);
+    if (log->c1l_pmem)
+        err = c1_pmem_erase(log->c1l_pmem);
+    else
+        err = mpool_mlog_erase(log->c1l_ds, log->c1l_mlh, 0);
     if (ev(err))
         return err;
 
@@ -376,7 +462,10 @@ BullseyeCoverageRestore
 {
     merr_t err;
 
-    err = mpool_mlog_flush(log->c1l_ds, log->c1l_mlh);
+    if (log->c1l_pmem)
+        err = c1_pmem_flush(log->c1l_pmem);
+    else
+        err = mpool_mlog_flush(log->c1l_ds, log->c1l_mlh);
     if (ev(err))
         return err;
 
@@ -414,7 +503,7 @@ c1_log_reserve_space(struct c1_log *log, u64 size)
      * mlog append failures, until it has retry logic when the current
      * gets exhausted and mlog appends start failing.
      */
-    err = mpool_mlog_len(log->c1l_ds, log->c1l_mlh, &len);
+    err = c1_log_len(log, &len);
     if (ev(err))
         return err;
 
@@ -489,12 +578,18 @@ c1_log_add_val(
 
     *logtype = C1_LOG_MBLOCK;
 
+    /*
+     * Only the cheap allocations need the log mutex.  The value copy
+     * into the vblock below is serialized by the vblock builder itself
+     * (per-kvs rwsem and atomic room reservation), so it must not wait
+     * behind a synchronous mlog append of another io thread.
+     */
     mutex_lock(&log->c1l_ingest_mtx);
     vbb = cheap_malloc(log->c1l_cheap[tidx], sizeof(*vbb));
     omf = cheap_malloc(log->c1l_cheap[tidx], sizeof(*omf));
+    mutex_unlock(&log->c1l_ingest_mtx);
 
     if (!vbb || !omf || (atomic_read(&log->c1l_mb_lowutil) > 0)) {
-        mutex_unlock(&log->c1l_ingest_mtx);
         c1_log_add_val_mlog(vt, iov, size, logtype);
         return 0;
     }
@@ -522,7 +617,6 @@ c1_log_add_val(
     if (err && merr_errno(err) == ENOSPC)
         atomic_set(&log->c1l_mb_lowutil, 1);
 
-    mutex_unlock(&log->c1l_ingest_mtx);
     if (err) {
         c1_log_add_val_mlog(vt, iov, size, logtype);
 
@@ -549,6 +643,123 @@ c1_log_add_val(
     return 0;
 }
 
+/*
+ * c1_log_compress_kvb() - lz4 compress the data record of a kvbundle
+ *
+ * Sets *zbufp to NULL if compression would not make the record smaller.
+ */
+static merr_t
+c1_log_compress_kvb(struct iovec *iov, int iovcnt, size_t size, void **zbufp, size_t *zsizep)
+{
+    struct c1_zkvb_omf *zomf;
+
+    char * raw;
+    char * zbuf;
+    size_t off = 0;
+    uint   zcap;
+    uint   zlen;
+    merr_t err;
+    int    i;
+
+    *zbufp = NULL;
+
+    raw = malloc(size);
+    if (!raw)
+        return merr(ev(ENOMEM));
+
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(raw + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    assert(off == size);
+
+    zcap = compress_lz4_bound(size);
+
+    zbuf = malloc(sizeof(*zomf) + zcap);
+    if (!zbuf) {
+        free(raw);
+        return merr(ev(ENOMEM));
+    }
+
+    err = compress_lz4(raw, size, zbuf + sizeof(*zomf), zcap, &zlen);
+    free(raw);
+
+    if (ev(err) || sizeof(*zomf) + zlen >= size) {
+        free(zbuf);
+        return err;
+    }
+
+    zomf = (struct c1_zkvb_omf *)zbuf;
+    omf_set_c1zkvb_sign(zomf, C1_ZKVB_MAGIC);
+    omf_set_c1zkvb_algo(zomf, VCOMP_ALGO_LZ4);
+    omf_set_c1zkvb_rawsize(zomf, size);
+
+    *zbufp = zbuf;
+    *zsizep = sizeof(*zomf) + zlen;
+
+    return 0;
+}
+
+/*
+ * c1_log_gather_kvb() - coalesce the small segments of a kvbundle record
+ *
+ * A kvbundle record is a key omf, key, value omf and value per tuple, so
+ * the gather list is mostly tiny segments.  Runs of segments shorter than
+ * HSE_C1_GATHER_MIN are copied into one buffer and replaced by a single
+ * iovec, larger values stay in place and are written straight out of c0.
+ * Returns the new iovec count, *bufp is NULL if nothing was coalesced.
+ */
+static merr_t
+c1_log_gather_kvb(struct iovec *iov, int iovcnt, void **bufp, int *iovcntp)
+{
+    size_t len = 0;
+    char * buf;
+    int    small = 0;
+    bool   run;
+    int    i, n;
+
+    *bufp = NULL;
+    *iovcntp = iovcnt;
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len < HSE_C1_GATHER_MIN) {
+            len += iov[i].iov_len;
+            small++;
+        }
+    }
+
+    if (small < 2)
+        return 0;
+
+    buf = malloc(len);
+    if (!buf)
+        return merr(ev(ENOMEM));
+
+    for (i = 0, n = 0, run = false; i < iovcnt; i++) {
+        if (iov[i].iov_len >= HSE_C1_GATHER_MIN) {
+            iov[n++] = iov[i];
+            run = false;
+            continue;
+        }
+
+        if (!run) {
+            iov[n].iov_base = buf;
+            iov[n].iov_len = 0;
+            n++;
+            run = true;
+        }
+
+        memcpy(buf, iov[i].iov_base, iov[i].iov_len);
+        buf += iov[i].iov_len;
+        iov[n - 1].iov_len += iov[i].iov_len;
+    }
+
+    *bufp = buf - len;
+    *iovcntp = n;
+
+    return 0;
+}
+
 merr_t
 c1_log_issue_kvb(
     struct c1_log *               log,
@@ -561,6 +772,7 @@ c1_log_issue_kvb(
     u32                           gen,
     u64                           mutation,
     int                           sync,
+    bool                          compress,
     u8                            tidx,
     struct c1_log_stats *         statsp)
 {
@@ -581,6 +793,9 @@ c1_log_issue_kvb(
     u64                    vtalen;
     int                    logtype;
     u64                    latency = 0;
+    void *                 zbuf = NULL;
+    void *                 gbuf = NULL;
+    size_t                 zsize;
 
     err = 0;
     kvtomf = NULL;
@@ -743,6 +958,29 @@ c1_log_issue_kvb(
 
     assert(i <= numiov);
 
+    /*
+     * Values placed in c1 vblocks are already out of the record, what
+     * is compressed here are the keys, the small values and the vblock
+     * references.
+     */
+    if (compress && size >= HSE_C1_ZKVB_MIN) {
+        err = c1_log_compress_kvb(iov, i, size, &zbuf, &zsize);
+        if (ev(err))
+            goto err_exit;
+
+        if (zbuf) {
+            iov[0].iov_base = zbuf;
+            iov[0].iov_len = zsize;
+            size = zsize;
+        }
+    }
+
+    if (!zbuf) {
+        err = c1_log_gather_kvb(iov, i, &gbuf, &i);
+        if (ev(err))
+            goto err_exit;
+    }
+
     c1_set_hdr(&omf.hdr, C1_TYPE_KVB, sizeof(omf));
 
     omf_set_c1kvb_seqno(&omf, seqno);
@@ -764,13 +1002,13 @@ c1_log_issue_kvb(
     /*
      * Sending header to mlog first
      */
-    err = mpool_mlog_append_data(log->c1l_ds, log->c1l_mlh, &omf, sizeof(omf), false);
+    err = c1_log_append(log, &omf, sizeof(omf), false);
     if (ev(err)) {
-        size_t len;
+        size_t len = 0;
 
-        mpool_mlog_len(log->c1l_ds, log->c1l_mlh, &len);
+        c1_log_len(log, &len);
         hse_elog(
-            HSE_ERR "%s: mpool_mlog_append_data failed "
+            HSE_ERR "%s: log append failed "
                     "mlog len %ld reserved space %ld : @@e",
             err,
             __func__,
@@ -782,14 +1020,14 @@ c1_log_issue_kvb(
     /*
      * Then the actual key-value bundle
      */
-    err = mpool_mlog_append_datav(log->c1l_ds, log->c1l_mlh, iov, size, sync);
+    err = c1_log_appendv(log, iov, size, sync);
     if (ev(err)) {
-        size_t len;
+        size_t len = 0;
 
-        mpool_mlog_len(log->c1l_ds, log->c1l_mlh, &len);
+        c1_log_len(log, &len);
 
         hse_elog(
-            HSE_ERR "%s: mpool_mlog_append_datav failed "
+            HSE_ERR "%s: log append failed "
                     "mlog len %ld reserved space %ld : @@e",
             err,
             __func__,
@@ -805,6 +1043,7 @@ c1_log_issue_kvb(
             statsp->c1log_mllatency += latency;
 
         statsp->c1log_vsize = vsize;
+        statsp->c1log_appbytes = size;
     }
 
     log->c1l_maxkv_seqno = max_t(u64, log->c1l_maxkv_seqno, kvb->c1kvb_maxseqno);
@@ -813,6 +1052,8 @@ err_exit2:
     mutex_unlock(&log->c1l_ingest_mtx);
 
 err_exit:
+    free(gbuf);
+    free(zbuf);
     free(kvtomf);
     free(iov);
     free(vt);
@@ -844,11 +1085,11 @@ c1_log_issue_txn(
     omf_set_c1ttxn_flag(&omf, txn->c1t_flag);
 
     mutex_lock(&log->c1l_ingest_mtx);
-    err = mpool_mlog_append_data(log->c1l_ds, log->c1l_mlh, &omf, sizeof(omf), false);
+    err = c1_log_append(log, &omf, sizeof(omf), false);
     mutex_unlock(&log->c1l_ingest_mtx);
 
     if (ev(err))
-        hse_elog(HSE_ERR "%s: mpool_mlog_append_data failed: @@e", err, __func__);
+        hse_elog(HSE_ERR "%s: log append failed: @@e", err, __func__);
 
     return err;
 }
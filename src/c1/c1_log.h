@@ -8,6 +8,7 @@
 
 struct c1_kvset_builder_elem;
 struct c1_bonsai_vbldr;
+struct c1_pmem;
 
 #define HSE_C1_KEY_IOVS (1 + 1) /* 1 each for kvt, key*/
 #define HSE_C1_VAL_IOVS (1 + 1) /* 1 each for vallen & val) */
@@ -15,6 +16,8 @@ struct c1_bonsai_vbldr;
 #define HSE_C1_LOG_USEABLE_CAPACITY(space) ((space * 60) / 100)
 #define HSE_C1_LOG_VBLDR_HEAPSZ (1024 * MB)
 #define HSE_C1_SMALL_VALUE_THRESHOLD 16
+#define HSE_C1_ZKVB_MIN 512 /* smallest kvbundle worth compressing */
+#define HSE_C1_GATHER_MIN 256 /* smallest segment written in place */
 
 enum {
     C1_LOG_MLOG,
@@ -48,6 +51,7 @@ struct c1_log {
     atomic64_t         c1l_cvcount;
     struct mpool *     c1l_ds;
     struct mpool_mlog *c1l_mlh;
+    struct c1_pmem *   c1l_pmem; /* log records are in pmem, not the mlog */
     struct cheap *     c1l_cheap[HSE_C1_DEFAULT_STRIPE_WIDTH];
     struct list_head   c1l_kvb_list;
     struct list_head   c1l_txn_list;
@@ -118,6 +122,7 @@ struct c1_log_stats {
     u64 c1log_mllatency;
     u64 c1log_mblatency;
     u64 c1log_vsize;
+    u64 c1log_appbytes;
 };
 
 static inline u64
@@ -170,6 +175,7 @@ c1_log_issue_kvb(
     u32                           gen,
     u64                           mutation,
     int                           sync,
+    bool                          compress,
     u8                            tidx,
     struct c1_log_stats *         statsp);
 
@@ -198,6 +204,14 @@ c1_log_make(
 merr_t
 c1_log_reset(struct c1_log *log, u64 newseqno, u64 newgen);
 
+/* Replay reads, from the mlog or pmem (see mpool_mlog_seek_read_data_next()).
+ */
+merr_t
+c1_log_read_init(struct c1_log *log);
+
+merr_t
+c1_log_read_next(struct c1_log *log, u64 seek, void *data, size_t len, size_t *len_read);
+
 merr_t
 c1_log_flush(struct c1_log *log);
 
@@ -3,6 +3,8 @@
  * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
  */
 
+#include <hse_util/compression.h>
+
 #include "c1_omf_internal.h"
 
 #include <mpool/mpool.h>
@@ -13,13 +15,13 @@ c1_log_read(struct c1_log *log, u64 seek, void *data, size_t len)
     size_t len_read;
     merr_t err;
 
-    err = mpool_mlog_seek_read_data_next(log->c1l_ds, log->c1l_mlh, seek, data, len, &len_read);
+    err = c1_log_read_next(log, seek, data, len, &len_read);
     if (ev(err)) {
         if ((merr_errno(err) == ERANGE) && !len_read)
             return merr(ev(ENOENT));
 
         hse_elog(
-            HSE_ERR "%s: mpool_mlog_seek_read_data_next failed: "
+            HSE_ERR "%s: log read failed: "
                     "@@e",
             err,
             __func__);
@@ -50,7 +52,7 @@ c1_log_skip_data(struct c1_log *log, u64 skiplen)
     merr_t err;
     size_t len_read;
 
-    err = mpool_mlog_seek_read_data_next(log->c1l_ds, log->c1l_mlh, skiplen, NULL, 0, &len_read);
+    err = c1_log_read_next(log, skiplen, NULL, 0, &len_read);
     if (ev(err))
         return err;
 
@@ -128,7 +130,7 @@ c1_log_replay_open(struct c1_log *log, int type, u16 ver)
     if (!buffer)
         return merr(ev(ENOMEM));
 
-    err = mpool_mlog_read_data_init(log->c1l_ds, log->c1l_mlh);
+    err = c1_log_read_init(log);
     if (ev(err)) {
         free(buffer);
         return err;
@@ -187,6 +189,48 @@ c1_log_replay_close(struct c1_log *log, bool destroy)
     }
 }
 
+/*
+ * c1_log_inflate_kvb() - decompress a kvbundle data record if it was written
+ * compressed, replacing *datap with the raw record.
+ */
+static merr_t
+c1_log_inflate_kvb(void **datap, u64 size)
+{
+    struct c1_zkvb_omf *zomf = *datap;
+
+    void * raw;
+    u64    rawsize;
+    uint   len;
+    merr_t err;
+
+    if (size < sizeof(*zomf) || omf_c1zkvb_sign(zomf) != C1_ZKVB_MAGIC)
+        return 0;
+
+    if (ev(omf_c1zkvb_algo(zomf) != VCOMP_ALGO_LZ4))
+        return merr(EPROTO);
+
+    rawsize = omf_c1zkvb_rawsize(zomf);
+
+    raw = malloc(rawsize);
+    if (!raw)
+        return merr(ev(ENOMEM));
+
+    err = decompress_lz4(zomf + 1, size - sizeof(*zomf), raw, rawsize, &len);
+    if (!err && len != rawsize)
+        err = merr(EILSEQ);
+
+    if (ev(err)) {
+        hse_elog(HSE_ERR "%s: corrupt compressed kvbundle: @@e", err, __func__);
+        free(raw);
+        return err;
+    }
+
+    free(*datap);
+    *datap = raw;
+
+    return 0;
+}
+
 static merr_t
 c1_log_replay_kvb(struct c1_log *log, u64 ingestid, u16 ver)
 {
@@ -226,6 +270,8 @@ c1_log_replay_kvb(struct c1_log *log, u64 ingestid, u16 ver)
     }
 
     err = c1_log_read(log, 0, data, kvb->c1kvb_size);
+    if (!err)
+        err = c1_log_inflate_kvb(&data, kvb->c1kvb_size);
     if (ev(err)) {
         free(kvb);
         free(data);
@@ -422,7 +468,7 @@ c1_log_diag_replay_open(struct c1_log *log, c1_journal_replay_cb *cb, void *cbar
     if (ev(!buffer))
         return merr(ENOMEM);
 
-    err = mpool_mlog_read_data_init(log->c1l_ds, log->c1l_mlh);
+    err = c1_log_read_init(log);
     if (ev(err)) {
         free(buffer);
         return err;
@@ -510,6 +556,8 @@ c1_log_diag_replay(struct c1_log *log, c1_journal_replay_cb *cb, void *cbarg, u1
         }
 
         err = c1_log_read(log, 0, data, size);
+        if (!err)
+            err = c1_log_inflate_kvb(&data, size);
         if (ev(err)) {
             free(data);
             break;
@@ -17,6 +17,8 @@ enum {
     C1_MAGIC = 0x11223344,
     C1_KEY_MAGIC = 0x11223355,
     C1_VAL_MAGIC = 0x11223366,
+    C1_PMEM_MAGIC = 0x11223377,
+    C1_ZKVB_MAGIC = 0x11223388,
     C1_INVALID_SEQNO = 0,
     C1_INITIAL_SEQNO = 1,
     C1_VERSION1 = 1,
@@ -196,6 +198,38 @@ struct c1_mblk_omf {
     __le32 c1mblk_filler;
 } __packed;
 
+/*
+ * Header of a compressed kvbundle data record.  The raw record starts with
+ * a c1_kvtuple_omf whose sign is C1_KEY_MAGIC, a compressed one starts with
+ * this header instead and is followed by c1zkvb_rawsize bytes of kvtuples
+ * compressed with c1zkvb_algo (an enum vcomp_algo).
+ */
+struct c1_zkvb_omf {
+    __le32 c1zkvb_sign;
+    __le32 c1zkvb_algo;
+    __le64 c1zkvb_rawsize;
+} __packed;
+
+/*
+ * Persistent-memory c1 log (see c1_pmem.h).  The file header occupies the
+ * first page, records follow it 8-byte aligned.  A record is valid only if
+ * its gen matches the header's and its hash (seeded with gen) matches its
+ * data, erasing the log bumps the header's gen.
+ */
+struct c1_pmem_hdr_omf {
+    __le32 c1ph_magic;
+    __le32 c1ph_version;
+    __le32 c1ph_gen;
+    __le32 c1ph_filler;
+    __le64 c1ph_capacity;
+} __packed;
+
+struct c1_pmem_rec_omf {
+    __le32 c1pr_len;
+    __le32 c1pr_gen;
+    __le64 c1pr_hash;
+} __packed;
+
 /*
  * One or more records in the c1 Tree mlogs describing opcode/key
  * and if required value.
@@ -269,6 +303,19 @@ OMF_SETGET(struct c1_vtuple_omf, c1vt_logtype, 32)
 OMF_SETGET(struct c1_mblk_omf, c1mblk_id, 64)
 OMF_SETGET(struct c1_mblk_omf, c1mblk_off, 32)
 
+OMF_SETGET(struct c1_zkvb_omf, c1zkvb_sign, 32)
+OMF_SETGET(struct c1_zkvb_omf, c1zkvb_algo, 32)
+OMF_SETGET(struct c1_zkvb_omf, c1zkvb_rawsize, 64)
+
+OMF_SETGET(struct c1_pmem_hdr_omf, c1ph_magic, 32)
+OMF_SETGET(struct c1_pmem_hdr_omf, c1ph_version, 32)
+OMF_SETGET(struct c1_pmem_hdr_omf, c1ph_gen, 32)
+OMF_SETGET(struct c1_pmem_hdr_omf, c1ph_capacity, 64)
+
+OMF_SETGET(struct c1_pmem_rec_omf, c1pr_len, 32)
+OMF_SETGET(struct c1_pmem_rec_omf, c1pr_gen, 32)
+OMF_SETGET(struct c1_pmem_rec_omf, c1pr_hash, 64)
+
 OMF_SETGET(struct c1_treetxn_omf, c1ttxn_seqno, 64)
 OMF_SETGET(struct c1_treetxn_omf, c1ttxn_gen, 64)
 OMF_SETGET(struct c1_treetxn_omf, c1ttxn_kvseqno, 64)
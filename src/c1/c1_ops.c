@@ -9,7 +9,10 @@
 #include <hse_ikvdb/kvb_builder.h>
 #include <hse_ikvdb/kvdb_rparams.h>
 
+#include <hse_util/usdt.h>
+
 #include "c1_private.h"
+#include "c1_pmem.h"
 
 #include <mpool/mpool.h>
 
@@ -101,6 +104,7 @@ c1_create(const char *mpname)
     c1->c1_jrnl = NULL;
     c1->c1_io = NULL;
     c1->c1_ikvdb = NULL;
+    c1->c1_cpus = 0;
 
     INIT_LIST_HEAD(&c1->c1_tree_inuse);
     INIT_LIST_HEAD(&c1->c1_tree_clean);
@@ -207,9 +211,17 @@ c1_open(
     merr_t             err;
     u64                dtime;
 
+    if (rparams->dur_pmem_path[0]) {
+        err = c1_pmem_register(ds, rparams->dur_pmem_path);
+        if (ev(err))
+            return err;
+    }
+
     err = c1_journal_open(rdonly, ds, MP_MED_STAGING, mpname, oid1, oid2, &jrnl);
-    if (ev(err))
+    if (ev(err)) {
+        c1_pmem_unregister(ds);
         return err;
+    }
 
     c1 = c1_create(mpname);
     if (!c1) {
@@ -223,6 +235,10 @@ c1_open(
     c1->c1_rdonly = rdonly;
     c1->c1_kvms_gen = kvmsgen;
     c1->c1_vbldr = (bool)rparams->dur_vbb;
+    c1->c1_compress = (bool)rparams->dur_compress;
+    c1->c1_trees_lo = max_t(u32, rparams->dur_trees_lo, 1);
+    c1->c1_trees_hi = max_t(u32, rparams->dur_trees_hi, c1->c1_trees_lo + 1);
+    c1->c1_cpus = rparams->dur_cpus;
 
     err = c1_replay(c1);
     if (ev(err))
@@ -268,6 +284,7 @@ err_exit:
         free(c1);
     }
     c1_journal_close(jrnl);
+    c1_pmem_unregister(ds);
 
     return err;
 }
@@ -275,8 +292,9 @@ err_exit:
 merr_t
 c1_close(struct c1 *c1)
 {
-    merr_t err;
-    merr_t err2;
+    struct mpool *ds;
+    merr_t        err;
+    merr_t        err2;
 
     /* error paths may call with uninitialized handles */
     if (!c1)
@@ -284,6 +302,8 @@ c1_close(struct c1 *c1)
 
     assert(c1->c1_jrnl != NULL);
 
+    ds = c1_journal_get_ds(c1->c1_jrnl);
+
     if (!c1_rdonly(c1))
         c1_io_destroy(c1);
 
@@ -295,6 +315,8 @@ c1_close(struct c1 *c1)
     if (ev(err2))
         hse_elog(HSE_ERR "%s: Cannot close journal  : @@e", err2, __func__);
 
+    c1_pmem_unregister(ds);
+
     c1_kvcache_destroy(c1);
 
     assert(list_empty(&c1->c1_rep.c1r_desc));
@@ -345,6 +367,9 @@ c1_cningest_status(struct c1 *c1, u64 seqno, merr_t status, u64 cnid, const stru
     if (ev(err))
         return err;
 
+    c1_shrink_trees(c1);
+    c1_throttle_update(c1, c1_current_tree(c1));
+
     return 0;
 }
 BullseyeCoverageRestore
@@ -386,19 +411,23 @@ merr_t
 c1_sync(struct c1 *c1)
 {
     merr_t err;
-    u64    start;
+    u64    start, usdt;
 
     start = perfc_lat_start(&c1->c1_pcset_op);
+    usdt = HSE_USDT_START(c1_sync);
 
     err = c1_ingest(c1, NULL, 0, C1_INGEST_SYNC);
-    if (ev(err))
-        return err;
+    if (!err) {
+        assert(c1->c1_jrnl);
 
-    assert(c1->c1_jrnl);
+        err = c1_journal_flush(c1->c1_jrnl);
+    }
 
-    err = c1_journal_flush(c1->c1_jrnl);
-    if (err)
-        return ev(err);
+    if (usdt)
+        HSE_USDT(c1_sync, merr_errno(err), get_time_ns() - usdt);
+
+    if (ev(err))
+        return err;
 
     if (PERFC_ISON(&c1->c1_pcset_op)) {
         perfc_rec_lat(&c1->c1_pcset_op, PERFC_LT_C1_SYNC, start);
@@ -493,6 +522,13 @@ c1_get_capacity(u64 capacity)
     return capacity;
 }
 
+void
+c1_throttle_sensor(struct c1 *c1, struct throttle_sensor *sensor)
+{
+    if (c1)
+        c1->c1_sensor = sensor;
+}
+
 bool
 c1_jrnl_reaching_capacity(struct c1 *c1)
 {
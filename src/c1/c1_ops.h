@@ -26,6 +26,11 @@ struct c1 {
     atomic_t                c1_active_cnt;
     bool                    c1_rdonly;
     bool                    c1_vbldr;
+    bool                    c1_compress;
+    u32                     c1_trees_lo;
+    u32                     c1_trees_hi;
+    u64                     c1_cpus;
+    struct throttle_sensor *c1_sensor;
     u64                     c1_ingest_kvseqno;
     u64                     c1_kvdb_seqno;
     u64                     c1_txnid;
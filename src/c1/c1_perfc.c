@@ -44,7 +44,7 @@ struct perfc_name c1_perfc_io[] = {
     NE(PERFC_RA_C1_IOQUE, 3, "Rate of c1 io queued", "c_ioq(/s)"),
     NE(PERFC_RA_C1_IOPRO, 3, "Rate of c1 io processed", "c_iop(/s)"),
     NE(PERFC_LT_C1_IOQUE, 3, "c1 io wait time", "l_ioq(ns)"),
-    NE(PERFC_LT_C1_IOQLK, 3, "c1 io q lock wait time", "l_iql(ns)", 10),
+    NE(PERFC_LT_C1_IOQLK, 3, "c1 io ring full wait time", "l_iql(ns)", 10),
     NE(PERFC_LT_C1_IOSLK, 3, "c1 space lock wait time", "l_isl(ns)", 10),
     NE(PERFC_LT_C1_IOPRO, 3, "c1 io processing time", "l_iop(ns)"),
     NE(PERFC_BA_C1_IOERR, 3, "Count of c1 io errors", "c_ioerr"),
@@ -56,6 +56,7 @@ struct perfc_name c1_perfc_io[] = {
     NE(PERFC_LT_C1_MB1FL, 3, "mblk interim flush lat.", "l_mb1(ns)", 10),
     NE(PERFC_LT_C1_MB2FL, 3, "mblk final flush lat.", "l_mb2(ns)", 10),
     NE(PERFC_DI_C1_IOVSZ, 3, "value size in pipeline", "c_valsz"),
+    NE(PERFC_DI_C1_APPSZ, 3, "Bytes per c1 mlog append", "c_appsz"),
     NE(PERFC_DI_C1_TREE, 3, "Latency of tree alloc", "l_tree(ns)"),
 };
 
@@ -68,6 +69,7 @@ struct perfc_name c1_perfc_tree[] = {
     NE(PERFC_BA_C1_TINVAL, 3, "Count of c1 trees invalidated", "c_trinv"),
     NE(PERFC_BA_C1_TREPL, 3, "Count of c1 trees replayed", "c_trrep"),
     NE(PERFC_BA_C1_TFLUSH, 3, "Count of c1 trees flushed", "c_trflu"),
+    NE(PERFC_BA_C1_TFREE, 3, "Count of c1 trees freed", "c_trfre"),
 };
 
 NE_CHECK(c1_perfc_tree, PERFC_EN_C1TREE, "c1 perfc tree table/enum mismatch");
@@ -95,6 +97,7 @@ c1_perfc_init(void)
     c1_perfc_io[PERFC_DI_C1_IOMLG].pcn_ivl = ivl;
     c1_perfc_io[PERFC_DI_C1_IOMBK].pcn_ivl = ivl;
     c1_perfc_io[PERFC_DI_C1_IOVSZ].pcn_ivl = ivl;
+    c1_perfc_io[PERFC_DI_C1_APPSZ].pcn_ivl = ivl;
     c1_perfc_io[PERFC_DI_C1_TREE].pcn_ivl = ivl;
 }
 
@@ -108,6 +111,7 @@ c1_perfc_fini(void)
         c1_perfc_io[PERFC_DI_C1_IOMLG].pcn_ivl = NULL;
         c1_perfc_io[PERFC_DI_C1_IOMBK].pcn_ivl = NULL;
         c1_perfc_io[PERFC_DI_C1_IOVSZ].pcn_ivl = NULL;
+        c1_perfc_io[PERFC_DI_C1_APPSZ].pcn_ivl = NULL;
         c1_perfc_io[PERFC_DI_C1_TREE].pcn_ivl = NULL;
         perfc_ivl_destroy(ivl);
     }
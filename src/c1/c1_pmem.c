@@ -0,0 +1,546 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include <3rdparty/xxhash.h>
+
+#include "c1_private.h"
+#include "c1_pmem.h"
+
+#define C1_PMEM_VERSION (1)
+#define C1_PMEM_REGMAX (4)
+
+/**
+ * struct c1_pmem - a c1 log in persistent memory
+ * @pm_lock:  serializes appends, erase and reads
+ * @pm_fd:    log file descriptor
+ * @pm_base:  log file mapping
+ * @pm_size:  size of the mapping
+ * @pm_gen:   generation of the valid records
+ * @pm_dax:   mapped with MAP_SYNC, stores need only be flushed from the cpu
+ * @pm_dirty: appended to since the last msync (only if !@pm_dax)
+ * @pm_woff:  offset of the next record
+ * @pm_roff:  offset of the next record to read
+ */
+struct c1_pmem {
+    struct mutex pm_lock;
+    int          pm_fd;
+    char *       pm_base;
+    size_t       pm_size;
+    u32          pm_gen;
+    bool         pm_dax;
+    bool         pm_dirty;
+    size_t       pm_woff;
+    size_t       pm_roff;
+};
+
+static struct {
+    struct mpool *ds;
+    char          dir[PATH_MAX];
+} c1_pmem_regv[C1_PMEM_REGMAX];
+
+static DEFINE_MUTEX(c1_pmem_reglock);
+
+merr_t
+c1_pmem_register(struct mpool *ds, const char *dir)
+{
+    struct stat st;
+    int         i, n;
+
+    if (ev(stat(dir, &st) || !S_ISDIR(st.st_mode))) {
+        hse_log(HSE_ERR "%s: %s is not a directory", __func__, dir);
+        return merr(ENOTDIR);
+    }
+
+    mutex_lock(&c1_pmem_reglock);
+    for (i = 0; i < C1_PMEM_REGMAX; i++) {
+        if (!c1_pmem_regv[i].ds)
+            break;
+    }
+
+    if (i < C1_PMEM_REGMAX) {
+        n = snprintf(c1_pmem_regv[i].dir, sizeof(c1_pmem_regv[i].dir), "%s", dir);
+        if (n > 0 && n < sizeof(c1_pmem_regv[i].dir))
+            c1_pmem_regv[i].ds = ds;
+    }
+    mutex_unlock(&c1_pmem_reglock);
+
+    if (ev(i == C1_PMEM_REGMAX))
+        return merr(ENOSPC);
+
+    if (ev(!c1_pmem_regv[i].ds))
+        return merr(ENAMETOOLONG);
+
+    return 0;
+}
+
+void
+c1_pmem_unregister(struct mpool *ds)
+{
+    int i;
+
+    mutex_lock(&c1_pmem_reglock);
+    for (i = 0; i < C1_PMEM_REGMAX; i++) {
+        if (c1_pmem_regv[i].ds == ds)
+            c1_pmem_regv[i].ds = NULL;
+    }
+    mutex_unlock(&c1_pmem_reglock);
+}
+
+static bool
+c1_pmem_path(struct mpool *ds, u64 oid, char *path, size_t pathsz)
+{
+    bool found = false;
+    int  i, n;
+
+    mutex_lock(&c1_pmem_reglock);
+    for (i = 0; i < C1_PMEM_REGMAX; i++) {
+        if (c1_pmem_regv[i].ds == ds) {
+            n = snprintf(path, pathsz, "%s/c1-%lx", c1_pmem_regv[i].dir, (ulong)oid);
+            found = n > 0 && n < pathsz;
+            break;
+        }
+    }
+    mutex_unlock(&c1_pmem_reglock);
+
+    return found;
+}
+
+/*
+ * Stores to the log bypass the cpu caches where the architecture allows
+ * it, so that a single fence makes them persistent.  Records start on a
+ * word boundary and are padded to one, all stores are whole words.
+ */
+struct c1_pmem_wr {
+    u64 *wr_dst;
+    u64  wr_word;
+    uint wr_fill;
+};
+
+static inline void
+c1_pmem_wr_word(struct c1_pmem_wr *wr, u64 word)
+{
+#if defined(__x86_64__)
+    _mm_stream_si64((long long *)wr->wr_dst, word);
+#else
+    *wr->wr_dst = word;
+#endif
+    wr->wr_dst++;
+}
+
+static void
+c1_pmem_wr_init(struct c1_pmem_wr *wr, struct c1_pmem *pm, size_t off)
+{
+    assert(IS_ALIGNED(off, sizeof(u64)));
+
+    wr->wr_dst = (u64 *)(pm->pm_base + off);
+    wr->wr_word = 0;
+    wr->wr_fill = 0;
+}
+
+static void
+c1_pmem_wr(struct c1_pmem_wr *wr, const void *src, size_t len)
+{
+    u64 word;
+
+    while (len > 0) {
+        if (wr->wr_fill == 0 && len >= sizeof(word)) {
+            memcpy(&word, src, sizeof(word));
+            c1_pmem_wr_word(wr, word);
+            src += sizeof(word);
+            len -= sizeof(word);
+            continue;
+        }
+
+        while (len > 0 && wr->wr_fill < sizeof(word)) {
+            ((u8 *)&wr->wr_word)[wr->wr_fill++] = *(const u8 *)src++;
+            --len;
+        }
+
+        if (wr->wr_fill == sizeof(word)) {
+            c1_pmem_wr_word(wr, wr->wr_word);
+            wr->wr_word = 0;
+            wr->wr_fill = 0;
+        }
+    }
+}
+
+static void
+c1_pmem_wr_end(struct c1_pmem_wr *wr)
+{
+    if (wr->wr_fill > 0) {
+        c1_pmem_wr_word(wr, wr->wr_word);
+        wr->wr_word = 0;
+        wr->wr_fill = 0;
+    }
+}
+
+static void
+c1_pmem_fence(struct c1_pmem *pm)
+{
+#if defined(__x86_64__)
+    _mm_sfence();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+    if (!pm->pm_dax)
+        pm->pm_dirty = true;
+}
+
+static merr_t
+c1_pmem_msync(struct c1_pmem *pm)
+{
+    if (pm->pm_dax || !pm->pm_dirty)
+        return 0;
+
+    if (ev(msync(pm->pm_base, pm->pm_size, MS_SYNC)))
+        return merr(errno);
+
+    pm->pm_dirty = false;
+
+    return 0;
+}
+
+static merr_t
+c1_pmem_write_hdr(struct c1_pmem *pm)
+{
+    struct c1_pmem_hdr_omf hdr;
+    struct c1_pmem_wr      wr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    omf_set_c1ph_magic(&hdr, C1_PMEM_MAGIC);
+    omf_set_c1ph_version(&hdr, C1_PMEM_VERSION);
+    omf_set_c1ph_gen(&hdr, pm->pm_gen);
+    omf_set_c1ph_capacity(&hdr, pm->pm_size - PAGE_SIZE);
+
+    c1_pmem_wr_init(&wr, pm, 0);
+    c1_pmem_wr(&wr, &hdr, sizeof(hdr));
+    c1_pmem_wr_end(&wr);
+    c1_pmem_fence(pm);
+
+    return c1_pmem_msync(pm);
+}
+
+/* Returns the length of the valid record at @off, zero if there is none.
+ */
+static size_t
+c1_pmem_rec_valid(struct c1_pmem *pm, size_t off)
+{
+    struct c1_pmem_rec_omf *rec;
+    size_t                  len;
+
+    if (off + sizeof(*rec) > pm->pm_size)
+        return 0;
+
+    rec = (void *)(pm->pm_base + off);
+    len = omf_c1pr_len(rec);
+
+    if (len == 0 || omf_c1pr_gen(rec) != pm->pm_gen)
+        return 0;
+
+    if (len > pm->pm_size - off - sizeof(*rec))
+        return 0;
+
+    if (XXH64(rec + 1, len, pm->pm_gen) != omf_c1pr_hash(rec))
+        return 0;
+
+    return len;
+}
+
+static size_t
+c1_pmem_rec_next(size_t off, size_t len)
+{
+    return off + sizeof(struct c1_pmem_rec_omf) + ALIGN(len, sizeof(u64));
+}
+
+merr_t
+c1_pmem_open(struct mpool *ds, u64 oid, u64 capacity, bool create, struct c1_pmem **out)
+{
+    struct c1_pmem_hdr_omf *hdr;
+    struct c1_pmem *        pm;
+    struct stat             st;
+    char                    path[PATH_MAX];
+    merr_t                  err = 0;
+    size_t                  len;
+    void *                  base = MAP_FAILED;
+    int                     fd;
+
+    *out = NULL;
+
+    if (!c1_pmem_path(ds, oid, path, sizeof(path)))
+        return 0;
+
+    fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+    if (fd == -1) {
+        if (!create && errno == ENOENT)
+            return 0; /* the log predates dur_pmem_path, it's in the mlog */
+
+        err = merr(errno);
+        hse_elog(HSE_ERR "%s: cannot open %s: @@e", err, __func__, path);
+        return err;
+    }
+
+    if (create) {
+        len = PAGE_SIZE + ALIGN(capacity, PAGE_SIZE);
+
+        if (posix_fallocate(fd, 0, len)) {
+            err = merr(ENOSPC);
+            hse_elog(HSE_ERR "%s: cannot allocate %s: @@e", err, __func__, path);
+            goto err_exit;
+        }
+    } else {
+        if (fstat(fd, &st)) {
+            err = merr(errno);
+            goto err_exit;
+        }
+        len = st.st_size;
+    }
+
+    if (ev(len <= PAGE_SIZE)) {
+        err = merr(EBADMSG);
+        goto err_exit;
+    }
+
+    pm = calloc(1, sizeof(*pm));
+    if (ev(!pm)) {
+        err = merr(ENOMEM);
+        goto err_exit;
+    }
+
+#if defined(__x86_64__) && defined(MAP_SYNC) && defined(MAP_SHARED_VALIDATE)
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
+    pm->pm_dax = (base != MAP_FAILED);
+#endif
+    if (base == MAP_FAILED)
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (base == MAP_FAILED) {
+        err = merr(errno);
+        hse_elog(HSE_ERR "%s: cannot map %s: @@e", err, __func__, path);
+        free(pm);
+        goto err_exit;
+    }
+
+    if (!pm->pm_dax)
+        hse_log(HSE_NOTICE "%s: %s is not on a DAX file system, using msync", __func__, path);
+
+    mutex_init(&pm->pm_lock);
+    pm->pm_fd = fd;
+    pm->pm_base = base;
+    pm->pm_size = len;
+    pm->pm_woff = PAGE_SIZE;
+    pm->pm_roff = PAGE_SIZE;
+
+    if (create) {
+        pm->pm_gen = 1;
+        err = c1_pmem_write_hdr(pm);
+    } else {
+        hdr = base;
+        if (omf_c1ph_magic(hdr) != C1_PMEM_MAGIC || omf_c1ph_version(hdr) != C1_PMEM_VERSION) {
+            hse_log(HSE_ERR "%s: %s is not a c1 log", __func__, path);
+            err = merr(EBADMSG);
+        }
+
+        pm->pm_gen = omf_c1ph_gen(hdr);
+
+        while ((len = c1_pmem_rec_valid(pm, pm->pm_woff)) > 0)
+            pm->pm_woff = c1_pmem_rec_next(pm->pm_woff, len);
+    }
+
+    if (ev(err)) {
+        c1_pmem_close(pm);
+        return err;
+    }
+
+    *out = pm;
+
+    return 0;
+
+err_exit:
+    close(fd);
+
+    return err;
+}
+
+void
+c1_pmem_close(struct c1_pmem *pm)
+{
+    if (!pm)
+        return;
+
+    ev(c1_pmem_msync(pm));
+
+    munmap(pm->pm_base, pm->pm_size);
+    close(pm->pm_fd);
+    mutex_destroy(&pm->pm_lock);
+    free(pm);
+}
+
+void
+c1_pmem_destroy(struct mpool *ds, u64 oid)
+{
+    char path[PATH_MAX];
+
+    if (c1_pmem_path(ds, oid, path, sizeof(path)))
+        if (unlink(path) && errno != ENOENT)
+            hse_log(HSE_WARNING "%s: cannot remove %s: %d", __func__, path, errno);
+}
+
+merr_t
+c1_pmem_erase(struct c1_pmem *pm)
+{
+    merr_t err;
+
+    mutex_lock(&pm->pm_lock);
+    pm->pm_gen++;
+    pm->pm_woff = PAGE_SIZE;
+    pm->pm_roff = PAGE_SIZE;
+    err = c1_pmem_write_hdr(pm);
+    mutex_unlock(&pm->pm_lock);
+
+    return err;
+}
+
+merr_t
+c1_pmem_append(struct c1_pmem *pm, struct iovec *iov, size_t buflen, bool sync)
+{
+    struct c1_pmem_rec_omf rec;
+    struct c1_pmem_wr      wr;
+    XXH64_state_t          xs;
+    size_t                 off, resid, sz;
+    int                    i;
+    merr_t                 err = 0;
+
+    if (ev(buflen == 0 || buflen > U32_MAX))
+        return merr(EINVAL);
+
+    XXH64_reset(&xs, pm->pm_gen);
+    for (i = 0, resid = buflen; resid > 0; i++) {
+        sz = min_t(size_t, resid, iov[i].iov_len);
+        XXH64_update(&xs, iov[i].iov_base, sz);
+        resid -= sz;
+    }
+
+    omf_set_c1pr_len(&rec, buflen);
+    omf_set_c1pr_gen(&rec, pm->pm_gen);
+    omf_set_c1pr_hash(&rec, XXH64_digest(&xs));
+
+    mutex_lock(&pm->pm_lock);
+    off = pm->pm_woff;
+
+    if (c1_pmem_rec_next(off, buflen) > pm->pm_size) {
+        mutex_unlock(&pm->pm_lock);
+        return merr(ENOSPC);
+    }
+
+    c1_pmem_wr_init(&wr, pm, off);
+    c1_pmem_wr(&wr, &rec, sizeof(rec));
+
+    for (i = 0, resid = buflen; resid > 0; i++) {
+        sz = min_t(size_t, resid, iov[i].iov_len);
+        c1_pmem_wr(&wr, iov[i].iov_base, sz);
+        resid -= sz;
+    }
+
+    c1_pmem_wr_end(&wr);
+    c1_pmem_fence(pm);
+    pm->pm_woff = c1_pmem_rec_next(off, buflen);
+
+    if (sync)
+        err = c1_pmem_msync(pm);
+    mutex_unlock(&pm->pm_lock);
+
+    return err;
+}
+
+merr_t
+c1_pmem_flush(struct c1_pmem *pm)
+{
+    merr_t err;
+
+    mutex_lock(&pm->pm_lock);
+    err = c1_pmem_msync(pm);
+    mutex_unlock(&pm->pm_lock);
+
+    return err;
+}
+
+size_t
+c1_pmem_len(struct c1_pmem *pm)
+{
+    return pm->pm_woff - PAGE_SIZE;
+}
+
+void
+c1_pmem_read_init(struct c1_pmem *pm)
+{
+    mutex_lock(&pm->pm_lock);
+    pm->pm_roff = PAGE_SIZE;
+    mutex_unlock(&pm->pm_lock);
+}
+
+merr_t
+c1_pmem_read_next(struct c1_pmem *pm, u64 seek, void *data, size_t len, size_t *len_read)
+{
+    struct c1_pmem_rec_omf *rec;
+    size_t                  rlen, skipped = 0;
+    merr_t                  err = 0;
+
+    *len_read = 0;
+
+    mutex_lock(&pm->pm_lock);
+    while (skipped < seek) {
+        if (pm->pm_roff >= pm->pm_woff) {
+            err = merr(ERANGE);
+            goto exit;
+        }
+
+        rec = (void *)(pm->pm_base + pm->pm_roff);
+        rlen = omf_c1pr_len(rec);
+
+        if (ev(skipped + rlen > seek)) {
+            err = merr(EINVAL); /* not on a record boundary */
+            goto exit;
+        }
+
+        skipped += rlen;
+        pm->pm_roff = c1_pmem_rec_next(pm->pm_roff, rlen);
+    }
+
+    if (!data) {
+        *len_read = skipped;
+        goto exit;
+    }
+
+    if (pm->pm_roff >= pm->pm_woff) {
+        err = merr(ERANGE);
+        goto exit;
+    }
+
+    rec = (void *)(pm->pm_base + pm->pm_roff);
+    rlen = omf_c1pr_len(rec);
+    *len_read = rlen;
+
+    if (rlen > len) {
+        err = merr(EOVERFLOW);
+        goto exit;
+    }
+
+    memcpy(data, rec + 1, rlen);
+    pm->pm_roff = c1_pmem_rec_next(pm->pm_roff, rlen);
+
+exit:
+    mutex_unlock(&pm->pm_lock);
+
+    return err;
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_C1_PMEM_H
+#define HSE_C1_PMEM_H
+
+/*
+ * Persistent-memory backend for c1 logs
+ *
+ * When a kvdb is opened with dur_pmem_path set, c1 logs created from then on
+ * keep their records in a file of that directory, mapped from a DAX file
+ * system, instead of in their mlog.  The mlog is still allocated, it names
+ * the file and is what the journal refers to.  A record is persistent once
+ * its append returns, which costs a single store fence.
+ */
+
+struct c1_pmem;
+struct mpool;
+struct iovec;
+
+/**
+ * c1_pmem_register() - use persistent memory for the c1 logs of an mpool
+ * @ds:  dataset handle
+ * @dir: directory on a DAX file system for the log files
+ */
+merr_t
+c1_pmem_register(struct mpool *ds, const char *dir);
+
+/**
+ * c1_pmem_unregister() - stop using persistent memory for an mpool
+ * @ds: dataset handle
+ */
+void
+c1_pmem_unregister(struct mpool *ds);
+
+/**
+ * c1_pmem_open() - open the persistent memory of a c1 log
+ * @ds:       dataset handle
+ * @oid:      mlog object id of the log
+ * @capacity: log capacity, used only if @create is set
+ * @create:   create the log file, discarding an existing one
+ * @out:      set to NULL if @ds has none or the log has no log file
+ */
+merr_t
+c1_pmem_open(struct mpool *ds, u64 oid, u64 capacity, bool create, struct c1_pmem **out);
+
+void
+c1_pmem_close(struct c1_pmem *pm);
+
+/**
+ * c1_pmem_destroy() - delete the log file of a c1 log, if any
+ * @ds:  dataset handle
+ * @oid: mlog object id of the log
+ */
+void
+c1_pmem_destroy(struct mpool *ds, u64 oid);
+
+/**
+ * c1_pmem_erase() - discard all records of a log
+ * @pm: log
+ */
+merr_t
+c1_pmem_erase(struct c1_pmem *pm);
+
+/**
+ * c1_pmem_append() - append one record
+ * @pm:     log
+ * @iov:    record data
+ * @buflen: total length of @iov
+ * @sync:   only matters if the file is not DAX mapped, then msync it
+ */
+merr_t
+c1_pmem_append(struct c1_pmem *pm, struct iovec *iov, size_t buflen, bool sync);
+
+/**
+ * c1_pmem_flush() - make all appended records persistent
+ * @pm: log
+ */
+merr_t
+c1_pmem_flush(struct c1_pmem *pm);
+
+size_t
+c1_pmem_len(struct c1_pmem *pm);
+
+void
+c1_pmem_read_init(struct c1_pmem *pm);
+
+/**
+ * c1_pmem_read_next() - read the next record, as mpool_mlog_seek_read_data_next()
+ * @pm:       log
+ * @seek:     bytes of record data to skip first
+ * @data:     buffer for the record, may be NULL to only skip
+ * @len:      size of @data
+ * @len_read: length of the record, or the bytes skipped if @data is NULL
+ */
+merr_t
+c1_pmem_read_next(struct c1_pmem *pm, u64 seek, void *data, size_t len, size_t *len_read);
+
+#endif /* HSE_C1_PMEM_H */
@@ -75,6 +75,7 @@
 #include <hse_ikvdb/c1.h>
 #include <hse_ikvdb/c1_replay.h>
 #include <hse_ikvdb/ikvdb.h>
+#include <hse_ikvdb/throttle.h>
 
 #include "c1_omf.h"
 #include "c1_ops.h"
@@ -41,6 +41,12 @@ err_exit:
     return err;
 }
 
+void
+c1_thread_set_cpus(struct c1_thread *thr, u64 cpus)
+{
+    workqueue_set_cpus(thr->c1thr_wq, cpus);
+}
+
 merr_t
 c1_thread_destroy(struct c1_thread *thr)
 {
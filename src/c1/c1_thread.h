@@ -18,6 +18,10 @@ c1_thread_create(
 merr_t
 c1_thread_run(struct c1_thread *thr);
 
+/* Bind the thread to the cpus in @cpus (0: all cpus). */
+void
+c1_thread_set_cpus(struct c1_thread *thr, u64 cpus);
+
 merr_t
 c1_thread_destroy(struct c1_thread *thr);
 
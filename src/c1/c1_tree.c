@@ -429,7 +429,7 @@ c1_tree_reserve_space_txn(struct c1_tree *tree, u64 size)
 }
 
 merr_t
-c1_tree_reserve_space(struct c1_tree *tree, u64 size, int *idx, u64 *mutation, bool txn)
+c1_tree_reserve_space(struct c1_tree *tree, u64 size, int *idx, bool txn)
 {
     struct c1_log *log;
     int            i;
@@ -471,7 +471,6 @@ c1_tree_reserve_space(struct c1_tree *tree, u64 size, int *idx, u64 *mutation, b
     return err;
 
 exit_succ:
-    *mutation = atomic64_add_return(1, &tree->c1t_mutation);
     atomic_inc(&tree->c1t_nextlog);
 
     /* txn data has already been accounted in the tree space during
@@ -494,6 +493,7 @@ c1_tree_issue_kvb(
     u64                           mutation,
     struct c1_kvbundle *          kvb,
     int                           sync,
+    bool                          compress,
     u8                            tidx,
     struct c1_log_stats *         statsp)
 {
@@ -507,7 +507,19 @@ c1_tree_issue_kvb(
     log = tree->c1t_log[idx];
 
     return c1_log_issue_kvb(
-        log, vbldr, ingestid, vsize, kvb, seqno, txnid, gen, mutation, sync, tidx, statsp);
+        log,
+        vbldr,
+        ingestid,
+        vsize,
+        kvb,
+        seqno,
+        txnid,
+        gen,
+        mutation,
+        sync,
+        compress,
+        tidx,
+        statsp);
 }
 
 merr_t
@@ -51,6 +51,16 @@ c1_tree_mark_empty(struct c1_tree *tree)
         tree->c1t_log[i]->c1l_empty = true;
 }
 
+/* Replay merges the records of all the mlogs of a tree by mutation, so
+ * the records of each mlog must be written in mutation order.  Callers
+ * take the mutation number of a record when they queue it to its mlog.
+ */
+static inline u64
+c1_tree_next_mutation(struct c1_tree *tree)
+{
+    return atomic64_add_return(1, &tree->c1t_mutation);
+}
+
 merr_t
 c1_tree_alloc(
     struct mpool *   ds,
@@ -109,11 +119,12 @@ c1_tree_reserve_space_txn(struct c1_tree *tree, u64 size);
 
 /* MTF_MOCK */
 merr_t
-c1_tree_reserve_space(struct c1_tree *tree, u64 size, int *idx, u64 *mutation, bool txn);
+c1_tree_reserve_space(struct c1_tree *tree, u64 size, int *idx, bool txn);
 
 u64
 c1_tree_space_threshold(struct c1_tree *tree);
 
+/* MTF_MOCK */
 merr_t
 c1_tree_issue_kvb(
     struct c1_tree *              tree,
@@ -125,6 +136,7 @@ c1_tree_issue_kvb(
     u64                           mutation,
     struct c1_kvbundle *          kvb,
     int                           sync,
+    bool                          compress,
     u8                            tidx,
     struct c1_log_stats *         statsp);
 
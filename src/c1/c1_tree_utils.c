@@ -142,6 +142,72 @@ c1_tree_replay_merge(
     } while (cur);
 }
 
+struct c1_log_replay_work {
+    struct work_struct lrw_work;
+    struct c1_log *    lrw_log;
+    u64                lrw_ingestid;
+    u16                lrw_ver;
+    merr_t             lrw_err;
+};
+
+static void
+c1_tree_replay_log_cb(struct work_struct *work)
+{
+    struct c1_log_replay_work *lrw = container_of(work, struct c1_log_replay_work, lrw_work);
+
+    lrw->lrw_err = c1_log_replay(lrw->lrw_log, lrw->lrw_ingestid, lrw->lrw_ver);
+}
+
+/* Read all the logs of a tree, one thread per log.  The logs are
+ * independent until their lists are merged by the caller.
+ */
+static merr_t
+c1_tree_replay_logs(struct c1 *c1, struct c1_tree *tree)
+{
+    struct c1_log_replay_work *lrwv;
+    struct workqueue_struct *  wq = NULL;
+    merr_t                     err = 0;
+    int                        numlogs;
+    int                        i;
+
+    numlogs = tree->c1t_stripe_width;
+
+    lrwv = calloc(numlogs, sizeof(*lrwv));
+    if (ev(!lrwv))
+        return merr(ENOMEM);
+
+    if (numlogs > 1)
+        wq = alloc_workqueue("c1_replay", 0, numlogs);
+
+    for (i = 0; i < numlogs; i++) {
+        struct c1_log_replay_work *lrw = lrwv + i;
+
+        INIT_WORK(&lrw->lrw_work, c1_tree_replay_log_cb);
+        lrw->lrw_log = tree->c1t_log[i];
+        lrw->lrw_ingestid = c1_kvmsgen(c1);
+        lrw->lrw_ver = c1->c1_version;
+
+        if (wq)
+            queue_work(wq, &lrw->lrw_work);
+        else
+            c1_tree_replay_log_cb(&lrw->lrw_work);
+    }
+
+    if (wq)
+        destroy_workqueue(wq);
+
+    for (i = 0; i < numlogs; i++) {
+        if (lrwv[i].lrw_err && merr_errno(lrwv[i].lrw_err) != ENOENT) {
+            err = lrwv[i].lrw_err;
+            break;
+        }
+    }
+
+    free(lrwv);
+
+    return err;
+}
+
 merr_t
 c1_tree_replay_process_txn(struct c1 *c1, struct c1_tree *tree)
 {
@@ -168,15 +234,12 @@ c1_tree_replay_process_txn(struct c1 *c1, struct c1_tree *tree)
             goto err_exit;
     }
 
-    for (j = 0; j < numlogs; j++) {
-        err = c1_log_replay(tree->c1t_log[j], c1_kvmsgen(c1), c1->c1_version);
-        if (ev(err))
-            if (ev(merr_errno(err) != ENOENT))
-                goto err_exit;
-        src[j] = &tree->c1t_log[j]->c1l_txn_list;
-    }
+    err = c1_tree_replay_logs(c1, tree);
+    if (ev(err))
+        goto err_exit;
 
-    err = 0;
+    for (j = 0; j < numlogs; j++)
+        src[j] = &tree->c1t_log[j]->c1l_txn_list;
 
     c1_tree_replay_merge(
         src, &tree->c1t_txn_list, numlogs, c1_tree_txn_next, c1_tree_txn_cmp, c1_tree_merge_txn);
@@ -217,14 +280,12 @@ c1_tree_replay_process_kvb(struct c1 *c1, struct c1_tree *tree)
             goto err_exit;
     }
 
-    for (j = 0; j < numlogs; j++) {
-        err = c1_log_replay(tree->c1t_log[j], c1_kvmsgen(c1), c1->c1_version);
-        if (ev(err))
-            if (merr_errno(err) != ENOENT)
-                goto err_exit;
-        err = 0;
+    err = c1_tree_replay_logs(c1, tree);
+    if (ev(err))
+        goto err_exit;
+
+    for (j = 0; j < numlogs; j++)
         src[j] = &tree->c1t_log[j]->c1l_kvb_list;
-    }
 
     c1_tree_replay_merge(
         src, &tree->c1t_kvb_list, numlogs, c1_tree_kvb_next, c1_tree_kvb_cmp, c1_tree_merge_kvb);
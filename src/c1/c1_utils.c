@@ -929,6 +929,128 @@ c1_invalidate_tree(struct c1 *c1, u64 seqno, merr_t status, u64 cnid, const stru
     return err;
 }
 
+/**
+ * c1_shrink_trees() - return clean trees beyond dur_trees_lo to the mpool
+ * @c1: c1 handle
+ *
+ * c1 allocates a new tree whenever it runs out of clean ones, so a burst
+ * of writes that outpaces cn ingest grows it.  Once ingest catches up,
+ * the extra trees are dropped from the journal and then destroyed.  A
+ * crash in between only leaks their mlogs.
+ */
+void
+c1_shrink_trees(struct c1 *c1)
+{
+    struct c1_tree *    tree, *tree_tmp;
+    struct c1_log_desc *desc;
+    struct list_head    victims;
+    struct mpool *      ds;
+    int                 numdesc;
+    u32                 keep, cnt;
+    merr_t              err;
+
+    INIT_LIST_HEAD(&victims);
+
+    if (!mutex_trylock(&c1->c1_alloc_mtx))
+        return;
+
+    keep = c1->c1_trees_lo;
+    cnt = atomic_read(&c1->c1_active_cnt);
+    keep = keep > cnt ? keep - cnt : 0;
+
+    mutex_lock(&c1->c1_active_mtx);
+    list_for_each_entry_safe (tree, tree_tmp, &c1->c1_tree_clean, c1t_list) {
+        if (keep > 0) {
+            --keep;
+            continue;
+        }
+
+        list_del(&tree->c1t_list);
+        list_add_tail(&tree->c1t_list, &victims);
+    }
+    mutex_unlock(&c1->c1_active_mtx);
+
+    if (list_empty(&victims)) {
+        mutex_unlock(&c1->c1_alloc_mtx);
+        return;
+    }
+
+    err = c1_compact(c1);
+    if (ev(err)) {
+        mutex_lock(&c1->c1_active_mtx);
+        list_splice_tail(&victims, &c1->c1_tree_clean);
+        mutex_unlock(&c1->c1_active_mtx);
+        mutex_unlock(&c1->c1_alloc_mtx);
+        return;
+    }
+
+    mutex_unlock(&c1->c1_alloc_mtx);
+
+    ds = c1_journal_get_ds(c1->c1_jrnl);
+
+    list_for_each_entry_safe (tree, tree_tmp, &victims, c1t_list) {
+        list_del(&tree->c1t_list);
+
+        err = c1_tree_get_desc(tree, &desc, &numdesc);
+        if (ev(err)) {
+            c1_tree_close(tree);
+            continue;
+        }
+
+        hse_log(
+            HSE_DEBUG "c1 releasing tree %p ver %ld-%ld",
+            tree,
+            (unsigned long)tree->c1t_seqno,
+            (unsigned long)tree->c1t_gen);
+
+        c1_tree_close(tree);
+        c1_tree_destroy(ds, desc, numdesc);
+        free(desc);
+
+        perfc_inc(&c1->c1_pcset_tree, PERFC_BA_C1_TFREE);
+    }
+}
+
+/**
+ * c1_throttle_update() - set the c1 throttle sensor from c1 fill
+ * @c1:  c1 handle
+ * @cur: current tree
+ *
+ * Fill is measured in trees: the full trees still awaiting cn ingest
+ * plus the used fraction of the current one.  The sensor rises linearly
+ * to THROTTLE_SENSOR_SCALE at dur_trees_lo trees, and on to its maximum
+ * at dur_trees_hi, so c1 growth slows writers down gradually.
+ */
+void
+c1_throttle_update(struct c1 *c1, struct c1_tree *cur)
+{
+    u64 fill, cap, used, lo, hi;
+    int cnt, svalue;
+
+    if (!c1->c1_sensor || !cur)
+        return;
+
+    cap = HSE_C1_TREE_USEABLE_CAPACITY(cur->c1t_capacity);
+    if (cap == 0)
+        return;
+
+    used = min_t(u64, atomic64_read(&cur->c1t_rsvdspace), cap);
+    cnt = max_t(int, atomic_read(&c1->c1_active_cnt) - 1, 0);
+
+    fill = cnt * THROTTLE_SENSOR_SCALE + used * THROTTLE_SENSOR_SCALE / cap;
+    lo = c1->c1_trees_lo * THROTTLE_SENSOR_SCALE;
+    hi = c1->c1_trees_hi * THROTTLE_SENSOR_SCALE;
+
+    if (fill < lo)
+        svalue = THROTTLE_SENSOR_SCALE * fill / lo;
+    else if (fill < hi)
+        svalue = THROTTLE_SENSOR_SCALE + THROTTLE_SENSOR_SCALE * (fill - lo) / (hi - lo);
+    else
+        svalue = 2 * THROTTLE_SENSOR_SCALE;
+
+    throttle_sensor_set(c1->c1_sensor, svalue);
+}
+
 u64
 c1_get_time(u64 time)
 {
@@ -109,6 +109,12 @@ c1_invalidate_tree(struct c1 *c1, u64 seqno, merr_t status, u64 cnid, const stru
 merr_t
 c1_mark_tree_complete(struct c1 *c1, struct c1_tree *tree);
 
+void
+c1_shrink_trees(struct c1 *c1);
+
+void
+c1_throttle_update(struct c1 *c1, struct c1_tree *cur);
+
 merr_t
 c1_next_tree(struct c1 *c1);
 
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <sys/uio.h>
+
+#include <hse_ut/framework.h>
+#include <hse_test_support/mock_api.h>
+#include "../../c1/c1_private.h"
+#include "../../c1/c1_pmem.h"
+
+#define PMEM_OID (0x1234)
+
+/* The backend never dereferences the dataset, it's only a registration key.
+ */
+static struct mpool *pmem_ds = (void *)0x1000;
+static char          pmem_dir[PATH_MAX];
+static char          pmem_path[PATH_MAX];
+
+static const char *pmem_recv[] = { "a", "hello", "eight888", "a record of some length" };
+
+static int
+test_pre(struct mtf_test_info *ti)
+{
+    snprintf(pmem_dir, sizeof(pmem_dir), "/tmp/c1_pmem_test.XXXXXX");
+    if (!mkdtemp(pmem_dir))
+        return -1;
+
+    snprintf(pmem_path, sizeof(pmem_path), "%s/c1-%lx", pmem_dir, (ulong)PMEM_OID);
+
+    return 0;
+}
+
+static int
+test_post(struct mtf_test_info *ti)
+{
+    c1_pmem_destroy(pmem_ds, PMEM_OID);
+    c1_pmem_unregister(pmem_ds);
+    rmdir(pmem_dir);
+
+    return 0;
+}
+
+static merr_t
+pmem_append_str(struct c1_pmem *pm, const char *str)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)str;
+    iov.iov_len = strlen(str);
+
+    return c1_pmem_append(pm, &iov, iov.iov_len, false);
+}
+
+/* Reads all records from the start of @pm and checks them against pmem_recv.
+ */
+static int
+pmem_verify(struct mtf_test_info *lcl_ti, struct c1_pmem *pm, int nrec)
+{
+    char   buf[64];
+    size_t len;
+    merr_t err;
+    int    i;
+
+    c1_pmem_read_init(pm);
+
+    for (i = 0; i < nrec; i++) {
+        err = c1_pmem_read_next(pm, 0, buf, sizeof(buf), &len);
+        VERIFY_EQ_RET(0, err, -1);
+        VERIFY_EQ_RET(strlen(pmem_recv[i]), len, -1);
+        VERIFY_EQ_RET(0, memcmp(buf, pmem_recv[i], len), -1);
+    }
+
+    err = c1_pmem_read_next(pm, 0, buf, sizeof(buf), &len);
+    VERIFY_EQ_RET(ERANGE, merr_errno(err), -1);
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(c1_pmem_test)
+
+MTF_DEFINE_UTEST_PREPOST(c1_pmem_test, unregistered, test_pre, test_post)
+{
+    struct c1_pmem *pm = (void *)-1;
+    merr_t          err;
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, PAGE_SIZE, true, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, pm);
+
+    err = c1_pmem_register(pmem_ds, "/nonexistent/c1_pmem_test");
+    ASSERT_EQ(ENOTDIR, merr_errno(err));
+
+    err = c1_pmem_register(pmem_ds, pmem_dir);
+    ASSERT_EQ(0, err);
+
+    /* A log created before the registration has no log file. */
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, pm);
+
+    c1_pmem_unregister(pmem_ds);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, PAGE_SIZE, true, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, pm);
+}
+
+MTF_DEFINE_UTEST_PREPOST(c1_pmem_test, append_read, test_pre, test_post)
+{
+    struct c1_pmem *pm;
+    struct iovec    iov[3];
+    char            buf[64];
+    size_t          len, total;
+    merr_t          err;
+    int             i;
+
+    err = c1_pmem_register(pmem_ds, pmem_dir);
+    ASSERT_EQ(0, err);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, PAGE_SIZE, true, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+    ASSERT_EQ(0, c1_pmem_len(pm));
+
+    iov[0].iov_base = buf;
+    err = c1_pmem_append(pm, iov, 0, false);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    for (i = 0; i < NELEM(pmem_recv) - 1; i++) {
+        err = pmem_append_str(pm, pmem_recv[i]);
+        ASSERT_EQ(0, err);
+    }
+
+    /* The last record is gathered from several iovecs. */
+    iov[0].iov_base = (void *)pmem_recv[i];
+    iov[0].iov_len = 3;
+    iov[1].iov_base = (void *)pmem_recv[i] + 3;
+    iov[1].iov_len = 7;
+    iov[2].iov_base = (void *)pmem_recv[i] + 10;
+    iov[2].iov_len = strlen(pmem_recv[i]) - 10;
+
+    err = c1_pmem_append(pm, iov, strlen(pmem_recv[i]), true);
+    ASSERT_EQ(0, err);
+
+    err = c1_pmem_flush(pm);
+    ASSERT_EQ(0, err);
+
+    for (i = 0, total = 0; i < NELEM(pmem_recv); i++)
+        total += sizeof(struct c1_pmem_rec_omf) + ALIGN(strlen(pmem_recv[i]), sizeof(u64));
+    ASSERT_EQ(total, c1_pmem_len(pm));
+
+    ASSERT_EQ(0, pmem_verify(lcl_ti, pm, NELEM(pmem_recv)));
+
+    /* A short buffer reports the record length and doesn't consume it. */
+    c1_pmem_read_init(pm);
+    err = c1_pmem_read_next(pm, 0, buf, 3, &len);
+    ASSERT_EQ(EOVERFLOW, merr_errno(err));
+    ASSERT_EQ(strlen(pmem_recv[0]), len);
+
+    err = c1_pmem_read_next(pm, 0, buf, sizeof(buf), &len);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(strlen(pmem_recv[0]), len);
+
+    /* Seek past the next two records. */
+    c1_pmem_read_init(pm);
+    len = strlen(pmem_recv[0]) + strlen(pmem_recv[1]);
+    err = c1_pmem_read_next(pm, len, buf, sizeof(buf), &len);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(strlen(pmem_recv[2]), len);
+    ASSERT_EQ(0, memcmp(buf, pmem_recv[2], len));
+
+    /* Skip only, without data. */
+    c1_pmem_read_init(pm);
+    err = c1_pmem_read_next(pm, strlen(pmem_recv[0]), NULL, 0, &len);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(strlen(pmem_recv[0]), len);
+
+    /* A seek that ends inside a record. */
+    c1_pmem_read_init(pm);
+    err = c1_pmem_read_next(pm, strlen(pmem_recv[0]) + 1, buf, sizeof(buf), &len);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    c1_pmem_read_init(pm);
+    err = c1_pmem_read_next(pm, total, buf, sizeof(buf), &len);
+    ASSERT_EQ(ERANGE, merr_errno(err));
+
+    c1_pmem_close(pm);
+}
+
+MTF_DEFINE_UTEST_PREPOST(c1_pmem_test, full, test_pre, test_post)
+{
+    struct c1_pmem *pm;
+    struct iovec    iov;
+    char *          buf;
+    size_t          len;
+    merr_t          err;
+
+    buf = calloc(1, PAGE_SIZE);
+    ASSERT_NE(NULL, buf);
+
+    err = c1_pmem_register(pmem_ds, pmem_dir);
+    ASSERT_EQ(0, err);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, PAGE_SIZE, true, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+
+    /* A record and its header don't fit in a page of capacity. */
+    iov.iov_base = buf;
+    iov.iov_len = PAGE_SIZE;
+    err = c1_pmem_append(pm, &iov, iov.iov_len, false);
+    ASSERT_EQ(ENOSPC, merr_errno(err));
+    ASSERT_EQ(0, c1_pmem_len(pm));
+
+    len = PAGE_SIZE - sizeof(struct c1_pmem_rec_omf);
+    iov.iov_len = len;
+    err = c1_pmem_append(pm, &iov, len, false);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(PAGE_SIZE, c1_pmem_len(pm));
+
+    err = pmem_append_str(pm, pmem_recv[0]);
+    ASSERT_EQ(ENOSPC, merr_errno(err));
+
+    c1_pmem_close(pm);
+    free(buf);
+}
+
+MTF_DEFINE_UTEST_PREPOST(c1_pmem_test, replay, test_pre, test_post)
+{
+    struct c1_pmem *pm;
+    size_t          len, off;
+    merr_t          err;
+    char            c;
+    int             fd, i;
+
+    err = c1_pmem_register(pmem_ds, pmem_dir);
+    ASSERT_EQ(0, err);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, PAGE_SIZE, true, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+
+    for (i = 0; i < NELEM(pmem_recv); i++) {
+        err = pmem_append_str(pm, pmem_recv[i]);
+        ASSERT_EQ(0, err);
+    }
+
+    len = c1_pmem_len(pm);
+    c1_pmem_close(pm);
+
+    /* Reopening finds all records again. */
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+    ASSERT_EQ(len, c1_pmem_len(pm));
+    ASSERT_EQ(0, pmem_verify(lcl_ti, pm, NELEM(pmem_recv)));
+    c1_pmem_close(pm);
+
+    /* Corrupt the data of the third record, replay stops before it. */
+    off = PAGE_SIZE;
+    for (i = 0; i < 2; i++)
+        off += sizeof(struct c1_pmem_rec_omf) + ALIGN(strlen(pmem_recv[i]), sizeof(u64));
+
+    fd = open(pmem_path, O_RDWR);
+    ASSERT_NE(-1, fd);
+
+    off += sizeof(struct c1_pmem_rec_omf);
+    ASSERT_EQ(1, pread(fd, &c, 1, off));
+    c = ~c;
+    ASSERT_EQ(1, pwrite(fd, &c, 1, off));
+    close(fd);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+    ASSERT_EQ(off - sizeof(struct c1_pmem_rec_omf) - PAGE_SIZE, c1_pmem_len(pm));
+    ASSERT_EQ(0, pmem_verify(lcl_ti, pm, 2));
+
+    /* Erased records are of an older generation and aren't replayed. */
+    err = c1_pmem_erase(pm);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, c1_pmem_len(pm));
+
+    err = pmem_append_str(pm, pmem_recv[0]);
+    ASSERT_EQ(0, err);
+    c1_pmem_close(pm);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, pm);
+    ASSERT_EQ(0, pmem_verify(lcl_ti, pm, 1));
+    c1_pmem_close(pm);
+
+    /* Once destroyed, the log has no log file. */
+    c1_pmem_destroy(pmem_ds, PMEM_OID);
+    ASSERT_NE(0, access(pmem_path, F_OK));
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, pm);
+}
+
+MTF_DEFINE_UTEST_PREPOST(c1_pmem_test, bad_file, test_pre, test_post)
+{
+    struct c1_pmem *pm;
+    merr_t          err;
+    int             fd;
+
+    err = c1_pmem_register(pmem_ds, pmem_dir);
+    ASSERT_EQ(0, err);
+
+    /* Too short to hold the header. */
+    fd = open(pmem_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(EBADMSG, merr_errno(err));
+    ASSERT_EQ(NULL, pm);
+
+    /* Long enough, but no c1 log header. */
+    fd = open(pmem_path, O_RDWR);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(0, ftruncate(fd, 2 * PAGE_SIZE));
+    close(fd);
+
+    err = c1_pmem_open(pmem_ds, PMEM_OID, 0, false, &pm);
+    ASSERT_EQ(EBADMSG, merr_errno(err));
+    ASSERT_EQ(NULL, pm);
+}
+
+MTF_END_UTEST_COLLECTION(c1_pmem_test)
@@ -45,6 +45,7 @@
 #include "mock_mpool.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -78,6 +79,15 @@ _kvset_builder_set_mclass(struct kvset_builder *bldr, enum mp_media_classp mclas
 {
 }
 
+void
+_kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    bldr,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+}
+
 struct mock_kvdb {
     struct c0sk *ikdb_c0sk;
 };
@@ -107,8 +117,10 @@ mocks_set(struct mtf_test_info *info)
     MOCK_SET(ikvdb, _ikvdb_get_c0sk);
     MOCK_SET(kvset_builder, _kvset_builder_create);
     MOCK_SET(kvset_builder, _kvset_builder_set_mclass);
+    MOCK_SET(kvset_builder, _kvset_builder_set_mclass_lvl);
 
     mapi_inject(mapi_idx_kvset_builder_get_mblocks, 0);
+    mapi_inject(mapi_idx_kvset_builder_get_wstats, 0);
     mapi_inject(mapi_idx_kvset_builder_add_key, 0);
     mapi_inject(mapi_idx_kvset_builder_add_val, 0);
     mapi_inject(mapi_idx_kvset_builder_add_nonval, 0);
@@ -1827,4 +1839,162 @@ MTF_DEFINE_UTEST_PREPOST(c1_test, upgrade3, no_fail_pre, no_fail_post)
     ASSERT_EQ(5, len);
 }
 
+/* Records the kvbs that reach each mlog, which is only written by the
+ * io slave of its index.  Replay merges the per-log lists of kvbs by
+ * mutation, so the kvbs of each log must arrive in mutation order.
+ */
+#define IO_ORDER_LOGS_MAX (64)
+#define IO_ORDER_THREADS (8)
+#define IO_ORDER_ITERS (2000)
+
+static struct c1_tree *io_order_treev[IO_ORDER_LOGS_MAX];
+static u64             io_order_lastv[IO_ORDER_LOGS_MAX];
+static atomic_t        io_order_bad;
+static atomic_t        io_order_kvbs;
+
+static struct c1_kvbundle io_order_kvb;
+
+struct io_order_iter {
+    struct kvb_builder_iter oi_iter;
+    bool                    oi_done;
+};
+
+static merr_t
+_c1_tree_issue_kvb(
+    struct c1_tree *              tree,
+    struct c1_kvset_builder_elem *vbldr,
+    u64                           ingestid,
+    u64                           vsize,
+    int                           idx,
+    u64                           txnid,
+    u64                           mutation,
+    struct c1_kvbundle *          kvb,
+    int                           sync,
+    bool                          compress,
+    u8                            tidx,
+    struct c1_log_stats *         statsp)
+{
+    assert(idx < IO_ORDER_LOGS_MAX);
+
+    /* Each tree numbers its mutations from scratch. */
+    if (io_order_treev[idx] != tree) {
+        io_order_treev[idx] = tree;
+        io_order_lastv[idx] = 0;
+    }
+
+    if (mutation <= io_order_lastv[idx])
+        atomic_inc(&io_order_bad);
+
+    io_order_lastv[idx] = mutation;
+    atomic_inc(&io_order_kvbs);
+
+    return 0;
+}
+
+static merr_t
+io_order_get_next(struct kvb_builder_iter *iter, struct c1_kvbundle **kvb)
+{
+    struct io_order_iter *oi = container_of(iter, struct io_order_iter, oi_iter);
+
+    *kvb = oi->oi_done ? NULL : &io_order_kvb;
+    oi->oi_done = true;
+
+    return 0;
+}
+
+static void
+io_order_put(struct kvb_builder_iter *iter)
+{
+    free(container_of(iter, struct io_order_iter, oi_iter));
+}
+
+static void *
+io_order_writer(void *arg)
+{
+    struct io_order_iter *oi;
+    struct c1 *           c1 = arg;
+    merr_t                err;
+    int                   i;
+
+    for (i = 0; i < IO_ORDER_ITERS; i++) {
+        oi = aligned_alloc(SMP_CACHE_BYTES, sizeof(*oi));
+        if (!oi)
+            return (void *)merr(ENOMEM);
+
+        memset(oi, 0, sizeof(*oi));
+        oi->oi_iter.kvbi_c1h = c1;
+        oi->oi_iter.kvbi_ingestid = i;
+        oi->oi_iter.get_next = io_order_get_next;
+        oi->oi_iter.put = io_order_put;
+
+        err = c1_issue_iter(c1, &oi->oi_iter, 0, 512, C1_INGEST_ASYNC);
+        if (err)
+            return (void *)err;
+    }
+
+    return NULL;
+}
+
+MTF_DEFINE_UTEST_PREPOST(c1_test, io_mutation_order, no_fail_pre, no_fail_post)
+{
+    struct kvdb_rparams kvdb_rp;
+    struct kvdb_cparams kvdb_cp;
+    pthread_t           tidv[IO_ORDER_THREADS];
+    struct c1 *         c1 = NULL;
+    u64                 c1_oid1;
+    u64                 c1_oid2;
+    merr_t              err;
+    void *              rv;
+    int                 i, rc;
+
+    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_cp = kvdb_cparams_defaults();
+
+    /* No value builders, the kvbs never reach an mlog. */
+    kvdb_rp.dur_vbb = 0;
+
+    mapi_inject(mapi_idx_ikvdb_flush, 0);
+    MOCK_SET(c1_tree, _c1_tree_issue_kvb);
+
+    memset(io_order_treev, 0, sizeof(io_order_treev));
+    atomic_set(&io_order_bad, 0);
+    atomic_set(&io_order_kvbs, 0);
+
+    c1_mock_mpool();
+
+    err = c1_alloc(NULL, &kvdb_cp, &c1_oid1, &c1_oid2);
+    ASSERT_EQ(0, err);
+
+    err = c1_make(NULL, &kvdb_cp, c1_oid1, c1_oid2);
+    ASSERT_EQ(0, err);
+
+    err = c1_open(NULL, false, c1_oid1, c1_oid2, 0, "mock_mp", &kvdb_rp, NULL, NULL, &c1);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < IO_ORDER_THREADS; i++) {
+        rc = pthread_create(tidv + i, NULL, io_order_writer, c1);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < IO_ORDER_THREADS; i++) {
+        rc = pthread_join(tidv[i], &rv);
+        ASSERT_EQ(0, rc);
+        ASSERT_EQ(NULL, rv);
+    }
+
+    /* Waits for the slaves to finish all the requests. */
+    err = c1_issue_sync(c1, C1_INGEST_SYNC);
+    ASSERT_EQ(0, err);
+
+    ASSERT_EQ(IO_ORDER_THREADS * IO_ORDER_ITERS, atomic_read(&io_order_kvbs));
+    ASSERT_EQ(0, atomic_read(&io_order_bad));
+
+    err = c1_close(c1);
+    ASSERT_EQ(0, err);
+
+    c1_unmock_mpool();
+    MOCK_UNSET(c1_tree, _c1_tree_issue_kvb);
+    mapi_inject_unset(mapi_idx_ikvdb_flush);
+}
+
 MTF_END_UTEST_COLLECTION(c1_test)
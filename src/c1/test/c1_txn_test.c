@@ -68,6 +68,15 @@ _kvset_builder_set_mclass(struct kvset_builder *bldr, enum mp_media_classp mclas
 {
 }
 
+void
+_kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    bldr,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+}
+
 static merr_t
 _cn_open(
     struct cn_kvdb *    cn_kvdb,
@@ -114,6 +123,7 @@ mocks_set(struct mtf_test_info *info)
 
     MOCK_SET(kvset_builder, _kvset_builder_create);
     MOCK_SET(kvset_builder, _kvset_builder_set_mclass);
+    MOCK_SET(kvset_builder, _kvset_builder_set_mclass_lvl);
 
     mapi_inject(mapi_idx_cndb_cn_drop, 0);
 
@@ -121,6 +131,7 @@ mocks_set(struct mtf_test_info *info)
     mapi_inject(mapi_idx_c1_kvset_vbuilder_acquire, 0);
     mapi_inject(mapi_idx_c1_kvset_builder_add_val, 0);
     mapi_inject(mapi_idx_kvset_builder_get_mblocks, 0);
+    mapi_inject(mapi_idx_kvset_builder_get_wstats, 0);
     mapi_inject(mapi_idx_kvset_builder_add_key, 0);
     mapi_inject(mapi_idx_kvset_builder_add_val, 0);
     mapi_inject(mapi_idx_kvset_builder_add_nonval, 0);
@@ -155,6 +166,8 @@ test_pre(struct mtf_test_info *ti)
     mapi_inject(mapi_idx_kvdb_log_make, 0);
     mapi_inject(mapi_idx_kvdb_log_mdc_create, 0);
     mapi_inject(mapi_idx_cndb_replay, 0);
+    mapi_inject(mapi_idx_cndb_replay_recs, 0);
+    mapi_inject(mapi_idx_cndb_cn_dropped, 0);
     mapi_inject(mapi_idx_kvdb_log_done, 0);
     mapi_inject(mapi_idx_cn_make, 0);
     mapi_inject(mapi_idx_cn_close, 0);
@@ -163,6 +176,7 @@ test_pre(struct mtf_test_info *ti)
     mapi_inject(mapi_idx_cn_ref_put, 0);
     mapi_inject(mapi_idx_cn_hash_get, 0);
     mapi_inject(mapi_idx_cn_periodic, 0);
+    mapi_inject(mapi_idx_cn_open_stats_get, 0);
     mapi_inject(mapi_idx_cndb_cn_make, 0);
 
     return 0;
@@ -183,6 +197,7 @@ test_post(struct mtf_test_info *ti)
     mapi_inject_unset(mapi_idx_cndb_make);
     mapi_inject_unset(mapi_idx_cndb_alloc);
     mapi_inject_unset(mapi_idx_cn_periodic);
+    mapi_inject_unset(mapi_idx_cn_open_stats_get);
     mapi_inject_unset(mapi_idx_cndb_cn_make);
 
     mocks_unset();
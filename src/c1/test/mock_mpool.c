@@ -8,6 +8,7 @@
 #include "mock_mpool.h"
 
 #include "../../kvdb/kvdb_log.h"
+#include "../../cn/test/mock_mpool_dev.h"
 
 #include <bsd/string.h>
 
@@ -15,10 +16,29 @@
 
 static FILE *c1_mlog_fp[C1_IO_MAX_LOG];
 static FILE *c1_mdc_fp[C1_IO_MAX_LOG];
+static u8    c1_mlog_mclass[C1_IO_MAX_LOG];
+static u8    c1_mdc_mclass[C1_IO_MAX_LOG];
 static int   c1_next_logoid;
 static int   c1_next_mdcoid;
 static char  c1_test_dir[MAXPATHLEN + 1];
 
+/* Media class of an mlog or MDC, for the device model.
+ */
+static enum mp_media_classp
+c1_mock_mclass(FILE **fpv, const u8 *mclassv, int fpc, FILE *fp)
+{
+    int i;
+
+    for (i = 0; i < fpc; i++)
+        if (fpv[i] == fp)
+            return mclassv[i];
+
+    return MP_MED_CAPACITY;
+}
+
+#define c1_mlog_mclass_get(_fp) c1_mock_mclass(c1_mlog_fp, c1_mlog_mclass, c1_next_logoid, (_fp))
+#define c1_mdc_mclass_get(_fp) c1_mock_mclass(c1_mdc_fp, c1_mdc_mclass, c1_next_mdcoid, (_fp))
+
 static char *
 c1_mock_mpool_get_test_dir(void)
 {
@@ -209,6 +229,7 @@ _mpool_mlog_alloc(
     hse_log(HSE_DEBUG "MLOG open oid %d filename %s fp %p", c1_next_logoid, filename, fp);
 
     c1_mlog_fp[c1_next_logoid] = fp;
+    c1_mlog_mclass[c1_next_logoid] = mclassp;
     props->lpr_objid = (u64)c1_next_logoid;
     *mlh = (struct mpool_mlog *)fp;
 
@@ -245,6 +266,8 @@ _mpool_mdc_alloc(
 
     fclose(fp);
 
+    c1_mdc_mclass[c1_next_mdcoid] = mclassp;
+
     *logid1 = c1_next_mdcoid;
     *logid2 = c1_next_mdcoid;
 
@@ -396,6 +419,7 @@ _mpool_mdc_append(struct mpool_mdc *mdc, void *data, ssize_t len, bool sync)
 
     if (fwrite(data, 1, len, fp) == len) {
         fflush(fp);
+        mpm_dev_io(c1_mdc_mclass_get(fp), MPM_DEV_WRITE, len, sync);
         return 0;
     }
 
@@ -414,6 +438,7 @@ _mpool_mlog_append_data(struct mpool *ds, struct mpool_mlog *mlh, void *data, si
 
     if (fwrite(data, 1, len, fp) == len) {
         fflush(fp);
+        mpm_dev_io(c1_mlog_mclass_get(fp), MPM_DEV_WRITE, len, sync);
         return 0;
     }
 
@@ -440,6 +465,7 @@ _mpool_mlog_append_datav(
     bytes = writev(fileno(fp), iov, iovcnt);
     if (bytes == len) {
         fflush(fp);
+        mpm_dev_io(c1_mlog_mclass_get(fp), MPM_DEV_WRITE, len, sync);
         return 0;
     }
 
@@ -459,8 +485,10 @@ _mpool_mlog_read_data_next(
     assert(fp);
 
     *rdlen = fread(data, 1, len, fp);
-    if (*rdlen)
+    if (*rdlen) {
+        mpm_dev_io(c1_mlog_mclass_get(fp), MPM_DEV_READ, *rdlen, true);
         return 0;
+    }
 
     return merr(ev(ERANGE));
 }
@@ -503,6 +531,8 @@ _mpool_mdc_read(struct mpool_mdc *mdc, void *data, size_t len, size_t *rdlen)
     assert(fp);
 
     *rdlen = fread(data, 1, len, fp);
+    if (*rdlen)
+        mpm_dev_io(c1_mdc_mclass_get(fp), MPM_DEV_READ, *rdlen, true);
 
     hse_log(
         HSE_DEBUG "mpool_mdc_read fp %p offset %ld bytes %ldi read %ld",
@@ -544,6 +574,7 @@ _mpool_mlog_read_data_init(struct mpool *ds, struct mpool_mlog *mlh)
 static uint64_t
 _mpool_mlog_flush(struct mpool *ds, struct mpool_mlog *mlh)
 {
+    mpm_dev_wait();
     return 0;
 }
 
@@ -640,6 +671,10 @@ c1_mock_mpool(void)
     c1_mock_mpool_init();
     c1_mpool_unset_mock();
     c1_mpool_set_mock();
+
+    /* e.g., HSE_MOCK_DEV="staging=nvme,capacity=ssd,seed=7" */
+    if (getenv("HSE_MOCK_DEV") && mpm_dev_config(getenv("HSE_MOCK_DEV")))
+        hse_log(HSE_ERR "%s: invalid HSE_MOCK_DEV", __func__);
 }
 
 void
@@ -647,4 +682,5 @@ c1_unmock_mpool(void)
 {
     c1_mock_mpool_fini();
     c1_mpool_unset_mock();
+    mpm_dev_clear();
 }
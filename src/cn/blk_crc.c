@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/byteorder.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+#include <hse_util/crc32c.h>
+
+#include <sys/uio.h>
+
+#include "blk_crc.h"
+
+uint
+blk_crc_iov(const struct iovec *iov, uint iovc, u32 *crcv)
+{
+    size_t pgoff = 0;
+    uint   pgc = 0;
+    u32    crc = 0;
+    uint   i;
+
+    /* A page may straddle two or more buffers of the image. */
+    for (i = 0; i < iovc; i++) {
+        const u8 *p = iov[i].iov_base;
+        size_t    len = iov[i].iov_len;
+
+        while (len > 0) {
+            size_t n = min_t(size_t, len, PAGE_SIZE - pgoff);
+
+            crc = crc32c(crc, p, n);
+            p += n;
+            len -= n;
+            pgoff += n;
+
+            if (pgoff == PAGE_SIZE) {
+                crcv[pgc++] = cpu_to_le32(crc);
+                pgoff = 0;
+                crc = 0;
+            }
+        }
+    }
+
+    assert(pgoff == 0);
+
+    return pgc;
+}
+
+static merr_t
+blk_crc_page(const struct kvs_mblk_desc *md, const void *page, uint pg)
+{
+    u32 crc = crc32c(0, page, PAGE_SIZE);
+
+    if (likely(crc == le32_to_cpu(md->crcv[pg])))
+        return 0;
+
+    hse_log(
+        HSE_ERR "%s: mblock %lx page %u: checksum %08x expected %08x",
+        __func__,
+        (ulong)md->mb_id,
+        pg,
+        crc,
+        le32_to_cpu(md->crcv[pg]));
+
+    return merr(ev(EILSEQ));
+}
+
+merr_t
+blk_crc_check(const struct kvs_mblk_desc *md, const void *buf, size_t off, size_t len)
+{
+    uint   pg, end;
+    merr_t err;
+
+    if (!md->crcv)
+        return 0;
+
+    assert(IS_ALIGNED(off, PAGE_SIZE));
+
+    pg = off / PAGE_SIZE;
+    end = min_t(size_t, (off + len) / PAGE_SIZE, md->crc_pgc);
+
+    for (; pg < end; pg++, buf += PAGE_SIZE) {
+        err = blk_crc_page(md, buf, pg);
+        if (err)
+            return err;
+    }
+
+    return 0;
+}
+
+/* Get the bitmap of verified pages, allocating it on first use.  Racing
+ * readers may each allocate one, all but the first to install it free
+ * theirs.
+ */
+static u64 *
+blk_crc_okv(struct kvs_mblk_desc *md)
+{
+    u64 *okv, *cur = NULL;
+
+    okv = __atomic_load_n(&md->crc_okv, __ATOMIC_ACQUIRE);
+    if (okv)
+        return okv;
+
+    okv = calloc((md->crc_pgc + 63) / 64, sizeof(*okv));
+    if (ev(!okv))
+        return NULL;
+
+    if (!__atomic_compare_exchange_n(
+            &md->crc_okv, &cur, okv, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(okv);
+        okv = cur;
+    }
+
+    return okv;
+}
+
+merr_t
+blk_crc_verify_slow(struct kvs_mblk_desc *md, uint pg, uint end)
+{
+    u64 *  okv;
+    merr_t err;
+
+    end = min_t(uint, end, md->crc_pgc);
+    if (pg >= end)
+        return 0;
+
+    okv = blk_crc_okv(md);
+
+    for (; pg < end; pg++) {
+        u64 bit = 1ull << (pg % 64);
+
+        if (okv && (__atomic_load_n(&okv[pg / 64], __ATOMIC_RELAXED) & bit))
+            continue;
+
+        err = blk_crc_page(md, md->map_base + (size_t)pg * PAGE_SIZE, pg);
+        if (err)
+            return err;
+
+        if (okv)
+            __atomic_fetch_or(&okv[pg / 64], bit, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+void
+blk_crc_fini(struct kvs_mblk_desc *md)
+{
+    free(md->crc_okv);
+    md->crc_okv = NULL;
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_CN_BLK_CRC_H
+#define HSE_KVS_CN_BLK_CRC_H
+
+#include <hse_util/inttypes.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/compiler.h>
+#include <hse_util/page.h>
+
+#include "kvs_mblk_desc.h"
+
+struct iovec;
+
+/**
+ * blk_crc_iov() - compute the page checksums of an mblock image
+ * @iov:   image, a whole number of pages split over @iovc buffers
+ * @iovc:  number of entries in @iov
+ * @crcv:  (output) one __le32 checksum per page of the image
+ *
+ * Return: the number of pages in the image.
+ */
+uint
+blk_crc_iov(const struct iovec *iov, uint iovc, u32 *crcv);
+
+/**
+ * blk_crc_check() - verify pages read from an mblock
+ * @md:   mblock descriptor
+ * @buf:  pages read from the mblock
+ * @off:  page aligned mblock offset at which @buf was read
+ * @len:  length of @buf, only whole pages are verified
+ *
+ * Pages outside the checksummed range of the mblock are not verified.
+ * Used for reads that bypass the mcache (e.g., by compaction), which
+ * are always verified.
+ *
+ * Return: merr(EILSEQ) if a page does not match its checksum.
+ */
+merr_t
+blk_crc_check(const struct kvs_mblk_desc *md, const void *buf, size_t off, size_t len);
+
+merr_t
+blk_crc_verify_slow(struct kvs_mblk_desc *md, uint pg, uint end);
+
+/**
+ * blk_crc_verify() - verify mapped pages of an mblock on first touch
+ * @md:   mblock descriptor
+ * @off:  mblock offset of the data to be accessed
+ * @len:  length of the data to be accessed
+ *
+ * Each mapped page is verified against its checksum the first time it
+ * is accessed through this function, which records the pages that have
+ * been verified in @md so that the common case costs a bit test.  The
+ * record is allocated on first use, if that fails pages are verified on
+ * every access.
+ *
+ * Return: merr(EILSEQ) if a page does not match its checksum.
+ */
+static __always_inline merr_t
+blk_crc_verify(struct kvs_mblk_desc *md, size_t off, size_t len)
+{
+    const u64 *okv;
+    uint       pg, end;
+
+    if (!md->crcv || !len)
+        return 0;
+
+    pg = off / PAGE_SIZE;
+    end = (off + len - 1) / PAGE_SIZE + 1;
+    okv = __atomic_load_n(&md->crc_okv, __ATOMIC_ACQUIRE);
+
+    if (okv && pg + 1 == end && pg < md->crc_pgc &&
+        (__atomic_load_n(&okv[pg / 64], __ATOMIC_RELAXED) & (1ull << (pg % 64))))
+        return 0;
+
+    return blk_crc_verify_slow(md, pg, end);
+}
+
+/**
+ * blk_crc_fini() - free the record of verified pages of an mblock
+ * @md:   mblock descriptor
+ *
+ * Must not race with blk_crc_verify() on @md.
+ */
+void
+blk_crc_fini(struct kvs_mblk_desc *md);
+
+#endif
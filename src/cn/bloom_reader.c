@@ -59,6 +59,11 @@ bloom_reader_mcache_lookup(
 
     bitmap = pagev[0] + (bkt % PAGE_SIZE);
 
+    if (desc->bd_split) {
+        *hit = bf_split_lookup(kt->kt_hash, bitmap);
+        return 0;
+    }
+
     *hit = bf_lookup(kt->kt_hash, bitmap, desc->bd_n_hashes, desc->bd_rotl, desc->bd_bktmask);
 
     return 0;
@@ -72,9 +77,21 @@ bloom_reader_buffer_lookup(const struct bloom_desc *desc, const u8 *bitmap, stru
 
     bitmap += bf_hash2bkt(kt->kt_hash, desc->bd_modulus, desc->bd_bktshift);
 
+    if (desc->bd_split)
+        return bf_split_lookup(kt->kt_hash, bitmap);
+
     return bf_lookup(kt->kt_hash, bitmap, desc->bd_n_hashes, desc->bd_rotl, desc->bd_bktmask);
 }
 
+void
+bloom_reader_buffer_prefetch(const struct bloom_desc *desc, const u8 *bitmap, struct kvs_ktuple *kt)
+{
+    if (!kt->kt_hash)
+        kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len);
+
+    __builtin_prefetch(bitmap + bf_hash2bkt(kt->kt_hash, desc->bd_modulus, desc->bd_bktshift));
+}
+
 merr_t
 bloom_reader_filter_info(struct bloom_desc *desc, u32 *hash_cnt, u32 *modulus)
 {
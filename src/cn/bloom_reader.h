@@ -20,6 +20,8 @@ struct kvs_mblk_desc;
  * @bd_n_pages:     size of data region in pages
  * @bd_n_hashes:
  * @bd_n_bits:      size of bloom filter in bits
+ * @bd_split:       true if buckets use the split-block layout
+ * @bd_pfx:         true if the filter also holds cn tree prefix hashes
  *
  * When a kblock is opened for reading, the @bloom_hdr_omf struct is read from
  * media and the relevant information is stored in a @bloom_desc struct.
@@ -39,12 +41,18 @@ struct bloom_desc {
     u32 bd_first_page;
     u32 bd_n_pages;
     u32 bd_bktsz;
+    u32 bd_split;
+    u32 bd_pfx;
 };
 
 #define BLOOM_LOOKUP_NONE (0)
 #define BLOOM_LOOKUP_MCACHE (1)
 #define BLOOM_LOOKUP_BUFFER (2) /* more efficient */
 
+#define BLOOM_CREATE_NONE (0)
+#define BLOOM_CREATE_KPROBE (1)
+#define BLOOM_CREATE_SPLIT (2) /* one cache line per lookup */
+
 /**
  * bloom_reader_buffer_lookup() -
  * @desc:       bloom descriptor
@@ -58,6 +66,19 @@ struct bloom_desc {
 bool
 bloom_reader_buffer_lookup(const struct bloom_desc *desc, const u8 *buffer, struct kvs_ktuple *kt);
 
+/**
+ * bloom_reader_buffer_prefetch() - prefetch the bloom bucket that a lookup
+ *                                  of a key would probe
+ * @desc:       bloom descriptor
+ * @buffer:     base address of bloom bitmap
+ * @kt:         key/value tuple
+ */
+void
+bloom_reader_buffer_prefetch(
+    const struct bloom_desc *desc,
+    const u8 *               buffer,
+    struct kvs_ktuple *      kt);
+
 merr_t
 bloom_reader_mcache_lookup(
     const struct bloom_desc *   desc,
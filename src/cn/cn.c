@@ -16,6 +16,9 @@
 #include <hse_util/alloc.h>
 #include <hse_util/slab.h>
 #include <hse_util/log2.h>
+#include <hse_util/compression.h>
+#include <hse_util/keycmp.h>
+#include <hse_util/hlog.h>
 
 #include <hse_util/perfc.h>
 
@@ -23,6 +26,7 @@
 
 #include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/cn_cursor.h>
+#include <hse_ikvdb/cn_tree_view.h>
 #include <hse_ikvdb/cndb.h>
 #include <hse_ikvdb/cursor.h>
 #include <hse_ikvdb/kvset_builder.h>
@@ -31,7 +35,11 @@
 #include <hse_ikvdb/ikvdb.h>
 #include <hse_ikvdb/kvdb_health.h>
 #include <hse_ikvdb/cn_kvdb.h>
+#include <hse_ikvdb/cn_evlog.h>
+#include <hse_ikvdb/cn_reclaim.h>
+#include <hse_ikvdb/cn_scrub.h>
 #include <hse_ikvdb/kvs_cparams.h>
+#include <hse_ikvdb/kvset_view.h>
 
 #include <hse_ikvdb/csched.h>
 
@@ -54,9 +62,11 @@
 #include "kv_iterator.h"
 #include "vblock_reader.h"
 #include "wbt_reader.h"
+#include "kblock_reader.h"
 #include "bloom_reader.h"
 #include "cn_perfc.h"
 #include "pscan.h"
+#include "wbt_icache.h"
 
 struct tbkt;
 
@@ -74,8 +84,15 @@ cn_init(void)
     if (err)
         return err;
 
+    err = kbr_init();
+    if (err) {
+        wbti_fini();
+        return err;
+    }
+
     err = cn_tree_init();
     if (err) {
+        kbr_fini();
         wbti_fini();
         return err;
     }
@@ -91,6 +108,7 @@ cn_fini(void)
 {
     kvset_fini();
     cn_tree_fini();
+    kbr_fini();
     wbti_fini();
 }
 
@@ -100,6 +118,24 @@ cn_get_ingest_dgen(const struct cn *cn)
     return atomic64_read(&cn->cn_ingest_dgen);
 }
 
+u64
+cn_get_cfilter_gen(const struct cn *cn)
+{
+    return atomic64_read(&cn->cn_cfilter_gen);
+}
+
+void
+cn_inc_cfilter_gen(struct cn *cn)
+{
+    atomic64_inc(&cn->cn_cfilter_gen);
+}
+
+u64
+cn_get_ingest_seqno(const struct cn *cn)
+{
+    return atomic64_read(&cn->cn_ingest_seqno);
+}
+
 struct kvs_rparams *
 cn_get_rp(const struct cn *cn)
 {
@@ -112,6 +148,24 @@ cn_get_tbkt_maint(const struct cn *cn)
     return csched_tbkt_maint_get(cn->csched);
 }
 
+struct tbkt *
+cn_get_tbkt_vgc(const struct cn *cn)
+{
+    return csched_tbkt_vgc_get(cn->csched);
+}
+
+struct tbkt *
+cn_get_tbkt_floor(struct cn *cn)
+{
+    return cn->rp->cn_compact_rate_min ? &cn->cn_tbkt_floor : NULL;
+}
+
+struct io_sched *
+cn_get_io_sched(const struct cn *cn)
+{
+    return cn->cn_kvdb ? cn->cn_kvdb->cnd_ios : NULL;
+}
+
 bool
 cn_is_closing(const struct cn *cn)
 {
@@ -172,6 +226,28 @@ cn_get_cancel(struct cn *cn)
     return &cn->cn_maint_cancel;
 }
 
+void
+cn_cfilter_set(struct cn *cn, kvs_cfilter_fn *fn, void *arg)
+{
+    mutex_lock(&cn->cn_cfilter_lock);
+    cn->cn_cfilter = fn;
+    cn->cn_cfilter_arg = arg;
+    mutex_unlock(&cn->cn_cfilter_lock);
+}
+
+kvs_cfilter_fn *
+cn_cfilter_get(struct cn *cn, void **arg)
+{
+    kvs_cfilter_fn *fn;
+
+    mutex_lock(&cn->cn_cfilter_lock);
+    fn = cn->cn_cfilter;
+    *arg = cn->cn_cfilter_arg;
+    mutex_unlock(&cn->cn_cfilter_lock);
+
+    return fn;
+}
+
 struct perfc_set *
 cn_get_perfc(struct cn *cn, enum cn_action action)
 {
@@ -234,6 +310,12 @@ cn_get_cnid(const struct cn *handle)
     return handle->cn_cnid;
 }
 
+u64
+cn_get_pinned(const struct cn *handle, uint level)
+{
+    return cn_tree_pinned(handle->cn_tree, level);
+}
+
 struct cndb *
 cn_get_cndb(const struct cn *handle)
 {
@@ -246,6 +328,12 @@ cn_get_cn_kvdb(const struct cn *handle)
     return handle ? handle->cn_kvdb : 0;
 }
 
+void
+cn_open_stats_get(const struct cn *cn, struct cn_open_stats *stats)
+{
+    *stats = cn->cn_open_stats;
+}
+
 u32
 cn_get_flags(const struct cn *handle)
 {
@@ -258,6 +346,75 @@ cn_get_ingest_perfc(const struct cn *cn)
     return cn ? &((struct cn *)cn)->cn_pc_ingest : 0;
 }
 
+struct perfc_set *
+cn_get_amp_perfc(const struct cn *cn)
+{
+    return cn ? &((struct cn *)cn)->cn_pc_amp : 0;
+}
+
+static void
+cn_amp_read_cum(struct cn *cn, struct cn_amp *amp)
+{
+    struct perfc_set *pc = &cn->cn_pc_amp;
+
+    memset(amp, 0, sizeof(*amp));
+
+    amp->ca_ubytes = perfc_read(pc, PERFC_RA_CNAMP_UBYTES);
+    amp->ca_c1bytes = perfc_read(pc, PERFC_RA_CNAMP_C1BYTES);
+    amp->ca_ingest = perfc_read(pc, PERFC_RA_CNAMP_INGEST);
+    amp->ca_spill = perfc_read(pc, PERFC_RA_CNAMP_SPILL);
+    amp->ca_kcompact = perfc_read(pc, PERFC_RA_CNAMP_KCOMPACT);
+    amp->ca_kvcompact = perfc_read(pc, PERFC_RA_CNAMP_KVCOMPACT);
+    amp->ca_rbytes = perfc_read(pc, PERFC_RA_CNAMP_RBYTES);
+    amp->ca_gets = perfc_read(pc, PERFC_RA_CNAMP_GETS);
+    amp->ca_kvsets = perfc_read(pc, PERFC_RA_CNAMP_KVSETS);
+}
+
+void
+cn_amp_read(struct cn *cn, struct cn_amp *cum, struct cn_amp *win)
+{
+    struct cn_samp_stats samp;
+    u64                  now;
+
+    now = get_time_ns();
+    cn_amp_read_cum(cn, cum);
+
+    /* The tree's samp stats may be caught mid-update by a concurrent
+     * ingest or compaction, which is fine for reporting.
+     */
+    cn_tree_samp(cn->cn_tree, &samp);
+    cum->ca_alen = max_t(s64, 0, samp.r_alen + samp.i_alen + samp.l_alen);
+    cum->ca_lgood = max_t(s64, 0, samp.l_good);
+
+    if (!win)
+        return;
+
+    mutex_lock(&cn->cn_amp_lock);
+    win->ca_ubytes = cum->ca_ubytes - cn->cn_amp_base.ca_ubytes;
+    win->ca_c1bytes = cum->ca_c1bytes - cn->cn_amp_base.ca_c1bytes;
+    win->ca_ingest = cum->ca_ingest - cn->cn_amp_base.ca_ingest;
+    win->ca_spill = cum->ca_spill - cn->cn_amp_base.ca_spill;
+    win->ca_kcompact = cum->ca_kcompact - cn->cn_amp_base.ca_kcompact;
+    win->ca_kvcompact = cum->ca_kvcompact - cn->cn_amp_base.ca_kvcompact;
+    win->ca_rbytes = cum->ca_rbytes - cn->cn_amp_base.ca_rbytes;
+    win->ca_gets = cum->ca_gets - cn->cn_amp_base.ca_gets;
+    win->ca_kvsets = cum->ca_kvsets - cn->cn_amp_base.ca_kvsets;
+    win->ca_window = now - cn->cn_amp_start;
+    mutex_unlock(&cn->cn_amp_lock);
+
+    win->ca_alen = cum->ca_alen;
+    win->ca_lgood = cum->ca_lgood;
+}
+
+void
+cn_amp_reset(struct cn *cn)
+{
+    mutex_lock(&cn->cn_amp_lock);
+    cn->cn_amp_start = get_time_ns();
+    cn_amp_read_cum(cn, &cn->cn_amp_base);
+    mutex_unlock(&cn->cn_amp_lock);
+}
+
 u32
 cn_cp2cflags(struct kvs_cparams *cp)
 {
@@ -266,6 +423,20 @@ cn_cp2cflags(struct kvs_cparams *cp)
     if (cp->cp_kvs_ext01)
         flags |= CN_CFLAG_CAPPED;
 
+    if (cp->cp_vcomp == VCOMP_ALGO_LZ4)
+        flags |= CN_CFLAG_VCOMP_LZ4;
+
+    if (cp->cp_range)
+        flags |= CN_CFLAG_RANGE;
+
+    if (cp->cp_ptlookup)
+        flags |= CN_CFLAG_PTLOOKUP;
+
+    if (cp->cp_kfixed == 8)
+        flags |= CN_CFLAG_KFIXED8;
+    else if (cp->cp_kfixed == 16)
+        flags |= CN_CFLAG_KFIXED16;
+
     return flags;
 }
 
@@ -325,6 +496,252 @@ cn_get_sfx_len(struct cn *cn)
     return cn->cp->cp_sfx_len;
 }
 
+/* A kblock of a kvset, weighed by the average number of keys per kblock
+ * of its kvset.
+ */
+struct cn_split_samp {
+    const void *css_key;
+    u32         css_klen;
+    u64         css_wt;
+};
+
+static int
+cn_split_samp_cmp(const void *lhs, const void *rhs)
+{
+    const struct cn_split_samp *l = lhs;
+    const struct cn_split_samp *r = rhs;
+
+    return keycmp(l->css_key, l->css_klen, r->css_key, r->css_klen);
+}
+
+merr_t
+cn_range_split(
+    struct cn *          cn,
+    const void *         pfx,
+    u32                  pfx_len,
+    u32                  rangec,
+    struct cn_split_key *keyv,
+    u32 *                keycp)
+{
+    struct cn_split_samp *sampv;
+    struct table *        view;
+    u64                   total, cum;
+    u32                   sampc, keyc, i, j;
+    int                   retries = 3;
+    merr_t                err;
+
+    *keycp = 0;
+
+    if (rangec < 2)
+        return 0;
+
+    /* The view holds a ref on each kvset, so the kblock min keys remain
+     * valid without holding the tree lock while they are sorted.
+     */
+    do {
+        err = cn_tree_view_create(cn, &view);
+    } while (merr_errno(err) == EAGAIN && --retries > 0);
+
+    if (ev(err))
+        return err;
+
+    for (i = sampc = 0; i < table_len(view); ++i) {
+        struct kvset_view *v = table_at(view, i);
+
+        if (v->kvset)
+            sampc += kvset_get_num_kblocks(v->kvset);
+    }
+
+    sampv = malloc(sizeof(*sampv) * (sampc + 1));
+    if (ev(!sampv)) {
+        cn_tree_view_destroy(view);
+        return merr(ENOMEM);
+    }
+
+    total = 0;
+
+    for (i = sampc = 0; i < table_len(view); ++i) {
+        struct kvset_view *v = table_at(view, i);
+        u32                nkblks;
+        u64                wt;
+
+        if (!v->kvset)
+            continue;
+
+        nkblks = kvset_get_num_kblocks(v->kvset);
+        if (nkblks == 0)
+            continue;
+
+        wt = max_t(u64, kvset_statsp(v->kvset)->kst_keys / nkblks, 1);
+
+        for (j = 0; j < nkblks; ++j) {
+            struct cn_split_samp *samp = sampv + sampc;
+            uint                  klen;
+
+            kvset_get_nth_kblock_minkey(v->kvset, j, &samp->css_key, &klen);
+
+            if (pfx_len > 0 && keycmp_prefix(pfx, pfx_len, samp->css_key, klen))
+                continue;
+
+            samp->css_klen = klen;
+            samp->css_wt = wt;
+            total += wt;
+            ++sampc;
+        }
+    }
+
+    qsort(sampv, sampc, sizeof(*sampv), cn_split_samp_cmp);
+
+    /* Each range ends just before the first kblock whose keys would put
+     * it past its share of the total.
+     */
+    cum = 0;
+    keyc = 0;
+
+    for (i = 0; i + 1 < sampc && keyc < rangec - 1; ++i) {
+        struct cn_split_samp *next = sampv + i + 1;
+
+        cum += sampv[i].css_wt;
+        if (cum < total * (keyc + 1) / rangec)
+            continue;
+
+        if (keyc > 0 && !keycmp(
+                            next->css_key,
+                            next->css_klen,
+                            keyv[keyc - 1].csk_key,
+                            keyv[keyc - 1].csk_len))
+            continue;
+
+        memcpy(keyv[keyc].csk_key, next->css_key, next->css_klen);
+        keyv[keyc].csk_len = next->css_klen;
+        ++keyc;
+    }
+
+    free(sampv);
+    cn_tree_view_destroy(view);
+
+    *keycp = keyc;
+
+    return 0;
+}
+
+merr_t
+cn_range_estimate(
+    struct cn *          cn,
+    const void *         lo,
+    u32                  lo_len,
+    const void *         hi,
+    u32                  hi_len,
+    struct cn_range_est *est)
+{
+    struct table *view;
+    struct hlog * hlog;
+    u64           keys_full, keys_part, bytes_full, bytes_part;
+    u64           keys, bytes, total, card;
+    u32           i, j;
+    int           retries = 3;
+    merr_t        err;
+
+    memset(est, 0, sizeof(*est));
+
+    err = hlog_create(&hlog, HLOG_PRECISION);
+    if (ev(err))
+        return err;
+
+    do {
+        err = cn_tree_view_create(cn, &view);
+    } while (merr_errno(err) == EAGAIN && --retries > 0);
+
+    if (ev(err)) {
+        hlog_destroy(hlog);
+        return err;
+    }
+
+    keys = bytes = total = 0;
+
+    for (i = 0; i < table_len(view); ++i) {
+        struct kvset_view *v = table_at(view, i);
+        u32                nkblks;
+
+        if (!v->kvset)
+            continue;
+
+        keys_full = keys_part = bytes_full = bytes_part = 0;
+        nkblks = kvset_get_num_kblocks(v->kvset);
+
+        for (j = 0; j < nkblks; ++j) {
+            const struct kblk_metrics *m;
+            const void *               minkey, *maxkey;
+            uint                       minlen, maxlen;
+            u64                        n, b;
+            bool                       full = true;
+
+            kvset_get_nth_kblock_minkey(v->kvset, j, &minkey, &minlen);
+            kvset_get_nth_kblock_maxkey(v->kvset, j, &maxkey, &maxlen);
+
+            if (lo && keycmp(maxkey, maxlen, lo, lo_len) < 0)
+                continue;
+            if (hi && keycmp(minkey, minlen, hi, hi_len) > 0)
+                continue;
+
+            if (lo && keycmp(minkey, minlen, lo, lo_len) < 0)
+                full = false;
+            if (hi && keycmp(maxkey, maxlen, hi, hi_len) > 0)
+                full = false;
+
+            m = kvset_get_nth_kblock_metrics(v->kvset, j);
+            n = m->num_keys > m->num_tombstones ? m->num_keys - m->num_tombstones : 0;
+            b = m->tot_key_bytes + m->tot_val_bytes;
+
+            if (full) {
+                keys_full += n;
+                bytes_full += b;
+            } else {
+                keys_part += n;
+                bytes_part += b;
+            }
+        }
+
+        if (keys_full + keys_part == 0)
+            continue;
+
+        /* Every key of a fully covered kblock is in the range, so the
+         * largest such count of any one kvset is a floor.
+         */
+        est->cre_keys_lo = max_t(u64, est->cre_keys_lo, keys_full);
+        est->cre_keys_hi += keys_full + keys_part;
+        est->cre_bytes_hi += bytes_full + bytes_part;
+        est->cre_kvsets++;
+
+        keys += keys_full + keys_part / 2;
+        bytes += bytes_full + bytes_part / 2;
+
+        total += kvset_statsp(v->kvset)->kst_keys;
+        if (kvset_get_hlog(v->kvset))
+            hlog_union(hlog, kvset_get_hlog(v->kvset));
+    }
+
+    cn_tree_view_destroy(view);
+
+    /* Keys updated in more than one kvset are counted once per kvset
+     * above, the hlog union tells how many of them are distinct.
+     */
+    card = hlog_card(hlog);
+    hlog_destroy(hlog);
+
+    if (card > 0 && card < total) {
+        double ratio = (double)card / total;
+
+        keys = keys * ratio;
+        bytes = bytes * ratio;
+    }
+
+    est->cre_keys = clamp_t(u64, keys, est->cre_keys_lo, est->cre_keys_hi);
+    est->cre_bytes = min_t(u64, bytes, est->cre_bytes_hi);
+
+    return 0;
+}
+
 /*----------------------------------------------------------------
  * CN GET
  */
@@ -343,6 +760,52 @@ cn_get(
     return cn_tree_lookup(cn->cn_tree, &cn->cn_pc_get, kt, seq, res, &qctx, 0, vbuf);
 }
 
+merr_t
+cn_get_lease(
+    struct cn *          cn,
+    struct kvs_ktuple *  kt,
+    u64                  seq,
+    enum key_lookup_res *res,
+    struct kvs_vlease *  lease)
+{
+    struct query_ctx qctx;
+
+    qctx.qtype = QUERY_GET_LEASE;
+    qctx.lease = lease;
+    return cn_tree_lookup(cn->cn_tree, &cn->cn_pc_get, kt, seq, res, &qctx, 0, 0);
+}
+
+merr_t
+cn_prefetch(struct cn *cn, struct kvs_ktuple *kt, u64 seq, enum key_lookup_res *res)
+{
+    struct query_ctx qctx;
+
+    qctx.qtype = QUERY_PREFETCH;
+    return cn_tree_lookup(cn->cn_tree, &cn->cn_pc_get, kt, seq, res, &qctx, 0, 0);
+}
+
+void
+cn_lease_release(struct kvs_vlease *lease)
+{
+    if (lease->vl_pin)
+        kvset_put_ref(lease->vl_pin);
+    lease->vl_pin = NULL;
+}
+
+merr_t
+cn_get_batch(
+    struct cn *          cn,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc)
+{
+    return cn_tree_lookup_batch(
+        cn->cn_tree, &cn->cn_pc_get, ktv, seq, resv, vbufv, lookupv, lookupc);
+}
+
 merr_t
 cn_pfx_probe(
     struct cn *          cn,
@@ -356,6 +819,22 @@ cn_pfx_probe(
     return cn_tree_lookup(cn->cn_tree, &cn->cn_pc_get, kt, seq, res, qctx, kbuf, vbuf);
 }
 
+merr_t
+cn_pfx_probe_batch(
+    struct cn *          cn,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct query_ctx *   qctxv,
+    struct kvs_buf *     kbufv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc)
+{
+    return cn_tree_pfx_probe_batch(
+        cn->cn_tree, &cn->cn_pc_get, ktv, seq, resv, qctxv, kbufv, vbufv, lookupv, lookupc);
+}
+
 /**
  * cn_commit_blks() - commit a set of mblocks
  * @ds:           dataset
@@ -497,6 +976,32 @@ roundup_size(size_t val, size_t align)
     return align * ((val + align - 1) / align);
 }
 
+merr_t
+cn_mblock_alloc(
+    struct cn *          cn,
+    struct mpool *       ds,
+    enum mp_media_classp mclass,
+    enum mblock_life     life,
+    bool                 spare,
+    u64 *                mbh,
+    struct mblock_props *props)
+{
+    struct cn_kvdb *cn_kvdb;
+    merr_t          err;
+
+    assert(life < MBLOCK_LIFE_CNT);
+
+    err = mpool_mblock_alloc(ds, mclass, spare, mbh, props);
+    if (err)
+        return err;
+
+    cn_kvdb = cn_get_cn_kvdb(cn);
+    if (cn_kvdb)
+        atomic64_add(props->mpr_alloc_cap, &cn_kvdb->cnd_life_alloc[life]);
+
+    return 0;
+}
+
 /**
  * cn_mb_est_alen() - estimate media space required to store data in mblocks
  * @full_captgt: value of mbc_captgt in mpool_mblock_alloc() for full size
@@ -575,38 +1080,61 @@ cn_mb_est_alen(size_t full_captgt, size_t mb_alloc_unit, size_t wlen, uint flags
  * cn_ingest_prep()
  * @cn:
  * @childv:
- * @childc:
+ * @childc:     number of kvsets to ingest, in ascending key order when
+ *              childc > 1 (the kvsets must have disjoint key ranges)
  * @txid:
  * @context:
  * @vcommitted: vblocks already committed.
  *      Can be NULL. If NULL, none of the vblocks are already committed.
- * @le_out:
+ *      Must be NULL or zero if childc > 1.
+ * @kvsetv:     (output) vector of @childc kvsets (NULL for empty children)
+ * @st:         stats to which the time of each step is added
  */
 static merr_t
 cn_ingest_prep(
-    struct cn *           cn,
-    struct kvset_mblocks *childv,
-    unsigned int          childc,
-    u64                   txid,
-    u64 *                 context,
-    u32 *                 vcommitted,
-    struct kvset **       kvsetp)
+    struct cn *             cn,
+    struct kvset_mblocks *  childv,
+    unsigned int            childc,
+    u64                     txid,
+    u64 *                   context,
+    u32 *                   vcommitted,
+    struct kvset **         kvsetv,
+    struct cn_ingest_stats *st)
 {
     struct kvset_meta km = {};
-    struct kvset *    kvset;
-    u64               dgen, tag_throwaway = 0;
+    u64               dgen, seqno, *tagv, tstart;
     u32               commitc = 0;
     merr_t            err = 0;
+    uint              lx;
 
-    /* Currently support only one child (this would need
-     * to change if we re-enable c0_spill).
-     */
-    if (!childv || childc != 1)
+    if (!childv || childc < 1)
         return merr(ev(EINVAL));
 
-    dgen = atomic64_add_return(1, &cn->cn_ingest_dgen);
+    /* Only a single-kvset ingest may carry externally committed vblocks.
+     */
+    if (childc > 1) {
+        if (ev(vcommitted && *vcommitted))
+            return merr(EINVAL);
+        vcommitted = NULL;
+    }
+
+    memset(kvsetv, 0, childc * sizeof(*kvsetv));
+
+    tagv = malloc(childc * sizeof(*tagv));
+    if (ev(!tagv)) {
+        err = merr(ENOMEM);
+        goto done;
+    }
+
+    /* Publish the ingest's max seqno before its dgen (see cn_get_ingest_seqno()).
+     */
+    seqno = atomic64_read(&cn->cn_ingest_seqno);
+    for (lx = 0; lx < childc; lx++)
+        seqno = max_t(u64, seqno, childv[lx].bl_seqno_max);
+    atomic64_set(&cn->cn_ingest_seqno, seqno);
 
     /* Note: cn_mblocks_commit() creates "C" records in CNDB */
+    tstart = get_time_ns();
     err = cn_mblocks_commit(
         cn->cn_dataset,
         cn->cn_cndb,
@@ -618,96 +1146,123 @@ cn_ingest_prep(
         vcommitted,
         &commitc,
         context,
-        &tag_throwaway);
+        tagv);
+    st->cis_commit_ns += get_time_ns() - tstart;
     if (ev(err))
         goto done;
 
-    /* Lend childv[0] kblk and vblk lists to kvset_create().
-     * Yes, the struct copy is a bit gross, but it works and
-     * avoids unnecessary allocations of temporary lists.
-     */
-    km.km_kblk_list = childv[0].kblks;
-    km.km_vblk_list = childv[0].vblks;
-    km.km_dgen = dgen;
-    km.km_node_level = 0;
-    km.km_node_offset = 0;
-
-    km.km_vused = childv[0].bl_vused;
-    km.km_compc = 0;
-    km.km_capped = cn_is_capped(cn);
-    km.km_restored = false;
-    km.km_scatter = km.km_vused ? 1 : 0;
-
-    /* It is conceivable that there are no kblocks on ingest.  All it takes
-     * is the creation of builder in the c0 ingest code without any keys
-     * ever making it to that builder.  We've already told CNDB how many
-     * C-records to expect, so we had to get this far to create the
-     * correct number of C and CMeta records.  But if there are in fact
-     * no kblocks, there's nothing more to do.  CNDB recognizes this
-     * and realizes that this is not a real kvset.
-     */
-    if (childv[0].kblks.n_blks == 0) {
-        assert(childv[0].vblks.n_blks == 0);
-        goto done;
-    }
+    for (lx = 0; lx < childc; lx++) {
 
-    /* DO NOT LOG META WHEN childv[0].kblks.n_blks == 0 */
-    err = cndb_txn_meta(cn->cn_cndb, txid, cn->cn_cnid, *context, &km);
-    if (ev(err))
-        goto done;
+        /* It is conceivable that there are no kblocks on ingest.  All it
+         * takes is the creation of builder in the c0 ingest code without
+         * any keys ever making it to that builder.  We've already told
+         * CNDB how many C-records to expect, so we had to get this far to
+         * create the correct number of C and CMeta records.  But if there
+         * are in fact no kblocks, there's nothing more to do.  CNDB
+         * recognizes this and realizes that this is not a real kvset.
+         */
+        if (childv[lx].kblks.n_blks == 0) {
+            assert(childv[lx].vblks.n_blks == 0);
+            continue;
+        }
 
-    err = kvset_create(cn->cn_tree, *context, &km, &kvset);
-    if (ev(err))
-        goto done;
+        dgen = atomic64_add_return(1, &cn->cn_ingest_dgen);
+
+        /* Lend childv[lx] kblk and vblk lists to kvset_create().
+         * Yes, the struct copy is a bit gross, but it works and
+         * avoids unnecessary allocations of temporary lists.
+         */
+        km.km_kblk_list = childv[lx].kblks;
+        km.km_vblk_list = childv[lx].vblks;
+        km.km_dgen = dgen;
+        km.km_node_level = 0;
+        km.km_node_offset = 0;
+
+        km.km_vused = childv[lx].bl_vused;
+        km.km_compc = 0;
+        km.km_capped = cn_is_capped(cn);
+        km.km_restored = false;
+        km.km_scatter = km.km_vused ? 1 : 0;
+
+        /* DO NOT LOG META WHEN childv[lx].kblks.n_blks == 0 */
+        tstart = get_time_ns();
+        err = cndb_txn_meta(cn->cn_cndb, txid, cn->cn_cnid, tagv[lx], &km);
+        st->cis_cndb_ns += get_time_ns() - tstart;
+        if (ev(err))
+            goto done;
 
-    *kvsetp = kvset;
+        tstart = get_time_ns();
+        err = kvset_create(cn->cn_tree, tagv[lx], &km, &kvsetv[lx]);
+        st->cis_insert_ns += get_time_ns() - tstart;
+        if (ev(err))
+            goto done;
+    }
 
 done:
     if (err) {
+        for (lx = 0; lx < childc; lx++) {
+            if (kvsetv[lx])
+                kvset_put_ref(kvsetv[lx]);
+            kvsetv[lx] = NULL;
+        }
+
         /* Delete committed mblocks, abort those not yet committed. */
         cn_mblocks_destroy(cn->cn_dataset, childc, childv, 0, commitc);
-        *kvsetp = NULL;
     }
 
+    free(tagv);
+
     return err;
 }
 
-merr_t
-cn_ingestv(
-    struct cn **           cn,
-    struct kvset_mblocks **mbv,
-    int *                  mbc,
-    u32 *                  vcommitted,
-    u64                    ingestid,
-    int                    ingestc,
-    bool *                 ingested_out,
-    u64 *                  seqno_max_out)
-{
-    struct kvset **    kvsetv = NULL;
-    struct cndb *      cndb = NULL;
-    struct kvset_stats kst = {};
+/* A bulk ingest carries a seqno reserved when the load began, which c0
+ * ingests of other kvses may since have passed in cndb.
+ */
+static merr_t
+cn_ingestv_impl(
+    struct cn **            cn,
+    struct kvset_mblocks ** mbv,
+    int *                   mbc,
+    u32 *                   vcommitted,
+    u64                     ingestid,
+    int                     ingestc,
+    bool                    bulk,
+    bool *                  ingested_out,
+    u64 *                   seqno_max_out,
+    struct cn_ingest_stats *stats)
+{
+    struct kvset **        kvsetv = NULL;
+    struct cndb *          cndb = NULL;
+    struct kvset_stats     kst = {};
+    struct cn_ingest_stats st = {};
 
     merr_t err = 0;
     u64    txid = 0;
-    uint   i, first, last, count, check;
+    uint   i, j, first, last, count, check, nc, *kvsetx;
     u64    context = 0; /* must be initialized to zero */
     u64    seqno_max = 0, seqno_min = U64_MAX;
     uint   ext_vblk_count = 0;
     bool   log_ingest = false;
+    bool   locked = false;
     u64    dgen = 0;
+    u64    tstart = get_time_ns();
+    u64    tstep;
 
     /* Ingestc can be large (256), and is typically sparse.
      * Remember the first and last index so we don't have
-     * to iterate the entire list each time.
+     * to iterate the entire list each time.  Each cn may
+     * receive several kvsets (mbc[i]) with disjoint key ranges.
      */
-    first = last = count = 0;
+    first = last = count = nc = 0;
     for (i = 0; i < ingestc; i++) {
 
         if (!cn[i] || !mbc[i] || !mbv[i])
             continue;
 
-        seqno_max = max_t(u64, seqno_max, mbv[i]->bl_seqno_max);
-        seqno_min = min_t(u64, seqno_min, mbv[i]->bl_seqno_min);
+        for (j = 0; j < mbc[i]; j++) {
+            seqno_max = max_t(u64, seqno_max, mbv[i][j].bl_seqno_max);
+            seqno_min = min_t(u64, seqno_min, mbv[i][j].bl_seqno_min);
+        }
 
         if (ev(seqno_min > seqno_max)) {
             err = merr(EINVAL);
@@ -720,6 +1275,7 @@ cn_ingestv(
             first = i;
         last = i;
         count++;
+        nc += mbc[i];
         perfc_inc(&cn[i]->cn_pc_ingest, PERFC_BA_CNCOMP_START);
     }
 
@@ -730,7 +1286,17 @@ cn_ingestv(
         goto done;
     }
 
-    if (ev(seqno_min < cndb_seqno(cndb))) {
+    /* Allocating dgens and adding the kvsets to the root nodes must be
+     * atomic with respect to a concurrent bulk ingest.  The locks are
+     * taken in index order, a bulk ingest takes only one.
+     */
+    for (i = first; i <= last; i++) {
+        if (cn[i] && mbc[i] && mbv[i])
+            mutex_lock(&cn[i]->cn_ingest_lock);
+    }
+    locked = true;
+
+    if (ev(!bulk && seqno_min < cndb_seqno(cndb))) {
         err = merr(EINVAL);
         hse_log(
             HSE_ERR "seqno_min %lu seqno_max %lu cndb_seqno %lu",
@@ -741,13 +1307,24 @@ cn_ingestv(
         goto done;
     }
 
-    kvsetv = calloc(ingestc, sizeof(*kvsetv));
+    /* kvsetx[i] is the offset of the first of cn[i]'s kvsets in kvsetv[].
+     */
+    kvsetv = calloc(1, nc * sizeof(*kvsetv) + ingestc * sizeof(*kvsetx));
     if (ev(!kvsetv)) {
         err = merr(EINVAL);
         goto done;
     }
 
-    err = cndb_txn_start(cndb, &txid, ingestid, count, 0, seqno_max);
+    kvsetx = (void *)(kvsetv + nc);
+    for (i = first, j = 0; i <= last; i++) {
+        kvsetx[i] = j;
+        if (cn[i] && mbc[i] && mbv[i])
+            j += mbc[i];
+    }
+
+    tstep = get_time_ns();
+    err = cndb_txn_start(cndb, &txid, ingestid, nc, 0, seqno_max);
+    st.cis_cndb_ns += get_time_ns() - tstep;
     if (ev(err))
         goto done;
 
@@ -765,7 +1342,8 @@ cn_ingestv(
         if (vcp)
             ext_vblk_count += *vcp;
 
-        err = cn_ingest_prep(cn[i], mbv[i], mbc[i], txid, &context, vcp, &kvsetv[i]);
+        err = cn_ingest_prep(
+            cn[i], mbv[i], mbc[i], txid, &context, vcp, kvsetv + kvsetx[i], &st);
         if (ev(err))
             goto done;
         check++;
@@ -775,31 +1353,71 @@ cn_ingestv(
     /* There must not be any failure conditions after successful ACK_C
      * because the operation has been committed.
      */
+    tstep = get_time_ns();
     err = cndb_txn_ack_c(cndb, txid);
+    st.cis_cndb_ns += get_time_ns() - tstep;
     if (ev(err))
         goto done;
 
+    tstep = get_time_ns();
     check = 0;
     for (i = first; i <= last; i++) {
+        struct kvset_mblocks *pt;
+        struct cn_event       cev = { 0 };
 
         if (!cn[i] || !mbc[i] || !mbv[i])
             continue;
 
-        if (log_ingest) {
-            kvset_stats_add(kvset_statsp(kvsetv[i]), &kst);
-            dgen = kvsetv[i]->ks_dgen;
+        /* The kvsets are in ascending key order, so the max ptomb
+         * is that of the last kvset which has one.
+         */
+        pt = mbv[i] + mbc[i] - 1;
+        for (j = mbc[i]; j-- > 0;) {
+            if (mbv[i][j].bl_last_ptlen) {
+                pt = mbv[i] + j;
+                break;
+            }
+        }
+
+        for (j = 0; j < mbc[i]; j++) {
+            struct kvset *ks = kvsetv[kvsetx[i] + j];
+
+            if (!ks)
+                continue;
+
+            if (log_ingest) {
+                kvset_stats_add(kvset_statsp(ks), &kst);
+                dgen = ks->ks_dgen;
+            }
+
+            perfc_add(
+                &cn[i]->cn_pc_amp,
+                PERFC_RA_CNAMP_INGEST,
+                kvset_statsp(ks)->kst_kwlen + kvset_statsp(ks)->kst_vwlen);
+
+            cev.ce_kvsets_out++;
+            cev.ce_keys_out += kvset_statsp(ks)->kst_keys;
+            cev.ce_bytes_out += kvset_statsp(ks)->kst_kwlen + kvset_statsp(ks)->kst_vwlen;
+
+            cn_tree_ingest_update(
+                cn[i]->cn_tree, ks, pt->bl_last_ptomb, pt->bl_last_ptlen, pt->bl_last_ptseq);
         }
 
-        cn_tree_ingest_update(
-            cn[i]->cn_tree,
-            kvsetv[i],
-            mbv[i]->bl_last_ptomb,
-            mbv[i]->bl_last_ptlen,
-            mbv[i]->bl_last_ptseq);
+        cn_tree_ttl_sample(cn[i]->cn_tree, cn_get_ingest_seqno(cn[i]));
         check++;
+
+        if (cn[i]->cn_kvdb) {
+            cev.ce_type = CN_EVENT_INGEST;
+            cev.ce_cnid = cn[i]->cn_cnid;
+            cev.ce_keys_in = cev.ce_keys_out;
+            cev.ce_run_ns = get_time_ns() - tstart;
+            cn_evlog_add(cn[i]->cn_kvdb->cnd_evlog, &cev);
+        }
     }
     assert(check == count);
 
+    st.cis_insert_ns += get_time_ns() - tstep;
+
     *ingested_out = true;
     *seqno_max_out = seqno_max;
 
@@ -828,7 +1446,11 @@ done:
 
     /* NOTE: we always free the callers kvset mblocks */
     for (i = first; i <= last; i++) {
-        kvset_mblocks_destroy(mbv[i]);
+        for (j = 0; mbv[i] && j < mbc[i]; j++)
+            kvset_mblocks_destroy(mbv[i] + j);
+
+        if (locked && cn[i] && mbc[i] && mbv[i])
+            mutex_unlock(&cn[i]->cn_ingest_lock);
 
         if (cn[i])
             perfc_inc(&cn[i]->cn_pc_ingest, PERFC_BA_CNCOMP_FINISH);
@@ -836,9 +1458,38 @@ done:
 
     free(kvsetv);
 
+    if (stats)
+        *stats = st;
+
     return err;
 }
 
+merr_t
+cn_ingestv(
+    struct cn **            cn,
+    struct kvset_mblocks ** mbv,
+    int *                   mbc,
+    u32 *                   vcommitted,
+    u64                     ingestid,
+    int                     ingestc,
+    bool *                  ingested_out,
+    u64 *                   seqno_max_out,
+    struct cn_ingest_stats *stats)
+{
+    return cn_ingestv_impl(
+        cn, mbv, mbc, vcommitted, ingestid, ingestc, false, ingested_out, seqno_max_out, stats);
+}
+
+merr_t
+cn_ingest_bulk(struct cn *cn, struct kvset_mblocks *mbv, int mbc)
+{
+    bool ingested;
+    u64  seqno_max;
+
+    return cn_ingestv_impl(
+        &cn, &mbv, &mbc, NULL, CNDB_INVAL_INGESTID, 1, true, &ingested, &seqno_max, NULL);
+}
+
 static void
 cn_maintenance_task(struct work_struct *context)
 {
@@ -883,6 +1534,46 @@ cn_tstate_get(struct cn_tstate *tstate, u32 *genp, u8 *mapv)
     mutex_unlock(&impl->tsi_lock);
 }
 
+static void
+cn_tstate_get_ckpt(struct cn_tstate *tstate, struct cn_tstate_ckpt *ckptv)
+{
+    struct cn_tstate_impl *    impl;
+    struct cn_tstate_ckpt_omf *omf;
+    uint                       i;
+
+    assert(tstate && ckptv);
+
+    impl = container_of(tstate, struct cn_tstate_impl, tsi_tstate);
+
+    mutex_lock(&impl->tsi_lock);
+    for (i = 0; i < CN_TSTATE_CKPT_MAX; i++) {
+        omf = &impl->tsi_omf.ts_ckptv[i];
+
+        ckptv[i].tsc_loc.node_level = omf_tsc_level(omf);
+        ckptv[i].tsc_loc.node_offset = omf_tsc_offset(omf);
+        ckptv[i].tsc_dgen_lo = omf_tsc_dgen_lo(omf);
+        ckptv[i].tsc_dgen_hi = omf_tsc_dgen_hi(omf);
+    }
+    mutex_unlock(&impl->tsi_lock);
+}
+
+static u64
+cn_tstate_get_ttl_seq(struct cn_tstate *tstate)
+{
+    struct cn_tstate_impl *impl;
+    u64                    seq;
+
+    assert(tstate);
+
+    impl = container_of(tstate, struct cn_tstate_impl, tsi_tstate);
+
+    mutex_lock(&impl->tsi_lock);
+    seq = omf_ts_ttl_seq(&impl->tsi_omf);
+    mutex_unlock(&impl->tsi_lock);
+
+    return seq;
+}
+
 static merr_t
 cn_tstate_update(
     struct cn_tstate *   tstate,
@@ -941,6 +1632,8 @@ cn_tstate_create(struct cn *cn)
     mutex_init(&impl->tsi_lock);
     impl->tsi_tstate.ts_update = cn_tstate_update;
     impl->tsi_tstate.ts_get = cn_tstate_get;
+    impl->tsi_tstate.ts_get_ckpt = cn_tstate_get_ckpt;
+    impl->tsi_tstate.ts_get_ttl_seq = cn_tstate_get_ttl_seq;
     impl->tsi_cn = cn;
 
     omf = &impl->tsi_omf;
@@ -1015,39 +1708,173 @@ cn_tstate_destroy(struct cn_tstate *tstate)
     free_aligned(impl);
 }
 
+/**
+ * struct cn_kvsetmk_job - a kvset to create at open
+ * @kj_work:   work struct, for the kvset creation workqueue
+ * @kj_tree:   cn tree
+ * @kj_km:     kvset metadata, a copy of the one given by cndb
+ * @kj_tag:    kvset tag
+ * @kj_kvset:  kvset created
+ * @kj_err:    creation status
+ */
+struct cn_kvsetmk_job {
+    struct work_struct kj_work;
+    struct cn_tree *   kj_tree;
+    struct kvset_meta  kj_km;
+    u64                kj_tag;
+    struct kvset *     kj_kvset;
+    merr_t             kj_err;
+};
+
+/**
+ * struct cn_kvsetmk_ctx - kvsets to create at open
+ * @ckmk_cn:             cn
+ * @ckmk_dgen:           (output) highest dgen of the kvsets
+ * @ckmk_node_level_max: (output) deepest level of the kvsets
+ * @ckmk_kvsets:         (output) number of kvsets created
+ * @ckmk_mblocks:        number of kblocks and vblocks of the kvsets to create
+ * @ckmk_jobv:           kvsets to create, in cndb order
+ * @ckmk_jobc:           length of @ckmk_jobv
+ * @ckmk_jobmax:         allocated length of @ckmk_jobv
+ */
 struct cn_kvsetmk_ctx {
-    struct cn *ckmk_cn;
-    u64 *      ckmk_dgen;
-    uint       ckmk_node_level_max;
-    uint       ckmk_kvsets;
+    struct cn *            ckmk_cn;
+    u64 *                  ckmk_dgen;
+    uint                   ckmk_node_level_max;
+    uint                   ckmk_kvsets;
+    u64                    ckmk_mblocks;
+    struct cn_kvsetmk_job *ckmk_jobv;
+    uint                   ckmk_jobc;
+    uint                   ckmk_jobmax;
 };
 
+/* cndb_cn_instantiate() callback: remember the kvset to create.  cndb
+ * reuses @km, so the block lists are copied.
+ */
 static merr_t
 cn_kvset_mk(struct cn_kvsetmk_ctx *ctx, struct kvset_meta *km, u64 tag)
 {
-    struct kvset *kvset;
-    struct cn *   cn = ctx->ckmk_cn;
-    merr_t        err;
+    struct cn_kvsetmk_job *job;
+    merr_t                 err = 0;
+    uint                   i;
 
-    err = kvset_create(cn->cn_tree, tag, km, &kvset);
-    if (ev(err))
-        return err;
+    if (ctx->ckmk_jobc == ctx->ckmk_jobmax) {
+        uint  max = ctx->ckmk_jobmax ? ctx->ckmk_jobmax * 2 : 256;
+        void *p;
+
+        p = realloc(ctx->ckmk_jobv, max * sizeof(*job));
+        if (ev(!p))
+            return merr(ENOMEM);
+
+        ctx->ckmk_jobv = p;
+        ctx->ckmk_jobmax = max;
+    }
+
+    job = ctx->ckmk_jobv + ctx->ckmk_jobc;
+    memset(job, 0, sizeof(*job));
+
+    job->kj_tree = ctx->ckmk_cn->cn_tree;
+    job->kj_tag = tag;
+    job->kj_km = *km;
+
+    blk_list_init(&job->kj_km.km_kblk_list);
+    blk_list_init(&job->kj_km.km_vblk_list);
+
+    for (i = 0; i < km->km_kblk_list.n_blks && !err; i++)
+        err = blk_list_append(&job->kj_km.km_kblk_list, 0, km->km_kblk_list.blks[i].bk_blkid);
+
+    for (i = 0; i < km->km_vblk_list.n_blks && !err; i++)
+        err = blk_list_append(&job->kj_km.km_vblk_list, 0, km->km_vblk_list.blks[i].bk_blkid);
 
-    err = cn_tree_insert_kvset(cn->cn_tree, kvset, km->km_node_level, km->km_node_offset);
     if (ev(err)) {
-        kvset_put_ref(kvset);
+        blk_list_free(&job->kj_km.km_kblk_list);
+        blk_list_free(&job->kj_km.km_vblk_list);
         return err;
     }
 
-    ctx->ckmk_kvsets++;
+    ctx->ckmk_jobc++;
+    ctx->ckmk_mblocks += km->km_kblk_list.n_blks + km->km_vblk_list.n_blks;
+
+    return 0;
+}
+
+static void
+cn_kvset_mk_work(struct work_struct *work)
+{
+    struct cn_kvsetmk_job *job = container_of(work, struct cn_kvsetmk_job, kj_work);
+
+    job->kj_err = kvset_create(job->kj_tree, job->kj_tag, &job->kj_km, &job->kj_kvset);
+}
+
+/* Create the kvsets on up to cn_io_threads threads, which maps their
+ * kblocks, reads their headers and preloads their blooms in parallel.
+ * Then insert them into the tree in cndb order, as the order of the
+ * kvsets within a node must follow their dgens.  If @err is set (cndb
+ * failed), only release the jobs.
+ */
+static merr_t
+cn_kvset_mk_all(struct cn_kvsetmk_ctx *ctx, merr_t err)
+{
+    struct workqueue_struct *wq = NULL;
+    struct cn *              cn = ctx->ckmk_cn;
+    uint                     i;
+
+    if (!err && ctx->ckmk_jobc > 1) {
+        wq = alloc_workqueue("cn_open", 0, cn->rp->cn_io_threads ?: 4);
+        ev(!wq);
+    }
 
-    if (km->km_dgen > *(ctx->ckmk_dgen))
-        *(ctx->ckmk_dgen) = km->km_dgen;
+    for (i = 0; i < ctx->ckmk_jobc && !err; i++) {
+        struct cn_kvsetmk_job *job = ctx->ckmk_jobv + i;
 
-    if (km->km_node_level > ctx->ckmk_node_level_max)
-        ctx->ckmk_node_level_max = km->km_node_level;
+        INIT_WORK(&job->kj_work, cn_kvset_mk_work);
 
-    return 0;
+        if (wq)
+            queue_work(wq, &job->kj_work);
+        else
+            cn_kvset_mk_work(&job->kj_work);
+    }
+
+    if (wq) {
+        flush_workqueue(wq);
+        destroy_workqueue(wq);
+    }
+
+    for (i = 0; i < ctx->ckmk_jobc; i++) {
+        struct cn_kvsetmk_job *job = ctx->ckmk_jobv + i;
+        struct kvset_meta *    km = &job->kj_km;
+
+        if (!err)
+            err = job->kj_err;
+
+        if (!err && job->kj_kvset) {
+            err = cn_tree_insert_kvset(
+                cn->cn_tree, job->kj_kvset, km->km_node_level, km->km_node_offset);
+            if (!err) {
+                job->kj_kvset = NULL;
+
+                ctx->ckmk_kvsets++;
+
+                if (km->km_dgen > *(ctx->ckmk_dgen))
+                    *(ctx->ckmk_dgen) = km->km_dgen;
+
+                if (km->km_node_level > ctx->ckmk_node_level_max)
+                    ctx->ckmk_node_level_max = km->km_node_level;
+            }
+        }
+
+        if (job->kj_kvset)
+            kvset_put_ref(job->kj_kvset);
+
+        blk_list_free(&km->km_kblk_list);
+        blk_list_free(&km->km_vblk_list);
+    }
+
+    free(ctx->ckmk_jobv);
+    ctx->ckmk_jobv = NULL;
+    ctx->ckmk_jobc = ctx->ckmk_jobmax = 0;
+
+    return err;
 }
 
 /*----------------------------------------------------------------
@@ -1085,6 +1912,8 @@ cn_perfc_alloc(struct cn *cn)
         { cn_perfc_shape, PERFC_EN_CNSHAPE, "lnode", &cn->cn_pc_shape_lnode },
 
         { cn_perfc_capped, PERFC_EN_CNCAPPED, "capped", &cn->cn_pc_capped },
+
+        { cn_perfc_amp, PERFC_EN_CNAMP, "amp", &cn->cn_pc_amp },
     };
 
     i = snprintf(
@@ -1131,6 +1960,7 @@ cn_perfc_free(struct cn *cn)
     perfc_ctrseti_free(&cn->cn_pc_shape_inode);
     perfc_ctrseti_free(&cn->cn_pc_shape_lnode);
     perfc_ctrseti_free(&cn->cn_pc_capped);
+    perfc_ctrseti_free(&cn->cn_pc_amp);
 }
 
 /*----------------------------------------------------------------
@@ -1158,6 +1988,7 @@ cn_open(
     struct cn * cn;
     size_t      sz;
     u64         dgen = 0;
+    u64         tstart;
     bool        maint;
     uint64_t    mperr, staging_absent;
 
@@ -1210,6 +2041,14 @@ cn_open(
     cn->cn_hash = key_hash64(kvs_name, strlen(kvs_name));
     cn->cn_mpool_params = mpool_params;
 
+    mutex_init(&cn->cn_amp_lock);
+    mutex_init(&cn->cn_ingest_lock);
+    mutex_init(&cn->cn_cfilter_lock);
+    cn->cn_amp_start = get_time_ns();
+
+    /* One second worth of burst for the guaranteed write rate. */
+    tbkt_init(&cn->cn_tbkt_floor, rp->cn_compact_rate_min << 20, rp->cn_compact_rate_min << 20);
+
     hse_meminfo(NULL, &mavail, 30);
 
     staging_absent = mpool_mclass_get(ds, MP_MED_STAGING, NULL);
@@ -1218,6 +2057,13 @@ cn_open(
             hse_log(HSE_WARNING "Staging media is not configured.");
             rp->cn_media_class = MP_MED_CAPACITY;
         }
+
+        if (rp->cn_kblk_mclass_map != CN_MCLASS_MAP_UNSET ||
+            rp->cn_vblk_mclass_map != CN_MCLASS_MAP_UNSET) {
+            hse_log(HSE_WARNING "Staging media is not configured, ignoring cn mclass maps.");
+            rp->cn_kblk_mclass_map = CN_MCLASS_MAP_UNSET;
+            rp->cn_vblk_mclass_map = CN_MCLASS_MAP_UNSET;
+        }
     }
 
     /* Reduce c1 vbuilder contribution for low memory configurations. */
@@ -1253,6 +2099,14 @@ cn_open(
 
     cn_tree_setup(cn->cn_tree, ds, cn, rp, cndb, cnid, cn->cn_kvdb);
 
+    if (rp->cn_icache_mb > 0) {
+        err = wbt_icache_create(rp->cn_icache_mb << 20, &cn->cn_pc_get, &cn->cn_icache);
+        if (ev(err))
+            goto err_exit;
+
+        cn_tree_set_icache(cn->cn_tree, cn->cn_icache);
+    }
+
     ctx.ckmk_cn = cn;
     ctx.ckmk_dgen = &dgen;
 
@@ -1267,10 +2121,19 @@ cn_open(
         vcnt = atomic64_read(&cn_kvdb->cnd_vblk_cnt);
     }
 
+    tstart = get_time_ns();
     err = cndb_cn_instantiate(cndb, cnid, &ctx, (void *)cn_kvset_mk);
+    cn->cn_open_stats.cos_instantiate_ns = get_time_ns() - tstart;
+
+    tstart = get_time_ns();
+    err = cn_kvset_mk_all(&ctx, err);
     if (ev(err))
         goto err_exit;
 
+    cn->cn_open_stats.cos_kvset_ns = get_time_ns() - tstart;
+    cn->cn_open_stats.cos_kvsets = ctx.ckmk_kvsets;
+    cn->cn_open_stats.cos_mblocks = ctx.ckmk_mblocks;
+
     if (cn_kvdb) {
         /* [HSE_REVISIT]: This approach is not thread-safe */
         ksz = atomic64_read(&cn_kvdb->cnd_kblk_size) - ksz;
@@ -1287,14 +2150,23 @@ cn_open(
 
     cn_tree_set_initial_dgen(cn->cn_tree, dgen);
 
+    cn_tree_ckpt_restore(cn->cn_tree);
+
+    err = cn_tree_split_restore(cn->cn_tree);
+    if (ev(err))
+        goto err_exit;
+
     cn_tree_samp_init(cn->cn_tree);
 
     atomic64_set(&cn->cn_ingest_dgen, cn_tree_initial_dgen(cn->cn_tree));
+    atomic64_set(&cn->cn_ingest_seqno, cndb_seqno(cn->cn_cndb));
+
+    cn_tree_ttl_init(cn->cn_tree, rp->kvs_ttl, atomic64_read(&cn->cn_ingest_seqno));
 
     hse_log(
         HSE_NOTICE "cn_open %s/%s replay %d fanout %u "
                    "pfx_len %u pfx_pivot %u cnid %lu depth %u/%u %s "
-                   "kb %lu%c/%lu vb %lu%c/%lu",
+                   "kb %lu%c/%lu vb %lu%c/%lu kvsets %lu open %lu+%lums",
         cn->cn_mpname,
         cn->cn_kvsname,
         cn->cn_replay,
@@ -1310,7 +2182,10 @@ cn_open(
         kcnt,
         vsz >> (vshift * 10),
         *vszsuf,
-        vcnt);
+        vcnt,
+        (ulong)cn->cn_open_stats.cos_kvsets,
+        (ulong)cn->cn_open_stats.cos_instantiate_ns / 1000000,
+        (ulong)cn->cn_open_stats.cos_kvset_ns / 1000000);
 
     if (!maint)
         goto done;
@@ -1324,6 +2199,8 @@ cn_open(
         goto err_exit;
     }
 
+    workqueue_set_cpus(cn->cn_io_wq, cn_kvdb ? cn_kvdb->cnd_cpus : 0);
+
     /* Work queue for other work such as managing "capped" trees,
      * offloading kvset destroy from client queries, and running
      * vblock readahead operations.
@@ -1334,9 +2211,14 @@ cn_open(
         goto err_exit;
     }
 
+    workqueue_set_cpus(cn->cn_maint_wq, cn_kvdb ? cn_kvdb->cnd_cpus : 0);
+
     if (cn->csched && !cn_is_capped(cn))
         csched_tree_add(cn->csched, cn->cn_tree);
 
+    if (cn->cn_kvdb && !cn_is_capped(cn))
+        cn_scrub_add(cn->cn_kvdb->cnd_scrub, cn);
+
     if (cn_is_capped(cn)) {
         INIT_WORK(&cn->cn_maintenance_work, cn_maintenance_task);
         queue_work(cn->cn_maint_wq, &cn->cn_maintenance_work);
@@ -1346,9 +2228,10 @@ cn_open(
      * Otherwise, cn_bloom_capped overrides cn_bloom_prob.
      */
     if (cn_is_capped(cn) && rp->cn_bloom_create) {
-        rp->cn_bloom_create = (rp->cn_bloom_capped > 0);
-        if (rp->cn_bloom_create)
+        if (rp->cn_bloom_capped > 0)
             rp->cn_bloom_prob = rp->cn_bloom_capped;
+        else
+            rp->cn_bloom_create = BLOOM_CREATE_NONE;
     }
 
 done:
@@ -1362,9 +2245,13 @@ err_exit:
     destroy_workqueue(cn->cn_maint_wq);
     destroy_workqueue(cn->cn_io_wq);
     cn_tree_destroy(cn->cn_tree);
+    wbt_icache_destroy(cn->cn_icache);
     cn_tstate_destroy(cn->cn_tstate);
     if (!cn->cn_replay)
         cn_perfc_free(cn);
+    mutex_destroy(&cn->cn_cfilter_lock);
+    mutex_destroy(&cn->cn_ingest_lock);
+    mutex_destroy(&cn->cn_amp_lock);
     free_aligned(cn);
 
     return err ?: merr(ev(EBUG));
@@ -1394,10 +2281,17 @@ cn_close(struct cn *cn)
     if (cn->csched && !cn->cn_replay)
         csched_tree_remove(cn->csched, cn->cn_tree, cancel);
 
+    if (cn->cn_kvdb)
+        cn_scrub_remove(cn->cn_kvdb->cnd_scrub, cn);
+
     /* Wait for all compaction jobs and async kvset destroys to complete.
+     * Deferred mblock deletes hold a reference until done, hurry them.
      */
     next_report = get_time_ns() + NSEC_PER_SEC;
     while (atomic_read(&cn->cn_refcnt) > 0) {
+        if (cn->cn_kvdb)
+            cn_reclaim_flush(cn->cn_kvdb->cnd_reclaim);
+
         msleep(100);
         if (get_time_ns() < next_report)
             continue;
@@ -1421,11 +2315,15 @@ cn_close(struct cn *cn)
     cndb_putref(cn->cn_cndb);
 
     cn_tree_destroy(cn->cn_tree);
+    wbt_icache_destroy(cn->cn_icache);
     cn_tstate_destroy(cn->cn_tstate);
 
     destroy_workqueue(maint_wq);
     destroy_workqueue(io_wq);
     cn_perfc_free(cn);
+    mutex_destroy(&cn->cn_cfilter_lock);
+    mutex_destroy(&cn->cn_ingest_lock);
+    mutex_destroy(&cn->cn_amp_lock);
 
     free_aligned(cn);
 
@@ -1534,6 +2432,8 @@ cn_cursor_create(
     struct cn *            cn,
     u64                    seqno,
     bool                   reverse,
+    bool                   keys_only,
+    bool                   direct,
     const void *           prefix,
     u32                    pfx_len,
     struct cursor_summary *summary,
@@ -1564,6 +2464,12 @@ cn_cursor_create(
      *  valbuf  MAX_VAL_LEN
      */
     cur->pfxhash = pfx_hash64(prefix, pfx_len, ct_pfx_len);
+
+    /* A range tree routes the cursor on its whole prefix, which
+     * thus names its shared view.
+     */
+    if (cn->cn_cflags & CN_CFLAG_RANGE)
+        cur->pfxhash = key_hash64(prefix, pfx_len);
     cur->pfx_len = pfx_len;
     cur->ct_pfx_len = ct_pfx_len;
     cur->pfx = prefix;
@@ -1577,6 +2483,8 @@ cn_cursor_create(
 
     cur->summary = summary;
     cur->reverse = reverse;
+    cur->keys_only = keys_only;
+    cur->direct = direct;
 
     /*
      * attempt to create the cursor several times:
@@ -1619,8 +2527,10 @@ cn_cursor_update(void *cursor, u64 seqno, bool *updated)
 
     cur->seqno = seqno;
 
-    /* common case: nothing changed, nothing to do */
-    if (cur->dgen == dgen)
+    /* common case: nothing changed, nothing to do, unless the new view
+     * admits kvsets the cursor left out as too new.
+     */
+    if (cur->dgen == dgen && seqno < cur->seqno_skip)
         return 0;
 
     do {
@@ -1671,6 +2581,16 @@ cn_cursor_destroy(void *cursor)
     cn_pscan_free(cur);
 }
 
+void
+cn_cursor_pred(void *cursor, kvs_pred_fn *keyfn, kvs_pred_fn *valfn, void *arg)
+{
+    struct pscan *cur = cursor;
+
+    cur->pred_key = keyfn;
+    cur->pred_val = valfn;
+    cur->pred_arg = arg;
+}
+
 merr_t
 cn_cursor_active_kvsets(void *cursor, u32 *active, u32 *total)
 {
@@ -1716,6 +2636,7 @@ cn_make(struct mpool *ds, struct kvs_cparams *cp, struct kvdb_health *health)
     icp.cp_pfx_len = cp->cp_pfx_len;
     icp.cp_sfx_len = cp->cp_sfx_len;
     icp.cp_pfx_pivot = cp->cp_pfx_pivot;
+    icp.cp_range = cp->cp_range;
 
     err = cn_tree_create(&tree, NULL, cn_cp2cflags(cp), &icp, health, &rp);
     if (!err)
@@ -0,0 +1,506 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/minmax.h>
+#include <hse_util/keycmp.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+
+#include <hse/hse_limits.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_attach.h>
+#include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvset_builder.h>
+#include <hse_ikvdb/mblock_life.h>
+#include <hse_ikvdb/limits.h>
+
+#include <mpool/mpool.h>
+
+#include "cn_mblocks.h"
+#include "cn_tree_iter.h"
+#include "blk_list.h"
+#include "kvset.h"
+#include "omf.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Most kblocks and vblocks a kvset's image directory may hold, of each.
+ */
+#define CN_ATTACH_BLKS_MAX (1024)
+
+/**
+ * struct cn_attach - attach of kvset images
+ * @ca_cn:        cn
+ * @ca_mbv:       mblocks of the kvsets written, in ingest order
+ * @ca_mbc:       number of kvsets written
+ * @ca_mbmax:     capacity of @ca_mbv
+ * @ca_seqno_min: smallest seqno of the kvsets written
+ * @ca_seqno_max: largest seqno of the kvsets written
+ */
+struct cn_attach {
+    struct cn *           ca_cn;
+    struct kvset_mblocks *ca_mbv;
+    uint                  ca_mbc;
+    uint                  ca_mbmax;
+    u64                   ca_seqno_min;
+    u64                   ca_seqno_max;
+};
+
+/**
+ * struct ca_images - image files of a kvset
+ * @ci_kpathv: kblock image paths, by kblock index
+ * @ci_vpathv: vblock image paths, by vblock index
+ * @ci_vlenv:  vblock image lengths
+ * @ci_kblkc:  number of kblocks
+ * @ci_vblkc:  number of vblocks
+ */
+struct ca_images {
+    char *ci_kpathv[CN_ATTACH_BLKS_MAX];
+    char *ci_vpathv[CN_ATTACH_BLKS_MAX];
+    u32   ci_vlenv[CN_ATTACH_BLKS_MAX];
+    u32   ci_kblkc;
+    u32   ci_vblkc;
+};
+
+static void
+ca_images_free(struct ca_images *ci)
+{
+    uint i;
+
+    for (i = 0; i < CN_ATTACH_BLKS_MAX; i++) {
+        free(ci->ci_kpathv[i]);
+        free(ci->ci_vpathv[i]);
+    }
+
+    free(ci);
+}
+
+/* Collect the K<n> and V<n> files of @dir, whose indexes must each run
+ * from zero without gaps.
+ */
+static merr_t
+ca_scan(const char *dir, struct ca_images *ci)
+{
+    struct dirent *d;
+    DIR *          dirp;
+    merr_t         err = 0;
+    uint           i;
+
+    dirp = opendir(dir);
+    if (ev(!dirp))
+        return merr(errno);
+
+    while (!err && (d = readdir(dirp))) {
+        char ** pathv;
+        u32 *   countp;
+        char *  end;
+        ulong   idx;
+
+        if (d->d_name[0] == 'K') {
+            pathv = ci->ci_kpathv;
+            countp = &ci->ci_kblkc;
+        } else if (d->d_name[0] == 'V') {
+            pathv = ci->ci_vpathv;
+            countp = &ci->ci_vblkc;
+        } else {
+            continue;
+        }
+
+        if (!isdigit(d->d_name[1]))
+            continue;
+
+        idx = strtoul(d->d_name + 1, &end, 10);
+        if (*end && *end != '.')
+            continue;
+
+        if (ev(idx >= CN_ATTACH_BLKS_MAX || pathv[idx])) {
+            err = merr(EINVAL);
+            break;
+        }
+
+        if (ev(asprintf(&pathv[idx], "%s/%s", dir, d->d_name) == -1)) {
+            pathv[idx] = NULL;
+            err = merr(ENOMEM);
+            break;
+        }
+
+        *countp = max_t(u32, *countp, idx + 1);
+    }
+
+    closedir(dirp);
+
+    if (err)
+        return err;
+
+    if (ev(!ci->ci_kblkc))
+        return merr(EINVAL);
+
+    for (i = 0; i < ci->ci_kblkc; i++)
+        if (ev(!ci->ci_kpathv[i]))
+            return merr(EINVAL);
+
+    for (i = 0; i < ci->ci_vblkc; i++)
+        if (ev(!ci->ci_vpathv[i]))
+            return merr(EINVAL);
+
+    return 0;
+}
+
+/* Read an image into a page aligned buffer.  If @hdrlen is not zero only
+ * that much of it is read, into @buf, but its whole length is checked.
+ */
+static merr_t
+ca_read(const char *path, size_t max, size_t hdrlen, void **bufp, size_t *lenp)
+{
+    struct stat st;
+    ssize_t     cc;
+    size_t      len, off;
+    void *      buf;
+    merr_t      err = 0;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if (ev(fd == -1))
+        return merr(errno);
+
+    if (ev(fstat(fd, &st))) {
+        err = merr(errno);
+        goto out;
+    }
+
+    len = st.st_size;
+    if (ev(!len || len % PAGE_SIZE || len > max)) {
+        err = merr(EINVAL);
+        goto out;
+    }
+
+    *lenp = len;
+
+    if (hdrlen) {
+        buf = *bufp;
+        len = hdrlen;
+    } else {
+        buf = alloc_page_aligned(len, GFP_KERNEL);
+        if (ev(!buf)) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+    }
+
+    for (off = 0; off < len; off += cc) {
+        cc = pread(fd, buf + off, len - off, off);
+        if (ev(cc <= 0)) {
+            err = merr(cc ? errno : EIO);
+            break;
+        }
+    }
+
+    if (!hdrlen) {
+        if (err)
+            free_aligned(buf);
+        else
+            *bufp = buf;
+    }
+
+out:
+    close(fd);
+
+    return err;
+}
+
+/* Copy an image into a new mblock and add the mblock to @list.
+ */
+static merr_t
+ca_write(struct cn *cn, struct blk_list *list, bool vblock, void *buf, size_t len)
+{
+    struct kvs_rparams * rp = cn_get_rp(cn);
+    struct mpool *       ds = cn_get_dataset(cn);
+    struct mblock_props  props;
+    enum mp_media_classp mclass;
+    struct iovec         iov;
+    size_t               chunk, off;
+    merr_t               err;
+    u64                  mbh;
+
+    mclass = kvset_mclass_lvl(
+        vblock ? rp->cn_vblk_mclass_map : rp->cn_kblk_mclass_map, 0, rp->cn_media_class);
+
+    err = cn_mblock_alloc(cn, ds, mclass, mblock_life_cn(vblock, 0), false, &mbh, &props);
+    if (ev(err))
+        return err;
+
+    if (ev(len > props.mpr_alloc_cap)) {
+        err = merr(EFBIG);
+        goto errout;
+    }
+
+    /* Write in chunks that are a multiple of the mblock stripe length. */
+    chunk = (1024 * 1024) - (1024 * 1024) % props.mpr_stripe_len;
+
+    for (off = 0; off < len && !err; off += iov.iov_len) {
+        iov.iov_base = buf + off;
+        iov.iov_len = min_t(size_t, chunk, len - off);
+
+        err = mpool_mblock_write_data(ds, true, mbh, &iov, 1, NULL);
+    }
+
+    if (ev(err))
+        goto errout;
+
+    err = blk_list_append(list, mbh, props.mpr_objid);
+    if (ev(err))
+        goto errout;
+
+    return 0;
+
+errout:
+    mpool_mblock_abort(ds, mbh);
+
+    return err;
+}
+
+static merr_t
+ca_kblocks(struct cn_attach *att, struct ca_images *ci, struct kvset_mblocks *mb)
+{
+    struct kvs_cparams *cp = cn_get_cparams(att->ca_cn);
+    u8                  maxkey[HSE_KVS_KLEN_MAX];
+    uint                maxklen = 0;
+    merr_t              err = 0;
+    uint                i;
+
+    mb->bl_seqno_min = U64_MAX;
+
+    for (i = 0; i < ci->ci_kblkc && !err; i++) {
+        struct kblock_hdr_omf *kbh;
+        size_t                 len;
+        void *                 buf;
+
+        err = ca_read(ci->ci_kpathv[i], KBLOCK_MAX_SIZE, 0, &buf, &len);
+        if (ev(err))
+            break;
+
+        kbh = buf;
+
+        /* The ptombs of a kvset are ingested apart from its kblocks. */
+        if (ev(omf_kbh_version(kbh) != KBLOCK_HDR_VERSION || omf_kbh_ptombs(kbh))) {
+            err = merr(EINVAL);
+            goto next;
+        }
+
+        err = kc_kblock_image_check(cp, i, buf, len, ci->ci_vlenv, ci->ci_vblkc);
+        if (ev(err))
+            goto next;
+
+        /* The kblocks of a kvset hold disjoint, ascending key ranges. */
+        if (ev(maxklen && keycmp(
+                              maxkey,
+                              maxklen,
+                              buf + omf_kbh_min_koff(kbh),
+                              omf_kbh_min_klen(kbh)) >= 0)) {
+            err = merr(EILSEQ);
+            goto next;
+        }
+
+        if (ev(omf_kbh_max_klen(kbh) > sizeof(maxkey))) {
+            err = merr(EILSEQ);
+            goto next;
+        }
+
+        maxklen = omf_kbh_max_klen(kbh);
+        memcpy(maxkey, buf + omf_kbh_max_koff(kbh), maxklen);
+
+        mb->bl_seqno_min = min_t(u64, mb->bl_seqno_min, omf_kbh_min_seqno(kbh));
+        mb->bl_seqno_max = max_t(u64, mb->bl_seqno_max, omf_kbh_max_seqno(kbh));
+        mb->bl_vused += omf_kbh_val_bytes(kbh);
+
+        err = ca_write(att->ca_cn, &mb->kblks, false, buf, len);
+
+    next:
+        free_aligned(buf);
+    }
+
+    if (!err && ev(mb->bl_seqno_min > mb->bl_seqno_max))
+        err = merr(EILSEQ);
+
+    return err;
+}
+
+static merr_t
+ca_vblocks(struct cn_attach *att, struct ca_images *ci, struct kvset_mblocks *mb)
+{
+    merr_t err = 0;
+    uint   i;
+
+    for (i = 0; i < ci->ci_vblkc && !err; i++) {
+        size_t len;
+        void * buf;
+
+        err = ca_read(ci->ci_vpathv[i], VBLOCK_MAX_SIZE, 0, &buf, &len);
+        if (ev(err))
+            break;
+
+        /* The image must not have changed since its header was checked. */
+        if (ev(len != ci->ci_vlenv[i]))
+            err = merr(EINVAL);
+        else
+            err = kc_vblock_image_check(i, buf, len);
+
+        if (!err)
+            err = ca_write(att->ca_cn, &mb->vblks, true, buf, len);
+
+        free_aligned(buf);
+    }
+
+    return err;
+}
+
+merr_t
+cn_attach_add(struct cn_attach *att, const char *dir)
+{
+    struct kvset_mblocks *mb;
+    struct ca_images *    ci;
+    merr_t                err;
+    uint                  i;
+
+    ci = calloc(1, sizeof(*ci));
+    if (ev(!ci))
+        return merr(ENOMEM);
+
+    err = ca_scan(dir, ci);
+    if (ev(err))
+        goto out;
+
+    /* The kblock checks need the vblocks' lengths, so check the vblock
+     * headers before any image is written.
+     */
+    for (i = 0; i < ci->ci_vblkc; i++) {
+        struct vblock_hdr_omf hdr;
+        void *                buf = &hdr;
+        size_t                len;
+
+        err = ca_read(ci->ci_vpathv[i], VBLOCK_MAX_SIZE, sizeof(hdr), &buf, &len);
+        if (ev(err))
+            goto out;
+
+        err = kc_vblock_image_check(i, &hdr, len);
+        if (ev(err))
+            goto out;
+
+        ci->ci_vlenv[i] = len;
+    }
+
+    if (att->ca_mbc == att->ca_mbmax) {
+        uint mbmax = att->ca_mbmax ? att->ca_mbmax * 2 : 8;
+
+        mb = realloc(att->ca_mbv, mbmax * sizeof(*mb));
+        if (ev(!mb)) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+
+        att->ca_mbv = mb;
+        att->ca_mbmax = mbmax;
+    }
+
+    mb = att->ca_mbv + att->ca_mbc;
+    memset(mb, 0, sizeof(*mb));
+
+    err = ca_kblocks(att, ci, mb);
+    if (!err)
+        err = ca_vblocks(att, ci, mb);
+
+    if (ev(err)) {
+        hse_elog(HSE_ERR "%s: cannot attach kvset images in %s: @@e", err, __func__, dir);
+
+        cn_mblocks_destroy(cn_get_dataset(att->ca_cn), 1, mb, false, 0);
+        kvset_mblocks_destroy(mb);
+        goto out;
+    }
+
+    att->ca_seqno_min = min_t(u64, att->ca_seqno_min, mb->bl_seqno_min);
+    att->ca_seqno_max = max_t(u64, att->ca_seqno_max, mb->bl_seqno_max);
+    att->ca_mbc++;
+
+out:
+    ca_images_free(ci);
+
+    return err;
+}
+
+void
+cn_attach_seqno(struct cn_attach *att, u64 *seqno_min, u64 *seqno_max)
+{
+    *seqno_min = att->ca_seqno_min;
+    *seqno_max = att->ca_seqno_max;
+}
+
+merr_t
+cn_attach_commit(struct cn_attach *att)
+{
+    struct cn_node_loc loc;
+    struct kvset *     ks;
+    uint               mbc;
+
+    if (!att->ca_mbc)
+        return 0;
+
+    /* The seqnos of a key's values must decrease from the root down, which
+     * kvsets older than what is already in cn would violate.
+     */
+    ks = cn_tree_kvset_next(cn_get_tree(att->ca_cn), 0, &loc);
+    if (ks) {
+        kvset_put_ref(ks);
+
+        if (ev(att->ca_seqno_min <= cn_get_ingest_seqno(att->ca_cn)))
+            return merr(ERANGE);
+    }
+
+    /* The ingest frees the mblock lists whether it succeeds or not. */
+    mbc = att->ca_mbc;
+    att->ca_mbc = 0;
+
+    return cn_ingest_bulk(att->ca_cn, att->ca_mbv, mbc);
+}
+
+merr_t
+cn_attach_create(struct cn *cn, struct cn_attach **attp)
+{
+    struct cn_attach *att;
+
+    att = calloc(1, sizeof(*att));
+    if (ev(!att))
+        return merr(ENOMEM);
+
+    att->ca_cn = cn;
+    att->ca_seqno_min = U64_MAX;
+
+    *attp = att;
+
+    return 0;
+}
+
+void
+cn_attach_destroy(struct cn_attach *att)
+{
+    uint i;
+
+    if (!att)
+        return;
+
+    if (att->ca_mbc)
+        cn_mblocks_destroy(cn_get_dataset(att->ca_cn), att->ca_mbc, att->ca_mbv, false, 0);
+
+    for (i = 0; i < att->ca_mbc; i++)
+        kvset_mblocks_destroy(att->ca_mbv + i);
+
+    free(att->ca_mbv);
+    free(att);
+}
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/keycmp.h>
+#include <hse_util/key_util.h>
+#include <hse_util/event_counter.h>
+
+#include <hse/hse_limits.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_bulk.h>
+#include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvset_builder.h>
+
+#include "cn_mblocks.h"
+
+/* Start a new kvset once this much has been added to the current one,
+ * so that spilling the loaded data out of the root is done by several
+ * jobs of bounded size.
+ */
+#define CN_BULK_KVSET_SZ (4ul << 30)
+
+/**
+ * struct cn_bulk - bulk load
+ * @cb_cn:     cn
+ * @cb_seqno:  seqno of all values
+ * @cb_bld:    builder of the current kvset, NULL if none
+ * @cb_bytes:  bytes added to the current kvset
+ * @cb_mbv:    mblocks of the finished kvsets, in ascending key order
+ * @cb_mbc:    number of finished kvsets
+ * @cb_mbmax:  capacity of @cb_mbv
+ * @cb_failed: an add failed, the load can only be destroyed
+ * @cb_klen:   length of the last key added, zero if none
+ * @cb_key:    last key added
+ */
+struct cn_bulk {
+    struct cn *           cb_cn;
+    u64                   cb_seqno;
+    struct kvset_builder *cb_bld;
+    u64                   cb_bytes;
+    struct kvset_mblocks *cb_mbv;
+    uint                  cb_mbc;
+    uint                  cb_mbmax;
+    bool                  cb_failed;
+    uint                  cb_klen;
+    u8                    cb_key[HSE_KVS_KLEN_MAX];
+};
+
+/* Move the current kvset's mblocks onto the list of finished kvsets.
+ */
+static merr_t
+cn_bulk_finish(struct cn_bulk *bulk)
+{
+    struct kvset_mblocks *mbv;
+    merr_t                err;
+
+    if (!bulk->cb_bld)
+        return 0;
+
+    if (bulk->cb_mbc == bulk->cb_mbmax) {
+        uint mbmax = bulk->cb_mbmax ? bulk->cb_mbmax * 2 : 8;
+
+        mbv = realloc(bulk->cb_mbv, mbmax * sizeof(*mbv));
+        if (ev(!mbv))
+            return merr(ENOMEM);
+
+        bulk->cb_mbv = mbv;
+        bulk->cb_mbmax = mbmax;
+    }
+
+    mbv = bulk->cb_mbv + bulk->cb_mbc;
+    memset(mbv, 0, sizeof(*mbv));
+
+    err = kvset_builder_get_mblocks(bulk->cb_bld, mbv);
+    if (ev(err))
+        return err;
+
+    kvset_builder_destroy(bulk->cb_bld);
+    bulk->cb_bld = NULL;
+    bulk->cb_bytes = 0;
+    bulk->cb_mbc++;
+
+    return 0;
+}
+
+static merr_t
+cn_bulk_start(struct cn_bulk *bulk)
+{
+    struct kvs_rparams *rp = cn_get_rp(bulk->cb_cn);
+    merr_t              err;
+
+    err = kvset_builder_create(
+        &bulk->cb_bld,
+        bulk->cb_cn,
+        cn_get_ingest_perfc(bulk->cb_cn),
+        get_time_ns(),
+        KVSET_BUILDER_FLAGS_INGEST);
+    if (ev(err)) {
+        bulk->cb_bld = NULL;
+        return err;
+    }
+
+    kvset_builder_set_mclass_lvl(bulk->cb_bld, rp, 0, rp->cn_media_class);
+
+    return 0;
+}
+
+merr_t
+cn_bulk_add(struct cn_bulk *bulk, const void *key, uint klen, const void *val, uint vlen)
+{
+    struct key_obj ko;
+    merr_t         err;
+
+    if (ev(bulk->cb_failed))
+        return merr(EINVAL);
+
+    if (ev(!klen || klen > HSE_KVS_KLEN_MAX))
+        return merr(EINVAL);
+
+    if (ev(bulk->cb_klen && keycmp(bulk->cb_key, bulk->cb_klen, key, klen) >= 0))
+        return merr(EINVAL);
+
+    if (bulk->cb_bytes >= CN_BULK_KVSET_SZ) {
+        err = cn_bulk_finish(bulk);
+        if (ev(err))
+            goto errout;
+    }
+
+    if (!bulk->cb_bld) {
+        err = cn_bulk_start(bulk);
+        if (ev(err))
+            goto errout;
+    }
+
+    err = kvset_builder_add_val(bulk->cb_bld, bulk->cb_seqno, val, vlen, 0, NULL);
+    if (ev(err))
+        goto errout;
+
+    key2kobj(&ko, key, klen);
+
+    err = kvset_builder_add_key(bulk->cb_bld, &ko);
+    if (ev(err))
+        goto errout;
+
+    memcpy(bulk->cb_key, key, klen);
+    bulk->cb_klen = klen;
+    bulk->cb_bytes += klen + vlen;
+
+    return 0;
+
+errout:
+    bulk->cb_failed = true;
+
+    return err;
+}
+
+merr_t
+cn_bulk_commit(struct cn_bulk *bulk)
+{
+    merr_t err;
+    uint   mbc;
+
+    if (ev(bulk->cb_failed))
+        return merr(EINVAL);
+
+    err = cn_bulk_finish(bulk);
+    if (ev(err)) {
+        bulk->cb_failed = true;
+        return err;
+    }
+
+    if (!bulk->cb_mbc)
+        return 0;
+
+    /* The ingest frees the mblock lists whether it succeeds or not. */
+    mbc = bulk->cb_mbc;
+    bulk->cb_mbc = 0;
+
+    return cn_ingest_bulk(bulk->cb_cn, bulk->cb_mbv, mbc);
+}
+
+merr_t
+cn_bulk_create(struct cn *cn, u64 seqno, struct cn_bulk **bulkp)
+{
+    struct cn_bulk *bulk;
+
+    bulk = calloc(1, sizeof(*bulk));
+    if (ev(!bulk))
+        return merr(ENOMEM);
+
+    bulk->cb_cn = cn;
+    bulk->cb_seqno = seqno;
+
+    *bulkp = bulk;
+
+    return 0;
+}
+
+void
+cn_bulk_destroy(struct cn_bulk *bulk)
+{
+    uint i;
+
+    if (!bulk)
+        return;
+
+    /* The builder aborts the mblocks of the kvset in progress. */
+    if (bulk->cb_bld)
+        kvset_builder_destroy(bulk->cb_bld);
+
+    if (bulk->cb_mbc)
+        cn_mblocks_destroy(cn_get_dataset(bulk->cb_cn), bulk->cb_mbc, bulk->cb_mbv, false, 0);
+
+    for (i = 0; i < bulk->cb_mbc; i++)
+        kvset_mblocks_destroy(bulk->cb_mbv + i);
+
+    free(bulk->cb_mbv);
+    free(bulk);
+}
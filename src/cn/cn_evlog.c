@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/minmax.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/event_counter.h>
+
+#include <hse_ikvdb/cn_evlog.h>
+
+#include "cn_tree_compact.h"
+
+/**
+ * struct cn_evlog - most recent cn events of a kvdb
+ * @cel_lock: protects all fields
+ * @cel_seq:  number of the most recent event (events are numbered from 1)
+ * @cel_evv:  events, event n is in slot n modulo CN_EVLOG_SZ
+ */
+struct cn_evlog {
+    spinlock_t      cel_lock;
+    u64             cel_seq;
+    struct cn_event cel_evv[CN_EVLOG_SZ];
+};
+
+merr_t
+cn_evlog_create(struct cn_evlog **evlogp)
+{
+    struct cn_evlog *evlog;
+
+    evlog = calloc(1, sizeof(*evlog));
+    if (ev(!evlog))
+        return merr(ENOMEM);
+
+    spin_lock_init(&evlog->cel_lock);
+
+    *evlogp = evlog;
+
+    return 0;
+}
+
+void
+cn_evlog_destroy(struct cn_evlog *evlog)
+{
+    free(evlog);
+}
+
+void
+cn_evlog_add(struct cn_evlog *evlog, struct cn_event *cev)
+{
+    if (!evlog)
+        return;
+
+    cev->ce_time = get_time_ns();
+
+    spin_lock(&evlog->cel_lock);
+    cev->ce_seq = ++evlog->cel_seq;
+    evlog->cel_evv[cev->ce_seq % CN_EVLOG_SZ] = *cev;
+    spin_unlock(&evlog->cel_lock);
+}
+
+uint
+cn_evlog_read(struct cn_evlog *evlog, u64 since, struct cn_event *evv, uint evc)
+{
+    u64  first;
+    uint i, n;
+
+    spin_lock(&evlog->cel_lock);
+    since = min_t(u64, since, evlog->cel_seq);
+    n = min_t(u64, evlog->cel_seq - since, min_t(uint, evc, CN_EVLOG_SZ));
+    first = evlog->cel_seq - n + 1;
+
+    for (i = 0; i < n; ++i)
+        evv[i] = evlog->cel_evv[(first + i) % CN_EVLOG_SZ];
+    spin_unlock(&evlog->cel_lock);
+
+    return n;
+}
+
+const char *
+cn_event_type2str(enum cn_event_type type)
+{
+    static const char *const namev[] = { "ingest", "spill", "kcompact", "kvcompact" };
+
+    return type < NELEM(namev) ? namev[type] : "unknown";
+}
+
+const char *
+cn_event_rule2str(uint rule)
+{
+    return rule ? cn_comp_rule2str(rule) : "none";
+}
@@ -13,6 +13,7 @@ struct cndb;
 struct ikvdb;
 struct kvdb_health;
 struct csched;
+struct wbt_icache;
 
 #include <hse_util/atomic.h>
 #include <hse_util/workqueue.h>
@@ -23,18 +24,26 @@ struct csched;
 
 #include <hse/hse_limits.h>
 
+#include <hse_ikvdb/cn.h>
+
 struct cn {
-    struct cn_tree *  cn_tree;
-    struct perfc_set  cn_pc_get;
-    struct cn_kvdb *  cn_kvdb;
-    struct cn_tstate *cn_tstate;
-    struct mpool *    cn_dataset;
-    struct cndb *     cn_cndb;
-    struct tbkt *     cn_tbkt_maint;
-    u64               cn_cnid;
-    u64               cn_hash;
+    struct cn_tree *   cn_tree;
+    struct perfc_set   cn_pc_get;
+    struct cn_kvdb *   cn_kvdb;
+    struct cn_tstate * cn_tstate;
+    struct mpool *     cn_dataset;
+    struct cndb *      cn_cndb;
+    struct tbkt *      cn_tbkt_maint;
+    struct tbkt        cn_tbkt_floor;
+    struct wbt_icache *cn_icache;
+    u64                cn_cnid;
+    u64                cn_hash;
 
     __aligned(SMP_CACHE_BYTES) atomic64_t cn_ingest_dgen;
+    atomic64_t cn_ingest_seqno;
+
+    /* serializes c0 and bulk ingests, see cn_ingest_bulk() */
+    struct mutex cn_ingest_lock;
 
     atomic_t cn_refcnt;
     bool     cn_closing;
@@ -55,6 +64,18 @@ struct cn {
     struct perfc_set cn_pc_shape_inode;
     struct perfc_set cn_pc_shape_lnode;
     struct perfc_set cn_pc_capped;
+    struct perfc_set cn_pc_amp;
+
+    /* amplification window baseline, see cn_amp_reset() */
+    struct mutex  cn_amp_lock;
+    struct cn_amp cn_amp_base;
+    u64           cn_amp_start;
+
+    /* compaction filter, see cn_cfilter_set() */
+    struct mutex    cn_cfilter_lock;
+    kvs_cfilter_fn *cn_cfilter;
+    void *          cn_cfilter_arg;
+    atomic64_t      cn_cfilter_gen;
 
     /* for maintenance work */
     struct workqueue_struct *cn_maint_wq;
@@ -73,7 +94,8 @@ struct cn {
     char cn_mpname[HSE_KVS_NAME_LEN_MAX];
     char cn_kvsname[HSE_KVS_NAME_LEN_MAX];
 
-    struct mpool_params cn_mpool_params;
+    struct mpool_params  cn_mpool_params;
+    struct cn_open_stats cn_open_stats;
 };
 
 #endif
@@ -12,6 +12,11 @@
 #include <hse_util/event_counter.h>
 
 #include <hse_ikvdb/cn_kvdb.h>
+#include <hse_ikvdb/cn_evlog.h>
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cn_reclaim.h>
+#include <hse_ikvdb/cn_scrub.h>
+#include <hse_ikvdb/cn_reap.h>
 
 /* handle to impl converter */
 #define h2i(_H) container_of((_H), struct cn_kvdb_impl, h)
@@ -25,15 +30,27 @@ merr_t
 cn_kvdb_create(struct cn_kvdb **out)
 {
     struct cn_kvdb_impl *self;
+    merr_t               err;
+    int                  i;
 
     self = calloc(1, sizeof(*self));
     if (ev(!self))
         return merr(ENOMEM);
 
+    err = cn_evlog_create(&self->h.cnd_evlog);
+    if (ev(err)) {
+        free(self);
+        return err;
+    }
+
     atomic64_set(&self->h.cnd_kblk_cnt, 0);
     atomic64_set(&self->h.cnd_vblk_cnt, 0);
     atomic64_set(&self->h.cnd_kblk_size, 0);
     atomic64_set(&self->h.cnd_vblk_size, 0);
+    atomic_set(&self->h.cnd_ra_pct, 100);
+
+    for (i = 0; i < MBLOCK_LIFE_CNT; ++i)
+        atomic64_set(&self->h.cnd_life_alloc[i], 0);
 
     *out = &self->h;
 
@@ -43,8 +60,15 @@ cn_kvdb_create(struct cn_kvdb **out)
 void
 cn_kvdb_destroy(struct cn_kvdb *h)
 {
-    if (h)
-        free(h2i(h));
+    if (!h)
+        return;
+
+    cn_reap_destroy(h->cnd_reap);
+    cn_scrub_destroy(h->cnd_scrub);
+    cn_reclaim_destroy(h->cnd_reclaim);
+    cn_scache_destroy(h->cnd_scache);
+    cn_evlog_destroy(h->cnd_evlog);
+    free(h2i(h));
 }
 
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
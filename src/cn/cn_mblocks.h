@@ -8,6 +8,11 @@
 
 /* MTF_MOCK_DECL(cn_mblocks) */
 
+#include <hse_ikvdb/mblock_life.h>
+
+#include <mpool/mpool.h>
+
+struct cn;
 struct mpool;
 struct cndb;
 struct kvset_mblocks;
@@ -30,6 +35,30 @@ enum cn_mutation {
 #define CN_MB_EST_FLAGS_TRUNCATE (1u << 1) /* truncation enabled */
 #define CN_MB_EST_FLAGS_POW2 (1u << 2)     /* round mblk sz to power of 2 */
 
+/**
+ * cn_mblock_alloc() - allocate a cn mblock
+ * @cn:     cn the mblock is allocated for
+ * @ds:     dataset
+ * @mclass: media class
+ * @life:   expected lifetime of the mblock's data
+ * @spare:  allocate from spare space
+ * @mbh:    (output) mblock handle
+ * @props:  (output) mblock properties
+ *
+ * All cn kblock and vblock allocations go through here so that their
+ * expected lifetime can be passed to the device as a placement hint once
+ * mpool takes one.  Until then the lifetime is only accounted for.
+ */
+merr_t
+cn_mblock_alloc(
+    struct cn *          cn,
+    struct mpool *       ds,
+    enum mp_media_classp mclass,
+    enum mblock_life     life,
+    bool                 spare,
+    u64 *                mbh,
+    struct mblock_props *props);
+
 /* MTF_MOCK */
 size_t
 cn_mb_est_alen(size_t max_captgt, size_t alloc_unit, size_t payload, uint flags);
@@ -13,6 +13,8 @@
 /**
  * struct kvset_stats - kvset statistics
  * @kst_keys:  number of keys
+ * @kst_tombs: number of tombstones
+ * @kst_ptombs: number of ptombs (not counted in kblocks older than v6)
  * @kst_kvsets: number of kvsets
  * @kst_kblks: number of kblocks
  * @kst_vblks: number of vblocks
@@ -25,6 +27,8 @@
  */
 struct kvset_stats {
     u64 kst_keys;
+    u64 kst_tombs;
+    u64 kst_ptombs;
     u64 kst_kalen;
     u64 kst_kwlen;
     u64 kst_valen;
@@ -84,6 +88,7 @@ struct cn_node_stats {
  *   cn_ns_wlen()  - sum of kvset wlen
  *   cn_ns_vulen() - sum of kvset vblocks ulen
  *   cn_ns_keys()  - number of keys in kvset
+ *   cn_ns_tombs() - number of tombstones and ptombs in node
  *   cn_ns_kblks() - number of kblocks in node
  *   cn_ns_vblks() - number of vblocks in node
  */
@@ -120,6 +125,12 @@ cn_ns_keys(const struct cn_node_stats *ns)
     return ns->ns_kst.kst_keys;
 }
 
+static inline u64
+cn_ns_tombs(const struct cn_node_stats *ns)
+{
+    return ns->ns_kst.kst_tombs + ns->ns_kst.kst_ptombs;
+}
+
 static inline u64
 cn_ns_kblks(const struct cn_node_stats *ns)
 {
@@ -160,6 +171,14 @@ count_ops(struct cn_merge_stats_ops *op, u64 count, u64 size, u64 time)
     op->op_time += time;
 }
 
+static inline void
+cn_merge_stats_ops_add(struct cn_merge_stats_ops *s, const struct cn_merge_stats_ops *a)
+{
+    s->op_cnt += a->op_cnt;
+    s->op_size += a->op_size;
+    s->op_time += a->op_time;
+}
+
 static inline void
 cn_merge_stats_ops_diff(
     struct cn_merge_stats_ops *      s,
@@ -180,6 +199,7 @@ cn_merge_stats_ops_diff(
  * @ms_key_bytes_out: total length of output keys
  * @ms_val_bytes_out: total length of output values
  * @ms_wbytes:        ptr to shared atomic for "realtime" I/O stats
+ * @ms_tbkt_delay:    writes delayed by the compaction rate limit
  */
 struct cn_merge_stats {
     u64 ms_srcs;
@@ -208,6 +228,8 @@ struct cn_merge_stats {
 
     struct cn_merge_stats_ops ms_kblk_read;
     struct cn_merge_stats_ops ms_kblk_read_wait;
+
+    struct cn_merge_stats_ops ms_tbkt_delay;
 };
 
 static inline void
@@ -255,6 +277,42 @@ cn_merge_stats_diff(
     cn_merge_stats_ops_diff(&s->ms_kblk_read, &a->ms_kblk_read, &b->ms_kblk_read);
 
     cn_merge_stats_ops_diff(&s->ms_kblk_read_wait, &a->ms_kblk_read_wait, &b->ms_kblk_read_wait);
+
+    cn_merge_stats_ops_diff(&s->ms_tbkt_delay, &a->ms_tbkt_delay, &b->ms_tbkt_delay);
+}
+
+static inline void
+cn_merge_stats_add(struct cn_merge_stats *s, const struct cn_merge_stats *a)
+{
+    s->ms_srcs += a->ms_srcs;
+    s->ms_keys_in += a->ms_keys_in;
+    s->ms_keys_out += a->ms_keys_out;
+
+    s->ms_key_bytes_in += a->ms_key_bytes_in;
+    s->ms_key_bytes_out += a->ms_key_bytes_out;
+    s->ms_val_bytes_out += a->ms_val_bytes_out;
+
+    s->ms_vblk_wasted_reads += a->ms_vblk_wasted_reads;
+
+    cn_merge_stats_ops_add(&s->ms_kblk_alloc, &a->ms_kblk_alloc);
+    cn_merge_stats_ops_add(&s->ms_kblk_write, &a->ms_kblk_write);
+    cn_merge_stats_ops_add(&s->ms_kblk_write_async, &a->ms_kblk_write_async);
+    cn_merge_stats_ops_add(&s->ms_kblk_flush, &a->ms_kblk_flush);
+
+    cn_merge_stats_ops_add(&s->ms_vblk_alloc, &a->ms_vblk_alloc);
+    cn_merge_stats_ops_add(&s->ms_vblk_write, &a->ms_vblk_write);
+    cn_merge_stats_ops_add(&s->ms_vblk_write_async, &a->ms_vblk_write_async);
+    cn_merge_stats_ops_add(&s->ms_vblk_flush, &a->ms_vblk_flush);
+
+    cn_merge_stats_ops_add(&s->ms_vblk_read1, &a->ms_vblk_read1);
+    cn_merge_stats_ops_add(&s->ms_vblk_read1_wait, &a->ms_vblk_read1_wait);
+    cn_merge_stats_ops_add(&s->ms_vblk_read2, &a->ms_vblk_read2);
+    cn_merge_stats_ops_add(&s->ms_vblk_read2_wait, &a->ms_vblk_read2_wait);
+
+    cn_merge_stats_ops_add(&s->ms_kblk_read, &a->ms_kblk_read);
+    cn_merge_stats_ops_add(&s->ms_kblk_read_wait, &a->ms_kblk_read_wait);
+
+    cn_merge_stats_ops_add(&s->ms_tbkt_delay, &a->ms_tbkt_delay);
 }
 
 /**
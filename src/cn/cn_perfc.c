@@ -30,7 +30,12 @@ struct perfc_name cn_perfc_get[] = {
     NE(PERFC_LT_CNGET_GET_L5, 3, "Latency of cN get in L5", "l_get_l5(ns)"),
     NE(PERFC_LT_CNGET_PROBEPFX, 3, "Latency of cN pfx probe", "l_pprobe(ns)"),
     NE(PERFC_LT_CNGET_MISS, 3, "Latency of cN misses", "l_mis(ns)"),
-    NE(PERFC_RA_CNGET_TOMB, 3, "Count of cN tombs", "c_tmb(/s)")
+    NE(PERFC_RA_CNGET_TOMB, 3, "Count of cN tombs", "c_tmb(/s)"),
+    NE(PERFC_RA_CNGET_ICHIT, 3, "Count of wbt index cache hits", "c_ichit(/s)"),
+    NE(PERFC_RA_CNGET_ICMISS, 3, "Count of wbt index cache misses", "c_icmis(/s)"),
+    NE(PERFC_RA_CNGET_ICEVICT, 3, "Count of wbt index cache evictions", "c_icevict(/s)"),
+    NE(PERFC_RA_CNGET_FENCE, 3, "Count of kvsets skipped by key fences", "c_fence(/s)"),
+    NE(PERFC_RA_CNGET_SEQSKIP, 3, "Count of kvsets newer than the view", "c_seqskip(/s)")
 };
 
 struct perfc_name cn_perfc_compact[] = {
@@ -64,6 +69,18 @@ struct perfc_name cn_perfc_capped[] = {
     NE(PERFC_BA_CNCAPPED_OLD, 3, "old (valid) kvsets", "old"),
 };
 
+struct perfc_name cn_perfc_amp[] = {
+    NE(PERFC_RA_CNAMP_UBYTES, 2, "user bytes written", "ubytes"),
+    NE(PERFC_RA_CNAMP_C1BYTES, 2, "c1 bytes written", "c1bytes"),
+    NE(PERFC_RA_CNAMP_INGEST, 2, "ingest bytes written", "ingest"),
+    NE(PERFC_RA_CNAMP_SPILL, 2, "spill bytes written", "spill"),
+    NE(PERFC_RA_CNAMP_KCOMPACT, 2, "k-compact bytes written", "kcompact"),
+    NE(PERFC_RA_CNAMP_KVCOMPACT, 2, "kv-compact bytes written", "kvcompact"),
+    NE(PERFC_RA_CNAMP_RBYTES, 2, "compaction bytes read", "rbytes"),
+    NE(PERFC_RA_CNAMP_GETS, 2, "gets", "gets"),
+    NE(PERFC_RA_CNAMP_KVSETS, 2, "kvsets probed by gets", "kvsets"),
+};
+
 NE_CHECK(cn_perfc_capped, PERFC_EN_CNCAPPED, "cn_perfc_capped table/enum mismatch");
 
 NE_CHECK(cn_perfc_get, PERFC_EN_CNGET, "cn_perfc_get table/enum mismatch");
@@ -72,6 +89,8 @@ NE_CHECK(cn_perfc_compact, PERFC_EN_CNCOMP, "cn_perfc_compact table/enum mismatc
 
 NE_CHECK(cn_perfc_shape, PERFC_EN_CNSHAPE, "cn_perfc_shape table/enum mismatch");
 
+NE_CHECK(cn_perfc_amp, PERFC_EN_CNAMP, "cn_perfc_amp table/enum mismatch");
+
 STATIC
 void
 cn_perfc_bkts_create(struct perfc_name *pcn, int edgec, u64 *edgev, uint sample_pct)
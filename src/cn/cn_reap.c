@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/mutex.h>
+#include <hse_util/condvar.h>
+#include <hse_util/token_bucket.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+
+#include <hse_ikvdb/cndb.h>
+#include <hse_ikvdb/cn_reap.h>
+
+#include <mpool/mpool.h>
+
+#include <pthread.h>
+
+/* Mblocks deleted between two pacing delays and two checks for exit.
+ */
+#define CN_REAP_BATCH (16)
+
+/**
+ * struct cn_reap - kvdb-wide reaper of dropped cns
+ * @cr_lock:    protects @cr_pending, @cr_exit and @cr_stats
+ * @cr_cv:      wakes the reaper thread
+ * @cr_pending: a cn was dropped since the reaper thread last looked
+ * @cr_exit:    the reaper thread must exit
+ * @cr_ds:      dataset
+ * @cr_cndb:    cndb
+ * @cr_rate:    bytes deleted per second, 0 if not paced
+ * @cr_tb:      paces deletes (bytes)
+ * @cr_stats:   activity
+ * @cr_tid:     reaper thread
+ */
+struct cn_reap {
+    struct mutex         cr_lock;
+    struct cv            cr_cv;
+    bool                 cr_pending;
+    bool                 cr_exit;
+    struct mpool *       cr_ds;
+    struct cndb *        cr_cndb;
+    u64                  cr_rate;
+    struct tbkt          cr_tb;
+    struct cn_reap_stats cr_stats;
+    pthread_t            cr_tid;
+};
+
+static bool
+cr_exiting(struct cn_reap *cr)
+{
+    bool exit;
+
+    mutex_lock(&cr->cr_lock);
+    exit = cr->cr_exit;
+    mutex_unlock(&cr->cr_lock);
+
+    return exit;
+}
+
+/* Delete a batch of mblocks, skipping those already deleted.
+ */
+static merr_t
+cr_batch(struct cn_reap *cr, const u64 *mbidv, uint mbidc)
+{
+    struct mblock_props props;
+    u64                 handle, bytes = 0, mblocks = 0;
+    merr_t              err = 0;
+    uint                i;
+
+    for (i = 0; i < mbidc; i++) {
+        err = mpool_mblock_find_get(cr->cr_ds, mbidv[i], &handle, &props);
+        if (err) {
+            if (merr_errno(err) != ENOENT)
+                break;
+
+            err = 0;
+            continue;
+        }
+
+        if (props.mpr_iscommitted)
+            err = mpool_mblock_delete(cr->cr_ds, handle);
+        else
+            err = mpool_mblock_abort(cr->cr_ds, handle);
+        if (err) {
+            hse_elog(HSE_ERR "%s: mblock 0x%lx: @@e", err, __func__, (ulong)mbidv[i]);
+            break;
+        }
+
+        bytes += props.mpr_alloc_cap;
+        mblocks++;
+    }
+
+    mutex_lock(&cr->cr_lock);
+    cr->cr_stats.crs_mblocks += mblocks;
+    cr->cr_stats.crs_bytes += bytes;
+    mutex_unlock(&cr->cr_lock);
+
+    if (cr->cr_rate && !err)
+        tbkt_delay(tbkt_request(&cr->cr_tb, bytes));
+
+    return err;
+}
+
+/* Reap the dropped cns one at a time, until there are none left or one
+ * fails.  A failed cn is retried by the next kick or the next open.
+ */
+static void
+cr_reap(struct cn_reap *cr)
+{
+    u64 *  mbidv;
+    uint   mbidc, i;
+    u64    cnid;
+    merr_t err;
+
+    while (!cr_exiting(cr)) {
+        cnid = 0;
+        mbidv = NULL;
+        mbidc = 0;
+
+        err = cndb_cn_dropped(cr->cr_cndb, &cnid, &mbidv, &mbidc);
+        if (err || !cnid)
+            break;
+
+        for (i = 0; i < mbidc && !err; i += CN_REAP_BATCH) {
+            if (cr_exiting(cr)) {
+                free(mbidv);
+                return;
+            }
+
+            err = cr_batch(cr, mbidv + i, min_t(uint, mbidc - i, CN_REAP_BATCH));
+        }
+
+        free(mbidv);
+
+        if (!err)
+            err = cndb_cn_purge(cr->cr_cndb, cnid);
+
+        mutex_lock(&cr->cr_lock);
+        if (err)
+            cr->cr_stats.crs_errors++;
+        else
+            cr->cr_stats.crs_cns++;
+        mutex_unlock(&cr->cr_lock);
+
+        if (err) {
+            hse_elog(HSE_ERR "%s: dropped cnid %lu not reaped: @@e", err, __func__, (ulong)cnid);
+            break;
+        }
+
+        hse_log(HSE_NOTICE "%s: dropped cnid %lu reaped, %u mblocks", __func__, (ulong)cnid, mbidc);
+    }
+}
+
+static void *
+cr_main(void *arg)
+{
+    struct cn_reap *cr = arg;
+
+    pthread_setname_np(pthread_self(), "cn_reap");
+
+    mutex_lock(&cr->cr_lock);
+    while (!cr->cr_exit) {
+        if (!cr->cr_pending) {
+            cv_wait(&cr->cr_cv, &cr->cr_lock);
+            continue;
+        }
+
+        cr->cr_pending = false;
+        mutex_unlock(&cr->cr_lock);
+
+        cr_reap(cr);
+
+        mutex_lock(&cr->cr_lock);
+    }
+    mutex_unlock(&cr->cr_lock);
+
+    return NULL;
+}
+
+void
+cn_reap_kick(struct cn_reap *cr)
+{
+    if (!cr)
+        return;
+
+    mutex_lock(&cr->cr_lock);
+    cr->cr_pending = true;
+    cv_signal(&cr->cr_cv);
+    mutex_unlock(&cr->cr_lock);
+}
+
+void
+cn_reap_stats(struct cn_reap *cr, struct cn_reap_stats *stats)
+{
+    if (!cr) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    mutex_lock(&cr->cr_lock);
+    *stats = cr->cr_stats;
+    mutex_unlock(&cr->cr_lock);
+}
+
+merr_t
+cn_reap_create(struct mpool *ds, struct cndb *cndb, u64 rate, struct cn_reap **crp)
+{
+    struct cn_reap *cr;
+    int             rc;
+
+    if (ev(!ds || !cndb || !crp))
+        return merr(EINVAL);
+
+    cr = calloc(1, sizeof(*cr));
+    if (ev(!cr))
+        return merr(ENOMEM);
+
+    mutex_init(&cr->cr_lock);
+    cv_init(&cr->cr_cv, "cn_reap");
+    cr->cr_ds = ds;
+    cr->cr_cndb = cndb;
+    cr->cr_rate = rate;
+
+    /* Cns dropped before the last close are still to be reaped. */
+    cr->cr_pending = true;
+
+    /* Allow a one second burst. */
+    if (rate)
+        tbkt_init(&cr->cr_tb, rate, rate);
+
+    rc = pthread_create(&cr->cr_tid, NULL, cr_main, cr);
+    if (ev(rc)) {
+        cv_destroy(&cr->cr_cv);
+        mutex_destroy(&cr->cr_lock);
+        free(cr);
+        return merr(rc);
+    }
+
+    *crp = cr;
+
+    return 0;
+}
+
+void
+cn_reap_destroy(struct cn_reap *cr)
+{
+    if (!cr)
+        return;
+
+    mutex_lock(&cr->cr_lock);
+    cr->cr_exit = true;
+    cv_signal(&cr->cr_cv);
+    mutex_unlock(&cr->cr_lock);
+
+    pthread_join(cr->cr_tid, NULL);
+
+    cv_destroy(&cr->cr_cv);
+    mutex_destroy(&cr->cr_lock);
+    free(cr);
+}
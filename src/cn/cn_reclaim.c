@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/list.h>
+#include <hse_util/mutex.h>
+#include <hse_util/condvar.h>
+#include <hse_util/token_bucket.h>
+#include <hse_util/event_counter.h>
+
+#include <hse_ikvdb/cn_reclaim.h>
+
+#include <mpool/mpool.h>
+
+#include <pthread.h>
+
+/* Requests queued within this long of each other are deleted as a batch.
+ */
+#define CN_RECLAIM_BATCH_MS (100)
+
+/**
+ * struct cr_req - mblocks to delete
+ * @rq_link:  link on the queue
+ * @rq_ds:    dataset
+ * @rq_cb:    completion callback
+ * @rq_rock:  argument to @rq_cb
+ * @rq_bytes: sum of the mblocks' allocated lengths
+ * @rq_mbc:   number of mblock handles
+ * @rq_mbv:   mblock handles
+ */
+struct cr_req {
+    struct list_head rq_link;
+    struct mpool *   rq_ds;
+    cn_reclaim_cb *  rq_cb;
+    void *           rq_rock;
+    u64              rq_bytes;
+    uint             rq_mbc;
+    u64              rq_mbv[];
+};
+
+/**
+ * struct cn_reclaim - reclaim queue
+ * @rc_lock:   protects all fields but @rc_tb and @rc_hurry
+ * @rc_cv:     wakes the reclaim thread
+ * @rc_idle:   signaled when the reclaim thread finishes a batch
+ * @rc_reqs:   queued requests
+ * @rc_busy:   the reclaim thread is processing a batch
+ * @rc_exit:   the reclaim thread must drain the queue and exit
+ * @rc_hurry:  number of flushers, delete without pacing while non-zero
+ * @rc_tb:     paces deletes (bytes)
+ * @rc_usage:  activity
+ * @rc_tid:    reclaim thread
+ */
+struct cn_reclaim {
+    struct mutex            rc_lock;
+    struct cv               rc_cv;
+    struct cv               rc_idle;
+    struct list_head        rc_reqs;
+    bool                    rc_busy;
+    bool                    rc_exit;
+    atomic_t                rc_hurry;
+    struct tbkt             rc_tb;
+    struct cn_reclaim_usage rc_usage;
+    pthread_t               rc_tid;
+};
+
+/* Delete the mblocks of a request, stopping at the first error.
+ * Return the number deleted, or -1 on error.
+ */
+static int
+cr_delete(struct cn_reclaim *rc, struct mpool *ds, uint mbc, const u64 *mbv, u64 bytes)
+{
+    u64    per;
+    merr_t err;
+    uint   i, n;
+
+    for (i = n = 0; i < mbc; ++i)
+        n += !!mbv[i];
+
+    per = n ? bytes / n : 0;
+
+    for (i = n = 0; i < mbc; ++i) {
+        if (!mbv[i])
+            continue;
+
+        if (rc && !atomic_read(&rc->rc_hurry) && !rc->rc_exit)
+            tbkt_delay(tbkt_request(&rc->rc_tb, per));
+
+        err = mpool_mblock_delete(ds, mbv[i]);
+        if (ev(err))
+            return -1;
+
+        ++n;
+    }
+
+    return n;
+}
+
+static void
+cr_batch(struct cn_reclaim *rc, struct list_head *batch)
+{
+    struct cr_req *req, *next;
+    u64            mblocks = 0, bytes = 0, errors = 0;
+    int            n;
+
+    list_for_each_entry_safe (req, next, batch, rq_link) {
+        n = cr_delete(rc, req->rq_ds, req->rq_mbc, req->rq_mbv, req->rq_bytes);
+        if (n < 0)
+            errors++;
+        else
+            mblocks += n;
+
+        bytes += req->rq_bytes;
+
+        if (req->rq_cb)
+            req->rq_cb(req->rq_rock, n < 0);
+
+        free(req);
+    }
+
+    mutex_lock(&rc->rc_lock);
+    rc->rc_usage.cru_queued -= bytes;
+    rc->rc_usage.cru_mblocks += mblocks;
+    rc->rc_usage.cru_bytes += bytes;
+    rc->rc_usage.cru_errors += errors;
+    rc->rc_usage.cru_batches++;
+    mutex_unlock(&rc->rc_lock);
+}
+
+static void *
+cr_main(void *arg)
+{
+    struct cn_reclaim *rc = arg;
+    struct list_head   batch;
+
+    pthread_setname_np(pthread_self(), "cn_reclaim");
+
+    mutex_lock(&rc->rc_lock);
+    while (true) {
+        if (list_empty(&rc->rc_reqs)) {
+            rc->rc_busy = false;
+            cv_broadcast(&rc->rc_idle);
+
+            if (rc->rc_exit)
+                break;
+
+            cv_wait(&rc->rc_cv, &rc->rc_lock);
+            continue;
+        }
+
+        /* Let the deletes of a compaction gather into one batch. */
+        if (!rc->rc_busy && !rc->rc_exit && !atomic_read(&rc->rc_hurry))
+            cv_timedwait(&rc->rc_cv, &rc->rc_lock, CN_RECLAIM_BATCH_MS);
+
+        rc->rc_busy = true;
+
+        INIT_LIST_HEAD(&batch);
+        list_splice(&rc->rc_reqs, &batch);
+        INIT_LIST_HEAD(&rc->rc_reqs);
+        mutex_unlock(&rc->rc_lock);
+
+        cr_batch(rc, &batch);
+
+        mutex_lock(&rc->rc_lock);
+    }
+    mutex_unlock(&rc->rc_lock);
+
+    return NULL;
+}
+
+void
+cn_reclaim_add(
+    struct cn_reclaim *rc,
+    struct mpool *     ds,
+    uint               mbc,
+    const u64 *        mbv,
+    u64                bytes,
+    cn_reclaim_cb *    cb,
+    void *             rock)
+{
+    struct cr_req *req = NULL;
+    int            n;
+
+    if (rc)
+        req = malloc(sizeof(*req) + mbc * sizeof(*mbv));
+
+    if (ev(!req)) {
+        n = cr_delete(NULL, ds, mbc, mbv, bytes);
+        if (cb)
+            cb(rock, n < 0);
+        return;
+    }
+
+    req->rq_ds = ds;
+    req->rq_cb = cb;
+    req->rq_rock = rock;
+    req->rq_bytes = bytes;
+    req->rq_mbc = mbc;
+    memcpy(req->rq_mbv, mbv, mbc * sizeof(*mbv));
+
+    /* Only the first request of a batch wakes the reclaim thread,
+     * which then waits for the rest of the batch.
+     */
+    mutex_lock(&rc->rc_lock);
+    if (list_empty(&rc->rc_reqs) && !rc->rc_busy)
+        cv_signal(&rc->rc_cv);
+    list_add_tail(&req->rq_link, &rc->rc_reqs);
+    rc->rc_usage.cru_queued += bytes;
+    mutex_unlock(&rc->rc_lock);
+}
+
+void
+cn_reclaim_flush(struct cn_reclaim *rc)
+{
+    if (!rc)
+        return;
+
+    atomic_inc(&rc->rc_hurry);
+
+    mutex_lock(&rc->rc_lock);
+    cv_signal(&rc->rc_cv);
+
+    while (rc->rc_busy || !list_empty(&rc->rc_reqs))
+        cv_wait(&rc->rc_idle, &rc->rc_lock);
+    mutex_unlock(&rc->rc_lock);
+
+    atomic_dec(&rc->rc_hurry);
+}
+
+void
+cn_reclaim_usage(struct cn_reclaim *rc, struct cn_reclaim_usage *usage)
+{
+    if (!rc) {
+        memset(usage, 0, sizeof(*usage));
+        return;
+    }
+
+    mutex_lock(&rc->rc_lock);
+    *usage = rc->rc_usage;
+    mutex_unlock(&rc->rc_lock);
+}
+
+merr_t
+cn_reclaim_create(u64 rate, struct cn_reclaim **rcp)
+{
+    struct cn_reclaim *rc;
+    int                rc_err;
+
+    if (ev(!rate))
+        return merr(EINVAL);
+
+    rc = calloc(1, sizeof(*rc));
+    if (ev(!rc))
+        return merr(ENOMEM);
+
+    mutex_init(&rc->rc_lock);
+    cv_init(&rc->rc_cv, "cn_reclaim");
+    cv_init(&rc->rc_idle, "cn_reclaim_idle");
+    INIT_LIST_HEAD(&rc->rc_reqs);
+    atomic_set(&rc->rc_hurry, 0);
+
+    /* Allow a one second burst, a typical compaction frees far more. */
+    tbkt_init(&rc->rc_tb, rate, rate);
+
+    rc_err = pthread_create(&rc->rc_tid, NULL, cr_main, rc);
+    if (ev(rc_err)) {
+        cv_destroy(&rc->rc_idle);
+        cv_destroy(&rc->rc_cv);
+        mutex_destroy(&rc->rc_lock);
+        free(rc);
+        return merr(rc_err);
+    }
+
+    *rcp = rc;
+
+    return 0;
+}
+
+void
+cn_reclaim_destroy(struct cn_reclaim *rc)
+{
+    if (!rc)
+        return;
+
+    mutex_lock(&rc->rc_lock);
+    rc->rc_exit = true;
+    cv_signal(&rc->rc_cv);
+    mutex_unlock(&rc->rc_lock);
+
+    pthread_join(rc->rc_tid, NULL);
+
+    assert(list_empty(&rc->rc_reqs));
+
+    cv_destroy(&rc->rc_idle);
+    cv_destroy(&rc->rc_cv);
+    mutex_destroy(&rc->rc_lock);
+    free(rc);
+}
@@ -0,0 +1,644 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/list.h>
+#include <hse_util/log2.h>
+#include <hse_util/minmax.h>
+#include <hse_util/delay.h>
+#include <hse_util/scratch.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/workqueue.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cndb.h>
+#include <hse_ikvdb/blk_list.h>
+
+#include <mpool/mpool.h>
+
+#include "mbset.h"
+#include "vblock_reader.h"
+
+#define SC_SEGS_MIN (2)
+#define SC_FILLS_MAX (64)
+#define SC_WRITE_MAX (1024 * 1024)
+
+/**
+ * struct sc_entry - a cached extent
+ * @se_hlink: hash chain linkage, by vblock id and extent
+ * @se_vlink: vblock chain linkage, by vblock id
+ * @se_mbid:  vblock id, 0 if the slot holds no extent
+ * @se_ext:   extent number within the vblock
+ *
+ * Entry n describes slot n modulo sc_slotc of segment n / sc_slotc.
+ */
+struct sc_entry {
+    struct list_head se_hlink;
+    struct list_head se_vlink;
+    u64              se_mbid;
+    u32              se_ext;
+};
+
+/**
+ * struct sc_seg - a segment of the cache
+ * @ss_buf:     contents of the open segment, NULL once committed
+ * @ss_mbh:     staging mblock handle, 0 if none
+ * @ss_txid:    cndb transaction that records the mblock
+ * @ss_used:    slots filled
+ * @ss_readers: reads in progress from the committed mblock
+ */
+struct sc_seg {
+    void *   ss_buf;
+    u64      ss_mbh;
+    u64      ss_txid;
+    uint     ss_used;
+    atomic_t ss_readers;
+};
+
+/**
+ * struct sc_fill - request to copy an extent to the cache
+ * @sf_work: fill thread work
+ * @sf_sc:   cache
+ * @sf_mbs:  vblock set, on which the request holds a reference
+ * @sf_bnum: index of the vblock in @sf_mbs
+ * @sf_ext:  extent number within the vblock
+ */
+struct sc_fill {
+    struct work_struct sf_work;
+    struct cn_scache * sf_sc;
+    struct mbset *     sf_mbs;
+    uint               sf_bnum;
+    u32                sf_ext;
+};
+
+/**
+ * struct cn_scache - staging cache
+ * @sc_lock:    protects the entries, the chains and @ss_buf of the segments
+ * @sc_segc:    number of segments
+ * @sc_slotc:   extents per segment
+ * @sc_bktmask: mask of the chain and doorkeeper tables
+ * @sc_cur:     index of the segment being filled (fill thread only)
+ * @sc_segsz:   segment size (the staging mblock size)
+ * @sc_wrsz:    length of the writes that fill a segment's mblock
+ * @sc_ds:      dataset
+ * @sc_cndb:    cndb
+ * @sc_wq:      fill thread
+ * @sc_segv:    segments
+ * @sc_entv:    entries, sc_segc * sc_slotc of them
+ * @sc_hbktv:   hash chains
+ * @sc_vbktv:   vblock chains
+ * @sc_ghostv:  doorkeeper, hashes of recently missed extents
+ * @sc_fills:   fill requests pending
+ */
+struct cn_scache {
+    spinlock_t               sc_lock;
+    uint                     sc_segc;
+    uint                     sc_slotc;
+    uint                     sc_bktmask;
+    uint                     sc_cur;
+    size_t                   sc_segsz;
+    size_t                   sc_wrsz;
+    struct mpool *           sc_ds;
+    struct cndb *            sc_cndb;
+    struct workqueue_struct *sc_wq;
+    struct sc_seg *          sc_segv;
+    struct sc_entry *        sc_entv;
+    struct list_head *       sc_hbktv;
+    struct list_head *       sc_vbktv;
+    u64 *                    sc_ghostv;
+    atomic_t                 sc_fills;
+
+    atomic64_t sc_hits;
+    atomic64_t sc_misses;
+    atomic64_t sc_filled;
+    atomic64_t sc_evicts;
+};
+
+static inline u64
+sc_hash(u64 mbid, u32 ext)
+{
+    return ((mbid ^ ((u64)ext << 40)) * 0x9e3779b97f4a7c15ul) | 1;
+}
+
+static inline struct list_head *
+sc_vbkt(struct cn_scache *sc, u64 mbid)
+{
+    return sc->sc_vbktv + (sc_hash(mbid, 0) & sc->sc_bktmask);
+}
+
+/* Caller must hold sc_lock. */
+static struct sc_entry *
+sc_find(struct cn_scache *sc, u64 mbid, u32 ext)
+{
+    struct list_head *head;
+    struct sc_entry * se;
+
+    head = sc->sc_hbktv + (sc_hash(mbid, ext) & sc->sc_bktmask);
+
+    list_for_each_entry (se, head, se_hlink) {
+        if (se->se_mbid == mbid && se->se_ext == ext)
+            return se;
+    }
+
+    return NULL;
+}
+
+/* Caller must hold sc_lock. */
+static void
+sc_unlink(struct sc_entry *se)
+{
+    list_del_init(&se->se_hlink);
+    list_del_init(&se->se_vlink);
+    se->se_mbid = 0;
+}
+
+/* Drop the segment's extents, wait for reads of its mblock to finish,
+ * then delete the mblock.  The mblock's cndb transaction is aborted only
+ * if the mblock is gone, otherwise recovery will delete it.
+ */
+static void
+sc_seg_evict(struct cn_scache *sc, struct sc_seg *seg)
+{
+    struct sc_entry *entv;
+    void *           buf;
+    merr_t           err;
+    uint             i;
+
+    entv = sc->sc_entv + (seg - sc->sc_segv) * sc->sc_slotc;
+
+    spin_lock(&sc->sc_lock);
+    for (i = 0; i < seg->ss_used; ++i) {
+        if (entv[i].se_mbid)
+            sc_unlink(entv + i);
+    }
+
+    buf = seg->ss_buf;
+    seg->ss_buf = NULL;
+    spin_unlock(&sc->sc_lock);
+
+    while (atomic_read(&seg->ss_readers) > 0)
+        usleep(100);
+
+    if (buf) {
+        err = mpool_mblock_abort(sc->sc_ds, seg->ss_mbh);
+        free_aligned(buf);
+    } else {
+        err = mpool_mblock_delete(sc->sc_ds, seg->ss_mbh);
+    }
+
+    if (!ev(err))
+        cndb_txn_nak(sc->sc_cndb, seg->ss_txid);
+
+    seg->ss_mbh = 0;
+    seg->ss_used = 0;
+
+    atomic64_inc(&sc->sc_evicts);
+}
+
+/* Allocate a staging mblock for the segment and record it in cndb before
+ * anything is written to it, evicting the segment first if need be.
+ */
+static merr_t
+sc_seg_open(struct cn_scache *sc, struct sc_seg *seg)
+{
+    struct kvset_mblocks mblocks = {};
+    struct mblock_props  props;
+    void *               buf;
+    u64                  mbh, txid = 0, tag = 0;
+    merr_t               err;
+
+    if (seg->ss_mbh)
+        sc_seg_evict(sc, seg);
+
+    buf = alloc_page_aligned(sc->sc_segsz, GFP_KERNEL);
+    if (ev(!buf))
+        return merr(ENOMEM);
+
+    err = mpool_mblock_alloc(sc->sc_ds, MP_MED_STAGING, false, &mbh, &props);
+    if (ev(err))
+        goto err_free;
+
+    /* A cache on capacity media would be of no use. */
+    if (ev(props.mpr_mclassp != MP_MED_STAGING || props.mpr_alloc_cap != sc->sc_segsz)) {
+        err = merr(ENOSPC);
+        goto err_abort;
+    }
+
+    blk_list_init(&mblocks.kblks);
+    blk_list_init(&mblocks.vblks);
+
+    err = blk_list_append(&mblocks.vblks, mbh, props.mpr_objid);
+    if (ev(err))
+        goto err_abort;
+
+    err = cndb_txn_start(sc->sc_cndb, &txid, CNDB_INVAL_INGESTID, 1, 0, 0);
+    if (!ev(err)) {
+        err = cndb_txn_txc(sc->sc_cndb, txid, 0, &tag, &mblocks, 0);
+        if (ev(err))
+            cndb_txn_nak(sc->sc_cndb, txid);
+    }
+
+    blk_list_free(&mblocks.vblks);
+    if (err)
+        goto err_abort;
+
+    sc->sc_wrsz = SC_WRITE_MAX - (SC_WRITE_MAX % props.mpr_stripe_len);
+
+    seg->ss_mbh = mbh;
+    seg->ss_txid = txid;
+    seg->ss_used = 0;
+
+    spin_lock(&sc->sc_lock);
+    seg->ss_buf = buf;
+    spin_unlock(&sc->sc_lock);
+
+    return 0;
+
+err_abort:
+    mpool_mblock_abort(sc->sc_ds, mbh);
+err_free:
+    free_aligned(buf);
+
+    return err;
+}
+
+/* Write and commit a full segment, after which its extents are read from
+ * its mblock rather than from memory.
+ */
+static void
+sc_seg_seal(struct cn_scache *sc, struct sc_seg *seg)
+{
+    struct iovec iov;
+    size_t       off;
+    void *       buf;
+    merr_t       err = 0;
+
+    for (off = 0; off < sc->sc_segsz && !err; off += iov.iov_len) {
+        iov.iov_base = seg->ss_buf + off;
+        iov.iov_len = min_t(size_t, sc->sc_wrsz, sc->sc_segsz - off);
+
+        err = mpool_mblock_write_data(sc->sc_ds, true, seg->ss_mbh, &iov, 1, NULL);
+    }
+
+    if (!err)
+        err = mpool_mblock_commit(sc->sc_ds, seg->ss_mbh);
+
+    if (ev(err)) {
+        sc_seg_evict(sc, seg);
+        return;
+    }
+
+    spin_lock(&sc->sc_lock);
+    buf = seg->ss_buf;
+    seg->ss_buf = NULL;
+    spin_unlock(&sc->sc_lock);
+
+    free_aligned(buf);
+}
+
+static void
+sc_fill_cb(struct work_struct *work)
+{
+    struct sc_fill *    sf = container_of(work, struct sc_fill, sf_work);
+    struct cn_scache *  sc = sf->sf_sc;
+    struct vblock_desc *vbd;
+    struct sc_entry *   se;
+    struct sc_seg *     seg;
+    struct iovec        iov;
+    u64                 mbid, off, wlen;
+    merr_t              err;
+
+    mbid = mbset_get_mbid(sf->sf_mbs, sf->sf_bnum);
+    vbd = mbset_get_udata(sf->sf_mbs, sf->sf_bnum);
+
+    spin_lock(&sc->sc_lock);
+    se = sc_find(sc, mbid, sf->sf_ext);
+    spin_unlock(&sc->sc_lock);
+
+    if (se)
+        goto out;
+
+    seg = sc->sc_segv + sc->sc_cur;
+    if (!seg->ss_buf) {
+        err = sc_seg_open(sc, seg);
+        if (ev(err))
+            goto out;
+    }
+
+    off = (u64)sf->sf_ext * CN_SCACHE_EXT_SZ;
+    wlen = vbd->vbd_off + vbd->vbd_len;
+
+    iov.iov_base = seg->ss_buf + (size_t)seg->ss_used * CN_SCACHE_EXT_SZ;
+    iov.iov_len = ALIGN(min_t(u64, CN_SCACHE_EXT_SZ, wlen - off), PAGE_SIZE);
+
+    /* The slot is not yet in any chain, so no reader can see it. */
+    err = mpool_mblock_read(sc->sc_ds, mbset_get_mbh(sf->sf_mbs, sf->sf_bnum), &iov, 1, off);
+    if (ev(err))
+        goto out;
+
+    se = sc->sc_entv + (sc->sc_cur * sc->sc_slotc + seg->ss_used);
+
+    spin_lock(&sc->sc_lock);
+    se->se_mbid = mbid;
+    se->se_ext = sf->sf_ext;
+    list_add(&se->se_hlink, sc->sc_hbktv + (sc_hash(mbid, sf->sf_ext) & sc->sc_bktmask));
+    list_add(&se->se_vlink, sc_vbkt(sc, mbid));
+    seg->ss_used++;
+    spin_unlock(&sc->sc_lock);
+
+    if (seg->ss_used == sc->sc_slotc) {
+        sc_seg_seal(sc, seg);
+        sc->sc_cur = (sc->sc_cur + 1) % sc->sc_segc;
+    }
+
+    atomic64_inc(&sc->sc_filled);
+
+out:
+    /* Holding the mbset until now ensures that its vblocks cannot be
+     * deleted (and invalidated) while the fill is in progress.
+     */
+    mbset_put_ref(sf->sf_mbs);
+    atomic_dec(&sc->sc_fills);
+    free(sf);
+}
+
+/* Admit an extent on its second miss.  The doorkeeper remembers one hash
+ * per slot, so a miss is forgotten once another extent's miss lands on
+ * its slot.  Races on the doorkeeper only cost an admission.
+ */
+static void
+sc_admit(struct cn_scache *sc, struct mbset *mbs, uint bnum, u64 mbid, u32 ext)
+{
+    struct sc_fill *sf;
+    u64             hash, *ghost;
+
+    hash = sc_hash(mbid, ext);
+    ghost = sc->sc_ghostv + (hash & sc->sc_bktmask);
+
+    if (READ_ONCE(*ghost) != hash) {
+        *ghost = hash;
+        return;
+    }
+
+    *ghost = 0;
+
+    if (atomic_inc_return(&sc->sc_fills) > SC_FILLS_MAX)
+        goto busy;
+
+    sf = malloc(sizeof(*sf));
+    if (ev(!sf))
+        goto busy;
+
+    INIT_WORK(&sf->sf_work, sc_fill_cb);
+    sf->sf_sc = sc;
+    sf->sf_mbs = mbset_get_ref(mbs);
+    sf->sf_bnum = bnum;
+    sf->sf_ext = ext;
+
+    queue_work(sc->sc_wq, &sf->sf_work);
+    return;
+
+busy:
+    atomic_dec(&sc->sc_fills);
+}
+
+static merr_t
+sc_read_mblock(struct cn_scache *sc, u64 mbh, size_t off, u32 len, void *buf)
+{
+    struct scratch_mark mark;
+    struct iovec        iov;
+    merr_t              err;
+
+    iov.iov_len = ALIGN(off + len, PAGE_SIZE) - (off & PAGE_MASK);
+
+    scratch_save(&mark);
+
+    iov.iov_base = scratch_alloc(iov.iov_len, PAGE_SIZE);
+    if (!iov.iov_base) {
+        scratch_restore(&mark);
+        return merr(ev(ENOMEM));
+    }
+
+    err = mpool_mblock_read(sc->sc_ds, mbh, &iov, 1, off & PAGE_MASK);
+    if (!ev(err))
+        memcpy(buf, iov.iov_base + (off & ~PAGE_MASK), len);
+
+    scratch_restore(&mark);
+
+    return err;
+}
+
+bool
+cn_scache_read(struct cn_scache *sc, struct mbset *mbs, uint bnum, u32 off, u32 len, void *buf)
+{
+    struct vblock_desc *vbd;
+    struct sc_entry *   se;
+    struct sc_seg *     seg;
+    size_t              soff;
+    u64                 mbid, mbh, pos;
+    uint                slot;
+    u32                 ext;
+    merr_t              err;
+
+    vbd = mbset_get_udata(mbs, bnum);
+    if (!vbd || vbd->vbd_mclass != MP_MED_CAPACITY)
+        return false;
+
+    /* Only values that lie within one extent are cached. */
+    pos = vbd->vbd_off + off;
+    ext = pos / CN_SCACHE_EXT_SZ;
+    if ((pos % CN_SCACHE_EXT_SZ) + len > CN_SCACHE_EXT_SZ)
+        return false;
+
+    mbid = mbset_get_mbid(mbs, bnum);
+
+    spin_lock(&sc->sc_lock);
+    se = sc_find(sc, mbid, ext);
+    if (!se) {
+        spin_unlock(&sc->sc_lock);
+        atomic64_inc(&sc->sc_misses);
+        sc_admit(sc, mbs, bnum, mbid, ext);
+        return false;
+    }
+
+    slot = se - sc->sc_entv;
+    seg = sc->sc_segv + slot / sc->sc_slotc;
+    soff = (size_t)(slot % sc->sc_slotc) * CN_SCACHE_EXT_SZ + (pos % CN_SCACHE_EXT_SZ);
+
+    if (seg->ss_buf) {
+        memcpy(buf, seg->ss_buf + soff, len);
+        spin_unlock(&sc->sc_lock);
+        atomic64_inc(&sc->sc_hits);
+        return true;
+    }
+
+    atomic_inc(&seg->ss_readers);
+    mbh = seg->ss_mbh;
+    spin_unlock(&sc->sc_lock);
+
+    err = sc_read_mblock(sc, mbh, soff, len, buf);
+
+    atomic_dec(&seg->ss_readers);
+
+    if (err)
+        return false;
+
+    atomic64_inc(&sc->sc_hits);
+
+    return true;
+}
+
+void
+cn_scache_invalidate(struct cn_scache *sc, uint idc, const u64 *idv)
+{
+    struct sc_entry *se, *next;
+    uint             i;
+
+    if (!sc)
+        return;
+
+    spin_lock(&sc->sc_lock);
+    for (i = 0; i < idc; ++i) {
+        list_for_each_entry_safe (se, next, sc_vbkt(sc, idv[i]), se_vlink) {
+            if (se->se_mbid == idv[i])
+                sc_unlink(se);
+        }
+    }
+    spin_unlock(&sc->sc_lock);
+}
+
+void
+cn_scache_usage(struct cn_scache *sc, struct cn_scache_usage *usage)
+{
+    uint i;
+
+    memset(usage, 0, sizeof(*usage));
+
+    if (!sc)
+        return;
+
+    for (i = 0; i < sc->sc_segc; ++i)
+        if (sc->sc_segv[i].ss_mbh)
+            usage->scu_size += sc->sc_segsz;
+
+    usage->scu_hits = atomic64_read(&sc->sc_hits);
+    usage->scu_misses = atomic64_read(&sc->sc_misses);
+    usage->scu_fills = atomic64_read(&sc->sc_filled);
+    usage->scu_evicts = atomic64_read(&sc->sc_evicts);
+}
+
+merr_t
+cn_scache_create(struct mpool *ds, struct cndb *cndb, size_t capacity, struct cn_scache **scp)
+{
+    struct mblock_props props;
+    struct cn_scache *  sc;
+    size_t              segsz, sz;
+    uint                segc, slotc, entc, bktc, i;
+    u64                 mbh;
+    merr_t              err;
+
+    *scp = NULL;
+
+    if (mpool_mclass_get(ds, MP_MED_STAGING, NULL))
+        return merr(ENOENT);
+
+    /* Learn the size of staging mblocks, which is the segment size. */
+    err = mpool_mblock_alloc(ds, MP_MED_STAGING, false, &mbh, &props);
+    if (ev(err))
+        return err;
+
+    mpool_mblock_abort(ds, mbh);
+
+    segsz = props.mpr_alloc_cap;
+    if (ev(props.mpr_mclassp != MP_MED_STAGING || segsz < CN_SCACHE_EXT_SZ))
+        return merr(ENOSPC);
+
+    segc = max_t(size_t, capacity / segsz, SC_SEGS_MIN);
+    slotc = segsz / CN_SCACHE_EXT_SZ;
+    entc = segc * slotc;
+    bktc = roundup_pow_of_two(entc);
+
+    sz = sizeof(*sc);
+    sz += sizeof(*sc->sc_segv) * segc;
+    sz += sizeof(*sc->sc_entv) * entc;
+    sz += sizeof(*sc->sc_hbktv) * bktc * 2;
+    sz += sizeof(*sc->sc_ghostv) * bktc;
+
+    sc = alloc_page_aligned(sz, GFP_KERNEL);
+    if (ev(!sc))
+        return merr(ENOMEM);
+
+    memset(sc, 0, sz);
+
+    sc->sc_hbktv = (void *)(sc + 1);
+    sc->sc_vbktv = sc->sc_hbktv + bktc;
+    sc->sc_ghostv = (void *)(sc->sc_vbktv + bktc);
+    sc->sc_entv = (void *)(sc->sc_ghostv + bktc);
+    sc->sc_segv = (void *)(sc->sc_entv + entc);
+
+    for (i = 0; i < bktc; ++i) {
+        INIT_LIST_HEAD(sc->sc_hbktv + i);
+        INIT_LIST_HEAD(sc->sc_vbktv + i);
+    }
+
+    for (i = 0; i < entc; ++i) {
+        INIT_LIST_HEAD(&sc->sc_entv[i].se_hlink);
+        INIT_LIST_HEAD(&sc->sc_entv[i].se_vlink);
+    }
+
+    for (i = 0; i < segc; ++i)
+        atomic_set(&sc->sc_segv[i].ss_readers, 0);
+
+    spin_lock_init(&sc->sc_lock);
+    sc->sc_segc = segc;
+    sc->sc_slotc = slotc;
+    sc->sc_bktmask = bktc - 1;
+    sc->sc_segsz = segsz;
+    sc->sc_ds = ds;
+    sc->sc_cndb = cndb;
+    atomic_set(&sc->sc_fills, 0);
+    atomic64_set(&sc->sc_hits, 0);
+    atomic64_set(&sc->sc_misses, 0);
+    atomic64_set(&sc->sc_filled, 0);
+    atomic64_set(&sc->sc_evicts, 0);
+
+    sc->sc_wq = alloc_workqueue("cn_scache", 0, 1);
+    if (ev(!sc->sc_wq)) {
+        free_aligned(sc);
+        return merr(ENOMEM);
+    }
+
+    hse_log(
+        HSE_NOTICE "%s: %u segments of %zu MiB on staging media",
+        __func__,
+        segc,
+        segsz >> 20);
+
+    *scp = sc;
+
+    return 0;
+}
+
+void
+cn_scache_destroy(struct cn_scache *sc)
+{
+    uint i;
+
+    if (!sc)
+        return;
+
+    flush_workqueue(sc->sc_wq);
+    destroy_workqueue(sc->sc_wq);
+
+    for (i = 0; i < sc->sc_segc; ++i) {
+        if (sc->sc_segv[i].ss_mbh)
+            sc_seg_evict(sc, sc->sc_segv + i);
+    }
+
+    free_aligned(sc);
+}
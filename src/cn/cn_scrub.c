@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/list.h>
+#include <hse_util/mutex.h>
+#include <hse_util/condvar.h>
+#include <hse_util/page.h>
+#include <hse_util/token_bucket.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_scrub.h>
+#include <hse_ikvdb/kvdb_health.h>
+
+#include "cn_tree.h"
+#include "cn_tree_iter.h"
+#include "cn_metrics.h"
+#include "kvset.h"
+
+#include <pthread.h>
+
+/* Delay before the first pass over a newly added cn.
+ */
+#define CN_SCRUB_DELAY_NS (60 * NSEC_PER_SEC)
+
+/**
+ * struct cs_ent - a cn being scrubbed
+ * @e_link:  link on the scrubber's list
+ * @e_cn:    cn
+ * @e_tag:   tag of the last kvset verified in the current pass
+ * @e_next:  time at which the next pass may start
+ */
+struct cs_ent {
+    struct list_head e_link;
+    struct cn *      e_cn;
+    u64              e_tag;
+    u64              e_next;
+};
+
+/**
+ * struct cn_scrub - kvdb-wide scrubber
+ * @cs_lock:    protects all fields but @cs_tb and @cs_health
+ * @cs_cv:      wakes the scrubber thread
+ * @cs_idle:    signaled when the scrubber thread is done with @cs_busy
+ * @cs_ents:    cns being scrubbed, in round robin order
+ * @cs_busy:    entry whose kvset is being verified
+ * @cs_exit:    the scrubber thread must exit
+ * @cs_period:  minimum time between the starts of two passes over a cn
+ * @cs_tb:      paces reads (bytes)
+ * @cs_health:  kvdb health
+ * @cs_stats:   activity
+ * @cs_tid:     scrubber thread
+ */
+struct cn_scrub {
+    struct mutex          cs_lock;
+    struct cv             cs_cv;
+    struct cv             cs_idle;
+    struct list_head      cs_ents;
+    struct cs_ent *       cs_busy;
+    bool                  cs_exit;
+    u64                   cs_period;
+    struct tbkt           cs_tb;
+    struct kvdb_health *  cs_health;
+    struct cn_scrub_stats cs_stats;
+    pthread_t             cs_tid;
+};
+
+/* Get the first entry due for scrubbing, or the time (in ms) until
+ * one is due.
+ */
+static struct cs_ent *
+cs_pick(struct cn_scrub *cs, u64 now, int *wait_ms)
+{
+    struct cs_ent *ent;
+    u64            next = U64_MAX;
+
+    list_for_each_entry (ent, &cs->cs_ents, e_link) {
+        if (ent->e_next <= now)
+            return ent;
+
+        next = min(next, ent->e_next);
+    }
+
+    *wait_ms = -1;
+    if (next != U64_MAX)
+        *wait_ms = min_t(u64, (next - now) / (NSEC_PER_SEC / MSEC_PER_SEC) + 1, INT_MAX);
+
+    return NULL;
+}
+
+/* Verify the kvset of @ent's cn that follows the last one verified.
+ * Return the number of bytes read.
+ */
+static u64
+cs_verify(struct cn_scrub *cs, struct cs_ent *ent, bool *done)
+{
+    struct kvset_stats st;
+    struct cn_node_loc loc;
+    struct kvset *     ks;
+    merr_t             err;
+    u64                tag, bytes;
+
+    ks = cn_tree_kvset_next(cn_get_tree(ent->e_cn), ent->e_tag, &loc);
+    if (!ks) {
+        *done = true;
+        return 0;
+    }
+
+    err = kvset_verify(ks, &loc);
+
+    tag = kvset_get_tag(ks);
+    kvset_stats(ks, &st);
+    kvset_put_ref(ks);
+
+    /* Full kblocks and the header page of each vblock. */
+    bytes = st.kst_kalen + st.kst_vblks * PAGE_SIZE;
+
+    mutex_lock(&cs->cs_lock);
+    cs->cs_stats.css_bytes += bytes;
+
+    /* Retry the kvset if verification merely ran out of memory. */
+    if (merr_errno(err) != ENOMEM) {
+        ent->e_tag = tag;
+        cs->cs_stats.css_kvsets++;
+    }
+
+    if (err && merr_errno(err) != ENOMEM) {
+        cs->cs_stats.css_errors++;
+        cs->cs_stats.css_last_cnid = cn_get_cnid(ent->e_cn);
+        cs->cs_stats.css_last_tag = tag;
+    }
+    mutex_unlock(&cs->cs_lock);
+
+    if (err && merr_errno(err) != ENOMEM) {
+        hse_elog(
+            HSE_ERR "cn_scrub: cnid %lu kvset %lu level %u offset %u failed verification: @@e",
+            err,
+            (ulong)cn_get_cnid(ent->e_cn),
+            (ulong)tag,
+            loc.node_level,
+            loc.node_offset);
+
+        kvdb_health_event(cs->cs_health, KVDB_HEALTH_FLAG_IO, err);
+    }
+
+    *done = false;
+
+    return bytes;
+}
+
+static void *
+cs_main(void *arg)
+{
+    struct cn_scrub *cs = arg;
+    struct cs_ent *  ent;
+    u64              delay;
+    bool             done;
+    int              wait_ms;
+
+    pthread_setname_np(pthread_self(), "cn_scrub");
+
+    mutex_lock(&cs->cs_lock);
+    while (!cs->cs_exit) {
+        ent = cs_pick(cs, get_time_ns(), &wait_ms);
+        if (!ent) {
+            cv_timedwait(&cs->cs_cv, &cs->cs_lock, wait_ms);
+            continue;
+        }
+
+        cs->cs_busy = ent;
+        mutex_unlock(&cs->cs_lock);
+
+        delay = tbkt_request(&cs->cs_tb, cs_verify(cs, ent, &done));
+
+        mutex_lock(&cs->cs_lock);
+        if (done) {
+            ent->e_tag = 0;
+            ent->e_next = get_time_ns() + cs->cs_period;
+            cs->cs_stats.css_passes++;
+        }
+
+        /* Take turns with the other cns, one kvset at a time. */
+        list_move_tail(&ent->e_link, &cs->cs_ents);
+
+        cs->cs_busy = NULL;
+        cv_broadcast(&cs->cs_idle);
+
+        /* Sleep off the read pacing here so that exit is prompt. */
+        if (delay && !cs->cs_exit)
+            cv_timedwait(
+                &cs->cs_cv, &cs->cs_lock, delay / (NSEC_PER_SEC / MSEC_PER_SEC) + 1);
+    }
+    mutex_unlock(&cs->cs_lock);
+
+    return NULL;
+}
+
+void
+cn_scrub_add(struct cn_scrub *cs, struct cn *cn)
+{
+    struct cs_ent *ent;
+
+    if (!cs)
+        return;
+
+    ent = malloc(sizeof(*ent));
+    if (ev(!ent))
+        return;
+
+    ent->e_cn = cn;
+    ent->e_tag = 0;
+    ent->e_next = get_time_ns() + CN_SCRUB_DELAY_NS;
+
+    mutex_lock(&cs->cs_lock);
+    list_add_tail(&ent->e_link, &cs->cs_ents);
+    cv_signal(&cs->cs_cv);
+    mutex_unlock(&cs->cs_lock);
+}
+
+void
+cn_scrub_remove(struct cn_scrub *cs, struct cn *cn)
+{
+    struct cs_ent *ent, *found = NULL;
+
+    if (!cs)
+        return;
+
+    mutex_lock(&cs->cs_lock);
+    list_for_each_entry (ent, &cs->cs_ents, e_link) {
+        if (ent->e_cn == cn) {
+            found = ent;
+            break;
+        }
+    }
+
+    while (found && cs->cs_busy == found)
+        cv_wait(&cs->cs_idle, &cs->cs_lock);
+
+    if (found)
+        list_del(&found->e_link);
+    mutex_unlock(&cs->cs_lock);
+
+    free(found);
+}
+
+void
+cn_scrub_stats(struct cn_scrub *cs, struct cn_scrub_stats *stats)
+{
+    if (!cs) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    mutex_lock(&cs->cs_lock);
+    *stats = cs->cs_stats;
+    mutex_unlock(&cs->cs_lock);
+}
+
+merr_t
+cn_scrub_create(u64 rate, u64 period_ns, struct kvdb_health *health, struct cn_scrub **csp)
+{
+    struct cn_scrub *cs;
+    int              rc;
+
+    if (ev(!rate))
+        return merr(EINVAL);
+
+    cs = calloc(1, sizeof(*cs));
+    if (ev(!cs))
+        return merr(ENOMEM);
+
+    mutex_init(&cs->cs_lock);
+    cv_init(&cs->cs_cv, "cn_scrub");
+    cv_init(&cs->cs_idle, "cn_scrub_idle");
+    INIT_LIST_HEAD(&cs->cs_ents);
+    cs->cs_period = period_ns;
+    cs->cs_health = health;
+
+    /* A one second burst covers the largest kblock. */
+    tbkt_init(&cs->cs_tb, rate, rate);
+
+    rc = pthread_create(&cs->cs_tid, NULL, cs_main, cs);
+    if (ev(rc)) {
+        cv_destroy(&cs->cs_idle);
+        cv_destroy(&cs->cs_cv);
+        mutex_destroy(&cs->cs_lock);
+        free(cs);
+        return merr(rc);
+    }
+
+    *csp = cs;
+
+    return 0;
+}
+
+void
+cn_scrub_destroy(struct cn_scrub *cs)
+{
+    struct cs_ent *ent, *next;
+
+    if (!cs)
+        return;
+
+    mutex_lock(&cs->cs_lock);
+    cs->cs_exit = true;
+    cv_signal(&cs->cs_cv);
+    mutex_unlock(&cs->cs_lock);
+
+    pthread_join(cs->cs_tid, NULL);
+
+    /* Normally empty, every cn removes itself on close. */
+    list_for_each_entry_safe (ent, next, &cs->cs_ents, e_link)
+        free(ent);
+
+    cv_destroy(&cs->cs_idle);
+    cv_destroy(&cs->cs_cv);
+    mutex_destroy(&cs->cs_lock);
+    free(cs);
+}
@@ -0,0 +1,438 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/minmax.h>
+#include <hse_util/delay.h>
+#include <hse_util/mutex.h>
+#include <hse_util/table.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/logging.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_snap.h>
+#include <hse_ikvdb/cn_tree_view.h>
+#include <hse_ikvdb/kvset_view.h>
+
+#include <mpool/mpool.h>
+
+#include "cn_internal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Size of the reads and writes that copy an mblock.
+ */
+#define CN_SNAP_IOSZ (1024 * 1024)
+
+/**
+ * struct cs_cn - a cn of a snapshot
+ * @c_cn:   cn, on which a reference is held
+ * @c_name: name of the cn's directory in an export
+ * @c_view: tree view, holds a reference on each of the cn's kvsets
+ */
+struct cs_cn {
+    struct cn *   c_cn;
+    char *        c_name;
+    struct table *c_view;
+};
+
+/**
+ * struct cn_snap - snapshot
+ * @cs_cnc: number of cns
+ * @cs_cnv: cns
+ */
+struct cn_snap {
+    uint         cs_cnc;
+    struct cs_cn cs_cnv[];
+};
+
+/**
+ * struct cs_export - state of an export
+ * @e_dir:   export directory
+ * @e_base:  absolute path of the base export directory, NULL if none
+ * @e_idv:   sorted ids of the mblocks of the base snapshot
+ * @e_idc:   number of ids in @e_idv
+ * @e_buf:   copy buffer
+ * @e_bytes: bytes copied
+ */
+struct cs_export {
+    const char *e_dir;
+    char *      e_base;
+    u64 *       e_idv;
+    size_t      e_idc;
+    void *      e_buf;
+    u64         e_bytes;
+};
+
+/* Take the ingest locks of all the cns, or none of them.  An ingest takes
+ * the locks of its cns in its own order, so waiting for a lock here while
+ * holding another could deadlock.
+ */
+static bool
+cs_trylock(struct cn_snap *snap)
+{
+    uint i;
+
+    for (i = 0; i < snap->cs_cnc; i++)
+        if (!mutex_trylock(&snap->cs_cnv[i].c_cn->cn_ingest_lock))
+            break;
+
+    if (i == snap->cs_cnc)
+        return true;
+
+    while (i-- > 0)
+        mutex_unlock(&snap->cs_cnv[i].c_cn->cn_ingest_lock);
+
+    return false;
+}
+
+static void
+cs_unlock(struct cn_snap *snap)
+{
+    uint i;
+
+    for (i = 0; i < snap->cs_cnc; i++)
+        mutex_unlock(&snap->cs_cnv[i].c_cn->cn_ingest_lock);
+}
+
+merr_t
+cn_snap_create(struct cn **cnv, const char *const *namev, uint cnc, struct cn_snap **snapp)
+{
+    struct cn_snap *snap;
+    merr_t          err = 0;
+    uint            i;
+
+    snap = calloc(1, sizeof(*snap) + cnc * sizeof(snap->cs_cnv[0]));
+    if (ev(!snap))
+        return merr(ENOMEM);
+
+    for (i = 0; i < cnc; i++) {
+        struct cs_cn *c = snap->cs_cnv + i;
+
+        c->c_name = strdup(namev[i]);
+        if (ev(!c->c_name)) {
+            err = merr(ENOMEM);
+            break;
+        }
+
+        c->c_cn = cnv[i];
+        cn_ref_get(c->c_cn);
+        snap->cs_cnc++;
+    }
+
+    if (err) {
+        cn_snap_destroy(snap);
+        return err;
+    }
+
+    while (!cs_trylock(snap))
+        msleep(1);
+
+    for (i = 0; i < cnc && !err; i++) {
+        int retries = 3;
+
+        /* A spill in progress may perturb the tree under the view. */
+        do {
+            err = cn_tree_view_create(snap->cs_cnv[i].c_cn, &snap->cs_cnv[i].c_view);
+        } while (merr_errno(err) == EAGAIN && --retries > 0);
+
+        if (ev(err))
+            snap->cs_cnv[i].c_view = NULL;
+    }
+
+    cs_unlock(snap);
+
+    if (err) {
+        cn_snap_destroy(snap);
+        return err;
+    }
+
+    *snapp = snap;
+
+    return 0;
+}
+
+void
+cn_snap_destroy(struct cn_snap *snap)
+{
+    uint i;
+
+    if (!snap)
+        return;
+
+    for (i = 0; i < snap->cs_cnc; i++) {
+        struct cs_cn *c = snap->cs_cnv + i;
+
+        if (c->c_view)
+            cn_tree_view_destroy(c->c_view);
+
+        cn_ref_put(c->c_cn);
+        free(c->c_name);
+    }
+
+    free(snap);
+}
+
+static int
+cs_id_cmp(const void *lhs, const void *rhs)
+{
+    u64 l = *(const u64 *)lhs;
+    u64 r = *(const u64 *)rhs;
+
+    return (l > r) - (l < r);
+}
+
+/* Collect the ids of all the mblocks of a snapshot, sorted.
+ */
+static merr_t
+cs_ids(struct cn_snap *snap, u64 **idvp, size_t *idcp)
+{
+    size_t idc = 0;
+    u64 *  idv;
+    uint   i, j, k;
+
+    for (i = 0; i < snap->cs_cnc; i++) {
+        struct table *view = snap->cs_cnv[i].c_view;
+
+        for (j = 0; j < table_len(view); j++) {
+            struct kvset_view *v = table_at(view, j);
+
+            if (v->kvset)
+                idc += kvset_get_num_kblocks(v->kvset) + kvset_get_num_vblocks(v->kvset);
+        }
+    }
+
+    idv = malloc((idc + 1) * sizeof(*idv));
+    if (ev(!idv))
+        return merr(ENOMEM);
+
+    idc = 0;
+
+    for (i = 0; i < snap->cs_cnc; i++) {
+        struct table *view = snap->cs_cnv[i].c_view;
+
+        for (j = 0; j < table_len(view); j++) {
+            struct kvset_view *v = table_at(view, j);
+
+            if (!v->kvset)
+                continue;
+
+            for (k = 0; k < kvset_get_num_kblocks(v->kvset); k++)
+                idv[idc++] = kvset_get_nth_kblock_id(v->kvset, k);
+
+            for (k = 0; k < kvset_get_num_vblocks(v->kvset); k++)
+                idv[idc++] = kvset_get_nth_vblock_id(v->kvset, k);
+        }
+    }
+
+    qsort(idv, idc, sizeof(*idv), cs_id_cmp);
+
+    *idvp = idv;
+    *idcp = idc;
+
+    return 0;
+}
+
+/* Copy the contents of an mblock into a new file.
+ */
+static merr_t
+cs_copy(struct cs_export *ex, struct mpool *ds, u64 id, const char *path)
+{
+    struct mblock_props props;
+    struct iovec        iov;
+    merr_t              err;
+    size_t              off;
+    u64                 mbh;
+    int                 fd;
+
+    err = mpool_mblock_find_get(ds, id, &mbh, &props);
+    if (ev(err))
+        return err;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0640);
+    if (ev(fd == -1)) {
+        err = merr(errno);
+        mpool_mblock_put(ds, mbh);
+        return err;
+    }
+
+    for (off = 0; off < props.mpr_write_len && !err; off += iov.iov_len) {
+        iov.iov_base = ex->e_buf;
+        iov.iov_len = min_t(size_t, CN_SNAP_IOSZ, props.mpr_write_len - off);
+
+        err = mpool_mblock_read(ds, mbh, &iov, 1, off);
+        if (ev(err))
+            break;
+
+        if (ev(write(fd, iov.iov_base, iov.iov_len) != iov.iov_len))
+            err = merr(errno ?: EIO);
+    }
+
+    if (!err && ev(fsync(fd)))
+        err = merr(errno);
+
+    close(fd);
+    mpool_mblock_put(ds, mbh);
+
+    if (err)
+        unlink(path);
+    else
+        ex->e_bytes += props.mpr_write_len;
+
+    return err;
+}
+
+/* Add an mblock of a kvset to an export: its image goes in the mblocks
+ * directory unless it is already there, and the kvset's directory links
+ * to it.
+ */
+static merr_t
+cs_mblock(struct cs_export *ex, struct mpool *ds, const char *ksdir, char type, uint idx, u64 id)
+{
+    char        path[PATH_MAX], target[PATH_MAX];
+    struct stat st;
+    merr_t      err = 0;
+    int         n;
+
+    n = snprintf(path, sizeof(path), "%s/mblocks/0x%08lx", ex->e_dir, (ulong)id);
+    if (ev(n >= sizeof(path)))
+        return merr(ENAMETOOLONG);
+
+    if (lstat(path, &st) == -1) {
+        if (ex->e_base && bsearch(&id, ex->e_idv, ex->e_idc, sizeof(id), cs_id_cmp)) {
+            n = snprintf(target, sizeof(target), "%s/mblocks/0x%08lx", ex->e_base, (ulong)id);
+            if (ev(n >= sizeof(target)))
+                return merr(ENAMETOOLONG);
+
+            if (ev(symlink(target, path)))
+                err = merr(errno);
+        } else {
+            err = cs_copy(ex, ds, id, path);
+        }
+
+        if (ev(err))
+            return err;
+    }
+
+    n = snprintf(path, sizeof(path), "%s/%c%03u.0x%08lx", ksdir, type, idx, (ulong)id);
+    if (ev(n >= sizeof(path)))
+        return merr(ENAMETOOLONG);
+
+    snprintf(target, sizeof(target), "../../mblocks/0x%08lx", (ulong)id);
+
+    if (ev(symlink(target, path)))
+        return merr(errno);
+
+    return 0;
+}
+
+static merr_t
+cs_export_cn(struct cs_export *ex, struct cs_cn *c)
+{
+    struct mpool *ds = cn_get_dataset(c->c_cn);
+    char          path[PATH_MAX];
+    merr_t        err = 0;
+    uint          i, j;
+    int           n;
+
+    n = snprintf(path, sizeof(path), "%s/%s", ex->e_dir, c->c_name);
+    if (ev(n >= sizeof(path)))
+        return merr(ENAMETOOLONG);
+
+    if (ev(mkdir(path, 0750)))
+        return merr(errno);
+
+    for (i = 0; i < table_len(c->c_view) && !err; i++) {
+        struct kvset_view *v = table_at(c->c_view, i);
+        struct kvset *     ks = v->kvset;
+
+        if (!ks)
+            continue;
+
+        n = snprintf(
+            path, sizeof(path), "%s/%s/%020lu", ex->e_dir, c->c_name, (ulong)kvset_get_dgen(ks));
+        if (ev(n >= sizeof(path)))
+            return merr(ENAMETOOLONG);
+
+        if (ev(mkdir(path, 0750)))
+            return merr(errno);
+
+        for (j = 0; j < kvset_get_num_kblocks(ks) && !err; j++)
+            err = cs_mblock(ex, ds, path, 'K', j, kvset_get_nth_kblock_id(ks, j));
+
+        for (j = 0; j < kvset_get_num_vblocks(ks) && !err; j++)
+            err = cs_mblock(ex, ds, path, 'V', j, kvset_get_nth_vblock_id(ks, j));
+    }
+
+    return err;
+}
+
+merr_t
+cn_snap_export(struct cn_snap *snap, const char *dir, struct cn_snap *base, const char *basedir)
+{
+    struct cs_export ex = {};
+    char             path[PATH_MAX];
+    merr_t           err;
+    uint             i;
+    int              n;
+
+    if (ev(!snap || !dir || (base && !basedir)))
+        return merr(EINVAL);
+
+    ex.e_dir = dir;
+
+    if (base) {
+        /* The links into the base export must not depend on the cwd. */
+        ex.e_base = realpath(basedir, NULL);
+        if (ev(!ex.e_base))
+            return merr(errno);
+
+        err = cs_ids(base, &ex.e_idv, &ex.e_idc);
+        if (ev(err))
+            goto out;
+    }
+
+    ex.e_buf = alloc_page_aligned(CN_SNAP_IOSZ, GFP_KERNEL);
+    if (ev(!ex.e_buf)) {
+        err = merr(ENOMEM);
+        goto out;
+    }
+
+    n = snprintf(path, sizeof(path), "%s/mblocks", dir);
+    if (ev(n >= sizeof(path))) {
+        err = merr(ENAMETOOLONG);
+        goto out;
+    }
+
+    if (ev(mkdir(dir, 0750) || mkdir(path, 0750))) {
+        err = merr(errno);
+        goto out;
+    }
+
+    for (i = 0; i < snap->cs_cnc; i++) {
+        err = cs_export_cn(&ex, snap->cs_cnv + i);
+        if (ev(err))
+            goto out;
+    }
+
+    hse_log(
+        HSE_NOTICE "%s: exported %u kvs to %s, %lu bytes copied",
+        __func__,
+        snap->cs_cnc,
+        dir,
+        (ulong)ex.e_bytes);
+
+out:
+    if (err)
+        hse_elog(HSE_ERR "%s: export to %s failed: @@e", err, __func__, dir);
+
+    free_aligned(ex.e_buf);
+    free(ex.e_idv);
+    free(ex.e_base);
+
+    return err;
+}
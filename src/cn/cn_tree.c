@@ -14,9 +14,11 @@
 #define _GNU_SOURCE /* for pthread_setname_np() */
 
 #include <hse_util/alloc.h>
+#include <hse_util/cursor_heap.h>
 #include <hse_util/event_counter.h>
 #include <hse_util/page.h>
 #include <hse_util/slab.h>
+#include <hse_util/scratch.h>
 #include <hse_util/mman.h>
 #include <hse_util/list.h>
 #include <hse_util/mutex.h>
@@ -29,9 +31,11 @@
 #include <hse_util/darray.h>
 #include <hse_util/table.h>
 #include <hse_util/keycmp.h>
-#include <hse_util/bin_heap.h>
+#include <hse_util/loser_tree.h>
 #include <hse_util/log2.h>
+#include <hse_util/usdt.h>
 #include <hse_util/workqueue.h>
+#include <hse_util/compression.h>
 
 #include <mpool/mpool.h>
 
@@ -43,11 +47,13 @@
 #include <hse_ikvdb/kvdb_health.h>
 #include <hse_ikvdb/cn_tree_view.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_evlog.h>
 #include <hse_ikvdb/cn_kvdb.h>
 #include <hse_ikvdb/cursor.h>
 #include <hse_ikvdb/sched_sts.h>
 #include <hse_ikvdb/csched.h>
 #include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include "cn_tree.h"
 #include "cn_tree_compact.h"
@@ -59,6 +65,7 @@
 #include "cn_mblocks.h"
 #include "cn_metrics.h"
 #include "kvset.h"
+#include "mbset.h"
 #include "cn_perfc.h"
 #include "kcompact.h"
 #include "blk_list.h"
@@ -132,6 +139,40 @@ kvset_iterv_release(uint iterc, struct kv_iterator **iterv, struct workqueue_str
     ev(1);
 }
 
+static void
+cn_tree_cview_put(struct cn_cview *cv)
+{
+    uint i;
+
+    if (!cv || atomic_dec_return(&cv->cv_ref) > 0)
+        return;
+
+    for (i = 0; i < cv->cv_kvsetc; ++i)
+        kvset_put_ref(cv->cv_kvsetv[i].kvset);
+
+    free(cv);
+}
+
+/*
+ * Drop the cached cursor views after a change to the tree, so that they
+ * do not keep the kvsets it retired alive.
+ */
+static void
+cn_tree_cview_purge(struct cn_tree *tree)
+{
+    struct cn_cview_cache *cc = &tree->ct_cview;
+    struct cn_cview *      viewv[CN_CVIEW_SLOTS];
+    uint                   i;
+
+    spin_lock(&cc->cc_lock);
+    memcpy(viewv, cc->cc_viewv, sizeof(viewv));
+    memset(cc->cc_viewv, 0, sizeof(cc->cc_viewv));
+    spin_unlock(&cc->cc_lock);
+
+    for (i = 0; i < CN_CVIEW_SLOTS; ++i)
+        cn_tree_cview_put(viewv[i]);
+}
+
 static void
 cn_setname(const char *name)
 {
@@ -395,6 +436,108 @@ path_step_to_target(struct cn_tree *tree, struct cn_node_loc *tgt, u32 curr_leve
     return child_branch;
 }
 
+/* Lookups search the kvsets of a node through its kvset snapshot (struct
+ * cn_kvsnap) under rcu instead of taking the tree read lock, such that
+ * ingest and compaction commits no longer stall them.  Whoever changes
+ * the kvset list of a node must republish its snapshot before releasing
+ * the tree write lock.  The retired snapshot (and with it the references
+ * it holds on its kvsets) is freed after an rcu grace period.
+ *
+ * A spill must publish the children it adds kvsets to before the node it
+ * removes them from, so that a lookup that does not find them in the node
+ * finds them in a child.  If a snapshot cannot be allocated the node is
+ * given the stale snapshot, and lookups search its kvset list under the
+ * tree read lock until the next publish succeeds.
+ */
+static struct cn_kvsnap cn_kvsnap_stale;
+
+static void
+cn_kvsnap_free(struct cn_kvsnap *snap)
+{
+    uint i;
+
+    if (!snap || snap == &cn_kvsnap_stale)
+        return;
+
+    for (i = 0; i < snap->ksn_kvsetc; ++i)
+        kvset_put_ref(snap->ksn_kvsetv[i]);
+
+    free(snap);
+}
+
+static void
+cn_kvsnap_free_cb(struct rcu_head *rh)
+{
+    struct cn_kvsnap *snap = container_of(rh, struct cn_kvsnap, ksn_rcu);
+    struct cn *       cn = snap->ksn_cn;
+
+    cn_kvsnap_free(snap);
+
+    if (cn)
+        cn_ref_put(cn);
+}
+
+/**
+ * cn_node_kvsnap_publish() - replace the kvset snapshot of a node
+ * @tn: node whose kvset list changed
+ *
+ * The caller must hold the tree write lock (or be the only user of the
+ * tree, as during open).
+ */
+static void
+cn_node_kvsnap_publish(struct cn_tree_node *tn)
+{
+    struct kvset_list_entry *le;
+    struct cn_kvsnap *       snap, *old;
+    uint                     cnt = 0;
+
+    list_for_each_entry (le, &tn->tn_kvset_list, le_link)
+        ++cnt;
+
+    snap = NULL;
+    if (cnt > 0) {
+        snap = malloc(sizeof(*snap) + cnt * (sizeof(snap->ksn_kvsetv[0]) + 3 * sizeof(u64)));
+        if (ev(!snap)) {
+            snap = &cn_kvsnap_stale;
+        } else {
+            snap->ksn_cn = tn->tn_tree->cn;
+            snap->ksn_kvsetc = 0;
+            snap->ksn_fencev = (u64 *)(snap->ksn_kvsetv + cnt);
+            snap->ksn_seqminv = snap->ksn_fencev + 2 * cnt;
+
+            list_for_each_entry (le, &tn->tn_kvset_list, le_link) {
+                u64 *fence = snap->ksn_fencev + 2 * snap->ksn_kvsetc;
+                u64  seqmin = kvset_get_seqno_min(le->le_kvset);
+
+                fence[0] = 0;
+                fence[1] = U64_MAX;
+                kvset_key_fences(le->le_kvset, &fence[0], &fence[1]);
+
+                if (snap->ksn_kvsetc > 0)
+                    seqmin = min_t(u64, seqmin, snap->ksn_seqminv[snap->ksn_kvsetc - 1]);
+                snap->ksn_seqminv[snap->ksn_kvsetc] = seqmin;
+
+                kvset_get_ref(le->le_kvset);
+                snap->ksn_kvsetv[snap->ksn_kvsetc++] = le->le_kvset;
+            }
+        }
+    }
+
+    old = tn->tn_kvsnap;
+    rcu_assign_pointer(tn->tn_kvsnap, snap);
+
+    if (!old || old == &cn_kvsnap_stale)
+        return;
+
+    /* cn_close() waits for the cn's references, and therefore for the
+     * deferred free to put the kvsets while the cn is still usable.
+     */
+    if (old->ksn_cn)
+        cn_ref_get(old->ksn_cn);
+
+    call_rcu(&old->ksn_rcu, cn_kvsnap_free_cb);
+}
+
 static size_t
 cn_node_size(void)
 {
@@ -451,6 +594,9 @@ cn_node_free(struct cn_tree_node *tn)
 {
     if (tn) {
         hlog_destroy(tn->tn_hlog);
+        cn_kvsnap_free(tn->tn_kvsnap);
+        free(tn->tn_ckpt);
+        free(tn->tn_split);
         kmem_cache_free(cn_node_cache, tn);
     }
 }
@@ -500,6 +646,420 @@ cn_node_level(const struct cn_tree_node *node)
     return node->tn_loc.node_level;
 }
 
+bool
+cn_node_ptomb_hidden(struct cn_tree_node *tn, struct kvset_list_entry *le, u64 horizon)
+{
+    struct kvset *ks = le->le_kvset;
+    const void *  kmin, *kmax;
+    u16           kminlen, kmaxlen;
+    uint          pfx_len;
+    u64           seqno_max;
+
+    pfx_len = tn->tn_tree->ct_cp->cp_pfx_len;
+    seqno_max = kvset_get_seqno_max(ks);
+
+    /* A ptomb of the kvset itself may hide keys in older kvsets. */
+    if (!pfx_len || seqno_max >= horizon || kvset_pt_start(ks) >= 0)
+        return false;
+
+    kvset_minkey(ks, &kmin, &kminlen);
+    kvset_maxkey(ks, &kmax, &kmaxlen);
+
+    if (kminlen < pfx_len || kmaxlen < pfx_len || memcmp(kmin, kmax, pfx_len))
+        return false;
+
+    /* The kvsets ahead of it in its node and all those of its ancestors
+     * are newer.
+     */
+    for (; tn; tn = tn->tn_parent, le = NULL) {
+        struct kvset_list_entry *newer;
+
+        list_for_each_entry (newer, &tn->tn_kvset_list, le_link) {
+            if (newer == le)
+                break;
+
+            if (kvset_ptomb_seqno(newer->le_kvset, kmin, kminlen, horizon) > seqno_max)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/* Truncate a key to the prefix length of a node that spills by prefix,
+ * so that all the keys of a prefix go to the same child.
+ */
+static __always_inline void
+cn_split_trunc(struct key_obj *kobj, uint pfx_len)
+{
+    if (!pfx_len || key_obj_len(kobj) <= pfx_len)
+        return;
+
+    if (kobj->ko_pfx_len >= pfx_len) {
+        kobj->ko_pfx_len = pfx_len;
+        kobj->ko_sfx_len = 0;
+    } else {
+        kobj->ko_sfx_len = pfx_len - kobj->ko_pfx_len;
+    }
+}
+
+uint
+cn_split_child(const struct cn_split *split, uint pfx_len, const struct key_obj *kobj)
+{
+    struct key_obj key = *kobj;
+    uint           lo, hi;
+
+    if (!split)
+        return 0;
+
+    cn_split_trunc(&key, pfx_len);
+
+    lo = 0;
+    hi = split->cs_splitc;
+
+    while (lo < hi) {
+        uint mid = (lo + hi) / 2;
+
+        if (key_obj_cmp(split->cs_splitv + mid, &key) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Create a split from @keyc ascending keys, truncating each to @pfx_len.
+ */
+static struct cn_split *
+cn_split_create(const struct key_obj *keyv, uint keyc, uint pfx_len)
+{
+    struct cn_split *split;
+    size_t           sz;
+    u8 *             dst;
+    uint             i;
+
+    sz = sizeof(*split) + keyc * sizeof(split->cs_splitv[0]);
+    for (i = 0; i < keyc; i++)
+        sz += key_obj_len(keyv + i);
+
+    split = malloc(sz);
+    if (ev(!split))
+        return NULL;
+
+    split->cs_splitc = keyc;
+    dst = (u8 *)(split->cs_splitv + keyc);
+
+    for (i = 0; i < keyc; i++) {
+        struct key_obj key = keyv[i];
+        uint           klen;
+
+        cn_split_trunc(&key, pfx_len);
+        key_obj_copy(dst, HSE_KVS_KLEN_MAX, &klen, &key);
+        key2kobj(split->cs_splitv + i, dst, klen);
+        dst += klen;
+    }
+
+    return split;
+}
+
+/* A kblock boundary key of a spill's input, weighed by the average number
+ * of keys per kblock of its kvset.
+ */
+struct cn_split_samp {
+    struct key_obj css_kobj;
+    u64            css_wt;
+};
+
+static int
+cn_split_samp_cmp(const void *lhs, const void *rhs)
+{
+    const struct cn_split_samp *l = lhs;
+    const struct cn_split_samp *r = rhs;
+
+    return key_obj_cmp(&l->css_kobj, &r->css_kobj);
+}
+
+/* Get the min and max keys of a kvset, truncated to the prefix length of
+ * a spill, false if it has only prefix tombstones.
+ */
+static bool
+cn_split_range(struct kvset *ks, uint pfx_len, struct key_obj *kmin, struct key_obj *kmax)
+{
+    const void *key;
+    u16         klen;
+
+    kvset_minkey(ks, &key, &klen);
+    if (!klen)
+        return false;
+
+    key2kobj(kmin, key, klen);
+    cn_split_trunc(kmin, pfx_len);
+
+    kvset_maxkey(ks, &key, &klen);
+    key2kobj(kmax, key, klen);
+    cn_split_trunc(kmax, pfx_len);
+
+    return true;
+}
+
+/* Sample the min key of each input kvset, weighed by its number of keys,
+ * if no two input kvsets overlap.  The splitters then fall between kvsets,
+ * so that the spill can move them whole (see cn_comp_move_prepare()).
+ * Returns the number of samples, zero if any two overlap.
+ */
+static uint
+cn_split_samp_disjoint(struct cn_compaction_work *w, struct cn_split_samp *sampv, u64 *total)
+{
+    struct cn_split_samp *   maxv = sampv + w->cw_kvset_cnt;
+    struct kvset_list_entry *le = w->cw_mark;
+    uint                     i, j;
+
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        struct kvset *ks = le->le_kvset;
+
+        if (!cn_split_range(ks, w->cw_pfx_len, &sampv[i].css_kobj, &maxv[i].css_kobj))
+            return 0;
+
+        for (j = 0; j < i; j++) {
+            if (key_obj_cmp(&maxv[i].css_kobj, &sampv[j].css_kobj) >= 0 &&
+                key_obj_cmp(&maxv[j].css_kobj, &sampv[i].css_kobj) >= 0)
+                return 0;
+        }
+
+        sampv[i].css_wt = max_t(u64, kvset_statsp(ks)->kst_keys, 1);
+        *total += sampv[i].css_wt;
+
+        le = list_prev_entry(le, le_link);
+    }
+
+    return w->cw_kvset_cnt;
+}
+
+/* Choose the splitters of a node at its first spill, such that each child
+ * gets about the same share of the spill's keys.
+ */
+static struct cn_split *
+cn_split_choose(struct cn_compaction_work *w, uint outc)
+{
+    struct kvset_list_entry *le;
+    struct cn_split_samp *   sampv;
+    struct cn_split *        split;
+    struct key_obj           keyv[CN_FANOUT_MAX];
+    u64                      total, cum;
+    uint                     sampc, keyc, i, j;
+
+    /* The input kvsets are the marked one and the newer ones before it,
+     * which only this spill removes from the node.
+     */
+    le = w->cw_mark;
+    for (i = sampc = 0; i < w->cw_kvset_cnt; i++) {
+        sampc += 2 * kvset_get_num_kblocks(le->le_kvset);
+        le = list_prev_entry(le, le_link);
+    }
+
+    sampc = max_t(uint, sampc, 2 * w->cw_kvset_cnt);
+
+    sampv = malloc(sizeof(*sampv) * (sampc + 1));
+    if (ev(!sampv))
+        return NULL;
+
+    total = 0;
+
+    sampc = cn_split_samp_disjoint(w, sampv, &total);
+    if (sampc > 0)
+        goto choose;
+
+    total = 0;
+    le = w->cw_mark;
+
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        struct kvset *ks = le->le_kvset;
+        uint          nkblks = kvset_get_num_kblocks(ks);
+        u64           wt;
+
+        le = list_prev_entry(le, le_link);
+        if (nkblks == 0)
+            continue;
+
+        wt = max_t(u64, kvset_statsp(ks)->kst_keys / (2 * nkblks), 1);
+
+        for (j = 0; j < nkblks; j++) {
+            const void *key;
+            uint        klen;
+
+            kvset_get_nth_kblock_minkey(ks, j, &key, &klen);
+            if (klen > 0) {
+                key2kobj(&sampv[sampc].css_kobj, key, klen);
+                cn_split_trunc(&sampv[sampc].css_kobj, w->cw_pfx_len);
+                sampv[sampc++].css_wt = wt;
+                total += wt;
+            }
+
+            kvset_get_nth_kblock_maxkey(ks, j, &key, &klen);
+            if (klen > 0) {
+                key2kobj(&sampv[sampc].css_kobj, key, klen);
+                cn_split_trunc(&sampv[sampc].css_kobj, w->cw_pfx_len);
+                sampv[sampc++].css_wt = wt;
+                total += wt;
+            }
+        }
+    }
+
+choose:
+    qsort(sampv, sampc, sizeof(*sampv), cn_split_samp_cmp);
+
+    /* Each child ends just before the first sample that would put it
+     * past its share of the total.
+     */
+    cum = 0;
+    keyc = 0;
+
+    for (i = 0; i + 1 < sampc && keyc < outc - 1; i++) {
+        struct key_obj *next = &sampv[i + 1].css_kobj;
+
+        cum += sampv[i].css_wt;
+        if (cum < total * (keyc + 1) / outc)
+            continue;
+
+        if (!key_obj_cmp(next, &sampv[i].css_kobj))
+            continue;
+
+        keyv[keyc++] = *next;
+    }
+
+    split = cn_split_create(keyv, keyc, 0);
+
+    free(sampv);
+
+    return split;
+}
+
+/* Get the splitters of the node a spill is from, choosing them if this is
+ * its first spill.  Concurrent root spills all use those of the first one.
+ */
+static merr_t
+cn_split_get(struct cn_compaction_work *w, uint outc)
+{
+    struct cn_tree_node *node = w->cw_node;
+    struct cn_tree *     tree = w->cw_tree;
+    struct cn_split *    split;
+    void *               lock;
+
+    rmlock_rlock(&tree->ct_lock, &lock);
+    split = node->tn_split;
+    rmlock_runlock(lock);
+
+    if (!split) {
+        split = cn_split_choose(w, outc);
+        if (ev(!split))
+            return merr(ENOMEM);
+
+        rmlock_wlock(&tree->ct_lock);
+        if (node->tn_split) {
+            free(split);
+            split = node->tn_split;
+        } else {
+            node->tn_split = split;
+        }
+        rmlock_wunlock(&tree->ct_lock);
+    }
+
+    w->cw_split = split;
+
+    return 0;
+}
+
+/* Get the smallest key in the subtree of a node, false if it has none.
+ * Kvsets of only prefix tombstones have no keys.
+ */
+static bool
+cn_node_minkey(struct cn_tree_node *tn, struct key_obj *kmin)
+{
+    struct kvset_list_entry *le;
+    struct key_obj           kobj;
+    bool                     found = false;
+    uint                     i;
+
+    list_for_each_entry (le, &tn->tn_kvset_list, le_link) {
+        const void *key;
+        u16         klen;
+
+        kvset_minkey(le->le_kvset, &key, &klen);
+        if (!klen)
+            continue;
+
+        key2kobj(&kobj, key, klen);
+        if (!found || key_obj_cmp(&kobj, kmin) < 0) {
+            *kmin = kobj;
+            found = true;
+        }
+    }
+
+    for (i = 0; i < tn->tn_tree->ct_cp->cp_fanout; i++) {
+        if (!tn->tn_childv[i] || !cn_node_minkey(tn->tn_childv[i], &kobj))
+            continue;
+
+        if (!found || key_obj_cmp(&kobj, kmin) < 0) {
+            *kmin = kobj;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+merr_t
+cn_tree_split_restore(struct cn_tree *tree)
+{
+    struct tree_iter     iter;
+    struct cn_tree_node *tn;
+
+    if (!tree->ct_range)
+        return 0;
+
+    /* The splitters are not persisted.  Each is rebuilt from the smallest
+     * key of the next child that has any, which routes every key already
+     * in the tree to the child it went to, so the keys yet to come need
+     * only follow the rebuilt ones.
+     */
+    tree_iter_init(tree, &iter, TRAVERSE_TOPDOWN);
+
+    while (NULL != (tn = tree_iter_next(tree, &iter))) {
+        struct key_obj keyv[CN_FANOUT_MAX], next, kmin;
+        uint           keyc = 0;
+        bool           found = false;
+        int            i;
+
+        if (tn->tn_childc == 0)
+            continue;
+
+        for (i = tree->ct_cp->cp_fanout - 1; i >= 0; i--) {
+            if (found)
+                keyv[i] = next;
+
+            if (!tn->tn_childv[i] || !cn_node_minkey(tn->tn_childv[i], &kmin))
+                continue;
+
+            /* The children after the last one with keys get none. */
+            if (!found)
+                keyc = i;
+
+            next = kmin;
+            found = true;
+        }
+
+        if (!found)
+            continue;
+
+        tn->tn_split = cn_split_create(keyv, keyc, tn->tn_pfx_spill ? tree->ct_pfx_len : 0);
+        if (ev(!tn->tn_split))
+            return merr(ENOMEM);
+    }
+
+    return 0;
+}
+
 /**
  * cn_tree_create() - add node to tree during initial tree creation
  *
@@ -537,6 +1097,13 @@ cn_tree_create(
     tree->ct_fanout_mask = tree->ct_cp->cp_fanout - 1;
     tree->ct_pfx_len = cp->cp_pfx_len;
     tree->ct_sfx_len = cp->cp_sfx_len;
+    tree->ct_range = cn_cflags & CN_CFLAG_RANGE;
+
+    /* Range trees route on whole keys, see kvs_cparams_validate(). */
+    if (ev(tree->ct_range && tree->ct_sfx_len)) {
+        free_aligned(tree);
+        return merr(EINVAL);
+    }
 
     if (tstate) {
         struct cn_khashmap *khm = &tree->ct_khmbuf;
@@ -546,7 +1113,9 @@ cn_tree_create(
         tstate->ts_get(tstate, &khm->khm_gen, khm->khm_mapv);
         khm->khm_gen_committed = khm->khm_gen;
 
-        tree->ct_khashmap = khm;
+        /* The key hash map only distributes hashes among children. */
+        if (!tree->ct_range)
+            tree->ct_khashmap = khm;
         tree->ct_tstate = tstate;
     }
 
@@ -567,6 +1136,7 @@ cn_tree_create(
     tree->ct_lvl_max = 0; /* root at level 0 */
 
     rmlock_init(&tree->ct_lock);
+    spin_lock_init(&tree->ct_cview.cc_lock);
 
     /* setup cn_tree handle and return */
     *handle = tree;
@@ -592,6 +1162,14 @@ cn_tree_destroy(struct cn_tree *tree)
     nodecnt = 0;
     wq = NULL;
 
+    cn_tree_cview_purge(tree);
+
+    /* The retired kvset snapshots of a tree without a cn hold no cn
+     * reference for cn_close() to wait on (see cn_node_kvsnap_publish()).
+     */
+    if (!tree->cn)
+        rcu_barrier();
+
     /* Create a workqueue so that we can destroy the tree nodes
      * concurrently, as doing so yields a 4x reduction in teardown
      * time (vs destroying them one-by-one).
@@ -1098,18 +1676,279 @@ cn_tree_insert_kvset(struct cn_tree *tree, struct kvset *kvset, uint level, uint
     if (ev(err))
         return err;
 
+    /* The kvsets committed by the checkpoints of a spill all have the
+     * dgen of its oldest input kvset (see cn_comp_checkpoint()).
+     */
     list_for_each (head, &node->tn_kvset_list) {
         entry = list_entry(head, typeof(*entry), le_link);
         if (dgen > kvset_get_dgen(entry->le_kvset))
             break;
-        assert(dgen != kvset_get_dgen(entry->le_kvset));
     }
 
     kvset_list_add_tail(kvset, head);
+    cn_node_kvsnap_publish(node);
+
+    return 0;
+}
+
+/* Return the last key a checkpointed spill from @tn committed into its
+ * children, which is the largest key of the kvsets it committed.
+ */
+static uint
+cn_tree_ckpt_key(struct cn_tree_node *tn, u64 dgen, void *kbuf, size_t kbufsz)
+{
+    struct kvset_list_entry *le;
+    uint                     klen = 0;
+    uint                     i;
+
+    for (i = 0; i < tn->tn_tree->ct_cp->cp_fanout; i++) {
+        struct cn_tree_node *cnode = tn->tn_childv[i];
+
+        if (!cnode)
+            continue;
+
+        list_for_each_entry (le, &cnode->tn_kvset_list, le_link) {
+            void *key;
+            uint  len;
+
+            if (kvset_get_dgen(le->le_kvset) != dgen)
+                continue;
+
+            kvset_get_max_key(le->le_kvset, &key, &len);
+            if (len == 0 || len > kbufsz)
+                continue;
+
+            if (klen == 0 || keycmp(key, len, kbuf, klen) > 0) {
+                memcpy(kbuf, key, len);
+                klen = len;
+            }
+        }
+    }
+
+    return klen;
+}
+
+void
+cn_tree_ckpt_restore(struct cn_tree *tree)
+{
+    struct cn_tstate_ckpt    ckptv[CN_TSTATE_CKPT_MAX];
+    struct cn_tstate *       ts = tree->ct_tstate;
+    struct kvset_list_entry *le;
+    uint                     i;
+
+    if (!ts || !ts->ts_get_ckpt)
+        return;
+
+    ts->ts_get_ckpt(ts, ckptv);
+
+    for (i = 0; i < CN_TSTATE_CKPT_MAX; i++) {
+        struct cn_tstate_ckpt *tsc = ckptv + i;
+        struct cn_tree_node *  tn;
+        struct cn_node_ckpt *  ckpt;
+        bool                   found = false;
+
+        if (tsc->tsc_dgen_lo == 0)
+            continue;
+
+        /* The record is stale unless the node still holds the input
+         * kvsets of the spill and some of its output is committed.
+         */
+        tn = cn_tree_find_node(tree, &tsc->tsc_loc);
+        if (!tn || tn->tn_ckpt || list_empty(&tn->tn_kvset_list))
+            continue;
+
+        le = list_last_entry(&tn->tn_kvset_list, typeof(*le), le_link);
+        if (kvset_get_dgen(le->le_kvset) != tsc->tsc_dgen_lo)
+            continue;
+
+        list_for_each_entry (le, &tn->tn_kvset_list, le_link) {
+            if (kvset_get_dgen(le->le_kvset) == tsc->tsc_dgen_hi) {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+            continue;
+
+        ckpt = calloc(1, sizeof(*ckpt));
+        if (ev(!ckpt))
+            return;
+
+        ckpt->nc_klen = cn_tree_ckpt_key(tn, tsc->tsc_dgen_lo, ckpt->nc_key, sizeof(ckpt->nc_key));
+        if (ckpt->nc_klen == 0) {
+            free(ckpt);
+            continue;
+        }
+
+        ckpt->nc_dgen_lo = tsc->tsc_dgen_lo;
+        ckpt->nc_dgen_hi = tsc->tsc_dgen_hi;
+        ckpt->nc_slot = i;
+
+        tn->tn_ckpt = ckpt;
+        tree->ct_ckptv[i] = tn;
+
+        hse_log(
+            HSE_NOTICE "cnid %lu node (%u,%u) resumes checkpointed spill, dgen %lu-%lu",
+            (ulong)tree->cnid,
+            tn->tn_loc.node_level,
+            tn->tn_loc.node_offset,
+            (ulong)ckpt->nc_dgen_lo,
+            (ulong)ckpt->nc_dgen_hi);
+    }
+}
+
+void
+cn_tree_ttl_init(struct cn_tree *tree, u64 ttl_secs, u64 seq)
+{
+    struct cn_ttl *   ttl = &tree->ct_ttl;
+    struct cn_tstate *ts = tree->ct_tstate;
+
+    spin_lock_init(&ttl->ttl_lock);
+    ttl->ttl_ns = ttl_secs * NSEC_PER_SEC;
+    ttl->ttl_persisted = 0;
+
+    if (ts && ts->ts_get_ttl_seq)
+        ttl->ttl_persisted = ts->ts_get_ttl_seq(ts);
+
+    atomic64_set(&ttl->ttl_seq, ttl->ttl_persisted);
+    atomic64_set(&ttl->ttl_next, U64_MAX);
+
+    ttl->ttl_head = 0;
+    ttl->ttl_cnt = 0;
+
+    if (ttl->ttl_ns)
+        cn_tree_ttl_sample(tree, seq);
+}
+
+u64
+cn_tree_ttl_seq(struct cn_tree *tree)
+{
+    struct cn_ttl *ttl = &tree->ct_ttl;
+    u64            now, expire;
+
+    if (!ttl->ttl_ns)
+        return 0;
+
+    now = get_time_ns();
+    if (now < atomic64_read(&ttl->ttl_next))
+        return atomic64_read(&ttl->ttl_seq);
+
+    expire = now - ttl->ttl_ns;
+
+    spin_lock(&ttl->ttl_lock);
+    while (ttl->ttl_cnt > 0 && ttl->ttl_timev[ttl->ttl_head] <= expire) {
+        if (ttl->ttl_seqv[ttl->ttl_head] > atomic64_read(&ttl->ttl_seq))
+            atomic64_set(&ttl->ttl_seq, ttl->ttl_seqv[ttl->ttl_head]);
+
+        ttl->ttl_head = (ttl->ttl_head + 1) % CN_TTL_SAMPLES;
+        ttl->ttl_cnt--;
+    }
+
+    expire = U64_MAX;
+    if (ttl->ttl_cnt > 0)
+        expire = ttl->ttl_timev[ttl->ttl_head] + ttl->ttl_ns;
+    atomic64_set(&ttl->ttl_next, expire);
+    spin_unlock(&ttl->ttl_lock);
+
+    return atomic64_read(&ttl->ttl_seq);
+}
+
+void
+cn_tree_ttl_hide(struct cn_tree *tree, enum key_lookup_res *res, u64 vseq)
+{
+    if (*res == FOUND_VAL && vseq <= cn_tree_ttl_seq(tree))
+        *res = FOUND_TMB;
+}
+
+struct cn_ttl_update {
+    struct cn_ttl *tu_ttl;
+    u64            tu_seq;
+    u64            tu_prev;
+};
+
+static merr_t
+cn_tree_ttl_persist_prepare(struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_ttl_update *tu = arg;
+
+    tu->tu_prev = omf_ts_ttl_seq(omf);
+    if (tu->tu_seq <= tu->tu_prev)
+        return merr(EALREADY);
+
+    omf_set_ts_ttl_seq(omf, tu->tu_seq);
 
     return 0;
 }
 
+static void
+cn_tree_ttl_persist_commit(const struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_ttl_update *tu = arg;
+
+    spin_lock(&tu->tu_ttl->ttl_lock);
+    tu->tu_ttl->ttl_persisted = tu->tu_seq;
+    spin_unlock(&tu->tu_ttl->ttl_lock);
+}
+
+static void
+cn_tree_ttl_persist_abort(struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_ttl_update *tu = arg;
+
+    omf_set_ts_ttl_seq(omf, tu->tu_prev);
+}
+
+void
+cn_tree_ttl_sample(struct cn_tree *tree, u64 seq)
+{
+    struct cn_ttl *      ttl = &tree->ct_ttl;
+    struct cn_tstate *   ts = tree->ct_tstate;
+    struct cn_ttl_update tu;
+    u64                  now;
+    uint                 last;
+    merr_t               err;
+
+    if (!ttl->ttl_ns)
+        return;
+
+    now = get_time_ns();
+
+    /* Samples are taken at most every ttl_ns / CN_TTL_SAMPLES.  Skipping
+     * a sample when the ring is full only delays expiry.
+     */
+    spin_lock(&ttl->ttl_lock);
+    last = (ttl->ttl_head + ttl->ttl_cnt + CN_TTL_SAMPLES - 1) % CN_TTL_SAMPLES;
+
+    if (ttl->ttl_cnt == 0 ||
+        (ttl->ttl_cnt < CN_TTL_SAMPLES && seq > ttl->ttl_seqv[last] &&
+         now >= ttl->ttl_timev[last] + ttl->ttl_ns / CN_TTL_SAMPLES)) {
+
+        last = (ttl->ttl_head + ttl->ttl_cnt) % CN_TTL_SAMPLES;
+        ttl->ttl_timev[last] = now;
+        ttl->ttl_seqv[last] = seq;
+
+        if (ttl->ttl_cnt++ == 0)
+            atomic64_set(&ttl->ttl_next, now + ttl->ttl_ns);
+    }
+    spin_unlock(&ttl->ttl_lock);
+
+    /* Record the horizon so that expired entries stay hidden after
+     * a restart until compaction has dropped them.
+     */
+    tu.tu_ttl = ttl;
+    tu.tu_seq = cn_tree_ttl_seq(tree);
+
+    if (!ts || tu.tu_seq <= ttl->ttl_persisted)
+        return;
+
+    err = ts->ts_update(
+        ts, cn_tree_ttl_persist_prepare, cn_tree_ttl_persist_commit, cn_tree_ttl_persist_abort,
+        &tu);
+    if (err && merr_errno(err) != EALREADY)
+        ev(err);
+}
+
 /**
  * struct vtc_bkt - view table cache bucket
  * @lock:  protects all fields in the bucket
@@ -1289,6 +2128,38 @@ cn_tree_view_create(struct cn *cn, struct table **view_out)
     return err;
 }
 
+struct kvset *
+cn_tree_kvset_next(struct cn_tree *tree, u64 tag, struct cn_node_loc *loc)
+{
+    struct tree_iter         iter;
+    struct cn_tree_node *    node;
+    struct kvset_list_entry *le;
+    struct kvset *           next = NULL;
+    u64                      next_tag = U64_MAX;
+    void *                   lock;
+
+    tree_iter_init(tree, &iter, TRAVERSE_TOPDOWN);
+
+    rmlock_rlock(&tree->ct_lock, &lock);
+    while (NULL != (node = tree_iter_next(tree, &iter))) {
+        list_for_each_entry (le, &node->tn_kvset_list, le_link) {
+            u64 t = kvset_get_tag(le->le_kvset);
+
+            if (t > tag && t < next_tag) {
+                next = le->le_kvset;
+                next_tag = t;
+                *loc = node->tn_loc;
+            }
+        }
+    }
+
+    if (next)
+        kvset_get_ref(next);
+    rmlock_runlock(lock);
+
+    return next;
+}
+
 void
 cn_tree_preorder_walk(
     struct cn_tree *          tree,
@@ -1357,6 +2228,175 @@ khashmap2child(struct cn_khashmap *khashmap, u64 hash, uint shift, uint level)
     return child;
 }
 
+#define CN_PROBE_BATCH (16)
+
+/**
+ * cn_kvsnap_fence_mask() - find the kvsets whose key fences admit a key
+ * @snap:   kvset snapshot of a node
+ * @first:  index of the first kvset to check
+ * @kpfx:   first eight bytes of the key (i.e., kdisc[0] of its key_disc)
+ *
+ * Returns a bitmap of kvsets [@first, @first + 64) of @snap in which bit i
+ * is set if kvset @first + i may hold the key.  The scan reads only the
+ * packed fences and has no branches but the loop.
+ */
+static __always_inline u64
+cn_kvsnap_fence_mask(const struct cn_kvsnap *snap, uint first, u64 kpfx)
+{
+    const u64 *fv = snap->ksn_fencev + 2 * first;
+    uint       n = min_t(uint, snap->ksn_kvsetc - first, 64);
+    u64        mask = 0;
+    uint       i;
+
+    for (i = 0; i < n; ++i)
+        mask |= (u64)((fv[2 * i] <= kpfx) & (kpfx <= fv[2 * i + 1])) << i;
+
+    return mask;
+}
+
+/**
+ * cn_kvsnap_seq_first() - find the first kvset that may be visible at a seqno
+ * @snap:  kvset snapshot of a node
+ * @seq:   view seqno of the read
+ *
+ * Returns the index of the newest kvset of @snap that may hold an entry
+ * visible at @seq (@snap->ksn_kvsetc if none), all the kvsets before it
+ * hold only newer entries.  Reads at the current seqno take the first
+ * branch, only snapshot and historical reads search.
+ */
+static __always_inline uint
+cn_kvsnap_seq_first(const struct cn_kvsnap *snap, u64 seq)
+{
+    uint lo, hi;
+
+    if (likely(snap->ksn_seqminv[0] <= seq))
+        return 0;
+
+    lo = 1;
+    hi = snap->ksn_kvsetc;
+
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+
+        if (snap->ksn_seqminv[mid] > seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * cn_node_lookup_batch() - search the kvsets of a node a batch at a time
+ *
+ * The bloom buckets of all the kvsets in a batch are prefetched before any
+ * of them is probed, so that their cache misses overlap rather than being
+ * taken one kvset at a time.  Only the kvsets whose bloom filters admit the
+ * key are then searched, from newest to oldest.  Kvsets whose key fences
+ * rule out the key are skipped up front and counted in *@nfencedp.  The
+ * search starts at kvset @first (see cn_kvsnap_seq_first()).
+ */
+static merr_t
+cn_node_lookup_batch(
+    const struct cn_kvsnap *snap,
+    uint                    first,
+    struct kvs_ktuple *     kt,
+    const struct key_disc * kdisc,
+    u64                     seq,
+    enum key_lookup_res *   res,
+    struct query_ctx *      qctx,
+    struct kvs_buf *        vbuf,
+    uint *                  nfencedp)
+{
+    struct kvset *ksv[CN_PROBE_BATCH];
+    int           kbidxv[CN_PROBE_BATCH];
+    merr_t        err;
+    uint          n, i, x;
+    u64           mask = 0;
+
+    x = first;
+
+    while (x < snap->ksn_kvsetc) {
+        for (n = 0; n < CN_PROBE_BATCH && x < snap->ksn_kvsetc; ++x) {
+            if (x == first || x % 64 == 0)
+                mask = cn_kvsnap_fence_mask(snap, x & ~63u, kdisc->kdisc[0]);
+
+            if (!(mask & (1ul << (x % 64)))) {
+                ++*nfencedp;
+                continue;
+            }
+
+            ksv[n] = snap->ksn_kvsetv[x];
+            kbidxv[n] = kvset_lookup_prefetch(ksv[n], kt, kdisc);
+            ++n;
+        }
+
+        for (i = 0; i < n; ++i) {
+            if (!kvset_lookup_may_exist(ksv[i], kt, kbidxv[i]))
+                ksv[i] = NULL;
+        }
+
+        for (i = 0; i < n; ++i) {
+            if (!ksv[i])
+                continue;
+
+            if (qctx->qtype == QUERY_GET)
+                err = kvset_lookup(ksv[i], kt, kdisc, seq, res, vbuf);
+            else if (qctx->qtype == QUERY_GET_LEASE)
+                err = kvset_lookup_lease(ksv[i], kt, kdisc, seq, res, qctx->lease);
+            else
+                err = kvset_lookup_willneed(ksv[i], kt, kdisc, seq, res);
+
+            if (err || *res != NOT_FOUND)
+                return err;
+        }
+    }
+
+    return 0;
+}
+
+/* Search one kvset for the query, returns true if the search is done.
+ */
+static __always_inline bool
+cn_kvset_query(
+    struct kvset *         kvset,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res,
+    struct query_ctx *     qctx,
+    void *                 wbti,
+    struct kvs_buf *       kbuf,
+    struct kvs_buf *       vbuf,
+    merr_t *               errp)
+{
+    merr_t err = 0;
+
+    switch (qctx->qtype) {
+        case QUERY_GET:
+            err = kvset_lookup(kvset, kt, kdisc, seq, res, vbuf);
+            break;
+
+        case QUERY_GET_LEASE:
+            err = kvset_lookup_lease(kvset, kt, kdisc, seq, res, qctx->lease);
+            break;
+
+        case QUERY_PREFETCH:
+            err = kvset_lookup_willneed(kvset, kt, kdisc, seq, res);
+            break;
+
+        case QUERY_PROBE_PFX:
+            err = kvset_pfx_lookup(kvset, kt, kdisc, seq, res, wbti, kbuf, vbuf, qctx);
+            *errp = err;
+            return ev(err) || qctx->seen > 1 || *res == FOUND_PTMB;
+    }
+
+    *errp = err;
+
+    return err || *res != NOT_FOUND;
+}
+
 /**
  * cn_tree_lookup() - search cn tree for a key
  * @tree: cn tree
@@ -1419,10 +2459,11 @@ cn_tree_lookup(
     merr_t                   err;
     u32                      child;
     u32                      shift;
-    uint                     pc_nkvset;
-    u64                      pc_start;
+    uint                     pc_nkvset, pc_nfenced, pc_nseqskip;
+    u64                      pc_start, usdt;
     u64                      spill_hash = 0;
     u16                      pc_lvl, pc_lvl_start, pc_depth;
+    uint                     batch;
     bool                     pfx_hashing, first;
     void *                   wbti;
 
@@ -1431,10 +2472,12 @@ cn_tree_lookup(
     err = 0;
     *res = NOT_FOUND;
 
-    pc_depth = pc_nkvset = 0;
+    pc_depth = pc_nkvset = pc_nfenced = pc_nseqskip = 0;
     pc_lvl = CNGET_LMAX;
     pc_lvl_start = 0;
 
+    usdt = HSE_USDT_START(cn_tree_lookup);
+
     pc_start = perfc_lat_start(pc);
     if (pc_start > 0) {
         if (perfc_ison(pc, PERFC_LT_CNGET_GET_L0)) {
@@ -1465,43 +2508,102 @@ cn_tree_lookup(
     pfx_hashing = kt->kt_len > tree->ct_pfx_len && node->tn_pfx_spill;
     first = true;
 
-    rmlock_rlock(&tree->ct_lock, &lock);
+    batch = wbti ? 0 : tree->rp->cn_bloom_batch;
+
+    rcu_read_lock();
     while (node) {
-        bool yield = false;
+        struct cn_kvsnap *snap;
+        bool              stop = false;
+        uint              i, sfirst;
 
-        /* Search kvsets from newest to oldest (head to tail).
-         * If an error occurs or a key is found, return immediately.
-         */
-        list_for_each_entry (le, &node->tn_kvset_list, le_link) {
-            struct kvset *kvset;
-
-            kvset = le->le_kvset;
-            yield = true;
-            ++pc_nkvset;
-
-            switch (qctx->qtype) {
-                case QUERY_GET:
-                    err = kvset_lookup(kvset, kt, &kdisc, seq, res, vbuf);
-                    if (err || *res != NOT_FOUND) {
-                        rmlock_runlock(lock);
-                        if (pc_lvl < CNGET_LMAX)
-                            perfc_lat_record(pc, pc_lvl, pc_lvl_start);
-                        goto done;
-                    }
+        KVS_TRACE_INC(kt_cnnodes);
+
+        snap = rcu_dereference(node->tn_kvsnap);
+
+        if (unlikely(snap == &cn_kvsnap_stale)) {
+            rmlock_rlock(&tree->ct_lock, &lock);
+            list_for_each_entry (le, &node->tn_kvset_list, le_link) {
+                ++pc_nkvset;
+                KVS_TRACE_INC(kt_kvsets);
+
+                if (kvset_get_seqno_min(le->le_kvset) > seq) {
+                    ++pc_nseqskip;
+                    continue;
+                }
+
+                stop = cn_kvset_query(
+                    le->le_kvset, kt, &kdisc, seq, res, qctx, wbti, kbuf, vbuf, &err);
+                if (stop)
                     break;
+            }
+            rmlock_runlock(lock);
+
+        } else if (snap && batch && snap->ksn_kvsetc >= batch) {
+            pc_nkvset += snap->ksn_kvsetc;
+            KVS_TRACE_ADD(kt_kvsets, snap->ksn_kvsetc);
+
+            sfirst = cn_kvsnap_seq_first(snap, seq);
+            pc_nseqskip += sfirst;
+
+            err = cn_node_lookup_batch(
+                snap, sfirst, kt, &kdisc, seq, res, qctx, vbuf, &pc_nfenced);
+            stop = err || *res != NOT_FOUND;
+
+        } else if (snap) {
+            u64 mask = 0;
+
+            sfirst = cn_kvsnap_seq_first(snap, seq);
+            pc_nseqskip += sfirst;
+            pc_nkvset += sfirst;
+            KVS_TRACE_ADD(kt_kvsets, sfirst);
+
+            /* Search kvsets from newest to oldest, skipping those newer
+             * than the view and those whose fences rule out the key
+             * (which a prefix probe cannot use).
+             */
+            for (i = sfirst; i < snap->ksn_kvsetc && !stop; ++i) {
+                ++pc_nkvset;
+                KVS_TRACE_INC(kt_kvsets);
+
+                if (!wbti) {
+                    if (i == sfirst || i % 64 == 0)
+                        mask = cn_kvsnap_fence_mask(snap, i & ~63u, kdisc.kdisc[0]);
 
-                case QUERY_PROBE_PFX:
-                    err = kvset_pfx_lookup(kvset, kt, &kdisc, seq, res, wbti, kbuf, vbuf, qctx);
-                    if (ev(err) || qctx->seen > 1 || *res == FOUND_PTMB) {
-                        rmlock_runlock(lock);
-                        goto done;
+                    if (!(mask & (1ul << (i % 64)))) {
+                        ++pc_nfenced;
+                        continue;
                     }
-                    break;
+                }
+
+                stop = cn_kvset_query(
+                    snap->ksn_kvsetv[i], kt, &kdisc, seq, res, qctx, wbti, kbuf, vbuf, &err);
             }
         }
 
-        if (pc_depth > 0 && yield)
-            rmlock_yield(&tree->ct_lock, &lock);
+        /* If an error occurs or a key is found, return immediately.
+         */
+        if (stop) {
+            rcu_read_unlock();
+            if (qctx->qtype != QUERY_PROBE_PFX && pc_lvl < CNGET_LMAX)
+                perfc_lat_record(pc, pc_lvl, pc_lvl_start);
+            goto done;
+        }
+
+        /* Read the routing state of the node only after its kvsets, so
+         * that a lookup that missed the kvsets a spill retired from the
+         * node sees the children they were spilled into.
+         */
+        cmm_smp_rmb();
+
+        if (tree->ct_range) {
+            struct key_obj kobj;
+            uint           pfx_len;
+
+            key2kobj(&kobj, kt->kt_data, kt->kt_len);
+            pfx_len = node->tn_pfx_spill ? tree->ct_pfx_len : 0;
+            child = cn_split_child(node->tn_split, pfx_len, &kobj);
+            goto next;
+        }
 
         if (first && pfx_hashing) {
             /* Descend by prefix key */
@@ -1524,7 +2626,7 @@ cn_tree_lookup(
             } else {
                 size_t hashlen;
 
-                assert(qctx->qtype == QUERY_GET);
+                assert(qctx->qtype != QUERY_PROBE_PFX);
                 hashlen = kt->kt_len - tree->ct_sfx_len;
                 spill_hash = key_hash64(kt->kt_data, hashlen);
             }
@@ -1532,7 +2634,9 @@ cn_tree_lookup(
 
         child = khashmap2child(khashmap, spill_hash, shift, pc_depth);
         child &= tree->ct_fanout_mask;
-        node = node->tn_childv[child];
+
+    next:
+        node = rcu_dereference(node->tn_childv[child]);
 
         __builtin_prefetch(node);
 
@@ -1543,7 +2647,7 @@ cn_tree_lookup(
 
         ++pc_depth;
     }
-    rmlock_runlock(lock);
+    rcu_read_unlock();
 
 done:
     if (pc && !wbti) {
@@ -1563,10 +2667,18 @@ done:
         }
 
         perfc_inc(pc, PERFC_RA_CNGET_GET);
+        perfc_add(pc, PERFC_RA_CNGET_FENCE, pc_nfenced);
+        perfc_add(pc, PERFC_RA_CNGET_SEQSKIP, pc_nseqskip);
         perfc_rec_sample(pc, PERFC_DI_CNGET_DEPTH, pc_depth);
         perfc_rec_sample(pc, PERFC_DI_CNGET_NKVSET, pc_nkvset);
     }
 
+    if (qctx->qtype == QUERY_GET)
+        perfc_add(cn_get_amp_perfc(tree->cn), PERFC_RA_CNAMP_KVSETS, pc_nkvset);
+
+    if (usdt)
+        HSE_USDT(cn_tree_lookup, tree->cnid, kt->kt_len, seq, *res, pc_nkvset, get_time_ns() - usdt);
+
     if (wbti) {
         kvset_wbti_free(wbti);
         if (pc)
@@ -1576,21 +2688,543 @@ done:
     return err;
 }
 
-u64
-cn_tree_initial_dgen(const struct cn_tree *tree)
-{
-    return tree->ct_dgen_init;
-}
+/**
+ * struct cn_lookup_ent - per-key state of a batched tree lookup
+ * @cle_node:        node the key is to be probed in next
+ * @cle_kt:          key to search for
+ * @cle_kdisc:       discriminator of @cle_kt
+ * @cle_hash:        hash used to select the child node
+ * @cle_idx:         index of the key in the caller's vectors
+ * @cle_first:       true until the key has left the root node
+ * @cle_pfx_hashing: true while the key descends by prefix hash
+ */
+struct cn_lookup_ent {
+    struct cn_tree_node *cle_node;
+    struct kvs_ktuple *  cle_kt;
+    struct key_disc      cle_kdisc;
+    u64                  cle_hash;
+    u32                  cle_idx;
+    bool                 cle_first;
+    bool                 cle_pfx_hashing;
+};
 
-void
-cn_tree_set_initial_dgen(struct cn_tree *tree, u64 dgen)
+static int
+cn_lookup_ent_cmp(const void *lhs, const void *rhs)
 {
-    tree->ct_dgen_init = dgen;
+    const struct cn_lookup_ent *l = lhs;
+    const struct cn_lookup_ent *r = rhs;
+
+    if (l->cle_node != r->cle_node)
+        return (uintptr_t)l->cle_node < (uintptr_t)r->cle_node ? -1 : 1;
+
+    return keycmp(l->cle_kt->kt_data, l->cle_kt->kt_len, r->cle_kt->kt_data, r->cle_kt->kt_len);
 }
 
-u32
-cn_tree_fanout_bits(const struct cn_tree *tree)
-{
+/**
+ * cn_lookup_ent_descend() - advance a pending key to its child node
+ * @tree:  cn tree
+ * @ent:   lookup state of the key
+ * @depth: depth of the node the key was just probed in
+ * @probe: true if the key is the prefix of a prefix probe
+ *
+ * Implements the same descent rules as cn_tree_lookup() for QUERY_GET,
+ * or for QUERY_PROBE_PFX if @probe is true.
+ */
+static void
+cn_lookup_ent_descend(struct cn_tree *tree, struct cn_lookup_ent *ent, uint depth, bool probe)
+{
+    struct cn_tree_node *node = ent->cle_node;
+    struct kvs_ktuple *  kt = ent->cle_kt;
+    uint                 shift;
+    u32                  child;
+
+    if (tree->ct_range) {
+        struct key_obj kobj;
+        uint           pfx_len;
+
+        key2kobj(&kobj, kt->kt_data, kt->kt_len);
+        pfx_len = node->tn_pfx_spill ? tree->ct_pfx_len : 0;
+        child = cn_split_child(node->tn_split, pfx_len, &kobj);
+
+        ent->cle_node = rcu_dereference(node->tn_childv[child]);
+        return;
+    }
+
+    if (ent->cle_first && ent->cle_pfx_hashing) {
+        ent->cle_hash = key_hash64(kt->kt_data, tree->ct_pfx_len);
+        ent->cle_first = false;
+    } else if (ent->cle_first || (ent->cle_pfx_hashing && !node->tn_pfx_spill)) {
+        if (ent->cle_pfx_hashing && !node->tn_pfx_spill)
+            ent->cle_pfx_hashing = false;
+        ent->cle_first = false;
+
+        if (!tree->ct_sfx_len || probe) {
+            if (!kt->kt_hash)
+                kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len);
+
+            ent->cle_hash = kt->kt_hash;
+        } else {
+            ent->cle_hash = key_hash64(kt->kt_data, kt->kt_len - tree->ct_sfx_len);
+        }
+    }
+
+    shift = tree->ct_khashmap ? CN_KHASHMAP_SHIFT : tree->ct_fanout_bits;
+
+    child = khashmap2child(tree->ct_khashmap, ent->cle_hash, shift, depth);
+    child &= tree->ct_fanout_mask;
+
+    ent->cle_node = rcu_dereference(node->tn_childv[child]);
+}
+
+/* Probe one kvset for the unresolved keys of a group of lookup entries
+ * that share a node, adding the number of keys it resolves to @resolvedp.
+ */
+static merr_t
+cn_lookup_ent_probe(
+    struct kvset *        kvset,
+    struct cn_lookup_ent *entv,
+    u32                   entc,
+    u64                   seq,
+    enum key_lookup_res * resv,
+    struct kvs_buf *      vbufv,
+    u32 *                 resolvedp,
+    u64 *                 nprobep)
+{
+    merr_t err;
+    u32    i;
+
+    for (i = 0; i < entc; ++i) {
+        struct cn_lookup_ent *ent = entv + i;
+
+        if (resv[ent->cle_idx] != NOT_FOUND)
+            continue;
+
+        ++*nprobep;
+        err = kvset_lookup(
+            kvset, ent->cle_kt, &ent->cle_kdisc, seq, resv + ent->cle_idx, vbufv + ent->cle_idx);
+        if (ev(err))
+            return err;
+
+        if (resv[ent->cle_idx] != NOT_FOUND)
+            ++*resolvedp;
+    }
+
+    return 0;
+}
+
+/**
+ * cn_tree_lookup_batch() - search cn tree for a batch of keys
+ * @tree:    cn tree
+ * @pc:      perf counters
+ * @ktv:     vector of keys
+ * @seq:     view sequence number
+ * @resv:    (output) vector of lookup results, one per key
+ * @vbufv:   (output) vector of value buffers, one per key
+ * @lookupv: indices into @ktv, @resv and @vbufv of the keys to search for
+ * @lookupc: number of entries in @lookupv
+ *
+ * Behaves as if cn_tree_lookup(QUERY_GET) were called for each key named
+ * by @lookupv, but walks the tree one level at a time for the whole batch.
+ * At each level the pending keys are grouped by node and sorted, and each
+ * kvset in a node is probed for all of the node's candidate keys before
+ * moving on to the next (older) kvset.  This keeps the kvset's bloom and
+ * wbt pages hot across many keys.  As with cn_tree_lookup() the nodes are
+ * searched through their kvset snapshots under rcu.
+ */
+merr_t
+cn_tree_lookup_batch(
+    struct cn_tree *     tree,
+    struct perfc_set *   pc,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc)
+{
+    struct scratch_mark   mark;
+    struct cn_lookup_ent *entv;
+    void *                lock;
+    merr_t                err = 0;
+    uint                  depth;
+    u32                   pending, i;
+    u64                   pc_start;
+    u64                   nprobe = 0;
+
+    if (lookupc == 0)
+        return 0;
+
+    scratch_save(&mark);
+
+    entv = scratch_alloc(lookupc * sizeof(*entv), __alignof(*entv));
+    if (ev(!entv))
+        return merr(ENOMEM);
+
+    pc_start = perfc_lat_start(pc);
+    if (!pc_start)
+        pc = NULL;
+
+    for (i = 0; i < lookupc; ++i) {
+        struct cn_lookup_ent *ent = entv + i;
+        struct kvs_ktuple *   kt = ktv + lookupv[i];
+
+        resv[lookupv[i]] = NOT_FOUND;
+        key_disc_init(kt->kt_data, kt->kt_len, &ent->cle_kdisc);
+
+        ent->cle_node = tree->ct_root;
+        ent->cle_kt = kt;
+        ent->cle_hash = 0;
+        ent->cle_idx = lookupv[i];
+        ent->cle_first = true;
+        ent->cle_pfx_hashing = kt->kt_len > tree->ct_pfx_len && tree->ct_root->tn_pfx_spill;
+    }
+
+    pending = lookupc;
+    depth = 0;
+
+    rcu_read_lock();
+    while (pending > 0) {
+        struct kvset_list_entry *le;
+        u32                      first, last, n;
+
+        if (pending > 1)
+            qsort(entv, pending, sizeof(*entv), cn_lookup_ent_cmp);
+
+        for (first = 0; first < pending; first = last) {
+            struct cn_tree_node *node = entv[first].cle_node;
+            struct cn_kvsnap *   snap;
+            u32                  resolved = 0;
+
+            for (last = first + 1; last < pending; ++last)
+                if (entv[last].cle_node != node)
+                    break;
+
+            snap = rcu_dereference(node->tn_kvsnap);
+
+            if (unlikely(snap == &cn_kvsnap_stale)) {
+                rmlock_rlock(&tree->ct_lock, &lock);
+                list_for_each_entry (le, &node->tn_kvset_list, le_link) {
+                    err = cn_lookup_ent_probe(
+                        le->le_kvset, entv + first, last - first, seq, resv, vbufv,
+                        &resolved, &nprobe);
+                    if (err || resolved == last - first)
+                        break;
+                }
+                rmlock_runlock(lock);
+
+            } else if (snap) {
+                for (i = cn_kvsnap_seq_first(snap, seq); i < snap->ksn_kvsetc; ++i) {
+                    err = cn_lookup_ent_probe(
+                        snap->ksn_kvsetv[i], entv + first, last - first, seq, resv, vbufv,
+                        &resolved, &nprobe);
+                    if (err || resolved == last - first)
+                        break;
+                }
+            }
+
+            if (err) {
+                rcu_read_unlock();
+                goto done;
+            }
+        }
+
+        /* Read the routing state of the nodes only after their kvsets
+         * (see cn_tree_lookup()).
+         */
+        cmm_smp_rmb();
+
+        /* Retire keys that were resolved at this level and advance the
+         * rest to their child nodes.
+         */
+        for (i = n = 0; i < pending; ++i) {
+            struct cn_lookup_ent *ent = entv + i;
+
+            if (resv[ent->cle_idx] != NOT_FOUND)
+                continue;
+
+            cn_lookup_ent_descend(tree, ent, depth, false);
+            if (ent->cle_node)
+                entv[n++] = *ent;
+        }
+
+        pending = n;
+        ++depth;
+    }
+    rcu_read_unlock();
+
+done:
+    if (pc) {
+        perfc_lat_record(pc, PERFC_LT_CNGET_GET, pc_start);
+        perfc_add(pc, PERFC_RA_CNGET_GET, lookupc);
+        perfc_rec_sample(pc, PERFC_DI_CNGET_DEPTH, depth);
+    }
+
+    perfc_add(cn_get_amp_perfc(tree->cn), PERFC_RA_CNAMP_KVSETS, nprobe);
+
+    scratch_restore(&mark);
+
+    return err;
+}
+
+/* A prefix probe is done once it finds a ptomb or a second key (see
+ * cn_kvset_query()).
+ */
+static __always_inline bool
+cn_pfx_ent_done(const struct cn_lookup_ent *ent, enum key_lookup_res *resv, struct query_ctx *qctxv)
+{
+    return resv[ent->cle_idx] == FOUND_PTMB || qctxv[ent->cle_idx].seen > 1;
+}
+
+/* Prefix probe one kvset for the pending prefixes of a group of lookup
+ * entries that share a node, adding the number it completes to @donep.
+ */
+static merr_t
+cn_pfx_ent_probe(
+    struct kvset *        kvset,
+    struct cn_lookup_ent *entv,
+    u32                   entc,
+    u64                   seq,
+    enum key_lookup_res * resv,
+    struct query_ctx *    qctxv,
+    void *                wbti,
+    struct kvs_buf *      kbufv,
+    struct kvs_buf *      vbufv,
+    u32 *                 donep)
+{
+    merr_t err;
+    u32    i;
+
+    for (i = 0; i < entc; ++i) {
+        struct cn_lookup_ent *ent = entv + i;
+        u32                   k = ent->cle_idx;
+
+        if (cn_pfx_ent_done(ent, resv, qctxv))
+            continue;
+
+        err = kvset_pfx_lookup(
+            kvset, ent->cle_kt, &ent->cle_kdisc, seq, resv + k, wbti, kbufv + k, vbufv + k,
+            qctxv + k);
+        if (ev(err))
+            return err;
+
+        if (cn_pfx_ent_done(ent, resv, qctxv))
+            ++*donep;
+    }
+
+    return 0;
+}
+
+/**
+ * cn_tree_pfx_probe_batch() - prefix probe cn tree for a batch of prefixes
+ * @tree:    cn tree
+ * @pc:      perf counters
+ * @ktv:     vector of prefixes
+ * @seq:     view sequence number
+ * @resv:    (output) vector of probe results, one per prefix
+ * @qctxv:   vector of query contexts (QUERY_PROBE_PFX), one per prefix
+ * @kbufv:   (output) vector of key buffers, one per prefix
+ * @vbufv:   (output) vector of value buffers, one per prefix
+ * @lookupv: indices into the above vectors of the prefixes to probe
+ * @lookupc: number of entries in @lookupv
+ *
+ * Behaves as if cn_tree_lookup(QUERY_PROBE_PFX) were called for each
+ * prefix named by @lookupv, picking up where c0 left off in @qctxv,
+ * but walks the tree one level at a time for the whole batch as
+ * cn_tree_lookup_batch() does, sharing one wbtree iterator.
+ */
+merr_t
+cn_tree_pfx_probe_batch(
+    struct cn_tree *     tree,
+    struct perfc_set *   pc,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct query_ctx *   qctxv,
+    struct kvs_buf *     kbufv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc)
+{
+    struct scratch_mark   mark;
+    struct cn_lookup_ent *entv;
+    void *                wbti;
+    void *                lock;
+    merr_t                err = 0;
+    uint                  depth;
+    u32                   pending, i;
+    u64                   pc_start;
+
+    if (lookupc == 0)
+        return 0;
+
+    scratch_save(&mark);
+
+    entv = scratch_alloc(lookupc * sizeof(*entv), __alignof(*entv));
+    if (ev(!entv)) {
+        scratch_restore(&mark);
+        return merr(ENOMEM);
+    }
+
+    err = kvset_wbti_alloc(&wbti);
+    if (ev(err)) {
+        scratch_restore(&mark);
+        return err;
+    }
+
+    pc_start = perfc_lat_start(pc);
+    if (!pc_start)
+        pc = NULL;
+
+    for (i = 0; i < lookupc; ++i) {
+        struct cn_lookup_ent *ent = entv + i;
+        struct kvs_ktuple *   kt = ktv + lookupv[i];
+
+        resv[lookupv[i]] = NOT_FOUND;
+        key_disc_init(kt->kt_data, kt->kt_len, &ent->cle_kdisc);
+
+        ent->cle_node = tree->ct_root;
+        ent->cle_kt = kt;
+        ent->cle_hash = 0;
+        ent->cle_idx = lookupv[i];
+        ent->cle_first = true;
+        ent->cle_pfx_hashing = kt->kt_len > tree->ct_pfx_len && tree->ct_root->tn_pfx_spill;
+    }
+
+    pending = lookupc;
+    depth = 0;
+
+    rcu_read_lock();
+    while (pending > 0) {
+        struct kvset_list_entry *le;
+        u32                      first, last, n;
+
+        if (pending > 1)
+            qsort(entv, pending, sizeof(*entv), cn_lookup_ent_cmp);
+
+        for (first = 0; first < pending; first = last) {
+            struct cn_tree_node *node = entv[first].cle_node;
+            struct cn_kvsnap *   snap;
+            u32                  ndone = 0;
+
+            for (last = first + 1; last < pending; ++last)
+                if (entv[last].cle_node != node)
+                    break;
+
+            snap = rcu_dereference(node->tn_kvsnap);
+
+            if (unlikely(snap == &cn_kvsnap_stale)) {
+                rmlock_rlock(&tree->ct_lock, &lock);
+                list_for_each_entry (le, &node->tn_kvset_list, le_link) {
+                    err = cn_pfx_ent_probe(
+                        le->le_kvset, entv + first, last - first, seq, resv, qctxv, wbti,
+                        kbufv, vbufv, &ndone);
+                    if (err || ndone == last - first)
+                        break;
+                }
+                rmlock_runlock(lock);
+
+            } else if (snap) {
+                for (i = cn_kvsnap_seq_first(snap, seq); i < snap->ksn_kvsetc; ++i) {
+                    err = cn_pfx_ent_probe(
+                        snap->ksn_kvsetv[i], entv + first, last - first, seq, resv, qctxv,
+                        wbti, kbufv, vbufv, &ndone);
+                    if (err || ndone == last - first)
+                        break;
+                }
+            }
+
+            if (err) {
+                rcu_read_unlock();
+                goto done;
+            }
+        }
+
+        /* Read the routing state of the nodes only after their kvsets
+         * (see cn_tree_lookup()).
+         */
+        cmm_smp_rmb();
+
+        for (i = n = 0; i < pending; ++i) {
+            struct cn_lookup_ent *ent = entv + i;
+
+            if (cn_pfx_ent_done(ent, resv, qctxv))
+                continue;
+
+            cn_lookup_ent_descend(tree, ent, depth, true);
+            if (ent->cle_node)
+                entv[n++] = *ent;
+        }
+
+        pending = n;
+        ++depth;
+    }
+    rcu_read_unlock();
+
+done:
+    if (pc) {
+        perfc_lat_record(pc, PERFC_LT_CNGET_PROBEPFX, pc_start);
+        perfc_rec_sample(pc, PERFC_DI_CNGET_DEPTH, depth);
+    }
+
+    kvset_wbti_free(wbti);
+    scratch_restore(&mark);
+
+    return err;
+}
+
+u64
+cn_tree_initial_dgen(const struct cn_tree *tree)
+{
+    return tree->ct_dgen_init;
+}
+
+void
+cn_tree_set_initial_dgen(struct cn_tree *tree, u64 dgen)
+{
+    tree->ct_dgen_init = dgen;
+}
+
+void
+cn_tree_set_icache(struct cn_tree *tree, struct wbt_icache *ic)
+{
+    tree->ct_icache = ic;
+}
+
+bool
+cn_tree_pin_reserve(struct cn_tree *tree, uint level, size_t len)
+{
+    u64 cap = tree->rp->cn_pin_mb << 20;
+
+    assert(level < CN_PIN_LVL_MAX);
+
+    if (atomic64_add_return(len, &tree->ct_pin_bytes) > cap) {
+        atomic64_sub(len, &tree->ct_pin_bytes);
+        return false;
+    }
+
+    atomic64_add(len, &tree->ct_pin_lvlv[level]);
+
+    return true;
+}
+
+void
+cn_tree_pin_release(struct cn_tree *tree, uint level, size_t len)
+{
+    assert(level < CN_PIN_LVL_MAX);
+
+    atomic64_sub(len, &tree->ct_pin_lvlv[level]);
+    atomic64_sub(len, &tree->ct_pin_bytes);
+}
+
+u64
+cn_tree_pinned(const struct cn_tree *tree, uint level)
+{
+    return level < CN_PIN_LVL_MAX ? atomic64_read(&tree->ct_pin_lvlv[level]) : 0;
+}
+
+u32
+cn_tree_fanout_bits(const struct cn_tree *tree)
+{
     return tree->ct_fanout_bits;
 }
 
@@ -1616,6 +3250,43 @@ cn_node_comp_token_put(struct cn_tree_node *tn)
     assert(oldval == 1);
 }
 
+/* Account the bytes read and written by a completed compaction to the
+ * cn's amplification counters.
+ */
+static void
+cn_comp_amp(struct cn_compaction_work *w)
+{
+    const struct cn_merge_stats *ms = &w->cw_stats;
+    struct perfc_set *           pc;
+    u32                          cidx;
+
+    switch (w->cw_action) {
+        case CN_ACTION_COMPACT_K:
+            cidx = PERFC_RA_CNAMP_KCOMPACT;
+            break;
+        case CN_ACTION_COMPACT_KV:
+            cidx = PERFC_RA_CNAMP_KVCOMPACT;
+            break;
+        case CN_ACTION_SPILL:
+            cidx = PERFC_RA_CNAMP_SPILL;
+            break;
+        default:
+            return;
+    }
+
+    pc = cn_get_amp_perfc(w->cw_tree->cn);
+
+    perfc_add(
+        pc,
+        cidx,
+        ms->ms_kblk_write.op_size + ms->ms_kblk_write_async.op_size + ms->ms_vblk_write.op_size +
+            ms->ms_vblk_write_async.op_size);
+    perfc_add(
+        pc,
+        PERFC_RA_CNAMP_RBYTES,
+        ms->ms_kblk_read.op_size + ms->ms_vblk_read1.op_size + ms->ms_vblk_read2.op_size);
+}
+
 static void
 cn_comp_release(struct cn_compaction_work *w)
 {
@@ -1654,6 +3325,9 @@ cn_comp_release(struct cn_compaction_work *w)
 
     perfc_inc(w->cw_pc, PERFC_BA_CNCOMP_FINISH);
 
+    if (!w->cw_err)
+        cn_comp_amp(w);
+
     if (ev(w->cw_bonus))
         atomic_dec(w->cw_bonus);
     w->cw_bonus = NULL;
@@ -1825,9 +3499,12 @@ cn_tree_capped_compact(struct cn_tree *tree)
     /* Step 3: Remove retired kvsets from node list.
      */
     rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
     list_trim(&retired, head, &mark->le_link);
+    cn_node_kvsnap_publish(node);
     cn_tree_samp_update_compact(tree, node);
     rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
 
     /* Step 4: Delete retired kvsets outside the tree write lock.
      */
@@ -1850,6 +3527,7 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
     bool *                   drop_tombs = 0;
     struct kvset_mblocks *   outs = 0;
     struct kvset_vblk_map    vbm = {};
+    bool *                   gcv = 0;
     bool                     oldest;
     struct workqueue_struct *vra_wq;
 
@@ -1860,6 +3538,12 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
     if (w->cw_action < CN_ACTION_SPILL)
         n_outs = 1;
 
+    /* The arena is virtual memory that is populated only as needed, and
+     * is returned to the cheap pool when the compaction completes.
+     */
+    w->cw_arena = cheap_create(SMP_CACHE_BYTES, CN_COMPACT_ARENA_SZ);
+    ev(!w->cw_arena);
+
     ins = calloc(w->cw_kvset_cnt, sizeof(*ins));
     outs = calloc(n_outs, sizeof(*outs));
     drop_tombs = calloc(n_outs, sizeof(*drop_tombs));
@@ -1896,7 +3580,7 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
         kvset_get_ref(le->le_kvset);
 
         err = kvset_iter_create(
-            le->le_kvset, w->cw_io_workq, vra_wq, w->cw_pc, w->cw_iter_flags, iter);
+            le->le_kvset, w->cw_io_workq, vra_wq, w->cw_pc, w->cw_arena, w->cw_iter_flags, iter);
         if (ev(err)) {
             kvset_put_ref(le->le_kvset);
             goto err_exit;
@@ -1909,7 +3593,22 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
      * vbm_blkv[n] is the id of the last vblock of the oldest kvset
      */
     if (w->cw_action == CN_ACTION_COMPACT_K) {
-        err = kvset_keep_vblocks(&vbm, ins, w->cw_kvset_cnt);
+
+        /* Value gc: leave out the vblocks of the kvsets with the most
+         * garbage, the compaction rewrites their referenced values.
+         */
+        if (w->cw_vgc_pct > 0) {
+            gcv = calloc(w->cw_kvset_cnt, sizeof(*gcv));
+            if (ev(!gcv)) {
+                err = merr(ENOMEM);
+                goto err_exit;
+            }
+
+            for (i = 0; i < w->cw_kvset_cnt; i++)
+                gcv[i] = kvset_get_vgarb_pct(kvset_from_iter(ins[i])) >= w->cw_vgc_pct;
+        }
+
+        err = kvset_keep_vblocks(&vbm, ins, w->cw_kvset_cnt, gcv);
         if (ev(err))
             goto err_exit;
     }
@@ -1934,6 +3633,12 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
             drop_tombs[i] = node->tn_childv[i] == NULL;
     }
 
+    if (n_outs > 1 && w->cw_tree->ct_range) {
+        err = cn_split_get(w, n_outs);
+        if (ev(err))
+            goto err_exit;
+    }
+
     /*
      * set work struct outputs
      */
@@ -1951,8 +3656,21 @@ cn_tree_prepare_compaction(struct cn_compaction_work *w)
             bits = CN_KHASHMAP_SHIFT;
 
         w->cw_hash_shift = bits * node->tn_loc.node_level;
+
+        /* Checkpoint spills from below the root, root spills are
+         * small and must stay ordered with ingests.
+         */
+        if (node->tn_parent && w->cw_tree->ct_tstate && !cn_is_capped(w->cw_tree->cn))
+            w->cw_ckpt_sz = (u64)w->cw_rp->cn_compact_ckpt_mb << 20;
+
+        if (node->tn_ckpt && node->tn_ckpt->nc_dgen_lo == w->cw_dgen_lo) {
+            assert(node->tn_ckpt->nc_dgen_hi == w->cw_dgen_hi);
+            w->cw_resume = node->tn_ckpt;
+        }
     }
 
+    free(gcv);
+
     return 0;
 
 err_exit:
@@ -1963,9 +3681,13 @@ err_exit:
         free(ins);
         free(vbm.vbm_blkv);
     }
+    free(gcv);
     free(drop_tombs);
     free(outs);
 
+    cheap_destroy(w->cw_arena);
+    w->cw_arena = NULL;
+
     return err;
 }
 
@@ -1995,6 +3717,39 @@ cn_kv_cmp(const void *a_blob, const void *b_blob)
     return key_obj_cmp(&a->kobj, &b->kobj);
 }
 
+/* cn_kv_cmp() of the keys of a kvs with fixed length keys (see kfixed).
+ */
+static int
+cn_kv_cmp8(const void *a_blob, const void *b_blob)
+{
+    const struct cn_kv_item *a = a_blob;
+    const struct cn_kv_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 8);
+}
+
+static int
+cn_kv_cmp16(const void *a_blob, const void *b_blob)
+{
+    const struct cn_kv_item *a = a_blob;
+    const struct cn_kv_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 16);
+}
+
+static loser_tree_compare_fn *
+cn_kv_cmp_select(struct cn *cn)
+{
+    switch (cn_cflags_kfixed(cn_get_flags(cn))) {
+    case 8:
+        return cn_kv_cmp8;
+    case 16:
+        return cn_kv_cmp16;
+    default:
+        return cn_kv_cmp;
+    }
+}
+
 /*
  * Max heap comparator with a caveat: A ptomb sorts before all keys w/ matching
  * prefix.
@@ -2004,6 +3759,18 @@ cn_kv_cmp(const void *a_blob, const void *b_blob)
  *   > 0 : a_blob < b_blob
  *  == 0 : a_blob == b_blob
  */
+/*
+ * Prefix of an item's key for forward cursors.  There is none for reverse
+ * cursors, whose comparator does not order ptombs by key alone.
+ */
+static u64
+cn_kv_pfx(const void *blob)
+{
+    const struct cn_kv_item *item = blob;
+
+    return key_obj_pfx64(&item->kobj);
+}
+
 static int
 cn_kv_cmp_rev(const void *a_blob, const void *b_blob)
 {
@@ -2037,58 +3804,121 @@ kvstart_put_ref(void *arg)
 {
     struct kvstarts *s = arg;
 
-    assert(s->view.kvset);
-
-    kvset_put_ref(s->view.kvset);
+    /* The reference was handed off to an iterator. */
+    if (s->view.kvset)
+        kvset_put_ref(s->view.kvset);
 }
 
 merr_t
 cn_tree_cursor_active_kvsets(struct pscan *cur, u32 *active, u32 *total)
 {
-    *active = bin_heap2_width(cur->bh);
+    *active = loser_tree_width(cur->lt);
     *total = cur->iterc;
     return 0;
 }
 
-merr_t
-cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
+/*
+ * Take the iterator over kvset ks out of oldv[], if the cursor's previous
+ * view had one.  Both views list their kvsets in the same order, so each
+ * search starts where the previous one left off.
+ */
+static struct kv_iterator *
+cn_tree_cursor_reuse(struct kv_iterator **oldv, uint oldc, struct kvset *ks, uint *hint)
+{
+    uint i, j;
+
+    for (i = 0; i < oldc; ++i) {
+        struct kv_iterator *p;
+
+        j = (*hint + i) % oldc;
+        p = oldv[j];
+
+        if (p && kvset_from_iter(p) == ks) {
+            oldv[j] = NULL;
+            *hint = j + 1;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/* Return true if the subtree of a node of a range tree may have keys with
+ * the cursor's prefix, i.e., if each node on the way up to the root is
+ * among the children of its parent whose key ranges overlap the prefix.
+ */
+static bool
+cn_tree_range_overlap(struct cn_tree *tree, struct cn_tree_node *node, const struct pscan *cur)
+{
+    struct key_obj pfx;
+
+    if (!cur->pfx_len)
+        return true;
+
+    key2kobj(&pfx, cur->pfx, cur->pfx_len);
+
+    for (; node->tn_parent; node = node->tn_parent) {
+        struct cn_tree_node *  parent = node->tn_parent;
+        const struct cn_split *split = parent->tn_split;
+        uint                   child, first, last, pfx_len;
+
+        child = node->tn_loc.node_offset & tree->ct_fanout_mask;
+        pfx_len = parent->tn_pfx_spill ? tree->ct_pfx_len : 0;
+
+        first = cn_split_child(split, pfx_len, &pfx);
+        last = first;
+
+        /* Unless the parent spills on a prefix no longer than the
+         * cursor's, the keys with the cursor's prefix run up to the
+         * last splitter that some of them are not less than.
+         */
+        if (split && (!pfx_len || pfx_len > cur->pfx_len)) {
+            while (last < split->cs_splitc) {
+                struct key_obj s = split->cs_splitv[last];
+
+                cn_split_trunc(&s, cur->pfx_len);
+                if (key_obj_cmp(&s, &pfx) > 0)
+                    break;
+                last++;
+            }
+        }
+
+        if (child < first || child > last)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Take the list of kvsets on the cursor's route.  The walk follows the
+ * same rules as cn_tree_lookup().
+ *
+ * Dgen must follow a strict ordering:
+ * 1. within node, strictly decrease L->R.
+ * 2. Within tree, strictly decrease top->bottom.
+ * 3. Children must be less than least kvset in parent.
+ * 4. Siblings may be relatively unordered, but must
+ *    obey the tree rules.
+ *
+ * If a violation is found, assume a spill finished during
+ * this walk.  If so, the next attempt should succeed.
+ */
+static merr_t
+cn_tree_cview_create(struct cn_tree *tree, struct pscan *cur, bool pfx, struct cn_cview **cvp)
 {
     u64                      tdgenv[32];
-    struct workqueue_struct *vra_wq;
     struct cn_tree_node *    node;
     struct cn_khashmap *     khashmap;
     struct kvset_list_entry *le;
-    void *                   lock;
-    struct table *           view;
     struct tree_iter         iter, *iterp;
-    struct kv_iterator **    kv_iter;
-    struct element_source ** esrc;
-    uint                     iterc;
-    uint                     shift;
-    enum kvset_iter_flags    flags;
-
-    merr_t err = 0;
-    int    i;
-
-    assert(cur->iterc == 0);
-    iterp = NULL;
-    iterc = 0;
-
-    /* [HSE_REVISIT] Replace the following code to create table view with
-     * cn_tree_view_create().
-     */
+    struct cn_cview *        cv;
+    struct table *           view;
+    void *                   lock;
+    uint                     shift, i, n;
+    u64                      gen, dgen_max;
+    merr_t                   err = 0;
 
-    /*
-     * Dgen must follow a strict ordering:
-     * 1. within node, strictly decrease L->R.
-     * 2. Within tree, strictly decrease top->bottom.
-     * 3. Children must be less than least kvset in parent.
-     * 4. Siblings may be relatively unordered, but must
-     *    obey the tree rules.
-     *
-     * If a violation is found, assume a spill finished during
-     * this create.  If so, the next attempt should succeed.
-     */
     if (ev(tree->ct_depth_max > NELEM(tdgenv) - 1)) {
         assert(tree->ct_depth_max < NELEM(tdgenv));
         return merr(EINVAL);
@@ -2098,20 +3928,6 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
     if (ev(!view))
         return merr(ENOMEM);
 
-    /*
-     * find all the kvsets, and collect in a table:
-     * the root node in particular may have hundreds of kvsets
-     * but no child node should be much larger than 8 kvsets
-     * and the depth is typically 3 for a large (>32g key) database.
-     *
-     * We must collect these pointers first, since we
-     * need to police the set prior to creating iterators
-     * and bin_heap_create requires a vector + len.
-     *
-     * The logic for descending the tree is similar to the logic
-     * cn_tree_lookup().
-     */
-
     /*
      * Use the ingest dgen for tree traversal correctness.
      * But due to the race where ingest_dgen is updated before
@@ -2119,28 +3935,42 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
      * must be set to the best dgen encountered in the tree.
      * See the note above on dgen rules.
      */
-
+    iterp = NULL;
     node = tree->ct_root;
     khashmap = cn_tree_get_khashmap(tree);
     tdgenv[0] = cn_get_ingest_dgen(cur->cn);
-    cur->dgen = 0;
+    dgen_max = 0;
     shift = khashmap ? CN_KHASHMAP_SHIFT : cur->shift;
 
 #define dgen_at(_idx) (tdgenv[1 + _idx])
 
     rmlock_rlock(&tree->ct_lock, &lock);
+    gen = atomic64_read(&tree->ct_view_gen);
+
+    /* A range tree is walked in full, but only the subtrees whose key
+     * ranges overlap the cursor's prefix contribute kvsets.
+     */
+    if (tree->ct_range) {
+        iterp = &iter;
+        tree_iter_init(tree, iterp, TRAVERSE_TOPDOWN);
+        node = tree_iter_next(tree, iterp);
+    }
+
     while (node) {
 
         /* recover least dgen of parent when entering a node */
         u32 level = node->tn_loc.node_level;
         u64 dgen = dgen_at(level - 1);
 
+        if (tree->ct_range && !cn_tree_range_overlap(tree, node, cur)) {
+            node = tree_iter_next(tree, iterp);
+            continue;
+        }
+
         list_for_each_entry (le, &node->tn_kvset_list, le_link) {
             struct kvset *   kvset = le->le_kvset;
             struct kvstarts *s;
             u64              x;
-            int              start;
-            int              pt_start;
 
             x = kvset_get_dgen(kvset);
             if (ev(x > dgen)) {
@@ -2148,18 +3978,8 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
                 err = merr(EAGAIN);
                 break;
             }
-            if (x > cur->dgen)
-                cur->dgen = x;
-
-            /* determine if this kvset participates.
-             * If prefixed tree, check if kvset has ptombs.
-             */
-            pt_start = kvset_pt_start(kvset);
-
-            /* check if key lies within this kvset's range */
-            start = kvset_kblk_start(kvset, cur->pfx, -cur->pfx_len, cur->reverse);
-            if (start < 0 && pt_start < 0)
-                continue;
+            if (x > dgen_max)
+                dgen_max = x;
 
             s = table_append(view);
             if (ev(!s)) {
@@ -2170,12 +3990,8 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
             kvset_get_ref(kvset);
             s->view.kvset = kvset;
             s->view.node_loc = node->tn_loc;
-            s->start = start;
-            s->pt_start = pt_start;
 
             dgen = x;
-
-            ++iterc;
         }
 
         if (unlikely(err)) {
@@ -2202,7 +4018,7 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
         if (iterp) {
             /* in region of tree that spills on hash of full key */
             node = tree_iter_next(tree, iterp);
-        } else if (node->tn_pfx_spill && cur->pfx_len >= cur->ct_pfx_len) {
+        } else if (node->tn_pfx_spill && pfx) {
             uint child;
 
             /* descend by prefix hash */
@@ -2224,6 +4040,189 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
 
 #undef dgen_at
 
+    n = table_len(view);
+
+    cv = malloc(sizeof(*cv) + n * sizeof(cv->cv_kvsetv[0]));
+    if (ev(!cv)) {
+        err = merr(ENOMEM);
+        goto errout;
+    }
+
+    atomic_set(&cv->cv_ref, 1);
+    cv->cv_gen = gen;
+    cv->cv_route = pfx ? cur->pfxhash : 0;
+    cv->cv_pfx = pfx;
+    cv->cv_dgen = dgen_max;
+    cv->cv_kvsetc = n;
+
+    for (i = 0; i < n; ++i) {
+        struct kvstarts *s = table_at(view, i);
+
+        cv->cv_kvsetv[i] = s->view;
+    }
+
+    vtc_free(view);
+
+    *cvp = cv;
+
+    return 0;
+
+errout:
+    table_apply(view, kvstart_put_ref);
+    vtc_free(view);
+
+    return err;
+}
+
+/*
+ * Get the shared view of the cursor's route, taking (and caching) a new
+ * one if the tree changed since the cached one was taken.  Cursors with
+ * a prefix at least as long as the tree's descend by prefix hash, all
+ * others walk the whole tree.  In a range tree, the route of a cursor
+ * with any prefix is that of its whole prefix (see cn_cursor_create()).
+ */
+static merr_t
+cn_tree_cview_get(struct cn_tree *tree, struct pscan *cur, struct cn_cview **cvp)
+{
+    struct cn_cview_cache *cc = &tree->ct_cview;
+    struct cn_cview *      cv, *old = NULL;
+    bool                   pfx;
+    u64                    route;
+    uint                   slot;
+    merr_t                 err;
+
+    pfx = cur->ct_pfx_len > 0 && cur->pfx_len >= cur->ct_pfx_len;
+    if (tree->ct_range)
+        pfx = cur->pfx_len > 0;
+    route = pfx ? cur->pfxhash : 0;
+    slot = route % CN_CVIEW_SLOTS;
+
+    spin_lock(&cc->cc_lock);
+    cv = cc->cc_viewv[slot];
+    if (cv && cv->cv_gen == atomic64_read(&tree->ct_view_gen) && cv->cv_pfx == pfx &&
+        cv->cv_route == route)
+        atomic_inc(&cv->cv_ref);
+    else
+        cv = NULL;
+    spin_unlock(&cc->cc_lock);
+
+    if (cv) {
+        *cvp = cv;
+        return 0;
+    }
+
+    err = cn_tree_cview_create(tree, cur, pfx, &cv);
+    if (err)
+        return err;
+
+    /* Cache the view unless the tree changed while it was taken. */
+    spin_lock(&cc->cc_lock);
+    if (cv->cv_gen == atomic64_read(&tree->ct_view_gen)) {
+        old = cc->cc_viewv[slot];
+        cc->cc_viewv[slot] = cv;
+        atomic_inc(&cv->cv_ref);
+    }
+    spin_unlock(&cc->cc_lock);
+
+    cn_tree_cview_put(old);
+
+    *cvp = cv;
+
+    return 0;
+}
+
+/*
+ * Build the cursor's view of the tree.  Iterators in oldv[] over kvsets that
+ * are still in the view are moved to the new view as is (the kvs layer seeks
+ * the cursor after an update), the caller releases those left in oldv[].
+ */
+static merr_t
+cn_tree_cursor_build(
+    struct pscan *       cur,
+    struct cn_tree *     tree,
+    struct kv_iterator **oldv,
+    uint                 oldc)
+{
+    struct workqueue_struct *vra_wq, *io_wq;
+    struct cn_cview *        cv;
+    struct table *           view;
+    struct kv_iterator **    kv_iter;
+    struct element_source ** esrc;
+    uint                     iterc;
+    uint                     hint, reused;
+    enum kvset_iter_flags    flags;
+
+    merr_t err = 0;
+    int    i;
+
+    assert(cur->iterc == 0);
+    iterc = 0;
+    cur->seqno_skip = U64_MAX;
+
+    /* The kvsets on the cursor's route come from a view shared by all
+     * the cursors on that route, the tree is only walked if it changed
+     * since the view was taken.
+     */
+    err = cn_tree_cview_get(tree, cur, &cv);
+    if (ev(err))
+        return err;
+
+    view = vtc_alloc();
+    if (ev(!view)) {
+        cn_tree_cview_put(cv);
+        return merr(ENOMEM);
+    }
+
+    cur->dgen = cv->cv_dgen;
+
+    for (i = 0; i < cv->cv_kvsetc; ++i) {
+        struct kvset *   kvset = cv->cv_kvsetv[i].kvset;
+        struct kvstarts *s;
+        int              start;
+        int              pt_start;
+        u64              seqmin;
+
+        /* A kvset whose entries are all newer than the view contributes
+         * nothing to the cursor.  A capped cursor's update relies on its
+         * iterators covering every kvset, so it keeps them all.
+         */
+        seqmin = kvset_get_seqno_min(kvset);
+        if (seqmin > cur->seqno && !cn_is_capped(cur->cn)) {
+            cur->seqno_skip = min_t(u64, cur->seqno_skip, seqmin);
+            continue;
+        }
+
+        /* determine if this kvset participates.
+         * If prefixed tree, check if kvset has ptombs.
+         */
+        pt_start = kvset_pt_start(kvset);
+
+        /* check if key lies within this kvset's range */
+        start = kvset_kblk_start(kvset, cur->pfx, -cur->pfx_len, cur->reverse);
+        if (start >= 0 && !kvset_pfx_may_exist(kvset, cur->pfx, cur->pfx_len))
+            start = KVSET_MISS_KEY_TOO_SMALL;
+        if (start < 0 && pt_start < 0)
+            continue;
+
+        s = table_append(view);
+        if (ev(!s)) {
+            err = merr(ENOMEM);
+            break;
+        }
+
+        kvset_get_ref(kvset);
+        s->view = cv->cv_kvsetv[i];
+        s->start = start;
+        s->pt_start = pt_start;
+
+        ++iterc;
+    }
+
+    cn_tree_cview_put(cv);
+
+    if (err)
+        goto errout;
+
     /* if nothing found, no further work needed; set eof and return */
     if (iterc == 0) {
         vtc_free(view);
@@ -2251,17 +4250,39 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
     flags = kvset_iter_flag_mcache;
     if (cur->reverse)
         flags |= kvset_iter_flag_reverse;
+    if (cur->keys_only)
+        flags |= kvset_iter_flag_keys_only;
+    if (tree->rp->cn_cursor_noreuse)
+        flags |= kvset_iter_flag_noreuse;
     vra_wq = cn_get_maint_wq(cur->cn);
 
+    /* A direct cursor reads mblocks into private buffers rather than
+     * faulting in the page cache through mcache maps.
+     */
+    io_wq = NULL;
+    if (cur->direct) {
+        flags &= ~kvset_iter_flag_mcache;
+        io_wq = cn_get_io_wq(cur->cn);
+    }
+
     kv_iter = cur->iterv;
     esrc = cur->esrcv;
+    hint = reused = 0;
 
     for (i = 0; i < iterc; ++i) {
         struct kvstarts *   s = table_at(view, i);
         struct kv_iterator *p;
         struct kvset *      ks = s->view.kvset;
 
-        err = kvset_iter_create(ks, NULL, vra_wq, NULL, flags, &p);
+        p = cn_tree_cursor_reuse(oldv, oldc, ks, &hint);
+        if (p) {
+            kvset_put_ref(ks);
+            s->view.kvset = NULL;
+            ++reused;
+            goto next;
+        }
+
+        err = kvset_iter_create(ks, io_wq, vra_wq, NULL, NULL, flags, &p);
         if (ev(err))
             goto errout;
 
@@ -2282,17 +4303,32 @@ cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
             goto errout;
         }
 
+    next:
         *kv_iter++ = p;
         *esrc++ = &p->kvi_es;
 
         ++cur->iterc;
     }
 
-    err = bin_heap2_create(cur->iterc, cur->reverse ? cn_kv_cmp_rev : cn_kv_cmp, &cur->bh);
+    if (oldc > 0) {
+        struct perfc_set *pc = cn_pc_capped_get(cur->cn);
+
+        perfc_add(pc, PERFC_BA_CNCAPPED_OLD, reused);
+        perfc_add(pc, PERFC_BA_CNCAPPED_NEW, iterc - reused);
+    }
+
+    err = loser_tree_create(
+        cur->iterc,
+        cur->reverse ? cn_kv_cmp_rev : cn_kv_cmp_select(cur->cn),
+        cur->reverse ? NULL : cn_kv_pfx,
+        &cur->lt);
     if (ev(err))
         goto errout;
 
-    err = bin_heap2_prepare(cur->bh, cur->iterc, cur->esrcv);
+    cur->ltmax = cur->iterc;
+    cur->capped_skip = 0;
+
+    err = loser_tree_prepare(cur->lt, cur->iterc, cur->esrcv);
     if (ev(err))
         goto errout;
 
@@ -2310,10 +4346,16 @@ errout:
     return err;
 }
 
+merr_t
+cn_tree_cursor_create(struct pscan *cur, struct cn_tree *tree)
+{
+    return cn_tree_cursor_build(cur, tree, NULL, 0);
+}
+
 static merr_t
 cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
 {
-    struct workqueue_struct *vra_wq;
+    struct workqueue_struct *vra_wq, *io_wq;
     struct cn_tree_node *    node;
     struct kvset_list_entry *le;
     enum kvset_iter_flags    flags;
@@ -2334,8 +4376,6 @@ cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
         return 0;
     }
 
-    bin_heap2_destroy(cur->bh);
-    cur->bh = NULL;
     cur->eof = 0;
 
     old_cnt = new_cnt = 0;
@@ -2389,10 +4429,14 @@ cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
         kvset_iterv_release(cur->iterc - old_cnt, &cur->iterv[old_cnt], cn_get_maint_wq(cur->cn));
 
         memset(cur->iterv + old_cnt, 0, (cur->iterc - old_cnt) * sizeof(cur->iterv[0]));
+
+        /* The retired kvsets are the oldest, those skipped first. */
+        cur->capped_skip -= min_t(u32, cur->capped_skip, cur->iterc - old_cnt);
     }
 
     if (!iterc) {
         cur->iterc = iterc;
+        cur->capped_skip = 0;
         vtc_free(view);
         cur->eof = 1;
         return 0; /* no kvsets in cn */
@@ -2441,8 +4485,21 @@ cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
     flags = kvset_iter_flag_mcache;
     if (cur->reverse)
         flags |= kvset_iter_flag_reverse;
+    if (cur->keys_only)
+        flags |= kvset_iter_flag_keys_only;
+    if (tree->rp->cn_cursor_noreuse)
+        flags |= kvset_iter_flag_noreuse;
     vra_wq = cn_get_maint_wq(cur->cn);
 
+    /* A direct cursor reads mblocks into private buffers rather than
+     * faulting in the page cache through mcache maps.
+     */
+    io_wq = NULL;
+    if (cur->direct) {
+        flags &= ~kvset_iter_flag_mcache;
+        io_wq = cn_get_io_wq(cur->cn);
+    }
+
     /* Create iterators for the new kvsets.
      */
     for (i = 0; i < new_cnt; i++) {
@@ -2450,7 +4507,7 @@ cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
         struct kv_iterator *iter;
         struct kvset *      ks = s->view.kvset;
 
-        err = kvset_iter_create(ks, NULL, vra_wq, NULL, flags, &iter);
+        err = kvset_iter_create(ks, io_wq, vra_wq, NULL, NULL, flags, &iter);
         if (ev(err))
             break;
 
@@ -2488,11 +4545,22 @@ cn_tree_capped_cursor_update(struct pscan *cur, struct cn_tree *tree)
 
 done:
     cur->iterc = iterc;
-    err = bin_heap2_create(cur->iterc, cn_kv_cmp, &cur->bh);
-    if (ev(err))
-        goto errout;
 
-    err = bin_heap2_prepare(cur->bh, cur->iterc, cur->esrcv);
+    /* Reuse the loser tree unless the iterators outgrew it, so that an
+     * update costs only as much as the kvsets that came and went.
+     */
+    if (!cur->lt || cur->ltmax < cur->iterc) {
+        loser_tree_destroy(cur->lt);
+        cur->lt = NULL;
+
+        err = loser_tree_create(cur->itermax, cn_kv_cmp_select(cur->cn), cn_kv_pfx, &cur->lt);
+        if (ev(err))
+            goto errout;
+
+        cur->ltmax = cur->itermax;
+    }
+
+    err = loser_tree_prepare(cur->lt, cur->iterc - cur->capped_skip, cur->esrcv);
     if (ev(err))
         goto errout;
 
@@ -2513,6 +4581,10 @@ errout:
 merr_t
 cn_tree_cursor_update(struct pscan *cur, struct cn_tree *tree)
 {
+    struct kv_iterator **oldv;
+    uint                 oldc, i, n;
+    merr_t               err;
+
     if (cur->pt_set) {
         uint len;
 
@@ -2527,17 +4599,42 @@ cn_tree_cursor_update(struct pscan *cur, struct cn_tree *tree)
     if (ev(cn_is_capped(cur->cn) && !cur->reverse))
         return cn_tree_capped_cursor_update(cur, tree);
 
-    kvset_iterv_release(cur->iterc, cur->iterv, cn_get_maint_wq(cur->cn));
-    bin_heap2_destroy(cur->bh);
+    /* Set aside the current iterators so that the rebuilt view can keep
+     * those of the kvsets that did not change.  If that isn't possible
+     * simply rebuild the view from scratch.
+     */
+    oldc = cur->iterc;
+    oldv = oldc > 0 ? malloc(oldc * sizeof(*oldv)) : NULL;
+    if (oldv) {
+        memcpy(oldv, cur->iterv, oldc * sizeof(*oldv));
+    } else {
+        kvset_iterv_release(cur->iterc, cur->iterv, cn_get_maint_wq(cur->cn));
+        oldc = 0;
+    }
+
+    loser_tree_destroy(cur->lt);
 
     /* Note that we intentionally preserve the iterv and esrcv
-     * buffers for reuse by cn_tree_cursor_create().
+     * buffers for reuse by cn_tree_cursor_build().
      */
     cur->iterc = 0;
-    cur->bh = NULL;
+    cur->lt = NULL;
     cur->eof = 0;
 
-    return cn_tree_cursor_create(cur, tree);
+    err = cn_tree_cursor_build(cur, tree, oldv, oldc);
+
+    /* Release the iterators of the kvsets that left the view. */
+    for (i = n = 0; i < oldc; ++i) {
+        if (oldv[i])
+            oldv[n++] = oldv[i];
+    }
+
+    if (n > 0)
+        kvset_iterv_release(n, oldv, cn_get_maint_wq(cur->cn));
+
+    free(oldv);
+
+    return err;
 }
 
 /* cn_tree_cursor_destroy() doesn't really destroy the cursor object,
@@ -2547,8 +4644,8 @@ void
 cn_tree_cursor_destroy(struct pscan *cur)
 {
     kvset_iterv_release(cur->iterc, cur->iterv, cn_get_maint_wq(cur->cn));
-    bin_heap2_destroy(cur->bh);
-    cur->bh = 0;
+    loser_tree_destroy(cur->lt);
+    cur->lt = 0;
 
     free(cur->iterv);
     free(cur->esrcv);
@@ -2566,7 +4663,7 @@ drop_dups(struct pscan *cur, struct cn_kv_item *item)
 {
     struct cn_kv_item *dup;
 
-    while (bin_heap2_peek(cur->bh, (void **)&dup)) {
+    while (loser_tree_peek(cur->lt, (void **)&dup)) {
 
         if (key_obj_cmp(&dup->kobj, &item->kobj))
             return;
@@ -2577,8 +4674,57 @@ drop_dups(struct pscan *cur, struct cn_kv_item *item)
         if (dup->vctx.is_ptomb)
             return;
 
-        bin_heap2_pop(cur->bh, (void **)&dup);
+        loser_tree_pop(cur->lt, (void **)&dup);
+    }
+}
+
+/*
+ * Move every source older than the ptomb's source past the ptomb's prefix in
+ * one step.  The ptomb hides all keys with its prefix in older kvsets, so
+ * there is no need to pop and compare them one by one.  Sources whose current
+ * key lies outside the prefix are left alone.
+ */
+static merr_t
+cn_tree_cursor_pt_skip(struct pscan *cur, struct cn_kv_item *pt)
+{
+    struct loser_tree *lt = cur->lt;
+    unsigned char      key[HSE_KVS_MAX_PFXLEN];
+    uint               klen;
+    u32                i, n;
+
+    key_obj_copy(key, sizeof(key), &klen, &pt->kobj);
+
+    /* The least key greater than every key with the prefix. */
+    while (klen > 0 && key[klen - 1] == 0xff)
+        --klen;
+    if (klen > 0)
+        key[klen - 1]++;
+
+    n = 0;
+    for (i = pt->src->es_sort + 1; i < lt->lt_width; ++i) {
+        struct cn_kv_item *dup = lt->lt_leafv[i].ll_data;
+        bool               eof = false;
+        merr_t             err;
+
+        if (!dup || key_obj_cmp_prefix(&pt->kobj, &dup->kobj))
+            continue;
+
+        if (klen > 0) {
+            err = kvset_iter_seek(cur->iterv[i], key, klen, &eof);
+            if (ev(err))
+                return err;
+        } else {
+            kvset_iter_mark_eof(cur->iterv[i]);
+        }
+
+        loser_tree_refetch(lt, i);
+        ++n;
     }
+
+    if (n > 0)
+        loser_tree_rebuild(lt);
+
+    return 0;
 }
 
 /*
@@ -2629,12 +4775,16 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
     u64                 seq;
     bool                end;
     bool                is_tomb;
+    enum kmd_vtype      vtype;
+    u32                 vbidx, vboff;
+    const void *        kdata;
     const void *        vdata;
-    uint                vlen;
+    uint                vlen, complen = 0;
     uint                klen;
     int                 rc;
     struct kv_iterator *kv_iter = 0;
     struct key_obj      filter_ko = { 0 };
+    u64                 ttl_seq;
 
     if (ev(cur->merr))
         return cur->merr;
@@ -2644,23 +4794,27 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
         return 0;
     }
 
+    ttl_seq = cn_tree_ttl_seq(cn_get_tree(cur->cn));
+
     if (unlikely(cur->filter))
         key2kobj(&filter_ko, cur->filter->kcf_maxkey, cur->filter->kcf_maxklen);
 
+again:
     do {
+        kdata = NULL;
 
-        if (!bin_heap2_peek(cur->bh, (void **)&popme)) {
+        if (!loser_tree_peek(cur->lt, (void **)&popme)) {
             *eof = (cur->eof = 1);
             return 0;
         }
 
-        /* copy out bh item before bin_heap2_pop() overwrites its
+        /* copy out the item before loser_tree_pop() overwrites its
          * element (*popme).
          */
         item = *popme;
         is_tomb = item.vctx.is_ptomb;
 
-        bin_heap2_pop(cur->bh, (void **)&popme);
+        loser_tree_pop(cur->lt, (void **)&popme);
 
         rc = cur_item_cmp(cur, &item);
         if (rc > 0) {
@@ -2682,25 +4836,35 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
         end = false;
 
         do {
-            enum kmd_vtype vtype;
-            u32            vbidx;
-            u32            vboff;
-
             if (!kvset_iter_next_vref(
-                    kv_iter, &item.vctx, &seq, &vtype, &vbidx, &vboff, &vdata, &vlen)) {
+                    kv_iter, &item.vctx, &seq, &vtype, &vbidx, &vboff, &vdata, &vlen, &complen)) {
                 end = true;
                 break;
             }
-
-            cur->merr =
-                kvset_iter_next_val(kv_iter, &item.vctx, vtype, vbidx, vboff, &vdata, &vlen);
-            if (ev(cur->merr))
-                return cur->merr;
-
         } while (seq > cur->seqno);
         if (end)
             continue;
 
+        /* Run the key predicate before the value is read, so that
+         * rejected keys never fault in their vblock pages.  Rejecting
+         * a key hides its older values just as returning it would.
+         */
+        if (unlikely(cur->pred_key) && vtype != vtype_tomb && vtype != vtype_ptomb &&
+            seq > ttl_seq) {
+            kdata = key_obj_copy(cur->buf, cur->bufsz, &klen, &item.kobj);
+
+            if (!cur->pred_key(cur->pred_arg, kdata, klen, NULL, vlen)) {
+                drop_dups(cur, &item);
+                end = true;
+                continue;
+            }
+        }
+
+        cur->merr =
+            kvset_iter_next_val(kv_iter, &item.vctx, vtype, vbidx, vboff, &vdata, &vlen, complen);
+        if (ev(cur->merr))
+            return cur->merr;
+
         if (HSE_CORE_IS_PTOMB(vdata) &&
             (!cur->pt_set || key_obj_cmp(&cur->pt_kobj, &item.kobj) != 0)) {
             /* only store ptomb w/ highest seqno (less than cur's
@@ -2712,16 +4876,22 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
             cur->pt_kobj = item.kobj;
             cur->pt_seq = seq;
 
-            /* [HSE_REVISIT]
-             * if ptomb, move all srcs > item->src past pfx only if
-             * ptomb was NOT from the spread region.
-             */
+            if (!cur->reverse) {
+                cur->merr = cn_tree_cursor_pt_skip(cur, &item);
+                if (ev(cur->merr))
+                    return cur->merr;
+            }
         }
 
         /* A kvset can have a matching key and ptomb such that the key
          * is newer than ptomb. So drop dups only if regular tomb.
          */
         is_tomb = HSE_CORE_IS_TOMB(vdata) && !HSE_CORE_IS_PTOMB(vdata);
+
+        /* An expired value hides its key as would a tombstone. */
+        if (!is_tomb && !HSE_CORE_IS_PTOMB(vdata) && seq <= ttl_seq)
+            is_tomb = true;
+
         if (is_tomb)
             drop_dups(cur, &item);
 
@@ -2740,11 +4910,43 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
     assert(!HSE_CORE_IS_TOMB(vdata));
 
     /* copyout before drop dups! */
-    kvt->kvt_key.kt_data = key_obj_copy(cur->buf, cur->bufsz, &klen, &item.kobj);
+    if (!kdata)
+        kdata = key_obj_copy(cur->buf, cur->bufsz, &klen, &item.kobj);
+
+    kvt->kvt_key.kt_data = kdata;
 
     kvt->kvt_key.kt_len = klen;
     kvt->kvt_value.vt_len = vlen;
-    kvt->kvt_value.vt_data = memcpy(cur->buf + kvt->kvt_key.kt_len, vdata, vlen);
+    kvt->kvt_value.vt_data = NULL;
+    if (!cur->keys_only && complen) {
+        void *vbuf = cur->buf + kvt->kvt_key.kt_len;
+        uint  outlen;
+
+        /* The cursor buffer has room for the largest value, so compressed
+         * values are decompressed straight into it.
+         */
+        cur->merr = decompress_lz4(vdata, complen, vbuf, vlen, &outlen);
+        if (ev(cur->merr))
+            return cur->merr;
+
+        if (ev(outlen != vlen))
+            return cur->merr = merr(EILSEQ);
+
+        vdata = vbuf;
+    }
+
+    /* The value predicate sees the value in place, it is copied into
+     * the cursor buffer only if it passes.
+     */
+    if (unlikely(cur->pred_val) && !cur->pred_val(cur->pred_arg, kdata, klen, vdata, vlen)) {
+        drop_dups(cur, &item);
+        goto again;
+    }
+
+    if (!cur->keys_only && complen)
+        kvt->kvt_value.vt_data = (void *)vdata;
+    else if (!cur->keys_only)
+        kvt->kvt_value.vt_data = memcpy(cur->buf + kvt->kvt_key.kt_len, vdata, vlen);
 
     cur->stats.ms_keys_out++;
     cur->stats.ms_key_bytes_out += kvt->kvt_key.kt_len;
@@ -2756,6 +4958,63 @@ cn_tree_cursor_read(struct pscan *cur, struct kvs_kvtuple *kvt, bool *eof)
     return 0;
 }
 
+/* Whether a kvset of a capped cursor holds only keys below @key, such that
+ * a forward read from @key never needs it.  A kvset's max key is also an
+ * upper bound on its ptombs, but a ptomb hides the keys of its prefix,
+ * some of which may be above @key unless the prefix itself is below it.
+ */
+static bool
+cn_tree_capped_below(struct pscan *cur, struct kvset *ks, const void *key, u32 len)
+{
+    const void *maxkey;
+    u16         maxklen;
+    u32         plen;
+
+    kvset_maxkey(ks, &maxkey, &maxklen);
+
+    if (kvset_pt_start(ks) < 0)
+        return keycmp(maxkey, maxklen, key, len) < 0;
+
+    plen = cur->ct_pfx_len;
+
+    return keycmp(maxkey, min_t(u32, maxklen, plen), key, min_t(u32, len, plen)) < 0;
+}
+
+/* Get the number of oldest iterators a forward capped cursor can leave out
+ * of a seek to @key.  The kvsets of a capped kvs are ordered by age and, as
+ * queues append ever larger keys, mostly by key too.  The cursor remembers
+ * the run of oldest kvsets below its last key and only extends it while
+ * seeks move forward, so that a seek costs as much as the kvsets it may
+ * read, not as much as all the kvsets of the kvs.
+ */
+static u32
+cn_tree_capped_skip(struct pscan *cur, const void *key, u32 len)
+{
+    u32 skip = cur->capped_skip;
+
+    if (skip > 0 && keycmp(key, len, cur->capped_key, cur->capped_klen) < 0)
+        skip = 0;
+
+    while (skip < cur->iterc) {
+        struct kvset *ks = kvset_from_iter(cur->iterv[cur->iterc - skip - 1]);
+
+        if (!cn_tree_capped_below(cur, ks, key, len))
+            break;
+
+        ++skip;
+    }
+
+    /* Leave at least the newest iterator in the loser tree. */
+    if (skip == cur->iterc)
+        --skip;
+
+    cur->capped_skip = skip;
+    cur->capped_klen = min_t(u32, len, sizeof(cur->capped_key));
+    memcpy(cur->capped_key, key, cur->capped_klen);
+
+    return skip;
+}
+
 #define handle_to_kvset_iter(_handle) container_of(_handle, struct kvset_iterator, handle)
 
 /*
@@ -2771,6 +5030,7 @@ cn_tree_cursor_seek(
 {
     int               i;
     int               first;
+    u32               skip;
     struct perfc_set *pc = cn_pc_capped_get(cur->cn);
 
     /* A cursor in error cannot be used. */
@@ -2791,9 +5051,13 @@ cn_tree_cursor_seek(
     if (cur->eof)
         cur->eof = 0;
 
+    skip = 0;
+    if (cn_is_capped(cur->cn) && !cur->reverse)
+        skip = cn_tree_capped_skip(cur, key, len);
+
     /* [HSE_REVISIT]: this is parallelizable */
     first = -1; /* first kvset that is not at EOF */
-    for (i = cur->iterc - 1; i >= 0; --i) {
+    for (i = cur->iterc - skip - 1; i >= 0; --i) {
         bool eof = false;
 
         if (cur->filter) {
@@ -2812,8 +5076,24 @@ cn_tree_cursor_seek(
                 kvset_iter_mark_eof(cur->iterv[i]);
                 continue;
             }
+
+            /* Otherwise consult the kblock key ranges and prefix blooms,
+             * unless the kvset has ptombs that may hide older keys.
+             */
+            if (!cur->reverse && kvset_pt_start(ks) < 0 &&
+                !kvset_range_may_exist(ks, key, len, smaxkey, smaxklen)) {
+                kvset_iter_mark_eof(cur->iterv[i]);
+                continue;
+            }
         }
 
+        /* Let the iterator stop short of kblocks beyond the range. */
+        if (cur->filter)
+            kvset_iter_set_limit(
+                cur->iterv[i], cur->filter->kcf_maxkey, cur->filter->kcf_maxklen);
+        else
+            kvset_iter_set_limit(cur->iterv[i], NULL, 0);
+
         cur->merr = kvset_iter_seek(cur->iterv[i], key, len, &eof);
         if (ev(cur->merr))
             return cur->merr;
@@ -2832,8 +5112,8 @@ cn_tree_cursor_seek(
      * If we have a problem here, the cursor becomes invalid,
      * and cannot be reused.  Only recovery is to destroy it.
      */
-    cur->merr = bin_heap2_prepare(cur->bh, cur->iterc, cur->esrcv);
-    perfc_set(pc, PERFC_BA_CNCAPPED_ACTIVE, (10000 * bin_heap2_width(cur->bh)) / cur->iterc);
+    cur->merr = loser_tree_prepare(cur->lt, cur->iterc - skip, cur->esrcv);
+    perfc_set(pc, PERFC_BA_CNCAPPED_ACTIVE, (10000 * loser_tree_width(cur->lt)) / cur->iterc);
 
     /*
      * If asked for what we found, return the key here.
@@ -2846,7 +5126,7 @@ cn_tree_cursor_seek(
         struct cn_kv_item *i = &item;
 
         kt->kt_len = 0;
-        if (bin_heap2_peek(cur->bh, (void **)&i)) {
+        if (loser_tree_peek(cur->lt, (void **)&i)) {
             uint len;
 
             kt->kt_data = key_obj_copy(cur->buf, cur->bufsz, &len, &i->kobj);
@@ -2883,6 +5163,16 @@ cn_tree_cursor_seek(
  *
  */
 
+/* Return true if the vblocks of the input kvset at index @idx (0 is the
+ * newest) are handed to the output kvset rather than deleted.  Value gc
+ * deletes the vblocks whose referenced values it copied.
+ */
+static bool
+cn_comp_keepv(struct cn_compaction_work *w, uint idx)
+{
+    return w->cw_keep_vblks && !(w->cw_vbmap.vbm_gcv && w->cw_vbmap.vbm_gcv[idx]);
+}
+
 /**
  * cn_comp_update_kvcompact() - Update tree after k-compact and kv-compact
  * See section comment for more info.
@@ -2903,6 +5193,7 @@ cn_comp_update_kvcompact(struct cn_compaction_work *work, struct kvset *new_kvse
     assert(work->cw_dgen_lo == kvset_get_workid(work->cw_mark->le_kvset));
 
     rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
     {
         assert(!list_empty(&work->cw_node->tn_kvset_list));
         le = work->cw_mark;
@@ -2915,6 +5206,8 @@ cn_comp_update_kvcompact(struct cn_compaction_work *work, struct kvset *new_kvse
 
         if (new_kvset)
             kvset_list_add(new_kvset, &le->le_link);
+
+        cn_node_kvsnap_publish(work->cw_node);
     }
 
     cn_tree_samp(tree, &work->cw_samp_pre);
@@ -2924,14 +5217,16 @@ cn_comp_update_kvcompact(struct cn_compaction_work *work, struct kvset *new_kvse
     cn_tree_samp(tree, &work->cw_samp_post);
 
     rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
 
-    /* Delete retired kvsets. */
+    /* Delete retired kvsets, which are on the list newest first. */
+    i = 0;
     list_for_each_entry_safe (le, tmp, &retired_kvsets, le_link) {
 
         assert(kvset_get_dgen(le->le_kvset) >= work->cw_dgen_lo);
         assert(kvset_get_dgen(le->le_kvset) <= work->cw_dgen_hi);
 
-        kvset_mark_mblocks_for_delete(le->le_kvset, work->cw_keep_vblks, txid);
+        kvset_mark_mblocks_for_delete(le->le_kvset, cn_comp_keepv(work, i++), txid);
         kvset_put_ref(le->le_kvset);
     }
 }
@@ -2954,7 +5249,9 @@ cn_comp_commit_kvcompact(struct cn_compaction_work *work, struct kvset *kvset)
      */
     le = work->cw_mark;
     for (i = 0; i < work->cw_kvset_cnt; i++) {
-        err = kvset_log_d_records(le->le_kvset, work->cw_keep_vblks, work->cw_work_txid);
+        bool keepv = cn_comp_keepv(work, work->cw_kvset_cnt - 1 - i);
+
+        err = kvset_log_d_records(le->le_kvset, keepv, work->cw_work_txid);
         if (ev(err))
             return err;
 
@@ -2979,6 +5276,105 @@ struct spill_child {
     struct kvset *       kvset;
 };
 
+/* Link a new child into its parent.  The caller must hold the tree
+ * write lock, and must have published the child's kvset snapshot (lookups
+ * descend into it without the lock).
+ */
+static void
+cn_comp_child_link(
+    struct cn_tree *     tree,
+    struct cn_tree_node *pnode,
+    u32                  cx,
+    struct cn_tree_node *cnode)
+{
+    assert(!pnode->tn_childv[cx]);
+
+    cnode->tn_parent = pnode;
+    rcu_assign_pointer(pnode->tn_childv[cx], cnode);
+    pnode->tn_childc++;
+    if (pnode->tn_childc == 1)
+        tree->ct_i_nodec++;
+    else
+        tree->ct_l_nodec++;
+
+    tree->ct_lvl_max = max(tree->ct_lvl_max, cnode->tn_loc.node_level);
+}
+
+/* Add the new kvsets of a spill to the children of the node, linking
+ * in the new children.  The caller must hold the tree write lock, and
+ * must publish the node's kvset snapshot after this if it retires kvsets
+ * from the node.
+ */
+static void
+cn_comp_spill_children(struct cn_compaction_work *work, struct spill_child *childv)
+{
+    struct cn_tree *     tree = work->cw_tree;
+    struct cn_tree_node *pnode = work->cw_node;
+    u32                  cx;
+
+    for (cx = 0; cx < work->cw_outc; cx++) {
+        struct cn_tree_node *cnode;
+        struct kvset *       kvset;
+
+        kvset = childv[cx].kvset;
+        if (!kvset)
+            continue;
+
+        cnode = childv[cx].node;
+        if (cnode) {
+            /* Add new kvsets to new children. */
+            kvset_list_add(kvset, &cnode->tn_kvset_list);
+            cn_node_kvsnap_publish(cnode);
+            cn_comp_child_link(tree, pnode, cx, cnode);
+
+        } else {
+            /* Add new kvset to existing child */
+            cnode = pnode->tn_childv[cx];
+            assert(cnode);
+
+            kvset_list_add(kvset, &cnode->tn_kvset_list);
+            cn_node_kvsnap_publish(cnode);
+        }
+    }
+}
+
+/* Allocate the children a spill creates, those that receive a kvset
+ * and do not exist yet.
+ */
+static merr_t
+cn_comp_spill_childv(
+    struct cn_compaction_work *work,
+    struct kvset **            kvsets,
+    struct spill_child *       childv)
+{
+    struct cn_tree *     tree = work->cw_tree;
+    struct cn_tree_node *node = work->cw_node;
+    u32                  cx;
+
+    for (cx = 0; cx < work->cw_outc; cx++) {
+        childv[cx].kvset = kvsets[cx];
+        childv[cx].node = NULL;
+
+        if (!kvsets[cx])
+            continue;
+
+        if (!node->tn_childv[cx]) {
+
+            childv[cx].node = cn_node_alloc(
+                tree,
+                node->tn_loc.node_level + 1,
+                node_nth_child_offset(tree->ct_fanout_bits, &node->tn_loc, cx));
+            if (ev(!childv[cx].node)) {
+                while (cx-- > 0)
+                    cn_node_free(childv[cx].node);
+                return merr(ENOMEM);
+            }
+        }
+    }
+
+    return 0;
+}
+
 /**
  * cn_comp_update_spill() - update tree after spill operation
  * See section comment for more info.
@@ -2990,71 +5386,351 @@ cn_comp_update_spill(struct cn_compaction_work *work, struct spill_child *childv
     u64                      txid = work->cw_work_txid;
     struct cn_tree_node *    pnode = work->cw_node;
     struct kvset_list_entry *le, *tmp;
-    u32                      cx, kx;
+    u32                      kx;
     struct list_head         retired_kvsets;
 
-    if (ev(work->cw_err))
-        return;
+    if (ev(work->cw_err))
+        return;
+
+    INIT_LIST_HEAD(&retired_kvsets);
+
+    rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
+    {
+        cn_comp_spill_children(work, childv);
+
+        /* Move old kvsets from parent node to retired list. */
+        for (kx = 0; kx < work->cw_kvset_cnt; kx++) {
+            assert(!list_empty(&pnode->tn_kvset_list));
+            le = list_last_entry(&pnode->tn_kvset_list, struct kvset_list_entry, le_link);
+            list_del(&le->le_link);
+            list_add(&le->le_link, &retired_kvsets);
+        }
+
+        cn_node_kvsnap_publish(pnode);
+
+        cn_tree_samp(tree, &work->cw_samp_pre);
+
+        cn_tree_samp_update_spill(tree, pnode);
+
+        cn_tree_samp(tree, &work->cw_samp_post);
+    }
+    rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
+
+    /* Delete old kvsets. */
+    list_for_each_entry_safe (le, tmp, &retired_kvsets, le_link) {
+        kvset_mark_mblocks_for_delete(le->le_kvset, false, txid);
+        kvset_put_ref(le->le_kvset);
+    }
+}
+
+/*----------------------------------------------------------------
+ * SECTION: Spill checkpoints
+ *
+ * A long spill periodically commits the output produced so far into
+ * the children of the node, as kvsets with the dgen of the oldest input
+ * kvset (such that the children never appear newer than the node), and
+ * leaves the input kvsets in the node.  The tree state records which
+ * kvsets of which node are being spilled.  The last key spilled is not
+ * recorded, it is the largest key of the checkpoint kvsets in the
+ * children (see cn_tree_ckpt_restore()).
+ *
+ * A spill that is interrupted by a crash or a shutdown is then resumed
+ * from its last checkpoint, skipping the keys already in the children.
+ * Keys spilled again after a checkpoint are harmless duplicates, the
+ * merge loops keep only the first value of a key with a given seqno.
+ */
+
+static merr_t
+cn_comp_ckpt_record_prepare(struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_tree_node *      tn = arg;
+    struct cn_tree *           tree = tn->tn_tree;
+    struct cn_node_ckpt *      ckpt = tn->tn_ckpt;
+    struct cn_tstate_ckpt_omf *slot;
+    int                        i, free_slot = -1;
+
+    for (i = 0; i < CN_TSTATE_CKPT_MAX; i++) {
+        if (tree->ct_ckptv[i])
+            continue;
+
+        slot = &omf->ts_ckptv[i];
+
+        /* Stale slots from an earlier incarnation of this node's
+         * checkpoint must not survive this one.
+         */
+        if (omf_tsc_level(slot) == tn->tn_loc.node_level &&
+            omf_tsc_offset(slot) == tn->tn_loc.node_offset)
+            memset(slot, 0, sizeof(*slot));
+
+        if (free_slot < 0)
+            free_slot = i;
+    }
+
+    if (free_slot < 0)
+        return merr(ENOSPC);
+
+    slot = &omf->ts_ckptv[free_slot];
+    omf_set_tsc_level(slot, tn->tn_loc.node_level);
+    omf_set_tsc_offset(slot, tn->tn_loc.node_offset);
+    omf_set_tsc_dgen_lo(slot, ckpt->nc_dgen_lo);
+    omf_set_tsc_dgen_hi(slot, ckpt->nc_dgen_hi);
+
+    ckpt->nc_slot = free_slot;
+
+    return 0;
+}
+
+static void
+cn_comp_ckpt_record_commit(const struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_tree_node *tn = arg;
+
+    tn->tn_tree->ct_ckptv[tn->tn_ckpt->nc_slot] = tn;
+}
+
+static void
+cn_comp_ckpt_record_abort(struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_tree_node *tn = arg;
+
+    memset(&omf->ts_ckptv[tn->tn_ckpt->nc_slot], 0, sizeof(omf->ts_ckptv[0]));
+}
+
+static merr_t
+cn_comp_ckpt_clear_prepare(struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_tree_node *tn = arg;
+
+    memset(&omf->ts_ckptv[tn->tn_ckpt->nc_slot], 0, sizeof(omf->ts_ckptv[0]));
+
+    return 0;
+}
+
+static void
+cn_comp_ckpt_clear_commit(const struct cn_tstate_omf *omf, void *arg)
+{
+    struct cn_tree_node *tn = arg;
+
+    tn->tn_tree->ct_ckptv[tn->tn_ckpt->nc_slot] = NULL;
+}
+
+static void
+cn_comp_ckpt_clear_abort(struct cn_tstate_omf *omf, void *arg)
+{
+    cn_comp_ckpt_clear_commit(omf, arg);
+}
+
+bool
+cn_comp_checkpoint_begin(struct cn_compaction_work *w)
+{
+    struct cn_tree_node *node = w->cw_node;
+    struct cn_tstate *   ts = w->cw_tree->ct_tstate;
+    struct cn_node_ckpt *ckpt;
+    merr_t               err;
+
+    if (w->cw_rspill_conc) {
+        struct cn_compaction_work *first;
+
+        /* Only the oldest of the concurrent spills from a node can
+         * add kvsets to the children ahead of its completion.
+         */
+        mutex_lock(&node->tn_rspills_lock);
+        first = list_first_entry_or_null(&node->tn_rspills, typeof(*first), cw_rspill_link);
+        mutex_unlock(&node->tn_rspills_lock);
+
+        if (first != w)
+            return false;
+    }
+
+    ckpt = node->tn_ckpt;
+    if (ckpt)
+        return ckpt->nc_dgen_lo == w->cw_dgen_lo;
+
+    ckpt = calloc(1, sizeof(*ckpt));
+    if (ev(!ckpt))
+        return false;
+
+    ckpt->nc_dgen_lo = w->cw_dgen_lo;
+    ckpt->nc_dgen_hi = w->cw_dgen_hi;
+
+    rmlock_wlock(&w->cw_tree->ct_lock);
+    node->tn_ckpt = ckpt;
+    rmlock_wunlock(&w->cw_tree->ct_lock);
+
+    /* Record the checkpoint before any of its kvsets are committed, the
+     * record is ignored on restart if there are none.
+     */
+    err = ts->ts_update(
+        ts, cn_comp_ckpt_record_prepare, cn_comp_ckpt_record_commit, cn_comp_ckpt_record_abort,
+        node);
+    if (err) {
+        if (merr_errno(err) != ENOSPC)
+            hse_elog(
+                HSE_WARNING "%s: cnid %lu unable to record checkpoint: @@e",
+                err,
+                __func__,
+                (ulong)w->cw_tree->cnid);
+
+        rmlock_wlock(&w->cw_tree->ct_lock);
+        node->tn_ckpt = NULL;
+        rmlock_wunlock(&w->cw_tree->ct_lock);
+        free(ckpt);
+        return false;
+    }
+
+    return true;
+}
+
+merr_t
+cn_comp_checkpoint(
+    struct cn_compaction_work *w,
+    struct kvset_mblocks *     outv,
+    const struct key_obj *     kobj)
+{
+    struct cn_tree *     tree = w->cw_tree;
+    struct cn_tree_node *pnode = w->cw_node;
+    struct cn_node_ckpt *ckpt = pnode->tn_ckpt;
+    struct spill_child * childv = NULL;
+    struct kvset **      kvsets = NULL;
+    u64 *                tagv = NULL;
+    u64                  txid = 0;
+    u64                  context = 0;
+    u32                  commitc = 0;
+    bool                 committed = false;
+    merr_t               err;
+    uint                 i;
+
+    assert(ckpt && ckpt->nc_dgen_lo == w->cw_dgen_lo);
+
+    childv = calloc(w->cw_outc, sizeof(*childv));
+    kvsets = calloc(w->cw_outc, sizeof(*kvsets));
+    tagv = calloc(w->cw_outc, sizeof(*tagv));
+    if (ev(!childv || !kvsets || !tagv)) {
+        err = merr(ENOMEM);
+        goto errout;
+    }
+
+    err = cndb_txn_start(tree->cndb, &txid, CNDB_INVAL_INGESTID, w->cw_outc, 0, 0);
+    if (ev(err))
+        goto errout;
+
+    err = cn_mblocks_commit(
+        w->cw_ds, tree->cndb, tree->cnid, txid, w->cw_outc, outv, CN_MUT_OTHER, NULL, &commitc,
+        &context, tagv);
+    if (ev(err))
+        goto errout;
+
+    for (i = 0; i < w->cw_outc; i++) {
+        struct kvset_meta km = {};
+
+        if (outv[i].kblks.n_blks == 0)
+            continue;
+
+        km.km_dgen = ckpt->nc_dgen_lo;
+        km.km_vused = outv[i].bl_vused;
+        km.km_kblk_list = outv[i].kblks;
+        km.km_vblk_list = outv[i].vblks;
+        km.km_scatter = km.km_vused ? 1 : 0;
+        km.km_node_level = pnode->tn_loc.node_level + 1;
+        km.km_node_offset = node_nth_child_offset(tree->ct_fanout_bits, &pnode->tn_loc, i);
+
+        err = cndb_txn_meta(tree->cndb, txid, tree->cnid, tagv[i], &km);
+        if (ev(err))
+            goto errout;
+
+        err = kvset_create(tree, tagv[i], &km, &kvsets[i]);
+        if (ev(err))
+            goto errout;
+    }
+
+    err = cn_comp_spill_childv(w, kvsets, childv);
+    if (ev(err))
+        goto errout;
 
-    INIT_LIST_HEAD(&retired_kvsets);
+    err = cndb_txn_ack_c(tree->cndb, txid);
+    if (ev(err)) {
+        for (i = 0; i < w->cw_outc; i++)
+            cn_node_free(childv[i].node);
+        goto errout;
+    }
+
+    committed = true;
 
     rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
     {
+        cn_comp_spill_children(w, childv);
 
-        for (cx = 0; cx < work->cw_outc; cx++) {
-            struct cn_tree_node *cnode;
-            struct kvset *       kvset;
+        for (i = 0; i < w->cw_outc; i++)
+            if (kvsets[i])
+                cn_tree_samp_update_ingest(tree, pnode->tn_childv[i]);
 
-            kvset = childv[cx].kvset;
-            if (!kvset)
-                continue;
+        key_obj_copy(ckpt->nc_key, sizeof(ckpt->nc_key), &ckpt->nc_klen, kobj);
+    }
+    rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
 
-            cnode = childv[cx].node;
-            if (cnode) {
-                /* Add new kvsets to new children. */
-                assert(!pnode->tn_childv[cx]);
+    if (w->cw_debug & CW_DEBUG_PROGRESS)
+        hse_log(
+            HSE_NOTICE "sts/job %u cnid %lu node (%u,%u) spill checkpoint, dgen %lu-%lu",
+            w->cw_job.sj_id,
+            (ulong)tree->cnid,
+            pnode->tn_loc.node_level,
+            pnode->tn_loc.node_offset,
+            (ulong)ckpt->nc_dgen_lo,
+            (ulong)ckpt->nc_dgen_hi);
 
-                kvset_list_add(kvset, &cnode->tn_kvset_list);
-                cnode->tn_parent = pnode;
-                pnode->tn_childv[cx] = cnode;
-                pnode->tn_childc++;
-                if (pnode->tn_childc == 1)
-                    tree->ct_i_nodec++;
-                else
-                    tree->ct_l_nodec++;
+errout:
+    if (!committed) {
+        if (txid)
+            cndb_txn_nak(tree->cndb, txid);
+
+        if (kvsets) {
+            for (i = 0; i < w->cw_outc; i++)
+                if (kvsets[i])
+                    kvset_put_ref(kvsets[i]);
+        }
 
-                tree->ct_lvl_max = max(tree->ct_lvl_max, cnode->tn_loc.node_level);
+        cn_mblocks_destroy(w->cw_ds, w->cw_outc, outv, false, commitc);
+    }
 
-            } else {
-                /* Add new kvset to existing child */
-                cnode = pnode->tn_childv[cx];
-                assert(cnode);
+    for (i = 0; i < w->cw_outc; i++) {
+        blk_list_free(&outv[i].kblks);
+        blk_list_free(&outv[i].vblks);
+    }
 
-                kvset_list_add(kvset, &cnode->tn_kvset_list);
-            }
-        }
+    free(tagv);
+    free(kvsets);
+    free(childv);
 
-        /* Move old kvsets from parent node to retired list. */
-        for (kx = 0; kx < work->cw_kvset_cnt; kx++) {
-            assert(!list_empty(&pnode->tn_kvset_list));
-            le = list_last_entry(&pnode->tn_kvset_list, struct kvset_list_entry, le_link);
-            list_del(&le->le_link);
-            list_add(&le->le_link, &retired_kvsets);
-        }
+    return err;
+}
 
-        cn_tree_samp(tree, &work->cw_samp_pre);
+/* Drop the checkpoint of a completed spill.  If the slot cannot be
+ * cleared on media, it is ignored on restart as its kvsets are gone.
+ */
+static void
+cn_comp_checkpoint_end(struct cn_compaction_work *w)
+{
+    struct cn_tree_node *node = w->cw_node;
+    struct cn_tstate *   ts = w->cw_tree->ct_tstate;
+    struct cn_node_ckpt *ckpt = node->tn_ckpt;
+    merr_t               err;
 
-        cn_tree_samp_update_spill(tree, pnode);
+    if (ckpt->nc_dgen_lo != w->cw_dgen_lo)
+        return;
 
-        cn_tree_samp(tree, &work->cw_samp_post);
-    }
-    rmlock_wunlock(&tree->ct_lock);
+    err = ts->ts_update(
+        ts, cn_comp_ckpt_clear_prepare, cn_comp_ckpt_clear_commit, cn_comp_ckpt_clear_abort, node);
+    ev(err);
 
-    /* Delete old kvsets. */
-    list_for_each_entry_safe (le, tmp, &retired_kvsets, le_link) {
-        kvset_mark_mblocks_for_delete(le->le_kvset, false, txid);
-        kvset_put_ref(le->le_kvset);
-    }
+    rmlock_wlock(&w->cw_tree->ct_lock);
+    node->tn_ckpt = NULL;
+    rmlock_wunlock(&w->cw_tree->ct_lock);
+
+    free(ckpt);
 }
 
 /**
@@ -3065,7 +5741,6 @@ static merr_t
 cn_comp_commit_spill(struct cn_compaction_work *work, struct kvset **kvsets)
 {
     struct cn_tree *         tree = work->cw_tree;
-    struct cn_tree_node *    node = work->cw_node;
     merr_t                   err = 0;
     struct kvset_list_entry *le;
     u32                      cx, kx;
@@ -3080,24 +5755,10 @@ cn_comp_commit_spill(struct cn_compaction_work *work, struct kvset **kvsets)
     if (!childv)
         return merr(EBUG);
 
-    for (cx = 0; cx < work->cw_outc; cx++) {
-        childv[cx].kvset = kvsets[cx];
-        childv[cx].node = NULL;
-
-        if (!kvsets[cx])
-            continue;
-
-        if (!node->tn_childv[cx]) {
-
-            childv[cx].node = cn_node_alloc(
-                tree,
-                node->tn_loc.node_level + 1,
-                node_nth_child_offset(tree->ct_fanout_bits, &node->tn_loc, cx));
-            if (ev(!childv[cx].node)) {
-                err = merr(ENOMEM);
-                goto done;
-            }
-        }
+    err = cn_comp_spill_childv(work, kvsets, childv);
+    if (ev(err)) {
+        free(childv);
+        return err;
     }
 
     /* Update CNDB with "D" records.  No need to lock kvset as long as
@@ -3123,9 +5784,12 @@ cn_comp_commit_spill(struct cn_compaction_work *work, struct kvset **kvsets)
     /* Update tree and stats.  No failure paths allowed after ACK_C. */
     cn_comp_update_spill(work, childv);
 
+    if (work->cw_node->tn_ckpt)
+        cn_comp_checkpoint_end(work);
+
 done:
     if (err) {
-        while (cx-- > 0)
+        for (cx = 0; cx < work->cw_outc; cx++)
             cn_node_free(childv[cx].node);
     }
     free(childv);
@@ -3133,6 +5797,135 @@ done:
     return err;
 }
 
+/**
+ * cn_comp_commit_move() - commit a spill that moves its input kvsets
+ * See cn_comp_move_prepare().
+ */
+static merr_t
+cn_comp_commit_move(struct cn_compaction_work *w)
+{
+    struct cn_tree *         tree = w->cw_tree;
+    struct cn_tree_node *    pnode = w->cw_node;
+    struct cn_tree_node *    newv[CN_FANOUT_MAX] = {};
+    bool                     movedv[CN_FANOUT_MAX] = {};
+    struct kvset_list_entry *le, *prev;
+    u64                      txid = w->cw_work_txid;
+    u32                      level = pnode->tn_loc.node_level + 1;
+    u64 *                    tagv, *oldv;
+    uint *                   cxv;
+    u64                      tag = 0;
+    merr_t                   err = 0;
+    uint                     i, cx;
+
+    tagv = calloc(w->cw_kvset_cnt, 2 * sizeof(*tagv) + sizeof(*cxv));
+    if (ev(!tagv))
+        return merr(ENOMEM);
+
+    oldv = tagv + w->cw_kvset_cnt;
+    cxv = (uint *)(oldv + w->cw_kvset_cnt);
+
+    /* Log a C record for each kvset at its new location, oldest first
+     * such that each child's kvsets stay in dgen order, then D records
+     * that delete none of their mblocks.
+     */
+    le = w->cw_mark;
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        struct key_obj kmin, kmax;
+
+        cn_split_range(le->le_kvset, 0, &kmin, &kmax);
+        cx = cn_split_child(w->cw_split, w->cw_pfx_len, &kmin);
+        cxv[i] = cx;
+
+        if (!pnode->tn_childv[cx] && !newv[cx]) {
+            newv[cx] = cn_node_alloc(
+                tree, level, node_nth_child_offset(tree->ct_fanout_bits, &pnode->tn_loc, cx));
+            if (ev(!newv[cx])) {
+                err = merr(ENOMEM);
+                goto errout;
+            }
+        }
+
+        oldv[i] = kvset_get_tag(le->le_kvset);
+
+        err = kvset_log_move(
+            le->le_kvset,
+            txid,
+            level,
+            node_nth_child_offset(tree->ct_fanout_bits, &pnode->tn_loc, cx),
+            &tag);
+        if (ev(err))
+            goto errout;
+
+        tagv[i] = tag;
+        le = list_prev_entry(le, le_link);
+    }
+
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        err = cndb_txn_txd(tree->cndb, txid, tree->cnid, oldv[i], 0, NULL);
+        if (ev(err))
+            goto errout;
+    }
+
+    /* There must not be any failure conditions after successful ACK_C
+     * because the operation has been committed.
+     */
+    err = cndb_txn_ack_c(tree->cndb, txid);
+    if (ev(err))
+        goto errout;
+
+    rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
+    {
+        cn_tree_samp(tree, &w->cw_samp_pre);
+
+        le = w->cw_mark;
+        for (i = 0; i < w->cw_kvset_cnt; i++, le = prev) {
+            struct kvset *ks = le->le_kvset;
+
+            prev = list_prev_entry(le, le_link);
+            cx = cxv[i];
+
+            if (newv[cx]) {
+                cn_comp_child_link(tree, pnode, cx, newv[cx]);
+                newv[cx] = NULL;
+            }
+
+            list_del(&le->le_link);
+            kvset_move(ks, tagv[i], level);
+            kvset_set_workid(ks, 0);
+            kvset_list_add(ks, &pnode->tn_childv[cx]->tn_kvset_list);
+            movedv[cx] = true;
+        }
+
+        for (cx = 0; cx < tree->ct_cp->cp_fanout; cx++)
+            if (movedv[cx])
+                cn_node_kvsnap_publish(pnode->tn_childv[cx]);
+
+        cn_node_kvsnap_publish(pnode);
+
+        cn_tree_samp_update_compact(tree, pnode);
+
+        for (cx = 0; cx < tree->ct_cp->cp_fanout; cx++)
+            if (pnode->tn_childv[cx])
+                cn_tree_samp_update_compact(tree, pnode->tn_childv[cx]);
+
+        cn_tree_samp(tree, &w->cw_samp_post);
+    }
+    rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
+
+    /* The old tags have no mblocks to delete. */
+    for (i = 0; i < w->cw_kvset_cnt; i++)
+        cndb_txn_ack_d(tree->cndb, txid, oldv[i], tree->cnid);
+
+errout:
+    for (cx = 0; cx < CN_FANOUT_MAX; cx++)
+        cn_node_free(newv[cx]);
+    free(tagv);
+
+    return err;
+}
+
 /**
  * cn_comp_commit() - commit compaction operation to cndb log
  * See section comment for more info.
@@ -3142,28 +5935,37 @@ cn_comp_commit(struct cn_compaction_work *w)
 {
     struct kvset ** kvsets = 0;
     struct mbset ***vecs = 0;
+    struct mbset *  vgc_vbset = 0;
     uint *          cnts = 0;
-    uint            i, alloc_len;
+    uint            i, alloc_len, vecc;
     bool            spill, use_mbsets;
     uint            scatter;
 
     if (ev(w->cw_err))
         goto done;
 
+    if (w->cw_move) {
+        w->cw_err = cn_comp_commit_move(w);
+        goto done;
+    }
+
     assert(w->cw_outc);
 
     spill = w->cw_outc > 1;
 
     use_mbsets = w->cw_action == CN_ACTION_COMPACT_K;
 
+    /* Value gc adds an mbset for the vblocks of the rewritten values. */
+    vecc = w->cw_kvset_cnt + (w->cw_vbmap.vbm_gcv ? 1 : 0);
+
     alloc_len = sizeof(*kvsets) * w->cw_outc;
     if (use_mbsets) {
         /* For k-compaction, create new kvset with references to
          * mbsets from input kvsets instead of creating new mbsets.
          * We need extra allocations for this.
          */
-        alloc_len += sizeof(*vecs) * w->cw_kvset_cnt;
-        alloc_len += sizeof(*cnts) * w->cw_kvset_cnt;
+        alloc_len += sizeof(*vecs) * vecc;
+        alloc_len += sizeof(*cnts) * vecc;
     }
 
     kvsets = calloc(1, alloc_len);
@@ -3177,7 +5979,7 @@ cn_comp_commit(struct cn_compaction_work *w)
         struct kvset_list_entry *le;
 
         vecs = (void *)(kvsets + w->cw_outc);
-        cnts = (void *)(vecs + w->cw_kvset_cnt);
+        cnts = (void *)(vecs + vecc);
 
         /* The kvset represented by vecs[i] must be newer than
          * the kvset represented by vecs[i+1] (that is, in same order
@@ -3188,7 +5990,10 @@ cn_comp_commit(struct cn_compaction_work *w)
         i = w->cw_kvset_cnt;
         while (i--) {
             vecs[i] = kvset_get_vbsetv(le->le_kvset, &cnts[i]);
-            scatter += (kvset_get_scatter_score(le->le_kvset));
+            if (w->cw_vbmap.vbm_gcv && w->cw_vbmap.vbm_gcv[i])
+                cnts[i] = 0;
+            else
+                scatter += (kvset_get_scatter_score(le->le_kvset));
             le = list_prev_entry(le, le_link);
         }
     }
@@ -3229,9 +6034,21 @@ cn_comp_commit(struct cn_compaction_work *w)
         if (ev(w->cw_err))
             goto done;
 
+        if (use_mbsets && w->cw_vbmap.vbm_gcv) {
+            /* The vblocks past the kept ones hold the rewritten values. */
+            w->cw_err = kvset_create_vbset(w->cw_tree, &km, w->cw_vbmap.vbm_blkc, &vgc_vbset);
+            if (ev(w->cw_err))
+                goto done;
+
+            vecs[vecc - 1] = &vgc_vbset;
+            cnts[vecc - 1] = vgc_vbset ? 1 : 0;
+            if (vgc_vbset)
+                km.km_scatter++;
+        }
+
         if (use_mbsets) {
-            w->cw_err = kvset_create2(
-                w->cw_tree, w->cw_tagv[i], &km, w->cw_kvset_cnt, cnts, vecs, &kvsets[i]);
+            w->cw_err =
+                kvset_create2(w->cw_tree, w->cw_tagv[i], &km, vecc, cnts, vecs, &kvsets[i]);
         } else {
             w->cw_err = kvset_create(w->cw_tree, w->cw_tagv[i], &km, &kvsets[i]);
         }
@@ -3244,6 +6061,12 @@ cn_comp_commit(struct cn_compaction_work *w)
     else
         w->cw_err = cn_comp_commit_kvcompact(w, kvsets[0]);
 
+    /* The old values the filter dropped or replaced are no longer in
+     * the tree, so values cached from it are now stale.
+     */
+    if (!w->cw_err && w->cw_cfiltered)
+        cn_inc_cfilter_gen(w->cw_tree->cn);
+
 done:
     if (w->cw_err && kvsets) {
         for (i = 0; i < w->cw_outc; i++) {
@@ -3252,10 +6075,142 @@ done:
         }
     }
 
+    /* kvset_create2() takes its own ref on the value gc mbset */
+    if (vgc_vbset)
+        mbset_put_ref(vgc_vbset);
+
     /* always free kvset ptrs */
     free(kvsets);
 }
 
+/**
+ * cn_comp_event() - record a finished compaction in the kvdb's event log
+ */
+static void
+cn_comp_event(struct cn_compaction_work *w)
+{
+    const struct cn_merge_stats *ms = &w->cw_stats;
+    struct cn_event              cev = { 0 };
+    u64                          now = get_time_ns();
+    uint                         i;
+
+    if (!w->cw_tree->cn_kvdb)
+        return;
+
+    switch (w->cw_action) {
+        case CN_ACTION_COMPACT_K:
+            cev.ce_type = CN_EVENT_KCOMPACT;
+            break;
+        case CN_ACTION_COMPACT_KV:
+            cev.ce_type = CN_EVENT_KVCOMPACT;
+            break;
+        case CN_ACTION_SPILL:
+            cev.ce_type = CN_EVENT_SPILL;
+            break;
+        default:
+            return;
+    }
+
+    cev.ce_cnid = w->cw_tree->cnid;
+    cev.ce_rule = w->cw_comp_rule;
+    cev.ce_level = w->cw_node->tn_loc.node_level;
+    cev.ce_offset = w->cw_node->tn_loc.node_offset;
+    cev.ce_token = w->cw_have_token;
+    cev.ce_errno = merr_errno(w->cw_err);
+
+    cev.ce_kvsets_in = w->cw_kvset_cnt;
+    for (i = 0; w->cw_outv && i < w->cw_outc; i++)
+        if (w->cw_outv[i].kblks.n_blks > 0)
+            cev.ce_kvsets_out++;
+    if (w->cw_move)
+        cev.ce_kvsets_out = w->cw_kvset_cnt;
+
+    cev.ce_keys_in = ms->ms_keys_in;
+    cev.ce_keys_out = ms->ms_keys_out;
+    cev.ce_bytes_in =
+        ms->ms_kblk_read.op_size + ms->ms_vblk_read1.op_size + ms->ms_vblk_read2.op_size;
+    cev.ce_bytes_out = ms->ms_kblk_write.op_size + ms->ms_kblk_write_async.op_size +
+                      ms->ms_vblk_write.op_size + ms->ms_vblk_write_async.op_size;
+
+    if (w->cw_t0_enqueue && w->cw_t1_qtime) {
+        cev.ce_queue_ns = w->cw_t1_qtime - w->cw_t0_enqueue;
+        cev.ce_run_ns = now - w->cw_t1_qtime;
+    }
+    cev.ce_throttle_ns = ms->ms_tbkt_delay.op_time;
+
+    cn_evlog_add(w->cw_tree->cn_kvdb->cnd_evlog, &cev);
+}
+
+merr_t
+cn_comp_filter(
+    struct cn_compaction_work *w,
+    void **                    bufp,
+    const struct key_obj *     kobj,
+    const void **              vdata,
+    uint *                     vlen,
+    uint *                     complen,
+    int *                      action)
+{
+    const void *val = *vdata;
+    u8 *        kbuf, *vbuf, *rbuf;
+    size_t      rlen = 0;
+    uint        klen;
+
+    /* Room for a key, a decompressed value and a replacement. */
+    if (!*bufp) {
+        *bufp = malloc(HSE_KVS_KLEN_MAX + 2 * HSE_KVS_VLEN_MAX);
+        if (ev(!*bufp))
+            return merr(ENOMEM);
+    }
+
+    kbuf = *bufp;
+    vbuf = kbuf + HSE_KVS_KLEN_MAX;
+    rbuf = vbuf + HSE_KVS_VLEN_MAX;
+
+    key_obj_copy(kbuf, HSE_KVS_KLEN_MAX, &klen, kobj);
+
+    if (*complen) {
+        uint   outlen;
+        merr_t err;
+
+        err = decompress_lz4(val, *complen, vbuf, *vlen, &outlen);
+        if (ev(err))
+            return err;
+
+        if (ev(outlen != *vlen))
+            return merr(EILSEQ);
+
+        val = vbuf;
+    }
+
+    *action = w->cw_cfilter(
+        w->cw_cfilter_arg, kbuf, klen, val, *vlen, rbuf, HSE_KVS_VLEN_MAX, &rlen);
+
+    switch (*action) {
+        case KVS_CFILTER_DROP:
+            w->cw_cfiltered = true;
+            break;
+
+        case KVS_CFILTER_REPLACE:
+            if (ev(rlen > HSE_KVS_VLEN_MAX)) {
+                *action = KVS_CFILTER_KEEP;
+                break;
+            }
+
+            *vdata = rbuf;
+            *vlen = rlen;
+            *complen = 0;
+            w->cw_cfiltered = true;
+            break;
+
+        default:
+            *action = KVS_CFILTER_KEEP;
+            break;
+    }
+
+    return 0;
+}
+
 /**
  * cn_comp_cleanup() - cleanup after compaction operation
  * See section comment for more info.
@@ -3288,8 +6243,23 @@ cn_comp_cleanup(struct cn_compaction_work *w)
     if (merr_errno(w->cw_err) == ENOSPC)
         w->cw_tree->ct_nospace = true;
 
-    if (w->cw_err && w->cw_outv)
+    if (w->cw_err && w->cw_outv) {
+        struct blk_list *vblks = &w->cw_outv[0].vblks;
+
+        /* Value gc owns only the vblocks that follow the kept ones,
+         * so drop the kept ones from the list before destroying it.
+         */
+        if (kcompact && w->cw_vbmap.vbm_gcv && vblks->n_blks > 0) {
+            uint keepc = w->cw_vbmap.vbm_blkc;
+
+            assert(vblks->n_blks >= keepc);
+            vblks->n_blks -= keepc;
+            memmove(vblks->blks, vblks->blks + keepc, vblks->n_blks * sizeof(*vblks->blks));
+            kcompact = false;
+        }
+
         cn_mblocks_destroy(w->cw_ds, w->cw_outc, w->cw_outv, kcompact, w->cw_commitc);
+    }
 
     free(w->cw_vbmap.vbm_blkv);
     free(w->cw_tagv);
@@ -3386,6 +6356,58 @@ done:
     return w;
 }
 
+/* A spill in a range tree moves its input kvsets to the children whole,
+ * rather than merging them, if each of them falls in the key range of a
+ * single child.  That is the norm for keys written in ascending order,
+ * e.g., timestamps or sequence numbers, whose kvsets do not overlap.  An
+ * input with prefix tombstones is merged as usual, its ptombs may apply
+ * to every child.
+ */
+static merr_t
+cn_comp_move_prepare(struct cn_compaction_work *w)
+{
+    struct kvset_list_entry *le;
+    merr_t                   err;
+    uint                     i;
+
+    if (w->cw_action != CN_ACTION_SPILL || !w->cw_tree->ct_range || w->cw_node->tn_ckpt)
+        return 0;
+
+    le = w->cw_mark;
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        struct key_obj kmin, kmax;
+
+        if (kvset_pt_start(le->le_kvset) >= 0)
+            return 0;
+
+        if (!cn_split_range(le->le_kvset, 0, &kmin, &kmax))
+            return 0;
+
+        le = list_prev_entry(le, le_link);
+    }
+
+    err = cn_split_get(w, 1 << w->cw_tree->ct_fanout_bits);
+    if (ev(err))
+        return err;
+
+    le = w->cw_mark;
+    for (i = 0; i < w->cw_kvset_cnt; i++) {
+        struct key_obj kmin, kmax;
+
+        cn_split_range(le->le_kvset, 0, &kmin, &kmax);
+
+        if (cn_split_child(w->cw_split, w->cw_pfx_len, &kmin) !=
+            cn_split_child(w->cw_split, w->cw_pfx_len, &kmax))
+            return 0;
+
+        le = list_prev_entry(le, le_link);
+    }
+
+    w->cw_move = true;
+
+    return 0;
+}
+
 /**
  * cn_comp_compact() - perform the actual compaction operation
  * See section comment for more info.
@@ -3397,6 +6419,7 @@ cn_comp_compact(struct cn_compaction_work *w)
 
     bool   kcompact = w->cw_action == CN_ACTION_COMPACT_K;
     bool   skip_commit = false;
+    bool   vgc;
     merr_t err;
     u32    i;
     u64    ns;
@@ -3406,6 +6429,8 @@ cn_comp_compact(struct cn_compaction_work *w)
         return;
 
     w->cw_horizon = cn_get_seqno_horizon(w->cw_tree->cn);
+    w->cw_ttl_seq = cn_tree_ttl_seq(w->cw_tree);
+    w->cw_cfilter = cn_cfilter_get(w->cw_tree->cn, &w->cw_cfilter_arg);
     w->cw_cancel_request = cn_get_cancel(w->cw_tree->cn);
 
     perfc_inc(w->cw_pc, PERFC_BA_CNCOMP_START);
@@ -3421,6 +6446,50 @@ cn_comp_compact(struct cn_compaction_work *w)
     if (ev(err))
         goto err_exit;
 
+    /* The input kvsets of a ptomb drop are hidden in their entirety (see
+     * cn_node_ptomb_hidden()), so they are deleted as if k-compacted into
+     * nothing, without being read.
+     */
+    if (w->cw_comp_rule == CN_CR_LPTOMB) {
+        w->cw_outc = 1;
+        w->cw_outv = calloc(w->cw_outc, sizeof(*w->cw_outv));
+        if (ev(!w->cw_outv)) {
+            err = merr(ENOMEM);
+            goto err_exit;
+        }
+
+        w->cw_keep_vblks = false;
+        w->cw_t2_prep = w->cw_t3_build = get_time_ns();
+        skip_commit = true;
+        goto commit;
+    }
+
+    err = cn_comp_move_prepare(w);
+    if (ev(err))
+        goto err_exit;
+
+    /* A move journals and relinks the input kvsets when it is committed
+     * (see cn_comp_commit_move()), there is no data to write.
+     */
+    if (w->cw_move) {
+        w->cw_t2_prep = w->cw_t3_build = get_time_ns();
+
+        err = cndb_txn_start(
+            w->cw_tree->cndb,
+            &w->cw_work_txid,
+            CNDB_INVAL_INGESTID,
+            w->cw_kvset_cnt,
+            w->cw_kvset_cnt,
+            0);
+        if (ev(err)) {
+            kvdb_health_error(hp, err);
+            goto err_exit;
+        }
+
+        w->cw_t4_commit = get_time_ns();
+        goto err_exit;
+    }
+
     /* cn_tree_prepare_compaction() will initiate I/O
      * if ASYNCIO is enabled.
      */
@@ -3464,6 +6533,9 @@ cn_comp_compact(struct cn_compaction_work *w)
             w->cw_inputv[i]->kvi_ops->kvi_release(w->cw_inputv[i]);
     free(w->cw_inputv);
     free(w->cw_drop_tombv);
+
+    cheap_destroy(w->cw_arena);
+    w->cw_arena = NULL;
     if (ev(err)) {
         if (!w->cw_canceled)
             kvdb_health_error(hp, err);
@@ -3487,6 +6559,7 @@ cn_comp_compact(struct cn_compaction_work *w)
         }
     }
 
+commit:
     {
         int nc = (skip_commit) ? 0 : w->cw_outc;
         int nd = w->cw_kvset_cnt;
@@ -3498,6 +6571,9 @@ cn_comp_compact(struct cn_compaction_work *w)
         }
     }
 
+    /* Value gc commits the new vblocks that follow the kept ones. */
+    vgc = kcompact && w->cw_vbmap.vbm_gcv;
+
     if (!skip_commit) {
         u64 context = 0; /* must initially be zero */
 
@@ -3509,8 +6585,8 @@ cn_comp_compact(struct cn_compaction_work *w)
             w->cw_work_txid,
             w->cw_outc,
             w->cw_outv,
-            kcompact ? CN_MUT_KCOMPACT : CN_MUT_OTHER,
-            NULL,
+            kcompact && !vgc ? CN_MUT_KCOMPACT : CN_MUT_OTHER,
+            vgc ? &w->cw_vbmap.vbm_blkc : NULL,
             &w->cw_commitc,
             &context,
             w->cw_tagv);
@@ -3537,8 +6613,22 @@ static void
 cn_comp_finish(struct cn_compaction_work *w)
 {
     cn_comp_commit(w);
+    cn_comp_event(w);
+
+    if (HSE_USDT_ENABLED(cn_comp_end))
+        HSE_USDT(
+            cn_comp_end,
+            w->cw_tree->cnid,
+            w->cw_action,
+            w->cw_node->tn_loc.node_level,
+            w->cw_node->tn_loc.node_offset,
+            merr_errno(w->cw_err),
+            w->cw_t1_qtime ? get_time_ns() - w->cw_t1_qtime : 0);
+
     cn_comp_cleanup(w);
     cn_comp_release(w);
+
+    atomic_dec(&kvs_flight_env.kfe_comps);
 }
 
 /**
@@ -3555,6 +6645,18 @@ cn_comp(struct cn_compaction_work *w)
     struct perfc_set *pc = w->cw_pc;
 
     tstart = perfc_lat_start(pc);
+
+    atomic_inc(&kvs_flight_env.kfe_comps);
+
+    HSE_USDT(
+        cn_comp_start,
+        w->cw_tree->cnid,
+        w->cw_action,
+        w->cw_comp_rule,
+        w->cw_node->tn_loc.node_level,
+        w->cw_node->tn_loc.node_offset,
+        w->cw_kvset_cnt);
+
     cn_comp_compact(w);
 
     if (w->cw_rspill_conc) {
@@ -3625,7 +6727,9 @@ cn_tree_ingest_update(struct cn_tree *tree, struct kvset *kvset, void *ptomb, ui
     assert(tree->ct_root);
 
     rmlock_wlock(&tree->ct_lock);
+    atomic64_inc(&tree->ct_view_gen);
     kvset_list_add(kvset, &tree->ct_root->tn_kvset_list);
+    cn_node_kvsnap_publish(tree->ct_root);
 
     /* Record ptomb as the max ptomb seen by this cn */
     if (cn_get_flags(tree->cn) & CN_CFLAG_CAPPED) {
@@ -3645,6 +6749,7 @@ cn_tree_ingest_update(struct cn_tree *tree, struct kvset *kvset, void *ptomb, ui
     assert(post.l_good == pre.l_good);
 
     rmlock_wunlock(&tree->ct_lock);
+    cn_tree_cview_purge(tree);
 
     csched_notify_ingest(
         cn_get_sched(tree->cn), tree, post.r_alen - pre.r_alen, post.r_wlen - pre.r_wlen);
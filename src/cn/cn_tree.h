@@ -36,6 +36,18 @@ cn_tstate_commit_t(const struct cn_tstate_omf *omf, void *arg);
 typedef void
 cn_tstate_abort_t(struct cn_tstate_omf *omf, void *arg);
 
+/**
+ * struct cn_tstate_ckpt - spill checkpoint slot (see cn_tree_ckpt_restore())
+ * @tsc_loc:     node being spilled
+ * @tsc_dgen_lo: dgen of the oldest input kvset, zero if the slot is unused
+ * @tsc_dgen_hi: dgen of the newest input kvset
+ */
+struct cn_tstate_ckpt {
+    struct cn_node_loc tsc_loc;
+    u64                tsc_dgen_lo;
+    u64                tsc_dgen_hi;
+};
+
 struct cn_tstate {
     merr_t (*ts_update)(
         struct cn_tstate *   tstate,
@@ -45,6 +57,8 @@ struct cn_tstate {
         void *               arg);
 
     void (*ts_get)(struct cn_tstate *tstate, u32 *genp, u8 *mapv);
+    void (*ts_get_ckpt)(struct cn_tstate *tstate, struct cn_tstate_ckpt *ckptv);
+    u64 (*ts_get_ttl_seq)(struct cn_tstate *tstate);
 };
 
 /* MTF_MOCK */
@@ -59,6 +73,52 @@ cn_tree_lookup(
     struct kvs_buf *     kbuf,
     struct kvs_buf *     vbuf);
 
+/* MTF_MOCK */
+merr_t
+cn_tree_lookup_batch(
+    struct cn_tree *     tree,
+    struct perfc_set *   pc,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc);
+
+/* MTF_MOCK */
+merr_t
+cn_tree_pfx_probe_batch(
+    struct cn_tree *     tree,
+    struct perfc_set *   pc,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct query_ctx *   qctxv,
+    struct kvs_buf *     kbufv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc);
+
+/**
+ * cn_tree_ttl_seq() - get the time-to-live expiry horizon of a tree
+ * @tree: tree to query
+ *
+ * Entries at or below the returned seqno have expired, zero if none.
+ */
+u64
+cn_tree_ttl_seq(struct cn_tree *tree);
+
+/**
+ * cn_tree_ttl_hide() - hide a value found by a lookup if it has expired
+ * @tree: tree the value was found in
+ * @res:  (in/out) lookup result, FOUND_VAL becomes FOUND_TMB if expired
+ * @vseq: seqno of the value
+ *
+ * An expired value hides its key as would a tombstone.
+ */
+void
+cn_tree_ttl_hide(struct cn_tree *tree, enum key_lookup_res *res, u64 vseq);
+
 /**
  * cn_tree_initial_dgen() - return most current dgen in tree
  * @tree: tree to query
@@ -123,6 +183,34 @@ cn_tree_get_pfx_pivot(struct cn_tree *tree);
 void
 cn_tree_samp(const struct cn_tree *tree, struct cn_samp_stats *s_out);
 
+/**
+ * cn_tree_pin_reserve() - charge pages to be pinned against the tree's budget
+ * @tree:  cn tree
+ * @level: cn level of the kvset that owns the pages
+ * @len:   bytes to be pinned
+ *
+ * Return: true if the pages fit within cn_pin_mb and may be pinned.
+ */
+bool
+cn_tree_pin_reserve(struct cn_tree *tree, uint level, size_t len);
+
+/**
+ * cn_tree_pin_release() - credit unpinned pages back to the tree's budget
+ * @tree:  cn tree
+ * @level: cn level of the kvset that owned the pages
+ * @len:   bytes unpinned
+ */
+void
+cn_tree_pin_release(struct cn_tree *tree, uint level, size_t len);
+
+/**
+ * cn_tree_pinned() - get the bytes pinned by the kvsets of a cn level
+ * @tree:  cn tree
+ * @level: cn level
+ */
+u64
+cn_tree_pinned(const struct cn_tree *tree, uint level);
+
 merr_t
 cn_tree_init(void);
 
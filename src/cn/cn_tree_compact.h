@@ -13,6 +13,7 @@
 #include <hse_util/perfc.h>
 
 #include <hse_ikvdb/sched_sts.h>
+#include <hse_ikvdb/tuple.h>
 
 #include "cn_metrics.h"
 #include "kcompact.h"
@@ -25,6 +26,9 @@ struct kv_iterator;
 struct kvset_list_entry;
 struct kvset_mblocks;
 struct kvset;
+struct key_obj;
+struct cn_node_ckpt;
+struct cn_split;
 
 enum cn_action {
     CN_ACTION_NONE = 0,
@@ -48,6 +52,13 @@ enum cn_comp_rule {
     CN_CR_LSHORT_IDLE,    /* short leaf, idle */
     CN_CR_LSHORT_IDLE_VG, /* short leaf, idle, vblk groups */
     CN_CR_LSCATTER,       /* leaf vblk scatter */
+    CN_CR_LLEVEL,         /* hybrid leaf, merge newer runs into the level */
+    CN_CR_LRUNS,          /* hybrid leaf, merge newer runs together */
+    CN_CR_TOMB,           /* node dense with tombstones */
+    CN_CR_LVGC,           /* leaf vblock garbage, rewrite live values */
+    CN_CR_SPILL_RESUME,   /* resume a checkpointed spill */
+    CN_CR_LTIER,          /* move a leaf kvset to the media class of its heat */
+    CN_CR_LPTOMB,         /* delete leaf kvsets hidden by a newer ptomb */
     CN_CR_END,
 };
 
@@ -104,6 +115,20 @@ cn_comp_rule2str(enum cn_comp_rule rule)
             return "idle_vg";
         case CN_CR_LSCATTER:
             return "scatter";
+        case CN_CR_LLEVEL:
+            return "level";
+        case CN_CR_LRUNS:
+            return "runs";
+        case CN_CR_TOMB:
+            return "tombs";
+        case CN_CR_LVGC:
+            return "vgc";
+        case CN_CR_SPILL_RESUME:
+            return "resume";
+        case CN_CR_LTIER:
+            return "tier";
+        case CN_CR_LPTOMB:
+            return "ptomb";
     }
 
     return "unknown_rule";
@@ -112,6 +137,11 @@ cn_comp_rule2str(enum cn_comp_rule rule)
 #define CW_DEBUG_ROOT 0x01 /* include ingest and root spills */
 #define CW_DEBUG_PROGRESS 0x02
 
+/* Size of the arena from which a compaction's input iterators are
+ * allocated, which suffices for about a thousand inputs.
+ */
+#define CN_COMPACT_ARENA_SZ (4ul << 20)
+
 typedef void (*cn_work_callback)(struct cn_compaction_work *w);
 
 /**
@@ -136,6 +166,11 @@ struct cn_work_est {
  * @cw_mark:         oldest kvset to be compacted
  * @cw_kvset_cnt:    number of kvsets to be compacted
  * @cw_action:       spill, k-compact, or kv-compact
+ * @cw_vgc_pct:      if non-zero, a k-compaction rewrites the referenced values
+ *                   of the input kvsets whose vblock garbage pct (see
+ *                   kvset_get_vgarb_pct()) is at least this much
+ * @cw_mclass:       media class (enum mp_media_classp) of the output of a
+ *                   CN_CR_LTIER kv-compaction
  * @cw_rspill_link:  for adding struct to root node's list of completed spills
  * @cw_rspill_done:  if set, then root spill compaction work is done
  * @cw_rspill_busy:  if set, then root spill compaction work is done and the
@@ -144,14 +179,25 @@ struct cn_work_est {
  * @cw_dgen_lo:      the dgen of the oldest kvset to be compacted
  * @cw_active_count: for tracking the number of active "root" or "other" threads
  * @cw_horizon:      sequence number horizon to use while compacting
+ * @cw_ttl_seq:      entries at or below this seqno have expired (time-to-live)
+ * @cw_cfilter:      compaction filter of the kvs, if any (see cn_comp_filter())
+ * @cw_cfilter_arg:  argument of @cw_cfilter
+ * @cw_cfiltered:    @cw_cfilter dropped or replaced a value
  * @cw_debug:        enables debug stats
  * @cw_outc:         number of output kvsets
  * @cw_outv:         outputs (mblock ids used to make output kvsets)
  * @cw_inputv:       number of input kvsets
+ * @cw_arena:        arena for the input iterators and their reader state
  * @cw_vbmap:        tracks vblocks that are transferred from intput to output
  *                       kvsets during k-compaction
  * @cw_hash_shift:   used to determine output child when spilling
+ * @cw_split:        key ranges of the output children, if spilling in a
+ *                   range tree
+ * @cw_move:         spill by moving the input kvsets to the children whole
  * @cw_drop_tombv:   if true, then tombstones can be dropped in the merge loop
+ * @cw_ckpt_sz:      spill output bytes between checkpoints, zero to disable
+ * @cw_resume:       checkpoint of the spill to resume (keys up to and
+ *                   including its key are already in the children)
  * @cw_work_txid:    the cndb transaction id
  * @cw_commitc:      keeps track of how many output mblocks have been committed
  * @cw_keep_vblks:   indicates whether or not vblocks should be deleted or
@@ -171,6 +217,10 @@ struct cn_compaction_work {
     /* initialized in cn_compaction() */
     struct work_struct       cw_work;
     u64                      cw_horizon;
+    u64                      cw_ttl_seq;
+    kvs_cfilter_fn *         cw_cfilter;
+    void *                   cw_cfilter_arg;
+    bool                     cw_cfiltered;
     uint                     cw_iter_flags;
     uint                     cw_debug;
     bool                     cw_canceled;
@@ -194,6 +244,8 @@ struct cn_compaction_work {
     uint                     cw_pfx_len;
     enum cn_action           cw_action;
     enum cn_comp_rule        cw_comp_rule;
+    uint                     cw_vgc_pct;
+    uint                     cw_mclass;
     bool                     cw_have_token;
     bool                     cw_rspill_conc;
     struct list_head         cw_rspill_link;
@@ -222,9 +274,14 @@ struct cn_compaction_work {
     uint                  cw_outc;
     struct kvset_mblocks *cw_outv;
     struct kv_iterator ** cw_inputv;
+    struct cheap *        cw_arena;
     struct kvset_vblk_map cw_vbmap;
     u32                   cw_hash_shift;
+    struct cn_split *     cw_split;
+    bool                  cw_move;
     bool *                cw_drop_tombv;
+    u64                   cw_ckpt_sz;
+    struct cn_node_ckpt * cw_resume;
 
     /* initialized in cn_compaction_worker() */
     u64                   cw_work_txid;
@@ -251,10 +308,69 @@ cn_tree_ingest_update(
     uint            ptlen,
     u64             ptseq);
 
+/**
+ * cn_tree_ttl_sample() - sample the ingest seqno of a tree for ttl expiry
+ * @tree: tree into which kvsets were just ingested
+ * @seq:  ingest seqno of the tree
+ */
+void
+cn_tree_ttl_sample(struct cn_tree *tree, u64 seq);
+
 /* MTF_MOCK */
 void
 cn_tree_capped_compact(struct cn_tree *tree);
 
+/**
+ * cn_comp_checkpoint_begin() - check whether a spill can checkpoint now
+ * @w: spill work
+ *
+ * Reserves a checkpoint slot in the tree state on the first call for
+ * the spill.  Returns false if the spill cannot checkpoint at this time.
+ */
+bool
+cn_comp_checkpoint_begin(struct cn_compaction_work *w);
+
+/**
+ * cn_comp_checkpoint() - commit the output of a spill produced so far
+ * @w:    spill work, cn_comp_checkpoint_begin() must have returned true
+ * @outv: output mblocks of each child (consumed, success or not)
+ * @kobj: last key spilled, all keys up to and including it are in @outv
+ *
+ * The output is committed as new kvsets in the children, the input
+ * kvsets remain in the node until the spill completes.
+ */
+merr_t
+cn_comp_checkpoint(
+    struct cn_compaction_work *w,
+    struct kvset_mblocks *     outv,
+    const struct key_obj *     kobj);
+
+/**
+ * cn_comp_filter() - run the compaction filter on a value
+ * @w:       compaction work, w->cw_cfilter must be set
+ * @bufp:    (in/out) buffer of the caller's merge loop, allocated on first
+ *           use, to be freed by the caller
+ * @kobj:    key
+ * @vdata:   (in/out) value
+ * @vlen:    (in/out) value length
+ * @complen: (in/out) compressed length of the value, 0 if not compressed
+ * @action:  (output) enum kvs_cfilter_action
+ *
+ * Meant for the newest value of a key at or below the horizon, that is the
+ * value every view sees.  The value is passed to the filter uncompressed.
+ * On KVS_CFILTER_REPLACE, @vdata, @vlen and @complen describe the new value,
+ * which is not compressed and remains valid until the next call.
+ */
+merr_t
+cn_comp_filter(
+    struct cn_compaction_work *w,
+    void **                    bufp,
+    const struct key_obj *     kobj,
+    const void **              vdata,
+    uint *                     vlen,
+    uint *                     complen,
+    int *                      action);
+
 /* MTF_MOCK */
 bool
 cn_node_comp_token_get(struct cn_tree_node *tn);
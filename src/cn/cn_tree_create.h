@@ -20,6 +20,7 @@ struct kvs_rparams;
 struct kvset;
 struct mpool;
 struct kvs_cparams;
+struct wbt_icache;
 
 /**
  * cn_tree_create() - Create a CN_TREE and associate it with
@@ -83,6 +84,16 @@ cn_tree_setup(
 void
 cn_tree_set_initial_dgen(struct cn_tree *tree, u64 dgen);
 
+/**
+ * cn_tree_set_icache() - set the wbt index node cache for the tree's kvsets
+ * @tree: tree to update
+ * @ic:   index node cache, owned by the caller (may be NULL)
+ *
+ * Must be called before kvsets are added to the tree.
+ */
+void
+cn_tree_set_icache(struct cn_tree *tree, struct wbt_icache *ic);
+
 /**
  * cn_tree_insert_kvset() - Add kvset to a tree node during tree initialization
  * @tree:  cn tree structure
@@ -99,6 +110,35 @@ cn_tree_set_initial_dgen(struct cn_tree *tree, u64 dgen);
 merr_t
 cn_tree_insert_kvset(struct cn_tree *tree, struct kvset *kvset, uint level, uint offset);
 
+/**
+ * cn_tree_ckpt_restore() - restore the spill checkpoints of a tree
+ * @tree: tree whose kvsets have all been added
+ *
+ * The checkpointed spills are resumed by csched from where they left off.
+ */
+void
+cn_tree_ckpt_restore(struct cn_tree *tree);
+
+/**
+ * cn_tree_split_restore() - restore the key ranges of the nodes of a range tree
+ * @tree: tree whose kvsets have all been added
+ */
+merr_t
+cn_tree_split_restore(struct cn_tree *tree);
+
+/**
+ * cn_tree_ttl_init() - initialize the time-to-live expiry of a tree
+ * @tree:     tree
+ * @ttl_secs: time-to-live of the entries, zero if they never expire
+ * @seq:      ingest seqno of the tree
+ *
+ * Restores the expiry horizon recorded in the tree state, entries
+ * ingested before the tree was opened expire no sooner than @ttl_secs
+ * from now.
+ */
+void
+cn_tree_ttl_init(struct cn_tree *tree, u64 ttl_secs, u64 seq);
+
 /* MTF_MOCK */
 void
 cn_tree_samp_init(struct cn_tree *tree);
@@ -10,10 +10,14 @@
 
 #include <hse_util/mutex.h>
 #include <hse_util/list.h>
+#include <hse_util/key_util.h>
+#include <hse_util/rcu.h>
 
 #include <hse/hse_limits.h>
 
+#include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/sched_sts.h>
+#include <hse_ikvdb/kvset_view.h>
 
 #include "cn_tree.h"
 #include "cn_tree_iter.h"
@@ -23,6 +27,7 @@
 #include "csched_sp3.h"
 
 struct hlog;
+struct wbt_icache;
 
 /* Each node in a cN tree contains a list of kvsets that must be protected
  * against concurrent update.  Since update of the list is relatively rare,
@@ -97,12 +102,78 @@ struct cn_khashmap {
     u8         khm_mapv[CN_TSTATE_KHM_SZ];
 };
 
+#define CN_TTL_SAMPLES (64)
+
+/**
+ * struct cn_ttl - time-to-live expiry of the entries of a tree
+ * @ttl_lock:   protects the samples and @ttl_persisted
+ * @ttl_ns:     time-to-live of entries, zero if they never expire
+ * @ttl_seq:    seqno at or below which all entries are expired
+ * @ttl_next:   time at which the oldest sample expires, U64_MAX if none
+ * @ttl_persisted: @ttl_seq as last recorded in the tree state
+ * @ttl_head:   index of the oldest sample
+ * @ttl_cnt:    number of samples
+ * @ttl_timev:  sample times
+ * @ttl_seqv:   sample seqnos, entries at or below one were put before its time
+ *
+ * Seqnos order puts in time, so entries ttl_ns old are those at or below
+ * the seqno sampled ttl_ns ago (see cn_tree_ttl_seq()).
+ */
+struct cn_ttl {
+    spinlock_t ttl_lock;
+    u64        ttl_ns;
+    atomic64_t ttl_seq;
+    atomic64_t ttl_next;
+    u64        ttl_persisted;
+    uint       ttl_head;
+    uint       ttl_cnt;
+    u64        ttl_timev[CN_TTL_SAMPLES];
+    u64        ttl_seqv[CN_TTL_SAMPLES];
+};
+
+#define CN_CVIEW_SLOTS (8)
+
+/**
+ * struct cn_cview - immutable list of the kvsets on a cursor route
+ * @cv_ref:     reference count, the cache slot holding the view has one
+ * @cv_gen:     value of ct_view_gen when the list was taken
+ * @cv_route:   prefix hash of the route, zero for the whole tree
+ * @cv_pfx:     true if the route descends the tree by prefix hash
+ * @cv_dgen:    largest dgen of the kvsets in the list
+ * @cv_kvsetc:  number of kvsets in @cv_kvsetv
+ * @cv_kvsetv:  kvsets in tree traversal order, each with a reference
+ *
+ * All cursors created on a route between two changes of the tree see
+ * the same kvsets, so they share one list rather than each walking
+ * the tree under its read lock.
+ */
+struct cn_cview {
+    atomic_t          cv_ref;
+    u64               cv_gen;
+    u64               cv_route;
+    bool              cv_pfx;
+    u64               cv_dgen;
+    uint              cv_kvsetc;
+    struct kvset_view cv_kvsetv[];
+};
+
+/**
+ * struct cn_cview_cache - cache of shared cursor views
+ * @cc_lock:   protects @cc_viewv
+ * @cc_viewv:  views indexed by route
+ */
+struct cn_cview_cache {
+    spinlock_t       cc_lock;
+    struct cn_cview *cc_viewv[CN_CVIEW_SLOTS];
+};
+
 /**
  * struct cn_tree - the cn tree (tree of nodes holding kvsets)
  * @ct_root:        root node of tree
  * @ct_khashmap:    ptr to key hash map
  * @ct_cp:          cn create-time parameters
  * @ct_fanout_bits: log base2 of tree fanout
+ * @ct_range:       children are chosen by key range rather than by hash
  * @ds:    dataset
  * @cn:    ptr to parent cn object
  * @rp:    ptr to shared runtime parameters struct
@@ -122,6 +193,13 @@ struct cn_khashmap {
  * @ct_last_ptlen:  length of @ct_last_ptomb
  * @ct_last_ptomb:  if cn is a capped, this holds the last (largest) ptomb in cn
  * @ct_kle_cache:   kvset list entry cache
+ * @ct_icache:      wbt index node cache shared by the tree's kvsets
+ * @ct_pin_bytes:   bytes of kvset pages pinned in memory
+ * @ct_pin_lvlv:    bytes of kvset pages pinned in memory, by cn level
+ * @ct_ckptv:       nodes owning the spill checkpoint slots of @ct_tstate
+ * @ct_ttl:         time-to-live expiry of the tree's entries
+ * @ct_view_gen:    bumped under @ct_lock by each change to the kvset lists
+ * @ct_cview:       shared cursor views at @ct_view_gen
  * @ct_lock:        read-mostly lock to protect kvset list
  *
  * Note: The first fields are frequently accessed in the order listed
@@ -136,12 +214,15 @@ struct cn_tree {
     u16                  ct_depth_max;
     u16                  ct_sfx_len;
     bool                 ct_nospace;
+    bool                 ct_range;
     struct cn *          cn;
     struct mpool *       ds;
     struct kvs_rparams * rp;
+    struct wbt_icache *  ct_icache;
 
-    struct cn_khashmap ct_khmbuf;
-    struct cn_tstate * ct_tstate;
+    struct cn_khashmap   ct_khmbuf;
+    struct cn_tstate *   ct_tstate;
+    struct cn_tree_node *ct_ckptv[CN_TSTATE_CKPT_MAX];
 
     struct cndb *       cndb;
     struct cn_kvdb *    cn_kvdb;
@@ -168,11 +249,86 @@ struct cn_tree {
     u32 ct_last_ptlen;
     u8  ct_last_ptomb[HSE_KVS_MAX_PFXLEN];
 
+    __aligned(SMP_CACHE_BYTES) atomic64_t ct_pin_bytes;
+    atomic64_t ct_pin_lvlv[CN_PIN_LVL_MAX];
+
     __aligned(SMP_CACHE_BYTES) struct cn_kle_cache ct_kle_cache;
 
+    __aligned(SMP_CACHE_BYTES) struct cn_ttl ct_ttl;
+
+    __aligned(SMP_CACHE_BYTES) atomic64_t ct_view_gen;
+    struct cn_cview_cache ct_cview;
+
     __aligned(SMP_CACHE_BYTES) struct rmlock ct_lock;
 };
 
+/**
+ * struct cn_node_ckpt - checkpoint of a spill from a node
+ * @nc_dgen_lo: dgen of the oldest kvset being spilled
+ * @nc_dgen_hi: dgen of the newest kvset being spilled
+ * @nc_slot:    index of the checkpoint slot in the tree state
+ * @nc_klen:    length of @nc_key, zero until the first checkpoint commits
+ * @nc_key:     last key already spilled, the spill resumes after it
+ *
+ * Each checkpoint commits the output produced so far into the children
+ * as kvsets with dgen @nc_dgen_lo, while the input kvsets stay in the
+ * node until the spill completes.
+ */
+struct cn_node_ckpt {
+    u64  nc_dgen_lo;
+    u64  nc_dgen_hi;
+    uint nc_slot;
+    uint nc_klen;
+    u8   nc_key[HSE_KVS_KLEN_MAX];
+};
+
+/**
+ * struct cn_split - key ranges of the children of a node of a range tree
+ * @cs_splitc: number of splitters
+ * @cs_splitv: splitters, ascending
+ *
+ * A key goes to the child whose index is the number of splitters less
+ * than or equal to the key, truncated to the prefix length at the levels
+ * that spill by prefix.  The splitters of a node never change once set,
+ * so they may be read by holding either the tree lock or a reference on
+ * the node (e.g., a spill from it).
+ */
+struct cn_split {
+    uint           cs_splitc;
+    struct key_obj cs_splitv[];
+};
+
+/**
+ * struct cn_kvsnap - immutable snapshot of the kvsets of a node
+ * @ksn_rcu:     deferred free
+ * @ksn_cn:      cn to hold a reference on while the free is deferred
+ * @ksn_kvsetc:  number of kvsets in @ksn_kvsetv
+ * @ksn_fencev:  key fences of @ksn_kvsetv, a (lo, hi) pair per kvset
+ * @ksn_seqminv: running min of the kvsets' min seqnos, see below
+ * @ksn_kvsetv:  the kvsets of the node, newest first
+ *
+ * Lookups search a node's kvsets through its snapshot under rcu rather
+ * than its kvset list under the tree read lock.  A snapshot holds a
+ * reference on each of its kvsets.  See cn_node_kvsnap_publish().
+ *
+ * The fences (see kvset_key_fences()) are packed apart from the kvsets
+ * so that a point lookup rules out the kvsets that cannot hold its key
+ * without touching them.  See cn_kvsnap_fence_mask().
+ *
+ * @ksn_seqminv[i] is the smallest min seqno of kvsets [0, i], and so is
+ * non-increasing.  A read at view seqno @seq can see nothing in kvsets
+ * [0, i) where i is the first index with @ksn_seqminv[i] <= @seq, which
+ * a snapshot read finds by binary search.  See cn_kvsnap_seq_first().
+ */
+struct cn_kvsnap {
+    struct rcu_head ksn_rcu;
+    struct cn *     ksn_cn;
+    uint            ksn_kvsetc;
+    u64 *           ksn_fencev;
+    u64 *           ksn_seqminv;
+    struct kvset *  ksn_kvsetv[];
+};
+
 /**
  * struct cn_tree_node - A node in a k-way cn_tree
  * @tn_rspills_lock:  lock to protect @tn_rspills
@@ -187,6 +343,9 @@ struct cn_tree {
  * @tn_loc:          location of node within tree
  * @tn_kvset_cnt:    number of kvsets  in node
  * @tn_pfx_spill:    true if spills/scans from this node use the prefix hash
+ * @tn_ckpt:         checkpoint of the oldest spill from this node, if any
+ * @tn_split:        key ranges of the children, if the tree is a range tree
+ * @tn_kvsnap:       rcu protected snapshot of @tn_kvset_list for lookups
  * @tn_tree:         ptr to tree struct
  * @tn_parent:       parent node
  * @tn_child:        child nodes
@@ -212,6 +371,9 @@ struct cn_tree_node {
     __aligned(SMP_CACHE_BYTES) struct cn_node_loc tn_loc;
     bool                 tn_terminal_node_warning;
     bool                 tn_pfx_spill;
+    struct cn_node_ckpt *tn_ckpt;
+    struct cn_split *    tn_split;
+    struct cn_kvsnap *   tn_kvsnap;
     struct list_head     tn_kvset_list; /* head = newest kvset */
     struct cn_tree *     tn_tree;
     struct cn_tree_node *tn_parent;
@@ -231,6 +393,15 @@ struct cn_tree_node {
 struct cn_tree_node *
 cn_tree_find_node(struct cn_tree *tree, struct cn_node_loc *loc);
 
+/**
+ * cn_split_child() - get the child of a range tree node to route a key to
+ * @split:   splitters of the node
+ * @pfx_len: prefix length if the node spills by prefix, else zero
+ * @kobj:    key
+ */
+uint
+cn_split_child(const struct cn_split *split, uint pfx_len, const struct key_obj *kobj);
+
 /* MTF_MOCK */
 merr_t
 cn_tree_create_node(
@@ -260,6 +431,20 @@ cn_node_isroot(const struct cn_tree_node *node);
 uint
 cn_node_level(const struct cn_tree_node *node);
 
+/**
+ * cn_node_ptomb_hidden() - check whether a kvset is hidden by a ptomb
+ * @tn:      node that holds the kvset
+ * @le:      list entry of the kvset
+ * @horizon: seqno horizon, only ptombs at or below it count
+ *
+ * Returns true if all the keys of the kvset share one tree prefix and a
+ * newer kvset, in @tn or an ancestor, holds a ptomb for that prefix that
+ * is newer than every entry of the kvset.  Such a kvset can be deleted
+ * without being read.  The caller must hold the tree lock.
+ */
+bool
+cn_node_ptomb_hidden(struct cn_tree_node *tn, struct kvset_list_entry *le, u64 horizon);
+
 /* MTF_MOCK */
 void
 cn_comp(struct cn_compaction_work *w);
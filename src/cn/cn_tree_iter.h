@@ -73,6 +73,22 @@ cn_tree_preorder_walk(
     cn_tree_walk_callback_fn *callback,
     void *                    rock);
 
+/**
+ * cn_tree_kvset_next() - get the kvset with the next larger tag
+ * @tree: tree to search
+ * @tag:  tag of the previous kvset, 0 for the first
+ * @loc:  (output) location of the kvset's node
+ *
+ * Visits every kvset of a tree once, in creation order, without holding
+ * the tree lock between calls.  Kvsets created since the previous call
+ * are included, kvsets deleted since are skipped.
+ *
+ * Return: the kvset with a reference the caller must put, or NULL if
+ * no kvset has a larger tag.
+ */
+struct kvset *
+cn_tree_kvset_next(struct cn_tree *tree, u64 tag, struct cn_node_loc *loc);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "cn_tree_iter_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -10,6 +10,7 @@
 #include <hse_util/string.h>
 #include <hse_util/log2.h>
 #include <hse_util/atomic.h>
+#include <hse_util/compression.h>
 
 #define MTF_MOCK_IMPL_cndb
 #define MTF_MOCK_IMPL_cndb_internal
@@ -804,6 +805,10 @@ cndb_import_md(struct cndb *cndb, struct cndb_hdr_omf *buf, union cndb_mtu **mtu
             .cp_pfx_len = mti->mti_prefix_len,
             .cp_sfx_len = mti->mti_sfx_len,
             .cp_pfx_pivot = mti->mti_prefix_pivot,
+            .cp_vcomp = mti->mti_flags & CN_CFLAG_VCOMP_LZ4 ? VCOMP_ALGO_LZ4 : VCOMP_ALGO_NONE,
+            .cp_range = mti->mti_flags & CN_CFLAG_RANGE ? 1 : 0,
+            .cp_ptlookup = mti->mti_flags & CN_CFLAG_PTLOOKUP ? 1 : 0,
+            .cp_kfixed = cn_cflags_kfixed(mti->mti_flags),
         };
 
         err = cndb_cnv_add(
@@ -1069,9 +1074,8 @@ cndb_drop_mtx(struct cndb *cndb, union cndb_mtu *mtu, struct cndb_tx *txp)
     switch (mtu->h.mth_type) {
 
         case CNDB_TYPE_TXC:
+            /* The mblocks were deleted before the cn was purged. */
             txp->mtx_nc--;
-            mtu->c.mtc_keepvbc = 0; /* delete all mblocks */
-            err = cndb_blkdel(cndb, mtu, txp->mtx_id);
             break;
         case CNDB_TYPE_TXD:
             txp->mtx_nd--;
@@ -1134,6 +1138,10 @@ cndb_blkdel(struct cndb *cndb, union cndb_mtu *mtu, u64 txid)
 
     assert(mtu->h.mth_type == CNDB_TYPE_TXD || mtu->h.mth_type == CNDB_TYPE_TXC);
 
+    /* The mblocks of a moved kvset still belong to its old tag. */
+    if (mtu->h.mth_type == CNDB_TYPE_TXC && txc->mtc_keepvbc == CNDB_KEEP_ALL)
+        return 0;
+
     blk_list_init(&blks);
 
     if (mtu->h.mth_type == CNDB_TYPE_TXD) {
@@ -1402,7 +1410,7 @@ md_rollback(struct cndb *cndb, int from, int to)
     merr_t          err = 0;
     /* we will roll backward
      * 1) loop [from:to].  for each c record:
-     *        delete kblocks
+     *        delete kblocks, unless keepvbc is CNDB_KEEP_ALL
      *        if (!keepvbc)
      *              delete vblocks
      * 2) deallocate each record and remove it from workv.
@@ -1437,6 +1445,7 @@ md_reap(struct cndb *cndb, int from, int to, struct txstate *needed, struct txst
     merr_t err = 0;
 
     txid = mtxid(cndb->cndb_workv[from]);
+    cndb->cndb_reaped = true;
 
     if (seen->ackc) {
         int unseen;
@@ -2012,6 +2021,39 @@ cndb_putref(struct cndb *cndb)
 static merr_t
 cndb_rollover(struct cndb *cndb);
 
+/* Compact cndb, rewriting the MDC only when that is needed to persist the
+ * outcome: a recovered transaction, a dropped kvs, a media version upgrade,
+ * or a log past its high water mark.  Otherwise the MDC holds the snapshot
+ * written by the last rollover plus a tail that replays to the same state,
+ * and rewriting all of it would only lengthen kvdb and kvs open.
+ */
+static merr_t
+cndb_compact_or_rollover(struct cndb *cndb)
+{
+    size_t usage = 0;
+    merr_t err;
+
+    if (cndb->cndb_rdonly)
+        return cndb_compact(cndb);
+
+    if (cndb->cndb_version != CNDB_VERSION)
+        return cndb_rollover(cndb);
+
+    err = mpool_mdc_usage(cndb->cndb_mdc, &usage);
+    if (ev(err) || usage >= cndb->cndb_high_water)
+        return cndb_rollover(cndb);
+
+    cndb->cndb_reaped = false;
+
+    err = cndb_compact(cndb);
+    if (err || !cndb->cndb_reaped)
+        return err;
+
+    CNDB_LOG(0, cndb, HSE_NOTICE, " recovered transactions, rolling over");
+
+    return cndb_rollover(cndb);
+}
+
 static merr_t
 cndb_read(struct cndb *cndb, size_t *len)
 {
@@ -2065,6 +2107,7 @@ cndb_replay(struct cndb *cndb, u64 *seqno, u64 *ingestid)
 
     cndb->cndb_keepc = 0;
     cndb->cndb_workc = 0;
+    cndb->cndb_replayc = 1;
 
     /* First record must be a valid version record */
     err = cndb_read(cndb, &len);
@@ -2145,6 +2188,8 @@ cndb_replay(struct cndb *cndb, u64 *seqno, u64 *ingestid)
         if (len == 0 || ev(err, HSE_ERR))
             break;
 
+        cndb->cndb_replayc++;
+
         err = cndb_import_md(cndb, cndb->cndb_cbuf, &mtu);
         if (ev(err, HSE_ERR))
             return err;
@@ -2173,10 +2218,7 @@ cndb_replay(struct cndb *cndb, u64 *seqno, u64 *ingestid)
         return err;
     }
 
-    if (cndb->cndb_rdonly)
-        err = cndb_compact(cndb);
-    else
-        err = cndb_rollover(cndb);
+    err = cndb_compact_or_rollover(cndb);
 
     if (!err) {
         if (cndb->cndb_workc) {
@@ -2188,7 +2230,7 @@ cndb_replay(struct cndb *cndb, u64 *seqno, u64 *ingestid)
             CNDB_LOG(err, cndb, HSE_ERR, "");
         }
     } else {
-        CNDB_LOG(err, cndb, HSE_ERR, " %s failed", cndb->cndb_rdonly ? "compact" : "rollover");
+        CNDB_LOG(err, cndb, HSE_ERR, " compaction failed");
     }
 
     for (i = 0, cndb->cndb_cnid = 0; i < cndb->cndb_cnc; i++)
@@ -2219,11 +2261,20 @@ cndb_seqno(struct cndb *cndb)
     return cndb->cndb_seqno;
 }
 
+u64
+cndb_replay_recs(struct cndb *cndb)
+{
+    return cndb->cndb_replayc;
+}
+
 merr_t
 cndb_cn_count(struct cndb *cndb, u32 *cnt)
 {
+    int i;
+
     mutex_lock(&cndb->cndb_cnv_lock);
-    *cnt = cndb->cndb_cnc;
+    for (i = 0, *cnt = 0; i < cndb->cndb_cnc; i++)
+        *cnt += !cndb->cndb_cnv[i]->cn_removed;
     mutex_unlock(&cndb->cndb_cnv_lock);
 
     return 0;
@@ -2320,16 +2371,28 @@ cndb_cn_info_idx(
     size_t               namelen)
 {
     merr_t          err = 0;
-    struct cndb_cn *cn;
+    struct cndb_cn *cn = NULL;
+    u32             n = 0;
+    int             i;
 
     mutex_lock(&cndb->cndb_cnv_lock);
-    if (idx >= cndb->cndb_cnc) {
+
+    /* Dropped cns are not counted by cndb_cn_count(), skip them. */
+    for (i = 0; i < cndb->cndb_cnc; i++) {
+        if (cndb->cndb_cnv[i]->cn_removed)
+            continue;
+
+        if (n++ == idx) {
+            cn = cndb->cndb_cnv[i];
+            break;
+        }
+    }
+
+    if (!cn) {
         err = ev(merr(ESTALE), HSE_ERR);
         goto errout;
     }
 
-    cn = cndb->cndb_cnv[idx];
-
     /* [HSE_REVISIT] is it useful to provide refcnt or removed? */
     if (cnid)
         *cnid = cn->cn_cnid;
@@ -2410,12 +2473,8 @@ cndb_cn_instantiate(struct cndb *cndb, u64 cnid, void *ctx, cn_init_callback *cb
 
     /* Processes which open, close, and re-open cN require a compact.
      */
-    if (!cndb->cndb_compacted) {
-        if (cndb->cndb_rdonly)
-            err = cndb_compact(cndb);
-        else
-            err = cndb_rollover(cndb);
-    }
+    if (!cndb->cndb_compacted)
+        err = cndb_compact_or_rollover(cndb);
 
     if (ev(err, HSE_ERR))
         goto done;
@@ -2578,8 +2637,7 @@ cndb_rollover(struct cndb *cndb)
     int    i;
     merr_t err = 0;
     size_t sz;
-    u64    drop_cnid = 0;
-    int    drop_idx = -1;
+    u64    drop_cnid;
 
     struct cndb_hdr_omf * buf = (void *)cndb->cndb_cbuf;
     struct cndb_ver_omf * ver = NULL;
@@ -2641,22 +2699,8 @@ cndb_rollover(struct cndb *cndb)
         struct cndb_cn *cn;
 
         cn = cndb->cndb_cnv[i];
-        if (cn->cn_removed) {
-            if (drop_cnid || (drop_idx != -1)) {
-                err = merr(EPROTO);
-                CNDB_LOG(
-                    err,
-                    cndb,
-                    HSE_ERR,
-                    " nested kvs drop (%lu, %lu)",
-                    (ulong)drop_cnid,
-                    (ulong)cn->cn_cnid);
-                goto errout;
-            }
-            drop_idx = i;
-            drop_cnid = cn->cn_cnid;
+        if (cn->cn_purged)
             continue;
-        }
 
         inf = (void *)cn->cn_cbuf;
         sz = sizeof(*inf);
@@ -2670,16 +2714,32 @@ cndb_rollover(struct cndb *cndb)
             CNDB_LOG(err, cndb, HSE_ERR, " info %lu failed", (ulong)cn->cn_cnid);
             goto errout;
         }
+
+        if (!cn->cn_removed)
+            continue;
+
+        /* A dropped cn keeps its records until it is purged. */
+        cndb_info2omf(CNDB_TYPE_INFOD, cn, inf);
+
+        err = mpool_mdc_append(cndb->cndb_mdc, inf, sizeof(*inf), false);
+        if (err) {
+            CNDB_LOG(err, cndb, HSE_ERR, " infod %lu failed", (ulong)cn->cn_cnid);
+            goto errout;
+        }
     }
 
-    if (drop_cnid) {
-        cndb_cnv_del(cndb, drop_idx);
+    for (i = cndb->cndb_cnc - 1; i >= 0; i--) {
+        if (!cndb->cndb_cnv[i]->cn_purged)
+            continue;
+
+        drop_cnid = cndb->cndb_cnv[i]->cn_cnid;
+        cndb_cnv_del(cndb, i);
+
         err = cndb_cull(cndb, drop_cnid);
         if (err) {
             CNDB_LOG(err, cndb, HSE_ERR, " cull cnid %lu failed", (ulong)drop_cnid);
             goto errout;
         }
-        cndb_defragment(cndb);
     }
 
     /* ensure no uninitialized bytes in the output record.
@@ -2984,6 +3044,20 @@ cndb_cn_make2(struct cndb *cndb, struct kvs_cparams *cparams, u64 *cnid_out, con
     if (cparams->cp_kvs_ext01)
         flags |= CN_CFLAG_CAPPED;
 
+    if (cparams->cp_vcomp == VCOMP_ALGO_LZ4)
+        flags |= CN_CFLAG_VCOMP_LZ4;
+
+    if (cparams->cp_range)
+        flags |= CN_CFLAG_RANGE;
+
+    if (cparams->cp_ptlookup)
+        flags |= CN_CFLAG_PTLOOKUP;
+
+    if (cparams->cp_kfixed == 8)
+        flags |= CN_CFLAG_KFIXED8;
+    else if (cparams->cp_kfixed == 16)
+        flags |= CN_CFLAG_KFIXED16;
+
     omf_set_cninfo_flags(&info, flags);
 
     mutex_lock(&cndb->cndb_cnv_lock);
@@ -3053,6 +3127,12 @@ cndb_cn_drop(struct cndb *cndb, u64 cnid)
         goto done;
     }
 
+    if (ev(cn->cn_removed)) {
+        err = merr(ENOENT);
+        msg = " already dropped";
+        goto done;
+    }
+
     if (ev(cn->cn_refcnt)) {
         err = merr(EBUSY);
         goto done;
@@ -3063,26 +3143,135 @@ cndb_cn_drop(struct cndb *cndb, u64 cnid)
 
     assert(cn->cn_cnid == cnid);
     cn->cn_removed = true;
-    cn = NULL; /* Might be freed by cndb_journal() */
 
+    /* The mblocks are left to cndb_cn_dropped() and cndb_cn_purge(). */
     err = cndb_journal(cndb, &inf, sizeof(inf));
-    if (ev(err)) {
+    if (ev(err))
         msg = " drop tx failed";
-        goto done;
+
+done:
+    mutex_unlock(&cndb->cndb_cnv_lock);
+
+    if (err)
+        CNDB_LOG(err, cndb, HSE_ERR, "cnid %lu%s", (ulong)cnid, msg);
+
+    return err;
+}
+
+static merr_t
+cndb_dropped_add(void **vector, size_t count, u64 cnid, u64 **mbidv, uint *mbidc, uint *mbida)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        union cndb_mtu *mtu = vector[i];
+        uint            n;
+
+        if (!mtu || mtu->h.mth_type != CNDB_TYPE_TXC || mtu->c.mtc_cnid != cnid)
+            continue;
+
+        /* kblock ids, then vblock ids, including those kept from the
+         * kvsets that were compacted into this one.
+         */
+        n = mtu->c.mtc_kcnt + mtu->c.mtc_vcnt;
+
+        if (*mbidc + n > *mbida) {
+            uint  newa = max_t(uint, *mbida * 2, *mbidc + n);
+            void *p;
+
+            p = realloc(*mbidv, newa * sizeof(**mbidv));
+            if (ev(!p))
+                return merr(ENOMEM);
+
+            *mbidv = p;
+            *mbida = newa;
+        }
+
+        memcpy(*mbidv + *mbidc, &mtu->c + 1, n * sizeof(**mbidv));
+        *mbidc += n;
     }
 
-    /* cndb_rollover removes the indicated cn and culls its metadata */
+    return 0;
+}
+
+merr_t
+cndb_cn_dropped(struct cndb *cndb, u64 *cnid, u64 **mbidv, uint *mbidc)
+{
+    struct cndb_cn *cn = NULL;
+    merr_t          err = 0;
+    uint            mbida = 0;
+    u64             id = 0;
+    int             i;
+
+    *cnid = 0;
+    *mbidv = NULL;
+    *mbidc = 0;
+
+    mutex_lock(&cndb->cndb_cnv_lock);
     mutex_lock(&cndb->cndb_lock);
-    err = cndb_rollover(cndb);
+
+    for (i = 0; i < cndb->cndb_cnc; i++) {
+        if (cndb->cndb_cnv[i]->cn_removed && !cndb->cndb_cnv[i]->cn_purged) {
+            cn = cndb->cndb_cnv[i];
+            break;
+        }
+    }
+
+    if (cn) {
+        id = cn->cn_cnid;
+
+        err = cndb_dropped_add(cndb->cndb_keepv, cndb->cndb_keepc, id, mbidv, mbidc, &mbida);
+        if (!err)
+            err = cndb_dropped_add(cndb->cndb_workv, cndb->cndb_workc, id, mbidv, mbidc, &mbida);
+        if (!err)
+            *cnid = id;
+    }
+
     mutex_unlock(&cndb->cndb_lock);
+    mutex_unlock(&cndb->cndb_cnv_lock);
 
-    msg = " rollover failed, cndb_cn_drop may be retried on next r/w open";
+    if (err) {
+        CNDB_LOG(err, cndb, HSE_ERR, " cnid %lu mblock list failed", (ulong)id);
+        free(*mbidv);
+        *mbidv = NULL;
+        *mbidc = 0;
+    }
+
+    return err;
+}
+
+merr_t
+cndb_cn_purge(struct cndb *cndb, u64 cnid)
+{
+    struct cndb_cn *cn = NULL;
+    merr_t          err;
+
+    mutex_lock(&cndb->cndb_cnv_lock);
+    mutex_lock(&cndb->cndb_lock);
+
+    err = cndb_cnv_get(cndb, cnid, &cn);
+    if (ev(err))
+        goto done;
+
+    if (ev(!cn->cn_removed)) {
+        err = merr(EINVAL);
+        goto done;
+    }
+
+    /* cndb_rollover() removes the purged cn and culls its metadata.
+     * Should it fail, the next rollover will.
+     */
+    cn->cn_purged = true;
+    cn = NULL;
+
+    err = cndb_rollover(cndb);
 
 done:
+    mutex_unlock(&cndb->cndb_lock);
     mutex_unlock(&cndb->cndb_cnv_lock);
 
     if (err)
-        CNDB_LOG(err, cndb, HSE_ERR, "cnid %lu%s", (ulong)cnid, msg);
+        CNDB_LOG(err, cndb, HSE_ERR, " cnid %lu purge failed", (ulong)cnid);
 
     return err;
 }
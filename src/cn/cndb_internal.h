@@ -50,6 +50,11 @@ struct mpool;
 #define CNDB_CAPTGT_DEFAULT (CNDB_ENTRIES * CNDB_CBUFSZ_DEFAULT / 4)
 #define CNDB_HIGH_WATER(c) ((c)->cndb_captgt * 3 / 4)
 
+/* Dropped cns remain in cndb_cnv[] until their mblocks have been reaped,
+ * leave room for as many of them as there can be live ones.
+ */
+#define CNDB_CNV_MAX (2 * HSE_KVS_COUNT_MAX)
+
 struct cndb_cn {
     struct kvs_cparams cn_cp;
     u32                cn_flags;
@@ -57,6 +62,7 @@ struct cndb_cn {
     u64                cn_cnid;
     size_t             cn_cbufsz;
     bool               cn_removed;
+    bool               cn_purged;
     char               cn_name[CNDB_CN_NAME_MAX];
 
     /* cn_cbuf is used to format updated info records. At all times, it
@@ -119,6 +125,8 @@ struct cndb_ingest_replay {
  *  (aka CNDB_VERSION).
  * @cndb_rdonly:
  * @cndb_compacted:
+ * @cndb_reaped: a compaction rolled a transaction forward or back, which
+ *      only a rollover persists
  * @cndb_txid:
  * @cndb_captgt:
  * @cndb_high_water:
@@ -160,6 +168,7 @@ struct cndb_ingest_replay {
  * @cndb_cbufsz: protected by cndb_lock
  * @cndb_cbuf:   protected by cndb_lock
  * @cndb_ing_rep: used to determine the id of the last successful ingest.
+ * @cndb_replayc: number of records read by cndb_replay()
  *
  * The id of the last successful ingest (stored in cndb_ing_rep) is
  * passed to C1 at the end of cndb replay.
@@ -175,6 +184,7 @@ struct cndb {
     u16                       cndb_version;
     bool                      cndb_rdonly;
     bool                      cndb_compacted;
+    bool                      cndb_reaped;
     atomic64_t                cndb_txid;
     u64                       cndb_captgt;
     u64                       cndb_high_water;
@@ -192,12 +202,13 @@ struct cndb {
     size_t                    cndb_tagc;
     struct cndb_idx **        cndb_tagv;
     struct mutex              cndb_cnv_lock;
-    struct cndb_cn *          cndb_cnv[HSE_KVS_COUNT_MAX]; /* cnv_lock */
-    int                       cndb_cnc;                    /* cnv_lock */
-    u64                       cndb_cnid;                   /* cnv_lock */
+    struct cndb_cn *          cndb_cnv[CNDB_CNV_MAX]; /* cnv_lock */
+    int                       cndb_cnc;               /* cnv_lock */
+    u64                       cndb_cnid;              /* cnv_lock */
     size_t                    cndb_cbufsz;
     void *                    cndb_cbuf;
     struct cndb_ingest_replay cndb_ing_rep;
+    u64                       cndb_replayc;
 };
 
 /* in-memory counterparts to cndb structures */
@@ -250,7 +261,7 @@ struct cndb_tx {
  * @mtc_id:
  * @mtc_tag:
  * @mtc_keepvbc: number of vblocks to keep (NOT to delete in case the CN
- *      mutation is rolled back).
+ *      mutation is rolled back), or CNDB_KEEP_ALL to keep the kblocks too.
  * @mtc_kcnt:
  * @mtc_vcnt:
  * an array of mtc_kcnt mblock OIDs appears here
@@ -46,6 +46,9 @@ csched_create(
         case csched_policy_sp3:
             err = sp3_create(ds, rp, mp, &cs);
             break;
+        case csched_policy_hybrid:
+            err = sp3_hybrid_create(ds, rp, mp, &cs);
+            break;
     }
 
     if (!err)
@@ -128,6 +131,48 @@ csched_tbkt_maint_get(struct csched *handle)
     return 0;
 }
 
+struct tbkt *
+csched_tbkt_vgc_get(struct csched *handle)
+{
+    struct csched_ops *cs = (void *)handle;
+
+    if (cs && cs->cs_tbkt_vgc_get)
+        return cs->cs_tbkt_vgc_get(cs);
+
+    return 0;
+}
+
+uint
+csched_root_len(struct csched *handle)
+{
+    struct csched_ops *cs = (void *)handle;
+
+    if (cs && cs->cs_root_len)
+        return cs->cs_root_len(cs);
+
+    return 0;
+}
+
+bool
+csched_assist(struct csched *handle)
+{
+    struct csched_ops *cs = (void *)handle;
+
+    if (cs && cs->cs_assist)
+        return cs->cs_assist(cs);
+
+    return false;
+}
+
+void
+csched_notify_latency(struct csched *handle, u64 lat_ns)
+{
+    struct csched_ops *cs = (void *)handle;
+
+    if (cs && cs->cs_notify_latency)
+        cs->cs_notify_latency(cs, lat_ns);
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "csched_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
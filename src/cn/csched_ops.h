@@ -31,6 +31,14 @@ struct csched_ops {
 
     struct tbkt *(*cs_tbkt_maint_get)(struct csched_ops *);
 
+    struct tbkt *(*cs_tbkt_vgc_get)(struct csched_ops *);
+
+    uint (*cs_root_len)(struct csched_ops *);
+
+    bool (*cs_assist)(struct csched_ops *);
+
+    void (*cs_notify_latency)(struct csched_ops *, u64);
+
     void (*cs_destroy)(struct csched_ops *);
 };
 
@@ -14,6 +14,7 @@
 #include <hse_ikvdb/ikvdb.h>
 #include <hse_ikvdb/kvdb_perfc.h>
 #include <hse_ikvdb/csched.h>
+#include <hse_ikvdb/io_sched.h>
 #include <hse_ikvdb/sched_sts.h>
 #include <hse_ikvdb/throttle.h>
 #include <hse_ikvdb/kvdb_rparams.h>
@@ -144,17 +145,32 @@ struct mpool;
 /* Red-Black Trees */
 #define RBT_RI_ALEN 0 /* root and internal nodes sorted by alen */
 #define RBT_L_PCAP 1  /* leaf nodes sorted by pct capacity */
-#define RBT_L_GARB 2  /* leaf nodes sorted by garbage */
+#define RBT_L_GARB 2  /* leaf nodes sorted by garbage score */
 #define RBT_LI_LEN 3  /* internal and leaf nodes, sorted by #kvsets */
 #define RBT_L_SCAT 4  /* leaf nodes sorted by vblock scatter */
+#define RBT_LI_TOMB 5 /* internal and leaf nodes sorted by tombstone pct */
+#define RBT_L_VGC 6   /* leaf nodes sorted by reclaimable vblock garbage */
+#define RBT_L_TIER 7  /* leaf nodes sorted by #kvsets on the wrong media class */
+#define RBT_L_PTOMB 8 /* leaf nodes sorted by #kvsets hidden by a newer ptomb */
 
 static const char *const rbt_name[] = {
-    "ri_size", "l_size", "l_garb", "li_len", "l_scat",
+    "ri_size", "l_size", "l_garb", "li_len", "l_scat", "li_tomb", "l_vgc", "l_tier", "l_ptomb",
 };
 
+/**
+ * struct sp3_qinfo - per queue job accounting
+ * @qjobs:       jobs submitted and not yet finished
+ * @qjobs_max:   worker count of the queue
+ * @qjobs_peak:  most jobs seen since the last autoscaler decision
+ * @full_since:  time at which the queue filled up, 0 if not full
+ * @as_reason:   reason of the last autoscaler decision logged
+ */
 struct sp3_qinfo {
-    uint qjobs;
-    uint qjobs_max;
+    uint        qjobs;
+    uint        qjobs_max;
+    uint        qjobs_peak;
+    u64         full_since;
+    const char *as_reason;
 };
 
 static inline bool
@@ -181,6 +197,14 @@ qfull(struct sp3_qinfo *qi)
  * @samp_reduce:      if true, compact while samp > LWM
  * @comp_flags:       compaction flags for an active compaction request
  * @comp_request:     whether a compaction request is active
+ * @hybrid:           tier internal nodes and level leaves (csched_policy_hybrid)
+ * @tier_ok:          the mpool has a staging media class to promote kvsets to
+ * @slo_rate:         compaction write rate cap for the get latency objective
+ *                    (bytes/sec, 0: none)
+ * @slo_rate_hi:      cap at which the pacing for the objective ends
+ * @slo_hold:         defer non-urgent compactions for the objective
+ * @slo_lat:          latest get latency at the objective percentile (ns)
+ * @slo_wbytes:       bytes written by compaction jobs since the last check
  */
 struct sp3 {
     /* Accessed only by monitor thread */
@@ -188,6 +212,8 @@ struct sp3 {
     struct mpool *           ds;
     struct kvdb_rparams *    rp;
     char *                   name;
+    bool                     hybrid;
+    bool                     tier_ok;
     struct sts *             sts;
     struct work_struct       wstruct;
     struct workqueue_struct *wqueue;
@@ -198,9 +224,11 @@ struct sp3 {
     struct rb_root rbt[RBT_MAX];
 
     struct sp3_qinfo qinfo[SP3_NUM_QUEUES];
+    uint             qthreads_min[SP3_NUM_QUEUES];
     uint             jobs_started;
     uint             jobs_finished;
     uint             jobs_max;
+    uint             weight_total;
     uint             rr_job_type;
     u64              job_id;
 
@@ -216,6 +244,8 @@ struct sp3 {
 
     u64 iowrite_limit_burst;
     u64 iowrite_limit_rate;
+    u64 vgc_limit_burst;
+    u64 vgc_limit_rate;
 
     atomic64_t wbyte_spill_rt;
 
@@ -242,6 +272,16 @@ struct sp3 {
 
     u64 qos_prv_log;
 
+    /* Autoscaler I/O scheduler snapshots */
+    struct io_sched_stats as_fg;
+    struct io_sched_stats as_comp;
+
+    /* Get latency objective */
+    u64  slo_rate;
+    u64  slo_rate_hi;
+    u64  slo_prev;
+    bool slo_hold;
+
     /* Tree shape report */
     u64  tree_shape_last_report;
     bool tree_shape_bad;
@@ -268,11 +308,30 @@ struct sp3 {
     /* Accessed by monitor and job threads */
     __aligned(SMP_CACHE_BYTES) struct tbkt tbkt;
 
+    /* Accessed by monitor and value gc job threads */
+    __aligned(SMP_CACHE_BYTES) struct tbkt tbkt_vgc;
+
     /* Accessed by forced compactions and monitor */
     __aligned(SMP_CACHE_BYTES) int comp_flags;
     bool comp_request;
+
+    /* Updated by monitor, read by c0 ingest tuning */
+    atomic_t rlen_max;
+
+    /* Updated by job threads and the kvdb, read by monitor */
+    __aligned(SMP_CACHE_BYTES) atomic64_t slo_lat;
+    atomic64_t slo_wbytes;
 };
 
+/* True if idle shared workers, or idle workers of less urgent queues,
+ * can run a job beyond the queue's own worker count.
+ */
+static inline bool
+qspare(struct sp3 *sp, struct sp3_qinfo *qi)
+{
+    return sts_wcnt_get_idle(sp->sts, qi - sp->qinfo) > 0;
+}
+
 /* external to internal handle */
 #define h2sp(_hdl) container_of(_hdl, struct sp3, ops)
 
@@ -348,6 +407,47 @@ samp_pct_garbage(struct cn_samp_stats *s, uint scale)
     return scale * safe_div(s->l_alen - s->l_good, s->l_alen);
 }
 
+/* A removed kvset is credited as reclaiming 1/SP3_RAMP_DIV of the bytes
+ * its compaction writes.
+ */
+#define SP3_RAMP_DIV 64
+
+/* Benefit/cost score of compacting a leaf node, in SCALE units.  The cost
+ * is the bytes the compaction writes, i.e., the node's estimated length
+ * after compaction (l_good, from the node's hlog).  The benefit is the
+ * garbage it reclaims (l_alen - l_good) plus the read amp it removes, the
+ * number of kvsets a point get no longer has to search.  Garbage ordered
+ * by this score yields the most reclaim per byte written.
+ */
+static u64
+sp3_leaf_garbage_score(struct sp3 *sp, struct cn_tree_node *tn)
+{
+    const struct cn_samp_stats *s = &tn->tn_samp;
+    u64                         written, reclaim, kvsets;
+
+    assert(s->l_alen >= s->l_good);
+
+    written = max_t(s64, s->l_good, 1);
+    reclaim = s->l_alen - s->l_good;
+
+    kvsets = min_t(u64, cn_ns_kvsets(&tn->tn_ns), sp->thresh.lcomp_kvsets_max);
+    kvsets = kvsets > 1 ? kvsets - 1 : 0;
+
+    return SCALE * reclaim / written + SCALE * kvsets / SP3_RAMP_DIV;
+}
+
+/* Convert a leaf garbage percentage to the garbage score of a single kvset
+ * leaf with that much garbage.
+ */
+static u64
+sp3_garbage_pct2score(uint pct)
+{
+    if (pct >= 100)
+        return U64_MAX;
+
+    return (u64)SCALE * pct / (100 - pct);
+}
+
 static void
 sp3_node_init(struct sp3 *sp, struct sp3_node *spn)
 {
@@ -767,6 +867,90 @@ sp3_node_scatter_score_compute(struct sp3_node *spn)
     return n_score;
 }
 
+/* Percentage of a node's keys that are tombstones or ptombs.  Nodes with
+ * fewer than SP3_TOMBS_MIN of them are not worth compacting early.
+ */
+#define SP3_TOMBS_MIN (64 * 1024)
+
+static uint
+sp3_node_tomb_pct(struct cn_tree_node *tn)
+{
+    u64 tombs = cn_ns_tombs(&tn->tn_ns);
+    u64 keys = cn_ns_keys(&tn->tn_ns);
+
+    if (tombs < SP3_TOMBS_MIN || !keys)
+        return 0;
+
+    return min_t(u64, 100, tombs * 100 / keys);
+}
+
+/* Vblock garbage (MiB) of the kvsets in a leaf whose garbage pct passes
+ * csched_vgc_pct, i.e., the space a value gc job would reclaim.  Leaves
+ * with less than SP3_VGC_MB_MIN of it are not worth the rewrite.
+ */
+#define SP3_VGC_MB_MIN (256)
+
+static u64
+sp3_node_vgc_mb(struct sp3 *sp, struct cn_tree_node *tn)
+{
+    struct kvset_list_entry *le;
+    u64                      garb = 0;
+
+    list_for_each_entry (le, &tn->tn_kvset_list, le_link) {
+        const struct kvset_stats *stats = kvset_statsp(le->le_kvset);
+
+        if (kvset_get_vgarb_pct(le->le_kvset) >= sp->thresh.vgc_pct)
+            garb += stats->kst_vwlen - stats->kst_vulen;
+    }
+
+    return garb >> 20;
+}
+
+/* Number of kvsets in a leaf that are on the wrong media class for their
+ * heat (see sp3_kvset_tier()).  Heat decays without the node changing, so
+ * the leaves are also rescored periodically by sp3_leaf_check().
+ */
+static uint
+sp3_node_tier_cnt(struct sp3 *sp, struct cn_tree_node *tn)
+{
+    struct kvset_list_entry *le;
+    uint                     cnt = 0;
+
+    if (!sp->thresh.tier_hot || !tn->tn_parent)
+        return 0;
+
+    list_for_each_entry (le, &tn->tn_kvset_list, le_link)
+        if (sp3_kvset_tier(&sp->thresh, le->le_kvset) != MP_MED_INVALID)
+            ++cnt;
+
+    return cnt;
+}
+
+/* Number of kvsets in a leaf of a prefixed tree that a newer ptomb hides
+ * entirely, which a job can delete without reading them.  Ptombs arrive
+ * in the ancestors without the leaf changing, so the leaves are also
+ * rescored periodically by sp3_leaf_check().  The caller must hold the
+ * tree lock.
+ */
+static uint
+sp3_node_ptomb_cnt(struct cn_tree_node *tn)
+{
+    struct kvset_list_entry *le;
+    u64                      horizon;
+    uint                     cnt = 0;
+
+    if (!tn->tn_tree->ct_cp->cp_pfx_len || !tn->tn_parent)
+        return 0;
+
+    horizon = cn_get_seqno_horizon(tn->tn_tree->cn);
+
+    list_for_each_entry (le, &tn->tn_kvset_list, le_link)
+        if (cn_node_ptomb_hidden(tn, le, horizon))
+            cnt++;
+
+    return cnt;
+}
+
 static void
 sp3_refresh_thresholds(struct sp3 *sp)
 {
@@ -837,6 +1021,17 @@ sp3_refresh_thresholds(struct sp3 *sp)
     v = sp->rp->csched_vb_scatter_pct;
     thresh.lscatter_pct = clamp_t(u64, v, 0, 100);
 
+    /* tombstone density settings */
+    v = sp->rp->csched_tomb_pct;
+    thresh.tomb_pct = clamp_t(u64, v, 0, 100);
+
+    /* value gc settings */
+    v = sp->rp->csched_vgc_pct;
+    thresh.vgc_pct = clamp_t(u64, v, 1, 100);
+
+    /* media tiering settings */
+    thresh.tier_hot = sp->tier_ok ? min_t(u64, sp->rp->csched_tier_hot, U32_MAX) : 0;
+
     if (!memcmp(&thresh, &sp->thresh, sizeof(thresh)))
         return;
 
@@ -851,7 +1046,10 @@ sp3_refresh_thresholds(struct sp3 *sp)
                    " kvcompc: %u,"
                    " idlec: %u,"
                    " idlem: %u,"
-                   " lscatter_pct: %u%%",
+                   " lscatter_pct: %u%%,"
+                   " tomb_pct: %u%%,"
+                   " vgc_pct: %u%%,"
+                   " tier_hot: %u",
         thresh.rspill_kvsets_min,
         thresh.rspill_kvsets_max,
 
@@ -869,7 +1067,10 @@ sp3_refresh_thresholds(struct sp3 *sp)
         thresh.llen_idlec,
         thresh.llen_idlem,
 
-        thresh.lscatter_pct);
+        thresh.lscatter_pct,
+        thresh.tomb_pct,
+        thresh.vgc_pct,
+        thresh.tier_hot);
 }
 
 static void
@@ -890,6 +1091,24 @@ sp3_refresh_worker_counts(struct sp3 *sp)
     sp->jobs_max += sts_wcnt_get_target(sp->sts, SP3_NUM_QUEUES);
 }
 
+/* The maintenance write limits, those of the rparams capped by the pacing
+ * for the get latency objective (see sp3_slo_check()).
+ */
+static void
+sp3_write_limits(struct sp3 *sp, u64 *burstp, u64 *ratep)
+{
+    u64 burst = sp->iowrite_limit_burst << 20;
+    u64 rate = sp->iowrite_limit_rate << 20;
+
+    if (sp->slo_rate && (!rate || sp->slo_rate < rate)) {
+        rate = sp->slo_rate;
+        burst = min_t(u64, burst, rate);
+    }
+
+    *burstp = burst;
+    *ratep = rate;
+}
+
 static void
 sp3_refresh_rate_limiters(struct sp3 *sp)
 {
@@ -908,7 +1127,29 @@ sp3_refresh_rate_limiters(struct sp3 *sp)
     sp->iowrite_limit_burst = burst;
     sp->iowrite_limit_rate = rate;
 
-    tbkt_reinit(&sp->tbkt, burst << 20, rate << 20);
+    sp3_write_limits(sp, &burst, &rate);
+    tbkt_reinit(&sp->tbkt, burst, rate);
+}
+
+static void
+sp3_refresh_vgc_limiter(struct sp3 *sp)
+{
+    u64 burst = sp->rp->csched_vgc_burst_sz;
+    u64 rate = sp->rp->csched_vgc_rate_max;
+
+    if (burst == sp->vgc_limit_burst && rate == sp->vgc_limit_rate)
+        return;
+
+    hse_log(
+        HSE_NOTICE "sp3: set value gc write limits:"
+                   " burst %lu MiB, rate %lu MiB",
+        (ulong)burst,
+        (ulong)rate);
+
+    sp->vgc_limit_burst = burst;
+    sp->vgc_limit_rate = rate;
+
+    tbkt_reinit(&sp->tbkt_vgc, burst << 20, rate << 20);
 }
 
 static void
@@ -918,6 +1159,7 @@ sp3_refresh_settings(struct sp3 *sp)
     sp3_refresh_thresholds(sp);
     sp3_refresh_worker_counts(sp);
     sp3_refresh_rate_limiters(sp);
+    sp3_refresh_vgc_limiter(sp);
 }
 
 static void
@@ -1005,20 +1247,32 @@ sp3_dirty_node(struct sp3 *sp, struct cn_tree_node *tn)
     uint             garbage;
 
     uint scatter = 0;
+    uint tombs = 0;
+    uint tier = 0;
+    uint ptombs = 0;
+    u64  score = 0;
+    u64  vgc = 0;
 
     sp3_node_unlink(sp, spn);
 
     if (tn->tn_parent != NULL) {
         /* RBT_LI_LEN: internal and leaf nodes sorted by #kvsets*/
         sp3_node_insert(sp, spn, RBT_LI_LEN, n_kvsets);
+
+        /* RBT_LI_TOMB: internal and leaf nodes sorted by tombstone pct */
+        if (sp->thresh.tomb_pct < 100) {
+            tombs = sp3_node_tomb_pct(tn);
+            sp3_node_insert(sp, spn, RBT_LI_TOMB, tombs);
+        }
     }
 
     garbage = samp_pct_garbage(&tn->tn_samp, 100);
 
     if (cn_node_isleaf(tn)) {
 
-        /* RBT_L_GARB: leaf nodes sorted by garbage */
-        sp3_node_insert(sp, spn, RBT_L_GARB, garbage);
+        /* RBT_L_GARB: leaf nodes sorted by garbage score */
+        score = sp3_leaf_garbage_score(sp, tn);
+        sp3_node_insert(sp, spn, RBT_L_GARB, score);
 
         /* RBT_L_PCAP: leaf nodes sorted by pct capacity */
         sp3_node_insert(sp, spn, RBT_L_PCAP, tn->tn_ns.ns_pcap);
@@ -1029,6 +1283,29 @@ sp3_dirty_node(struct sp3 *sp, struct cn_tree_node *tn)
             scatter = sp3_node_scatter_score_compute(spn);
             sp3_node_insert(sp, spn, RBT_L_SCAT, scatter);
         }
+
+        /* RBT_L_VGC: leaf nodes sorted by reclaimable vblock garbage */
+        if (sp->thresh.vgc_pct < 100) {
+            vgc = sp3_node_vgc_mb(sp, tn);
+            sp3_node_insert(sp, spn, RBT_L_VGC, vgc);
+        }
+
+        /* RBT_L_TIER: leaf nodes sorted by #kvsets to move */
+        if (sp->thresh.tier_hot) {
+            tier = sp3_node_tier_cnt(sp, tn);
+            sp3_node_insert(sp, spn, RBT_L_TIER, tier);
+        }
+
+        /* RBT_L_PTOMB: leaf nodes sorted by #kvsets hidden by ptombs */
+        if (tn->tn_tree->ct_cp->cp_pfx_len) {
+            void *lock;
+
+            rmlock_rlock(&tn->tn_tree->ct_lock, &lock);
+            ptombs = sp3_node_ptomb_cnt(tn);
+            rmlock_runlock(lock);
+
+            sp3_node_insert(sp, spn, RBT_L_PTOMB, ptombs);
+        }
     } else {
         /* RBT_RI_ALEN: root and internal nodes sorted by alen */
         sp3_node_insert(sp, spn, RBT_RI_ALEN, alen);
@@ -1048,17 +1325,73 @@ sp3_dirty_node(struct sp3 *sp, struct cn_tree_node *tn)
             HSE_SLOG_FIELD("nd_len", "%lu", (ulong)n_kvsets),
             HSE_SLOG_FIELD("alen", "%lu", (ulong)alen),
             HSE_SLOG_FIELD("garbage", "%lu", (ulong)garbage),
+            HSE_SLOG_FIELD("score", "%lu", (ulong)score),
             HSE_SLOG_FIELD("scatter", "%u", scatter),
+            HSE_SLOG_FIELD("tombs", "%u", tombs),
+            HSE_SLOG_FIELD("vgc", "%lu", (ulong)vgc),
+            HSE_SLOG_FIELD("tier", "%u", tier),
+            HSE_SLOG_FIELD("ptombs", "%u", ptombs),
             HSE_SLOG_END);
     }
 }
 
+/* Rescore the leaves for the media tiering and ptomb rules, as the heat
+ * of their kvsets changes, and ptombs land in their ancestors, without the
+ * leaves being dirtied.
+ */
+static void
+sp3_leaf_check(struct sp3 *sp)
+{
+    struct cn_tree *tree;
+
+    list_for_each_entry (tree, &sp->mon_tlist, ct_sched.sp3t.spt_tlink) {
+        struct cn_tree_node *tn;
+        struct tree_iter     iter;
+        void *               lock;
+        bool                 pfx;
+
+        pfx = tree->ct_cp->cp_pfx_len > 0;
+        if (!sp->thresh.tier_hot && !pfx)
+            continue;
+
+        rmlock_rlock(&tree->ct_lock, &lock);
+
+        tree_iter_init(tree, &iter, TRAVERSE_TOPDOWN);
+        while (NULL != (tn = tree_iter_next(tree, &iter))) {
+            struct sp3_node *spn = tn2spn(tn);
+
+            if (!spn->spn_initialized || !cn_node_isleaf(tn))
+                continue;
+
+            if (sp->thresh.tier_hot) {
+                sp3_rb_erase(sp->rbt + RBT_L_TIER, spn->spn_rbe + RBT_L_TIER);
+                sp3_node_insert(sp, spn, RBT_L_TIER, sp3_node_tier_cnt(sp, tn));
+            }
+
+            if (pfx) {
+                sp3_rb_erase(sp->rbt + RBT_L_PTOMB, spn->spn_rbe + RBT_L_PTOMB);
+                sp3_node_insert(sp, spn, RBT_L_PTOMB, sp3_node_ptomb_cnt(tn));
+            }
+        }
+
+        rmlock_runlock(lock);
+    }
+}
+
+static inline u64
+sp3_merge_stats_wbytes(const struct cn_merge_stats *ms)
+{
+    return ms->ms_kblk_write.op_size + ms->ms_kblk_write_async.op_size +
+           ms->ms_vblk_write.op_size + ms->ms_vblk_write_async.op_size;
+}
+
 static void
 sp3_process_workitem(struct sp3 *sp, struct cn_compaction_work *w)
 {
-    struct sp3_tree *    spt = tree2spt(w->cw_tree);
-    struct cn_tree_node *tn = w->cw_node;
-    struct cn_samp_stats diff;
+    struct sp3_tree *     spt = tree2spt(w->cw_tree);
+    struct cn_tree_node * tn = w->cw_node;
+    struct cn_samp_stats  diff;
+    struct cn_merge_stats ms;
 
     assert(spt->spt_job_cnt > 0);
     assert(w->cw_job.sj_qnum < SP3_NUM_QUEUES);
@@ -1069,6 +1402,10 @@ sp3_process_workitem(struct sp3 *sp, struct cn_compaction_work *w)
     sp->qinfo[w->cw_job.sj_qnum].qjobs--;
     sp->jobs_finished++;
 
+    /* Account the writes since the last progress report. */
+    cn_merge_stats_diff(&ms, &w->cw_stats, &w->cw_stats_prev);
+    atomic64_add(sp3_merge_stats_wbytes(&ms), &sp->slo_wbytes);
+
     cn_samp_diff(&diff, &w->cw_samp_post, &w->cw_samp_pre);
 
     if (debug_samp_work(sp)) {
@@ -1215,6 +1552,7 @@ sp3_process_new_trees(struct sp3 *sp)
         sp->samp.l_good += tree->ct_samp.l_good;
 
         sp->lvl_max = max(sp->lvl_max, tree->ct_lvl_max);
+        sp->weight_total += spt->spt_weight;
 
         /* Move to the monitor's list. */
         list_del(&spt->spt_tlink);
@@ -1255,6 +1593,9 @@ sp3_prune_trees(struct sp3 *sp)
             sp->samp.l_alen -= tree->ct_samp.l_alen;
             sp->samp.l_good -= tree->ct_samp.l_good;
 
+            assert(sp->weight_total >= spt->spt_weight);
+            sp->weight_total -= spt->spt_weight;
+
             sp3_log_samp_overall(sp);
 
             cn_ref_put(tree->cn);
@@ -1286,12 +1627,15 @@ sp3_work_complete(struct cn_compaction_work *w)
 static void
 sp3_work_progress(struct cn_compaction_work *w)
 {
+    struct sp3 *          sp = w->cw_sched;
     struct cn_merge_stats ms;
 
     /* compute change in merge stats from previous progress report */
     cn_merge_stats_diff(&ms, &w->cw_stats, &w->cw_stats_prev);
     memcpy(&w->cw_stats_prev, &w->cw_stats, sizeof(w->cw_stats_prev));
 
+    atomic64_add(sp3_merge_stats_wbytes(&ms), &sp->slo_wbytes);
+
     if ((w->cw_debug & CW_DEBUG_PROGRESS) &&
         (w->cw_node->tn_loc.node_level > 0 || (w->cw_debug & CW_DEBUG_ROOT))) {
         sp3_log_progress(w, &ms, false);
@@ -1370,6 +1714,27 @@ sp3_comp_thread_name(
         case CN_CR_LSCATTER:
             r = "sc";
             break;
+        case CN_CR_LLEVEL:
+            r = "lv";
+            break;
+        case CN_CR_LRUNS:
+            r = "lr";
+            break;
+        case CN_CR_TOMB:
+            r = "tb";
+            break;
+        case CN_CR_LVGC:
+            r = "vg";
+            break;
+        case CN_CR_SPILL_RESUME:
+            r = "sr";
+            break;
+        case CN_CR_LTIER:
+            r = "mt";
+            break;
+        case CN_CR_LPTOMB:
+            r = "pd";
+            break;
     }
 
     if (loc->node_level == 0)
@@ -1416,12 +1781,17 @@ sp3_submit(struct sp3 *sp, struct cn_compaction_work *w, uint qnum, uint rbt_idx
             break;
     }
 
-    /* Use mcache for root spills to efficiently handle c1 vblocks. */
-    if (cn_node_isroot(tn)) {
+    /* Use mcache for root spills to efficiently handle c1 vblocks, unless
+     * the kvs asks for all compactions to bypass the page cache.
+     */
+    if (cn_node_isroot(tn) && !(w->cw_io_workq && w->cw_tree->rp->cn_compact_direct)) {
         w->cw_iter_flags |= kvset_iter_flag_mcache;
         w->cw_io_workq = NULL;
     }
 
+    if ((w->cw_iter_flags & kvset_iter_flag_mcache) && w->cw_tree->rp->cn_compact_noreuse)
+        w->cw_iter_flags |= kvset_iter_flag_noreuse;
+
     w->cw_sched = sp;
     w->cw_completion = sp3_work_complete;
     w->cw_progress = sp3_work_progress;
@@ -1480,11 +1850,13 @@ sp3_submit(struct sp3 *sp, struct cn_compaction_work *w, uint qnum, uint rbt_idx
 static bool
 sp3_check_roots(struct sp3 *sp)
 {
-    uint            debug;
-    struct cn_tree *tree;
-    uint            lvl_max = 0;
+    enum sp3_work_type wtype;
+    uint               debug;
+    struct cn_tree *   tree;
+    uint               lvl_max = 0;
 
     debug = csched_rp_dbg_comp(sp->rp);
+    wtype = sp->hybrid ? wtype_hybrid : wtype_rspill;
 
     list_for_each_entry (tree, &sp->mon_tlist, ct_sched.sp3t.spt_tlink) {
 
@@ -1493,7 +1865,7 @@ sp3_check_roots(struct sp3 *sp)
 
         lvl_max = max(lvl_max, tree->ct_lvl_max);
 
-        if (sp3_work(tn2spn(tree->ct_root), &sp->thresh, wtype_rspill, debug, &qnum, &sp->wp))
+        if (sp3_work(tn2spn(tree->ct_root), &sp->thresh, wtype, debug, &qnum, &sp->wp))
             return false;
 
         have_work = sp->wp && sp->wp->cw_action != CN_ACTION_NONE;
@@ -1588,6 +1960,26 @@ sp3_tree_shape_log(const struct cn_tree_node *tn, bool bad, const char *category
         HSE_SLOG_END);
 }
 
+/**
+ * sp3_update_rlen() - publish the length of the longest root node
+ * @sp: scheduler context
+ *
+ * The length (in kvsets) of the longest root node across all monitored
+ * trees approximates the ingest backlog that compaction has yet to
+ * spill, and is consumed by c0 to size its ingest buffers.
+ */
+static void
+sp3_update_rlen(struct sp3 *sp)
+{
+    struct cn_tree *tree;
+    uint            rlen = 0;
+
+    list_for_each_entry (tree, &sp->mon_tlist, ct_sched.sp3t.spt_tlink)
+        rlen = max_t(uint, rlen, cn_ns_kvsets(&tree->ct_root->tn_ns));
+
+    atomic_set(&sp->rlen_max, rlen);
+}
+
 /**
  * sp3_tree_shape_check() - report on tree shape
  * @sp: scheduler context
@@ -1722,12 +2114,32 @@ sp3_tree_shape_check(struct sp3 *sp)
     }
 }
 
+/* A tree is over its share of the workers when it runs at least its
+ * cn_compact_weight proportion of the jobs sp3 can run.
+ */
+static inline bool
+sp3_tree_over_share(struct sp3 *sp, struct cn_tree *tree)
+{
+    struct sp3_tree *spt = tree2spt(tree);
+
+    return (u64)spt->spt_job_cnt * sp->weight_total >= (u64)spt->spt_weight * max(sp->jobs_max, 1u);
+}
+
+/* Nodes qualify for work if their weight is at least @threshold, except
+ * in RBT_L_GARB where @threshold is a garbage percentage: the garbage score
+ * only orders the leaves, a leaf qualifies by its garbage alone.  A leaf's
+ * score is at least the score of its garbage, so the walk still ends at
+ * the first leaf whose score is below that of the threshold percentage.
+ */
 static bool
 sp3_check_rb_tree(struct sp3 *sp, uint tx, u64 threshold, enum sp3_work_type wtype)
 {
     struct rb_root *root;
     struct rb_node *rbn;
     uint            debug;
+    u64             gate = 0;
+    bool            skipped = false;
+    bool            fair = true;
 
     assert(tx < RBT_MAX);
 
@@ -1735,6 +2147,15 @@ sp3_check_rb_tree(struct sp3 *sp, uint tx, u64 threshold, enum sp3_work_type wty
 
     root = sp->rbt + tx;
 
+    if (tx == RBT_L_GARB) {
+        gate = threshold;
+        threshold = sp3_garbage_pct2score(min_t(u64, gate, 100));
+    }
+
+    /* Serve the trees within their share of the workers first, then any
+     * tree such that workers do not sit idle while there is work.
+     */
+again:
     for (rbn = rb_first(root); rbn; rbn = rb_next(rbn)) {
 
         struct sp3_rbe * rbe;
@@ -1747,7 +2168,15 @@ sp3_check_rb_tree(struct sp3 *sp, uint tx, u64 threshold, enum sp3_work_type wty
         spn = (void *)(rbe - tx);
 
         if (rbe->rbe_weight < threshold)
-            return false;
+            break;
+
+        if (gate && samp_pct_garbage(&spn2tn(spn)->tn_samp, 100) < gate)
+            continue;
+
+        if (fair && sp3_tree_over_share(sp, spn2tn(spn)->tn_tree)) {
+            skipped = true;
+            continue;
+        }
 
         if (sp3_work(spn, &sp->thresh, wtype, debug, &qnum, &sp->wp))
             return false;
@@ -1760,6 +2189,11 @@ sp3_check_rb_tree(struct sp3 *sp, uint tx, u64 threshold, enum sp3_work_type wty
         }
     }
 
+    if (fair && skipped) {
+        fair = false;
+        goto again;
+    }
+
     return false;
 }
 
@@ -1835,10 +2269,245 @@ sp3_qos_check(struct sp3 *sp)
     }
 }
 
+/* Autoscaler decision period, a queue that has been full for this
+ * long has a backlog.
+ */
+#define SP3_AUTOSCALE_NS (5 * NSEC_PER_SEC)
+
+static void
+sp3_autoscale_sample(struct sp3 *sp, u64 now)
+{
+    uint i;
+
+    for (i = SP3_QNUM_INTERN; i < SP3_NUM_QUEUES; i++) {
+        struct sp3_qinfo *qi = sp->qinfo + i;
+
+        qi->qjobs_peak = max_t(uint, qi->qjobs_peak, qi->qjobs);
+
+        if (!qfull(qi))
+            qi->full_since = 0;
+        else if (!qi->full_since)
+            qi->full_since = now;
+    }
+}
+
+/* Get the activity of an I/O class since the previous call.
+ */
+static void
+sp3_autoscale_ios(
+    struct io_sched *      ios,
+    enum io_sched_class    cls,
+    struct io_sched_stats *prev,
+    struct io_sched_stats *delta)
+{
+    struct io_sched_stats cur = {}, mc;
+    uint                  i;
+
+    for (i = 0; i <= MP_MED_CAPACITY; i++) {
+        io_sched_stats(ios, i, cls, &mc);
+        cur.iss_ops += mc.iss_ops;
+        cur.iss_waits += mc.iss_waits;
+        cur.iss_wait_ns += mc.iss_wait_ns;
+    }
+
+    delta->iss_ops = cur.iss_ops - prev->iss_ops;
+    delta->iss_waits = cur.iss_waits - prev->iss_waits;
+    delta->iss_wait_ns = cur.iss_wait_ns - prev->iss_wait_ns;
+    *prev = cur;
+}
+
+/**
+ * sp3_autoscale() - adjust the worker counts of the queues
+ * @sp:  scheduler context
+ * @now: current time
+ *
+ * Each queue's worker count moves by one per period between its
+ * csched_qthreads value and its csched_qthreads_max bound:
+ * - down if foreground reads waited on average more than half their
+ *   deadline for admission by the I/O scheduler,
+ * - up if the queue has been full for a whole period, unless over half
+ *   of the compaction I/Os had to wait for admission (adding workers
+ *   to a saturated device only lengthens the wait),
+ * - down if the queue never filled up during the period.
+ */
+static void
+sp3_autoscale(struct sp3 *sp, u64 now)
+{
+    struct io_sched_stats d;
+    struct io_sched *     ios = NULL;
+    struct cn_tree *      tree;
+
+    u64  fg_wait_ns = 0, comp_wait_pct = 0;
+    bool fg_slow, dev_busy, changed = false;
+    uint i;
+
+    if (!sp->rp->csched_qthreads_max)
+        return;
+
+    tree = list_first_entry_or_null(&sp->mon_tlist, struct cn_tree, ct_sched.sp3t.spt_tlink);
+    if (tree)
+        ios = cn_get_io_sched(tree->cn);
+
+    if (ios) {
+        sp3_autoscale_ios(ios, IOS_FG_READ, &sp->as_fg, &d);
+        if (d.iss_ops)
+            fg_wait_ns = d.iss_wait_ns / d.iss_ops;
+
+        sp3_autoscale_ios(ios, IOS_COMPACT, &sp->as_comp, &d);
+        if (d.iss_ops)
+            comp_wait_pct = d.iss_waits * 100 / d.iss_ops;
+    }
+
+    fg_slow = fg_wait_ns > sp->rp->io_sched_fg_us * 1000 / 2;
+    dev_busy = comp_wait_pct > 50;
+
+    for (i = SP3_QNUM_INTERN; i < SP3_NUM_QUEUES; i++) {
+        struct sp3_qinfo *qi = sp->qinfo + i;
+        const char *      reason = NULL;
+        uint              cur, tgt, min, max;
+        u64               age;
+
+        cur = sts_wcnt_get_target(sp->sts, i);
+        min = sp->qthreads_min[i];
+        max = (sp->rp->csched_qthreads_max >> (8 * i)) & 0xff;
+        age = qi->full_since ? now - qi->full_since : 0;
+        tgt = cur;
+
+        if (max <= min) {
+            qi->qjobs_peak = qi->qjobs;
+            continue;
+        }
+
+        if (fg_slow) {
+            if (cur > min) {
+                tgt = cur - 1;
+                reason = "foreground";
+            }
+        } else if (age >= SP3_AUTOSCALE_NS) {
+            if (dev_busy) {
+                reason = "device_busy";
+            } else if (cur < max) {
+                tgt = cur + 1;
+                reason = "backlog";
+            } else {
+                reason = "at_max";
+            }
+        } else if (qi->qjobs_peak < cur && cur > min) {
+            tgt = cur - 1;
+            reason = "idle";
+        }
+
+        qi->qjobs_peak = qi->qjobs;
+
+        /* Log every change, and a decision to hold only when it
+         * differs from the previous decision.
+         */
+        if (!reason || (tgt == cur && reason == qi->as_reason))
+            continue;
+
+        qi->as_reason = reason;
+
+        if (tgt != cur) {
+            sts_wcnt_set_target(sp->sts, i, tgt);
+            changed = true;
+        }
+
+        hse_slog(
+            HSE_NOTICE,
+            HSE_SLOG_START("cn_autoscale"),
+            HSE_SLOG_FIELD("queue", "%u", i),
+            HSE_SLOG_FIELD("reason", "%s", reason),
+            HSE_SLOG_FIELD("from", "%u", cur),
+            HSE_SLOG_FIELD("to", "%u", tgt),
+            HSE_SLOG_FIELD("min", "%u", min),
+            HSE_SLOG_FIELD("max", "%u", max),
+            HSE_SLOG_FIELD("full_ms", "%lu", (ulong)(age / 1000000)),
+            HSE_SLOG_FIELD("fg_wait_us", "%lu", (ulong)(fg_wait_ns / 1000)),
+            HSE_SLOG_FIELD("comp_wait_pct", "%lu", (ulong)comp_wait_pct),
+            HSE_SLOG_END);
+    }
+
+    if (changed)
+        sp3_refresh_worker_counts(sp);
+}
+
 /**
  * sp3_schedule() - try to schedule a single job
  * Returns true if a job was scheduled, false otherwise.
  */
+/* Get latency objective check period, and the lowest compaction write
+ * rate the pacing for it goes down to.
+ */
+#define SP3_SLO_NS (NSEC_PER_SEC)
+#define SP3_SLO_RATE_MIN (16ul << 20)
+
+/* Steer compaction by the get latency at the csched_slo_pct percentile
+ * reported by the kvdb (see csched_notify_latency()).  Above csched_slo_us
+ * the compaction write rate is halved, starting from the rate compaction
+ * ran at, down to SP3_SLO_RATE_MIN, and non-urgent compactions are deferred
+ * (see sp3_schedule()).  Once the latency is back below 80% of the
+ * objective the rate grows by a quarter per period until the pacing ends.
+ */
+static void
+sp3_slo_check(struct sp3 *sp, u64 now)
+{
+    u64  thresh = sp->rp->csched_slo_us * 1000;
+    u64  slo_rate = sp->slo_rate;
+    bool hold = sp->slo_hold;
+    u64  lat, wbytes, rate, dt;
+
+    dt = max_t(u64, (now - sp->slo_prev) / 1000000, 1);
+    sp->slo_prev = now;
+
+    wbytes = atomic64_read(&sp->slo_wbytes);
+    atomic64_sub(wbytes, &sp->slo_wbytes);
+    rate = wbytes * 1000 / dt;
+
+    lat = atomic64_read(&sp->slo_lat);
+
+    if (!thresh) {
+        slo_rate = 0;
+        hold = false;
+    } else if (lat > thresh) {
+        if (!slo_rate) {
+            sp->slo_rate_hi = max_t(u64, rate, SP3_SLO_RATE_MIN);
+            slo_rate = sp->slo_rate_hi;
+        }
+        slo_rate = max_t(u64, slo_rate / 2, SP3_SLO_RATE_MIN);
+        hold = true;
+    } else if (lat < thresh * 4 / 5) {
+        if (slo_rate) {
+            slo_rate += slo_rate / 4;
+            if (slo_rate >= sp->slo_rate_hi)
+                slo_rate = 0;
+        }
+        hold = false;
+    }
+
+    if (slo_rate == sp->slo_rate && hold == sp->slo_hold)
+        return;
+
+    hse_slog(
+        HSE_NOTICE,
+        HSE_SLOG_START("cn_slo"),
+        HSE_SLOG_FIELD("lat_us", "%lu", (ulong)lat / 1000),
+        HSE_SLOG_FIELD("slo_us", "%lu", (ulong)thresh / 1000),
+        HSE_SLOG_FIELD("wr_mbs", "%lu", (ulong)rate >> 20),
+        HSE_SLOG_FIELD("cap_mbs", "%lu", (ulong)slo_rate >> 20),
+        HSE_SLOG_FIELD("hold", "%d", hold),
+        HSE_SLOG_END);
+
+    sp->slo_hold = hold;
+
+    if (slo_rate != sp->slo_rate) {
+        u64 burst;
+
+        sp->slo_rate = slo_rate;
+        sp3_write_limits(sp, &burst, &rate);
+        tbkt_adjust(&sp->tbkt, burst, rate);
+    }
+}
+
 static bool
 sp3_schedule(struct sp3 *sp)
 {
@@ -1849,21 +2518,30 @@ sp3_schedule(struct sp3 *sp)
         jtype_leaf_garbage,
         jtype_leaf_size,
         jtype_leaf_scatter,
+        jtype_tomb,
+        jtype_vgc,
+        jtype_tier,
+        jtype_ptomb,
         jtype_MAX,
     };
 
     u64               node_len_max;
     bool              job = false;
+    bool              defer;
     struct sp3_qinfo *qi;
-    bool              shared_full;
     uint              rp_leaf_pct;
     uint              rr;
 
     /* convert rparam to internal scale */
     rp_leaf_pct = sp->inputs.csched_leaf_pct * SCALE / EXT_SCALE;
 
+    /* Over the get latency objective only the root and node length
+     * rules run, which keep the writers unthrottled and the gets short,
+     * unless space amp is too high to wait.
+     */
+    defer = sp->slo_hold && !sp->samp_reduce;
+
     node_len_max = sp->rp->csched_node_len_max ?: SP3_LLEN_RUNLEN_MIN;
-    shared_full = sts_wcnt_get_idle(sp->sts, SP3_NUM_QUEUES) == 0;
 
     for (rr = 0; !job && rr < jtype_MAX; rr++) {
 
@@ -1879,7 +2557,7 @@ sp3_schedule(struct sp3 *sp)
              * Uses "intern" queue.
              */
                 qi = sp->qinfo + SP3_QNUM_INTERN;
-                if (qfull(qi) && shared_full)
+                if (qfull(qi) && !qspare(sp, qi))
                     break;
                 job = sp3_check_roots(sp);
                 break;
@@ -1892,10 +2570,14 @@ sp3_schedule(struct sp3 *sp)
              *   - Root node space amp rule
              *   - Internal node space amp rule
              */
+                if (defer)
+                    break;
                 qi = sp->qinfo + SP3_QNUM_INTERN;
-                if (qfull(qi) && shared_full)
+                if (qfull(qi) && !qspare(sp, qi))
                     break;
-                if (sp->lpct_targ < rp_leaf_pct)
+                if (sp->hybrid)
+                    job = sp3_check_rb_tree(sp, RBT_RI_ALEN, 0, wtype_hybrid);
+                else if (sp->lpct_targ < rp_leaf_pct)
                     job = sp3_check_rb_tree(sp, RBT_RI_ALEN, 0, wtype_ispill);
                 break;
 
@@ -1906,9 +2588,12 @@ sp3_schedule(struct sp3 *sp)
              *   - Leaf node query-shape rule
              */
                 qi = sp->qinfo + SP3_QNUM_INTERN;
-                if (qfull(qi) && shared_full)
+                if (qfull(qi) && !qspare(sp, qi))
                     break;
-                job = sp3_check_rb_tree(sp, RBT_LI_LEN, node_len_max, wtype_node_len);
+                if (sp->hybrid)
+                    job = sp3_check_rb_tree(sp, RBT_LI_LEN, SP3_LCOMP_KVSETS_MIN, wtype_hybrid);
+                else
+                    job = sp3_check_rb_tree(sp, RBT_LI_LEN, node_len_max, wtype_node_len);
                 break;
 
             case jtype_leaf_garbage:
@@ -1941,6 +2626,8 @@ sp3_schedule(struct sp3 *sp)
              * Implements:
              *   - Leaf node size rule
              */
+                if (defer)
+                    break;
                 qi = sp->qinfo + SP3_QNUM_LEAFBIG;
                 if (qfull(qi))
                     break;
@@ -1953,13 +2640,88 @@ sp3_schedule(struct sp3 *sp)
              * [HSE_REVISIT]: Node length is currently not factored
              * into this metric.
              */
-                if (sp->thresh.lscatter_pct == 100)
+                if (sp->thresh.lscatter_pct == 100 || defer)
                     break;
                 qi = sp->qinfo + SP3_QNUM_LSCAT;
-                if (qfull(qi) && shared_full)
+                if (qfull(qi) && !qspare(sp, qi))
                     break;
                 job = sp3_check_rb_tree(sp, RBT_L_SCAT, SP3_LSCAT_THRESH_MIN, wtype_leaf_scatter);
                 break;
+
+            case jtype_tomb:
+                /* Service RBT_LI_TOMB red-black tree.
+             * Implements:
+             *   - Node tombstone density rule
+             * Notes:
+             *   - Delete heavy workloads leave nodes whose tombstones
+             *     slow gets and cursors well before the size rules
+             *     trip, so spill them toward (or k-compact them in)
+             *     the leaves, where they are dropped.
+             */
+                if (sp->thresh.tomb_pct == 100 || defer)
+                    break;
+                qi = sp->qinfo + SP3_QNUM_INTERN;
+                if (qfull(qi) && !qspare(sp, qi))
+                    break;
+                job = sp3_check_rb_tree(
+                    sp, RBT_LI_TOMB, max_t(uint, sp->thresh.tomb_pct, 1), wtype_tomb);
+                break;
+
+            case jtype_vgc:
+                /* Service RBT_L_VGC red-black tree.
+             * Implements:
+             *   - Leaf node value gc rule
+             * Notes:
+             *   - K-compactions keep vblocks as they are, so large
+             *     value workloads pile up dead values in them.
+             *     Copy the live values out of the worst kvsets and
+             *     k-compact their keys, at a fraction of the I/O of a
+             *     kv-compaction, throttled by their own token bucket.
+             */
+                if (sp->thresh.vgc_pct == 100 || defer)
+                    break;
+                qi = sp->qinfo + SP3_QNUM_LSCAT;
+                if (qfull(qi) && !qspare(sp, qi))
+                    break;
+                job = sp3_check_rb_tree(sp, RBT_L_VGC, SP3_VGC_MB_MIN, wtype_vgc);
+                break;
+
+            case jtype_tier:
+                /* Service RBT_L_TIER red-black tree.
+             * Implements:
+             *   - Leaf node media tiering rule
+             * Notes:
+             *   - Leaves are written to the capacity media class.
+             *     Rewrite the kvsets of a leaf that are hot onto the
+             *     staging media class, and those that went cold back
+             *     to capacity, one kvset per job.
+             */
+                if (!sp->thresh.tier_hot || defer)
+                    break;
+                qi = sp->qinfo + SP3_QNUM_LSCAT;
+                if (qfull(qi) && !qspare(sp, qi))
+                    break;
+                job = sp3_check_rb_tree(sp, RBT_L_TIER, 1, wtype_tier);
+                break;
+
+            case jtype_ptomb:
+                /* Service RBT_L_PTOMB red-black tree.
+                 * Implements:
+                 *   - Leaf node ptomb rule
+                 * Notes:
+                 *   - A prefix delete leaves the keys it hides in place
+                 *     until compaction happens to merge them with the
+                 *     ptomb.  Leaf kvsets that hold nothing but keys of
+                 *     a deleted prefix are deleted outright, unread, so
+                 *     the space comes back right away.
+                 */
+                if (defer)
+                    break;
+                qi = sp->qinfo + SP3_QNUM_INTERN;
+                if (qfull(qi) && !qspare(sp, qi))
+                    break;
+                job = sp3_check_rb_tree(sp, RBT_L_PTOMB, 1, wtype_ptomb);
+                break;
         }
     }
 
@@ -2067,6 +2829,9 @@ sp3_monitor(struct work_struct *work)
     struct periodic_check chk_qos;
     struct periodic_check chk_refresh;
     struct periodic_check chk_shape;
+    struct periodic_check chk_leaf;
+    struct periodic_check chk_scale;
+    struct periodic_check chk_slo;
 
     bool busy = false;
     u64  now;
@@ -2076,10 +2841,18 @@ sp3_monitor(struct work_struct *work)
     chk_qos.interval = NSEC_PER_SEC / 5;
     chk_refresh.interval = 10 * NSEC_PER_SEC;
     chk_shape.interval = 15 * NSEC_PER_SEC;
+    chk_leaf.interval = 15 * NSEC_PER_SEC;
+    chk_scale.interval = SP3_AUTOSCALE_NS;
+    chk_slo.interval = SP3_SLO_NS;
 
     chk_qos.next = now + chk_qos.interval;
     chk_refresh.next = now + chk_refresh.interval;
     chk_shape.next = now + chk_shape.interval;
+    chk_leaf.next = now + chk_leaf.interval;
+    chk_scale.next = now + chk_scale.interval;
+    chk_slo.next = now + chk_slo.interval;
+
+    sp->slo_prev = now;
 
     sp3_refresh_settings(sp);
 
@@ -2097,8 +2870,10 @@ sp3_monitor(struct work_struct *work)
         sp3_prune_trees(sp);
 
         sp3_update_samp(sp);
+        sp3_update_rlen(sp);
 
         busy = sp3_compact(sp);
+        sp3_autoscale_sample(sp, now);
 
         if (now > chk_refresh.next) {
             sp3_refresh_settings(sp);
@@ -2118,6 +2893,21 @@ sp3_monitor(struct work_struct *work)
             }
             chk_shape.next = now + chk_shape.interval;
         }
+
+        if (now > chk_leaf.next) {
+            sp3_leaf_check(sp);
+            chk_leaf.next = now + chk_leaf.interval;
+        }
+
+        if (now > chk_scale.next) {
+            sp3_autoscale(sp, now);
+            chk_scale.next = now + chk_scale.interval;
+        }
+
+        if (now > chk_slo.next) {
+            sp3_slo_check(sp, now);
+            chk_slo.next = now + chk_slo.interval;
+        }
     }
 }
 
@@ -2133,6 +2923,33 @@ sp3_op_tbkt_maint_get(struct csched_ops *handle)
     return &h2sp(handle)->tbkt;
 }
 
+static struct tbkt *
+sp3_op_tbkt_vgc_get(struct csched_ops *handle)
+{
+    return &h2sp(handle)->tbkt_vgc;
+}
+
+static uint
+sp3_op_root_len(struct csched_ops *handle)
+{
+    return atomic_read(&h2sp(handle)->rlen_max);
+}
+
+/* Root and internal spills share the intern queue, running one of them
+ * is what relieves the root backlog that throttles the writers.
+ */
+static bool
+sp3_op_assist(struct csched_ops *handle)
+{
+    return sts_job_assist(h2sp(handle)->sts, SP3_QNUM_INTERN);
+}
+
+static void
+sp3_op_notify_latency(struct csched_ops *handle, u64 lat_ns)
+{
+    atomic64_set(&h2sp(handle)->slo_lat, lat_ns);
+}
+
 static void
 sp3_op_throttle_sensor(struct csched_ops *handle, struct throttle_sensor *sensor)
 {
@@ -2210,6 +3027,7 @@ sp3_op_tree_add(struct csched_ops *handle, struct cn_tree *tree)
     cn_ref_get(tree->cn);
 
     sp3_tree_init(spt);
+    spt->spt_weight = clamp_t(uint, tree->rp->cn_compact_weight, 1, 1000);
 
     mutex_lock(&sp->new_tlist_lock);
     list_add(&spt->spt_tlink, &sp->new_tlist);
@@ -2282,14 +3100,23 @@ sp3_op_destroy(struct csched_ops *handle)
 
     perfc_ctrseti_free(&sp->sched_pc);
 
+    tbkt_pcpu_free(&sp->tbkt);
+
     free_aligned(sp);
 }
 
-/**
- * sp3_create() - External API: constructor
+/* Max tokens a cpu takes at once from the maintenance write limiter,
+ * enough for a few mblock writes of the compaction jobs.
  */
-merr_t
-sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csched_ops **handle)
+#define SP3_TBKT_BATCH (4ul << 20)
+
+static merr_t
+sp3_create_impl(
+    struct mpool *       ds,
+    struct kvdb_rparams *rp,
+    const char *         mp,
+    bool                 hybrid,
+    struct csched_ops ** handle)
 {
     struct sp3 *sp;
     merr_t      err;
@@ -2327,6 +3154,12 @@ sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csc
     strlcpy(sp->name, mp, name_sz);
 
     sp->rp = rp;
+    sp->hybrid = hybrid;
+    sp->tier_ok = ds && !mpool_mclass_get(ds, MP_MED_STAGING, NULL);
+
+    /* The configured worker counts are the autoscaler's lower bounds. */
+    for (tx = 0; tx < SP3_NUM_QUEUES; tx++)
+        sp->qthreads_min[tx] = (rp->csched_qthreads >> (8 * tx)) & 0xff;
 
     mutex_init(&sp->new_tlist_lock);
     mutex_init(&sp->work_list_lock);
@@ -2334,6 +3167,10 @@ sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csc
     cv_init(&sp->cv, "csched");
 
     tbkt_init(&sp->tbkt, 0, 0);
+    tbkt_init(&sp->tbkt_vgc, 0, 0);
+
+    if (tbkt_pcpu_alloc(&sp->tbkt, SP3_TBKT_BATCH))
+        hse_log(HSE_ERR "cannot alloc sp3 token batches");
 
     INIT_LIST_HEAD(&sp->mon_tlist);
     INIT_LIST_HEAD(&sp->new_tlist);
@@ -2354,6 +3191,8 @@ sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csc
         goto err_exit;
     }
 
+    workqueue_set_cpus(sp->wqueue, rp->csched_cpus);
+
     INIT_WORK(&sp->wstruct, sp3_monitor);
     queue_work(sp->wqueue, &sp->wstruct);
 
@@ -2367,6 +3206,10 @@ sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csc
     sp->ops.cs_tree_add = sp3_op_tree_add;
     sp->ops.cs_tree_remove = sp3_op_tree_remove;
     sp->ops.cs_tbkt_maint_get = sp3_op_tbkt_maint_get;
+    sp->ops.cs_tbkt_vgc_get = sp3_op_tbkt_vgc_get;
+    sp->ops.cs_root_len = sp3_op_root_len;
+    sp->ops.cs_assist = sp3_op_assist;
+    sp->ops.cs_notify_latency = sp3_op_notify_latency;
 
     if (perfc_ctrseti_alloc(
             COMPNAME, sp->name, csched_sp3_perfc, PERFC_EN_SP3, "sp3", &sp->sched_pc))
@@ -2384,11 +3227,42 @@ err_exit:
     mutex_destroy(&sp->new_tlist_lock);
     mutex_destroy(&sp->mutex);
 
+    tbkt_pcpu_free(&sp->tbkt);
+
     free_aligned(sp);
 
     return err;
 }
 
+/**
+ * sp3_create() - External API: constructor
+ */
+merr_t
+sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csched_ops **handle)
+{
+    return sp3_create_impl(ds, rp, mp, false, handle);
+}
+
+/**
+ * sp3_hybrid_create() - External API: constructor of the hybrid policy
+ *
+ * The hybrid policy runs on the sp3 engine but replaces its spill and
+ * node length rules: root and internal nodes are tiered, i.e., spilled
+ * once cn_size_ratio kvsets have accumulated, and leaf nodes are leveled,
+ * i.e., their newer kvsets are kv-compacted into the oldest one once they
+ * reach 1/cn_size_ratio of its size.  The garbage, leaf size and scatter
+ * rules are unchanged.
+ */
+merr_t
+sp3_hybrid_create(
+    struct mpool *       ds,
+    struct kvdb_rparams *rp,
+    const char *         mp,
+    struct csched_ops ** handle)
+{
+    return sp3_create_impl(ds, rp, mp, true, handle);
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "csched_sp3_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
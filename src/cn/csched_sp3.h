@@ -10,7 +10,7 @@
 
 /* MTF_MOCK_DECL(csched_sp3) */
 
-#define RBT_MAX 5
+#define RBT_MAX 9
 #define CN_THROTTLE_MAX (THROTTLE_SENSOR_SCALE_MED + 50)
 
 struct kvdb_rparams;
@@ -21,6 +21,14 @@ struct mpool;
 merr_t
 sp3_create(struct mpool *ds, struct kvdb_rparams *rp, const char *mp, struct csched_ops **handle);
 
+/* MTF_MOCK */
+merr_t
+sp3_hybrid_create(
+    struct mpool *       ds,
+    struct kvdb_rparams *rp,
+    const char *         mp,
+    struct csched_ops ** handle);
+
 struct sp3_rbe {
     s64            rbe_weight;
     struct rb_node rbe_node;
@@ -36,6 +44,7 @@ struct sp3_node {
 struct sp3_tree {
     struct list_head spt_tlink;
     uint             spt_job_cnt;
+    uint             spt_weight;
     atomic_t         spt_enabled;
     atomic_t         spt_ingest_count;
     atomic64_t       spt_ingest_alen;
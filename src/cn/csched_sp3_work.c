@@ -79,6 +79,13 @@ sp3_work_estimate(struct cn_compaction_work *w, uint internal_children, uint lea
         le = list_prev_entry(le, le_link);
     }
 
+    /* A ptomb drop reads and writes nothing, its kvsets are deleted. */
+    if (w->cw_comp_rule == CN_CR_LPTOMB) {
+        w->cw_est.cwe_keys += keys;
+        w->cw_est.cwe_samp.l_alen -= kalen + valen;
+        return;
+    }
+
     consume = 0;
     produce = 0;
     percent_keep = 100;
@@ -462,6 +469,297 @@ sp3_work_leaf_len(
     return 0;
 }
 
+/* Hybrid policy leaf node.  The oldest kvset of a leaf is its level and
+ * the newer kvsets are runs spilled into it from the tiered parent.  The
+ * runs are merged into the level once they hold 1/ratio of its size, or
+ * k-compacted among themselves if there are more than ratio of them.  A
+ * leaf near its max size is spilled as under sp3.
+ */
+static uint
+sp3_work_leaf_level(
+    struct sp3_node *         spn,
+    struct sp3_thresholds *   thresh,
+    uint                      ratio,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule)
+{
+    const struct kvset_stats *stats;
+    struct cn_tree_node *     tn;
+    struct kvset_list_entry * le;
+    u64                       alen, lvl_alen;
+    uint                      kvsets;
+
+    tn = spn2tn(spn);
+    kvsets = cn_ns_kvsets(&tn->tn_ns);
+    if (kvsets < SP3_LCOMP_KVSETS_MIN)
+        return 0;
+
+    le = list_last_entry(&tn->tn_kvset_list, typeof(*le), le_link);
+    stats = kvset_statsp(le->le_kvset);
+    lvl_alen = stats->kst_kalen + stats->kst_valen;
+    alen = cn_ns_alen(&tn->tn_ns) - min_t(u64, lvl_alen, cn_ns_alen(&tn->tn_ns));
+
+    *mark = le;
+
+    if (cn_ns_clen(&tn->tn_ns) * 100 > thresh->lcomp_pop_pct * tn->tn_size_max) {
+        *action = CN_ACTION_SPILL;
+        *rule = CN_CR_LBIG;
+        return min_t(uint, kvsets, thresh->lcomp_kvsets_max);
+    }
+
+    if (alen * ratio >= lvl_alen) {
+        *action = CN_ACTION_COMPACT_KV;
+        *rule = CN_CR_LLEVEL;
+        return min_t(uint, kvsets, thresh->lcomp_kvsets_max);
+    }
+
+    if (kvsets > ratio) {
+        *mark = list_prev_entry(le, le_link);
+        *action = CN_ACTION_COMPACT_K;
+        *rule = CN_CR_LRUNS;
+        return min_t(uint, kvsets - 1, thresh->llen_runlen_max);
+    }
+
+    return 0;
+}
+
+/* Handle a node dense with tombstones.  A leaf k-compacts its oldest
+ * kvsets, which drops their tombstones along with the keys they delete.
+ * An internal node spills its oldest kvsets, moving the tombstones toward
+ * the leaves, regardless of how small the node is.
+ */
+static uint
+sp3_work_tomb(
+    struct sp3_node *         spn,
+    struct sp3_thresholds *   thresh,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule)
+{
+    struct cn_tree_node *    tn;
+    struct kvset_list_entry *le;
+    uint                     kvsets;
+
+    tn = spn2tn(spn);
+    *rule = CN_CR_TOMB;
+
+    if (!cn_node_isleaf(tn)) {
+        *action = CN_ACTION_SPILL;
+        return sp3_work_ispill_find_kvsets(spn, thresh->ispill_kvsets_max, mark);
+    }
+
+    kvsets = cn_ns_kvsets(&tn->tn_ns);
+    if (kvsets == 0)
+        return 0;
+
+    *mark = list_last_entry(&tn->tn_kvset_list, typeof(*le), le_link);
+    *action = CN_ACTION_COMPACT_K;
+
+    return min_t(uint, kvsets, thresh->lcomp_kvsets_max);
+}
+
+/* Handle a leaf whose vblocks are heavy with garbage.  K-compact the oldest
+ * kvsets up to and including the newest one whose vblock garbage passes
+ * vgc_pct, such that the compaction rewrites the live values of those
+ * kvsets and keeps the vblocks of the others.
+ */
+static uint
+sp3_work_vgc(
+    struct sp3_node *         spn,
+    struct sp3_thresholds *   thresh,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule)
+{
+    struct cn_tree_node *    tn;
+    struct kvset_list_entry *le;
+    uint                     kvsets = 0;
+    uint                     n = 0;
+
+    tn = spn2tn(spn);
+
+    list_for_each_entry_reverse (le, &tn->tn_kvset_list, le_link) {
+        if (n == thresh->lcomp_kvsets_max)
+            break;
+
+        ++n;
+        if (kvset_get_vgarb_pct(le->le_kvset) >= thresh->vgc_pct)
+            kvsets = n;
+    }
+
+    if (kvsets == 0)
+        return 0;
+
+    *mark = list_last_entry(&tn->tn_kvset_list, typeof(*le), le_link);
+    *action = CN_ACTION_COMPACT_K;
+    *rule = CN_CR_LVGC;
+
+    return kvsets;
+}
+
+/* Handle a node with a checkpointed spill.  The spill must be resumed
+ * with the same input kvsets, as the children already hold their keys
+ * up to the checkpoint.  Nothing else is done with the node until then.
+ */
+static uint
+sp3_work_spill_resume(
+    struct sp3_node *         spn,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule)
+{
+    struct cn_tree_node *    tn;
+    struct cn_node_ckpt *    ckpt;
+    struct kvset_list_entry *le;
+    uint                     kvsets = 0;
+    bool                     found = false;
+
+    tn = spn2tn(spn);
+    ckpt = tn->tn_ckpt;
+
+    list_for_each_entry_reverse (le, &tn->tn_kvset_list, le_link) {
+        u64 dgen = kvset_get_dgen(le->le_kvset);
+
+        if (kvset_get_workid(le->le_kvset) != 0)
+            return 0;
+
+        if (kvsets == 0 && dgen != ckpt->nc_dgen_lo)
+            return 0;
+
+        ++kvsets;
+        if (dgen == ckpt->nc_dgen_hi) {
+            found = true;
+            break;
+        }
+    }
+
+    if (!found)
+        return 0;
+
+    *mark = list_last_entry(&tn->tn_kvset_list, typeof(*le), le_link);
+    *action = CN_ACTION_SPILL;
+    *rule = CN_CR_SPILL_RESUME;
+
+    return kvsets;
+}
+
+uint
+sp3_kvset_tier(struct sp3_thresholds *thresh, struct kvset *ks)
+{
+    enum mp_media_classp mclass;
+    u64                  heat;
+
+    if (!thresh->tier_hot)
+        return MP_MED_INVALID;
+
+    mclass = kvset_get_mclass(ks);
+    heat = kvset_get_heat(ks);
+
+    if (mclass == MP_MED_CAPACITY && heat >= thresh->tier_hot)
+        return MP_MED_STAGING;
+
+    if (mclass == MP_MED_STAGING && heat < thresh->tier_hot / SP3_TIER_COLD_DIV &&
+        get_time_ns() - kvset_ctime(ks) >= SP3_TIER_AGE_MIN)
+        return MP_MED_CAPACITY;
+
+    return MP_MED_INVALID;
+}
+
+/* Move one leaf kvset to the media class of its heat: the hottest kvset
+ * due for promotion if any, else the oldest kvset due for demotion.  The
+ * kvset is kv-compacted on its own, so the move commits atomically in
+ * cndb like any other compaction.
+ */
+static uint
+sp3_work_tier(
+    struct sp3_node *         spn,
+    struct sp3_thresholds *   thresh,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule,
+    uint *                    mclass)
+{
+    struct cn_tree_node *    tn;
+    struct kvset_list_entry *le;
+    u64                      heat, heat_max = 0;
+
+    tn = spn2tn(spn);
+    *mark = NULL;
+
+    list_for_each_entry_reverse (le, &tn->tn_kvset_list, le_link) {
+        uint tier = sp3_kvset_tier(thresh, le->le_kvset);
+
+        if (tier == MP_MED_INVALID)
+            continue;
+
+        heat = kvset_get_heat(le->le_kvset);
+
+        if (!*mark || (tier == MP_MED_STAGING && heat > heat_max)) {
+            *mark = le;
+            *mclass = tier;
+            heat_max = tier == MP_MED_STAGING ? heat : 0;
+        }
+    }
+
+    if (!*mark)
+        return 0;
+
+    *action = CN_ACTION_COMPACT_KV;
+    *rule = CN_CR_LTIER;
+
+    return 1;
+}
+
+/* Delete the longest run of idle leaf kvsets that are each hidden by a
+ * newer ptomb (see cn_node_ptomb_hidden()).  The job neither reads nor
+ * writes them, it only commits their deletion.
+ */
+static uint
+sp3_work_ptomb(
+    struct sp3_node *         spn,
+    struct sp3_thresholds *   thresh,
+    struct kvset_list_entry **mark,
+    enum cn_action *          action,
+    enum cn_comp_rule *       rule)
+{
+    struct cn_tree_node *    tn;
+    struct kvset_list_entry *le, *start = NULL;
+    u64                      horizon;
+    uint                     kvsets = 0;
+    uint                     n = 0;
+
+    tn = spn2tn(spn);
+    horizon = cn_get_seqno_horizon(tn->tn_tree->cn);
+    *mark = NULL;
+
+    list_for_each_entry_reverse (le, &tn->tn_kvset_list, le_link) {
+        if (kvset_get_workid(le->le_kvset) != 0 || !cn_node_ptomb_hidden(tn, le, horizon)) {
+            n = 0;
+            continue;
+        }
+
+        if (n++ == 0)
+            start = le;
+
+        if (n > kvsets) {
+            *mark = start;
+            kvsets = n;
+        }
+
+        if (kvsets == thresh->lcomp_kvsets_max)
+            break;
+    }
+
+    if (!*mark)
+        return 0;
+
+    *action = CN_ACTION_COMPACT_K;
+    *rule = CN_CR_LPTOMB;
+
+    return kvsets;
+}
+
 uint
 sp3_node_scatter_pct_compute(struct sp3_node *spn)
 {
@@ -639,12 +937,14 @@ sp3_work(
     uint                       ichildc;
     uint                       lchildc;
     bool                       use_token;
+    uint                       ratio;
 
     uint                     n_kvsets = 0;
     enum cn_action           action = CN_ACTION_NONE;
     enum cn_comp_rule        rule = CN_CR_NONE;
     struct kvset_list_entry *mark = NULL;
     atomic_t *               bonus = NULL;
+    uint                     mclass = MP_MED_INVALID;
 
     *qnum_out = 0;
     tn = spn2tn(spn);
@@ -652,6 +952,8 @@ sp3_work(
     if (tn->tn_tree->rp->cn_maint_disable)
         return 0;
 
+    ratio = tn->tn_tree->rp->cn_size_ratio;
+
     if (!*wp) {
         *wp = calloc(1, sizeof(*w));
         if (ev(!*wp))
@@ -674,7 +976,16 @@ sp3_work(
         hse_log(HSE_NOTICE "re-enable compaction after wedge");
     }
 
-    if (cn_node_isleaf(tn)) {
+    /* The output of a checkpointed spill must stay in the children as
+     * is until the spill completes (see cn_tree_ckpt_restore()).
+     */
+    if (tn->tn_parent && tn->tn_parent->tn_ckpt)
+        goto locked_nowork;
+
+    if (tn->tn_ckpt) {
+        n_kvsets = sp3_work_spill_resume(spn, &mark, &action, &rule);
+        *qnum_out = SP3_QNUM_INTERN;
+    } else if (cn_node_isleaf(tn)) {
 
         switch (wtype) {
             case wtype_leaf_size:
@@ -697,10 +1008,38 @@ sp3_work(
                 *qnum_out = SP3_QNUM_LEAFBIG;
                 break;
 
+            case wtype_hybrid:
+                n_kvsets = sp3_work_leaf_level(spn, thresh, ratio, &mark, &action, &rule);
+                *qnum_out = action == CN_ACTION_COMPACT_K ? SP3_QNUM_INTERN : SP3_QNUM_LEAF;
+                break;
+
+            case wtype_tomb:
+                n_kvsets = sp3_work_tomb(spn, thresh, &mark, &action, &rule);
+                *qnum_out = SP3_QNUM_INTERN;
+                break;
+
+            case wtype_vgc:
+                n_kvsets = sp3_work_vgc(spn, thresh, &mark, &action, &rule);
+                *qnum_out = SP3_QNUM_LSCAT;
+                break;
+
+            case wtype_tier:
+                n_kvsets = sp3_work_tier(spn, thresh, &mark, &action, &rule, &mclass);
+                *qnum_out = SP3_QNUM_LSCAT;
+                break;
+
+            case wtype_ptomb:
+                n_kvsets = sp3_work_ptomb(spn, thresh, &mark, &action, &rule);
+                *qnum_out = SP3_QNUM_INTERN;
+                break;
+
             default:
                 ev(1, HSE_WARNING);
                 break;
         }
+    } else if (wtype == wtype_tomb) {
+        n_kvsets = sp3_work_tomb(spn, thresh, &mark, &action, &rule);
+        *qnum_out = SP3_QNUM_INTERN;
     } else {
         uint cmin;
         uint cmax;
@@ -715,6 +1054,12 @@ sp3_work(
                 cmin = thresh->ispill_kvsets_min;
                 cmax = thresh->ispill_kvsets_max;
                 break;
+            case wtype_hybrid:
+                /* Tiered: spill once ratio runs have accumulated. */
+                cmin = ratio;
+                cmax = tn->tn_parent ? thresh->ispill_kvsets_max : thresh->rspill_kvsets_max;
+                cmax = max(cmin, cmax);
+                break;
             default:
                 ev(1, HSE_WARNING);
                 goto locked_nowork;
@@ -788,6 +1133,8 @@ sp3_work(
     w->cw_mark = mark;
     w->cw_action = action;
     w->cw_comp_rule = rule;
+    w->cw_vgc_pct = rule == CN_CR_LVGC ? thresh->vgc_pct : 0;
+    w->cw_mclass = mclass;
     w->cw_bonus = bonus;
     w->cw_debug = debug;
 
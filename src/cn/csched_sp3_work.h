@@ -15,6 +15,7 @@
 
 struct cn_tree_node;
 struct cn_compaction_work;
+struct kvset;
 
 enum sp3_work_type {
     wtype_rspill,       /* root node: spill */
@@ -23,10 +24,16 @@ enum sp3_work_type {
     wtype_leaf_size,    /* leaf nodes: size */
     wtype_node_len,     /* all nodes: numbrer of kvsets */
     wtype_leaf_scatter, /* leaf nodes: scatter */
+    wtype_hybrid,       /* all nodes: tier internal nodes, level leaves */
+    wtype_tomb,         /* internal and leaf nodes: tombstone density */
+    wtype_vgc,          /* leaf nodes: vblock garbage */
+    wtype_tier,         /* leaf nodes: kvsets on the wrong media class */
+    wtype_ptomb,        /* leaf nodes: kvsets hidden by a newer ptomb */
 };
-#define wtype_MAX (wtype_leaf_scatter + 1)
+#define wtype_MAX (wtype_ptomb + 1)
 
 struct sp3_thresholds {
+    u32 tier_hot;
     u8 rspill_kvsets_min;
     u8 rspill_kvsets_max;
     u8 rspill_vautilpct;
@@ -36,6 +43,8 @@ struct sp3_thresholds {
     u8 lcomp_kvsets_max;
     u8 lcomp_pop_pct;
     u8 lscatter_pct;
+    u8 tomb_pct;
+    u8 vgc_pct;
     u8 llen_runlen_min;
     u8 llen_runlen_max;
     u8 llen_kvcompc;
@@ -52,6 +61,26 @@ struct sp3_thresholds {
 #define SP3_LLEN_RUNLEN_MIN ((u8)2)
 #define SP3_LSCAT_THRESH_MIN ((u8)2)
 
+/* Leaf kvsets whose heat reaches tier_hot are moved to the staging media
+ * class, and moved back to capacity once their heat drops below
+ * tier_hot / SP3_TIER_COLD_DIV.  A kvset is not moved back before it is
+ * SP3_TIER_AGE_MIN old, which gives a promoted kvset (whose heat starts
+ * from zero) time to prove itself hot.
+ */
+#define SP3_TIER_COLD_DIV (4)
+#define SP3_TIER_AGE_MIN (5 * 60 * NSEC_PER_SEC)
+
+/**
+ * sp3_kvset_tier() - media class a leaf kvset should be moved to
+ * @thresholds: sp3 thresholds
+ * @ks:         kvset
+ *
+ * Return: enum mp_media_classp, MP_MED_INVALID if the kvset is to stay
+ * where it is
+ */
+uint
+sp3_kvset_tier(struct sp3_thresholds *thresholds, struct kvset *ks);
+
 /* MTF_MOCK */
 merr_t
 sp3_work(
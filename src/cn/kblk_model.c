@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/minmax.h>
+
+#include <float.h>
+
+#include "kblk_model.h"
+
+/**
+ * struct kblk_model_seg - one linear piece of a kblock model
+ * @ms_x0:    key position of the piece's first min key
+ * @ms_slope: kblocks per unit of key position
+ * @ms_y0:    index of the kblock whose min key is at @ms_x0
+ */
+struct kblk_model_seg {
+    u64   ms_x0;
+    float ms_slope;
+    u32   ms_y0;
+};
+
+/**
+ * struct kblk_model - piecewise-linear map from key position to kblock
+ * @km_lcp:   bytes of each key skipped before its position is taken
+ * @km_kblkc: kblocks added so far
+ * @km_kblkn: kblocks expected
+ * @km_segc:  closed pieces in @km_segv
+ * @km_x0:    position of the first key of the open piece
+ * @km_xprev: position of the last key added
+ * @km_y0:    kblock of the first key of the open piece
+ * @km_slo:   least slope that fits all keys of the open piece
+ * @km_shi:   greatest slope that fits all keys of the open piece
+ * @km_segv:  closed pieces, in order of key position
+ */
+struct kblk_model {
+    uint                  km_lcp;
+    uint                  km_kblkc;
+    uint                  km_kblkn;
+    uint                  km_segc;
+    u64                   km_x0;
+    u64                   km_xprev;
+    uint                  km_y0;
+    double                km_slo;
+    double                km_shi;
+    struct kblk_model_seg km_segv[];
+};
+
+/* The position of a key is the eight bytes that follow the common prefix,
+ * zero padded, such that positions are ordered as the keys are.
+ */
+static inline u64
+km_pos(uint lcp, const void *key, uint klen)
+{
+    const u8 *k = key;
+    u64       x = 0;
+    uint      i;
+
+    for (i = lcp; i < lcp + sizeof(x); ++i)
+        x = (x << 8) | (i < klen ? k[i] : 0);
+
+    return x;
+}
+
+static void
+km_seg_open(struct kblk_model *model, u64 x, uint y)
+{
+    model->km_x0 = x;
+    model->km_xprev = x;
+    model->km_y0 = y;
+    model->km_slo = 0;
+    model->km_shi = DBL_MAX;
+}
+
+static void
+km_seg_close(struct kblk_model *model)
+{
+    struct kblk_model_seg *seg = model->km_segv + model->km_segc++;
+
+    assert(model->km_segc <= model->km_kblkn);
+
+    seg->ms_x0 = model->km_x0;
+    seg->ms_y0 = model->km_y0;
+    seg->ms_slope = model->km_slo;
+    if (model->km_shi < DBL_MAX)
+        seg->ms_slope = (model->km_slo + model->km_shi) / 2;
+}
+
+struct kblk_model *
+kblk_model_create(uint lcp, uint kblkc)
+{
+    struct kblk_model *model;
+
+    if (kblkc < KBLK_MODEL_KBLKS_MIN)
+        return NULL;
+
+    model = malloc(sizeof(*model) + sizeof(model->km_segv[0]) * kblkc);
+    if (ev(!model))
+        return NULL;
+
+    memset(model, 0, sizeof(*model));
+    model->km_lcp = lcp;
+    model->km_kblkn = kblkc;
+
+    return model;
+}
+
+void
+kblk_model_destroy(struct kblk_model *model)
+{
+    free(model);
+}
+
+/* Extend the open piece by the key if a line through its first key fits
+ * every key of the piece to within KBLK_MODEL_ERR kblocks (i.e., the cone
+ * of fitting slopes remains non-empty), otherwise open a new piece with it.
+ */
+void
+kblk_model_add(struct kblk_model *model, const void *key, uint klen)
+{
+    u64    x = km_pos(model->km_lcp, key, klen);
+    uint   y = model->km_kblkc++;
+    double dx, dy, lo, hi;
+
+    assert(y < model->km_kblkn);
+
+    if (y == 0) {
+        km_seg_open(model, x, y);
+        return;
+    }
+
+    /* A kblock whose min key has the same position as its predecessor's
+     * cannot be told from it, it is found by widening the search.
+     */
+    if (x <= model->km_xprev)
+        return;
+
+    model->km_xprev = x;
+
+    dx = x - model->km_x0;
+    dy = (double)y - model->km_y0;
+
+    lo = max_t(double, model->km_slo, (dy - KBLK_MODEL_ERR) / dx);
+    hi = min_t(double, model->km_shi, (dy + KBLK_MODEL_ERR) / dx);
+
+    if (lo <= hi) {
+        model->km_slo = lo;
+        model->km_shi = hi;
+        return;
+    }
+
+    km_seg_close(model);
+    km_seg_open(model, x, y);
+}
+
+bool
+kblk_model_seal(struct kblk_model *model)
+{
+    if (model->km_kblkc == 0)
+        return false;
+
+    km_seg_close(model);
+
+    /* Bisecting the pieces and then the predicted window must take fewer
+     * probes than bisecting the kblocks.
+     */
+    return model->km_segc * 8 <= model->km_kblkc;
+}
+
+void
+kblk_model_window(
+    const struct kblk_model *model,
+    const void *             key,
+    uint                     klen,
+    int *                    first,
+    int *                    last)
+{
+    const struct kblk_model_seg *seg;
+    u64                          x;
+    int                          lo, hi, mid, p, ylim;
+    float                        dy;
+
+    x = km_pos(model->km_lcp, key, klen);
+
+    /* Find the last piece that starts at or before the key.
+     */
+    lo = 0;
+    hi = model->km_segc - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (model->km_segv[mid].ms_x0 <= x)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    seg = model->km_segv + lo;
+
+    /* Keys between two pieces belong to the kblocks of the first.
+     */
+    ylim = model->km_kblkc - 1;
+    if (lo + 1 < model->km_segc)
+        ylim = model->km_segv[lo + 1].ms_y0 - 1;
+
+    p = seg->ms_y0;
+    if (x > seg->ms_x0) {
+        dy = seg->ms_slope * (x - seg->ms_x0) + 0.5f;
+        p = dy < ylim - p ? p + (int)dy : ylim;
+    }
+
+    lo = max_t(int, *first, p - KBLK_MODEL_ERR - 1);
+    hi = min_t(int, *last, p + KBLK_MODEL_ERR + 1);
+
+    if (lo > *last)
+        lo = hi = *last;
+    else if (hi < *first)
+        lo = hi = *first;
+
+    *first = lo;
+    *last = hi;
+}
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_CN_KBLK_MODEL_H
+#define HSE_KVS_CN_KBLK_MODEL_H
+
+#include <hse_util/inttypes.h>
+
+/* A kblock model predicts which of the kblocks of a kvset may contain a key,
+ * so that a lookup in a kvset with many kblocks can confine its search to a
+ * few neighbouring kblocks instead of bisecting their min/max keys.
+ *
+ * The model maps the eight key bytes that follow the kvset's common prefix,
+ * read as a big-endian integer, to a kblock index by a piecewise-linear fit
+ * of the kblocks' min keys whose error at every min key is at most
+ * KBLK_MODEL_ERR kblocks.  A prediction is only a hint: callers must verify
+ * it against the kblocks' key ranges and widen the search when it misses.
+ */
+struct kblk_model;
+
+#define KBLK_MODEL_ERR (2)
+#define KBLK_MODEL_KBLKS_MIN (16)
+
+/**
+ * kblk_model_create() - start building a model of a kvset's kblocks
+ * @lcp:   length of the prefix common to all keys in the kvset
+ * @kblkc: number of kblocks to be added
+ *
+ * Return: a model to which the kblocks' min keys are to be added in order,
+ * or NULL if @kblkc is too small to benefit or memory is short.
+ */
+struct kblk_model *
+kblk_model_create(uint lcp, uint kblkc);
+
+/**
+ * kblk_model_add() - add the min key of the next kblock to a model
+ * @model: model under construction
+ * @key:   min key of the kblock
+ * @klen:  length of @key
+ */
+void
+kblk_model_add(struct kblk_model *model, const void *key, uint klen);
+
+/**
+ * kblk_model_seal() - finish building a model
+ * @model: model under construction
+ *
+ * Return: true if the model is compact enough to be worth using, in which
+ * case it is ready for kblk_model_window().  Otherwise the caller should
+ * destroy it.
+ */
+bool
+kblk_model_seal(struct kblk_model *model);
+
+/**
+ * kblk_model_destroy() - free a model
+ * @model: model, may be NULL
+ */
+void
+kblk_model_destroy(struct kblk_model *model);
+
+/**
+ * kblk_model_window() - narrow a kblock search window for a key
+ * @model: sealed model
+ * @key:   key or key prefix to search for
+ * @klen:  length of @key
+ * @first: (in/out) index of the first kblock of the window
+ * @last:  (in/out) index of the last kblock of the window
+ *
+ * The window is narrowed to the kblocks around the predicted one and never
+ * widened, nor left empty if it was not.
+ */
+void
+kblk_model_window(
+    const struct kblk_model *model,
+    const void *             key,
+    uint                     klen,
+    int *                    first,
+    int *                    last);
+
+#endif
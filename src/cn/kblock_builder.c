@@ -14,6 +14,7 @@
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/kvset_builder.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/io_sched.h>
 #include <hse_ikvdb/kvs_rparams.h>
 
 #include <hse_util/alloc.h>
@@ -28,7 +29,9 @@
 #include <hse_util/log2.h>
 
 #include "omf.h"
+#include "blk_crc.h"
 #include "blk_list.h"
+#include "bloom_reader.h"
 #include "wbt_builder.h"
 #include "cn_mblocks.h"
 #include "cn_metrics.h"
@@ -96,10 +99,20 @@ struct hash_set {
  * @bloom_elt_cap: Number of keys Bloom filter can hold at current size
  * @hash_set:  Hash set to store key hashes. Used to build
  *             Bloom filter at end of kblock construction.
+ * @pfx_len:   Length of tree prefixes added to the Bloom filter (or 0).
+ * @num_pfxs:  Number of distinct tree prefixes added to the Bloom filter.
+ * @pfx_last:  Most recently added tree prefix.
  * @num_keys:  Number of keys in kblock.
  * @num_tombstones:  Number of keys in kblock that have tombstone values.
+ * @num_ptombs:      Number of ptombs in kblock.
  * @total_key_bytes: Sum of all key lengths.
  * @total_val_bytes: Sum of all value lengths.
+ * @hix_pgc:   Number of pages reserved for the hash index (or 0).
+ * @hix_cap:   Number of keys the hash index can hold at current size.
+ * @hixv:      Key hashes and leaf node numbers of the keys in the kblock.
+ * @hixv_cap:  Number of entries allocated for @hixv.
+ * @crc_pgc:   Number of pages reserved for the page checksums.
+ * @crc:       Buffer for the page checksums.
  *
  * Description:
  *
@@ -123,6 +136,12 @@ struct hash_set {
  *   Wbtree occupies next wbt_pgc pages.
  *
  *   Bloom tree occupies next blm_pbc pages.
+ *
+ *   The hash index of a point-lookup-only kvs occupies the next hix_pgc
+ *   pages, after the hlog and ptomb tree.
+ *
+ *   The checksums of all the preceding pages occupy the last pages.  Room
+ *   for the checksums of a kblock of max_pgc pages is reserved up front.
  */
 struct curr_kblock {
 
@@ -135,6 +154,7 @@ struct curr_kblock {
     u64 total_val_bytes;
     u32 num_keys;
     u32 num_tombstones;
+    u32 num_ptombs;
 
     uint max_size;
     uint max_pgc;
@@ -145,16 +165,36 @@ struct curr_kblock {
     struct hash_set        hash_set;
     struct bf_bithash_desc desc;
 
+    uint num_pfxs;
+    uint pfx_len;
+    u8   pfx_last[HSE_KVS_MAX_PFXLEN];
+
     void *kblk_hdr;
     void *bloom;
     uint  bloom_len;
     uint  bloom_alloc_len;
+
+    bool  hix_create;
+    uint  hix_pgc;
+    uint  hix_cap;
+    u64 * hixv;
+    uint  hixv_cap;
+    void *hix;
+    uint  hix_alloc_len;
+
+    uint  crc_pgc;
+    void *crc;
 };
 
+/* Keep the hash index at most 3/4 full so that probes stay short. */
+#define KBLOCK_HIX_SLOTS_PER_PG (PAGE_SIZE / sizeof(u32))
+#define KBLOCK_HIX_KEYS_PER_PG ((KBLOCK_HIX_SLOTS_PER_PG * 3) / 4)
+
 static __always_inline uint
 free_pgc(struct curr_kblock *kblk)
 {
-    uint used = KBLOCK_HDR_PAGES + HLOG_PGC + kblk->blm_pgc + kblk->wbt_pgc;
+    uint used = KBLOCK_HDR_PAGES + HLOG_PGC + kblk->blm_pgc + kblk->wbt_pgc + kblk->hix_pgc +
+                kblk->crc_pgc;
 
     assert(kblk->max_pgc >= used);
     if (kblk->max_pgc >= used)
@@ -182,6 +222,7 @@ struct kblock_builder {
     bool                   cn_mblk_sync_writes;
     bool                   finished;
     enum mp_media_classp   mclass;
+    enum mblock_life       life;
     uint                   flags;
     struct wbb *           ptree;
     uint                   pt_pgc;
@@ -239,6 +280,10 @@ mblk_blow_chunks(
 
     u64                    dt = 0;
     struct cn_merge_stats *stats = self->mstats;
+    struct io_sched *      ios = cn_get_io_sched(self->cn);
+    enum io_sched_class    cls;
+
+    cls = (self->flags & KVSET_BUILDER_FLAGS_INGEST) ? IOS_INGEST : IOS_COMPACT;
 
     /* ax, aoff, alen, bx, blen explained:
      *
@@ -281,10 +326,20 @@ mblk_blow_chunks(
         }
 
         if (!(self->flags & KVSET_BUILDER_FLAGS_INGEST)) {
-            struct tbkt *tb = cn_get_tbkt_maint(self->cn);
+            struct tbkt *tb;
 
-            if (tb)
-                tbkt_delay(tbkt_request(tb, wlen));
+            if (self->flags & KVSET_BUILDER_FLAGS_VGC)
+                tb = cn_get_tbkt_vgc(self->cn);
+            else
+                tb = cn_get_tbkt_maint(self->cn);
+
+            if (tb) {
+                u64 delay = tbkt_request_floor(tb, cn_get_tbkt_floor(self->cn), wlen);
+
+                tbkt_delay(delay);
+                if (stats)
+                    count_ops(&stats->ms_tbkt_delay, 1, wlen, delay);
+            }
         }
 
         if (alen >= need) {
@@ -297,8 +352,10 @@ mblk_blow_chunks(
 
             if (stats)
                 dt = get_time_ns();
+            io_sched_enter(ios, self->mclass, cls, need);
             err = mpool_mblock_write_data(
                 self->ds, self->cn_mblk_sync_writes, mbh, iov + ax, 1, pasyncio);
+            io_sched_exit(ios, self->mclass);
             if (ev(err))
                 return err;
             if (stats)
@@ -337,8 +394,10 @@ mblk_blow_chunks(
 
             if (stats)
                 dt = get_time_ns();
+            io_sched_enter(ios, self->mclass, cls, wlen);
             err = mpool_mblock_write_data(
                 self->ds, self->cn_mblk_sync_writes, mbh, iov + ax, bx - ax + 1, pasyncio);
+            io_sched_exit(ios, self->mclass);
             if (ev(err))
                 return err;
             if (stats)
@@ -389,7 +448,7 @@ hash_set_init(struct hash_set *hs)
 }
 
 static merr_t
-hash_set_add(struct hash_set *hs, const struct key_obj *kobj)
+hash_set_add_hash(struct hash_set *hs, u64 hash)
 {
     if (!hs->curr_part) {
         hs->curr_part = malloc(sizeof(*hs->curr_part));
@@ -401,7 +460,7 @@ hash_set_add(struct hash_set *hs, const struct key_obj *kobj)
 
     assert(hs->curr_part->n_hashes < HSP_HASH_MAX_KEYS);
 
-    hs->curr_part->hashvec[hs->curr_part->n_hashes++] = key_obj_hash64(kobj);
+    hs->curr_part->hashvec[hs->curr_part->n_hashes++] = hash;
 
     /* If full, then use next part.  If next is null, allocate new
      * part next time one is added.
@@ -411,6 +470,12 @@ hash_set_add(struct hash_set *hs, const struct key_obj *kobj)
     return 0;
 }
 
+static merr_t
+hash_set_add(struct hash_set *hs, const struct key_obj *kobj)
+{
+    return hash_set_add_hash(hs, key_obj_hash64(kobj));
+}
+
 void
 hash_set_reset(struct hash_set *hs)
 {
@@ -478,12 +543,19 @@ kblock_init(
 
     kblk->max_size = max_size;
     kblk->max_pgc = max_size / PAGE_SIZE;
+    kblk->crc_pgc = MBLK_CRC_PGC(kblk->max_pgc);
     kblk->rp = rp;
     kblk->cp = cp;
     kblk->pc = pc;
     kblk->desc = bf_compute_bithash_est(rp->cn_bloom_prob);
 
-    err = wbb_create(&kblk->wbtree, kblk->wbt_pgc + free_pgc(kblk), &kblk->wbt_pgc);
+    if (rp->cn_bloom_pfx)
+        kblk->pfx_len = min_t(uint, cp->cp_pfx_len, HSE_KVS_MAX_PFXLEN);
+
+    kblk->hix_create = cp->cp_ptlookup && !cp->cp_sfx_len;
+
+    err = wbb_create(
+        &kblk->wbtree, kblk->wbt_pgc + free_pgc(kblk), &kblk->wbt_pgc, rp->kblock_fcode);
     if (ev(err))
         return err;
 
@@ -499,11 +571,16 @@ kblock_reset(struct curr_kblock *kblk)
     kblk->total_val_bytes = 0;
     kblk->num_keys = 0;
     kblk->num_tombstones = 0;
+    kblk->num_ptombs = 0;
+    kblk->num_pfxs = 0;
 
     kblk->blm_pgc = 0;
     kblk->blm_elt_cap = 0;
     kblk->bloom_len = 0;
 
+    kblk->hix_pgc = 0;
+    kblk->hix_cap = 0;
+
     hash_set_reset(&kblk->hash_set);
 
     wbb_reset(kblk->wbtree, &kblk->wbt_pgc);
@@ -517,6 +594,9 @@ kblock_free(struct curr_kblock *kblk)
 {
     free_aligned(kblk->kblk_hdr);
     free_aligned(kblk->bloom);
+    free_aligned(kblk->hix);
+    free(kblk->hixv);
+    free_aligned(kblk->crc);
 
     wbb_destroy(kblk->wbtree);
     hash_set_free(&kblk->hash_set);
@@ -552,9 +632,21 @@ kblock_add_entry(
 
     if (kblk->rp->cn_bloom_create) {
         size_t tree_sfx_len = kblk->cp->cp_sfx_len;
+        u8     pfx[HSE_KVS_MAX_PFXLEN];
+        bool   newpfx = false;
+
+        /* Add each distinct tree prefix to the bloom so that prefix
+         * cursors can skip kblocks that have no keys with their prefix.
+         * Keys arrive in sorted order, so comparing with the previous
+         * prefix suffices for uniqueness.
+         */
+        if (kblk->pfx_len && key_obj_len(kobj) >= kblk->pfx_len) {
+            key_obj_copy(pfx, kblk->pfx_len, NULL, kobj);
+            newpfx = !kblk->num_pfxs || memcmp(pfx, kblk->pfx_last, kblk->pfx_len);
+        }
 
         /* Ensure we have enough pages reserved for bloom filters. */
-        if (kblk->num_keys + 1 > kblk->blm_elt_cap) {
+        if (kblk->num_keys + kblk->num_pfxs + 1 + newpfx > kblk->blm_elt_cap) {
             if (!free_pgc(kblk))
                 return 0;
             kblk->blm_pgc++;
@@ -574,10 +666,42 @@ kblock_add_entry(
             err = hash_set_add(&kblk->hash_set, kobj);
         }
 
+        if (!err && newpfx) {
+            err = hash_set_add_hash(&kblk->hash_set, key_hash64(pfx, kblk->pfx_len));
+            if (!err) {
+                memcpy(kblk->pfx_last, pfx, kblk->pfx_len);
+                kblk->num_pfxs++;
+            }
+        }
+
         if (ev(err))
             return err;
     }
 
+    /* Ensure we have enough pages reserved for the hash index, and room
+     * to remember the key's hash once it is added.
+     */
+    if (kblk->hix_create) {
+        if (kblk->num_keys + 1 > kblk->hix_cap) {
+            if (!free_pgc(kblk))
+                return 0;
+            kblk->hix_pgc++;
+            kblk->hix_cap = kblk->hix_pgc * KBLOCK_HIX_KEYS_PER_PG;
+        }
+
+        if (kblk->num_keys + 1 > kblk->hixv_cap) {
+            uint  cap = max_t(uint, kblk->hixv_cap * 2, KBLOCK_HIX_KEYS_PER_PG);
+            u64 * hixv;
+
+            hixv = realloc(kblk->hixv, cap * sizeof(*hixv));
+            if (ev(!hixv))
+                return merr(ENOMEM);
+
+            kblk->hixv = hixv;
+            kblk->hixv_cap = cap;
+        }
+    }
+
     /* update wbtree */
     err = wbb_add_entry(
         kblk->wbtree,
@@ -592,6 +716,14 @@ kblock_add_entry(
     if (ev(err) || !*added)
         return err;
 
+    /* The leaf node number fits in the bits of the hash the index drops. */
+    if (kblk->hix_create) {
+        uint node = wbb_leaf_node(kblk->wbtree);
+
+        assert(node <= KBLOCK_HIX_NODE_MAX);
+        kblk->hixv[kblk->num_keys] = (key_obj_hash64(kobj) & ~0xffffull) | node;
+    }
+
     /* update metrics */
     kblk->num_keys++;
     kblk->total_key_bytes += key_obj_len(kobj);
@@ -610,8 +742,11 @@ _kblock_finish_bloom(struct curr_kblock *kblk, struct bloom_hdr_omf *blm_hdr)
 {
     struct bloom_filter   bloom;
     struct hash_set_part *part;
+    bool                  split;
+
+    split = (kblk->rp->cn_bloom_create == BLOOM_CREATE_SPLIT);
 
-    if (kblk->num_keys == 0 || kblk->rp->cn_bloom_create == 0) {
+    if (kblk->num_keys == 0 || kblk->rp->cn_bloom_create == BLOOM_CREATE_NONE) {
         assert(kblk->blm_pgc == 0);
         memset(&bloom, 0, sizeof(bloom));
     } else {
@@ -628,7 +763,10 @@ _kblock_finish_bloom(struct curr_kblock *kblk, struct bloom_hdr_omf *blm_hdr)
         }
 
         memset(kblk->bloom, 0, kblk->bloom_len);
-        bf_filter_init(&bloom, kblk->desc, kblk->num_keys, kblk->bloom, kblk->bloom_len);
+        if (split)
+            bf_filter_init_split(&bloom, kblk->desc, kblk->num_keys, kblk->bloom, kblk->bloom_len);
+        else
+            bf_filter_init(&bloom, kblk->desc, kblk->num_keys, kblk->bloom, kblk->bloom_len);
         list_for_each_entry (part, &kblk->hash_set.part_list, part_link) {
             bf_filter_insert_by_hashv(&bloom, part->hashvec, part->n_hashes);
         }
@@ -637,12 +775,91 @@ _kblock_finish_bloom(struct curr_kblock *kblk, struct bloom_hdr_omf *blm_hdr)
     /* Construct Bloom header */
     memset(blm_hdr, 0, sizeof(*blm_hdr));
     omf_set_bh_magic(blm_hdr, BLOOM_OMF_MAGIC);
-    omf_set_bh_version(blm_hdr, BLOOM_OMF_VERSION);
+    omf_set_bh_version(blm_hdr, split ? BLOOM_OMF_VERSION5 : BLOOM_OMF_VERSION4);
     omf_set_bh_bitmapsz(blm_hdr, bloom.bf_bitmapsz);
     omf_set_bh_modulus(blm_hdr, bloom.bf_modulus);
     omf_set_bh_bktshift(blm_hdr, bloom.bf_bktshift);
     omf_set_bh_rotl(blm_hdr, bloom.bf_rotl);
     omf_set_bh_n_hashes(blm_hdr, bloom.bf_n_hashes);
+    if (kblk->pfx_len && bloom.bf_bitmapsz)
+        omf_set_bh_flags(blm_hdr, BLOOM_OMF_FLAG_PFX);
+
+    return 0;
+}
+
+/**
+ * _kblock_finish_hix() - build the hash index from the recorded key hashes
+ */
+static merr_t
+_kblock_finish_hix(struct curr_kblock *kblk)
+{
+    __le32 *slotv;
+    size_t  len;
+    uint    nslots, slot, i;
+
+    if (!kblk->hix_pgc)
+        return 0;
+
+    len = kblk->hix_pgc * PAGE_SIZE;
+    if (kblk->hix_alloc_len < len) {
+        free_aligned(kblk->hix);
+        kblk->hix = alloc_page_aligned(len, GFP_KERNEL);
+        if (!kblk->hix) {
+            kblk->hix_alloc_len = 0;
+            return merr(ev(ENOMEM));
+        }
+        kblk->hix_alloc_len = len;
+    }
+
+    memset(kblk->hix, 0, len);
+
+    slotv = kblk->hix;
+    nslots = len / sizeof(*slotv);
+
+    assert(kblk->num_keys <= kblk->hix_cap);
+
+    for (i = 0; i < kblk->num_keys; i++) {
+        u64 hash = kblk->hixv[i];
+
+        slot = (hash >> 16) % nslots;
+        while (slotv[slot])
+            slot = (slot + 1) % nslots;
+
+        slotv[slot] = cpu_to_le32(KBLOCK_HIX_SLOT(hash, hash & 0xffff));
+    }
+
+    return 0;
+}
+
+/**
+ * _kblock_finish_crc() - checksum the kblock image and append the checksums
+ * @iov:     (in/out) kblock image, header included
+ * @iov_cnt: (in/out) number of entries in @iov
+ */
+static merr_t
+_kblock_finish_crc(struct curr_kblock *kblk, struct iovec *iov, uint *iov_cnt)
+{
+    struct kblock_hdr_omf *hdr = kblk->kblk_hdr;
+    uint                   len, pgc;
+
+    len = kblk->crc_pgc * PAGE_SIZE;
+    if (!kblk->crc) {
+        kblk->crc = alloc_page_aligned(len, GFP_KERNEL);
+        if (!kblk->crc)
+            return merr(ENOMEM);
+    }
+
+    memset(kblk->crc, 0, len);
+
+    pgc = blk_crc_iov(iov, *iov_cnt, kblk->crc);
+    if (ev(pgc != omf_kbh_crc_doff_pg(hdr))) {
+        assert(0);
+        return merr(EBUG);
+    }
+
+    iov[*iov_cnt].iov_base = kblk->crc;
+    iov[*iov_cnt].iov_len = omf_kbh_crc_dlen_pg(hdr) * PAGE_SIZE;
+    ++*iov_cnt;
 
     return 0;
 }
@@ -697,6 +914,7 @@ _kblock_make_header(
     omf_set_kbh_version(hdr, KBLOCK_HDR_VERSION);
     omf_set_kbh_entries(hdr, kblk->num_keys);
     omf_set_kbh_tombs(hdr, kblk->num_tombstones);
+    omf_set_kbh_ptombs(hdr, kblk->num_ptombs);
     omf_set_kbh_key_bytes(hdr, kblk->total_key_bytes);
     omf_set_kbh_val_bytes(hdr, kblk->total_val_bytes);
 
@@ -766,6 +984,17 @@ _kblock_make_header(
         omf_set_kbh_pt_dlen_pg(hdr, pt_pgc);
     }
 
+    if (kblk->hix_pgc) {
+        omf_set_kbh_hix_doff_pg(
+            hdr, KBLOCK_HDR_PAGES + kblk->wbt_pgc + kblk->blm_pgc + HLOG_PGC + pt_pgc);
+        omf_set_kbh_hix_dlen_pg(hdr, kblk->hix_pgc);
+    }
+
+    off = KBLOCK_HDR_PAGES + kblk->wbt_pgc + kblk->blm_pgc + HLOG_PGC + pt_pgc + kblk->hix_pgc;
+    omf_set_kbh_crc_doff_pg(hdr, off);
+    omf_set_kbh_crc_dlen_pg(hdr, MBLK_CRC_PGC(off));
+    assert(MBLK_CRC_PGC(off) <= kblk->crc_pgc);
+
     omf_set_kbh_min_seqno(hdr, seqno_min);
     omf_set_kbh_max_seqno(hdr, seqno_max);
 
@@ -811,7 +1040,7 @@ kblock_finish(struct kblock_builder *bld, struct wbb *ptree)
     struct blk_list *      blklist = &bld->finished_kblks;
     struct cn_merge_stats *stats = bld->mstats;
 
-    struct iovec iov[(2 * WBB_FREEZE_IOV_MAX) + 3];
+    struct iovec iov[(2 * WBB_FREEZE_IOV_MAX) + 5];
     uint         iov_cnt = 0;
     uint         i, chunk;
     size_t       wlen;
@@ -889,11 +1118,27 @@ kblock_finish(struct kblock_builder *bld, struct wbb *ptree)
         iov_cnt += i;
     }
 
+    /* Finalize hash index, which must follow the ptomb tree. */
+    err = _kblock_finish_hix(kblk);
+    if (ev(err))
+        goto errout;
+    if (kblk->hix_pgc) {
+        iov[iov_cnt].iov_base = kblk->hix;
+        iov[iov_cnt].iov_len = kblk->hix_pgc * PAGE_SIZE;
+        iov_cnt++;
+    }
+
     /* Format kblock header. */
-    kblk->num_keys += ptree ? wbb_entries(ptree) : 0;
+    kblk->num_ptombs = ptree ? wbb_entries(ptree) : 0;
+    kblk->num_keys += kblk->num_ptombs;
     _kblock_make_header(
         kblk, &wbt_hdr, &pt_hdr, pt_pgc, &blm_hdr, bld->seqno_min, bld->seqno_max, kblk->kblk_hdr);
 
+    /* Checksum every page written so far, header included. */
+    err = _kblock_finish_crc(kblk, iov, &iov_cnt);
+    if (ev(err))
+        goto errout;
+
     /* pre-allocate space for handle and blkid */
     err = blk_list_append(blklist, 0, 0);
     if (ev(err))
@@ -916,7 +1161,7 @@ kblock_finish(struct kblock_builder *bld, struct wbb *ptree)
 
     if (stats)
         tstart = get_time_ns();
-    err = mpool_mblock_alloc(bld->ds, bld->mclass, spare, &handle, &mbprop);
+    err = cn_mblock_alloc(bld->cn, bld->ds, bld->mclass, bld->life, spare, &handle, &mbprop);
     if (ev(err))
         goto errout;
 
@@ -1001,6 +1246,7 @@ kbb_create(struct kblock_builder **builder_out, struct cn *cn, struct perfc_set
     bld->pc = pc;
     bld->flags = flags;
     bld->mclass = MP_MED_CAPACITY;
+    bld->life = MBLOCK_LIFE_SHORT;
     bld->cn_mblk_sync_writes = cn_get_mblk_sync_writes(cn);
 
     err = hlog_create(&bld->hlog, HLOG_PRECISION);
@@ -1013,7 +1259,7 @@ kbb_create(struct kblock_builder **builder_out, struct cn *cn, struct perfc_set
     if (ev(err))
         goto err_exit2;
 
-    err = wbb_create(&bld->ptree, kb_size / PAGE_SIZE, &bld->pt_pgc);
+    err = wbb_create(&bld->ptree, kb_size / PAGE_SIZE, &bld->pt_pgc, false);
     if (ev(err))
         goto err_exit3;
 
@@ -1164,7 +1410,8 @@ kbb_finish(struct kblock_builder *bld, struct blk_list *kblks, u64 seqno_min, u6
         u64         kbsize = (bld->rp->kblock_size_mb << 20);
         u64         ptsize = (wbb_page_cnt_get(bld->ptree)) * PAGE_SIZE;
         u64         kbused =
-            (KBLOCK_HDR_PAGES + HLOG_PGC + bld->curr.blm_pgc + wbb_page_cnt_get(bld->curr.wbtree)) *
+            (KBLOCK_HDR_PAGES + HLOG_PGC + bld->curr.blm_pgc + bld->curr.crc_pgc +
+             wbb_page_cnt_get(bld->curr.wbtree)) *
             PAGE_SIZE;
 
         hse_log(HSE_DEBUG "kbsize %lu kbused %lu ptsize %lu", kbsize, kbused, ptsize);
@@ -1207,12 +1454,40 @@ kbb_get_mclass(struct kblock_builder *bld)
     return bld->mclass;
 }
 
+void
+kbb_set_life(struct kblock_builder *bld, enum mblock_life life)
+{
+    bld->life = life;
+}
+
 void
 kbb_set_merge_stats(struct kblock_builder *bld, struct cn_merge_stats *stats)
 {
     bld->mstats = stats;
 }
 
+void
+kbb_set_node_level(struct kblock_builder *bld, uint level)
+{
+    struct curr_kblock *kblk = &bld->curr;
+    ulong               lvl = bld->rp->kblock_lcomp_lvl;
+    merr_t              err;
+
+    if (!kblock_is_empty(kblk))
+        return;
+
+    /* Leave the tree uncompressed if the staging buffer cannot be had.
+     */
+    err = wbb_set_lcomp(kblk->wbtree, lvl > 0 && level >= lvl, &kblk->wbt_pgc);
+    ev(err);
+}
+
+void
+kbb_merge_hlog(struct kblock_builder *dst, struct kblock_builder *src)
+{
+    hlog_union(dst->hlog, hlog_data(src->hlog));
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "kblock_builder_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
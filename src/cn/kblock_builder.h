@@ -12,6 +12,8 @@
 #include <hse_util/perfc.h>
 #include <hse_util/key_util.h>
 
+#include <hse_ikvdb/mblock_life.h>
+
 struct cn;
 struct kblock_builder;
 struct blk_list;
@@ -140,9 +142,34 @@ kbb_set_mclass(struct kblock_builder *bld, enum mp_media_classp mclass);
 enum mp_media_classp
 kbb_get_mclass(struct kblock_builder *bld);
 
+/**
+ * kbb_set_life() - set the expected lifetime of the kblocks to be built
+ */
+void
+kbb_set_life(struct kblock_builder *bld, enum mblock_life life);
+
 void
 kbb_set_merge_stats(struct kblock_builder *bld, struct cn_merge_stats *stats);
 
+/**
+ * kbb_set_node_level() - set the cn tree level of the kvset being built
+ * @bld:   kblock builder
+ * @level: cn tree node level
+ *
+ * Kblocks of kvsets at or below the kblock_lcomp_lvl level have their
+ * wbtree leaf nodes compressed.  Must be called before adding entries.
+ */
+void
+kbb_set_node_level(struct kblock_builder *bld, uint level);
+
+/**
+ * kbb_merge_hlog() - add the keys seen by one builder to another's hlog
+ * @dst: kblock builder whose last kblock will carry the combined hlog
+ * @src: kblock builder, may be finished
+ */
+void
+kbb_merge_hlog(struct kblock_builder *dst, struct kblock_builder *src);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "kblock_builder_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
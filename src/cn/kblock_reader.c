@@ -12,6 +12,9 @@
 #include <hse_util/compiler.h>
 #include <hse_util/arch.h>
 #include <hse_util/bloom_filter.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/logging.h>
+#include <hse_util/mman.h>
 
 #include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/tuple.h>
@@ -22,8 +25,88 @@
 #include "bloom_reader.h"
 #include "wbt_reader.h"
 #include "kvs_mblk_desc.h"
+#include "blk_crc.h"
 #include "cn_metrics.h"
 #include "kblock_reader.h"
+#include "wbt_internal.h"
+
+#define KBR_LCACHE_SHIFT (10) /* 1024 pages of decompressed leaf nodes */
+
+/**
+ * struct kbr_lcache_slot - a slot of the decompressed leaf node cache
+ * @ls_lock:  protects the slot
+ * @ls_blkid: kblock id of the cached node (zero if the slot is empty)
+ * @ls_base:  kblock's mcache map base, which qualifies @ls_blkid
+ * @ls_node:  leaf node number
+ * @ls_page:  decompressed leaf node
+ *
+ * The cache is direct mapped and small, it exists to spare repeated
+ * lookups in the same cold kblocks from decompressing the same leaf nodes.
+ * Hits are copied out under the slot lock, which is much cheaper than
+ * decompressing the node and leaves no references to track.
+ */
+struct kbr_lcache_slot {
+    spinlock_t  ls_lock;
+    u64         ls_blkid;
+    const void *ls_base;
+    uint        ls_node;
+    void *      ls_page;
+} __aligned(SMP_CACHE_BYTES);
+
+static struct kbr_lcache_slot *kbr_lcache;
+static void *                  kbr_lcache_pages;
+static atomic_t                kbr_init_ref;
+
+static inline struct kbr_lcache_slot *
+kbr_lcache_slot(u64 blkid, uint node)
+{
+    u64 h = (blkid ^ ((u64)node << 32 | node)) * 0x9e3779b97f4a7c15ull;
+
+    return kbr_lcache + (h >> (64 - KBR_LCACHE_SHIFT));
+}
+
+merr_t
+kbr_init(void)
+{
+    size_t nslots = 1u << KBR_LCACHE_SHIFT;
+    size_t i;
+
+    if (atomic_inc_return(&kbr_init_ref) > 1)
+        return 0;
+
+    kbr_lcache = alloc_aligned(nslots * sizeof(*kbr_lcache), SMP_CACHE_BYTES, GFP_KERNEL);
+    kbr_lcache_pages = alloc_page_aligned(nslots * PAGE_SIZE, GFP_KERNEL);
+
+    if (ev(!kbr_lcache || !kbr_lcache_pages)) {
+        free_aligned(kbr_lcache_pages);
+        free_aligned(kbr_lcache);
+        kbr_lcache_pages = NULL;
+        kbr_lcache = NULL;
+        atomic_dec(&kbr_init_ref);
+        return merr(ENOMEM);
+    }
+
+    memset(kbr_lcache, 0, nslots * sizeof(*kbr_lcache));
+
+    for (i = 0; i < nslots; ++i) {
+        spin_lock_init(&kbr_lcache[i].ls_lock);
+        kbr_lcache[i].ls_page = kbr_lcache_pages + i * PAGE_SIZE;
+    }
+
+    return 0;
+}
+
+void
+kbr_fini(void)
+{
+    if (atomic_dec_return(&kbr_init_ref) > 0)
+        return;
+
+    free_aligned(kbr_lcache_pages);
+    free_aligned(kbr_lcache);
+    kbr_lcache_pages = NULL;
+    kbr_lcache = NULL;
+}
 
 static __always_inline bool
 kblock_hdr_valid(const struct kblock_hdr_omf *omf)
@@ -51,6 +134,9 @@ kbr_get_kblock_desc(
     kblkdesc->map = map;
     kblkdesc->map_idx = map_idx;
     kblkdesc->map_base = base;
+    kblkdesc->crcv = NULL;
+    kblkdesc->crc_pgc = 0;
+    kblkdesc->crc_okv = NULL;
     return 0;
 }
 
@@ -61,17 +147,25 @@ kbr_read_wbt_region_desc_mem(void *wbt_hdr, struct wbt_desc *desc)
 
     switch (desc->wbd_version) {
         case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
         case WBT_TREE_VERSION4:
             desc->wbd_root = omf_wbt_root(wbt_hdr);
             desc->wbd_leaf = omf_wbt_leaf(wbt_hdr);
             desc->wbd_leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+            desc->wbd_leaf_pgc = desc->wbd_leaf_cnt;
             desc->wbd_kmd_pgc = omf_wbt_kmd_pgc(wbt_hdr);
+
+            if (wbt_leaf_compressed(desc))
+                desc->wbd_leaf_pgc = omf_wbt_leaf_pgc(wbt_hdr);
             break;
 
         case WBT_TREE_VERSION3:
             desc->wbd_root = omf_wbt3_root(wbt_hdr);
             desc->wbd_leaf = omf_wbt3_leaf(wbt_hdr);
             desc->wbd_leaf_cnt = omf_wbt3_leaf_cnt(wbt_hdr);
+            desc->wbd_leaf_pgc = desc->wbd_leaf_cnt;
             desc->wbd_kmd_pgc = omf_wbt3_kmd_pgc(wbt_hdr);
             break;
 
@@ -138,6 +232,65 @@ kbr_read_seqno_range(struct kvs_mblk_desc *kblkdesc, u64 *seqno_min, u64 *seqno_
     return 0;
 }
 
+merr_t
+kbr_read_hix_region(struct kvs_mblk_desc *kblkdesc, const void **hix, u32 *hixc)
+{
+    merr_t                 err;
+    size_t                 pg_idxs[1];
+    struct kblock_hdr_omf *kb_hdr;
+    void *                 pg;
+
+    *hix = NULL;
+    *hixc = 0;
+
+    pg_idxs[0] = 0;
+    err = mpool_mcache_getpages(kblkdesc->map, 1, kblkdesc->map_idx, pg_idxs, &pg);
+    if (ev(err))
+        return err;
+
+    kb_hdr = pg;
+    if (!kblock_hdr_valid(kb_hdr))
+        return merr(EINVAL);
+
+    if (omf_kbh_version(kb_hdr) <= KBLOCK_HDR_VERSION6 || !omf_kbh_hix_dlen_pg(kb_hdr))
+        return 0;
+
+    *hix = kblkdesc->map_base + PAGE_SIZE * omf_kbh_hix_doff_pg(kb_hdr);
+    *hixc = omf_kbh_hix_dlen_pg(kb_hdr) * (PAGE_SIZE / sizeof(u32));
+
+    return 0;
+}
+
+merr_t
+kbr_read_crc_region(struct kvs_mblk_desc *kblkdesc)
+{
+    merr_t                 err;
+    size_t                 pg_idxs[1];
+    struct kblock_hdr_omf *kb_hdr;
+    void *                 pg;
+
+    pg_idxs[0] = 0;
+    err = mpool_mcache_getpages(kblkdesc->map, 1, kblkdesc->map_idx, pg_idxs, &pg);
+    if (ev(err))
+        return err;
+
+    kb_hdr = pg;
+    if (!kblock_hdr_valid(kb_hdr))
+        return merr(EINVAL);
+
+    if (omf_kbh_version(kb_hdr) <= KBLOCK_HDR_VERSION7 || !omf_kbh_crc_dlen_pg(kb_hdr))
+        return 0;
+
+    if (ev(MBLK_CRC_PGC(omf_kbh_crc_doff_pg(kb_hdr)) > omf_kbh_crc_dlen_pg(kb_hdr)))
+        return merr(EILSEQ);
+
+    kblkdesc->crcv = kblkdesc->map_base + PAGE_SIZE * omf_kbh_crc_doff_pg(kb_hdr);
+    kblkdesc->crc_pgc = omf_kbh_crc_doff_pg(kb_hdr);
+
+    /* Verify the header before the other regions are located through it. */
+    return blk_crc_verify(kblkdesc, 0, PAGE_SIZE);
+}
+
 merr_t
 kbr_read_pt_region_desc(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc)
 {
@@ -214,7 +367,7 @@ kbr_read_blm_region_desc(struct kvs_mblk_desc *kbd, struct bloom_desc *desc)
      * it's safe to run without blooms, albeit at a big hit to read perf.
      */
     version = omf_bh_version(blm_omf);
-    if (ev(version != BLOOM_OMF_VERSION)) {
+    if (ev(version != BLOOM_OMF_VERSION5 && version != BLOOM_OMF_VERSION4)) {
         hse_log(
             HSE_ERR "%s: bloom %lx invalid version %u (expected %u)",
             __func__,
@@ -232,6 +385,8 @@ kbr_read_blm_region_desc(struct kvs_mblk_desc *kbd, struct bloom_desc *desc)
     desc->bd_n_hashes = omf_bh_n_hashes(blm_omf);
     desc->bd_rotl = omf_bh_rotl(blm_omf);
     desc->bd_bktmask = (1u << desc->bd_bktshift) - 1;
+    desc->bd_split = (version == BLOOM_OMF_VERSION5);
+    desc->bd_pfx = !!(omf_bh_flags(blm_omf) & BLOOM_OMF_FLAG_PFX);
 
     return 0;
 }
@@ -330,6 +485,9 @@ kbr_read_metrics(struct kvs_mblk_desc *kblkdesc, struct kblk_metrics *metrics)
 
     metrics->num_keys = omf_kbh_entries(hdr);
     metrics->num_tombstones = omf_kbh_tombs(hdr);
+    metrics->num_ptombs = 0;
+    if (omf_kbh_version(hdr) > KBLOCK_HDR_VERSION5)
+        metrics->num_ptombs = omf_kbh_ptombs(hdr);
     metrics->tot_key_bytes = omf_kbh_key_bytes(hdr);
     metrics->tot_val_bytes = omf_kbh_val_bytes(hdr);
     metrics->tot_wbt_pages = omf_kbh_wbt_dlen_pg(hdr);
@@ -338,6 +496,108 @@ kbr_read_metrics(struct kvs_mblk_desc *kblkdesc, struct kblk_metrics *metrics)
     return 0;
 }
 
+/* Verify the mapped pages of a leaf node on their first access.  The
+ * descriptor is const for the readers, only its verified page bitmap
+ * is updated here.
+ */
+static merr_t
+kbr_wbt_leaf_verify(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        off,
+    uint                        len)
+{
+    merr_t err;
+
+    err = blk_crc_verify(
+        (struct kvs_mblk_desc *)kbd, PAGE_SIZE * wbd->wbd_first_page + off, len);
+    if (err)
+        hse_elog(HSE_ERR "%s: kblock %lx leaf at %u: @@e", err, __func__, kbd->mb_id, off);
+
+    return err;
+}
+
+const void *
+kbr_wbt_leaf(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        node,
+    void *                      buf,
+    bool                        cache)
+{
+    struct kbr_lcache_slot *ls = NULL;
+    const void *            rgn;
+    uint                    off, end;
+    merr_t                  err;
+
+    assert(node < wbd->wbd_leaf_cnt);
+
+    rgn = kbd->map_base + PAGE_SIZE * wbd->wbd_first_page;
+
+    if (!wbt_leaf_compressed(wbd)) {
+        err = kbr_wbt_leaf_verify(kbd, wbd, PAGE_SIZE * node, PAGE_SIZE);
+
+        return err ? NULL : rgn + PAGE_SIZE * node;
+    }
+
+    if (cache && kbr_lcache) {
+        ls = kbr_lcache_slot(kbd->mb_id, node);
+
+        spin_lock(&ls->ls_lock);
+        if (ls->ls_blkid == kbd->mb_id && ls->ls_base == kbd->map_base && ls->ls_node == node) {
+            memcpy(buf, ls->ls_page, PAGE_SIZE);
+            spin_unlock(&ls->ls_lock);
+            return buf;
+        }
+        spin_unlock(&ls->ls_lock);
+    }
+
+    off = wbt8_leaf_off(rgn, node);
+    end = wbt8_leaf_off(rgn, node + 1);
+
+    err = kbr_wbt_leaf_verify(kbd, wbd, off, end - off);
+    if (err)
+        return NULL;
+
+    err = wbt8_leaf_decode(rgn + off, end - off, buf);
+    if (ev(err)) {
+        hse_elog(HSE_ERR "%s: kblock %lx leaf %u: @@e", err, __func__, kbd->mb_id, node);
+        return NULL;
+    }
+
+    if (ls) {
+        spin_lock(&ls->ls_lock);
+        memcpy(ls->ls_page, buf, PAGE_SIZE);
+        ls->ls_blkid = kbd->mb_id;
+        ls->ls_base = kbd->map_base;
+        ls->ls_node = node;
+        spin_unlock(&ls->ls_lock);
+    }
+
+    return buf;
+}
+
+void
+kbr_wbt_leaf_evict(const struct kvs_mblk_desc *kbd, const struct wbt_desc *wbd)
+{
+    struct kbr_lcache_slot *ls;
+    uint                    node;
+
+    if (!kbr_lcache || !wbt_leaf_compressed(wbd))
+        return;
+
+    for (node = 0; node < wbd->wbd_leaf_cnt; ++node) {
+        ls = kbr_lcache_slot(kbd->mb_id, node);
+
+        spin_lock(&ls->ls_lock);
+        if (ls->ls_blkid == kbd->mb_id && ls->ls_base == kbd->map_base && ls->ls_node == node) {
+            ls->ls_blkid = 0;
+            ls->ls_base = NULL;
+        }
+        spin_unlock(&ls->ls_lock);
+    }
+}
+
 static merr_t
 kbr_madvise_region(struct kvs_mblk_desc *kblkdesc, u32 pg, u32 pg_cnt, int advice)
 {
@@ -363,7 +623,7 @@ void
 kbr_madvise_kmd(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, int advice)
 {
     merr_t err;
-    u32    pg = desc->wbd_first_page + desc->wbd_root + 1;
+    u32    pg = wbt_kmd_pg(desc);
     u32    pg_cnt = desc->wbd_kmd_pgc;
 
     err = kbr_madvise_region(kblkdesc, pg, pg_cnt, advice);
@@ -376,19 +636,39 @@ kbr_madvise_wbt_leaf_nodes(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc
 {
     merr_t err;
     u32    pg = desc->wbd_first_page;
-    u32    pg_cnt = desc->wbd_leaf_cnt;
+    u32    pg_cnt = desc->wbd_leaf_pgc;
 
     err = kbr_madvise_region(kblkdesc, pg, pg_cnt, advice);
 
     ev(err);
 }
 
+void
+kbr_madvise_wbt_leaf_range(
+    struct kvs_mblk_desc *kblkdesc,
+    struct wbt_desc *     desc,
+    u32                   first,
+    u32                   cnt,
+    int                   advice)
+{
+    merr_t err;
+
+    if (first >= desc->wbd_leaf_pgc)
+        return;
+
+    cnt = min_t(u32, cnt, desc->wbd_leaf_pgc - first);
+
+    err = kbr_madvise_region(kblkdesc, desc->wbd_first_page + first, cnt, advice);
+
+    ev(err);
+}
+
 void
 kbr_madvise_wbt_int_nodes(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, int advice)
 {
     merr_t err;
-    u32    pg = desc->wbd_first_page + desc->wbd_leaf_cnt;
-    u32    pg_cnt = (desc->wbd_n_pages - desc->wbd_leaf_cnt - desc->wbd_kmd_pgc);
+    u32    pg = desc->wbd_first_page + desc->wbd_leaf_pgc;
+    u32    pg_cnt = (desc->wbd_n_pages - desc->wbd_leaf_pgc - desc->wbd_kmd_pgc);
 
     err = kbr_madvise_region(kblkdesc, pg, pg_cnt, advice);
 
@@ -406,3 +686,87 @@ kbr_madvise_bloom(struct kvs_mblk_desc *kblkdesc, struct bloom_desc *desc, int a
 
     ev(err);
 }
+
+void
+kbr_madvise_thp(struct kvs_mblk_desc *kblkdesc, size_t len)
+{
+    int rc;
+
+    rc = madvise(kblkdesc->map_base, len, MADV_HUGEPAGE);
+
+    ev(rc);
+}
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+static void
+kbr_populate_region(struct kvs_mblk_desc *kblkdesc, u32 pg, u32 pg_cnt)
+{
+    void *addr = kblkdesc->map_base + PAGE_SIZE * pg;
+    int   rc;
+
+    if (!pg_cnt)
+        return;
+
+    /* MADV_POPULATE_READ requires Linux 5.14, fall back to touching
+     * each page on older kernels.
+     */
+    rc = madvise(addr, PAGE_SIZE * pg_cnt, MADV_POPULATE_READ);
+    if (rc && errno == EINVAL) {
+        volatile const u8 *p = addr;
+        u32                i;
+
+        for (i = 0; i < pg_cnt; ++i)
+            (void)p[PAGE_SIZE * i];
+    }
+}
+
+void
+kbr_populate_index(
+    struct kvs_mblk_desc *kblkdesc,
+    struct wbt_desc *     wbd,
+    struct bloom_desc *   bd,
+    bool                  leaves)
+{
+    if (bd)
+        kbr_populate_region(kblkdesc, bd->bd_first_page, bd->bd_n_pages);
+
+    kbr_populate_region(
+        kblkdesc,
+        wbd->wbd_first_page + wbd->wbd_leaf_pgc,
+        wbd->wbd_n_pages - wbd->wbd_leaf_pgc - wbd->wbd_kmd_pgc);
+
+    if (leaves)
+        kbr_populate_region(kblkdesc, wbd->wbd_first_page, wbd->wbd_leaf_pgc);
+}
+
+static merr_t
+kbr_mlock_region(struct kvs_mblk_desc *kblkdesc, u32 pg, u32 pg_cnt, bool lock)
+{
+    void *addr = kblkdesc->map_base + PAGE_SIZE * pg;
+    int   rc;
+
+    if (!pg_cnt)
+        return 0;
+
+    rc = lock ? mlock(addr, PAGE_SIZE * pg_cnt) : munlock(addr, PAGE_SIZE * pg_cnt);
+
+    return rc ? merr(errno) : 0;
+}
+
+merr_t
+kbr_mlock_wbt_int_nodes(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, bool lock)
+{
+    u32 pg = desc->wbd_first_page + desc->wbd_leaf_pgc;
+    u32 pg_cnt = (desc->wbd_n_pages - desc->wbd_leaf_pgc - desc->wbd_kmd_pgc);
+
+    return kbr_mlock_region(kblkdesc, pg, pg_cnt, lock);
+}
+
+merr_t
+kbr_mlock_bloom(struct kvs_mblk_desc *kblkdesc, struct bloom_desc *desc, bool lock)
+{
+    return kbr_mlock_region(kblkdesc, desc->bd_first_page, desc->bd_n_pages, lock);
+}
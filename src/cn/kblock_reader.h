@@ -19,12 +19,22 @@ struct kvs_rparams;
 struct kblk_metrics {
     u32 num_keys;
     u32 num_tombstones;
+    u32 num_ptombs;
     u64 tot_key_bytes;
     u64 tot_val_bytes;
     u32 tot_wbt_pages;
     u32 tot_blm_pages;
 };
 
+/**
+ * kbr_init() - create the cache of decompressed wbtree leaf nodes
+ */
+merr_t
+kbr_init(void);
+
+void
+kbr_fini(void);
+
 /**
  * kbr_get_kblock_desc() - Get the KVBLOCK descriptor for the given
  *                     KBLOCK ID.
@@ -87,6 +97,26 @@ kbr_read_pt_region_desc(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc);
 merr_t
 kbr_read_seqno_range(struct kvs_mblk_desc *kblkdesc, u64 *seqno_min, u64 *seqno_max);
 
+/**
+ * kbr_read_hix_region() - Locate the hash index of a kblock
+ * @kblkdesc: KVBLOCK_DESC for KBLOCK to read
+ * @hix:      (output) first slot of the mapped hash index, or NULL if none
+ * @hixc:     (output) number of slots in the hash index
+ */
+merr_t
+kbr_read_hix_region(struct kvs_mblk_desc *kblkdesc, const void **hix, u32 *hixc);
+
+/**
+ * kbr_read_crc_region() - Locate the page checksums of a kblock
+ * @kblkdesc: KVBLOCK_DESC for KBLOCK to read
+ *
+ * Older kblocks have no checksums, in which case their pages are not
+ * verified.  Otherwise the header page is verified here, and all other
+ * pages as they are first accessed.
+ */
+merr_t
+kbr_read_crc_region(struct kvs_mblk_desc *kblkdesc);
+
 void
 kbr_free_blm_pages(struct kvs_mblk_desc *kbd, ulong cn_bloom_lookup, void *blm_pages);
 
@@ -99,12 +129,54 @@ kbr_free_blm_pages(struct kvs_mblk_desc *kbd, ulong cn_bloom_lookup, void *blm_p
 merr_t
 kbr_read_metrics(struct kvs_mblk_desc *kblock_desc, struct kblk_metrics *metrics);
 
+/**
+ * kbr_wbt_leaf() - Get a wbtree leaf node
+ * @kbd:   kblock descriptor
+ * @wbd:   wbtree descriptor
+ * @node:  leaf node number
+ * @buf:   page sized buffer for the node if the leaf nodes are compressed
+ * @cache: whether to look up and insert the node in the decompressed leaf
+ *         node cache
+ *
+ * Return: the leaf node, either in the mcache map or, if the leaf nodes are
+ * compressed, decompressed into @buf.  NULL if the node could not be
+ * decompressed.
+ */
+const void *
+kbr_wbt_leaf(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        node,
+    void *                      buf,
+    bool                        cache);
+
+/**
+ * kbr_wbt_leaf_evict() - evict a kblock's leaf nodes from the decompressed
+ *                        leaf node cache
+ */
+void
+kbr_wbt_leaf_evict(const struct kvs_mblk_desc *kbd, const struct wbt_desc *wbd);
+
 /**
  * kbr_madvise_wbt_leaf_nodes() - advise about caching of wbtree leaf nodes
  */
 void
 kbr_madvise_wbt_leaf_nodes(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, int advice);
 
+/**
+ * kbr_madvise_wbt_leaf_range() - advise about caching of a range of wbtree
+ *                                leaf node pages
+ * @first: first page of the range, relative to the first leaf node page
+ * @cnt:   number of pages, the range is clipped to the leaf node pages
+ */
+void
+kbr_madvise_wbt_leaf_range(
+    struct kvs_mblk_desc *kblkdesc,
+    struct wbt_desc *     desc,
+    u32                   first,
+    u32                   cnt,
+    int                   advice);
+
 /**
  * kbr_madvise_wbt_int_nodes() - advise about caching of wbtree internal modes
  */
@@ -123,4 +195,40 @@ kbr_madvise_kmd(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, int advic
 void
 kbr_madvise_bloom(struct kvs_mblk_desc *kblkdesc, struct bloom_desc *desc, int advice);
 
+/**
+ * kbr_madvise_thp() - advise the use of transparent huge pages for a kblock
+ * @len: length of the kblock's mapping
+ *
+ * The advice takes effect only if the mpool's backing store supports huge
+ * pages for file mappings, otherwise it is harmless.
+ */
+void
+kbr_madvise_thp(struct kvs_mblk_desc *kblkdesc, size_t len);
+
+/**
+ * kbr_populate_index() - fault in the index regions of a kblock
+ * @leaves: populate the wbtree leaf nodes as well
+ *
+ * Unlike MADV_WILLNEED, which merely starts readahead, this populates the
+ * page tables such that the first lookups of a new kvset take no faults.
+ */
+void
+kbr_populate_index(
+    struct kvs_mblk_desc *kblkdesc,
+    struct wbt_desc *     wbd,
+    struct bloom_desc *   bd,
+    bool                  leaves);
+
+/**
+ * kbr_mlock_wbt_int_nodes() - lock or unlock wbtree internal nodes in memory
+ */
+merr_t
+kbr_mlock_wbt_int_nodes(struct kvs_mblk_desc *kblkdesc, struct wbt_desc *desc, bool lock);
+
+/**
+ * kbr_mlock_bloom() - lock or unlock a bloom filter in memory
+ */
+merr_t
+kbr_mlock_bloom(struct kvs_mblk_desc *kblkdesc, struct bloom_desc *desc, bool lock);
+
 #endif
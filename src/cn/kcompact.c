@@ -5,7 +5,12 @@
 
 #include <hse_util/platform.h>
 #include <hse_util/event_counter.h>
+#include <hse_util/loser_tree.h>
+#include <hse_util/condvar.h>
+#include <hse_util/workqueue.h>
 
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/kvs_cparams.h>
 #include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/tuple.h>
@@ -25,9 +30,58 @@
 #include "cn_tree.h"
 #include "cn_tree_internal.h"
 #include "cn_tree_compact.h"
+#include "blk_list.h"
+
+#define KCOMPACT_SUBC_MAX (8)
+#define KCOMPACT_SUB_KBLKS_MIN (4)
+
+struct kcompact_job;
+
+/**
+ * struct kcompact_sub - a key range of a k-compaction
+ * @kcs_work:   for queueing on the cn maintenance workqueue
+ * @kcs_w:      the k-compaction
+ * @kcs_job:    the subcompactions this one is part of
+ * @kcs_inputv: one iterator per input kvset, positioned at the range
+ * @kcs_end:    first key past the range, if not the last range
+ * @kcs_child:  builder of the range's kblocks
+ * @kcs_stats:  merge stats of the range
+ * @kcs_vused:  bytes of the values referenced by the range's keys
+ * @kcs_err:    merge status
+ */
+struct kcompact_sub {
+    struct work_struct         kcs_work;
+    struct cn_compaction_work *kcs_w;
+    struct kcompact_job *      kcs_job;
+    struct kv_iterator **      kcs_inputv;
+    struct key_obj             kcs_end;
+    bool                       kcs_bounded;
+    struct kvset_builder *     kcs_child;
+    struct cn_merge_stats *    kcs_stats;
+    u64                        kcs_vused;
+    merr_t                     kcs_err;
+};
+
+/**
+ * struct kcompact_job - a k-compaction split into key-range subcompactions
+ * @kcj_mtx:     protects @kcj_pending
+ * @kcj_cv:      signaled when the last queued subcompaction finishes
+ * @kcj_pending: number of queued subcompactions not yet finished
+ * @kcj_subc:    number of subcompactions
+ * @kcj_subv:    subcompactions, in key order
+ * @kcj_statsv:  merge stats of each subcompaction
+ */
+struct kcompact_job {
+    struct mutex          kcj_mtx;
+    struct cv             kcj_cv;
+    uint                  kcj_pending;
+    uint                  kcj_subc;
+    struct kcompact_sub   kcj_subv[KCOMPACT_SUBC_MAX];
+    struct cn_merge_stats kcj_statsv[KCOMPACT_SUBC_MAX];
+};
 
 /**
- * struct merge_item -- an item in the bin_heap
+ * struct merge_item -- an item in the loser tree
  */
 struct merge_item {
     struct key_obj         kobj;
@@ -35,102 +89,242 @@ struct merge_item {
     uint                   src;
 };
 
+struct merge;
+
+/**
+ * struct merge_src -- element source over the keys of one input kvset
+ * @ms_es:    element source handle
+ * @ms_iter:  input kvset iterator
+ * @ms_merge: merge this source is part of
+ * @ms_item:  current key
+ */
+struct merge_src {
+    struct element_source ms_es;
+    struct kv_iterator *  ms_iter;
+    struct merge *        ms_merge;
+    struct merge_item     ms_item;
+};
+
+/**
+ * struct merge -- loser tree merge of the input kvsets
+ * @mg_lt:    loser tree of the sources in @mg_srcv
+ * @mg_stats: merge stats
+ * @mg_err:   first error returned by an input kvset iterator
+ * @mg_esv:   element source handles of @mg_srcv
+ * @mg_srcv:  one source per input kvset, newest first
+ */
+struct merge {
+    struct loser_tree *     mg_lt;
+    struct cn_merge_stats * mg_stats;
+    merr_t                  mg_err;
+    struct element_source **mg_esv;
+    struct merge_src        mg_srcv[];
+};
+
 static int
 merge_item_compare(const void *a_blob, const void *b_blob)
 {
     const struct merge_item *a = a_blob;
     const struct merge_item *b = b_blob;
-    int                      rc;
 
     /* Tie breaker: If keycmp() return 0, the keys are equal, in this case
-     * lower numbered merge sources contain newer data and must come out
-     * of the binheap first.
+     * the loser tree pops the item of the lower numbered merge source first,
+     * as lower numbered merge sources contain newer data.
      */
-    rc = key_obj_cmp(&a->kobj, &b->kobj);
-    if (rc)
-        return rc;
-    if (a->src < b->src)
-        return -1;
-    if (a->src > b->src)
-        return 1;
-    return 0;
+    return key_obj_cmp(&a->kobj, &b->kobj);
 }
 
-static merr_t
-replenish(struct bin_heap *bh, struct kv_iterator **iterv, uint src, struct cn_merge_stats *stats)
+/* merge_item_compare() of the keys of a kvs with fixed length keys.
+ */
+static int
+merge_item_compare8(const void *a_blob, const void *b_blob)
 {
-    struct kv_iterator *iter = iterv[src];
+    const struct merge_item *a = a_blob;
+    const struct merge_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 8);
+}
+
+static int
+merge_item_compare16(const void *a_blob, const void *b_blob)
+{
+    const struct merge_item *a = a_blob;
+    const struct merge_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 16);
+}
+
+static u64
+merge_item_pfx(const void *blob)
+{
+    const struct merge_item *item = blob;
+
+    return key_obj_pfx64(&item->kobj);
+}
+
+static bool
+merge_src_next(struct element_source *es, void **data)
+{
+    struct merge_src *  src = container_of(es, struct merge_src, ms_es);
+    struct merge *      mg = src->ms_merge;
+    struct kv_iterator *iter = src->ms_iter;
     merr_t              err;
-    struct merge_item   item;
 
     if (unlikely(iter->kvi_eof))
-        return 0;
+        return false;
 
-    err = kvset_iter_next_key(iter, &item.kobj, &item.vctx);
-    if (ev(err))
-        return err;
+    err = kvset_iter_next_key(iter, &src->ms_item.kobj, &src->ms_item.vctx);
+    if (ev(err)) {
+        mg->mg_err = mg->mg_err ?: err;
+        return false;
+    }
     if (unlikely(iter->kvi_eof))
-        return 0;
+        return false;
 
-    item.src = src;
+    mg->mg_stats->ms_keys_in++;
+    mg->mg_stats->ms_key_bytes_in += key_obj_len(&src->ms_item.kobj);
 
-    err = bin_heap_insert(bh, &item);
-    if (ev(err))
-        return err;
+    *data = &src->ms_item;
 
-    stats->ms_keys_in++;
-    stats->ms_key_bytes_in += key_obj_len(&item.kobj);
+    return true;
+}
 
-    return 0;
+static void
+merge_fini(struct merge *mg)
+{
+    if (mg) {
+        loser_tree_destroy(mg->mg_lt);
+        free(mg);
+    }
 }
 
 static merr_t
 merge_init(
-    struct bin_heap **     bh_out,
+    struct merge **        mg_out,
     struct kv_iterator **  iterv,
     u32                    iterc,
+    uint                   kfixed,
     struct cn_merge_stats *stats)
 {
-    u32    i;
-    merr_t err;
-
-    err = bin_heap_create(bh_out, iterc, sizeof(struct merge_item), merge_item_compare);
-    if (ev(err))
-        goto err_exit1;
+    loser_tree_compare_fn *cmp;
+    struct merge *         mg;
+    size_t                 sz;
+    u32                    i;
+    merr_t                 err;
+
+    sz = sizeof(*mg) + iterc * sizeof(mg->mg_srcv[0]);
+
+    mg = malloc(sz + iterc * sizeof(*mg->mg_esv));
+    if (ev(!mg))
+        return merr(ENOMEM);
+
+    mg->mg_stats = stats;
+    mg->mg_err = 0;
+    mg->mg_esv = (void *)mg + sz;
+
+    cmp = merge_item_compare;
+    if (kfixed == 8)
+        cmp = merge_item_compare8;
+    else if (kfixed == 16)
+        cmp = merge_item_compare16;
+
+    err = loser_tree_create(iterc, cmp, merge_item_pfx, &mg->mg_lt);
+    if (ev(err)) {
+        free(mg);
+        return err;
+    }
 
     stats->ms_srcs = iterc;
 
     for (i = 0; i < iterc; i++) {
-        err = replenish(*bh_out, iterv, i, stats);
-        if (ev(err))
-            goto err_exit2;
+        struct merge_src *src = mg->mg_srcv + i;
+
+        src->ms_es = es_make(merge_src_next, NULL, NULL);
+        src->ms_iter = iterv[i];
+        src->ms_merge = mg;
+        src->ms_item.src = i;
+        mg->mg_esv[i] = &src->ms_es;
+    }
+
+    err = loser_tree_prepare(mg->mg_lt, iterc, mg->mg_esv) ?: mg->mg_err;
+    if (ev(err)) {
+        merge_fini(mg);
+        return err;
     }
 
+    *mg_out = mg;
+
     return 0;
+}
 
-err_exit2:
-    bin_heap_destroy(*bh_out);
-err_exit1:
-    return err;
+/* Move every source older than a ptomb's source past the ptomb's prefix.
+ * The ptomb hides all their keys with that prefix, so there is no need to
+ * merge them one by one only to drop them, nor to read the kblocks that
+ * hold nothing else.  Sources whose current key lies outside the prefix
+ * are left alone.
+ */
+static merr_t
+merge_pt_skip(struct merge *mg, const struct merge_item *pt)
+{
+    struct loser_tree *lt = mg->mg_lt;
+    unsigned char      key[HSE_KVS_MAX_PFXLEN];
+    uint               klen;
+    u32                i, n;
+
+    key_obj_copy(key, sizeof(key), &klen, &pt->kobj);
+
+    /* The least key greater than every key with the prefix. */
+    while (klen > 0 && key[klen - 1] == 0xff)
+        --klen;
+    if (klen > 0)
+        key[klen - 1]++;
+
+    n = 0;
+    for (i = pt->src + 1; i < lt->lt_width; ++i) {
+        struct merge_item *dup = lt->lt_leafv[i].ll_data;
+        bool               eof = false;
+        merr_t             err;
+
+        if (!dup || key_obj_cmp_prefix(&pt->kobj, &dup->kobj))
+            continue;
+
+        if (klen > 0) {
+            err = kvset_iter_seek(mg->mg_srcv[i].ms_iter, key, klen, &eof);
+            if (ev(err))
+                return err;
+        } else {
+            kvset_iter_mark_eof(mg->mg_srcv[i].ms_iter);
+        }
+
+        loser_tree_refetch(lt, i);
+        ++n;
+    }
+
+    if (n > 0)
+        loser_tree_rebuild(lt);
+
+    return mg->mg_err;
 }
 
 /* return true if item returned, false if no more items */
 static __always_inline bool
-get_next_item(
-    struct bin_heap *      bh,
-    struct kv_iterator **  iterv,
-    struct merge_item *    item,
-    struct cn_merge_stats *stats,
-    merr_t *               err_out)
+get_next_item(struct merge *mg, struct merge_item *item, merr_t *err_out)
 {
-    bool got_item;
+    struct merge_item *top;
 
-    got_item = bin_heap_get_delete(bh, item);
-    if (got_item)
-        *err_out = replenish(bh, iterv, item->src, stats);
-    else
-        *err_out = 0;
-    return got_item;
+    if (!loser_tree_peek(mg->mg_lt, (void **)&top)) {
+        *err_out = mg->mg_err;
+        return false;
+    }
+
+    /* Copy out the item before loser_tree_pop() replaces it with the next
+     * key of its source.
+     */
+    *item = *top;
+    loser_tree_pop(mg->mg_lt, (void **)&top);
+
+    *err_out = mg->mg_err;
+    return true;
 }
 
 /**
@@ -138,16 +332,24 @@ get_next_item(
  * Requirements:
  *   - Each input iterator must produce keys in sorted order.
  *   - Iterator iterv[i] must contain newer entries than iterv[i+1].
+ *
+ * Only the keys that precede sub->kcs_end, if bounded, are merged.
+ *
+ * The values of the inputs flagged in w->cw_vbmap.vbm_gcv are copied to
+ * new vblocks rather than referenced in place (value gc).
  */
 static merr_t
-kcompact(struct cn_compaction_work *w)
+kcompact(struct cn_compaction_work *w, struct kcompact_sub *sub, bool progress)
 {
-    struct bin_heap * bh;
-    struct merge_item curr;
-    merr_t            err;
+    struct kv_iterator ** iterv = sub->kcs_inputv;
+    struct kvset_builder *child = sub->kcs_child;
+    const bool *          gcv = w->cw_vbmap.vbm_gcv;
+    struct merge *        mg;
+    struct merge_item     curr;
+    merr_t                err;
 
     enum kmd_vtype vtype;
-    uint           vbidx, vboff, vlen;
+    uint           vbidx, vboff, vlen, complen;
     const void *   vdata;
 
     u64  seq, emitted_seq = 0, emitted_seq_pt = 0;
@@ -159,6 +361,10 @@ kcompact(struct cn_compaction_work *w)
     u64  pt_seq = 0;
     u64  tprog = 0;
 
+    void *cfbuf = NULL;
+    bool  vread;
+    uint  kfixed;
+
     u64 dbg_prev_seq __maybe_unused;
     uint dbg_prev_src __maybe_unused;
     uint dbg_nvals_this_key __maybe_unused;
@@ -166,19 +372,18 @@ kcompact(struct cn_compaction_work *w)
 
     uint seqno_errcnt = 0;
 
-    /* 'vbm_used' counts only the values referenced after this compaction;
-     * however, waste accumulates from compact-to-compact
-     */
-    w->cw_vbmap.vbm_used = 0;
-
-    if (w->cw_prog_interval && w->cw_progress)
+    if (progress && w->cw_prog_interval && w->cw_progress)
         tprog = get_time_ns();
 
-    err = merge_init(&bh, w->cw_inputv, w->cw_kvset_cnt, &w->cw_stats);
+    kfixed = w->cw_cp ? w->cw_cp->cp_kfixed : 0;
+
+    err = merge_init(&mg, iterv, w->cw_kvset_cnt, kfixed, sub->kcs_stats);
     if (ev(err))
         return err;
 
-    more = get_next_item(bh, w->cw_inputv, &curr, &w->cw_stats, &err);
+    more = get_next_item(mg, &curr, &err);
+    if (more && sub->kcs_bounded && key_obj_cmp(&curr.kobj, &sub->kcs_end) >= 0)
+        more = false;
     if (!more || ev(err))
         goto done;
 
@@ -213,10 +418,20 @@ get_values:
 
     while (horizon &&
            kvset_iter_next_vref(
-               w->cw_inputv[curr.src], &curr.vctx, &seq, &vtype, &vbidx, &vboff, &vdata, &vlen)) {
+               iterv[curr.src],
+               &curr.vctx,
+               &seq,
+               &vtype,
+               &vbidx,
+               &vboff,
+               &vdata,
+               &vlen,
+               &complen)) {
 
         bool should_emit = false;
 
+        vread = false;
+
         /* Assertion logic:
          *   if (dbg_nvals_this_key)
          *       assert(dbg_prev_seq > seq);
@@ -229,6 +444,12 @@ get_values:
         dbg_nvals_this_key++;
         dbg_prev_seq = seq;
 
+        /* Expired entries and all older values of their key are dropped. */
+        if (seq <= w->cw_ttl_seq) {
+            horizon = false;
+            continue;
+        }
+
         if (seq <= w->cw_horizon) {
             horizon = false;
             if (pt_set && seq < pt_seq)
@@ -239,6 +460,60 @@ get_values:
                 pt_kobj = curr.kobj;
                 assert(key_obj_len(&curr.kobj) == w->cw_pfx_len);
                 pt_seq = seq;
+
+                err = merge_pt_skip(mg, &curr);
+                if (ev(err))
+                    goto done;
+            }
+
+            /* K-compaction filters only the values it has at hand, those
+             * stored inline and those of the inputs it garbage collects.
+             * A replacement is kept only if it can be stored likewise,
+             * otherwise it is left to a later spill or kv-compaction.
+             */
+            if (w->cw_cfilter &&
+                (vtype == vtype_ival || vtype == vtype_zval ||
+                 ((vtype == vtype_val || vtype == vtype_cval) && gcv && gcv[curr.src]))) {
+                const void *cfdata;
+                uint        cflen, cfclen = 0;
+                int         action;
+
+                if (vtype == vtype_val || vtype == vtype_cval) {
+                    err = kvset_iter_next_val(
+                        iterv[curr.src],
+                        &curr.vctx,
+                        vtype,
+                        vbidx,
+                        vboff,
+                        &vdata,
+                        &vlen,
+                        complen);
+                    if (ev(err))
+                        goto done;
+
+                    cfclen = complen;
+                    vread = true;
+                }
+
+                cfdata = vdata;
+                cflen = vlen;
+
+                err = cn_comp_filter(w, &cfbuf, &curr.kobj, &cfdata, &cflen, &cfclen, &action);
+                if (ev(err))
+                    goto done;
+
+                if (action == KVS_CFILTER_DROP) {
+                    vtype = vtype_tomb;
+                    vlen = 0;
+                    complen = 0;
+                } else if (
+                    action == KVS_CFILTER_REPLACE &&
+                    (cflen <= w->cw_rp->kblock_ival_max || w->cw_vbmap.vbm_gcv)) {
+                    vtype = vtype_ival;
+                    vdata = cfdata;
+                    vlen = cflen;
+                    complen = 0;
+                }
             }
 
             if (w->cw_drop_tombv[0] && (vtype == vtype_tomb || vtype == vtype_ptomb))
@@ -260,15 +535,39 @@ get_values:
 
             switch (vtype) {
                 case vtype_val:
+                case vtype_cval:
+                    if (gcv && gcv[curr.src]) {
+                        err = 0;
+                        if (!vread)
+                            err = kvset_iter_next_val(
+                                iterv[curr.src],
+                                &curr.vctx,
+                                vtype,
+                                vbidx,
+                                vboff,
+                                &vdata,
+                                &vlen,
+                                complen);
+                        if (!ev(err))
+                            err = kvset_builder_add_val(child, seq, vdata, vlen, complen, NULL);
+                        break;
+                    }
+
                     err = kvset_builder_add_vref(
-                        w->cw_child[0], seq, vbidx + w->cw_vbmap.vbm_map[curr.src], vboff, vlen);
+                        child,
+                        seq,
+                        vbidx + w->cw_vbmap.vbm_map[curr.src],
+                        vboff,
+                        vlen,
+                        complen);
+                    sub->kcs_vused += complen ?: vlen;
                     break;
                 case vtype_zval:
                 case vtype_ival:
-                    err = kvset_builder_add_val(w->cw_child[0], seq, vdata, vlen, NULL);
+                    err = kvset_builder_add_val(child, seq, vdata, vlen, 0, NULL);
                     break;
                 default:
-                    err = kvset_builder_add_nonval(w->cw_child[0], seq, vtype);
+                    err = kvset_builder_add_nonval(child, seq, vtype);
                     break;
             }
             if (ev(err))
@@ -280,8 +579,7 @@ get_values:
             else
                 emitted_seq = seq;
 
-            w->cw_stats.ms_val_bytes_out += vlen;
-            w->cw_vbmap.vbm_used += vlen;
+            sub->kcs_stats->ms_val_bytes_out += complen ?: vlen;
         } else {
             /* The only time we ever land here is when the same
              * key appears in two input kvsets with overlapping
@@ -314,10 +612,13 @@ get_values:
     dbg_nvals_this_key = 0;
     dbg_prev_src = curr.src;
 
-    more = get_next_item(bh, w->cw_inputv, &curr, &w->cw_stats, &err);
+    more = get_next_item(mg, &curr, &err);
     if (ev(err))
         goto done;
 
+    if (more && sub->kcs_bounded && key_obj_cmp(&curr.kobj, &sub->kcs_end) >= 0)
+        more = false;
+
     if (more) {
         if (0 == key_obj_cmp(&curr.kobj, &prev_kobj)) {
             dbg_dup = true;
@@ -329,19 +630,19 @@ get_values:
     }
 
     if (emitted_val) {
-        err = kvset_builder_add_key(w->cw_child[0], &prev_kobj);
+        err = kvset_builder_add_key(child, &prev_kobj);
         if (ev(err))
             goto done;
-        w->cw_stats.ms_keys_out++;
-        w->cw_stats.ms_key_bytes_out += key_obj_len(&prev_kobj);
+        sub->kcs_stats->ms_keys_out++;
+        sub->kcs_stats->ms_key_bytes_out += key_obj_len(&prev_kobj);
     }
 
     if (more)
         goto new_key;
 
 done:
-    w->cw_vbmap.vbm_waste = w->cw_vbmap.vbm_tot - w->cw_vbmap.vbm_used;
-    bin_heap_destroy(bh);
+    merge_fini(mg);
+    free(cfbuf);
 
     if (seqno_errcnt)
         hse_log(HSE_WARNING "%s: seqno errcnt %u", __func__, seqno_errcnt);
@@ -352,38 +653,406 @@ done:
     return err;
 }
 
-merr_t
-cn_kcompact(struct cn_compaction_work *w)
+static merr_t
+kcompact_builder_create(
+    struct cn_compaction_work *w,
+    struct cn_merge_stats *    stats,
+    struct kvset_builder **    bldp)
 {
-    merr_t               err;
     enum mp_media_classp mclassp;
     struct cn_tree_node *pnode;
+    merr_t               err;
+    uint                 flags = KVSET_BUILDER_FLAGS_SPARE;
 
-    err = kvset_builder_create(
-        &w->cw_child[0],
-        cn_tree_get_cn(w->cw_tree),
-        w->cw_pc,
-        w->cw_dgen_hi,
-        KVSET_BUILDER_FLAGS_SPARE);
-    if (ev(err))
-        goto done;
+    if (w->cw_vbmap.vbm_gcv)
+        flags |= KVSET_BUILDER_FLAGS_VGC;
 
-    mclassp = w->cw_rp->cn_media_class;
+    err = kvset_builder_create(bldp, cn_tree_get_cn(w->cw_tree), w->cw_pc, w->cw_dgen_hi, flags);
+    if (ev(err))
+        return err;
 
     pnode = w->cw_node;
-    if (pnode && !cn_node_isleaf(pnode))
-        kvset_builder_set_mclass(w->cw_child[0], mclassp);
+    if (pnode) {
+        mclassp = cn_node_isleaf(pnode) ? MP_MED_CAPACITY : w->cw_rp->cn_media_class;
+        kvset_builder_set_mclass_lvl(*bldp, w->cw_rp, cn_node_level(pnode), mclassp);
+    }
+
+    kvset_builder_set_merge_stats(*bldp, stats);
+
+    if (pnode)
+        kvset_builder_set_node_level(*bldp, cn_node_level(pnode));
+
+    /* Rewritten values go to new vblocks that follow the kept ones. */
+    if (w->cw_vbmap.vbm_gcv)
+        kvset_builder_set_vbidx_base(*bldp, w->cw_vbmap.vbm_blkc);
+
+    return 0;
+}
+
+/* A k-compaction is split into key ranges at the min keys of evenly spaced
+ * kblocks of its input kvset with the most kblocks.  Prefixed trees are not
+ * split because a kvset keeps all its ptombs in its last kblock, nor are
+ * compactions too small to gain from it, nor value gc compactions, whose
+ * ranges would each append vblocks to the output kvset.
+ */
+static uint
+kcompact_subc(struct cn_compaction_work *w, struct kvset **bigp)
+{
+    struct kvset *big = NULL;
+    uint          subc, nkblks, i;
+
+    subc = min_t(uint, w->cw_rp->cn_compact_subc, KCOMPACT_SUBC_MAX);
+    if (subc < 2 || !w->cw_tree || !w->cw_cp || w->cw_cp->cp_pfx_len > 0)
+        return 1;
+
+    if (w->cw_vbmap.vbm_gcv)
+        return 1;
+
+    if (cn_get_flags(cn_tree_get_cn(w->cw_tree)) & CN_CFLAG_CAPPED)
+        return 1;
+
+    nkblks = 0;
+    for (i = 0; i < w->cw_kvset_cnt; ++i) {
+        struct kvset *ks = kvset_from_iter(w->cw_inputv[i]);
+
+        if (kvset_get_num_kblocks(ks) > nkblks) {
+            nkblks = kvset_get_num_kblocks(ks);
+            big = ks;
+        }
+    }
+
+    subc = min_t(uint, subc, nkblks / KCOMPACT_SUB_KBLKS_MIN);
+    if (subc < 2)
+        return 1;
+
+    *bigp = big;
+
+    return subc;
+}
+
+/* Create the iterators of a subcompaction other than the first and position
+ * them at the start of its range.
+ */
+static merr_t
+kcompact_sub_iters(struct cn_compaction_work *w, struct kcompact_sub *sub, struct key_obj *start)
+{
+    struct workqueue_struct *vra_wq;
+    merr_t                   err;
+    uint                     i;
+
+    sub->kcs_inputv = calloc(w->cw_kvset_cnt, sizeof(*sub->kcs_inputv));
+    if (ev(!sub->kcs_inputv))
+        return merr(ENOMEM);
 
-    kvset_builder_set_merge_stats(w->cw_child[0], &w->cw_stats);
+    vra_wq = cn_get_maint_wq(cn_tree_get_cn(w->cw_tree));
+
+    for (i = 0; i < w->cw_kvset_cnt; ++i) {
+        struct kvset *ks = kvset_from_iter(w->cw_inputv[i]);
+        bool          eof;
+
+        /* If successful, kvset_iter_create() adopts this reference.
+         */
+        kvset_get_ref(ks);
+
+        err = kvset_iter_create(
+            ks, w->cw_io_workq, vra_wq, w->cw_pc, NULL, w->cw_iter_flags, &sub->kcs_inputv[i]);
+        if (ev(err)) {
+            kvset_put_ref(ks);
+            return err;
+        }
+
+        kvset_iter_set_stats(sub->kcs_inputv[i], sub->kcs_stats);
+
+        err = kvset_iter_seek(sub->kcs_inputv[i], start->ko_sfx, start->ko_sfx_len, &eof);
+        if (ev(err))
+            return err;
+    }
+
+    return 0;
+}
+
+static void
+kcompact_sub_work(struct work_struct *work)
+{
+    struct kcompact_sub *sub = container_of(work, struct kcompact_sub, kcs_work);
+    struct kcompact_job *job = sub->kcs_job;
+
+    sub->kcs_err = kcompact(sub->kcs_w, sub, false);
+
+    mutex_lock(&job->kcj_mtx);
+    if (--job->kcj_pending == 0)
+        cv_signal(&job->kcj_cv);
+    mutex_unlock(&job->kcj_mtx);
+}
+
+/* Gather the kblocks built by the subcompactions, in key order, into the
+ * output kvset.  The last range that has keys writes the kvset's last kblock,
+ * so it is finished only after it has joined all the other ranges.
+ */
+static merr_t
+kcompact_sub_gather(struct cn_compaction_work *w, struct kcompact_job *job, uint last)
+{
+    struct kvset_mblocks mbv[KCOMPACT_SUBC_MAX] = {};
+    struct kvs_block *   blk;
+    struct blk_list      kblks;
+    merr_t               err = 0;
+    uint                 i, j;
+
+    for (i = 0; i < job->kcj_subc && !err; ++i) {
+        if (i == last)
+            continue;
+
+        err = kvset_builder_get_mblocks(job->kcj_subv[i].kcs_child, &mbv[i]);
+        if (!ev(err))
+            kvset_builder_join(job->kcj_subv[last].kcs_child, job->kcj_subv[i].kcs_child);
+    }
+
+    if (!err)
+        err = kvset_builder_get_mblocks(job->kcj_subv[last].kcs_child, &mbv[last]);
+
+    blk_list_init(&kblks);
+
+    for (i = 0; i < job->kcj_subc && !err; ++i) {
+        for (j = 0; j < mbv[i].kblks.n_blks && !err; ++j) {
+            blk = mbv[i].kblks.blks + j;
+
+            err = blk_list_append_ext(
+                &kblks, blk->bk_handle, blk->bk_blkid, blk->bk_valid, blk->bk_needs_commit);
+        }
+
+        w->cw_outv->bl_vused += mbv[i].bl_vused;
+    }
+
+    if (!ev(err)) {
+        w->cw_outv->kblks = kblks;
+        w->cw_outv->bl_seqno_min = mbv[last].bl_seqno_min;
+        w->cw_outv->bl_seqno_max = mbv[last].bl_seqno_max;
+    } else {
+        blk_list_free(&kblks);
+    }
+
+    /* The mblocks of finished ranges are ours to abort on failure.
+     */
+    for (i = 0; i < job->kcj_subc; ++i) {
+        if (err)
+            abort_mblocks(w->cw_ds, &mbv[i].kblks);
+
+        /* kvset builder should not have created vblocks during kcompaction */
+        assert(mbv[i].vblks.n_blks == 0);
+
+        free(mbv[i].kblks.blks);
+        free(mbv[i].vblks.blks);
+    }
+
+    return err;
+}
+
+/* Merge the key ranges of a k-compaction concurrently, the first range on
+ * this thread and the others on the cn maintenance workqueue.
+ */
+static merr_t
+kcompact_split(struct cn_compaction_work *w, struct kvset *big, uint subc)
+{
+    struct workqueue_struct *wq;
+    struct kcompact_job *    job;
+    uint                     nkblks, last, i, j;
+    merr_t                   err = 0;
+
+    job = calloc(1, sizeof(*job));
+    if (ev(!job))
+        return merr(ENOMEM);
+
+    mutex_init(&job->kcj_mtx);
+    cv_init(&job->kcj_cv, "kcompact_job");
+    job->kcj_subc = subc;
+
+    nkblks = kvset_get_num_kblocks(big);
+
+    for (i = 0; i < subc; ++i) {
+        struct kcompact_sub *sub = job->kcj_subv + i;
+
+        sub->kcs_w = w;
+        sub->kcs_job = job;
+        sub->kcs_stats = i > 0 ? job->kcj_statsv + i : &w->cw_stats;
+
+        if (i + 1 < subc) {
+            const void *key;
+            uint        klen;
+
+            kvset_get_nth_kblock_minkey(big, (i + 1) * nkblks / subc, &key, &klen);
+            key2kobj(&sub->kcs_end, key, klen);
+            sub->kcs_bounded = true;
+        }
+
+        err = kcompact_builder_create(w, sub->kcs_stats, &sub->kcs_child);
+        if (ev(err))
+            goto done;
+
+        if (i == 0) {
+            sub->kcs_inputv = w->cw_inputv;
+            continue;
+        }
+
+        err = kcompact_sub_iters(w, sub, &job->kcj_subv[i - 1].kcs_end);
+        if (ev(err))
+            goto done;
+    }
+
+    wq = cn_get_maint_wq(cn_tree_get_cn(w->cw_tree));
+
+    job->kcj_pending = subc - 1;
+    for (i = 1; i < subc; ++i) {
+        INIT_WORK(&job->kcj_subv[i].kcs_work, kcompact_sub_work);
+        queue_work(wq, &job->kcj_subv[i].kcs_work);
+    }
+
+    job->kcj_subv[0].kcs_err = kcompact(w, &job->kcj_subv[0], false);
+
+    mutex_lock(&job->kcj_mtx);
+    while (job->kcj_pending > 0)
+        cv_wait(&job->kcj_cv, &job->kcj_mtx);
+    mutex_unlock(&job->kcj_mtx);
+
+    last = 0;
+    for (i = 0; i < subc; ++i) {
+        struct kcompact_sub *sub = job->kcj_subv + i;
+
+        if (sub->kcs_stats->ms_keys_out > 0)
+            last = i;
+        err = err ?: sub->kcs_err;
+    }
+
+    /* The first range merged directly into the work's stats. */
+    for (i = 1; i < subc; ++i)
+        cn_merge_stats_add(&w->cw_stats, job->kcj_subv[i].kcs_stats);
+    w->cw_stats.ms_srcs = w->cw_kvset_cnt;
+
+    for (i = 0; i < subc; ++i)
+        w->cw_vbmap.vbm_used += job->kcj_subv[i].kcs_vused;
+    w->cw_vbmap.vbm_waste = w->cw_vbmap.vbm_tot - w->cw_vbmap.vbm_used;
 
-    err = kcompact(w);
     if (ev(err))
         goto done;
 
+    err = kcompact_sub_gather(w, job, last);
+
+done:
+    for (i = 0; i < subc; ++i) {
+        struct kcompact_sub *sub = job->kcj_subv + i;
+
+        kvset_builder_destroy(sub->kcs_child);
+
+        if (i == 0 || !sub->kcs_inputv)
+            continue;
+
+        for (j = 0; j < w->cw_kvset_cnt; ++j)
+            kvset_iter_release(sub->kcs_inputv[j]);
+        free(sub->kcs_inputv);
+    }
+
+    cv_destroy(&job->kcj_cv);
+    mutex_destroy(&job->kcj_mtx);
+    free(job);
+
+    return err;
+}
+
+static merr_t
+kcompact_one(struct cn_compaction_work *w)
+{
+    struct kcompact_sub sub = {};
+    merr_t              err;
+
+    err = kcompact_builder_create(w, &w->cw_stats, &w->cw_child[0]);
+    if (ev(err))
+        return err;
+
+    sub.kcs_inputv = w->cw_inputv;
+    sub.kcs_child = w->cw_child[0];
+    sub.kcs_stats = &w->cw_stats;
+
+    err = kcompact(w, &sub, true);
+
+    w->cw_vbmap.vbm_used = sub.kcs_vused;
+    w->cw_vbmap.vbm_waste = w->cw_vbmap.vbm_tot - w->cw_vbmap.vbm_used;
+
     /* get resulting mblocks */
-    err = kvset_builder_get_mblocks(w->cw_child[0], w->cw_outv);
+    if (!ev(err))
+        err = kvset_builder_get_mblocks(w->cw_child[0], w->cw_outv);
+
+    kvset_builder_destroy(w->cw_child[0]);
+    w->cw_child[0] = NULL;
+
+    return err;
+}
+
+/* Prepend the kept vblocks to the new vblocks of a value gc compaction,
+ * such that the output's vblock list is either empty or holds all of its
+ * vblocks, the kept ones first.
+ */
+static merr_t
+kcompact_vgc_vblks(struct cn_compaction_work *w)
+{
+    struct blk_list * newv = &w->cw_outv->vblks;
+    struct kvs_block *blk;
+    struct blk_list   vblks;
+    merr_t            err = 0;
+    uint              i;
+
+    if (newv->n_blks == 0 && w->cw_vbmap.vbm_blkc == 0)
+        return 0;
+
+    blk_list_init(&vblks);
+
+    for (i = 0; i < w->cw_vbmap.vbm_blkc && !err; ++i) {
+        blk = w->cw_vbmap.vbm_blkv + i;
+
+        err = blk_list_append_ext(&vblks, blk->bk_handle, blk->bk_blkid, false, false);
+    }
+
+    for (i = 0; i < newv->n_blks && !err; ++i) {
+        blk = newv->blks + i;
+
+        err = blk_list_append_ext(
+            &vblks, blk->bk_handle, blk->bk_blkid, blk->bk_valid, blk->bk_needs_commit);
+    }
+
+    if (ev(err)) {
+        blk_list_free(&vblks);
+        abort_mblocks(w->cw_ds, newv);
+        blk_list_free(newv);
+        return err;
+    }
+
+    blk_list_free(newv);
+    *newv = vblks;
+
+    return 0;
+}
+
+merr_t
+cn_kcompact(struct cn_compaction_work *w)
+{
+    struct kvset *big = NULL;
+    merr_t        err;
+    uint          subc;
+
+    /* 'vbm_used' counts only the values referenced after this compaction;
+     * however, waste accumulates from compact-to-compact
+     */
+    w->cw_vbmap.vbm_used = 0;
+
+    subc = kcompact_subc(w, &big);
+    if (subc > 1)
+        err = kcompact_split(w, big, subc);
+    else
+        err = kcompact_one(w);
     if (ev(err))
-        goto done;
+        return err;
+
+    /* value gc --> keep the vblocks of the other inputs, as well */
+    if (w->cw_vbmap.vbm_gcv)
+        return kcompact_vgc_vblks(w);
 
     /* kvset builder should not have created vblocks during kcompaction */
     assert(w->cw_outv->vblks.blks == 0);
@@ -397,7 +1066,5 @@ cn_kcompact(struct cn_compaction_work *w)
         w->cw_vbmap.vbm_blkc = 0;
     }
 
-done:
-    kvset_builder_destroy(w->cw_child[0]);
-    return err;
+    return 0;
 }
@@ -22,6 +22,8 @@ struct cn_compaction_work;
  * @vbm_used:   total bytes of used vblock space
  * @vbm_waste:  total bytes of un-used vblock space
  * @vbm_tot:    total bytes of all values in vblock space
+ * @vbm_gcv:    if not NULL, vbm_gcv[i] is set if the vblocks of source i
+ *              are left out of blkv because its values are rewritten
  *
  * This structure is used during k-compaction to map the vr_index
  * in kvs_vtuple_ref into the new target vr_index in the larger kvset.
@@ -38,6 +40,10 @@ struct cn_compaction_work;
  * For backwards-compat, a full vblock has 0 waste, and 0 used.
  * Once k-compacted, used and waste are set to non-zero.
  *
+ * A value gc k-compaction copies the referenced values of the sources
+ * flagged in gcv[] to new vblocks, which follow the kept vblocks in the
+ * output kvset.  Only the kept vblocks count towards used, waste and tot.
+ *
  * Wasted space is calculated as ratio of waste / (used+waste).
  * Examples:
  * used 0,    waste 0,    ratio:   0 / 1   = 0
@@ -55,6 +61,7 @@ struct kvset_vblk_map {
     u64               vbm_used;
     u64               vbm_waste;
     u64               vbm_tot;
+    bool *            vbm_gcv;
 };
 
 /**
@@ -13,18 +13,26 @@
 #include "kcompact.h"
 
 merr_t
-kvset_keep_vblocks(struct kvset_vblk_map *vbm, struct kv_iterator **iv, int niv)
+kvset_keep_vblocks(struct kvset_vblk_map *vbm, struct kv_iterator **iv, int niv, const bool *gcv)
 {
     int               i, j, nv;
     int               nbytes;
     struct kvs_block *blks;
+    bool              gc = false;
 
     nv = 0;
-    for (i = 0; i < niv; ++i)
+    for (i = 0; i < niv; ++i) {
+        if (gcv && gcv[i]) {
+            gc = true;
+            continue;
+        }
         nv += kvset_get_num_vblocks(kvset_from_iter(iv[i]));
+    }
 
-    /* alloc both the vblks and the vbm; 1 free does both */
+    /* alloc the vblks, the vbm and the gcv; 1 free does all */
     nbytes = nv * sizeof(*vbm->vbm_blkv) + niv * sizeof(*vbm->vbm_map);
+    if (gc)
+        nbytes += niv * sizeof(*vbm->vbm_gcv);
     blks = calloc(1, nbytes);
     if (!blks)
         return merr(ev(ENOMEM));
@@ -36,6 +44,12 @@ kvset_keep_vblocks(struct kvset_vblk_map *vbm, struct kv_iterator **iv, int niv)
     vbm->vbm_used = 0;
     vbm->vbm_waste = 0;
     vbm->vbm_tot = 0;
+    vbm->vbm_gcv = NULL;
+
+    if (gc) {
+        vbm->vbm_gcv = (bool *)(vbm->vbm_map + niv);
+        memcpy(vbm->vbm_gcv, gcv, niv * sizeof(*gcv));
+    }
 
     /*
      * copy all the vblocks from the set of input iterators to
@@ -50,6 +64,9 @@ kvset_keep_vblocks(struct kvset_vblk_map *vbm, struct kv_iterator **iv, int niv)
      * and waste start as zero: there is no waste in ingest, kv-compact
      * or spill.  If this node has been previously k-compacted, then
      * waste may be >= 0, and this cycle adds to the waste count.
+     *
+     * The vblocks of sources flagged in gcv[] are left out, as the
+     * compaction copies their referenced values to new vblocks.
      */
 
     nv = 0;
@@ -58,6 +75,9 @@ kvset_keep_vblocks(struct kvset_vblk_map *vbm, struct kv_iterator **iv, int niv)
         int           cnt = kvset_get_num_vblocks(kvset);
 
         vbm->vbm_map[i] = nv;
+        if (vbm->vbm_gcv && vbm->vbm_gcv[i])
+            continue;
+
         for (j = 0; j < cnt; ++j) {
             blks[nv].bk_blkid = kvset_get_nth_vblock_id(kvset, j);
             blks[nv].bk_handle = kvset_get_nth_vblock_handle(kvset, j);
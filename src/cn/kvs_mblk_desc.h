@@ -11,12 +11,20 @@
 struct mpool_mcache_map;
 struct mpool;
 
+/* The page checksums (if any) live in the mapped mblock itself, crc_okv
+ * records which of the mapped pages have been verified against them.  It
+ * is allocated on the first verification, sized from crc_pgc, and freed
+ * by blk_crc_fini().
+ */
 struct kvs_mblk_desc {
     void *                   map_base; /* base address of mcache map */
     struct mpool_mcache_map *map;      /* mcache map */
     u32                      map_idx;  /* index of mblk in map */
+    u32                      crc_pgc;  /* number of checksummed pages */
     struct mpool *           ds;       /* mpool dataset */
     u64                      mb_id;    /* mblock id */
+    const u32 *              crcv;     /* mapped page checksums (__le32) */
+    u64 *                    crc_okv;  /* bitmap of verified pages */
 };
 
 #endif
@@ -6,10 +6,13 @@
 #include <hse_util/hse_err.h>
 #include <hse_util/event_counter.h>
 #include <hse_util/alloc.h>
+#include <hse_util/cursor_heap.h>
+#include <hse_util/scratch.h>
 #include <hse_util/slab.h>
 #include <hse_util/assert.h>
 #include <hse_util/logging.h>
 #include <hse_util/bloom_filter.h>
+#include <hse_util/usdt.h>
 #include <hse_util/logging.h>
 #include <hse_util/condvar.h>
 #include <hse_util/mutex.h>
@@ -17,15 +20,23 @@
 #include <hse_util/perfc.h>
 #include <hse_util/log2.h>
 #include <hse_util/mman.h>
+#include <hse_util/rcu.h>
+#include <hse_util/compression.h>
 
 #include <hse/hse_limits.h>
 #include <hse/kvdb_perfc.h>
 
+#include <hse_ikvdb/kvdb_perfc.h>
+
 #include <hse_ikvdb/tuple.h>
 #include <hse_ikvdb/cn_kvdb.h>
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cn_reclaim.h>
+#include <hse_ikvdb/io_sched.h>
 #include <hse_ikvdb/ikvdb.h>
 #include <hse_ikvdb/c1.h>
 #include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include "kvs_mblk_desc.h"
 
@@ -46,6 +57,7 @@
 #include "bloom_reader.h"
 #include "wbt_reader.h"
 #include "blk_list.h"
+#include "blk_crc.h"
 #include "kcompact.h"
 #include "kv_iterator.h"
 #include "wbt_internal.h"
@@ -100,6 +112,7 @@ struct kvset_cache {
 static struct kvset_cache kvset_cache[3] __read_mostly;
 static struct kmem_cache *kvset_iter_cache __read_mostly;
 static atomic_t           kvset_init_ref;
+static struct mutex       kvset_vlazy_lock;
 
 /* The kvset read buf cache maintains a small pool of preallocated large
  * (mostly sparse) buffers primarily for cn maintenance reads.  The cache
@@ -265,6 +278,12 @@ lvx2vbd(struct kvset *ks, uint i)
     return mbset_get_udata(lvx2mbs(ks, i), lvx2mbs_bnum(ks, i));
 }
 
+static __always_inline struct io_sched *
+kvset_io_sched(const struct kvset *ks)
+{
+    return ks->ks_cn_kvdb ? ks->ks_cn_kvdb->cnd_ios : NULL;
+}
+
 static void
 _kvset_destroy(struct kvset *ks);
 
@@ -357,6 +376,8 @@ kvset_kblk_init(
     struct mpool_mcache_map *kmap,
     u32                      idx,
     struct kvset_kblk *      p,
+    u64 *                    seqno_min,
+    u64 *                    seqno_max,
     u8 **                    hlog)
 {
     struct kvs_mblk_desc * kbd = &p->kb_kblk_desc;
@@ -369,6 +390,10 @@ kvset_kblk_init(
     if (ev(err))
         return err;
 
+    err = kbr_read_crc_region(kbd);
+    if (ev(err))
+        return err;
+
     err = kbr_read_wbt_region_desc(kbd, &p->kb_wbt_desc);
     if (ev(err))
         return err;
@@ -385,11 +410,15 @@ kvset_kblk_init(
     if (ev(err))
         return err;
 
+    err = kbr_read_hix_region(kbd, &p->kb_hix, &p->kb_hixc);
+    if (ev(err))
+        return err;
+
     err = kbr_read_metrics(kbd, &p->kb_metrics);
     if (ev(err))
         return err;
 
-    err = kbr_read_seqno_range(kbd, &p->kb_seqno_min, &p->kb_seqno_max);
+    err = kbr_read_seqno_range(kbd, seqno_min, seqno_max);
     if (ev(err))
         return err;
 
@@ -403,26 +432,15 @@ kvset_kblk_init(
         *hlog = 0;
     }
 
-    /* Cache min/max key ptrs and lengths, and initialize the
-     * min/max key discriminators for use in kblk_plausible().
+    /* Cache the min/max key lengths and initialize the min/max key
+     * discriminators for use in kblk_plausible().  The keys themselves
+     * are copied into the kvset's key arena by the caller.
      */
-    p->kb_koff_max = (const char *)hdr + omf_kbh_max_koff(hdr);
     p->kb_klen_max = omf_kbh_max_klen(hdr);
-
-    p->kb_koff_min = (const char *)hdr + omf_kbh_min_koff(hdr);
     p->kb_klen_min = omf_kbh_min_klen(hdr);
 
-    /* If the combined key lengths are short we can cache them nearby
-     * in p->kb_ksmall.  Otherwise the caller may try to pack them into
-     * a larger outboard buffer (i.e., kvset->ks_klarge).
-     */
-    if (sizeof(p->kb_ksmall) >= p->kb_klen_max + p->kb_klen_min) {
-        p->kb_koff_max = memcpy(p->kb_ksmall, p->kb_koff_max, p->kb_klen_max);
-        p->kb_koff_min = memcpy(p->kb_ksmall + p->kb_klen_max, p->kb_koff_min, p->kb_klen_min);
-    }
-
-    key_disc_init(p->kb_koff_max, p->kb_klen_max, &p->kb_kdisc_max);
-    key_disc_init(p->kb_koff_min, p->kb_klen_min, &p->kb_kdisc_min);
+    key_disc_init((const char *)hdr + omf_kbh_max_koff(hdr), p->kb_klen_max, &p->kb_kdisc_max);
+    key_disc_init((const char *)hdr + omf_kbh_min_koff(hdr), p->kb_klen_min, &p->kb_kdisc_min);
 
     /* Preload the wbtree nodes.
      */
@@ -523,6 +541,14 @@ vblock_udata_init(
         rock);
 }
 
+static void
+vblock_udata_fini(void *rock)
+{
+    struct vblock_desc *vbd = rock;
+
+    blk_crc_fini(&vbd->vbd_mblkdesc);
+}
+
 static merr_t
 vblock_udata_update(
     struct mbset *       mbs,
@@ -542,6 +568,170 @@ vblock_udata_update(
         rock);
 }
 
+static merr_t
+kvset_vmaterialize_slow(struct kvset *ks)
+{
+    merr_t err;
+    u64 *  argv;
+    uint   argc = 0;
+    uint   i;
+
+    for (i = 0; i < ks->ks_vbsetc; ++i) {
+        err = mbset_materialize(ks->ks_vbsetv[i]);
+        if (ev(err))
+            return err;
+    }
+
+    argv = malloc(sizeof(*argv) * (ks->ks_st.kst_vblks + 1));
+    if (ev(!argv))
+        return merr(ENOMEM);
+
+    /* vblock_udata_update() rewrites each vblock's vgroup index, which
+     * must happen exactly once, and vbsets may be shared by kvsets.
+     */
+    mutex_lock(&kvset_vlazy_lock);
+    if (atomic_read(&ks->ks_vlazy)) {
+        for (i = 0; i < ks->ks_vbsetc; ++i)
+            mbset_apply(ks->ks_vbsetv[i], vblock_udata_update, &argc, argv);
+
+        ks->ks_vgroups = argc;
+        atomic_set_rel(&ks->ks_vlazy, 0);
+    }
+    mutex_unlock(&kvset_vlazy_lock);
+
+    free(argv);
+
+    return 0;
+}
+
+/**
+ * kvset_vmaterialize() - map the vblocks of a lazily opened kvset
+ *
+ * Must be called before accessing the vblock maps, descriptors or vgroups
+ * of a kvset.  Cheap once the vblocks are mapped.
+ */
+static __always_inline merr_t
+kvset_vmaterialize(struct kvset *ks)
+{
+    if (likely(!atomic_read_acq(&ks->ks_vlazy)))
+        return 0;
+
+    return kvset_vmaterialize_slow(ks);
+}
+
+/* Bytes of a kblock's bloom filter and wbt internal nodes, which are what
+ * point lookups read from the mcache map on every probe.
+ */
+static size_t
+kvset_kblk_pin_len(struct kvset_kblk *kb)
+{
+    struct wbt_desc *wbd = &kb->kb_wbt_desc;
+    size_t           pgc;
+
+    pgc = wbd->wbd_n_pages - wbd->wbd_leaf_pgc - wbd->wbd_kmd_pgc;
+    if (kb->kb_cn_bloom_lookup == BLOOM_LOOKUP_MCACHE)
+        pgc += kb->kb_blm_desc.bd_n_pages;
+
+    return pgc * PAGE_SIZE;
+}
+
+static void
+kvset_kblk_unpin(struct kvset *ks, struct kvset_kblk *kb)
+{
+    kbr_mlock_wbt_int_nodes(&kb->kb_kblk_desc, &kb->kb_wbt_desc, false);
+    if (kb->kb_cn_bloom_lookup == BLOOM_LOOKUP_MCACHE)
+        kbr_mlock_bloom(&kb->kb_kblk_desc, &kb->kb_blm_desc, false);
+
+    cn_tree_pin_release(ks->ks_tree, ks->ks_node_level, kvset_kblk_pin_len(kb));
+    kb->kb_pinned = false;
+}
+
+/* Pin the blooms and wbt internal nodes of a kvset in one of the top levels
+ * of the tree, so that lookups do not fault them in from media after the
+ * kvset has been created by compaction.  Kblocks beyond the tree's budget,
+ * or whose pages cannot be locked (e.g., RLIMIT_MEMLOCK), are only preloaded.
+ */
+static void
+kvset_pin(struct kvset *ks)
+{
+    uint i;
+
+    for (i = 0; i < ks->ks_st.kst_kblks; ++i) {
+        struct kvset_kblk *   kb = ks->ks_kblks + i;
+        struct kvs_mblk_desc *kbd = &kb->kb_kblk_desc;
+        bool                  blm = kb->kb_cn_bloom_lookup == BLOOM_LOOKUP_MCACHE;
+        size_t                len = kvset_kblk_pin_len(kb);
+        merr_t                err;
+
+        if (!len)
+            continue;
+
+        if (cn_tree_pin_reserve(ks->ks_tree, ks->ks_node_level, len)) {
+            kb->kb_pinned = true;
+
+            err = kbr_mlock_wbt_int_nodes(kbd, &kb->kb_wbt_desc, true);
+            if (!err && blm)
+                err = kbr_mlock_bloom(kbd, &kb->kb_blm_desc, true);
+            if (!ev(err))
+                continue;
+
+            kvset_kblk_unpin(ks, kb);
+        }
+
+        kbr_madvise_wbt_int_nodes(kbd, &kb->kb_wbt_desc, MADV_WILLNEED);
+        if (blm)
+            kbr_madvise_bloom(kbd, &kb->kb_blm_desc, MADV_WILLNEED);
+    }
+}
+
+/* Fit a kblock model to the min keys of a kvset's kblocks, leaving out a
+ * trailing kblock that holds only ptombs.
+ */
+static struct kblk_model *
+kvset_kmodel_create(struct kvset *ks)
+{
+    struct kblk_model *model;
+    uint               kblkc, i;
+
+    kblkc = ks->ks_st.kst_kblks;
+    if (kblkc > 1 && ks->ks_kblks[kblkc - 1].kb_wbt_desc.wbd_n_pages == 0)
+        --kblkc;
+
+    model = kblk_model_create(ks->ks_lcp, kblkc);
+    if (!model)
+        return NULL;
+
+    for (i = 0; i < kblkc; ++i)
+        kblk_model_add(model, kblk_kmin(ks, ks->ks_kblks + i), ks->ks_kblks[i].kb_klen_min);
+
+    if (!kblk_model_seal(model)) {
+        kblk_model_destroy(model);
+        model = NULL;
+    }
+
+    return model;
+}
+
+#define ra_lev0(_ra) ((_ra)&0xffu)
+#define ra_lev1(_ra) (((_ra) >> 8) & 0xffu)
+#define ra_pct(_ra) (((_ra) >> 16) & 0xffu)
+#define ra_willneed(_ra) (((_ra) >> 24) & 0x01u)
+
+/* Restored kvsets whose vblocks are not read ahead may defer mapping them
+ * until first access (see kvset_vmaterialize()).  Kblocks are always mapped
+ * at open, their headers supply the kvset's key range and seqnos.
+ */
+static bool
+kvset_lazy_ok(struct cn_tree *tree, struct kvset_meta *km)
+{
+    struct kvs_rparams *rp = cn_tree_get_rp(tree);
+
+    if (!rp || !rp->cn_lazy_open || !km->km_restored || km->km_capped)
+        return false;
+
+    return km->km_node_level > 0 && km->km_node_level >= ra_lev0(rp->cn_mcache_vra_params);
+}
+
 merr_t
 kvset_create2(
     struct cn_tree *   tree,
@@ -562,7 +752,7 @@ kvset_create2(
     uint          i, j;
     size_t        alloc_len;
     struct kvset *ks;
-    size_t        kcachesz;
+    size_t        karenasz;
     ulong         mavail;
     uint          n_kblks = km->km_kblk_list.n_blks;
     uint          n_vblks = km->km_vblk_list.n_blks;
@@ -649,12 +839,16 @@ kvset_create2(
     ks->ks_vmin = rp->cn_mcache_vmin;
     ks->ks_vmax = rp->cn_mcache_vmax;
     ks->ks_cn_kvdb = cn_kvdb;
+    ks->ks_icache = tree->ct_icache;
 
     /* initialize atomics */
     atomic_set(&ks->ks_ref, 0);
     atomic_set(&ks->ks_delete_error, 0);
     atomic_set(&ks->ks_mbset_callbacks, 0);
 
+    spin_lock_init(&ks->ks_heat.kh_lock);
+    ks->ks_heat.kh_time = get_time_ns();
+
     if (cn_tree_is_capped(ks->ks_tree))
         ks->ks_vra_len = rp->cn_capped_vra;
     else if (n_vblks > 0)
@@ -666,7 +860,7 @@ kvset_create2(
     if (rp->cn_verify) {
         struct cn_khashmap *map = cn_tree_get_khashmap(tree);
 
-        kc_kvset_check(ds, cp, km, map->khm_mapv);
+        kc_kvset_check(ds, cp, km, map ? map->khm_mapv : NULL);
     }
 
     hse_meminfo(NULL, &mavail, 30);
@@ -682,7 +876,7 @@ kvset_create2(
     if (ev(err))
         goto err_exit;
 
-    kcachesz = 0;
+    karenasz = 0;
 
     for (i = 0; i < n_kblks; i++) {
         struct kvset_kblk * kblk = ks->ks_kblks + i;
@@ -699,15 +893,36 @@ kvset_create2(
         kblk->kb_kblk.bk_blkid = mbid;
         kblk->kb_kblk.bk_handle = mbh;
 
-        err = kvset_kblk_init(rp, ds, ks->ks_kmapv[i / mblock_max], i % mblock_max, kblk, &hlog);
+        if (i == 0)
+            ks->ks_mclass = props.mpr_mclassp;
+
+        err = kvset_kblk_init(
+            rp,
+            ds,
+            ks->ks_kmapv[i / mblock_max],
+            i % mblock_max,
+            kblk,
+            &ks->ks_seqno_min,
+            &ks->ks_seqno_max,
+            &hlog);
         if (ev(err))
             goto err_exit;
 
-        /* Ignore these keys if they've already been cached
-         * to kblk->kb_ksmall by kblk_init().
+        if (rp->cn_mcache_thp)
+            kbr_madvise_thp(&kblk->kb_kblk_desc, props.mpr_alloc_cap);
+
+        /* Fault in the index regions of kvsets built by ingest or
+         * compaction, as they're about to be searched.
          */
-        if (kblk->kb_koff_max != kblk->kb_ksmall)
-            kcachesz += kblk->kb_klen_max + kblk->kb_klen_min;
+        if (rp->cn_mcache_populate && !cn_tree_is_replay(tree))
+            kbr_populate_index(
+                &kblk->kb_kblk_desc,
+                &kblk->kb_wbt_desc,
+                kblk->kb_cn_bloom_lookup == BLOOM_LOOKUP_MCACHE ? &kblk->kb_blm_desc : NULL,
+                rp->cn_mcache_populate > 1);
+
+        kblk->kb_koff = karenasz;
+        karenasz += kblk->kb_klen_max + kblk->kb_klen_min;
 
         /* save ptr to last kblock's hlog */
         ks->ks_hlog = hlog;
@@ -716,67 +931,47 @@ kvset_create2(
         ks->ks_st.kst_kalen += props.mpr_alloc_cap;
         ks->ks_st.kst_kwlen += props.mpr_write_len;
         ks->ks_st.kst_keys += kblk->kb_metrics.num_keys;
+        ks->ks_st.kst_tombs += kblk->kb_metrics.num_tombstones;
+        ks->ks_st.kst_ptombs += kblk->kb_metrics.num_ptombs;
     }
 
-    /* Cache the large min/max keys from all the kblocks into a packed
-     * buffer to avoid having to reference their mcache mapped header
-     * to find them.  The malloc here might be very large and hence
-     * fail (esp. in the kernel), but that's ok because we'll simply
-     * fall back to using the keys in the mcache mapped header.
+    /* Pack the min/max keys from all the kblocks into a single buffer
+     * sized to fit, so that we needn't reference their mcache mapped
+     * headers to find them.  The last kblock's header doubles as the
+     * kvset header, and kvset_kblk_init() left the kvset's seqno range
+     * from that header in ks_seqno_min/max.
      */
-    kcachesz = min(kcachesz, rp->cn_kcachesz);
-    if (kcachesz > 0) {
-        u8 *dst;
-
-        dst = malloc(kcachesz);
-        ks->ks_klarge = dst;
-
-        for (i = dst ? 0 : UINT_MAX; i < n_kblks; ++i) {
-            struct kvset_kblk *kb = ks->ks_kblks + i;
-
-            /* Ignore these keys if they've already been cached
-             * to kb->kb_ksmall by kblk_init().
-             */
-            if (kb->kb_koff_max == kb->kb_ksmall)
-                continue;
-
-            if (dst + kb->kb_klen_max > ks->ks_klarge + kcachesz)
-                break;
-
-            kb->kb_koff_max = memcpy(dst, kb->kb_koff_max, kb->kb_klen_max);
-
-            dst += kb->kb_klen_max;
-
-            if (dst + kb->kb_klen_min > ks->ks_klarge + kcachesz)
-                break;
+    ks->ks_karena = malloc(karenasz);
+    if (ev(!ks->ks_karena)) {
+        err = merr(ENOMEM);
+        goto err_exit;
+    }
 
-            kb->kb_koff_min = memcpy(dst, kb->kb_koff_min, kb->kb_klen_min);
+    for (i = 0; i < n_kblks; ++i) {
+        struct kvset_kblk *    kb = ks->ks_kblks + i;
+        struct kblock_hdr_omf *hdr = kb->kb_kblk_desc.map_base;
+        u8 *                   dst = ks->ks_karena + kb->kb_koff;
 
-            dst += kb->kb_klen_min;
+        memcpy(dst, (const char *)hdr + omf_kbh_max_koff(hdr), kb->kb_klen_max);
+        memcpy(dst + kb->kb_klen_max, (const char *)hdr + omf_kbh_min_koff(hdr), kb->kb_klen_min);
 
-/* There is no further need to access the kblock
-             * header past this point, and hence its physical
-             * pages will eventually be reclaimed by the VMM.
-             * For debug builds, we remove all access rights
-             * to the kblock header in order to catch those
-             * who might otherwise try to access it.
-             */
+        /* There is no further need to access the kblock
+         * header past this point, and hence its physical
+         * pages will eventually be reclaimed by the VMM.
+         * For debug builds, we remove all access rights
+         * to the kblock header in order to catch those
+         * who might otherwise try to access it.
+         */
 #if !defined(HSE_BUILD_RELEASE)
-            mprotect(kb->kb_kblk_desc.map_base, PAGE_SIZE, PROT_NONE);
+        mprotect(kb->kb_kblk_desc.map_base, PAGE_SIZE, PROT_NONE);
 #endif
-        }
     }
 
-    ks->ks_minkey = ks->ks_kblks[0].kb_koff_min;
+    ks->ks_minkey = kblk_kmin(ks, ks->ks_kblks);
     ks->ks_minklen = ks->ks_kblks[0].kb_klen_min;
-    ks->ks_maxkey = ks->ks_kblks[n_kblks - 1].kb_koff_max;
+    ks->ks_maxkey = kblk_kmax(ks, ks->ks_kblks + n_kblks - 1);
     ks->ks_maxklen = ks->ks_kblks[n_kblks - 1].kb_klen_max;
 
-    /* The last kblock's header doubles as a kvset header.
-     * Retrieve kvset's seqno range from this kblock's hdr.
-     */
-    ks->ks_seqno_min = ks->ks_kblks[n_kblks - 1].kb_seqno_min;
-    ks->ks_seqno_max = ks->ks_kblks[n_kblks - 1].kb_seqno_max;
     assert(ks->ks_seqno_max >= ks->ks_seqno_min);
 
     /* Initialize kvset key min/max discriminators - only from main wbt
@@ -792,7 +987,13 @@ kvset_create2(
     rkb = ks->ks_kblks + n_kblks - 1;
 
     ks->ks_lcp = min_t(size_t, lkb->kb_klen_min, rkb->kb_klen_max);
-    ks->ks_lcp = memlcpq(lkb->kb_koff_min, rkb->kb_koff_max, ks->ks_lcp);
+    ks->ks_lcp = memlcpq(kblk_kmin(ks, lkb), kblk_kmax(ks, rkb), ks->ks_lcp);
+
+    if (rp->cn_kblk_model)
+        ks->ks_kmodel = kvset_kmodel_create(ks);
+
+    if (ks->ks_node_level < min_t(ulong, rp->cn_pin_lvl, CN_PIN_LVL_MAX))
+        kvset_pin(ks);
 
     {
         uint v = 0; /* vblock number (0..n_vblks) */
@@ -800,6 +1001,20 @@ kvset_create2(
         uint k;
         u64 *argv;
         uint argc;
+        bool lazy = false;
+
+        /* A new kvset that is not itself lazy may inherit lazy vbsets
+         * from its inputs (k-compaction), map them now.
+         */
+        if (!kvset_lazy_ok(tree, km)) {
+            for (i = 0; i < vbset_cnt_len; i++) {
+                for (j = 0; j < vbset_cnts[i]; j++) {
+                    err = mbset_materialize(vbset_vecs[i][j]);
+                    if (ev(err))
+                        goto err_exit;
+                }
+            }
+        }
 
         for (i = 0; i < vbset_cnt_len; i++) {
             for (j = 0; j < vbset_cnts[i]; j++, m++) {
@@ -812,6 +1027,7 @@ kvset_create2(
                 ks->ks_st.kst_vwlen += mbset_get_wlen(mbset);
 
                 ks->ks_vbsetv[m] = mbset_get_ref(mbset);
+                lazy |= mbset_is_lazy(mbset);
                 for (k = 0; k < blks_in_mbset; k++, v++) {
                     ks->ks_vblk2mbs[v].mbs = mbset;
                     ks->ks_vblk2mbs[v].idx = k;
@@ -820,20 +1036,23 @@ kvset_create2(
         }
 
         /* Compute vgroup indices and tally the number of vgroups.
+         * This reads the vblock headers, so for lazy vbsets it is
+         * left to kvset_vmaterialize().
          */
-        argc = 0;
-        argv = malloc(sizeof(*argv) * (v + 1));
-        if (ev(!argv))
-            goto err_exit;
+        if (lazy) {
+            atomic_set(&ks->ks_vlazy, 1);
+        } else {
+            argc = 0;
+            argv = malloc(sizeof(*argv) * (v + 1));
+            if (ev(!argv))
+                goto err_exit;
 
-        for (i = 0; i < m; ++i) {
-            struct mbset *mbset = ks->ks_vbsetv[i];
+            for (i = 0; i < m; ++i)
+                mbset_apply(ks->ks_vbsetv[i], vblock_udata_update, &argc, argv);
 
-            mbset_apply(mbset, vblock_udata_update, &argc, argv);
+            ks->ks_vgroups = argc;
+            free(argv);
         }
-
-        ks->ks_vgroups = argc;
-        free(argv);
     }
 
     /* begin life with one ref and not deleting */
@@ -854,11 +1073,6 @@ kvset_create2(
     kvdb_kalen >>= 30;
     kvdb_valen >>= 30;
 
-#define ra_lev0(_ra) ((_ra)&0xffu)
-#define ra_lev1(_ra) (((_ra) >> 8) & 0xffu)
-#define ra_pct(_ra) (((_ra) >> 16) & 0xffu)
-#define ra_willneed(_ra) (((_ra) >> 24) & 0x01u)
-
     /* Enable mcache readahead for cn level zero k/v blocks and for
      * non-zero level k/v blocks if the kvdb size isn't larger than
      * the specified pct usage of system RAM.
@@ -908,6 +1122,9 @@ kvset_create2(
 done:
     ks->ks_ctime = get_time_ns();
 
+    ks->ks_memsz = alloc_len + karenasz;
+    kvdb_memacct_alloc(KVDB_MEMACCT_CN, ks->ks_memsz);
+
     *ks_out = ks;
 
     return 0;
@@ -917,43 +1134,67 @@ err_exit:
     return err;
 }
 
+merr_t
+kvset_create_vbset(struct cn_tree *tree, struct kvset_meta *km, uint first, struct mbset **vbset)
+{
+    struct blk_list vblks = km->km_vblk_list;
+    uint            flags = 0;
+    merr_t          err;
+    u64 *           idv;
+
+    *vbset = NULL;
+
+    if (first >= vblks.n_blks)
+        return 0;
+
+    vblks.blks += first;
+    vblks.n_blks -= first;
+
+    idv = blkid_list_to_vec(&vblks);
+    if (!idv)
+        return merr(ev(ENOMEM));
+
+    if (km->km_node_level == 0)
+        flags |= MBSET_FLAGS_VBLK_ROOT;
+
+    if (km->km_capped)
+        flags |= MBSET_FLAGS_CAPPED;
+
+    if (kvset_lazy_ok(tree, km))
+        flags |= MBSET_FLAGS_LAZY;
+
+    err = mbset_create(
+        cn_tree_get_ds(tree),
+        vblks.n_blks,
+        idv,
+        sizeof(struct vblock_desc),
+        vblock_udata_init,
+        vblock_udata_fini,
+        flags,
+        cn_vma_mblock_max(tree->cn, MP_MED_CAPACITY),
+        vbset);
+    free(idv);
+
+    if (!err && cn_tree_get_cnkvdb(tree))
+        mbset_set_scache(*vbset, cn_tree_get_cnkvdb(tree)->cnd_scache);
+
+    return err;
+}
+
 merr_t
 kvset_create(struct cn_tree *tree, u64 tag, struct kvset_meta *km, struct kvset **ks)
 {
     merr_t         err;
-    uint           n_vblks = km->km_vblk_list.n_blks;
-    struct mbset * vbset = 0;
+    struct mbset * vbset;
     struct mbset **vbsetv = &vbset;
     uint           vbsetc = 0;
     uint           len = 0;
-    uint           flags = 0;
-
-    if (n_vblks) {
-        u64 *idv;
 
-        idv = blkid_list_to_vec(&km->km_vblk_list);
-        if (!idv)
-            return merr(ev(ENOMEM));
-
-        if (km->km_node_level == 0)
-            flags |= MBSET_FLAGS_VBLK_ROOT;
-
-        if (km->km_capped)
-            flags |= MBSET_FLAGS_CAPPED;
-
-        err = mbset_create(
-            cn_tree_get_ds(tree),
-            n_vblks,
-            idv,
-            sizeof(struct vblock_desc),
-            vblock_udata_init,
-            flags,
-            cn_vma_mblock_max(tree->cn, MP_MED_CAPACITY),
-            &vbset);
-        free(idv);
-        if (ev(err))
-            return err;
+    err = kvset_create_vbset(tree, km, 0, &vbset);
+    if (ev(err))
+        return err;
 
+    if (vbset) {
         len = 1;
         vbsetc = 1;
     }
@@ -964,7 +1205,7 @@ kvset_create(struct cn_tree *tree, u64 tag, struct kvset_meta *km, struct kvset
     err = kvset_create2(tree, tag, km, len, &vbsetc, &vbsetv, ks);
     ev(err);
 
-    if (n_vblks)
+    if (vbset)
         mbset_put_ref(vbset);
 
     return err;
@@ -1007,6 +1248,83 @@ kvset_log_d_records(struct kvset *ks, bool keepv, u64 txid)
     return err;
 }
 
+merr_t
+kvset_log_move(struct kvset *ks, u64 txid, u32 level, u32 offset, u64 *tag)
+{
+    struct kvset_mblocks mblks = {};
+    struct kvset_meta    km = {};
+    struct kvs_block *   blkv;
+    uint                 i;
+    merr_t               err;
+
+    assert(txid);
+    assert(ks->ks_tag != 0);
+
+    blkv = calloc(ks->ks_st.kst_kblks + ks->ks_st.kst_vblks, sizeof(*blkv));
+    if (!blkv)
+        return merr(ev(ENOMEM));
+
+    mblks.kblks.blks = blkv;
+    mblks.kblks.n_blks = ks->ks_st.kst_kblks;
+    mblks.vblks.blks = blkv + ks->ks_st.kst_kblks;
+    mblks.vblks.n_blks = ks->ks_st.kst_vblks;
+
+    for (i = 0; i < ks->ks_st.kst_kblks; i++)
+        mblks.kblks.blks[i].bk_blkid = ks->ks_kblks[i].kb_kblk.bk_blkid;
+    for (i = 0; i < ks->ks_st.kst_vblks; i++)
+        mblks.vblks.blks[i].bk_blkid = lvx2mbid(ks, i);
+
+    /* The mblocks stay with the old tag should the move be rolled back. */
+    err = cndb_txn_txc(ks->ks_cndb, txid, ks->ks_cnid, tag, &mblks, CNDB_KEEP_ALL);
+    free(blkv);
+    if (ev(err))
+        return err;
+
+    km.km_dgen = ks->ks_dgen;
+    km.km_vused = ks->ks_st.kst_vulen;
+    km.km_compc = ks->ks_compc;
+    km.km_scatter = ks->ks_scatter;
+    km.km_node_level = level;
+    km.km_node_offset = offset;
+
+    err = cndb_txn_meta(ks->ks_cndb, txid, ks->ks_cnid, *tag, &km);
+
+    return ev(err);
+}
+
+void
+kvset_move(struct kvset *ks, u64 tag, u32 level)
+{
+    bool pin;
+    uint i;
+
+    pin = level < min_t(ulong, ks->ks_rp->cn_pin_lvl, CN_PIN_LVL_MAX);
+
+    /* Carry the pinned kblocks over to the new level, within its budget.
+     */
+    for (i = 0; i < ks->ks_st.kst_kblks; i++) {
+        struct kvset_kblk *kb = ks->ks_kblks + i;
+        size_t             len;
+
+        if (!kb->kb_pinned)
+            continue;
+
+        len = kvset_kblk_pin_len(kb);
+        cn_tree_pin_release(ks->ks_tree, ks->ks_node_level, len);
+
+        if (pin && cn_tree_pin_reserve(ks->ks_tree, level, len))
+            continue;
+
+        kbr_mlock_wbt_int_nodes(&kb->kb_kblk_desc, &kb->kb_wbt_desc, false);
+        if (kb->kb_cn_bloom_lookup == BLOOM_LOOKUP_MCACHE)
+            kbr_mlock_bloom(&kb->kb_kblk_desc, &kb->kb_blm_desc, false);
+        kb->kb_pinned = false;
+    }
+
+    ks->ks_tag = tag;
+    ks->ks_node_level = level;
+}
+
 static void
 _kvset_mbset_destroyed(void *rock, bool mblk_delete_error)
 {
@@ -1066,11 +1384,89 @@ kvset_mark_mblocks_for_delete(struct kvset *ks, bool keepv, u64 txid)
 
             mbset_set_delete_flag(vbset);
             mbset_set_callback(vbset, _kvset_mbset_destroyed, ks);
+
+            if (ks->ks_cn_kvdb)
+                mbset_set_reclaim(vbset, ks->ks_cn_kvdb->cnd_reclaim);
         }
     }
 }
 
+/**
+ * struct kvset_reclaim - deferred deletion of the kblocks of a kvset
+ * @kr_cn:    cn, on which a reference is held until the deletion is done
+ * @kr_cndb:  cndb
+ * @kr_txid:  cndb transaction that deleted the kvset
+ * @kr_tag:   kvset tag
+ * @kr_cnid:  cn id
+ * @kr_mbhv:  kblock handles
+ */
+struct kvset_reclaim {
+    struct cn *  kr_cn;
+    struct cndb *kr_cndb;
+    u64          kr_txid;
+    u64          kr_tag;
+    u64          kr_cnid;
+    u64          kr_mbhv[];
+};
+
 static void
+_kvset_kblks_reclaimed(void *rock, bool mblk_delete_error)
+{
+    struct kvset_reclaim *kr = rock;
+
+    if (!mblk_delete_error)
+        cndb_txn_ack_d(kr->kr_cndb, kr->kr_txid, kr->kr_tag, kr->kr_cnid);
+
+    cn_ref_put(kr->kr_cn);
+    free(kr);
+}
+
+/* Hand the kblocks of a deleted kvset to the reclaim queue.  The ack_d
+ * record goes with them, as it must follow their deletion.  By now all
+ * vblocks to delete have been deleted (or handed to the queue ahead of
+ * the kblocks).
+ */
+static bool
+reclaim_kblocks(struct kvset *ks)
+{
+    struct kvset_reclaim *kr;
+    struct cn_reclaim *   rc;
+    uint                  i;
+
+    rc = ks->ks_cn_kvdb ? ks->ks_cn_kvdb->cnd_reclaim : NULL;
+    if (!rc || atomic_read(&ks->ks_delete_error))
+        return false;
+
+    kr = malloc(sizeof(*kr) + ks->ks_st.kst_kblks * sizeof(kr->kr_mbhv[0]));
+    if (ev(!kr))
+        return false;
+
+    for (i = 0; i < ks->ks_st.kst_kblks; i++)
+        kr->kr_mbhv[i] = ks->ks_kblks[i].kb_kblk.bk_handle;
+
+    kr->kr_cn = cn_tree_get_cn(ks->ks_tree);
+    kr->kr_cndb = ks->ks_cndb;
+    kr->kr_txid = ks->ks_delete_txid;
+    kr->kr_tag = ks->ks_tag;
+    kr->kr_cnid = ks->ks_cnid;
+
+    cn_ref_get(kr->kr_cn);
+
+    cn_reclaim_add(
+        rc,
+        ks->ks_ds,
+        ks->ks_st.kst_kblks,
+        kr->kr_mbhv,
+        ks->ks_st.kst_kalen,
+        _kvset_kblks_reclaimed,
+        kr);
+
+    return true;
+}
+
+/* Return true if the deletion of the kblocks was deferred.
+ */
+static bool
 cleanup_kblocks(struct kvset *ks)
 {
     merr_t err = 0;
@@ -1087,6 +1483,9 @@ cleanup_kblocks(struct kvset *ks)
         }
     }
 
+    if (ks->ks_deleted && reclaim_kblocks(ks))
+        return true;
+
     /* Stop deleting mblocks on the fist sign of trouble and let CNDB
      * finish deleting them during recovery.  We could continue to delete
      * remaining mblocks here, but a delete failure might be indicative of
@@ -1100,13 +1499,15 @@ cleanup_kblocks(struct kvset *ks)
             err = mpool_mblock_delete(ks->ks_ds, mbh);
             if (ev(err)) {
                 atomic_inc(&ks->ks_delete_error);
-                return;
+                return false;
             }
         } else {
             err = mpool_mblock_put(ks->ks_ds, mbh);
             ev(err); /* log event, but otherwise ignore it */
         }
     }
+
+    return false;
 }
 
 static void
@@ -1130,15 +1531,26 @@ _kvset_destroy(struct kvset *ks)
     for (i = 0; i < ks->ks_st.kst_kblks; i++) {
         struct kvset_kblk *kblk = ks->ks_kblks + i;
 
+        if (kblk->kb_pinned)
+            kvset_kblk_unpin(ks, kblk);
+
         kbr_free_blm_pages(&kblk->kb_kblk_desc, kblk->kb_cn_bloom_lookup, kblk->kb_blm_pages);
-    }
 
-    cleanup_kblocks(ks);
+        if (ks->ks_icache)
+            wbt_icache_remove(ks->ks_icache, &kblk->kb_icache);
 
-    if (ks->ks_deleted && !atomic_read(&ks->ks_delete_error))
+        kbr_wbt_leaf_evict(&kblk->kb_kblk_desc, &kblk->kb_wbt_desc);
+        blk_crc_fini(&kblk->kb_kblk_desc);
+    }
+
+    if (!cleanup_kblocks(ks) && ks->ks_deleted && !atomic_read(&ks->ks_delete_error))
         cndb_txn_ack_d(ks->ks_cndb, ks->ks_delete_txid, ks->ks_tag, ks->ks_cnid);
 
-    free((void *)ks->ks_klarge);
+    free(ks->ks_karena);
+    kblk_model_destroy(ks->ks_kmodel);
+
+    if (ks->ks_memsz)
+        kvdb_memacct_free(KVDB_MEMACCT_CN, ks->ks_memsz);
 
     if (ks->ks_kvset_sz > kvset_cache[0].sz)
         free_aligned(ks);
@@ -1152,6 +1564,7 @@ _kvset_destroy(struct kvset *ks)
 
 static int
 kblk_plausible(
+    struct kvset *         ks,
     struct kvset_kblk *    kblk,
     const struct key_disc *kdisc,
     const void *           key,
@@ -1192,7 +1605,7 @@ kblk_plausible(
      * bounds of this kblock.
      */
     if (cmpmax) {
-        const void *kmax = kblk->kb_koff_max;
+        const void *kmax = kblk_kmax(ks, kblk);
         u32         lmax = kblk->kb_klen_max;
 
         if (len > 0)
@@ -1205,7 +1618,7 @@ kblk_plausible(
     }
 
     if (cmpmin) {
-        const void *kmin = kblk->kb_koff_min;
+        const void *kmin = kblk_kmin(ks, kblk);
         u32         lmin = kblk->kb_klen_min;
 
         if (len > 0)
@@ -1243,33 +1656,123 @@ kvset_pt_start(struct kvset *ks)
     return last;
 }
 
-/**
- * kvset_kblk_start() - determine if a kvset might contain a key. This does not
- * include ptombs. For ptombs, see kvset_pt_start().
- *
- * len > 0 => seek;   seek to key
- * len < 0 => create; seek to prefix
- *
- * Return value:
- * i >= 0 : of the first kblock that could possibly contain a match for key.
- * %KVSET_MISS_KEY_TOO_LARGE: key is larger than all key in the kvset.
- * %KVSET_MISS_KEY_TOO_SMALL: key is smaller than all keys in the kvset.
+/* Probe a kblock's prefix bloom, treating lookup errors as a hit.
  */
-int
-kvset_kblk_start(struct kvset *ks, const void *key, int len, bool reverse)
+static bool
+kblk_pfx_lookup(struct kvset_kblk *kblk, struct kvs_ktuple *kt)
 {
-    struct key_disc kdisc;
-    int             rc, i;
+    bool   hit;
+    merr_t err;
 
-    /* len == 0 ==> full scan */
-    if (len == 0)
-        return reverse ? ks->ks_st.kst_kblks - 1 : 0;
+    if (kblk->kb_blm_pages)
+        return bloom_reader_buffer_lookup(&kblk->kb_blm_desc, kblk->kb_blm_pages, kt);
 
-    if (len > 0) { /* seek */
-        key_disc_init(key, len, &kdisc);
+    err = bloom_reader_mcache_lookup(&kblk->kb_blm_desc, &kblk->kb_kblk_desc, kt, &hit);
 
-        /* if this is a seek (len > 0), can be too small only if rev */
-        if (reverse) {
+    return ev(err) ? true : hit;
+}
+
+bool
+kvset_pfx_may_exist(struct kvset *ks, const void *pfx, u32 pfx_len)
+{
+    struct kvs_ktuple kt;
+    int               i, rc;
+
+    if (ks->ks_pfx_len == 0 || pfx_len < ks->ks_pfx_len)
+        return true;
+
+    kvs_ktuple_init_nohash(&kt, pfx, ks->ks_pfx_len);
+
+    for (i = 0; i < ks->ks_st.kst_kblks; ++i) {
+        struct kvset_kblk *kblk = ks->ks_kblks + i;
+
+        rc = kblk_plausible(ks, kblk, NULL, pfx, -pfx_len, 0);
+        if (rc > 0)
+            continue;
+        if (rc < 0)
+            break;
+
+        if (!kblk->kb_blm_desc.bd_pfx || !kblk->kb_blm_desc.bd_n_pages)
+            return true;
+
+        if (kblk_pfx_lookup(kblk, &kt))
+            return true;
+    }
+
+    return false;
+}
+
+bool
+kvset_range_may_exist(struct kvset *ks, const void *lo, u32 lolen, const void *hi, u32 hilen)
+{
+    struct kvs_ktuple kt;
+    bool              usepfx;
+    int               i;
+
+    if (keycmp(hi, hilen, ks->ks_minkey, ks->ks_minklen) < 0)
+        return false;
+
+    if (lolen > 0 && keycmp(lo, lolen, ks->ks_maxkey, ks->ks_maxklen) > 0)
+        return false;
+
+    /* If both bounds carry the same tree prefix then so does every key
+     * in between, and the kblock prefix blooms can rule the range out.
+     */
+    usepfx = ks->ks_pfx_len > 0 && lolen >= ks->ks_pfx_len && hilen >= ks->ks_pfx_len &&
+             !memcmp(lo, hi, ks->ks_pfx_len);
+    if (usepfx)
+        kvs_ktuple_init_nohash(&kt, lo, ks->ks_pfx_len);
+
+    /* The kblocks of a kvset hold disjoint, ascending key ranges, so the
+     * range may also fall entirely within the gap between two kblocks.
+     */
+    for (i = 0; i < ks->ks_st.kst_kblks; ++i) {
+        struct kvset_kblk *kblk = ks->ks_kblks + i;
+
+        if (lolen > 0 && keycmp(lo, lolen, kblk_kmax(ks, kblk), kblk->kb_klen_max) > 0)
+            continue;
+
+        if (keycmp(hi, hilen, kblk_kmin(ks, kblk), kblk->kb_klen_min) < 0)
+            break;
+
+        if (!usepfx || !kblk->kb_blm_desc.bd_pfx || !kblk->kb_blm_desc.bd_n_pages)
+            return true;
+
+        if (kblk_pfx_lookup(kblk, &kt))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * kvset_kblk_start() - determine if a kvset might contain a key. This does not
+ * include ptombs. For ptombs, see kvset_pt_start().
+ *
+ * len > 0 => seek;   seek to key
+ * len < 0 => create; seek to prefix
+ *
+ * Return value:
+ * i >= 0 : of the first kblock that could possibly contain a match for key.
+ * %KVSET_MISS_KEY_TOO_LARGE: key is larger than all key in the kvset.
+ * %KVSET_MISS_KEY_TOO_SMALL: key is smaller than all keys in the kvset.
+ */
+int
+kvset_kblk_start(struct kvset *ks, const void *key, int len, bool reverse)
+{
+    struct key_disc kdisc;
+    int             rc, i;
+    int             first, last;
+
+    /* len == 0 ==> full scan */
+    if (len == 0)
+        return reverse ? ks->ks_st.kst_kblks - 1 : 0;
+
+    if (len > 0) { /* seek */
+        key_disc_init(key, len, &kdisc);
+
+        /* if this is a seek (len > 0), can be too small only if rev */
+        if (reverse) {
             rc = key_disc_cmp(&kdisc, &ks->ks_kdisc_min);
             if (rc < 0)
                 return KVSET_MISS_KEY_TOO_SMALL;
@@ -1280,10 +1783,26 @@ kvset_kblk_start(struct kvset *ks, const void *key, int len, bool reverse)
         }
     }
 
+    /* Skip the kblocks the model places wholly on the far side of the key,
+     * but only if the kblock that bounds the skipped ones confirms it.
+     */
+    first = 0;
+    last = ks->ks_st.kst_kblks - 1;
+    if (ks->ks_kmodel && last > 0) {
+        int lo = first, hi = last;
+
+        kblk_model_window(ks->ks_kmodel, key, abs(len), &lo, &hi);
+
+        if (lo > 0 && kblk_plausible(ks, ks->ks_kblks + lo - 1, &kdisc, key, len, 0) > 0)
+            first = lo;
+        if (hi < last && kblk_plausible(ks, ks->ks_kblks + hi + 1, &kdisc, key, len, 0) < 0)
+            last = hi;
+    }
+
     /* create */
     if (reverse) {
-        for (i = ks->ks_st.kst_kblks - 1; i >= 0; --i) {
-            rc = kblk_plausible(ks->ks_kblks + i, &kdisc, key, len, 0);
+        for (i = last; i >= 0; --i) {
+            rc = kblk_plausible(ks, ks->ks_kblks + i, &kdisc, key, len, 0);
             if (rc == 0)
                 return i;
             if (rc > 0)
@@ -1294,8 +1813,8 @@ kvset_kblk_start(struct kvset *ks, const void *key, int len, bool reverse)
         return KVSET_MISS_KEY_TOO_SMALL;
 
     } else {
-        for (i = 0; i < ks->ks_st.kst_kblks; ++i) {
-            rc = kblk_plausible(ks->ks_kblks + i, &kdisc, key, len, 0);
+        for (i = first; i < ks->ks_st.kst_kblks; ++i) {
+            rc = kblk_plausible(ks, ks->ks_kblks + i, &kdisc, key, len, 0);
             if (rc == 0)
                 return i;
             /*
@@ -1311,6 +1830,71 @@ kvset_kblk_start(struct kvset *ks, const void *key, int len, bool reverse)
     }
 }
 
+/* Probe a kblock's bloom filter for a key, treating lookup errors and
+ * kblocks without a bloom filter as a hit.
+ */
+static bool
+kblk_may_contain(struct kvset_kblk *kblk, struct kvs_ktuple *kt)
+{
+    bool   hit = true;
+    merr_t err;
+
+    if (kblk->kb_blm_pages)
+        return bloom_reader_buffer_lookup(&kblk->kb_blm_desc, kblk->kb_blm_pages, kt);
+
+    if (kblk->kb_blm_desc.bd_n_pages) {
+        err = bloom_reader_mcache_lookup(&kblk->kb_blm_desc, &kblk->kb_kblk_desc, kt, &hit);
+        if (ev(err))
+            hit = true;
+    }
+
+    return hit;
+}
+
+/* Find @kt through the kblock's hash index: each slot whose tag matches the
+ * key's hash names a leaf node that may hold the key, and an empty slot ends
+ * the probe.
+ */
+static merr_t
+kblk_hix_get_value_ref(
+    struct kvset_kblk *    kblk,
+    struct kvs_ktuple *    kt,
+    u64                    seq,
+    enum key_lookup_res *  result,
+    struct kvs_vtuple_ref *vref)
+{
+    const __le32 *slotv = kblk->kb_hix;
+    u32           tag = kt->kt_hash >> 48;
+    u32           prev = U32_MAX;
+    u32           slot, i;
+    merr_t        err;
+
+    *result = NOT_FOUND;
+
+    slot = (kt->kt_hash >> 16) % kblk->kb_hixc;
+
+    for (i = 0; i < kblk->kb_hixc; i++) {
+        u32 v = le32_to_cpu(slotv[slot]);
+
+        if (!v)
+            break;
+
+        if (KBLOCK_HIX_TAG(v) == tag && KBLOCK_HIX_NODE(v) != prev) {
+            prev = KBLOCK_HIX_NODE(v);
+
+            err = wbtr_read_vref_leaf(
+                &kblk->kb_kblk_desc, &kblk->kb_wbt_desc, prev, kt, seq, result, vref);
+            if (err || *result != NOT_FOUND)
+                return err;
+        }
+
+        if (++slot == kblk->kb_hixc)
+            slot = 0;
+    }
+
+    return 0;
+}
+
 static merr_t
 kblk_get_value_ref(
     struct kvset *         ks,
@@ -1322,20 +1906,132 @@ kblk_get_value_ref(
     struct kvs_vtuple_ref *vref)
 {
     struct kvset_kblk *kblk = ks->ks_kblks + kblk_idx;
-    bool               hit;
     merr_t             err;
 
-    if (kblk->kb_blm_pages) {
-        hit = bloom_reader_buffer_lookup(&kblk->kb_blm_desc, kblk->kb_blm_pages, kt);
-        if (!hit)
-            return 0;
-    } else if (kblk->kb_blm_desc.bd_n_pages) {
-        err = bloom_reader_mcache_lookup(&kblk->kb_blm_desc, &kblk->kb_kblk_desc, kt, &hit);
-        if (!ev(err) && !hit)
-            return 0;
+    kvset_heat_add(ks, KVSET_HEAT_PROBES, 1);
+
+    if (!kblk_may_contain(kblk, kt)) {
+        KVS_TRACE_INC(kt_bloom_neg);
+        return 0;
+    }
+
+    KVS_TRACE_INC(kt_bloom_pos);
+
+    if (kblk->kb_hix) {
+        err = kblk_hix_get_value_ref(kblk, kt, seq, result, vref);
+    } else if (ks->ks_icache) {
+        const void *inodes;
+
+        /* The vref refers only to the kmd region of the mapped kblock,
+         * not to the cached nodes, so it outlives the read lock.
+         */
+        rcu_read_lock();
+        inodes = wbt_icache_get(
+            ks->ks_icache, &kblk->kb_icache, &kblk->kb_kblk_desc, &kblk->kb_wbt_desc,
+            ks->ks_node_level);
+        err = wbtr_read_vref(
+            &kblk->kb_kblk_desc, &kblk->kb_wbt_desc, inodes, kt, lcp, seq, result, vref);
+        rcu_read_unlock();
+    } else {
+        err = wbtr_read_vref(
+            &kblk->kb_kblk_desc, &kblk->kb_wbt_desc, NULL, kt, lcp, seq, result, vref);
     }
 
-    return wbtr_read_vref(&kblk->kb_kblk_desc, &kblk->kb_wbt_desc, kt, lcp, seq, result, vref);
+    if (!err && *result == NOT_FOUND)
+        KVS_TRACE_INC(kt_bloom_fp);
+
+    return err;
+}
+
+/* Return the index of the kblock whose key range admits @kt, or -1 if there
+ * is none, and the length of the prefix @kt shares with all keys in the
+ * kvset in @lcpp.
+ */
+static int
+kvset_kblk_find(struct kvset *ks, struct kvs_ktuple *kt, const struct key_disc *kdisc, int *lcpp)
+{
+    int  first, last, lo, hi;
+    int  rc, i;
+    int  lcp;
+    bool wide;
+
+    lcp = 0;
+
+    first = 0;
+    last = ks->ks_st.kst_kblks - 1;
+
+    /* If (kvset->ks_lcp > 0) then all keys in the kvset have a common
+     * prefix of at least kvset->ks_lcp bytes.  Here we compute the
+     * longest common prefix between the kvset and the target key.
+     */
+    if (ks->ks_lcp > 0) {
+        const void *kmax = kblk_kmax(ks, ks->ks_kblks);
+
+        lcp = memlcpq(kt->kt_data, kmax, ks->ks_lcp);
+        if (lcp > 0) {
+            lcp -= 1;
+            if (lcp >= sizeof(*kdisc))
+                goto search;
+        }
+    }
+
+    /* Check the bounds of the kvset.
+     */
+    rc = key_disc_cmp(kdisc, &ks->ks_kdisc_max);
+    if (rc > 0)
+        return -1;
+
+    rc = key_disc_cmp(kdisc, &ks->ks_kdisc_min);
+    if (rc < 0)
+        return -1;
+
+search:
+    if (last && ks->ks_kblks[last].kb_wbt_desc.wbd_n_pages == 0)
+        --last; /* last kblk contains only ptombs. Don't include it */
+
+    lo = first;
+    hi = last;
+    wide = !ks->ks_kmodel;
+    if (!wide)
+        kblk_model_window(ks->ks_kmodel, kt->kt_data, kt->kt_len, &first, &last);
+
+    while (1) {
+        int wfirst = first, wlast = last;
+
+        while (first <= last) {
+            i = (first + last) / 2;
+
+            rc = kblk_plausible(ks, ks->ks_kblks + i, kdisc, kt->kt_data, kt->kt_len, lcp);
+            if (rc < 0) {
+                last = i - 1;
+                continue;
+            }
+            if (rc > 0) {
+                first = i + 1;
+                continue;
+            }
+
+            *lcpp = lcp;
+            return i;
+        }
+
+        if (wide)
+            break;
+
+        /* The key fell off an edge of the predicted window, search the
+         * kblocks beyond that edge.
+         */
+        wide = true;
+        if (first == wfirst && wfirst > lo) {
+            first = lo;
+            last = wfirst - 1;
+        } else if (last == wlast && wlast < hi) {
+            first = wlast + 1;
+            last = hi;
+        }
+    }
+
+    return -1;
 }
 
 static merr_t
@@ -1360,6 +2056,7 @@ kvset_ptomb_lookup(
         err = wbtr_read_vref(
             &ks->ks_kblks[last].kb_kblk_desc,
             &ks->ks_kblks[last].kb_pt_desc,
+            NULL,
             &pfx,
             0,
             view_seq,
@@ -1372,6 +2069,23 @@ kvset_ptomb_lookup(
     return 0;
 }
 
+u64
+kvset_ptomb_seqno(struct kvset *ks, const void *key, uint klen, u64 view_seq)
+{
+    enum key_lookup_res   res = NOT_FOUND;
+    struct kvs_vtuple_ref vref;
+    struct kvs_ktuple     kt;
+    merr_t                err;
+
+    kvs_ktuple_init(&kt, key, klen);
+
+    err = kvset_ptomb_lookup(ks, &kt, view_seq, &res, &vref);
+    if (ev(err) || res != FOUND_PTMB)
+        return 0;
+
+    return vref.vr_seq;
+}
+
 merr_t
 kvset_lookup_vref(
     struct kvset *         ks,
@@ -1381,74 +2095,27 @@ kvset_lookup_vref(
     enum key_lookup_res *  result,
     struct kvs_vtuple_ref *vref)
 {
-    int    first, last;
-    int    rc, i;
-    int    lcp;
+    int    i, lcp;
     merr_t err;
+    u64    usdt;
 
     enum key_lookup_res   pt_result;
     struct kvs_vtuple_ref pt_vref;
 
-    lcp = 0;
-
-    first = 0;
-    last = ks->ks_st.kst_kblks - 1;
+    usdt = HSE_USDT_START(kvset_lookup);
 
     pt_result = NOT_FOUND;
     err = kvset_ptomb_lookup(ks, kt, seq, &pt_result, &pt_vref);
     if (ev(err))
         return err;
 
-    /* If (kvset->ks_lcp > 0) then all keys in the kvset have a common
-     * prefix of at least kvset->ks_lcp bytes.  Here we compute the
-     * longest common prefix between the kvset and the target key.
-     */
-    if (ks->ks_lcp > 0) {
-        const void *kmax = ks->ks_kblks->kb_koff_max;
-
-        lcp = memlcpq(kt->kt_data, kmax, ks->ks_lcp);
-        if (lcp > 0) {
-            lcp -= 1;
-            if (lcp >= sizeof(*kdisc))
-                goto search;
-        }
-    }
-
-    /* Check the bounds of the kvset.
-     */
-    rc = key_disc_cmp(kdisc, &ks->ks_kdisc_max);
-    if (rc > 0)
-        goto done;
-
-    rc = key_disc_cmp(kdisc, &ks->ks_kdisc_min);
-    if (rc < 0)
-        goto done;
-
-search:
-    if (last && ks->ks_kblks[last].kb_wbt_desc.wbd_n_pages == 0)
-        --last; /* last kblk contains only ptombs. Don't include it */
-
-    while (first <= last) {
-        i = (first + last) / 2;
-
-        rc = kblk_plausible(ks->ks_kblks + i, kdisc, kt->kt_data, kt->kt_len, lcp);
-        if (rc < 0) {
-            last = i - 1;
-            continue;
-        }
-        if (rc > 0) {
-            first = i + 1;
-            continue;
-        }
-
+    i = kvset_kblk_find(ks, kt, kdisc, &lcp);
+    if (i >= 0) {
         err = kblk_get_value_ref(ks, i, kt, lcp, seq, result, vref);
         if (ev(err))
             return err;
-
-        break;
     }
 
-done:
     if (pt_result == FOUND_PTMB) {
         if (*result == NOT_FOUND || pt_vref.vr_seq > vref->vr_seq) {
             *result = pt_result;
@@ -1456,9 +2123,61 @@ done:
         }
     }
 
+    if (ks->ks_tree)
+        cn_tree_ttl_hide(ks->ks_tree, result, vref->vr_seq);
+
+    if (*result != NOT_FOUND)
+        kvset_heat_add(ks, KVSET_HEAT_HITS, 1);
+
+    if (usdt)
+        HSE_USDT(kvset_lookup, ks->ks_dgen, kt->kt_len, seq, *result, get_time_ns() - usdt);
+
     return 0;
 }
 
+int
+kvset_lookup_prefetch(struct kvset *ks, struct kvs_ktuple *kt, const struct key_disc *kdisc)
+{
+    struct kvset_kblk *kblk;
+    int                i, lcp;
+
+    i = kvset_kblk_find(ks, kt, kdisc, &lcp);
+    if (i < 0)
+        return i;
+
+    kblk = ks->ks_kblks + i;
+    if (kblk->kb_blm_pages)
+        bloom_reader_buffer_prefetch(&kblk->kb_blm_desc, kblk->kb_blm_pages, kt);
+
+    return i;
+}
+
+bool
+kvset_lookup_may_exist(struct kvset *ks, struct kvs_ktuple *kt, int kbidx)
+{
+    struct kvset_kblk *kblk;
+    struct wbt_desc *  wbd;
+
+    /* A prefix tombstone may hide the key, which only a lookup reports.
+     */
+    if (kvset_pt_start(ks) >= 0)
+        return true;
+
+    if (kbidx < 0)
+        return false;
+
+    kblk = ks->ks_kblks + kbidx;
+    if (!kblk_may_contain(kblk, kt))
+        return false;
+
+    /* Start pulling in the root of the wbtree the lookup descends.
+     */
+    wbd = &kblk->kb_wbt_desc;
+    __builtin_prefetch(kblk->kb_kblk_desc.map_base + PAGE_SIZE * wbt_inode_pg(wbd, wbd->wbd_root));
+
+    return true;
+}
+
 static merr_t
 kvset_get_immediate_value(struct kvs_vtuple_ref *vref, struct kvs_buf *vbuf)
 {
@@ -1488,12 +2207,13 @@ kvset_lookup_val_direct(
     u32                 vbufsz,
     u32                 copylen)
 {
-    struct iovec iov;
-    bool         aligned_vbuf;
-    bool         aligned_all;
-    size_t       off;
-    u64          mbh;
-    merr_t       err;
+    struct scratch_mark mark;
+    struct iovec        iov;
+    bool                aligned_vbuf;
+    bool                aligned_all;
+    size_t              off;
+    u64                 mbh;
+    merr_t              err;
 
     mbh = lvx2mbh(ks, vbidx);
 
@@ -1507,31 +2227,96 @@ kvset_lookup_val_direct(
     aligned_all = aligned_vbuf && IS_ALIGNED(copylen, PAGE_SIZE) &&
                   IS_ALIGNED(vbd->vbd_off + vboff, PAGE_SIZE);
 
-    /* Eliminate both the malloc and buffer copy by reading directly
-     * into vbuf if everything is sufficiently aligned (i.e.,
-     * aligned_all is true).  If not, try to eliminate the malloc
-     * and improve the buffer copy if at least vbuf is aligned and
-     * large enough to contain the entire read.
+    /* Eliminate both the bounce buffer and buffer copy by reading
+     * directly into vbuf if everything is sufficiently aligned (i.e.,
+     * aligned_all is true).  If not, try to eliminate the bounce buffer
+     * and improve the buffer copy if at least vbuf is aligned and large
+     * enough to contain the entire read.  Otherwise, the bounce buffer
+     * comes from the thread's scratch arena.
      */
+    scratch_save(&mark);
+
     if (!aligned_all && !(aligned_vbuf && vbufsz >= iov.iov_len)) {
-        iov.iov_base = alloc_page_aligned(iov.iov_len, GFP_KERNEL);
+        iov.iov_base = scratch_alloc(iov.iov_len, PAGE_SIZE);
         if (!iov.iov_base)
             return merr(ev(ENOMEM));
     }
 
-    err = mpool_mblock_read(ks->ks_ds, mbh, &iov, 1, off);
+    err = io_sched_mblock_read(
+        kvset_io_sched(ks), vbd->vbd_mclass, IOS_FG_READ, ks->ks_ds, mbh, &iov, off);
+    if (!err)
+        err = blk_crc_check(&vbd->vbd_mblkdesc, iov.iov_base, off, iov.iov_len);
+
+    if (!aligned_all && !err)
+        memmove(vbuf, iov.iov_base + (vboff & ~PAGE_MASK), copylen);
+
+    scratch_restore(&mark);
+
+    return ev(err);
+}
+
+/* Decompress a value straight from the vblock map into the caller's buffer,
+ * truncating it if the buffer is too small, so that gets of compressed values
+ * need no intermediate buffer.
+ */
+static merr_t
+kvset_lookup_cval(struct kvset *ks, struct kvs_vtuple_ref *vref, void *buf, uint bufsz)
+{
+    struct vblock_desc *vbd;
+    const void *        src;
+    uint                outlen, copylen;
+    merr_t              err;
+
+    copylen = min_t(uint, vref->vb.vr_len, bufsz);
+    if (!copylen)
+        return 0;
+
+    vbd = lvx2vbd(ks, vref->vb.vr_index);
+    assert(vbd);
+
+    err = blk_crc_verify(
+        &vbd->vbd_mblkdesc, vbd->vbd_off + vref->vb.vr_off, vref->vb.vr_complen);
+    if (ev(err))
+        return err;
+
+    src = vbr_value(vbd, vref->vb.vr_off, vref->vb.vr_complen);
+
+    err = decompress_lz4(src, vref->vb.vr_complen, buf, copylen, &outlen);
+    if (ev(err))
+        return err;
 
-    if (!aligned_all) {
-        void *src = iov.iov_base + (vboff & ~PAGE_MASK);
+    if (ev(outlen != copylen))
+        return merr(EILSEQ);
 
-        if (!err)
-            memmove(vbuf, src, copylen);
+    return 0;
+}
 
-        if (iov.iov_base != vbuf)
-            free_aligned(iov.iov_base);
+/* Length of the value a vref refers to.
+ */
+static inline u32
+kvset_vref_len(const struct kvs_vtuple_ref *vref)
+{
+    switch (vref->vr_type) {
+        case vtype_val:
+        case vtype_cval:
+            return vref->vb.vr_len;
+        case vtype_ival:
+            return vref->vi.vr_len;
+        default:
+            return 0;
     }
+}
 
-    return ev(err);
+/* Scale a vblock readahead length by the kvdb's readahead percentage,
+ * which is lowered under memory pressure (see ikvdb_memgov_update()).
+ */
+static inline u32
+kvset_vra_scale(const struct kvset *ks, u32 len)
+{
+    if (!ks->ks_cn_kvdb)
+        return len;
+
+    return len / 100 * atomic_read(&ks->ks_cn_kvdb->cnd_ra_pct);
 }
 
 merr_t
@@ -1543,16 +2328,28 @@ kvset_lookup_val(struct kvset *ks, struct kvs_vtuple_ref *vref, struct kvs_buf *
     merr_t              err;
 
     assert(
-        vref->vr_type == vtype_ival || vref->vr_type == vtype_zval || vref->vr_type == vtype_val);
+        vref->vr_type == vtype_ival || vref->vr_type == vtype_zval || vref->vr_type == vtype_val ||
+        vref->vr_type == vtype_cval);
 
     if (unlikely(vref->vr_type == vtype_zval)) {
         vbuf->b_len = 0;
         return 0;
     }
 
+    kvset_heat_add(ks, KVSET_HEAT_BYTES, kvset_vref_len(vref));
+
     if (vref->vr_type == vtype_ival)
         return kvset_get_immediate_value(vref, vbuf);
 
+    err = kvset_vmaterialize(ks);
+    if (ev(err))
+        return err;
+
+    if (vref->vr_type == vtype_cval) {
+        vbuf->b_len = vref->vb.vr_len;
+        return kvset_lookup_cval(ks, vref, vbuf->b_buf, vbuf->b_buf_sz);
+    }
+
     vbd = lvx2vbd(ks, vref->vb.vr_index);
     assert(vbd);
 
@@ -1561,6 +2358,22 @@ kvset_lookup_val(struct kvset *ks, struct kvs_vtuple_ref *vref, struct kvs_buf *
     if (copylen > vbuf->b_buf_sz)
         copylen = vbuf->b_buf_sz;
 
+    /* Don't touch the vblock if the caller only wants the length.
+     */
+    if (!copylen)
+        return 0;
+
+    /* Values of capacity vblocks may be cached on staging media. */
+    if (ks->ks_cn_kvdb && ks->ks_cn_kvdb->cnd_scache &&
+        cn_scache_read(
+            ks->ks_cn_kvdb->cnd_scache,
+            lvx2mbs(ks, vref->vb.vr_index),
+            lvx2mbs_bnum(ks, vref->vb.vr_index),
+            vref->vb.vr_off,
+            copylen,
+            vbuf->b_buf))
+        return 0;
+
     /* Try to issue a direct mblock read for large values.
      *
      * [HSE_REVISIT] Need to consider additional factors into
@@ -1577,6 +2390,10 @@ kvset_lookup_val(struct kvset *ks, struct kvs_vtuple_ref *vref, struct kvs_buf *
         /* Proceed with macache access otherwise */
     }
 
+    err = blk_crc_verify(&vbd->vbd_mblkdesc, vbd->vbd_off + vref->vb.vr_off, copylen);
+    if (ev(err))
+        return err;
+
     memcpy(vbuf->b_buf, vbr_value(vbd, vref->vb.vr_off, vref->vb.vr_len), copylen);
 
     return 0;
@@ -1585,13 +2402,25 @@ kvset_lookup_val(struct kvset *ks, struct kvs_vtuple_ref *vref, struct kvs_buf *
 merr_t
 kvset_wbti_alloc(void **wbti)
 {
-    return wbti_alloc((struct wbti **)wbti);
+    struct wbti *self;
+
+    self = scratch_alloc(sizeof(*self), __alignof(*self));
+    if (ev(!self))
+        return merr(ENOMEM);
+
+    self->lbuf = NULL;
+    *wbti = self;
+
+    return 0;
 }
 
 void
 kvset_wbti_free(void *wbti)
 {
-    wbti_destroy(wbti);
+    struct wbti *self = wbti;
+
+    if (self)
+        free_aligned(self->lbuf);
 }
 
 merr_t
@@ -1610,6 +2439,7 @@ kvset_pfx_lookup(
     struct kvset_kblk *   kblk;
     merr_t                err;
     u64                   pt_seq = 0;
+    u64                   ttl_seq = 0;
     int                   kbidx, last;
     const void *          kmd;
 
@@ -1628,6 +2458,9 @@ kvset_pfx_lookup(
     if (*res == FOUND_PTMB)
         pt_seq = vref.vr_seq;
 
+    if (ks->ks_tree)
+        ttl_seq = cn_tree_ttl_seq(ks->ks_tree);
+
     /* Find the relevant wbt and starting kbidx */
     kbidx = kvset_kblk_start(ks, kt->kt_data, -kt->kt_len, 0);
     if (kbidx < 0)
@@ -1684,26 +2517,18 @@ get_more:
     {
         size_t off = 0;
         u64    vseq;
-        uint   nvals;
 
         *res = NOT_FOUND;
-        nvals = kmd_count(kmd, &off);
-        while (nvals--) {
-            wbt_read_kmd_vref(kmd, &off, &vseq, &vref);
-            if (seq >= vseq) {
-                assert(vref.vr_type != vtype_ptomb);
-                vref.vr_seq = vseq;
-                if (vref.vr_type == vtype_tomb)
-                    *res = FOUND_TMB;
-                else
-                    *res = FOUND_VAL;
-                break;
-            }
-        }
-
-        if (*res == NOT_FOUND)
+        if (!wbt_read_kmd_seek(kmd, &off, seq, &vseq, &vref))
             goto get_more;
 
+        assert(vref.vr_type != vtype_ptomb);
+        vref.vr_seq = vseq;
+        if (vref.vr_type == vtype_tomb || vseq <= ttl_seq)
+            *res = FOUND_TMB;
+        else
+            *res = FOUND_VAL;
+
         if (pt_seq && vseq < pt_seq)
             goto get_more; /* key is hidden behind ptomb; skip */
     }
@@ -1795,6 +2620,121 @@ kvset_lookup(
     return kvset_lookup_val(ks, &vref, vbuf);
 }
 
+merr_t
+kvset_lookup_lease(
+    struct kvset *         ks,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res,
+    struct kvs_vlease *    lease)
+{
+    struct kvs_vtuple_ref vref;
+    struct vblock_desc *  vbd;
+    merr_t                err;
+
+    err = kvset_lookup_vref(ks, kt, kdisc, seq, res, &vref);
+    if (ev(err))
+        return err;
+
+    if (*res != FOUND_VAL)
+        return 0;
+
+    kvset_heat_add(ks, KVSET_HEAT_BYTES, kvset_vref_len(&vref));
+
+    if (vref.vr_type != vtype_ival) {
+        err = kvset_vmaterialize(ks);
+        if (ev(err))
+            return err;
+    }
+
+    switch (vref.vr_type) {
+        case vtype_val:
+            vbd = lvx2vbd(ks, vref.vb.vr_index);
+            assert(vbd);
+
+            err = blk_crc_verify(
+                &vbd->vbd_mblkdesc, vbd->vbd_off + vref.vb.vr_off, vref.vb.vr_len);
+            if (ev(err))
+                return err;
+
+            lease->vl_data = vbr_value(vbd, vref.vb.vr_off, vref.vb.vr_len);
+            lease->vl_len = vref.vb.vr_len;
+            break;
+
+        case vtype_ival:
+            lease->vl_data = vref.vi.vr_data;
+            lease->vl_len = vref.vi.vr_len;
+            break;
+
+        case vtype_cval:
+            /* There is nothing to reference, so lease a private copy.
+             */
+            lease->vl_buf = malloc(vref.vb.vr_len);
+            if (ev(!lease->vl_buf))
+                return merr(ENOMEM);
+
+            err = kvset_lookup_cval(ks, &vref, lease->vl_buf, vref.vb.vr_len);
+            if (ev(err)) {
+                free(lease->vl_buf);
+                lease->vl_buf = NULL;
+                return err;
+            }
+
+            lease->vl_data = lease->vl_buf;
+            lease->vl_len = vref.vb.vr_len;
+            return 0;
+
+        default:
+            assert(vref.vr_type == vtype_zval);
+            lease->vl_data = NULL;
+            lease->vl_len = 0;
+            break;
+    }
+
+    kvset_get_ref(ks);
+    lease->vl_pin = ks;
+
+    return 0;
+}
+
+merr_t
+kvset_lookup_willneed(
+    struct kvset *         ks,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res)
+{
+    struct kvs_vtuple_ref vref;
+    struct vblock_desc *  vbd;
+    merr_t                err;
+
+    err = kvset_lookup_vref(ks, kt, kdisc, seq, res, &vref);
+    if (ev(err))
+        return err;
+
+    if (*res != FOUND_VAL)
+        return 0;
+
+    if (vref.vr_type != vtype_val && vref.vr_type != vtype_cval)
+        return 0;
+
+    err = kvset_vmaterialize(ks);
+    if (ev(err))
+        return err;
+
+    vbd = lvx2vbd(ks, vref.vb.vr_index);
+    assert(vbd);
+
+    if (vref.vr_type == vtype_cval)
+        vbr_prefetch(vbd, vref.vb.vr_off, vref.vb.vr_complen);
+    else
+        vbr_prefetch(vbd, vref.vb.vr_off, vref.vb.vr_len);
+
+    return 0;
+}
+
 u64
 kvset_get_dgen(struct kvset *ks)
 {
@@ -1807,15 +2747,30 @@ kvset_get_seqno_max(struct kvset *ks)
     return ks->ks_seqno_max;
 }
 
+u64
+kvset_get_seqno_min(struct kvset *ks)
+{
+    return ks->ks_seqno_min;
+}
+
 uint
 kvset_get_compc(struct kvset *ks)
 {
     return ks->ks_compc;
 }
 
+enum mp_media_classp
+kvset_get_mclass(struct kvset *ks)
+{
+    return ks->ks_mclass;
+}
+
 uint
 kvset_get_vgroups(struct kvset *ks)
 {
+    if (ev(kvset_vmaterialize(ks)))
+        return 0;
+
     return ks->ks_vgroups;
 }
 
@@ -1870,6 +2825,8 @@ kvset_stats_add(const struct kvset_stats *add, struct kvset_stats *result)
 {
     result->kst_kvsets += add->kst_kvsets;
     result->kst_keys += add->kst_keys;
+    result->kst_tombs += add->kst_tombs;
+    result->kst_ptombs += add->kst_ptombs;
     result->kst_kblks += add->kst_kblks;
     result->kst_vblks += add->kst_vblks;
 
@@ -1887,6 +2844,18 @@ kvset_get_vulen(struct kvset *ks)
     return ks->ks_st.kst_vulen;
 }
 
+uint
+kvset_get_vgarb_pct(struct kvset *ks)
+{
+    u64 vwlen = ks->ks_st.kst_vwlen;
+    u64 vulen = ks->ks_st.kst_vulen;
+
+    if (!vwlen || vulen >= vwlen)
+        return 0;
+
+    return (vwlen - vulen) * 100 / vwlen;
+}
+
 uint
 kvset_get_scatter_score(struct kvset *ks)
 {
@@ -1923,6 +2892,12 @@ kvset_set_workid(struct kvset *ks, u64 id)
     ks->ks_workid = id;
 }
 
+u64
+kvset_get_tag(struct kvset *ks)
+{
+    return ks->ks_tag;
+}
+
 u64
 kvset_get_nth_kblock_id(struct kvset *ks, u32 index)
 {
@@ -1935,6 +2910,32 @@ kvset_get_nth_kblock_handle(struct kvset *ks, u32 index)
     return (index < ks->ks_st.kst_kblks ? ks->ks_kblks[index].kb_kblk.bk_handle : 0);
 }
 
+void
+kvset_get_nth_kblock_minkey(struct kvset *ks, u32 index, const void **key, uint *klen)
+{
+    assert(index < ks->ks_st.kst_kblks);
+
+    *key = kblk_kmin(ks, ks->ks_kblks + index);
+    *klen = ks->ks_kblks[index].kb_klen_min;
+}
+
+void
+kvset_get_nth_kblock_maxkey(struct kvset *ks, u32 index, const void **key, uint *klen)
+{
+    assert(index < ks->ks_st.kst_kblks);
+
+    *key = kblk_kmax(ks, ks->ks_kblks + index);
+    *klen = ks->ks_kblks[index].kb_klen_max;
+}
+
+const struct kblk_metrics *
+kvset_get_nth_kblock_metrics(struct kvset *ks, u32 index)
+{
+    assert(index < ks->ks_st.kst_kblks);
+
+    return &ks->ks_kblks[index].kb_metrics;
+}
+
 u32
 kvset_get_num_vblocks(struct kvset *ks)
 {
@@ -1956,7 +2957,12 @@ kvset_get_nth_vblock_handle(struct kvset *ks, u32 index)
 u64
 kvset_get_nth_vblock_len(struct kvset *ks, u32 index)
 {
-    struct vblock_desc *vbd = lvx2vbd(ks, index);
+    struct vblock_desc *vbd;
+
+    if (ev(kvset_vmaterialize(ks)))
+        return 0;
+
+    vbd = lvx2vbd(ks, index);
 
     return vbd ? vbd->vbd_len : 0;
 }
@@ -1968,6 +2974,19 @@ kvset_get_vbsetv(struct kvset *ks, uint *vbsetc)
     return ks->ks_vbsetv;
 }
 
+void
+kvset_key_fences(struct kvset *ks, u64 *lo, u64 *hi)
+{
+    if (kvset_pt_start(ks) >= 0) {
+        *lo = 0;
+        *hi = U64_MAX;
+        return;
+    }
+
+    *lo = ks->ks_kdisc_min.kdisc[0];
+    *hi = ks->ks_kdisc_max.kdisc[0];
+}
+
 /**
  * kvset_get_max_key() - Get the largest key in a kvset
  * @ks:   struct kvset handle.
@@ -1996,18 +3015,73 @@ kvset_get_max_key(struct kvset *ks, void **key, uint *klen)
 
     kb = &ks->ks_kblks[last];
 
-    *key = (void *)kb->kb_koff_max;
+    *key = (void *)kblk_kmax(ks, kb);
     *klen = kb->kb_klen_max;
 }
 
+/* The heat of a kvset is a count of its accesses that decays by half every
+ * KVSET_HEAT_HALFLIFE.  Readers only bump the cumulative counts, the heat
+ * is brought up to date when read: the heat is decayed for the time since
+ * the last update (in steps of 1/16th of a half-life), and the accesses
+ * since the last update are added to it.
+ */
+static void
+kvset_heat_read(struct kvset *ks, u64 *heatv)
+{
+    static const u32 pow2v[] = { /* 2^(-i/16) * 2^16 */
+        65536, 62757, 60097, 57549, 55109, 52773, 50535, 48393,
+        46341, 44376, 42495, 40693, 38968, 37316, 35734, 34219,
+    };
+
+    struct kvset_heat *kh = &ks->ks_heat;
+    u64                dt, halves, frac, heat, cur;
+    int                i;
+
+    spin_lock(&kh->kh_lock);
+    dt = get_time_ns() - kh->kh_time;
+    halves = dt / KVSET_HEAT_HALFLIFE;
+    frac = (dt % KVSET_HEAT_HALFLIFE) * NELEM(pow2v) / KVSET_HEAT_HALFLIFE;
+
+    kh->kh_time += halves * KVSET_HEAT_HALFLIFE + frac * KVSET_HEAT_HALFLIFE / NELEM(pow2v);
+
+    for (i = 0; i < KVSET_HEAT_MAX; ++i) {
+        heat = halves < 64 ? kh->kh_heatv[i] >> halves : 0;
+        heat = (heat >> 16) * pow2v[frac] + (((heat & 0xffff) * pow2v[frac]) >> 16);
+
+        cur = atomic64_read(&kh->kh_ctrv[i]);
+        kh->kh_heatv[i] = heat + (cur - kh->kh_prevv[i]);
+        kh->kh_prevv[i] = cur;
+
+        heatv[i] = kh->kh_heatv[i];
+    }
+    spin_unlock(&kh->kh_lock);
+}
+
+u64
+kvset_get_heat(struct kvset *ks)
+{
+    u64 heatv[KVSET_HEAT_MAX];
+
+    kvset_heat_read(ks, heatv);
+
+    return heatv[KVSET_HEAT_PROBES] + heatv[KVSET_HEAT_SEEKS];
+}
+
 void
 kvset_get_metrics(struct kvset *ks, struct kvset_metrics *m)
 {
     struct kvset_kblk *p;
+    u64                heatv[KVSET_HEAT_MAX];
     u32                i;
 
     memset(m, 0, sizeof(*m));
 
+    kvset_heat_read(ks, heatv);
+    m->heat_probes = heatv[KVSET_HEAT_PROBES];
+    m->heat_hits = heatv[KVSET_HEAT_HITS];
+    m->heat_seeks = heatv[KVSET_HEAT_SEEKS];
+    m->heat_bytes = heatv[KVSET_HEAT_BYTES];
+
     m->num_kblocks = ks->ks_st.kst_kblks;
     m->num_vblocks = ks->ks_st.kst_vblks;
     m->compc = ks->ks_compc;
@@ -2042,7 +3116,9 @@ kvset_list_add_tail(struct kvset *ks, struct list_head *head)
 
 struct kv_iterator_ops kvset_iter_ops;
 
-/* async_mbio: for asynchronous mblock i/o */
+/* async_mbio: for asynchronous mblock i/o, possibly split into several
+ * concurrent reads, where status is that of the first read to fail.
+ */
 struct async_mbio {
     struct cv    cv;
     struct mutex mutex;
@@ -2050,6 +3126,20 @@ struct async_mbio {
     int          status;
 };
 
+/* A vblock read-ahead is split into at most VR_QD_MAX reads of at least
+ * VR_IO_MIN bytes each, which are issued concurrently on the io workqueue
+ * to keep more requests in flight on the device.
+ */
+#define VR_QD_MAX (8)
+#define VR_IO_MIN (64 * 1024)
+
+struct vr_io {
+    struct work_struct  vio_work;
+    struct vblk_reader *vio_vr;
+    uint                vio_off; /* offset into the read-ahead */
+    uint                vio_len;
+};
+
 struct kr_buf {
     void *node_buf;
     void *kmd_buf;
@@ -2070,6 +3160,12 @@ struct kblk_reader {
     u8            kr_bufx;
     bool          asyncio;
 
+    /* compressed leaf node buffers */
+    void *kr_loffv;
+    void *kr_lcbuf;
+    uint  kr_loffv_sz;
+    uint  kr_lcbuf_sz;
+
     /* reader state */
     bool kr_requested;
     bool kr_eof;
@@ -2084,6 +3180,14 @@ struct kblk_reader {
         uint  kr_ops;
     } iores;
 
+    /* I/O scheduler, and the class and media class of our reads */
+    struct io_sched *   kr_ios;
+    enum io_sched_class kr_ioscls;
+    uint                kr_mclass;
+
+    /* descriptor of the kblock being read, for its page checksums */
+    struct kvs_mblk_desc *kr_kbd;
+
     u64 kr_mbh;
     u16 kr_kblk_cnt;
     u16 kr_nodex;
@@ -2092,6 +3196,7 @@ struct kblk_reader {
     u16 kr_kmd_start_pg;
     u16 kr_kmd_pgc;
     u16 kr_next_kblk_idx;
+    bool kr_lcomp;
 };
 
 struct vr_buf {
@@ -2105,10 +3210,9 @@ struct vr_buf {
  * must maintain its own vbidx to handle vblock transitions within a vgroup.
  */
 struct vblk_reader {
-    struct work_struct work;
-    struct async_mbio  mbio;
-    struct mpool *     ds;
-    struct perfc_set * pc;
+    struct async_mbio mbio;
+    struct mpool *    ds;
+    struct perfc_set *pc;
     /* index, offset, and length of async mblock read */
     uint vr_io_vbidx;
     uint vr_io_offset;
@@ -2117,6 +3221,13 @@ struct vblk_reader {
     u64  vr_mbh;
     uint vr_mblk_dstart;
     uint vr_mblk_dlen;
+    uint vr_mclass;
+
+    struct kvs_mblk_desc *vr_mblkdesc;
+
+    /* I/O scheduler, and the class of our reads */
+    struct io_sched *   vr_ios;
+    enum io_sched_class vr_ioscls;
     /* buffer */
     struct vr_buf vr_buf[2];
     uint          vr_buf_sz;
@@ -2125,12 +3236,16 @@ struct vblk_reader {
     bool          vr_read_ahead;
     bool          asyncio;
     atomic_t      vr_async_mcache;
+    /* concurrent reads of a read-ahead */
+    uint         vr_qd;
+    struct vr_io vr_iov[VR_QD_MAX];
 };
 
 enum last_src {
     SRC_NONE = 0,
     SRC_PT,
     SRC_WBT,
+    SRC_SEEK, /* both sources positioned by a seek, none consumed */
 };
 
 struct iter_meta {
@@ -2142,8 +3257,8 @@ struct iter_meta {
 
 struct wb_pos {
     void *              wb_node;    /* current node */
-    void *              wb_pfx;     /* node's lcp */
-    u16                 wb_pfx_len; /* length of node's lcp */
+    void *              wb_pfx;     /* node's lcp (v7: current key's prefix) */
+    u16                 wb_pfx_len; /* length of wb_pfx */
     struct wbt_lfe_omf *wb_lfe;     /* current key */
     u16                 wb_nodec;   /* #nodes left in current buffer */
     u16                 wb_keyc;    /* #keys left in current node */
@@ -2152,6 +3267,43 @@ struct wb_pos {
     uint  wb_node_kmd_off_adj;
 };
 
+/* Cursor readahead adapts to the observed scan length: a cursor is presumed
+ * sequential once it has read KVSET_ITER_RA_SEQ_KEYS keys since it was
+ * created or last repositioned (or from the start if cn_cursor_seq is set).
+ * From then on the vblock window doubles each time the cursor consumes twice
+ * the window's worth of values, and the kblock leaf node window doubles at
+ * each kblock boundary.  A seek resets both windows.
+ */
+#define KVSET_ITER_RA_SEQ_KEYS (256)
+#define KVSET_ITER_VRA_MAX (1024 * 1024)
+#define KVSET_ITER_KRA_MIN (8)   /* pages */
+#define KVSET_ITER_KRA_MAX (256) /* pages */
+
+/* A noreuse iterator (see kvset_iter_flag_noreuse) releases the mcache
+ * pages of the kblocks and vblocks it has consumed, so that a long scan
+ * does not push the working set of point gets out of the page cache.
+ * The residency of a region is sampled with mincore() before the iterator
+ * first touches it (or reads ahead into it), and once the iterator moves
+ * on only the pages that were not already resident are released.
+ *
+ * A kblock is tracked as a whole, from wbtree entry to exit.  A vblock is
+ * tracked through a sliding window of KVSET_ITER_NR_WIN pages on either
+ * side of the current value, which is never smaller than the vblock
+ * readahead window so that readahead never runs ahead of the sample.
+ */
+#define KVSET_ITER_NR_WIN (KVSET_ITER_VRA_MAX / PAGE_SIZE)
+
+struct kvset_iter_nr {
+    struct kvs_mblk_desc *md;   /* mblock of the tracked region, or NULL */
+    u32                   pg;   /* first mblock page of the region */
+    u32                   pgc;  /* number of pages in the region */
+    u32                   win;  /* window of the region (vblocks only) */
+    u32                   vecsz;
+    u8 *                  vec;  /* residency of the region's pages */
+    u8 *                  tmp;
+    u8 *                  buf;  /* backs both vec and tmp */
+};
+
 struct kvset_iterator {
     struct kv_iterator       handle;
     struct kvset *           ks;
@@ -2159,15 +3311,28 @@ struct kvset_iterator {
     struct wbti *            pti;
     struct perfc_set *       pc;
     struct cn_merge_stats *  stats;
+    struct cheap *           arena; /* compaction arena, may be NULL */
     uint                     curr_kblk;
     enum last_src            last;
     u32                      vra_flags;
     u32                      vra_len;
+    u32                      vra_base;
+    u32                      kra_pgs;
+    u64                      ra_keys;
+    u64                      ra_bytes;
+    bool                     ra_limit;
+    const void *             limit;
+    uint                     limit_len;
     struct workqueue_struct *vra_wq;
     bool                     reverse;
+    bool                     keys_only;
     bool                     asyncio;
+    bool                     noreuse;
+    enum io_sched_class      ioscls;
     struct iter_meta         wbti_meta;
     struct iter_meta         pti_meta;
+    struct kvset_iter_nr     nr_kblk;
+    struct kvset_iter_nr     nr_vblk;
 
     struct ra_hist ra_histv[64];
     u8 *           ra_bitmap; /* For unordered vblocks. */
@@ -2193,6 +3358,76 @@ struct kvset_iterator {
 
 #define handle_to_kvset_iter(_handle) container_of(_handle, struct kvset_iterator, handle)
 
+/* Compaction iterators and their reader state are carved from the
+ * compaction's arena (which is destroyed in one shot when the compaction
+ * completes), falling back to the heap if the arena is full.
+ */
+static void *
+kvset_iter_zalloc(struct cheap *arena, size_t sz)
+{
+    void *mem;
+
+    if (!arena)
+        return calloc(1, sz);
+
+    mem = cheap_memalign(arena, SMP_CACHE_BYTES, sz);
+    if (!mem)
+        return calloc(1, sz);
+
+    memset(mem, 0, sz);
+
+    return mem;
+}
+
+static bool
+kvset_iter_arena_owns(const struct cheap *arena, const void *mem)
+{
+    return arena && mem >= arena->mem && mem < arena->mem + arena->maplen;
+}
+
+static void
+kvset_iter_zfree(struct cheap *arena, void *mem)
+{
+    if (!kvset_iter_arena_owns(arena, mem))
+        free(mem);
+}
+
+/**
+ * kvset_iter_limit() - check a kblock against the iterator's upper bound
+ * @iter: kvset iterator
+ * @kblk: kblock the iterator is about to read
+ *
+ * Stops readahead if the bound falls within @kblk.
+ *
+ * Return: true if every key in @kblk lies beyond the bound
+ */
+static bool
+kvset_iter_limit(struct kvset_iterator *iter, struct kvset_kblk *kblk)
+{
+    if (!iter->limit)
+        return false;
+
+    if (keycmp(kblk_kmin(iter->ks, kblk), kblk->kb_klen_min, iter->limit, iter->limit_len) > 0)
+        return true;
+
+    if (keycmp(kblk_kmax(iter->ks, kblk), kblk->kb_klen_max, iter->limit, iter->limit_len) > 0)
+        iter->ra_limit = true;
+
+    return false;
+}
+
+void
+kvset_iter_set_limit(struct kv_iterator *handle, const void *key, uint len)
+{
+    struct kvset_iterator *iter = handle_to_kvset_iter(handle);
+
+    if (iter->reverse)
+        return;
+
+    iter->limit = key;
+    iter->limit_len = len;
+}
+
 static void
 mbio_init(struct async_mbio *io)
 {
@@ -2203,11 +3438,12 @@ mbio_init(struct async_mbio *io)
 }
 
 static void
-mbio_arm(struct async_mbio *io)
+mbio_arm(struct async_mbio *io, int count)
 {
     mutex_lock(&io->mutex);
     assert(!io->pending);
-    io->pending = 1;
+    io->pending = count;
+    io->status = 0;
     mutex_unlock(&io->mutex);
 }
 
@@ -2215,10 +3451,11 @@ static void
 mbio_signal(struct async_mbio *io, merr_t err)
 {
     mutex_lock(&io->mutex);
-    assert(io->pending);
-    io->status = err;
-    io->pending = 0;
-    cv_signal(&io->cv);
+    assert(io->pending > 0);
+    if (!io->status)
+        io->status = err;
+    if (--io->pending == 0)
+        cv_signal(&io->cv);
     mutex_unlock(&io->mutex);
 }
 
@@ -2240,6 +3477,106 @@ mbio_wait(struct async_mbio *io, struct cn_merge_stats_ops *stats)
     return err;
 }
 
+/* Read the next @nodec leaf nodes of the current kblock into @buf, which
+ * requires reading the compressed nodes into the staging buffer and then
+ * decompressing them if the kblock's leaf nodes are compressed.
+ */
+static merr_t
+kvset_iter_kblock_read_nodes(
+    struct kblk_reader *kr,
+    struct kr_buf *     buf,
+    uint                nodec,
+    size_t *            rlen,
+    uint *              ops)
+{
+    struct iovec iov;
+    size_t       a, b, kblk_off;
+    merr_t       err;
+    uint         i, off;
+
+    iov.iov_base = buf->node_buf;
+    iov.iov_len = nodec * PAGE_SIZE;
+    kblk_off = (kr->kr_node_start_pg + kr->kr_nodex) * PAGE_SIZE;
+
+    if (kr->kr_lcomp) {
+        if (kr->kr_nodex == 0) {
+            /* starting a new kblock, read its leaf offset table */
+            iov.iov_len = PAGE_ALIGN(WBT_LEAF_OFFV_LEN(kr->kr_nodec));
+            if (iov.iov_len > kr->kr_loffv_sz) {
+                free_aligned(kr->kr_loffv);
+                kr->kr_loffv_sz = 0;
+
+                kr->kr_loffv = alloc_page_aligned(iov.iov_len, GFP_KERNEL);
+                if (ev(!kr->kr_loffv))
+                    return merr(ENOMEM);
+
+                kr->kr_loffv_sz = iov.iov_len;
+            }
+
+            iov.iov_base = kr->kr_loffv;
+            kblk_off = kr->kr_node_start_pg * PAGE_SIZE;
+
+            err = io_sched_mblock_read(
+        kr->kr_ios, kr->kr_mclass, kr->kr_ioscls, kr->ds, kr->kr_mbh, &iov, kblk_off);
+            if (!err)
+                err = blk_crc_check(kr->kr_kbd, iov.iov_base, kblk_off, iov.iov_len);
+            if (ev(err))
+                return err;
+
+            *rlen += iov.iov_len;
+            ++*ops;
+        }
+
+        /* Each compressed node is no larger than a page, so the page
+         * aligned range that holds them spans at most two extra pages.
+         */
+        if (!kr->kr_lcbuf) {
+            kr->kr_lcbuf_sz = buf->node_buf_sz + 2 * PAGE_SIZE;
+            kr->kr_lcbuf = alloc_page_aligned(kr->kr_lcbuf_sz, GFP_KERNEL);
+            if (ev(!kr->kr_lcbuf))
+                return merr(ENOMEM);
+        }
+
+        a = wbt8_leaf_off(kr->kr_loffv, kr->kr_nodex) & PAGE_MASK;
+        b = PAGE_ALIGN(wbt8_leaf_off(kr->kr_loffv, kr->kr_nodex + nodec));
+        if (ev(b <= a || b - a > kr->kr_lcbuf_sz))
+            return merr(EILSEQ);
+
+        iov.iov_base = kr->kr_lcbuf;
+        iov.iov_len = b - a;
+        kblk_off = kr->kr_node_start_pg * PAGE_SIZE + a;
+    }
+
+    err = io_sched_mblock_read(
+        kr->kr_ios, kr->kr_mclass, kr->kr_ioscls, kr->ds, kr->kr_mbh, &iov, kblk_off);
+    if (!err)
+        err = blk_crc_check(kr->kr_kbd, iov.iov_base, kblk_off, iov.iov_len);
+    if (ev(err))
+        return err;
+
+    perfc_inc(kr->pc, PERFC_RA_CNCOMP_RREQS);
+    perfc_add(kr->pc, PERFC_RA_CNCOMP_RBYTES, iov.iov_len);
+
+    *rlen += iov.iov_len;
+    ++*ops;
+
+    if (!kr->kr_lcomp)
+        return 0;
+
+    for (i = 0; i < nodec; ++i) {
+        off = wbt8_leaf_off(kr->kr_loffv, kr->kr_nodex + i);
+
+        err = wbt8_leaf_decode(
+            kr->kr_lcbuf + off - a,
+            wbt8_leaf_off(kr->kr_loffv, kr->kr_nodex + i + 1) - off,
+            buf->node_buf + i * PAGE_SIZE);
+        if (ev(err))
+            return err;
+    }
+
+    return 0;
+}
+
 static void
 kvset_iter_kblock_read(struct work_struct *rock)
 {
@@ -2250,6 +3587,7 @@ kvset_iter_kblock_read(struct work_struct *rock)
     merr_t         err = 0;
     uint           node_read_cnt;
     size_t         a, b, kblk_off, rlen;
+    uint           ops;
     u32            end_node_kmd_off;
     u32            start_node_kmd_off;
     bool           last_node;
@@ -2271,20 +3609,15 @@ kvset_iter_kblock_read(struct work_struct *rock)
         last_node = true;
     }
 
-    iov.iov_base = buf->node_buf;
-    iov.iov_len = node_read_cnt * PAGE_SIZE;
-    kblk_off = (kr->kr_node_start_pg + kr->kr_nodex) * PAGE_SIZE;
+    rlen = 0;
+    ops = 0;
 
-    rlen = iov.iov_len;
-    err = mpool_mblock_read(kr->ds, kr->kr_mbh, &iov, 1, kblk_off);
+    err = kvset_iter_kblock_read_nodes(kr, buf, node_read_cnt, &rlen, &ops);
     if (ev(err))
         goto done;
 
-    perfc_inc(kr->pc, PERFC_RA_CNCOMP_RREQS);
-    perfc_add(kr->pc, PERFC_RA_CNCOMP_RBYTES, iov.iov_len);
-
     /* figure out kmd range that corresponds to leaf nodes */
-    hdr = iov.iov_base;
+    hdr = buf->node_buf;
     assert(omf_wbn_magic(hdr) == WBT_LFE_NODE_MAGIC);
     start_node_kmd_off = omf_wbn_kmd(hdr);
 
@@ -2292,7 +3625,7 @@ kvset_iter_kblock_read(struct work_struct *rock)
         end_node_kmd_off = kr->kr_kmd_pgc * PAGE_SIZE;
     } else {
         /* get end of kmd range last node */
-        hdr = iov.iov_base + iov.iov_len - PAGE_SIZE;
+        hdr = buf->node_buf + (node_read_cnt - 1) * PAGE_SIZE;
         assert(omf_wbn_magic(hdr) == WBT_LFE_NODE_MAGIC);
         end_node_kmd_off = omf_wbn_kmd(hdr);
         /* Cannot read keys from last node b/c we don't have kmd
@@ -2337,7 +3670,10 @@ kvset_iter_kblock_read(struct work_struct *rock)
     }
 
     rlen += iov.iov_len;
-    err = mpool_mblock_read(kr->ds, kr->kr_mbh, &iov, 1, kblk_off);
+    err = io_sched_mblock_read(
+        kr->kr_ios, kr->kr_mclass, kr->kr_ioscls, kr->ds, kr->kr_mbh, &iov, kblk_off);
+    if (!err)
+        err = blk_crc_check(kr->kr_kbd, iov.iov_base, kblk_off, iov.iov_len);
     if (ev(err))
         goto done;
 
@@ -2345,7 +3681,7 @@ kvset_iter_kblock_read(struct work_struct *rock)
     perfc_add(kr->pc, PERFC_RA_CNCOMP_RBYTES, iov.iov_len);
 
     /* stash results in consumable form for caller */
-    kr->iores.kr_ops = 2;
+    kr->iores.kr_ops = ops + 1;
     kr->iores.kr_bytes = rlen;
     kr->iores.kr_nodec = node_read_cnt;
     kr->iores.kr_nodev = buf->node_buf;
@@ -2383,14 +3719,21 @@ kblk_start_read(struct kvset_iterator *iter, struct kblk_reader *kr, enum read_t
         /* starting a new kblock */
         kblk = &iter->ks->ks_kblks[kr->kr_next_kblk_idx];
 
+        if (read_type == READ_WBT && kvset_iter_limit(iter, kblk)) {
+            kr->kr_eof = true;
+            return;
+        }
+
         wbt = read_type == READ_WBT ? &kblk->kb_wbt_desc : &kblk->kb_pt_desc;
 
         kr->kr_nodex = 0;
         kr->kr_nodec = wbt->wbd_leaf_cnt;
         kr->kr_mbh = kblk->kb_kblk.bk_handle;
+        kr->kr_kbd = &kblk->kb_kblk_desc;
         kr->kr_kmd_pgc = wbt->wbd_kmd_pgc;
         kr->kr_node_start_pg = wbt->wbd_first_page;
-        kr->kr_kmd_start_pg = (wbt->wbd_first_page + wbt->wbd_root + 1);
+        kr->kr_kmd_start_pg = wbt_kmd_pg(wbt);
+        kr->kr_lcomp = wbt_leaf_compressed(wbt);
 
         if (kr->kr_kmd_pgc == 0) {
             kr->kr_eof = true;
@@ -2401,7 +3744,7 @@ kblk_start_read(struct kvset_iterator *iter, struct kblk_reader *kr, enum read_t
         kr->kr_next_kblk_idx++;
     }
 
-    mbio_arm(&kr->mbio);
+    mbio_arm(&kr->mbio, 1);
     INIT_WORK(&kr->work, kvset_iter_kblock_read);
     if (iter->asyncio) {
         success = queue_work(iter->workq, &kr->work);
@@ -2414,29 +3757,27 @@ kblk_start_read(struct kvset_iterator *iter, struct kblk_reader *kr, enum read_t
 static void
 vr_read_work(struct work_struct *rock)
 {
-    struct vblk_reader *vr = container_of(rock, struct vblk_reader, work);
+    struct vr_io *      io = container_of(rock, struct vr_io, vio_work);
+    struct vblk_reader *vr = io->vio_vr;
     struct iovec        iov;
     merr_t              err;
     int                 empty = !vr->vr_active;
     size_t              vblk_offset;
 
-    iov.iov_base = vr->vr_buf[empty].data;
-    iov.iov_len = vr->vr_io_len;
+    iov.iov_base = vr->vr_buf[empty].data + io->vio_off;
+    iov.iov_len = io->vio_len;
 
     /* adjust offset for start of vblock data region */
-    vblk_offset = vr->vr_io_offset + vr->vr_mblk_dstart;
-    err = mpool_mblock_read(vr->ds, vr->vr_mbh, &iov, 1, vblk_offset);
-    if (ev(err))
-        goto done;
-
-    perfc_inc(vr->pc, PERFC_RA_CNCOMP_RREQS);
-    perfc_add(vr->pc, PERFC_RA_CNCOMP_RBYTES, iov.iov_len);
-
-    vr->vr_buf[empty].idx = vr->vr_io_vbidx;
-    vr->vr_buf[empty].off = vr->vr_io_offset;
-    vr->vr_buf[empty].len = vr->vr_io_len;
+    vblk_offset = vr->vr_io_offset + vr->vr_mblk_dstart + io->vio_off;
+    err = io_sched_mblock_read(
+        vr->vr_ios, vr->vr_mclass, vr->vr_ioscls, vr->ds, vr->vr_mbh, &iov, vblk_offset);
+    if (!err)
+        err = blk_crc_check(vr->vr_mblkdesc, iov.iov_base, vblk_offset, iov.iov_len);
+    if (!ev(err)) {
+        perfc_inc(vr->pc, PERFC_RA_CNCOMP_RREQS);
+        perfc_add(vr->pc, PERFC_RA_CNCOMP_RBYTES, iov.iov_len);
+    }
 
-done:
     mbio_signal(&vr->mbio, err);
 }
 
@@ -2449,12 +3790,15 @@ vr_start_read(
     struct kvset *           ks)
 {
     bool success __maybe_unused;
+    uint chunk, iocnt, empty, i;
 
     /* update mblock properties */
     assert(lvx2vbd(ks, vbidx));
     vr->vr_mblk_dstart = lvx2vbd(ks, vbidx)->vbd_off;
     vr->vr_mblk_dlen = lvx2vbd(ks, vbidx)->vbd_len;
+    vr->vr_mclass = lvx2vbd(ks, vbidx)->vbd_mclass;
     vr->vr_mbh = lvx2mbh(ks, vbidx);
+    vr->vr_mblkdesc = &lvx2vbd(ks, vbidx)->vbd_mblkdesc;
 
     /* set io fields for async mblock read */
     vr->vr_io_vbidx = vbidx;
@@ -2467,14 +3811,39 @@ vr_start_read(
     if (vr->vr_io_len > vr->vr_buf_sz)
         vr->vr_io_len = vr->vr_buf_sz;
 
-    vr->mbio.pending = 1;
+    chunk = vr->vr_io_len;
+    if (vr->asyncio && vr->vr_qd > 1) {
+        chunk = PAGE_ALIGN((vr->vr_io_len + vr->vr_qd - 1) / vr->vr_qd);
+        chunk = max_t(uint, chunk, VR_IO_MIN);
+    }
+
+    iocnt = (vr->vr_io_len + chunk - 1) / chunk;
+    assert(iocnt <= VR_QD_MAX);
 
-    INIT_WORK(&vr->work, vr_read_work);
-    if (vr->asyncio) {
-        success = queue_work(workq, &vr->work);
-        assert(success);
-    } else {
-        vr_read_work(&vr->work);
+    /* The buffer is not looked at until all its reads have completed,
+     * and an error from any of them fails the iteration.
+     */
+    empty = !vr->vr_active;
+    vr->vr_buf[empty].idx = vr->vr_io_vbidx;
+    vr->vr_buf[empty].off = vr->vr_io_offset;
+    vr->vr_buf[empty].len = vr->vr_io_len;
+
+    mbio_arm(&vr->mbio, iocnt);
+
+    for (i = 0; i < iocnt; ++i) {
+        struct vr_io *io = vr->vr_iov + i;
+
+        io->vio_vr = vr;
+        io->vio_off = i * chunk;
+        io->vio_len = min_t(uint, chunk, vr->vr_io_len - io->vio_off);
+
+        INIT_WORK(&io->vio_work, vr_read_work);
+        if (vr->asyncio) {
+            success = queue_work(workq, &io->vio_work);
+            assert(success);
+        } else {
+            vr_read_work(&io->vio_work);
+        }
     }
 
     return true;
@@ -2498,14 +3867,18 @@ kvset_iter_free_buffers(struct kvset_iterator *iter, struct kblk_reader *kr)
     kvset_rbuf_free(kr->kr_buf[0].kmd_buf, kr->kr_buf[0].kmd_used_sz);
     kvset_rbuf_free(kr->kr_buf[1].kmd_buf, kr->kr_buf[1].kmd_used_sz);
 
+    free_aligned(kr->kr_loffv);
+    free_aligned(kr->kr_lcbuf);
+    kr->kr_loffv = kr->kr_lcbuf = NULL;
+
     if (iter->vreaders) {
         for (i = 0; i < iter->ks->ks_vgroups; i++)
             kvset_rbuf_free(iter->vreaders[i].vr_buf[0].data, iter->vreaders[i].vr_buf_sz * 2);
-        free(iter->vreaders);
+        kvset_iter_zfree(iter->arena, iter->vreaders);
         iter->vreaders = 0;
     }
 
-    free(iter->ra_bitmap);
+    kvset_iter_zfree(iter->arena, iter->ra_bitmap);
     iter->ra_bitmap = NULL;
 }
 
@@ -2547,6 +3920,9 @@ kvset_iter_enable_mblock_read_cmn(struct kvset_iterator *iter, struct kblk_reade
     kr->kr_kblk_cnt = iter->ks->ks_st.kst_kblks;
     kr->ds = iter->ks->ks_ds;
     kr->pc = iter->pc;
+    kr->kr_ios = kvset_io_sched(iter->ks);
+    kr->kr_ioscls = iter->ioscls;
+    kr->kr_mclass = iter->ks->ks_mclass;
 
     mbio_init(&kr->mbio);
 
@@ -2622,7 +3998,7 @@ kvset_iter_enable_mblock_read(struct kvset_iterator *iter)
      * reader because vblocks will be consumed in order.  Kvsets
      * produced by kcompaction will need one reader for each vgroup.
      */
-    iter->vreaders = calloc(iter->ks->ks_vgroups, sizeof(*iter->vreaders));
+    iter->vreaders = kvset_iter_zalloc(iter->arena, iter->ks->ks_vgroups * sizeof(*iter->vreaders));
     if (ev(!iter->vreaders))
         goto nomem;
     for (i = 0; i < iter->ks->ks_vgroups; i++) {
@@ -2649,9 +4025,12 @@ kvset_iter_enable_mblock_read(struct kvset_iterator *iter)
 
         vr->vr_active = 0;
         vr->vr_buf_sz = vr_buf_sz;
+        vr->vr_qd = clamp_t(uint, iter->ks->ks_rp->cn_compact_vblk_qd, 1, VR_QD_MAX);
 
         vr->ds = iter->ks->ks_ds;
         vr->pc = iter->pc;
+        vr->vr_ios = kvset_io_sched(iter->ks);
+        vr->vr_ioscls = iter->ioscls;
     }
 
     return 0;
@@ -2675,19 +4054,179 @@ kvset_iter_mblock_read_start(struct kvset_iterator *iter)
     /* Initiate first reads */
     k->kr_requested = true;
     kblk_start_read(iter, k, READ_WBT);
-    if (iter->ks->ks_st.kst_vblks) {
+    if (iter->ks->ks_st.kst_vblks && !iter->keys_only) {
         struct vblk_reader *vr = &iter->vreaders[0];
 
         vr->vr_requested = vr_start_read(vr, 0, 0, iter->workq, iter->ks);
     }
 }
 
+static void
+kvset_iter_nr_sample(struct kvs_mblk_desc *md, u32 pg, u32 pgc, u8 *vec)
+{
+    void *addr = md->map_base + (size_t)pg * PAGE_SIZE;
+
+    /* When in doubt, keep the pages. */
+    if (pgc > 0 && ev(mincore(addr, (size_t)pgc * PAGE_SIZE, vec)))
+        memset(vec, 1, pgc);
+}
+
+static void
+kvset_iter_nr_drop(struct kvs_mblk_desc *md, u32 pg, u32 pgc, const u8 *vec)
+{
+    u32 i = 0;
+
+    while (i < pgc) {
+        u32 n = 0;
+
+        while (i + n < pgc && !(vec[i + n] & 1))
+            ++n;
+
+        if (n > 0)
+            ev(kbr_madvise_region(md, pg + i, n, MADV_DONTNEED));
+
+        i += n + 1;
+    }
+}
+
+/**
+ * kvset_iter_nr_move() - move a noreuse region
+ * @nr:  noreuse region
+ * @md:  mblock of the new region, or NULL to stop tracking
+ * @pg:  first mblock page of the new region
+ * @pgc: number of pages in the new region
+ *
+ * Releases the pages of the old region that lie outside the new region
+ * and were not resident when sampled, and samples the pages of the new
+ * region that lie outside the old region.
+ */
+static void
+kvset_iter_nr_move(struct kvset_iter_nr *nr, struct kvs_mblk_desc *md, u32 pg, u32 pgc)
+{
+    u32 lo = pg + pgc, hi = pg + pgc;
+    u8 *vec;
+
+    if (pgc > nr->vecsz) {
+        u32 sz = roundup_pow_of_two(pgc);
+
+        vec = malloc(2 * sz);
+        if (ev(!vec)) {
+            md = NULL;
+            pgc = 0;
+        } else {
+            if (nr->pgc)
+                memcpy(vec, nr->vec, nr->pgc);
+            free(nr->buf);
+            nr->buf = nr->vec = vec;
+            nr->tmp = vec + sz;
+            nr->vecsz = sz;
+        }
+    }
+
+    if (nr->md && nr->md == md) {
+        lo = max_t(u32, pg, nr->pg);
+        hi = min_t(u32, pg + pgc, nr->pg + nr->pgc);
+        if (lo >= hi)
+            lo = hi = pg + pgc;
+    }
+
+    if (nr->md) {
+        if (lo < hi) {
+            kvset_iter_nr_drop(nr->md, nr->pg, lo - nr->pg, nr->vec);
+            kvset_iter_nr_drop(
+                nr->md, hi, nr->pg + nr->pgc - hi, nr->vec + (hi - nr->pg));
+        } else {
+            kvset_iter_nr_drop(nr->md, nr->pg, nr->pgc, nr->vec);
+        }
+    }
+
+    if (!md) {
+        nr->md = NULL;
+        nr->pgc = 0;
+        return;
+    }
+
+    if (lo < hi)
+        memcpy(nr->tmp + (lo - pg), nr->vec + (lo - nr->pg), hi - lo);
+    else
+        lo = hi = pg + pgc;
+
+    kvset_iter_nr_sample(md, pg, lo - pg, nr->tmp);
+    kvset_iter_nr_sample(md, hi, pg + pgc - hi, nr->tmp + (hi - pg));
+
+    vec = nr->vec;
+    nr->vec = nr->tmp;
+    nr->tmp = vec;
+
+    nr->md = md;
+    nr->pg = pg;
+    nr->pgc = pgc;
+}
+
+/**
+ * kvset_iter_nr_vblk() - slide the vblock noreuse window to a value
+ * @iter:  kvset iterator
+ * @vbd:   vblock of the value
+ * @vboff: offset of the value in @vbd
+ *
+ * Called before a value is read, and before any readahead is issued
+ * on its behalf.
+ */
+static void
+kvset_iter_nr_vblk(struct kvset_iterator *iter, struct vblock_desc *vbd, uint vboff)
+{
+    struct kvset_iter_nr *nr = &iter->nr_vblk;
+    u32                   win, first, last, end;
+
+    win = vboff / (KVSET_ITER_NR_WIN * PAGE_SIZE);
+
+    if (nr->md == &vbd->vbd_mblkdesc && nr->win == win)
+        return;
+
+    first = vbd->vbd_off / PAGE_SIZE;
+    end = (vbd->vbd_off + vbd->vbd_len + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    last = min_t(u32, first + (win + 2) * KVSET_ITER_NR_WIN, end);
+    first += (win > 0 ? win - 1 : 0) * KVSET_ITER_NR_WIN;
+
+    kvset_iter_nr_move(nr, &vbd->vbd_mblkdesc, first, last - first);
+    nr->win = win;
+}
+
+static void
+kvset_iter_nr_kblk(struct kvset_iterator *iter, struct kvset_kblk *kb)
+{
+    struct wbt_desc *wbd = &kb->kb_wbt_desc;
+
+    kvset_iter_nr_move(&iter->nr_kblk, &kb->kb_kblk_desc, wbd->wbd_first_page, wbd->wbd_n_pages);
+}
+
+static void
+kvset_iter_nr_fini(struct kvset_iterator *iter)
+{
+    kvset_iter_nr_move(&iter->nr_kblk, NULL, 0, 0);
+    kvset_iter_nr_move(&iter->nr_vblk, NULL, 0, 0);
+
+    free(iter->nr_kblk.buf);
+    free(iter->nr_vblk.buf);
+}
+
+static void
+kvset_iter_free(struct kvset_iterator *iter)
+{
+    if (!iter->arena)
+        kmem_cache_free(kvset_iter_cache, iter);
+    else
+        kvset_iter_zfree(iter->arena, iter);
+}
+
 merr_t
 kvset_iter_create(
     struct kvset *           ks,
     struct workqueue_struct *io_workq,
     struct workqueue_struct *vra_wq,
     struct perfc_set *       pc,
+    struct cheap *           arena,
     enum kvset_iter_flags    flags,
     struct kv_iterator **    handle)
 {
@@ -2704,19 +4243,29 @@ kvset_iter_create(
     if (ev(reverse && (io_workq || mblock_read)))
         return merr(EINVAL);
 
-    iter = kmem_cache_zalloc(kvset_iter_cache, GFP_KERNEL);
+    err = kvset_vmaterialize(ks);
+    if (ev(err))
+        return err;
+
+    if (arena)
+        iter = kvset_iter_zalloc(arena, sizeof(*iter));
+    else
+        iter = kmem_cache_zalloc(kvset_iter_cache, GFP_KERNEL);
     if (ev(!iter))
         return merr(ENOMEM);
 
+    KVS_TRACE_INC(kt_kvsets);
+
     /* If successful, kvset_iter_create() adopts one reference
      * on the kvset from the caller.
      */
     iter->ks = ks;
+    iter->arena = arena;
     iter->handle.kvi_ops = &kvset_iter_ops;
-    iter->vra_len = roundup(ks->ks_vra_len, PAGE_SIZE);
+    iter->vra_len = roundup(kvset_vra_scale(ks, ks->ks_vra_len), PAGE_SIZE);
 
     if (fullscan && !mblock_read) {
-        iter->vra_len = roundup(ks->ks_rp->cn_compact_vra, PAGE_SIZE);
+        iter->vra_len = roundup(kvset_vra_scale(ks, ks->ks_rp->cn_compact_vra), PAGE_SIZE);
         iter->vra_flags |= VBR_FULLSCAN;
     }
 
@@ -2725,9 +4274,26 @@ kvset_iter_create(
         iter->reverse = reverse;
     }
 
-    iter->vra_len = min_t(u32, iter->vra_len, 1024 * 1024);
+    /* Full scans are compactions, their reads yield to foreground reads. */
+    iter->ioscls = fullscan ? IOS_COMPACT : IOS_FG_READ;
+
+    /* Only mcache maps populate the page cache on behalf of the iterator. */
+    iter->noreuse = (flags & kvset_iter_flag_noreuse) && !mblock_read;
+
+    iter->vra_len = min_t(u32, iter->vra_len, KVSET_ITER_VRA_MAX);
     iter->vra_wq = vra_wq;
 
+    /* A key-only iterator never dereferences values, so there is
+     * nothing to read ahead.
+     */
+    if (flags & kvset_iter_flag_keys_only) {
+        iter->keys_only = true;
+        iter->vra_len = 0;
+        iter->vra_wq = NULL;
+    }
+
+    iter->vra_base = iter->vra_len;
+
     iter->workq = io_workq;
     iter->last = SRC_NONE;
     iter->pc = pc;
@@ -2757,7 +4323,7 @@ kvset_iter_create(
         nbkts = (ks->ks_rp->vblock_size_mb << 20) / vra_len;
         iter->ra_vblk_nbytes = max_t(uint, nbkts >> 3, 1);
 
-        iter->ra_bitmap = calloc(iter->ks->ks_st.kst_vblks, iter->ra_vblk_nbytes);
+        iter->ra_bitmap = kvset_iter_zalloc(arena, iter->ks->ks_st.kst_vblks * iter->ra_vblk_nbytes);
         if (ev(!iter->ra_bitmap)) {
             err = merr(ENOMEM);
             goto err_exit1;
@@ -2771,7 +4337,7 @@ err_exit2:
     kvset_iter_free_buffers(iter, &iter->kreader);
 
 err_exit1:
-    kmem_cache_free(kvset_iter_cache, iter);
+    kvset_iter_free(iter);
     return err;
 }
 
@@ -2801,6 +4367,49 @@ kvset_iter_set_stats(struct kv_iterator *handle, struct cn_merge_stats *stats)
     iter->stats = stats;
 }
 
+/* Restart the key reader of an mblock read iterator at kblock @start, or
+ * at eof if @start < 0, and the ptomb reader at the ptomb kblock.  Reads
+ * still in flight are waited for and their results dropped.
+ */
+static merr_t
+kvset_iter_read_restart(struct kvset_iterator *iter, int start, int pt_start)
+{
+    struct kblk_reader *krv[] = { &iter->kreader, &iter->ptreader };
+    merr_t              err = 0;
+    int                 i;
+
+    assert(!iter->reverse);
+
+    for (i = 0; i < NELEM(krv); ++i) {
+        struct kblk_reader *kr = krv[i];
+
+        if (kr->kr_requested) {
+            merr_t err2 = mbio_wait(&kr->mbio, 0);
+
+            if (!err)
+                err = err2;
+            kr->kr_requested = false;
+        }
+
+        kr->kr_nodex = kr->kr_nodec = 0;
+        kr->kr_eof = false;
+    }
+
+    iter->kreader.kr_next_kblk_idx = max_t(int, start, 0);
+    iter->ptreader.kr_next_kblk_idx = iter->ptreader.kr_kblk_cnt - 1;
+
+    memset(&iter->wbt_reader, 0, sizeof(iter->wbt_reader));
+    memset(&iter->pt_reader, 0, sizeof(iter->pt_reader));
+
+    iter->curr_kblk = max_t(int, start, 0);
+    iter->wbti_meta.eof = start < 0;
+    iter->pti_meta.eof = pt_start < 0;
+    iter->last = SRC_NONE;
+    iter->handle.kvi_eof = false;
+
+    return err;
+}
+
 merr_t
 kvset_iter_set_start(struct kv_iterator *handle, int start, int pt_start)
 {
@@ -2808,6 +4417,17 @@ kvset_iter_set_start(struct kv_iterator *handle, int start, int pt_start)
 
     if (start < iter->curr_kblk)
         return merr(ev(EINVAL));
+
+    /* The key reader of an mblock read iterator has already started
+     * reading the first kblock.
+     */
+    if (iter->workq && start > iter->curr_kblk) {
+        merr_t err;
+
+        err = kvset_iter_read_restart(iter, start, pt_start);
+        if (ev(err))
+            return err;
+    }
     iter->curr_kblk = start;
 
     iter->wbti_meta.eof = iter->pti_meta.eof = true;
@@ -2897,6 +4517,10 @@ kvset_madvise_vblks(struct kvset *ks, int advice)
 
     assert(advice == MADV_WILLNEED || advice == MADV_DONTNEED);
 
+    /* Nothing to advise until the vblocks are mapped. */
+    if (atomic_read_acq(&ks->ks_vlazy))
+        return;
+
     wq = cn_get_maint_wq(ks->ks_tree->cn);
 
     for (i = 0; i < ks->ks_vbsetc; i++) {
@@ -2920,8 +4544,12 @@ kvset_madvise_capped(struct kvset *ks, int advice)
 
     assert(advice == MADV_WILLNEED || advice == MADV_DONTNEED);
 
+    /* Nothing to advise until the vblocks are mapped. */
+    if (atomic_read_acq(&ks->ks_vlazy))
+        return;
+
     wq = cn_get_maint_wq(ks->ks_tree->cn);
-    vra_len = ks->ks_vra_len;
+    vra_len = kvset_vra_scale(ks, ks->ks_vra_len);
 
     for (i = 0; i < ks->ks_vbsetc; i++) {
         struct mbset *v = ks->ks_vbsetv[i];
@@ -2965,6 +4593,79 @@ kvset_iter_mark_eof(struct kv_iterator *handle)
     handle->kvi_eof = iter->wbti_meta.eof = iter->pti_meta.eof = true;
 }
 
+static merr_t
+kvset_iter_seek_read(struct kvset_iterator *iter, const void *key, s32 len, bool *eof);
+
+static inline bool
+kvset_iter_ra_seq(struct kvset_iterator *iter)
+{
+    return iter->ra_keys >= KVSET_ITER_RA_SEQ_KEYS || iter->ks->ks_rp->cn_cursor_seq;
+}
+
+/**
+ * kvset_iter_ra_reset() - shrink the readahead windows back to their minimum
+ * @iter: kvset iterator
+ *
+ * A repositioned cursor has yet to prove that it is sequential.
+ */
+static void
+kvset_iter_ra_reset(struct kvset_iterator *iter)
+{
+    iter->vra_len = iter->vra_base;
+    iter->kra_pgs = 0;
+    iter->ra_keys = 0;
+    iter->ra_bytes = 0;
+    iter->ra_limit = false;
+}
+
+/**
+ * kvset_iter_kra() - read ahead the leaf nodes of a newly visited kblock
+ * @iter: kvset iterator
+ * @kb:   kblock the iterator is about to read
+ */
+static void
+kvset_iter_kra(struct kvset_iterator *iter, struct kvset_kblk *kb)
+{
+    struct wbt_desc *wbd = &kb->kb_wbt_desc;
+    u32              first = 0;
+
+    if (iter->ra_limit || !kvset_iter_ra_seq(iter))
+        return;
+
+    if (iter->kra_pgs)
+        iter->kra_pgs = min_t(u32, iter->kra_pgs * 2, KVSET_ITER_KRA_MAX);
+    else
+        iter->kra_pgs = KVSET_ITER_KRA_MIN;
+
+    if (iter->reverse && wbd->wbd_leaf_pgc > iter->kra_pgs)
+        first = wbd->wbd_leaf_pgc - iter->kra_pgs;
+
+    kbr_madvise_wbt_leaf_range(&kb->kb_kblk_desc, wbd, first, iter->kra_pgs, MADV_WILLNEED);
+}
+
+/**
+ * kvset_iter_vra() - account for a value read and grow the vblock window
+ * @iter: kvset iterator
+ * @vlen: length of the value read
+ */
+static void
+kvset_iter_vra(struct kvset_iterator *iter, uint vlen)
+{
+    if (iter->vra_flags & VBR_FULLSCAN)
+        return;
+
+    iter->ra_bytes += vlen;
+
+
+    if (iter->vra_len >= KVSET_ITER_VRA_MAX || iter->ra_bytes < iter->vra_len * 2)
+        return;
+
+    if (kvset_iter_ra_seq(iter)) {
+        iter->vra_len = min_t(u32, iter->vra_len * 2, KVSET_ITER_VRA_MAX);
+        iter->ra_bytes = 0;
+    }
+}
+
 /*
  * kvset_iter_seek efficiently moves the iterator to key (or eof)
  *
@@ -2984,6 +4685,13 @@ kvset_iter_seek(struct kv_iterator *handle, const void *key, s32 len, bool *eof)
     kt.kt_data = key;
     kt.kt_len = len;
 
+    /* Compaction iterators have stats and do not count as accesses.
+     */
+    if (!iter->stats)
+        kvset_heat_add(ks, KVSET_HEAT_SEEKS, 1);
+
+    kvset_iter_ra_reset(iter);
+
     /* If key lies beyond the kvset range in the direction of the cursor,
      * mark iterator as eof. Do this only for cursor seeks, not cursor
      * create.
@@ -3005,6 +4713,9 @@ kvset_iter_seek(struct kv_iterator *handle, const void *key, s32 len, bool *eof)
         }
     }
 
+    if (iter->workq)
+        return kvset_iter_seek_read(iter, key, len, eof);
+
     /*
      * Do not tear down iterators immediately if they can be re-used by
      * this call. If they are not re-used, destroy them at the end.
@@ -3073,6 +4784,9 @@ kvset_iter_seek(struct kv_iterator *handle, const void *key, s32 len, bool *eof)
     iter->curr_kblk = start;
     kblk = &ks->ks_kblks[iter->curr_kblk];
 
+    if (!iter->wbti_meta.eof && kvset_iter_limit(iter, kblk))
+        iter->wbti_meta.eof = true;
+
     if (!iter->wbti_meta.eof) {
         if (!wbti)
             err = wbti_alloc(&wbti);
@@ -3086,6 +4800,9 @@ kvset_iter_seek(struct kv_iterator *handle, const void *key, s32 len, bool *eof)
             }
             return err;
         }
+        if (iter->noreuse)
+            kvset_iter_nr_kblk(iter, kblk);
+
         wbti_reset(wbti, &kblk->kb_kblk_desc, &kblk->kb_wbt_desc, &kt, iter->reverse, 0);
         iter->wbti = wbti;
         wbti = NULL;
@@ -3178,6 +4895,11 @@ next_kblock:
         assert(iter->curr_kblk < ks->ks_st.kst_kblks);
         kb = ks->ks_kblks + iter->curr_kblk;
 
+        if (kvset_iter_limit(iter, kb)) {
+            iter->wbti_meta.eof = true;
+            return 0;
+        }
+
         /* This kblock doesn't have a wb tree. This is possible only
          * with the last kblock of the ks
          */
@@ -3192,11 +4914,16 @@ next_kblock:
          * with mcache map since this code is only used with cursors.
          */
         preload_wbt_nodes = ks->ks_rp->cn_cursor_kra ? 1 : 0;
+        if (iter->noreuse)
+            kvset_iter_nr_kblk(iter, kb);
+
         err = wbti_create(
             &iter->wbti, &kb->kb_kblk_desc, &kb->kb_wbt_desc, 0, iter->reverse, preload_wbt_nodes);
         if (ev(err))
             return err;
         assert(iter->wbti);
+
+        kvset_iter_kra(iter, kb);
     }
 
     if (!wbti_next(iter->wbti, kdata, klen, &iter->wbti_meta.kmd)) {
@@ -3204,9 +4931,14 @@ next_kblock:
         iter->wbti = 0;
         iter->curr_kblk += inc;
 
+        if (iter->noreuse)
+            kvset_iter_nr_move(&iter->nr_kblk, NULL, 0, 0);
+
         goto next_kblock;
     }
 
+    iter->ra_keys++;
+
     return 0;
 }
 
@@ -3292,10 +5024,19 @@ kvset_iter_next_key_read(
 
 next_key:
     /* set kdata and klen outputs */
-    if (wbd->wbd_version < WBT_TREE_VERSION5)
+    if (wbd->wbd_version < WBT_TREE_VERSION5) {
         wbt4_lfe_key(wbt_reader->wb_node, wbt_reader->wb_lfe, kdata, klen);
-    else
+    } else if (wbd->wbd_version < WBT_TREE_VERSION7) {
         wbt_lfe_key(wbt_reader->wb_node, wbt_reader->wb_lfe, kdata, klen);
+    } else {
+        const void *pfx;
+        uint        pfx_len;
+
+        /* The prefix of a front-coded key varies from key to key */
+        wbt7_lfe_key(wbt_reader->wb_node, wbt_reader->wb_lfe, &pfx, &pfx_len, kdata, klen);
+        wbt_reader->wb_pfx = (void *)pfx;
+        wbt_reader->wb_pfx_len = pfx_len;
+    }
 
     /* set kmd output, which is used by caller to iterate through values */
     meta->kmd =
@@ -3307,6 +5048,69 @@ next_key:
     return 0;
 }
 
+/* Seek an mblock read iterator by restarting its readers at the kblock that
+ * may hold the key and skipping the keys (and ptombs) that precede it.  The
+ * first key and ptomb at or after the target are left for kvset_iter_next_key()
+ * to consume, so a seek reads at most one kblock's worth of excess keys.
+ */
+static merr_t
+kvset_iter_seek_read(struct kvset_iterator *iter, const void *key, s32 len, bool *eof)
+{
+    struct kvset * ks = iter->ks;
+    struct key_obj target, kobj;
+    int            start;
+    merr_t         err;
+
+    start = kvset_kblk_start(ks, key, len, false);
+    if (start == KVSET_MISS_KEY_TOO_SMALL)
+        start = 0;
+
+    err = kvset_iter_read_restart(iter, start, kvset_pt_start(ks));
+    if (ev(err))
+        return err;
+
+    key2kobj(&target, key, abs(len));
+
+    while (!iter->wbti_meta.eof) {
+        err = kvset_iter_next_key_read(
+            iter, &iter->wbti_meta.last_key, &iter->wbti_meta.last_klen, READ_WBT);
+        if (ev(err))
+            return err;
+
+        if (iter->wbti_meta.eof)
+            break;
+
+        wbti_kobj_get(iter, &kobj);
+        if (key_obj_cmp(&kobj, &target) >= 0)
+            break;
+    }
+
+    /* A ptomb covers the target if it is a prefix of the target.
+     */
+    target.ko_sfx_len = min_t(uint, target.ko_sfx_len, ks->ks_pfx_len);
+
+    while (!iter->pti_meta.eof) {
+        err = kvset_iter_next_key_read(
+            iter, &iter->pti_meta.last_key, &iter->pti_meta.last_klen, READ_PT);
+        if (ev(err))
+            return err;
+
+        if (iter->pti_meta.eof)
+            break;
+
+        pti_kobj_get(iter, &kobj);
+        if (key_obj_cmp(&kobj, &target) >= 0)
+            break;
+    }
+
+    iter->last = SRC_SEEK;
+
+    *eof = iter->handle.kvi_eof = iter->pti_meta.eof && iter->wbti_meta.eof;
+    iter->handle.kvi_es = es_make(kvset_cursor_next, 0, 0);
+
+    return 0;
+}
+
 merr_t
 kvset_iter_next_wbt_key(struct kv_iterator *handle, const void **kdata, uint *klen)
 {
@@ -3443,11 +5247,15 @@ kvset_iter_next_vref(
     uint *                  vbidx,
     uint *                  vboff,
     const void **           vdata,
-    uint *                  vlen)
+    uint *                  vlen,
+    uint *                  complen)
 {
+    struct kmd_ent ent;
+
     assert(vc);
     assert(vc->kmd);
     *vlen = 0;
+    *complen = 0;
 
     if (!vc->off) {
         assert(vc->nvals == 0);
@@ -3461,11 +5269,15 @@ kvset_iter_next_vref(
     if (vc->next >= vc->nvals)
         return false;
 
-    kmd_type_seq(vc->kmd, &vc->off, vtype, seq);
-    if (*vtype == vtype_val)
-        kmd_val(vc->kmd, &vc->off, vbidx, vboff, vlen);
-    else if (*vtype == vtype_ival)
-        kmd_ival(vc->kmd, &vc->off, vdata, vlen);
+    kmd_ent_decode(vc->kmd, &vc->off, &ent);
+
+    *seq = ent.seq;
+    *vtype = (ent.vtype == vtype_lival) ? vtype_ival : ent.vtype;
+    *vbidx = ent.vbidx;
+    *vboff = ent.vboff;
+    *vdata = ent.vdata;
+    *vlen = ent.vlen;
+    *complen = ent.complen;
 
     vc->next++;
     return true;
@@ -3559,7 +5371,8 @@ have_data:
      * request, then we re-enable read ahead (see above where vr_read_ahead
      * is set to true).
      */
-    if (vr->vr_read_ahead && !vr->vr_requested && vboff - active->off > active->len / 64) {
+    if (vr->vr_read_ahead && !vr->vr_requested && !iter->ra_limit &&
+        vboff - active->off > active->len / 64) {
 
         uint off;
 
@@ -3672,10 +5485,18 @@ kvset_iter_get_valptr_mcache(struct kvset_iterator *iter, uint vbidx, uint vboff
     vbd = lvx2vbd(ks, vbidx);
     assert(vbd);
 
-    if (iter->vra_len > 0) {
+    /* The c1 vblocks of the root node are read in no particular order,
+     * so a window cannot follow them.
+     */
+    if (iter->noreuse && !(iter->vra_flags & VBR_UNORDERED))
+        kvset_iter_nr_vblk(iter, vbd, vboff);
+
+    if (iter->vra_len > 0 && !iter->ra_limit) {
         if (iter->vra_flags & VBR_UNORDERED)
             return kvset_iter_valptr_mcache_root(iter, vbidx, vboff, vlen);
 
+        kvset_iter_vra(iter, vlen);
+
         vbr_readahead(
             vbd,
             vboff,
@@ -3699,13 +5520,16 @@ kvset_iter_get_valptr(
     const void **       vdata)
 {
     struct kvset_iterator *iter = handle_to_kvset_iter(handle);
+    struct vblock_desc *   vbd;
 
     if (iter->workq)
         return kvset_iter_get_valptr_read(iter, vbidx, vboff, vlen, vdata);
 
+    vbd = lvx2vbd(iter->ks, vbidx);
+
     *vdata = kvset_iter_get_valptr_mcache(iter, vbidx, vboff, vlen);
 
-    return 0;
+    return blk_crc_verify(&vbd->vbd_mblkdesc, vbd->vbd_off + vboff, vlen);
 }
 
 merr_t
@@ -3716,11 +5540,27 @@ kvset_iter_next_val(
     uint                    vbidx,
     uint                    vboff,
     const void **           vdata,
-    uint *                  vlen)
+    uint *                  vlen,
+    uint                    complen)
 {
+    struct kvset_iterator *iter = handle_to_kvset_iter(handle);
+
+    if (!iter->stats && !iter->keys_only)
+        kvset_heat_add(iter->ks, KVSET_HEAT_BYTES, *vlen);
+
     switch (vtype) {
         case vtype_val:
+            if (iter->keys_only) {
+                *vdata = NULL;
+                return 0;
+            }
             return kvset_iter_get_valptr(handle, vbidx, vboff, *vlen, vdata);
+        case vtype_cval:
+            if (iter->keys_only) {
+                *vdata = NULL;
+                return 0;
+            }
+            return kvset_iter_get_valptr(handle, vbidx, vboff, complen, vdata);
         case vtype_zval:
             *vdata = 0;
             *vlen = 0;
@@ -3737,6 +5577,9 @@ kvset_iter_next_val(
             assert(*vdata);
             assert(*vlen);
             return 0;
+        case vtype_lival:
+            /* Reported as vtype_ival by kvset_iter_next_vref(). */
+            break;
     }
 
     /* BUG! */
@@ -3802,12 +5645,16 @@ kvset_iter_release(struct kv_iterator *handle)
 
     wbti_destroy(iter->wbti);
     wbti_destroy(iter->pti);
+
+    if (iter->noreuse)
+        kvset_iter_nr_fini(iter);
+
     kvset_put_ref(iter->ks);
 
     kvset_iter_free_buffers(iter, &iter->kreader);
     kvset_iter_free_buffers(iter, &iter->ptreader);
 
-    kmem_cache_free(kvset_iter_cache, iter);
+    kvset_iter_free(iter);
 }
 
 struct kv_iterator_ops kvset_iter_ops = {
@@ -3830,8 +5677,8 @@ kvset_from_iter(struct kv_iterator *iv)
 void
 kvset_maxkey(struct kvset *ks, const void **maxkey, u16 *maxklen)
 {
-    *maxkey = ks->ks_minkey;
-    *maxklen = ks->ks_minklen;
+    *maxkey = ks->ks_maxkey;
+    *maxklen = ks->ks_maxklen;
 }
 
 void
@@ -3852,11 +5699,13 @@ kvset_init(void)
         return 0;
 
     kvset_rbuf_init();
+    mutex_init(&kvset_vlazy_lock);
 
     sz = sizeof(struct kvset_iterator);
 
     cache = kmem_cache_create("kvsiter", sz, SMP_CACHE_BYTES, 0, NULL);
     if (ev(!cache)) {
+        mutex_destroy(&kvset_vlazy_lock);
         kvset_rbuf_fini();
         atomic_dec(&kvset_init_ref);
         return merr(ENOMEM);
@@ -3899,9 +5748,42 @@ kvset_fini(void)
 
     kmem_cache_destroy(kvset_iter_cache);
 
+    mutex_destroy(&kvset_vlazy_lock);
     kvset_rbuf_fini();
 }
 
+merr_t
+kvset_verify(struct kvset *ks, const struct cn_node_loc *loc)
+{
+    struct cn_khashmap *map = cn_tree_get_khashmap(ks->ks_tree);
+    struct kvset_meta   km = { 0 };
+    merr_t              err = 0;
+    uint                i;
+
+    blk_list_init(&km.km_kblk_list);
+    blk_list_init(&km.km_vblk_list);
+
+    for (i = 0; i < ks->ks_st.kst_kblks && !err; i++)
+        err = blk_list_append(&km.km_kblk_list, 0, kvset_get_nth_kblock_id(ks, i));
+
+    for (i = 0; i < ks->ks_st.kst_vblks && !err; i++)
+        err = blk_list_append(&km.km_vblk_list, 0, lvx2mbid(ks, i));
+
+    if (!ev(err)) {
+        km.km_dgen = ks->ks_dgen;
+        km.km_node_level = loc->node_level;
+        km.km_node_offset = loc->node_offset;
+
+        err = kc_kvset_check(
+            ks->ks_ds, cn_tree_get_cparams(ks->ks_tree), &km, map ? map->khm_mapv : NULL);
+    }
+
+    blk_list_free(&km.km_vblk_list);
+    blk_list_free(&km.km_kblk_list);
+
+    return err;
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "kvset_ut_impl.i"
 #include "kvset_view_ut_impl.i"
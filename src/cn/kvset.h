@@ -16,6 +16,8 @@
 #include <hse_ikvdb/omf_kmd.h>
 #include <hse_ikvdb/kvset_view.h>
 
+#include <mpool/mpool.h>
+
 #include "kv_iterator.h"
 
 struct kvset;
@@ -31,6 +33,7 @@ struct mbset;
 struct cn_kvdb;
 struct cn_tree;
 struct cn_merge_stats;
+struct cn_node_loc;
 
 #include "blk_list.h"
 
@@ -45,6 +48,8 @@ enum kvset_iter_flags {
     kvset_iter_flag_mcache = (1u << 0),
     kvset_iter_flag_reverse = (1u << 1),
     kvset_iter_flag_fullscan = (1u << 2),
+    kvset_iter_flag_keys_only = (1u << 3),
+    kvset_iter_flag_noreuse = (1u << 4),
 };
 
 /**
@@ -85,11 +90,12 @@ kvset_init(void);
 void
 kvset_fini(void);
 
+/* MTF_MOCK_DECL(kvset) */
+
+/* MTF_MOCK */
 u64
 kvset_get_tag(struct kvset *kvset);
 
-/* MTF_MOCK_DECL(kvset) */
-
 /**
  * kvset_get_ref() - Obtain a ref on a kvset
  *
@@ -224,6 +230,19 @@ kvset_create2(
     struct mbset ***   vbset_vecs,
     struct kvset **    kvset);
 
+/**
+ * kvset_create_vbset() - Create an mbset of the trailing vblocks of a kvset
+ * @tree:  cn tree handle
+ * @meta:  kvset_meta data, its vblock list holds the vblocks
+ * @first: index of the first vblock in @meta's vblock list to include
+ * @vbset: (output) new mbset, or NULL if @first leaves no vblocks
+ *
+ * The caller owns the reference on @vbset.
+ */
+/* MTF_MOCK */
+merr_t
+kvset_create_vbset(struct cn_tree *tree, struct kvset_meta *meta, uint first, struct mbset **vbset);
+
 /* MTF_MOCK */
 merr_t
 kvset_log_d_records(struct kvset *kvset, bool keepv, u64 txid);
@@ -232,6 +251,36 @@ kvset_log_d_records(struct kvset *kvset, bool keepv, u64 txid);
 void
 kvset_mark_mblocks_for_delete(struct kvset *kvset, bool keepv, u64 txid);
 
+/**
+ * kvset_log_move() - log the move of a kvset to another node
+ * @kvset:  kvset to move
+ * @txid:   cndb transaction id
+ * @level:  level of the node to move to
+ * @offset: offset of the node to move to
+ * @tag:    (input/output) cndb tag iterator, set to the kvset's new tag
+ *
+ * The kvset's mblocks are not rewritten, a C record lists them under a
+ * new tag with the new location, and they are kept if the transaction
+ * is rolled back.  The caller also logs a D record of no mblocks for
+ * the old tag.
+ */
+/* MTF_MOCK */
+merr_t
+kvset_log_move(struct kvset *kvset, u64 txid, u32 level, u32 offset, u64 *tag);
+
+/**
+ * kvset_move() - switch a kvset to the tag and level of a logged move
+ * @kvset:  kvset to move
+ * @tag:    tag from kvset_log_move()
+ * @level:  level of the node it moves to
+ *
+ * Must be called only after the move is committed, with the tree
+ * write lock held.
+ */
+/* MTF_MOCK */
+void
+kvset_move(struct kvset *kvset, u64 tag, u32 level);
+
 /* MTF_MOCK */
 struct mbset **
 kvset_get_vbsetv(struct kvset *km, uint *vbsetc);
@@ -248,6 +297,20 @@ kvset_list_add_tail(struct kvset *kvset, struct list_head *head);
 void
 kvset_get_max_key(struct kvset *km, void **key, uint *klen);
 
+/**
+ * kvset_key_fences() - get the key fences of a kvset
+ * @ks:   struct kvset handle
+ * @lo:   (output) first eight bytes of the smallest key (big-endian)
+ * @hi:   (output) first eight bytes of the largest key (big-endian)
+ *
+ * A key whose first eight bytes (zero padded) are not within [@lo, @hi]
+ * cannot be in the kvset.  The fences of a kvset with prefix tombstones
+ * admit every key, as its ptombs may hide keys outside its key range.
+ */
+/* MTF_MOCK */
+void
+kvset_key_fences(struct kvset *ks, u64 *lo, u64 *hi);
+
 /* MTF_MOCK */
 u64
 kvset_ctime(const struct kvset *kvset);
@@ -256,6 +319,19 @@ kvset_ctime(const struct kvset *kvset);
 int
 kvset_pt_start(struct kvset *kvset);
 
+/**
+ * kvset_ptomb_seqno() - seqno of a kvset's ptomb for the prefix of a key
+ * @kvset:    kvset to search
+ * @key:      key, at least as long as the tree prefix
+ * @klen:     length of @key
+ * @view_seq: ptombs newer than this are ignored
+ *
+ * Return: seqno of the newest ptomb for the tree prefix of @key that is
+ * visible at @view_seq, or 0 if there is none.
+ */
+u64
+kvset_ptomb_seqno(struct kvset *kvset, const void *key, uint klen, u64 view_seq);
+
 /**
  * kvset_kblk_start() - return index of kblock where this key may reside
  * @kvset:   kvset to search
@@ -272,6 +348,64 @@ kvset_pt_start(struct kvset *kvset);
 int
 kvset_kblk_start(struct kvset *kvset, const void *key, int len, bool reverse);
 
+/**
+ * kvset_pfx_may_exist() - check kblock prefix blooms for a cursor prefix
+ * @kvset:   kvset to check
+ * @pfx:     cursor prefix
+ * @pfx_len: length of @pfx
+ *
+ * Returns false only if @pfx is at least as long as the tree prefix and
+ * every kblock whose key range admits @pfx has a bloom filter holding tree
+ * prefixes (see cn_bloom_pfx) that does not contain the tree prefix of
+ * @pfx.  Prefix tombstones are not considered (see kvset_pt_start()).
+ */
+/* MTF_MOCK */
+bool
+kvset_pfx_may_exist(struct kvset *kvset, const void *pfx, u32 pfx_len);
+
+/**
+ * kvset_range_may_exist() - check if a kvset might hold keys in a key range
+ * @kvset: kvset to check
+ * @lo:    lower bound of the range (inclusive), may be zero length
+ * @lolen: length of @lo
+ * @hi:    upper bound of the range (inclusive)
+ * @hilen: length of @hi
+ *
+ * Return: %false if no key in [@lo, @hi] can be in @kvset, either because
+ * the range lies outside or between the key ranges of its kblocks, or
+ * because both bounds share a tree prefix that the prefix blooms (see
+ * cn_bloom_pfx) of all the overlapping kblocks exclude.  Prefix tombstones
+ * are not considered.
+ */
+/* MTF_MOCK */
+bool
+kvset_range_may_exist(struct kvset *kvset, const void *lo, u32 lolen, const void *hi, u32 hilen);
+
+/**
+ * kvset_lookup_prefetch() - find the kblock that may hold a key and prefetch
+ *                           the part of its bloom filter a lookup probes
+ * @kvset:  kvset to search
+ * @kt:     key to search for
+ * @kdisc:  key discriminator
+ *
+ * Return: index of the kblock to pass to kvset_lookup_may_exist(), or a
+ * negative value if no kblock's key range admits the key.
+ */
+int
+kvset_lookup_prefetch(struct kvset *kvset, struct kvs_ktuple *kt, const struct key_disc *kdisc);
+
+/**
+ * kvset_lookup_may_exist() - check if a point lookup could find a key
+ * @kvset:  kvset to search
+ * @kt:     key to search for
+ * @kbidx:  kblock index from kvset_lookup_prefetch()
+ *
+ * Returns false only if a lookup of @kt in @kvset would certainly return
+ * NOT_FOUND.  Kvsets with prefix tombstones always pass.
+ */
+bool
+kvset_lookup_may_exist(struct kvset *kvset, struct kvs_ktuple *kt, int kbidx);
+
 /**
  * kvset_lookup() - Search a kvset for a key and return its value
  * @kvset:  kvset to search
@@ -283,6 +417,7 @@ kvset_kblk_start(struct kvset *kvset, const void *key, int len, bool reverse);
  *                   If vbuf->b_buf is NULL, a buffer large enough to hold the
  *                   value will be allocated.
  */
+/* MTF_MOCK */
 merr_t
 kvset_lookup(
     struct kvset *         kvset,
@@ -292,8 +427,57 @@ kvset_lookup(
     enum key_lookup_res *  res,
     struct kvs_buf *       vbuf);
 
+/**
+ * kvset_lookup_lease() - Search a kvset for a key and lease its value
+ * @kvset:  kvset to search
+ * @kt:     key to search for
+ * @kdisc:  key discriminator
+ * @seq:    sequence number
+ * @result: (output) one of NOT_FOUND, FOUND_VAL, FOUND_TMB or FOUND_PTMB
+ * @lease:  (output) value if result==FOUND_VAL
+ *
+ * On FOUND_VAL a reference is acquired on @kvset (which pins its mbsets
+ * and hence the mapped value) and recorded in @lease->vl_pin.  The caller
+ * must drop it via kvset_put_ref() once done with the value.
+ */
+merr_t
+kvset_lookup_lease(
+    struct kvset *         kvset,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res,
+    struct kvs_vlease *    lease);
+
+/**
+ * kvset_lookup_willneed() - Search a kvset for a key and prefetch its value
+ * @kvset:  kvset to search
+ * @kt:     key to search for
+ * @kdisc:  key discriminator
+ * @seq:    sequence number
+ * @result: (output) one of NOT_FOUND, FOUND_VAL, FOUND_TMB or FOUND_PTMB
+ *
+ * The search itself reads the kblock pages on the path to the key, the
+ * vblock pages of a found value are read asynchronously via vbr_prefetch().
+ * Nothing is copied out.
+ */
+merr_t
+kvset_lookup_willneed(
+    struct kvset *         kvset,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res);
+
 struct query_ctx;
 
+/**
+ * kvset_wbti_alloc() - allocate a wbtree iterator for kvset_pfx_lookup()
+ * @wbti: (output) iterator
+ *
+ * The iterator is allocated from the calling thread's scratch arena, and
+ * hence the caller must hold a scratch mark until after kvset_wbti_free().
+ */
 merr_t
 kvset_wbti_alloc(void **wbti);
 
@@ -327,6 +511,27 @@ kvset_set_workid(struct kvset *km, u64 id);
 u64
 kvset_get_nth_kblock_handle(struct kvset *kvset, u32 index);
 
+/**
+ * kvset_get_nth_kblock_minkey() - Get the smallest key of the nth kblock in kvset
+ */
+/* MTF_MOCK */
+void
+kvset_get_nth_kblock_minkey(struct kvset *kvset, u32 index, const void **key, uint *klen);
+
+/**
+ * kvset_get_nth_kblock_maxkey() - Get the largest key of the nth kblock in kvset
+ */
+/* MTF_MOCK */
+void
+kvset_get_nth_kblock_maxkey(struct kvset *kvset, u32 index, const void **key, uint *klen);
+
+/**
+ * kvset_get_nth_kblock_metrics() - Get the key and tombstone counts of the nth kblock
+ */
+/* MTF_MOCK */
+const struct kblk_metrics *
+kvset_get_nth_kblock_metrics(struct kvset *kvset, u32 index);
+
 /**
  * kvset_get_nth_vblock_handle() - Get mblock handle of the nth vblock in kvset
  */
@@ -353,6 +558,15 @@ kvset_statsp(const struct kvset *ks);
 uint
 kvset_get_scatter_score(struct kvset *self);
 
+/**
+ * kvset_get_vgarb_pct() - percentage of a kvset's vblock space that holds
+ * no referenced values, e.g., values dropped by k-compactions
+ * @kvset: kvset handle
+ */
+/* MTF_MOCK */
+uint
+kvset_get_vgarb_pct(struct kvset *kvset);
+
 /* MTF_MOCK */
 uint
 kvset_get_scatter_pct(struct kvset *self);
@@ -369,6 +583,26 @@ kvset_get_hlog(struct kvset *km);
 uint
 kvset_get_compc(struct kvset *km);
 
+/**
+ * kvset_get_mclass() - media class of a kvset's kblocks
+ * @kvset: kvset handle
+ *
+ * The vblocks of a kvset are written to the same media class as its
+ * kblocks, except for the vblocks a k-compaction kept from its inputs.
+ */
+/* MTF_MOCK */
+enum mp_media_classp
+kvset_get_mclass(struct kvset *kvset);
+
+/**
+ * kvset_get_heat() - decayed count of the kblock probes and cursor seeks
+ * of a kvset, which halves every minute (see kvset_heat_read())
+ * @kvset: kvset handle
+ */
+/* MTF_MOCK */
+u64
+kvset_get_heat(struct kvset *kvset);
+
 /* MTF_MOCK */
 uint
 kvset_get_vgroups(struct kvset *km);
@@ -399,6 +633,7 @@ kvset_defer_compc(struct kvset *km, u64 totkeys);
  * @io_workq:  workqueue to assist with async I/O (see %FLAG_MBREAD)
  * @vra_wq:    workqueue for vblock readahead requests
  * @pc:
+ * @arena:     arena for the iterator's memory (e.g., a compaction's), or NULL
  * @flags:     option flags (see below)
  * @kv_iter:   (output) iterator
  *
@@ -407,6 +642,9 @@ kvset_defer_compc(struct kvset *km, u64 totkeys);
  *     be used with mcache map based iteration.
  *   - %kvset_iter_flag_mcache: If set, use mcache maps to access
  *     mblock data.  If not set, access data with mblock read.
+ *   - %kvset_iter_flag_noreuse: Release the mcache pages consumed by
+ *     the iterator, except for those that were already resident.  Only
+ *     meaningful with %kvset_iter_flag_mcache.
  *
  * Notes:
  *   - @io_workq is ignored when iterating with mcache maps.
@@ -432,6 +670,7 @@ kvset_iter_create(
     struct workqueue_struct *io_workq,
     struct workqueue_struct *vra_wq,
     struct perfc_set *       pc,
+    struct cheap *           arena,
     enum kvset_iter_flags    flags,
     struct kv_iterator **    kv_iter);
 
@@ -457,6 +696,22 @@ kvset_iter_set_start(struct kv_iterator *kv_iter, int start, int pt_start);
 merr_t
 kvset_iter_seek(struct kv_iterator *handle, const void *key, int len, bool *eof);
 
+/**
+ * kvset_iter_set_limit() - bound a forward iterator at a key
+ * @handle:  kv_iter from kvset_iter_create
+ * @key:     last key of interest (or NULL for no bound)
+ * @len:     length of key
+ *
+ * The iterator stops reading kblocks whose keys all lie beyond @key, and
+ * stops value readahead once it enters the kblock that holds the bound.
+ * Keys beyond the bound may still be returned, the caller filters them.
+ * The key must remain valid until the limit is reset.  The bound is
+ * ignored by reverse iterators.
+ */
+/* MTF_MOCK */
+void
+kvset_iter_set_limit(struct kv_iterator *handle, const void *key, uint len);
+
 /* MTF_MOCK */
 void
 kvset_iter_mark_eof(struct kv_iterator *handle);
@@ -469,6 +724,12 @@ kvset_from_iter(struct kv_iterator *iv);
 merr_t
 kvset_iter_next_key(struct kv_iterator *handle, struct key_obj *kobj, struct kvset_iter_vctx *vc);
 
+/**
+ * kvset_iter_next_val() - get the value of a vref from kvset_iter_next_vref()
+ *
+ * A compressed value (vtype_cval) is returned as is, i.e., @vdata points to
+ * @complen bytes of lz4 compressed data and @vlen is left unchanged.
+ */
 /* MTF_MOCK */
 merr_t
 kvset_iter_next_val(
@@ -478,8 +739,15 @@ kvset_iter_next_val(
     uint                    vbidx,
     uint                    vboff,
     const void **           vdata,
-    uint *                  vlen);
+    uint *                  vlen,
+    uint                    complen);
 
+/**
+ * kvset_iter_next_vref() - get the next vref of the current key
+ *
+ * @complen is set to the stored length of a compressed value, in which case
+ * @vlen is its uncompressed length.  It is set to zero for all other vtypes.
+ */
 /* MTF_MOCK */
 bool
 kvset_iter_next_vref(
@@ -490,13 +758,15 @@ kvset_iter_next_vref(
     uint *                  vbidx,
     uint *                  vboff,
     const void **           vdata,
-    uint *                  vlen);
+    uint *                  vlen,
+    uint *                  complen);
 
 /**
  * kvset_keep_vblocks - populate a vblock map from many-to-one
  * @out:  the map to populate
  * @iv:   the vector of input iterators
  * @niv:  the number of iterator
+ * @gcv:  if not NULL, the iterators whose vblocks are not kept
  *
  * This function creates a map of vblock offsets necessary
  * for correctly locating the values when used in a k-compaction.
@@ -507,7 +777,7 @@ kvset_iter_next_vref(
  * NB: This function lives in keep.c so it can be tested.
  */
 merr_t
-kvset_keep_vblocks(struct kvset_vblk_map *out, struct kv_iterator **iv, int niv);
+kvset_keep_vblocks(struct kvset_vblk_map *out, struct kv_iterator **iv, int niv, const bool *gcv);
 
 /* MTF_MOCK */
 void
@@ -520,6 +790,7 @@ kvset_minkey(struct kvset *ks, const void **minkey, u16 *minklen);
 /*-  kvset checker  ---------------------------------------------------------*/
 
 struct vb_meta;
+struct cheap;
 
 typedef void
 print_cb(char *, ...);
@@ -558,6 +829,47 @@ kc_kblock_check(struct mpool *ds, u64 kblkid, struct vb_meta *vb_meta);
 merr_t
 kc_kvset_check(struct mpool *ds, struct kvs_cparams *cp, struct kvset_meta *meta, u8 *khmapv);
 
+/**
+ * kc_kblock_image_check() - Verify a kblock image of a root node kvset
+ * @cp:    kvs create-time params
+ * @idx:   index of the kblock in its kvset, for messages
+ * @kblk:  page aligned kblock image
+ * @len:   length of @kblk
+ * @vlenv: lengths of the kvset's vblocks
+ * @vblkc: number of vblocks
+ *
+ * Checks a kblock that is not (yet) in an mblock, along with the offsets
+ * in its headers against @len.
+ */
+merr_t
+kc_kblock_image_check(
+    struct kvs_cparams *cp,
+    u32                 idx,
+    void *              kblk,
+    size_t              len,
+    const u32 *         vlenv,
+    u32                 vblkc);
+
+/**
+ * kc_vblock_image_check() - Verify the header and length of a vblock image
+ * @idx:  index of the vblock in its kvset, for messages
+ * @vblk: vblock image, at least its header
+ * @len:  length of the whole image
+ */
+merr_t
+kc_vblock_image_check(u32 idx, const void *vblk, size_t len);
+
+/**
+ * kvset_verify() - Verify the on-media contents of a live kvset
+ * @ks:  kvset
+ * @loc: location of the kvset's node
+ *
+ * Reads the kvset's kblocks and vblock headers with mblock reads, not
+ * through its mcache maps, and checks them with kc_kvset_check().
+ */
+merr_t
+kvset_verify(struct kvset *ks, const struct cn_node_loc *loc);
+
 /**
  * kvset_iter_next_val_direct() -  read value via direct io
  * @handle: handle to kv iterator
@@ -8,6 +8,7 @@
 #include <hse_ikvdb/key_hash.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/kvs_rparams.h>
 
 #include <hse/hse_limits.h>
 
@@ -15,6 +16,7 @@
 #include <hse_util/event_counter.h>
 #include <hse_util/slab.h>
 #include <hse_util/bonsai_tree.h>
+#include <hse_util/compression.h>
 
 #include "kcompact.h"
 #include "spill.h"
@@ -53,9 +55,19 @@ kvset_builder_create(
         goto err_exit2;
 
     bld->cn = cn;
+    bld->vcomp = cn_get_flags(cn) & CN_CFLAG_VCOMP_LZ4;
+    bld->ival_max = CN_SMALL_VALUE_THRESHOLD;
+    if (cn_get_rp(cn))
+        bld->ival_max = cn_get_rp(cn)->kblock_ival_max;
     bld->key_stats.seqno_prev = U64_MAX;
     bld->key_stats.seqno_prev_ptomb = U64_MAX;
 
+    /* Ingest builders account their own writes for the c0 ingest stats. */
+    if (flags & KVSET_BUILDER_FLAGS_INGEST) {
+        kbb_set_merge_stats(bld->kbb, &bld->mstats);
+        vbb_set_merge_stats(bld->vbb, &bld->mstats);
+    }
+
     *bld_out = bld;
     return 0;
 
@@ -66,11 +78,13 @@ err_exit1:
     return err;
 }
 
+/* Ensure room for one more kmd entry carrying @ilen bytes of immediate value.
+ */
 static int
-reserve_kmd(struct kmd_info *ki)
+reserve_kmd(struct kmd_info *ki, uint ilen)
 {
     uint initial = 256;
-    uint need = 64;
+    uint need = 64 + ilen;
     uint min_size = ki->kmd_used + need;
     uint new_size;
     u8 * new_mem;
@@ -142,21 +156,48 @@ kvset_builder_add_key(struct kvset_builder *self, const struct key_obj *kobj)
     return ev(err);
 }
 
+/* Compress a value into the builder's compression buffer.  Returns the
+ * compressed length, or zero if the value should be stored uncompressed
+ * because it did not shrink.
+ */
+static uint
+kvset_builder_compress(struct kvset_builder *self, const void *vdata, uint vlen)
+{
+    uint   complen;
+    merr_t err;
+
+    if (!self->vcbuf) {
+        self->vcbuf = malloc(compress_lz4_bound(HSE_KVS_VLEN_MAX));
+        if (ev(!self->vcbuf)) {
+            self->vcomp = false;
+            return 0;
+        }
+    }
+
+    err = compress_lz4(vdata, vlen, self->vcbuf, compress_lz4_bound(vlen), &complen);
+    if (ev(err))
+        return 0;
+
+    return complen < vlen ? complen : 0;
+}
+
 merr_t
 kvset_builder_add_val(
     struct kvset_builder *  self,
     u64                     seq,
     const void *            vdata,
     uint                    vlen,
+    uint                    complen,
     struct c1_bonsai_vbldr *vbldr)
 {
     merr_t           err;
     uint             vbidx = 0, vboff = 0;
+    uint             omlen;
     u64              vbid = 0;
     u64              seqno_prev;
     struct kmd_info *ki = vdata == HSE_CORE_TOMB_PFX ? &self->sec : &self->main;
 
-    if (reserve_kmd(ki))
+    if (reserve_kmd(ki, vlen <= self->ival_max ? vlen : 0))
         return merr(ev(ENOMEM));
 
     if (vdata == HSE_CORE_TOMB_REG) {
@@ -168,26 +209,49 @@ kvset_builder_add_val(
         self->last_ptseq = seq;
     } else if (vlen == 0) {
         kmd_add_zval(self->main.kmd, &self->main.kmd_used, seq);
-    } else if (vlen <= CN_SMALL_VALUE_THRESHOLD) {
+    } else if (vlen <= self->ival_max && !complen) {
         assert(vdata);
-        kmd_add_ival(self->main.kmd, &self->main.kmd_used, seq, vdata, vlen);
+        if (vlen <= U8_MAX)
+            kmd_add_ival(self->main.kmd, &self->main.kmd_used, seq, vdata, vlen);
+        else
+            kmd_add_lival(self->main.kmd, &self->main.kmd_used, seq, vdata, vlen);
         self->key_stats.tot_vlen += vlen;
     } else {
         assert(vdata);
 
-        if (kvset_vbuilder_vblock_exists(self, seq, vdata, vlen, vbldr, &vbidx, &vboff, &vbid))
+        if (!complen &&
+            kvset_vbuilder_vblock_exists(self, seq, vdata, vlen, vbldr, &vbidx, &vboff, &vbid)) {
+            omlen = vlen;
             goto skip_add_entry;
+        }
+
+        /* A value that arrives compressed (e.g., from a spill) is stored
+         * as is.  Otherwise compress it if the kvs asks for it.
+         */
+        if (!complen && self->vcomp) {
+            complen = kvset_builder_compress(self, vdata, vlen);
+            if (complen)
+                vdata = self->vcbuf;
+        }
 
-        err = vbb_add_entry(self->vbb, vdata, vlen, &vbid, &vbidx, &vboff);
+        omlen = complen ?: vlen;
+
+        err = vbb_add_entry(self->vbb, vdata, omlen, &vbid, &vbidx, &vboff);
         if (ev(err))
             return err;
 
-        self->key_stats.c0_vlen += vlen;
+        self->key_stats.c0_vlen += omlen;
 
     skip_add_entry:
-        kmd_add_val(self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen);
+        vbidx += self->vbidx_base;
+
+        if (complen)
+            kmd_add_cval(
+                self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen, complen);
+        else
+            kmd_add_val(self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen);
 
-        self->vused += vlen;
+        self->vused += omlen;
         self->key_stats.tot_vlen += vlen;
     }
 
@@ -212,13 +276,23 @@ kvset_builder_add_val(
 }
 
 merr_t
-kvset_builder_add_vref(struct kvset_builder *self, u64 seq, uint vbidx, uint vboff, uint vlen)
+kvset_builder_add_vref(
+    struct kvset_builder *self,
+    u64                   seq,
+    uint                  vbidx,
+    uint                  vboff,
+    uint                  vlen,
+    uint                  complen)
 {
-    if (reserve_kmd(&self->main))
+    if (reserve_kmd(&self->main, 0))
         return merr(ev(ENOMEM));
 
-    kmd_add_val(self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen);
-    self->vused += vlen;
+    if (complen)
+        kmd_add_cval(self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen, complen);
+    else
+        kmd_add_val(self->main.kmd, &self->main.kmd_used, seq, vbidx, vboff, vlen);
+
+    self->vused += complen ?: vlen;
     self->key_stats.tot_vlen += vlen;
     self->key_stats.nvals++;
 
@@ -233,7 +307,7 @@ kvset_builder_add_nonval(struct kvset_builder *self, u64 seq, enum kmd_vtype vty
 {
     struct kmd_info *ki = vtype == vtype_ptomb ? &self->sec : &self->main;
 
-    if (reserve_kmd(ki))
+    if (reserve_kmd(ki, 0))
         return merr(ev(ENOMEM));
 
     assert(vtype != vtype_zval);
@@ -271,6 +345,7 @@ kvset_builder_destroy(struct kvset_builder *bld)
 
     free(bld->main.kmd);
     free(bld->sec.kmd);
+    free(bld->vcbuf);
     free(bld);
 }
 
@@ -405,6 +480,31 @@ kvset_builder_set_mclass(struct kvset_builder *self, enum mp_media_classp mclass
     kvset_builder_set_mclass_kvblk(self, mclass, mclass);
 }
 
+enum mp_media_classp
+kvset_mclass_lvl(unsigned long map, uint level, enum mp_media_classp dflt)
+{
+    if (map == CN_MCLASS_MAP_UNSET)
+        return dflt;
+
+    return (map >> min_t(uint, level, 63)) & 1 ? MP_MED_CAPACITY : MP_MED_STAGING;
+}
+
+void
+kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    self,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+    kvset_builder_set_mclass_kvblk(
+        self,
+        kvset_mclass_lvl(rp->cn_kblk_mclass_map, level, dflt),
+        kvset_mclass_lvl(rp->cn_vblk_mclass_map, level, dflt));
+
+    kbb_set_life(self->kbb, mblock_life_cn(false, level));
+    vbb_set_life(self->vbb, mblock_life_cn(true, level));
+}
+
 void
 kvset_builder_set_merge_stats(struct kvset_builder *self, struct cn_merge_stats *stats)
 {
@@ -412,6 +512,46 @@ kvset_builder_set_merge_stats(struct kvset_builder *self, struct cn_merge_stats
     vbb_set_merge_stats(self->vbb, stats);
 }
 
+void
+kvset_builder_get_wstats(
+    struct kvset_builder *self,
+    u64 *                 kblk_ns,
+    u64 *                 kblk_bytes,
+    u64 *                 vblk_ns,
+    u64 *                 vblk_bytes)
+{
+    const struct cn_merge_stats *ms = &self->mstats;
+
+    *kblk_ns = ms->ms_kblk_alloc.op_time + ms->ms_kblk_write.op_time +
+               ms->ms_kblk_write_async.op_time + ms->ms_kblk_flush.op_time;
+    *kblk_bytes = ms->ms_kblk_write.op_size + ms->ms_kblk_write_async.op_size;
+
+    *vblk_ns = ms->ms_vblk_alloc.op_time + ms->ms_vblk_write.op_time +
+               ms->ms_vblk_write_async.op_time + ms->ms_vblk_flush.op_time;
+    *vblk_bytes = ms->ms_vblk_write.op_size + ms->ms_vblk_write_async.op_size;
+}
+
+void
+kvset_builder_set_node_level(struct kvset_builder *self, uint level)
+{
+    kbb_set_node_level(self->kbb, level);
+}
+
+void
+kvset_builder_set_vbidx_base(struct kvset_builder *self, uint base)
+{
+    self->vbidx_base = base;
+}
+
+void
+kvset_builder_join(struct kvset_builder *self, struct kvset_builder *src)
+{
+    self->seqno_min = min_t(u64, self->seqno_min, src->seqno_min);
+    self->seqno_max = max_t(u64, self->seqno_max, src->seqno_max);
+
+    kbb_merge_hlog(self->kbb, src->kbb);
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "kvset_builder_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -27,7 +27,8 @@ struct kmd_info {
  * @vblk_list:       list of vblock ids allocated by @vbb
  * @seqno_max:       max seqno present in output kvset
  * @seqno_min:       min seqno present in output kvset
- * @vused:           sum of vlen of all selected values
+ * @vused:           sum of vlen of all selected values (as stored, i.e.,
+ *                   after compression)
  * @main:            kmd info about the main wbtree
  * @sec:             kmd info about the ptomb wbtree
  * @key_stats:       stats regarding the current key being added
@@ -35,6 +36,9 @@ struct kmd_info {
  *                   only if cn is a capped.
  * @last_ptlen:      length of @last_ptomb
  * @vblk_baseidx:    base index used for coalescing multiple vblock builders
+ * @vbidx_base:      index in the new kvset of the first vblock of @vbb
+ * @vcomp:           compress values before adding them to @vbb
+ * @vcbuf:           compression output buffer (allocated on first use)
  *
  * This struct contains the output kvset when merging multiple input kvsets
  * into one output kvset.  It is used for ingest, compaction and spill.  When
@@ -69,6 +73,11 @@ struct kvset_builder {
     u32 last_ptlen;
     u64 last_ptseq;
     u32 vblk_baseidx;
+    u32 vbidx_base;
+
+    bool  vcomp;
+    void *vcbuf;
+    uint  ival_max;
 };
 
 bool
@@ -12,6 +12,8 @@
 #include <hse_util/hash.h>
 #include <hse_util/bitmap.h>
 #include <hse_util/log2.h>
+#include <hse_util/crc32c.h>
+#include <hse_util/byteorder.h>
 
 #include <mpool/mpool.h>
 
@@ -36,12 +38,32 @@
 
 #define pgoff(x) ((x)*PAGE_SIZE)
 
+static void
+wbt7_lfe_kobj(void *node, struct wbt_lfe_omf *lfe, struct key_obj *kobj)
+{
+    wbt7_lfe_key(node, lfe, &kobj->ko_pfx, &kobj->ko_pfx_len, &kobj->ko_sfx, &kobj->ko_sfx_len);
+}
+
+static void
+wbt5_lfe_kobj(void *node, struct wbt_lfe_omf *lfe, struct key_obj *kobj)
+{
+    wbt_node_pfx(node, &kobj->ko_pfx, &kobj->ko_pfx_len);
+    wbt_lfe_key(node, lfe, &kobj->ko_sfx, &kobj->ko_sfx_len);
+}
+
+static void
+wbt4_lfe_kobj(void *node, struct wbt_lfe_omf *lfe, struct key_obj *kobj)
+{
+    wbt4_node_pfx(node, &kobj->ko_pfx, &kobj->ko_pfx_len);
+    wbt4_lfe_key(node, lfe, &kobj->ko_sfx, &kobj->ko_sfx_len);
+}
+
 struct wbt_ops {
     struct wbt_lfe_omf *(*wops_lfe)(void *node, int nth);
 
     void (*wops_node_pfx)(void *node, const void **pfx, uint *pfx_len);
 
-    void (*wops_lfe_key)(void *node, struct wbt_lfe_omf *lfe, const void **kdata, uint *klen);
+    void (*wops_lfe_kobj)(void *node, struct wbt_lfe_omf *lfe, struct key_obj *kobj);
 
     uint (*wops_lfe_kmd)(void *node, struct wbt_lfe_omf *lfe);
 
@@ -52,7 +74,9 @@ struct wbt_ops {
 
 struct kb_info {
     /* kblock contents */
-    void *blk;
+    void * blk;
+    size_t len;
+    void *nodes; /* wbtree nodes, decompressed if the leaves are compressed */
 
     /* position of current entity */
     u64 blkid;
@@ -92,10 +116,9 @@ struct vb_meta {
 };
 
 struct node_info {
-    const void *maxkey;
-    size_t      maxlen;
-    u32         vboff;
-    u32         vbidx;
+    struct key_obj maxkey;
+    u32            vboff;
+    u32            vbidx;
 };
 
 /* Map of all nodes pointed to directly.
@@ -211,6 +234,10 @@ kc_loc_check(struct kb_info *kb, struct key_obj *kobj, u64 *hash_out)
         pfxhash = hse_hash64(key, hashlen);
     }
 
+    /* The key ranges of the nodes of a range tree are not persisted. */
+    if (kb->cp->cp_range)
+        return 0;
+
     /* Check if the key can land in this node. Verify if all relevant bits
      * of the hash lead up the right nodes to the root node.
      */
@@ -240,7 +267,7 @@ rightmost_key(struct kb_info *kb, int idx, struct key_obj *kobj, struct nodemap
     void *node;
     int   num_keys;
 
-    node = kb->blk + pgoff(1 + idx);
+    node = kb->nodes + pgoff(idx);
     num_keys = omf_wbn_num_keys(node);
 
     if (omf_wbn_magic(node) == WBT_LFE_NODE_MAGIC) {
@@ -249,8 +276,7 @@ rightmost_key(struct kb_info *kb, int idx, struct key_obj *kobj, struct nodemap
         lfe = kb->wbt_ops.wops_lfe(node, 0);
         lfe += (num_keys - 1);
 
-        kb->wbt_ops.wops_lfe_key(node, lfe, &kobj->ko_sfx, &kobj->ko_sfx_len);
-        kb->wbt_ops.wops_node_pfx(node, &kobj->ko_pfx, &kobj->ko_pfx_len);
+        kb->wbt_ops.wops_lfe_kobj(node, lfe, kobj);
 
         return 0;
     }
@@ -289,12 +315,17 @@ check_vref(
     struct kb_metrics *metrics,
     struct vb_meta *   vb_meta,
     u32 *              last_vbidx,
-    u32 *              last_vboff)
+    u32 *              last_vboff,
+    bool               compressed)
 {
-    u32  vbidx, vlen, vboff;
+    u32  vbidx, vlen, vboff, ulen;
     bool err = false;
 
-    kmd_val(kb_info->kmd, off, &vbidx, &vboff, &vlen);
+    /* Check the extent of a compressed value's stored data. */
+    if (compressed)
+        kmd_cval(kb_info->kmd, off, &vbidx, &vboff, &ulen, &vlen);
+    else
+        kmd_val(kb_info->kmd, off, &vbidx, &vboff, &vlen);
 
     if (*last_vboff > 0 && vbidx == *last_vbidx && vboff < *last_vboff) {
         err = true;
@@ -321,7 +352,7 @@ check_vref(
     if (!vb_meta)
         goto done;
 
-    if (vbidx > vb_meta->blk_list->n_blks) {
+    if (vbidx >= vb_meta->blk_list->n_blks) {
         err = true;
         kmd_err(
             kb_info,
@@ -331,9 +362,7 @@ check_vref(
             vboff,
             vlen,
             vb_meta->blk_list->n_blks);
-    }
-
-    if (vboff + vlen > vb_meta->props[vbidx].mpr_write_len) {
+    } else if (vboff + vlen > vb_meta->props[vbidx].mpr_write_len) {
         err = true;
         kmd_err(
             kb_info,
@@ -364,15 +393,9 @@ wbn_leaf_check(
     int                 i, j;
     struct wbt_lfe_omf *lfe;
 
-    const void *key = 0;
-    const void *pfx = 0;
-    u32         klen = 0;
-    u32         pfx_len = 0;
-
-    const void *prev_key = prev->maxkey;
-    u32         prev_klen = prev->maxlen;
-    u32         last_vbidx = prev->vbidx;
-    u32         last_vboff = prev->vboff;
+    struct key_obj prev_kobj = prev->maxkey;
+    u32            last_vbidx = prev->vbidx;
+    u32            last_vboff = prev->vboff;
 
     u32    kmd_cnt, kcnt;
     size_t lfe_kmd, off;
@@ -387,28 +410,22 @@ wbn_leaf_check(
 
     lfe = kb_info->wbt_ops.wops_lfe(hdr, 0);
 
-    kb_info->wbt_ops.wops_node_pfx(hdr, &pfx, &pfx_len);
     for (i = 0; i < kcnt; i++) {
         struct key_obj    kobj;
         struct kvs_ktuple kt;
 
-        kb_info->wbt_ops.wops_lfe_key(hdr, lfe, &key, &klen);
-        kt.kt_data = key;
-        kt.kt_len = klen;
+        kb_info->wbt_ops.wops_lfe_kobj(hdr, lfe, &kobj);
+        kt.kt_data = kobj.ko_sfx;
+        kt.kt_len = kobj.ko_sfx_len;
 
         kb_info->wbt_entry = i;
 
         /* Check key */
-        if (prev_key && keycmp(key, klen, prev_key, prev_klen) <= 0) {
+        if (key_obj_len(&prev_kobj) && key_obj_cmp(&kobj, &prev_kobj) <= 0) {
             err = true;
             lfe_err(kb_info, "keys out of order");
         }
 
-        kobj.ko_pfx = pfx;
-        kobj.ko_pfx_len = pfx_len;
-        kobj.ko_sfx = key;
-        kobj.ko_sfx_len = klen;
-
         if (kb_info->is_kvset && kc_loc_check(kb_info, &kobj, &kt.kt_hash)) {
             err = true;
             break;
@@ -419,8 +436,7 @@ wbn_leaf_check(
             lfe_err(kb_info, "bloom cannot find this key");
         }
 
-        prev_key = key;
-        prev_klen = klen;
+        prev_kobj = kobj;
 
         /* Check key's kmd region */
         lfe_kmd = kb_info->wbt_ops.wops_lfe_kmd(hdr, lfe);
@@ -450,21 +466,29 @@ wbn_leaf_check(
 
             switch (vtype) {
                 case vtype_val:
-                    if (check_vref(kb_info, &off, kb_metrics, vb_meta, &last_vbidx, &last_vboff) !=
-                        0)
+                case vtype_cval:
+                    if (check_vref(
+                            kb_info,
+                            &off,
+                            kb_metrics,
+                            vb_meta,
+                            &last_vbidx,
+                            &last_vboff,
+                            vtype == vtype_cval) != 0)
                         err = true;
                     break;
                 case vtype_tomb:
                     kb_metrics->tombs++;
                     break;
                 case vtype_ival:
-                    kmd_ival(kb_info->kmd, &off, &ival, &ivlen);
-                    if (ivlen > CN_SMALL_VALUE_THRESHOLD) {
+                case vtype_lival:
+                    if (vtype == vtype_ival)
+                        kmd_ival(kb_info->kmd, &off, &ival, &ivlen);
+                    else
+                        kmd_lival(kb_info->kmd, &off, &ival, &ivlen);
+                    if (ivlen > CN_IVAL_MAX) {
                         err = true;
-                        kmd_err(
-                            kb_info,
-                            "ival larger than "
-                            "CN_SMALL_VALUE_THRESHOLD");
+                        kmd_err(kb_info, "ival larger than CN_IVAL_MAX");
                     }
                     kb_metrics->val_bytes += ivlen;
                     break;
@@ -479,8 +503,7 @@ wbn_leaf_check(
         kb_metrics->key_bytes += key_obj_len(&kobj);
     }
 
-    prev->maxkey = key;
-    prev->maxlen = klen;
+    prev->maxkey = prev_kobj;
     prev->vbidx = last_vbidx;
     prev->vboff = last_vboff;
 
@@ -587,7 +610,7 @@ kc_vblock_meta(struct mpool *ds, struct blk_list *list)
         if (omf_vbh_magic(vb_hdr) != VBLOCK_HDR_MAGIC)
             print_err("vblock 0x%08lx: incorrect magic", vbid);
 
-        if (omf_vbh_version(vb_hdr) > VBLOCK_HDR_VERSION2)
+        if (omf_vbh_version(vb_hdr) > VBLOCK_HDR_VERSION3)
             print_err("vblock 0x%08lx: invalid version", vbid);
 
         free_aligned(vb_buf);
@@ -603,7 +626,7 @@ kc_vblock_meta(struct mpool *ds, struct blk_list *list)
 
 /* Read contents of an mblock in a page aligned buffer */
 static int
-read_mblock(struct mpool *ds, u64 blkid, void **buf)
+read_mblock(struct mpool *ds, u64 blkid, void **buf, size_t *lenp)
 {
     merr_t       err;
     int          rc = 0;
@@ -664,6 +687,38 @@ read_mblock(struct mpool *ds, u64 blkid, void **buf)
     }
 
     *buf = mem;
+    *lenp = len;
+
+    return 0;
+}
+
+/* Verify the page checksums of a v8 kblock */
+static int
+verify_crc(struct kb_info *kb)
+{
+    struct kblock_hdr_omf *kb_hdr = kb->blk;
+    const u32 *            crcv;
+    u32                    pg, pgc, crc;
+
+    pgc = omf_kbh_crc_doff_pg(kb_hdr);
+    if (!omf_kbh_crc_dlen_pg(kb_hdr))
+        return 0;
+
+    if (MBLK_CRC_PGC(pgc) > omf_kbh_crc_dlen_pg(kb_hdr) ||
+        pgoff((size_t)pgc + omf_kbh_crc_dlen_pg(kb_hdr)) > kb->len) {
+        kb_err(kb, "invalid page checksum region");
+        return 1;
+    }
+
+    crcv = kb->blk + pgoff(pgc);
+
+    for (pg = 0; pg < pgc; pg++) {
+        crc = crc32c(0, kb->blk + pgoff(pg), PAGE_SIZE);
+        if (crc != le32_to_cpu(crcv[pg])) {
+            kb_err(kb, "page %u checksum mismatch", pg);
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -682,7 +737,7 @@ verify_minmax(struct kb_info *kb)
     u32   maxklen = omf_kbh_max_klen(kb_hdr);
 
     struct wbt_hdr_omf *wbt_hdr = kb->blk + omf_kbh_wbt_hoff(kb_hdr);
-    void *              node_hdr = kb->blk + pgoff(omf_wbt_leaf(wbt_hdr) + 1);
+    void *              node_hdr = kb->nodes + pgoff(omf_wbt_leaf(wbt_hdr));
 
     u16 leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
 
@@ -692,8 +747,7 @@ verify_minmax(struct kb_info *kb)
     lfe = kb->wbt_ops.wops_lfe(node_hdr, 0);
 
     key2kobj(&ref, minkey, minklen);
-    kb->wbt_ops.wops_node_pfx(node_hdr, &key.ko_pfx, &key.ko_pfx_len);
-    kb->wbt_ops.wops_lfe_key(node_hdr, lfe, &key.ko_sfx, &key.ko_sfx_len);
+    kb->wbt_ops.wops_lfe_kobj(node_hdr, lfe, &key);
     if (key_obj_cmp(&key, &ref) != 0) {
         err = true;
         kb_err(kb, "incorrect min key in hdr");
@@ -705,8 +759,7 @@ verify_minmax(struct kb_info *kb)
     lfe += omf_wbn_num_keys(node_hdr) - 1;
 
     key2kobj(&ref, maxkey, maxklen);
-    kb->wbt_ops.wops_node_pfx(node_hdr, &key.ko_pfx, &key.ko_pfx_len);
-    kb->wbt_ops.wops_lfe_key(node_hdr, lfe, &key.ko_sfx, &key.ko_sfx_len);
+    kb->wbt_ops.wops_lfe_kobj(node_hdr, lfe, &key);
     if (key_obj_cmp(&key, &ref) != 0) {
         err = true;
         kb_err(kb, "incorrect max key in hdr");
@@ -715,6 +768,42 @@ verify_minmax(struct kb_info *kb)
     return err ? 1 : 0;
 }
 
+/* Version 8 trees have their leaf nodes compressed, so make an uncompressed
+ * copy of all the tree's nodes for the checks that follow.
+ */
+static merr_t
+kc_wbt_nodes(struct kb_info *kb, struct wbt_hdr_omf *wbt_hdr, void *rgn)
+{
+    u32    leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+    u32    nodec = omf_wbt_root(wbt_hdr) + 1;
+    merr_t err;
+    u32    i, off;
+
+    kb->nodes = alloc_page_aligned(pgoff(nodec), GFP_KERNEL);
+    if (!kb->nodes) {
+        kb_err(kb, "cannot allocate memory (%lu bytes)", pgoff(nodec));
+        return merr(ev(ENOMEM));
+    }
+
+    for (i = 0; i < leaf_cnt; i++) {
+        off = wbt8_leaf_off(rgn, i);
+
+        err = wbt8_leaf_decode(rgn + off, wbt8_leaf_off(rgn, i + 1) - off, kb->nodes + pgoff(i));
+        if (err) {
+            lfe_err(kb, "cannot decompress leaf node %u", i);
+            free_aligned(kb->nodes);
+            return err;
+        }
+    }
+
+    memcpy(
+        kb->nodes + pgoff(leaf_cnt),
+        rgn + pgoff(omf_wbt_leaf_pgc(wbt_hdr)),
+        pgoff(nodec - leaf_cnt));
+
+    return 0;
+}
+
 /* If 'is_kvset' is false, the arguments following it will be ignored since
  * the information of the kblock (i.e. info regarding its location in the
  * cn tree) is missing.
@@ -730,10 +819,12 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
 
     struct nodemap kb_map;
 
-    int  i, errcnt = 0;
-    int  root_idx;
-    u32  leaf_cnt;
-    uint wbt_ver;
+    int    i, errcnt = 0;
+    int    root_idx;
+    u32    leaf_cnt, leaf_pgc;
+    uint   wbt_ver;
+    void * rgn;
+    merr_t err;
 
     if (!kb_info->blk)
         return merr(ev(EINVAL));
@@ -749,6 +840,10 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
     if (errcnt)
         return merr(ev(EILSEQ));
 
+    /* Nothing else can be trusted if the checksums do not match. */
+    if (omf_kbh_version(kb_hdr) > KBLOCK_HDR_VERSION7 && verify_crc(kb_info))
+        return merr(ev(EILSEQ));
+
     wbt_hdr = kb_info->blk + omf_kbh_wbt_hoff(kb_hdr);
 
     if (omf_wbt_magic(wbt_hdr) != WBT_TREE_MAGIC && (++errcnt))
@@ -762,10 +857,20 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
 
     wbt_ver = omf_wbt_version(wbt_hdr);
     switch (wbt_ver) {
+        case WBT_TREE_VERSION8:
+        case WBT_TREE_VERSION7:
+            kb_info->wbt_ops.wops_lfe = wbt_lfe;
+            kb_info->wbt_ops.wops_node_pfx = wbt_node_pfx;
+            kb_info->wbt_ops.wops_lfe_kobj = wbt7_lfe_kobj;
+            kb_info->wbt_ops.wops_lfe_kmd = wbt_lfe_kmd;
+            kb_info->wbt_ops.wops_ine = wbt_ine;
+            kb_info->wbt_ops.wops_ine_key = wbt_ine_key;
+            break;
+        case WBT_TREE_VERSION6:
         case WBT_TREE_VERSION5:
             kb_info->wbt_ops.wops_lfe = wbt_lfe;
             kb_info->wbt_ops.wops_node_pfx = wbt_node_pfx;
-            kb_info->wbt_ops.wops_lfe_key = wbt_lfe_key;
+            kb_info->wbt_ops.wops_lfe_kobj = wbt5_lfe_kobj;
             kb_info->wbt_ops.wops_lfe_kmd = wbt_lfe_kmd;
             kb_info->wbt_ops.wops_ine = wbt_ine;
             kb_info->wbt_ops.wops_ine_key = wbt_ine_key;
@@ -774,7 +879,7 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
         default:
             kb_info->wbt_ops.wops_lfe = wbt4_lfe;
             kb_info->wbt_ops.wops_node_pfx = wbt4_node_pfx;
-            kb_info->wbt_ops.wops_lfe_key = wbt4_lfe_key;
+            kb_info->wbt_ops.wops_lfe_kobj = wbt4_lfe_kobj;
             kb_info->wbt_ops.wops_lfe_kmd = wbt_lfe_kmd; /* same as v5 */
             kb_info->wbt_ops.wops_ine = wbt4_ine;
             kb_info->wbt_ops.wops_ine_key = wbt4_ine_key;
@@ -793,14 +898,27 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
         return merr(ev(EILSEQ));
 
     leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+    leaf_pgc = leaf_cnt;
+
+    rgn = (void *)kb_hdr + pgoff(omf_kbh_wbt_doff_pg(kb_hdr));
+    kb_info->nodes = rgn;
 
-    node_hdr = (void *)kb_hdr + pgoff(omf_wbt_leaf(wbt_hdr) + 1);
+    if (wbt_ver >= WBT_TREE_VERSION8) {
+        leaf_pgc = omf_wbt_leaf_pgc(wbt_hdr);
+
+        err = kc_wbt_nodes(kb_info, wbt_hdr, rgn);
+        if (err)
+            return err;
+    }
+
+    node_hdr = kb_info->nodes + pgoff(omf_wbt_leaf(wbt_hdr));
 
     kb_map.len = omf_wbt_root(wbt_hdr) + 1;
     kb_map.map = calloc(kb_map.len, sizeof(*kb_map.map));
     if (!kb_map.map) {
         kb_err(kb_info, "cannot allocate memory (%lu bytes)", kb_map.len * sizeof(*kb_map.map));
-        return merr(ev(ENOMEM));
+        err = merr(ev(ENOMEM));
+        goto out;
     }
 
     kb_info->blm_desc.bd_first_page = omf_kbh_blm_doff_pg(kb_hdr);
@@ -811,10 +929,12 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
     kb_info->blm_desc.bd_n_hashes = omf_bh_n_hashes(blm_hdr);
     kb_info->blm_desc.bd_rotl = omf_bh_rotl(blm_hdr);
     kb_info->blm_desc.bd_bktmask = (1u << kb_info->blm_desc.bd_bktshift) - 1;
+    kb_info->blm_desc.bd_split = (omf_bh_version(blm_hdr) == BLOOM_OMF_VERSION5);
+    kb_info->blm_desc.bd_pfx = !!(omf_bh_flags(blm_hdr) & BLOOM_OMF_FLAG_PFX);
 
     kb_info->blm_data = (void *)kb_hdr + pgoff(kb_info->blm_desc.bd_first_page);
 
-    kb_info->kmd = (void *)kb_hdr + pgoff(omf_kbh_wbt_doff_pg(kb_hdr) + omf_wbt_root(wbt_hdr) + 1);
+    kb_info->kmd = rgn + pgoff(leaf_pgc + omf_wbt_root(wbt_hdr) + 1 - leaf_cnt);
 
     for (i = 0; i < leaf_cnt; i++) {
         struct node_info last = { 0 };
@@ -892,7 +1012,13 @@ _kblock_check(struct kb_info *kb_info, struct vb_meta *vb_meta)
             kb_metrics.val_bytes);
 
 done:
-    return errcnt ? merr(EILSEQ) : 0;
+    err = errcnt ? merr(EILSEQ) : 0;
+
+out:
+    if (kb_info->nodes != rgn)
+        free_aligned(kb_info->nodes);
+
+    return err;
 }
 
 merr_t
@@ -903,7 +1029,7 @@ kc_kblock_check(struct mpool *ds, u64 kblkid, struct vb_meta *vb_meta)
     merr_t         err;
     struct kb_info kb;
 
-    ret = read_mblock(ds, kblkid, &kb_buf);
+    ret = read_mblock(ds, kblkid, &kb_buf, &kb.len);
     if (ret)
         return merr(ev(EIO));
 
@@ -947,7 +1073,7 @@ kc_kvset_check(struct mpool *ds, struct kvs_cparams *cp, struct kvset_meta *km,
 
         print_dbg("kblock 0x%08lx", id);
 
-        err = read_mblock(ds, id, &kb_buf);
+        err = read_mblock(ds, id, &kb_buf, &kb_info.len);
         if (err) {
             rc = true;
             errcnt++;
@@ -980,3 +1106,126 @@ kc_kvset_check(struct mpool *ds, struct kvs_cparams *cp, struct kvset_meta *km,
 
     return rc ? merr(EILSEQ) : 0;
 }
+
+#define rgn_end(doff_pg, dlen_pg) pgoff((size_t)(doff_pg) + (dlen_pg))
+
+/* The checks of _kblock_check() follow the offsets in the headers, so make
+ * sure those of an image that did not come from an mblock stay within it.
+ */
+static int
+kc_kblock_image_bounds(struct kb_info *kb, size_t len)
+{
+    struct kblock_hdr_omf *kb_hdr = kb->blk;
+    struct wbt_hdr_omf *   wbt_hdr;
+    u32                    leaf_cnt, leaf_pgc, root;
+    size_t                 end;
+
+    if (len < PAGE_SIZE || len % PAGE_SIZE) {
+        kb_err(kb, "invalid image length %zu", len);
+        return 1;
+    }
+
+    end = omf_kbh_wbt_hoff(kb_hdr) + sizeof(struct wbt_hdr_omf);
+    end = max_t(size_t, end, omf_kbh_blm_hoff(kb_hdr) + sizeof(struct bloom_hdr_omf));
+    end = max_t(size_t, end, (size_t)omf_kbh_min_koff(kb_hdr) + omf_kbh_min_klen(kb_hdr));
+    end = max_t(size_t, end, (size_t)omf_kbh_max_koff(kb_hdr) + omf_kbh_max_klen(kb_hdr));
+    end = max_t(size_t, end, rgn_end(omf_kbh_wbt_doff_pg(kb_hdr), omf_kbh_wbt_dlen_pg(kb_hdr)));
+    end = max_t(size_t, end, rgn_end(omf_kbh_blm_doff_pg(kb_hdr), omf_kbh_blm_dlen_pg(kb_hdr)));
+    end = max_t(size_t, end, rgn_end(omf_kbh_pt_doff_pg(kb_hdr), omf_kbh_pt_dlen_pg(kb_hdr)));
+    end = max_t(size_t, end, rgn_end(omf_kbh_hlog_doff_pg(kb_hdr), omf_kbh_hlog_dlen_pg(kb_hdr)));
+
+    if (end > len) {
+        kb_err(kb, "header refers beyond image length %zu", len);
+        return 1;
+    }
+
+    wbt_hdr = kb->blk + omf_kbh_wbt_hoff(kb_hdr);
+    leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+    root = omf_wbt_root(wbt_hdr);
+    leaf_pgc = leaf_cnt;
+
+    if (omf_wbt_version(wbt_hdr) >= WBT_TREE_VERSION8)
+        leaf_pgc = omf_wbt_leaf_pgc(wbt_hdr);
+
+    if (!leaf_cnt || omf_wbt_leaf(wbt_hdr) || root + 1 < leaf_cnt ||
+        leaf_pgc + root + 1 - leaf_cnt + omf_wbt_kmd_pgc(wbt_hdr) > omf_kbh_wbt_dlen_pg(kb_hdr)) {
+        kb_err(kb, "wbt nodes do not fit in the wbt region");
+        return 1;
+    }
+
+    return 0;
+}
+
+merr_t
+kc_kblock_image_check(
+    struct kvs_cparams *cp,
+    u32                 idx,
+    void *              kblk,
+    size_t              len,
+    const u32 *         vlenv,
+    u32                 vblkc)
+{
+    struct kb_info       kb = {};
+    struct blk_list      vblks = {};
+    struct vb_meta       vb_meta;
+    struct mblock_props *props;
+    merr_t               err;
+    u32                  i;
+
+    kb.blkid = idx;
+    kb.blk = kblk;
+    kb.len = len;
+    kb.is_kvset = true;
+    kb.cp = cp;
+
+    print_dbg("kblock image %u", idx);
+
+    if (kc_kblock_image_bounds(&kb, len))
+        return merr(ev(EILSEQ));
+
+    /* Only the vblocks' count and lengths are needed to check the values'
+     * references, the vblocks themselves need not be written yet.
+     */
+    props = calloc(vblkc + 1, sizeof(*props));
+    if (ev(!props))
+        return merr(ENOMEM);
+
+    for (i = 0; i < vblkc; i++)
+        props[i].mpr_write_len = vlenv[i];
+
+    vblks.n_blks = vblkc;
+    vb_meta.blk_list = &vblks;
+    vb_meta.props = props;
+
+    /* Level 0 has no location constraint, so the key hash map is unused. */
+    err = _kblock_check(&kb, &vb_meta);
+
+    free(props);
+
+    return err;
+}
+
+merr_t
+kc_vblock_image_check(u32 idx, const void *vblk, size_t len)
+{
+    const struct vblock_hdr_omf *vb_hdr = vblk;
+
+    print_dbg("vblock image %u", idx);
+
+    if (len < PAGE_SIZE || len % PAGE_SIZE || len > VBLOCK_MAX_SIZE) {
+        print_err("vblock image %u: invalid length %zu", idx, len);
+        return merr(ev(EILSEQ));
+    }
+
+    if (omf_vbh_magic(vb_hdr) != VBLOCK_HDR_MAGIC) {
+        print_err("vblock image %u: incorrect magic", idx);
+        return merr(ev(EILSEQ));
+    }
+
+    if (omf_vbh_version(vb_hdr) > VBLOCK_HDR_VERSION3) {
+        print_err("vblock image %u: invalid version", idx);
+        return merr(ev(EILSEQ));
+    }
+
+    return 0;
+}
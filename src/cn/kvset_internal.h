@@ -10,6 +10,7 @@
 #include <hse_util/inttypes.h>
 #include <hse_util/list.h>
 #include <hse_util/atomic.h>
+#include <hse_util/spinlock.h>
 #include <hse_util/workqueue.h>
 #include <hse_util/key_util.h>
 
@@ -28,29 +29,68 @@
 #include "wbt_internal.h"
 #include "cn_metrics.h"
 #include "cn_tree.h"
+#include "wbt_icache.h"
+#include "kblk_model.h"
 
+/* The min and max keys of all the kblocks of a kvset are packed into a
+ * single per-kvset key arena (kvset->ks_karena), such that each kvset_kblk
+ * need only record the offset and lengths of its keys.  Use kblk_kmax()
+ * and kblk_kmin() to find them.
+ */
 struct kvset_kblk {
     struct kvs_mblk_desc kb_kblk_desc; /* kblock descriptor */
     struct wbt_desc      kb_wbt_desc;  /* wbtree descriptor */
     struct wbt_desc      kb_pt_desc;   /* ptree descriptor */
 
-    u8              kb_ksmall[64]; /* small key cache */
-    struct key_disc kb_kdisc_max;  /* kdisc of largest key in kblk */
-    struct key_disc kb_kdisc_min;  /* kdisc of smallest key */
-    const void *    kb_koff_max;   /* ptr to largest key in kblk */
-    const void *    kb_koff_min;   /* ptr to smallest key in kblk */
-    u16             kb_klen_max;   /* length of largest key */
-    u16             kb_klen_min;   /* length of smallest key */
+    struct key_disc kb_kdisc_max; /* kdisc of largest key in kblk */
+    struct key_disc kb_kdisc_min; /* kdisc of smallest key */
 
-    u16               kb_cn_bloom_lookup;
     struct bloom_desc kb_blm_desc;  /* Bloom descriptor */
     u8 *              kb_blm_pages; /* Bloom pages */
 
-    u64 kb_seqno_min; /* min seqno */
-    u64 kb_seqno_max; /* max seqno */
-
     struct kblk_metrics kb_metrics; /* kblock metrics */
     struct kvs_block    kb_kblk;    /* blkid and handle */
+
+    struct wbt_icache_entry *kb_icache; /* cached wbt internal nodes (RCU) */
+
+    const void *kb_hix;  /* mapped hash index (or NULL) */
+    u32         kb_hixc; /* number of slots in kb_hix */
+
+    u32  kb_koff;            /* offset of largest key in ks_karena */
+    u16  kb_klen_max;        /* length of largest key */
+    u16  kb_klen_min;        /* length of smallest key */
+    u16  kb_cn_bloom_lookup;
+    bool kb_pinned;          /* blooms and wbt index nodes locked */
+};
+
+/* Access heat of a kvset (see kvset_heat_read()).
+ */
+enum kvset_heat_ctr {
+    KVSET_HEAT_PROBES, /* kblocks probed by point lookups */
+    KVSET_HEAT_HITS,   /* point lookups that found the key */
+    KVSET_HEAT_SEEKS,  /* cursor seeks */
+    KVSET_HEAT_BYTES,  /* value bytes read by point lookups and cursors */
+    KVSET_HEAT_MAX
+};
+
+/* Heat halves every KVSET_HEAT_HALFLIFE nanoseconds.
+ */
+#define KVSET_HEAT_HALFLIFE (60ul * NSEC_PER_SEC)
+
+/**
+ * struct kvset_heat - decayed access counts of a kvset
+ * @kh_ctrv:  cumulative access counts, bumped by readers
+ * @kh_lock:  protects the remaining fields
+ * @kh_time:  time up to which %kh_heatv has been decayed
+ * @kh_prevv: value of %kh_ctrv when %kh_heatv was last updated
+ * @kh_heatv: decayed access counts
+ */
+struct kvset_heat {
+    atomic64_t kh_ctrv[KVSET_HEAT_MAX];
+    spinlock_t kh_lock;
+    u64        kh_time;
+    u64        kh_prevv[KVSET_HEAT_MAX];
+    u64        kh_heatv[KVSET_HEAT_MAX];
 };
 
 struct kvset {
@@ -65,12 +105,14 @@ struct kvset {
     u32           ks_vmax;
     u32           ks_vra_len;
     uint          ks_compc;
+    uint          ks_mclass; /* media class of the kblocks */
 
     struct kvs_rparams *ks_rp;
     u64                 ks_seqno_max;
     u64                 ks_cnid;
     struct cn_kvdb *    ks_cn_kvdb;
     struct cn_tree *    ks_tree;
+    struct wbt_icache * ks_icache;
     struct cndb *       ks_cndb;
     struct kvset_stats  ks_st;
 
@@ -79,7 +121,8 @@ struct kvset {
     uint ks_scatter;
     uint ks_scatter_pct;
 
-    u32                   ks_vgroups;
+    u32                   ks_vgroups; /* valid once ks_vlazy is clear */
+    atomic_t              ks_vlazy;   /* vblocks not yet mapped */
     struct mbset_locator *ks_vblk2mbs;
     u64                   ks_workid;
 
@@ -87,7 +130,9 @@ struct kvset {
     struct key_disc ks_kdisc_min; /* min key in kvset */
     int             ks_lcp;       /* longest common prefix */
 
-    const u8 *                ks_klarge; /* large key cache */
+    struct kblk_model *ks_kmodel; /* kblock selector, may be NULL */
+
+    u8 *                      ks_karena; /* min/max keys of all kblocks */
     struct mpool_mcache_map **ks_kmapv;
     struct mbset **           ks_vbsetv;
     uint                      ks_vbsetc;
@@ -107,10 +152,31 @@ struct kvset {
     bool     ks_mbset_cb_pending;
     u64      ks_seqno_min;
     size_t   ks_kvset_sz;
+    size_t   ks_memsz; /* bytes accounted to KVDB_MEMACCT_CN */
     u64      ks_ctime;
     u64      ks_tag;
 
+    __aligned(SMP_CACHE_BYTES) struct kvset_heat ks_heat;
+
     __aligned(SMP_CACHE_BYTES) struct kvset_kblk ks_kblks[];
 };
 
+static __always_inline void
+kvset_heat_add(struct kvset *ks, enum kvset_heat_ctr ctr, u64 n)
+{
+    atomic64_add(n, &ks->ks_heat.kh_ctrv[ctr]);
+}
+
+static inline const void *
+kblk_kmax(const struct kvset *ks, const struct kvset_kblk *kblk)
+{
+    return ks->ks_karena + kblk->kb_koff;
+}
+
+static inline const void *
+kblk_kmin(const struct kvset *ks, const struct kvset_kblk *kblk)
+{
+    return ks->ks_karena + kblk->kb_koff + kblk->kb_klen_max;
+}
+
 #endif /* HSE_KVS_CN_KVSET_INTERNAL_H */
@@ -6,6 +6,9 @@
 #include <hse_util/alloc.h>
 #include <hse_util/slab.h>
 
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cn_reclaim.h>
+
 #define MTF_MOCK_IMPL_mbset
 
 #include "mbset.h"
@@ -90,6 +93,9 @@ _mbset_mblk_get(struct mbset *self, mbset_udata_init_fn *cb)
         if (ev(err))
             break;
 
+        if (self->mbs_propv)
+            self->mbs_propv[i] = props;
+
         if (cb) {
             err = cb(self, i, &argc, argv, &props, mbset_get_udata(self, i));
             if (ev(err))
@@ -203,9 +209,10 @@ _mbset_map(struct mbset *self, uint flags)
 }
 
 /**
- * _mbset_unmap() - destroy mcache maps
+ * _mbset_unmap() - destroy udata and mcache maps
  *
- * Used by mbset destructor.
+ * Used by mbset destructor.  The udata destructor must accept udata that
+ * was zeroed but never constructed.
  */
 static void
 _mbset_unmap(struct mbset *self)
@@ -213,14 +220,27 @@ _mbset_unmap(struct mbset *self)
     merr_t err;
     uint   i;
 
+    if (self->mbs_udata_fini)
+        for (i = 0; i < self->mbs_idc; i++)
+            self->mbs_udata_fini(mbset_get_udata(self, i));
+
     for (i = 0; i < self->mbs_mapc; i++) {
         if (self->mbs_mapv[i]) {
             err = mpool_mcache_munmap(self->mbs_mapv[i]);
             ev(err);
+            self->mbs_mapv[i] = NULL;
         }
     }
 }
 
+static void
+_mbset_free(struct mbset *self)
+{
+    free(self->mbs_propv);
+    mutex_destroy(&self->mbs_lock);
+    free(self);
+}
+
 /**
  * mbset_create() - mbset constructor
  */
@@ -231,6 +251,7 @@ mbset_create(
     u64 *               idv,
     size_t              udata_sz,
     mbset_udata_init_fn udata_init_fn,
+    mbset_udata_fini_fn udata_fini_fn,
     uint                flags,
     u64                 mblock_max,
     struct mbset **     handle)
@@ -276,6 +297,30 @@ mbset_create(
     self->mbs_del = false;
     self->mbs_udata_sz = udata_sz;
     self->mbs_mblock_max = mblock_max;
+    self->mbs_udata_init = udata_init_fn;
+    self->mbs_udata_fini = udata_fini_fn;
+    self->mbs_flags = flags;
+    mutex_init(&self->mbs_lock);
+
+    /* A lazy mbset only gets its mblock handles now.  It keeps their
+     * properties for the udata constructor, run when it is mapped.
+     */
+    if (flags & MBSET_FLAGS_LAZY) {
+        self->mbs_propv = malloc(sizeof(*self->mbs_propv) * idc);
+        if (ev(!self->mbs_propv)) {
+            err = merr(ENOMEM);
+            goto fail;
+        }
+
+        err = _mbset_mblk_get(self, NULL);
+        if (ev(err))
+            goto fail;
+
+        atomic_set(&self->mbs_lazy, 1);
+        atomic_set(&self->mbs_ref, 1);
+        *handle = self;
+        return 0;
+    }
 
     err = _mbset_map(self, flags);
     if (ev(err))
@@ -294,7 +339,59 @@ mbset_create(
 fail:
     _mbset_unmap(self);
     _mbset_mblk_put(self);
-    free(self);
+    _mbset_free(self);
+    return err;
+}
+
+merr_t
+mbset_materialize(struct mbset *self)
+{
+    merr_t err = 0;
+    u64 *  argv;
+    uint   argc = 0;
+    uint   i;
+
+    if (!mbset_is_lazy(self))
+        return 0;
+
+    mutex_lock(&self->mbs_lock);
+    if (!atomic_read(&self->mbs_lazy))
+        goto out;
+
+    err = _mbset_map(self, self->mbs_flags);
+    if (ev(err))
+        goto fail;
+
+    if (self->mbs_udata_init) {
+        argv = malloc(sizeof(*argv) * (self->mbs_idc + 1));
+        if (ev(!argv)) {
+            err = merr(ENOMEM);
+            goto fail;
+        }
+
+        for (i = 0; i < self->mbs_idc && !err; i++)
+            err = self->mbs_udata_init(
+                self, i, &argc, argv, self->mbs_propv + i, mbset_get_udata(self, i));
+
+        free(argv);
+
+        if (ev(err))
+            goto fail;
+    }
+
+    free(self->mbs_propv);
+    self->mbs_propv = NULL;
+    atomic_set_rel(&self->mbs_lazy, 0);
+
+out:
+    mutex_unlock(&self->mbs_lock);
+
+    return 0;
+
+fail:
+    _mbset_unmap(self);
+    mutex_unlock(&self->mbs_lock);
+
     return err;
 }
 
@@ -311,6 +408,7 @@ _mbset_destroy(struct mbset *self, bool *delete_errors)
 
     _mbset_unmap(self);
     if (self->mbs_del) {
+        cn_scache_invalidate(self->mbs_scache, self->mbs_idc, self->mbs_idv);
         err = _mbset_mblk_del(self);
         ev(err);
         *delete_errors = !!err;
@@ -319,7 +417,28 @@ _mbset_destroy(struct mbset *self, bool *delete_errors)
         *delete_errors = false;
     }
 
-    free(self);
+    _mbset_free(self);
+}
+
+/**
+ * _mbset_reclaim() - mbset destructor, mblock deletion deferred
+ */
+static void
+_mbset_reclaim(struct mbset *self, mbset_callback *callback, void *rock)
+{
+    _mbset_unmap(self);
+    cn_scache_invalidate(self->mbs_scache, self->mbs_idc, self->mbs_idv);
+
+    cn_reclaim_add(
+        self->mbs_reclaim,
+        self->mbs_ds,
+        self->mbs_idc,
+        self->mbs_bhv,
+        self->mbs_alen,
+        callback,
+        rock);
+
+    _mbset_free(self);
 }
 
 struct mbset *
@@ -348,6 +467,12 @@ mbset_put_ref(struct mbset *self)
     if (v == 0) {
         callback = self->mbs_callback;
         rock = self->mbs_callback_rock;
+
+        if (self->mbs_del && self->mbs_reclaim) {
+            _mbset_reclaim(self, callback, rock);
+            return;
+        }
+
         _mbset_destroy(self, &delete_errors);
         if (callback)
             callback(rock, delete_errors);
@@ -374,6 +499,18 @@ mbset_set_delete_flag(struct mbset *self)
     self->mbs_del = true;
 }
 
+void
+mbset_set_scache(struct mbset *self, struct cn_scache *sc)
+{
+    self->mbs_scache = sc;
+}
+
+void
+mbset_set_reclaim(struct mbset *self, struct cn_reclaim *rc)
+{
+    self->mbs_reclaim = rc;
+}
+
 void
 mbset_madvise(struct mbset *self, int advice)
 {
@@ -381,6 +518,9 @@ mbset_madvise(struct mbset *self, int advice)
     merr_t err;
     uint   i;
 
+    if (mbset_is_lazy(self))
+        return;
+
     for (i = 0; i < self->mbs_mapc; ++i) {
         err = mpool_mcache_madvise(self->mbs_mapv[i], 0, 0, len, advice);
         ev(err);
@@ -393,6 +533,9 @@ mbset_purge(struct mbset *self, const struct mpool *ds)
     merr_t err;
     uint   i;
 
+    if (mbset_is_lazy(self))
+        return;
+
     for (i = 0; i < self->mbs_mapc; ++i) {
         err = mpool_mcache_purge(self->mbs_mapv[i], ds);
         ev(err);
@@ -413,6 +556,9 @@ mbset_mincore(struct mbset *self, size_t *rss_out, size_t *vss_out)
     if (vss_out)
         *vss_out = 0;
 
+    if (mbset_is_lazy(self))
+        return 0;
+
     for (i = 0; i < self->mbs_mapc; ++i) {
         merr_t err;
         size_t rss;
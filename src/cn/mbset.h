@@ -7,6 +7,7 @@
 #define HSE_KVDB_CN_MBSET_H
 
 #include <hse_util/platform.h>
+#include <hse_util/mutex.h>
 
 #include <mpool/mpool.h>
 
@@ -14,9 +15,12 @@ struct mpool_mcache_map;
 struct mpool;
 struct mblock_props;
 struct mbset;
+struct cn_scache;
+struct cn_reclaim;
 
 #define MBSET_FLAGS_CAPPED (0x0001)
 #define MBSET_FLAGS_VBLK_ROOT (0x0002)
+#define MBSET_FLAGS_LAZY (0x0004) /* map on first mbset_materialize() */
 
 /* MTF_MOCK_DECL(mbset) */
 
@@ -32,6 +36,9 @@ mbset_udata_init_fn(
     struct mblock_props *props,
     void *               rock);
 
+typedef void
+mbset_udata_fini_fn(void *rock);
+
 /**
  * struct mbset - a ref counted set of mblocks
  * @mbs_mapv: vector of mcache map handles
@@ -42,6 +49,14 @@ mbset_udata_init_fn(
  * @mbs_ref:  reference count
  * @mbs_ds:   mpool dataset handle
  * @mbs_del:  if true, delete mblocks in destructor
+ * @mbs_scache: staging cache to invalidate when the mblocks are deleted
+ * @mbs_reclaim: reclaim queue to hand the mblocks to when deleting them
+ * @mbs_udata_init: udata constructor
+ * @mbs_udata_fini: udata destructor, run when the mblocks are unmapped
+ * @mbs_flags: MBSET_FLAGS_*
+ * @mbs_lazy:  not yet mapped, the udata is not yet constructed
+ * @mbs_lock:  serializes mapping a lazy mbset
+ * @mbs_propv: mblock properties, for the udata constructor of a lazy mbset
  * @mbs_alen: sum of mblock allocated lengths
  * @mbs_wlen: sum of mblock written lengths
  *
@@ -63,7 +78,15 @@ struct mbset {
     void *                    mbs_callback_rock;
     void *                    mbs_udata;
     uint                      mbs_udata_sz;
+    struct cn_scache *        mbs_scache;
+    struct cn_reclaim *       mbs_reclaim;
     bool                      mbs_del;
+    mbset_udata_init_fn *     mbs_udata_init;
+    mbset_udata_fini_fn *     mbs_udata_fini;
+    uint                      mbs_flags;
+    atomic_t                  mbs_lazy;
+    struct mutex              mbs_lock;
+    struct mblock_props *     mbs_propv;
 };
 
 /* MTF_MOCK */
@@ -74,10 +97,27 @@ mbset_create(
     u64 *               idv,
     size_t              udata_sz,
     mbset_udata_init_fn udata_init_fn,
+    mbset_udata_fini_fn udata_fini_fn,
     uint                flags,
     u64                 mblock_max,
     struct mbset **     handle);
 
+/**
+ * mbset_materialize() - map a lazy mbset and construct its udata
+ * @self: mbset
+ *
+ * Does nothing if the mbset is already mapped.  On failure the mbset
+ * stays lazy, and the next call tries again.
+ */
+merr_t
+mbset_materialize(struct mbset *self);
+
+static __always_inline bool
+mbset_is_lazy(struct mbset *self)
+{
+    return atomic_read_acq(&self->mbs_lazy);
+}
+
 /* MTF_MOCK */
 struct mbset *
 mbset_get_ref(struct mbset *self);
@@ -98,6 +138,25 @@ mbset_apply(struct mbset *self, mbset_udata_init_fn fn, uint *argcp, u64 *argv);
 void
 mbset_set_delete_flag(struct mbset *self);
 
+/**
+ * mbset_set_scache() - drop cached extents of the mblocks when deleting them
+ * @self: mbset
+ * @sc:   staging cache, may be NULL
+ */
+void
+mbset_set_scache(struct mbset *self, struct cn_scache *sc);
+
+/**
+ * mbset_set_reclaim() - defer the deletion of the mblocks to a reclaim queue
+ * @self: mbset
+ * @rc:   reclaim queue, may be NULL
+ *
+ * The mbset callback is then invoked by the reclaim queue, once the
+ * mblocks have been deleted.
+ */
+void
+mbset_set_reclaim(struct mbset *self, struct cn_reclaim *rc);
+
 /* MTF_MOCK */
 void
 mbset_madvise(struct mbset *self, int advise);
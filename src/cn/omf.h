@@ -14,7 +14,7 @@
  *
  ****************************************************************/
 
-#define KBLOCK_HDR_VERSION ((u32)5)
+#define KBLOCK_HDR_VERSION ((u32)8)
 #define KBLOCK_HDR_MAGIC ((u32)0xfadedfad)
 
 /* This is currently set to 1350 which is the max key size supported. However,
@@ -24,6 +24,9 @@
 #define HSE_KBLOCK_OMF_KLEN_MAX ((u32)1350)
 
 /* older versions that are still supported */
+#define KBLOCK_HDR_VERSION7 ((u32)7)
+#define KBLOCK_HDR_VERSION6 ((u32)6)
+#define KBLOCK_HDR_VERSION5 ((u32)5)
 #define KBLOCK_HDR_VERSION4 ((u32)4)
 #define KBLOCK_HDR_VERSION3 ((u32)3)
 #define KBLOCK_HDR_VERSION2 ((u32)2)
@@ -72,6 +75,17 @@ struct kblock_hdr_omf {
     __le64 kbh_min_seqno;
     __le64 kbh_max_seqno;
 
+    /* v6: number of ptombs */
+    __le32 kbh_ptombs;
+
+    /* v7: hash index of a point-lookup-only kvs */
+    __le32 kbh_hix_doff_pg;
+    __le32 kbh_hix_dlen_pg;
+
+    /* v8: page checksums */
+    __le32 kbh_crc_doff_pg;
+    __le32 kbh_crc_dlen_pg;
+
 } __packed;
 
 /* Define set/get methods for kblock_hdr_omf */
@@ -79,6 +93,7 @@ OMF_SETGET(struct kblock_hdr_omf, kbh_magic, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_version, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_entries, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_tombs, 32)
+OMF_SETGET(struct kblock_hdr_omf, kbh_ptombs, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_key_bytes, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_val_bytes, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_min_koff, 32)
@@ -107,6 +122,29 @@ OMF_SETGET(struct kblock_hdr_omf, kbh_pt_dlen_pg, 32)
 OMF_SETGET(struct kblock_hdr_omf, kbh_min_seqno, 64)
 OMF_SETGET(struct kblock_hdr_omf, kbh_max_seqno, 64)
 
+OMF_SETGET(struct kblock_hdr_omf, kbh_hix_doff_pg, 32)
+OMF_SETGET(struct kblock_hdr_omf, kbh_hix_dlen_pg, 32)
+
+OMF_SETGET(struct kblock_hdr_omf, kbh_crc_doff_pg, 32)
+OMF_SETGET(struct kblock_hdr_omf, kbh_crc_dlen_pg, 32)
+
+/* The hash index is an open-addressed table of __le32 slots filling its
+ * region.  A slot holds the top 16 bits of a key's hash and one plus the
+ * number of the wbtree leaf node holding the key, zero marks an empty slot.
+ * A key's probe starts at slot (hash >> 16) % nslots and proceeds linearly
+ * up to the first empty slot.
+ */
+#define KBLOCK_HIX_SLOT(_hash, _node) ((u32)((_hash) >> 48) << 16 | ((_node) + 1))
+#define KBLOCK_HIX_TAG(_slot) ((_slot) >> 16)
+#define KBLOCK_HIX_NODE(_slot) (((_slot)&0xffff) - 1)
+#define KBLOCK_HIX_NODE_MAX ((u32)0xfffe)
+
+/* The page checksum region of a v8 kblock (and the checksum table of a v3
+ * vblock) holds one __le32 CRC32C for each page of the mblock that precedes
+ * it, header page included, and is sized by MBLK_CRC_PGC().
+ */
+#define MBLK_CRC_PGC(_pgc) (((_pgc) * sizeof(u32) + PAGE_SIZE - 1) / PAGE_SIZE)
+
 /*****************************************************************
  *
  * Bloom filter header OMF (part of the kblock)
@@ -114,17 +152,23 @@ OMF_SETGET(struct kblock_hdr_omf, kbh_max_seqno, 64)
  ****************************************************************/
 
 #define BLOOM_OMF_MAGIC ((u32)('b' << 24 | 'l' << 16 | 'm' << 8 | 'h'))
-#define BLOOM_OMF_VERSION ((u32)4)
+#define BLOOM_OMF_VERSION BLOOM_OMF_VERSION5
+#define BLOOM_OMF_VERSION5 ((u32)5) /* split-block buckets */
+#define BLOOM_OMF_VERSION4 ((u32)4) /* k-probe buckets */
+
+/* The bloom also holds the hash of each distinct cn tree prefix */
+#define BLOOM_OMF_FLAG_PFX ((u16)1 << 0)
 
 /**
  * struct bloom_hdr_omf -
  * @bh_magic:           BLOOM_OMF_MAGIC
- * @bh_version:         BLOOM_OMF_VERSION
+ * @bh_version:         BLOOM_OMF_VERSION4 or BLOOM_OMF_VERSION5
  * @bh_bktsz:           number of bytes per bucket
  * @bh_rotl:            hash rotate left amount
  * @bh_n_hashes:        number of hashes per bucket
  * @bh_bitmapsz:        size of bitmap in bytes
  * @bh_modulus:         modulus used to convert first hash to bucket
+ * @bh_flags:           BLOOM_OMF_FLAG_*
  */
 struct bloom_hdr_omf {
     __le32 bh_magic;
@@ -132,7 +176,7 @@ struct bloom_hdr_omf {
     __le32 bh_bitmapsz;
     __le32 bh_modulus;
     __le32 bh_bktshift;
-    __le16 bh_rsvd1;
+    __le16 bh_flags;
     u8     bh_rotl;
     u8     bh_n_hashes;
     __le32 bh_rsvd2;
@@ -145,6 +189,7 @@ OMF_SETGET(struct bloom_hdr_omf, bh_version, 32)
 OMF_SETGET(struct bloom_hdr_omf, bh_bitmapsz, 32)
 OMF_SETGET(struct bloom_hdr_omf, bh_modulus, 32)
 OMF_SETGET(struct bloom_hdr_omf, bh_bktshift, 32)
+OMF_SETGET(struct bloom_hdr_omf, bh_flags, 16)
 OMF_SETGET(struct bloom_hdr_omf, bh_rotl, 8)
 OMF_SETGET(struct bloom_hdr_omf, bh_n_hashes, 8)
 
@@ -156,12 +201,51 @@ OMF_SETGET(struct bloom_hdr_omf, bh_n_hashes, 8)
 #define WBT_NODE_SIZE 4096 /* must equal system page size */
 
 #define WBT_TREE_MAGIC ((u32)0x4a3a2a1a)
-#define WBT_TREE_VERSION WBT_TREE_VERSION5
+#define WBT_TREE_VERSION WBT_TREE_VERSION8
+#define WBT_TREE_VERSION8 ((u32)8)
+#define WBT_TREE_VERSION7 ((u32)7)
+#define WBT_TREE_VERSION6 ((u32)6)
 #define WBT_TREE_VERSION5 ((u32)5)
 #define WBT_TREE_VERSION4 ((u32)4)
 #define WBT_TREE_VERSION3 ((u32)3)
 #define WBT_TREE_VERSION2 ((u32)2)
 
+/******** WB tree Version 6 ********/
+
+/* Version 6 keeps the version 5 node layout and appends to each node an array
+ * of key heads, one per key, located at the first 4-byte aligned offset
+ * following the node's entries (num_keys LFEs, or num_keys + 1 INEs).  A key
+ * head holds the first WBT_KEYHEAD_LEN bytes of the key's suffix (zero-padded)
+ * as a little-endian integer that sorts in key order, so that a search can
+ * narrow its range by scanning the heads before comparing any key data.
+ */
+#define WBT_KEYHEAD_LEN 4
+
+/******** WB tree Version 7 ********/
+
+/* Version 7 is version 6 with front-coded keys in the leaf nodes (internal
+ * nodes are unchanged).  Every WBT_RESTART_INTERVAL'th entry of a leaf node,
+ * starting with the first, is a restart entry whose key is stored in full,
+ * including the node prefix.  Every other entry stores the length of the
+ * part of its key it shares with the key of the preceding restart entry, as
+ * a little-endian u16, followed by the rest of its key.  Entries, key heads
+ * and kmd offsets are as in version 6.
+ */
+#define WBT_RESTART_INTERVAL 16
+
+/******** WB tree Version 8 ********/
+
+/* Version 8 is version 7 with lz4 compressed leaf nodes.  The leaf nodes are
+ * packed into the first wbt_leaf_pgc pages of the data region, which start
+ * with a table of wbt_leaf_cnt + 1 little-endian u32 byte offsets (relative
+ * to the start of the region): leaf node i is stored in the bytes from
+ * offset i through offset i + 1.  A leaf node that does not shrink when
+ * compressed is stored as is, in WBT_NODE_SIZE bytes.  The internal nodes,
+ * which are not compressed, follow the leaf nodes and are numbered as if the
+ * leaf nodes were not compressed.  The kmd region follows the internal nodes.
+ */
+#define WBT_LEAF_OFFV_LEN(_leaf_cnt) (((_leaf_cnt) + 1) * sizeof(u32))
+
 /******** WB tree Version 4 ********/
 
 /* Version 4 just added a new value type of "immediate" and changed no earlier
@@ -179,7 +263,8 @@ struct wbt_hdr_omf {
     __le16 wbt_leaf;     /* index of first wbtree leaf node */
     __le16 wbt_leaf_cnt; /* number of wbtree leaf nodes */
     __le16 wbt_kmd_pgc;  /* size of kmd region in pages */
-    __le32 wbt_reserved1;
+    __le16 wbt_leaf_pgc; /* v8: size of compressed leaf nodes in pages */
+    __le16 wbt_reserved1;
     __le32 wbt_reserved2;
 } __packed;
 
@@ -189,6 +274,7 @@ OMF_SETGET(struct wbt_hdr_omf, wbt_root, 16);
 OMF_SETGET(struct wbt_hdr_omf, wbt_leaf, 16);
 OMF_SETGET(struct wbt_hdr_omf, wbt_leaf_cnt, 16);
 OMF_SETGET(struct wbt_hdr_omf, wbt_kmd_pgc, 16);
+OMF_SETGET(struct wbt_hdr_omf, wbt_leaf_pgc, 16);
 
 static inline int
 wbt_hdr_version(void *omf)
@@ -312,6 +398,8 @@ BullseyeCoverageRestore
 #define VBLOCK_HDR_MAGIC ((u32)0xea73feed)
 #define VBLOCK_HDR_VERSION1 ((u32)1)
 #define VBLOCK_HDR_VERSION2 ((u32)2)
+#define VBLOCK_HDR_VERSION3 ((u32)3)
+#define VBLOCK_FTR_MAGIC ((u32)0xea73f007)
 
     /* Version 2 header */
     struct vblock_hdr_omf {
@@ -324,6 +412,22 @@ OMF_SETGET(struct vblock_hdr_omf, vbh_magic, 32)
 OMF_SETGET(struct vblock_hdr_omf, vbh_version, 32)
 OMF_SETGET(struct vblock_hdr_omf, vbh_vgroup, 64)
 
+/* A v3 vblock ends with a footer in the last bytes of its final write.  The
+ * values (header page included) occupy the first vbf_data_pgc pages, which
+ * are followed by their page checksum table and zero fill up to the footer.
+ * Older vblocks have neither checksums nor a footer.
+ */
+struct vblock_ftr_omf {
+    __le32 vbf_magic;
+    __le32 vbf_version;
+    __le32 vbf_data_pgc;
+    __le32 vbf_rsvd;
+} __packed;
+
+OMF_SETGET(struct vblock_ftr_omf, vbf_magic, 32)
+OMF_SETGET(struct vblock_ftr_omf, vbf_version, 32)
+OMF_SETGET(struct vblock_ftr_omf, vbf_data_pgc, 32)
+
 /* Version 1 header */
 struct vblock_hdr1_omf {
     __le32 vbh1_magic;
@@ -338,12 +442,30 @@ struct vblock_hdr1_omf {
 #define CN_TSTATE_MAGIC (u32)('c' << 24 | 't' << 16 | 's' << 8 | 'm')
 #define CN_TSTATE_VERSION (u32)1
 #define CN_TSTATE_KHM_SZ (1024)
+#define CN_TSTATE_CKPT_MAX (4)
+
+/* A spill checkpoint slot, unused if tsc_dgen_lo is zero.  The slots
+ * were carved out of reserved space, so version 1 still applies.
+ */
+struct cn_tstate_ckpt_omf {
+    __le32 tsc_level;
+    __le32 tsc_offset;
+    __le64 tsc_dgen_lo;
+    __le64 tsc_dgen_hi;
+} __packed;
+
+OMF_SETGET(struct cn_tstate_ckpt_omf, tsc_level, 32)
+OMF_SETGET(struct cn_tstate_ckpt_omf, tsc_offset, 32)
+OMF_SETGET(struct cn_tstate_ckpt_omf, tsc_dgen_lo, 64)
+OMF_SETGET(struct cn_tstate_ckpt_omf, tsc_dgen_hi, 64)
 
 struct cn_tstate_omf {
     __le32 ts_magic;
     __le32 ts_version;
 
-    __le64 ts_rsvd[14];
+    struct cn_tstate_ckpt_omf ts_ckptv[CN_TSTATE_CKPT_MAX];
+    __le64                    ts_ttl_seq;
+    __le64                    ts_rsvd;
 
     __le32 ts_khm_gen;
     __le32 ts_khm_rsvd;
@@ -352,6 +474,7 @@ struct cn_tstate_omf {
 
 OMF_SETGET(struct cn_tstate_omf, ts_magic, 32)
 OMF_SETGET(struct cn_tstate_omf, ts_version, 32)
+OMF_SETGET(struct cn_tstate_omf, ts_ttl_seq, 64)
 
 OMF_SETGET(struct cn_tstate_omf, ts_khm_gen, 32)
 OMF_SETGET_CHBUF(struct cn_tstate_omf, ts_khm_mapv);
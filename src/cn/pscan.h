@@ -6,10 +6,12 @@
 #ifndef HSE_KVDB_CN_PSCAN_H
 #define HSE_KVDB_CN_PSCAN_H
 
-#include <hse_util/bin_heap.h>
+#include <hse_util/loser_tree.h>
 #include <hse_util/hse_err.h>
 #include <hse_util/inttypes.h>
 #include <hse_util/darray.h>
+#include <hse_ikvdb/tuple.h>
+
 #include "cn_metrics.h"
 
 struct cursor_summary;
@@ -21,7 +23,7 @@ struct cursor_summary;
  * @itermax:    max elements in iterv[] and esrcv[]
  * @iterv:      kvset iterator vector
  * @esrcv:      element source vector
- * @bin_heap:   how to merge iterators
+ * @lt:         how to merge iterators
  * @cn:         cn this cursor operates upon
  * @buf:        where to store current key + value
  * @pfx:        prefix is saved here
@@ -34,16 +36,27 @@ struct cursor_summary;
  * @dgen:       max dgen in this scan
  * @eof:        cursor eof separate from iterators
  * @seqno:      view sequence number for this cursor
+ * @seqno_skip: smallest min seqno of the kvsets left out of the cursor
+ *              because they are newer than @seqno (U64_MAX if none)
  * @bufsz:      length of buffer for key + value
  * @reverse:    reverse iterator: 1=yes 0=no
+ * @direct:     read mblocks instead of using mcache maps: 1=yes 0=no
+ * @pred_key:   key filter predicate, run before the value is read
+ * @pred_val:   value filter predicate
+ * @pred_arg:   argument of @pred_key and @pred_val
  * @eof:        cursor is at eof: 1=yes 0=no
  * @pt_buf:     buffer for ptomb at cursor update
  * @pt_set:     if the ptomb in pt_kobj, if there is one, is relevant.
  * @pt_kobj:    ptomb key obj (key in kblk OR pt_buf[] right after cur update)
  * @pt_seq:     ptomb's seqno
+ * @ltmax:      max width of @lt
+ * @capped_skip: oldest iterators of a capped cursor left out of @lt, their
+ *              keys are all below @capped_key
+ * @capped_klen: length of @capped_key
+ * @capped_key: last key a capped cursor was positioned at
  */
 struct pscan {
-    struct bin_heap2 *      bh;
+    struct loser_tree *     lt;
     u32                     iterc;
     u32                     itermax;
     struct kv_iterator **   iterv;
@@ -59,19 +72,30 @@ struct pscan {
     u32                     mask;
     u64                     dgen;
     u64                     seqno;
+    u64                     seqno_skip;
     u32                     bufsz;
 
     /* bitflags */
     u32 reverse : 1;
     u32 eof : 1;
     u32 pt_set : 1;
+    u32 keys_only : 1;
+    u32 direct : 1;
 
     struct key_obj pt_kobj;
     u64            pt_seq;
     unsigned char  pt_buf[HSE_KVS_MAX_PFXLEN];
 
+    u32           ltmax;
+    u32           capped_skip;
+    u32           capped_klen;
+    unsigned char capped_key[HSE_KVS_KLEN_MAX];
+
     struct cn_merge_stats stats;
     struct kc_filter *    filter;
+    kvs_pred_fn *         pred_key;
+    kvs_pred_fn *         pred_val;
+    void *                pred_arg;
     void *                base;
 
     __aligned(SMP_CACHE_BYTES) char buf[];
@@ -5,6 +5,7 @@
 
 #include <hse_util/platform.h>
 #include <hse_util/event_counter.h>
+#include <hse_util/loser_tree.h>
 #include <hse_util/slab.h>
 
 #include <hse_ikvdb/kvs_cparams.h>
@@ -31,7 +32,7 @@
 #include "blk_list.h"
 
 /**
- * struct merge_item -- an item in the bin_heap
+ * struct merge_item -- an item in the loser tree
  */
 struct merge_item {
     struct key_obj         kobj;
@@ -39,102 +40,193 @@ struct merge_item {
     uint                   src;
 };
 
+struct merge;
+
+/**
+ * struct merge_src -- element source over the keys of one input kvset
+ * @ms_es:    element source handle
+ * @ms_iter:  input kvset iterator
+ * @ms_merge: merge this source is part of
+ * @ms_item:  current key
+ */
+struct merge_src {
+    struct element_source ms_es;
+    struct kv_iterator *  ms_iter;
+    struct merge *        ms_merge;
+    struct merge_item     ms_item;
+};
+
+/**
+ * struct merge -- loser tree merge of the input kvsets
+ * @mg_lt:    loser tree of the sources in @mg_srcv
+ * @mg_stats: merge stats
+ * @mg_err:   first error returned by an input kvset iterator
+ * @mg_esv:   element source handles of @mg_srcv
+ * @mg_srcv:  one source per input kvset, newest first
+ */
+struct merge {
+    struct loser_tree *     mg_lt;
+    struct cn_merge_stats * mg_stats;
+    merr_t                  mg_err;
+    struct element_source **mg_esv;
+    struct merge_src        mg_srcv[];
+};
+
 static int
 merge_item_compare(const void *a_blob, const void *b_blob)
 {
     const struct merge_item *a = a_blob;
     const struct merge_item *b = b_blob;
-    int                      rc;
 
     /* Tie breaker: If keycmp() return 0, the keys are equal, in this case
-     * lower numbered merge sources contain newer data and must come out
-     * of the binheap first.
+     * the loser tree pops the item of the lower numbered merge source first,
+     * as lower numbered merge sources contain newer data.
      */
-    rc = key_obj_cmp(&a->kobj, &b->kobj);
-    if (rc)
-        return rc;
-    if (a->src < b->src)
-        return -1;
-    if (a->src > b->src)
-        return 1;
-    return 0;
+    return key_obj_cmp(&a->kobj, &b->kobj);
 }
 
-static merr_t
-replenish(struct bin_heap *bh, struct kv_iterator **iterv, uint src, struct cn_merge_stats *stats)
+/* merge_item_compare() of the keys of a kvs with fixed length keys.
+ */
+static int
+merge_item_compare8(const void *a_blob, const void *b_blob)
 {
-    struct kv_iterator *iter = iterv[src];
+    const struct merge_item *a = a_blob;
+    const struct merge_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 8);
+}
+
+static int
+merge_item_compare16(const void *a_blob, const void *b_blob)
+{
+    const struct merge_item *a = a_blob;
+    const struct merge_item *b = b_blob;
+
+    return key_obj_cmp_fixed(&a->kobj, &b->kobj, 16);
+}
+
+static u64
+merge_item_pfx(const void *blob)
+{
+    const struct merge_item *item = blob;
+
+    return key_obj_pfx64(&item->kobj);
+}
+
+static bool
+merge_src_next(struct element_source *es, void **data)
+{
+    struct merge_src *  src = container_of(es, struct merge_src, ms_es);
+    struct merge *      mg = src->ms_merge;
+    struct kv_iterator *iter = src->ms_iter;
     merr_t              err;
-    struct merge_item   item;
 
     if (unlikely(iter->kvi_eof))
-        return 0;
+        return false;
 
-    err = kvset_iter_next_key(iter, &item.kobj, &item.vctx);
-    if (ev(err))
-        return err;
+    err = kvset_iter_next_key(iter, &src->ms_item.kobj, &src->ms_item.vctx);
+    if (ev(err)) {
+        mg->mg_err = mg->mg_err ?: err;
+        return false;
+    }
     if (unlikely(iter->kvi_eof))
-        return 0;
+        return false;
 
-    item.src = src;
+    mg->mg_stats->ms_keys_in++;
+    mg->mg_stats->ms_key_bytes_in += key_obj_len(&src->ms_item.kobj);
 
-    err = bin_heap_insert(bh, &item);
-    if (ev(err))
-        return err;
+    *data = &src->ms_item;
 
-    stats->ms_keys_in++;
-    stats->ms_key_bytes_in += key_obj_len(&item.kobj);
+    return true;
+}
 
-    return 0;
+static void
+merge_fini(struct merge *mg)
+{
+    if (mg) {
+        loser_tree_destroy(mg->mg_lt);
+        free(mg);
+    }
 }
 
 static merr_t
 merge_init(
-    struct bin_heap **     bh_out,
+    struct merge **        mg_out,
     struct kv_iterator **  iterv,
     u32                    iterc,
+    uint                   kfixed,
     struct cn_merge_stats *stats)
 {
-    u32    i;
-    merr_t err;
-
-    err = bin_heap_create(bh_out, iterc, sizeof(struct merge_item), merge_item_compare);
-    if (ev(err))
-        goto err_exit1;
+    loser_tree_compare_fn *cmp;
+    struct merge *         mg;
+    size_t                 sz;
+    u32                    i;
+    merr_t                 err;
+
+    sz = sizeof(*mg) + iterc * sizeof(mg->mg_srcv[0]);
+
+    mg = malloc(sz + iterc * sizeof(*mg->mg_esv));
+    if (ev(!mg))
+        return merr(ENOMEM);
+
+    mg->mg_stats = stats;
+    mg->mg_err = 0;
+    mg->mg_esv = (void *)mg + sz;
+
+    cmp = merge_item_compare;
+    if (kfixed == 8)
+        cmp = merge_item_compare8;
+    else if (kfixed == 16)
+        cmp = merge_item_compare16;
+
+    err = loser_tree_create(iterc, cmp, merge_item_pfx, &mg->mg_lt);
+    if (ev(err)) {
+        free(mg);
+        return err;
+    }
 
     stats->ms_srcs = iterc;
 
     for (i = 0; i < iterc; i++) {
-        err = replenish(*bh_out, iterv, i, stats);
-        if (ev(err))
-            goto err_exit2;
+        struct merge_src *src = mg->mg_srcv + i;
+
+        src->ms_es = es_make(merge_src_next, NULL, NULL);
+        src->ms_iter = iterv[i];
+        src->ms_merge = mg;
+        src->ms_item.src = i;
+        mg->mg_esv[i] = &src->ms_es;
     }
 
-    return 0;
+    err = loser_tree_prepare(mg->mg_lt, iterc, mg->mg_esv) ?: mg->mg_err;
+    if (ev(err)) {
+        merge_fini(mg);
+        return err;
+    }
 
-err_exit2:
-    bin_heap_destroy(*bh_out);
-err_exit1:
-    return err;
+    *mg_out = mg;
+
+    return 0;
 }
 
 /* return true if item returned, false if no more items */
 static __always_inline bool
-get_next_item(
-    struct bin_heap *      bh,
-    struct kv_iterator **  iterv,
-    struct merge_item *    item,
-    struct cn_merge_stats *stats,
-    merr_t *               err_out)
+get_next_item(struct merge *mg, struct merge_item *item, merr_t *err_out)
 {
-    bool got_item;
-
-    got_item = bin_heap_get_delete(bh, item);
-    if (got_item)
-        *err_out = replenish(bh, iterv, item->src, stats);
-    else
-        *err_out = 0;
-    return got_item;
+    struct merge_item *top;
+
+    if (!loser_tree_peek(mg->mg_lt, (void **)&top)) {
+        *err_out = mg->mg_err;
+        return false;
+    }
+
+    /* Copy out the item before loser_tree_pop() replaces it with the next
+     * key of its source.
+     */
+    *item = *top;
+    loser_tree_pop(mg->mg_lt, (void **)&top);
+
+    *err_out = mg->mg_err;
+    return true;
 }
 
 static merr_t
@@ -177,6 +269,136 @@ kv_spill_abort(struct cn_tstate_omf *omf, void *arg)
 {
 }
 
+static inline bool
+is_spill_to_intnode(struct cn_tree_node *pnode, u32 child)
+{
+    return pnode->tn_childv[child] && !cn_node_isleaf(pnode->tn_childv[child]);
+}
+
+/* Persist the key hash map if it changed since it was last persisted.
+ */
+static merr_t
+kv_spill_khashmap_sync(struct cn_compaction_work *w)
+{
+    struct cn_khashmap *khashmap;
+    struct cn_tstate *  ts;
+    bool                update;
+
+    khashmap = cn_tree_get_khashmap(w->cw_tree);
+    if (!khashmap)
+        return 0;
+
+    spin_lock(&khashmap->khm_lock);
+    update = (khashmap->khm_gen > khashmap->khm_gen_committed);
+    spin_unlock(&khashmap->khm_lock);
+
+    if (!update)
+        return 0;
+
+    ts = w->cw_tree->ct_tstate;
+
+    return ts->ts_update(ts, kv_spill_prepare, kv_spill_commit, kv_spill_abort, w->cw_tree);
+}
+
+static merr_t
+kv_spill_builders_create(struct cn_compaction_work *w)
+{
+    enum mp_media_classp mclassp;
+    merr_t               err;
+    uint                 i, level;
+
+    for (i = 0; i < w->cw_outc; i++) {
+        struct cn_tree_node *pnode;
+
+        err = kvset_builder_create(
+            &w->cw_child[i],
+            cn_tree_get_cn(w->cw_tree),
+            w->cw_pc,
+            w->cw_dgen_hi,
+            KVSET_BUILDER_FLAGS_SPARE);
+        if (ev(err))
+            return err;
+
+        kvset_builder_set_merge_stats(w->cw_child[i], &w->cw_stats);
+
+        pnode = w->cw_node;
+        if (!pnode)
+            continue;
+
+        level = cn_node_level(pnode) + (w->cw_action == CN_ACTION_SPILL ? 1 : 0);
+        kvset_builder_set_node_level(w->cw_child[i], level);
+
+        /* A media tiering job moves its kvset to the given class. */
+        if (w->cw_comp_rule == CN_CR_LTIER) {
+            kvset_builder_set_mclass(w->cw_child[i], w->cw_mclass);
+            continue;
+        }
+
+        mclassp = MP_MED_CAPACITY;
+        if ((w->cw_action == CN_ACTION_SPILL && is_spill_to_intnode(pnode, i)) ||
+            (w->cw_action == CN_ACTION_COMPACT_KV && !cn_node_isleaf(pnode)))
+            mclassp = w->cw_rp->cn_media_class;
+
+        kvset_builder_set_mclass_lvl(w->cw_child[i], w->cw_rp, level, mclassp);
+    }
+
+    return 0;
+}
+
+/* Commit the output of the spill produced so far (see cn_comp_checkpoint()),
+ * then carry on with new kvset builders.  @kobj is the last key spilled.
+ */
+static merr_t
+kv_spill_checkpoint(struct cn_compaction_work *w, const struct key_obj *kobj)
+{
+    struct kvset_mblocks *outv;
+    merr_t                err;
+    uint                  i;
+
+    if (!cn_comp_checkpoint_begin(w))
+        return 0;
+
+    /* Lookups must find the committed keys in the children they were
+     * spilled to, so persist the key hash map first.
+     */
+    err = kv_spill_khashmap_sync(w);
+    if (ev(err))
+        return err;
+
+    outv = calloc(w->cw_outc, sizeof(*outv));
+    if (ev(!outv))
+        return merr(ENOMEM);
+
+    for (i = 0; i < w->cw_outc; i++) {
+        err = kvset_builder_get_mblocks(w->cw_child[i], &outv[i]);
+        if (ev(err))
+            break;
+    }
+
+    if (err) {
+        while (i-- > 0) {
+            abort_mblocks(w->cw_ds, &outv[i].kblks);
+            abort_mblocks(w->cw_ds, &outv[i].vblks);
+            blk_list_free(&outv[i].kblks);
+            blk_list_free(&outv[i].vblks);
+        }
+        free(outv);
+        return err;
+    }
+
+    for (i = 0; i < w->cw_outc; i++) {
+        kvset_builder_destroy(w->cw_child[i]);
+        w->cw_child[i] = NULL;
+    }
+
+    err = cn_comp_checkpoint(w, outv, kobj);
+    free(outv);
+    if (ev(err))
+        return err;
+
+    return kv_spill_builders_create(w);
+}
+
 /**
  * kv_spill() - merge key-value streams, then partition by child
  * Requirements:
@@ -186,17 +408,18 @@ kv_spill_abort(struct cn_tstate_omf *omf, void *arg)
 static merr_t
 kv_spill(struct cn_compaction_work *w)
 {
-    struct bin_heap *     bh;
+    struct merge *        mg;
     struct merge_item     curr;
     merr_t                err;
     struct kvset_builder *child;
 
     u64   hash;
-    uint  vlen;
+    uint  vlen, complen, omlen;
     uint  cnum;
     u32   childmask; /* mask: which children get kvpairs */
     void *buf = NULL;
     u32   bufsz = 0;
+    void *cfbuf = NULL;
 
     struct cn_khashmap *khashmap = NULL;
 
@@ -220,6 +443,13 @@ kv_spill(struct cn_compaction_work *w)
     u64    tstart;
     u64    tprog = 0;
 
+    /* Resumed spills skip the keys up to and including resume_kobj,
+     * checkpointed spills checkpoint each time ckpt_next bytes are out.
+     */
+    struct key_obj resume_kobj = { 0 };
+    bool           skip = false;
+    u64            ckpt_next = 0;
+
     u64 dbg_prev_seq __maybe_unused;
     uint dbg_prev_src __maybe_unused;
     uint dbg_nvals_this_key __maybe_unused;
@@ -228,11 +458,11 @@ kv_spill(struct cn_compaction_work *w)
     if (w->cw_prog_interval && w->cw_progress)
         tprog = get_time_ns();
 
-    err = merge_init(&bh, w->cw_inputv, w->cw_kvset_cnt, &w->cw_stats);
+    err = merge_init(&mg, w->cw_inputv, w->cw_kvset_cnt, w->cw_cp->cp_kfixed, &w->cw_stats);
     if (ev(err))
         return err;
 
-    more = get_next_item(bh, w->cw_inputv, &curr, &w->cw_stats, &err);
+    more = get_next_item(mg, &curr, &err);
     if (!more || ev(err))
         goto done;
 
@@ -252,6 +482,14 @@ kv_spill(struct cn_compaction_work *w)
 
     tstart = perfc_ison(w->cw_pc, PERFC_DI_CNCOMP_VGET) ? 1 : 0;
 
+    if (w->cw_resume && w->cw_resume->nc_klen > 0) {
+        key2kobj(&resume_kobj, w->cw_resume->nc_key, w->cw_resume->nc_klen);
+        skip = true;
+    }
+
+    if (w->cw_ckpt_sz)
+        ckpt_next = w->cw_ckpt_sz;
+
 new_key:
     pt_spread = 0;
     childmask = 0;
@@ -270,6 +508,13 @@ new_key:
         }
     }
 
+    if (unlikely(skip)) {
+        if (key_obj_cmp(&curr.kobj, &resume_kobj) <= 0)
+            goto skip_key;
+
+        skip = false;
+    }
+
     /* Caller sets cw_pfx_len appropriately for the current
      * level, so no need to adapt the hash according to the
      * tree level.
@@ -277,6 +522,12 @@ new_key:
     curr_klen = key_obj_len(&curr.kobj);
     assert(curr_klen >= cn_sfx_len || curr.vctx.is_ptomb);
 
+    if (w->cw_split) {
+        /* Range trees route on the (prefix of the) key itself. */
+        cnum = cn_split_child(w->cw_split, w->cw_pfx_len, &curr.kobj);
+        goto route;
+    }
+
     hashlen = w->cw_pfx_len;
     hashlen = hashlen ?: curr_klen - cn_sfx_len;
 
@@ -306,6 +557,8 @@ new_key:
     }
 
     cnum &= (w->cw_outc - 1);
+
+route:
     child = w->cw_child[cnum];
 
     bg_val = false;
@@ -324,18 +577,30 @@ get_values:
         const void *   vdata = NULL;
         bool           should_emit = false;
         enum kmd_vtype vtype;
-        u32            vbidx;
-        u32            vboff;
+        uint           vbidx;
+        uint           vboff;
         bool           direct;
 
         if (tstart > 0)
             tstart = get_time_ns();
 
         if (!kvset_iter_next_vref(
-                w->cw_inputv[curr.src], &curr.vctx, &seq, &vtype, &vbidx, &vboff, &vdata, &vlen))
+                w->cw_inputv[curr.src],
+                &curr.vctx,
+                &seq,
+                &vtype,
+                &vbidx,
+                &vboff,
+                &vdata,
+                &vlen,
+                &complen))
             break;
 
-        direct = vtype == vtype_val && vlen > direct_read_len;
+        /* Compressed values are spilled as is, so read only their
+         * compressed data.
+         */
+        omlen = complen ?: vlen;
+        direct = (vtype == vtype_val || vtype == vtype_cval) && omlen > direct_read_len;
 
         /* [HSE_REVISIT] direct read path allocates buffer. Performing
          * direct reads into the buffer in kvset builder without this
@@ -344,13 +609,13 @@ get_values:
         if (direct) {
             uint bufsz_min;
 
-            if (ev(vlen > HSE_KVS_VLEN_MAX)) {
-                assert(vlen <= HSE_KVS_VLEN_MAX);
+            if (ev(omlen > HSE_KVS_VLEN_MAX)) {
+                assert(omlen <= HSE_KVS_VLEN_MAX);
                 err = merr(EBUG);
                 goto done;
             }
 
-            bufsz_min = vlen;
+            bufsz_min = omlen;
 
             /* If value offset is not page aligned then allocate
              * one additional page to prevent a potential copy
@@ -362,9 +627,9 @@ get_values:
             if (!buf || bufsz < bufsz_min) {
                 free_aligned(buf);
 
-                if (vlen < HSE_KVS_VLEN_MAX / 4)
+                if (omlen < HSE_KVS_VLEN_MAX / 4)
                     bufsz = HSE_KVS_VLEN_MAX / 4;
-                else if (vlen < HSE_KVS_VLEN_MAX / 2)
+                else if (omlen < HSE_KVS_VLEN_MAX / 2)
                     bufsz = HSE_KVS_VLEN_MAX / 2;
                 else
                     bufsz = HSE_KVS_VLEN_MAX;
@@ -381,11 +646,11 @@ get_values:
             }
 
             err = kvset_iter_next_val_direct(
-                w->cw_inputv[curr.src], vtype, vbidx, vboff, buf, vlen, bufsz);
+                w->cw_inputv[curr.src], vtype, vbidx, vboff, buf, omlen, bufsz);
             vdata = buf;
         } else {
             err = kvset_iter_next_val(
-                w->cw_inputv[curr.src], &curr.vctx, vtype, vbidx, vboff, &vdata, &vlen);
+                w->cw_inputv[curr.src], &curr.vctx, vtype, vbidx, vboff, &vdata, &vlen, complen);
         }
         if (ev(err))
             goto done;
@@ -413,6 +678,10 @@ get_values:
         dbg_nvals_this_key++;
         dbg_prev_seq = seq;
 
+        /* Expired entries and all older values of their key are dropped. */
+        if (seq <= w->cw_ttl_seq)
+            break;
+
         bg_val = (seq <= w->cw_horizon);
 
         if (bg_val) {
@@ -426,6 +695,25 @@ get_values:
             }
         }
 
+        /* The value that every view sees goes through the compaction
+         * filter, if any.  It is the last value of its key to be merged,
+         * so a dropped key becomes a tombstone (or nothing, where
+         * tombstones are dropped) and a replaced value hides no others.
+         */
+        if (bg_val && w->cw_cfilter && !HSE_CORE_IS_TOMB(vdata)) {
+            int action;
+
+            err = cn_comp_filter(w, &cfbuf, &curr.kobj, &vdata, &vlen, &complen, &action);
+            if (ev(err))
+                goto done;
+
+            if (action == KVS_CFILTER_DROP) {
+                vdata = HSE_CORE_TOMB_REG;
+                vlen = 0;
+                complen = 0;
+            }
+        }
+
         if (HSE_CORE_IS_PTOMB(vdata))
             should_emit = !emitted_seq_pt || seq < emitted_seq_pt;
         else
@@ -448,7 +736,7 @@ get_values:
                     if (w->cw_drop_tombv[i] && bg_val)
                         continue;
 
-                    err = kvset_builder_add_val(w->cw_child[i], seq, vdata, vlen, NULL);
+                    err = kvset_builder_add_val(w->cw_child[i], seq, vdata, vlen, 0, NULL);
                     if (ev(err))
                         goto done;
 
@@ -460,11 +748,11 @@ get_values:
                 if (w->cw_drop_tombv[cnum] && HSE_CORE_IS_TOMB(vdata) && bg_val)
                     continue; /* skip value */
 
-                err = kvset_builder_add_val(child, seq, vdata, vlen, NULL);
+                err = kvset_builder_add_val(child, seq, vdata, vlen, complen, NULL);
                 if (ev(err))
                     goto done;
 
-                w->cw_stats.ms_val_bytes_out += vlen;
+                w->cw_stats.ms_val_bytes_out += complen ?: vlen;
                 emitted_val = true;
                 childmask |= (1 << cnum);
                 if (HSE_CORE_IS_PTOMB(vdata))
@@ -509,7 +797,7 @@ get_values:
     dbg_nvals_this_key = 0;
     dbg_prev_src = curr.src;
 
-    more = get_next_item(bh, w->cw_inputv, &curr, &w->cw_stats, &err);
+    more = get_next_item(mg, &curr, &err);
     if (ev(err))
         goto done;
 
@@ -551,12 +839,74 @@ get_values:
         }
     }
 
+    if (more && ckpt_next) {
+        u64 outsz = w->cw_stats.ms_key_bytes_out + w->cw_stats.ms_val_bytes_out;
+
+        if (outsz >= ckpt_next) {
+            err = kv_spill_checkpoint(w, &prev_kobj);
+            if (ev(err))
+                goto done;
+
+            ckpt_next = outsz + w->cw_ckpt_sz;
+        }
+    }
+
     if (more)
         goto new_key;
 
+    goto done;
+
+skip_key:
+    /* The children already have this key, only track the ptombs that
+     * may annihilate the keys after it.
+     */
+    {
+        const void *   vdata;
+        enum kmd_vtype vtype;
+        uint           vbidx;
+        uint           vboff;
+
+        while (kvset_iter_next_vref(
+            w->cw_inputv[curr.src],
+            &curr.vctx,
+            &seq,
+            &vtype,
+            &vbidx,
+            &vboff,
+            &vdata,
+            &vlen,
+            &complen)) {
+
+            if (seq > w->cw_horizon)
+                continue;
+
+            if (vtype == vtype_ptomb && !(pt_set && seq < pt_seq)) {
+                pt_set = true;
+                pt_kobj = curr.kobj;
+                pt_seq = seq;
+            }
+            break;
+        }
+    }
+
+    prev_kobj = curr.kobj;
+
+    more = get_next_item(mg, &curr, &err);
+    if (ev(err))
+        goto done;
+
+    if (more) {
+        if (pt_set && key_obj_cmp(&curr.kobj, &prev_kobj) != 0 &&
+            key_obj_cmp_prefix(&pt_kobj, &curr.kobj) != 0)
+            pt_set = false;
+
+        goto new_key;
+    }
+
 done:
-    bin_heap_destroy(bh);
+    merge_fini(mg);
     free_aligned(buf);
+    free(cfbuf);
 
     /* We must ensure the latest version of the key hash map is persisted
      * if it changed while we were using it (regardless of who changed it,
@@ -564,18 +914,9 @@ done:
      */
     if (khashmap) {
         merr_t err2;
-        bool   update;
 
-        spin_lock(&khashmap->khm_lock);
-        update = (khashmap->khm_gen > khashmap->khm_gen_committed);
-        spin_unlock(&khashmap->khm_lock);
-
-        if (update) {
-            struct cn_tstate *ts = w->cw_tree->ct_tstate;
-
-            err2 = ts->ts_update(ts, kv_spill_prepare, kv_spill_commit, kv_spill_abort, w->cw_tree);
-            err = err ?: err2;
-        }
+        err2 = kv_spill_khashmap_sync(w);
+        err = err ?: err2;
     }
 
     if (seqno_errcnt)
@@ -587,44 +928,21 @@ done:
     return err;
 }
 
-static inline bool
-is_spill_to_intnode(struct cn_tree_node *pnode, u32 child)
-{
-    return pnode->tn_childv[child] && !cn_node_isleaf(pnode->tn_childv[child]);
-}
-
 merr_t
 cn_spill(struct cn_compaction_work *w)
 {
-    merr_t               err;
-    uint                 i;
-    enum mp_media_classp mclassp;
+    merr_t err;
+    uint   i;
 
     assert(w->cw_kvset_cnt);
     assert(w->cw_inputv);
 
     memset(w->cw_outv, 0, w->cw_outc * sizeof(*w->cw_outv));
+    memset(w->cw_child, 0, w->cw_outc * sizeof(*w->cw_child));
 
-    for (i = 0; i < w->cw_outc; i++) {
-        struct cn_tree_node *pnode;
-
-        err = kvset_builder_create(
-            &w->cw_child[i],
-            cn_tree_get_cn(w->cw_tree),
-            w->cw_pc,
-            w->cw_dgen_hi,
-            KVSET_BUILDER_FLAGS_SPARE);
-        if (ev(err))
-            goto done;
-
-        kvset_builder_set_merge_stats(w->cw_child[i], &w->cw_stats);
-
-        mclassp = w->cw_rp->cn_media_class;
-        pnode = w->cw_node;
-        if (pnode && ((w->cw_action == CN_ACTION_SPILL && is_spill_to_intnode(pnode, i)) ||
-                      (w->cw_action == CN_ACTION_COMPACT_KV && !cn_node_isleaf(pnode))))
-            kvset_builder_set_mclass(w->cw_child[i], mclassp);
-    }
+    err = kv_spill_builders_create(w);
+    if (ev(err))
+        goto done;
 
     err = kv_spill(w);
     if (ev(err))
@@ -648,7 +966,8 @@ cn_spill(struct cn_compaction_work *w)
 done:
     /* Applies to success and failure paths */
     for (i = 0; i < w->cw_outc; i++)
-        kvset_builder_destroy(w->cw_child[i]);
+        if (w->cw_child[i])
+            kvset_builder_destroy(w->cw_child[i]);
 
     return err;
 }
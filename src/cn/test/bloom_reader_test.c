@@ -96,7 +96,7 @@ read_blooms(struct mtf_test_info *lcl_ti, char *kblock_file)
     mpm_mblock_read(blkid, &blm_hdr, omf_kbh_blm_hoff(&kb_hdr), omf_kbh_blm_hlen(&kb_hdr));
 
     ASSERT_EQ(omf_bh_magic(&blm_hdr), BLOOM_OMF_MAGIC);
-    ASSERT_EQ(omf_bh_version(&blm_hdr), BLOOM_OMF_VERSION);
+    ASSERT_EQ(omf_bh_version(&blm_hdr), BLOOM_OMF_VERSION4);
 
     ASSERT_GE(omf_bh_bktshift(&blm_hdr), 9);
     ASSERT_LE(omf_bh_bktshift(&blm_hdr), 16);
@@ -32,6 +32,20 @@ pre(struct mtf_test_info *info)
     return 0;
 }
 
+static int
+cfilter_drop(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    return KVS_CFILTER_DROP;
+}
+
 MTF_BEGIN_UTEST_COLLECTION_PRE(cn_api, init);
 
 MTF_DEFINE_UTEST_PRE(cn_api, basic, pre)
@@ -103,6 +117,14 @@ MTF_DEFINE_UTEST_PRE(cn_api, basic, pre)
     ASSERT_EQ(0, cnid);
 
     (void)cn_get_cancel(cn);
+
+    void *arg = NULL;
+
+    ASSERT_EQ(NULL, cn_cfilter_get(cn, &arg));
+    cn_cfilter_set(cn, cfilter_drop, &rp);
+    ASSERT_EQ(cfilter_drop, cn_cfilter_get(cn, &arg));
+    ASSERT_EQ(&rp, arg);
+
     (void)cn_get_io_wq(cn);
     (void)cn_get_sched(cn);
     (void)cn_get_cndb(cn);
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/page.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_attach.h>
+
+#include <ftw.h>
+
+#define mock_cn ((struct cn *)1)
+
+static char dir[64];
+static int  ingested;
+
+static merr_t
+_cn_ingest_bulk(struct cn *cn, struct kvset_mblocks *mbv, int mbc)
+{
+    ingested += mbc;
+
+    return 0;
+}
+
+static void
+image(const char *name, size_t len)
+{
+    char  path[128];
+    char *buf;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    buf = calloc(1, len + 1);
+    fp = fopen(path, "w");
+    if (fp && buf && len)
+        fwrite(buf, 1, len, fp);
+    if (fp)
+        fclose(fp);
+    free(buf);
+}
+
+static int
+rm_ent(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    return remove(path);
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    ingested = 0;
+
+    snprintf(dir, sizeof(dir), "/tmp/cn_attach_test.XXXXXX");
+    if (!mkdtemp(dir))
+        return -1;
+
+    MOCK_SET(cn, _cn_ingest_bulk);
+
+    mapi_inject(mapi_idx_cn_get_dataset, 0);
+    mapi_inject(mapi_idx_cn_get_cparams, 0);
+    mapi_inject(mapi_idx_cn_get_rp, 0);
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    nftw(dir, rm_ent, 8, FTW_DEPTH | FTW_PHYS);
+    mapi_inject_clear();
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_attach)
+
+MTF_DEFINE_UTEST_PREPOST(cn_attach, layout, pre, post)
+{
+    struct cn_attach *att;
+    merr_t            err;
+    u64               min, max;
+
+    err = cn_attach_create(mock_cn, &att);
+    ASSERT_EQ(0, err);
+
+    err = cn_attach_add(att, "/nonexistent/cn_attach_test");
+    ASSERT_EQ(ENOENT, merr_errno(err));
+
+    /* No kblocks. */
+    image("README", 10);
+    image("V0.0x1234", PAGE_SIZE);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* Gap in the kblock indexes. */
+    image("K000.0x1000", PAGE_SIZE);
+    image("K002.0x1002", PAGE_SIZE);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* Gap filled, the vblock header is checked first. */
+    image("K1", PAGE_SIZE);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EILSEQ, merr_errno(err));
+
+    cn_attach_seqno(att, &min, &max);
+    ASSERT_EQ(U64_MAX, min);
+    ASSERT_EQ(0, max);
+
+    /* Nothing was added, so there is nothing to ingest. */
+    err = cn_attach_commit(att);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, ingested);
+
+    cn_attach_destroy(att);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_attach, length, pre, post)
+{
+    struct cn_attach *att;
+    merr_t            err;
+
+    err = cn_attach_create(mock_cn, &att);
+    ASSERT_EQ(0, err);
+
+    /* Images are whole pages. */
+    image("K0", PAGE_SIZE + 1);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    image("K0", 0);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* Duplicate index. */
+    image("K0", PAGE_SIZE);
+    image("K00", PAGE_SIZE);
+    err = cn_attach_add(att, dir);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    cn_attach_destroy(att);
+}
+
+MTF_END_UTEST_COLLECTION(cn_attach)
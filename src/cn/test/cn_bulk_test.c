@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_bulk.h>
+#include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvset_builder.h>
+
+#define mock_cn ((struct cn *)1)
+
+static struct kvs_rparams rp;
+static int                builders;
+static int                ingested;
+
+static struct kvs_rparams *
+_cn_get_rp(const struct cn *cn)
+{
+    return &rp;
+}
+
+static merr_t
+_cn_ingest_bulk(struct cn *cn, struct kvset_mblocks *mbv, int mbc)
+{
+    ingested += mbc;
+
+    return 0;
+}
+
+static merr_t
+_kvset_builder_create(
+    struct kvset_builder **builder_out,
+    struct cn *            cn,
+    struct perfc_set *     pc,
+    u64                    vgroup,
+    uint                   flags)
+{
+    *builder_out = (struct kvset_builder *)1111;
+    builders++;
+
+    return 0;
+}
+
+static void
+_kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    bldr,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    rp = kvs_rparams_defaults();
+    builders = 0;
+    ingested = 0;
+
+    MOCK_SET(cn, _cn_get_rp);
+    MOCK_SET(cn, _cn_ingest_bulk);
+    MOCK_SET(kvset_builder, _kvset_builder_create);
+    MOCK_SET(kvset_builder, _kvset_builder_set_mclass_lvl);
+
+    mapi_inject(mapi_idx_cn_get_ingest_perfc, 0);
+    mapi_inject(mapi_idx_cn_get_dataset, 0);
+    mapi_inject(mapi_idx_kvset_builder_add_val, 0);
+    mapi_inject(mapi_idx_kvset_builder_add_key, 0);
+    mapi_inject(mapi_idx_kvset_builder_get_mblocks, 0);
+    mapi_inject(mapi_idx_kvset_builder_destroy, 0);
+    mapi_inject(mapi_idx_kvset_mblocks_destroy, 0);
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    mapi_inject_clear();
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_bulk)
+
+MTF_DEFINE_UTEST_PREPOST(cn_bulk, order, pre, post)
+{
+    struct cn_bulk *bulk;
+    merr_t          err;
+
+    err = cn_bulk_create(mock_cn, 100, &bulk);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_add(bulk, "b", 1, "v", 1);
+    ASSERT_EQ(0, err);
+
+    /* Duplicate and descending keys are rejected, the load goes on. */
+    err = cn_bulk_add(bulk, "b", 1, "v", 1);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = cn_bulk_add(bulk, "a", 1, "v", 1);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = cn_bulk_add(bulk, "ba", 2, "", 0);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_add(bulk, "c", 1, "v", 1);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_commit(bulk);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(1, builders);
+    ASSERT_EQ(1, ingested);
+    ASSERT_EQ(3, mapi_calls(mapi_idx_kvset_builder_add_key));
+
+    cn_bulk_destroy(bulk);
+    ASSERT_EQ(1, mapi_calls(mapi_idx_kvset_builder_destroy));
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_bulk, empty, pre, post)
+{
+    struct cn_bulk *bulk;
+    merr_t          err;
+
+    err = cn_bulk_create(mock_cn, 100, &bulk);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_commit(bulk);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, builders);
+    ASSERT_EQ(0, ingested);
+
+    cn_bulk_destroy(bulk);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_bulk, abort, pre, post)
+{
+    struct cn_bulk *bulk;
+    merr_t          err;
+
+    err = cn_bulk_create(mock_cn, 100, &bulk);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_add(bulk, "a", 1, "v", 1);
+    ASSERT_EQ(0, err);
+
+    /* Destroying an uncommitted load discards the kvset in progress. */
+    cn_bulk_destroy(bulk);
+    ASSERT_EQ(1, mapi_calls(mapi_idx_kvset_builder_destroy));
+    ASSERT_EQ(0, ingested);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_bulk, failure, pre, post)
+{
+    struct cn_bulk *bulk;
+    merr_t          err;
+
+    err = cn_bulk_create(mock_cn, 100, &bulk);
+    ASSERT_EQ(0, err);
+
+    err = cn_bulk_add(bulk, "a", 1, "v", 1);
+    ASSERT_EQ(0, err);
+
+    mapi_inject(mapi_idx_kvset_builder_add_val, EIO);
+
+    err = cn_bulk_add(bulk, "b", 1, "v", 1);
+    ASSERT_EQ(EIO, merr_errno(err));
+
+    /* A failed load can only be destroyed. */
+    mapi_inject(mapi_idx_kvset_builder_add_val, 0);
+
+    err = cn_bulk_add(bulk, "c", 1, "v", 1);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = cn_bulk_commit(bulk);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+    ASSERT_EQ(0, ingested);
+
+    cn_bulk_destroy(bulk);
+}
+
+MTF_END_UTEST_COLLECTION(cn_bulk)
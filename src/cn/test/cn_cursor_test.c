@@ -171,7 +171,7 @@ verify_cursor(
     merr_t                err;
 
     /* make seqno so large there is never any filtering */
-    err = cn_cursor_create(cn, seqno, false, pfx, pfx_len, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, pfx, pfx_len, &sum, &cur);
     ASSERT_EQ(err, 0);
     ASSERT_NE(cur, NULL);
 
@@ -193,7 +193,7 @@ verify_seek(
     void *                cur;
     merr_t                err;
 
-    err = cn_cursor_create(cn, seqno, false, pfx, pfx_len, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, pfx, pfx_len, &sum, &cur);
     ASSERT_EQ(err, 0);
     ASSERT_NE(cur, NULL);
 
@@ -220,7 +220,7 @@ verify_seek_eof(
     void *cur;
     merr_t err;
 
-    err = cn_cursor_create(cn, seqno, false, pfx, pfx_len, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, pfx, pfx_len, &sum, &cur);
     ASSERT_EQ(err, 0);
     ASSERT_NE(cur, NULL);
 
@@ -365,7 +365,7 @@ MTF_DEFINE_UTEST_PREPOST(cn_cursor, repeat_update, pre, post)
     ASSERT_EQ(err, 0);
 
 #if 0
-    err = cn_cursor_create(cn, seqno, false, NULL, 0, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, NULL, 0, &sum, &cur);
     ASSERT_EQ(err, 0);
     ASSERT_NE(cur, NULL);
 
@@ -963,7 +963,7 @@ MTF_DEFINE_UTEST_PREPOST(cn_cursor, capped_update, pre, post)
     }
 
     /* Test 1: capped cursor update test */
-    err = cn_cursor_create(cn, seqno, false, NULL, 0, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, NULL, 0, &sum, &cur);
     ASSERT_EQ(err, 0);
 
     err = cn_tree_insert_kvset(tree, ITV_KVSET(itv[NELEM(make) - 1]), 0, 0);
@@ -1112,7 +1112,7 @@ MTF_DEFINE_UTEST_PREPOST(cn_cursor, capped_update_errors, pre, post)
         ASSERT_EQ(err, 0);
     }
 
-    err = cn_cursor_create(cn, seqno, false, NULL, 0, &sum, &cur);
+    err = cn_cursor_create(cn, seqno, false, false, false, NULL, 0, &sum, &cur);
     ASSERT_EQ(err, 0);
 
     for (; i < NELEM(make); ++i) {
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_util/hse_err.h>
+
+#include <hse_ikvdb/cn_evlog.h>
+
+MTF_BEGIN_UTEST_COLLECTION(cn_evlog)
+
+MTF_DEFINE_UTEST(cn_evlog, read_since)
+{
+    struct cn_evlog *evlog;
+    struct cn_event  cev, evv[CN_EVLOG_SZ];
+    merr_t           err;
+    uint             n, i;
+
+    err = cn_evlog_create(&evlog);
+    ASSERT_EQ(err, 0);
+
+    n = cn_evlog_read(evlog, 0, evv, NELEM(evv));
+    ASSERT_EQ(0, n);
+
+    for (i = 0; i < 3; ++i) {
+        memset(&cev, 0, sizeof(cev));
+        cev.ce_type = CN_EVENT_SPILL;
+        cev.ce_kvsets_in = i;
+        cn_evlog_add(evlog, &cev);
+        ASSERT_EQ(i + 1, cev.ce_seq);
+    }
+
+    n = cn_evlog_read(evlog, 0, evv, NELEM(evv));
+    ASSERT_EQ(3, n);
+    for (i = 0; i < n; ++i) {
+        ASSERT_EQ(i + 1, evv[i].ce_seq);
+        ASSERT_EQ(i, evv[i].ce_kvsets_in);
+    }
+
+    /* Only the events that follow the given one are returned.
+     */
+    n = cn_evlog_read(evlog, 2, evv, NELEM(evv));
+    ASSERT_EQ(1, n);
+    ASSERT_EQ(3, evv[0].ce_seq);
+
+    n = cn_evlog_read(evlog, 3, evv, NELEM(evv));
+    ASSERT_EQ(0, n);
+
+    n = cn_evlog_read(evlog, 100, evv, NELEM(evv));
+    ASSERT_EQ(0, n);
+
+    cn_evlog_destroy(evlog);
+}
+
+MTF_DEFINE_UTEST(cn_evlog, wrap)
+{
+    struct cn_evlog *evlog;
+    struct cn_event  cev, evv[CN_EVLOG_SZ];
+    merr_t           err;
+    uint             n, i;
+
+    err = cn_evlog_create(&evlog);
+    ASSERT_EQ(err, 0);
+
+    /* The log keeps the newest events.
+     */
+    for (i = 0; i < CN_EVLOG_SZ + 10; ++i) {
+        memset(&cev, 0, sizeof(cev));
+        cn_evlog_add(evlog, &cev);
+    }
+
+    n = cn_evlog_read(evlog, 0, evv, NELEM(evv));
+    ASSERT_EQ(CN_EVLOG_SZ, n);
+    ASSERT_EQ(11, evv[0].ce_seq);
+    ASSERT_EQ(CN_EVLOG_SZ + 10, evv[n - 1].ce_seq);
+
+    /* A small buffer gets the newest of the requested events.
+     */
+    n = cn_evlog_read(evlog, 0, evv, 4);
+    ASSERT_EQ(4, n);
+    ASSERT_EQ(CN_EVLOG_SZ + 7, evv[0].ce_seq);
+
+    cn_evlog_add(NULL, &cev);
+
+    cn_evlog_destroy(evlog);
+}
+
+MTF_END_UTEST_COLLECTION(cn_evlog)
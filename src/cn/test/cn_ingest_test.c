@@ -47,10 +47,12 @@ struct injections injections[] = {
     { 0, mapi_idx_kvset_create },
     { 0, mapi_idx_kvset_put_ref },
     { 0, mapi_idx_kvset_get_ref },
+    { 0, mapi_idx_kvset_key_fences },
     { 0, mapi_idx_kvset_log_d_records },
     { 0, mapi_idx_kvset_mark_mblocks_for_delete },
     { 0, mapi_idx_kvset_get_hlog },
     { 123, mapi_idx_kvset_get_dgen },
+    { 0, mapi_idx_kvset_get_seqno_min },
 
     /* cndb */
     { 0, mapi_idx_cndb_seqno },
@@ -292,13 +294,68 @@ MTF_DEFINE_UTEST_PRE(cn_ingest_test, worker, test_pre)
 
     init_mblks(m, n_kvsets, &k, &v);
     mbc[0] = n_kvsets;
-    err = cn_ingestv(cnv, mbv, mbc, NULL, U64_MAX, (int)NELEM(cnv), &ingested, &seqno);
+    err = cn_ingestv(cnv, mbv, mbc, NULL, U64_MAX, (int)NELEM(cnv), &ingested, &seqno, NULL);
     ASSERT_EQ(err, 0);
     free_mblks(m, n_kvsets);
 
     cn_tree_destroy(cn.cn_tree);
 }
 
+MTF_DEFINE_UTEST_PRE(cn_ingest_test, worker_multi, test_pre)
+{
+    struct kvset_mblocks m[3];
+    uint                 n_kvsets = NELEM(m);
+
+    u32                k, v, vcommitted[1];
+    merr_t             err;
+    struct cn          cn = {};
+    struct kvs_rparams rp;
+
+    struct cn *           cnv[1] = { &cn };
+    struct kvset_mblocks *mbv[1] = { &m[0] };
+    int                   mbc[1];
+    bool                  ingested;
+    u64                   seqno;
+    struct kvs_cparams    cp;
+
+    rp = kvs_rparams_defaults();
+    cn.rp = &rp;
+    cn.cn_dataset = mock_ds;
+    atomic64_set(&cn.cn_ingest_dgen, 41);
+
+    cp.cp_fanout = 4;
+    cp.cp_pfx_len = 0;
+    cp.cp_pfx_pivot = 0;
+    cp.cp_sfx_len = 0;
+    err = cn_tree_create(&cn.cn_tree, NULL, 0, &cp, &mock_health, &rp);
+    ASSERT_EQ(err, 0);
+
+    /* Several kvsets into one cn: one C and one meta record per kvset,
+     * and a distinct dgen per kvset.
+     */
+    init_mblks(m, n_kvsets, &k, &v);
+    mbc[0] = n_kvsets;
+    mapi_calls_clear(mapi_idx_cndb_txn_txc);
+    mapi_calls_clear(mapi_idx_cndb_txn_meta);
+    err = cn_ingestv(cnv, mbv, mbc, NULL, U64_MAX, (int)NELEM(cnv), &ingested, &seqno, NULL);
+    ASSERT_EQ(err, 0);
+    ASSERT_TRUE(ingested);
+    ASSERT_EQ(mapi_calls(mapi_idx_cndb_txn_txc), n_kvsets);
+    ASSERT_EQ(mapi_calls(mapi_idx_cndb_txn_meta), n_kvsets);
+    ASSERT_EQ(atomic64_read(&cn.cn_ingest_dgen), 41 + n_kvsets);
+    free_mblks(m, n_kvsets);
+
+    /* Externally committed vblocks are only allowed for a single kvset.
+     */
+    init_mblks(m, n_kvsets, &k, &v);
+    vcommitted[0] = 1;
+    err = cn_ingestv(cnv, mbv, mbc, vcommitted, 1, (int)NELEM(cnv), &ingested, &seqno, NULL);
+    ASSERT_EQ(merr_errno(err), EINVAL);
+    free_mblks(m, n_kvsets);
+
+    cn_tree_destroy(cn.cn_tree);
+}
+
 MTF_DEFINE_UTEST_PRE(cn_ingest_test, fail_cleanup, test_pre)
 {
     struct kvset_mblocks m[1];
@@ -331,7 +388,7 @@ MTF_DEFINE_UTEST_PRE(cn_ingest_test, fail_cleanup, test_pre)
     /* kvset create failure */
     init_mblks(m, n_kvsets, &k, &v);
     mapi_inject(mapi_idx_kvset_create, merr(EBADF));
-    err = cn_ingestv(cnv, mbv, mbc, NULL, U64_MAX, NELEM(cnv), &ingested, &seqno);
+    err = cn_ingestv(cnv, mbv, mbc, NULL, U64_MAX, NELEM(cnv), &ingested, &seqno, NULL);
     ASSERT_EQ(merr_errno(err), EBADF);
     mapi_inject(mapi_idx_kvset_create, 0);
     free_mblks(m, n_kvsets);
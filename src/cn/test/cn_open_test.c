@@ -12,12 +12,15 @@
 
 #include <hse_ikvdb/kvs_cparams.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cndb.h>
 #include <hse_ikvdb/kvdb_health.h>
 
 #include "../cn_tree.h"
 #include "../cn_tree_create.h"
 #include "../cn_internal.h"
 #include "../cn_perfc.h"
+#include "../blk_list.h"
+#include "../kvset.h"
 
 static int
 init(struct mtf_test_info *lcl_ti)
@@ -255,4 +258,180 @@ MTF_DEFINE_UTEST_PREPOST(cn_open_test, cn_tstate_update, pre, post)
     cn_close(cn);
 }
 
+/* More kvsets than fit the initial job vector of cn_kvset_mk().
+ */
+#define MK_KVSETS 300
+
+static atomic_t mk_active, mk_peak, mk_created;
+static int      mk_inserted, mk_put;
+static u64      mk_fail;
+static merr_t   mk_cndb_err;
+static bool     mk_meta_ok, mk_order_ok;
+
+/* Kvset i has tag and dgen i + 1, a kblock with id 1000 + i, and lives
+ * in the root or in its first child.  Like cndb, reuse one kvset_meta.
+ */
+static merr_t
+_cndb_cn_instantiate(struct cndb *cndb, u64 cnid, void *ctx, cn_init_callback *cb)
+{
+    struct kvset_meta km = {};
+    merr_t            err;
+    u64               i;
+
+    blk_list_init(&km.km_kblk_list);
+    blk_list_init(&km.km_vblk_list);
+
+    for (i = 0; i < MK_KVSETS; i++) {
+        km.km_kblk_list.n_blks = 0;
+
+        err = blk_list_append(&km.km_kblk_list, 0, 1000 + i);
+        if (err)
+            break;
+
+        km.km_dgen = i + 1;
+        km.km_node_level = i % 2;
+        km.km_node_offset = 0;
+
+        err = cb(ctx, &km, i + 1);
+        if (err)
+            break;
+    }
+
+    blk_list_free(&km.km_kblk_list);
+
+    return err ?: mk_cndb_err;
+}
+
+static merr_t
+_kvset_create(struct cn_tree *tree, u64 tag, struct kvset_meta *km, struct kvset **kvset)
+{
+    int n, peak;
+
+    if (km->km_dgen != tag || km->km_kblk_list.n_blks != 1 ||
+        km->km_kblk_list.blks[0].bk_blkid != 1000 + tag - 1)
+        mk_meta_ok = false;
+
+    n = atomic_inc_return(&mk_active);
+    while ((peak = atomic_read(&mk_peak)) < n && atomic_cmpxchg(&mk_peak, peak, n) != peak)
+        ;
+
+    usleep(1000);
+    atomic_dec(&mk_active);
+
+    if (tag == mk_fail)
+        return merr(EIO);
+
+    atomic_inc(&mk_created);
+    *kvset = (struct kvset *)(uintptr_t)tag;
+
+    return 0;
+}
+
+static merr_t
+_cn_tree_insert_kvset(struct cn_tree *tree, struct kvset *kvset, uint level, uint offset)
+{
+    u64 tag = (uintptr_t)kvset;
+
+    if (tag != mk_inserted + 1 || level != (tag - 1) % 2)
+        mk_order_ok = false;
+
+    mk_inserted++;
+
+    return 0;
+}
+
+static void
+_kvset_put_ref(struct kvset *kvset)
+{
+    mk_put++;
+}
+
+static int
+pre_mk(struct mtf_test_info *lcl_ti)
+{
+    pre(lcl_ti);
+
+    rp->cn_io_threads = 4;
+
+    atomic_set(&mk_active, 0);
+    atomic_set(&mk_peak, 0);
+    atomic_set(&mk_created, 0);
+    mk_inserted = mk_put = 0;
+    mk_fail = 0;
+    mk_cndb_err = 0;
+    mk_meta_ok = mk_order_ok = true;
+
+    mapi_inject_unset(mapi_idx_cndb_cn_instantiate);
+    MOCK_SET(cndb, _cndb_cn_instantiate);
+    MOCK_SET(kvset, _kvset_create);
+    MOCK_SET(kvset, _kvset_put_ref);
+    MOCK_SET(cn_tree_create, _cn_tree_insert_kvset);
+
+    return 0;
+}
+
+static int
+post_mk(struct mtf_test_info *lcl_ti)
+{
+    MOCK_UNSET(cn_tree_create, _cn_tree_insert_kvset);
+    MOCK_UNSET(kvset, _kvset_put_ref);
+    MOCK_UNSET(kvset, _kvset_create);
+    MOCK_UNSET(cndb, _cndb_cn_instantiate);
+
+    return post(lcl_ti);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_open_test, cn_open_kvsets, pre_mk, post_mk)
+{
+    merr_t     err;
+    struct cn *cn;
+
+    /* The kvsets are created concurrently, each from its own copy of
+     * the metadata, and inserted in cndb order.
+     */
+    err = cn_open(CN_OPEN_ARGS, &cn);
+    ASSERT_EQ(0, err);
+    ASSERT_TRUE(mk_meta_ok);
+    ASSERT_TRUE(mk_order_ok);
+    ASSERT_EQ(MK_KVSETS, atomic_read(&mk_created));
+    ASSERT_EQ(MK_KVSETS, mk_inserted);
+    ASSERT_EQ(0, mk_put);
+    ASSERT_GT(atomic_read(&mk_peak), 1);
+    ASSERT_LE(atomic_read(&mk_peak), rp->cn_io_threads);
+    ASSERT_EQ(MK_KVSETS, cn->cn_open_stats.cos_kvsets);
+    ASSERT_EQ(MK_KVSETS, cn->cn_open_stats.cos_mblocks);
+
+    cn_close(cn);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_open_test, cn_open_kvsets_fail, pre_mk, post_mk)
+{
+    merr_t     err;
+    struct cn *cn;
+
+    /* The kvsets before the one that failed are inserted, and those
+     * after it are released.
+     */
+    mk_fail = MK_KVSETS / 2;
+    err = cn_open(CN_OPEN_ARGS, &cn);
+    ASSERT_EQ(EIO, merr_errno(err));
+    ASSERT_TRUE(mk_order_ok);
+    ASSERT_EQ(MK_KVSETS - 1, atomic_read(&mk_created));
+    ASSERT_EQ(mk_fail - 1, mk_inserted);
+    ASSERT_EQ(MK_KVSETS - mk_fail, mk_put);
+
+    /* No kvset is created if cndb fails after its callbacks.
+     */
+    mk_fail = 0;
+    mk_inserted = mk_put = 0;
+    atomic_set(&mk_created, 0);
+    mk_cndb_err = merr(EPROTO);
+
+    err = cn_open(CN_OPEN_ARGS, &cn);
+    ASSERT_EQ(EPROTO, merr_errno(err));
+    ASSERT_EQ(0, atomic_read(&mk_created));
+    ASSERT_EQ(0, mk_inserted);
+    ASSERT_EQ(0, mk_put);
+}
+
 MTF_END_UTEST_COLLECTION(cn_open_test)
@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_test_support/mock_api.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/hash.h>
+#include <hse_util/hlog.h>
+
+#include <mpool/mpool.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_tree_view.h>
+#include <hse_ikvdb/kvset_view.h>
+
+#include "../cn_internal.h"
+#include "../kvset.h"
+#include "../kblock_reader.h"
+
+struct fake_kblock {
+    const char *        minkey;
+    const char *        maxkey;
+    struct kblk_metrics metrics;
+};
+
+struct fake_kvset {
+    struct fake_kblock  kblkv[3];
+    u32                 kblkc;
+    struct kvset_stats  stats;
+    struct hlog *       hlog;
+};
+
+/* Two kvsets, newest first, whose keys are the prefix of a kblock's min
+ * key followed by a two digit number.  Each kblock holds 10 live keys of
+ * 100 bytes each, but the older kvset's first kblock straddles "a" and
+ * "b" and holds twice as many, some of them tombstones.
+ */
+static struct fake_kvset ksv[2];
+static struct cn         fake_cn;
+static int               views, view_fails;
+
+static merr_t
+_cn_tree_view_create(struct cn *cn, struct table **view_out)
+{
+    struct kvset_view *v;
+    struct table *     view;
+    int                i;
+
+    if (view_fails > 0) {
+        view_fails--;
+        return merr(EAGAIN);
+    }
+
+    view = table_create(NELEM(ksv) + 1, sizeof(*v), true);
+    if (!view)
+        return merr(ENOMEM);
+
+    /* The view of a node without kvsets. */
+    v = table_append(view);
+    v->kvset = NULL;
+
+    for (i = 0; i < NELEM(ksv); i++) {
+        v = table_append(view);
+        v->kvset = (struct kvset *)&ksv[i];
+    }
+
+    views++;
+    *view_out = view;
+
+    return 0;
+}
+
+static void
+_cn_tree_view_destroy(struct table *view)
+{
+    views--;
+    table_destroy(view);
+}
+
+static u32
+_kvset_get_num_kblocks(struct kvset *ks)
+{
+    return ((struct fake_kvset *)ks)->kblkc;
+}
+
+static void
+_kvset_get_nth_kblock_minkey(struct kvset *ks, u32 index, const void **key, uint *klen)
+{
+    *key = ((struct fake_kvset *)ks)->kblkv[index].minkey;
+    *klen = strlen(*key);
+}
+
+static void
+_kvset_get_nth_kblock_maxkey(struct kvset *ks, u32 index, const void **key, uint *klen)
+{
+    *key = ((struct fake_kvset *)ks)->kblkv[index].maxkey;
+    *klen = strlen(*key);
+}
+
+static const struct kblk_metrics *
+_kvset_get_nth_kblock_metrics(struct kvset *ks, u32 index)
+{
+    return &((struct fake_kvset *)ks)->kblkv[index].metrics;
+}
+
+static const struct kvset_stats *
+_kvset_statsp(const struct kvset *ks)
+{
+    return &((struct fake_kvset *)ks)->stats;
+}
+
+static u8 *
+_kvset_get_hlog(struct kvset *ks)
+{
+    struct hlog *hlog = ((struct fake_kvset *)ks)->hlog;
+
+    return hlog ? hlog_data(hlog) : NULL;
+}
+
+static void
+fake_kblock_add(struct fake_kvset *ks, const char *minkey, const char *maxkey, u32 keys, u32 tombs)
+{
+    struct fake_kblock *kb = &ks->kblkv[ks->kblkc++];
+
+    kb->minkey = minkey;
+    kb->maxkey = maxkey;
+    kb->metrics.num_keys = keys;
+    kb->metrics.num_tombstones = tombs;
+    kb->metrics.tot_key_bytes = 10 * keys;
+    kb->metrics.tot_val_bytes = 90 * keys;
+
+    ks->stats.kst_keys += keys;
+    ks->stats.kst_kblks++;
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    views = view_fails = 0;
+
+    memset(ksv, 0, sizeof(ksv));
+
+    fake_kblock_add(&ksv[0], "a00", "a09", 10, 0);
+    fake_kblock_add(&ksv[0], "b00", "b09", 10, 0);
+    fake_kblock_add(&ksv[0], "c00", "c09", 10, 0);
+
+    fake_kblock_add(&ksv[1], "a05", "b05", 24, 4);
+    fake_kblock_add(&ksv[1], "c00", "c09", 10, 0);
+
+    MOCK_SET(ct_view, _cn_tree_view_create);
+    MOCK_SET(ct_view, _cn_tree_view_destroy);
+    MOCK_SET(kvset_view, _kvset_get_num_kblocks);
+    MOCK_SET(kvset, _kvset_get_nth_kblock_minkey);
+    MOCK_SET(kvset, _kvset_get_nth_kblock_maxkey);
+    MOCK_SET(kvset, _kvset_get_nth_kblock_metrics);
+    MOCK_SET(kvset, _kvset_statsp);
+    MOCK_SET(kvset, _kvset_get_hlog);
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    int i;
+
+    for (i = 0; i < NELEM(ksv); i++)
+        if (ksv[i].hlog)
+            hlog_destroy(ksv[i].hlog);
+
+    MOCK_UNSET(ct_view, _cn_tree_view_create);
+    MOCK_UNSET(ct_view, _cn_tree_view_destroy);
+    MOCK_UNSET(kvset_view, _kvset_get_num_kblocks);
+    MOCK_UNSET(kvset, _kvset_get_nth_kblock_minkey);
+    MOCK_UNSET(kvset, _kvset_get_nth_kblock_maxkey);
+    MOCK_UNSET(kvset, _kvset_get_nth_kblock_metrics);
+    MOCK_UNSET(kvset, _kvset_statsp);
+    MOCK_UNSET(kvset, _kvset_get_hlog);
+
+    mapi_inject_clear();
+
+    return 0;
+}
+
+static merr_t
+range_estimate(const char *lo, const char *hi, struct cn_range_est *est)
+{
+    return cn_range_estimate(
+        &fake_cn, lo, lo ? strlen(lo) : 0, hi, hi ? strlen(hi) : 0, est);
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_range_est)
+
+MTF_DEFINE_UTEST_PREPOST(cn_range_est, bounds, pre, post)
+{
+    struct cn_range_est est;
+    merr_t              err;
+
+    /* The newer kvset's "b" kblock is inside the range and counts in
+     * full, the older kvset's straddling kblock counts for half of its
+     * live keys, and its tombstones not at all.
+     */
+    err = range_estimate("b00", "b09", &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, views);
+    ASSERT_EQ(2, est.cre_kvsets);
+    ASSERT_EQ(10, est.cre_keys_lo);
+    ASSERT_EQ(30, est.cre_keys_hi);
+    ASSERT_EQ(20, est.cre_keys);
+    ASSERT_EQ(1000 + 2400 / 2, est.cre_bytes);
+    ASSERT_EQ(1000 + 2400, est.cre_bytes_hi);
+
+    /* With an open lower end, the "a" kblock of the newer kvset and the
+     * straddling kblock of the older one are both fully covered.
+     */
+    err = range_estimate(NULL, "b09", &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2, est.cre_kvsets);
+    ASSERT_EQ(20, est.cre_keys_lo);
+    ASSERT_EQ(40, est.cre_keys_hi);
+    ASSERT_EQ(40, est.cre_keys);
+    ASSERT_EQ(2000 + 2400, est.cre_bytes);
+    ASSERT_EQ(2000 + 2400, est.cre_bytes_hi);
+
+    /* Both ends open, every kblock is fully covered.
+     */
+    err = range_estimate(NULL, NULL, &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2, est.cre_kvsets);
+    ASSERT_EQ(30, est.cre_keys_lo);
+    ASSERT_EQ(60, est.cre_keys_hi);
+    ASSERT_EQ(60, est.cre_keys);
+    ASSERT_EQ(est.cre_bytes_hi, est.cre_bytes);
+
+    /* A range between the kblocks of both kvsets.
+     */
+    err = range_estimate("b50", "b99", &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, est.cre_kvsets);
+    ASSERT_EQ(0, est.cre_keys);
+    ASSERT_EQ(0, est.cre_keys_hi);
+    ASSERT_EQ(0, est.cre_bytes_hi);
+
+    err = range_estimate("d", NULL, &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, est.cre_kvsets);
+    ASSERT_EQ(0, est.cre_keys_hi);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_range_est, dups, pre, post)
+{
+    struct cn_range_est est;
+    merr_t              err;
+    u64                 i, hash;
+    int                 k;
+
+    /* The kvsets hold 30 keys each, 15 of which are in both, so there
+     * are 45 distinct keys.
+     */
+    for (k = 0; k < NELEM(ksv); k++) {
+        err = hlog_create(&ksv[k].hlog, HLOG_PRECISION);
+        ASSERT_EQ(0, err);
+
+        for (i = 15 * k; i < 15 * k + 30; i++) {
+            hash = hse_hash64(&i, sizeof(i));
+            hlog_add(ksv[k].hlog, hash);
+        }
+    }
+
+    err = range_estimate(NULL, NULL, &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(30, est.cre_keys_lo);
+    ASSERT_EQ(60, est.cre_keys_hi);
+    ASSERT_GE(est.cre_keys, 40);
+    ASSERT_LE(est.cre_keys, 50);
+    ASSERT_LT(est.cre_bytes, est.cre_bytes_hi);
+
+    /* The floor holds even if the sketches claim fewer distinct keys.
+     */
+    hlog_destroy(ksv[1].hlog);
+    ksv[1].hlog = NULL;
+    ksv[0].stats.kst_keys *= 10;
+
+    err = range_estimate(NULL, NULL, &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(30, est.cre_keys_lo);
+    ASSERT_EQ(30, est.cre_keys);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_range_est, view_fail, pre, post)
+{
+    struct cn_range_est est;
+    merr_t              err;
+
+    /* A view that cannot be created is retried a few times.
+     */
+    view_fails = 2;
+    err = range_estimate(NULL, NULL, &est);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, view_fails);
+    ASSERT_EQ(60, est.cre_keys);
+
+    view_fails = 100;
+    err = range_estimate(NULL, NULL, &est);
+    ASSERT_EQ(EAGAIN, merr_errno(err));
+    ASSERT_EQ(97, view_fails);
+    ASSERT_EQ(0, views);
+    ASSERT_EQ(0, est.cre_keys_hi);
+
+    mapi_inject(mapi_idx_hlog_create, merr(ENOMEM));
+    err = range_estimate(NULL, NULL, &est);
+    mapi_inject_unset(mapi_idx_hlog_create);
+    ASSERT_EQ(ENOMEM, merr_errno(err));
+    ASSERT_EQ(0, views);
+}
+
+MTF_END_UTEST_COLLECTION(cn_range_est)
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/delay.h>
+
+#include <hse_ikvdb/cn_reclaim.h>
+
+#include <mpool/mpool.h>
+
+#define ds ((struct mpool *)1)
+
+#define MBH_BAD (666)
+
+static atomic_t deleted;
+static atomic_t completed;
+static atomic_t failed;
+
+static uint64_t
+_mpool_mblock_delete(struct mpool *dsp, uint64_t mbh)
+{
+    if (mbh == MBH_BAD)
+        return merr(EIO);
+
+    atomic_inc(&deleted);
+
+    return 0;
+}
+
+static void
+reclaimed(void *rock, bool delete_error)
+{
+    if (delete_error)
+        atomic_inc(&failed);
+
+    atomic_inc(&completed);
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    MOCK_SET(mpool, _mpool_mblock_delete);
+
+    atomic_set(&deleted, 0);
+    atomic_set(&completed, 0);
+    atomic_set(&failed, 0);
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    mapi_inject_clear();
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_reclaim)
+
+MTF_DEFINE_UTEST_PREPOST(cn_reclaim, sync, pre, post)
+{
+    u64 mbv[] = { 1, 0, 2, MBH_BAD, 3 };
+
+    /* Without a queue the mblocks are deleted on the caller's stack. */
+    cn_reclaim_add(NULL, ds, 3, mbv, 3 << 20, reclaimed, NULL);
+    ASSERT_EQ(2, atomic_read(&deleted));
+    ASSERT_EQ(1, atomic_read(&completed));
+    ASSERT_EQ(0, atomic_read(&failed));
+
+    /* Deletion stops at the first error. */
+    cn_reclaim_add(NULL, ds, NELEM(mbv), mbv, 5 << 20, reclaimed, NULL);
+    ASSERT_EQ(4, atomic_read(&deleted));
+    ASSERT_EQ(2, atomic_read(&completed));
+    ASSERT_EQ(1, atomic_read(&failed));
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_reclaim, batch, pre, post)
+{
+    struct cn_reclaim_usage usage;
+    struct cn_reclaim *     rc;
+    merr_t                  err;
+    u64                     mbv[] = { 1, 2, 3, 4 };
+    int                     i;
+
+    err = cn_reclaim_create(0, &rc);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = cn_reclaim_create(1ul << 40, &rc);
+    ASSERT_EQ(0, err);
+
+    /* Requests queued together are deleted as one batch. */
+    for (i = 0; i < 4; ++i)
+        cn_reclaim_add(rc, ds, 1, mbv + i, 1 << 20, reclaimed, NULL);
+
+    cn_reclaim_add(rc, ds, 1, mbv, 1 << 20, NULL, NULL);
+
+    cn_reclaim_flush(rc);
+    ASSERT_EQ(5, atomic_read(&deleted));
+    ASSERT_EQ(4, atomic_read(&completed));
+
+    cn_reclaim_usage(rc, &usage);
+    ASSERT_EQ(0, usage.cru_queued);
+    ASSERT_EQ(5, usage.cru_mblocks);
+    ASSERT_EQ(5 << 20, usage.cru_bytes);
+    ASSERT_EQ(1, usage.cru_batches);
+    ASSERT_EQ(0, usage.cru_errors);
+
+    /* Destroy drains the queue. */
+    cn_reclaim_add(rc, ds, 2, mbv, 2 << 20, reclaimed, NULL);
+    cn_reclaim_destroy(rc);
+    ASSERT_EQ(7, atomic_read(&deleted));
+    ASSERT_EQ(5, atomic_read(&completed));
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_reclaim, pace, pre, post)
+{
+    struct cn_reclaim *rc;
+    merr_t             err;
+    u64                mbv[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    u64                start;
+    int                i;
+
+    /* One MiB per second with a one MiB burst: deleting four MiB takes
+     * about three seconds, and a flush skips the wait.
+     */
+    err = cn_reclaim_create(1 << 20, &rc);
+    ASSERT_EQ(0, err);
+
+    cn_reclaim_add(rc, ds, NELEM(mbv), mbv, 4 << 20, reclaimed, NULL);
+
+    for (i = 0; i < 10; ++i) {
+        usleep(100 * 1000);
+        if (atomic_read(&deleted) > 0)
+            break;
+    }
+
+    ASSERT_GT(atomic_read(&deleted), 0);
+    ASSERT_LT(atomic_read(&deleted), NELEM(mbv));
+
+    start = get_time_ns();
+    cn_reclaim_flush(rc);
+    ASSERT_EQ(NELEM(mbv), atomic_read(&deleted));
+    ASSERT_EQ(1, atomic_read(&completed));
+    ASSERT_LT(get_time_ns() - start, 2 * NSEC_PER_SEC);
+
+    cn_reclaim_destroy(rc);
+}
+
+MTF_END_UTEST_COLLECTION(cn_reclaim)
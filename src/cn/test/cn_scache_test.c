@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/delay.h>
+
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cndb.h>
+
+#include <mpool/mpool.h>
+
+#include "../mbset.h"
+#include "../vblock_reader.h"
+
+#define ds ((struct mpool *)1)
+
+/* Staging mblocks hold two extents, so the cache has two segments of
+ * two slots each.  The capacity vblock holds eight extents.  The first
+ * staging mblock is the one cn_scache_create() allocates to learn the
+ * mblock size.
+ */
+#define SEG_SZ (2 * CN_SCACHE_EXT_SZ)
+#define VBLK_SZ (8 * CN_SCACHE_EXT_SZ)
+#define VBLK_ID (0xc0ffee)
+#define VBLK_MBH (1000)
+#define STG_MAX (16)
+
+static char *vblk_buf;
+
+static struct {
+    char *buf;
+    uint  wlen;
+    bool  committed;
+} stgv[STG_MAX];
+
+static uint stgc;
+
+static uint64_t
+_mpool_mclass_get(struct mpool *mp, enum mp_media_classp mclass, struct mpool_mclass_props *props)
+{
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_alloc(
+    struct mpool *       dsp,
+    enum mp_media_classp mclassp,
+    bool                 spare,
+    uint64_t *           handle,
+    struct mblock_props *props)
+{
+    if (stgc >= STG_MAX)
+        return merr(ENOSPC);
+
+    stgv[stgc].buf = alloc_page_aligned(SEG_SZ, GFP_KERNEL);
+    stgv[stgc].wlen = 0;
+    stgv[stgc].committed = false;
+
+    memset(props, 0, sizeof(*props));
+    props->mpr_objid = 100 + stgc;
+    props->mpr_alloc_cap = SEG_SZ;
+    props->mpr_mclassp = mclassp;
+    props->mpr_stripe_len = 3 * PAGE_SIZE;
+
+    *handle = ++stgc;
+
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_abort(struct mpool *dsp, uint64_t mbh)
+{
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_commit(struct mpool *dsp, uint64_t mbh)
+{
+    stgv[mbh - 1].committed = true;
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_delete(struct mpool *dsp, uint64_t mbh)
+{
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_write_data(
+    struct mpool *          dsp,
+    bool                    sync,
+    uint64_t                mbh,
+    struct iovec *          iov,
+    int                     iovc,
+    struct mp_asyncctx_ioc *asyncio)
+{
+    VERIFY_EQ_RET(1, iovc, merr(EINVAL));
+    VERIFY_LE_RET(stgv[mbh - 1].wlen + iov->iov_len, SEG_SZ, merr(EINVAL));
+
+    memcpy(stgv[mbh - 1].buf + stgv[mbh - 1].wlen, iov->iov_base, iov->iov_len);
+    stgv[mbh - 1].wlen += iov->iov_len;
+
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_read(struct mpool *dsp, uint64_t mbh, struct iovec *iov, int iovc, size_t off)
+{
+    VERIFY_EQ_RET(1, iovc, merr(EINVAL));
+    VERIFY_TRUE_RET(IS_ALIGNED(off, PAGE_SIZE), merr(EINVAL));
+    VERIFY_TRUE_RET(IS_ALIGNED(iov->iov_len, PAGE_SIZE), merr(EINVAL));
+
+    if (mbh == VBLK_MBH) {
+        VERIFY_LE_RET(off + iov->iov_len, VBLK_SZ, merr(EINVAL));
+        memcpy(iov->iov_base, vblk_buf + off, iov->iov_len);
+        return 0;
+    }
+
+    /* Staging mblocks are readable once committed. */
+    VERIFY_TRUE_RET(stgv[mbh - 1].committed, merr(EINVAL));
+    VERIFY_LE_RET(off + iov->iov_len, stgv[mbh - 1].wlen, merr(EINVAL));
+    memcpy(iov->iov_base, stgv[mbh - 1].buf + off, iov->iov_len);
+
+    return 0;
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    uint i;
+
+    MOCK_SET(mpool, _mpool_mclass_get);
+    MOCK_SET(mpool, _mpool_mblock_alloc);
+    MOCK_SET(mpool, _mpool_mblock_abort);
+    MOCK_SET(mpool, _mpool_mblock_commit);
+    MOCK_SET(mpool, _mpool_mblock_delete);
+    MOCK_SET(mpool, _mpool_mblock_write_data);
+    MOCK_SET(mpool, _mpool_mblock_read);
+
+    mapi_inject(mapi_idx_cndb_txn_start, 0);
+    mapi_inject(mapi_idx_cndb_txn_txc, 0);
+    mapi_inject(mapi_idx_cndb_txn_nak, 0);
+
+    vblk_buf = alloc_page_aligned(VBLK_SZ, GFP_KERNEL);
+    for (i = 0; i < VBLK_SZ; ++i)
+        vblk_buf[i] = i * 7;
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    uint i;
+
+    for (i = 0; i < stgc; ++i)
+        free_aligned(stgv[i].buf);
+    stgc = 0;
+
+    free_aligned(vblk_buf);
+
+    mapi_inject_clear();
+
+    return 0;
+}
+
+static void
+vbset_init(struct mbset *mbs, struct vblock_desc *vbd, u64 *idp, u64 *mbhp)
+{
+    memset(mbs, 0, sizeof(*mbs));
+    memset(vbd, 0, sizeof(*vbd));
+
+    *idp = VBLK_ID;
+    *mbhp = VBLK_MBH;
+
+    vbd->vbd_off = PAGE_SIZE;
+    vbd->vbd_len = VBLK_SZ - PAGE_SIZE;
+    vbd->vbd_mclass = MP_MED_CAPACITY;
+
+    mbs->mbs_idv = idp;
+    mbs->mbs_bhv = mbhp;
+    mbs->mbs_idc = 1;
+    mbs->mbs_udata = vbd;
+    mbs->mbs_udata_sz = sizeof(*vbd);
+    atomic_set(&mbs->mbs_ref, 1);
+}
+
+/* Read a value at @off of the vblock's data twice, so that its extent is
+ * admitted, and wait for the fill to finish.
+ */
+static int
+admit(struct cn_scache *sc, struct mbset *mbs, u32 off, u64 fills)
+{
+    struct cn_scache_usage usage;
+    char                   buf[64];
+    int                    i;
+
+    if (cn_scache_read(sc, mbs, 0, off, sizeof(buf), buf) ||
+        cn_scache_read(sc, mbs, 0, off, sizeof(buf), buf))
+        return -1;
+
+    for (i = 0; i < 1000; ++i) {
+        cn_scache_usage(sc, &usage);
+        if (usage.scu_fills >= fills)
+            return 0;
+        usleep(1000);
+    }
+
+    return -1;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_scache)
+
+MTF_DEFINE_UTEST_PREPOST(cn_scache, read_through, pre, post)
+{
+    struct cn_scache_usage usage;
+    struct vblock_desc     vbd;
+    struct cn_scache *     sc;
+    struct mbset           mbs;
+    char                   buf[64];
+    u64                    id, mbh;
+    merr_t                 err;
+    bool                   hit;
+    int                    rc;
+
+    vbset_init(&mbs, &vbd, &id, &mbh);
+
+    err = cn_scache_create(ds, NULL, 0, &sc);
+    ASSERT_EQ(0, err);
+
+    /* A single miss does not admit an extent. */
+    hit = cn_scache_read(sc, &mbs, 0, 2 * CN_SCACHE_EXT_SZ, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+    cn_scache_usage(sc, &usage);
+    ASSERT_EQ(1, usage.scu_misses);
+    ASSERT_EQ(0, usage.scu_fills);
+
+    rc = admit(sc, &mbs, 200, 1);
+    ASSERT_EQ(0, rc);
+
+    /* Served from the open segment. */
+    hit = cn_scache_read(sc, &mbs, 0, 200, sizeof(buf), buf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(0, memcmp(buf, vblk_buf + PAGE_SIZE + 200, sizeof(buf)));
+
+    /* Filling the second slot seals the segment. */
+    rc = admit(sc, &mbs, CN_SCACHE_EXT_SZ + 300, 2);
+    ASSERT_EQ(0, rc);
+    ASSERT_TRUE(stgv[1].committed);
+    ASSERT_EQ(SEG_SZ, stgv[1].wlen);
+
+    /* Served from the staging mblock. */
+    hit = cn_scache_read(sc, &mbs, 0, CN_SCACHE_EXT_SZ + 300, sizeof(buf), buf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(0, memcmp(buf, vblk_buf + PAGE_SIZE + CN_SCACHE_EXT_SZ + 300, sizeof(buf)));
+
+    /* Values that straddle two extents are not cached. */
+    hit = cn_scache_read(sc, &mbs, 0, CN_SCACHE_EXT_SZ - PAGE_SIZE - 10, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+
+    /* Nor are those of staging vblocks. */
+    vbd.vbd_mclass = MP_MED_STAGING;
+    hit = cn_scache_read(sc, &mbs, 0, 200, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+    vbd.vbd_mclass = MP_MED_CAPACITY;
+
+    cn_scache_usage(sc, &usage);
+    ASSERT_EQ(SEG_SZ, usage.scu_size);
+    ASSERT_EQ(2, usage.scu_hits);
+
+    /* Deleting the vblock drops its extents. */
+    cn_scache_invalidate(sc, 1, &id);
+    hit = cn_scache_read(sc, &mbs, 0, 200, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+
+    cn_scache_destroy(sc);
+    ASSERT_EQ(1, atomic_read(&mbs.mbs_ref));
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_scache, evict, pre, post)
+{
+    struct cn_scache_usage usage;
+    struct vblock_desc     vbd;
+    struct cn_scache *     sc;
+    struct mbset           mbs;
+    char                   buf[64];
+    u64                    id, mbh;
+    merr_t                 err;
+    bool                   hit;
+    int                    rc, i;
+
+    vbset_init(&mbs, &vbd, &id, &mbh);
+
+    err = cn_scache_create(ds, NULL, 0, &sc);
+    ASSERT_EQ(0, err);
+
+    /* Fill both segments, then one more extent, which evicts the
+     * oldest segment.
+     */
+    for (i = 0; i < 5; ++i) {
+        rc = admit(sc, &mbs, i * CN_SCACHE_EXT_SZ + 64, i + 1);
+        ASSERT_EQ(0, rc);
+    }
+
+    cn_scache_usage(sc, &usage);
+    ASSERT_EQ(1, usage.scu_evicts);
+    ASSERT_EQ(5, usage.scu_fills);
+
+    /* Extents 0 and 1 were evicted, 2 and 3 are in the sealed segment,
+     * and 4 is in the open one.
+     */
+    hit = cn_scache_read(sc, &mbs, 0, 64, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+
+    hit = cn_scache_read(sc, &mbs, 0, CN_SCACHE_EXT_SZ + 64, sizeof(buf), buf);
+    ASSERT_FALSE(hit);
+
+    for (i = 2; i < 5; ++i) {
+        u32 off = i * CN_SCACHE_EXT_SZ + 64;
+
+        hit = cn_scache_read(sc, &mbs, 0, off, sizeof(buf), buf);
+        ASSERT_TRUE(hit);
+        ASSERT_EQ(0, memcmp(buf, vblk_buf + PAGE_SIZE + off, sizeof(buf)));
+    }
+
+    cn_scache_destroy(sc);
+}
+
+MTF_END_UTEST_COLLECTION(cn_scache)
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+
+#include <hse_ikvdb/cn_scrub.h>
+#include <hse_ikvdb/kvdb_health.h>
+
+MTF_BEGIN_UTEST_COLLECTION(cn_scrub)
+
+MTF_DEFINE_UTEST(cn_scrub, basic)
+{
+    struct cn_scrub_stats stats;
+    struct kvdb_health    health = {};
+    struct cn_scrub *     cs;
+    merr_t                err;
+
+    err = cn_scrub_create(0, NSEC_PER_SEC, &health, &cs);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* A disabled scrubber ignores cns and reports no activity. */
+    cn_scrub_add(NULL, (struct cn *)1);
+    cn_scrub_remove(NULL, (struct cn *)1);
+    cn_scrub_stats(NULL, &stats);
+    ASSERT_EQ(0, stats.css_kvsets);
+    ASSERT_EQ(0, stats.css_errors);
+
+    err = cn_scrub_create(1 << 20, NSEC_PER_SEC, &health, &cs);
+    ASSERT_EQ(0, err);
+
+    /* The first pass over a cn is delayed, so these cns are never
+     * scrubbed, and removing an unknown cn is harmless.
+     */
+    cn_scrub_add(cs, (struct cn *)1);
+    cn_scrub_add(cs, (struct cn *)2);
+    cn_scrub_remove(cs, (struct cn *)1);
+    cn_scrub_remove(cs, (struct cn *)3);
+
+    cn_scrub_stats(cs, &stats);
+    ASSERT_EQ(0, stats.css_kvsets);
+    ASSERT_EQ(0, stats.css_passes);
+
+    /* Destroy frees the entries of cns never removed. */
+    cn_scrub_destroy(cs);
+    cn_scrub_destroy(NULL);
+}
+
+MTF_END_UTEST_COLLECTION(cn_scrub)
@@ -0,0 +1,451 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_test_support/mock_api.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/page.h>
+
+#include <mpool/mpool.h>
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/cn_snap.h>
+#include <hse_ikvdb/cn_tree_view.h>
+#include <hse_ikvdb/kvset_view.h>
+
+#include "../cn_internal.h"
+
+#include <ftw.h>
+#include <sys/stat.h>
+
+/* Each fake mblock image is two pages filled with the low byte of its id.
+ */
+#define MBLOCK_LEN (2 * PAGE_SIZE)
+
+struct fake_kvset {
+    u64 dgen;
+    u64 kblk;
+    u64 vblk;
+};
+
+/* The kvsets of a fake cn, oldest first.  Those before @first have been
+ * compacted away, but may still be pinned by a snapshot.
+ */
+struct fake_cn {
+    struct cn         cn;
+    struct fake_kvset ksv[4];
+    int               first;
+    int               ksc;
+};
+
+static char           dir[64];
+static struct fake_cn fcnv[2];
+static int            refs, views, copies;
+
+static merr_t
+_cn_tree_view_create(struct cn *cn, struct table **view_out)
+{
+    struct fake_cn *   fcn = container_of(cn, struct fake_cn, cn);
+    struct kvset_view *v;
+    struct table *     view;
+    int                i;
+
+    view = table_create(fcn->ksc, sizeof(*v), true);
+    if (!view)
+        return merr(ENOMEM);
+
+    for (i = fcn->ksc - 1; i >= fcn->first; i--) {
+        v = table_append(view);
+        v->kvset = (struct kvset *)&fcn->ksv[i];
+    }
+
+    views++;
+    *view_out = view;
+
+    return 0;
+}
+
+static void
+_cn_tree_view_destroy(struct table *view)
+{
+    views--;
+    table_destroy(view);
+}
+
+static void
+_cn_ref_get(struct cn *cn)
+{
+    refs++;
+}
+
+static void
+_cn_ref_put(struct cn *cn)
+{
+    refs--;
+}
+
+static u64
+_kvset_get_dgen(struct kvset *ks)
+{
+    return ((struct fake_kvset *)ks)->dgen;
+}
+
+static u32
+_kvset_get_num_kblocks(struct kvset *ks)
+{
+    return 1;
+}
+
+static u32
+_kvset_get_num_vblocks(struct kvset *ks)
+{
+    return 1;
+}
+
+static u64
+_kvset_get_nth_kblock_id(struct kvset *ks, u32 index)
+{
+    return ((struct fake_kvset *)ks)->kblk;
+}
+
+static u64
+_kvset_get_nth_vblock_id(struct kvset *ks, u32 index)
+{
+    return ((struct fake_kvset *)ks)->vblk;
+}
+
+static uint64_t
+_mpool_mblock_find_get(struct mpool *ds, uint64_t objid, uint64_t *mbh, struct mblock_props *props)
+{
+    memset(props, 0, sizeof(*props));
+    props->mpr_objid = objid;
+    props->mpr_write_len = MBLOCK_LEN;
+    *mbh = objid;
+
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_put(struct mpool *ds, uint64_t mbh)
+{
+    return 0;
+}
+
+static uint64_t
+_mpool_mblock_read(struct mpool *ds, uint64_t mbh, struct iovec *iov, int niov, size_t off)
+{
+    int i;
+
+    for (i = 0; i < niov; i++)
+        memset(iov[i].iov_base, mbh & 0xff, iov[i].iov_len);
+
+    copies++;
+
+    return 0;
+}
+
+static void
+fake_kvset_add(struct fake_cn *fcn, u64 dgen, u64 kblk, u64 vblk)
+{
+    struct fake_kvset *ks = &fcn->ksv[fcn->ksc++];
+
+    ks->dgen = dgen;
+    ks->kblk = kblk;
+    ks->vblk = vblk;
+}
+
+static int
+rm_ent(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    return remove(path);
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    int i;
+
+    refs = views = copies = 0;
+
+    snprintf(dir, sizeof(dir), "/tmp/cn_snap_test.XXXXXX");
+    if (!mkdtemp(dir))
+        return -1;
+
+    memset(fcnv, 0, sizeof(fcnv));
+    for (i = 0; i < NELEM(fcnv); i++)
+        mutex_init(&fcnv[i].cn.cn_ingest_lock);
+
+    fake_kvset_add(&fcnv[0], 1, 0x101, 0x102);
+    fake_kvset_add(&fcnv[0], 3, 0x103, 0x104);
+    fake_kvset_add(&fcnv[1], 2, 0x201, 0x202);
+
+    MOCK_SET(ct_view, _cn_tree_view_create);
+    MOCK_SET(ct_view, _cn_tree_view_destroy);
+    MOCK_SET(cn, _cn_ref_get);
+    MOCK_SET(cn, _cn_ref_put);
+    MOCK_SET(kvset_view, _kvset_get_dgen);
+    MOCK_SET(kvset_view, _kvset_get_num_kblocks);
+    MOCK_SET(kvset_view, _kvset_get_num_vblocks);
+    MOCK_SET(kvset_view, _kvset_get_nth_kblock_id);
+    MOCK_SET(kvset_view, _kvset_get_nth_vblock_id);
+    MOCK_SET(mpool, _mpool_mblock_find_get);
+    MOCK_SET(mpool, _mpool_mblock_put);
+    MOCK_SET(mpool, _mpool_mblock_read);
+
+    mapi_inject(mapi_idx_cn_get_dataset, 0);
+
+    return 0;
+}
+
+static int
+post(struct mtf_test_info *lcl_ti)
+{
+    int i;
+
+    nftw(dir, rm_ent, 8, FTW_DEPTH | FTW_PHYS);
+
+    for (i = 0; i < NELEM(fcnv); i++)
+        mutex_destroy(&fcnv[i].cn.cn_ingest_lock);
+
+    MOCK_UNSET(ct_view, _cn_tree_view_create);
+    MOCK_UNSET(ct_view, _cn_tree_view_destroy);
+    MOCK_UNSET(cn, _cn_ref_get);
+    MOCK_UNSET(cn, _cn_ref_put);
+    MOCK_UNSET(kvset_view, _kvset_get_dgen);
+    MOCK_UNSET(kvset_view, _kvset_get_num_kblocks);
+    MOCK_UNSET(kvset_view, _kvset_get_num_vblocks);
+    MOCK_UNSET(kvset_view, _kvset_get_nth_kblock_id);
+    MOCK_UNSET(kvset_view, _kvset_get_nth_vblock_id);
+    MOCK_UNSET(mpool, _mpool_mblock_find_get);
+    MOCK_UNSET(mpool, _mpool_mblock_put);
+    MOCK_UNSET(mpool, _mpool_mblock_read);
+
+    mapi_inject_clear();
+
+    return 0;
+}
+
+static merr_t
+snap_create(struct cn_snap **snapp)
+{
+    static const char *const namev[] = { "kvs0", "kvs1" };
+    struct cn *              cnv[NELEM(fcnv)];
+    int                      i;
+
+    for (i = 0; i < NELEM(fcnv); i++)
+        cnv[i] = &fcnv[i].cn;
+
+    return cn_snap_create(cnv, namev, NELEM(fcnv), snapp);
+}
+
+/* Check that an exported mblock reads back as its image, and return
+ * whether the export holds the image itself or links to another export.
+ */
+static int
+check_mblock(struct mtf_test_info *lcl_ti, const char *exp, u64 id, bool *linked)
+{
+    char        path[PATH_MAX], buf[MBLOCK_LEN + 1];
+    struct stat st;
+    FILE *      fp;
+    size_t      i;
+
+    snprintf(path, sizeof(path), "%s/%s/mblocks/0x%08lx", dir, exp, (ulong)id);
+
+    VERIFY_EQ_RET(0, lstat(path, &st), -1);
+    *linked = S_ISLNK(st.st_mode);
+
+    fp = fopen(path, "r");
+    VERIFY_NE_RET(NULL, fp, -1);
+    VERIFY_EQ_RET(MBLOCK_LEN, fread(buf, 1, sizeof(buf), fp), -1);
+    fclose(fp);
+
+    for (i = 0; i < MBLOCK_LEN; i++)
+        VERIFY_EQ_RET(id & 0xff, buf[i] & 0xff, -1);
+
+    return 0;
+}
+
+/* Check that a kvset directory of an export links to its mblocks.
+ */
+static int
+check_kvset(struct mtf_test_info *lcl_ti, const char *exp, const char *kvs, struct fake_kvset *ks)
+{
+    char        path[PATH_MAX], target[PATH_MAX];
+    struct stat st;
+    ssize_t     n;
+
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/%s/%s/%020lu/K000.0x%08lx",
+        dir,
+        exp,
+        kvs,
+        (ulong)ks->dgen,
+        (ulong)ks->kblk);
+
+    n = readlink(path, target, sizeof(target) - 1);
+    VERIFY_GT_RET(n, 0, -1);
+    target[n] = 0;
+    VERIFY_NE_RET(NULL, strstr(target, "../../mblocks/"), -1);
+    VERIFY_EQ_RET(0, stat(path, &st), -1);
+    VERIFY_EQ_RET(MBLOCK_LEN, st.st_size, -1);
+
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/%s/%s/%020lu/V000.0x%08lx",
+        dir,
+        exp,
+        kvs,
+        (ulong)ks->dgen,
+        (ulong)ks->vblk);
+
+    VERIFY_EQ_RET(0, stat(path, &st), -1);
+    VERIFY_EQ_RET(MBLOCK_LEN, st.st_size, -1);
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(cn_snap)
+
+MTF_DEFINE_UTEST_PREPOST(cn_snap, export, pre, post)
+{
+    struct cn_snap *snap;
+    char            path[PATH_MAX];
+    merr_t          err;
+    bool            linked;
+    int             i, j;
+
+    err = snap_create(&snap);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NELEM(fcnv), refs);
+    ASSERT_EQ(NELEM(fcnv), views);
+
+    /* The ingest locks are released once the kvsets are pinned. */
+    for (i = 0; i < NELEM(fcnv); i++) {
+        ASSERT_TRUE(mutex_trylock(&fcnv[i].cn.cn_ingest_lock));
+        mutex_unlock(&fcnv[i].cn.cn_ingest_lock);
+    }
+
+    snprintf(path, sizeof(path), "%s/full", dir);
+    err = cn_snap_export(snap, path, NULL, NULL);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(6, copies);
+
+    for (i = 0; i < NELEM(fcnv); i++) {
+        for (j = 0; j < fcnv[i].ksc; j++) {
+            struct fake_kvset *ks = &fcnv[i].ksv[j];
+
+            ASSERT_EQ(0, check_kvset(lcl_ti, "full", i ? "kvs1" : "kvs0", ks));
+            ASSERT_EQ(0, check_mblock(lcl_ti, "full", ks->kblk, &linked));
+            ASSERT_FALSE(linked);
+            ASSERT_EQ(0, check_mblock(lcl_ti, "full", ks->vblk, &linked));
+            ASSERT_FALSE(linked);
+        }
+    }
+
+    /* An export never overwrites a directory. */
+    err = cn_snap_export(snap, path, NULL, NULL);
+    ASSERT_EQ(EEXIST, merr_errno(err));
+
+    err = cn_snap_export(snap, path, snap, NULL);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    cn_snap_destroy(snap);
+    ASSERT_EQ(0, refs);
+    ASSERT_EQ(0, views);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_snap, incremental, pre, post)
+{
+    struct cn_snap *base, *snap;
+    char            path[PATH_MAX], basedir[PATH_MAX];
+    merr_t          err;
+    bool            linked;
+    int             i;
+
+    err = snap_create(&base);
+    ASSERT_EQ(0, err);
+
+    snprintf(basedir, sizeof(basedir), "%s/base", dir);
+    err = cn_snap_export(base, basedir, NULL, NULL);
+    ASSERT_EQ(0, err);
+
+    /* An ingest into kvs1, and a compaction of kvs0 that reuses the
+     * vblock of its newest kvset.
+     */
+    fake_kvset_add(&fcnv[1], 4, 0x203, 0x204);
+    fake_kvset_add(&fcnv[0], 5, 0x105, 0x104);
+    fcnv[0].first = 2;
+
+    err = snap_create(&snap);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2 * NELEM(fcnv), refs);
+
+    copies = 0;
+    snprintf(path, sizeof(path), "%s/incr", dir);
+    err = cn_snap_export(snap, path, base, basedir);
+    ASSERT_EQ(0, err);
+
+    /* Only the three new mblocks are copied. */
+    ASSERT_EQ(3, copies);
+
+    for (i = 0; i < fcnv[1].ksc; i++)
+        ASSERT_EQ(0, check_kvset(lcl_ti, "incr", "kvs1", &fcnv[1].ksv[i]));
+    ASSERT_EQ(0, check_kvset(lcl_ti, "incr", "kvs0", &fcnv[0].ksv[2]));
+
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x105, &linked));
+    ASSERT_FALSE(linked);
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x203, &linked));
+    ASSERT_FALSE(linked);
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x204, &linked));
+    ASSERT_FALSE(linked);
+
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x104, &linked));
+    ASSERT_TRUE(linked);
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x201, &linked));
+    ASSERT_TRUE(linked);
+    ASSERT_EQ(0, check_mblock(lcl_ti, "incr", 0x202, &linked));
+    ASSERT_TRUE(linked);
+
+    /* The compacted kvset of kvs0 isn't in the incremental export. */
+    snprintf(path, sizeof(path), "%s/incr/mblocks/0x%08lx", dir, (ulong)0x101);
+    ASSERT_NE(0, access(path, F_OK));
+    snprintf(path, sizeof(path), "%s/incr/kvs0/%020lu", dir, (ulong)1);
+    ASSERT_NE(0, access(path, F_OK));
+
+    cn_snap_destroy(snap);
+    cn_snap_destroy(base);
+    ASSERT_EQ(0, refs);
+    ASSERT_EQ(0, views);
+}
+
+MTF_DEFINE_UTEST_PREPOST(cn_snap, create_fail, pre, post)
+{
+    struct cn_snap *snap = NULL;
+    merr_t          err;
+    int             i;
+
+    /* A view that stays busy fails the snapshot after a few tries. */
+    mapi_inject(mapi_idx_cn_tree_view_create, merr(EAGAIN));
+
+    err = snap_create(&snap);
+    ASSERT_EQ(EAGAIN, merr_errno(err));
+    ASSERT_EQ(NULL, snap);
+    ASSERT_EQ(0, refs);
+
+    for (i = 0; i < NELEM(fcnv); i++) {
+        ASSERT_TRUE(mutex_trylock(&fcnv[i].cn.cn_ingest_lock));
+        mutex_unlock(&fcnv[i].cn.cn_ingest_lock);
+    }
+
+    mapi_inject_unset(mapi_idx_cn_tree_view_create);
+
+    cn_snap_destroy(NULL);
+}
+
+MTF_END_UTEST_COLLECTION(cn_snap)
@@ -17,6 +17,7 @@
 #include <hse_ikvdb/cn_node_loc.h>
 #include <hse_ikvdb/kvdb_health.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/query_ctx.h>
 
 #include "../cn_tree.h"
 #include "../cn_tree_iter.h"
@@ -25,8 +26,10 @@
 #include "../cn_tree_compact.h"
 
 #include "../cn_internal.h"
+#include "../omf.h"
 #include "../kvset.h"
 #include "../kv_iterator.h"
+#include "../spill.h"
 
 struct mpool *     mock_ds = (void *)0x1234abcd;
 struct kvdb_health mock_health;
@@ -48,6 +51,9 @@ struct fake_kvset {
     u64                     dgen;
     u64                     vused;
     u64                     workid;
+    u64                     tag;
+    const char *            minkey;
+    const char *            maxkey;
     struct kvset_stats      stats;
     struct fake_kvset *     next;
 };
@@ -184,8 +190,10 @@ _kvset_get_num_vblocks(struct kvset *handle)
 void
 _kvset_get_max_key(struct kvset *ks, void **key, uint *klen)
 {
-    *key = "foo";
-    *klen = 3;
+    const char *maxkey = ((struct fake_kvset *)ks)->maxkey ?: "foo";
+
+    *key = (void *)maxkey;
+    *klen = strlen(maxkey);
 }
 
 /*----------------------------------------------------------------
@@ -210,6 +218,7 @@ _kvset_iter_create(
     struct workqueue_struct *workq,
     struct workqueue_struct *vra_wq,
     struct perfc_set *       pc,
+    struct cheap *           arena,
     enum kvset_iter_flags    flags,
     struct kv_iterator **    handle)
 {
@@ -258,6 +267,7 @@ struct injections injections[] = {
     { 0, mapi_idx_kvset_create },
     { 0, mapi_idx_kvset_put_ref },
     { 0, mapi_idx_kvset_get_ref },
+    { 0, mapi_idx_kvset_key_fences },
     { 0, mapi_idx_kvset_log_d_records },
     { 0, mapi_idx_kvset_mark_mblocks_for_delete },
     { 0, mapi_idx_kvset_madvise_kblks },
@@ -270,6 +280,7 @@ struct injections injections[] = {
     { 929523521341, mapi_idx_kvset_ctime },
     { KVSET_MISS_KEY_TOO_SMALL, mapi_idx_kvset_kblk_start },
     { 1234, mapi_idx_kvset_get_seqno_max },
+    { 0, mapi_idx_kvset_get_seqno_min },
     { 0, mapi_idx_kvset_get_hlog },
     { 0, mapi_idx_kvset_get_vbsetv },
 
@@ -281,6 +292,7 @@ struct injections injections[] = {
     { 0, mapi_idx_cn_get_flags },
     { 10, mapi_idx_cn_get_seqno_horizon },
     { 0, mapi_idx_cn_get_cancel },
+    { 0, mapi_idx_cn_cfilter_get },
     { 0, mapi_idx_cn_get_flags },
     { 0, mapi_idx_cn_get_sched },
     { 0, mapi_idx_cn_get_maint_wq },
@@ -447,6 +459,44 @@ MTF_DEFINE_UTEST_PRE(test, t_simple_api, test_setup)
     cn_tree_destroy(tree);
 }
 
+MTF_DEFINE_UTEST_PRE(test, t_pin_budget, test_setup)
+{
+    struct cn_tree *   tree = 0;
+    struct kvs_cparams cp = {.cp_fanout = 4 };
+    merr_t             err;
+    bool               ok;
+
+    rp->cn_pin_mb = 1;
+
+    err = cn_tree_create(&tree, NULL, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(err, 0);
+
+    ok = cn_tree_pin_reserve(tree, 0, 768 << 10);
+    ASSERT_TRUE(ok);
+
+    /* Exceeds the budget and leaves it untouched. */
+    ok = cn_tree_pin_reserve(tree, 1, 512 << 10);
+    ASSERT_FALSE(ok);
+    ASSERT_EQ(0, cn_tree_pinned(tree, 1));
+
+    ok = cn_tree_pin_reserve(tree, 1, 256 << 10);
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(768 << 10, cn_tree_pinned(tree, 0));
+    ASSERT_EQ(256 << 10, cn_tree_pinned(tree, 1));
+    ASSERT_EQ(0, cn_tree_pinned(tree, CN_PIN_LVL_MAX));
+
+    cn_tree_pin_release(tree, 0, 768 << 10);
+    ASSERT_EQ(0, cn_tree_pinned(tree, 0));
+
+    ok = cn_tree_pin_reserve(tree, 0, 512 << 10);
+    ASSERT_TRUE(ok);
+
+    cn_tree_pin_release(tree, 0, 512 << 10);
+    cn_tree_pin_release(tree, 1, 256 << 10);
+
+    cn_tree_destroy(tree);
+}
+
 /*----------------------------------------------------------------
  * Test cn_tree_find_parent_child_link() by way of cn_tree_create_node().
  */
@@ -568,6 +618,12 @@ MTF_DEFINE_UTEST_PRE(test, t_cn_tree_ingest_update, test_setup)
     /* Should be at end of list */
     ASSERT_TRUE(le == 0);
 
+    /* The lookup snapshot lists the same kvsets, newest first */
+    ASSERT_NE(NULL, node->tn_kvsnap);
+    ASSERT_EQ(NELEM(kvsetv), node->tn_kvsnap->ksn_kvsetc);
+    for (i = 0; i < NELEM(kvsetv); i++)
+        ASSERT_EQ(kvsetv[i], node->tn_kvsnap->ksn_kvsetv[NELEM(kvsetv) - 1 - i]);
+
     INIT_LIST_HEAD(&node->tn_kvset_list);
     cn_tree_destroy(tree);
 
@@ -892,6 +948,819 @@ MTF_DEFINE_UTEST_PRE(test, t_cn_comp, test_setup)
     }
 }
 
+/* Age the ttl samples of a tree by @ns rather than waiting for them to
+ * expire, and force the next cn_tree_ttl_seq() to look at them.
+ */
+static void
+ttl_age(struct cn_tree *tree, u64 ns)
+{
+    struct cn_ttl *ttl = &tree->ct_ttl;
+    uint           i;
+
+    for (i = 0; i < CN_TTL_SAMPLES; i++)
+        ttl->ttl_timev[i] -= ns;
+
+    atomic64_set(&ttl->ttl_next, 0);
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_ttl_horizon, test_setup)
+{
+    struct kvs_cparams  cp = {.cp_fanout = 8 };
+    struct cn_tree *    tree;
+    struct cn_ttl *     ttl;
+    enum key_lookup_res res;
+    u64                 step, seq;
+    merr_t              err;
+    int                 i;
+
+    err = cn_tree_create(&tree, NULL, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    ttl = &tree->ct_ttl;
+
+    /* Without a ttl nothing expires and nothing is sampled.
+     */
+    cn_tree_ttl_init(tree, 0, 100);
+    cn_tree_ttl_sample(tree, 200);
+    ttl_age(tree, 10 * NSEC_PER_SEC);
+    ASSERT_EQ(0, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(0, ttl->ttl_cnt);
+
+    res = FOUND_VAL;
+    cn_tree_ttl_hide(tree, &res, 1);
+    ASSERT_EQ(FOUND_VAL, res);
+
+    /* Entries expire once the seqno sampled ttl ago is behind them.
+     */
+    cn_tree_ttl_init(tree, 1, 100);
+    ASSERT_EQ(1, ttl->ttl_cnt);
+    ASSERT_EQ(0, cn_tree_ttl_seq(tree));
+
+    ttl_age(tree, NSEC_PER_SEC / 2);
+    cn_tree_ttl_sample(tree, 200);
+    cn_tree_ttl_sample(tree, 300); /* too soon after the last, skipped */
+    ASSERT_EQ(2, ttl->ttl_cnt);
+    ASSERT_EQ(0, cn_tree_ttl_seq(tree));
+
+    ttl_age(tree, NSEC_PER_SEC / 2);
+    ASSERT_EQ(100, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(1, ttl->ttl_cnt);
+
+    ttl_age(tree, NSEC_PER_SEC);
+    ASSERT_EQ(200, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(0, ttl->ttl_cnt);
+    ASSERT_EQ(U64_MAX, atomic64_read(&ttl->ttl_next));
+
+    /* The horizon never moves back.
+     */
+    cn_tree_ttl_sample(tree, 150);
+    ttl_age(tree, NSEC_PER_SEC);
+    ASSERT_EQ(200, cn_tree_ttl_seq(tree));
+
+    /* Sample well past the end of the ring, a sample every 1/16th of
+     * the ttl leaves the last 16 samples unexpired.
+     */
+    step = NSEC_PER_SEC / 16;
+
+    for (i = 0; i < 2 * CN_TTL_SAMPLES; i++) {
+        ttl_age(tree, step);
+        cn_tree_ttl_sample(tree, 1000 + i);
+    }
+
+    seq = cn_tree_ttl_seq(tree);
+    ASSERT_EQ(1000 + 2 * CN_TTL_SAMPLES - 17, seq);
+    ASSERT_EQ(16, ttl->ttl_cnt);
+
+    /* Lookups hide values at or below the horizon, and only values.
+     */
+    res = FOUND_VAL;
+    cn_tree_ttl_hide(tree, &res, seq);
+    ASSERT_EQ(FOUND_TMB, res);
+
+    res = FOUND_VAL;
+    cn_tree_ttl_hide(tree, &res, 1);
+    ASSERT_EQ(FOUND_TMB, res);
+
+    res = FOUND_VAL;
+    cn_tree_ttl_hide(tree, &res, seq + 1);
+    ASSERT_EQ(FOUND_VAL, res);
+
+    res = FOUND_PTMB;
+    cn_tree_ttl_hide(tree, &res, 1);
+    ASSERT_EQ(FOUND_PTMB, res);
+
+    res = NOT_FOUND;
+    cn_tree_ttl_hide(tree, &res, 1);
+    ASSERT_EQ(NOT_FOUND, res);
+
+    cn_tree_destroy(tree);
+}
+
+/* Emulate cn.c's tree state management of the ttl horizon.
+ */
+struct ttl_tstate {
+    struct cn_tstate     tt_tstate;
+    struct cn_tstate_omf tt_omf;
+};
+
+static void
+ttl_ts_get(struct cn_tstate *tstate, u32 *genp, u8 *mapv)
+{
+    struct ttl_tstate *tt = container_of(tstate, struct ttl_tstate, tt_tstate);
+
+    *genp = omf_ts_khm_gen(&tt->tt_omf);
+    memcpy(mapv, tt->tt_omf.ts_khm_mapv, CN_TSTATE_KHM_SZ);
+}
+
+static u64
+ttl_ts_get_ttl_seq(struct cn_tstate *tstate)
+{
+    struct ttl_tstate *tt = container_of(tstate, struct ttl_tstate, tt_tstate);
+
+    return omf_ts_ttl_seq(&tt->tt_omf);
+}
+
+static merr_t
+ttl_ts_update(
+    struct cn_tstate *   tstate,
+    cn_tstate_prepare_t *ts_prepare,
+    cn_tstate_commit_t * ts_commit,
+    cn_tstate_abort_t *  ts_abort,
+    void *               arg)
+{
+    struct ttl_tstate *tt = container_of(tstate, struct ttl_tstate, tt_tstate);
+    merr_t             err;
+
+    err = ts_prepare(&tt->tt_omf, arg);
+    if (err) {
+        ts_abort(&tt->tt_omf, arg);
+        return err;
+    }
+
+    ts_commit(&tt->tt_omf, arg);
+
+    return 0;
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_ttl_reopen, test_setup)
+{
+    struct kvs_cparams cp = {.cp_fanout = 8 };
+    struct ttl_tstate  tt;
+    struct cn_tree *   tree;
+    merr_t             err;
+
+    memset(&tt, 0, sizeof(tt));
+    tt.tt_tstate.ts_get = ttl_ts_get;
+    tt.tt_tstate.ts_update = ttl_ts_update;
+    tt.tt_tstate.ts_get_ttl_seq = ttl_ts_get_ttl_seq;
+    omf_set_ts_magic(&tt.tt_omf, CN_TSTATE_MAGIC);
+    omf_set_ts_version(&tt.tt_omf, CN_TSTATE_VERSION);
+
+    err = cn_tree_create(&tree, &tt.tt_tstate, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    cn_tree_ttl_init(tree, 1, 100);
+    ASSERT_EQ(0, omf_ts_ttl_seq(&tt.tt_omf));
+
+    /* A sample records the horizon once it has moved.
+     */
+    ttl_age(tree, NSEC_PER_SEC);
+    cn_tree_ttl_sample(tree, 200);
+    ASSERT_EQ(100, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(100, omf_ts_ttl_seq(&tt.tt_omf));
+
+    cn_tree_destroy(tree);
+
+    /* After a reopen the recorded horizon keeps entries hidden before
+     * any new sample has expired.
+     */
+    err = cn_tree_create(&tree, &tt.tt_tstate, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    cn_tree_ttl_init(tree, 1, 300);
+    ASSERT_EQ(100, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(1, tree->ct_ttl.ttl_cnt);
+
+    ttl_age(tree, NSEC_PER_SEC);
+    cn_tree_ttl_sample(tree, 400);
+    ASSERT_EQ(300, cn_tree_ttl_seq(tree));
+    ASSERT_EQ(300, omf_ts_ttl_seq(&tt.tt_omf));
+
+    cn_tree_destroy(tree);
+
+    /* Reopened without a ttl, nothing is hidden.
+     */
+    err = cn_tree_create(&tree, &tt.tt_tstate, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    cn_tree_ttl_init(tree, 0, 500);
+    ASSERT_EQ(0, cn_tree_ttl_seq(tree));
+
+    cn_tree_destroy(tree);
+}
+
+/*----------------------------------------------------------------
+ * Spill checkpoints
+ */
+
+static void
+ckpt_ts_get_ckpt(struct cn_tstate *tstate, struct cn_tstate_ckpt *ckptv)
+{
+    struct ttl_tstate *tt = container_of(tstate, struct ttl_tstate, tt_tstate);
+    uint               i;
+
+    for (i = 0; i < CN_TSTATE_CKPT_MAX; i++) {
+        struct cn_tstate_ckpt_omf *omf = &tt->tt_omf.ts_ckptv[i];
+
+        ckptv[i].tsc_loc.node_level = omf_tsc_level(omf);
+        ckptv[i].tsc_loc.node_offset = omf_tsc_offset(omf);
+        ckptv[i].tsc_dgen_lo = omf_tsc_dgen_lo(omf);
+        ckptv[i].tsc_dgen_hi = omf_tsc_dgen_hi(omf);
+    }
+}
+
+/* Reopen a tree whose node (1,0) holds kvsets @dgen_lo..@dgen_hi, and
+ * whose children hold @outc checkpoint kvsets with max keys @outv.
+ */
+static struct cn_tree *
+ckpt_tree_open(
+    struct ttl_tstate * tt,
+    struct fake_kvset **head,
+    u64                 dgen_lo,
+    u64                 dgen_hi,
+    const char **       outv,
+    uint                outc)
+{
+    struct kvs_cparams cp = {.cp_fanout = 4 };
+    struct fake_kvset *kvset;
+    struct cn_tree *   tree;
+    u64                dgen;
+    uint               i;
+
+    if (cn_tree_create(&tree, &tt->tt_tstate, 0, &cp, &mock_health, rp))
+        return NULL;
+
+    /* An older kvset in a child, spilled before the checkpoint. */
+    kvset = fake_kvset_create_add(head, tree, 2, 3, dgen_lo - 1);
+    if (!kvset)
+        goto err;
+    kvset->maxkey = "zzz";
+
+    for (i = 0; i < outc; i++) {
+        kvset = fake_kvset_create_add(head, tree, 2, i, dgen_lo);
+        if (!kvset)
+            goto err;
+        kvset->maxkey = outv[i];
+    }
+
+    for (dgen = dgen_lo; dgen <= dgen_hi; dgen++)
+        if (!fake_kvset_create_add(head, tree, 1, 0, dgen))
+            goto err;
+
+    cn_tree_ckpt_restore(tree);
+
+    return tree;
+
+err:
+    cn_tree_destroy(tree);
+    return NULL;
+}
+
+static void
+ckpt_kvsets_destroy(struct fake_kvset **head)
+{
+    struct fake_kvset *kvset;
+
+    while (*head) {
+        kvset = *head;
+        *head = kvset->next;
+        fake_kvset_destroy(kvset);
+    }
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_spill_ckpt, test_setup)
+{
+    const char *               outv[] = { "key020", "key010", "key015" };
+    struct cn_node_loc         loc = {.node_level = 1, .node_offset = 0 };
+    struct fake_kvset *        head = NULL;
+    struct cn_compaction_work  w;
+    struct cn_tstate_ckpt_omf *slot;
+    struct cn_tree_node *      tn;
+    struct cn_tree *           tree;
+    struct ttl_tstate          tt;
+
+    memset(&tt, 0, sizeof(tt));
+    tt.tt_tstate.ts_get = ttl_ts_get;
+    tt.tt_tstate.ts_update = ttl_ts_update;
+    tt.tt_tstate.ts_get_ckpt = ckpt_ts_get_ckpt;
+    omf_set_ts_magic(&tt.tt_omf, CN_TSTATE_MAGIC);
+    omf_set_ts_version(&tt.tt_omf, CN_TSTATE_VERSION);
+
+    tree = ckpt_tree_open(&tt, &head, 10, 13, outv, 0);
+    ASSERT_NE(NULL, tree);
+
+    tn = cn_tree_find_node(tree, &loc);
+    ASSERT_NE(NULL, tn);
+    ASSERT_EQ(NULL, tn->tn_ckpt);
+
+    /* The first checkpoint of a spill records it in the tree state,
+     * later ones of the same spill reuse the record.
+     */
+    memset(&w, 0, sizeof(w));
+    w.cw_tree = tree;
+    w.cw_node = tn;
+    w.cw_dgen_lo = 10;
+    w.cw_dgen_hi = 13;
+
+    ASSERT_TRUE(cn_comp_checkpoint_begin(&w));
+    ASSERT_NE(NULL, tn->tn_ckpt);
+    ASSERT_EQ(tn, tree->ct_ckptv[tn->tn_ckpt->nc_slot]);
+
+    slot = &tt.tt_omf.ts_ckptv[tn->tn_ckpt->nc_slot];
+    ASSERT_EQ(1, omf_tsc_level(slot));
+    ASSERT_EQ(0, omf_tsc_offset(slot));
+    ASSERT_EQ(10, omf_tsc_dgen_lo(slot));
+    ASSERT_EQ(13, omf_tsc_dgen_hi(slot));
+
+    ASSERT_TRUE(cn_comp_checkpoint_begin(&w));
+
+    /* Another spill of the node cannot checkpoint meanwhile. */
+    w.cw_dgen_lo = 14;
+    w.cw_dgen_hi = 15;
+    ASSERT_FALSE(cn_comp_checkpoint_begin(&w));
+
+    cn_tree_destroy(tree);
+    ckpt_kvsets_destroy(&head);
+
+    /* Reopened with checkpoint kvsets in the children, the spill resumes
+     * after the largest key they hold.
+     */
+    tree = ckpt_tree_open(&tt, &head, 10, 13, outv, NELEM(outv));
+    ASSERT_NE(NULL, tree);
+
+    tn = cn_tree_find_node(tree, &loc);
+    ASSERT_NE(NULL, tn);
+    ASSERT_NE(NULL, tn->tn_ckpt);
+    ASSERT_EQ(10, tn->tn_ckpt->nc_dgen_lo);
+    ASSERT_EQ(13, tn->tn_ckpt->nc_dgen_hi);
+    ASSERT_EQ(6, tn->tn_ckpt->nc_klen);
+    ASSERT_EQ(0, memcmp(tn->tn_ckpt->nc_key, "key020", 6));
+    ASSERT_EQ(tn, tree->ct_ckptv[tn->tn_ckpt->nc_slot]);
+
+    cn_tree_destroy(tree);
+    ckpt_kvsets_destroy(&head);
+
+    /* No checkpoint kvsets were committed, the spill starts over. */
+    tree = ckpt_tree_open(&tt, &head, 10, 13, outv, 0);
+    ASSERT_NE(NULL, tree);
+
+    tn = cn_tree_find_node(tree, &loc);
+    ASSERT_EQ(NULL, tn->tn_ckpt);
+
+    cn_tree_destroy(tree);
+    ckpt_kvsets_destroy(&head);
+
+    /* The spill completed, its inputs are gone from the node. */
+    tree = ckpt_tree_open(&tt, &head, 14, 15, outv, NELEM(outv));
+    ASSERT_NE(NULL, tree);
+
+    tn = cn_tree_find_node(tree, &loc);
+    ASSERT_EQ(NULL, tn->tn_ckpt);
+
+    cn_tree_destroy(tree);
+    ckpt_kvsets_destroy(&head);
+}
+
+/*----------------------------------------------------------------
+ * Kvset snapshots
+ */
+
+static struct kvset *lookup_hit;
+static struct kvset *lookupv[16];
+static uint          lookupc;
+
+/* Record the kvsets a lookup searches, the key is in lookup_hit only.
+ */
+static merr_t
+_kvset_lookup(
+    struct kvset *         kvset,
+    struct kvs_ktuple *    kt,
+    const struct key_disc *kdisc,
+    u64                    seq,
+    enum key_lookup_res *  res,
+    struct kvs_buf *       vbuf)
+{
+    if (lookupc < NELEM(lookupv))
+        lookupv[lookupc++] = kvset;
+
+    *res = (kvset == lookup_hit) ? FOUND_VAL : NOT_FOUND;
+
+    return 0;
+}
+
+static enum key_lookup_res
+tree_lookup(struct cn_tree *tree, struct fake_kvset *hit)
+{
+    struct query_ctx    qctx = {.qtype = QUERY_GET };
+    struct kvs_ktuple   kt;
+    struct kvs_buf      vbuf;
+    enum key_lookup_res res;
+    char                buf[8];
+    merr_t              err;
+
+    kvs_ktuple_init(&kt, "key", 3);
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+    lookup_hit = (struct kvset *)hit;
+    lookupc = 0;
+
+    err = cn_tree_lookup(tree, NULL, &kt, 1000, &res, &qctx, NULL, &vbuf);
+
+    return err ? NOT_FOUND : res;
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_kvsnap_publish, test_setup)
+{
+    struct kvs_cparams       cp = {.cp_fanout = 4 };
+    struct fake_kvset *      kvsetv[5], *head = NULL;
+    struct kvset_list_entry *le;
+    struct cn_tree_node *    root;
+    struct cn_kvsnap *       snap;
+    struct cn_tree *         tree;
+    merr_t                   err;
+    int                      i;
+
+    MOCK_SET(kvset, _kvset_lookup);
+
+    err = cn_tree_create(&tree, NULL, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    root = tree->ct_root;
+    ASSERT_EQ(NULL, root->tn_kvsnap);
+    ASSERT_EQ(NOT_FOUND, tree_lookup(tree, NULL));
+    ASSERT_EQ(0, lookupc);
+
+    /* Each insert publishes a snapshot of the node's kvsets, newest
+     * first, and a lookup searches them in that order.
+     */
+    for (i = 0; i < 3; i++) {
+        kvsetv[i] = fake_kvset_create_add(&head, tree, 0, 0, 100 + i);
+        ASSERT_NE(NULL, kvsetv[i]);
+
+        snap = root->tn_kvsnap;
+        ASSERT_NE(NULL, snap);
+        ASSERT_EQ(i + 1, snap->ksn_kvsetc);
+        ASSERT_EQ((struct kvset *)kvsetv[i], snap->ksn_kvsetv[0]);
+    }
+
+    i = 0;
+    list_for_each_entry (le, &root->tn_kvset_list, le_link)
+        ASSERT_EQ(le->le_kvset, snap->ksn_kvsetv[i++]);
+
+    ASSERT_EQ(FOUND_VAL, tree_lookup(tree, kvsetv[1]));
+    ASSERT_EQ(2, lookupc);
+    ASSERT_EQ((struct kvset *)kvsetv[2], lookupv[0]);
+    ASSERT_EQ((struct kvset *)kvsetv[1], lookupv[1]);
+
+    ASSERT_EQ(NOT_FOUND, tree_lookup(tree, NULL));
+    ASSERT_EQ(3, lookupc);
+
+    /* If a snapshot can't be allocated the node gets the stale one,
+     * and lookups fall back to its kvset list until the next publish.
+     */
+    mapi_inject_once_ptr(mapi_idx_malloc, 1, 0);
+    kvsetv[3] = fake_kvset_create_add(&head, tree, 0, 0, 103);
+    mapi_inject_unset(mapi_idx_malloc);
+    ASSERT_NE(NULL, kvsetv[3]);
+
+    snap = root->tn_kvsnap;
+    ASSERT_NE(NULL, snap);
+    ASSERT_EQ(0, snap->ksn_kvsetc);
+
+    ASSERT_EQ(FOUND_VAL, tree_lookup(tree, kvsetv[0]));
+    ASSERT_EQ(4, lookupc);
+    ASSERT_EQ((struct kvset *)kvsetv[3], lookupv[0]);
+    ASSERT_EQ((struct kvset *)kvsetv[0], lookupv[3]);
+
+    kvsetv[4] = fake_kvset_create_add(&head, tree, 0, 0, 104);
+    ASSERT_NE(NULL, kvsetv[4]);
+
+    snap = root->tn_kvsnap;
+    ASSERT_EQ(5, snap->ksn_kvsetc);
+
+    ASSERT_EQ(FOUND_VAL, tree_lookup(tree, kvsetv[3]));
+    ASSERT_EQ(2, lookupc);
+    ASSERT_EQ((struct kvset *)kvsetv[4], lookupv[0]);
+
+    MOCK_UNSET(kvset, _kvset_lookup);
+
+    cn_tree_destroy(tree);
+
+    while (head) {
+        struct fake_kvset *next = head->next;
+
+        fake_kvset_destroy(head);
+        head = next;
+    }
+}
+
+static struct fake_kvset **spill_head;
+static struct fake_kvset * spill_outv[2];
+static bool                spill_refv[2];
+static struct cn_kvsnap *  spill_psnap;
+static struct cn_tree *    spill_tree;
+static int                 spill_outc;
+static bool                spill_order;
+
+/* Spill into children 0 and 2 of the node.
+ */
+static merr_t
+_cn_spill(struct cn_compaction_work *w)
+{
+    w->cw_outv[0].kblks.n_blks = 1;
+    w->cw_outv[2].kblks.n_blks = 1;
+
+    return 0;
+}
+
+static merr_t
+_kvset_create(struct cn_tree *tree, u64 tag, struct kvset_meta *km, struct kvset **handle)
+{
+    struct fake_kvset *kvset;
+
+    kvset = fake_kvset_create(spill_head, km->km_dgen);
+    if (!kvset)
+        return merr(ENOMEM);
+
+    kvset->node_level = km->km_node_level;
+    kvset->node_offset = km->km_node_offset;
+
+    if (spill_outc < NELEM(spill_outv))
+        spill_outv[spill_outc++] = kvset;
+
+    *handle = (struct kvset *)kvset;
+
+    return 0;
+}
+
+/* The first ref on a spill output is taken by the publish of its child,
+ * which must happen while the parent still publishes the spill inputs.
+ */
+static void
+_kvset_get_ref(struct kvset *handle)
+{
+    int i;
+
+    for (i = 0; i < spill_outc; i++) {
+        if (handle != (struct kvset *)spill_outv[i] || spill_refv[i])
+            continue;
+
+        spill_refv[i] = true;
+
+        if (spill_tree->ct_root->tn_kvsnap != spill_psnap)
+            spill_order = false;
+    }
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_kvsnap_spill, test_setup)
+{
+    struct test_params        tp = {.fanout_bits = 2 };
+    struct kvs_cparams        cp = {.cp_fanout = 4 };
+    struct cn_compaction_work w;
+    struct cn_tree_node *     root, *tn;
+    struct cn_kvsnap *        snap;
+    struct test               t;
+    merr_t                    err;
+    int                       i;
+
+    test_init(&t, &tp, lcl_ti);
+
+    err = cn_tree_create(&t.tree, NULL, 0, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    root = t.tree->ct_root;
+
+    for (i = 0; i < 2; i++)
+        ASSERT_NE(NULL, fake_kvset_create_add(&t.kvset_list, t.tree, 0, 0, 100 + i));
+
+    spill_head = &t.kvset_list;
+    spill_psnap = root->tn_kvsnap;
+    spill_tree = t.tree;
+    spill_outc = 0;
+    spill_refv[0] = spill_refv[1] = false;
+    spill_order = true;
+
+    mapi_inject(mapi_idx_cn_is_capped, 0);
+    mapi_inject_unset(mapi_idx_cn_spill);
+    mapi_inject_unset(mapi_idx_kvset_create);
+    mapi_inject_unset(mapi_idx_kvset_get_ref);
+    MOCK_SET(spill, _cn_spill);
+    MOCK_SET(kvset, _kvset_create);
+    MOCK_SET(kvset, _kvset_get_ref);
+
+    cn_comp_work_init(&t, root, &w, CN_ACTION_SPILL, false);
+    cn_comp_slice_cb(&w.cw_job);
+
+    MOCK_UNSET(kvset, _kvset_get_ref);
+    MOCK_UNSET(kvset, _kvset_create);
+    MOCK_UNSET(spill, _cn_spill);
+    mapi_inject_unset(mapi_idx_cn_is_capped);
+
+    ASSERT_EQ(0, w.cw_err);
+
+    /* Both children were published before the node lost its kvsets.
+     */
+    ASSERT_EQ(2, spill_outc);
+    ASSERT_TRUE(spill_refv[0] && spill_refv[1]);
+    ASSERT_TRUE(spill_order);
+    ASSERT_EQ(NULL, root->tn_kvsnap);
+
+    for (i = 0; i < 4; i++) {
+        tn = root->tn_childv[i];
+        if (i % 2) {
+            ASSERT_EQ(NULL, tn);
+            continue;
+        }
+
+        ASSERT_NE(NULL, tn);
+        snap = tn->tn_kvsnap;
+        ASSERT_NE(NULL, snap);
+        ASSERT_EQ(1, snap->ksn_kvsetc);
+        ASSERT_EQ(1, ((struct fake_kvset *)snap->ksn_kvsetv[0])->node_level);
+        ASSERT_EQ(i, ((struct fake_kvset *)snap->ksn_kvsetv[0])->node_offset);
+    }
+
+    test_tree_destroy(&t);
+}
+
+/*----------------------------------------------------------------
+ * Spill by moving kvsets
+ */
+
+static int move_cnt;
+
+static void
+_kvset_minkey(struct kvset *ks, const void **key, u16 *klen)
+{
+    const char *minkey = ((struct fake_kvset *)ks)->minkey ?: "foo";
+
+    *key = minkey;
+    *klen = strlen(minkey);
+}
+
+static void
+_kvset_maxkey(struct kvset *ks, const void **key, u16 *klen)
+{
+    const char *maxkey = ((struct fake_kvset *)ks)->maxkey ?: "foo";
+
+    *key = maxkey;
+    *klen = strlen(maxkey);
+}
+
+static u64
+_kvset_get_tag(struct kvset *ks)
+{
+    return ((struct fake_kvset *)ks)->tag;
+}
+
+static merr_t
+_kvset_log_move(struct kvset *ks, u64 txid, u32 level, u32 offset, u64 *tag)
+{
+    struct fake_kvset *kvset = (struct fake_kvset *)ks;
+
+    kvset->node_level = level;
+    kvset->node_offset = offset;
+    *tag = 1000 + move_cnt++;
+
+    return 0;
+}
+
+static void
+_kvset_move(struct kvset *ks, u64 tag, u32 level)
+{
+    ((struct fake_kvset *)ks)->tag = tag;
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_spill_move, test_setup)
+{
+    const char *const         rangev[][2] = {
+        { "k10", "k19" }, { "k20", "k29" }, { "k30", "k39" },
+    };
+    struct test_params        tp = {.fanout_bits = 2 };
+    struct kvs_cparams        cp = {.cp_fanout = 4 };
+    struct fake_kvset *       kvsetv[NELEM(rangev)], *kvset;
+    struct kvset_list_entry * le;
+    struct cn_compaction_work w;
+    struct cn_tree_node *     root, *tn;
+    struct test               t;
+    merr_t                    err;
+    u64                       dgen;
+    int                       i, cx;
+
+    test_init(&t, &tp, lcl_ti);
+
+    err = cn_tree_create(&t.tree, NULL, CN_CFLAG_RANGE, &cp, &mock_health, rp);
+    ASSERT_EQ(0, err);
+
+    root = t.tree->ct_root;
+
+    for (i = 0; i < NELEM(rangev); i++) {
+        kvsetv[i] = fake_kvset_create_add(&t.kvset_list, t.tree, 0, 0, 100 + i);
+        ASSERT_NE(NULL, kvsetv[i]);
+        kvsetv[i]->tag = 1 + i;
+        kvsetv[i]->minkey = rangev[i][0];
+        kvsetv[i]->maxkey = rangev[i][1];
+    }
+
+    move_cnt = 0;
+
+    mapi_inject(mapi_idx_cn_is_capped, 0);
+    mapi_inject(mapi_idx_kvset_pt_start, -1);
+    MOCK_SET(kvset, _kvset_minkey);
+    MOCK_SET(kvset, _kvset_maxkey);
+    MOCK_SET(kvset, _kvset_get_tag);
+    MOCK_SET(kvset, _kvset_log_move);
+    MOCK_SET(kvset, _kvset_move);
+
+    /* No two kvsets overlap, so the splitters fall between them and the
+     * spill moves them to the children without writing anything.
+     */
+    cn_comp_work_init(&t, root, &w, CN_ACTION_SPILL, false);
+    cn_comp_slice_cb(&w.cw_job);
+
+    ASSERT_EQ(0, w.cw_err);
+    ASSERT_TRUE(w.cw_move);
+    ASSERT_EQ(NELEM(rangev), move_cnt);
+    ASSERT_TRUE(list_empty(&root->tn_kvset_list));
+    ASSERT_NE(NULL, root->tn_split);
+
+    for (i = 0; i < NELEM(rangev); i++) {
+        kvset = kvsetv[i];
+
+        ASSERT_EQ(1, kvset->node_level);
+        ASSERT_GE(kvset->tag, 1000);
+        ASSERT_EQ(0, kvset->workid);
+
+        tn = root->tn_childv[kvset->node_offset];
+        ASSERT_NE(NULL, tn);
+
+        list_for_each_entry (le, &tn->tn_kvset_list, le_link)
+            if (le->le_kvset == (struct kvset *)kvset)
+                break;
+        ASSERT_NE(&tn->tn_kvset_list, &le->le_link);
+    }
+
+    /* Each child's kvsets are still newest first. */
+    for (cx = 0; cx < cp.cp_fanout; cx++) {
+        tn = root->tn_childv[cx];
+        if (!tn)
+            continue;
+
+        dgen = U64_MAX;
+        list_for_each_entry (le, &tn->tn_kvset_list, le_link) {
+            ASSERT_LT(kvset_get_dgen(le->le_kvset), dgen);
+            dgen = kvset_get_dgen(le->le_kvset);
+        }
+    }
+
+    /* A kvset that spans children is merged and spilled as usual. */
+    kvset = fake_kvset_create_add(&t.kvset_list, t.tree, 0, 0, 200);
+    ASSERT_NE(NULL, kvset);
+    kvset->minkey = rangev[0][0];
+    kvset->maxkey = rangev[NELEM(rangev) - 1][1];
+
+    spill_head = &t.kvset_list;
+    spill_psnap = root->tn_kvsnap;
+    spill_tree = t.tree;
+    spill_outc = 0;
+
+    mapi_inject_unset(mapi_idx_cn_spill);
+    mapi_inject_unset(mapi_idx_kvset_create);
+    MOCK_SET(spill, _cn_spill);
+    MOCK_SET(kvset, _kvset_create);
+
+    cn_comp_work_init(&t, root, &w, CN_ACTION_SPILL, false);
+    cn_comp_slice_cb(&w.cw_job);
+
+    MOCK_UNSET(kvset, _kvset_create);
+    MOCK_UNSET(spill, _cn_spill);
+    MOCK_UNSET(kvset, _kvset_move);
+    MOCK_UNSET(kvset, _kvset_log_move);
+    MOCK_UNSET(kvset, _kvset_get_tag);
+    MOCK_UNSET(kvset, _kvset_maxkey);
+    MOCK_UNSET(kvset, _kvset_minkey);
+    mapi_inject_unset(mapi_idx_kvset_pt_start);
+    mapi_inject_unset(mapi_idx_cn_is_capped);
+
+    ASSERT_EQ(0, w.cw_err);
+    ASSERT_FALSE(w.cw_move);
+    ASSERT_EQ(NELEM(rangev), move_cnt);
+    ASSERT_EQ(2, spill_outc);
+    ASSERT_TRUE(list_empty(&root->tn_kvset_list));
+
+    test_tree_destroy(&t);
+}
+
 #define MY_TEST1(NAME, N1, V1, VERBOSE)                     \
     MTF_DEFINE_UTEST_PRE(test, NAME##_##N1##V1, test_setup) \
     {                                                       \
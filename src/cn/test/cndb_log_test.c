@@ -152,6 +152,59 @@ MTF_DEFINE_UTEST(cndb_log_test, rollforward)
     mapi_inject_unset(mapi_idx_mpool_mblock_abort);
 }
 
+/* A clean log is compacted in memory only, the MDC is not rewritten. */
+MTF_DEFINE_UTEST(cndb_log_test, replay_no_rewrite)
+{
+    merr_t err;
+    size_t expect_keepc = 66;
+    u64    ingestid;
+
+    load_log("missing_ackds.cndblog");
+
+    err = cndb_open(mock_ds, CNDB_OPEN_RDWR, 0, 2, 0, 0, &mock_health, &mock_cndb);
+    ASSERT_EQ(0, err);
+
+    err = mpm_mdc_set_getlen(mock_cndb->cndb_mdc, getlen);
+    ASSERT_EQ(0, err);
+
+    mapi_inject(mapi_idx_mpool_mblock_find_get, 0);
+    mapi_inject(mapi_idx_mpool_mblock_getprops, 0);
+    mapi_inject(mapi_idx_mpool_mblock_abort, 0);
+    mapi_inject(mapi_idx_mpool_mdc_usage, 0);
+
+    /* Recovery must be persisted by a rollover. */
+    mapi_calls_clear(mapi_idx_mpool_mdc_cstart);
+    err = cndb_replay(mock_cndb, &seqno, &ingestid);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(1, mapi_calls(mapi_idx_mpool_mdc_cstart));
+
+    err = cndb_close(mock_cndb);
+    ASSERT_EQ(0, err);
+
+    err = cndb_open(mock_ds, CNDB_OPEN_RDWR, 0, 2, 0, 0, &mock_health, &mock_cndb);
+    ASSERT_EQ(0, err);
+
+    err = mpm_mdc_set_getlen(mock_cndb->cndb_mdc, getlen);
+    ASSERT_EQ(0, err);
+
+    mapi_calls_clear(mapi_idx_mpool_mdc_cstart);
+    err = cndb_replay(mock_cndb, &seqno, &ingestid);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, mapi_calls(mapi_idx_mpool_mdc_cstart));
+
+    ASSERT_EQ(0, mock_cndb->cndb_workc);
+    ASSERT_EQ(expect_keepc, mock_cndb->cndb_keepc);
+    cndb_validate_vector(mock_cndb->cndb_keepv, mock_cndb->cndb_keepc);
+
+    err = cndb_close(mock_cndb);
+    ASSERT_EQ(0, err);
+
+    mapi_inject_unset(mapi_idx_mpool_mdc_usage);
+    mapi_inject_unset(mapi_idx_mpool_mblock_find_get);
+    mapi_inject_unset(mapi_idx_mpool_mblock_getprops);
+    mapi_inject_unset(mapi_idx_mpool_mblock_abort);
+}
+
 MTF_DEFINE_UTEST(cndb_log_test, rollbackward)
 {
     merr_t err;
@@ -244,6 +297,9 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop)
     size_t final_keepc = 26;
     u64    drop_cnid = 2;
     u64    ingestid;
+    u64    cnid;
+    u64 *  mbidv;
+    uint   mbidc;
     size_t blobsz;
     char * blob = NULL;
     int    rc;
@@ -271,6 +327,28 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop)
 
     err = cndb_cn_drop(mock_cndb, drop_cnid);
     ASSERT_EQ(0, err);
+
+    /* The drop is only recorded, the cn is culled once purged. */
+    err = cndb_cnv_get(mock_cndb, drop_cnid, NULL);
+    ASSERT_EQ(0, err);
+
+    err = cndb_cn_drop(mock_cndb, drop_cnid);
+    ASSERT_EQ(ENOENT, merr_errno(err));
+
+    err = cndb_cn_dropped(mock_cndb, &cnid, &mbidv, &mbidc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(drop_cnid, cnid);
+    ASSERT_NE(0, mbidc);
+    free(mbidv);
+
+    err = cndb_cn_purge(mock_cndb, drop_cnid);
+    ASSERT_EQ(0, err);
+
+    err = cndb_cn_dropped(mock_cndb, &cnid, &mbidv, &mbidc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, cnid);
+    ASSERT_EQ(0, mbidc);
+
     ASSERT_EQ(final_workc, mock_cndb->cndb_workc);
     cndb_validate_vector(mock_cndb->cndb_workv, mock_cndb->cndb_workc);
     ASSERT_EQ(final_keepc, mock_cndb->cndb_keepc);
@@ -305,6 +383,9 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop2)
     size_t final_keepc = 36;
     u64    drop_cnid = 3;
     u64    ingestid;
+    u64    cnid;
+    u64 *  mbidv;
+    uint   mbidc;
 
     load_log("simpledrop.cndblog");
 
@@ -328,6 +409,28 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop2)
 
     err = cndb_cn_drop(mock_cndb, drop_cnid);
     ASSERT_EQ(0, err);
+
+    /* The drop is only recorded, the cn is culled once purged. */
+    err = cndb_cnv_get(mock_cndb, drop_cnid, NULL);
+    ASSERT_EQ(0, err);
+
+    err = cndb_cn_drop(mock_cndb, drop_cnid);
+    ASSERT_EQ(ENOENT, merr_errno(err));
+
+    err = cndb_cn_dropped(mock_cndb, &cnid, &mbidv, &mbidc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(drop_cnid, cnid);
+    ASSERT_NE(0, mbidc);
+    free(mbidv);
+
+    err = cndb_cn_purge(mock_cndb, drop_cnid);
+    ASSERT_EQ(0, err);
+
+    err = cndb_cn_dropped(mock_cndb, &cnid, &mbidv, &mbidc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, cnid);
+    ASSERT_EQ(0, mbidc);
+
     ASSERT_EQ(final_workc, mock_cndb->cndb_workc);
     cndb_validate_vector(mock_cndb->cndb_workv, mock_cndb->cndb_workc);
     ASSERT_EQ(final_keepc, mock_cndb->cndb_keepc);
@@ -353,6 +456,10 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop_recovery)
     size_t expect_keepc = 36;
     u64    drop_cnid = 3;
     u64    ingestid;
+    u64    cnid;
+    u64 *  mbidv;
+    uint   mbidc;
+    u32    cnt;
 
     load_log("simpledrop_recovery.cndblog");
 
@@ -369,6 +476,22 @@ MTF_DEFINE_UTEST(cndb_log_test, simpledrop_recovery)
     err = cndb_replay(mock_cndb, &seqno, &ingestid);
     ASSERT_EQ(0, err);
 
+    /* The cn is still dropped after the restart, and still to be reaped. */
+    err = cndb_cnv_get(mock_cndb, drop_cnid, NULL);
+    ASSERT_EQ(0, err);
+
+    err = cndb_cn_count(mock_cndb, &cnt);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(mock_cndb->cndb_cnc - 1, cnt);
+
+    err = cndb_cn_dropped(mock_cndb, &cnid, &mbidv, &mbidc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(drop_cnid, cnid);
+    free(mbidv);
+
+    err = cndb_cn_purge(mock_cndb, drop_cnid);
+    ASSERT_EQ(0, err);
+
     ASSERT_EQ(expect_workc, mock_cndb->cndb_workc);
     cndb_validate_vector(mock_cndb->cndb_workv, mock_cndb->cndb_workc);
     ASSERT_EQ(expect_keepc, mock_cndb->cndb_keepc);
@@ -467,7 +467,7 @@ MTF_DEFINE_UTEST_PREPOST(cndb_test, cndb_cnv_add_test, test_pre, test_post)
 
     ASSERT_EQ(256, HSE_KVS_COUNT_MAX);
 
-    for (i = 0; i < HSE_KVS_COUNT_MAX; i++) {
+    for (i = 0; i < CNDB_CNV_MAX; i++) {
         u32 meta = (((ulong)i << 24) + i) ^ 0xaa55aa55;
 
         err = cndb_cnv_add(&cndb, 0, &cp, i, "", sizeof(meta), &meta);
@@ -475,13 +475,13 @@ MTF_DEFINE_UTEST_PREPOST(cndb_test, cndb_cnv_add_test, test_pre, test_post)
             break;
     }
     ASSERT_EQ(0, err);
-    ASSERT_EQ(HSE_KVS_COUNT_MAX, cndb.cndb_cnc);
+    ASSERT_EQ(CNDB_CNV_MAX, cndb.cndb_cnc);
 
     err = cndb_cnv_add(&cndb, 0, &cp, i, "", 0, NULL);
     ASSERT_EQ(ENFILE, merr_errno(err));
-    ASSERT_EQ(HSE_KVS_COUNT_MAX, cndb.cndb_cnc);
+    ASSERT_EQ(CNDB_CNV_MAX, cndb.cndb_cnc);
 
-    for (i = 0; i < HSE_KVS_COUNT_MAX; i++) {
+    for (i = 0; i < CNDB_CNV_MAX; i++) {
         u32    expect = (((ulong)i << 24) + i) ^ 0xaa55aa55;
         u64    expect8 = (u64)expect << 32 | (u64)expect;
         u32 *  meta;
@@ -510,7 +510,7 @@ MTF_DEFINE_UTEST_PREPOST(cndb_test, cndb_cnv_add_test, test_pre, test_post)
         free(meta8);
     }
 
-    for (i = 0; i < HSE_KVS_COUNT_MAX; i++) {
+    for (i = 0; i < CNDB_CNV_MAX; i++) {
         err = cndb_cnv_del(&cndb, 0);
         ASSERT_EQ(0, err);
     }
@@ -981,10 +981,10 @@ MTF_DEFINE_UTEST(cndb_test, cndb_misc_test)
     mapi_inject(mapi_idx_mpool_mdc_append, 0);
     mapi_inject(mapi_idx_cndb_journal, 0);
     mapi_inject(mapi_idx_mpool_mdc_usage, 1);
-    err = cn_ingestv(cnv, mbv, &mbc, NULL, U64_MAX, 1, &ingested, &seqno);
+    err = cn_ingestv(cnv, mbv, &mbc, NULL, U64_MAX, 1, &ingested, &seqno, NULL);
     ASSERT_EQ(1, err);
 
-    err = cn_ingestv(cnv, mbv, &mbc, NULL, U64_MAX, 1, &ingested, &seqno);
+    err = cn_ingestv(cnv, mbv, &mbc, NULL, U64_MAX, 1, &ingested, &seqno, NULL);
     ASSERT_EQ(1, err);
 
     err = cndb_replay(&cndb, &seqno, &ingestid);
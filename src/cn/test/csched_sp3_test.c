@@ -515,6 +515,8 @@ MTF_DEFINE_UTEST_PRE(test, t_sp3_one_empty_tree, pre_test)
 
     msleep(DELAY_MS);
 
+    ASSERT_EQ(ops->cs_root_len(ops), 0);
+
     remove_tree(tt->tree, ops);
 
     destroy_trees();
@@ -652,4 +654,39 @@ MTF_DEFINE_UTEST_PRE(test, t_sp3_one_big_tree_with_work, pre_test)
     ops->cs_destroy(ops);
 }
 
+MTF_DEFINE_UTEST_PRE(test, t_sp3_kvset_tier, pre_test)
+{
+    struct sp3_thresholds thresh = {};
+    struct kvset *        ks = (void *)&thresh; /* only seen by mocked kvset accessors */
+    u64                   hot = 100;
+
+    mapi_inject(mapi_idx_kvset_get_mclass, MP_MED_CAPACITY);
+    mapi_inject(mapi_idx_kvset_get_heat, hot);
+    mapi_inject(mapi_idx_kvset_ctime, 0);
+
+    /* disabled */
+    ASSERT_EQ(MP_MED_INVALID, sp3_kvset_tier(&thresh, ks));
+
+    thresh.tier_hot = hot;
+    ASSERT_EQ(MP_MED_STAGING, sp3_kvset_tier(&thresh, ks));
+
+    mapi_inject(mapi_idx_kvset_get_heat, hot - 1);
+    ASSERT_EQ(MP_MED_INVALID, sp3_kvset_tier(&thresh, ks));
+
+    /* cold kvsets on staging move back to capacity, with hysteresis */
+    mapi_inject(mapi_idx_kvset_get_mclass, MP_MED_STAGING);
+    ASSERT_EQ(MP_MED_INVALID, sp3_kvset_tier(&thresh, ks));
+
+    mapi_inject(mapi_idx_kvset_get_heat, hot / SP3_TIER_COLD_DIV - 1);
+    ASSERT_EQ(MP_MED_CAPACITY, sp3_kvset_tier(&thresh, ks));
+
+    /* but not before they have had time to warm up */
+    mapi_inject(mapi_idx_kvset_ctime, get_time_ns());
+    ASSERT_EQ(MP_MED_INVALID, sp3_kvset_tier(&thresh, ks));
+
+    mapi_inject_unset(mapi_idx_kvset_get_mclass);
+    mapi_inject_unset(mapi_idx_kvset_get_heat);
+    mapi_inject_unset(mapi_idx_kvset_ctime);
+}
+
 MTF_END_UTEST_COLLECTION(test);
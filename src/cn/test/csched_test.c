@@ -27,7 +27,9 @@ merr_t mocked_sp_create_rc;
 
 struct throttle_sensor;
 
-enum csched_policy policy_list[] = { csched_policy_old, csched_policy_noop, csched_policy_sp3 };
+enum csched_policy policy_list[] = {
+    csched_policy_old, csched_policy_noop, csched_policy_sp3, csched_policy_hybrid
+};
 
 static void
 mocked_sp_destroy(struct csched_ops *handle)
@@ -166,6 +168,7 @@ pre_test(struct mtf_test_info *ti)
 
     MOCK_SET_FN(csched_noop, sp_noop_create, mocked_sp_create);
     MOCK_SET_FN(csched_sp3, sp3_create, mocked_sp3_create);
+    MOCK_SET_FN(csched_sp3, sp3_hybrid_create, mocked_sp3_create);
 
     mp = "fred_flintstone";
     mocked_sp_create_rc = 0;
@@ -264,6 +267,7 @@ MTF_DEFINE_UTEST_PRE(test, t_csched_methods, pre_test)
     csched_compact_request(cs, flags);
     csched_compact_status(cs, &status);
     csched_tbkt_maint_get(cs);
+    csched_root_len(cs);
     csched_notify_ingest(cs, tree, 1234, 1234);
     csched_tree_remove(cs, tree, true);
 
@@ -282,6 +286,7 @@ MTF_DEFINE_UTEST_PRE(test, t_csched_methods, pre_test)
     csched_compact_request(cs, flags);
     csched_compact_status(cs, &status);
     csched_tbkt_maint_get(cs);
+    ASSERT_EQ(csched_root_len(cs), 0);
     csched_notify_ingest(cs, tree, 1234, 1234);
     csched_tree_remove(cs, tree, true);
 
@@ -292,6 +297,7 @@ MTF_DEFINE_UTEST_PRE(test, t_csched_methods, pre_test)
     csched_tree_add(cs, tree);
     csched_throttle_sensor(cs, 0);
     csched_tbkt_maint_get(cs);
+    ASSERT_EQ(csched_root_len(cs), 0);
     csched_notify_ingest(cs, tree, 1234, 1234);
     csched_tree_remove(cs, tree, true);
 }
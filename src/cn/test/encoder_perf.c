@@ -653,9 +653,11 @@ run_kmd_tp(struct kmd_test_profile *tp, struct kmd_test_stats *s, bool writing)
                     s->nzvals++;
                     break;
                 case vtype_ival:
+                case vtype_lival:
                     s->nivals++;
                     break;
                 case vtype_val:
+                case vtype_cval:
                     s->nvals++;
                     break;
             }
@@ -673,8 +675,15 @@ run_kmd_tp(struct kmd_test_profile *tp, struct kmd_test_stats *s, bool writing)
                     case vtype_ival:
                         kmd_add_ival(mem, &off, seq, vdata, vlen);
                         break;
+                    case vtype_lival:
+                        kmd_add_lival(mem, &off, seq, vdata, vlen);
+                        break;
                     case vtype_val:
                         kmd_add_val(mem, &off, seq, vbidx, vboff, vlen);
+                        break;
+                    case vtype_cval:
+                        kmd_add_cval(mem, &off, seq, vbidx, vboff, vlen, vlen);
+                        break;
                 }
             } else {
                 u64            actual_seq;
@@ -682,6 +691,7 @@ run_kmd_tp(struct kmd_test_profile *tp, struct kmd_test_stats *s, bool writing)
                 uint           actual_vbidx;
                 uint           actual_vboff;
                 uint           actual_vlen;
+                uint           actual_clen;
                 const void *   actual_vdata;
 
                 kmd_type_seq(mem, &off, &actual_vtype, &actual_seq);
@@ -692,9 +702,18 @@ run_kmd_tp(struct kmd_test_profile *tp, struct kmd_test_stats *s, bool writing)
                     assert(actual_vbidx == vbidx);
                     assert(actual_vboff == vboff);
                     assert(actual_vlen == vlen);
+                } else if (vtype == vtype_cval) {
+                    kmd_cval(mem, &off, &actual_vbidx, &actual_vboff, &actual_vlen, &actual_clen);
+                    assert(actual_vbidx == vbidx);
+                    assert(actual_vboff == vboff);
+                    assert(actual_vlen == vlen);
+                    assert(actual_clen == vlen);
                 } else if (vtype == vtype_ival) {
                     kmd_ival(mem, &off, &actual_vdata, &actual_vlen);
                     assert(actual_vlen == vlen);
+                } else if (vtype == vtype_lival) {
+                    kmd_lival(mem, &off, &actual_vdata, &actual_vlen);
+                    assert(actual_vlen == vlen);
                 }
             }
         }
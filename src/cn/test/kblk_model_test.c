@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+
+#include "../kblk_model.h"
+
+#define KEYLEN (16)
+#define LCP (4)
+
+static void
+mkkey(char *key, u64 pos)
+{
+    int i;
+
+    memset(key, 'k', LCP);
+    for (i = 0; i < 8; ++i)
+        key[LCP + i] = pos >> (56 - 8 * i);
+    memset(key + LCP + 8, 0, KEYLEN - LCP - 8);
+}
+
+/* Build a model over kblocks whose min keys are at the given positions.
+ */
+static struct kblk_model *
+mkmodel(const u64 *posv, uint kblkc)
+{
+    struct kblk_model *model;
+    char               key[KEYLEN];
+    uint               i;
+
+    model = kblk_model_create(LCP, kblkc);
+    if (!model)
+        return NULL;
+
+    for (i = 0; i < kblkc; ++i) {
+        mkkey(key, posv[i]);
+        kblk_model_add(model, key, sizeof(key));
+    }
+
+    if (!kblk_model_seal(model)) {
+        kblk_model_destroy(model);
+        return NULL;
+    }
+
+    return model;
+}
+
+/* Verify that the window predicted for a key within each kblock contains it.
+ */
+static int
+check_model(struct mtf_test_info *lcl_ti, const u64 *posv, uint kblkc)
+{
+    struct kblk_model *model;
+    char               key[KEYLEN];
+    int                first, last;
+    uint               i;
+
+    model = mkmodel(posv, kblkc);
+    ASSERT_NE_RET(NULL, model, 1);
+
+    for (i = 0; i < kblkc; ++i) {
+        u64 pos[] = { posv[i], posv[i] + 1, i + 1 < kblkc ? posv[i + 1] - 1 : ~0ul };
+        int j;
+
+        for (j = 0; j < NELEM(pos); ++j) {
+            mkkey(key, pos[j]);
+
+            first = 0;
+            last = kblkc - 1;
+            kblk_model_window(model, key, sizeof(key), &first, &last);
+
+            ASSERT_LE_RET(first, i, 1);
+            ASSERT_GE_RET(last, i, 1);
+            ASSERT_LE_RET(last - first, 2 * KBLK_MODEL_ERR + 2, 1);
+        }
+    }
+
+    kblk_model_destroy(model);
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(kblk_model_test);
+
+MTF_DEFINE_UTEST(kblk_model_test, t_linear)
+{
+    u64  posv[512];
+    uint i;
+    int  rc;
+
+    for (i = 0; i < NELEM(posv); ++i)
+        posv[i] = i * (1ul << 40);
+
+    rc = check_model(lcl_ti, posv, NELEM(posv));
+    ASSERT_EQ(0, rc);
+}
+
+MTF_DEFINE_UTEST(kblk_model_test, t_skewed)
+{
+    u64  posv[512];
+    uint i;
+    int  rc;
+
+    /* Three regions of very different key density.
+     */
+    for (i = 0; i < NELEM(posv); ++i) {
+        if (i < 128)
+            posv[i] = i * 1000;
+        else if (i < 384)
+            posv[i] = (1ul << 32) + (u64)i * i * (1ul << 20);
+        else
+            posv[i] = (1ul << 62) + i * (1ul << 44);
+    }
+
+    rc = check_model(lcl_ti, posv, NELEM(posv));
+    ASSERT_EQ(0, rc);
+}
+
+MTF_DEFINE_UTEST(kblk_model_test, t_window_clamp)
+{
+    struct kblk_model *model;
+    char               key[KEYLEN];
+    u64                posv[64];
+    int                first, last;
+    uint               i;
+
+    for (i = 0; i < NELEM(posv); ++i)
+        posv[i] = (i + 1) * (1ul << 48);
+
+    model = mkmodel(posv, NELEM(posv));
+    ASSERT_NE(NULL, model);
+
+    /* A window outside the caller's bounds is pinned to the nearest one.
+     */
+    mkkey(key, posv[60]);
+    first = 0;
+    last = 10;
+    kblk_model_window(model, key, sizeof(key), &first, &last);
+    ASSERT_EQ(10, first);
+    ASSERT_EQ(10, last);
+
+    mkkey(key, 0);
+    first = 20;
+    last = 30;
+    kblk_model_window(model, key, sizeof(key), &first, &last);
+    ASSERT_EQ(20, first);
+    ASSERT_EQ(20, last);
+
+    /* A key shorter than the common prefix is positioned at zero.
+     */
+    first = 0;
+    last = NELEM(posv) - 1;
+    kblk_model_window(model, key, LCP - 1, &first, &last);
+    ASSERT_EQ(0, first);
+
+    kblk_model_destroy(model);
+}
+
+MTF_DEFINE_UTEST(kblk_model_test, t_not_worthwhile)
+{
+    struct kblk_model *model;
+    u64                posv[64];
+    uint               i;
+
+    /* Too few kblocks to bother.
+     */
+    model = kblk_model_create(LCP, KBLK_MODEL_KBLKS_MIN - 1);
+    ASSERT_EQ(NULL, model);
+
+    /* Runs of exponentially spaced keys, which need a piece for every
+     * few kblocks.
+     */
+    for (i = 0; i < NELEM(posv); ++i)
+        posv[i] = (i / 32) * (1ul << 40) + (1ul << (i % 32));
+
+    model = mkmodel(posv, NELEM(posv));
+    ASSERT_EQ(NULL, model);
+}
+
+MTF_END_UTEST_COLLECTION(kblk_model_test);
@@ -196,6 +196,10 @@ test_setup(struct mtf_test_info *lcl_ti)
     mapi_inject(mapi_idx_cn_get_dataset, 0);
     mapi_inject(mapi_idx_cn_get_flags, 0);
     mapi_inject(mapi_idx_cn_get_tbkt_maint, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_vgc, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_floor, 0);
+    mapi_inject(mapi_idx_cn_get_io_sched, 0);
+    mapi_inject(mapi_idx_cn_get_cn_kvdb, 0);
     mapi_inject(mapi_idx_cn_get_mblk_sync_writes, true);
 
     return 0;
@@ -394,6 +398,28 @@ MTF_DEFINE_UTEST_PRE(test, t_kbb_finish, test_setup)
     blk_list_free(&blks);
     kbb_destroy(kbb);
 
+    /* with split-block bloom and tree prefixes */
+    mocked_rp.cn_bloom_create = BLOOM_CREATE_SPLIT;
+    mocked_rp.cn_bloom_pfx = 1;
+    mocked_cp.cp_pfx_len = 4;
+
+    err = kbb_create(KBB_CREATE_ARGS);
+    ASSERT_EQ(err, 0);
+
+    for (i = 0; i < 1000; i++) {
+        err = add_entry(lcl_ti, kbb, 16, 0, 9, 0);
+        ASSERT_EQ(err, 0);
+    }
+
+    err = kbb_finish(kbb, &blks, 0, 0);
+    ASSERT_EQ(err, 0);
+
+    blk_list_free(&blks);
+    kbb_destroy(kbb);
+
+    mocked_rp = mocked_rp_default;
+    mocked_cp = mocked_cp_default;
+
     /* without bloom */
     mocked_rp.cn_bloom_create = 0;
 
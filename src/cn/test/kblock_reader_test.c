@@ -82,6 +82,7 @@ init_kb_hdr(struct kb_hdr *kb)
     omf_set_kbh_version(kb->kb_hdr, KBLOCK_HDR_VERSION);
     omf_set_kbh_entries(kb->kb_hdr, 1173);
     omf_set_kbh_tombs(kb->kb_hdr, 87);
+    omf_set_kbh_ptombs(kb->kb_hdr, 5);
     omf_set_kbh_key_bytes(kb->kb_hdr, 13789);
     omf_set_kbh_val_bytes(kb->kb_hdr, 83787);
     omf_set_kbh_wbt_hoff(kb->kb_hdr, wbt_off);
@@ -115,7 +116,7 @@ init_kb_hdr(struct kb_hdr *kb)
     omf_set_wbt_leaf_cnt(kb->wbt_hdr, 0);
 
     omf_set_bh_magic(kb->blm_hdr, BLOOM_OMF_MAGIC);
-    omf_set_bh_version(kb->blm_hdr, BLOOM_OMF_VERSION);
+    omf_set_bh_version(kb->blm_hdr, BLOOM_OMF_VERSION4);
 
     omf_set_bh_modulus(kb->blm_hdr, 11730);
     omf_set_bh_bktshift(kb->blm_hdr, BF_BKTSHIFT);
@@ -283,6 +284,7 @@ MTF_DEFINE_UTEST_PRE(kblock_reader_test, basic_wbt_blm_test, pre)
     ASSERT_EQ(0, err);
     ASSERT_EQ(omf_kbh_entries(kb.kb_hdr), metrics.num_keys);
     ASSERT_EQ(omf_kbh_tombs(kb.kb_hdr), metrics.num_tombstones);
+    ASSERT_EQ(omf_kbh_ptombs(kb.kb_hdr), metrics.num_ptombs);
     ASSERT_EQ(omf_kbh_key_bytes(kb.kb_hdr), metrics.tot_key_bytes);
     ASSERT_EQ(omf_kbh_val_bytes(kb.kb_hdr), metrics.tot_val_bytes);
 
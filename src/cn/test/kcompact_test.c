@@ -167,7 +167,13 @@ _kvset_builder_add_key(struct kvset_builder *builder, const struct key_obj *kobj
 }
 
 static merr_t
-_kvset_builder_add_vref(struct kvset_builder *self, u64 seq, uint vbidx, uint vboff, uint vlen)
+_kvset_builder_add_vref(
+    struct kvset_builder *self,
+    u64                   seq,
+    uint                  vbidx,
+    uint                  vboff,
+    uint                  vlen,
+    uint                  complen)
 {
     VERIFY_EQ_RET(st.have.nvals, 0, __LINE__);
 
@@ -200,6 +206,7 @@ _kvset_builder_add_val(
     u64                     seq,
     const void *            vdata,
     uint                    vlen,
+    uint                    complen,
     struct c1_bonsai_vbldr *vbldr)
 {
     VERIFY_EQ_RET(st.have.nvals, 0, __LINE__);
@@ -229,7 +236,7 @@ MTF_DEFINE_UTEST_PRE(kcompact_test, keep, pre)
     for (i = 0; i < NITER; ++i)
         ASSERT_EQ(0, mock_make_vblocks(&itv[i], &rp, i));
 
-    err = kvset_keep_vblocks(&vbm, itv, NITER);
+    err = kvset_keep_vblocks(&vbm, itv, NITER, NULL);
     ASSERT_EQ(err, 0);
 
     /* verify each map is cumulative of what came before */
@@ -248,6 +255,53 @@ MTF_DEFINE_UTEST_PRE(kcompact_test, keep, pre)
 #undef NITER
 }
 
+MTF_DEFINE_UTEST_PRE(kcompact_test, keep_gcv, pre)
+{
+#define NITER 8
+    struct kvs_rparams    rp = kvs_rparams_defaults();
+    struct kvset_vblk_map vbm = { 0 };
+    bool                  gcv[NITER] = { false };
+    int                   i, j;
+    merr_t                err;
+
+    memset(itv, 0, sizeof(itv));
+
+    for (i = 0; i < NITER; ++i)
+        ASSERT_EQ(0, mock_make_vblocks(&itv[i], &rp, i + 1));
+
+    /* no victims: no gcv map */
+    err = kvset_keep_vblocks(&vbm, itv, NITER, gcv);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(NULL, vbm.vbm_gcv);
+    ASSERT_EQ(NITER * (NITER + 1) / 2, vbm.vbm_blkc);
+    free(vbm.vbm_blkv);
+
+    /* the vblocks of victims are not kept */
+    for (i = 0; i < NITER; i += 2)
+        gcv[i] = true;
+
+    err = kvset_keep_vblocks(&vbm, itv, NITER, gcv);
+    ASSERT_EQ(err, 0);
+    ASSERT_NE(NULL, vbm.vbm_gcv);
+
+    for (j = i = 0; i < NITER; ++i) {
+        ASSERT_EQ(gcv[i], vbm.vbm_gcv[i]);
+        ASSERT_EQ(vbm.vbm_map[i], j);
+        if (!gcv[i])
+            j += i + 1;
+    }
+    ASSERT_EQ(j, vbm.vbm_blkc);
+
+    free(vbm.vbm_blkv);
+    for (i = 0; i < NITER; ++i) {
+        struct mock_kv_iterator *iter = itv[i]->kvi_context;
+
+        kvset_put_ref((struct kvset *)iter->kvset);
+        kvset_iter_release(itv[i]);
+    }
+#undef NITER
+}
+
 MTF_DEFINE_UTEST_PRE(kcompact_test, four_into_one, pre)
 {
 #define NITER 4
@@ -279,7 +333,7 @@ MTF_DEFINE_UTEST_PRE(kcompact_test, four_into_one, pre)
         ASSERT_EQ(0, mock_make_kvi(&itv[i], i, &rp, &nkv));
     }
 
-    err = kvset_keep_vblocks(&vbm, itv, NITER);
+    err = kvset_keep_vblocks(&vbm, itv, NITER, NULL);
     ASSERT_EQ(0, err);
 
     st.kwant = 1;
@@ -343,7 +397,7 @@ MTF_DEFINE_UTEST_PRE(kcompact_test, all_gone, pre)
         ASSERT_EQ(0, mock_make_kvi(&itv[i], i, &rp, &nkv));
     }
 
-    err = kvset_keep_vblocks(&vbm, itv, 5);
+    err = kvset_keep_vblocks(&vbm, itv, 5, NULL);
     ASSERT_EQ(0, err);
 
     /* HSE_REVISIT: is it possible to detect a memory overwrite here? */
@@ -408,7 +462,7 @@ MTF_DEFINE_UTEST_PREPOST(kcompact_test, all_gone_mixed, mixed_pre, mixed_post)
         ASSERT_EQ(0, mock_make_kvi(&itv[i], i, &rp, &nkv));
     }
 
-    err = kvset_keep_vblocks(&vbm, itv, 5);
+    err = kvset_keep_vblocks(&vbm, itv, 5, NULL);
     ASSERT_EQ(0, err);
 
     /* HSE_REVISIT: is it possible to detect a memory overwrite here? */
@@ -470,7 +524,7 @@ MTF_DEFINE_UTEST_PREPOST(kcompact_test, four_into_one_mixed, mixed_pre, mixed_po
         ASSERT_EQ(0, mock_make_kvi(&itv[i], i, &rp, &nkv));
     }
 
-    err = kvset_keep_vblocks(&vbm, itv, NITER);
+    err = kvset_keep_vblocks(&vbm, itv, NITER, NULL);
     ASSERT_EQ(0, err);
 
     st.kwant = 1;
@@ -531,7 +585,7 @@ run_kcompact(struct mtf_test_info *lcl_ti, int expect)
         ASSERT_EQ_RET(0, mock_make_kvi(&itv[i], i, &rp, &nkv), 1);
     }
 
-    err = kvset_keep_vblocks(&vbm, itv, 5);
+    err = kvset_keep_vblocks(&vbm, itv, 5, NULL);
     ASSERT_EQ_RET(err, 0, 1);
 
     /* HSE_REVISIT: is it possible to detect a memory overwrite here? */
@@ -620,7 +674,9 @@ pre(struct mtf_test_info *info)
     mapi_inject(mapi_idx_cn_tree_get_cn, 0);
     mapi_inject(mapi_idx_kvset_builder_set_mclass_kvblk, 0);
     mapi_inject(mapi_idx_kvset_builder_set_mclass, 0);
+    mapi_inject(mapi_idx_kvset_builder_set_mclass_lvl, 0);
     mapi_inject(mapi_idx_kvset_builder_set_merge_stats, 0);
+    mapi_inject(mapi_idx_kvset_builder_set_node_level, 0);
 
     return 0;
 }
@@ -10,11 +10,15 @@
 #include <hse_util/slab.h>
 
 #include <hse_ikvdb/kvset_builder.h>
+#include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/limits.h>
+#include <hse_ikvdb/omf_kmd.h>
 #include <hse_ikvdb/cn.h>
 
 #include <hse/hse_limits.h>
 
 #include "mock_kbb_vbb.h"
+#include "../kvset_builder_internal.h"
 
 int
 init(struct mtf_test_info *mtf)
@@ -39,6 +43,10 @@ pre(struct mtf_test_info *mtf)
     mapi_inject(mapi_idx_cn_get_dataset, 0);
     mapi_inject(mapi_idx_cn_get_flags, 0);
     mapi_inject(mapi_idx_cn_get_tbkt_maint, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_vgc, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_floor, 0);
+    mapi_inject(mapi_idx_cn_get_io_sched, 0);
+    mapi_inject(mapi_idx_cn_get_cn_kvdb, 0);
 
     mock_kbb_set();
     mock_vbb_set();
@@ -115,26 +123,26 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_entry1, pre, post)
      * Four flavors for add_val
      */
     /* zlen values: vlen or both vdata and vlen set to 0 */
-    err = kvset_builder_add_val(bld, seq1, 0, 0, NULL);
+    err = kvset_builder_add_val(bld, seq1, 0, 0, 0, NULL);
     ASSERT_EQ(err, 0);
-    err = kvset_builder_add_val(bld, seq1, vdata1, 0, NULL);
+    err = kvset_builder_add_val(bld, seq1, vdata1, 0, 0, NULL);
     ASSERT_EQ(err, 0);
     /* tombstone: vlen can be zero or non-zero */
-    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_REG, 0, NULL);
+    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_REG, 0, 0, NULL);
     ASSERT_EQ(err, 0);
-    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_REG, vlen1, NULL);
+    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_REG, vlen1, 0, NULL);
     ASSERT_EQ(err, 0);
     /* pfx tombstone: vlen can be zero or non-zero */
-    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_PFX, 0, NULL);
+    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_PFX, 0, 0, NULL);
     ASSERT_EQ(err, 0);
-    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_PFX, vlen1, NULL);
+    err = kvset_builder_add_val(bld, seq1, HSE_CORE_TOMB_PFX, vlen1, 0, NULL);
     ASSERT_EQ(err, 0);
     /* real values */
-    err = kvset_builder_add_val(bld, seq1, vdata1, vlen1, NULL);
+    err = kvset_builder_add_val(bld, seq1, vdata1, vlen1, 0, NULL);
     ASSERT_EQ(err, 0);
-    err = kvset_builder_add_val(bld, seq2, vdata2, vlen2, NULL);
+    err = kvset_builder_add_val(bld, seq2, vdata2, vlen2, 0, NULL);
     ASSERT_EQ(err, 0);
-    err = kvset_builder_add_val(bld, seq2, 0, 0, NULL);
+    err = kvset_builder_add_val(bld, seq2, 0, 0, 0, NULL);
     ASSERT_EQ(err, 0);
 
     /*
@@ -153,7 +161,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_entry1, pre, post)
     /*
      * One flavor for add_vref
      */
-    err = kvset_builder_add_vref(bld, seq2, 1, 2, 3);
+    err = kvset_builder_add_vref(bld, seq2, 1, 2, 3, 0);
     ASSERT_EQ(err, 0);
 
     /*
@@ -193,7 +201,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_val_fail1, pre, post)
 
     api = mapi_idx_vbb_add_entry;
     mapi_inject(api, 1234);
-    err = kvset_builder_add_val(bld, seq, value, strlen(value), NULL);
+    err = kvset_builder_add_val(bld, seq, value, strlen(value), 0, NULL);
     ASSERT_EQ(err, 1234);
 
     mapi_inject_unset(api);
@@ -201,6 +209,93 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_val_fail1, pre, post)
     kvset_builder_destroy(bld);
 }
 
+MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_val_vcomp, pre, post)
+{
+    struct kvset_builder *bld = 0;
+
+    merr_t err;
+    u64    seq = 1;
+    char   value[4096];
+    uint   i;
+
+    mapi_inject(mapi_idx_cn_get_flags, CN_CFLAG_VCOMP_LZ4);
+
+    err = KVSET_BUILDER_CREATE();
+    ASSERT_EQ(err, 0);
+    ASSERT_TRUE(bld);
+
+    /* compressible value */
+    memset(value, 'a', sizeof(value));
+    err = kvset_builder_add_val(bld, seq, value, sizeof(value), 0, NULL);
+    ASSERT_EQ(err, 0);
+
+    /* incompressible value is stored as is */
+    for (i = 0; i < sizeof(value); i++)
+        value[i] = (i * 2654435761u) >> 13;
+    err = kvset_builder_add_val(bld, seq, value, sizeof(value), 0, NULL);
+    ASSERT_EQ(err, 0);
+
+    /* already compressed value from a compaction */
+    err = kvset_builder_add_val(bld, seq, value, sizeof(value), 100, NULL);
+    ASSERT_EQ(err, 0);
+    err = kvset_builder_add_vref(bld, seq, 1, 2, 4096, 100);
+    ASSERT_EQ(err, 0);
+
+    kvset_builder_destroy(bld);
+
+    mapi_inject(mapi_idx_cn_get_flags, 0);
+}
+
+MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_add_val_ival, pre, post)
+{
+    struct kvset_builder *bld = 0;
+    struct kvs_rparams    rp = kvs_rparams_defaults();
+    enum kmd_vtype        vtype;
+    const void *          vdata;
+    char                  value[CN_IVAL_MAX + 1];
+    size_t                off;
+    merr_t                err;
+    u64                   seq;
+    uint                  vlen;
+
+    rp.kblock_ival_max = CN_IVAL_MAX;
+    mapi_inject_ptr(mapi_idx_cn_get_rp, &rp);
+
+    err = KVSET_BUILDER_CREATE();
+    ASSERT_EQ(err, 0);
+    ASSERT_TRUE(bld);
+
+    memset(value, 'v', sizeof(value));
+
+    /* short and long immediate values, then a value too long for the kmd */
+    err = kvset_builder_add_val(bld, 3, value, 200, 0, NULL);
+    ASSERT_EQ(err, 0);
+    err = kvset_builder_add_val(bld, 2, value, CN_IVAL_MAX, 0, NULL);
+    ASSERT_EQ(err, 0);
+    err = kvset_builder_add_val(bld, 1, value, sizeof(value), 0, NULL);
+    ASSERT_EQ(err, 0);
+
+    off = 0;
+    kmd_type_seq(bld->main.kmd, &off, &vtype, &seq);
+    ASSERT_EQ(vtype_ival, vtype);
+    kmd_ival(bld->main.kmd, &off, &vdata, &vlen);
+    ASSERT_EQ(200, vlen);
+
+    kmd_type_seq(bld->main.kmd, &off, &vtype, &seq);
+    ASSERT_EQ(vtype_lival, vtype);
+    ASSERT_EQ(2, seq);
+    kmd_lival(bld->main.kmd, &off, &vdata, &vlen);
+    ASSERT_EQ(CN_IVAL_MAX, vlen);
+    ASSERT_EQ(0, memcmp(vdata, value, vlen));
+
+    kmd_type_seq(bld->main.kmd, &off, &vtype, &seq);
+    ASSERT_EQ(vtype_val, vtype);
+
+    kvset_builder_destroy(bld);
+
+    mapi_inject(mapi_idx_cn_get_rp, 0);
+}
+
 MTF_DEFINE_UTEST_PREPOST(test, t_reserve_kmd1, pre, post)
 {
     merr_t err;
@@ -218,7 +313,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_reserve_kmd1, pre, post)
 
     /* Add entries to exercise kmd growth */
     for (i = 0; i < 100; i++) {
-        err = kvset_builder_add_vref(bld, seq, vbidx, vboff, vlen);
+        err = kvset_builder_add_vref(bld, seq, vbidx, vboff, vlen, 0);
         ASSERT_EQ(err, 0);
     }
 
@@ -247,7 +342,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_reserve_kmd2, pre, post)
 
     /* Add entries to kmd, eventually we should get an ENOMEM. */
     for (i = 0; i < 100; i++) {
-        err = kvset_builder_add_vref(bld, seq, vbidx, vboff, vlen);
+        err = kvset_builder_add_vref(bld, seq, vbidx, vboff, vlen, 0);
         if (err)
             break;
     }
@@ -263,7 +358,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_reserve_kmd2, pre, post)
 
     /* Do it again with kvset_builder_add_val */
     for (i = 0; i < 100; i++) {
-        err = kvset_builder_add_val(bld, seq, "foobar", 6, NULL);
+        err = kvset_builder_add_val(bld, seq, "foobar", 6, 0, NULL);
         if (err)
             break;
     }
@@ -306,7 +401,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_builder_get_mblocks, pre, post)
     ASSERT_EQ(err, 0);
     ASSERT_TRUE(bld);
 
-    err = kvset_builder_add_val(bld, seq, "foobar", 6, NULL);
+    err = kvset_builder_add_val(bld, seq, "foobar", 6, 0, NULL);
     ASSERT_EQ(err, 0);
 
     key2kobj(&ko, "foobar", 6);
@@ -337,4 +432,26 @@ MTF_DEFINE_UTEST_PREPOST(test, t_kvset_build_destroy, pre, post)
     kvset_builder_destroy(NULL);
 }
 
+MTF_DEFINE_UTEST(test, t_kvset_mclass_lvl)
+{
+    enum mp_media_classp mc;
+    unsigned long        map = 0x6; /* levels 1 and 2 on capacity */
+
+    mc = kvset_mclass_lvl(CN_MCLASS_MAP_UNSET, 0, MP_MED_STAGING);
+    ASSERT_EQ(MP_MED_STAGING, mc);
+    mc = kvset_mclass_lvl(CN_MCLASS_MAP_UNSET, 5, MP_MED_CAPACITY);
+    ASSERT_EQ(MP_MED_CAPACITY, mc);
+
+    ASSERT_EQ(MP_MED_STAGING, kvset_mclass_lvl(map, 0, MP_MED_CAPACITY));
+    ASSERT_EQ(MP_MED_CAPACITY, kvset_mclass_lvl(map, 1, MP_MED_STAGING));
+    ASSERT_EQ(MP_MED_CAPACITY, kvset_mclass_lvl(map, 2, MP_MED_STAGING));
+    ASSERT_EQ(MP_MED_STAGING, kvset_mclass_lvl(map, 3, MP_MED_CAPACITY));
+
+    /* Levels deeper than 63 follow bit 63. */
+    map = 1ul << 63;
+    ASSERT_EQ(MP_MED_STAGING, kvset_mclass_lvl(map, 62, MP_MED_CAPACITY));
+    ASSERT_EQ(MP_MED_CAPACITY, kvset_mclass_lvl(map, 63, MP_MED_STAGING));
+    ASSERT_EQ(MP_MED_CAPACITY, kvset_mclass_lvl(map, 200, MP_MED_STAGING));
+}
+
 MTF_END_UTEST_COLLECTION(test);
@@ -247,7 +247,7 @@ t_mbs_create(struct mtf_test_info *lcl_ti, uint idc, u64 **idv_out, struct mbset
     idv = idv_alloc(idc);
     ASSERT_NE_RET(idv, NULL, -1);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_EQ_RET(err, 0, -1);
 
     *idv_out = idv;
@@ -315,7 +315,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_create_simple, pre, post)
     idv = idv_alloc(idc);
     ASSERT_NE(idv, NULL);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_EQ(err, 0);
     mbset_put_ref(mbs);
 
@@ -332,16 +332,16 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_create_invalid_params, pre, post)
     idv = idv_alloc(idc);
     ASSERT_NE(idv, NULL);
 
-    err = mbset_create(0, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(0, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_NE(err, 0);
 
-    err = mbset_create(ds, 0, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, 0, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_NE(err, 0);
 
-    err = mbset_create(ds, idc, 0, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, 0, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_NE(err, 0);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, 0);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, 0);
     ASSERT_NE(err, 0);
 
     mapi_safe_free(idv);
@@ -365,7 +365,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_create_alloc_fail, pre, post)
     num_allocs = 2;
     for (i = 0; i <= num_allocs; i++) {
         mapi_inject_once_ptr(mapi_idx_malloc, i + 1, 0);
-        err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+        err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
         if (i < num_allocs) {
             ASSERT_EQ(merr_errno(err), ENOMEM);
         } else {
@@ -439,7 +439,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_create_fail, pre, post)
              */
             mapi_inject_unset(api);
 
-            err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+            err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
             ASSERT_EQ(err, 0);
             num_allocs = mapi_calls(api);
 
@@ -459,7 +459,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_create_fail, pre, post)
                 else
                     mapi_inject_once(api, i + 1, rc);
 
-                err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+                err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
 
                 if (i < num_allocs) {
                     ASSERT_NE(err, 0);
@@ -503,7 +503,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_callback, pre, post)
         mapi_inject_unset(mapi_idx_mpool_mblock_put);
         mapi_inject_unset(mapi_idx_mpool_mblock_delete);
 
-        err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+        err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
         ASSERT_EQ(err, 0);
 
         switch (i) {
@@ -555,7 +555,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_madvise, pre, post)
     idv = idv_alloc(idc);
     ASSERT_NE(idv, NULL);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_EQ(err, 0);
 
     /* This madvise will fail, but we'll get coverage...
@@ -579,7 +579,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_mincore, pre, post)
     idv = idv_alloc(idc);
     ASSERT_NE(idv, NULL);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_EQ(err, 0);
 
     err = mbset_mincore(NULL, &rss, &vss);
@@ -623,7 +623,7 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_apply, pre, post)
     idv = idv_alloc(idc);
     ASSERT_NE(idv, NULL);
 
-    err = mbset_create(ds, idc, idv, usz, ufn, 0, MBLOCKS_MAX, &mbs);
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, 0, MBLOCKS_MAX, &mbs);
     ASSERT_EQ(err, 0);
 
     mbset_apply(NULL, t_udata_update, &argc, argv);
@@ -643,4 +643,96 @@ MTF_DEFINE_UTEST_PREPOST(test, t_mbset_apply, pre, post)
     mapi_safe_free(idv);
 }
 
+MTF_DEFINE_UTEST_PREPOST(test, t_mbset_lazy, pre, post)
+{
+    u64 *         idv;
+    uint          idc = 3;
+    struct mbset *mbs;
+    merr_t        err;
+    size_t        rss, vss;
+
+    idv = idv_alloc(idc);
+    ASSERT_NE(idv, NULL);
+
+    err = mbset_create(ds, idc, idv, usz, ufn, NULL, MBSET_FLAGS_LAZY, MBLOCKS_MAX, &mbs);
+    ASSERT_EQ(err, 0);
+
+    /* Handles and lengths are known, nothing is mapped. */
+    ASSERT_TRUE(mbset_is_lazy(mbs));
+    ASSERT_EQ(mbset_get_mbh(mbs, 1), bnum2mbh(1));
+    ASSERT_EQ(mbset_get_alen(mbs), (u64)idc * mock_alloc_cap);
+    ASSERT_EQ(mbset_get_map(mbs, 0), NULL);
+
+    err = mbset_mincore(mbs, &rss, &vss);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(vss, 0);
+
+    /* A failed mapping leaves the mbset lazy. */
+    mapi_inject_once_ptr(mapi_idx_malloc, 1, 0);
+    err = mbset_materialize(mbs);
+    mapi_inject_unset(mapi_idx_malloc);
+    ASSERT_NE(err, 0);
+    ASSERT_TRUE(mbset_is_lazy(mbs));
+
+    err = mbset_materialize(mbs);
+    ASSERT_EQ(err, 0);
+    ASSERT_FALSE(mbset_is_lazy(mbs));
+
+    err = mbset_materialize(mbs);
+    ASSERT_EQ(err, 0);
+
+    err = t_mbs_verify(lcl_ti, idc, idv, mbs);
+    ASSERT_EQ(err, 0);
+
+    mbset_put_ref(mbs);
+
+    mapi_safe_free(idv);
+}
+
+static uint fini_calls;
+
+static void
+t_udata_fini(void *rock)
+{
+    fini_calls++;
+}
+
+MTF_DEFINE_UTEST_PREPOST(test, t_mbset_udata_fini, pre, post)
+{
+    u64 *         idv;
+    uint          idc = 3;
+    struct mbset *mbs;
+    merr_t        err;
+
+    idv = idv_alloc(idc);
+    ASSERT_NE(idv, NULL);
+
+    fini_calls = 0;
+    err = mbset_create(ds, idc, idv, usz, ufn, t_udata_fini, 0, MBLOCKS_MAX, &mbs);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(fini_calls, 0);
+
+    mbset_put_ref(mbs);
+    ASSERT_EQ(fini_calls, idc);
+
+    /* A lazy mbset destroys its udata whether or not it was mapped, and
+     * again after a failed mapping so that a retry starts afresh.
+     */
+    fini_calls = 0;
+    err = mbset_create(
+        ds, idc, idv, usz, ufn, t_udata_fini, MBSET_FLAGS_LAZY, MBLOCKS_MAX, &mbs);
+    ASSERT_EQ(err, 0);
+
+    mapi_inject_once_ptr(mapi_idx_malloc, 1, 0);
+    err = mbset_materialize(mbs);
+    mapi_inject_unset(mapi_idx_malloc);
+    ASSERT_NE(err, 0);
+    ASSERT_EQ(fini_calls, idc);
+
+    mbset_put_ref(mbs);
+    ASSERT_EQ(fini_calls, 2 * idc);
+
+    mapi_safe_free(idv);
+}
+
 MTF_END_UTEST_COLLECTION(test);
@@ -0,0 +1,825 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/*
+ * Merge throughput benchmark.
+ *
+ * Where merge_test checks the output of spill and k-compaction against
+ * the YAML test cases, this program measures how fast they get there.
+ * It synthesizes a set of input kvsets in memory, feeds them to cn_spill()
+ * and cn_kcompact() through the same kvset iterator and kvset builder mocks
+ * that merge_test uses, and reports keys/s and bytes/s for each merge.
+ * The mocks do no I/O, so the numbers isolate the merge loop (bin heap,
+ * duplicate and tombstone resolution) from the media.
+ *
+ * The defaults are small such that ctest runs quickly.  For meaningful
+ * numbers use a release build and something like:
+ *
+ *   merge_perf -s 16 -k 1000000 -d 50 -c 4 -t 20 -p 1 -i 5
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_test_support/mock_api.h>
+#include <hse_test_support/mwc_rand.h>
+#include "mock_kvset_builder.h"
+
+#include <hse_util/byteorder.h>
+#include <hse_util/key_util.h>
+#include <hse_util/logging.h>
+#include <hse_util/timing.h>
+
+#include <hse/hse_limits.h>
+
+#include <hse_ikvdb/kvs_rparams.h>
+#include <hse_ikvdb/kvs_cparams.h>
+#include <hse_ikvdb/kvset_builder.h>
+#include <hse_ikvdb/limits.h>
+#include <hse_ikvdb/cn.h>
+
+#include "../cn_tree.h"
+#include "../cn_tree_compact.h"
+#include "../spill.h"
+#include "../kcompact.h"
+#include "../cn_metrics.h"
+#include "../kv_iterator.h"
+#include "../kvset.h"
+
+#include <getopt.h>
+
+/* Keys are a 4-byte big-endian prefix followed by an 8-byte big-endian
+ * suffix, such that the byte order of the keys is their numeric order.
+ * A ptomb is the bare prefix, which sorts ahead of all keys it covers.
+ */
+#define MP_PFX_LEN 4
+#define MP_KLEN (MP_PFX_LEN + 8)
+#define MP_CHAIN_MAX 64
+#define MP_VLEN_MAX (64 * 1024)
+
+struct mp_ent {
+    u8  key[MP_KLEN];
+    u8  klen;
+    u8  nvals;
+    u8  ptomb;
+    u64 seq;   /* seqno of the newest value */
+    u64 tombs; /* bit i set if value i is a tombstone */
+};
+
+struct mp_src {
+    struct mp_ent *entv;
+    u64            entc;
+};
+
+static struct mp_params {
+    /* Set from the command line */
+    uint srcc;
+    u64  keys;
+    uint dup_pct;
+    uint chain;
+    uint tomb_pct;
+    uint ptomb_pct;
+    uint pfxc;
+    uint vlen;
+    uint fanout;
+    uint horizon_pct;
+    bool drop_tombs;
+    uint iters;
+    bool spill;
+    bool kcompact;
+    u32  seed;
+
+    /* Derived from the above */
+    struct mp_src *srcv;
+    u8 *           vbuf;
+    u64            horizon;
+    u64            keys_in;
+    u64            ptombs_in;
+    u64            vals_in;
+    u64            bytes_in;
+} mp;
+
+static struct mp_out {
+    u64 keys;
+    u64 vals;
+    u64 tombs;
+    u64 bytes;
+} out;
+
+static void
+mp_key_fill(struct mp_ent *ent, u32 pfx, u64 sfx, bool ptomb)
+{
+    *(u32 *)ent->key = cpu_to_be32(pfx);
+    *(u64 *)(ent->key + MP_PFX_LEN) = cpu_to_be64(sfx);
+    ent->klen = ptomb ? MP_PFX_LEN : MP_KLEN;
+    ent->ptomb = ptomb;
+}
+
+/* Source 0 is the newest kvset, hence each source gets its own range of
+ * seqnos above those of all older sources.  A key's values are newest
+ * first, and a prefix's ptomb is newer than every key of the source.
+ */
+static merr_t
+mp_src_create(struct mp_src *src, uint srcidx, u64 keyspace, struct mwc_rand *mwc)
+{
+    u64 rsvd = mp.keys * mp.chain + mp.pfxc;
+    u64 base = (mp.srcc - 1 - srcidx) * rsvd + 1;
+    u64 per_pfx = (keyspace + mp.pfxc - 1) / mp.pfxc;
+    u64 need = mp.keys, left = keyspace;
+    u64 id, seq = base;
+    u32 pfx = U32_MAX;
+    uint i;
+
+    src->entv = malloc((mp.keys + mp.pfxc) * sizeof(*src->entv));
+    if (!src->entv)
+        return merr(ENOMEM);
+    src->entc = 0;
+
+    /* Selection sampling yields mp.keys distinct ids in ascending order.
+     */
+    for (id = 0; id < keyspace && need > 0; ++id, --left) {
+        struct mp_ent *ent;
+
+        if (mwc_rand_range64(mwc, 0, left) >= need)
+            continue;
+
+        --need;
+
+        if (id / per_pfx != pfx) {
+            pfx = id / per_pfx;
+
+            if (mwc_rand_range32(mwc, 0, 100) < mp.ptomb_pct) {
+                ent = src->entv + src->entc++;
+                mp_key_fill(ent, pfx, 0, true);
+                ent->nvals = 1;
+                ent->seq = base + mp.keys * mp.chain + pfx;
+                ent->tombs = 1;
+
+                mp.ptombs_in++;
+                mp.bytes_in += ent->klen;
+            }
+        }
+
+        ent = src->entv + src->entc++;
+        mp_key_fill(ent, pfx, id, false);
+        ent->nvals = mp.chain;
+        ent->tombs = 0;
+
+        for (i = 0; i < mp.chain; ++i) {
+            if (mwc_rand_range32(mwc, 0, 100) < mp.tomb_pct)
+                ent->tombs |= 1ull << i;
+            else
+                mp.bytes_in += mp.vlen;
+        }
+
+        seq += mp.chain;
+        ent->seq = seq - 1;
+
+        mp.keys_in++;
+        mp.vals_in += mp.chain;
+        mp.bytes_in += ent->klen;
+    }
+
+    return 0;
+}
+
+static merr_t
+mp_generate(void)
+{
+    struct mwc_rand mwc;
+    u64             keyspace;
+    merr_t          err;
+    uint            i;
+
+    /* dup_pct == 0 spreads the sources over a keyspace large enough
+     * that they rarely overlap, dup_pct == 100 makes every source
+     * hold every key.
+     */
+    keyspace = mp.keys * mp.srcc * (100 - mp.dup_pct) / 100;
+    keyspace = max_t(u64, keyspace, mp.keys);
+
+    mwc_rand_init(&mwc, mp.seed);
+
+    mp.srcv = calloc(mp.srcc, sizeof(*mp.srcv));
+    mp.vbuf = malloc(mp.vlen ?: 1);
+    if (!mp.srcv || !mp.vbuf)
+        return merr(ENOMEM);
+
+    for (i = 0; i < mp.vlen; ++i)
+        mp.vbuf[i] = mwc_rand8(&mwc);
+
+    for (i = 0; i < mp.srcc; ++i) {
+        err = mp_src_create(mp.srcv + i, i, keyspace, &mwc);
+        if (err)
+            return err;
+    }
+
+    mp.horizon = (mp.keys * mp.chain + mp.pfxc) * mp.srcc * mp.horizon_pct / 100;
+
+    return 0;
+}
+
+static void
+mp_release(void)
+{
+    uint i;
+
+    for (i = 0; mp.srcv && i < mp.srcc; ++i)
+        free(mp.srcv[i].entv);
+    free(mp.srcv);
+    free(mp.vbuf);
+}
+
+/*----------------------------------------------------------------
+ * Iterator
+ */
+struct mp_kvi {
+    struct kv_iterator kvi;
+    struct mp_src *    src;
+    uint               srcidx;
+    u64                cursor;
+};
+
+static merr_t
+_kvset_iter_next_key(struct kv_iterator *kvi, struct key_obj *kobj, struct kvset_iter_vctx *vc)
+{
+    struct mp_kvi *iter = kvi->kvi_context;
+    struct mp_ent *ent;
+
+    if (iter->cursor >= iter->src->entc) {
+        kvi->kvi_eof = true;
+        return 0;
+    }
+
+    ent = iter->src->entv + iter->cursor++;
+
+    kobj->ko_pfx = NULL;
+    kobj->ko_pfx_len = 0;
+    kobj->ko_sfx = ent->key;
+    kobj->ko_sfx_len = ent->klen;
+
+    vc->kmd = ent;
+    vc->off = iter->cursor - 1;
+    vc->nvals = ent->nvals;
+    vc->next = 0;
+    vc->is_ptomb = ent->ptomb;
+
+    return 0;
+}
+
+static merr_t
+_kvset_iter_seek(struct kv_iterator *kvi, const void *key, int len, bool *eof)
+{
+    struct mp_kvi *iter = kvi->kvi_context;
+    struct mp_ent *ent;
+
+    for (; iter->cursor < iter->src->entc; ++iter->cursor) {
+        ent = iter->src->entv + iter->cursor;
+        if (keycmp(ent->key, ent->klen, key, len) >= 0)
+            break;
+    }
+
+    kvi->kvi_eof = iter->cursor >= iter->src->entc;
+    *eof = kvi->kvi_eof;
+
+    return 0;
+}
+
+static void
+_kvset_iter_mark_eof(struct kv_iterator *kvi)
+{
+    kvi->kvi_eof = true;
+}
+
+static bool
+_kvset_iter_next_vref(
+    struct kv_iterator *    kvi,
+    struct kvset_iter_vctx *vc,
+    u64 *                   seq,
+    enum kmd_vtype *        vtype,
+    uint *                  vbidx,
+    uint *                  vboff,
+    const void **           vdata,
+    uint *                  vlen,
+    uint *                  complen)
+{
+    struct mp_kvi *      iter = kvi->kvi_context;
+    const struct mp_ent *ent = vc->kmd;
+
+    if (vc->next >= vc->nvals)
+        return false;
+
+    *seq = ent->seq - vc->next;
+    *complen = 0;
+    *vdata = NULL;
+    *vlen = 0;
+
+    if (ent->ptomb)
+        *vtype = vtype_ptomb;
+    else if (ent->tombs & (1ull << vc->next))
+        *vtype = vtype_tomb;
+    else if (mp.vlen == 0)
+        *vtype = vtype_zval;
+    else if (mp.vlen < CN_SMALL_VALUE_THRESHOLD)
+        *vtype = vtype_ival;
+    else
+        *vtype = vtype_val;
+
+    if (*vtype == vtype_val) {
+        *vbidx = iter->srcidx;
+        *vboff = vc->off;
+        *vlen = mp.vlen;
+    } else if (*vtype == vtype_ival) {
+        *vdata = mp.vbuf;
+        *vlen = mp.vlen;
+    }
+
+    ++vc->next;
+    return true;
+}
+
+static merr_t
+_kvset_iter_next_val(
+    struct kv_iterator *    kvi,
+    struct kvset_iter_vctx *vc,
+    enum kmd_vtype          vtype,
+    uint                    vbidx,
+    uint                    vboff,
+    const void **           vdata,
+    uint *                  vlen,
+    uint                    complen)
+{
+    switch (vtype) {
+        case vtype_val:
+        case vtype_ival:
+            *vdata = mp.vbuf;
+            *vlen = mp.vlen;
+            return 0;
+        case vtype_zval:
+            *vdata = NULL;
+            *vlen = 0;
+            return 0;
+        case vtype_tomb:
+            *vdata = HSE_CORE_TOMB_REG;
+            *vlen = 0;
+            return 0;
+        case vtype_ptomb:
+            *vdata = HSE_CORE_TOMB_PFX;
+            *vlen = 0;
+            return 0;
+        default:
+            break;
+    }
+
+    return merr(EBUG);
+}
+
+static void
+mp_kvi_release(struct kv_iterator *kvi)
+{
+    free(kvi->kvi_context);
+}
+
+static struct kv_iterator_ops mp_kvi_ops = {.kvi_release = mp_kvi_release };
+
+static merr_t
+mp_kvi_create(struct kv_iterator **kvi_out, uint srcidx)
+{
+    struct mp_kvi *iter;
+
+    iter = calloc(1, sizeof(*iter));
+    if (!iter)
+        return merr(ENOMEM);
+
+    iter->src = mp.srcv + srcidx;
+    iter->srcidx = srcidx;
+
+    iter->kvi.kvi_context = iter;
+    iter->kvi.kvi_ops = &mp_kvi_ops;
+
+    *kvi_out = &iter->kvi;
+
+    return 0;
+}
+
+/*----------------------------------------------------------------
+ * Builder: count what the merge emits, keep nothing.
+ */
+static merr_t
+_kvset_builder_add_key(struct kvset_builder *builder, const struct key_obj *kobj)
+{
+    out.keys++;
+    out.bytes += key_obj_len(kobj);
+    return 0;
+}
+
+static merr_t
+_kvset_builder_add_val(
+    struct kvset_builder *  self,
+    u64                     seq,
+    const void *            vdata,
+    uint                    vlen,
+    uint                    complen,
+    struct c1_bonsai_vbldr *vbldr)
+{
+    if (vdata == HSE_CORE_TOMB_REG || vdata == HSE_CORE_TOMB_PFX) {
+        out.tombs++;
+        return 0;
+    }
+
+    out.vals++;
+    out.bytes += complen ?: vlen;
+    return 0;
+}
+
+static merr_t
+_kvset_builder_add_nonval(struct kvset_builder *self, u64 seq, enum kmd_vtype vtype)
+{
+    if (vtype == vtype_zval)
+        out.vals++;
+    else
+        out.tombs++;
+    return 0;
+}
+
+static merr_t
+_kvset_builder_add_vref(
+    struct kvset_builder *self,
+    u64                   seq,
+    uint                  vbidx,
+    uint                  vboff,
+    uint                  vlen,
+    uint                  complen)
+{
+    out.vals++;
+    out.bytes += complen ?: vlen;
+    return 0;
+}
+
+/*----------------------------------------------------------------
+ * Benchmark
+ */
+#define MODE_SPILL 0
+#define MODE_KCOMPACT 1
+
+static merr_t
+mp_merge(int mode, u64 *nsecs)
+{
+    struct kv_iterator **     iterv;
+    struct cn_compaction_work w;
+    struct kvset_mblocks      outputs[mp.fanout];
+    bool                      drop_tombs[mp.fanout];
+    struct kvs_rparams        rp = kvs_rparams_defaults();
+    struct kvs_cparams        cp = {
+        .cp_fanout = mp.fanout, .cp_pfx_len = MP_PFX_LEN,
+    };
+    struct kvset_vblk_map vbm;
+    atomic_t              cancel;
+    merr_t                err;
+    uint                  i;
+    u64                   start;
+
+    memset(&vbm, 0, sizeof(vbm));
+
+    iterv = calloc(mp.srcc, sizeof(*iterv));
+    if (!iterv)
+        return merr(ENOMEM);
+
+    for (i = 0; i < mp.srcc; i++) {
+        err = mp_kvi_create(&iterv[i], i);
+        if (err)
+            goto out;
+    }
+
+    memset(outputs, 0, sizeof(outputs));
+    for (i = 0; i < mp.fanout; i++)
+        drop_tombs[i] = mp.drop_tombs;
+
+    atomic_set(&cancel, 0);
+
+    memset(&w, 0, sizeof(w));
+    w.cw_rp = &rp;
+    w.cw_cp = &cp;
+    w.cw_pfx_len = MP_PFX_LEN;
+    w.cw_horizon = mp.horizon;
+    w.cw_kvset_cnt = mp.srcc;
+    w.cw_inputv = iterv;
+    w.cw_cancel_request = &cancel;
+    w.cw_drop_tombv = drop_tombs;
+    w.cw_outv = outputs;
+
+    memset(&out, 0, sizeof(out));
+
+    if (mode == MODE_SPILL) {
+        w.cw_outc = mp.fanout;
+
+        start = get_time_ns();
+        err = cn_spill(&w);
+        *nsecs = get_time_ns() - start;
+    } else {
+        vbm.vbm_blkv = calloc(mp.srcc, sizeof(*vbm.vbm_blkv));
+        vbm.vbm_map = calloc(mp.srcc, sizeof(*vbm.vbm_map));
+        if (!vbm.vbm_blkv || !vbm.vbm_map) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+
+        /* The iterators report each source's vblock index as the source
+         * index, hence the map offsets are all zero.
+         */
+        for (i = 0; i < mp.srcc; i++)
+            vbm.vbm_blkv[i].bk_blkid = 1000 + i;
+
+        vbm.vbm_blkc = mp.srcc;
+        vbm.vbm_mapc = mp.srcc;
+
+        w.cw_outc = 1;
+        w.cw_vbmap = vbm;
+
+        start = get_time_ns();
+        err = cn_kcompact(&w);
+        *nsecs = get_time_ns() - start;
+    }
+
+out:
+    free(vbm.vbm_blkv);
+    free(vbm.vbm_map);
+
+    for (i = 0; i < mp.srcc; i++)
+        if (iterv[i])
+            kv_iterator_release(&iterv[i]);
+    free(iterv);
+
+    return err;
+}
+
+static void
+mp_report(const char *name, u64 best, u64 total)
+{
+    static bool header;
+
+    double M = 1024 * 1024;
+    double keys = mp.keys_in + mp.ptombs_in;
+    double secs_best = best * 1e-9;
+    double secs_avg = total * 1e-9 / mp.iters;
+
+    if (!header) {
+        header = true;
+
+        printf(
+            "\n# Merge performance (keys and bytes scaled by 1024*1024)\n"
+            "# srcs %u keys %lu dup %u%% chain %u tomb %u%% ptomb %u%% "
+            "pfxs %u vlen %u fanout %u horizon %u%% drop %d seed %u\n",
+            mp.srcc,
+            (ulong)mp.keys,
+            mp.dup_pct,
+            mp.chain,
+            mp.tomb_pct,
+            mp.ptomb_pct,
+            mp.pfxc,
+            mp.vlen,
+            mp.fanout,
+            mp.horizon_pct,
+            mp.drop_tombs,
+            mp.seed);
+
+        printf(
+            "%-8s  %8s  %8s  %8s  %8s  %8s  %8s  %8s  %8s\n",
+            "Test",
+            "KeysIn",
+            "KeysOut",
+            "BytesIn",
+            "BytesOut",
+            "Best",
+            "Avg",
+            "keys/s",
+            "bytes/s");
+        printf(
+            "%.8s  %.8s  %.8s  %.8s  %.8s  %.8s  %.8s  %.8s  %.8s\n",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------",
+            "-----------------");
+    }
+
+    /* Throughput is measured against the input, the amount of work the
+     * merge had to get through, using the best of the iterations.
+     */
+    printf(
+        "%-8s  %8.3f  %8.3f  %8.1f  %8.1f  %8.3f  %8.3f  %8.3f  %8.1f\n",
+        name,
+        keys / M,
+        out.keys / M,
+        mp.bytes_in / M,
+        out.bytes / M,
+        secs_best,
+        secs_avg,
+        keys / M / secs_best,
+        mp.bytes_in / M / secs_best);
+}
+
+static void
+mp_run(struct mtf_test_info *lcl_ti, int mode, const char *name)
+{
+    u64    nsecs, best = U64_MAX, total = 0;
+    merr_t err;
+    uint   i;
+
+    for (i = 0; i < mp.iters; i++) {
+        err = mp_merge(mode, &nsecs);
+        ASSERT_EQ(0, err);
+
+        /* Every output key came from an input. */
+        ASSERT_LE(out.keys, (mp.keys_in + mp.ptombs_in) * (mode == MODE_SPILL ? mp.fanout : 1));
+
+        best = min_t(u64, best, nsecs ?: 1);
+        total += nsecs;
+    }
+
+    mp_report(name, best, total);
+}
+
+#define HELP                                                            \
+    "Usage: merge_perf [ options ]\n"                                   \
+    "\n"                                                                \
+    "This utility measures spill and k-compaction throughput on\n"      \
+    "synthetic input kvsets.\n"                                         \
+    "\n"                                                                \
+    "Options:\n"                                                        \
+    "  -H        // show help\n"                                        \
+    "  -s srcs   // number of input kvsets (default: 8)\n"              \
+    "  -k keys   // keys per input kvset (default: 10000)\n"            \
+    "  -d pct    // keyspace overlap of the inputs (default: 50)\n"     \
+    "  -c vals   // values per key in each input (default: 2)\n"        \
+    "  -t pct    // percent of values that are tombs (default: 10)\n"   \
+    "  -p pct    // percent of prefixes with a ptomb (default: 5)\n"    \
+    "  -P pfxs   // number of distinct prefixes (default: 64)\n"        \
+    "  -l vlen   // value length (default: 100)\n"                      \
+    "  -f fanout // spill fanout (default: 4)\n"                        \
+    "  -z pct    // horizon as percent of max seqno (default: 100)\n"   \
+    "  -D        // drop tombstones\n"                                  \
+    "  -i iters  // iterations per merge (default: 3)\n"                \
+    "  -m mode   // spill, kcompact or all (default: all)\n"            \
+    "  -S seed   // random seed (default: 1)\n"
+
+static void
+help(FILE *fp, int code)
+{
+    fprintf(fp, "%s", HELP);
+    exit(code);
+}
+
+int
+test_collection_setup(struct mtf_test_info *info)
+{
+    int    argc = info->ti_coll->tci_argc;
+    char **argv = info->ti_coll->tci_argv;
+    int    opt;
+
+    hse_openlog("merge_perf", true);
+
+    mp.srcc = 8;
+    mp.keys = 10000;
+    mp.dup_pct = 50;
+    mp.chain = 2;
+    mp.tomb_pct = 10;
+    mp.ptomb_pct = 5;
+    mp.pfxc = 64;
+    mp.vlen = 100;
+    mp.fanout = 4;
+    mp.horizon_pct = 100;
+    mp.iters = 3;
+    mp.spill = mp.kcompact = true;
+    mp.seed = 1;
+
+    while ((opt = getopt(argc, argv, "Hs:k:d:c:t:p:P:l:f:z:Di:m:S:")) != -1) {
+        switch (opt) {
+            case 'H':
+                help(stdout, 0);
+                break;
+            case 's':
+                mp.srcc = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                mp.keys = strtoull(optarg, NULL, 0);
+                break;
+            case 'd':
+                mp.dup_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                mp.chain = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                mp.tomb_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                mp.ptomb_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                mp.pfxc = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                mp.vlen = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                mp.fanout = strtoul(optarg, NULL, 0);
+                break;
+            case 'z':
+                mp.horizon_pct = strtoul(optarg, NULL, 0);
+                break;
+            case 'D':
+                mp.drop_tombs = true;
+                break;
+            case 'i':
+                mp.iters = strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                mp.spill = !strcmp(optarg, "spill") || !strcmp(optarg, "all");
+                mp.kcompact = !strcmp(optarg, "kcompact") || !strcmp(optarg, "all");
+                if (!mp.spill && !mp.kcompact)
+                    help(stderr, 1);
+                break;
+            case 'S':
+                mp.seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                help(stderr, 1);
+                break;
+        }
+    }
+
+    if (mp.srcc < 1 || mp.keys < 1 || mp.iters < 1 || mp.pfxc < 1)
+        help(stderr, 1);
+
+    if (mp.chain < 1 || mp.chain > MP_CHAIN_MAX || mp.dup_pct > 100 || mp.tomb_pct > 100 ||
+        mp.ptomb_pct > 100 || mp.horizon_pct > 100 || mp.vlen > MP_VLEN_MAX)
+        help(stderr, 1);
+
+    if (mp.fanout < CN_FANOUT_MIN || mp.fanout > CN_FANOUT_MAX)
+        help(stderr, 1);
+
+    if (mp_generate()) {
+        fprintf(stderr, "cannot allocate input kvsets\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+test_collection_teardown(struct mtf_test_info *info)
+{
+    mp_release();
+
+#ifndef NDEBUG
+    printf("\nNote: this is a debug build. "
+           "Use a release build for better performance.\n\n");
+#endif
+    return 0;
+}
+
+int
+test_prehook(struct mtf_test_info *info)
+{
+    mock_kvset_builder_set();
+
+    MOCK_SET(kvset_builder, _kvset_builder_add_key);
+    MOCK_SET(kvset_builder, _kvset_builder_add_val);
+    MOCK_SET(kvset_builder, _kvset_builder_add_nonval);
+    MOCK_SET(kvset_builder, _kvset_builder_add_vref);
+
+    MOCK_SET(kvset, _kvset_iter_next_key);
+    MOCK_SET(kvset, _kvset_iter_next_val);
+    MOCK_SET(kvset, _kvset_iter_next_vref);
+    MOCK_SET(kvset, _kvset_iter_seek);
+    MOCK_SET(kvset, _kvset_iter_mark_eof);
+
+    /* Neuter the following APIs */
+    mapi_inject_ptr(mapi_idx_cn_tree_get_khashmap, NULL);
+    mapi_inject_ptr(mapi_idx_cn_tree_get_cn, NULL);
+    mapi_inject(mapi_idx_kvset_builder_set_merge_stats, 0);
+    mapi_inject(mapi_idx_kvset_builder_set_node_level, 0);
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION_PREPOST(merge_perf, test_collection_setup, test_collection_teardown);
+
+MTF_DEFINE_UTEST_PRE(merge_perf, spill_perf, test_prehook)
+{
+    if (mp.spill)
+        mp_run(lcl_ti, MODE_SPILL, "spill");
+}
+
+MTF_DEFINE_UTEST_PRE(merge_perf, kcompact_perf, test_prehook)
+{
+    if (mp.kcompact)
+        mp_run(lcl_ti, MODE_KCOMPACT, "kcompact");
+}
+
+MTF_END_UTEST_COLLECTION(merge_perf)
@@ -71,6 +71,7 @@ static struct test_params {
     int             test_number;
     u64             horizon;
     bool            drop_tombs;
+    bool            cfilter;
     int             fanout;
 
     /* Initialized with each mode (spill, kcompact, etc) */
@@ -485,6 +486,7 @@ process_yaml(void)
 
     tp.horizon = 0;
     tp.drop_tombs = 0;
+    tp.cfilter = false;
     tp.pfx_len = -1;
     tp.fanout = 4;
 
@@ -494,6 +496,9 @@ process_yaml(void)
     node2 = ydoc_map_lookup(doc, node, "drop_tombs");
     if (node2)
         tp.drop_tombs = ydoc_node_as_bool(doc, node2);
+    node2 = ydoc_map_lookup(doc, node, "cfilter");
+    if (node2)
+        tp.cfilter = ydoc_node_as_bool(doc, node2);
     node2 = ydoc_map_lookup(doc, node, "pfx_len");
     if (node2)
         tp.pfx_len = ydoc_node_as_int(doc, node2);
@@ -778,7 +783,8 @@ _kvset_builder_add_vref(
     u64                   seq,
     uint                  vbidx_kvset_node,
     uint                  vboff_nth_key,
-    uint                  vlen_nth_val)
+    uint                  vlen_nth_val,
+    uint                  complen)
 {
     u64            tmp_seq;
     enum kmd_vtype vtype;
@@ -812,6 +818,7 @@ _kvset_builder_add_val(
     u64                     seq,
     const void *            vdata,
     uint                    vlen,
+    uint                    complen,
     struct c1_bonsai_vbldr *vbldr)
 {
     enum kmd_vtype vtype;
@@ -892,6 +899,35 @@ _kvset_iter_next_key(struct kv_iterator *kvi, struct key_obj *kobj, struct kvset
     return 0;
 }
 
+/* Position the iterator at the first key not less than the given key.
+ */
+static merr_t
+_kvset_iter_seek(struct kv_iterator *kvi, const void *key, int len, bool *eof)
+{
+    struct kv_spill_test_kvi *iter = (struct kv_spill_test_kvi *)kvi->kvi_context;
+    const void *              kdata;
+    void *                    vdata;
+    uint                      klen, vlen;
+
+    for (;; ++iter->cursor) {
+        kvset_get_nth(iter->kvset_node, iter->cursor, &kvi->kvi_eof, &kdata, &klen, &vdata, &vlen);
+        if (kvi->kvi_eof || keycmp(kdata, klen, key, len) >= 0)
+            break;
+    }
+
+    if (tp.verbose >= VERBOSE_PER_KEY2)
+        printf("iter_seek src %d ent %d eof %d\n", iter->src, iter->cursor, kvi->kvi_eof);
+
+    *eof = kvi->kvi_eof;
+    return 0;
+}
+
+static void
+_kvset_iter_mark_eof(struct kv_iterator *kvi)
+{
+    kvi->kvi_eof = true;
+}
+
 static bool
 _kvset_iter_next_vref(
     struct kv_iterator *    kvi,
@@ -901,7 +937,8 @@ _kvset_iter_next_vref(
     uint *                  vbidx,
     uint *                  vboff,
     const void **           vdata,
-    uint *                  vblen)
+    uint *                  vblen,
+    uint *                  complen)
 {
     /* Unpack data from kvset_iter_vctx:
      *   vc->kmd   == kvset node
@@ -924,6 +961,8 @@ _kvset_iter_next_vref(
     if (eof)
         return false;
 
+    *complen = 0;
+
     if (*vtype == vtype_val) {
         /* Pack data into vref:
          *   vbidx == kvset node
@@ -953,7 +992,8 @@ _kvset_iter_next_val(
     uint                    vbidx,
     uint                    vboff,
     const void **           vdata_out,
-    uint *                  vlen_out)
+    uint *                  vlen_out,
+    uint                    complen)
 {
     /*
      * Unpack data from kvset_iter_vctx:
@@ -1005,6 +1045,12 @@ _kvset_iter_next_val(
             *vdata_out = HSE_CORE_TOMB_PFX;
             *vlen_out = 0;
             return 0;
+        case vtype_cval:
+            /* The test kvsets hold no compressed values. */
+            break;
+        case vtype_lival:
+            /* Reported as vtype_ival by _kvset_iter_next_vref(). */
+            break;
     }
 
     my_assert(false);
@@ -1055,6 +1101,37 @@ kv_spill_test_kvi_create(
 #define MODE_KCOMPACT 1
 #define MODE_KHASHMAP 2
 #define MODE_KHASHMAP_ERR 3
+#define MODE_KVCOMPACT 4
+
+/* The compaction filter of the test cases with "cfilter: true" acts on
+ * the first letter of a value: 'd' drops the key, 'r' replaces the value
+ * with a copy that starts with 'R', anything else keeps it.
+ */
+static int
+merge_test_cfilter(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    const char *v = val;
+
+    if (vlen > 0 && v[0] == 'd')
+        return KVS_CFILTER_DROP;
+
+    if (vlen > 0 && v[0] == 'r' && vlen <= rmax) {
+        memcpy(result, val, vlen);
+        *(char *)result = 'R';
+        *rlen = vlen;
+        return KVS_CFILTER_REPLACE;
+    }
+
+    return KVS_CFILTER_KEEP;
+}
 
 static struct cn_compaction_work *
 init_work(
@@ -1090,6 +1167,7 @@ init_work(
     w->cw_outc = num_outputs;
     w->cw_drop_tombv = drop_tomb;
     w->cw_outv = outputs;
+    w->cw_cfilter = tp.cfilter ? merge_test_cfilter : NULL;
 
     if (vbm)
         w->cw_vbmap = *vbm;
@@ -1190,12 +1268,14 @@ run_testcase(struct mtf_test_info *lcl_ti, int mode, const char *info)
     tp.fanout = tp.fanout;
     tp.pt_spread = false;
 
-    if (mode == MODE_SPILL) {
+    if (mode == MODE_SPILL || mode == MODE_KVCOMPACT) {
+        uint outc = mode == MODE_KVCOMPACT ? 1 : tp.fanout;
+
         struct kvs_cparams cp = {
-            .cp_fanout = tp.fanout, .cp_pfx_len = tp.pfx_len,
+            .cp_fanout = outc, .cp_pfx_len = tp.pfx_len,
         };
 
-        if (tp.pfx_len == 0)
+        if (tp.pfx_len == 0 && outc > 1)
             tp.pt_spread = true;
 
         init_work(
@@ -1210,7 +1290,7 @@ run_testcase(struct mtf_test_info *lcl_ti, int mode, const char *info)
             pfx_len,
             0,
             &cancel,
-            tp.fanout,
+            outc,
             drop_tombs,
             outputs,
             0);
@@ -1219,6 +1299,9 @@ run_testcase(struct mtf_test_info *lcl_ti, int mode, const char *info)
 
         err = cn_spill(&w);
         ASSERT_EQ(err, 0);
+
+        /* Every cfilter test case has values to drop or replace. */
+        ASSERT_EQ(tp.cfilter, w.cw_cfiltered);
     } else if (mode == MODE_KHASHMAP) {
         struct cn_tstate_impl impl;
         struct cn_tstate_omf *omf;
@@ -1371,6 +1454,7 @@ run_testcase(struct mtf_test_info *lcl_ti, int mode, const char *info)
 
         err = cn_kcompact(&w);
         ASSERT_EQ(err, 0);
+        ASSERT_EQ(tp.cfilter, w.cw_cfiltered);
 
         mapi_safe_free(vbm.vbm_blkv);
         mapi_safe_free(blkv);
@@ -1433,6 +1517,9 @@ run_all_tcases(struct mtf_test_info *lcl_ti)
         tp.pfx_len = tp.pfx_len >= 0 ? tp.pfx_len : 0;
         run_testcase(lcl_ti, MODE_KCOMPACT, "kcompact");
 
+        tp.pfx_len = tp.pfx_len >= 0 ? tp.pfx_len : 0;
+        run_testcase(lcl_ti, MODE_KVCOMPACT, "kvcompact");
+
         tp.pfx_len = tp.pfx_len >= 0 ? tp.pfx_len : 3;
         run_testcase(lcl_ti, MODE_SPILL, "spill with prefix");
 
@@ -1526,11 +1613,14 @@ test_prehook(struct mtf_test_info *info)
     MOCK_SET(kvset, _kvset_iter_next_key);
     MOCK_SET(kvset, _kvset_iter_next_val);
     MOCK_SET(kvset, _kvset_iter_next_vref);
+    MOCK_SET(kvset, _kvset_iter_seek);
+    MOCK_SET(kvset, _kvset_iter_mark_eof);
 
     /* Neuter the following APIs */
     mapi_inject_ptr(mapi_idx_cn_tree_get_khashmap, NULL);
     mapi_inject_ptr(mapi_idx_cn_tree_get_cn, NULL);
     mapi_inject(mapi_idx_kvset_builder_set_merge_stats, 0);
+    mapi_inject(mapi_idx_kvset_builder_set_node_level, 0);
 
     return 0;
 }
@@ -119,7 +119,7 @@ _make_common(
     if (err)
         return err;
 
-    err = kvset_iter_create(kvset, NULL, NULL, NULL, 0, kvi);
+    err = kvset_iter_create(kvset, NULL, NULL, NULL, NULL, 0, kvi);
     if (err) {
         free(kvset);
         return err;
@@ -293,6 +293,12 @@ _kvset_get_dgen(struct kvset *kvset)
     return mk->dgen;
 }
 
+static u64
+_kvset_get_seqno_min(struct kvset *kvset)
+{
+    return 0;
+}
+
 static u64
 _kvset_get_nth_kblock_id(struct kvset *kvset, u32 index)
 {
@@ -368,6 +374,13 @@ _kvset_get_ref(struct kvset *kvset)
     ++mk->ref;
 }
 
+static void
+_kvset_key_fences(struct kvset *kvset, u64 *lo, u64 *hi)
+{
+    *lo = 0;
+    *hi = U64_MAX;
+}
+
 static void
 _kvset_put_ref(struct kvset *kvset)
 {
@@ -417,6 +430,7 @@ _kvset_iter_create(
     struct workqueue_struct *workq,
     struct workqueue_struct *vra_wq,
     struct perfc_set *       pc,
+    struct cheap *           arena,
     enum kvset_iter_flags    flags,
     struct kv_iterator **    handle)
 {
@@ -516,7 +530,8 @@ _kvset_iter_next_val(
     uint                    vbidx,
     uint                    vboff,
     const void **           vdata,
-    uint *                  vlen)
+    uint *                  vlen,
+    uint                    complen)
 {
     struct mock_kv_iterator *iter = kvi->kvi_context;
     struct kvdata *          entry = iter->kvset->iter_data;
@@ -565,7 +580,8 @@ _kvset_iter_next_vref(
     uint *                  vbidx,
     uint *                  vboff,
     const void **           vdata,
-    uint *                  vlen)
+    uint *                  vlen,
+    uint *                  complen)
 {
     struct mock_kv_iterator *iter = kvi->kvi_context;
     struct kvdata *          entry = iter->kvset->iter_data;
@@ -580,6 +596,7 @@ _kvset_iter_next_vref(
     *vbidx = iter->src;
     *vboff = 0;
     *vlen = 0;
+    *complen = 0;
     if (entry->val_len == 0 && entry->val == -1) {
         *vtype = vtype_tomb;
     } else {
@@ -647,6 +664,8 @@ mock_kvset_set(void)
     mock_kvset_unset();
 
     mapi_inject(mapi_idx_kvset_kblk_start, 0);
+    mapi_inject(mapi_idx_kvset_pfx_may_exist, true);
+    mapi_inject(mapi_idx_kvset_range_may_exist, true);
     mapi_inject(mapi_idx_kvset_get_nth_vblock_handle, 1);
     mapi_inject(mapi_idx_kvset_get_scatter_score, 10);
 
@@ -656,6 +675,7 @@ mock_kvset_set(void)
     MOCK_SET(kvset, _kvset_list_add_tail);
     MOCK_SET(kvset, _kvset_get_ref);
     MOCK_SET(kvset, _kvset_put_ref);
+    MOCK_SET(kvset, _kvset_key_fences);
     MOCK_SET(kvset, _kvset_iter_set_start);
     MOCK_SET(kvset, _kvset_iter_create);
     MOCK_SET(kvset, _kvset_iter_release);
@@ -666,6 +686,7 @@ mock_kvset_set(void)
     MOCK_SET(kvset, _kvset_iter_next_vref);
 
     MOCK_SET(kvset_view, _kvset_get_dgen);
+    MOCK_SET(kvset_view, _kvset_get_seqno_min);
     MOCK_SET(kvset_view, _kvset_get_num_kblocks);
     MOCK_SET(kvset_view, _kvset_get_nth_kblock_id);
     MOCK_SET(kvset_view, _kvset_get_num_vblocks);
@@ -683,6 +704,7 @@ mock_kvset_unset(void)
     MOCK_UNSET(kvset, _kvset_list_add_tail);
     MOCK_UNSET(kvset, _kvset_get_ref);
     MOCK_UNSET(kvset, _kvset_put_ref);
+    MOCK_UNSET(kvset, _kvset_key_fences);
     MOCK_UNSET(kvset, _kvset_iter_create);
     MOCK_UNSET(kvset, _kvset_iter_release);
     MOCK_UNSET(kvset, _kvset_from_iter);
@@ -696,4 +718,5 @@ mock_kvset_unset(void)
     MOCK_UNSET(kvset_view, _kvset_get_num_vblocks);
     MOCK_UNSET(kvset_view, _kvset_get_nth_vblock_id);
     MOCK_UNSET(kvset_view, _kvset_get_dgen);
+    MOCK_UNSET(kvset_view, _kvset_get_seqno_min);
 }
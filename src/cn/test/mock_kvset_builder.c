@@ -37,6 +37,20 @@ _kvset_builder_set_mclass(struct kvset_builder *bldr, enum mp_media_classp mclas
 {
 }
 
+void
+_kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    bldr,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt)
+{
+}
+
+void
+_kvset_builder_set_node_level(struct kvset_builder *bldr, uint level)
+{
+}
+
 static merr_t
 _kvset_builder_add_key(struct kvset_builder *builder, const struct key_obj *kobj)
 {
@@ -49,6 +63,7 @@ _kvset_builder_add_val(
     u64                     seq,
     const void *            vdata,
     uint                    vlen,
+    uint                    complen,
     struct c1_bonsai_vbldr *vbldr)
 {
     return 0;
@@ -61,7 +76,13 @@ _kvset_builder_add_nonval(struct kvset_builder *self, u64 seq, enum kmd_vtype vt
 }
 
 static merr_t
-_kvset_builder_add_vref(struct kvset_builder *self, u64 seq, uint vbidx, uint vboff, uint vlen)
+_kvset_builder_add_vref(
+    struct kvset_builder *self,
+    u64                   seq,
+    uint                  vbidx,
+    uint                  vboff,
+    uint                  vlen,
+    uint                  complen)
 {
     return 0;
 }
@@ -72,6 +93,17 @@ _kvset_builder_get_mblocks(struct kvset_builder *bld, struct kvset_mblocks *mblk
     return 0;
 }
 
+static void
+_kvset_builder_get_wstats(
+    struct kvset_builder *bld,
+    u64 *                 kblk_ns,
+    u64 *                 kblk_bytes,
+    u64 *                 vblk_ns,
+    u64 *                 vblk_bytes)
+{
+    *kblk_ns = *kblk_bytes = *vblk_ns = *vblk_bytes = 0;
+}
+
 static void
 _kvset_builder_destroy(struct kvset_builder *bld)
 {
@@ -87,7 +119,10 @@ mock_kvset_builder_unset(void)
     MOCK_UNSET(kvset_builder, _kvset_builder_add_nonval);
     MOCK_UNSET(kvset_builder, _kvset_builder_add_vref);
     MOCK_UNSET(kvset_builder, _kvset_builder_get_mblocks);
+    MOCK_UNSET(kvset_builder, _kvset_builder_get_wstats);
     MOCK_UNSET(kvset_builder, _kvset_builder_set_mclass);
+    MOCK_UNSET(kvset_builder, _kvset_builder_set_mclass_lvl);
+    MOCK_UNSET(kvset_builder, _kvset_builder_set_node_level);
     MOCK_UNSET(kvset_builder, _kvset_builder_destroy);
 }
 
@@ -103,6 +138,9 @@ mock_kvset_builder_set(void)
     MOCK_SET(kvset_builder, _kvset_builder_add_nonval);
     MOCK_SET(kvset_builder, _kvset_builder_add_vref);
     MOCK_SET(kvset_builder, _kvset_builder_get_mblocks);
+    MOCK_SET(kvset_builder, _kvset_builder_get_wstats);
     MOCK_SET(kvset_builder, _kvset_builder_set_mclass);
+    MOCK_SET(kvset_builder, _kvset_builder_set_mclass_lvl);
+    MOCK_SET(kvset_builder, _kvset_builder_set_node_level);
     MOCK_SET(kvset_builder, _kvset_builder_destroy);
 }
@@ -13,11 +13,13 @@
 #include <hse_ikvdb/limits.h>
 
 #include "mock_mpool.h"
+#include "mock_mpool_dev.h"
 
 struct mocked_mblock {
-    void * mb_base;
-    size_t mb_alloc_cap;
-    size_t mb_write_len;
+    void *               mb_base;
+    size_t               mb_alloc_cap;
+    size_t               mb_write_len;
+    enum mp_media_classp mb_mclass;
 };
 
 struct mocked_map {
@@ -86,6 +88,8 @@ _mpool_mblock_alloc(
     err = get_mblock(blkid, &mb);
     VERIFY_TRUE_RET(err == 0, err);
 
+    mb->mb_mclass = mclassp;
+
     *handle = blkid & 0x0fffffffffffffff; /* make sure not negative */
     if (props) {
         memset(props, 0, sizeof(*props));
@@ -138,6 +142,8 @@ _mpool_mblock_find_get(struct mpool *ds, uint64_t objid, uint64_t *mbh, struct m
 static uint64_t
 _mpool_mblock_commit(struct mpool *ds, uint64_t id)
 {
+    /* The mblock's asynchronous writes complete before the commit. */
+    mpm_dev_wait();
     return 0;
 }
 
@@ -189,10 +195,11 @@ _mpool_mclass_get(struct mpool *mp, enum mp_media_classp mclass, struct mpool_mc
 
 /*
  * Internal function to support _mpool_mblock_read and mpool_mblock_write_data.
- * For writes, it is assumed the offset parameter is 0.
+ * For writes, it is assumed the offset parameter is 0.  The transfer is
+ * charged to the device model of the mblock's media class.
  */
 static merr_t
-mblock_rw(u64 id, struct iovec *iov, int niov, size_t off, bool read)
+mblock_rw(u64 id, struct iovec *iov, int niov, size_t off, bool read, bool sync)
 {
     merr_t                err;
     struct mocked_mblock *mb = 0;
@@ -242,6 +249,8 @@ mblock_rw(u64 id, struct iovec *iov, int niov, size_t off, bool read)
         off += iov[i].iov_len;
     }
 
+    mpm_dev_io(mb->mb_mclass, read ? MPM_DEV_READ : MPM_DEV_WRITE, total_len, sync);
+
     return 0;
 }
 
@@ -351,7 +360,7 @@ _mpool_mcache_getpages(
         iov.iov_base = (void *)__get_free_page(GFP_KERNEL);
         VERIFY_TRUE_RET(iov.iov_base, merr(EBUG));
 
-        err = mblock_rw(map->mbidv[idx], &iov, 1, offsets[i] * PAGE_SIZE, true);
+        err = mblock_rw(map->mbidv[idx], &iov, 1, offsets[i] * PAGE_SIZE, true, true);
         VERIFY_EQ_RET(err, 0, err);
 
         pagev[i] = iov.iov_base;
@@ -362,7 +371,7 @@ _mpool_mcache_getpages(
 static uint64_t
 _mpool_mblock_read(struct mpool *ds, uint64_t id, struct iovec *iovec, int niov, size_t off)
 {
-    return mblock_rw(id, iovec, niov, off, true);
+    return mblock_rw(id, iovec, niov, off, true, true);
 }
 
 static uint64_t
@@ -374,7 +383,7 @@ _mpool_mblock_write_data(
     int                     niov,
     struct mp_asyncctx_ioc *pasyncio)
 {
-    return mblock_rw(id, iovec, niov, 0, false);
+    return mblock_rw(id, iovec, niov, 0, false, !pasyncio);
 }
 
 /*
@@ -485,6 +494,8 @@ _mpool_mdc_append(struct mpool_mdc *mdc, void *data, ssize_t len, bool sync)
         return merr(ev(EFBIG));
     memcpy(m->array + m->wcur, data, len);
     m->wcur = end;
+
+    mpm_dev_io(MP_MED_CAPACITY, MPM_DEV_WRITE, len, sync);
     return 0;
 }
 
@@ -522,6 +533,8 @@ _mpool_mdc_read(struct mpool_mdc *mdc, void *data, size_t max, size_t *dlen)
     m->cur += len;
     *dlen = len;
 
+    mpm_dev_io(MP_MED_CAPACITY, MPM_DEV_READ, len, true);
+
     return 0;
 }
 
@@ -555,6 +568,7 @@ mpm_mblock_alloc(size_t capacity, u64 *id_out)
     mb->mb_write_len = 0;
     mb->mb_alloc_cap = capacity;
     mb->mb_base = mem;
+    mb->mb_mclass = MP_MED_CAPACITY;
     *id_out = index2id(i);
     return 0;
 }
@@ -762,6 +776,10 @@ mock_mpool_set(void)
     MOCK_SET(mpool, _mpool_mclass_get);
 
     mapi_inject(mapi_idx_mpool_mdc_get_root, 0);
+
+    /* e.g., HSE_MOCK_DEV="staging=nvme,capacity=ssd,seed=7" */
+    if (getenv("HSE_MOCK_DEV") && mpm_dev_config(getenv("HSE_MOCK_DEV")))
+        hse_log(HSE_ERR "%s: invalid HSE_MOCK_DEV", __func__);
 }
 
 void
@@ -804,4 +822,6 @@ mock_mpool_unset(void)
 
     memset(&mocked_mblocks, 0, sizeof(mocked_mblocks));
     memset(&mocked_maps, 0, sizeof(mocked_maps));
+
+    mpm_dev_clear();
 }
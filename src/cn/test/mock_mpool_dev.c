@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/mutex.h>
+#include <hse_util/time.h>
+#include <hse_util/timing.h>
+
+#include <bsd/string.h>
+
+#include "mock_mpool_dev.h"
+
+struct mpm_dev {
+    bool                  md_enabled;
+    struct mpm_dev_params md_params;
+    u64                   md_lane[MPM_DEV_QD_MAX];
+    u64                   md_bw_free[MPM_DEV_OPC];
+    u64                   md_rand;
+    struct mpm_dev_stats  md_stats[MPM_DEV_OPC];
+};
+
+static DEFINE_MUTEX(mpm_dev_lock);
+static struct mpm_dev mpm_devv[MP_MED_COUNT];
+static bool           mpm_dev_sleep;
+static u32            mpm_dev_seed;
+static u64            mpm_dev_epoch;
+
+/* Each thread's virtual clock and the completion of its latest
+ * asynchronous operation.
+ */
+static __thread u64 mpm_dev_vnow;
+static __thread u64 mpm_dev_vpend;
+
+static const struct {
+    const char *          name;
+    struct mpm_dev_params params;
+} mpm_dev_presets[] = {
+    { "pmem",
+      { .dp_lat_ns = { 2000, 5000 },
+        .dp_jitter_pct = 10,
+        .dp_tail_ppm = 100,
+        .dp_tail_mult = 10,
+        .dp_bw = { 6000ul << 20, 2000ul << 20 },
+        .dp_qdepth = 64 } },
+    { "nvme",
+      { .dp_lat_ns = { 80000, 20000 },
+        .dp_jitter_pct = 20,
+        .dp_tail_ppm = 1000,
+        .dp_tail_mult = 10,
+        .dp_bw = { 3000ul << 20, 2000ul << 20 },
+        .dp_qdepth = 64 } },
+    { "ssd",
+      { .dp_lat_ns = { 150000, 60000 },
+        .dp_jitter_pct = 25,
+        .dp_tail_ppm = 2000,
+        .dp_tail_mult = 10,
+        .dp_bw = { 550ul << 20, 500ul << 20 },
+        .dp_qdepth = 32 } },
+    { "hdd",
+      { .dp_lat_ns = { 8000000, 4000000 },
+        .dp_jitter_pct = 50,
+        .dp_tail_ppm = 5000,
+        .dp_tail_mult = 4,
+        .dp_bw = { 200ul << 20, 200ul << 20 },
+        .dp_qdepth = 4 } },
+};
+
+static void
+mpm_dev_reset(struct mpm_dev *dev, uint mclass)
+{
+    memset(dev->md_lane, 0, sizeof(dev->md_lane));
+    memset(dev->md_bw_free, 0, sizeof(dev->md_bw_free));
+    memset(dev->md_stats, 0, sizeof(dev->md_stats));
+
+    /* xorshift64 must not start at zero */
+    dev->md_rand = ((u64)mpm_dev_seed << 8 | mclass) * 0x9e3779b97f4a7c15ull ?: 1;
+}
+
+static u64
+mpm_dev_rand(struct mpm_dev *dev)
+{
+    u64 x = dev->md_rand;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return dev->md_rand = x;
+}
+
+static u64
+mpm_dev_lat(struct mpm_dev *dev, enum mpm_dev_op op)
+{
+    const struct mpm_dev_params *p = &dev->md_params;
+    u64                          lat = p->dp_lat_ns[op];
+    u32                          j = p->dp_jitter_pct;
+
+    if (j > 0)
+        lat = lat * (100 - j + mpm_dev_rand(dev) % (2 * j + 1)) / 100;
+
+    if (p->dp_tail_ppm > 0 && mpm_dev_rand(dev) % 1000000 < p->dp_tail_ppm)
+        lat *= p->dp_tail_mult;
+
+    return lat;
+}
+
+static u64
+mpm_dev_clock(void)
+{
+    if (mpm_dev_sleep)
+        return get_time_ns() - mpm_dev_epoch;
+
+    return mpm_dev_vnow;
+}
+
+/* Advance the calling thread's clock to @t.
+ */
+static void
+mpm_dev_advance(u64 t)
+{
+    struct timespec ts;
+    u64             now;
+
+    if (!mpm_dev_sleep) {
+        mpm_dev_vnow = max_t(u64, mpm_dev_vnow, t);
+        return;
+    }
+
+    now = mpm_dev_clock();
+    if (t <= now)
+        return;
+
+    ts.tv_sec = (t - now) / NSEC_PER_SEC;
+    ts.tv_nsec = (t - now) % NSEC_PER_SEC;
+
+    while (nanosleep(&ts, &ts) && errno == EINTR)
+        ;
+}
+
+merr_t
+mpm_dev_set(enum mp_media_classp mclass, const struct mpm_dev_params *params)
+{
+    struct mpm_dev *dev;
+
+    if (mclass >= MP_MED_COUNT)
+        return merr(ev(EINVAL));
+
+    if (params && (params->dp_qdepth < 1 || params->dp_qdepth > MPM_DEV_QD_MAX))
+        return merr(ev(EINVAL));
+
+    if (params && params->dp_jitter_pct > 100)
+        return merr(ev(EINVAL));
+
+    dev = &mpm_devv[mclass];
+
+    mutex_lock(&mpm_dev_lock);
+    dev->md_enabled = !!params;
+    if (params)
+        dev->md_params = *params;
+    mpm_dev_reset(dev, mclass);
+    mutex_unlock(&mpm_dev_lock);
+
+    return 0;
+}
+
+merr_t
+mpm_dev_preset(enum mp_media_classp mclass, const char *name)
+{
+    int i;
+
+    for (i = 0; i < NELEM(mpm_dev_presets); i++)
+        if (!strcmp(name, mpm_dev_presets[i].name))
+            return mpm_dev_set(mclass, &mpm_dev_presets[i].params);
+
+    return merr(ev(ENOENT));
+}
+
+void
+mpm_dev_mode(bool sleep, u32 seed)
+{
+    uint i;
+
+    mutex_lock(&mpm_dev_lock);
+    mpm_dev_sleep = sleep;
+    mpm_dev_seed = seed;
+    mpm_dev_epoch = get_time_ns();
+
+    for (i = 0; i < MP_MED_COUNT; i++)
+        mpm_dev_reset(&mpm_devv[i], i);
+    mutex_unlock(&mpm_dev_lock);
+
+    mpm_dev_vnow = 0;
+    mpm_dev_vpend = 0;
+}
+
+merr_t
+mpm_dev_config(const char *spec)
+{
+    char   buf[256], *tok, *val, *next;
+    bool   sleep = false;
+    u32    seed = 0;
+    merr_t err;
+
+    if (strlcpy(buf, spec, sizeof(buf)) >= sizeof(buf))
+        return merr(ev(ENAMETOOLONG));
+
+    for (next = buf; (tok = strsep(&next, ", ")); ) {
+        if (!*tok)
+            continue;
+
+        val = strchr(tok, '=');
+        if (val)
+            *val++ = '\000';
+
+        if (!strcmp(tok, "sleep")) {
+            sleep = true;
+        } else if (!strcmp(tok, "seed") && val) {
+            seed = strtoul(val, NULL, 0);
+        } else if (!strcmp(tok, "staging") && val) {
+            err = mpm_dev_preset(MP_MED_STAGING, val);
+            if (err)
+                return err;
+        } else if (!strcmp(tok, "capacity") && val) {
+            err = mpm_dev_preset(MP_MED_CAPACITY, val);
+            if (err)
+                return err;
+        } else {
+            return merr(ev(EINVAL));
+        }
+    }
+
+    mpm_dev_mode(sleep, seed);
+
+    return 0;
+}
+
+void
+mpm_dev_clear(void)
+{
+    uint i;
+
+    for (i = 0; i < MP_MED_COUNT; i++)
+        mpm_dev_set(i, NULL);
+}
+
+u64
+mpm_dev_io(enum mp_media_classp mclass, enum mpm_dev_op op, size_t len, bool sync)
+{
+    struct mpm_dev *      dev;
+    struct mpm_dev_stats *st;
+    u64                   now, start, xfer, done, bw;
+    uint                  lane, i;
+
+    /* Objects without a media class of their own live on capacity. */
+    if (mclass >= MP_MED_COUNT)
+        mclass = MP_MED_CAPACITY;
+
+    dev = &mpm_devv[mclass];
+    if (!dev->md_enabled)
+        return 0;
+
+    now = mpm_dev_clock();
+
+    mutex_lock(&mpm_dev_lock);
+
+    /* The operation waits for the first free slot of the device queue,
+     * then for its turn at the read or write bandwidth, and completes
+     * one device latency after its transfer.
+     */
+    lane = 0;
+    for (i = 1; i < dev->md_params.dp_qdepth; i++)
+        if (dev->md_lane[i] < dev->md_lane[lane])
+            lane = i;
+
+    bw = dev->md_params.dp_bw[op];
+    xfer = bw ? len * NSEC_PER_SEC / bw : 0;
+
+    start = max_t(u64, now, dev->md_lane[lane]);
+    start = max_t(u64, start, dev->md_bw_free[op]);
+    dev->md_bw_free[op] = start + xfer;
+
+    done = start + xfer + mpm_dev_lat(dev, op);
+    dev->md_lane[lane] = done;
+
+    st = &dev->md_stats[op];
+    st->ds_ops++;
+    st->ds_bytes += len;
+    st->ds_lat_sum += done - now;
+    st->ds_lat_max = max_t(u64, st->ds_lat_max, done - now);
+
+    mutex_unlock(&mpm_dev_lock);
+
+    if (sync)
+        mpm_dev_advance(done);
+    else
+        mpm_dev_vpend = max_t(u64, mpm_dev_vpend, done);
+
+    return done - now;
+}
+
+void
+mpm_dev_wait(void)
+{
+    if (mpm_dev_vpend) {
+        mpm_dev_advance(mpm_dev_vpend);
+        mpm_dev_vpend = 0;
+    }
+}
+
+u64
+mpm_dev_now(void)
+{
+    return mpm_dev_clock();
+}
+
+void
+mpm_dev_stats_get(enum mp_media_classp mclass, enum mpm_dev_op op, struct mpm_dev_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (mclass >= MP_MED_COUNT || op >= MPM_DEV_OPC)
+        return;
+
+    mutex_lock(&mpm_dev_lock);
+    *stats = mpm_devv[mclass].md_stats[op];
+    mutex_unlock(&mpm_dev_lock);
+}
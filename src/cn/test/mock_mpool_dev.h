@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_CN_TEST_MOCK_MPOOL_DEV_H
+#define HSE_KVS_CN_TEST_MOCK_MPOOL_DEV_H
+
+#include <mpool/mpool.h>
+
+#include <hse_util/platform.h>
+
+/*
+ * Device model for the mpool mocks.
+ *
+ * The mocks keep mblocks and mlogs in memory (or in files), so I/O costs
+ * nothing and real devices are too noisy for repeatable measurements.
+ * With a model set for a media class, each mblock and mlog operation the
+ * mocks emulate is charged a service time drawn from that class's
+ * latency distribution (a jittered base latency with an occasional tail
+ * outlier), delayed by the class's bandwidth cap and by the queue depth
+ * of the device, i.e., the number of operations it serves concurrently.
+ *
+ * By default time is virtual: each thread has its own device clock that
+ * a synchronous operation advances to the operation's completion, while
+ * asynchronous ones only advance it at the next mpm_dev_wait().  Nothing
+ * sleeps and, for a single thread, a given seed always yields the same
+ * timings.  In sleep mode the clock is the wall clock instead and the
+ * calling thread sleeps until its synchronous operations complete, such
+ * that the host-side timing of a test reflects the modeled device.
+ *
+ * A media class without a model costs nothing, as before.
+ */
+
+enum mpm_dev_op {
+    MPM_DEV_READ,
+    MPM_DEV_WRITE,
+    MPM_DEV_OPC,
+};
+
+#define MPM_DEV_QD_MAX 256
+
+/**
+ * struct mpm_dev_params - device model of a media class
+ * @dp_lat_ns:     base latency of a read or write
+ * @dp_jitter_pct: latencies are uniform within +/- this percentage
+ * @dp_tail_ppm:   per million operations that are tail outliers
+ * @dp_tail_mult:  latency multiplier of a tail outlier
+ * @dp_bw:         bandwidth cap in bytes/s of reads and writes (0: none)
+ * @dp_qdepth:     number of operations served concurrently (1 to 256)
+ */
+struct mpm_dev_params {
+    u32 dp_lat_ns[MPM_DEV_OPC];
+    u32 dp_jitter_pct;
+    u32 dp_tail_ppm;
+    u32 dp_tail_mult;
+    u64 dp_bw[MPM_DEV_OPC];
+    u32 dp_qdepth;
+};
+
+/**
+ * struct mpm_dev_stats - what a media class was charged for one op type
+ * @ds_ops:     number of operations
+ * @ds_bytes:   bytes transferred
+ * @ds_lat_sum: sum of latencies, from submission to completion (ns)
+ * @ds_lat_max: largest latency (ns)
+ */
+struct mpm_dev_stats {
+    u64 ds_ops;
+    u64 ds_bytes;
+    u64 ds_lat_sum;
+    u64 ds_lat_max;
+};
+
+/* Set (or with NULL, clear) the model of a media class. */
+merr_t
+mpm_dev_set(enum mp_media_classp mclass, const struct mpm_dev_params *params);
+
+/* Set the model of a media class to one of "pmem", "nvme", "ssd", "hdd". */
+merr_t
+mpm_dev_preset(enum mp_media_classp mclass, const char *name);
+
+/* Select virtual or sleep mode, reseed the latency distributions and
+ * reset the device queues, clocks and stats.
+ */
+void
+mpm_dev_mode(bool sleep, u32 seed);
+
+/*
+ * Configure from a string such as "staging=nvme,capacity=hdd,sleep,seed=7",
+ * e.g. from the HSE_MOCK_DEV environment variable (see mock_mpool_set()).
+ */
+merr_t
+mpm_dev_config(const char *spec);
+
+/* Clear all models. */
+void
+mpm_dev_clear(void);
+
+/*
+ * Charge one operation of @len bytes to @mclass.  Used by the mocks.
+ * Returns the modeled latency (ns), 0 if the class has no model.
+ */
+u64
+mpm_dev_io(enum mp_media_classp mclass, enum mpm_dev_op op, size_t len, bool sync);
+
+/* Wait for the calling thread's asynchronous operations to complete. */
+void
+mpm_dev_wait(void);
+
+/* The calling thread's device clock (ns). */
+u64
+mpm_dev_now(void);
+
+void
+mpm_dev_stats_get(enum mp_media_classp mclass, enum mpm_dev_op op, struct mpm_dev_stats *stats);
+
+#endif
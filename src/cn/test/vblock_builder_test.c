@@ -19,6 +19,7 @@
 
 #include <hse/hse_limits.h>
 
+#include "../omf.h"
 #include "../vblock_builder.h"
 #include "../blk_list.h"
 
@@ -71,8 +72,13 @@ test_setup(struct mtf_test_info *lcl_ti)
     mapi_inject(mapi_idx_cn_get_dataset, 0);
     mapi_inject(mapi_idx_cn_get_flags, 0);
     mapi_inject(mapi_idx_cn_get_tbkt_maint, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_vgc, 0);
+    mapi_inject(mapi_idx_cn_get_tbkt_floor, 0);
+    mapi_inject(mapi_idx_cn_get_io_sched, 0);
+    mapi_inject(mapi_idx_cn_get_cn_kvdb, 0);
 
     mapi_inject(mapi_idx_tbkt_request, 0);
+    mapi_inject(mapi_idx_tbkt_request_floor, 0);
     mapi_inject(mapi_idx_tbkt_delay, 0);
     mapi_inject(mapi_idx_cn_get_mblk_sync_writes, true);
 
@@ -566,6 +572,8 @@ fill_exact(struct mtf_test_info *lcl_ti, struct vblock_builder *vbb, uint space,
     merr_t err = 0;
     uint   vlen_max = HSE_KVS_VLEN_MAX;
     uint   avail = (kvsrp.vblock_size_mb << 20) - PAGE_SIZE - space;
+
+    avail -= VBLOCK_CRC_RSVD(kvsrp.vblock_size_mb << 20);
     uint   vlen;
 
     while (avail > 0) {
@@ -590,7 +598,7 @@ run_test_case(struct mtf_test_info *lcl_ti, enum test_case tc, size_t n_vblocks)
 
     const size_t mblock_size = kvsrp.vblock_size_mb << 20;
     const size_t vblock_hdr_size = PAGE_SIZE;
-    const size_t avail_mblock_size = mblock_size - vblock_hdr_size;
+    const size_t avail_mblock_size = mblock_size - vblock_hdr_size - VBLOCK_CRC_RSVD(mblock_size);
     const size_t vlen = 50 * 1000;
     const size_t values_per_mblock = avail_mblock_size / vlen;
     const size_t add_count = n_vblocks * values_per_mblock;
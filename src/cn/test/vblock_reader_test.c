@@ -100,6 +100,61 @@ MTF_DEFINE_UTEST_PRE(vblock_reader_test, t_vbr_desc_read, pre)
     ASSERT_EQ(0, err);
 }
 
+MTF_DEFINE_UTEST_PRE(vblock_reader_test, t_vbr_desc_read_v3, pre)
+{
+    merr_t                   err;
+    struct mpool *           ds = (void *)-1;
+    struct mpool_mcache_map *map;
+    struct vblock_desc       vblk_desc;
+    struct vblock_hdr_omf    vbhdr;
+    struct vblock_ftr_omf    vbftr = {};
+    u64                      blkid;
+    struct mblock_props      props;
+    uint                     vgroups = 0;
+    u64                      argv[1];
+    size_t                   wlen = 4 * PAGE_SIZE;
+
+    err = mpm_mblock_alloc(wlen, &blkid);
+    ASSERT_EQ(0, err);
+
+    omf_set_vbh_magic(&vbhdr, VBLOCK_HDR_MAGIC);
+    omf_set_vbh_version(&vbhdr, VBLOCK_HDR_VERSION3);
+    omf_set_vbh_vgroup(&vbhdr, get_time_ns());
+    set_props(&props, blkid, wlen - PAGE_SIZE);
+
+    /* header and one page of values, then the checksum table */
+    omf_set_vbf_magic(&vbftr, VBLOCK_FTR_MAGIC);
+    omf_set_vbf_version(&vbftr, VBLOCK_HDR_VERSION3);
+    omf_set_vbf_data_pgc(&vbftr, 2);
+
+    err = mpm_mblock_write(blkid, (void *)&vbhdr, 0, sizeof(vbhdr));
+    ASSERT_EQ(0, err);
+    err = mpm_mblock_write(blkid, (void *)&vbftr, wlen - sizeof(vbftr), sizeof(vbftr));
+    ASSERT_EQ(0, err);
+
+    err = mpool_mcache_mmap(ds, 1, &blkid, MPC_VMA_COLD, &map);
+    ASSERT_EQ(0, err);
+
+    err = vbr_desc_read(ds, map, 0, &vgroups, argv, &props, &vblk_desc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(PAGE_SIZE, vblk_desc.vbd_off);
+    ASSERT_EQ(PAGE_SIZE, vblk_desc.vbd_len);
+    ASSERT_EQ(2, vblk_desc.vbd_mblkdesc.crc_pgc);
+    ASSERT_EQ(
+        vblk_desc.vbd_mblkdesc.map_base + 2 * PAGE_SIZE, (void *)vblk_desc.vbd_mblkdesc.crcv);
+
+    /* a footer that claims more pages than were written */
+    omf_set_vbf_data_pgc(&vbftr, 4);
+    err = mpm_mblock_write(blkid, (void *)&vbftr, wlen - sizeof(vbftr), sizeof(vbftr));
+    ASSERT_EQ(0, err);
+
+    err = vbr_desc_read(ds, map, 0, &vgroups, argv, &props, &vblk_desc);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = mpool_mcache_munmap(map);
+    ASSERT_EQ(0, err);
+}
+
 MTF_DEFINE_UTEST_PRE(vblock_reader_test, t_vbr_desc_update, pre)
 {
     merr_t                   err;
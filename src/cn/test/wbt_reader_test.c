@@ -8,11 +8,17 @@
 #include <hse_util/alloc.h>
 #include <hse_util/slab.h>
 #include <hse_util/page.h>
+#include <hse_util/rcu.h>
 
 #include "../omf.h"
 #include "../wbt_reader.h"
 #include "../wbt_internal.h"
 #include "../kblock_reader.h"
+#include "../kvs_mblk_desc.h"
+#include "../wbt_icache.h"
+#include "../wbt_builder.h"
+
+#include <hse_ikvdb/omf_kmd.h>
 
 #include "mock_mpool.h"
 
@@ -105,7 +111,7 @@ t_wbtr_read_vref_helper(struct mtf_test_info *lcl_ti, const char *kblock_image_f
         ktuple.kt_len = strlen(keybuf);
         ktuple.kt_data = keybuf;
 
-        wbtr_read_vref(&blkdesc, &desc, &ktuple, 0, seqno, &lookup_res, &vref);
+        wbtr_read_vref(&blkdesc, &desc, NULL, &ktuple, 0, seqno, &lookup_res, &vref);
         if (i < nkeys)
             ASSERT_EQ(FOUND_VAL, lookup_res);
         else
@@ -149,4 +155,386 @@ MTF_DEFINE_UTEST(wbt_reader_test, t_wbtr_read_vref)
         t_wbtr_read_vref_helper(lcl_ti, kblock_files[i]);
 }
 
+MTF_DEFINE_UTEST(wbt_reader_test, t_wbtr_read_vref_icache)
+{
+    merr_t                   err;
+    struct mpool *           mp_ds = (void *)-1;
+    struct wbt_desc          desc = {};
+    struct wbt_icache *      ic;
+    struct wbt_icache_entry *slot = NULL;
+    const void *             inodes, *inodes2;
+    char                     keybuf[100];
+    char                     filename[PATH_MAX];
+    struct kvs_ktuple        ktuple;
+    struct kvs_vtuple_ref    vref, vref2;
+    enum key_lookup_res      res, res2;
+    struct kvs_mblk_desc     blkdesc = {};
+    u64                      blkid;
+    int                      i, rc;
+
+    /* Use the v5 kblock image. */
+    rc = snprintf(filename, sizeof(filename), "%s/%s", data_path, kblock_files[1]);
+    ASSERT_LT(rc, sizeof(filename));
+
+    err = mpm_mblock_alloc_file(&blkid, filename);
+    ASSERT_EQ(err, 0);
+    blkdesc.mb_id = blkid;
+
+    err = mpool_mcache_mmap(mp_ds, 1, &blkdesc.mb_id, MPC_VMA_COLD, &blkdesc.map);
+    ASSERT_EQ(err, 0);
+
+    blkdesc.map_base = mpool_mcache_getbase(blkdesc.map, blkdesc.map_idx);
+    ASSERT_NE(blkdesc.map_base, NULL);
+
+    desc.wbd_first_page = omf_kbh_wbt_doff_pg(blkdesc.map_base);
+    desc.wbd_n_pages = omf_kbh_wbt_dlen_pg(blkdesc.map_base);
+
+    err = kbr_read_wbt_region_desc_mem(
+        blkdesc.map_base + omf_kbh_wbt_hoff(blkdesc.map_base), &desc);
+    ASSERT_EQ(err, 0);
+
+    err = wbt_icache_create(0, NULL, &ic);
+    ASSERT_NE(err, 0);
+
+    err = wbt_icache_create(1 << 20, NULL, &ic);
+    ASSERT_EQ(err, 0);
+
+    rcu_read_lock();
+    inodes = wbt_icache_get(ic, &slot, &blkdesc, &desc, 0);
+    inodes2 = wbt_icache_get(ic, &slot, &blkdesc, &desc, 0);
+
+    if (desc.wbd_root < desc.wbd_leaf + desc.wbd_leaf_cnt) {
+        /* A single-leaf tree has no internal nodes to cache. */
+        ASSERT_EQ(NULL, inodes);
+        ASSERT_EQ(NULL, slot);
+    } else {
+        ASSERT_NE(NULL, inodes);
+        ASSERT_NE(NULL, slot);
+        ASSERT_EQ(inodes, inodes2);
+    }
+
+    /* Lookups through the cached nodes must agree with the mapped kblock. */
+    for (i = 0; i < 510; ++i) {
+        snprintf(keybuf, sizeof(keybuf), "key.%09d", i);
+        ktuple.kt_hash = 0;
+        ktuple.kt_len = strlen(keybuf);
+        ktuple.kt_data = keybuf;
+
+        res = res2 = NOT_FOUND;
+        err = wbtr_read_vref(&blkdesc, &desc, NULL, &ktuple, 0, U64_MAX, &res, &vref);
+        ASSERT_EQ(err, 0);
+        err = wbtr_read_vref(&blkdesc, &desc, inodes, &ktuple, 0, U64_MAX, &res2, &vref2);
+        ASSERT_EQ(err, 0);
+
+        ASSERT_EQ(res, res2);
+        ASSERT_EQ(i < 500 ? FOUND_VAL : NOT_FOUND, res2);
+        if (res == FOUND_VAL) {
+            ASSERT_EQ(vref.vr_type, vref2.vr_type);
+            ASSERT_EQ(vref.vr_seq, vref2.vr_seq);
+        }
+    }
+    rcu_read_unlock();
+
+    wbt_icache_remove(ic, &slot);
+    ASSERT_EQ(NULL, slot);
+
+    wbt_icache_destroy(ic);
+
+    err = mpool_mcache_munmap(blkdesc.map);
+    ASSERT_EQ(err, 0);
+}
+
+MTF_DEFINE_UTEST(wbt_reader_test, t_wbt6_keyhead)
+{
+    const char *keys[] = { "", "a", "ab", "ab\0", "abc", "abcd", "abcda", "abce", "b" };
+    __le32      khv[NELEM(keys)];
+    int         first, last, i;
+
+    for (i = 0; i < NELEM(keys); ++i)
+        khv[i] = cpu_to_le32(wbt6_keyhead(keys[i], strlen(keys[i]) + (i == 3)));
+
+    /* Heads of sorted keys are non-decreasing, and short keys are zero-padded.
+     */
+    for (i = 1; i < NELEM(keys); ++i)
+        ASSERT_LE(le32_to_cpu(khv[i - 1]), le32_to_cpu(khv[i]));
+
+    ASSERT_EQ(0x61620000, wbt6_keyhead("ab", 2));
+    ASSERT_EQ(wbt6_keyhead("ab", 2), wbt6_keyhead("ab\0", 3));
+    ASSERT_EQ(0x61626364, wbt6_keyhead("abcdefg", 7));
+
+    wbt6_kh_range(khv, NELEM(keys), wbt6_keyhead("abcd", 4), &first, &last);
+    ASSERT_EQ(5, first);
+    ASSERT_EQ(6, last);
+
+    wbt6_kh_range(khv, NELEM(keys), wbt6_keyhead("ab", 2), &first, &last);
+    ASSERT_EQ(2, first);
+    ASSERT_EQ(3, last);
+
+    /* No equal heads: the range is empty and first is the insertion slot.
+     */
+    wbt6_kh_range(khv, NELEM(keys), wbt6_keyhead("abd", 3), &first, &last);
+    ASSERT_EQ(8, first);
+    ASSERT_EQ(7, last);
+
+    wbt6_kh_range(khv, NELEM(keys), wbt6_keyhead("c", 1), &first, &last);
+    ASSERT_EQ(NELEM(keys), first);
+}
+
+#define FCODE_NKEYS 3000
+
+static int
+fcode_key(char *buf, size_t bufsz, int i)
+{
+    return snprintf(buf, bufsz, "tenant.0042/bucket.%04d/object.%06d", i / 100, i);
+}
+
+/* Build a wbtree in memory and check that it reads back in full through
+ * point lookups, iterators in both directions and prefix seeks.
+ */
+static void
+fcode_roundtrip(
+    struct mtf_test_info *lcl_ti,
+    bool                  fcode,
+    bool                  lcomp,
+    uint *                leaf_cnt,
+    uint *                pgc)
+{
+    struct wbt_hdr_omf    hdr;
+    struct wbt_desc       desc = {};
+    struct kvs_mblk_desc  blkdesc = {};
+    struct iovec          iov[WBB_FREEZE_IOV_MAX];
+    struct kvs_ktuple     kt;
+    struct kvs_vtuple_ref vref;
+    enum key_lookup_res   res;
+    struct key_obj        kobj;
+    struct wbti *         wbti;
+    struct wbb *          wbb;
+    const void *          kmd;
+    char                  key[64], kbuf[64];
+    uint                  max_pgc = 1024, wbt_pgc = 0, iovc, klen;
+    bool                  added;
+    merr_t                err;
+    void *                buf, *p;
+    int                   i;
+
+    err = wbb_create(&wbb, max_pgc, &wbt_pgc, fcode);
+    ASSERT_EQ(0, err);
+
+    if (lcomp) {
+        err = wbb_set_lcomp(wbb, true, &wbt_pgc);
+        ASSERT_EQ(0, err);
+    }
+
+    for (i = 0; i < FCODE_NKEYS; ++i) {
+        char   vkmd[32];
+        size_t vkmd_len = 0;
+
+        kmd_add_val(vkmd, &vkmd_len, i + 1, 0, i * 8, 8);
+
+        kobj.ko_pfx = NULL;
+        kobj.ko_pfx_len = 0;
+        kobj.ko_sfx = key;
+        kobj.ko_sfx_len = fcode_key(key, sizeof(key), i);
+
+        err = wbb_add_entry(wbb, &kobj, 1, vkmd, vkmd_len, max_pgc, &wbt_pgc, &added);
+        ASSERT_EQ(0, err);
+        ASSERT_TRUE(added);
+    }
+
+    err = wbb_freeze(wbb, &hdr, max_pgc, &wbt_pgc, iov, NELEM(iov), &iovc);
+    ASSERT_EQ(0, err);
+
+    buf = alloc_page_aligned(wbt_pgc * PAGE_SIZE, GFP_KERNEL);
+    ASSERT_NE(NULL, buf);
+
+    for (p = buf, i = 0; i < iovc; p += iov[i++].iov_len)
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+
+    blkdesc.map_base = buf;
+    desc.wbd_first_page = 0;
+    desc.wbd_n_pages = wbt_pgc;
+
+    err = kbr_read_wbt_region_desc_mem(&hdr, &desc);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(
+        lcomp ? WBT_TREE_VERSION8 : fcode ? WBT_TREE_VERSION7 : WBT_TREE_VERSION6,
+        desc.wbd_version);
+
+    *leaf_cnt = desc.wbd_leaf_cnt;
+    *pgc = wbt_pgc;
+
+    for (i = 0; i < FCODE_NKEYS; ++i) {
+        kt.kt_data = key;
+
+        kt.kt_len = fcode_key(key, sizeof(key), i);
+        err = wbtr_read_vref(&blkdesc, &desc, NULL, &kt, 0, U64_MAX, &res, &vref);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(FOUND_VAL, res);
+        ASSERT_EQ(i + 1, vref.vr_seq);
+
+        /* A key that sorts between key i and key i + 1 */
+        key[kt.kt_len++] = '~';
+        err = wbtr_read_vref(&blkdesc, &desc, NULL, &kt, 0, U64_MAX, &res, &vref);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(NOT_FOUND, res);
+    }
+
+    /* Forward and reverse iteration */
+    err = wbti_create(&wbti, &blkdesc, &desc, NULL, false, false);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; wbti_next(wbti, &kobj.ko_sfx, &kobj.ko_sfx_len, &kmd); ++i) {
+        wbti_prefix(wbti, &kobj.ko_pfx, &kobj.ko_pfx_len);
+        key_obj_copy(kbuf, sizeof(kbuf), &klen, &kobj);
+
+        ASSERT_EQ(fcode_key(key, sizeof(key), i), klen);
+        ASSERT_EQ(0, memcmp(key, kbuf, klen));
+    }
+    ASSERT_EQ(FCODE_NKEYS, i);
+    wbti_destroy(wbti);
+
+    err = wbti_create(&wbti, &blkdesc, &desc, NULL, true, false);
+    ASSERT_EQ(0, err);
+
+    for (i = FCODE_NKEYS - 1; wbti_next(wbti, &kobj.ko_sfx, &kobj.ko_sfx_len, &kmd); --i) {
+        wbti_prefix(wbti, &kobj.ko_pfx, &kobj.ko_pfx_len);
+        key_obj_copy(kbuf, sizeof(kbuf), &klen, &kobj);
+
+        ASSERT_EQ(fcode_key(key, sizeof(key), i), klen);
+        ASSERT_EQ(0, memcmp(key, kbuf, klen));
+    }
+    ASSERT_EQ(-1, i);
+    wbti_destroy(wbti);
+
+    /* Prefix seek positions the iterator at the first key of the bucket */
+    snprintf(key, sizeof(key), "tenant.0042/bucket.0017/");
+    kt.kt_data = key;
+    kt.kt_len = -strlen(key);
+
+    err = wbti_create(&wbti, &blkdesc, &desc, &kt, false, false);
+    ASSERT_EQ(0, err);
+    ASSERT_TRUE(wbti_next(wbti, &kobj.ko_sfx, &kobj.ko_sfx_len, &kmd));
+    wbti_prefix(wbti, &kobj.ko_pfx, &kobj.ko_pfx_len);
+    key_obj_copy(kbuf, sizeof(kbuf), &klen, &kobj);
+    ASSERT_EQ(fcode_key(key, sizeof(key), 1700), klen);
+    ASSERT_EQ(0, memcmp(key, kbuf, klen));
+    wbti_destroy(wbti);
+
+    free_aligned(buf);
+    wbb_destroy(wbb);
+}
+
+MTF_DEFINE_UTEST(wbt_reader_test, t_wbt7_fcode)
+{
+    uint leaf_cnt, fcode_leaf_cnt, pgc;
+
+    fcode_roundtrip(lcl_ti, false, false, &leaf_cnt, &pgc);
+    fcode_roundtrip(lcl_ti, true, false, &fcode_leaf_cnt, &pgc);
+
+    ASSERT_LT(fcode_leaf_cnt, leaf_cnt);
+}
+
+MTF_DEFINE_UTEST(wbt_reader_test, t_wbt8_lcomp)
+{
+    uint   leaf_cnt, lcomp_leaf_cnt, pgc, lcomp_pgc;
+    merr_t err;
+
+    fcode_roundtrip(lcl_ti, true, false, &leaf_cnt, &pgc);
+    fcode_roundtrip(lcl_ti, true, true, &lcomp_leaf_cnt, &lcomp_pgc);
+
+    /* Same leaf nodes, packed into fewer pages */
+    ASSERT_EQ(leaf_cnt, lcomp_leaf_cnt);
+    ASSERT_LT(lcomp_pgc, pgc);
+
+    /* Again, with lookups going through the decompressed leaf node cache */
+    err = kbr_init();
+    ASSERT_EQ(0, err);
+
+    fcode_roundtrip(lcl_ti, true, true, &lcomp_leaf_cnt, &lcomp_pgc);
+    kbr_fini();
+}
+
+MTF_DEFINE_UTEST(wbt_reader_test, t_wbt_read_kmd_seek)
+{
+    struct kvs_vtuple_ref vref;
+    char                  kmd[512];
+    char                  ival[200];
+    size_t                off = 0;
+    size_t                end;
+    u64                   vseq;
+    bool                  found;
+
+    memset(ival, 'i', sizeof(ival));
+
+    /* one entry of each shape, newest first */
+    kmd_set_count(kmd, &off, 7);
+    kmd_add_cval(kmd, &off, 1ul << 40, 200, 4096, 1000, 300);
+    kmd_add_lival(kmd, &off, 1ul << 20, ival, sizeof(ival));
+    kmd_add_val(kmd, &off, 900, 300, 8192, 100000);
+    kmd_add_val(kmd, &off, 800, 3, 512, 17);
+    kmd_add_ival(kmd, &off, 700, ival, 5);
+    kmd_add_tomb(kmd, &off, 600);
+    kmd_add_zval(kmd, &off, 500);
+    end = off;
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, U64_MAX, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(1ul << 40, vseq);
+    ASSERT_EQ(vtype_cval, vref.vr_type);
+    ASSERT_EQ(200, vref.vb.vr_index);
+    ASSERT_EQ(4096, vref.vb.vr_off);
+    ASSERT_EQ(1000, vref.vb.vr_len);
+    ASSERT_EQ(300, vref.vb.vr_complen);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, (1ul << 20) + 1, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(1ul << 20, vseq);
+    ASSERT_EQ(vtype_ival, vref.vr_type);
+    ASSERT_EQ(sizeof(ival), vref.vi.vr_len);
+    ASSERT_EQ(0, memcmp(vref.vi.vr_data, ival, sizeof(ival)));
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 900, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(900, vseq);
+    ASSERT_EQ(vtype_val, vref.vr_type);
+    ASSERT_EQ(300, vref.vb.vr_index);
+    ASSERT_EQ(8192, vref.vb.vr_off);
+    ASSERT_EQ(100000, vref.vb.vr_len);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 899, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(800, vseq);
+    ASSERT_EQ(vtype_val, vref.vr_type);
+    ASSERT_EQ(3, vref.vb.vr_index);
+    ASSERT_EQ(512, vref.vb.vr_off);
+    ASSERT_EQ(17, vref.vb.vr_len);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 799, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(vtype_ival, vref.vr_type);
+    ASSERT_EQ(5, vref.vi.vr_len);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 650, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(600, vseq);
+    ASSERT_EQ(vtype_tomb, vref.vr_type);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 500, &vseq, &vref);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(vtype_zval, vref.vr_type);
+    ASSERT_EQ(end, off);
+
+    off = 0;
+    found = wbt_read_kmd_seek(kmd, &off, 499, &vseq, &vref);
+    ASSERT_FALSE(found);
+    ASSERT_EQ(end, off);
+}
+
 MTF_END_UTEST_COLLECTION(wbt_reader_test)
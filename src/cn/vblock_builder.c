@@ -15,12 +15,15 @@
 #include <hse_util/logging.h>
 #include <hse_util/perfc.h>
 #include <hse_util/token_bucket.h>
+#include <hse_util/byteorder.h>
+#include <hse_util/crc32c.h>
 
 #include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/tuple.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/kvset_builder.h>
 #include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/io_sched.h>
 
 #include <hse/hse_limits.h>
 #include <hse/kvdb_perfc.h>
@@ -63,7 +66,7 @@ _vblock_start(struct vblock_builder *bld)
 
     if (stats)
         tstart = get_time_ns();
-    err = mpool_mblock_alloc(bld->ds, bld->mclass, spare, &handle, &mbprop);
+    err = cn_mblock_alloc(bld->cn, bld->ds, bld->mclass, bld->life, spare, &handle, &mbprop);
     if (ev(err))
         return err;
     if (stats)
@@ -96,15 +99,33 @@ _vblock_start(struct vblock_builder *bld)
     bld->wbuf_len = WBUF_LEN_MAX - (WBUF_LEN_MAX % mbprop.mpr_stripe_len);
     bld->stripe_len = mbprop.mpr_stripe_len;
 
+    bld->crcc = 0;
+    bld->crc_woff = 0;
+    bld->crc_done = false;
+
     /* add header to write buffer */
     memset(bld->wbuf, 0x0, VBLOCK_HDR_LEN);
     omf_set_vbh_magic(bld->wbuf, VBLOCK_HDR_MAGIC);
-    omf_set_vbh_version(bld->wbuf, VBLOCK_HDR_VERSION2);
+    omf_set_vbh_version(bld->wbuf, VBLOCK_HDR_VERSION3);
     omf_set_vbh_vgroup(bld->wbuf, bld->vgroup);
 
     return 0;
 }
 
+/* Checksum the pages of the write buffer up to offset @end. */
+static void
+_vblock_crc(struct vblock_builder *bld, uint end)
+{
+    uint off;
+
+    for (off = bld->crc_woff; off + PAGE_SIZE <= end; off += PAGE_SIZE) {
+        assert(bld->crcc < bld->max_size / PAGE_SIZE);
+        bld->crcv[bld->crcc++] = cpu_to_le32(crc32c(0, bld->wbuf + off, PAGE_SIZE));
+    }
+
+    bld->crc_woff = off;
+}
+
 static merr_t
 _vblock_flush_asynciolist(struct vblock_builder *bld, bool all)
 {
@@ -163,6 +184,7 @@ _vblock_write(struct vblock_builder *bld)
     bool                       doasync = pasyncio->mp_enabled;
     bool                       ingest;
     struct cn_merge_stats *    stats = bld->mstats;
+    struct io_sched *          ios;
     u64                        tstart;
 
     assert(bld->mbh);
@@ -172,11 +194,25 @@ _vblock_write(struct vblock_builder *bld)
     iov.iov_base = bld->wbuf;
     iov.iov_len = bld->wbuf_len;
 
+    if (bld->crcv && !bld->crc_done)
+        _vblock_crc(bld, bld->wbuf_len);
+    bld->crc_woff = 0;
+
     if (!ingest) {
-        struct tbkt *tb = cn_get_tbkt_maint(bld->cn);
+        struct tbkt *tb;
+
+        if (bld->flags & KVSET_BUILDER_FLAGS_VGC)
+            tb = cn_get_tbkt_vgc(bld->cn);
+        else
+            tb = cn_get_tbkt_maint(bld->cn);
 
-        if (tb)
-            tbkt_delay(tbkt_request(tb, iov.iov_len));
+        if (tb) {
+            u64 delay = tbkt_request_floor(tb, cn_get_tbkt_floor(bld->cn), iov.iov_len);
+
+            tbkt_delay(delay);
+            if (stats)
+                count_ops(&stats->ms_tbkt_delay, 1, iov.iov_len, delay);
+        }
     }
 
     while (doasync) {
@@ -214,7 +250,10 @@ _vblock_write(struct vblock_builder *bld)
      */
     if (stats)
         tstart = get_time_ns();
+    ios = cn_get_io_sched(bld->cn);
+    io_sched_enter(ios, bld->mclass, ingest ? IOS_INGEST : IOS_COMPACT, iov.iov_len);
     err = mpool_mblock_write_data(bld->ds, !doasync, bld->mbh, &iov, 1, pasyncio);
+    io_sched_exit(ios, bld->mclass);
     if (stats)
         count_ops(
             (doasync ? &stats->ms_vblk_write_async : &stats->ms_vblk_write),
@@ -247,14 +286,88 @@ _vblock_write(struct vblock_builder *bld)
     return 0;
 }
 
+/* Append @len bytes from @data (or zeroes if @data is NULL) to the current
+ * vblock, writing out the write buffer whenever it fills up.
+ */
+static merr_t
+_vblock_append(struct vblock_builder *bld, const void *data, uint len)
+{
+    uint   off = 0;
+    merr_t err;
+
+    while (off < len) {
+        uint bytes = min_t(uint, len - off, bld->wbuf_len - bld->wbuf_off);
+
+        if (data)
+            memcpy(bld->wbuf + bld->wbuf_off, data + off, bytes);
+        else
+            memset(bld->wbuf + bld->wbuf_off, 0, bytes);
+
+        bld->wbuf_off += bytes;
+        bld->vblk_off += bytes;
+        off += bytes;
+
+        if (bld->wbuf_off == bld->wbuf_len) {
+            err = _vblock_write(bld);
+            if (ev(err))
+                return err;
+        }
+    }
+
+    return 0;
+}
+
+/* Pad the values to a page, checksum the last pages, and append the
+ * checksum table.  Leaves the footer in the buffer to be placed by
+ * _vblock_finish() at the end of the final write.
+ */
+static merr_t
+_vblock_finish_crc(struct vblock_builder *bld, struct vblock_ftr_omf *ftr)
+{
+    merr_t err;
+
+    err = _vblock_append(bld, NULL, PAGE_ALIGN(bld->vblk_off) - bld->vblk_off);
+    if (ev(err))
+        return err;
+
+    _vblock_crc(bld, bld->wbuf_off);
+    bld->crc_done = true;
+
+    assert(bld->crcc == bld->vblk_off / PAGE_SIZE);
+
+    memset(ftr, 0, sizeof(*ftr));
+    omf_set_vbf_magic(ftr, VBLOCK_FTR_MAGIC);
+    omf_set_vbf_version(ftr, VBLOCK_HDR_VERSION3);
+    omf_set_vbf_data_pgc(ftr, bld->crcc);
+
+    err = _vblock_append(bld, bld->crcv, bld->crcc * sizeof(*bld->crcv));
+    if (ev(err))
+        return err;
+
+    /* The footer must fit in the final write. */
+    if (bld->wbuf_len - bld->wbuf_off < sizeof(*ftr))
+        err = _vblock_append(bld, NULL, bld->wbuf_len - bld->wbuf_off);
+
+    return err;
+}
+
 static merr_t
 _vblock_finish(struct vblock_builder *bld)
 {
+    struct vblock_ftr_omf ftr;
+
     merr_t err = 0;
     uint   buflen;
     uint   zfill_len;
 
-    if (bld->mbh && bld->wbuf_off) {
+    if (bld->mbh && bld->crcv) {
+        err = _vblock_finish_crc(bld, &ftr);
+        if (ev(err))
+            return err;
+    }
+
+    /* A vblock with checksums always ends with a write holding the footer. */
+    if (bld->mbh && (bld->wbuf_off || bld->crcv)) {
         /*
          * c1 may issue media writes before the 1MB buffer
          * gets full. The final write should not exceed
@@ -269,6 +382,11 @@ _vblock_finish(struct vblock_builder *bld)
 
         memset(bld->wbuf + bld->wbuf_off, 0, zfill_len);
 
+        if (bld->crcv) {
+            assert(zfill_len >= sizeof(ftr));
+            memcpy(bld->wbuf + bld->wbuf_len - sizeof(ftr), &ftr, sizeof(ftr));
+        }
+
         err = _vblock_write(bld);
         bld->wbuf_len = buflen;
     }
@@ -321,6 +439,7 @@ vbb_create(
     bld->asyncio_ctxswi = rp->vblock_asyncio_ctxswi;
     bld->asyncio_ingestpool = ingest;
     bld->mclass = MP_MED_CAPACITY;
+    bld->life = MBLOCK_LIFE_SHORT;
 
     bld->wbuf = cn_aio_alloc(bld->cn, WBUF_LEN_MAX, ingest, true);
     if (ev(!bld->wbuf)) {
@@ -328,6 +447,17 @@ vbb_create(
         return merr(ENOMEM);
     }
 
+    if (!(flags & KVSET_BUILDER_FLAGS_EXT)) {
+        bld->crcv = malloc(bld->max_size / PAGE_SIZE * sizeof(*bld->crcv));
+        if (ev(!bld->crcv)) {
+            cn_aio_free(bld->cn, bld->wbuf, WBUF_LEN_MAX, ingest);
+            free(bld);
+            return merr(ENOMEM);
+        }
+
+        bld->crc_rsvd = VBLOCK_CRC_RSVD(bld->max_size);
+    }
+
     if (flags & KVSET_BUILDER_FLAGS_EXT) {
         err = vbb_create_ext(bld, rp);
         if (ev(err)) {
@@ -358,6 +488,7 @@ vbb_destroy(struct vblock_builder *bld)
     if (bld->vbb_ext)
         vbb_destroy_ext(bld);
 
+    free(bld->crcv);
     free(bld);
 }
 
@@ -471,6 +602,12 @@ vbb_get_mclass(struct vblock_builder *bld)
     return bld->mclass;
 }
 
+void
+vbb_set_life(struct vblock_builder *bld, enum mblock_life life)
+{
+    bld->life = life;
+}
+
 void
 vbb_set_merge_stats(struct vblock_builder *bld, struct cn_merge_stats *stats)
 {
@@ -11,6 +11,8 @@
 
 #include <hse_util/perfc.h>
 
+#include <hse_ikvdb/mblock_life.h>
+
 struct cn;
 struct vblock_builder;
 struct blk_list;
@@ -19,6 +21,11 @@ struct cn_merge_stats;
 
 enum mp_media_classp;
 
+/* Space at the end of a vblock of size %_size that the builder reserves for
+ * padding the last value to a page, the page checksums and the footer.
+ */
+#define VBLOCK_CRC_RSVD(_size) (PAGE_SIZE * (MBLK_CRC_PGC((_size) / PAGE_SIZE) + 2))
+
 /* MTF_MOCK_DECL(vblock_builder) */
 
 /**
@@ -124,6 +131,12 @@ vbb_set_mclass(struct vblock_builder *bld, enum mp_media_classp mclass);
 enum mp_media_classp
 vbb_get_mclass(struct vblock_builder *bld);
 
+/**
+ * vbb_set_life() - set the expected lifetime of the vblocks to be built
+ */
+void
+vbb_set_life(struct vblock_builder *bld, enum mblock_life life);
+
 void
 vbb_set_merge_stats(struct vblock_builder *bld, struct cn_merge_stats *stats);
 
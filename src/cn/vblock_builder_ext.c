@@ -31,6 +31,7 @@
 
 #include "vblock_builder_internal.h"
 #include "cn_metrics.h"
+#include "cn_mblocks.h"
 
 struct vbb_ext_elem {
     u64   mbh;
@@ -101,7 +102,7 @@ _vblock_start_ext(struct vblock_builder *bld, u8 slot)
 
     spare = !!(bld->flags & KVSET_BUILDER_FLAGS_SPARE);
 
-    err = mpool_mblock_alloc(bld->ds, bld->mclass, spare, &handle, &mbprop);
+    err = cn_mblock_alloc(bld->cn, bld->ds, bld->mclass, bld->life, spare, &handle, &mbprop);
     if (ev(err))
         return err;
 
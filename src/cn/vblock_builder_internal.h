@@ -33,6 +33,11 @@ struct cn_merge_stats;
  *             minus the size of the vblock byte header.
  * @destruct:  if true, vlbock builder is ready to be destroyed
  * @stripe_len: mblock stripe length
+ * @crcv:      checksums of the pages of the current vblock written so far
+ * @crcc:      number of entries in @crcv
+ * @crc_woff:  offset of the first page in @wbuf not yet in @crcv
+ * @crc_rsvd:  space reserved at the end of each vblock by VBLOCK_CRC_RSVD()
+ * @crc_done:  the checksums of the current vblock are complete
  *
  * WBUF_LEN_MAX is the allocated size of the write buffer.  Each mblock write
  * will be at most WBUF_LEN_MAX bytes.  Member @wbuf_len is the actual write
@@ -70,6 +75,13 @@ struct cn_merge_stats;
  *       -- write @wbuf_len bytes to mblock
  *       -- set @wbuf_off to 0
  *       -- set @vblk_off += @wbuff_off
+ *
+ * The checksum of each page is computed just before the page is written.
+ * When a vblock is finished, its last page is padded and checksummed, and
+ * the checksum table followed by a footer is appended as though it were a
+ * value.  The footer must end at the end of the final write, so it is
+ * preceded by the zero fill of that write.  The c1 (ext) builder writes
+ * vblocks without checksums.
  */
 struct vblock_builder {
     struct mpool *         ds;
@@ -81,6 +93,7 @@ struct vblock_builder {
     int                    asyncio_lstcnt;
     struct mp_asyncctx_ioc asyncio_ctx;
     enum mp_media_classp   mclass;
+    enum mblock_life       life;
     int                    asyncio_max;
     int                    asyncio_ctxswi;
     bool                   asyncio_ingestpool;
@@ -96,6 +109,11 @@ struct vblock_builder {
     bool                   destruct;
     u32                    stripe_len;
     struct vbb_ext *       vbb_ext;
+    u32 *                  crcv;
+    uint                   crcc;
+    uint                   crc_woff;
+    uint                   crc_rsvd;
+    bool                   crc_done;
 };
 
 /* struct asyncio_list_entry
@@ -114,7 +132,7 @@ struct asyncio_list_entry {
 static inline bool
 _vblock_has_room(struct vblock_builder *bld, size_t vlen)
 {
-    return bld->vblk_off + vlen <= bld->max_size;
+    return bld->vblk_off + vlen + bld->crc_rsvd <= bld->max_size;
 }
 
 static inline uint
@@ -29,10 +29,12 @@ vbr_desc_read(
     struct vblock_desc *     vblk_desc)
 {
     struct vblock_hdr_omf *hdr;
+    struct vblock_ftr_omf *ftr = NULL;
 
     bool  supported;
     void *base;
     u64   vgroup;
+    u32   data_pgc = 0;
 
     base = mpool_mcache_getbase(map, idx);
     if (ev(!base))
@@ -43,10 +45,23 @@ vbr_desc_read(
 
     supported =
         (omf_vbh_magic(hdr) == VBLOCK_HDR_MAGIC && (omf_vbh_version(hdr) == VBLOCK_HDR_VERSION1 ||
-                                                    omf_vbh_version(hdr) == VBLOCK_HDR_VERSION2));
+                                                    omf_vbh_version(hdr) == VBLOCK_HDR_VERSION2 ||
+                                                    omf_vbh_version(hdr) == VBLOCK_HDR_VERSION3));
     if (ev(!supported))
         return merr(EINVAL);
 
+    if (omf_vbh_version(hdr) == VBLOCK_HDR_VERSION3) {
+        if (ev(props->mpr_write_len < 2 * PAGE_SIZE))
+            return merr(EINVAL);
+
+        ftr = base + props->mpr_write_len - sizeof(*ftr);
+        data_pgc = omf_vbf_data_pgc(ftr);
+
+        if (ev(omf_vbf_magic(ftr) != VBLOCK_FTR_MAGIC || !data_pgc ||
+               ((size_t)data_pgc + MBLK_CRC_PGC(data_pgc)) * PAGE_SIZE > props->mpr_write_len))
+            return merr(EINVAL);
+    }
+
     memset(vblk_desc, 0, sizeof(*vblk_desc));
     vblk_desc->vbd_mblkdesc.map_base = base;
     vblk_desc->vbd_mblkdesc.mb_id = props->mpr_objid;
@@ -54,7 +69,14 @@ vbr_desc_read(
     vblk_desc->vbd_mblkdesc.map_idx = idx;
     vblk_desc->vbd_off = PAGE_SIZE;
     vblk_desc->vbd_len = props->mpr_write_len - PAGE_SIZE;
+
+    if (ftr) {
+        vblk_desc->vbd_len = (data_pgc - 1) * PAGE_SIZE;
+        vblk_desc->vbd_mblkdesc.crcv = base + data_pgc * PAGE_SIZE;
+        vblk_desc->vbd_mblkdesc.crc_pgc = data_pgc;
+    }
     vblk_desc->vbd_vgroup = vgroup;
+    vblk_desc->vbd_mclass = props->mpr_mclassp;
     atomic_set(&vblk_desc->vbd_vgidx, 1);
     atomic_set(&vblk_desc->vbd_refcnt, 0);
 
@@ -281,6 +303,23 @@ vbr_madvise(struct vblock_desc *vbd, uint off, uint len, int advice)
     }
 }
 
+void
+vbr_prefetch(struct vblock_desc *vbd, uint off, uint len)
+{
+    size_t start, end;
+    merr_t err;
+
+    if (len == 0)
+        return;
+
+    start = (vbd->vbd_off + off) & PAGE_MASK;
+    end = PAGE_ALIGN((size_t)vbd->vbd_off + off + len);
+
+    err = mpool_mcache_madvise(
+        vbd->vbd_mblkdesc.map, vbd->vbd_mblkdesc.map_idx, start, end - start, MADV_WILLNEED);
+    ev(err);
+}
+
 /* off, len version */
 void *
 vbr_value(struct vblock_desc *vbd, uint vboff, uint vlen)
@@ -59,6 +59,7 @@ struct vblock_desc {
     u64                  vbd_vgroup;   /* vblock group ID (dgen_hi) */
     atomic_t             vbd_vgidx;    /* vblock group index */
     atomic_t             vbd_refcnt;   /* vbr_madvise_async() refcnt */
+    u8                   vbd_mclass;   /* media class of the vblock */
 };
 
 /**
@@ -139,6 +140,18 @@ vbr_readahead_simple(
 void
 vbr_madvise(struct vblock_desc *vbd, uint off, uint len, int advice);
 
+/**
+ * vbr_prefetch() - start reading the pages of one value into the page cache
+ * @vbd:   vblock descriptor
+ * @off:   offset of the value within the vblock data
+ * @len:   length of the value on media
+ *
+ * Unlike vbr_madvise() this covers every page the value touches, however
+ * small the value.  It does not wait for the reads to complete.
+ */
+void
+vbr_prefetch(struct vblock_desc *vbd, uint off, uint len);
+
 /**
  * vbr_value() - Get ptr to a value stored in a vblock
  * @vbd:   identifies vblock to read
@@ -7,6 +7,7 @@
 #include <hse_util/slab.h>
 #include <hse_util/event_counter.h>
 #include <hse_util/key_util.h>
+#include <hse_util/compression.h>
 
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/omf_kmd.h>
@@ -47,9 +48,17 @@ struct int_node_estimator {
  * @nodec: number of nodes in use
  * @max_inodec: upper limit on number of internal nodes that will be needed
  * @max_pgc: max allowable size of wbtree in pages (nodes+kmd+bloom)
+ * @fcode: whether to front-code the keys in leaf nodes (version 7)
+ * @lcomp: whether to compress the leaf nodes (version 8), implies @fcode
+ * @leaf_pgc: pages accounted for the leaf nodes in @used_pgc
+ * @lc_cnt: number of leaf nodes compressed into @lc_data
+ * @lc_used: length of the compressed leaf nodes in @lc_data
+ * @lc_data: offset table of WBB_LC_OFFV_CAP bytes, then the compressed nodes
  * @cnode: current node
  * @cnode_key_cursor: spot for next key. Points into the staging area.
  * @cnode_nkeys: number of keys (aka, entries) in current node
+ * @cnode_fc_sumlen: total length of front-coded keys in current leaf node
+ * @cnode_restart_off: staging area offset of current leaf node's restart key
  * @entries: total number of keys stored so far
  * @wbt_first_kobj: first key (aka, min key in wb tree)
  * @wbt_last_kobj: last key (aka, max key in wb tree)
@@ -68,6 +77,13 @@ struct wbb {
     uint  max_inodec;
     uint  max_pgc;
     uint  used_pgc;
+    bool  fcode;
+    bool  lcomp;
+
+    uint  leaf_pgc;
+    uint  lc_cnt;
+    uint  lc_used;
+    void *lc_data;
 
     void *cnode;
 
@@ -79,6 +95,8 @@ struct wbb {
     uint  cnode_sumlen;
     uint  cnode_key_stage_pgc;
     uint  cnode_key_extra_cnt;
+    uint  cnode_fc_sumlen;
+    uint  cnode_restart_off;
     void *cnode_first_key;
     void *cnode_key_stage;
 
@@ -105,6 +123,10 @@ struct key_stage_entry_leaf {
     u8  kdata[];
 };
 
+/* Room for the offset table of a tree whose nodes are all compressed leaves.
+ */
+#define WBB_LC_OFFV_CAP(_wbb) PAGE_ALIGN(WBT_LEAF_OFFV_LEN((_wbb)->nodev_len))
+
 static __always_inline uint
 get_kmd_len(struct wbb *wbb)
 {
@@ -171,8 +193,8 @@ max_inode_cnt(struct wbb *wbb, uint right_edge_klen, uint *estimate)
      */
     while (est) {
         uint used;
-        uint ine_sz = sizeof(struct wbt_ine_omf);
-        uint hdr_sz = sizeof(struct wbt_node_hdr_omf);
+        uint ine_sz = sizeof(struct wbt_ine_omf) + WBT_KEYHEAD_LEN;
+        uint hdr_sz = sizeof(struct wbt_node_hdr_omf) + WBT_KEYHEAD_LEN - 1;
 
         /* All internal nodes must have a right edge. Adding one to
          * the level's est->curr_rkeys_cnt accounts for this.
@@ -253,6 +275,51 @@ err_exit:
     return err;
 }
 
+/* Pages needed for the leaf nodes if @open more leaf nodes are added to
+ * those already published.  Compressed leaf nodes are packed behind their
+ * offset table and an open one is accounted as if stored raw.
+ */
+static uint
+wbb_leaf_pgc(struct wbb *wbb, uint open)
+{
+    size_t len;
+
+    if (!wbb->lcomp)
+        return wbb->nodec + open;
+
+    len = WBT_LEAF_OFFV_LEN(wbb->lc_cnt + open) + wbb->lc_used + open * PAGE_SIZE;
+
+    return PAGE_ALIGN(len) / PAGE_SIZE;
+}
+
+/* Compress the leaf node that was just published into lc_data, or copy it
+ * there as is if it does not shrink.  Offsets are kept relative to the start
+ * of the compressed nodes until the tree is frozen.
+ */
+static void
+wbb_leaf_compress(struct wbb *wbb)
+{
+    u32 * offv = wbb->lc_data;
+    void *node, *dst;
+    uint  len;
+
+    if (!wbb->lcomp || wbb->lc_cnt == wbb->nodec)
+        return;
+
+    assert(wbb->lc_cnt + 1 == wbb->nodec);
+
+    node = wbb->nodev + wbb->lc_cnt * PAGE_SIZE;
+    dst = wbb->lc_data + WBB_LC_OFFV_CAP(wbb) + wbb->lc_used;
+
+    if (compress_lz4(node, WBT_NODE_SIZE, dst, WBT_NODE_SIZE - 1, &len)) {
+        memcpy(dst, node, WBT_NODE_SIZE);
+        len = WBT_NODE_SIZE;
+    }
+
+    offv[wbb->lc_cnt++] = wbb->lc_used;
+    wbb->lc_used += len;
+}
+
 static struct wbt_node_hdr_omf *
 _new_node(struct wbb *wbb)
 {
@@ -263,6 +330,8 @@ _new_node(struct wbb *wbb)
     wbb->cnode_kmd_off = get_kmd_len(wbb);
     wbb->cnode_nkeys = 0;
     wbb->cnode_key_extra_cnt = 0;
+    wbb->cnode_fc_sumlen = 0;
+    wbb->cnode_restart_off = 0;
 
     memset(wbb->cnode, 0, PAGE_SIZE);
     wbb->nodec += 1;
@@ -275,7 +344,7 @@ _new_leaf_node(struct wbb *wbb, uint right_edge_klen)
 {
     struct wbt_node_hdr_omf *node_hdr;
     uint                     max_inodec = 0;
-    uint                     used_pgc;
+    uint                     used_pgc, leaf_pgc;
     merr_t                   err;
 
     /* Space calculation must account for:
@@ -288,11 +357,13 @@ _new_leaf_node(struct wbb *wbb, uint right_edge_klen)
     if (ev(err))
         return err;
 
-    used_pgc = wbb->used_pgc + 1 + max_inodec - wbb->max_inodec;
+    leaf_pgc = wbb_leaf_pgc(wbb, 1);
+    used_pgc = wbb->used_pgc - wbb->leaf_pgc + leaf_pgc + max_inodec - wbb->max_inodec;
     if (used_pgc > wbb->max_pgc || wbb->nodec + max_inodec >= wbb->nodev_len)
         return merr(ENOSPC); /* not a hard error */
 
     wbb->used_pgc = used_pgc;
+    wbb->leaf_pgc = leaf_pgc;
     wbb->max_inodec = max_inodec;
 
     node_hdr = _new_node(wbb);
@@ -368,11 +439,17 @@ rightmost_leaf_max_key(struct wbb *wbb, uint node, struct key_obj *ko)
     assert(omf_wbn_num_keys(nodep) > 0);
 
     lfe = wbt_lfe(nodep, omf_wbn_num_keys(nodep) - 1);
+
+    if (wbb->fcode) {
+        wbt7_lfe_key(nodep, lfe, &ko->ko_pfx, &ko->ko_pfx_len, &ko->ko_sfx, &ko->ko_sfx_len);
+        return;
+    }
+
     wbt_lfe_key(nodep, lfe, &ko->ko_sfx, &ko->ko_sfx_len);
     wbt_node_pfx(nodep, &ko->ko_pfx, &ko->ko_pfx_len);
 }
 
-/* Close out the node - Write out node_hdr, prefix, INEs and key suffixes.
+/* Close out the node - Write out node_hdr, prefix, INEs, key heads and key suffixes.
  */
 static void
 wbt_inner_publish(struct wbb *wbb, uint last_child)
@@ -382,6 +459,7 @@ wbt_inner_publish(struct wbb *wbb, uint last_child)
     size_t              pfx_len = wbb->cnode_pfx_len;
     struct wbt_ine_omf *entry; /* (out) current key entry ptr */
     void *              sfxp;  /* (out) current suffix ptr */
+    __le32 *            khp;   /* (out) current key head ptr */
     int                 i;
 
     struct key_stage_entry_intern *kin = wbb->cnode_key_stage;
@@ -398,6 +476,7 @@ wbt_inner_publish(struct wbb *wbb, uint last_child)
     }
 
     entry = wbb->cnode + sizeof(*node_hdr) + pfx_len;
+    khp = wbb->cnode + wbt6_kh_off(pfx_len, wbb->cnode_nkeys + 1);
     sfxp = wbb->cnode + PAGE_SIZE;
 
     for (i = 0; i < wbb->cnode_nkeys; i++) {
@@ -407,6 +486,7 @@ wbt_inner_publish(struct wbb *wbb, uint last_child)
         memcpy(sfxp, kin->kdata + pfx_len, sfx_len);
         omf_set_ine_koff(entry, sfxp - wbb->cnode);
         omf_set_ine_left_child(entry, kin->child);
+        *khp++ = cpu_to_le32(wbt6_keyhead(kin->kdata + pfx_len, sfx_len));
 
         assert((void *)kin >= wbb->cnode_key_stage);
         assert((void *)kin < wbb->cnode_key_stage + (wbb->cnode_key_stage_pgc * PAGE_SIZE));
@@ -416,8 +496,9 @@ wbt_inner_publish(struct wbb *wbb, uint last_child)
         kin = (void *)kin + sizeof(*kin) + kin->klen;
     }
 
-    /* should have space for this last entry */
+    /* should have space for this last entry and the key heads */
     assert((void *)(entry) <= sfxp);
+    assert((void *)khp <= sfxp);
 
     /* Create rightmost edge entry -- yes, it uses 'ine_left_child' member.
      */
@@ -496,8 +577,8 @@ _add_int_node_entry(struct wbb *wbb, uint child, bool last_entry)
     wbb->cnode_sumlen += klen;
 
     /* Leave room for an extra ine. */
-    space = sizeof(struct wbt_node_hdr_omf) + new_pfx_len +
-            ((wbb->cnode_nkeys + 2) * sizeof(struct wbt_ine_omf)) + wbb->cnode_sumlen -
+    space = wbt6_kh_off(new_pfx_len, wbb->cnode_nkeys + 2) +
+            ((wbb->cnode_nkeys + 1) * WBT_KEYHEAD_LEN) + wbb->cnode_sumlen -
             ((wbb->cnode_nkeys + 1) * new_pfx_len);
 
     /*
@@ -685,7 +766,16 @@ wbb_entries(struct wbb *wbb)
     return wbb->entries + wbb->cnode_nkeys;
 }
 
-/* Close out the node - Write out node_hdr, prefix, LFEs and key suffixes.
+uint
+wbb_leaf_node(struct wbb *wbb)
+{
+    assert(wbb->nodec > 0);
+
+    return wbb->nodec - 1;
+}
+
+/* Close out the node - Write out node_hdr, prefix, LFEs, key heads and key suffixes,
+ * or front-coded keys if wbb->fcode is set.
  */
 static void
 wbt_leaf_publish(struct wbb *wbb)
@@ -695,9 +785,12 @@ wbt_leaf_publish(struct wbb *wbb)
     size_t              pfx_len = wbb->cnode_pfx_len;
     struct wbt_lfe_omf *entry; /* (out) current key entry ptr */
     void *              sfxp;  /* (out) current suffix ptr */
+    __le32 *            khp;   /* (out) current key head ptr */
+    void *              rkey;  /* (out) current restart key ptr */
     int                 i;
 
     struct key_stage_entry_leaf *kin = wbb->cnode_key_stage;
+    struct key_stage_entry_leaf *rst = kin;
 
     omf_set_wbn_num_keys(node_hdr, wbb->cnode_nkeys);
     omf_set_wbn_pfx_len(node_hdr, pfx_len);
@@ -711,14 +804,35 @@ wbt_leaf_publish(struct wbb *wbb)
     }
 
     entry = wbb->cnode + sizeof(*node_hdr) + pfx_len;
+    khp = wbb->cnode + wbt6_kh_off(pfx_len, wbb->cnode_nkeys);
     sfxp = wbb->cnode + PAGE_SIZE;
+    rkey = NULL;
 
     for (i = 0; i < wbb->cnode_nkeys; i++) {
         u16  sfx_len = kin->klen - pfx_len;
         uint key_extra = kin->kmd_off < U16_MAX ? 0 : 4;
+        bool restart = wbb->fcode && i % WBT_RESTART_INTERVAL == 0;
+        uint shared, enc_len;
 
-        sfxp -= sfx_len + key_extra;
+        /* A front-coded key shares at least the node prefix with its
+         * restart key, and the others store only their suffix.
+         */
+        if (restart) {
+            rst = kin;
+            shared = 0;
+            enc_len = kin->klen;
+        } else if (wbb->fcode) {
+            shared = memlcp(kin->kdata, rst->kdata, min_t(uint, kin->klen, rst->klen));
+            enc_len = sizeof(u16) + kin->klen - shared;
+            assert(shared >= pfx_len);
+        } else {
+            shared = pfx_len;
+            enc_len = sfx_len;
+        }
+
+        sfxp -= enc_len + key_extra;
         assert((void *)entry < sfxp);
+        assert((void *)(khp + 1) <= sfxp);
 
         if (key_extra) {
             /* kmdoff is too large for u16 */
@@ -731,14 +845,32 @@ wbt_leaf_publish(struct wbb *wbb)
         assert((void *)kin >= wbb->cnode_key_stage);
         assert((void *)kin < wbb->cnode_key_stage + (wbb->cnode_key_stage_pgc * PAGE_SIZE));
 
-        memcpy(sfxp + key_extra, kin->kdata + pfx_len, sfx_len);
         omf_set_lfe_koff(entry, sfxp - wbb->cnode);
+        *khp++ = cpu_to_le32(wbt6_keyhead(kin->kdata + pfx_len, sfx_len));
+
+        /* Copy in the key and store it as the last key. */
+        if (wbb->fcode && !restart) {
+            u8 *p = sfxp + key_extra;
+
+            p[0] = shared & 0xff;
+            p[1] = shared >> 8;
+            memcpy(p + sizeof(u16), kin->kdata + shared, kin->klen - shared);
+
+            wbb->wbt_last_kobj.ko_pfx = rkey;
+            wbb->wbt_last_kobj.ko_pfx_len = shared;
+            wbb->wbt_last_kobj.ko_sfx = p + sizeof(u16);
+            wbb->wbt_last_kobj.ko_sfx_len = kin->klen - shared;
+        } else {
+            memcpy(sfxp + key_extra, kin->kdata + shared, enc_len);
 
-        /* Store last key. */
-        wbb->wbt_last_kobj.ko_pfx = wbb->cnode + sizeof(*node_hdr);
-        wbb->wbt_last_kobj.ko_pfx_len = pfx_len;
-        wbb->wbt_last_kobj.ko_sfx = sfxp + key_extra;
-        wbb->wbt_last_kobj.ko_sfx_len = sfx_len;
+            if (restart)
+                rkey = sfxp + key_extra;
+
+            wbb->wbt_last_kobj.ko_pfx = restart ? rkey : wbb->cnode + sizeof(*node_hdr);
+            wbb->wbt_last_kobj.ko_pfx_len = pfx_len;
+            wbb->wbt_last_kobj.ko_sfx = sfxp + key_extra + (restart ? pfx_len : 0);
+            wbb->wbt_last_kobj.ko_sfx_len = sfx_len;
+        }
 
         assert(pfx_len + sfx_len <= HSE_KVS_KLEN_MAX);
 
@@ -752,6 +884,39 @@ wbt_leaf_publish(struct wbb *wbb)
     }
 }
 
+/* Length of the longest common prefix of @key and @ko.
+ */
+static uint
+wbb_kobj_lcp(const void *key, uint klen, const struct key_obj *ko)
+{
+    uint len = min_t(uint, klen, ko->ko_pfx_len);
+    uint lcp = memlcp(key, ko->ko_pfx, len);
+
+    if (lcp < ko->ko_pfx_len)
+        return lcp;
+
+    len = min_t(uint, klen - lcp, ko->ko_sfx_len);
+
+    return lcp + memlcp(key + lcp, ko->ko_sfx, len);
+}
+
+/* Length of @ko front-coded as the next key of the current leaf node.  It is
+ * stored in full if it's a restart key, else as the length of the part it
+ * shares with the restart key followed by the rest of it.
+ */
+static uint
+wbb_fcode_len(struct wbb *wbb, const struct key_obj *ko, uint klen)
+{
+    struct key_stage_entry_leaf *rst;
+
+    if (wbb->cnode_nkeys % WBT_RESTART_INTERVAL == 0)
+        return klen;
+
+    rst = wbb->cnode_key_stage + wbb->cnode_restart_off;
+
+    return sizeof(u16) + klen - wbb_kobj_lcp(rst->kdata, rst->klen, ko);
+}
+
 merr_t
 wbb_add_entry(
     struct wbb *          wbb,
@@ -772,6 +937,7 @@ wbb_add_entry(
     size_t new_pfx_len;
     void * end;
     uint   klen = key_obj_len(kobj);
+    uint   fc_len = 0;
 
     struct key_stage_entry_leaf *kst_leaf;
 
@@ -806,7 +972,7 @@ wbb_add_entry(
      */
     kmd_pgc = (entry_kmd_off + encoded_cnt_len + key_kmd_len + PAGE_SIZE - 1) / PAGE_SIZE;
     wbb->max_pgc = max_pgc;
-    wbb->used_pgc = wbb->nodec + wbb->max_inodec + kmd_pgc;
+    wbb->used_pgc = wbb->leaf_pgc + wbb->max_inodec + kmd_pgc;
     if (wbb->used_pgc > wbb->max_pgc)
         return 0; /* not an error */
 
@@ -817,15 +983,25 @@ wbb_add_entry(
 
     wbb->cnode_sumlen += klen;
 
-    /* Create a new node if space exceeds PAGE_SIZE */
-    space = sizeof(struct wbt_node_hdr_omf) + new_pfx_len +
-            ((wbb->cnode_nkeys + 1) * sizeof(struct wbt_lfe_omf)) + wbb->cnode_sumlen +
-            (sizeof(u32) * wbb->cnode_key_extra_cnt) - ((wbb->cnode_nkeys + 1) * new_pfx_len);
+    /* Create a new node if space exceeds PAGE_SIZE.  The space taken by
+     * front-coded keys does not depend on the node prefix.
+     */
+    space = wbt6_kh_off(new_pfx_len, wbb->cnode_nkeys + 1) +
+            ((wbb->cnode_nkeys + 1) * WBT_KEYHEAD_LEN) + (sizeof(u32) * wbb->cnode_key_extra_cnt);
+
+    if (wbb->fcode) {
+        fc_len = wbb_fcode_len(wbb, kobj, klen);
+        wbb->cnode_fc_sumlen += fc_len;
+        space += wbb->cnode_fc_sumlen;
+    } else {
+        space += wbb->cnode_sumlen - ((wbb->cnode_nkeys + 1) * new_pfx_len);
+    }
 
     if (space > PAGE_SIZE) {
 
         /* close out current node */
         wbt_leaf_publish(wbb);
+        wbb_leaf_compress(wbb);
 
         /* new node allocate fail --> out of space (not error) */
         err = _new_leaf_node(wbb, key_obj_len(&wbb->wbt_last_kobj));
@@ -843,6 +1019,7 @@ wbb_add_entry(
 
         wbb->cnode_pfx_len = klen;
         wbb->cnode_sumlen += klen;
+        wbb->cnode_fc_sumlen += wbb->fcode ? klen : 0;
         key_extra = 0; /* reset key_extra */
     } else {
         wbb->cnode_pfx_len = new_pfx_len;
@@ -906,6 +1083,9 @@ wbb_add_entry(
 
     memcpy(kst_leaf->kdata + kobj->ko_pfx_len, kobj->ko_sfx, kobj->ko_sfx_len);
 
+    if (wbb->cnode_nkeys % WBT_RESTART_INTERVAL == 0)
+        wbb->cnode_restart_off = wbb->cnode_key_cursor - wbb->cnode_key_stage;
+
     wbb->cnode_key_cursor += sizeof(*kst_leaf) + klen;
 
     if (wbb->cnode_nkeys == 0)
@@ -913,16 +1093,50 @@ wbb_add_entry(
 
     wbb->cnode_nkeys++;
 
-    *wbt_pgc = wbb->nodec + wbb->max_inodec + get_kmd_pgc(wbb);
+    *wbt_pgc = wbb->leaf_pgc + wbb->max_inodec + get_kmd_pgc(wbb);
     *added = true;
     return 0;
 }
 
+static inline uint
+wbb_version(struct wbb *wbb)
+{
+    if (wbb && wbb->lcomp)
+        return WBT_TREE_VERSION8;
+
+    return wbb && wbb->fcode ? WBT_TREE_VERSION7 : WBT_TREE_VERSION6;
+}
+
+/* Finish the offset table of the compressed leaf nodes, move the nodes right
+ * behind it and return the length of the leaf node region.
+ */
+static size_t
+wbb_leaf_region(struct wbb *wbb)
+{
+    u32 *  offv = wbb->lc_data;
+    size_t tlen, len;
+    uint   i;
+
+    assert(wbb->lc_cnt == wbb->nodec);
+
+    tlen = WBT_LEAF_OFFV_LEN(wbb->lc_cnt);
+    memmove(wbb->lc_data + tlen, wbb->lc_data + WBB_LC_OFFV_CAP(wbb), wbb->lc_used);
+
+    offv[wbb->lc_cnt] = wbb->lc_used;
+    for (i = 0; i <= wbb->lc_cnt; i++)
+        offv[i] = cpu_to_le32(offv[i] + tlen);
+
+    len = tlen + wbb->lc_used;
+    memset(wbb->lc_data + len, 0, PAGE_ALIGN(len) - len);
+
+    return PAGE_ALIGN(len);
+}
+
 void
 wbb_hdr_init(struct wbb *wbb, struct wbt_hdr_omf *hdr)
 {
     omf_set_wbt_magic(hdr, WBT_TREE_MAGIC);
-    omf_set_wbt_version(hdr, WBT_TREE_VERSION);
+    omf_set_wbt_version(hdr, wbb_version(wbb));
 }
 
 merr_t
@@ -937,7 +1151,7 @@ wbb_freeze(
 {
     merr_t err;
     uint   first_leaf_node, num_leaf_nodes, root_node;
-    uint   i, kmd_pgc;
+    uint   i, n, kmd_pgc;
 
     assert(*wbt_pgc <= max_pgc);
     if (!(*wbt_pgc <= max_pgc))
@@ -947,18 +1161,20 @@ wbb_freeze(
     if (!(wbb->nodec > 0))
         return merr(ev(EBUG));
 
+    /* write node header in the leaf node that was in progress */
+    assert(wbb->cnode_nkeys <= U16_MAX);
+    wbt_leaf_publish(wbb);
+    wbb_leaf_compress(wbb);
+
     kmd_pgc = get_kmd_pgc(wbb);
-    wbb->used_pgc = wbb->nodec + kmd_pgc;
+    wbb->leaf_pgc = wbb_leaf_pgc(wbb, 0);
+    wbb->used_pgc = wbb->leaf_pgc + kmd_pgc;
     wbb->max_pgc = max_pgc;
 
     assert(wbb->used_pgc <= max_pgc);
     if (!(wbb->used_pgc <= max_pgc))
         return merr(ev(EBUG));
 
-    /* write node header in the leaf node that was in progress */
-    assert(wbb->cnode_nkeys <= U16_MAX);
-    wbt_leaf_publish(wbb);
-
     /* get num_leaf_nodes now, b/c wbb->nodec
      * will increase as internal nodes are built.
      */
@@ -978,27 +1194,44 @@ wbb_freeze(
     /* format the wbtree header */
     memset(hdr, 0, sizeof(*hdr));
     omf_set_wbt_magic(hdr, WBT_TREE_MAGIC);
-    omf_set_wbt_version(hdr, WBT_TREE_VERSION);
+    omf_set_wbt_version(hdr, wbb_version(wbb));
     omf_set_wbt_leaf(hdr, first_leaf_node);
     omf_set_wbt_leaf_cnt(hdr, num_leaf_nodes);
     omf_set_wbt_root(hdr, root_node);
     omf_set_wbt_kmd_pgc(hdr, kmd_pgc);
+    omf_set_wbt_leaf_pgc(hdr, wbb->lcomp ? wbb->leaf_pgc : 0);
 
-    assert(iov_max >= KMD_CHUNKS + 1);
+    assert(iov_max >= KMD_CHUNKS + 2);
 
+    /* The compressed leaf nodes are followed by internal nodes, if any.
+     */
     iov[0].iov_base = wbb->nodev;
     iov[0].iov_len = wbb->nodec * PAGE_SIZE;
+    n = 1;
+
+    if (wbb->lcomp) {
+        iov[0].iov_base = wbb->lc_data;
+        iov[0].iov_len = wbb_leaf_region(wbb);
+        assert(iov[0].iov_len == wbb->leaf_pgc * PAGE_SIZE);
+
+        if (wbb->nodec > num_leaf_nodes) {
+            iov[n].iov_base = wbb->nodev + num_leaf_nodes * PAGE_SIZE;
+            iov[n].iov_len = (wbb->nodec - num_leaf_nodes) * PAGE_SIZE;
+            n++;
+        }
+    }
+
     for (i = 0; i <= wbb->kmd_iov_index; i++) {
         size_t len = wbb->kmd_iov[i].iov_len;
         size_t padded_len = PAGE_ALIGN(len);
 
         memset(wbb->kmd_iov[i].iov_base + wbb->kmd_iov[i].iov_len, 0, padded_len - len);
-        iov[i + 1].iov_base = wbb->kmd_iov[i].iov_base;
-        iov[i + 1].iov_len = padded_len;
+        iov[n].iov_base = wbb->kmd_iov[i].iov_base;
+        iov[n].iov_len = padded_len;
+        n++;
     }
 
-    /* +1 for nodes, kmd_iov_index+1 for kmd */
-    *iov_cnt = wbb->kmd_iov_index + 2;
+    *iov_cnt = n;
     *wbt_pgc = wbb->used_pgc;
 
     return 0;
@@ -1007,18 +1240,25 @@ wbb_freeze(
 void
 wbb_init(struct wbb *wbb, void *nodev, uint max_pgc, uint *wbt_pgc)
 {
-    void *kst, *iov_base[KMD_CHUNKS];
+    void *kst, *lcd, *iov_base[KMD_CHUNKS];
     uint  kst_pgc;
     uint  i;
+    bool  fcode, lcomp;
 
     for (i = 0; i < KMD_CHUNKS; i++)
         iov_base[i] = wbb->kmd_iov[i].iov_base;
 
     kst = wbb->cnode_key_stage;
     kst_pgc = wbb->cnode_key_stage_pgc;
+    fcode = wbb->fcode;
+    lcomp = wbb->lcomp;
+    lcd = wbb->lc_data;
 
     memset(wbb, 0, sizeof(*wbb));
 
+    wbb->fcode = fcode;
+    wbb->lcomp = lcomp;
+    wbb->lc_data = lcd;
     wbb->max_pgc = max_pgc;
     wbb->nodev_len = max_pgc;
     wbb->nodev = nodev;
@@ -1030,15 +1270,15 @@ wbb_init(struct wbb *wbb, void *nodev, uint max_pgc, uint *wbt_pgc)
     for (i = 0; i < KMD_CHUNKS; i++)
         wbb->kmd_iov[i].iov_base = iov_base[i];
 
-    *wbt_pgc = wbb->nodec;
+    *wbt_pgc = wbb->used_pgc;
 }
 
 merr_t
 wbb_create(
     struct wbb **wbb_out,
     uint         max_pgc,
-    uint *       wbt_pgc /* in/out */
-    )
+    uint *       wbt_pgc, /* in/out */
+    bool         fcode)
 {
     struct wbb *wbb;
     void *      nodev;
@@ -1053,6 +1293,7 @@ wbb_create(
     if (!wbb)
         return merr(ev(ENOMEM));
 
+    wbb->fcode = fcode;
     wbb->cnode_key_stage_pgc = 2;
     wbb->cnode_key_stage = malloc(wbb->cnode_key_stage_pgc * PAGE_SIZE);
     if (ev(!wbb->cnode_key_stage)) {
@@ -1089,6 +1330,27 @@ wbb_reset(struct wbb *wbb, uint *wbt_pgc)
     }
 }
 
+merr_t
+wbb_set_lcomp(struct wbb *wbb, bool lcomp, uint *wbt_pgc)
+{
+    assert(wbb_entries(wbb) == 0);
+
+    if (lcomp && !wbb->lc_data) {
+        wbb->lc_data =
+            alloc_page_aligned(WBB_LC_OFFV_CAP(wbb) + wbb->nodev_len * PAGE_SIZE, GFP_KERNEL);
+        if (ev(!wbb->lc_data))
+            return merr(ENOMEM);
+    }
+
+    wbb->lcomp = lcomp;
+    if (lcomp)
+        wbb->fcode = true;
+
+    wbb_reset(wbb, wbt_pgc);
+
+    return 0;
+}
+
 void
 wbb_destroy(struct wbb *wbb)
 {
@@ -1107,6 +1369,7 @@ wbb_destroy(struct wbb *wbb)
         for (i = 0; i < KMD_CHUNKS; i++)
             free_aligned(wbb->kmd_iov[i].iov_base);
         free_aligned(wbb->nodev);
+        free_aligned(wbb->lc_data);
         free(wbb->cnode_key_stage);
         free(wbb);
     }
@@ -19,15 +19,25 @@ struct wbt_hdr_omf;
  * @wbb_out: (output) builder handle
  * @max_pgc: (in) max allowable size of wbtree in pages
  * @wbt_pgc: (in/out) actual size (in pages) of wbtree creation
+ * @fcode:   (in) front-code the keys in leaf nodes
  */
 /* MTF_MOCK */
 merr_t
-wbb_create(struct wbb **wbb_out, uint max_pgc, uint *wbt_pgc);
+wbb_create(struct wbb **wbb_out, uint max_pgc, uint *wbt_pgc, bool fcode);
 
 /* MTF_MOCK */
 void
 wbb_reset(struct wbb *wbb, uint *wbt_pgc);
 
+/**
+ * wbb_set_lcomp() - set whether to compress the leaf nodes of an empty wbtree
+ * @wbb:     builder handle
+ * @lcomp:   (in) compress the leaf nodes, which also front-codes their keys
+ * @wbt_pgc: (out) size (in pages) of the reset wbtree
+ */
+merr_t
+wbb_set_lcomp(struct wbb *wbb, bool lcomp, uint *wbt_pgc);
+
 /**
  * wbb_destroy() - destroy a wbtree builder
  */
@@ -38,6 +48,13 @@ wbb_destroy(struct wbb *wbb);
 uint
 wbb_entries(struct wbb *wbb);
 
+/**
+ * wbb_leaf_node() - number of the leaf node holding the last key added
+ * @wbb: builder handle
+ */
+uint
+wbb_leaf_node(struct wbb *wbb);
+
 /**
  * wbb_add_entry() - add an entry to a wbtree
  * @wbb: builder handle
@@ -64,7 +81,7 @@ wbb_add_entry(
     uint *                wbt_pgc,
     bool *                added);
 
-#define WBB_FREEZE_IOV_MAX 33
+#define WBB_FREEZE_IOV_MAX 34
 
 void
 wbb_hdr_init(struct wbb *wbb, struct wbt_hdr_omf *hdr);
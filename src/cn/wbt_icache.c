@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse/kvdb_perfc.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/list.h>
+#include <hse_util/minmax.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/perfc.h>
+#include <hse_util/rcu.h>
+#include <hse_util/page.h>
+
+#include "kvs_mblk_desc.h"
+#include "wbt_reader.h"
+#include "wbt_icache.h"
+#include "omf.h"
+
+#define WBT_ICACHE_SHARDS (16) /* must agree with ic_shard_idx() */
+
+/**
+ * struct wbt_icache_entry - cached internal nodes of one wbtree
+ * @ie_link:   shard clock list linkage
+ * @ie_rcu:    deferred free
+ * @ie_slot:   kblock's slot that publishes this entry
+ * @ie_shard:  index of the shard that owns this entry
+ * @ie_ref:    remaining trips around the clock, re-armed on each hit
+ * @ie_weight: trips around the clock granted by the entry's cn level
+ * @ie_size:   size of the entry including the nodes
+ * @ie_nodes:  copy of the internal nodes
+ */
+struct wbt_icache_entry {
+    struct list_head          ie_link;
+    struct rcu_head           ie_rcu;
+    struct wbt_icache_entry **ie_slot;
+    uint                      ie_shard;
+    atomic_t                  ie_ref;
+    int                       ie_weight;
+    size_t                    ie_size;
+    char                      ie_nodes[] __aligned(SMP_CACHE_BYTES);
+};
+
+struct ic_shard {
+    spinlock_t       is_lock;
+    size_t           is_size;
+    struct list_head is_clock;
+} __aligned(SMP_CACHE_BYTES);
+
+struct wbt_icache {
+    size_t            ic_shard_cap;
+    struct perfc_set *ic_pc;
+    struct ic_shard   ic_shardv[WBT_ICACHE_SHARDS];
+};
+
+static void
+ic_entry_free(struct rcu_head *rh)
+{
+    struct wbt_icache_entry *ie = container_of(rh, struct wbt_icache_entry, ie_rcu);
+
+    free_aligned(ie);
+}
+
+/* Scatter kblock ids, whose low bits are not well distributed, over the shards.
+ */
+static inline uint
+ic_shard_idx(u64 blkid)
+{
+    return (blkid * 0x9e3779b97f4a7c15ull) >> 60;
+}
+
+/* Unlink an entry and retract its slot.  Caller must hold the shard lock.
+ */
+static void
+ic_unlink(struct ic_shard *is, struct wbt_icache_entry *ie)
+{
+    list_del(&ie->ie_link);
+    is->is_size -= ie->ie_size;
+    rcu_assign_pointer(*ie->ie_slot, NULL);
+}
+
+/* The nodes of the upper levels are visited by nearly every lookup that
+ * reaches cn, so give them more trips around the clock.
+ */
+static inline int
+ic_level_weight(uint level)
+{
+    return level < 2 ? 3 - level : 1;
+}
+
+merr_t
+wbt_icache_create(size_t capacity, struct perfc_set *pc, struct wbt_icache **icp)
+{
+    struct wbt_icache *ic;
+    int                i;
+
+    if (ev(!icp || !capacity))
+        return merr(EINVAL);
+
+    *icp = NULL;
+
+    ic = alloc_aligned(sizeof(*ic), __alignof(*ic), GFP_KERNEL);
+    if (ev(!ic))
+        return merr(ENOMEM);
+
+    memset(ic, 0, sizeof(*ic));
+    ic->ic_shard_cap = capacity / WBT_ICACHE_SHARDS;
+    ic->ic_pc = pc;
+
+    for (i = 0; i < WBT_ICACHE_SHARDS; ++i) {
+        struct ic_shard *is = ic->ic_shardv + i;
+
+        spin_lock_init(&is->is_lock);
+        INIT_LIST_HEAD(&is->is_clock);
+    }
+
+    *icp = ic;
+
+    return 0;
+}
+
+void
+wbt_icache_destroy(struct wbt_icache *ic)
+{
+    int i;
+
+    if (!ic)
+        return;
+
+    for (i = 0; i < WBT_ICACHE_SHARDS; ++i) {
+        struct ic_shard *        is = ic->ic_shardv + i;
+        struct wbt_icache_entry *ie, *next;
+
+        /* All kblocks should have removed their entries by now.
+         */
+        assert(list_empty(&is->is_clock));
+
+        list_for_each_entry_safe (ie, next, &is->is_clock, ie_link)
+            free_aligned(ie);
+    }
+
+    free_aligned(ic);
+}
+
+const void *
+wbt_icache_get(
+    struct wbt_icache *         ic,
+    struct wbt_icache_entry **  slot,
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        level)
+{
+    struct wbt_icache_entry *ie, *old;
+    struct list_head         victims;
+    struct ic_shard *        is;
+    const void *             src;
+    uint                     first, nodec, shard;
+    u64                      evicted = 0;
+
+    ie = rcu_dereference(*slot);
+    if (ie) {
+        if (atomic_read(&ie->ie_ref) < ie->ie_weight)
+            atomic_set(&ie->ie_ref, ie->ie_weight);
+
+        perfc_inc(ic->ic_pc, PERFC_RA_CNGET_ICHIT);
+        return ie->ie_nodes;
+    }
+
+    /* Only v5 and later trees are cached, and only if the root is an
+     * internal node.
+     */
+    if (wbd->wbd_version < WBT_TREE_VERSION5)
+        return NULL;
+
+    first = wbd->wbd_leaf + wbd->wbd_leaf_cnt;
+    if (wbd->wbd_root < first)
+        return NULL;
+
+    nodec = wbd->wbd_root - first + 1;
+    if (sizeof(*ie) + nodec * PAGE_SIZE > ic->ic_shard_cap)
+        return NULL;
+
+    ie = alloc_aligned(sizeof(*ie) + nodec * PAGE_SIZE, SMP_CACHE_BYTES, GFP_KERNEL);
+    if (ev(!ie))
+        return NULL;
+
+    shard = ic_shard_idx(kbd->mb_id);
+    is = ic->ic_shardv + shard;
+
+    ie->ie_slot = slot;
+    ie->ie_shard = shard;
+    ie->ie_weight = ic_level_weight(level);
+    ie->ie_size = sizeof(*ie) + nodec * PAGE_SIZE;
+    atomic_set(&ie->ie_ref, ie->ie_weight);
+
+    src = kbd->map_base + wbt_inode_pg(wbd, first) * PAGE_SIZE;
+    memcpy(ie->ie_nodes, src, nodec * PAGE_SIZE);
+
+    INIT_LIST_HEAD(&victims);
+
+    spin_lock(&is->is_lock);
+    old = *slot;
+    if (old) {
+        /* Lost a race with a concurrent fill of the same kblock.
+         */
+        spin_unlock(&is->is_lock);
+        free_aligned(ie);
+        return old->ie_nodes;
+    }
+
+    list_add_tail(&ie->ie_link, &is->is_clock);
+    is->is_size += ie->ie_size;
+    rcu_assign_pointer(*slot, ie);
+
+    /* Sweep the clock from its head, giving each armed entry another
+     * trip around and evicting the first one that is not.
+     */
+    while (is->is_size > ic->ic_shard_cap) {
+        old = list_first_entry(&is->is_clock, struct wbt_icache_entry, ie_link);
+        if (old == ie)
+            break;
+
+        if (atomic_read(&old->ie_ref) > 0) {
+            atomic_dec(&old->ie_ref);
+            list_del(&old->ie_link);
+            list_add_tail(&old->ie_link, &is->is_clock);
+            continue;
+        }
+
+        ic_unlink(is, old);
+        list_add(&old->ie_link, &victims);
+        ++evicted;
+    }
+    spin_unlock(&is->is_lock);
+
+    while (!list_empty(&victims)) {
+        old = list_first_entry(&victims, struct wbt_icache_entry, ie_link);
+        list_del(&old->ie_link);
+        call_rcu(&old->ie_rcu, ic_entry_free);
+    }
+
+    perfc_inc(ic->ic_pc, PERFC_RA_CNGET_ICMISS);
+    if (evicted)
+        perfc_add(ic->ic_pc, PERFC_RA_CNGET_ICEVICT, evicted);
+
+    return ie->ie_nodes;
+}
+
+void
+wbt_icache_remove(struct wbt_icache *ic, struct wbt_icache_entry **slot)
+{
+    struct wbt_icache_entry *ie;
+    struct ic_shard *        is;
+
+    rcu_read_lock();
+    ie = rcu_dereference(*slot);
+    if (ie) {
+        is = ic->ic_shardv + ie->ie_shard;
+
+        spin_lock(&is->is_lock);
+        if (*slot == ie)
+            ic_unlink(is, ie);
+        else
+            ie = NULL;
+        spin_unlock(&is->is_lock);
+    }
+    rcu_read_unlock();
+
+    if (ie)
+        call_rcu(&ie->ie_rcu, ic_entry_free);
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_CN_WBT_ICACHE_H
+#define HSE_KVS_CN_WBT_ICACHE_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+struct kvs_mblk_desc;
+struct wbt_desc;
+struct perfc_set;
+
+/* The index-node cache holds heap copies of the internal nodes of kblock
+ * wbtrees so that point lookups need not fault them back in from the mcache
+ * map after scans or vblock reads have churned the page cache.  It is shared
+ * by all the kvsets of a cn tree and is bounded by a byte budget.
+ *
+ * Each kblock has at most one entry, published through an RCU-protected
+ * slot owned by the kblock (see struct kvset_kblk).  Eviction is by clock,
+ * where a hit arms an entry with a weight determined by the cn level of its
+ * kvset so that the nodes of the upper levels, which are visited by nearly
+ * every lookup, survive longer than those of the lower levels.
+ */
+struct wbt_icache;
+struct wbt_icache_entry;
+
+/**
+ * wbt_icache_create() - create an index-node cache
+ * @capacity: max bytes of internal nodes to cache
+ * @pc:       perf counter set (PERFC_EN_CNGET), may be NULL
+ * @icp:      (output) index-node cache handle
+ */
+merr_t
+wbt_icache_create(size_t capacity, struct perfc_set *pc, struct wbt_icache **icp);
+
+/**
+ * wbt_icache_destroy() - release an index-node cache and all its entries
+ * @ic: index-node cache handle
+ */
+void
+wbt_icache_destroy(struct wbt_icache *ic);
+
+/**
+ * wbt_icache_get() - get the cached internal nodes of a wbtree
+ * @ic:    index-node cache handle
+ * @slot:  kblock's entry slot
+ * @kbd:   kblock descriptor
+ * @wbd:   wbtree descriptor
+ * @level: cn level of the kvset
+ *
+ * Fills the cache from the kblock on a miss.  The caller must hold the RCU
+ * read lock, and the returned nodes remain valid until it is released.
+ *
+ * Return: the internal nodes (node @wbd_leaf + @wbd_leaf_cnt first) or NULL
+ * if they are not cacheable.
+ */
+const void *
+wbt_icache_get(
+    struct wbt_icache *         ic,
+    struct wbt_icache_entry **  slot,
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        level);
+
+/**
+ * wbt_icache_remove() - drop the entry published through a kblock's slot
+ * @ic:   index-node cache handle
+ * @slot: kblock's entry slot
+ *
+ * Must be called before the kblock is unmapped and its slot freed.
+ */
+void
+wbt_icache_remove(struct wbt_icache *ic, struct wbt_icache_entry **slot);
+
+#endif
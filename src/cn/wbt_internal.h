@@ -10,6 +10,10 @@
 
 #include <hse_util/inttypes.h>
 #include <hse_util/byteorder.h>
+#include <hse_util/page.h>
+#include <hse_util/keycmp.h>
+#include <hse_util/compression.h>
+#include <hse_util/event_counter.h>
 
 #include "omf.h"
 
@@ -90,6 +94,224 @@ wbt_ine_key(void *node, struct wbt_ine_omf *ine, const void **kdata, uint *klen)
     *klen = end - start;
 }
 
+/*
+ * Version 6 - version 5 nodes plus key heads
+ */
+
+/* Offset of the key heads in a node with nentries entries (LFEs or INEs).
+ */
+static __always_inline uint
+wbt6_kh_off(uint pfx_len, uint nentries)
+{
+    uint off = sizeof(struct wbt_node_hdr_omf) + pfx_len + nentries * sizeof(struct wbt_lfe_omf);
+
+    return ALIGN(off, sizeof(u32));
+}
+
+static __always_inline const __le32 *
+wbt6_lfe_kh(void *node)
+{
+    return node + wbt6_kh_off(omf_wbn_pfx_len(node), omf_wbn_num_keys(node));
+}
+
+static __always_inline const __le32 *
+wbt6_ine_kh(void *node)
+{
+    return node + wbt6_kh_off(omf_wbn_pfx_len(node), omf_wbn_num_keys(node) + 1);
+}
+
+/* Return the head of a key (or key suffix): its first WBT_KEYHEAD_LEN bytes,
+ * zero-padded, as an integer that sorts in memcmp order.  If the head of key
+ * A is less than the head of key B then A < B, hence keys with heads unequal
+ * to that of the search key can be excluded without looking at their data.
+ */
+static __always_inline u32
+wbt6_keyhead(const void *key, uint klen)
+{
+    const u8 *k = key;
+    u32       kh = 0;
+    int       i;
+
+    if (klen >= WBT_KEYHEAD_LEN)
+        return ((u32)k[0] << 24) | ((u32)k[1] << 16) | ((u32)k[2] << 8) | k[3];
+
+    for (i = 0; i < WBT_KEYHEAD_LEN; ++i)
+        kh = (kh << 8) | (i < klen ? k[i] : 0);
+
+    return kh;
+}
+
+/* Narrow a binary search over the nkeys keys of a node to the inclusive range
+ * [*first, *last] of keys whose heads equal kh.  Keys before the range are
+ * less than any key with head kh and keys after it are greater, so a binary
+ * search over the range ends with 'first' at the same slot as a search over
+ * the whole node.  The loop is free of branches so that the compiler can
+ * vectorize it.
+ */
+static __always_inline void
+wbt6_kh_range(const __le32 *khv, int nkeys, u32 kh, int *first, int *last)
+{
+    int lt = 0, le = 0;
+    int i;
+
+    for (i = 0; i < nkeys; ++i) {
+        u32 h = le32_to_cpu(khv[i]);
+
+        lt += h < kh;
+        le += h <= kh;
+    }
+
+    *first = lt;
+    *last = le - 1;
+}
+
+/*
+ * Version 7 - version 6 with front-coded leaf keys
+ */
+
+/* Get the key of a front-coded leaf entry in two pieces: the first @kpfx_len
+ * bytes of the full key of the entry's restart entry, and the rest of the
+ * key.  For a restart entry the first piece is just the node prefix.
+ */
+static __always_inline void
+wbt7_lfe_key(
+    void *              node,
+    struct wbt_lfe_omf *lfe,
+    const void **       kpfx,
+    uint *              kpfx_len,
+    const void **       kdata,
+    uint *              klen)
+{
+    struct wbt_lfe_omf *lfe0 = wbt_lfe(node, 0);
+    uint                nth = lfe - lfe0;
+    const void *        rkey;
+    const u8 *          p;
+    uint                rklen;
+
+    wbt_lfe_key(node, lfe0 + nth - nth % WBT_RESTART_INTERVAL, &rkey, &rklen);
+    *kpfx = rkey;
+
+    if (nth % WBT_RESTART_INTERVAL == 0) {
+        *kpfx_len = omf_wbn_pfx_len(node);
+        *kdata = rkey + *kpfx_len;
+        *klen = rklen - *kpfx_len;
+        return;
+    }
+
+    wbt_lfe_key(node, lfe, kdata, klen);
+
+    p = *kdata;
+    *kpfx_len = p[0] | (p[1] << 8);
+    *kdata = p + sizeof(u16);
+    *klen -= sizeof(u16);
+}
+
+/* Get the suffix (the key less the node prefix) of a leaf entry's key, in two
+ * pieces if the node is front-coded, else all in the second piece.
+ */
+static __always_inline void
+wbt_lfe_sfx(
+    void *              node,
+    struct wbt_lfe_omf *lfe,
+    bool                fcode,
+    const void **       sfx1,
+    uint *              sfx1_len,
+    const void **       sfx2,
+    uint *              sfx2_len)
+{
+    uint pfx_len;
+
+    if (!fcode) {
+        *sfx1 = NULL;
+        *sfx1_len = 0;
+        wbt_lfe_key(node, lfe, sfx2, sfx2_len);
+        return;
+    }
+
+    wbt7_lfe_key(node, lfe, sfx1, sfx1_len, sfx2, sfx2_len);
+
+    pfx_len = omf_wbn_pfx_len(node);
+    *sfx1 += pfx_len;
+    *sfx1_len -= pfx_len;
+}
+
+/* keycmp() of @kt against the key formed by @k1 followed by @k2.
+ */
+static __always_inline int
+wbt7_keycmp(const void *kt, uint kt_len, const void *k1, uint k1_len, const void *k2, uint k2_len)
+{
+    int rc;
+
+    if (!k1_len)
+        return keycmp(kt, kt_len, k2, k2_len);
+
+    if (kt_len < k1_len)
+        return keycmp(kt, kt_len, k1, k1_len);
+
+    rc = memcmp(kt, k1, k1_len);
+
+    return rc ?: keycmp(kt + k1_len, kt_len - k1_len, k2, k2_len);
+}
+
+/* keycmp_prefix() of prefix @kt against the key formed by @k1 followed by @k2.
+ */
+static __always_inline int
+wbt7_keycmp_prefix(
+    const void *kt,
+    uint        kt_len,
+    const void *k1,
+    uint        k1_len,
+    const void *k2,
+    uint        k2_len)
+{
+    int rc;
+
+    if (!k1_len)
+        return keycmp_prefix(kt, kt_len, k2, k2_len);
+
+    if (k1_len + k2_len < kt_len)
+        return 1;
+
+    if (kt_len <= k1_len)
+        return memcmp(kt, k1, kt_len);
+
+    rc = memcmp(kt, k1, k1_len);
+
+    return rc ?: memcmp(kt + k1_len, k2, kt_len - k1_len);
+}
+
+/*
+ * Version 8
+ */
+
+/* Byte offset of leaf node @nth in a region of compressed leaf nodes.
+ */
+static __always_inline uint
+wbt8_leaf_off(const void *rgn, uint nth)
+{
+    return le32_to_cpu(((const __le32 *)rgn)[nth]);
+}
+
+/* Decompress the @clen bytes of a leaf node at @src into the page at @node.
+ */
+static inline merr_t
+wbt8_leaf_decode(const void *src, uint clen, void *node)
+{
+    merr_t err;
+    uint   len;
+
+    if (clen >= WBT_NODE_SIZE) {
+        memcpy(node, src, WBT_NODE_SIZE);
+        return 0;
+    }
+
+    err = decompress_lz4(src, clen, node, WBT_NODE_SIZE, &len);
+    if (ev(err))
+        return err;
+
+    return len == WBT_NODE_SIZE ? 0 : merr(ev(EILSEQ));
+}
+
 /*
  * Version 4
  */
@@ -12,6 +12,7 @@
 
 #include <hse_ikvdb/tuple.h>
 #include <hse_ikvdb/omf_kmd.h>
+#include <hse_ikvdb/limits.h>
 
 #include "wbt_internal.h"
 #include "kvs_mblk_desc.h"
@@ -34,31 +35,38 @@ static atomic_t           wbti_init_ref;
 void
 wbt_read_kmd_vref(const void *kmd, size_t *off, u64 *seq, struct kvs_vtuple_ref *vref)
 {
+    struct kmd_ent ent;
     enum kmd_vtype vtype;
-    uint           vbidx = 0;
-    uint           vboff = 0;
-    uint           vlen = 0;
-    const void *   vdata = 0;
 
-    kmd_type_seq(kmd, off, &vtype, seq);
+    kmd_ent_decode(kmd, off, &ent);
+
+    *seq = ent.seq;
+    vtype = ent.vtype;
 
     switch (vtype) {
         case vtype_val:
-            kmd_val(kmd, off, &vbidx, &vboff, &vlen);
             /* assert no truncation */
-            assert(vbidx <= U16_MAX);
-            assert(vboff <= U32_MAX);
-            assert(vlen <= U32_MAX);
-            vref->vb.vr_index = vbidx;
-            vref->vb.vr_off = vboff;
-            vref->vb.vr_len = vlen;
+            assert(ent.vbidx <= U16_MAX);
+            vref->vb.vr_index = ent.vbidx;
+            vref->vb.vr_off = ent.vboff;
+            vref->vb.vr_len = ent.vlen;
+            break;
+        case vtype_cval:
+            assert(ent.vbidx <= U16_MAX);
+            vref->vb.vr_index = ent.vbidx;
+            vref->vb.vr_off = ent.vboff;
+            vref->vb.vr_len = ent.vlen;
+            vref->vb.vr_complen = ent.complen;
             break;
         case vtype_ival:
-            kmd_ival(kmd, off, &vdata, &vlen);
-            /* assert no truncation */
-            assert(vlen <= U32_MAX);
-            vref->vi.vr_data = vdata;
-            vref->vi.vr_len = vlen;
+            vref->vi.vr_data = ent.vdata;
+            vref->vi.vr_len = ent.vlen;
+            break;
+        case vtype_lival:
+            assert(ent.vlen <= CN_IVAL_MAX);
+            vref->vi.vr_data = ent.vdata;
+            vref->vi.vr_len = ent.vlen;
+            vtype = vtype_ival;
             break;
         case vtype_zval:
         case vtype_tomb:
@@ -69,11 +77,41 @@ wbt_read_kmd_vref(const void *kmd, size_t *off, u64 *seq, struct kvs_vtuple_ref
     vref->vr_type = vtype;
 }
 
+bool
+wbt_read_kmd_seek(const void *kmd, size_t *off, u64 seq, u64 *vseq, struct kvs_vtuple_ref *vref)
+{
+    uint nvals;
+
+    nvals = kmd_count(kmd, off);
+
+    /* Entries are in descending seqno order.  Only the entry visible at
+     * seq is decoded in full, those newer than seq are stepped over.
+     */
+    while (nvals--) {
+        enum kmd_vtype vtype;
+        size_t         ent = *off;
+
+        kmd_type_seq(kmd, off, &vtype, vseq);
+        if (seq >= *vseq) {
+            *off = ent;
+            wbt_read_kmd_vref(kmd, off, vseq, vref);
+            return true;
+        }
+
+        kmd_skip_vref(kmd, off, vtype);
+    }
+
+    return false;
+}
+
 bool
 wbti_seek(struct wbti *self, struct kvs_ktuple *seek)
 {
     switch (self->wbd->wbd_version) {
         case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
             return wbti5_seek(self, seek);
         case WBT_TREE_VERSION4:
         case WBT_TREE_VERSION3:
@@ -88,6 +126,9 @@ wbti_next(struct wbti *self, const void **kdata, uint *klen, const void **kmd)
 {
     switch (self->wbd->wbd_version) {
         case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
             return wbti5_next(self, kdata, klen, kmd);
         case WBT_TREE_VERSION4:
         case WBT_TREE_VERSION3:
@@ -108,6 +149,9 @@ wbti_reset(
 {
     switch (desc->wbd_version) {
         case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
             wbti5_reset(self, kbd, desc, seek, reverse, cache);
             break;
         case WBT_TREE_VERSION4:
@@ -126,6 +170,8 @@ wbti_alloc(struct wbti **wbti_out)
     if (ev(!self))
         return merr(ENOMEM);
 
+    self->lbuf = NULL;
+
     *wbti_out = self;
 
     return 0;
@@ -156,6 +202,9 @@ wbti_create(
 void
 wbti_destroy(struct wbti *self)
 {
+    if (self)
+        free_aligned(self->lbuf);
+
     kmem_cache_free(wbti_cache, self);
 }
 
@@ -164,6 +213,12 @@ wbti_prefix(struct wbti *self, const void **pfx, uint *pfx_len)
 {
     switch (self->wbd->wbd_version) {
         case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+            *pfx = self->pfx;
+            *pfx_len = self->pfx_len;
+            break;
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
             wbt_node_pfx(self->node, pfx, pfx_len);
             break;
         case WBT_TREE_VERSION4:
@@ -177,6 +232,7 @@ merr_t
 wbtr_read_vref(
     const struct kvs_mblk_desc *kbd,
     const struct wbt_desc *     wbd,
+    const void *                inodes,
     const struct kvs_ktuple *   kt,
     uint                        lcp,
     u64                         seq,
@@ -185,7 +241,10 @@ wbtr_read_vref(
 {
     switch (wbd->wbd_version) {
         case WBT_TREE_VERSION:
-            return wbtr5_read_vref(kbd, wbd, kt, lcp, seq, lookup_res, vref);
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
+            return wbtr5_read_vref(kbd, wbd, inodes, kt, lcp, seq, lookup_res, vref);
         case WBT_TREE_VERSION4:
         case WBT_TREE_VERSION3:
             return wbtr4_read_vref(kbd, wbd, kt, lcp, seq, lookup_res, vref);
@@ -194,6 +253,28 @@ wbtr_read_vref(
     return merr(ev(EBUG));
 }
 
+merr_t
+wbtr_read_vref_leaf(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        node_num,
+    const struct kvs_ktuple *   kt,
+    u64                         seq,
+    enum key_lookup_res *       lookup_res,
+    struct kvs_vtuple_ref *     vref)
+{
+    switch (wbd->wbd_version) {
+        case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
+            return wbtr5_read_vref_leaf(kbd, wbd, node_num, kt, seq, lookup_res, vref);
+    }
+
+    /* Only kblocks with a current wbtree have a hash index. */
+    return merr(ev(EBUG));
+}
+
 merr_t
 wbti_init(void)
 {
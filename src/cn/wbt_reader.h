@@ -11,6 +11,8 @@
 
 #include <hse_ikvdb/tuple.h>
 
+#include "omf.h"
+
 struct kvs_mblk_desc;
 struct wbt_desc;
 struct mpool;
@@ -24,6 +26,9 @@ struct wbti {
     void *                kmd;
     u32                   node_idx;
     u32                   lfe_idx;
+    const void *          pfx;     /* current key's prefix (v7 only) */
+    uint                  pfx_len; /* length of @pfx */
+    void *                lbuf;    /* decompressed leaf node (v8 only) */
 
     bool reverse;
 };
@@ -37,6 +42,8 @@ struct wbti {
  * @wbd_root: root node's page number (@wbd_root < @wbd_n_pages)
  * @wbd_leaf: first leaf node (@wbd_leaf < @wbd_n_pages)
  * @wbd_leaf_cnt: number of leaf nodes
+ * @wbd_leaf_pgc: size of leaf nodes in pages (less than @wbd_leaf_cnt if the
+ *                leaf nodes are compressed)
  * @wbd_kmd_pgc: size of key-metadata region in pages
  *
  * When a KBLOCK is opened for reading, the @wbt_hdr_omf struct is read from
@@ -54,14 +61,43 @@ struct wbt_desc {
     u16 wbd_root;
     u16 wbd_leaf;
     u16 wbd_leaf_cnt;
+    u16 wbd_leaf_pgc;
     u16 wbd_kmd_pgc;
     u16 wbd_version;
 };
 
+/* Leaf nodes are compressed only in version 8 trees.
+ */
+static inline bool
+wbt_leaf_compressed(const struct wbt_desc *wbd)
+{
+    return wbd->wbd_version >= WBT_TREE_VERSION8;
+}
+
+/* Page number, from the start of the mblock, of internal node @node_num.  The
+ * internal nodes follow the @wbd_leaf_pgc pages of leaf nodes.
+ */
+static inline uint
+wbt_inode_pg(const struct wbt_desc *wbd, uint node_num)
+{
+    return wbd->wbd_first_page + wbd->wbd_leaf_pgc + node_num - wbd->wbd_leaf_cnt;
+}
+
+/* Page number, from the start of the mblock, of the kmd region, which follows
+ * the root node.
+ */
+static inline uint
+wbt_kmd_pg(const struct wbt_desc *wbd)
+{
+    return wbt_inode_pg(wbd, wbd->wbd_root + 1);
+}
+
 /**
  * wbtr_read_vref() - Read the metadata data for the value associated with key
  * @kbd:    kblock region descriptor
  * @wbd:    wbtree descriptor
+ * @inodes: copy of the internal nodes (see wbt_icache_get()), or NULL to
+ *          read them from the mcache map
  * @kt:     key to search for
  * @lcp:    longest common prefix common to %kt and all keys in the kblock
  * @lookup_res: (output) one of NOT_FOUND, FOUND_VAL,
@@ -73,12 +109,30 @@ merr_t
 wbtr_read_vref(
     const struct kvs_mblk_desc *kbd,
     const struct wbt_desc *     wbd,
+    const void *                inodes,
     const struct kvs_ktuple *   kt,
     uint                        lcp,
     u64                         seq,
     enum key_lookup_res *       lookup_res,
     struct kvs_vtuple_ref *     vref);
 
+/**
+ * wbtr_read_vref_leaf() - wbtr_read_vref() confined to the given leaf node
+ * @node_num: leaf node that holds %kt if it is in the wbtree at all
+ *
+ * Used by point lookups that find the leaf node from the kblock's hash
+ * index rather than by descending the wbtree.
+ */
+merr_t
+wbtr_read_vref_leaf(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        node_num,
+    const struct kvs_ktuple *   kt,
+    u64                         seq,
+    enum key_lookup_res *       lookup_res,
+    struct kvs_vtuple_ref *     vref);
+
 merr_t
 wbti_alloc(struct wbti **wbti_out);
 
@@ -150,6 +204,19 @@ wbti_next(struct wbti *wbti, const void **kdata, uint *klen, const void **kmd);
 void
 wbt_read_kmd_vref(const void *kmd, size_t *off, u64 *seq, struct kvs_vtuple_ref *vref);
 
+/**
+ * wbt_read_kmd_seek() - find the newest entry of a kmd list visible at @seq
+ * @kmd:  base of the kmd region
+ * @off:  (in/out) offset of the kmd list (i.e., of its entry count)
+ * @seq:  view sequence number
+ * @vseq: (output) sequence number of the entry found
+ * @vref: (output) value reference of the entry found
+ *
+ * Returns: true if an entry at or below @seq was found, false otherwise.
+ */
+bool
+wbt_read_kmd_seek(const void *kmd, size_t *off, u64 seq, u64 *vseq, struct kvs_vtuple_ref *vref);
+
 merr_t
 wbti_init(void);
 void
@@ -505,28 +505,22 @@ wbtr4_read_vref(
             void * kmd;
             size_t off;
             u64    vseq;
-            uint   nvals;
 
             kmd = kbd->map_base + PAGE_SIZE * (wbd->wbd_first_page + wbd->wbd_root + 1);
 
             off = wbt_lfe_kmd(node, lfe);
             assert(off < wbd->wbd_kmd_pgc * PAGE_SIZE);
-            nvals = kmd_count(kmd, &off);
-            assert(nvals > 0);
-            while (nvals--) {
-                wbt_read_kmd_vref(kmd, &off, &vseq, vref);
+            if (wbt_read_kmd_seek(kmd, &off, seq, &vseq, vref)) {
                 assert(off <= wbd->wbd_kmd_pgc * PAGE_SIZE);
-                if (seq >= vseq) {
-                    vref->vr_seq = vseq;
-                    if (vref->vr_type == vtype_tomb)
-                        *lookup_res = FOUND_TMB;
-                    else if (vref->vr_type == vtype_ptomb)
-                        *lookup_res = FOUND_PTMB;
-                    else
-                        *lookup_res = FOUND_VAL;
-
-                    return 0;
-                }
+                vref->vr_seq = vseq;
+                if (vref->vr_type == vtype_tomb)
+                    *lookup_res = FOUND_TMB;
+                else if (vref->vr_type == vtype_ptomb)
+                    *lookup_res = FOUND_PTMB;
+                else
+                    *lookup_res = FOUND_VAL;
+
+                return 0;
             }
             break;
         }
@@ -21,26 +21,48 @@
 #include "wbt_reader.h"
 #include "wbt_reader_v5.h"
 
-static void
-wbti_get_page(struct wbti *self, u32 node_idx)
+/* Compressed leaf nodes are decompressed into one of two buffers, chosen by
+ * the parity of the node number, so that the keys of the previous node remain
+ * valid while the iterator steps into the next one.
+ */
+static bool
+wbti_get_page(struct wbti *self, u32 node_idx, bool cache)
 {
-    size_t mblock_offset;
+    void *buf = NULL;
 
     assert(node_idx != self->node_idx || self->node == NULL);
 
-    mblock_offset = PAGE_SIZE * (node_idx + self->wbd->wbd_first_page);
-    self->node = (struct wbt_node_hdr_omf *)(self->kbd->map_base + mblock_offset);
+    if (wbt_leaf_compressed(self->wbd)) {
+        if (!self->lbuf) {
+            self->lbuf = alloc_page_aligned(2 * PAGE_SIZE, GFP_KERNEL);
+            if (ev(!self->lbuf))
+                return false;
+        }
+
+        buf = self->lbuf + PAGE_SIZE * (node_idx & 1);
+    }
+
+    self->node = (void *)kbr_wbt_leaf(self->kbd, self->wbd, node_idx, buf, cache);
+    if (ev(!self->node))
+        return false;
 
     assert(omf_wbn_magic(self->node) == WBT_LFE_NODE_MAGIC);
 
     self->lfe_idx = -1;
     self->node_idx = node_idx;
+
+    return true;
 }
 
+/* Internal nodes are read from @inodes if given, which holds a copy of the
+ * nodes from the first internal node through the root.  Leaf nodes are
+ * always read by the caller, they may be compressed.
+ */
 static int
 wbtr_seek_page(
     const struct kvs_mblk_desc *kbd,
     const struct wbt_desc *     wbd,
+    const void *                inodes,
     const void *                kt_data,
     uint                        kt_len,
     uint                        lcp)
@@ -48,23 +70,26 @@ wbtr_seek_page(
     struct wbt_node_hdr_omf *node;
     int                      j, cmp, node_num;
     uint                     cmplen;
-    size_t                   pg;
 
     /* pull struct derefs out of the loop */
-    uint  first_page = wbd->wbd_first_page;
-    void *map_base = kbd->map_base;
+    int   first_inode = wbd->wbd_leaf + wbd->wbd_leaf_cnt;
+    void *ibase = kbd->map_base + PAGE_SIZE * wbt_inode_pg(wbd, first_inode);
+    bool  keyheads = wbd->wbd_version >= WBT_TREE_VERSION6;
 
-    /* search from root */
+    /* search from root, which is a leaf in a single node tree */
     node_num = wbd->wbd_root;
+    if (node_num < first_inode)
+        return node_num;
 
-    /* prefetch root node header */
-    __builtin_prefetch(map_base + (first_page + wbd->wbd_root) * PAGE_SIZE);
+    if (inodes)
+        ibase = (void *)inodes;
+
+    node = ibase + PAGE_SIZE * (node_num - first_inode);
 
-    assert(0 <= node_num && node_num < wbd->wbd_n_pages);
-    pg = first_page + node_num;
-    node = map_base + pg * PAGE_SIZE;
+    /* prefetch root node header */
+    __builtin_prefetch(node);
 
-    while (omf_wbn_magic(node) == WBT_INE_NODE_MAGIC) {
+    while (true) {
         struct wbt_ine_omf *ine;
 
         int first = 0;
@@ -76,6 +101,8 @@ wbtr_seek_page(
         const void *kdata;
         uint        klen;
 
+        assert(omf_wbn_magic(node) == WBT_INE_NODE_MAGIC);
+
         wbt_node_pfx(node, &node_pfx, &node_pfx_len);
 
         /* Check if key's prefix lies within this node's range.
@@ -92,6 +119,12 @@ wbtr_seek_page(
             goto navigate;
         }
 
+        if (keyheads) {
+            u32 kh = wbt6_keyhead(kt_data + cmplen, kt_len - cmplen);
+
+            wbt6_kh_range(wbt6_ine_kh(node), last + 1, kh, &first, &last);
+        }
+
         /* prefetch first node in binary search */
         __builtin_prefetch(wbt_ine(node, (first + last) / 2));
 
@@ -122,9 +155,10 @@ wbtr_seek_page(
         assert(omf_ine_left_child(ine) < node_num);
         node_num = omf_ine_left_child(ine);
 
-        assert(0 <= node_num && node_num < wbd->wbd_n_pages);
-        pg = first_page + node_num;
-        node = map_base + pg * PAGE_SIZE;
+        if (node_num < first_inode)
+            break; /* at leaf */
+
+        node = ibase + PAGE_SIZE * (node_num - first_inode);
         __builtin_prefetch(node);
     }
 
@@ -192,7 +226,6 @@ wbti_seek_fwd(struct wbti *self, struct kvs_ktuple *kt)
     struct wbt_node_hdr_omf *node;
     int                      j, cmp, node_num;
     int                      first, last;
-    size_t                   pg;
     const void *             kdata, *kt_data;
     uint                     klen, kt_len, cmplen;
     struct wbt_lfe_omf *     lfe;
@@ -200,10 +233,11 @@ wbti_seek_fwd(struct wbti *self, struct kvs_ktuple *kt)
     struct wbt_desc *        wbd = self->wbd;
 
     bool create = kt->kt_len < 0;
+    bool fcode = wbd->wbd_version >= WBT_TREE_VERSION7;
     bool sfx_search;
 
-    const void *node_pfx;
-    uint        node_pfx_len;
+    const void *node_pfx, *kpfx;
+    uint        node_pfx_len, kpfx_len;
 
     if (self->node_idx == NODE_EOF)
         return false;
@@ -211,12 +245,11 @@ wbti_seek_fwd(struct wbti *self, struct kvs_ktuple *kt)
     kt_data = kt->kt_data;
     kt_len = abs(kt->kt_len);
 
-    node_num = wbtr_seek_page(kbd, wbd, kt_data, kt_len, 0);
-    wbti_get_page(self, node_num);
+    node_num = wbtr_seek_page(kbd, wbd, NULL, kt_data, kt_len, 0);
+    if (!wbti_get_page(self, node_num, true))
+        return false;
 
-    assert(0 <= node_num && node_num < wbd->wbd_n_pages);
-    pg = wbd->wbd_first_page + node_num;
-    node = kbd->map_base + pg * PAGE_SIZE;
+    node = self->node;
 
     /* at leaf */
     assert(omf_wbn_magic(node) == WBT_LFE_NODE_MAGIC);
@@ -249,15 +282,19 @@ wbti_seek_fwd(struct wbti *self, struct kvs_ktuple *kt)
     if (!sfx_search)
         goto skip_search;
 
+    if (wbd->wbd_version >= WBT_TREE_VERSION6)
+        wbt6_kh_range(
+            wbt6_lfe_kh(node), last + 1, wbt6_keyhead(kt_data, kt_len), &first, &last);
+
     /* prefetch first node in binary search */
     __builtin_prefetch(wbt_lfe(node, (first + last) / 2));
 
     while (first <= last) {
         j = (first + last) / 2;
         lfe = wbt_lfe(node, j);
-        wbt_lfe_key(node, lfe, &kdata, &klen);
+        wbt_lfe_sfx(node, lfe, fcode, &kpfx, &kpfx_len, &kdata, &klen);
 
-        cmp = keycmp(kt_data, kt_len, kdata, klen);
+        cmp = wbt7_keycmp(kt_data, kt_len, kpfx, kpfx_len, kdata, klen);
         if (cmp < 0) {
             last = j - 1;
         } else if (cmp > 0) {
@@ -280,13 +317,19 @@ skip_search:
     }
 
     /* It wasn't a seek, must be a cursor create.  Compare with
-     * the prefix of the best match to determine if found.
+     * the prefix of the best match to determine if found.  There
+     * is no match if the key is greater than all keys in the node.
      */
-    lfe = wbt_lfe(node, first);
-    wbt_lfe_key(node, lfe, &kdata, &klen);
-
     if (sfx_search) {
-        cmp = keycmp_prefix(kt_data, kt_len, kdata, klen);
+        cmp = 1;
+
+        if (first < omf_wbn_num_keys(node)) {
+            lfe = wbt_lfe(node, first);
+            wbt_lfe_sfx(node, lfe, fcode, &kpfx, &kpfx_len, &kdata, &klen);
+
+            cmp = wbt7_keycmp_prefix(kt_data, kt_len, kpfx, kpfx_len, kdata, klen);
+        }
+
         if (!cmp)
             self->lfe_idx = first - 1; /* found pfx key */
     }
@@ -383,16 +426,16 @@ wbti_seek_rev(struct wbti *self, struct kvs_ktuple *kt)
     struct wbt_node_hdr_omf *node;
     int                      cmp, node_num;
     int                      first, last;
-    size_t                   pg;
     const void *             kdata, *kt_data;
     uint                     klen, kt_len, cmplen;
     struct wbt_lfe_omf *     lfe;
     struct kvs_mblk_desc *   kbd = self->kbd;
     struct wbt_desc *        wbd = self->wbd;
     bool                     create = kt->kt_len < 0;
+    bool                     fcode = wbd->wbd_version >= WBT_TREE_VERSION7;
     bool                     sfx_search;
-    const void *             node_pfx;
-    uint                     node_pfx_len;
+    const void *             node_pfx, *kpfx;
+    uint                     node_pfx_len, kpfx_len;
 
     int dbg_nrepeat __maybe_unused;
 
@@ -407,15 +450,14 @@ wbti_seek_rev(struct wbti *self, struct kvs_ktuple *kt)
     if (create)
         kt_len = HSE_KVS_KLEN_MAX;
 
-    node_num = wbtr_seek_page(kbd, wbd, kt_data, kt_len, 0);
+    node_num = wbtr_seek_page(kbd, wbd, NULL, kt_data, kt_len, 0);
     dbg_nrepeat = 0;
 
 repeat:
-    wbti_get_page(self, node_num);
+    if (!wbti_get_page(self, node_num, true))
+        return false;
 
-    assert(0 <= node_num && node_num < wbd->wbd_n_pages);
-    pg = wbd->wbd_first_page + node_num;
-    node = kbd->map_base + pg * PAGE_SIZE;
+    node = self->node;
 
     /* at leaf */
     assert(omf_wbn_magic(node) == WBT_LFE_NODE_MAGIC);
@@ -457,6 +499,10 @@ repeat:
     if (!sfx_search)
         goto skip_search;
 
+    if (wbd->wbd_version >= WBT_TREE_VERSION6)
+        wbt6_kh_range(
+            wbt6_lfe_kh(node), last + 1, wbt6_keyhead(kt_data, kt_len), &first, &last);
+
     /* prefetch first node in binary search */
     __builtin_prefetch(wbt_lfe(node, (first + last) / 2));
 
@@ -464,9 +510,9 @@ repeat:
         int j = (first + last) / 2;
 
         lfe = wbt_lfe(node, j);
-        wbt_lfe_key(node, lfe, &kdata, &klen);
+        wbt_lfe_sfx(node, lfe, fcode, &kpfx, &kpfx_len, &kdata, &klen);
 
-        cmp = keycmp(kt_data, kt_len, kdata, klen);
+        cmp = wbt7_keycmp(kt_data, kt_len, kpfx, kpfx_len, kdata, klen);
         if (cmp < 0) {
             last = j - 1;
         } else if (cmp > 0) {
@@ -504,17 +550,21 @@ skip_search:
     }
 
     /* It wasn't a seek, must be a cursor create.  Compare with
-     * the prefix of the best match to determine if found.
+     * the prefix of the best match to determine if found.  There
+     * is no match if the key is less than all keys in the node.
      */
-
-    lfe = wbt_lfe(node, last);
-    wbt_lfe_key(node, lfe, &kdata, &klen);
-
     if (sfx_search) {
         kt_data = kt->kt_data + node_pfx_len;
         kt_len = abs(kt->kt_len) - node_pfx_len;
+        cmp = -1;
+
+        if (last >= 0) {
+            lfe = wbt_lfe(node, last);
+            wbt_lfe_sfx(node, lfe, fcode, &kpfx, &kpfx_len, &kdata, &klen);
+
+            cmp = wbt7_keycmp_prefix(kt_data, kt_len, kpfx, kpfx_len, kdata, klen);
+        }
 
-        cmp = keycmp_prefix(kt_data, kt_len, kdata, klen);
         if (!cmp)
             self->lfe_idx = last + 1; /* found pfx key */
     }
@@ -528,15 +578,55 @@ wbti5_seek(struct wbti *self, struct kvs_ktuple *seek)
     return self->reverse ? wbti_seek_rev(self, seek) : wbti_seek_fwd(self, seek);
 }
 
+/* Number of leaf nodes read ahead at a time by a reverse iterator.
+ */
+#define WBTI_REV_RA_NODES (16)
+
+/**
+ * wbti_leaf_ra() - read ahead leaf nodes [first, first + cnt)
+ * @self:  wbt iterator
+ * @first: first leaf node
+ * @cnt:   number of leaf nodes
+ */
+static void
+wbti_leaf_ra(struct wbti *self, u32 first, u32 cnt)
+{
+    const void *rgn;
+    u32         pg, end;
+
+    if (!wbt_leaf_compressed(self->wbd)) {
+        kbr_madvise_wbt_leaf_range(self->kbd, self->wbd, first, cnt, MADV_WILLNEED);
+        return;
+    }
+
+    rgn = self->kbd->map_base + PAGE_SIZE * self->wbd->wbd_first_page;
+
+    pg = wbt8_leaf_off(rgn, first) / PAGE_SIZE;
+    end = roundup(wbt8_leaf_off(rgn, first + cnt), PAGE_SIZE) / PAGE_SIZE;
+
+    kbr_madvise_wbt_leaf_range(self->kbd, self->wbd, pg, end - pg, MADV_WILLNEED);
+}
+
 static void
 wbti_node_prev(struct wbti *self)
 {
-    if (self->node_idx > 0)
-        wbti_get_page(self, self->node_idx - 1);
-    else
-        self->node_idx = NODE_EOF;
+    u32 node_idx = self->node_idx - 1;
 
-    self->lfe_idx = omf_wbn_num_keys(self->node) - 1;
+    if (self->node_idx > 0 && wbti_get_page(self, node_idx, false)) {
+        self->lfe_idx = omf_wbn_num_keys(self->node) - 1;
+
+        /* Kernel readahead of the mapped kblock only ever runs forward,
+         * so a reverse iterator reads the leaf nodes behind it ahead of
+         * time in groups of WBTI_REV_RA_NODES.
+         */
+        if (node_idx > 0 && node_idx % WBTI_REV_RA_NODES == 0)
+            wbti_leaf_ra(self, node_idx - WBTI_REV_RA_NODES, WBTI_REV_RA_NODES);
+        else if (node_idx > 0 && !wbt_leaf_compressed(self->wbd))
+            __builtin_prefetch(self->node - PAGE_SIZE);
+        return;
+    }
+
+    self->node_idx = NODE_EOF;
 }
 
 static void
@@ -544,10 +634,8 @@ wbti_node_advance(struct wbti *self)
 {
     u32 max_idx = self->wbd->wbd_leaf + self->wbd->wbd_leaf_cnt;
 
-    if (self->node_idx + 1 < max_idx) {
-        wbti_get_page(self, self->node_idx + 1);
-
-        if (self->node_idx + 2 < max_idx)
+    if (self->node_idx + 1 < max_idx && wbti_get_page(self, self->node_idx + 1, false)) {
+        if (self->node_idx + 2 < max_idx && !wbt_leaf_compressed(self->wbd))
             __builtin_prefetch(self->node + PAGE_SIZE);
     } else {
         self->node_idx = NODE_EOF;
@@ -581,7 +669,10 @@ wbti_next_fwd(struct wbti *self, const void **kdata, uint *klen, const void **km
     lfe = wbt_lfe(self->node, self->lfe_idx);
 
     /* Set outputs */
-    wbt_lfe_key(self->node, lfe, kdata, klen);
+    if (self->wbd->wbd_version >= WBT_TREE_VERSION7)
+        wbt7_lfe_key(self->node, lfe, &self->pfx, &self->pfx_len, kdata, klen);
+    else
+        wbt_lfe_key(self->node, lfe, kdata, klen);
     __builtin_prefetch(*kdata);
     off = wbt_lfe_kmd(self->node, lfe);
     assert(off < self->wbd->wbd_kmd_pgc * PAGE_SIZE);
@@ -616,7 +707,11 @@ wbti_next_rev(struct wbti *self, const void **kdata, uint *klen, const void **km
     lfe = wbt_lfe(self->node, self->lfe_idx);
 
     /* Set outputs */
-    wbt_lfe_key(self->node, lfe, kdata, klen);
+    if (self->wbd->wbd_version >= WBT_TREE_VERSION7)
+        wbt7_lfe_key(self->node, lfe, &self->pfx, &self->pfx_len, kdata, klen);
+    else
+        wbt_lfe_key(self->node, lfe, kdata, klen);
+    __builtin_prefetch(*kdata);
     off = wbt_lfe_kmd(self->node, lfe);
     assert(off < self->wbd->wbd_kmd_pgc * PAGE_SIZE);
     *kmd = self->kmd + off;
@@ -645,10 +740,12 @@ wbti5_reset(
     self->wbd = desc;
     self->kbd = kbd;
     self->node = NULL;
-    self->kmd = kbd->map_base + PAGE_SIZE * (self->wbd->wbd_first_page + self->wbd->wbd_root + 1);
+    self->kmd = kbd->map_base + PAGE_SIZE * wbt_kmd_pg(desc);
 
     self->node_idx = 0;
     self->lfe_idx = 0;
+    self->pfx = NULL;
+    self->pfx_len = 0;
     self->reverse = reverse;
 
     if (cache)
@@ -658,46 +755,61 @@ wbti5_reset(
         if (!wbti5_seek(self, seek))
             self->node_idx = NODE_EOF;
     } else {
-        wbti_get_page(self, reverse ? desc->wbd_leaf_cnt - 1 : 0);
+        if (!wbti_get_page(self, reverse ? desc->wbd_leaf_cnt - 1 : 0, cache)) {
+            self->node_idx = NODE_EOF;
+            return;
+        }
 
         if (reverse) {
             self->lfe_idx = omf_wbn_num_keys(self->node);
             self->node_idx = desc->wbd_leaf + desc->wbd_leaf_cnt - 1;
         }
     }
+
+    /* Read ahead the nodes between the start of a reverse iteration and
+     * the first group boundary behind it, wbti_node_prev() takes it from
+     * there.
+     */
+    if (reverse && self->node_idx != NODE_EOF && self->node_idx % WBTI_REV_RA_NODES) {
+        u32 first = self->node_idx - self->node_idx % WBTI_REV_RA_NODES;
+
+        wbti_leaf_ra(self, first, self->node_idx - first);
+    }
 }
 
 merr_t
-wbtr5_read_vref(
+wbtr5_read_vref_leaf(
     const struct kvs_mblk_desc *kbd,
     const struct wbt_desc *     wbd,
+    uint                        node_num,
     const struct kvs_ktuple *   kt,
-    uint                        lcp,
     u64                         seq,
     enum key_lookup_res *       lookup_res,
     struct kvs_vtuple_ref *     vref)
 {
     struct wbt_node_hdr_omf *node;
-    int                      j, cmp, node_num;
+    int                      j, cmp;
     int                      first, last;
-    size_t                   pg;
     const void *             kdata, *kt_data;
     uint                     klen, kt_len;
     struct wbt_lfe_omf *     lfe;
 
-    const void *node_pfx;
-    uint        node_pfx_len;
+    const void *node_pfx, *kpfx;
+    uint        node_pfx_len, kpfx_len;
+    bool        fcode = wbd->wbd_version >= WBT_TREE_VERSION7;
+    char        lbuf[PAGE_SIZE] __aligned(SMP_CACHE_BYTES);
 
     kt_data = kt->kt_data;
     kt_len = kt->kt_len;
 
     assert(kt->kt_len > 0);
 
-    node_num = wbtr_seek_page(kbd, wbd, kt_data, kt_len, 0);
+    if (ev(node_num >= wbd->wbd_leaf_cnt))
+        return merr(EILSEQ);
 
-    assert(0 <= node_num && node_num < wbd->wbd_n_pages);
-    pg = wbd->wbd_first_page + node_num;
-    node = kbd->map_base + pg * PAGE_SIZE;
+    node = (void *)kbr_wbt_leaf(kbd, wbd, node_num, lbuf, true);
+    if (ev(!node))
+        return merr(EILSEQ);
 
     /* at leaf */
     assert(omf_wbn_magic(node) == WBT_LFE_NODE_MAGIC);
@@ -715,18 +827,22 @@ wbtr5_read_vref(
     if (cmp)
         goto done; /* prefix didn't match; key not found */
 
-    /* prefetch first node in binary search */
-    __builtin_prefetch(wbt_lfe(node, (first + last) / 2));
-
     kt_data += node_pfx_len;
     kt_len -= node_pfx_len;
 
+    if (wbd->wbd_version >= WBT_TREE_VERSION6)
+        wbt6_kh_range(
+            wbt6_lfe_kh(node), last + 1, wbt6_keyhead(kt_data, kt_len), &first, &last);
+
+    /* prefetch first node in binary search */
+    __builtin_prefetch(wbt_lfe(node, (first + last) / 2));
+
     while (first <= last) {
         j = (first + last) / 2;
         lfe = wbt_lfe(node, j);
-        wbt_lfe_key(node, lfe, &kdata, &klen); /* sfx */
+        wbt_lfe_sfx(node, lfe, fcode, &kpfx, &kpfx_len, &kdata, &klen);
 
-        cmp = keycmp(kt_data, kt_len, kdata, klen);
+        cmp = wbt7_keycmp(kt_data, kt_len, kpfx, kpfx_len, kdata, klen);
         if (cmp < 0)
             last = j - 1;
         else if (cmp > 0)
@@ -736,28 +852,22 @@ wbtr5_read_vref(
             void * kmd;
             size_t off;
             u64    vseq;
-            uint   nvals;
 
-            kmd = kbd->map_base + PAGE_SIZE * (wbd->wbd_first_page + wbd->wbd_root + 1);
+            kmd = kbd->map_base + PAGE_SIZE * wbt_kmd_pg(wbd);
 
             off = wbt_lfe_kmd(node, lfe);
             assert(off < wbd->wbd_kmd_pgc * PAGE_SIZE);
-            nvals = kmd_count(kmd, &off);
-            assert(nvals > 0);
-            while (nvals--) {
-                wbt_read_kmd_vref(kmd, &off, &vseq, vref);
+            if (wbt_read_kmd_seek(kmd, &off, seq, &vseq, vref)) {
                 assert(off <= wbd->wbd_kmd_pgc * PAGE_SIZE);
-                if (seq >= vseq) {
-                    vref->vr_seq = vseq;
-                    if (vref->vr_type == vtype_tomb)
-                        *lookup_res = FOUND_TMB;
-                    else if (vref->vr_type == vtype_ptomb)
-                        *lookup_res = FOUND_PTMB;
-                    else
-                        *lookup_res = FOUND_VAL;
-
-                    return 0;
-                }
+                vref->vr_seq = vseq;
+                if (vref->vr_type == vtype_tomb)
+                    *lookup_res = FOUND_TMB;
+                else if (vref->vr_type == vtype_ptomb)
+                    *lookup_res = FOUND_PTMB;
+                else
+                    *lookup_res = FOUND_VAL;
+
+                return 0;
             }
             break;
         }
@@ -767,3 +877,23 @@ done:
     *lookup_res = NOT_FOUND;
     return 0;
 }
+
+merr_t
+wbtr5_read_vref(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    const void *                inodes,
+    const struct kvs_ktuple *   kt,
+    uint                        lcp,
+    u64                         seq,
+    enum key_lookup_res *       lookup_res,
+    struct kvs_vtuple_ref *     vref)
+{
+    int node_num;
+
+    assert(kt->kt_len > 0);
+
+    node_num = wbtr_seek_page(kbd, wbd, inodes, kt->kt_data, kt->kt_len, 0);
+
+    return wbtr5_read_vref_leaf(kbd, wbd, node_num, kt, seq, lookup_res, vref);
+}
@@ -27,10 +27,21 @@ merr_t
 wbtr5_read_vref(
     const struct kvs_mblk_desc *kbd,
     const struct wbt_desc *     wbd,
+    const void *                inodes,
     const struct kvs_ktuple *   kt,
     uint                        lcp,
     u64                         seq,
     enum key_lookup_res *       lookup_res,
     struct kvs_vtuple_ref *     vref);
 
+merr_t
+wbtr5_read_vref_leaf(
+    const struct kvs_mblk_desc *kbd,
+    const struct wbt_desc *     wbd,
+    uint                        node_num,
+    const struct kvs_ktuple *   kt,
+    u64                         seq,
+    enum key_lookup_res *       lookup_res,
+    struct kvs_vtuple_ref *     vref);
+
 #endif /* HSE_KVS_CN_WBT_READER_v5_H */
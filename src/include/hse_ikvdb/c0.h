@@ -89,6 +89,16 @@ c0_index(struct c0 *handle);
 u64
 c0_hash_get(struct c0 *handle);
 
+/**
+ * c0_get_sfx_len() - get the suffix length of the kvs of a c0
+ * @c0: Instance of struct c0
+ *
+ * Return: number of trailing key bytes excluded from a key's kt_hash
+ */
+/* MTF_MOCK */
+u32
+c0_get_sfx_len(struct c0 *handle);
+
 /**
  * c0_get_width() - get the parallel width for a struct c0
  * @self: Instance of struct c0 to probe
@@ -159,6 +169,24 @@ c0_pfx_probe(
     struct kvs_buf *         kbuf,
     struct kvs_buf *         vbuf);
 
+/**
+ * c0_pfx_probe_batch() - prefix probe c0 for a batch of prefixes
+ *
+ * See c0sk_pfx_probe_batch().
+ */
+merr_t
+c0_pfx_probe_batch(
+    struct c0 *              handle,
+    const struct kvs_ktuple *ktv,
+    u64                      view_seqno,
+    uintptr_t                seqnoref,
+    enum key_lookup_res *    resv,
+    struct query_ctx *       qctxv,
+    struct kvs_buf *         kbufv,
+    struct kvs_buf *         vbufv,
+    const u32 *              lookupv,
+    u32                      lookupc);
+
 /**
  * c0_prefix_del() - delete any value with the prefix key
  * @self:      Instance of struct c0 from which to delete
@@ -171,6 +199,18 @@ c0_pfx_probe(
 merr_t
 c0_prefix_del(struct c0 *self, struct kvs_ktuple *key, u64 seqno);
 
+/**
+ * c0_fold() - merge an operand into the current value of a key
+ * @self:      Instance of struct c0 to update
+ * @key:       Key to update
+ * @oper:      Merge operand
+ * @fn:        Merge function of the kvs
+ *
+ * See c0sk_fold().
+ */
+merr_t
+c0_fold(struct c0 *self, const struct kvs_ktuple *key, const struct kvs_vtuple *oper, kvs_merge_fn *fn);
+
 /**
  * c0_sync() - force ingest of existing c0 data and waits until ingest complete
  * @self:      Instance of struct c0 to flush
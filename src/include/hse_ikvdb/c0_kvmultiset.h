@@ -141,6 +141,26 @@ c0kvms_get_mut_sz(struct c0_kvmultiset *handle);
 struct c0_kvset *
 c0kvms_get_hashed_c0kvset(struct c0_kvmultiset *mset, u64 hash);
 
+/**
+ * c0kvms_may_contain() - check the negative-lookup filter of a kvms
+ * @mset:  Struct c0_kvmultiset to check
+ * @hash:  Hash of the key (i.e., kt_hash of its ktuple)
+ *
+ * Return: false if no c0kvset of %mset (but for the ptomb c0kvset)
+ * contains the key, true if it might
+ */
+bool
+c0kvms_may_contain(struct c0_kvmultiset *mset, u64 hash);
+
+/**
+ * c0kvms_get_affine_c0kvset() - obtain the c0_kvset of the calling cpu
+ * @mset:  Struct c0_kvmultiset to lookup in
+ *
+ * Return: Struct c0_kvset pointer
+ */
+struct c0_kvset *
+c0kvms_get_affine_c0kvset(struct c0_kvmultiset *mset);
+
 /**
  * c0kvms_get_c0kvset() - obtain the c0_kvset at the absolute index
  * @mset:  Struct c0_kvmultiset to lookup in
@@ -157,7 +177,8 @@ c0kvms_get_c0kvset(struct c0_kvmultiset *mset, u32 index);
  * @wq:    workqueue to enable c0kvms_destroy() offload
  *
  * This function is invoked on a kvms at the end of the RCU grace
- * period during which it ceased being the active kvms.
+ * period during which it ceased being the active kvms, or as soon as
+ * it has been frozen by c0kvms_freeze().
  *
  * A kvms that is finalized is a guarantee that the kvms is stable and may
  * no longer be modified by put or delete operations, including updates to
@@ -172,6 +193,27 @@ c0kvms_get_c0kvset(struct c0_kvmultiset *mset, u32 index);
 void
 c0kvms_finalize(struct c0_kvmultiset *mset, struct workqueue_struct *wq);
 
+/**
+ * c0kvms_freeze() - stop the c0_kvmultiset from accepting updates
+ * @mset:  struct c0_kvmultiset to freeze
+ *
+ * This function is invoked on a kvms right after it ceased being the
+ * active kvms.  Once it returns, every update that was in progress on
+ * the kvms has been applied, and every subsequent update fails with
+ * ENOMEM such that the caller retries in the newly active kvms.  Hence
+ * a frozen kvms may be finalized without waiting for the end of the
+ * RCU grace period.
+ */
+void
+c0kvms_freeze(struct c0_kvmultiset *mset);
+
+/**
+ * c0kvms_is_frozen() - return 'true' if c0kvms_freeze() was called
+ * @mset:  struct c0_kvmultiset
+ */
+bool
+c0kvms_is_frozen(struct c0_kvmultiset *mset);
+
 /**
  * c0kvms_is_finalized() - return 'true' if finalized/frozen
  * @mset:  struct c0_kvmultiset
@@ -33,12 +33,16 @@ struct c0_usage {
 /**
  * c0kvs_reinit() - reinitialize global c0kvs state
  * @cc_max:   set max cache size (bytes)
+ * @index:    c0 index of new c0kvsets (0: bonsai tree, 1: radix tree)
+ * @hugepage: arena page size of new c0kvsets (0: base, 1: 2MB, 2: 1GB)
+ * @prefault: prefault the arenas of new c0kvsets on the local numa node
+ * @numa:     home new c0kvsets round-robin on all numa nodes
  *
  * Must be called at least once before calling c0kvs APIs.  Subsequent
  * calls are idempotent.
  */
 void
-c0kvs_reinit(size_t cc_max);
+c0kvs_reinit(size_t cc_max, uint index, uint hugepage, bool prefault, bool numa);
 
 /**
  * c0kvs_init() - initialize global c0kvs state
@@ -129,6 +133,32 @@ c0kvs_alloc(struct c0_kvset *handle, size_t align, size_t sz);
 void
 c0kvs_ingesting_init(struct c0_kvset *handle, atomic_t *ingesting);
 
+/**
+ * c0kvs_filter_init() - set the negative-lookup filter of a c0kvs
+ * @handle:     c0kvs handle
+ * @filter:     vector of filter words (or NULL to disable the filter)
+ * @mask:       number of filter words minus one
+ *
+ * The hash of each key put, deleted or folded into the c0kvs is added
+ * to %filter, which is shared by all the c0kvsets of a kvms (see
+ * c0kvms_may_contain()).
+ */
+void
+c0kvs_filter_init(struct c0_kvset *handle, u64 *filter, u32 mask);
+
+/**
+ * c0kvs_filter_bits() - filter bits of a key hash
+ * @hash:       key hash
+ *
+ * A key sets two bits within the filter word selected by the upper
+ * half of its hash, such that a lookup costs a single cache miss.
+ */
+static inline u64
+c0kvs_filter_bits(u64 hash)
+{
+    return (1ul << (hash & 63)) | (1ul << ((hash >> 6) & 63));
+}
+
 /**
  * c0kvs_put() - insert a key/value pair into the struct c0_kvset
  * @set:   Struct c0_kvset to insert the key/value into
@@ -168,6 +198,51 @@ c0kvs_put(
 merr_t
 c0kvs_del(struct c0_kvset *set, u16 skidx, const struct kvs_ktuple *key, const uintptr_t seqno);
 
+/**
+ * c0kvs_putdel_batch() - insert a batch of puts and deletes into a c0_kvset
+ * @set:      Struct c0_kvset to insert the ops into
+ * @opv:      Vector of write batch ops
+ * @idxv:     Indices into %opv of the ops to insert
+ * @idxc:     Number of indices in %idxv
+ * @seqnoref: seqnoref to use for all ops
+ *
+ * All the ops selected by %idxv are inserted in order under a single
+ * acquisition of the c0_kvset lock.  Either all or none of the ops are
+ * inserted: if the c0_kvset hasn't room for the entire batch then
+ * ENOMEM is returned (or EFBIG if the batch could never fit).  Callers
+ * that need not insert the ops all at once split them with
+ * c0kvs_putdel_batch_chunk(), so that only a single op larger than
+ * the c0_kvset fails with EFBIG.
+ *
+ * Return: [HSE_REVISIT]
+ */
+merr_t
+c0kvs_putdel_batch(
+    struct c0_kvset *           set,
+    const struct kvs_wbatch_op *opv,
+    const u32 *                 idxv,
+    u32                         idxc,
+    uintptr_t                   seqnoref);
+
+/**
+ * c0kvs_putdel_batch_chunk() - size the next chunk of a batch
+ * @set:  Struct c0_kvset the ops are to be inserted into
+ * @opv:  Vector of write batch ops
+ * @idxv: Indices into %opv of the ops still to insert
+ * @idxc: Number of indices in %idxv, at least one
+ *
+ * Return: the number of leading ops of %idxv to pass to one call of
+ * c0kvs_putdel_batch(), at least one.  Together they take no more than
+ * a quarter of the c0_kvset's space unless the first op alone does, so
+ * a chunk that doesn't fit now fits in an empty c0_kvset.
+ */
+u32
+c0kvs_putdel_batch_chunk(
+    struct c0_kvset *           set,
+    const struct kvs_wbatch_op *opv,
+    const u32 *                 idxv,
+    u32                         idxc);
+
 /**
  * c0kvs_prefix_del() - delete the key/value pair matching the given key
  * @set:   Struct c0_kvset to delete the key/value from
@@ -186,6 +261,51 @@ c0kvs_prefix_del(
     const struct kvs_ktuple *key,
     const uintptr_t          seqno);
 
+/**
+ * struct c0kvs_fold_base - base value of a fold, as found by the caller
+ * @fb_data:  base value, or NULL if the key has no value
+ * @fb_len:   length of @fb_data
+ * @fb_seq:   view seqno at which the base was looked up
+ * @fb_valid: the caller looked up the base
+ */
+struct c0kvs_fold_base {
+    const void *fb_data;
+    u32         fb_len;
+    u64         fb_seq;
+    bool        fb_valid;
+};
+
+/**
+ * c0kvs_fold() - fold a merge operand into the newest value of a key
+ * @set:      Struct c0_kvset to update
+ * @skidx:    Structured key index
+ * @key:      Key
+ * @oper:     Merge operand
+ * @base:     Base value found by the caller in older data
+ * @fn:       Merge function
+ * @rbuf:     Buffer for the merged value
+ * @seqnoref: seqnoref to use for the merged value
+ *
+ * The newest value of @key in @set (if any, and if not older than
+ * @base->fb_seq) or else @base is merged with @oper by @fn, and the
+ * result is inserted into @set, all under the c0_kvset lock.  Thus
+ * concurrent folds and puts of the same key into @set are serialized.
+ *
+ * Return: ENOENT if @key is not in @set and @base is not valid,
+ * EOVERFLOW if the result does not fit in @rbuf (its length is
+ * returned in @rbuf->b_len), ENOMEM if @set is full or frozen.
+ */
+merr_t
+c0kvs_fold(
+    struct c0_kvset *             set,
+    u16                           skidx,
+    const struct kvs_ktuple *     key,
+    const struct kvs_vtuple *     oper,
+    const struct c0kvs_fold_base *base,
+    kvs_merge_fn *                fn,
+    struct kvs_buf *              rbuf,
+    uintptr_t                     seqnoref);
+
 /**
  * c0kvs_get() - given a key, retrieve a value from a struct c0_kvset
  * @set:        Struct c0_kvset to search
@@ -312,6 +432,35 @@ c0kvs_get_element_count(struct c0_kvset *set);
 void
 c0kvs_usage(struct c0_kvset *handle, struct c0_usage *usage);
 
+/**
+ * c0kvs_freeze() - stop a struct c0_kvset from accepting updates
+ * @set:   c0kvs handle
+ *
+ * Once this function returns all updates that were in progress on the
+ * c0kvs have completed, and all subsequent updates fail with ENOMEM.
+ * A frozen c0kvs may be finalized without waiting for the end of the
+ * RCU grace period.
+ */
+void
+c0kvs_freeze(struct c0_kvset *set);
+
+/**
+ * c0kvs_is_frozen() - return 'true' if c0kvs_freeze() was called
+ * @set:   c0kvs handle
+ */
+bool
+c0kvs_is_frozen(struct c0_kvset *set);
+
+/**
+ * c0kvs_node() - return the numa node on which the c0kvs is homed
+ * @set:   c0kvs handle
+ *
+ * Return: the preferred numa node of the c0kvs memory, or -1 if
+ * the c0kvs was created while numa mode was disabled.
+ */
+int
+c0kvs_node(struct c0_kvset *set);
+
 /**
  * c0kvs_finalize() - transition a struct c0_kvset to a read-only state
  * @set:   c0kvs handle
@@ -320,7 +469,8 @@ c0kvs_usage(struct c0_kvset *handle, struct c0_usage *usage);
  * determine the longest common prefix of all the keys in the c0kvs.
  * All callers inserting/deleting keys from an active c0kvs must do
  * so under the RCU read lock, which holds off finalization until the
- * end of the grace period.  Attempts to insert/delete a key after the
+ * end of the grace period (unless the c0kvs was first frozen by
+ * c0kvs_freeze()).  Attempts to insert/delete a key after the
  * c0kvs has been finalized is a grievous error that could lead to data
  * integrity issues.
  *
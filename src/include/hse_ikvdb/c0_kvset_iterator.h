@@ -18,6 +18,7 @@
  * @c0it_root:       Root of cbtree (for seek)
  * @c0it_next:       Next element for foward traversal
  * @c0it_prev:       Next element for reverse traversal
+ * @c0it_end:        End of forward traversal (see c0_kvset_iterator_range())
  *
  * c0_kvset_iterator is a bi-directional iterator which can be used to move
  * both forward and backward within the c0kvs for which it was initialized.
@@ -30,6 +31,7 @@ struct c0_kvset_iterator {
     struct bonsai_root *  c0it_root;
     struct bonsai_kv *    c0it_next;
     struct bonsai_kv *    c0it_prev;
+    struct bonsai_kv *    c0it_end;
     uint                  c0it_flags;
     int                   c0it_index;
 };
@@ -84,6 +86,22 @@ c0_kvset_iterator_empty(struct c0_kvset_iterator *handle);
 bool
 c0_kvset_iterator_eof(struct c0_kvset_iterator *handle);
 
+/**
+ * c0_kvset_iterator_range() - restrict a forward iterator to a key range
+ * @iter:            c0_kvset iterator
+ * @lo:              inclusive lower bound, or NULL to start at the first key
+ * @hi:              exclusive upper bound, or NULL to end at the last key
+ *
+ * Re-initializes the iterator to visit only the keys from @lo up to but
+ * excluding @hi.  The bounds are located once, so the container must not
+ * change while the iterator is in use (e.g., a c0_kvset being ingested).
+ */
+void
+c0_kvset_iterator_range(
+    struct c0_kvset_iterator *iter,
+    const struct bonsai_skey *lo,
+    const struct bonsai_skey *hi);
+
 /**
  * c0_kvset_iterator_seek() - move iteration next to %seek argument
  * @iter:            c0_kvset iterator
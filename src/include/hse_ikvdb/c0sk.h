@@ -31,6 +31,62 @@ struct csched;
 struct throttle_sensor;
 struct query_ctx;
 
+/* Each c0 ingest records where it spent its time, stage by stage, from
+ * the moment its kvms stops admitting updates until its kvsets are in cn.
+ * The times are recorded as perfc distributions (c0sking set) and as one
+ * event per ingest in a bounded log of the most recent C0SK_IEVLOG_SZ
+ * ingests (see the REST url mpool/<mp>/c0/ingests).
+ *
+ * RCU through ORDER are on the ingest's critical path and add up to the
+ * ingest's latency, less cn_ingestv().  KWRITE and VWRITE happen within
+ * MERGE and KBUILD.  For an ingest merged as several parallel streams,
+ * MERGE and KBUILD are those of its slowest stream, while KWRITE, VWRITE
+ * and the byte counts are the sums over all streams.
+ */
+#define C0SK_IEVLOG_SZ (256)
+
+enum c0sk_ingest_stage {
+    C0SK_IST_RCU,      /* waiting for the RCU grace period and finalize */
+    C0SK_IST_COALESCE, /* held back to coalesce with later kvms */
+    C0SK_IST_QUEUE,    /* waiting for an ingest thread */
+    C0SK_IST_FINWAIT,  /* waiting for the kvms' last updaters to leave */
+    C0SK_IST_MERGE,    /* merging keys and values into the builders */
+    C0SK_IST_KBUILD,   /* finishing the kblocks */
+    C0SK_IST_KWRITE,   /* allocating and writing kblocks */
+    C0SK_IST_VWRITE,   /* allocating and writing vblocks */
+    C0SK_IST_ORDER,    /* waiting for the preceding ingests to reach cn */
+    C0SK_IST_MBCOMMIT, /* committing the mblocks */
+    C0SK_IST_CNDB,     /* logging the ingest to cndb */
+    C0SK_IST_CNINSERT, /* creating the kvsets and adding them to cn */
+    C0SK_IST_MAX
+};
+
+/**
+ * struct c0sk_ingest_event - one finished c0 ingest
+ * @cie_seq:     event number, assigned when the event is logged
+ * @cie_time:    time at which the ingest finished (ns, monotonic)
+ * @cie_gen:     generation of the (first) kvms ingested
+ * @cie_kbytes:  bytes written to kblocks
+ * @cie_vbytes:  bytes written to vblocks
+ * @cie_stagev:  time spent in each stage (ns)
+ * @cie_width:   number of c0 kvsets merged
+ * @cie_streams: number of parallel merge streams, 1 if not partitioned
+ * @cie_kvms:    number of kvms coalesced into the ingest
+ * @cie_errno:   errno of the ingest, 0 on success
+ */
+struct c0sk_ingest_event {
+    u64 cie_seq;
+    u64 cie_time;
+    u64 cie_gen;
+    u64 cie_kbytes;
+    u64 cie_vbytes;
+    u64 cie_stagev[C0SK_IST_MAX];
+    u32 cie_width;
+    u32 cie_streams;
+    u16 cie_kvms;
+    u16 cie_errno;
+};
+
 merr_t
 c0sk_init(void);
 
@@ -74,6 +130,24 @@ c0sk_open(
 merr_t
 c0sk_close(struct c0sk *self);
 
+/**
+ * c0sk_checkpoint() - Make the next close leave c0 in c1 rather than ingest it
+ * @self: Instance of struct c0sk
+ *
+ * On success every mutation in c0 is durable in c1, and neither c0_close()
+ * nor c0sk_close() ingest c0 into cn. The next open replays c1 into c0.
+ * The caller must have quiesced all writers.
+ */
+merr_t
+c0sk_checkpoint(struct c0sk *self);
+
+/**
+ * c0sk_checkpointed() - Check whether c0sk_checkpoint() succeeded
+ * @self: Instance of struct c0sk
+ */
+bool
+c0sk_checkpointed(struct c0sk *self);
+
 /**
  * c0sk_throttle_sensor() - configure c0sk with a throttle sensor
  * @handle: c0sk handle
@@ -135,6 +209,41 @@ c0sk_put(
     const struct kvs_vtuple *value,
     u64                      seq);
 
+/**
+ * c0sk_write_batch() - insert a batch of puts and deletes into the struct c0sk
+ * @self:      Instance of struct c0sk into which to insert
+ * @opv:       Vector of write batch ops (key hashes must be set)
+ * @opc:       Number of ops in %opv
+ * @seq:       Sequence number for all ops in the batch
+ *
+ * Return: [HSE_REVISIT]
+ */
+/* MTF_MOCK */
+merr_t
+c0sk_write_batch(struct c0sk *self, const struct kvs_wbatch_op *opv, u32 opc, u64 seq);
+
+/**
+ * c0sk_write_batch_priv() - insert a batch of ops that is not yet visible
+ * @self:      Instance of struct c0sk into which to insert
+ * @opv:       Vector of write batch ops (key hashes must be set)
+ * @opc:       Number of ops in %opv
+ * @dstp:      (output) kvms into which the batch was inserted
+ * @privp:     (output) priv storage holding the batch's seqnoref
+ *
+ * All ops land in one kvms and reference *@privp, which remains undefined
+ * until the caller stores the batch's seqno there.  On success the caller
+ * holds a ref on *@dstp and a priv ref on it, as with c0sk_merge().
+ *
+ * Return: ENOMEM if the batch must be retried in a new kvms
+ */
+merr_t
+c0sk_write_batch_priv(
+    struct c0sk *               self,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc,
+    struct c0_kvmultiset **     dstp,
+    uintptr_t **                privp);
+
 /**
  * c0sk_get() - retrieve the value associated with the given key
  * @self:      Instance of struct c0sk from which to retrieve
@@ -186,6 +295,30 @@ c0sk_pfx_probe(
     struct kvs_buf *         kbuf,
     struct kvs_buf *         vbuf);
 
+/**
+ * c0sk_pfx_probe_batch() - prefix probe c0sk for a batch of prefixes
+ * @lookupv: indices into @ktv, @resv, @qctxv, @kbufv and @vbufv of the
+ *           prefixes to probe, best sorted by prefix
+ * @lookupc: number of entries in @lookupv
+ *
+ * Equivalent to calling c0sk_pfx_probe() for each prefix named by
+ * @lookupv, but walks the list of c0_kvmultisets only once.
+ */
+merr_t
+c0sk_pfx_probe_batch(
+    struct c0sk *            handle,
+    u16                      skidx,
+    u32                      pfx_len,
+    const struct kvs_ktuple *ktv,
+    u64                      view_seq,
+    uintptr_t                seqref,
+    enum key_lookup_res *    resv,
+    struct query_ctx *       qctxv,
+    struct kvs_buf *         kbufv,
+    struct kvs_buf *         vbufv,
+    const u32 *              lookupv,
+    u32                      lookupc);
+
 /**
  * c0sk_prefix_del() - delete any value with the prefix key
  * @self:      Instance of struct c0sk from which to delete
@@ -199,6 +332,30 @@ c0sk_pfx_probe(
 merr_t
 c0sk_prefix_del(struct c0sk *self, u16 skidx, const struct kvs_ktuple *key, u64 seq);
 
+/**
+ * c0sk_fold() - merge an operand into the current value of a key
+ * @self:      Instance of struct c0sk to update
+ * @skidx:     Structured key index
+ * @pfx_len:   Prefix length of the kvs
+ * @key:       Key to update
+ * @oper:      Merge operand
+ * @fn:        Merge function of the kvs
+ *
+ * The merged value is inserted like a non-txn put.  The operand is
+ * folded under the lock of the key's c0_kvset in the active kvms, so
+ * concurrent folds and non-txn puts of the key are not lost.  The
+ * current value is read from older kvmses and cn only if the key is
+ * not yet in the active kvms.
+ */
+merr_t
+c0sk_fold(
+    struct c0sk *            self,
+    u16                      skidx,
+    u32                      pfx_len,
+    const struct kvs_ktuple *key,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn);
+
 /**
  * c0sk_rparams() - Get a ptr to c0sk kvdb rparams
  * @self:       Instance of struct c0sk
@@ -207,6 +364,29 @@ c0sk_prefix_del(struct c0sk *self, u16 skidx, const struct kvs_ktuple *key, u64
 struct kvdb_rparams *
 c0sk_rparams(struct c0sk *self);
 
+/**
+ * c0sk_usage() - Get the number of elements and bytes held by c0sk
+ * @self:   Instance of struct c0sk
+ * @keysp:  (output) number of elements in all kvms, over all kvs
+ * @bytesp: (output) bytes used by all kvms
+ *
+ * The counts include kvms pending ingest.  They are not kept per kvs,
+ * and they are read without synchronizing with writers.
+ */
+void
+c0sk_usage(struct c0sk *self, u64 *keysp, u64 *bytesp);
+
+/**
+ * c0sk_mem_budget_set() - Bound the memory of all in-flight kvms
+ * @self:   Instance of struct c0sk
+ * @budget: budget in bytes, 0 to revert to rparam c0_autotune_mem
+ *
+ * A non-zero budget enables the ingest autotuner (unless c0_heap_sz
+ * fixes the kvms size), which honors it from the next kvms on.
+ */
+void
+c0sk_mem_budget_set(struct c0sk *self, size_t budget);
+
 /**
  * c0sk_flush() - Start ingest of existing c0sk data
  * @self:       Instance of struct c0sk to flush
@@ -385,6 +565,23 @@ c0sk_kvset_builder_destroy(struct c0sk *c0sk, struct kvset_builder *bldr);
 merr_t
 c0sk_kvset_builder_flush(struct c0sk *c0sk, struct kvset_builder *bldr);
 
+/**
+ * c0sk_ingest_events() - copy the ingest events that follow a given event
+ * @handle: c0sk handle
+ * @since:  copy events whose number is greater than this, 0 for all
+ * @evv:    (output) events, oldest first
+ * @evc:    capacity of %evv
+ *
+ * If more than %evc events follow %since, the oldest of them are skipped.
+ *
+ * Return: number of events copied
+ */
+uint
+c0sk_ingest_events(struct c0sk *handle, u64 since, struct c0sk_ingest_event *evv, uint evc);
+
+const char *
+c0sk_ingest_stage2str(enum c0sk_ingest_stage stage);
+
 /**
  * c0sk_enable_mutation() - Enable mutation tracking.
  * @c0sk: c0sk handle
@@ -57,6 +57,39 @@ c0skm_flush(struct c0sk *self);
 merr_t
 c0skm_sync(struct c0sk *self);
 
+/**
+ * c0skm_checkpoint() - Persist all of c0 in c1 so that it needn't be ingested
+ * @self: Instance of struct c0sk
+ *
+ * Fails if c1 is disabled or if an open kvs is not durable.
+ */
+merr_t
+c0skm_checkpoint(struct c0sk *self);
+
+/**
+ * c0skm_ticket() - Get a durability ticket
+ * @self: c0sk handle
+ *
+ * The ticket covers the mutations and txn commits the calling thread made
+ * before the call, see c0skm_ticket_wait().
+ */
+u64
+c0skm_ticket(struct c0sk *self);
+
+/**
+ * c0skm_ticket_wait() - Wait until the mutations of a ticket are durable
+ * @self:       c0sk handle
+ * @ticket:     ticket from c0skm_ticket()
+ * @timeout_ms: 0 to only poll, negative to wait for as long as it takes
+ *
+ * Does not force a sync, the mutations become durable as the periodic
+ * c1 syncs or someone's c0skm_sync() cover them.
+ *
+ * Return: EAGAIN if the mutations are not durable yet.
+ */
+merr_t
+c0skm_ticket_wait(struct c0sk *self, u64 ticket, int timeout_ms);
+
 /**
  * c0skm_set_tseqno() - Set the last committed transaction seq. no.
  * @handle: c0sk handle
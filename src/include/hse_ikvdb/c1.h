@@ -32,6 +32,7 @@ struct ikvdb_c1_replay;
 struct kvset_builder;
 struct c1_kvset_builder_elem;
 struct throttle_sensor;
+struct io_sched;
 
 struct mpool;
 
@@ -399,6 +400,14 @@ c1_kvset_builder_release(struct c1 *c1, struct c1_kvset_builder_elem *elem);
 void
 c1_throttle_sensor(struct c1 *c1, struct throttle_sensor *sensor);
 
+/**
+ * c1_io_sched - admit c1 log appends through the kvdb I/O scheduler
+ * @c1:
+ * @ios: scheduler, NULL to stop
+ */
+void
+c1_io_sched(struct c1 *c1, struct io_sched *ios);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "c1_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -9,6 +9,8 @@
 #include <hse_util/hse_err.h>
 #include <hse_util/workqueue.h>
 
+#include <hse/hse_limits.h>
+
 #include <hse_ikvdb/kvs_cparams.h>
 #include <hse_ikvdb/tuple.h>
 #include <hse_ikvdb/limits.h>
@@ -18,9 +20,27 @@
 /* MTF_MOCK_DECL(cn) */
 
 #define CN_CFLAG_CAPPED (1 << 0)
+#define CN_CFLAG_VCOMP_LZ4 (1 << 1)
+#define CN_CFLAG_RANGE (1 << 2)
+#define CN_CFLAG_PTLOOKUP (1 << 3)
+#define CN_CFLAG_KFIXED8 (1 << 4)
+#define CN_CFLAG_KFIXED16 (1 << 5)
+
+/* Fixed key length of a cn with flags @cflags (see the kfixed cparam),
+ * 0 if keys are of variable length.
+ */
+static inline uint
+cn_cflags_kfixed(u32 cflags)
+{
+    if (cflags & CN_CFLAG_KFIXED8)
+        return 8;
+
+    return (cflags & CN_CFLAG_KFIXED16) ? 16 : 0;
+}
 
 struct cn;
 struct cn_kvdb;
+struct io_sched;
 struct cndb;
 struct mpool;
 struct kvs_cparams;
@@ -31,6 +51,64 @@ struct sts;
 enum cn_action;
 enum mp_media_classp;
 
+/**
+ * struct cn_ingest_stats - where a cn_ingestv() spent its time
+ * @cis_commit_ns: committing the kvsets' mblocks
+ * @cis_cndb_ns:   logging the ingest transaction to cndb, other than the
+ *                 mblock commit records
+ * @cis_insert_ns: creating the kvsets and adding them to the cn trees
+ */
+struct cn_ingest_stats {
+    u64 cis_commit_ns;
+    u64 cis_cndb_ns;
+    u64 cis_insert_ns;
+};
+
+/**
+ * struct cn_open_stats - where a cn_open() spent its time
+ * @cos_instantiate_ns: reading the kvsets' metadata from cndb
+ * @cos_kvset_ns:       creating the kvsets, which maps their kblocks and
+ *                      preloads their blooms, and adding them to the tree
+ * @cos_kvsets:         number of kvsets
+ * @cos_mblocks:        number of kblocks and vblocks of the kvsets
+ */
+struct cn_open_stats {
+    u64 cos_instantiate_ns;
+    u64 cos_kvset_ns;
+    u64 cos_kvsets;
+    u64 cos_mblocks;
+};
+
+/**
+ * struct cn_amp - read, write and space amplification inputs of a cn
+ * @ca_ubytes:    user bytes written (key + value lengths of puts)
+ * @ca_c1bytes:   bytes written to c1
+ * @ca_ingest:    bytes written by ingest
+ * @ca_spill:     bytes written by spill
+ * @ca_kcompact:  bytes written by k-compaction
+ * @ca_kvcompact: bytes written by kv-compaction
+ * @ca_rbytes:    bytes read by compaction
+ * @ca_gets:      gets
+ * @ca_kvsets:    kvsets probed by gets
+ * @ca_window:    length of the measurement window (ns)
+ * @ca_alen:      allocated length of the cn tree (not windowed)
+ * @ca_lgood:     estimated live length of the tree's leaves (not windowed)
+ */
+struct cn_amp {
+    u64 ca_ubytes;
+    u64 ca_c1bytes;
+    u64 ca_ingest;
+    u64 ca_spill;
+    u64 ca_kcompact;
+    u64 ca_kvcompact;
+    u64 ca_rbytes;
+    u64 ca_gets;
+    u64 ca_kvsets;
+    u64 ca_window;
+    u64 ca_alen;
+    u64 ca_lgood;
+};
+
 enum cn_aio_reqtype {
     CN_AIO_REQ_INGEST = 0,
     CN_AIO_REQ_MAINT,
@@ -96,6 +174,36 @@ cn_fini(void);
 u64
 cn_get_ingest_dgen(const struct cn *cn);
 
+/**
+ * cn_get_cfilter_gen() - count of compactions that filtered values
+ * @cn: cn handle
+ *
+ * Advanced after each compaction in which the compaction filter dropped
+ * or replaced a value has been committed to the tree.
+ */
+/* MTF_MOCK */
+u64
+cn_get_cfilter_gen(const struct cn *cn);
+
+/**
+ * cn_inc_cfilter_gen() - advance the cfilter gen after a filtered compaction
+ * @cn: cn handle
+ */
+void
+cn_inc_cfilter_gen(struct cn *cn);
+
+/**
+ * cn_get_ingest_seqno() - max seqno of the data ingested into cn
+ * @cn: cn handle
+ *
+ * Each ingest publishes its max seqno before advancing the ingest dgen, so
+ * the value read after cn_get_ingest_dgen() bounds the seqnos of all the
+ * keys in cn as of that dgen.
+ */
+/* MTF_MOCK */
+u64
+cn_get_ingest_seqno(const struct cn *cn);
+
 /* MTF_MOCK */
 struct kvs_rparams *
 cn_get_rp(const struct cn *cn);
@@ -108,6 +216,23 @@ cn_get_dataset(const struct cn *cn);
 struct tbkt *
 cn_get_tbkt_maint(const struct cn *cn);
 
+/* MTF_MOCK */
+struct tbkt *
+cn_get_tbkt_vgc(const struct cn *cn);
+
+/* Returns the token bucket of the guaranteed compaction write rate
+ * of the kvs (see tbkt_request_floor()), NULL if it has none.
+ */
+/* MTF_MOCK */
+struct tbkt *
+cn_get_tbkt_floor(struct cn *cn);
+
+/* Returns the kvdb's I/O scheduler, NULL if it has none.
+ */
+/* MTF_MOCK */
+struct io_sched *
+cn_get_io_sched(const struct cn *cn);
+
 /* MTF_MOCK */
 void
 cn_disable_maint(struct cn *handle, bool onoff);
@@ -125,6 +250,147 @@ cn_get(
     enum key_lookup_res *res,
     struct kvs_buf *     vbuf);
 
+/**
+ * cn_get_batch() - search cn for a batch of keys
+ * @cn:      cn handle
+ * @ktv:     vector of keys
+ * @seq:     view sequence number
+ * @resv:    (output) vector of lookup results, one per key
+ * @vbufv:   (output) vector of value buffers, one per key
+ * @lookupv: indices into @ktv, @resv and @vbufv of the keys to search for
+ * @lookupc: number of entries in @lookupv
+ *
+ * Equivalent to calling cn_get() for each key named by @lookupv.
+ */
+/* MTF_MOCK */
+merr_t
+cn_get_batch(
+    struct cn *          cn,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc);
+
+/**
+ * struct cn_split_key - a key at which cn_range_split() splits a key range
+ * @csk_len:  length of the key
+ * @csk_key:  the key
+ */
+struct cn_split_key {
+    u32 csk_len;
+    u8  csk_key[HSE_KVS_KLEN_MAX];
+};
+
+/**
+ * cn_range_split() - find keys that split cn into ranges of equal size
+ * @cn:      cn handle
+ * @pfx:     only split the keys that begin with this prefix (or NULL)
+ * @pfx_len: length of %pfx
+ * @rangec:  number of ranges wanted
+ * @keyv:    (output) vector of at least %rangec - 1 split keys
+ * @keycp:   (output) number of split keys in %keyv
+ *
+ * The split keys are kblock min keys, in ascending order, chosen such
+ * that the ranges between them hold about the same number of keys as
+ * estimated by the kvset stats.  Fewer than %rangec - 1 keys are
+ * returned if cn has too few kblocks to tell the ranges apart.
+ */
+merr_t
+cn_range_split(
+    struct cn *          cn,
+    const void *         pfx,
+    u32                  pfx_len,
+    u32                  rangec,
+    struct cn_split_key *keyv,
+    u32 *                keycp);
+
+/**
+ * struct cn_range_est - estimated size of a key range in cn
+ * @cre_keys:     estimated number of live keys
+ * @cre_keys_lo:  lower bound of %cre_keys
+ * @cre_keys_hi:  upper bound of %cre_keys
+ * @cre_bytes:    estimated key and value bytes
+ * @cre_bytes_hi: upper bound of %cre_bytes
+ * @cre_kvsets:   number of kvsets that overlap the range
+ */
+struct cn_range_est {
+    u64 cre_keys;
+    u64 cre_keys_lo;
+    u64 cre_keys_hi;
+    u64 cre_bytes;
+    u64 cre_bytes_hi;
+    u32 cre_kvsets;
+};
+
+/**
+ * cn_range_estimate() - estimate the keys and bytes in a key range of cn
+ * @cn:     cn handle
+ * @lo:     smallest key of the range (or NULL)
+ * @lo_len: length of %lo
+ * @hi:     largest key of the range (or NULL)
+ * @hi_len: length of %hi
+ * @est:    (output) the estimate
+ *
+ * The estimate reads only kvset metadata.  Kblocks that lie entirely in
+ * the range count in full, kblocks that straddle an end of the range
+ * count for half, and the sum over all kvsets is scaled down by the
+ * ratio of distinct to total keys given by the union of the kvsets'
+ * hyperloglogs.  The bounds assume that each straddling kblock is
+ * entirely outside (or inside) the range.
+ */
+merr_t
+cn_range_estimate(
+    struct cn *          cn,
+    const void *         lo,
+    u32                  lo_len,
+    const void *         hi,
+    u32                  hi_len,
+    struct cn_range_est *est);
+
+/**
+ * cn_get_lease() - like cn_get(), but lease rather than copy the value
+ * @cn:      cn from which to get
+ * @kt:      key to get
+ * @seq:     view seqno
+ * @res:     (output) lookup result
+ * @lease:   (output) value lease if *res is FOUND_VAL
+ *
+ * A found value is referenced in place and pinned until released via
+ * cn_lease_release().
+ */
+/* MTF_MOCK */
+merr_t
+cn_get_lease(
+    struct cn *          cn,
+    struct kvs_ktuple *  kt,
+    u64                  seq,
+    enum key_lookup_res *res,
+    struct kvs_vlease *  lease);
+
+/**
+ * cn_prefetch() - like cn_get(), but prefetch rather than copy the value
+ * @cn:      cn to search
+ * @kt:      key to prefetch
+ * @seq:     view seqno
+ * @res:     (output) lookup result
+ *
+ * Reads the kblock pages on the path to the key and starts reading the
+ * vblock pages of its value, so that a later cn_get() hits the page cache.
+ */
+/* MTF_MOCK */
+merr_t
+cn_prefetch(struct cn *cn, struct kvs_ktuple *kt, u64 seq, enum key_lookup_res *res);
+
+/**
+ * cn_lease_release() - release a lease acquired by cn_get_lease()
+ * @lease:   lease to release
+ */
+/* MTF_MOCK */
+void
+cn_lease_release(struct kvs_vlease *lease);
+
 struct query_ctx;
 
 merr_t
@@ -137,12 +403,41 @@ cn_pfx_probe(
     struct kvs_buf *     kbuf,
     struct kvs_buf *     vbuf);
 
+/**
+ * cn_pfx_probe_batch() - prefix probe cn for a batch of prefixes
+ * @cn:      cn handle
+ * @ktv:     vector of prefixes
+ * @seq:     view sequence number
+ * @resv:    (output) vector of probe results, one per prefix
+ * @qctxv:   vector of query contexts, one per prefix
+ * @kbufv:   (output) vector of key buffers, one per prefix
+ * @vbufv:   (output) vector of value buffers, one per prefix
+ * @lookupv: indices into the above vectors of the prefixes to probe
+ * @lookupc: number of entries in @lookupv
+ *
+ * Equivalent to calling cn_pfx_probe() for each prefix named by @lookupv.
+ */
+/* MTF_MOCK */
+merr_t
+cn_pfx_probe_batch(
+    struct cn *          cn,
+    struct kvs_ktuple *  ktv,
+    u64                  seq,
+    enum key_lookup_res *resv,
+    struct query_ctx *   qctxv,
+    struct kvs_buf *     kbufv,
+    struct kvs_buf *     vbufv,
+    const u32 *          lookupv,
+    u32                  lookupc);
+
 /**
  * cn_ingestv() - A vectored version of cn_ingest
  * @cn:
  * @mbv:
  *      The first vcommitted[i] vblocks of kvset mbv[i] are already committed.
- * @mbc:
+ * @mbc: number of kvsets in mbv[i].  If greater than one, the kvsets must
+ *      have disjoint key ranges in ascending order, and vcommitted[i] must
+ *      be zero.
  * @vcommitted: indicated in each kvset how many vblocks are already committed.
  *      Also these comitted vblocks ae not deleted by cndb replay [in the case
  *      this ingest is rolled back].
@@ -154,23 +449,61 @@ cn_pfx_probe(
  * @ingestc:
  * @ingested:
  * @seqno_max_out:
+ * @stats:      (output) where the ingest spent its time, may be NULL
  */
 /* MTF_MOCK */
 merr_t
 cn_ingestv(
-    struct cn **           cn,
-    struct kvset_mblocks **mbv,
-    int *                  mbc,
-    u32 *                  vcommitted,
-    u64                    ingestid,
-    int                    ingestc,
-    bool *                 ingested_out,
-    u64 *                  seqno_max_out);
+    struct cn **            cn,
+    struct kvset_mblocks ** mbv,
+    int *                   mbc,
+    u32 *                   vcommitted,
+    u64                     ingestid,
+    int                     ingestc,
+    bool *                  ingested_out,
+    u64 *                   seqno_max_out,
+    struct cn_ingest_stats *stats);
+
+/**
+ * cn_ingest_bulk() - ingest kvsets built by a bulk load (see cn_bulk.h)
+ * @cn:  cn
+ * @mbv: kvsets, with disjoint key ranges in ascending order
+ * @mbc: number of kvsets in @mbv
+ *
+ * Like cn_ingestv(), but the kvsets' seqnos may be older than the latest
+ * ingest recorded in cndb.  The mblocks are always freed, and deleted on
+ * error.
+ */
+/* MTF_MOCK */
+merr_t
+cn_ingest_bulk(struct cn *cn, struct kvset_mblocks *mbv, int mbc);
 
 /* MTF_MOCK */
 struct perfc_set *
 cn_get_ingest_perfc(const struct cn *cn);
 
+/* MTF_MOCK */
+struct perfc_set *
+cn_get_amp_perfc(const struct cn *cn);
+
+/**
+ * cn_amp_read() - read the amplification counters of a cn
+ * @cn:  cn handle
+ * @cum: (output) counters since the cn was opened
+ * @win: (output) counters since the last cn_amp_reset(), may be NULL
+ */
+/* MTF_MOCK */
+void
+cn_amp_read(struct cn *cn, struct cn_amp *cum, struct cn_amp *win);
+
+/**
+ * cn_amp_reset() - start a new amplification measurement window
+ * @cn:  cn handle
+ */
+/* MTF_MOCK */
+void
+cn_amp_reset(struct cn *cn);
+
 /* MTF_MOCK */
 void *
 cn_get_tree(const struct cn *cn);
@@ -207,6 +540,22 @@ cn_get_sched(struct cn *cn);
 atomic_t *
 cn_get_cancel(struct cn *cn);
 
+/**
+ * cn_cfilter_set() - set the compaction filter of a cn
+ * @cn:  cn
+ * @fn:  compaction filter, NULL for none
+ * @arg: passed to @fn
+ *
+ * Applies to the compactions that start after the call.
+ */
+/* MTF_MOCK */
+void
+cn_cfilter_set(struct cn *cn, kvs_cfilter_fn *fn, void *arg);
+
+/* MTF_MOCK */
+kvs_cfilter_fn *
+cn_cfilter_get(struct cn *cn, void **arg);
+
 /* MTF_MOCK */
 struct perfc_set *
 cn_get_perfc(struct cn *cn, enum cn_action action);
@@ -227,6 +576,10 @@ cn_get_sfx_len(struct cn *cn);
 u64
 cn_get_cnid(const struct cn *cn);
 
+/* MTF_MOCK */
+u64
+cn_get_pinned(const struct cn *cn, uint level);
+
 /* MTF_MOCK */
 struct cndb *
 cn_get_cndb(const struct cn *cn);
@@ -239,6 +592,15 @@ cn_get_cn_kvdb(const struct cn *handle);
 u32
 cn_get_flags(const struct cn *handle);
 
+/**
+ * cn_open_stats_get() - get the cn_open() stats of a cn
+ * @cn:    cn handle
+ * @stats: (output) open stats
+ */
+/* MTF_MOCK */
+void
+cn_open_stats_get(const struct cn *cn, struct cn_open_stats *stats);
+
 /* MTF_MOCK */
 unsigned
 cn_best_ingest_count(const struct cn *cn, unsigned avg_key_len);
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_ATTACH_H
+#define HSE_IKVDB_CN_ATTACH_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* An attach adds kvsets built elsewhere, e.g. by an offline kvdb, to the
+ * root node of a cn in a single cndb transaction.
+ *
+ * Each kvset is given as a directory of kblock and vblock images in the
+ * on-media format, one file per mblock, named K<n> and V<n> where <n> is
+ * the index of the mblock in the kvset.  Anything after the index that
+ * starts with a '.' is ignored, so the files written by "cn_kbdump -w"
+ * can be used once they are uncompressed.  The values referenced by the
+ * kblocks are located by vblock index, so the vblock images must keep
+ * the indexes they had in the kvset they were taken from.
+ *
+ * Each image is checked, kblocks with the kvset checker, before it is
+ * copied into a new mblock of the cn's dataset.  The kvsets keep their
+ * seqnos, which cannot be rewritten in place: unless the cn is empty,
+ * they must all be newer than the data already ingested into it.
+ */
+
+struct cn;
+struct cn_attach;
+
+/**
+ * cn_attach_create() - start an attach
+ * @cn:   cn
+ * @attp: (output) attach
+ */
+merr_t
+cn_attach_create(struct cn *cn, struct cn_attach **attp);
+
+/**
+ * cn_attach_destroy() - end an attach
+ * @att: attach, may be NULL
+ *
+ * The mblocks of kvsets that were not committed are deleted.
+ */
+void
+cn_attach_destroy(struct cn_attach *att);
+
+/**
+ * cn_attach_add() - check and write the images of a kvset
+ * @att: attach
+ * @dir: directory of the kvset's images
+ *
+ * Kvsets are ingested in the order they are added, each one newer than
+ * the one before.  Fails with EINVAL if the directory's files do not
+ * form a kvset, with EILSEQ if an image fails its check.  A failed add
+ * leaves the kvsets added before it in place.
+ */
+merr_t
+cn_attach_add(struct cn_attach *att, const char *dir);
+
+/**
+ * cn_attach_seqno() - get the range of seqnos of the kvsets added
+ * @att:       attach
+ * @seqno_min: (output) smallest seqno, U64_MAX if none
+ * @seqno_max: (output) largest seqno, zero if none
+ */
+void
+cn_attach_seqno(struct cn_attach *att, u64 *seqno_min, u64 *seqno_max);
+
+/**
+ * cn_attach_commit() - ingest the kvsets added into cn
+ * @att: attach
+ *
+ * Fails with ERANGE if the cn has kvsets and the added kvsets are not
+ * newer than everything ingested into it.  Whether it succeeds or not,
+ * the attach must then be destroyed.
+ */
+merr_t
+cn_attach_commit(struct cn_attach *att);
+
+#endif
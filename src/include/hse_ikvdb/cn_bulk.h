@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_BULK_H
+#define HSE_IKVDB_CN_BULK_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* A bulk load writes sorted key/value pairs straight into kvsets of a cn,
+ * bypassing c0 and c1, and ingests them in a single cndb transaction.
+ *
+ * The kvsets are added to the root node like those of a c0 ingest: keys
+ * are distributed among the children of a node by hash, so a kvset can
+ * only be placed below the root by a spill.  What the load saves is the
+ * write amplification of c0, c1 and the root's kvset compactions.
+ *
+ * All values carry the seqno given to cn_bulk_create().  The caller
+ * reserves it before flushing c0 and keeps the kvs from being mutated
+ * until the load is committed or aborted, so the loaded values are newer
+ * than everything already in cn and become visible, all at once, when
+ * cn_bulk_commit() adds the kvsets to the tree.
+ */
+
+struct cn;
+struct cn_bulk;
+
+/**
+ * cn_bulk_create() - start a bulk load
+ * @cn:    cn
+ * @seqno: seqno of all the loaded values
+ * @bulkp: (output) bulk load
+ */
+merr_t
+cn_bulk_create(struct cn *cn, u64 seqno, struct cn_bulk **bulkp);
+
+/**
+ * cn_bulk_destroy() - end a bulk load
+ * @bulk: bulk load, may be NULL
+ *
+ * The mblocks of a load that was not committed are deleted.
+ */
+void
+cn_bulk_destroy(struct cn_bulk *bulk);
+
+/**
+ * cn_bulk_add() - add a key/value pair
+ * @bulk: bulk load
+ * @key:  key
+ * @klen: length of @key
+ * @val:  value
+ * @vlen: length of @val
+ *
+ * Keys must be added in strictly ascending order.  A key out of order
+ * fails with EINVAL and is not added.  After any other error the load
+ * can only be destroyed.
+ */
+merr_t
+cn_bulk_add(struct cn_bulk *bulk, const void *key, uint klen, const void *val, uint vlen);
+
+/**
+ * cn_bulk_commit() - ingest the loaded kvsets into cn
+ * @bulk: bulk load
+ *
+ * Whether it succeeds or not, the load must then be destroyed.
+ */
+merr_t
+cn_bulk_commit(struct cn_bulk *bulk);
+
+#endif
@@ -9,6 +9,8 @@
 #include <hse_util/hse_err.h>
 #include <hse_util/inttypes.h>
 
+#include <hse_ikvdb/tuple.h>
+
 /* MTF_MOCK_DECL(cn_cursor) */
 
 struct cn;
@@ -22,6 +24,8 @@ cn_cursor_create(
     struct cn *            cn,
     u64                    seqno,
     bool                   reverse,
+    bool                   keys_only,
+    bool                   direct,
     const void *           prefix,
     u32                    len,
     struct cursor_summary *summary,
@@ -48,6 +52,19 @@ cn_cursor_read(void *cursor, struct kvs_kvtuple *kvt, bool *eof);
 void
 cn_cursor_destroy(void *cursor);
 
+/**
+ * cn_cursor_pred() - set (or clear) the filter predicates of a cn cursor
+ * @cursor:  cn cursor
+ * @keyfn:   called on each key before its value is read (or NULL)
+ * @valfn:   called on each key and value that pass %keyfn (or NULL)
+ * @arg:     argument passed to %keyfn and %valfn
+ *
+ * Keys rejected by either predicate are skipped by cn_cursor_read().
+ */
+/* MTF_MOCK */
+void
+cn_cursor_pred(void *cursor, kvs_pred_fn *keyfn, kvs_pred_fn *valfn, void *arg);
+
 /* MTF_MOCK */
 merr_t
 cn_cursor_active_kvsets(void *cursor, u32 *active, u32 *total);
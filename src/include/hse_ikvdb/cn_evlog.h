@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_EVLOG_H
+#define HSE_IKVDB_CN_EVLOG_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The cn event log is a bounded, kvdb-wide timeline of the ingest, spill,
+ * k-compact and kv-compact jobs run by cn.  Each job records one event
+ * when it finishes (successfully or not).  The log keeps the most recent
+ * CN_EVLOG_SZ events and numbers them so that a reader can poll for the
+ * events that followed the last one it saw (see the REST url
+ * mpool/<mp>/cn/events and "hse kvdb events").
+ */
+
+#define CN_EVLOG_SZ (1024)
+
+enum cn_event_type {
+    CN_EVENT_INGEST,
+    CN_EVENT_SPILL,
+    CN_EVENT_KCOMPACT,
+    CN_EVENT_KVCOMPACT,
+    CN_EVENT_TYPE_MAX
+};
+
+/**
+ * struct cn_event - one finished ingest or compaction job
+ * @ce_seq:         event number, assigned by cn_evlog_add()
+ * @ce_time:        time at which the job finished (ns, monotonic)
+ * @ce_cnid:        cnid of the tree
+ * @ce_kvsets_in:   number of input kvsets
+ * @ce_kvsets_out:  number of output kvsets
+ * @ce_keys_in:     number of input keys
+ * @ce_keys_out:    number of output keys
+ * @ce_bytes_in:    bytes read from the input kvsets
+ * @ce_bytes_out:   bytes written to the output kvsets
+ * @ce_queue_ns:    time from scheduling to the start of the job
+ * @ce_run_ns:      time from the start to the end of the job
+ * @ce_throttle_ns: time spent waiting on the compaction rate limit
+ * @ce_type:        enum cn_event_type
+ * @ce_rule:        compaction rule that chose the job (enum cn_comp_rule)
+ * @ce_level:       node level
+ * @ce_token:       true if the job held its node's compaction token
+ * @ce_offset:      node offset
+ * @ce_errno:       errno of the job, 0 on success
+ */
+struct cn_event {
+    u64 ce_seq;
+    u64 ce_time;
+    u64 ce_cnid;
+    u32 ce_kvsets_in;
+    u32 ce_kvsets_out;
+    u64 ce_keys_in;
+    u64 ce_keys_out;
+    u64 ce_bytes_in;
+    u64 ce_bytes_out;
+    u64 ce_queue_ns;
+    u64 ce_run_ns;
+    u64 ce_throttle_ns;
+    u8  ce_type;
+    u8  ce_rule;
+    u8  ce_level;
+    u8  ce_token;
+    u16 ce_offset;
+    u16 ce_errno;
+};
+
+struct cn_evlog;
+
+merr_t
+cn_evlog_create(struct cn_evlog **evlogp);
+
+void
+cn_evlog_destroy(struct cn_evlog *evlog);
+
+/**
+ * cn_evlog_add() - record an event
+ * @evlog: event log, may be NULL
+ * @cev:   event, whose @ce_seq and @ce_time are filled in
+ */
+void
+cn_evlog_add(struct cn_evlog *evlog, struct cn_event *cev);
+
+/**
+ * cn_evlog_read() - copy the events that follow a given event
+ * @evlog: event log
+ * @since: copy events whose number is greater than this, 0 for all
+ * @evv:   (output) events, oldest first
+ * @evc:   capacity of %evv
+ *
+ * If more than %evc events follow %since, the oldest of them are skipped.
+ *
+ * Return: number of events copied
+ */
+uint
+cn_evlog_read(struct cn_evlog *evlog, u64 since, struct cn_event *evv, uint evc);
+
+const char *
+cn_event_type2str(enum cn_event_type type);
+
+/**
+ * cn_event_rule2str() - name of the compaction rule of an event
+ * @rule: value of @ce_rule
+ */
+const char *
+cn_event_rule2str(uint rule);
+
+#endif
@@ -9,20 +9,48 @@
 #include <hse_util/atomic.h>
 #include <hse_util/hse_err.h>
 
+#include <hse_ikvdb/mblock_life.h>
+
 /* MTF_MOCK_DECL(cn_kvdb) */
 
+struct cn_evlog;
+struct cn_scache;
+struct cn_reclaim;
+struct cn_scrub;
+struct cn_reap;
+struct io_sched;
+
 /**
  * struct cn_kvdb - public portion of per kvdb cN object
  * @cnd_kblk_cnt:  number of cn kblocks in kvdb
  * @cnd_vblk_cnt:  number of cn vblocks in kvdb
  * @cnd_kblk_size: sum of on-media sizes of all cn kblocks in kvdb (bytes)
  * @cnd_vblk_size: sum of on-media sizes of all cn vblocks in kvdb (bytes)
+ * @cnd_ra_pct:    percent of the configured vblock readahead to apply
+ * @cnd_evlog:     log of recent ingest and compaction events
+ * @cnd_scache:    staging cache of capacity vblocks, NULL if disabled
+ * @cnd_reclaim:   queue of mblocks to delete, NULL if disabled
+ * @cnd_scrub:     background kvset verifier, NULL if disabled
+ * @cnd_reap:      reaper of dropped kvses, NULL if read-only
+ * @cnd_ios:       kvdb I/O scheduler (owned by ikvdb), NULL if disabled
+ * @cnd_life_alloc: bytes of cn mblocks allocated, by expected lifetime
  */
 struct cn_kvdb {
     atomic64_t cnd_kblk_cnt;
     atomic64_t cnd_vblk_cnt;
     atomic64_t cnd_kblk_size;
     atomic64_t cnd_vblk_size;
+    atomic_t   cnd_ra_pct;
+
+    struct cn_evlog *  cnd_evlog;
+    struct cn_scache * cnd_scache;
+    struct cn_reclaim *cnd_reclaim;
+    struct cn_scrub *  cnd_scrub;
+    struct cn_reap *   cnd_reap;
+    struct io_sched *  cnd_ios;
+    u64                cnd_cpus;
+
+    atomic64_t cnd_life_alloc[MBLOCK_LIFE_CNT];
 };
 
 /* MTF_MOCK */
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_REAP_H
+#define HSE_IKVDB_CN_REAP_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The cn reaper deletes the mblocks of dropped kvses in the background.
+ *
+ * Dropping a kvs only records the drop in cndb (cndb_cn_drop()), so the
+ * kvs is gone as soon as the call returns.  A single kvdb-wide thread then
+ * takes the dropped cns one at a time, deletes their mblocks in batches,
+ * at most cn_drop_mbps MiB per second, and finally purges each cn from
+ * cndb.  A kvs with many TiB of data thus neither blocks its dropper nor
+ * floods the media with discards.
+ *
+ * The drop is durable and the purge is the last step, so a restart
+ * simply resumes reaping: the mblocks already deleted are skipped.
+ */
+
+struct cn_reap;
+struct cndb;
+struct mpool;
+
+/**
+ * struct cn_reap_stats - reaper activity
+ * @crs_cns:      dropped cns purged
+ * @crs_mblocks:  mblocks deleted
+ * @crs_bytes:    bytes deleted
+ * @crs_errors:   cns whose reaping failed, to be retried
+ */
+struct cn_reap_stats {
+    u64 crs_cns;
+    u64 crs_mblocks;
+    u64 crs_bytes;
+    u64 crs_errors;
+};
+
+/**
+ * cn_reap_create() - create a reaper, and start reaping the dropped cns
+ * @ds:    dataset
+ * @cndb:  cndb
+ * @rate:  bytes deleted per second (0: no pacing)
+ * @crp:   (output) reaper
+ */
+merr_t
+cn_reap_create(struct mpool *ds, struct cndb *cndb, u64 rate, struct cn_reap **crp);
+
+/**
+ * cn_reap_destroy() - stop and destroy a reaper
+ * @cr: reaper, may be NULL
+ *
+ * Does not wait for the dropped cns to be reaped, the next
+ * cn_reap_create() resumes where this one left off.
+ */
+void
+cn_reap_destroy(struct cn_reap *cr);
+
+/**
+ * cn_reap_kick() - reap a cn that was just dropped
+ * @cr: reaper, may be NULL
+ */
+void
+cn_reap_kick(struct cn_reap *cr);
+
+/**
+ * cn_reap_stats() - get reaper activity
+ * @cr:    reaper, may be NULL
+ * @stats: (output) activity
+ */
+void
+cn_reap_stats(struct cn_reap *cr, struct cn_reap_stats *stats);
+
+#endif
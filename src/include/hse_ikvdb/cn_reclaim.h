@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_RECLAIM_H
+#define HSE_IKVDB_CN_RECLAIM_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The cn reclaim queue defers the deletion of the mblocks of dead kvsets
+ * to a single kvdb-wide thread.  It is enabled by the kvdb rparam
+ * cn_reclaim_mbps.
+ *
+ * Without it, the mblocks of the kvsets replaced by a compaction are
+ * deleted (and discarded by mpool) on the stack of whoever drops the last
+ * reference, in one burst.  With it, they are queued and deleted in
+ * batches, at most cn_reclaim_mbps MiB per second, so that the discards
+ * do not compete with foreground I/O.
+ *
+ * Deferral is crash-safe: a kvset's mblocks are recorded in cndb (the "D"
+ * record) before they are queued, and the "ack D" record is written only
+ * by the completion callback, after all of them have been deleted.
+ * Recovery deletes whatever remained on the queue.
+ */
+
+struct cn_reclaim;
+struct mpool;
+
+/**
+ * cn_reclaim_cb - called once the mblocks of a request have been deleted
+ * @rock:         argument given to cn_reclaim_add()
+ * @delete_error: not all mblocks could be deleted
+ */
+typedef void
+cn_reclaim_cb(void *rock, bool delete_error);
+
+/**
+ * struct cn_reclaim_usage - reclaim queue activity
+ * @cru_queued:   bytes waiting to be deleted
+ * @cru_mblocks:  mblocks deleted
+ * @cru_bytes:    bytes deleted
+ * @cru_batches:  batches processed
+ * @cru_errors:   mblock delete errors
+ */
+struct cn_reclaim_usage {
+    u64 cru_queued;
+    u64 cru_mblocks;
+    u64 cru_bytes;
+    u64 cru_batches;
+    u64 cru_errors;
+};
+
+/**
+ * cn_reclaim_create() - create a reclaim queue
+ * @rate:  bytes deleted per second
+ * @rcp:   (output) reclaim queue
+ */
+merr_t
+cn_reclaim_create(u64 rate, struct cn_reclaim **rcp);
+
+/**
+ * cn_reclaim_destroy() - delete all queued mblocks and destroy the queue
+ * @rc: reclaim queue, may be NULL
+ */
+void
+cn_reclaim_destroy(struct cn_reclaim *rc);
+
+/**
+ * cn_reclaim_add() - queue mblocks for deletion
+ * @rc:    reclaim queue, if NULL the mblocks are deleted immediately
+ * @ds:    dataset
+ * @mbc:   number of mblock handles
+ * @mbv:   mblock handles, zero handles are skipped (copied)
+ * @bytes: sum of the mblocks' allocated lengths
+ * @cb:    completion callback, may be NULL
+ * @rock:  argument to @cb
+ *
+ * Never fails.  Should the request not be queued, the mblocks are
+ * deleted and @cb is called before returning.  Deletion stops at the
+ * first error and leaves the remaining mblocks to cndb recovery.
+ */
+void
+cn_reclaim_add(
+    struct cn_reclaim *rc,
+    struct mpool *     ds,
+    uint               mbc,
+    const u64 *        mbv,
+    u64                bytes,
+    cn_reclaim_cb *    cb,
+    void *             rock);
+
+/**
+ * cn_reclaim_flush() - wait for all queued mblocks to be deleted
+ * @rc: reclaim queue, may be NULL
+ *
+ * The mblocks queued before the call are deleted without pacing.
+ */
+void
+cn_reclaim_flush(struct cn_reclaim *rc);
+
+/**
+ * cn_reclaim_usage() - get reclaim queue activity
+ * @rc:    reclaim queue, may be NULL
+ * @usage: (output) activity
+ */
+void
+cn_reclaim_usage(struct cn_reclaim *rc, struct cn_reclaim_usage *usage);
+
+#endif
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_SCACHE_H
+#define HSE_IKVDB_CN_SCACHE_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The cn staging cache is a kvdb-wide read-through cache, kept on the
+ * staging media class, of recently read extents of capacity media class
+ * vblocks.  It is enabled by the kvdb rparam cn_scache_mb.
+ *
+ * A get whose value lies within a cached extent reads it from staging
+ * instead of capacity.  A miss never waits: an extent is admitted on its
+ * second miss within a short window (a "doorkeeper"), and is then copied
+ * to staging by a single fill thread.
+ *
+ * The cache is a ring of segments, each one staging mblock.  Extents are
+ * appended to the open segment, which is kept in memory until full, then
+ * written and committed.  Opening a segment evicts the oldest one.  Each
+ * segment is recorded in cndb as an incomplete transaction, so that its
+ * mblock is rolled back by recovery should the kvdb crash.  Entries of
+ * deleted vblocks are dropped when their mbset is destroyed.
+ */
+
+#define CN_SCACHE_EXT_SZ (32 * 1024)
+
+struct cn_scache;
+struct mbset;
+struct mpool;
+struct cndb;
+
+/**
+ * struct cn_scache_usage - staging cache occupancy and effectiveness
+ * @scu_size:    bytes of staging media in use
+ * @scu_hits:    reads served from the cache
+ * @scu_misses:  reads of capacity vblocks not in the cache
+ * @scu_fills:   extents copied to the cache
+ * @scu_evicts:  segments evicted
+ */
+struct cn_scache_usage {
+    u64 scu_size;
+    u64 scu_hits;
+    u64 scu_misses;
+    u64 scu_fills;
+    u64 scu_evicts;
+};
+
+/**
+ * cn_scache_create() - create a staging cache
+ * @ds:       dataset
+ * @cndb:     cndb in which to record the cache's mblocks
+ * @capacity: bytes of staging media to use
+ * @scp:      (output) cache
+ *
+ * Return: ENOENT if the mpool has no staging media class
+ */
+merr_t
+cn_scache_create(struct mpool *ds, struct cndb *cndb, size_t capacity, struct cn_scache **scp);
+
+/**
+ * cn_scache_destroy() - wait for pending fills and delete the cache's mblocks
+ * @sc: cache, may be NULL
+ */
+void
+cn_scache_destroy(struct cn_scache *sc);
+
+/**
+ * cn_scache_read() - read a value through the staging cache
+ * @sc:   cache
+ * @mbs:  vblock set
+ * @bnum: index of the vblock in %mbs
+ * @off:  offset of the value in the vblock's data
+ * @len:  number of bytes to read
+ * @buf:  (output) value
+ *
+ * Return: true if the value was read from the cache, false if the caller
+ * must read it from the vblock
+ */
+bool
+cn_scache_read(struct cn_scache *sc, struct mbset *mbs, uint bnum, u32 off, u32 len, void *buf);
+
+/**
+ * cn_scache_invalidate() - drop the cached extents of deleted vblocks
+ * @sc:  cache, may be NULL
+ * @idc: number of vblocks
+ * @idv: vblock ids
+ */
+void
+cn_scache_invalidate(struct cn_scache *sc, uint idc, const u64 *idv);
+
+void
+cn_scache_usage(struct cn_scache *sc, struct cn_scache_usage *usage);
+
+#endif
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_SCRUB_H
+#define HSE_IKVDB_CN_SCRUB_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The cn scrubber verifies the kvsets of open kvses in the background,
+ * with the checks of the offline checker (kvck).  It is enabled by the
+ * kvdb rparam cn_scrub_mbps.
+ *
+ * A single kvdb-wide thread visits the kvsets of each kvs in creation
+ * order, one at a time and holding only a reference on the kvset being
+ * verified.  Kblocks and vblock headers are read with mblock reads rather
+ * than through the kvset's mcache maps, so scrubbing does not evict the
+ * pages foreground reads depend on.  Reads are paced to cn_scrub_mbps MiB
+ * per second, and a kvs is scrubbed at most once per cn_scrub_period
+ * seconds.
+ *
+ * A kvset that fails verification is logged, counted, and reported to
+ * kvdb health as an I/O error.
+ */
+
+struct cn_scrub;
+struct cn;
+struct kvdb_health;
+
+/**
+ * struct cn_scrub_stats - scrubber activity
+ * @css_kvsets:     kvsets verified
+ * @css_bytes:      bytes read
+ * @css_passes:     complete passes over a kvs
+ * @css_errors:     kvsets that failed verification
+ * @css_last_cnid:  cnid of the last kvset that failed verification
+ * @css_last_tag:   tag of the last kvset that failed verification
+ */
+struct cn_scrub_stats {
+    u64 css_kvsets;
+    u64 css_bytes;
+    u64 css_passes;
+    u64 css_errors;
+    u64 css_last_cnid;
+    u64 css_last_tag;
+};
+
+/**
+ * cn_scrub_create() - create a scrubber
+ * @rate:      bytes read per second
+ * @period_ns: minimum time between the starts of two passes over a kvs
+ * @health:    kvdb health, for reporting corrupt kvsets
+ * @csp:       (output) scrubber
+ */
+merr_t
+cn_scrub_create(u64 rate, u64 period_ns, struct kvdb_health *health, struct cn_scrub **csp);
+
+/**
+ * cn_scrub_destroy() - stop and destroy a scrubber
+ * @cs: scrubber, may be NULL
+ */
+void
+cn_scrub_destroy(struct cn_scrub *cs);
+
+/**
+ * cn_scrub_add() - scrub the kvsets of a cn
+ * @cs: scrubber, may be NULL
+ * @cn: cn
+ *
+ * The first pass starts a minute after the call, to stay out of the way
+ * of the activity that follows opening a kvs.
+ */
+void
+cn_scrub_add(struct cn_scrub *cs, struct cn *cn);
+
+/**
+ * cn_scrub_remove() - stop scrubbing the kvsets of a cn
+ * @cs: scrubber, may be NULL
+ * @cn: cn
+ *
+ * Waits for the verification of a kvset of @cn in progress, if any.
+ */
+void
+cn_scrub_remove(struct cn_scrub *cs, struct cn *cn);
+
+/**
+ * cn_scrub_stats() - get scrubber activity
+ * @cs:    scrubber, may be NULL
+ * @stats: (output) activity
+ */
+void
+cn_scrub_stats(struct cn_scrub *cs, struct cn_scrub_stats *stats);
+
+#endif
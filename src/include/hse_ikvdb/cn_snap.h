@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_CN_SNAP_H
+#define HSE_IKVDB_CN_SNAP_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* A snapshot pins the kvsets of a group of cns as they were between two
+ * ingests, so that their mblocks can be copied while the cns are in use.
+ *
+ * Kvsets are immutable, and the mblocks of a kvset that a compaction
+ * replaces are deleted only when its last reference is put.  A snapshot
+ * takes a reference on every kvset (by way of a tree view), and on every
+ * cn so that it cannot finish closing while the kvsets are pinned.  The
+ * pins are held in memory only: a crash releases them, and cndb recovery
+ * then deletes the mblocks of the kvsets that were compacted away.
+ *
+ * cn_snap_export() writes a snapshot as a directory:
+ *
+ *   <dir>/mblocks/0x<id>             an mblock image, or a symlink to the
+ *                                    same file of the base export
+ *   <dir>/<cn name>/<dgen>/K<n>.0x<id>
+ *   <dir>/<cn name>/<dgen>/V<n>.0x<id>
+ *                                    symlinks to ../../mblocks/0x<id>
+ *
+ * Each <dgen> directory is a kvset in the layout cn_attach_add() takes,
+ * and the dgens are zero-padded so the directories sort oldest first.
+ * Given a base export, only the mblocks that are not in its snapshot are
+ * copied, the others are linked to it, so a series of exports each sends
+ * only what was written since the previous one.
+ */
+
+struct cn;
+struct cn_snap;
+
+/**
+ * cn_snap_create() - pin the kvsets of a group of cns
+ * @cnv:   cns, in the order their ingest locks are taken
+ * @namev: names of the cns' directories in an export
+ * @cnc:   number of cns
+ * @snapp: (output) snapshot
+ *
+ * No ingest into any of the cns is in progress while their kvsets are
+ * pinned, so a multi-cn ingest is either entirely in the snapshot or not
+ * at all.
+ */
+merr_t
+cn_snap_create(struct cn **cnv, const char *const *namev, uint cnc, struct cn_snap **snapp);
+
+/**
+ * cn_snap_destroy() - release a snapshot's pins
+ * @snap: snapshot, may be NULL
+ */
+void
+cn_snap_destroy(struct cn_snap *snap);
+
+/**
+ * cn_snap_export() - copy a snapshot's mblocks into a directory
+ * @snap:    snapshot
+ * @dir:     directory to create
+ * @base:    snapshot of a previous export, or NULL
+ * @basedir: directory of the export of @base
+ */
+merr_t
+cn_snap_export(struct cn_snap *snap, const char *dir, struct cn_snap *base, const char *basedir);
+
+#endif
@@ -24,6 +24,11 @@ struct kvset_meta;
 /* Default ingest id. */
 #define CNDB_DFLT_INGESTID (U64_MAX - 1)
 
+/* Keep all the mblocks of a C record, kblocks included, when its
+ * transaction is rolled back (see cndb_txn_txc()).
+ */
+#define CNDB_KEEP_ALL U32_MAX
+
 /* MTF_MOCK_DECL(cndb) */
 
 /**
@@ -217,6 +222,14 @@ cndb_cn_info_idx(
 u64
 cndb_seqno(struct cndb *cndb);
 
+/**
+ * cndb_replay_recs() - number of records read by cndb_replay()
+ * @cndb: cndb handle
+ */
+/* MTF_MOCK */
+u64
+cndb_replay_recs(struct cndb *cndb);
+
 /**
  * cndb_journal() - write-through cache a message to the MDC.
  * @cndb:         cndb handle
@@ -273,11 +286,39 @@ cndb_cn_cparams(struct cndb *cndb, u64 cnid);
  * @cnid:  persistent identifier for new KVS
  *
  * The cn kvs must not be open, and cndb must be open read/write.
+ *
+ * The drop is only recorded: the cn disappears from cndb_cn_count() and
+ * cndb_cn_info_idx() at once, but its metadata, and its mblocks, remain
+ * until they are reaped with cndb_cn_dropped() and cndb_cn_purge().  A
+ * dropped cn that is not purged is still dropped after a restart.
  */
 /* MTF_MOCK */
 merr_t
 cndb_cn_drop(struct cndb *cndb, u64 cnid);
 
+/**
+ * cndb_cn_dropped() - get the mblocks of a dropped cn
+ * @cndb:   cndb handle
+ * @cnid:   (output) id of a dropped cn, 0 if there is none
+ * @mbidv:  (output) ids of its mblocks, free with free()
+ * @mbidc:  (output) number of ids in @mbidv
+ *
+ * Some of the mblocks may already have been deleted, by a compaction or
+ * by an earlier attempt at reaping the cn.
+ */
+/* MTF_MOCK */
+merr_t
+cndb_cn_dropped(struct cndb *cndb, u64 *cnid, u64 **mbidv, uint *mbidc);
+
+/**
+ * cndb_cn_purge() - forget a dropped cn
+ * @cndb:  cndb handle
+ * @cnid:  id of a dropped cn, all of whose mblocks have been deleted
+ */
+/* MTF_MOCK */
+merr_t
+cndb_cn_purge(struct cndb *cndb, u64 cnid);
+
 /**
  * cndb_txn_start() - begin a cndb transaction
  * @cndb:     a cndb handle obtained from cndb_open()
@@ -309,7 +350,8 @@ cndb_txn_start(struct cndb *cndb, u64 *txid, u64 ingestid, int nc, int nd, u64 s
  * @mblocks:  list of involved blkids
  * @keepvbc:  count of vblocks to keep (not delete) when the CN mutation is
  *      rolled back during cndb replay. The oids of vblocks to keep are the
- *      first in the vblocks oids list.
+ *      first in the vblocks oids list.  CNDB_KEEP_ALL keeps the kblocks
+ *      too, for a kvset that is moved rather than rewritten.
  *
  * @tag is a unique iterator for this @txid.  It is owned by the caller, but
  * maintained by cndb.  It must be initialized to zero when the txid is minted.
@@ -23,10 +23,17 @@ struct hse_kvdb_compact_status;
 
 /**
  * enum csched_policy - compaction scheduler policy
- * csched_policy_old:  Do not use csched.  Use old tree walker scheduler.
- * csched_policy_noop: Disable scheduler.
+ * csched_policy_old:    Do not use csched.  Use old tree walker scheduler.
+ * csched_policy_sp3:    Space amp scheduler.
+ * csched_policy_hybrid: Tier internal nodes, level leaf nodes (see cn_size_ratio).
+ * csched_policy_noop:   Disable scheduler.
  */
-enum csched_policy { csched_policy_old = 0, csched_policy_sp3 = 3, csched_policy_noop = 0xff };
+enum csched_policy {
+    csched_policy_old = 0,
+    csched_policy_sp3 = 3,
+    csched_policy_hybrid = 4,
+    csched_policy_noop = 0xff,
+};
 
 /**
  * csched_create() - create a scheduler for kvdb compaction work
@@ -78,6 +85,36 @@ csched_compact_status(struct csched *handle, struct hse_kvdb_compact_status *sta
 struct tbkt *
 csched_tbkt_maint_get(struct csched *handle);
 
+/* MTF_MOCK */
+struct tbkt *
+csched_tbkt_vgc_get(struct csched *handle);
+
+/* MTF_MOCK */
+uint
+csched_root_len(struct csched *handle);
+
+/**
+ * csched_assist() - run one queued root spill on the calling thread
+ * @handle: scheduler
+ *
+ * Used by throttled writers to help compaction rather than sleep.
+ *
+ * Return: true if a job was run
+ */
+/* MTF_MOCK */
+bool
+csched_assist(struct csched *handle);
+
+/**
+ * csched_notify_latency() - report the get latency at the objective percentile
+ * @handle: scheduler
+ * @lat_ns: latency of the csched_slo_pct percentile of the gets since the
+ *          previous report (ns), 0 if there were too few to tell
+ */
+/* MTF_MOCK */
+void
+csched_notify_latency(struct csched *handle, u64 lat_ns);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "csched_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
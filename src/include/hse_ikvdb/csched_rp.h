@@ -39,6 +39,7 @@ csched_bits_set(u64 word, uint shift, u64 mask, u64 bits)
  *            1:    Policy 1 (compatibility mode)
  *            2:    Policy 2 (no longer supported)
  *            3:    Policy 3 (space amp scheduler)
+ *            4:    Policy 4 (hybrid tiered/leveled scheduler)
  *            0xff: No-op scheduler
  */
 
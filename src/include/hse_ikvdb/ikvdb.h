@@ -16,6 +16,7 @@
 
 #include <hse_util/inttypes.h>
 #include <hse_util/hse_err.h>
+#include <hse_util/atomic.h>
 #include <hse_util/perfc.h>
 #include <hse_util/workqueue.h>
 
@@ -31,9 +32,16 @@ struct kvdb_log;
 struct hse_kvs_cursor;
 struct mpool;
 struct c0sk;
+struct kvdb_keylock;
 struct cndb;
 struct kvdb_diag_kvs_list;
 struct c1;
+struct cn_split_key;
+struct cn_range_est;
+struct ikvdb_bulk;
+struct ikvdb_stream;
+struct cn_snap;
+struct lathist;
 
 struct kvs;
 
@@ -44,20 +52,30 @@ struct hse_kvdb_txn {
  * struct kvdb_bak_work
  * @bak_work:
  * @bak_kvs:
- * @bak_fname: data file name
- * @bak_cur: cursor for export
- * @bak_fcnt: number of dumped data files for this kvs
- * @bak_kvcnt: number of k-v pairs in this kvs
+ * @bak_fname: data file name (export: prefix of the data file names)
+ * @bak_fcnt: number of dumped data files for this kvs (export: this range)
+ * @bak_kvcnt: number of k-v pairs in this kvs (export: this range)
  * @bak_err:
+ * @bak_ver: dump version of the data file (import)
+ * @bak_fseq: next data file number of the kvs (export)
+ * @bak_startlen: length of @bak_start, 0 to export from the first key
+ * @bak_endlen: length of @bak_end, 0 to export through the last key
+ * @bak_start: first key of the range to export
+ * @bak_end: first key past the range to export
  */
 struct kvdb_bak_work {
-    struct work_struct     bak_work;
-    struct hse_kvs *       bak_kvs;
-    char                   bak_fname[PATH_MAX];
-    struct hse_kvs_cursor *bak_cur;
-    int                    bak_fcnt;
-    u64                    bak_kvcnt;
-    merr_t                 bak_err;
+    struct work_struct bak_work;
+    struct hse_kvs *   bak_kvs;
+    char               bak_fname[PATH_MAX];
+    int                bak_fcnt;
+    u64                bak_kvcnt;
+    merr_t             bak_err;
+    int                bak_ver;
+    atomic_t *         bak_fseq;
+    u32                bak_startlen;
+    u32                bak_endlen;
+    u8                 bak_start[HSE_KVS_KLEN_MAX];
+    u8                 bak_end[HSE_KVS_KLEN_MAX];
 };
 
 /**
@@ -75,6 +93,42 @@ struct kvs_import {
     struct hse_kvs *   kvsi_kvs;
 };
 
+/**
+ * enum ikvdb_phase - timed steps of kvdb open and close
+ *
+ * The open phases are those of hse_kvdb_open(), but for the kvs phases
+ * which add up the kvs opens (including those of c1 replay) over the life
+ * of the kvdb.  The count of a phase is in the unit returned by
+ * ikvdb_phase2str(), and is 0 when the phase has none.
+ */
+enum ikvdb_phase {
+    IKVDB_PH_MPOOL_OPEN,     /* mpool_open() */
+    IKVDB_PH_KVDB_LOG,       /* kvdb log open and replay, count: none */
+    IKVDB_PH_CNDB_REPLAY,    /* cndb open and replay, count: cndb records */
+    IKVDB_PH_C0SK_OPEN,      /* c0sk_open(), count: none */
+    IKVDB_PH_C1_REPLAY,      /* c1 open and replay, count: keys replayed */
+    IKVDB_PH_OPEN,           /* all of ikvdb_open(), count: kvses */
+    IKVDB_PH_CN_INSTANTIATE, /* cndb_cn_instantiate(), count: kvsets */
+    IKVDB_PH_KVSET_CREATE,   /* kvset create and bloom preload, count: mblocks */
+    IKVDB_PH_KVS_OPEN,       /* all of the kvs opens, count: kvses */
+    IKVDB_PH_C0_FLUSH,       /* c0 checkpoint or final ingest, count: none */
+    IKVDB_PH_KVS_CLOSE,      /* kvs close, count: kvses */
+    IKVDB_PH_CNDB_CLOSE,     /* cndb and kvdb log close, count: none */
+    IKVDB_PH_C1_CLOSE,       /* c1_close(), count: none */
+    IKVDB_PH_CLOSE,          /* all of ikvdb_close(), count: none */
+    IKVDB_PH_MAX
+};
+
+/**
+ * struct ikvdb_phase_stats - time and count of a phase
+ * @ips_ns:    time spent in the phase (ns)
+ * @ips_count: units of work of the phase
+ */
+struct ikvdb_phase_stats {
+    u64 ips_ns;
+    u64 ips_count;
+};
+
 #define IKVDB_SUB_NAME_SEP ":"
 #define HSE_KVDB_DESC "Heterogeneous-memory Storage Engine KVDB"
 
@@ -240,6 +294,34 @@ ikvdb_get_c1(struct ikvdb *handle, struct c1 **out);
 struct csched *
 ikvdb_get_csched(struct ikvdb *handle);
 
+/**
+ * ikvdb_get_keylock() - get a handle to the kvdb keylock
+ */
+struct kvdb_keylock *
+ikvdb_get_keylock(struct ikvdb *handle);
+
+/**
+ * ikvdb_get_cn_kvdb() - get a handle to the kvdb's shared cn state
+ */
+struct cn_kvdb *
+ikvdb_get_cn_kvdb(struct ikvdb *handle);
+
+enum ikvdb_txn_lat {
+    IKVDB_TXN_LAT_BEGIN,
+    IKVDB_TXN_LAT_COMMIT,
+    IKVDB_TXN_LAT_ABORT,
+    IKVDB_TXN_LAT_MAX
+};
+
+/**
+ * ikvdb_get_txn_lathist() - get the transaction latency histograms
+ * @handle: kvdb handle
+ *
+ * Return: vector of IKVDB_TXN_LAT_MAX histograms (NULL if not recorded)
+ */
+struct lathist **
+ikvdb_get_txn_lathist(struct ikvdb *handle);
+
 /**
  * ikvdb_kvs_get_cn() - retrieve a pointer to the cn
  * @kvs:     kvs handle
@@ -292,10 +374,36 @@ ikvdb_kvs_drop(struct ikvdb *kvdb, const char *kvs_name);
 /**
  * ikvdb_close() - indicate that the KVDB will no longer be used
  * @kvdb: KVDB handle
+ *
+ * Logs the open and close phases of the kvdb, see ikvdb_phase_get().
  */
 merr_t
 ikvdb_close(struct ikvdb *kvdb);
 
+/**
+ * ikvdb_open_report() - log the open phases of a kvdb
+ * @kvdb:     KVDB handle
+ * @mpool_ns: time spent opening the mpool of the kvdb
+ */
+void
+ikvdb_open_report(struct ikvdb *kvdb, u64 mpool_ns);
+
+/**
+ * ikvdb_phase_get() - get the open and close phases of a kvdb
+ * @kvdb: KVDB handle, or NULL for the last kvdb closed by this process
+ * @phv:  (output) vector of IKVDB_PH_MAX phases
+ */
+void
+ikvdb_phase_get(struct ikvdb *kvdb, struct ikvdb_phase_stats *phv);
+
+/**
+ * ikvdb_phase2str() - name of a phase
+ * @ph:   phase
+ * @unit: (output) unit of the count of the phase, NULL if none
+ */
+const char *
+ikvdb_phase2str(enum ikvdb_phase ph, const char **unit);
+
 /**
  * ikvdb_mpool_get() - retrieve the mpool descriptor
  * @kvdb: KVDB handle
@@ -328,6 +436,129 @@ ikvdb_kvs_get(
     enum key_lookup_res *   res,
     struct kvs_buf *        vbuf);
 
+/**
+ * ikvdb_kvs_get_batch() - search for each of @cnt keys within the KVS.
+ * Results are returned in @resv and @vbufv, one entry per key in @ktv.
+ * HSE allocates memory for a result if its vbufv[i].b_buf is NULL.
+ */
+merr_t
+ikvdb_kvs_get_batch(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct kvs_ktuple *     ktv,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        vbufv,
+    unsigned int            cnt);
+
+/**
+ * ikvdb_kvs_get_lease() - search for the given key within the KVS and, if
+ * found, return a read-only reference to its value in @lease.  The lease
+ * must be released via ikvdb_kvs_lease_release() if *res is FOUND_VAL.
+ */
+merr_t
+ikvdb_kvs_get_lease(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct kvs_ktuple *     kt,
+    enum key_lookup_res *   res,
+    struct kvs_vlease *     lease);
+
+/**
+ * ikvdb_kvs_prefetch() - queue the prefetch of @cnt keys of the KVS
+ * to the kvdb's async workqueue.  The keys are copied, and the kvs
+ * cannot be closed until the prefetch is done.
+ */
+merr_t
+ikvdb_kvs_prefetch(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct kvs_ktuple *     ktv,
+    unsigned int            cnt);
+
+/**
+ * ikvdb_kvs_lease_release() - release a lease from ikvdb_kvs_get_lease()
+ */
+void
+ikvdb_kvs_lease_release(struct kvs_vlease *lease);
+
+/**
+ * ikvdb_kvs_stream_open() - start writing a value of key @kt in chunks
+ *
+ * The value is written by ikvdb_kvs_stream_write() and replaces the value
+ * of the key only once the stream is committed.  A value longer than
+ * HSE_KVS_VLEN_MAX is stored in chunk keys, each the key followed by a
+ * 12 byte suffix, and the key's value is a manifest of the chunks.
+ */
+merr_t
+ikvdb_kvs_stream_open(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct kvs_ktuple *     kt,
+    struct ikvdb_stream **  streamp);
+
+/**
+ * ikvdb_kvs_stream_write() - append @len bytes of @data to a stream
+ */
+merr_t
+ikvdb_kvs_stream_write(struct ikvdb_stream *stream, const void *data, size_t len);
+
+/**
+ * ikvdb_kvs_stream_commit() - publish the value of a stream and free it
+ *
+ * On error the stream is not freed and must be committed again or aborted.
+ */
+merr_t
+ikvdb_kvs_stream_commit(struct ikvdb_stream *stream);
+
+/**
+ * ikvdb_kvs_stream_abort() - discard the value of a stream and free it
+ */
+void
+ikvdb_kvs_stream_abort(struct ikvdb_stream *stream);
+
+/**
+ * ikvdb_kvs_stream_read() - read up to @buflen bytes at offset @off of
+ * the value of key @kt, streamed or not.  The number of bytes read is
+ * returned in *@rlen and the length of the whole value in *@slen.
+ */
+merr_t
+ikvdb_kvs_stream_read(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *opspec,
+    struct kvs_ktuple *     kt,
+    u64                     off,
+    void *                  buf,
+    size_t                  buflen,
+    enum key_lookup_res *   res,
+    size_t *                rlen,
+    u64 *                   slen);
+
+/**
+ * ikvdb_kvs_async_submit() - queue an async get (or put if @put is true) to
+ * the kvdb's async workqueue.  On completion the request's status and
+ * results are set and its callback is invoked from a worker thread.
+ */
+merr_t
+ikvdb_kvs_async_submit(
+    struct hse_kvs *          kvs,
+    struct hse_kvdb_opspec *  opspec,
+    struct hse_kvs_async_req *req,
+    bool                      put);
+
+/**
+ * ikvdb_kvs_write_batch() - apply a batch of puts and deletes to one or more
+ * KVSes of the kvdb.  Op @opv[i] is applied to @kvsv[i].  Outside of a txn
+ * the entire batch is inserted into c0 with a single throttle and seqnoref,
+ * and with HSE_KVDB_KOP_FLAG_ATOMIC it also becomes visible at once.
+ */
+merr_t
+ikvdb_kvs_write_batch(
+    struct ikvdb *          kvdb,
+    struct hse_kvdb_opspec *opspec,
+    struct hse_kvs **       kvsv,
+    struct kvs_wbatch_op *  opv,
+    unsigned int            opc);
+
 /**
  * ikvdb_kvs_del() - remove the supplied key and associated value from the KVS
  * indexed by opspec->kop_index.
@@ -336,6 +567,60 @@ ikvdb_kvs_get(
 merr_t
 ikvdb_kvs_del(struct hse_kvs *kvs, struct hse_kvdb_opspec *opspec, struct kvs_ktuple *kt);
 
+/**
+ * ikvdb_kvs_merge_register() - set the merge function of a KVS
+ */
+merr_t
+ikvdb_kvs_merge_register(struct hse_kvs *kvs, kvs_merge_fn *fn);
+
+/**
+ * ikvdb_kvs_compact_filter_register() - set the compaction filter of a KVS
+ */
+merr_t
+ikvdb_kvs_compact_filter_register(struct hse_kvs *kvs, kvs_cfilter_fn *fn, void *arg);
+
+/**
+ * ikvdb_kvs_index_register() - maintain a secondary index of a KVS
+ * @kvs:   primary KVS
+ * @index: KVS of the index (ignored if @fn is NULL)
+ * @fn:    index key extractor, NULL removes the index
+ * @arg:   passed to every call of @fn
+ *
+ * Puts into @kvs also put the key extracted from their value followed by
+ * their key into @index, with their key as value, in one atomic write.
+ * Entries left stale by later puts and deletes are dropped by the
+ * compaction of @index.
+ */
+merr_t
+ikvdb_kvs_index_register(
+    struct hse_kvs *kvs,
+    struct hse_kvs *index,
+    kvs_index_fn *  fn,
+    void *          arg);
+
+/**
+ * ikvdb_kvs_merge() - merge an operand into the value of a key in the KVS
+ * by the KVS's merge function (see ikvdb_kvs_merge_register()).
+ */
+merr_t
+ikvdb_kvs_merge(
+    struct hse_kvs *         kvs,
+    struct hse_kvdb_opspec * opspec,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper);
+
+/**
+ * ikvdb_kvs_patch() - write @vt into the value of a key at offset @off,
+ * or at its end if @off is KVS_PATCH_APPEND (see kvs_patch_merge()).
+ */
+merr_t
+ikvdb_kvs_patch(
+    struct hse_kvs *         kvs,
+    struct hse_kvdb_opspec * opspec,
+    struct kvs_ktuple *      kt,
+    u64                      off,
+    const struct kvs_vtuple *vt);
+
 /* MTF_MOCK */
 merr_t
 ikvdb_kvs_pfx_probe(
@@ -346,6 +631,22 @@ ikvdb_kvs_pfx_probe(
     struct kvs_buf *        kbuf,
     struct kvs_buf *        vbuf);
 
+/**
+ * ikvdb_kvs_pfx_probe_batch() - prefix probe each of @cnt prefixes within
+ * the KVS, all at the same view.  Results are returned in @resv, @kbufv
+ * and @vbufv, one entry per prefix in @ktv.
+ */
+/* MTF_MOCK */
+merr_t
+ikvdb_kvs_pfx_probe_batch(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        kbufv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt);
+
 /**
  * ikvdb_kvs_prefix_delete() - remove all key/value pairs with the given prefix
  * from the KVS indexed by opspec->kop_index. If a prefix scan is in progress
@@ -359,12 +660,108 @@ ikvdb_kvs_prefix_delete(
     struct kvs_ktuple *     kt,
     size_t *                kvs_pfx_len);
 
+/**
+ * ikvdb_kvs_bulk_begin() - start a bulk load of a kvs (see cn_bulk.h)
+ * @kvs:   kvs handle
+ * @bulkp: (output) bulk load
+ *
+ * Flushes c0 and reserves the seqno of the loaded values.  Until the load
+ * is committed or aborted, mutations of the kvs fail with EBUSY, and the
+ * kvs must not be closed.  Transactions that updated the kvs should be
+ * committed or aborted before the load begins.
+ */
+merr_t
+ikvdb_kvs_bulk_begin(struct hse_kvs *kvs, struct ikvdb_bulk **bulkp);
+
+/**
+ * ikvdb_kvs_bulk_put() - add a key/value pair to a bulk load
+ * @bulk: bulk load
+ * @kt:   key, greater than that of the previous put
+ * @vt:   value
+ */
+merr_t
+ikvdb_kvs_bulk_put(struct ikvdb_bulk *bulk, struct kvs_ktuple *kt, const struct kvs_vtuple *vt);
+
+/**
+ * ikvdb_kvs_bulk_end() - commit or abort a bulk load and destroy it
+ * @bulk:   bulk load
+ * @commit: make the loaded values visible, else discard them
+ *
+ * The loaded values become visible atomically, to every view whose seqno
+ * is at least that reserved by ikvdb_kvs_bulk_begin().
+ */
+merr_t
+ikvdb_kvs_bulk_end(struct ikvdb_bulk *bulk, bool commit);
+
+/**
+ * ikvdb_kvs_attach() - add kvsets built elsewhere to a kvs (see cn_attach.h)
+ * @kvs:  kvs handle
+ * @dirv: directories of kvset images, oldest kvset first
+ * @dirc: number of directories
+ *
+ * Mutations of the kvs fail with EBUSY while the kvsets are written.  The
+ * kvdb seqno is advanced past the kvsets' seqnos before they are added,
+ * all at once, to the kvs.
+ */
+merr_t
+ikvdb_kvs_attach(struct hse_kvs *kvs, const char *const *dirv, uint dirc);
+
+/**
+ * ikvdb_ckpt_create() - pin the kvsets of the open kvses (see cn_snap.h)
+ * @kvdb:  kvdb handle
+ * @ckptp: (output) checkpoint
+ *
+ * Flushes c0 first, so the checkpoint holds everything put before it.
+ * Closing a kvs blocks until the checkpoint is destroyed.
+ */
+merr_t
+ikvdb_ckpt_create(struct ikvdb *kvdb, struct cn_snap **ckptp);
+
+/**
+ * ikvdb_ckpt_export() - copy a checkpoint into a directory
+ * @ckpt:    checkpoint
+ * @dir:     directory to create
+ * @base:    checkpoint of a previous export to copy only the changes
+ *           from, or NULL
+ * @basedir: directory of the export of @base
+ */
+merr_t
+ikvdb_ckpt_export(
+    struct cn_snap *ckpt,
+    const char *    dir,
+    struct cn_snap *base,
+    const char *    basedir);
+
+/**
+ * ikvdb_ckpt_destroy() - release a checkpoint
+ * @ckpt: checkpoint, may be NULL
+ */
+void
+ikvdb_ckpt_destroy(struct cn_snap *ckpt);
+
 /**
  * ikvdb_sync() - flush data in all of the KVSes to stable media.
  */
 merr_t
 ikvdb_sync(struct ikvdb *kvdb);
 
+/**
+ * ikvdb_sync_ticket() - get a ticket for the mutations made so far
+ * @kvdb:   kvdb handle
+ * @ticket: (output) ticket to pass to ikvdb_sync_wait()
+ */
+merr_t
+ikvdb_sync_ticket(struct ikvdb *kvdb, u64 *ticket);
+
+/**
+ * ikvdb_sync_wait() - wait until the mutations of a ticket are durable
+ * @kvdb:       kvdb handle
+ * @ticket:     ticket from ikvdb_sync_ticket()
+ * @timeout_ms: 0 to only poll, negative to wait without a timeout
+ */
+merr_t
+ikvdb_sync_wait(struct ikvdb *kvdb, u64 ticket, int timeout_ms);
+
 /**
  * ikvdb_flush() - initiate data flush in all of the KVSes to stable media.
  */
@@ -392,6 +789,29 @@ ikvdb_txn_alloc(struct ikvdb *kvdb);
 void
 ikvdb_txn_free(struct ikvdb *kvdb, struct hse_kvdb_txn *txn);
 
+/**
+ * ikvdb_snapshot_acquire() - take a read view and register it in the horizon
+ * @kvdb: kvdb handle
+ * @snap: (output) snapshot handle
+ */
+merr_t
+ikvdb_snapshot_acquire(struct ikvdb *kvdb, struct hse_kvdb_snapshot **snap);
+
+/**
+ * ikvdb_snapshot_release() - release a snapshot from ikvdb_snapshot_acquire()
+ */
+void
+ikvdb_snapshot_release(struct ikvdb *kvdb, struct hse_kvdb_snapshot *snap);
+
+/**
+ * ikvdb_seqno_get() - return the current view seqno of a kvdb
+ *
+ * A read whose opspec has HSE_KVDB_KOP_FLAG_SEQNO reads as of such a seqno,
+ * provided it is not older than the last seqno_retain seqnos.
+ */
+u64
+ikvdb_seqno_get(struct ikvdb *kvdb);
+
 /**
  * ikvdb_txn_begin() - initiate a transaction. txn->kt_seq_num identifies it.
  */
@@ -465,6 +885,21 @@ ikvdb_kvs_cursor_read(
     size_t *                val_len,
     bool *                  eof);
 
+/**
+ * ikvdb_kvs_cursor_read_many() - read up to @recc kv pairs (or as many as
+ * fit into @buf) from the cursor in a single call
+ */
+merr_t
+ikvdb_kvs_cursor_read_many(
+    struct hse_kvs_cursor *    cursor,
+    struct hse_kvdb_opspec *   opspec,
+    void *                     buf,
+    size_t                     buf_sz,
+    struct hse_kvs_cursor_rec *recv,
+    unsigned int               recc,
+    unsigned int *             nread,
+    bool *                     eof);
+
 /**
  * ikvdb_kvs_cursor_destroy() - allow the caller to indicate that is is done
  * with the scan and release the associated cursor
@@ -472,6 +907,60 @@ ikvdb_kvs_cursor_read(
 merr_t
 ikvdb_kvs_cursor_destroy(struct hse_kvs_cursor *cursor);
 
+/**
+ * ikvdb_kvs_cursor_filter() - set (or clear) the key and value predicates
+ * of a cursor (see ikvs_cursor_pred())
+ */
+merr_t
+ikvdb_kvs_cursor_filter(
+    struct hse_kvs_cursor *cursor,
+    kvs_pred_fn *          keyfn,
+    kvs_pred_fn *          valfn,
+    void *                 arg);
+
+/**
+ * ikvdb_kvs_range_split() - find keys that split a kvs into equal ranges
+ * (see cn_range_split())
+ */
+merr_t
+ikvdb_kvs_range_split(
+    struct hse_kvs *     kvs,
+    const void *         pfx,
+    size_t               pfx_len,
+    u32                  rangec,
+    struct cn_split_key *keyv,
+    u32 *                keycp);
+
+/**
+ * ikvdb_kvs_range_estimate() - estimate the keys and bytes in a key range
+ * of a kvs (see cn_range_estimate())
+ *
+ * The upper bounds also allow for every key held in c0.
+ */
+merr_t
+ikvdb_kvs_range_estimate(
+    struct hse_kvs *     kvs,
+    const void *         lo,
+    size_t               lo_len,
+    const void *         hi,
+    size_t               hi_len,
+    struct cn_range_est *est);
+
+/**
+ * ikvdb_kvs_scan_parallel() - scan the ranges of a kvs from
+ * ikvdb_kvs_range_split() concurrently, one cursor per range, all at
+ * the same view
+ */
+merr_t
+ikvdb_kvs_scan_parallel(
+    struct hse_kvs *        kvs,
+    struct hse_kvdb_opspec *os,
+    const void *            pfx,
+    size_t                  pfx_len,
+    u32                     threadc,
+    kvs_scan_fn *           fn,
+    void *                  arg);
+
 void
 ikvdb_compact(struct ikvdb *self, int flags);
 
@@ -623,12 +1112,36 @@ kvdb_kop_is_reverse(const struct hse_kvdb_opspec *os)
     return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_REVERSE);
 }
 
+static __always_inline bool
+kvdb_kop_is_keys_only(const struct hse_kvdb_opspec *os)
+{
+    return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_KEYS_ONLY);
+}
+
+static __always_inline bool
+kvdb_kop_is_direct(const struct hse_kvdb_opspec *os)
+{
+    return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_DIRECT);
+}
+
+static __always_inline bool
+kvdb_kop_is_atomic(const struct hse_kvdb_opspec *os)
+{
+    return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_ATOMIC);
+}
+
 static __always_inline bool
 kvdb_kop_is_bind_txn(const struct hse_kvdb_opspec *os)
 {
     return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_BIND_TXN);
 }
 
+static __always_inline bool
+kvdb_kop_is_seqno(const struct hse_kvdb_opspec *os)
+{
+    return os && (os->kop_flags & HSE_KVDB_KOP_FLAG_SEQNO);
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "ikvdb_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
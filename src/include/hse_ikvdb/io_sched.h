@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_IO_SCHED_H
+#define HSE_IKVDB_IO_SCHED_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+#include <mpool/mpool.h>
+
+/* The kvdb I/O scheduler bounds the number of mblock and mlog I/Os in
+ * flight on each media class (rparam io_sched_qd), and decides which of
+ * the waiting I/Os goes next when one completes.  It is enabled by a
+ * non-zero queue depth.
+ *
+ * I/Os are tagged with one of four classes.  A waiting I/O whose deadline
+ * has passed is dispatched first (earliest deadline first); otherwise the
+ * classes share the queue in proportion to their weights (start-time fair
+ * queuing by bytes), so that compaction cannot crowd out foreground reads
+ * and c1 appends, yet is never starved.
+ *
+ * The scheduler admits I/Os rather than issuing them: callers bracket
+ * each synchronous mpool call with io_sched_enter() and io_sched_exit().
+ * Asynchronous writes are admitted for the duration of their submission.
+ */
+
+#define IO_SCHED_QD_MAX (1024)
+
+enum io_sched_class {
+    IOS_FG_READ,
+    IOS_C1,
+    IOS_INGEST,
+    IOS_COMPACT,
+    IOS_CLASS_CNT
+};
+
+/**
+ * struct io_sched_stats - activity of one class on one media class
+ * @iss_ops:     I/Os admitted
+ * @iss_bytes:   bytes admitted
+ * @iss_waits:   I/Os that had to wait for admission
+ * @iss_wait_ns: total time spent waiting
+ * @iss_max_ns:  longest wait
+ */
+struct io_sched_stats {
+    u64 iss_ops;
+    u64 iss_bytes;
+    u64 iss_waits;
+    u64 iss_wait_ns;
+    u64 iss_max_ns;
+};
+
+struct io_sched;
+
+/**
+ * io_sched_create() - create an I/O scheduler
+ * @qd:         I/Os in flight per media class
+ * @fg_lat_ns:  deadline of foreground reads
+ * @iosp:       (output) scheduler
+ */
+merr_t
+io_sched_create(uint qd, u64 fg_lat_ns, struct io_sched **iosp);
+
+/**
+ * io_sched_destroy() - destroy an I/O scheduler with no I/Os in flight
+ * @ios: scheduler, may be NULL
+ */
+void
+io_sched_destroy(struct io_sched *ios);
+
+/**
+ * io_sched_enter() - wait for admission of an I/O
+ * @ios:    scheduler, NULL admits immediately
+ * @mclass: media class of the I/O
+ * @cls:    class of the I/O
+ * @len:    bytes to transfer
+ */
+void
+io_sched_enter(struct io_sched *ios, uint mclass, enum io_sched_class cls, size_t len);
+
+/**
+ * io_sched_exit() - retire an I/O admitted by io_sched_enter()
+ * @ios:    scheduler, may be NULL
+ * @mclass: media class of the I/O
+ */
+void
+io_sched_exit(struct io_sched *ios, uint mclass);
+
+/**
+ * io_sched_stats() - get the activity of a class on a media class
+ * @ios:    scheduler
+ * @mclass: media class
+ * @cls:    class
+ * @stats:  (output) activity
+ */
+void
+io_sched_stats(
+    struct io_sched *      ios,
+    uint                   mclass,
+    enum io_sched_class    cls,
+    struct io_sched_stats *stats);
+
+const char *
+io_sched_class_name(enum io_sched_class cls);
+
+static inline merr_t
+io_sched_mblock_read(
+    struct io_sched *   ios,
+    uint                mclass,
+    enum io_sched_class cls,
+    struct mpool *      ds,
+    u64                 mbh,
+    struct iovec *      iov,
+    size_t              off)
+{
+    merr_t err;
+
+    io_sched_enter(ios, mclass, cls, iov->iov_len);
+    err = mpool_mblock_read(ds, mbh, iov, 1, off);
+    io_sched_exit(ios, mclass);
+
+    return err;
+}
+
+#endif
@@ -31,6 +31,16 @@ key_hash64_seed(const void *data, size_t len, u64 seed)
     return hse_hash64_seed(data, len, seed);
 }
 
+/* Hash four keys of the same length at once, see hse_hash64x4().
+ */
+static __always_inline void
+key_hash64x4(const void *const *datav, size_t len, u64 *hashv)
+{
+    assert(len < (1024 * 1024));
+
+    hse_hash64x4(datav, len, HSE_HASH_SEED64, hashv);
+}
+
 /* If key len > pfx_len and pfx_len > 0, then compute hash on first pfx_len
  * bytes. Otherwise, compute hash on entire key.
  */
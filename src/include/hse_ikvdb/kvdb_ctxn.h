@@ -19,6 +19,8 @@ struct hse_kvs_cursor;
 struct kvs_ktuple;
 struct kvs_vtuple;
 struct kvs_buf;
+struct kvs_wbatch_op;
+struct c0sk;
 struct kvdb_keylock;
 struct kvdb_ctxn_set;
 struct active_ctxn_set;
@@ -133,6 +135,12 @@ kvdb_ctxn_get_kvms(struct kvdb_ctxn *txn);
 uintptr_t
 kvdb_ctxn_get_seqnoref(struct kvdb_ctxn *txn);
 
+/* True if the txn's write set spilled past a single kvms, in which
+ * case it cannot be bound to a cursor.
+ */
+bool
+kvdb_ctxn_spilled(struct kvdb_ctxn *txn);
+
 struct kvdb_ctxn_bind *
 kvdb_ctxn_cursor_bind(struct kvdb_ctxn *txn);
 
@@ -152,4 +160,28 @@ kvdb_ctxn_set_create(struct kvdb_ctxn_set **handle_out, u64 txn_timeout, u64 mse
 void
 kvdb_ctxn_set_destroy(struct kvdb_ctxn_set *handle);
 
+/**
+ * kvdb_ctxn_set_write_batch() - apply a write batch atomically
+ * @handle:          txn set whose commit seqno ordering the batch joins
+ * @c0sk:            c0sk into which to insert the batch
+ * @kvdb_seqno_addr: kvdb seqno from which the batch's seqno is taken
+ * @opv:             vector of write batch ops (key hashes must be set)
+ * @opc:             number of ops in %opv
+ *
+ * The batch is committed like a txn with one commit seqno, but takes
+ * no write locks and so is not isolated from concurrent txns.
+ *
+ * The batch cannot be split across kvmses, nor across the inserts of
+ * one c0kvset: it fails with EFBIG if the ops that hash to a c0kvset
+ * exceed its size, and with ENOMEM if it still does not fit after a
+ * few retries in new kvmses.  None of a failed batch is visible.
+ */
+merr_t
+kvdb_ctxn_set_write_batch(
+    struct kvdb_ctxn_set *      handle,
+    struct c0sk *               c0sk,
+    atomic64_t *                kvdb_seqno_addr,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc);
+
 #endif
@@ -34,6 +34,55 @@ extern struct perfc_name kvdb_metrics_perfc[];
 
 extern struct perfc_set c0_metrics_pc;
 
+/*
+ * Memory accounting performance counter family.
+ *
+ * There is one counter set globally, with four counters for each of the
+ * subsystems in enum kvdb_memacct: bytes live, high-water mark of bytes
+ * live (updated by the kvdb maintenance task), and alloc/free rates.
+ * The counters are per-cpu, so accounting costs one uncontended atomic
+ * add per allocation or free.
+ */
+
+extern struct perfc_name kvdb_memacct_perfc[];
+extern struct perfc_set  kvdb_memacct_pc;
+
+enum kvdb_memacct {
+    KVDB_MEMACCT_C0,
+    KVDB_MEMACCT_CN,
+    KVDB_MEMACCT_CURSOR,
+    KVDB_MEMACCT_TXN,
+    KVDB_MEMACCT_C1,
+    KVDB_MEMACCT_MAX
+};
+
+#define KVDB_MEMACCT_CIDX(_sub, _c0cidx) \
+    ((_c0cidx) + (_sub) * (PERFC_BA_MEMACCT_CN_LIVE - PERFC_BA_MEMACCT_C0_LIVE))
+
+static inline void
+kvdb_memacct_alloc(enum kvdb_memacct sub, size_t sz)
+{
+    perfc_add2(
+        &kvdb_memacct_pc,
+        KVDB_MEMACCT_CIDX(sub, PERFC_BA_MEMACCT_C0_LIVE),
+        sz,
+        KVDB_MEMACCT_CIDX(sub, PERFC_RA_MEMACCT_C0_ALLOC),
+        1);
+}
+
+static inline void
+kvdb_memacct_free(enum kvdb_memacct sub, size_t sz)
+{
+    perfc_sub(&kvdb_memacct_pc, KVDB_MEMACCT_CIDX(sub, PERFC_BA_MEMACCT_C0_LIVE), sz);
+    perfc_inc(&kvdb_memacct_pc, KVDB_MEMACCT_CIDX(sub, PERFC_RA_MEMACCT_C0_FREE));
+}
+
+/**
+ * kvdb_memacct_update() - update the high-water marks of the memory counters
+ */
+void
+kvdb_memacct_update(void);
+
 void
 kvdb_perfc_init(void);
 
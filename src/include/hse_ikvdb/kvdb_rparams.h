@@ -16,6 +16,7 @@
  * @log_lvl:          log level for hse_log.
  * @log_squelch_ns:   log squelch window in nsec
  * @keylock_tables:   number of keylock hash tables
+ * @async_threads:    number of threads servicing async gets and puts
  * @keylock_entries:  number of entries in the keylock hash table
  * @txn_wkth_delay:        delay (msecs) to invoke transaction worker thread
  * @cndb_entries:     max number of entries CNDB's in memory structures. Note
@@ -23,6 +24,48 @@
  * @pct_bandwidth:    qos, %  mpoolbandwidth for the kvdb
  * @iotag2vq:         qos, association iotags to mpool qos virtual queues.
  * @vq_w:             qos, virtual queues weights
+ * @mem_budget:       memory budget of c0 and the kvs caches (MiB, 0: none)
+ * @mem_psi_pct:      memory pressure (percent) at which to shrink the budget
+ * @mem_adapt:        without a budget, shrink c0, caches and readahead under
+ *                    memory pressure
+ * @lat_hist:         record per-operation latency histograms (REST)
+ * @flight_signal:    signal on which to write the flight recorder to the
+ *                    sos log (0: none)
+ * @cn_scache_mb:     staging media for the cache of capacity vblocks (MiB,
+ *                    0: none)
+ * @cn_reclaim_mbps:  rate at which to delete the mblocks of dead kvsets,
+ *                    deferred and batched (MiB/s, 0: delete immediately)
+ * @cn_scrub_mbps:    rate at which to read kvsets to verify them in the
+ *                    background (MiB/s, 0: no verification)
+ * @cn_scrub_period:  minimum time between two verifications of a kvs (secs)
+ * @cn_drop_mbps:     rate at which to delete the mblocks of dropped kvses in
+ *                    the background (MiB/s, 0: unpaced)
+ * @io_sched_qd:      I/Os in flight per media class admitted by the I/O
+ *                    scheduler (0: no scheduler)
+ * @io_sched_fg_us:   deadline of foreground reads in the I/O scheduler
+ * @throttle_rate_ctl: pace puts at a rate steered by the throttle sensors,
+ *                    rather than sleep a heuristic amount per put
+ * @throttle_assist_us: a writer paced for at least this long runs a queued
+ *                    root spill instead of sleeping (usecs, 0: never)
+ * @csched_qthreads_max: per-queue upper bounds, encoded like csched_qthreads,
+ *                    up to which the queue worker counts are autoscaled from
+ *                    their csched_qthreads values (0: no autoscaling)
+ * @csched_slo_us:    get latency objective, above which compaction is paced
+ *                    down and non-urgent compactions deferred (usecs, 0: none)
+ * @csched_slo_pct:   percentile of gets held to csched_slo_us, in hundredths
+ *                    of a percent (9900: p99)
+ * @c0_cpus:          cpu mask of the c0 ingest and maintenance threads
+ * @cn_cpus:          cpu mask of the cn I/O and maintenance threads
+ * @dur_cpus:         cpu mask of the c1 I/O threads
+ * @maint_cpus:       cpu mask of the kvdb maintenance (throttle, memory
+ *                    budget) and async threads
+ *
+ * Like csched_cpus for the csched workers and monitors, a mask covers the
+ * first 64 cpus and is applied as the threads are created (0: all cpus).
+ *
+ * @optrace_path:     file to which to capture a trace of the kvs and txn
+ *                    operations, for optrace_replay (see optrace.h)
+ * @optrace_keys:     save the keys in the trace, not only their hashes
  *
  * The following tunable parameters can have a major impact on the way KVDB
  * operates.  Test thoroughly after any modifications.
@@ -46,6 +89,12 @@ struct kvdb_rparams {
     unsigned long c0_ingest_delay;
     unsigned long c0_ingest_width;
     unsigned long c0_coalesce_sz;
+    unsigned int  c0_affinity;
+    unsigned int  c0_index;
+    unsigned int  c0_hugepage;
+    unsigned int  c0_prefault;
+    unsigned int  c0_numa;
+    unsigned long c0_autotune_mem;
     unsigned long c0_throttle_async_ingest;
     unsigned long c0_throttle_async_default;
 
@@ -53,16 +102,25 @@ struct kvdb_rparams {
     unsigned long txn_ingest_delay;
     unsigned long txn_ingest_width;
     unsigned long txn_timeout;
+    unsigned long txn_occ;
+    unsigned long txn_spill_max;
+    unsigned long seqno_retain;
 
     unsigned int  csched_policy;
     unsigned long csched_debug_mask;
     unsigned long csched_node_len_max;
     unsigned long csched_qthreads;
+    unsigned long csched_qthreads_max;
+    unsigned long csched_slo_us;
+    unsigned long csched_slo_pct;
     unsigned long csched_samp_max;
     unsigned long csched_lo_th_pct;
     unsigned long csched_hi_th_pct;
     unsigned long csched_leaf_pct;
     unsigned long csched_vb_scatter_pct;
+    unsigned long csched_tomb_pct;
+    unsigned long csched_vgc_pct;
+    unsigned long csched_tier_hot;
     unsigned long csched_rspill_params;
     unsigned long csched_ispill_params;
     unsigned long csched_leaf_comp_params;
@@ -71,21 +129,46 @@ struct kvdb_rparams {
 
     unsigned long csched_wr_burst_sz;
     unsigned long csched_wr_rate_max;
+    unsigned long csched_vgc_burst_sz;
+    unsigned long csched_vgc_rate_max;
+    unsigned long csched_cpus;
+    unsigned long csched_nice;
+    unsigned long csched_ioprio;
 
     unsigned long dur_enable;
     unsigned long dur_intvl_ms;
     unsigned long dur_buf_sz;
     unsigned long dur_vbb;
+    unsigned long dur_compress;
+    unsigned long dur_close_ckpt;
     unsigned long dur_delay_pct;
     unsigned long dur_throttle_enable;
     unsigned long dur_throttle_lo_th;
     unsigned long dur_throttle_hi_th;
+    unsigned long dur_trees_lo;
+    unsigned long dur_trees_hi;
+    char          dur_pmem_path[256];
 
     unsigned int  throttle_relax;
     unsigned int  throttle_debug;
+    unsigned int  throttle_rate_ctl;
+    unsigned long throttle_assist_us;
     unsigned long throttle_c0_hi_th;
     unsigned long throttle_sleep_min_ns;
 
+    unsigned long mem_budget;
+    unsigned long mem_psi_pct;
+    unsigned long mem_adapt;
+    unsigned long lat_hist;
+    unsigned long flight_signal;
+    unsigned long cn_scache_mb;
+    unsigned long cn_reclaim_mbps;
+    unsigned long cn_scrub_mbps;
+    unsigned long cn_scrub_period;
+    unsigned long cn_drop_mbps;
+    unsigned long io_sched_qd;
+    unsigned long io_sched_fg_us;
+
     /* The following fields are typically only accessed by kvdb open
      * and hence are extrememly cold.
      */
@@ -96,7 +179,15 @@ struct kvdb_rparams {
     unsigned int  cndb_entries;
     unsigned int  c0_maint_threads;
     unsigned int  c0_ingest_threads;
+    unsigned int  c0_ingest_streams;
     unsigned int  c0_mutex_pool_sz;
+    unsigned int  async_threads;
+    unsigned long c0_cpus;
+    unsigned long cn_cpus;
+    unsigned long dur_cpus;
+    unsigned long maint_cpus;
+    unsigned long optrace_keys;
+    char          optrace_path[256];
 
     unsigned int keylock_entries;
     unsigned int keylock_tables;
@@ -15,6 +15,7 @@
 #include <hse_ikvdb/kvdb_health.h>
 #include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/query_ctx.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #define TOMBSPAN_MIN_WIDTH 8
 
@@ -34,6 +35,7 @@ struct kvs_cparams;
 struct kvs_rparams;
 struct cn;
 struct cn_kvdb;
+struct kvs_trace_ring;
 
 struct kc_filter {
     const void *kcf_maxkey;
@@ -76,6 +78,36 @@ kvs_close(struct ikvs *ikvs);
 struct perfc_set *
 ikvs_perfc_pkvsl(struct ikvs *ikvs);
 
+/**
+ * ikvs_trace_ring() - get the ring of recent operation traces
+ * @ikvs: kvs handle
+ *
+ * Return: trace ring, NULL if none
+ */
+struct kvs_trace_ring *
+ikvs_trace_ring(struct ikvs *ikvs);
+
+/**
+ * ikvs_trace_begin() - start tracing an operation per the kvs rparams
+ * @ikvs:  kvs handle
+ * @trace: record to fill in
+ * @op:    enum kvs_trace_op
+ *
+ * Return: true if the operation is traced, in which case the caller must
+ * call ikvs_trace_end()
+ */
+bool
+ikvs_trace_begin(struct ikvs *ikvs, struct kvs_trace *trace, enum kvs_trace_op op);
+
+/**
+ * ikvs_trace_end() - finish tracing an operation, save it in the kvs trace
+ *                    ring if sampled and in the flight recorder if slow
+ * @ikvs:  kvs handle
+ * @trace: record passed to ikvs_trace_begin()
+ */
+void
+ikvs_trace_end(struct ikvs *ikvs, struct kvs_trace *trace);
+
 merr_t
 ikvs_put(
     struct ikvs *            ikvs,
@@ -84,6 +116,46 @@ ikvs_put(
     const struct kvs_vtuple *vt,
     u64                      seqno);
 
+/**
+ * kvs_patch_merge() - merge function of hse_kvs_update_range() and
+ * hse_kvs_append(), @oper is a struct kvs_patch
+ */
+merr_t
+kvs_patch_merge(
+    const void *key,
+    size_t      klen,
+    const void *base,
+    size_t      blen,
+    const void *oper,
+    size_t      olen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen);
+
+/**
+ * ikvs_merge() - merge an operand into the current value of a key
+ * @ikvs:  kvs to update
+ * @os:    opspec, merges within a txn are resolved at the txn's view
+ * @kt:    key to update
+ * @oper:  merge operand
+ * @fn:    merge function of the kvs
+ */
+merr_t
+ikvs_merge(
+    struct ikvs *            ikvs,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn);
+
+/**
+ * ikvs_wbatch_prep() - prepare a write batch op for insertion into c0sk
+ * @ikvs:  kvs to which the op applies
+ * @op:    op to prepare (sets the key hash and c0sk index)
+ */
+merr_t
+ikvs_wbatch_prep(struct ikvs *ikvs, struct kvs_wbatch_op *op);
+
 merr_t
 ikvs_get(
     struct ikvs *           ikvs,
@@ -93,6 +165,54 @@ ikvs_get(
     enum key_lookup_res *   res,
     struct kvs_buf *        vbuf);
 
+/**
+ * ikvs_get_lease() - like ikvs_get(), but returns the value by reference
+ * @ikvs:   kvs to search
+ * @os:     opspec
+ * @kt:     key to get
+ * @seqno:  view seqno
+ * @res:    (output) lookup result
+ * @lease:  (output) value lease, valid if *res is FOUND_VAL
+ *
+ * The lease must be released via ikvs_lease_release() whenever *res is
+ * FOUND_VAL.
+ */
+merr_t
+ikvs_get_lease(
+    struct ikvs *           ikvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    u64                     seqno,
+    enum key_lookup_res *   res,
+    struct kvs_vlease *     lease);
+
+void
+ikvs_lease_release(struct kvs_vlease *lease);
+
+/**
+ * ikvs_prefetch() - page in the cn data of a batch of keys
+ * @ikvs:   kvs to search
+ * @ktv:    vector of keys
+ * @seqno:  view seqno
+ * @cnt:    number of keys in %ktv
+ *
+ * Keys found in c0 need nothing, the others are looked up via
+ * cn_prefetch().  No values are returned, and a failure to prefetch
+ * one key does not stop the prefetch of the rest.
+ */
+void
+ikvs_prefetch(struct ikvs *ikvs, struct kvs_ktuple *ktv, u64 seqno, u32 cnt);
+
+merr_t
+ikvs_get_batch(
+    struct ikvs *           ikvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    u64                     seqno,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt);
+
 merr_t
 ikvs_del(struct ikvs *ikvs, struct hse_kvdb_opspec *os, struct kvs_ktuple *key, u64 seqno);
 
@@ -106,17 +226,89 @@ ikvs_pfx_probe(
     struct kvs_buf *        kbuf,
     struct kvs_buf *        vbuf);
 
+/**
+ * ikvs_pfx_probe_batch() - prefix probe a batch of @cnt prefixes
+ *
+ * Equivalent to calling ikvs_pfx_probe() for each prefix in @ktv, all at
+ * view @seqno, but c0 and cn are each traversed once for the batch.
+ */
+merr_t
+ikvs_pfx_probe_batch(
+    struct ikvs *           kvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    u64                     seqno,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        kbufv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt);
+
 merr_t
 ikvs_prefix_del(struct ikvs *ikvs, struct hse_kvdb_opspec *os, struct kvs_ktuple *key, u64 seqno);
 
+/**
+ * ikvs_bulk_begin() - reserve a kvs for a bulk load
+ * @ikvs: kvs handle
+ *
+ * Until ikvs_bulk_end(), puts, merges, deletes and prefix deletes of the
+ * kvs fail with EBUSY.  Fails with EBUSY if a bulk load is already in
+ * progress.
+ */
+merr_t
+ikvs_bulk_begin(struct ikvs *ikvs);
+
+/**
+ * ikvs_bulk_end() - release a kvs reserved by ikvs_bulk_begin()
+ * @ikvs: kvs handle
+ */
+void
+ikvs_bulk_end(struct ikvs *ikvs);
+
 u16
 ikvs_index(struct ikvs *ikvs);
 
 void
 ikvs_maint_task(struct ikvs *ikvs, u64 now);
 
+/**
+ * ikvs_cursor_cache_purge() - destroy all cached cursors of a kvs
+ * @ikvs: kvs handle
+ *
+ * Releases the c0 and cn resources held by cached cursors regardless of
+ * their ttls, e.g., to relieve memory pressure.
+ */
+void
+ikvs_cursor_cache_purge(struct ikvs *ikvs);
+
+/**
+ * ikvs_vcache_usage() - report the value cache usage of a kvs
+ * @ikvs:    kvs handle
+ * @sizep:   (output) bytes cached
+ * @capp:    (output) capacity in bytes
+ * @hitsp:   (output) lookups served since open
+ * @missesp: (output) lookups not served since open
+ *
+ * Return: false if the kvs has no value cache
+ */
+bool
+ikvs_vcache_usage(struct ikvs *ikvs, size_t *sizep, size_t *capp, u64 *hitsp, u64 *missesp);
+
+/**
+ * ikvs_vcache_resize() - change the capacity of the value cache of a kvs
+ * @ikvs:     kvs handle
+ * @capacity: new capacity in bytes
+ */
+void
+ikvs_vcache_resize(struct ikvs *ikvs, size_t capacity);
+
 struct hse_kvs_cursor *
-ikvs_cursor_alloc(struct ikvs *ikvs, const void *prefix, size_t pfx_len, bool reverse);
+ikvs_cursor_alloc(
+    struct ikvs *ikvs,
+    const void * prefix,
+    size_t       pfx_len,
+    bool         reverse,
+    bool         keys_only,
+    bool         direct);
 
 void
 ikvs_cursor_free(struct hse_kvs_cursor *cursor);
@@ -145,6 +337,43 @@ ikvs_cursor_update(struct hse_kvs_cursor *cursor, u64 seqno);
 merr_t
 ikvs_cursor_read(struct hse_kvs_cursor *cursor, struct kvs_kvtuple *kvt, bool *eof);
 
+/**
+ * ikvs_cursor_pred() - set (or clear) the filter predicates of a cursor
+ * @cursor:  cursor
+ * @keyfn:   key predicate (or NULL)
+ * @valfn:   value predicate (or NULL), not allowed on a key-only cursor
+ * @arg:     argument passed to %keyfn and %valfn
+ *
+ * Pairs rejected by a predicate are skipped by subsequent reads.  A
+ * cursor loses its predicates when it is destroyed (or cached).
+ */
+merr_t
+ikvs_cursor_pred(struct hse_kvs_cursor *cursor, kvs_pred_fn *keyfn, kvs_pred_fn *valfn, void *arg);
+
+struct hse_kvs_cursor_rec;
+
+/**
+ * ikvs_cursor_read_many() - read and copy out up to @recc kv pairs
+ * @cursor:  cursor
+ * @buf:     buffer into which keys and values are copied
+ * @bufsz:   size of @buf
+ * @recv:    vector of records describing each kv pair copied out
+ * @recc:    number of records in @recv
+ * @nread:   (output) number of kv pairs copied out
+ * @eof:     (output) true if no more kv pairs remain
+ *
+ * A kv pair which doesn't fit into the remainder of @buf is left unread.
+ */
+merr_t
+ikvs_cursor_read_many(
+    struct hse_kvs_cursor *    cursor,
+    void *                     buf,
+    size_t                     bufsz,
+    struct hse_kvs_cursor_rec *recv,
+    u32                        recc,
+    u32 *                      nread,
+    bool *                     eof);
+
 void
 ikvs_cursor_tombspan_check(struct hse_kvs_cursor *handle);
 
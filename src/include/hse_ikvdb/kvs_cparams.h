@@ -24,6 +24,10 @@ struct kvs_cparams {
     unsigned int  cp_pfx_pivot;
     unsigned int  cp_kvs_ext01;
     unsigned int  cp_sfx_len;
+    unsigned int  cp_vcomp;
+    unsigned int  cp_range;
+    unsigned int  cp_ptlookup;
+    unsigned int  cp_kfixed;
     unsigned long cp_cpmagic;
 };
 
@@ -8,6 +8,15 @@
 
 #include <stdlib.h>
 
+/* The rparams cn_kblk_mclass_map and cn_vblk_mclass_map place the kblocks
+ * and vblocks of each cn level separately: bit n set places the blocks of
+ * level n (of levels 63 and deeper for bit 63) on the capacity media class,
+ * and clear on the staging media class.  A map left at CN_MCLASS_MAP_UNSET
+ * keeps the placement given by staging_policy (ingest) and cn_media_class
+ * (internal nodes), with leaves on capacity.
+ */
+#define CN_MCLASS_MAP_UNSET (~0ul)
+
 /**
  * struct kvs_rparams  - kvs runtime parameters
  * @cn_cursor_debug: 1=counters, 2=latencies, 4=summaries
@@ -26,6 +35,12 @@ struct kvs_rparams {
     unsigned long kvs_debug;
     unsigned long c0_cursor_ttl;
     unsigned long cn_cursor_ttl;
+    unsigned long kvs_vcache_mb;
+    unsigned long kvs_vcache_vmax;
+    unsigned long kvs_trace_sample;
+    unsigned long kvs_flight_us;
+    unsigned long kvs_ttl;
+    unsigned long kvs_durable;
 
     unsigned long cn_maint_delay;
     unsigned long cn_maint_disable;
@@ -34,10 +49,20 @@ struct kvs_rparams {
 
     unsigned long cn_compact_kblk_ra;
     unsigned long cn_compact_vblk_ra;
+    unsigned long cn_compact_vblk_qd;
+    unsigned long cn_compact_direct;
+    unsigned long cn_compact_noreuse;
+    unsigned long cn_compact_subc;
     unsigned long cn_compact_vra;
+    unsigned long cn_compact_ckpt_mb;
+    unsigned long cn_compact_weight;
+    unsigned long cn_compact_rate_min;
+    unsigned long throttle_weight;
+    unsigned long throttle_rate_min;
 
     unsigned long cn_node_size_lo;
     unsigned long cn_node_size_hi;
+    unsigned long cn_size_ratio;
 
     unsigned long cn_capped_ttl;
     unsigned long cn_capped_vra;
@@ -45,8 +70,14 @@ struct kvs_rparams {
     unsigned long cn_cursor_vra;
     unsigned long cn_cursor_kra;
     unsigned long cn_cursor_seq;
+    unsigned long cn_cursor_noreuse;
 
     unsigned long cn_mcache_wbt;
+    unsigned long cn_icache_mb;
+    unsigned long cn_pin_lvl;
+    unsigned long cn_pin_mb;
+    unsigned long cn_mcache_thp;
+    unsigned long cn_mcache_populate;
     unsigned long cn_mcache_vmin;
     unsigned long cn_mcache_vmax;
     unsigned long cn_mcache_vminlvl;
@@ -59,10 +90,16 @@ struct kvs_rparams {
     unsigned long cn_bloom_prob;
     unsigned long cn_bloom_capped;
     unsigned long cn_bloom_preload;
+    unsigned long cn_bloom_pfx;
+    unsigned long cn_bloom_batch;
 
     unsigned long cn_verify;
     unsigned long cn_kcachesz;
+    unsigned long cn_kblk_model;
     unsigned long kblock_size_mb;
+    unsigned long kblock_fcode;
+    unsigned long kblock_lcomp_lvl;
+    unsigned long kblock_ival_max;
     unsigned long vblock_size_mb;
 
     unsigned long capped_evict_ttl;
@@ -72,7 +109,10 @@ struct kvs_rparams {
     unsigned long c1_vblock_cappct;
 
     unsigned long cn_media_class;
+    unsigned long cn_kblk_mclass_map;
+    unsigned long cn_vblk_mclass_map;
     unsigned long cn_io_threads;
+    unsigned long cn_lazy_open;
     unsigned long cn_close_wait;
     unsigned long cn_diag_mode;
 
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_TRACE_H
+#define HSE_KVS_TRACE_H
+
+#include <hse_util/compiler.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+#include <hse_util/atomic.h>
+#include <hse_util/timing.h>
+
+/* A kvs trace records where a sampled get or cursor operation spent its
+ * time: which layer served it, how many c0 kvmultisets, cn nodes and
+ * kvsets it visited, how the kblock bloom filters fared, and how many
+ * page faults it took.  Tracing is enabled per kvs by the rparam
+ * kvs_trace_sample (trace one in that many operations per thread).
+ *
+ * While an operation is traced the calling thread's kvs_trace_cur points
+ * to its record, and the layers below the kvs bump the counters in it.
+ * Finished records are kept in a small per-kvs ring (see the REST url
+ * mpool/<mp>/kvs/<kvs>/trace).
+ *
+ * The flight recorder uses the same records to catch latency outliers:
+ * when the rparam kvs_flight_us is set, every operation is traced (without
+ * the page fault counts) and those that take longer than kvs_flight_us are
+ * saved in a lock-free ring of the calling thread, along with the number
+ * of c0 ingests and cn compactions in progress and the throttle delay at
+ * the time.  The rings of all threads can be read over the REST url
+ * mpool/<mp>/flight, or written to the sos log on the signal given by the
+ * kvdb rparam flight_signal.
+ */
+
+#define KVS_TRACE_RING_SZ (128)
+#define KVS_FLIGHT_RING_SZ (256)
+#define KVS_FLIGHT_DUMP_MAX (1024)
+
+enum kvs_trace_op {
+    KVS_TRACE_OP_GET,
+    KVS_TRACE_OP_CURSOR_INIT,
+    KVS_TRACE_OP_CURSOR_SEEK,
+    KVS_TRACE_OP_PUT,
+    KVS_TRACE_OP_DEL,
+};
+
+enum kvs_trace_stage {
+    KVS_TRACE_STAGE_C0,
+    KVS_TRACE_STAGE_VCACHE,
+    KVS_TRACE_STAGE_CN,
+    KVS_TRACE_STAGE_THROTTLE,
+    KVS_TRACE_STAGE_MAX
+};
+
+/**
+ * struct kvs_trace - trace of one operation
+ * @kt_time:      time at which the operation started (ns, monotonic)
+ * @kt_total:     duration of the operation (ns)
+ * @kt_stagev:    time spent in each stage (ns)
+ * @kt_c0kvms:    c0 kvmultisets probed
+ * @kt_c0_neg:    c0 kvmultisets ruled out by their filter
+ * @kt_cnnodes:   cn tree nodes visited
+ * @kt_kvsets:    cn kvsets visited
+ * @kt_bloom_neg: kblocks ruled out by their bloom filter
+ * @kt_bloom_pos: kblocks whose wbtree was searched
+ * @kt_bloom_fp:  searched kblocks that did not have the key
+ * @kt_minflt:    minor page faults
+ * @kt_majflt:    major page faults (e.g., kblock or vblock reads)
+ * @kt_cnid:      cnid of the kvs
+ * @kt_hash:      hash of the key, 0 for cursor operations
+ * @kt_ingests:   c0 ingests in progress when the operation finished
+ * @kt_comps:     cn compactions in progress when the operation finished
+ * @kt_throttle:  throttle delay when the operation finished
+ * @kt_op:        enum kvs_trace_op
+ * @kt_served:    stage that served a get, KVS_TRACE_STAGE_MAX if none
+ * @kt_res:       enum key_lookup_res of a get
+ * @kt_sampled:   true if sampled by kvs_trace_sample (else a flight trace)
+ */
+struct kvs_trace {
+    u64 kt_time;
+    u64 kt_total;
+    u64 kt_stagev[KVS_TRACE_STAGE_MAX];
+    u64 kt_cnid;
+    u64 kt_hash;
+    u32 kt_c0kvms;
+    u32 kt_c0_neg;
+    u32 kt_cnnodes;
+    u32 kt_kvsets;
+    u32 kt_bloom_neg;
+    u32 kt_bloom_pos;
+    u32 kt_bloom_fp;
+    u32 kt_minflt;
+    u32 kt_majflt;
+    u32 kt_ingests;
+    u32 kt_comps;
+    u32 kt_throttle;
+    u8  kt_op;
+    u8  kt_served;
+    u8  kt_res;
+    u8  kt_sampled;
+};
+
+/**
+ * struct kvs_flight_env - state of the kvdb recorded in flight traces
+ * @kfe_ingests:  c0 ingests in progress
+ * @kfe_comps:    cn compactions in progress
+ * @kfe_throttle: current throttle delay
+ */
+struct kvs_flight_env {
+    atomic_t kfe_ingests;
+    atomic_t kfe_comps;
+    atomic_t kfe_throttle;
+};
+
+struct kvs_trace_ring;
+
+extern __thread struct kvs_trace *kvs_trace_cur;
+extern struct kvs_flight_env      kvs_flight_env;
+
+#define KVS_TRACE_ADD(_field, _n)              \
+    do {                                       \
+        if (unlikely(kvs_trace_cur))           \
+            kvs_trace_cur->_field += (_n);     \
+    } while (0)
+
+#define KVS_TRACE_INC(_field) KVS_TRACE_ADD(_field, 1)
+
+merr_t
+kvs_trace_ring_create(struct kvs_trace_ring **ringp);
+
+void
+kvs_trace_ring_destroy(struct kvs_trace_ring *ring);
+
+/**
+ * kvs_trace_ring_read() - copy the most recent traces
+ * @ring:   trace ring
+ * @tracev: (output) traces, oldest first
+ * @tracec: capacity of %tracev
+ *
+ * Return: number of traces copied
+ */
+uint
+kvs_trace_ring_read(struct kvs_trace_ring *ring, struct kvs_trace *tracev, uint tracec);
+
+/**
+ * kvs_trace_begin() - start tracing an operation if it is sampled
+ * @trace:     record to fill in
+ * @op:        enum kvs_trace_op
+ * @sample:    trace one in %sample operations, 0 to trace none
+ * @flight_ns: trace all operations for the flight recorder, 0 to not
+ *
+ * Return: true if the operation is traced, in which case the caller must
+ * call kvs_trace_end()
+ */
+bool
+kvs_trace_begin(struct kvs_trace *trace, enum kvs_trace_op op, ulong sample, ulong flight_ns);
+
+/**
+ * kvs_trace_end() - finish tracing an operation and save the trace
+ * @trace:     record passed to kvs_trace_begin()
+ * @ring:      ring in which to save a sampled trace
+ * @flight_ns: save the trace in the flight recorder if the operation
+ *             took at least this long, 0 to not
+ */
+void
+kvs_trace_end(struct kvs_trace *trace, struct kvs_trace_ring *ring, ulong flight_ns);
+
+/**
+ * kvs_flight_read() - copy the traces saved by the flight recorder
+ * @tracev: (output) traces of all threads, oldest first
+ * @tracec: capacity of %tracev
+ *
+ * If there are more than %tracec traces, the oldest are skipped.
+ *
+ * Return: number of traces copied
+ */
+uint
+kvs_flight_read(struct kvs_trace *tracev, uint tracec);
+
+/**
+ * kvs_trace_fmt() - format a trace as a yaml list element
+ * @t:     trace
+ * @buf:   output buffer
+ * @bufsz: size of %buf
+ *
+ * Return: length of the output
+ */
+size_t
+kvs_trace_fmt(const struct kvs_trace *t, char *buf, size_t bufsz);
+
+/**
+ * kvs_trace_stage_start() - start timing a stage of the traced operation
+ *
+ * Return: the current time, 0 if no operation is traced
+ */
+static __always_inline u64
+kvs_trace_stage_start(void)
+{
+    return unlikely(kvs_trace_cur) ? get_time_ns() : 0;
+}
+
+static __always_inline void
+kvs_trace_stage_end(enum kvs_trace_stage stage, u64 start)
+{
+    if (unlikely(start))
+        kvs_trace_cur->kt_stagev[stage] += get_time_ns() - start;
+}
+
+#endif
@@ -26,6 +26,7 @@ struct cn_merge_stats;
 #define KVSET_BUILDER_FLAGS_SPARE (1u << 0)
 #define KVSET_BUILDER_FLAGS_EXT (1u << 1)
 #define KVSET_BUILDER_FLAGS_INGEST (1u << 2)
+#define KVSET_BUILDER_FLAGS_VGC (1u << 3) /* charge writes to the value gc bucket */
 
 /* MTF_MOCK_DECL(kvset_builder) */
 /* MTF_MOCK */
@@ -59,7 +60,7 @@ kvset_builder_get_mblocks(struct kvset_builder *builder, struct kvset_mblocks *m
  *
  *   for (i = 0; !err && i < nvals; i++) {
  *       assert(i == 0 || seq[i] > seq[i-1]);
- *       err = kvset_builder_add_val(bld, seq[i], vdata[i], vlen[i]);
+ *       err = kvset_builder_add_val(bld, seq[i], vdata[i], vlen[i], 0, NULL);
  *   }
  *   err = kvset_builder_add_key(bld, kobj);
  *
@@ -79,6 +80,7 @@ kvset_builder_add_key(struct kvset_builder *builder, const struct key_obj *ko);
  * @seq: sequence number of value or tombstone
  * @vdata: pointer to value, or a special tombstone pointer
  * @vlen: length of value
+ * @complen: length of @vdata if it is lz4 compressed, otherwise zero
  * @vbldr: vbldr which is already created
  *
  * See kvset_builder_add_key().
@@ -95,6 +97,11 @@ kvset_builder_add_key(struct kvset_builder *builder, const struct key_obj *ko);
  *        Then a zero-length value is added.
  *
  *   - Otherwise, and regular value is added.
+ *
+ * If @complen is zero and the kvs was created with value compression, then
+ * the value is compressed before it is written to a vblock.  A compressed
+ * value (@complen > 0) is written as is, with @vlen being its uncompressed
+ * length.
  */
 /* MTF_MOCK */
 merr_t
@@ -103,11 +110,18 @@ kvset_builder_add_val(
     u64                     seq,
     const void *            vdata,
     uint                    vlen,
+    uint                    complen,
     struct c1_bonsai_vbldr *vbldr);
 
 /* MTF_MOCK */
 merr_t
-kvset_builder_add_vref(struct kvset_builder *self, u64 seq, uint vbidx, uint vboff, uint vlen);
+kvset_builder_add_vref(
+    struct kvset_builder *self,
+    u64                   seq,
+    uint                  vbidx,
+    uint                  vboff,
+    uint                  vlen,
+    uint                  complen);
 
 /* MTF_MOCK */
 merr_t
@@ -173,10 +187,85 @@ kvset_builder_set_mclass_kvblk(
 void
 kvset_builder_set_mclass(struct kvset_builder *self, enum mp_media_classp mclass);
 
+/**
+ * kvset_mclass_lvl() - media class of the blocks of a cn level
+ * @map:   cn_kblk_mclass_map or cn_vblk_mclass_map
+ * @level: cn tree level, 0 for ingest
+ * @dflt:  media class if %map is CN_MCLASS_MAP_UNSET
+ */
+enum mp_media_classp
+kvset_mclass_lvl(unsigned long map, uint level, enum mp_media_classp dflt);
+
+/**
+ * kvset_builder_set_mclass_lvl() - place a kvset's kblocks and vblocks
+ * by the per-level media class maps of its kvs
+ * @self:  kvset builder
+ * @rp:    kvs rparams
+ * @level: cn tree level of the kvset, 0 for ingest
+ * @dflt:  media class of the blocks whose map is unset
+ */
+/* MTF_MOCK */
+void
+kvset_builder_set_mclass_lvl(
+    struct kvset_builder *    self,
+    const struct kvs_rparams *rp,
+    uint                      level,
+    enum mp_media_classp      dflt);
+
 /* MTF_MOCK */
 void
 kvset_builder_set_merge_stats(struct kvset_builder *self, struct cn_merge_stats *stats);
 
+/**
+ * kvset_builder_get_wstats() - time spent and bytes written by an ingest
+ * builder's kblock and vblock writers (allocations, writes and flushes)
+ * @self:       kvset builder created with KVSET_BUILDER_FLAGS_INGEST
+ * @kblk_ns:    (output) kblock write time (ns)
+ * @kblk_bytes: (output) kblock bytes written
+ * @vblk_ns:    (output) vblock write time (ns)
+ * @vblk_bytes: (output) vblock bytes written
+ */
+/* MTF_MOCK */
+void
+kvset_builder_get_wstats(
+    struct kvset_builder *self,
+    u64 *                 kblk_ns,
+    u64 *                 kblk_bytes,
+    u64 *                 vblk_ns,
+    u64 *                 vblk_bytes);
+
+/**
+ * kvset_builder_set_node_level() - set the cn tree level of the new kvset
+ * @self:  kvset builder
+ * @level: cn tree node level, which selects kblock leaf node compression
+ */
+/* MTF_MOCK */
+void
+kvset_builder_set_node_level(struct kvset_builder *self, uint level);
+
+/**
+ * kvset_builder_set_vbidx_base() - offset the vblock indices of added values
+ * @self: kvset builder
+ * @base: number of vblocks that precede the builder's vblocks in the new
+ *        kvset, e.g., those a k-compaction keeps
+ */
+/* MTF_MOCK */
+void
+kvset_builder_set_vbidx_base(struct kvset_builder *self, uint base);
+
+/**
+ * kvset_builder_join() - fold a finished builder into the one that follows it
+ * @self: kvset builder, not yet finished, whose keys all follow those of @src
+ * @src:  finished kvset builder
+ *
+ * A kvset's hlog and seqno range are taken from its last kblock.  When the
+ * kblocks of several builders are concatenated into one kvset, the builder
+ * that writes the last kblock must first join all the others.
+ */
+/* MTF_MOCK */
+void
+kvset_builder_join(struct kvset_builder *self, struct kvset_builder *src);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "kvset_builder_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
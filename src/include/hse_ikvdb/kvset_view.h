@@ -24,6 +24,15 @@ struct kvset_metrics {
     u32 tot_blm_pages;
     u16 compc;
     u32 vgroups;
+
+    /* Access heat: counts of accesses decayed with a half-life of a
+     * minute (kblocks probed and keys found by point lookups, cursor
+     * seeks, and value bytes read).
+     */
+    u64 heat_probes;
+    u64 heat_hits;
+    u64 heat_seeks;
+    u64 heat_bytes;
 };
 
 /* MTF_MOCK_DECL(kvset_view) */
@@ -68,6 +77,10 @@ kvset_get_dgen(struct kvset *kvset);
 u64
 kvset_get_seqno_max(struct kvset *kvset);
 
+/* MTF_MOCK */
+u64
+kvset_get_seqno_min(struct kvset *kvset);
+
 struct kvset_view {
     struct kvset *     kvset;
     struct cn_node_loc node_loc;
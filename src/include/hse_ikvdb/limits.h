@@ -24,9 +24,14 @@
 #define HSE_C0_INGEST_THREADS_DFLT (3)
 #define HSE_C0_INGEST_THREADS_MAX (8)
 
+#define HSE_C0_INGEST_STREAMS_MAX (8)
+
 #define HSE_C0_MAINT_THREADS_DFLT (5)
 #define HSE_C0_MAINT_THREADS_MAX (32)
 
+#define HSE_KVDB_ASYNC_THREADS_DFLT (8)
+#define HSE_KVDB_ASYNC_THREADS_MAX (256)
+
 #define HSE_ACTIVE_CTXN_BKTS_MAX (16)
 #define HSE_ACTIVE_CTXN_ELTS_MAX (1000)
 
@@ -39,6 +44,11 @@
  */
 #define HSE_C0KVMS_PRIV_MAX min(((HSE_C0_CCACHE_TRIMSZ - (128ul * 1024)) / 8), 1280ul * 1024)
 
+/* Max size of the c0kvms negative-lookup filter, also allocated from
+ * the ptomb c0kvs cheap.
+ */
+#define HSE_C0KVMS_FILTER_MAX (HSE_C0_CHEAP_SZ_MAX / 16)
+
 /* Using any size other than 32MB will likely cause problems
  * due to the way space is allocated to wbtree internal nodes.
  */
@@ -62,4 +72,14 @@
 
 #define CN_SMALL_VALUE_THRESHOLD (8)
 
+/* Upper bound of the kblock_ival_max rparam, the length up to which values
+ * are stored inline in kblocks.
+ */
+#define CN_IVAL_MAX (2048)
+
+/*
+ * Number of cn levels whose kvsets may have pages pinned in memory.
+ */
+#define CN_PIN_LVL_MAX (8)
+
 #endif
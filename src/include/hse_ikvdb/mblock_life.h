@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_MBLOCK_LIFE_H
+#define HSE_IKVDB_MBLOCK_LIFE_H
+
+#include <hse_util/inttypes.h>
+
+/* Expected lifetime of the data in an mblock, for devices that can keep
+ * data of different lifetimes apart (NVMe streams, FDP placement ids).
+ *
+ * Root kvsets are rewritten by the next spill.  Kblocks below the root are
+ * rewritten by spills and k-compactions, whereas their vblocks are carried
+ * along by reference and live until a kv-compaction or garbage collection
+ * of a leaf.
+ */
+enum mblock_life {
+    MBLOCK_LIFE_SHORT,
+    MBLOCK_LIFE_MEDIUM,
+    MBLOCK_LIFE_LONG,
+    MBLOCK_LIFE_CNT
+};
+
+/**
+ * mblock_life_cn() - lifetime of a cn mblock
+ * @vblock: the mblock is a vblock (else a kblock)
+ * @level:  cn tree level of the kvset
+ */
+static inline enum mblock_life
+mblock_life_cn(bool vblock, uint level)
+{
+    if (level == 0)
+        return MBLOCK_LIFE_SHORT;
+
+    return vblock ? MBLOCK_LIFE_LONG : MBLOCK_LIFE_MEDIUM;
+}
+
+static inline const char *
+mblock_life_name(enum mblock_life life)
+{
+    static const char *const namev[] = { "short", "medium", "long" };
+
+    return life < MBLOCK_LIFE_CNT ? namev[life] : "invalid";
+}
+
+#endif
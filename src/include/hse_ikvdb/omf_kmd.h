@@ -20,12 +20,16 @@
  *   vboff   u32          4   4   4   not present for tombs
  *   vbidx   hg16_32k     1   1   2   not present for tombs
  *   vlen    hg32_1024m   1   1   4   not present for tombs
+ *   clen    hg32_1024m   1   2   4   only present for compressed values
+ *   ilen    u8           1   1   1   immediate values only, followed by data
+ *   lilen   hg16_32k     2   2   2   long immediate values only, ditto
  *
  * Per-entry overhead:
  *
  *     Min  Typical  Max
  *      3      3      9     A key with 1 tombstone entry
  *      9      9     19     A key with a non-zero length value
+ *     10     11     23     A key with a compressed value
  *
  * KMD List:
  *
@@ -45,7 +49,9 @@
  *    kmd_add_tomb(mem, &off, seq);
  *    kmd_add_ptomb(mem, &off, seq);
  *    kmd_add_ival(mem, &off, seq, vbase, vlen);
+ *    kmd_add_lival(mem, &off, seq, vbase, vlen);
  *    kmd_add_val(mem, &off, seq, vbidx, vboff, vlen);
+ *    kmd_add_cval(mem, &off, seq, vbidx, vboff, vlen, clen);
  *    assert(off <= memsize);
  *
  * Unpack example:
@@ -57,18 +63,40 @@
  *                    kmd_val(mem, &off, &vbidx, &vboff, &vlen);
  *            } else if (vtype == vtype_ival) {
  *                    kmd_ival(mem, &off, &vbase, &vlen);
+ *            } else if (vtype == vtype_lival) {
+ *                    kmd_lival(mem, &off, &vbase, &vlen);
+ *            } else if (vtype == vtype_cval) {
+ *                    kmd_cval(mem, &off, &vbidx, &vboff, &vlen, &clen);
  *            }
  *    }
  *
+ * Readers that need the whole entry should prefer kmd_ent_decode(), which
+ * decodes the common shape of a value reference (a value with a 2-byte
+ * seqno and a 1-byte vbidx) in a single step, and readers that are only
+ * looking for a seqno should use kmd_skip_vref() to step over the entries
+ * they reject:
+ *
+ *    count = kmd_count(mem, &off);
+ *    for (i = 0; i < count; i++) {
+ *            kmd_ent_decode(mem, &off, &ent);
+ *            ...
+ *    }
+ *
  * Notes:
  *   - Vblock offfsets are not encoded because the vast majority of offsets in
  *     a large vblock will exceed 16MB and thus require 4-bytes to encode
  *     anyhow.
+ *   - The vlen of a compressed value is its uncompressed length, whereas
+ *     clen is the length of the compressed data stored in the vblock.
+ *   - Immediate values are stored in the kmd region of the kblock, next to
+ *     the wbtree leaf nodes, and are read without touching a vblock.  Those
+ *     longer than a u8 length allows are long immediate values, which the
+ *     readers hand out as vtype_ival.
  */
 
 #define KMD_MAX_COUNT HG32_1024M_MAX
 
-#define KMD_MAX_ENCODED_ENTRY_LEN 19
+#define KMD_MAX_ENCODED_ENTRY_LEN 23
 #define KMD_MAX_ENCODED_COUNT_LEN 4
 
 enum kmd_vtype {
@@ -76,7 +104,9 @@ enum kmd_vtype {
     vtype_zval = 1,  /* zero-length value       */
     vtype_tomb = 2,  /* tombstone               */
     vtype_ptomb = 3, /* prefix tombstone        */
-    vtype_ival = 4   /* immediate (short) value */
+    vtype_ival = 4,  /* immediate (short) value */
+    vtype_cval = 5,  /* compressed value        */
+    vtype_lival = 6  /* long immediate value    */
 };
 
 static inline uint
@@ -128,6 +158,17 @@ kmd_add_ival(void *kmd, size_t *off, u64 seq, const void *vdata, u8 vlen)
     *off += vlen;
 }
 
+static inline void
+kmd_add_lival(void *kmd, size_t *off, u64 seq, const void *vdata, uint vlen)
+{
+    ((u8 *)kmd)[*off] = vtype_lival;
+    *off += 1;
+    encode_hg64(kmd, off, seq);
+    encode_hg16_32k(kmd, off, vlen);
+    memcpy(((u8 *)kmd) + *off, vdata, vlen);
+    *off += vlen;
+}
+
 static inline void
 kmd_add_val(void *kmd, size_t *off, u64 seq, uint vbidx, uint vboff, uint vlen)
 {
@@ -140,6 +181,19 @@ kmd_add_val(void *kmd, size_t *off, u64 seq, uint vbidx, uint vboff, uint vlen)
     encode_hg32_1024m(kmd, off, vlen);
 }
 
+static inline void
+kmd_add_cval(void *kmd, size_t *off, u64 seq, uint vbidx, uint vboff, uint vlen, uint clen)
+{
+    ((u8 *)kmd)[*off] = vtype_cval;
+    *off += 1;
+    encode_hg64(kmd, off, seq);
+    encode_hg16_32k(kmd, off, vbidx);
+    *(u32 *)(kmd + *off) = cpu_to_be32(vboff);
+    *off += 4;
+    encode_hg32_1024m(kmd, off, vlen);
+    encode_hg32_1024m(kmd, off, clen);
+}
+
 static inline uint
 kmd_count(const void *kmd, size_t *off)
 {
@@ -163,6 +217,13 @@ kmd_val(const void *kmd, size_t *off, uint *vbidx, uint *vboff, uint *vlen)
     *vlen = decode_hg32_1024m(kmd, off);
 }
 
+static inline void
+kmd_cval(const void *kmd, size_t *off, uint *vbidx, uint *vboff, uint *vlen, uint *clen)
+{
+    kmd_val(kmd, off, vbidx, vboff, vlen);
+    *clen = decode_hg32_1024m(kmd, off);
+}
+
 static inline void
 kmd_ival(const void *kmd, size_t *off, const void **vbase, uint *vlen)
 {
@@ -171,4 +232,143 @@ kmd_ival(const void *kmd, size_t *off, const void **vbase, uint *vlen)
     *vbase = ((const u8 *)kmd) + *off;
     *off += *vlen;
 }
+
+static inline void
+kmd_lival(const void *kmd, size_t *off, const void **vbase, uint *vlen)
+{
+    *vlen = decode_hg16_32k(kmd, off);
+    *vbase = ((const u8 *)kmd) + *off;
+    *off += *vlen;
+}
+
+/* Length of an hg16_32k or hg32_1024m encoding from its leading byte. */
+static __always_inline uint
+kmd_hg16_len(const u8 *p)
+{
+    return (*p & 0x80) ? 2 : 1;
+}
+
+static __always_inline uint
+kmd_hg32_len(const u8 *p)
+{
+    if (!(*p & 0x80))
+        return 1;
+
+    return (*p & 0x40) ? 4 : 2;
+}
+
+/**
+ * kmd_skip_vref() - step over the value reference of an entry
+ * @kmd:   kmd list
+ * @off:   (in/out) offset of the value reference, as left by kmd_type_seq()
+ * @vtype: value type returned by kmd_type_seq()
+ *
+ * Advances @off to the next entry by examining only the length prefixes
+ * of the value reference rather than decoding it.
+ */
+static __always_inline void
+kmd_skip_vref(const void *kmd, size_t *off, enum kmd_vtype vtype)
+{
+    const u8 *p = kmd + *off;
+    size_t    pos = 0;
+    size_t    n = 0;
+
+    switch (vtype) {
+        case vtype_val:
+        case vtype_cval:
+            n = kmd_hg16_len(p);
+            n += 4;
+            n += kmd_hg32_len(p + n);
+            if (vtype == vtype_cval)
+                n += kmd_hg32_len(p + n);
+            break;
+        case vtype_ival:
+            n = 1 + p[0];
+            break;
+        case vtype_lival:
+            n = decode_hg16_32k(p, &pos);
+            n += pos;
+            break;
+        case vtype_zval:
+        case vtype_tomb:
+        case vtype_ptomb:
+            break;
+    }
+
+    *off += n;
+}
+
+/**
+ * struct kmd_ent - a decoded kmd entry
+ * @seq:     sequence number
+ * @vdata:   value data (ival and lival only)
+ * @vbidx:   vblock index (val and cval only)
+ * @vboff:   vblock offset (val and cval only)
+ * @vlen:    value length (zero for tombs and zvals)
+ * @complen: compressed length (cval only, otherwise zero)
+ * @vtype:   value type
+ */
+struct kmd_ent {
+    u64            seq;
+    const void *   vdata;
+    uint           vbidx;
+    uint           vboff;
+    uint           vlen;
+    uint           complen;
+    enum kmd_vtype vtype;
+};
+
+/**
+ * kmd_ent_decode() - decode the entry at @off and advance past it
+ * @kmd: kmd list
+ * @off: (in/out) offset of the entry
+ * @ent: (output) decoded entry
+ *
+ * The vtype byte, the leading seqno byte and the leading vbidx byte of a
+ * typical value entry fix the offsets of all its members, so once they
+ * are known the remaining members are loaded without a chain of dependent
+ * length decodes.  Everything else falls back to the per-member decoders.
+ */
+static __always_inline void
+kmd_ent_decode(const void *kmd, size_t *off, struct kmd_ent *ent)
+{
+    const u8 *p = kmd + *off;
+
+    ent->vdata = NULL;
+    ent->vbidx = 0;
+    ent->vboff = 0;
+    ent->vlen = 0;
+    ent->complen = 0;
+
+    if (likely(p[0] == vtype_val && !(p[1] & 0xc0) && !(p[3] & 0x80))) {
+        ent->vtype = vtype_val;
+        ent->seq = be16_to_cpu(*(const u16 *)(p + 1));
+        ent->vbidx = p[3];
+        ent->vboff = be32_to_cpu(*(const u32 *)(p + 4));
+        *off += 8;
+        ent->vlen = decode_hg32_1024m(kmd, off);
+        return;
+    }
+
+    kmd_type_seq(kmd, off, &ent->vtype, &ent->seq);
+
+    switch (ent->vtype) {
+        case vtype_val:
+            kmd_val(kmd, off, &ent->vbidx, &ent->vboff, &ent->vlen);
+            break;
+        case vtype_cval:
+            kmd_cval(kmd, off, &ent->vbidx, &ent->vboff, &ent->vlen, &ent->complen);
+            break;
+        case vtype_ival:
+            kmd_ival(kmd, off, &ent->vdata, &ent->vlen);
+            break;
+        case vtype_lival:
+            kmd_lival(kmd, off, &ent->vdata, &ent->vlen);
+            break;
+        case vtype_zval:
+        case vtype_tomb:
+        case vtype_ptomb:
+            break;
+    }
+}
 #endif
@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_IKVDB_OPTRACE_H
+#define HSE_IKVDB_OPTRACE_H
+
+#include <hse_util/compiler.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+#include <hse_util/page.h>
+
+/* An operation trace captures the kvs and transaction calls an application
+ * makes on a kvdb, at the API, such that optrace_replay can re-drive the
+ * same workload against a test kvdb at its original speed or faster.
+ *
+ * Capture is enabled when the kvdb is opened with the rparam optrace_path
+ * set, and stops when the kvdb is closed.  Only one kvdb per process is
+ * traced at a time.  Each put, get, delete, prefix delete, transaction
+ * begin, commit and abort, and each kvs open, appends one record to the
+ * trace file.  Records carry the time of the operation relative to the
+ * start of the trace, the calling thread (such that a replay can keep
+ * the concurrency of the application), the kvs, the transaction, the key
+ * and value lengths and a hash of the key.  The keys themselves are only
+ * saved with the rparam optrace_keys set, in which case each record is
+ * followed by its key.  Gets are recorded when they complete, with the
+ * length of the value found; all other operations when they are issued.
+ *
+ * Each thread buffers its records in a buffer of its own, which is
+ * handed to a writer thread once full, so the cost of capture is a clock
+ * read and a copy per operation, plus a short critical section every
+ * OPTRACE_BUFSZ bytes.  The records of a thread are in order in the
+ * trace, those of different threads are interleaved a buffer at a time.
+ *
+ * The file is a struct optrace_hdr followed by the records, in the byte
+ * order of the host.
+ */
+
+#define OPTRACE_MAGIC (0x4f505452) /* "OPTR" */
+#define OPTRACE_VERSION (1)
+#define OPTRACE_BUFSZ (256 * 1024)
+#define OPTRACE_KVS_MAX (256)
+
+/* Header flags */
+#define OPTRACE_F_KEYS (0x01) /* records are followed by their keys */
+
+/* Record flags */
+#define OPTRACE_RF_FOUND (0x01) /* a get found its key */
+#define OPTRACE_RF_KEY (0x02) /* the record is followed by or_klen bytes */
+
+enum optrace_op {
+    OPTRACE_OP_KVS_OPEN,
+    OPTRACE_OP_PUT,
+    OPTRACE_OP_GET,
+    OPTRACE_OP_DEL,
+    OPTRACE_OP_PFX_DEL,
+    OPTRACE_OP_TXN_BEGIN,
+    OPTRACE_OP_TXN_COMMIT,
+    OPTRACE_OP_TXN_ABORT,
+    OPTRACE_OP_MAX
+};
+
+/**
+ * struct optrace_hdr - trace file header
+ * @oh_magic:   OPTRACE_MAGIC
+ * @oh_version: OPTRACE_VERSION
+ * @oh_flags:   OPTRACE_F_*
+ * @oh_recsz:   sizeof(struct optrace_rec)
+ * @oh_start:   wall clock time at which the trace started (ns since epoch)
+ */
+struct optrace_hdr {
+    u32 oh_magic;
+    u32 oh_version;
+    u32 oh_flags;
+    u32 oh_recsz;
+    u64 oh_start;
+};
+
+/**
+ * struct optrace_rec - one traced operation
+ * @or_time:   time of the operation, since the start of the trace (ns)
+ * @or_hash:   hash of the key or prefix, 0 for transaction operations
+ * @or_txn:    transaction of the operation (0: none), unique among the
+ *             transactions in progress
+ * @or_vlen:   length of the value put, or found by a get
+ * @or_klen:   length of the key or prefix (of the kvs name for a kvs open)
+ * @or_thread: calling thread, numbered from 1 in order of first operation
+ * @or_op:     enum optrace_op
+ * @or_kvs:    kvs, numbered from 0 in order of kvs open
+ * @or_flags:  OPTRACE_RF_*
+ *
+ * A kvs open record is always followed by the name of the kvs.
+ */
+struct optrace_rec {
+    u64 or_time;
+    u64 or_hash;
+    u64 or_txn;
+    u32 or_vlen;
+    u16 or_klen;
+    u16 or_thread;
+    u8  or_op;
+    u8  or_kvs;
+    u8  or_flags;
+    u8  or_rsvd[5];
+};
+
+/* Size of a record and the key that follows it */
+static inline size_t
+optrace_rec_len(const struct optrace_rec *rec)
+{
+    size_t len = sizeof(*rec);
+
+    if (rec->or_flags & OPTRACE_RF_KEY)
+        len += ALIGN(rec->or_klen, 8);
+
+    return len;
+}
+
+struct hse_kvdb;
+struct hse_kvs;
+struct hse_kvdb_txn;
+
+extern bool optrace_enabled;
+
+/**
+ * optrace_start() - start tracing the operations on a kvdb
+ * @kvdb: kvdb to trace
+ * @path: trace file, created or truncated
+ * @keys: save keys rather than only their hashes
+ */
+merr_t
+optrace_start(struct hse_kvdb *kvdb, const char *path, bool keys);
+
+/**
+ * optrace_stop() - stop tracing if @kvdb is being traced, flush the trace
+ */
+void
+optrace_stop(struct hse_kvdb *kvdb);
+
+/**
+ * optrace_kvs_open() - record the opening of a kvs of the traced kvdb
+ */
+void
+optrace_kvs_open(struct hse_kvdb *kvdb, struct hse_kvs *kvs, const char *name);
+
+/**
+ * optrace_kvs_op() - record a kvs operation
+ * @op:    OPTRACE_OP_PUT, _GET, _DEL or _PFX_DEL
+ * @kvs:   kvs, ignored if not opened while being traced
+ * @txn:   transaction of the operation, if any
+ * @key:   key or prefix
+ * @klen:  length of %key
+ * @vlen:  length of the value put or found
+ * @flags: OPTRACE_RF_FOUND for a get that found its key
+ */
+void
+optrace_kvs_op(
+    enum optrace_op      op,
+    struct hse_kvs *     kvs,
+    struct hse_kvdb_txn *txn,
+    const void *         key,
+    size_t               klen,
+    size_t               vlen,
+    uint                 flags);
+
+/**
+ * optrace_txn_op() - record a transaction begin, commit or abort
+ */
+void
+optrace_txn_op(enum optrace_op op, struct hse_kvdb *kvdb, struct hse_kvdb_txn *txn);
+
+#endif
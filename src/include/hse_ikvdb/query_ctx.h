@@ -10,13 +10,13 @@
 
 #include <3rdparty/rbtree.h>
 
-#include <pthread.h>
-
-extern pthread_key_t tomb_thread_key;
+struct kvs_vlease;
 
 enum query_type {
     QUERY_GET = 0,
     QUERY_PROBE_PFX,
+    QUERY_GET_LEASE,
+    QUERY_PREFETCH,
 };
 
 /**
@@ -37,15 +37,17 @@ struct tomb_elem {
  * struct query_ctx - context for queries (get, probe etc.)
  * @qtype:     type of query
  * @tomb_tree: shrub for tombstones
- * @pos:       current position in the memory region backing tomb elems
  * @ntombs:    number of tombstones encountered in current query
  * @seen:      number of unique keys seen
+ * @lease:     value lease to fill in (QUERY_GET_LEASE only)
  */
 struct query_ctx {
     enum query_type qtype;
 
+    /* get lease specific context */
+    struct kvs_vlease *lease;
+
     /* prefix probe specific context */
-    int            pos;
     uint           ntombs;
     int            seen;
     struct rb_root tomb_tree[TT_WIDTH];
@@ -57,10 +59,4 @@ qctx_tomb_insert(struct query_ctx *qctx, const void *sfx, size_t sfx_len);
 bool
 qctx_tomb_seen(struct query_ctx *qctx, const void *sfx, size_t sfx_len);
 
-void
-qctx_te_mem_reset(void);
-
-merr_t
-qctx_te_mem_init(void);
-
 #endif /* HSE_KVS_QCTX_H */
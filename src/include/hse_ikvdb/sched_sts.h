@@ -31,6 +31,7 @@ sts_cancel_fn(struct sts_job *job);
 /**
  * struct sts_job - short term scheduler job handle
  * @sj_link:      for keeping jobs on a linked list (scheduler internal use)
+ * @sj_next:      for lock-free job submission (scheduler internal use)
  * @sj_sts:       handle to scheduler that manages this job
  * @sj_job_fn:    job handler, set by client, invoked by scheduler
  * @sj_cancel_fn: job cancel function, set by client, invoked by scheduler
@@ -40,6 +41,7 @@ sts_cancel_fn(struct sts_job *job);
 struct sts_job {
     /* internal use */
     struct list_head sj_link;
+    struct sts_job * sj_next;
     /* set by scheduler, used by client */
     struct sts *sj_sts;
     /* set by client */
@@ -106,6 +108,18 @@ sts_job_init(struct sts_job *job, sts_job_fn *job_fn, sts_cancel_fn *cancel_fn,
 void
 sts_job_submit(struct sts *s, struct sts_job *job);
 
+/**
+ * sts_job_assist() - run a queued job on the calling thread
+ * @s:       short term scheduler
+ * @qnum:    queue from which to take the job
+ *
+ * Return: true if a job was run, false if the queue was empty or the
+ * scheduler is not running
+ */
+/* MTF_MOCK */
+bool
+sts_job_assist(struct sts *s, uint qnum);
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "sched_sts_ut.h"
 #endif /* HSE_UNIT_TEST_MODE */
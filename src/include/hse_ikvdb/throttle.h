@@ -13,12 +13,15 @@
 #include <hse_util/spinlock.h>
 #include <hse_util/perfc.h>
 #include <hse_util/condvar.h>
+#include <hse_util/token_bucket.h>
+#include <hse_util/minmax.h>
 
 enum {
     THROTTLE_SENSOR_CSCHED,
     THROTTLE_SENSOR_C0SK,
     THROTTLE_SENSOR_C0SKM_DTIME,
     THROTTLE_SENSOR_C0SKM_DSIZE,
+    THROTTLE_SENSOR_C1,
     THROTTLE_SENSOR_CNT
 };
 
@@ -34,6 +37,22 @@ enum {
 #define THROTTLE_DELAY_MAX 268435456
 #define THROTTLE_MAX_RUN 6
 
+/* Rate controller (kvdb rparam throttle_rate_ctl), rates in bytes/sec.
+ * The gains apply to sensor errors and yield per-mille rate changes
+ * once divided by THROTTLE_RATE_GAIN_DIV.
+ */
+#define THROTTLE_RATE_SETPOINT (THROTTLE_SENSOR_SCALE * 9 / 10)
+#define THROTTLE_RATE_RELEASE (THROTTLE_SENSOR_SCALE / 4)
+#define THROTTLE_RATE_RELEASE_CYCLES 40
+#define THROTTLE_RATE_MIN (1ul << 20)
+#define THROTTLE_RATE_STEP_MAX 200
+#define THROTTLE_RATE_KP 200
+#define THROTTLE_RATE_KI 90
+#define THROTTLE_RATE_KD 100
+#define THROTTLE_RATE_GAIN_DIV 1000
+#define THROTTLE_RATE_BURST_MS 10
+#define THROTTLE_RATE_BURST_MIN (64ul << 10)
+
 /**
  * struct throttle_sensor - throttle sensor
  *
@@ -94,6 +113,9 @@ throttle_sensor_get(struct throttle_sensor *ts)
 
 enum throttle_state { THROTTLE_NO_CHANGE, THROTTLE_DECREASE, THROTTLE_INCREASE };
 
+typedef bool
+throttle_assist_fn(void *arg);
+
 /**
  * struct throttle_mavg - throttle mavg
  * @thr_samples   :     array of last THROTTLE_SAMPLE_CNT max sensor values
@@ -140,9 +162,20 @@ struct throttle_mavg {
  * @thr_num_tries:      number of trials in current reduction cycle
  * @thr_max_tries:      max number of trials
  * @thr_try_mreduce:    if set double prev sleep delta to ramp up quickly
+ * @thr_rate_ctl:       pace puts at @thr_rate rather than sleep per put
+ * @thr_rate_meas:      filtered max sensor value (rate controller input)
+ * @thr_rate_err:       rate controller errors of the last two updates
+ * @thr_rate_calm:      consecutive updates with low sensors and idle rate
+ * @thr_rate_last:      time of the last rate update (nsecs)
+ * @thr_rate_tb:        paces puts at @thr_rate
+ * @thr_assist:         runs queued compaction work on a paced writer thread
+ * @thr_assist_arg:     argument of @thr_assist
+ * @thr_assist_ns:      minimum pacing delay for which @thr_assist is called
  * @thr_rp:
  * @thr_perfc:
  * @thr_data:           raw nanosleep performance metrics
+ * @thr_rate:           admitted put rate (bytes/sec), 0 if not pacing
+ * @thr_rate_bytes:     bytes put since the last rate update
  * @thr_sensorv:        vector of throttle sensors
  */
 struct throttle {
@@ -174,11 +207,23 @@ struct throttle {
     uint                 thr_num_tries;
     uint                 thr_max_tries;
     bool                 thr_try_mreduce;
+    bool                 thr_rate_ctl;
+    uint                 thr_rate_meas;
+    long                 thr_rate_err[2];
+    uint                 thr_rate_calm;
+    u64                  thr_rate_last;
+    struct tbkt          thr_rate_tb;
+    throttle_assist_fn * thr_assist;
+    void *               thr_assist_arg;
+    u64                  thr_assist_ns;
     struct kvdb_rparams *thr_rp;
     struct perfc_set     thr_sensor_perfc;
     struct perfc_set     thr_sleep_perfc;
 
     __aligned(SMP_CACHE_BYTES) atomic64_t thr_data;
+    atomic64_t thr_rate;
+
+    __aligned(SMP_CACHE_BYTES) atomic64_t thr_rate_bytes;
 
     struct throttle_sensor thr_sensorv[THROTTLE_SENSOR_CNT];
 };
@@ -195,6 +240,18 @@ throttle_fini(struct throttle *self);
 void
 throttle_update(struct throttle *self);
 
+/**
+ * throttle_assist_set() - set the work a paced writer runs instead of sleeping
+ * @self: throttle
+ * @fn:   runs one piece of queued work, returns false if there was none
+ * @arg:  argument of @fn
+ *
+ * @fn is only called in rate control mode, and only if the throttle_assist_us
+ * rparam is set.  A NULL @fn disables assisting.
+ */
+void
+throttle_assist_set(struct throttle *self, throttle_assist_fn *fn, void *arg);
+
 bool
 throttle_active(struct throttle *self);
 
@@ -216,6 +273,42 @@ throttle_debug(struct throttle *self);
 void
 throttle_reduce_debug(struct throttle *self, uint value, uint mavg);
 
+/**
+ * throttle_rate() - get the admitted put rate of the rate controller
+ *
+ * Return: bytes/sec, 0 if puts are not paced.
+ */
+static inline u64
+throttle_rate(struct throttle *self)
+{
+    return atomic64_read(&self->thr_rate);
+}
+
+/* Burst of a token bucket that paces puts at @rate.
+ */
+static inline u64
+throttle_rate_burst(u64 rate)
+{
+    return max_t(u64, rate * THROTTLE_RATE_BURST_MS / 1000, THROTTLE_RATE_BURST_MIN);
+}
+
+/**
+ * throttle_tenant() - pace a put of a tenant at its share of the rate
+ * @self:
+ * @start: time in ns at which the put op began
+ * @len:   total key + value length for the put
+ * @tb:    tenant bucket, whose rate the caller keeps at the tenant's share
+ *         of throttle_rate()
+ * @floor: guaranteed rate of the tenant, may be NULL
+ *
+ * Same as throttle() with the sleep throttle, the tenant buckets apply
+ * only to the rate controller.
+ *
+ * Return: Returns the time slept in ns in this call.
+ */
+long
+throttle_tenant(struct throttle *self, u64 start, u32 len, struct tbkt *tb, struct tbkt *floor);
+
 /**
  * throttle() - sleep after a successful put
  * @self:
@@ -53,6 +53,137 @@ struct kvs_kvtuple {
     struct kvs_vtuple kvt_value;
 };
 
+/**
+ * kvs_merge_fn - merge function of a kvs (see hse_kvs_merge())
+ *
+ * Combines @oper with the current value @base of key @key (@base is
+ * NULL if the key has no value) into @result.  The length of the
+ * result is returned in *@rlen, a result longer than @rmax is not
+ * written and the function is called again with a larger buffer.
+ */
+typedef merr_t
+kvs_merge_fn(
+    const void *key,
+    size_t      klen,
+    const void *base,
+    size_t      blen,
+    const void *oper,
+    size_t      olen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen);
+
+/**
+ * struct kvs_patch - merge operand of kvs_patch_merge()
+ * @kp_off:  offset in the value at which to write @kp_data, or
+ *           KVS_PATCH_APPEND to write it at the end of the value
+ * @kp_data: bytes to write
+ * @kp_len:  length of @kp_data
+ *
+ * A kvs_patch is passed to the fold by address, with the operand
+ * length set to sizeof(struct kvs_patch).
+ */
+struct kvs_patch {
+    u64         kp_off;
+    const void *kp_data;
+    size_t      kp_len;
+};
+
+#define KVS_PATCH_APPEND (U64_MAX)
+
+/* Actions of a compaction filter, same as enum hse_kvs_cfilter_action. */
+enum kvs_cfilter_action {
+    KVS_CFILTER_KEEP = 0,
+    KVS_CFILTER_DROP = 1,
+    KVS_CFILTER_REPLACE = 2,
+};
+
+/**
+ * kvs_cfilter_fn - compaction filter of a kvs (see hse_kvs_compact_filter_register())
+ *
+ * Returns an enum kvs_cfilter_action for the value @val of key @key.  A
+ * replacement of at most @rmax bytes is written to @result and its length
+ * to *@rlen.
+ */
+typedef int
+kvs_cfilter_fn(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen);
+
+/**
+ * kvs_index_fn - key extractor of a secondary index (see hse_kvs_index_register())
+ *
+ * Writes the index key of the value @val of key @key, of at most @imax
+ * bytes, to @ikey and its length to *@ilen.  A non-zero return means the
+ * value has no index entry.
+ */
+typedef int
+kvs_index_fn(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      ikey,
+    size_t      imax,
+    size_t *    ilen);
+
+/**
+ * kvs_scan_fn - callback of a parallel scan (see hse_kvs_scan_parallel())
+ *
+ * Called for each key-value pair of a range, on the range's thread.  A
+ * non-zero return stops the scan.
+ */
+typedef int
+kvs_scan_fn(void *arg, const void *key, size_t klen, const void *val, size_t vlen);
+
+/**
+ * kvs_pred_fn - filter predicate of a cursor (see hse_kvs_cursor_filter())
+ *
+ * Called with a key and its value, or with a NULL value if only the key
+ * is filtered.  A zero return hides the key from the cursor.
+ */
+typedef int
+kvs_pred_fn(void *arg, const void *key, size_t klen, const void *val, size_t vlen);
+
+/**
+ * struct kvs_wbatch_op - one put or delete within a write batch
+ * @wbo_kt:     key to put or delete
+ * @wbo_vt:     value to put (ignored for a delete)
+ * @wbo_skidx:  c0sk index of the kvs to which the op applies
+ * @wbo_tomb:   true if the op is a delete
+ */
+struct kvs_wbatch_op {
+    struct kvs_ktuple wbo_kt;
+    struct kvs_vtuple wbo_vt;
+    u16               wbo_skidx;
+    bool              wbo_tomb;
+};
+
+/**
+ * struct kvs_vlease - read-only reference to a value returned by a lease get
+ * @vl_data:  ptr to the value
+ * @vl_len:   length of the value
+ * @vl_pin:   cn kvset pinned until the lease is released (or NULL)
+ * @vl_buf:   private copy of the value if not served from cn (or NULL)
+ *
+ * A value resident in a cn kvset is returned by reference into the kvset's
+ * mapped vblock (or kblock for immediate values) and the kvset is pinned for
+ * the lifetime of the lease.  Otherwise the value is copied into @vl_buf.
+ */
+struct kvs_vlease {
+    const void *vl_data;
+    u32         vl_len;
+    void *      vl_pin;
+    void *      vl_buf;
+};
+
 struct kvs_vtuple_ref {
     enum kmd_vtype vr_type;
     union {
@@ -60,6 +191,7 @@ struct kvs_vtuple_ref {
             u16 vr_index;
             u32 vr_off;
             u32 vr_len;
+            u32 vr_complen; /* vtype_cval only */
         } vb;
         struct {
             u16         vr_len;
@@ -85,6 +217,45 @@ kvs_ktuple_init_nohash(struct kvs_ktuple *kt, const void *key, s32 key_len)
     kt->kt_hash = 0;
 }
 
+/**
+ * kvs_ktuple_hashv() - set the hashes of a vector of keys
+ * @ktv:      vector of keys
+ * @cnt:      number of keys
+ * @sfx_len:  suffix length of the kvs (not hashed)
+ *
+ * Runs of four keys of the same length (the common case for a batch) are
+ * hashed together by key_hash64x4(), all other keys one at a time.
+ */
+static inline void
+kvs_ktuple_hashv(struct kvs_ktuple *ktv, u32 cnt, u32 sfx_len)
+{
+    u32 i = 0, j;
+
+    for (; i + 4 <= cnt; i += 4) {
+        struct kvs_ktuple *kt = ktv + i;
+        const void *       datav[4];
+        u64                hashv[4];
+
+        if (kt[1].kt_len != kt[0].kt_len || kt[2].kt_len != kt[0].kt_len ||
+            kt[3].kt_len != kt[0].kt_len) {
+            for (j = 0; j < 4; ++j)
+                kt[j].kt_hash = key_hash64(kt[j].kt_data, kt[j].kt_len - sfx_len);
+            continue;
+        }
+
+        for (j = 0; j < 4; ++j)
+            datav[j] = kt[j].kt_data;
+
+        key_hash64x4(datav, kt[0].kt_len - sfx_len, hashv);
+
+        for (j = 0; j < 4; ++j)
+            kt[j].kt_hash = hashv[j];
+    }
+
+    for (; i < cnt; ++i)
+        ktv[i].kt_hash = key_hash64(ktv[i].kt_data, ktv[i].kt_len - sfx_len);
+}
+
 static inline void
 kvs_vtuple_init(struct kvs_vtuple *vt, void *val, s32 val_len)
 {
@@ -24,20 +24,16 @@
 struct active_ctxn_set {
 };
 
-/* The bucket mask is indexed by the number of active transactions
- * to obtain a bitmask used to constrain the number of buckets
- * available to active_ctxn_set_insert().  Keeping the number of
- * buckets reasonably constrained w.r.t the number of active ctxns
- * reduces the overhead required to maintain the horizon.
- */
-static const u8 active_ctxn_bkt_maskv[] = { 3,  3,  3,  3,  7,  7,  7,  7,  7,  7,  7,
-                                            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
-                                            15, 15, 31, 31, 31, 31, 31, 31, 31, 31 };
+#define ACTIVE_CTXN_BKTS_MAX 32
 
 /**
  * struct active_ctxn_bkt -
  * @acb_tree:           ptr to the active_ctxn_tree object
  * @acb_min_view_sns:   minimum view sequence number for the set
+ *
+ * Each bucket is private to the cpus that map to it, so begin and end
+ * of a transaction only write the bucket's own cache lines.  While the
+ * tree is empty acb_min_view_sns is U64_MAX.
  */
 struct active_ctxn_bkt {
     struct active_ctxn_tree *acb_tree;
@@ -47,32 +43,23 @@ struct active_ctxn_bkt {
 /**
  * struct active_ctxn_set_impl
  * @acs_handle:         opaque handle for this struct
- * @acs_bkt_end:        ptr to one bucket past the last valid bucket
- * @acs_seqno_addr:
- * @acs_min_view_sn:    set minimum view seqno
- * @acs_min_view_bkt:   bucket which contains current min-view-sn
- * @acs_active:         count of active transactions
- * @acs_horizon:
- * @acs_lock:           min_view_sn computation lock
- * @acs_changing:       head of a bucket is changing to/from empty
+ * @acs_seqno_addr:     ptr to the kvdb seqno
+ * @acs_bktc:           number of buckets in use
+ * @acs_horizon:        cached set minimum view seqno (monotonic)
  * @acs_bktv:           active client transaction sets
+ *
+ * The set minimum is never maintained eagerly.  It is recomputed by
+ * scanning the per-cpu buckets whenever a reader asks for the horizon,
+ * or a remove drops what may have been the oldest view, and the result
+ * is published to acs_horizon only if it moved forward.
  */
 struct active_ctxn_set_impl {
     struct active_ctxn_set acs_handle;
-    u8                     acs_maskv[NELEM(active_ctxn_bkt_maskv)];
     atomic64_t *           acs_seqno_addr;
-
-    __aligned(SMP_CACHE_BYTES) volatile u64 acs_min_view_sn;
-    volatile void *acs_min_view_bkt;
-
-    __aligned(SMP_CACHE_BYTES) atomic_t acs_active;
+    u32                    acs_bktc;
 
     __aligned(SMP_CACHE_BYTES) atomic64_t acs_horizon;
 
-    __aligned(SMP_CACHE_BYTES) spinlock_t acs_lock;
-    atomic_t                acs_changing;
-    struct active_ctxn_bkt *acs_bkt_end;
-
     struct active_ctxn_bkt acs_bktv[];
 };
 
@@ -114,7 +101,7 @@ active_ctxn_set_create(struct active_ctxn_set **handle, atomic64_t *kvdb_seqno_a
     size_t sz;
     int    i;
 
-    max_bkts = NELEM(self->acs_maskv);
+    max_bkts = clamp_t(u32, num_online_cpus(), 1, ACTIVE_CTXN_BKTS_MAX);
 
     sz = sizeof(*self);
     sz += sizeof(self->acs_bktv[0]) * max_bkts;
@@ -124,7 +111,7 @@ active_ctxn_set_create(struct active_ctxn_set **handle, atomic64_t *kvdb_seqno_a
         return merr(ENOMEM);
 
     memset(self, 0, sz);
-    memcpy(self->acs_maskv, active_ctxn_bkt_maskv, sizeof(self->acs_maskv));
+    self->acs_bktc = max_bkts;
 
     for (i = 0; i < max_bkts; ++i) {
         struct active_ctxn_bkt *bkt = self->acs_bktv + i;
@@ -139,13 +126,7 @@ active_ctxn_set_create(struct active_ctxn_set **handle, atomic64_t *kvdb_seqno_a
     }
 
     self->acs_seqno_addr = kvdb_seqno_addr;
-    self->acs_min_view_sn = atomic64_read(kvdb_seqno_addr);
-    atomic64_set(&self->acs_horizon, self->acs_min_view_sn);
-    self->acs_min_view_bkt = NULL;
-    atomic_set(&self->acs_active, 1);
-    atomic_set(&self->acs_changing, 0);
-    spin_lock_init(&self->acs_lock);
-    self->acs_bkt_end = self->acs_bktv;
+    atomic64_set(&self->acs_horizon, atomic64_read(kvdb_seqno_addr));
 
     *handle = &self->acs_handle;
 
@@ -168,7 +149,7 @@ active_ctxn_set_destroy(struct active_ctxn_set *handle)
 
     self = active_ctxn_set_h2r(handle);
 
-    for (i = 0; i < NELEM(active_ctxn_bkt_maskv); ++i) {
+    for (i = 0; i < self->acs_bktc; ++i) {
         struct active_ctxn_bkt *bkt = self->acs_bktv + i;
 
         active_ctxn_tree_destroy(bkt->acb_tree);
@@ -177,79 +158,64 @@ active_ctxn_set_destroy(struct active_ctxn_set *handle)
     free_aligned(self);
 }
 
-u64
-active_ctxn_set_horizon(struct active_ctxn_set *handle)
+/**
+ * active_ctxn_set_scan() - compute a lower bound on all active views
+ * @self:   ptr to active_ctxn object
+ *
+ * The kvdb seqno must be read before the buckets.  An insert publishes
+ * a provisional bucket minimum before it takes its view from the kvdb
+ * seqno, so any view older than the seqno read here is already visible
+ * in its bucket.
+ */
+static u64
+active_ctxn_set_scan(struct active_ctxn_set_impl *self)
 {
-    struct active_ctxn_set_impl *self = active_ctxn_set_h2r(handle);
-
-    u64 newh;
-    u64 kvdb_seq = atomic64_read(self->acs_seqno_addr);
-    u64 oldh = atomic64_read(&self->acs_horizon);
-
-    /* Read old horizon and KVDB seqno before checking active txn cnt */
-    smp_rmb();
+    u64 min_sn;
+    int i;
 
-    if (atomic_read(&self->acs_active) > 1) {
-        newh = self->acs_min_view_sn;
-    } else {
-        /* Any transaction that began but wasn't reflected in acs_active
-         * will have a view seqno that is larger than kvdb_seq.
-         */
-        newh = kvdb_seq;
-    }
+    min_sn = atomic64_read(self->acs_seqno_addr);
+    smp_mb();
 
-    /* self->acs_min_view_sn updates are lazy. self->acs_min_view_sn may be
-     * lagging behind a previously returned horizon.
-     */
-    while (newh > oldh) {
-        if (atomic64_cmpxchg(&self->acs_horizon, oldh, newh) == oldh)
-            return newh;
+    for (i = 0; i < self->acs_bktc; ++i) {
+        u64 sn = self->acs_bktv[i].acb_min_view_sns;
 
-        oldh = atomic64_read(&self->acs_horizon);
+        if (sn < min_sn)
+            min_sn = sn;
     }
 
-    assert(oldh >= newh);
-
-    return oldh;
+    return min_sn;
 }
 
 /**
- * active_ctxn_set_update() - update set minimum view seqno
- * @self:       ptr to active_ctxn object
- * @entry_sn:   caller's min view seqno
+ * active_ctxn_set_advance() - publish a new set minimum
+ * @self:   ptr to active_ctxn object
+ * @newh:   candidate minimum from active_ctxn_set_scan()
  *
- * This function must be called with the ace_lock held.
+ * Scans may race and finish out of order, only ever move forward.
  */
-static inline void
-active_ctxn_set_update(struct active_ctxn_set_impl *self, u64 entry_sn)
+static u64
+active_ctxn_set_advance(struct active_ctxn_set_impl *self, u64 newh)
 {
-    struct active_ctxn_bkt *min_bkt, *bkt;
-    u64                     min_sn;
+    u64 oldh = atomic64_read(&self->acs_horizon);
 
-    min_sn = U64_MAX;
-    min_bkt = NULL;
+    while (newh > oldh) {
+        u64 cur = atomic64_cmpxchg(&self->acs_horizon, oldh, newh);
 
-    for (bkt = self->acs_bktv; bkt < self->acs_bkt_end; ++bkt) {
-        u64 old = bkt->acb_min_view_sns;
+        if (cur == oldh)
+            return newh;
 
-        if (old < min_sn) {
-            min_sn = old;
-            min_bkt = bkt;
-        }
+        oldh = cur;
     }
 
-    if (atomic_read_acq(&self->acs_changing))
-        return;
+    return oldh;
+}
 
-    /* No active transaction in the system after a remove. */
-    if (min_sn == U64_MAX) {
-        assert(entry_sn != 0);
-        min_sn = entry_sn;
-    }
+u64
+active_ctxn_set_horizon(struct active_ctxn_set *handle)
+{
+    struct active_ctxn_set_impl *self = active_ctxn_set_h2r(handle);
 
-    assert(min_sn >= self->acs_min_view_sn);
-    self->acs_min_view_sn = min_sn;
-    self->acs_min_view_bkt = min_bkt;
+    return active_ctxn_set_advance(self, active_ctxn_set_scan(self));
 }
 
 merr_t
@@ -259,50 +225,35 @@ active_ctxn_set_insert(struct active_ctxn_set *handle, u64 *viewp, void **cookie
     struct active_ctxn_entry *   entry;
     struct active_ctxn_tree *    tree;
     struct active_ctxn_bkt *     bkt;
-    u32                          idx;
-    bool                         changed;
-
-    idx = atomic_inc_return(&self->acs_active) / 2;
-    if (idx > NELEM(active_ctxn_bkt_maskv) - 1)
-        idx = NELEM(active_ctxn_bkt_maskv) - 1;
-    idx = raw_smp_processor_id() & self->acs_maskv[idx];
 
-    bkt = self->acs_bktv + idx;
+    bkt = self->acs_bktv + (raw_smp_processor_id() % self->acs_bktc);
     tree = bkt->acb_tree;
 
     spin_lock(&tree->act_lock);
     entry = active_ctxn_entry_alloc(&tree->act_cache);
     if (ev(!entry)) {
         spin_unlock(&tree->act_lock);
-        atomic_dec(&self->acs_active);
         return merr(ENOMEM);
     }
 
-    changed = list_empty(&tree->act_head);
-    if (changed)
-        atomic_inc_acq(&self->acs_changing);
+    if (list_empty(&tree->act_head)) {
+        assert(bkt->acb_min_view_sns == U64_MAX);
 
-    entry->ace_view_sn = atomic64_fetch_add(1, self->acs_seqno_addr);
-    entry->ace_tree = tree;
-    list_add_tail(&entry->ace_link, &tree->act_head);
+        /* Publish a provisional minimum no larger than the view we
+         * are about to take (see active_ctxn_set_scan()).
+         */
+        bkt->acb_min_view_sns = atomic64_read(self->acs_seqno_addr);
+        smp_mb();
 
-    if (changed) {
-        assert(bkt->acb_min_view_sns == U64_MAX);
+        entry->ace_view_sn = atomic64_fetch_add(1, self->acs_seqno_addr);
         bkt->acb_min_view_sns = entry->ace_view_sn;
+    } else {
+        entry->ace_view_sn = atomic64_fetch_add(1, self->acs_seqno_addr);
     }
-    spin_unlock(&tree->act_lock);
-
-    if (changed) {
-        spin_lock(&self->acs_lock);
-        assert(entry->ace_view_sn >= self->acs_min_view_sn);
-
-        if (bkt >= self->acs_bkt_end)
-            self->acs_bkt_end = bkt + 1;
 
-        if (atomic_dec_rel(&self->acs_changing) == 0)
-            active_ctxn_set_update(self, 0);
-        spin_unlock(&self->acs_lock);
-    }
+    entry->ace_tree = tree;
+    list_add_tail(&entry->ace_link, &tree->act_head);
+    spin_unlock(&tree->act_lock);
 
     *viewp = entry->ace_view_sn;
     *cookiep = entry;
@@ -310,6 +261,14 @@ active_ctxn_set_insert(struct active_ctxn_set *handle, u64 *viewp, void **cookie
     return 0;
 }
 
+u64
+active_ctxn_set_view(const void *cookie)
+{
+    const struct active_ctxn_entry *entry = cookie;
+
+    return entry->ace_view_sn;
+}
+
 BullseyeCoverageSaveOff void
 active_ctxn_set_remove(
     struct active_ctxn_set *handle,
@@ -344,32 +303,15 @@ active_ctxn_set_remove(
     active_ctxn_entry_free(&tree->act_cache, entry);
     spin_unlock(&tree->act_lock);
 
-    while (changed) {
-        if (atomic_read_acq(&self->acs_changing))
-            break;
-
-        if (entry_sn < self->acs_min_view_sn)
-            break;
-
-        if (self->acs_min_view_bkt != bkt)
-            break;
-
-        if (spin_trylock(&self->acs_lock)) {
-            if (entry_sn >= self->acs_min_view_sn) {
-                u64 seq = atomic64_read(self->acs_seqno_addr);
-                active_ctxn_set_update(self, seq);
-            }
-            spin_unlock(&self->acs_lock);
-            break;
-        }
-
-        __builtin_ia32_pause();
-    }
-
-    *min_view_sn = self->acs_min_view_sn;
-    *min_changed = *min_view_sn > entry_sn;
+    /* Only the oldest view of a bucket can be the set minimum, and only
+     * if the cached minimum hasn't already moved past it.
+     */
+    min_sn = atomic64_read(&self->acs_horizon);
+    if (changed && entry_sn >= min_sn)
+        min_sn = active_ctxn_set_advance(self, active_ctxn_set_scan(self));
 
-    atomic_dec(&self->acs_active);
+    *min_view_sn = min_sn;
+    *min_changed = min_sn > entry_sn;
 }
 BullseyeCoverageRestore
 
@@ -31,4 +31,10 @@ active_ctxn_set_remove(
 u64
 active_ctxn_set_horizon(struct active_ctxn_set *handle);
 
+/**
+ * active_ctxn_set_view() - view seqno of an active_ctxn_set_insert() cookie
+ */
+u64
+active_ctxn_set_view(const void *cookie);
+
 #endif
@@ -26,6 +26,9 @@ struct perfc_name ctxn_perfc_op[] = {
     NE(PERFC_RA_CTXNOP_ABORT, 3, "Count of ctxn aborts", "c_abt(/s)"),
     NE(PERFC_RA_CTXNOP_LOCK_DONE, 3, "Count of lock acquire success", "c_lksuc(/s)"),
     NE(PERFC_RA_CTXNOP_LOCK_FAILED, 3, "Count of lock acquire failure", "c_lkfld(/s)"),
+    NE(PERFC_RA_CTXNOP_LOCK_INHERIT, 3, "Count of locks inherited", "c_lkinh(/s)"),
+    NE(PERFC_LT_CTXNOP_LOCK_HOLD, 3, "Latency of lock set hold", "l_lkhold"),
+    NE(PERFC_DI_CTXNOP_LOCKS, 3, "Locks per lock set", "d_locks"),
 };
 
 NE_CHECK(ctxn_perfc_op, PERFC_EN_CTXNOP, "ctxn_perfc_op table/enum mismatch");
@@ -33,10 +36,36 @@ NE_CHECK(ctxn_perfc_op, PERFC_EN_CTXNOP, "ctxn_perfc_op table/enum mismatch");
 void
 ctxn_perfc_init(void)
 {
+    struct perfc_ivl *ivl;
+    u64               boundv[PERFC_IVL_MAX];
+    merr_t            err;
+    int               i;
+
     ctxn_perfc_op[PERFC_LT_CTXNOP_COMMIT].pcn_samplepct = 3;
+    ctxn_perfc_op[PERFC_LT_CTXNOP_LOCK_HOLD].pcn_samplepct = 3;
+
+    /* Lock set sizes are recorded in pow2 buckets.
+     */
+    for (i = 0; i < PERFC_IVL_MAX; i++)
+        boundv[i] = 1ul << i;
+
+    err = perfc_ivl_create(PERFC_IVL_MAX, boundv, &ivl);
+    if (ev(err))
+        return;
+
+    ctxn_perfc_op[PERFC_DI_CTXNOP_LOCKS].pcn_ivl = ivl;
 }
 
 void
 ctxn_perfc_fini(void)
 {
+    const struct perfc_ivl *ivl;
+
+    ivl = ctxn_perfc_op[PERFC_DI_CTXNOP_LOCKS].pcn_ivl;
+    if (!ivl)
+        return;
+
+    ctxn_perfc_op[PERFC_DI_CTXNOP_LOCKS].pcn_ivl = 0;
+
+    perfc_ivl_destroy(ivl);
 }
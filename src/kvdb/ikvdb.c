@@ -21,6 +21,14 @@
 #include <hse_ikvdb/c0skm_perfc.h>
 #include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/cn_kvdb.h>
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cn_reclaim.h>
+#include <hse_ikvdb/cn_scrub.h>
+#include <hse_ikvdb/cn_reap.h>
+#include <hse_ikvdb/cn_bulk.h>
+#include <hse_ikvdb/cn_attach.h>
+#include <hse_ikvdb/cn_snap.h>
+#include <hse_ikvdb/io_sched.h>
 #include <hse_ikvdb/cn_perfc.h>
 #include <hse_ikvdb/ctxn_perfc.h>
 #include <hse_ikvdb/kvdb_perfc.h>
@@ -35,12 +43,14 @@
 #include <hse_ikvdb/throttle_perfc.h>
 #include <hse_ikvdb/rparam_debug_flags.h>
 #include <hse_ikvdb/hse_params_internal.h>
+#include <hse_ikvdb/kvs_trace.h>
 #include "kvdb_omf.h"
 
 #include "kvdb_log.h"
 #include "kvdb_kvs.h"
 #include "active_ctxn_set.h"
 #include "kvdb_keylock.h"
+#include "kvdb_memgov.h"
 #include "sos_log.h"
 
 #include <mpool/mpool.h>
@@ -48,15 +58,20 @@
 #include <hse_util/platform.h>
 #include <hse_util/event_counter.h>
 #include <hse_util/string.h>
+#include <hse_util/keycmp.h>
 #include <hse_util/seqno.h>
 #include <hse_util/darray.h>
 #include <hse_util/rest_api.h>
 #include <hse_util/log2.h>
 #include <hse_util/atomic.h>
+#include <hse_util/compression.h>
+#include <hse_util/lathist.h>
 
 #include <3rdparty/xxhash.h>
 #include <3rdparty/cJSON.h>
 
+#include <signal.h>
+
 #include "kvdb_rest.h"
 #include "kvdb_params.h"
 
@@ -65,6 +80,7 @@ struct perfc_set kvdb_pc __read_mostly;
 
 struct perfc_set kvdb_metrics_pc __read_mostly;
 struct perfc_set c0_metrics_pc __read_mostly;
+struct perfc_set kvdb_memacct_pc __read_mostly;
 
 BUILD_BUG_ON_MSG(
     (sizeof(uintptr_t) != sizeof(u64)),
@@ -79,6 +95,10 @@ struct ikvdb {
  */
 #define KVDB_CTXN_BKT_MAX (61)
 
+/* Max tokens a cpu takes at once from the put rate share of a kvs.
+ */
+#define KVDB_KVS_THR_BATCH (64ul << 10)
+
 /* Simple fixed-size stack for caching ctxn objects.
  */
 struct kvdb_ctxn_bkt {
@@ -101,14 +121,22 @@ struct kvdb_ctxn_bkt {
  * @ikdb_log:           KVDB log handle
  * @ikdb_cndb:          CNDB handle
  * @ikdb_workqueue:
+ * @ikdb_async_wq:      workqueue servicing async gets and puts
  * @ikdb_maint_work:
+ * @ikdb_memgov:        memory governor (NULL if neither mem_budget nor mem_adapt)
+ * @ikdb_mem_scale:     percent of the memory limits last applied by the governor
+ * @ikdb_slo_snapv:     get latency snapshots of the latency objective (see
+ *                      ikvdb_slo_update()), NULL until first needed
+ * @ikdb_stream_gen:    last generation of the chunk keys of a kvs stream
  * @ikdb_curcnt:        number of active cursors
  * @ikdb_curcnt_max:    maximum number of active cursors
+ * @ikdb_curcnt_max0:   maximum number of active cursors without memory pressure
  * @ikdb_seqno:         current sequence number for the struct ikvdb
  * @ikdb_seqno_cur:     oldest seqno of cursors
  * @ikdb_c1:            Opaque structure for c1
  * @ikdb_c1_callback    c1 specific c0sk event handlers
  * @ikdb_profile:       hse params stored as profile
+ * @ikdb_txn_lathv:     txn latency histograms, NULL if not recorded
  * @ikdb_rp:            KVDB run time params
  * @ikdb_ctxn_cache:    ctxn cache
  * @ikdb_lock:          protects ikdb_kvs_vec/ikdb_kvs_cnt writes
@@ -118,6 +146,9 @@ struct kvdb_ctxn_bkt {
  * @ikdb_cndb_oid2:
  * @ikdb_c1_oid1:       First OID of c1 MDC
  * @ikdb_c1_oid2:       Second OID of c1 MDC
+ * @ikdb_phasev:        open and close phases (see ikvdb_phase_get()), protected
+ *                      by ikdb_lock once the kvdb is open
+ * @ikdb_c1_replayc:    number of keys replayed from c1
  * @ikdb_mpname:        KVDB mpool name
  *
  * Note:  The first group of fields are read-mostly and some of them are
@@ -151,13 +182,16 @@ struct ikvdb_impl {
     struct kvdb_log *        ikdb_log;
     struct cndb *            ikdb_cndb;
     struct workqueue_struct *ikdb_workqueue;
+    struct workqueue_struct *ikdb_async_wq;
     struct active_ctxn_set * ikdb_active_txn_set;
     struct c1 *              ikdb_c1;
     struct kvdb_callback     ikdb_c1_callback;
     struct hse_params *      ikdb_profile;
+    struct lathist *         ikdb_txn_lathv[IKVDB_TXN_LAT_MAX];
 
     __aligned(SMP_CACHE_BYTES) atomic_t ikdb_curcnt;
     u32 ikdb_curcnt_max;
+    u32 ikdb_curcnt_max0;
 
     __aligned(SMP_CACHE_BYTES) atomic64_t ikdb_seqno;
     atomic64_t ikdb_seqno_cur;
@@ -173,6 +207,11 @@ struct ikvdb_impl {
     struct kvdb_kvs *  ikdb_kvs_vec[HSE_KVS_COUNT_MAX];
     struct work_struct ikdb_maint_work;
     struct work_struct ikdb_throttle_work;
+    struct kvdb_memgov *ikdb_memgov;
+    uint                ikdb_mem_scale;
+    struct lathist_snap *ikdb_slo_snapv;
+    struct io_sched *   ikdb_ios;
+    atomic64_t          ikdb_stream_gen;
 
     struct {
         u64        mem_max;
@@ -183,9 +222,18 @@ struct ikvdb_impl {
     u64  ikdb_cndb_oid2;
     u64  ikdb_c1_oid1;
     u64  ikdb_c1_oid2;
+
+    struct ikvdb_phase_stats ikdb_phasev[IKVDB_PH_MAX];
+    atomic64_t               ikdb_c1_replayc;
+
     char ikdb_mpname[MPOOL_NAMESZ_MAX];
 };
 
+/* Phases of the last kvdb closed by this process, see ikvdb_phase_get().
+ */
+static DEFINE_MUTEX(ikvdb_phase_lock);
+static struct ikvdb_phase_stats ikvdb_phasev_last[IKVDB_PH_MAX];
+
 static merr_t
 ikvdb_flush_int(struct ikvdb_impl *self)
 {
@@ -527,6 +575,8 @@ ikvdb_c1_replay_put(
     kk = (struct kvdb_kvs *)kvs;
     assert(kk);
 
+    atomic64_inc(&ikvdb_h2r(ikdb)->ikdb_c1_replayc);
+
     return ikvs_put(kk->kk_ikvs, os, kt, vt, HSE_ORDNL_TO_SQNREF(seqno));
 }
 
@@ -564,6 +614,8 @@ ikvdb_c1_replay_del(
     kk = (struct kvdb_kvs *)kvs;
     assert(kk);
 
+    atomic64_inc(&ikvdb_h2r(ikdb)->ikdb_c1_replayc);
+
     tombval = *(u64 *)vt->vt_data;
     if (tombval == (u64)HSE_CORE_TOMB_REG)
         return ikvs_del(kk->kk_ikvs, os, kt, HSE_ORDNL_TO_SQNREF(seqno));
@@ -573,6 +625,36 @@ ikvdb_c1_replay_del(
     return ikvs_prefix_del(kk->kk_ikvs, os, kt, HSE_ORDNL_TO_SQNREF(seqno));
 }
 
+static void
+ikvdb_lathist_free(struct lathist **lathv, uint lathc)
+{
+    uint i;
+
+    for (i = 0; i < lathc; ++i) {
+        lathist_destroy(lathv[i]);
+        lathv[i] = NULL;
+    }
+}
+
+/* Latency histograms are best effort: on failure none are recorded.
+ */
+static merr_t
+ikvdb_lathist_alloc(struct lathist **lathv, uint lathc)
+{
+    merr_t err;
+    uint   i;
+
+    for (i = 0; i < lathc; ++i) {
+        err = lathist_create(lathv + i);
+        if (ev(err)) {
+            ikvdb_lathist_free(lathv, i);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
 void
 ikvdb_perfc_alloc(struct ikvdb_impl *self)
 {
@@ -588,11 +670,15 @@ ikvdb_perfc_alloc(struct ikvdb_impl *self)
     if (perfc_ctrseti_alloc(
             COMPNAME, dbname_buf, ctxn_perfc_op, PERFC_EN_CTXNOP, "set", &self->ikdb_ctxn_op))
         hse_log(HSE_ERR "cannot alloc ctxn op perf counters");
+
+    if (self->ikdb_rp.lat_hist && ikvdb_lathist_alloc(self->ikdb_txn_lathv, IKVDB_TXN_LAT_MAX))
+        hse_log(HSE_ERR "cannot alloc txn latency histograms");
 }
 
 static void
 ikvdb_perfc_free(struct ikvdb_impl *self)
 {
+    ikvdb_lathist_free(self->ikdb_txn_lathv, IKVDB_TXN_LAT_MAX);
     perfc_ctrseti_free(&self->ikdb_ctxn_op);
 }
 
@@ -685,6 +771,60 @@ out:
 static void
 ikvdb_sos_sched(struct ikvdb_impl *self);
 
+/* Set by the flight_signal handler, cleared by the first sos worker
+ * that writes the flight recorder to its sos log.
+ */
+static volatile sig_atomic_t ikvdb_flight_dump;
+
+static void
+ikvdb_flight_handler(int sig)
+{
+    ikvdb_flight_dump = 1;
+}
+
+static void
+ikvdb_flight_signal(struct ikvdb_impl *self)
+{
+    struct sigaction sa;
+    merr_t           err;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ikvdb_flight_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(self->ikdb_rp.flight_signal, &sa, NULL)) {
+        err = merr(errno);
+        hse_elog(HSE_WARNING "%s: cannot catch signal %lu: @@e",
+                 err, self->ikdb_mpname, self->ikdb_rp.flight_signal);
+    }
+}
+
+static void
+ikvdb_sos_flight(struct ikvdb_impl *self)
+{
+    struct kvs_trace *tracev;
+    char              buf[1024];
+    uint              tracec, i;
+    size_t            len;
+
+    tracev = malloc(KVS_FLIGHT_DUMP_MAX * sizeof(*tracev));
+    if (ev(!tracev))
+        return;
+
+    tracec = kvs_flight_read(tracev, KVS_FLIGHT_DUMP_MAX);
+
+    len = snprintf(buf, sizeof(buf), tracec ? "flight:\n" : "flight: []\n");
+    sos_log_write(self->ikdb_sos, buf, len);
+
+    for (i = 0; i < tracec; ++i) {
+        len = kvs_trace_fmt(tracev + i, buf, sizeof(buf));
+        sos_log_write(self->ikdb_sos, buf, len);
+    }
+
+    free(tracev);
+}
+
 static void
 ikvdb_sos_worker(struct work_struct *work)
 {
@@ -701,7 +841,7 @@ ikvdb_sos_worker(struct work_struct *work)
 
     self = container_of(work, struct ikvdb_impl, ikdb_sos_dwork.work);
 
-    if (!self->ikdb_rp.sos_log)
+    if (!self->ikdb_rp.sos_log && !ikvdb_flight_dump)
         goto resched;
 
     /* Open SOS log.  It might be the first open.  If log is already open
@@ -750,6 +890,11 @@ ikvdb_sos_worker(struct work_struct *work)
 
     sos_log_write(self->ikdb_sos, yc.yaml_buf, yc.yaml_offset);
 
+    if (ikvdb_flight_dump) {
+        ikvdb_flight_dump = 0;
+        ikvdb_sos_flight(self);
+    }
+
 resched:
     ikvdb_sos_sched(self);
 }
@@ -774,6 +919,76 @@ ikvdb_sos_sched(struct ikvdb_impl *self)
     assert(succ);
 }
 
+/* Share the put rate of the throttle among the open kvses by weight.  Each
+ * kvs is entitled to its weighted share, and the share that a kvs leaves
+ * unused (it puts less than half of it) goes to the kvses that want more,
+ * again by weight.  A quiet kvs thus keeps its share at hand, while a noisy
+ * one gets the slack but never the share of the others.
+ */
+static void
+ikvdb_throttle_share(struct ikvdb_impl *self, u64 dt)
+{
+    struct kvdb_kvs *kvsv[HSE_KVS_COUNT_MAX];
+    u64              needv[HSE_KVS_COUNT_MAX];
+    u64              rate, share, wsum = 0, whungry = 0, unused = 0;
+    uint             i, n = 0;
+
+    rate = throttle_rate(&self->ikdb_throttle);
+
+    mutex_lock(&self->ikdb_lock);
+    for (i = 0; i < self->ikdb_kvs_cnt; i++) {
+        struct kvdb_kvs *kk = self->ikdb_kvs_vec[i];
+        u64              bytes;
+
+        if (!kk || !kk->kk_ikvs)
+            continue;
+
+        bytes = atomic64_read(&kk->kk_thr_bytes);
+        atomic64_sub(bytes, &kk->kk_thr_bytes);
+
+        /* Twice the demand leaves a paced kvs room to grow. */
+        needv[n] = dt ? 2 * bytes * NSEC_PER_SEC / dt : 0;
+        kvsv[n++] = kk;
+        wsum += kk->kk_thr_weight;
+    }
+
+    if (!rate || !n)
+        goto out;
+
+    for (i = 0; i < n; i++) {
+        share = rate * kvsv[i]->kk_thr_weight / wsum;
+
+        if (needv[i] < share)
+            unused += share - needv[i];
+        else
+            whungry += kvsv[i]->kk_thr_weight;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct kvdb_kvs *kk = kvsv[i];
+
+        share = rate * kk->kk_thr_weight / wsum;
+        if (needv[i] >= share && whungry)
+            share += unused * kk->kk_thr_weight / whungry;
+
+        share = max_t(u64, share, 1);
+        tbkt_adjust(&kk->kk_thr_tb, throttle_rate_burst(share), share);
+    }
+
+out:
+    mutex_unlock(&self->ikdb_lock);
+}
+
+/* Called by a throttled writer in lieu of sleeping (see throttle_assist_set()).
+ */
+static bool
+ikvdb_throttle_assist(void *arg)
+{
+    struct ikvdb_impl *self = arg;
+
+    return csched_assist(self->ikdb_csched);
+}
+
 static void
 ikvdb_throttle_task(struct work_struct *work)
 {
@@ -789,6 +1004,7 @@ ikvdb_throttle_task(struct work_struct *work)
 
         if (tstart > (last_throttle_update + thr_update_ns)) {
             throttle_update(&self->ikdb_throttle);
+            ikvdb_throttle_share(self, tstart - last_throttle_update);
             last_throttle_update = tstart;
         }
 
@@ -798,10 +1014,129 @@ ikvdb_throttle_task(struct work_struct *work)
     }
 }
 
+/* Feed the memory governor the usage of c0 and of the kvs value caches,
+ * and apply the limits it hands back.  Caller must hold ikdb_lock.
+ */
+static void
+ikvdb_memgov_update(struct ikvdb_impl *self)
+{
+    struct kvdb_memgov_slot  slotv[KVDB_MEMGOV_SLOTS_MAX];
+    struct kvdb_memgov_stats stats;
+
+    size_t cachesz = 0;
+    u64    keys, c0sz, misses;
+    uint   i;
+
+    memset(slotv, 0, sizeof(slotv));
+
+    c0sk_usage(self->ikdb_c0sk, &keys, &c0sz);
+    slotv[0].mgs_active = true;
+    slotv[0].mgs_used = c0sz;
+
+    for (i = 0; i < self->ikdb_kvs_cnt; i++) {
+        struct kvdb_kvs *        kvs = self->ikdb_kvs_vec[i];
+        struct kvdb_memgov_slot *slot = slotv + i + 1;
+
+        if (kvs && kvs->kk_ikvs)
+            slot->mgs_active = ikvs_vcache_usage(
+                kvs->kk_ikvs, &slot->mgs_used, &slot->mgs_limit, &slot->mgs_hits, &misses);
+    }
+
+    kvdb_memgov_update(self->ikdb_memgov, slotv, self->ikdb_kvs_cnt + 1, &stats);
+
+    c0sk_mem_budget_set(self->ikdb_c0sk, slotv[0].mgs_limit);
+
+    /* Shrink the cursor limit and vblock readahead along with the memory
+     * limits, and log each transition.
+     */
+    self->ikdb_curcnt_max = max_t(u32, self->ikdb_curcnt_max0 / 100 * stats.mgt_scale, 1);
+    atomic_set(&self->ikdb_cn_kvdb->cnd_ra_pct, stats.mgt_scale);
+
+    if (stats.mgt_scale != self->ikdb_mem_scale) {
+        if (stats.mgt_scale < self->ikdb_mem_scale)
+            hse_log(
+                HSE_WARNING "%s: memory pressure %u.%02u%%, limits shrunk to %u%%",
+                __func__,
+                stats.mgt_psi / 100,
+                stats.mgt_psi % 100,
+                stats.mgt_scale);
+        else if (stats.mgt_scale == 100)
+            hse_log(HSE_NOTICE "%s: memory pressure subsided, limits restored", __func__);
+
+        self->ikdb_mem_scale = stats.mgt_scale;
+    }
+
+    for (i = 0; i < self->ikdb_kvs_cnt; i++) {
+        struct kvdb_kvs *        kvs = self->ikdb_kvs_vec[i];
+        struct kvdb_memgov_slot *slot = slotv + i + 1;
+
+        if (!kvs || !kvs->kk_ikvs)
+            continue;
+
+        if (slot->mgs_active) {
+            ikvs_vcache_resize(kvs->kk_ikvs, slot->mgs_limit);
+            cachesz += slot->mgs_used;
+        }
+
+        /* Cached cursors pin c0 and cn memory that no slot accounts for.
+         */
+        if (stats.mgt_pressure)
+            ikvs_cursor_cache_purge(kvs->kk_ikvs);
+    }
+
+    perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_MEMBUDGET, stats.mgt_budget >> 20);
+    perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_MEMC0, c0sz >> 20);
+    perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_MEMCACHE, cachesz >> 20);
+    perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_MEMPSI, stats.mgt_psi);
+}
+
+#define IKVDB_SLO_GETS_MIN (100)
+
+/* Report the get latency at the csched_slo_pct percentile since the last
+ * report to csched, which paces compaction to keep it below csched_slo_us.
+ * Caller must hold ikdb_lock.
+ */
+static void
+ikvdb_slo_update(struct ikvdb_impl *self)
+{
+    struct lathist_snap *prev, *cur;
+    u64                  lat = 0;
+    uint                 i;
+
+    if (!self->ikdb_slo_snapv) {
+        self->ikdb_slo_snapv = calloc(2, sizeof(*self->ikdb_slo_snapv));
+        if (ev(!self->ikdb_slo_snapv))
+            return;
+    }
+
+    prev = self->ikdb_slo_snapv;
+    cur = prev + 1;
+
+    memset(cur, 0, sizeof(*cur));
+    for (i = 0; i < self->ikdb_kvs_cnt; i++) {
+        struct kvdb_kvs *kk = self->ikdb_kvs_vec[i];
+
+        if (kk && kk->kk_ikvs && kk->kk_lathv[KVDB_KVS_LAT_GET])
+            lathist_snap(kk->kk_lathv[KVDB_KVS_LAT_GET], cur);
+    }
+
+    lathist_snap_diff(prev, cur, prev);
+
+    /* A percentile of too few gets says nothing. */
+    if (prev->lss_count >= IKVDB_SLO_GETS_MIN)
+        lat = lathist_snap_pct(prev, self->ikdb_rp.csched_slo_pct / 100.0);
+
+    memcpy(prev, cur, sizeof(*prev));
+
+    csched_notify_latency(self->ikdb_csched, lat);
+}
+
 static void
 ikvdb_maint_task(struct work_struct *work)
 {
     struct ikvdb_impl *self;
+    u64                last_memgov_update = 0;
+    u64                last_slo_update = 0;
     uint               i;
 
     self = container_of(work, struct ikvdb_impl, ikdb_maint_work);
@@ -820,8 +1155,20 @@ ikvdb_maint_task(struct work_struct *work)
             if (kvs && kvs->kk_ikvs)
                 ikvs_maint_task(kvs->kk_ikvs, tstart);
         }
+
+        if (self->ikdb_memgov && tstart > last_memgov_update + NSEC_PER_SEC) {
+            ikvdb_memgov_update(self);
+            last_memgov_update = tstart;
+        }
+
+        if (self->ikdb_rp.csched_slo_us && tstart > last_slo_update + NSEC_PER_SEC) {
+            ikvdb_slo_update(self);
+            last_slo_update = tstart;
+        }
         mutex_unlock(&self->ikdb_lock);
 
+        kvdb_memacct_update();
+
         /* Try to maintain slightly more than a 100ms period.
          */
         tstart = (get_time_ns() - tstart) / (1024 * 1024);
@@ -848,6 +1195,9 @@ ikvdb_init_throttle_params(struct ikvdb_impl *self)
 
     c0skm_dsize_throttle_sensor(
         self->ikdb_c0sk, throttle_sensor(&self->ikdb_throttle, THROTTLE_SENSOR_C0SKM_DSIZE));
+
+    if (self->ikdb_c1)
+        c1_throttle_sensor(self->ikdb_c1, throttle_sensor(&self->ikdb_throttle, THROTTLE_SENSOR_C1));
 }
 
 static void
@@ -1110,6 +1460,8 @@ ikvdb_maint_start(struct ikvdb_impl *self)
         return err;
     }
 
+    workqueue_set_cpus(self->ikdb_workqueue, self->ikdb_rp.maint_cpus);
+
     INIT_WORK(&self->ikdb_maint_work, ikvdb_maint_task);
     if (!queue_work(self->ikdb_workqueue, &self->ikdb_maint_work)) {
         err = merr(EBUG);
@@ -1148,6 +1500,7 @@ kvdb_kvs_destroy(struct kvdb_kvs *kvs)
 {
     if (kvs) {
         assert(atomic_read(&kvs->kk_refcnt) == 0);
+        ikvdb_lathist_free(kvs->kk_lathv, KVDB_KVS_LAT_MAX);
         mutex_destroy(&kvs->kk_cursors_lock);
         memset(kvs, -1, sizeof(*kvs));
         free_aligned(kvs);
@@ -1227,11 +1580,13 @@ ikvdb_low_mem_adjust(struct ikvdb_impl *self)
 
     /* The default parameter values in this function enables us to run
      * in a memory constrained cgroup. Scale the parameter values based
-     * on the available memory. This function is called only when the
-     * total RAM is <= 32G. Based on some experiments, the scale factor
-     * is set to 8G.
+     * on the available memory, or on the memory budget if one is set.
+     * This function is called only when either is <= 32G. Based on some
+     * experiments, the scale factor is set to 8G.
      */
     hse_meminfo(NULL, &mavail, 30);
+    if (rp->mem_budget)
+        mavail = rp->mem_budget >> 10;
     scale = mavail / 8;
     scale = max_t(uint, 1, scale);
 
@@ -1268,7 +1623,8 @@ ikvdb_low_mem_adjust(struct ikvdb_impl *self)
     if (rp->txn_ingest_delay == dflt.txn_ingest_delay)
         rp->txn_ingest_delay = 0;
 
-    c0kvs_reinit(rp->c0_heap_cache_sz_max);
+    c0kvs_reinit(
+        rp->c0_heap_cache_sz_max, rp->c0_index, rp->c0_hugepage, rp->c0_prefault, rp->c0_numa);
 }
 
 void
@@ -1279,6 +1635,121 @@ ikvdb_aio_params_set(struct ikvdb *handle, struct kvdb_rparams *rp)
     ikvdb_aio_mem_max_set(handle, CN_AIO_REQ_MAINT, rp->c0_throttle_async_default << 20);
 }
 
+static const struct {
+    const char *name;
+    const char *unit;
+} ikvdb_phase_namev[] = {
+    [IKVDB_PH_MPOOL_OPEN] = { "mpool_open", NULL },
+    [IKVDB_PH_KVDB_LOG] = { "kvdb_log", NULL },
+    [IKVDB_PH_CNDB_REPLAY] = { "cndb_replay", "records" },
+    [IKVDB_PH_C0SK_OPEN] = { "c0sk_open", NULL },
+    [IKVDB_PH_C1_REPLAY] = { "c1_replay", "keys" },
+    [IKVDB_PH_OPEN] = { "open", "kvses" },
+    [IKVDB_PH_CN_INSTANTIATE] = { "cn_instantiate", "kvsets" },
+    [IKVDB_PH_KVSET_CREATE] = { "kvset_create", "mblocks" },
+    [IKVDB_PH_KVS_OPEN] = { "kvs_open", "kvses" },
+    [IKVDB_PH_C0_FLUSH] = { "c0_flush", NULL },
+    [IKVDB_PH_KVS_CLOSE] = { "kvs_close", "kvses" },
+    [IKVDB_PH_CNDB_CLOSE] = { "cndb_close", NULL },
+    [IKVDB_PH_C1_CLOSE] = { "c1_close", NULL },
+    [IKVDB_PH_CLOSE] = { "close", NULL },
+};
+
+_Static_assert(NELEM(ikvdb_phase_namev) == IKVDB_PH_MAX, "ikvdb_phase_namev out of sync");
+
+const char *
+ikvdb_phase2str(enum ikvdb_phase ph, const char **unit)
+{
+    if (ph >= IKVDB_PH_MAX) {
+        *unit = NULL;
+        return "invalid";
+    }
+
+    *unit = ikvdb_phase_namev[ph].unit;
+
+    return ikvdb_phase_namev[ph].name;
+}
+
+static void
+ikvdb_phase_add(struct ikvdb_impl *self, enum ikvdb_phase ph, u64 ns, u64 count)
+{
+    self->ikdb_phasev[ph].ips_ns += ns;
+    self->ikdb_phasev[ph].ips_count += count;
+}
+
+/* Account the cndb and kvset work of a kvs open, see cn_open().
+ */
+static void
+ikvdb_phase_add_cn(struct ikvdb_impl *self, struct cn *cn)
+{
+    struct cn_open_stats cos = { 0 };
+
+    cn_open_stats_get(cn, &cos);
+
+    ikvdb_phase_add(self, IKVDB_PH_CN_INSTANTIATE, cos.cos_instantiate_ns, cos.cos_kvsets);
+    ikvdb_phase_add(self, IKVDB_PH_KVSET_CREATE, cos.cos_kvset_ns, cos.cos_mblocks);
+}
+
+/* Log phases 0 through @last, in microseconds.
+ */
+static void
+ikvdb_phase_log(struct ikvdb_impl *self, const char *type, enum ikvdb_phase last)
+{
+    struct slog *logger;
+    const char * name, *unit;
+    char         key[64];
+    int          i;
+
+    hse_slog_create(HSE_NOTICE, &logger, type);
+    hse_slog_append(logger, HSE_SLOG_FIELD("kvdb", "%s", self->ikdb_mpname));
+
+    for (i = 0; i <= last; i++) {
+        const struct ikvdb_phase_stats *ph = self->ikdb_phasev + i;
+
+        name = ikvdb_phase2str(i, &unit);
+
+        snprintf(key, sizeof(key), "%s_us", name);
+        hse_slog_append(logger, HSE_SLOG_FIELD(key, "%lu", ph->ips_ns / 1000));
+
+        if (unit) {
+            snprintf(key, sizeof(key), "%s_%s", name, unit);
+            hse_slog_append(logger, HSE_SLOG_FIELD(key, "%lu", ph->ips_count));
+        }
+    }
+
+    hse_slog_commit(logger);
+}
+
+void
+ikvdb_open_report(struct ikvdb *handle, u64 mpool_ns)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+
+    mutex_lock(&self->ikdb_lock);
+    ikvdb_phase_add(self, IKVDB_PH_MPOOL_OPEN, mpool_ns, 0);
+    ikvdb_phase_log(self, "kvdb_open", IKVDB_PH_OPEN);
+    mutex_unlock(&self->ikdb_lock);
+}
+
+void
+ikvdb_phase_get(struct ikvdb *handle, struct ikvdb_phase_stats *phv)
+{
+    struct ikvdb_impl *self;
+
+    if (!handle) {
+        mutex_lock(&ikvdb_phase_lock);
+        memcpy(phv, ikvdb_phasev_last, sizeof(ikvdb_phasev_last));
+        mutex_unlock(&ikvdb_phase_lock);
+        return;
+    }
+
+    self = ikvdb_h2r(handle);
+
+    mutex_lock(&self->ikdb_lock);
+    memcpy(phv, self->ikdb_phasev, sizeof(self->ikdb_phasev));
+    mutex_unlock(&self->ikdb_lock);
+}
+
 merr_t
 ikvdb_open(
     const char *       mp_name,
@@ -1295,6 +1766,10 @@ ikvdb_open(
     int                 i;
     u64                 ingestid;
     u64                 staging_absent;
+    u64                 tstart, tphase;
+    struct timespec     ts;
+
+    tstart = get_time_ns();
 
     self = alloc_aligned(sizeof(*self), __alignof(*self), GFP_KERNEL);
     if (ev(!self)) {
@@ -1332,6 +1807,8 @@ ikvdb_open(
     rp = self->ikdb_rp;
 
     hse_meminfo(NULL, &mavail, 30);
+    if (rp.mem_budget)
+        mavail = rp.mem_budget >> 10;
     if (rp.low_mem || mavail < 32)
         ikvdb_low_mem_adjust(self);
 
@@ -1356,6 +1833,7 @@ ikvdb_open(
      * cursors is limited to about 10% of system memory.
      */
     self->ikdb_curcnt_max = (((mavail << 30) * 10) / 100) >> 20;
+    self->ikdb_curcnt_max0 = self->ikdb_curcnt_max;
     atomic_set(&self->ikdb_curcnt, 0);
 
     err = active_ctxn_set_create(&self->ikdb_active_txn_set, &self->ikdb_seqno);
@@ -1370,6 +1848,8 @@ ikvdb_open(
         goto err1;
     }
 
+    tphase = get_time_ns();
+
     err = kvdb_log_open(ds, &self->ikdb_log, self->ikdb_rdonly ? O_RDONLY : O_RDWR);
     if (err) {
         hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
@@ -1387,15 +1867,27 @@ ikvdb_open(
         goto err1;
     }
 
+    ikvdb_phase_add(self, IKVDB_PH_KVDB_LOG, get_time_ns() - tphase, 0);
+    tphase = get_time_ns();
+
     err = ikvdb_cndb_open(self, &seqno, &ingestid);
     if (err) {
         hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
         goto err1;
     }
 
+    ikvdb_phase_add(
+        self, IKVDB_PH_CNDB_REPLAY, get_time_ns() - tphase, cndb_replay_recs(self->ikdb_cndb));
+
     atomic64_set(&self->ikdb_seqno, seqno);
     atomic64_set(&self->ikdb_seqno_cur, U64_MAX);
 
+    /* Stream generations are seeded from the wall clock so that they
+     * don't repeat those of chunk keys written before the kvdb was opened.
+     */
+    get_realtime(&ts);
+    atomic64_set(&self->ikdb_stream_gen, ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec);
+
     err = kvdb_ctxn_set_create(
         &self->ikdb_ctxn_set, self->ikdb_rp.txn_timeout, self->ikdb_rp.txn_wkth_delay);
     if (err) {
@@ -1409,6 +1901,64 @@ ikvdb_open(
         goto err1;
     }
 
+    self->ikdb_cn_kvdb->cnd_cpus = self->ikdb_rp.cn_cpus;
+
+    if (self->ikdb_rp.io_sched_qd && !self->ikdb_rdonly) {
+        err = io_sched_create(
+            self->ikdb_rp.io_sched_qd, self->ikdb_rp.io_sched_fg_us * 1000, &self->ikdb_ios);
+        if (err) {
+            hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
+            goto err1;
+        }
+
+        self->ikdb_cn_kvdb->cnd_ios = self->ikdb_ios;
+    }
+
+    /* Deferred deletes are an optimization, open without them on failure. */
+    if (self->ikdb_rp.cn_reclaim_mbps && !self->ikdb_rdonly) {
+        err = cn_reclaim_create(
+            self->ikdb_rp.cn_reclaim_mbps << 20, &self->ikdb_cn_kvdb->cnd_reclaim);
+        if (err)
+            hse_elog(HSE_WARNING "%s: deferred mblock deletes disabled: @@e", err, mp_name);
+    }
+
+    /* Scrubbing only reports corruption, open without it on failure. */
+    if (self->ikdb_rp.cn_scrub_mbps && !self->ikdb_rdonly) {
+        err = cn_scrub_create(
+            self->ikdb_rp.cn_scrub_mbps << 20,
+            self->ikdb_rp.cn_scrub_period * NSEC_PER_SEC,
+            &self->ikdb_health,
+            &self->ikdb_cn_kvdb->cnd_scrub);
+        if (err)
+            hse_elog(HSE_WARNING "%s: kvset scrubbing disabled: @@e", err, mp_name);
+    }
+
+    /* Resume reaping the kvses dropped before the kvdb was last closed. */
+    if (!self->ikdb_rdonly) {
+        err = cn_reap_create(
+            ds,
+            self->ikdb_cndb,
+            self->ikdb_rp.cn_drop_mbps << 20,
+            &self->ikdb_cn_kvdb->cnd_reap);
+        if (err) {
+            hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
+            goto err1;
+        }
+    }
+
+    /* The staging cache is an optimization, open without it on failure. */
+    if (self->ikdb_rp.cn_scache_mb && !self->ikdb_rdonly) {
+        err = cn_scache_create(
+            ds,
+            self->ikdb_cndb,
+            self->ikdb_rp.cn_scache_mb << 20,
+            &self->ikdb_cn_kvdb->cnd_scache);
+        if (err)
+            hse_elog(HSE_WARNING "%s: staging cache disabled: @@e", err, mp_name);
+    }
+
+    tphase = get_time_ns();
+
     err = c0sk_open(
         &self->ikdb_rp,
         ds,
@@ -1422,6 +1972,22 @@ ikvdb_open(
         goto err1;
     }
 
+    ikvdb_phase_add(self, IKVDB_PH_C0SK_OPEN, get_time_ns() - tphase, 0);
+
+    /* The memory governor runs from the maintenance task.  Without a
+     * budget it only adapts the memory limits to memory pressure.
+     */
+    self->ikdb_mem_scale = 100;
+
+    if ((self->ikdb_rp.mem_budget || self->ikdb_rp.mem_adapt) && !self->ikdb_rdonly) {
+        err = kvdb_memgov_create(
+            self->ikdb_rp.mem_budget << 20, self->ikdb_rp.mem_psi_pct, &self->ikdb_memgov);
+        if (err) {
+            hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
+            goto err1;
+        }
+    }
+
     *handle = &self->ikdb_handle;
 
     if (!self->ikdb_rdonly) {
@@ -1432,17 +1998,34 @@ ikvdb_open(
         }
     }
 
+    self->ikdb_async_wq = alloc_workqueue(
+        "kvdb_async", 0, clamp_t(uint, self->ikdb_rp.async_threads, 1, HSE_KVDB_ASYNC_THREADS_MAX));
+    if (!self->ikdb_async_wq) {
+        err = merr(ENOMEM);
+        hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
+        goto err1;
+    }
+
+    workqueue_set_cpus(self->ikdb_async_wq, self->ikdb_rp.maint_cpus);
+
     /* NOTE: c1 replay happens inside this call, which is before this
      * object (struct ikvdb_impl) is fully initialized.  Certain items
      * must be initialized before c1 replay, other items must be
      * initialized after.
      */
+    tphase = get_time_ns();
+
     err = ikvdb_c1_open(self, ds, ingestid);
     if (err) {
         hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
         goto err1;
     }
 
+    ikvdb_phase_add(
+        self, IKVDB_PH_C1_REPLAY, get_time_ns() - tphase, atomic64_read(&self->ikdb_c1_replayc));
+
+    c1_io_sched(self->ikdb_c1, self->ikdb_ios);
+
     err = c0skm_open(self->ikdb_c0sk, &self->ikdb_rp, self->ikdb_c1, mp_name);
     if (err) {
         hse_elog(HSE_ERR "cannot open %s: @@e", err, mp_name);
@@ -1465,9 +2048,13 @@ ikvdb_open(
         goto err1;
     }
 
-    if (!self->ikdb_rdonly)
+    if (!self->ikdb_rdonly) {
         ikvdb_sos_sched(self);
 
+        if (self->ikdb_rp.flight_signal)
+            ikvdb_flight_signal(self);
+    }
+
     /*
      * Install c1 related callbacks for c0sk to use
      */
@@ -1485,6 +2072,11 @@ ikvdb_open(
     throttle_init_params(&self->ikdb_throttle, &self->ikdb_rp);
     ikvdb_init_throttle_params(self);
 
+    if (self->ikdb_csched && self->ikdb_rp.throttle_assist_us)
+        throttle_assist_set(&self->ikdb_throttle, ikvdb_throttle_assist, self);
+
+    ikvdb_phase_add(self, IKVDB_PH_OPEN, get_time_ns() - tstart, self->ikdb_kvs_cnt);
+
     return 0;
 
 err1:
@@ -1493,6 +2085,7 @@ err1:
     c0sk_close(self->ikdb_c0sk);
     self->ikdb_work_stop = true;
     destroy_workqueue(self->ikdb_workqueue);
+    destroy_workqueue(self->ikdb_async_wq);
     cn_kvdb_destroy(self->ikdb_cn_kvdb);
     for (i = 0; i < self->ikdb_kvs_cnt; i++)
         kvdb_kvs_destroy(self->ikdb_kvs_vec[i]);
@@ -1503,6 +2096,9 @@ err1:
     active_ctxn_set_destroy(self->ikdb_active_txn_set);
     csched_destroy(self->ikdb_csched);
     throttle_fini(&self->ikdb_throttle);
+    kvdb_memgov_destroy(self->ikdb_memgov);
+    free(self->ikdb_slo_snapv);
+    io_sched_destroy(self->ikdb_ios);
 
 err2:
     ikvdb_txn_fini(self);
@@ -1551,16 +2147,34 @@ ikvdb_get_csched(struct ikvdb *handle)
     return handle ? ikvdb_h2r(handle)->ikdb_csched : 0;
 }
 
-bool
-ikvdb_get_cn_mblk_sync_writes(struct ikvdb *handle)
+struct kvdb_keylock *
+ikvdb_get_keylock(struct ikvdb *handle)
 {
-    return handle ? (bool)ikvdb_h2r(handle)->ikdb_rp.cn_mblk_sync_writes : 0;
+    return handle ? ikvdb_h2r(handle)->ikdb_keylock : 0;
 }
 
-static int
-get_kvs_index(struct kvdb_kvs **list, const char *kvs_name, int *avail)
+struct cn_kvdb *
+ikvdb_get_cn_kvdb(struct ikvdb *handle)
 {
-    int i, av = -1;
+    return handle ? ikvdb_h2r(handle)->ikdb_cn_kvdb : 0;
+}
+
+struct lathist **
+ikvdb_get_txn_lathist(struct ikvdb *handle)
+{
+    return handle ? ikvdb_h2r(handle)->ikdb_txn_lathv : 0;
+}
+
+bool
+ikvdb_get_cn_mblk_sync_writes(struct ikvdb *handle)
+{
+    return handle ? (bool)ikvdb_h2r(handle)->ikdb_rp.cn_mblk_sync_writes : 0;
+}
+
+static int
+get_kvs_index(struct kvdb_kvs **list, const char *kvs_name, int *avail)
+{
+    int i, av = -1;
 
     for (i = 0; i < HSE_KVS_COUNT_MAX; i++) {
         if (!list[i])
@@ -1750,10 +2364,15 @@ ikvdb_kvs_drop(struct ikvdb *handle, const char *kvs_name)
      */
     assert(atomic_read(&kvs->kk_refcnt) == 0);
 
+    /* The kvs is gone once the drop is recorded, its mblocks are
+     * deleted in the background.
+     */
     err = cndb_cn_drop(self->ikdb_cndb, kvs->kk_cnid);
     if (ev(err))
         goto err_out;
 
+    cn_reap_kick(self->ikdb_cn_kvdb->cnd_reap);
+
     drop_kvs_index(handle, idx);
 
 err_out:
@@ -1826,6 +2445,7 @@ ikvdb_kvs_open(
     int                idx;
     struct kvs_rparams rp, profile;
     merr_t             err;
+    u64                tstart;
 
     /* load profile */
     profile = hse_params_to_kvs_rparams(self->ikdb_profile, kvs_name, NULL);
@@ -1867,6 +2487,7 @@ ikvdb_kvs_open(
     /* Need a lock to prevent ikvdb_close from freeing up resources from
      * under us
      */
+    tstart = get_time_ns();
 
     err = kvs_open(
         handle,
@@ -1881,6 +2502,23 @@ ikvdb_kvs_open(
     if (ev(err))
         goto err_out;
 
+    ikvdb_phase_add(self, IKVDB_PH_KVS_OPEN, get_time_ns() - tstart, 1);
+    ikvdb_phase_add_cn(self, kvs_cn(kvs->kk_ikvs));
+
+    if ((self->ikdb_rp.lat_hist || self->ikdb_rp.csched_slo_us) &&
+        ikvdb_lathist_alloc(kvs->kk_lathv, KVDB_KVS_LAT_MAX))
+        hse_log(HSE_ERR "%s: cannot alloc latency histograms for kvs %s", __func__, kvs_name);
+
+    kvs->kk_thr_weight = clamp_t(u64, rp.throttle_weight, 1, 1000);
+    kvs->kk_thr_rate_min = rp.throttle_rate_min << 20;
+    atomic64_set(&kvs->kk_thr_bytes, 0);
+    tbkt_init(&kvs->kk_thr_tb, 0, 0);
+    tbkt_init(&kvs->kk_thr_floor, kvs->kk_thr_rate_min, kvs->kk_thr_rate_min);
+
+    /* Every put of the kvs requests tokens from its share. */
+    if (tbkt_pcpu_alloc(&kvs->kk_thr_tb, KVDB_KVS_THR_BATCH))
+        hse_log(HSE_ERR "%s: cannot alloc token batches for kvs %s", __func__, kvs_name);
+
     atomic_inc(&kvs->kk_refcnt);
 
     *kvs_out = (struct hse_kvs *)kvs;
@@ -1893,6 +2531,26 @@ err_out:
     return err;
 }
 
+/* Remove the secondary index of @kk, if any (see ikvdb_kvs_index_register()).
+ * Caller must hold ikdb_lock.
+ */
+static void
+ikvdb_kvs_index_unset(struct kvdb_kvs *kk)
+{
+    struct kvdb_kvs *ik = kk->kk_index;
+
+    if (!ik)
+        return;
+
+    kk->kk_index_fn = NULL;
+    kk->kk_index_arg = NULL;
+    kk->kk_index = NULL;
+
+    if (ik->kk_ikvs)
+        cn_cfilter_set(kvs_cn(ik->kk_ikvs), NULL, NULL);
+    ik->kk_index_of = NULL;
+}
+
 merr_t
 ikvdb_kvs_close(struct hse_kvs *handle)
 {
@@ -1908,8 +2566,17 @@ ikvdb_kvs_close(struct hse_kvs *handle)
         return merr(ev(EBADF));
     }
 
+    /* The compaction of an index looks up the kvs it indexes. */
+    if (kk->kk_index_of) {
+        mutex_unlock(&parent->ikdb_lock);
+        return merr(ev(EBUSY));
+    }
+
+    ikvdb_kvs_index_unset(kk);
+
     ikvs_tmp = kk->kk_ikvs;
     kk->kk_ikvs = 0;
+    kk->kk_merge_fn = NULL;
 
     mutex_unlock(&parent->ikdb_lock);
 
@@ -1920,6 +2587,9 @@ ikvdb_kvs_close(struct hse_kvs *handle)
     while (atomic_cmpxchg(&kk->kk_refcnt, 1, 0) > 1)
         __builtin_ia32_pause();
 
+    ikvdb_lathist_free(kk->kk_lathv, KVDB_KVS_LAT_MAX);
+    tbkt_pcpu_free(&kk->kk_thr_tb);
+
     err = kvs_close(ikvs_tmp);
 
     return err;
@@ -1997,6 +2667,14 @@ ikvdb_close(struct ikvdb *handle)
     unsigned int       i;
     merr_t             err;
     merr_t             ret = 0; /* store the first error encountered */
+    u64                tstart, tphase;
+    uint               kvsc = 0;
+
+    tstart = get_time_ns();
+
+    /* Wait for all queued async operations to complete.
+     */
+    destroy_workqueue(self->ikdb_async_wq);
 
     /* Shutdown workqueue
      */
@@ -2017,10 +2695,29 @@ ikvdb_close(struct ikvdb *handle)
 
     mutex_lock(&self->ikdb_lock);
 
-    for (i = 0; i < HSE_KVS_COUNT_MAX; i++) {
-        struct kvdb_kvs *kvs = self->ikdb_kvs_vec[i];
+    /* With dur_close_ckpt, c0 is left in c1 instead of being ingested
+     * into cn, and the next open replays it.  Fall back to a regular
+     * close if c1 cannot hold all of c0.
+     */
+    if (self->ikdb_rp.dur_close_ckpt && !self->ikdb_rdonly && self->ikdb_c1) {
+        tphase = get_time_ns();
 
-        if (!kvs)
+        err = c0sk_checkpoint(self->ikdb_c0sk);
+        if (err)
+            hse_elog(HSE_NOTICE "%s: %s: ingesting c0 at close: @@e", err, __func__, self->ikdb_mpname);
+
+        ikvdb_phase_add(self, IKVDB_PH_C0_FLUSH, get_time_ns() - tphase, 0);
+    }
+
+    tphase = get_time_ns();
+
+    /* Index kvses are closed first, their compactions look up the kvses
+     * they index (see ikvdb_kvs_index_cfilter()).
+     */
+    for (i = 0; i < 2 * HSE_KVS_COUNT_MAX; i++) {
+        struct kvdb_kvs *kvs = self->ikdb_kvs_vec[i % HSE_KVS_COUNT_MAX];
+
+        if (!kvs || (i < HSE_KVS_COUNT_MAX && !kvs->kk_index_of))
             continue;
 
         if (kvs->kk_ikvs)
@@ -2037,14 +2734,20 @@ ikvdb_close(struct ikvdb *handle)
             err = kvs_close(kvs->kk_ikvs);
             if (ev(err))
                 ret = ret ?: err;
+
+            kvsc++;
         }
 
-        self->ikdb_kvs_vec[i] = NULL;
+        self->ikdb_kvs_vec[i % HSE_KVS_COUNT_MAX] = NULL;
         kvdb_kvs_destroy(kvs);
     }
 
+    ikvdb_phase_add(self, IKVDB_PH_KVS_CLOSE, get_time_ns() - tphase, kvsc);
+    tphase = get_time_ns();
+
     /* c0sk can only be closed after all c0s. This ensures that there are
-     * no references to c0sk at this point.
+     * no references to c0sk at this point.  Closing c0sk ingests what is
+     * left in c0.
      */
     if (self->ikdb_c0sk) {
         err = c0sk_close(self->ikdb_c0sk);
@@ -2052,6 +2755,8 @@ ikvdb_close(struct ikvdb *handle)
             ret = ret ?: err;
     }
 
+    ikvdb_phase_add(self, IKVDB_PH_C0_FLUSH, get_time_ns() - tphase, 0);
+
     cn_kvdb_destroy(self->ikdb_cn_kvdb);
 
     err = kvdb_rparams_remove_from_dt(self->ikdb_mpname);
@@ -2063,6 +2768,8 @@ ikvdb_close(struct ikvdb *handle)
             __func__,
             self->ikdb_mpname);
 
+    tphase = get_time_ns();
+
     err = cndb_close(self->ikdb_cndb);
     if (ev(err))
         ret = ret ?: err;
@@ -2071,10 +2778,16 @@ ikvdb_close(struct ikvdb *handle)
     if (ev(err))
         ret = ret ?: err;
 
+    ikvdb_phase_add(self, IKVDB_PH_CNDB_CLOSE, get_time_ns() - tphase, 0);
+
     if (self->ikdb_c1) {
+        tphase = get_time_ns();
+
         err = c1_close(self->ikdb_c1);
         if (ev(err))
             ret = ret ?: err;
+
+        ikvdb_phase_add(self, IKVDB_PH_C1_CLOSE, get_time_ns() - tphase, 0);
     }
 
     mutex_unlock(&self->ikdb_lock);
@@ -2087,14 +2800,27 @@ ikvdb_close(struct ikvdb *handle)
 
     active_ctxn_set_destroy(self->ikdb_active_txn_set);
 
+    throttle_assist_set(&self->ikdb_throttle, NULL, NULL);
     csched_destroy(self->ikdb_csched);
 
     mutex_destroy(&self->ikdb_lock);
 
     throttle_fini(&self->ikdb_throttle);
 
+    kvdb_memgov_destroy(self->ikdb_memgov);
+    free(self->ikdb_slo_snapv);
+
+    io_sched_destroy(self->ikdb_ios);
+
     ikvdb_perfc_free(self);
 
+    ikvdb_phase_add(self, IKVDB_PH_CLOSE, get_time_ns() - tstart, 0);
+    ikvdb_phase_log(self, "kvdb_close", IKVDB_PH_MAX - 1);
+
+    mutex_lock(&ikvdb_phase_lock);
+    memcpy(ikvdb_phasev_last, self->ikdb_phasev, sizeof(ikvdb_phasev_last));
+    mutex_unlock(&ikvdb_phase_lock);
+
     free_aligned(self);
 
     return ret;
@@ -2103,22 +2829,91 @@ ikvdb_close(struct ikvdb *handle)
 /**
  * ikvdb_throttle() - sleep after a successful put
  * @p:
+ * @kk:    kvs of the put, NULL if the put spans kvses
  * @start: time in ns at which the put op began
  * @len:   total key + value length for the put
+ *
+ * The put of a kvs is paced at the share of the kvs (see
+ * ikvdb_throttle_share()), others at the rate of the kvdb.
  */
 static inline void
-ikvdb_throttle(struct ikvdb_impl *p, u64 start, u32 len)
+ikvdb_throttle(struct ikvdb_impl *p, struct kvdb_kvs *kk, u64 start, u32 len)
 {
     long delay __maybe_unused;
 
     if (!throttle_active(&p->ikdb_throttle))
         return;
 
-    delay = throttle(&p->ikdb_throttle, start, len);
+    if (kk) {
+        struct tbkt *floor = kk->kk_thr_rate_min ? &kk->kk_thr_floor : NULL;
+
+        atomic64_add(len, &kk->kk_thr_bytes);
+        delay = throttle_tenant(&p->ikdb_throttle, start, len, &kk->kk_thr_tb, floor);
+    } else {
+        delay = throttle(&p->ikdb_throttle, start, len);
+    }
+
     if (delay > 0)
         perfc_rec_sample(&kvdb_metrics_pc, PERFC_DI_KVDBMETRICS_THROTTLE, delay);
 }
 
+/* Put a key and its secondary index entry (see ikvdb_kvs_index_register())
+ * with one commit seqno, so that the compaction of the index never sees
+ * an entry before the put it was made from.
+ */
+static merr_t
+ikvdb_kvs_index_put(
+    struct kvdb_kvs *        kk,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *vt)
+{
+    struct hse_kvdb_opspec aos;
+    struct kvs_wbatch_op   opv[2];
+    struct hse_kvs *       kvsv[2];
+    char                   ikey[HSE_KVS_KLEN_MAX];
+    size_t                 ilen, imax;
+    uint                   opc = 1;
+    int                    rc;
+
+    if (ev(kt->kt_len > sizeof(ikey)))
+        return merr(EINVAL);
+
+    imax = sizeof(ikey) - kt->kt_len;
+
+    rc = kk->kk_index_fn(
+        kk->kk_index_arg, kt->kt_data, kt->kt_len, vt->vt_data, vt->vt_len, ikey, imax, &ilen);
+    if (!rc) {
+        if (ev(ilen > imax))
+            return merr(EINVAL);
+
+        memcpy(ikey + ilen, kt->kt_data, kt->kt_len);
+
+        kvs_ktuple_init_nohash(&opv[1].wbo_kt, ikey, ilen + kt->kt_len);
+        kvs_vtuple_init(&opv[1].wbo_vt, (void *)kt->kt_data, kt->kt_len);
+        opv[1].wbo_tomb = false;
+        kvsv[1] = (struct hse_kvs *)kk->kk_index;
+        opc++;
+    }
+
+    kvs_ktuple_init_nohash(&opv[0].wbo_kt, kt->kt_data, kt->kt_len);
+    kvs_vtuple_init(&opv[0].wbo_vt, vt->vt_data, vt->vt_len);
+    opv[0].wbo_tomb = false;
+    kvsv[0] = (struct hse_kvs *)kk;
+
+    if (!kvdb_kop_is_txn(os)) {
+        if (os)
+            aos = *os;
+        else
+            HSE_KVDB_OPSPEC_INIT(&aos);
+
+        aos.kop_flags |= HSE_KVDB_KOP_FLAG_ATOMIC;
+        os = &aos;
+    }
+
+    return ikvdb_kvs_write_batch(&kk->kk_parent->ikdb_handle, os, kvsv, opv, opc);
+}
+
 merr_t
 ikvdb_kvs_put(
     struct hse_kvs *         handle,
@@ -2128,15 +2923,19 @@ ikvdb_kvs_put(
 {
     struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
     struct ikvdb_impl *parent;
+    struct kvs_trace   trace;
     u64                put_seqno;
     merr_t             err;
-    u64                start;
+    u64                start, lstart, sstart;
+    bool               traced;
 
     start = kvdb_kop_is_priority(os) ? 0 : get_time_ns();
 
     if (ev(!handle))
         return merr(EINVAL);
 
+    lstart = lathist_start(kk->kk_lathv[KVDB_KVS_LAT_PUT]);
+
     parent = kk->kk_parent;
     if (ev(parent->ikdb_rdonly))
         return merr(EROFS);
@@ -2147,16 +2946,92 @@ ikvdb_kvs_put(
     if (ev(err))
         return err;
 
+    if (kk->kk_index_fn) {
+        err = ikvdb_kvs_index_put(kk, os, kt, vt);
+        if (err) {
+            ev(merr_errno(err) != ECANCELED);
+            return err;
+        }
+
+        lathist_record(kk->kk_lathv[KVDB_KVS_LAT_PUT], lstart);
+
+        return 0;
+    }
+
     put_seqno = kvdb_kop_is_txn(os) ? 0 : HSE_SQNREF_SINGLE;
 
+    /* The flight recorder sees the throttle sleep as a stage of the put.
+     */
+    traced = ikvs_trace_begin(kk->kk_ikvs, &trace, KVS_TRACE_OP_PUT);
+
     err = ikvs_put(kk->kk_ikvs, os, kt, vt, put_seqno);
+    if (!err && start > 0) {
+        sstart = kvs_trace_stage_start();
+        ikvdb_throttle(parent, kk, start, kt->kt_len + vt->vt_len);
+        kvs_trace_stage_end(KVS_TRACE_STAGE_THROTTLE, sstart);
+    }
+
+    if (traced) {
+        trace.kt_hash = kt->kt_hash;
+        ikvs_trace_end(kk->kk_ikvs, &trace);
+    }
+
     if (err) {
         ev(merr_errno(err) != ECANCELED);
         return err;
     }
 
-    if (start > 0)
-        ikvdb_throttle(parent, start, kt->kt_len + vt->vt_len);
+    lathist_record(kk->kk_lathv[KVDB_KVS_LAT_PUT], lstart);
+
+    return 0;
+}
+
+/* Oldest view seqno that a read may ask for by seqno, compaction keeps
+ * the horizon at or below it (see ikvdb_horizon()).
+ */
+static __always_inline u64
+ikvdb_seqno_floor(struct ikvdb_impl *self, u64 seqno)
+{
+    u64 retain = self->ikdb_rp.seqno_retain;
+
+    return seqno > retain ? seqno - retain : 0;
+}
+
+/* Check the view seqno of a read by seqno (HSE_KVDB_KOP_FLAG_SEQNO), which
+ * must lie within the retention window.
+ */
+static merr_t
+ikvdb_kop_seqno_check(struct ikvdb_impl *self, const struct hse_kvdb_opspec *os)
+{
+    u64 seqno = atomic64_read(&self->ikdb_seqno);
+
+    if (ev(kvdb_kop_is_txn(os) || os->kop_seqno > seqno))
+        return merr(EINVAL);
+
+    if (ev(os->kop_seqno < ikvdb_seqno_floor(self, seqno)))
+        return merr(ESTALE);
+
+    return 0;
+}
+
+/* Transactions read at their own view (passed down as 0), reads by seqno
+ * at kop_seqno, snapshots at the view taken by ikvdb_snapshot_acquire(),
+ * and everything else at the current seqno.
+ */
+static __always_inline merr_t
+ikvdb_kop_view_seqno(struct ikvdb_impl *self, const struct hse_kvdb_opspec *os, u64 *seqno)
+{
+    if (kvdb_kop_is_seqno(os)) {
+        *seqno = os->kop_seqno;
+        return ikvdb_kop_seqno_check(self, os);
+    }
+
+    if (kvdb_kop_is_txn(os))
+        *seqno = 0;
+    else if (os && os->kop_snap)
+        *seqno = active_ctxn_set_view(os->kop_snap);
+    else
+        *seqno = atomic64_read(&self->ikdb_seqno);
 
     return 0;
 }
@@ -2173,121 +3048,1375 @@ ikvdb_kvs_pfx_probe(
     struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
     struct ikvdb_impl *p;
     u64                view_seqno;
+    merr_t             err;
 
     if (ev(!handle))
         return merr(EINVAL);
 
     p = kk->kk_parent;
 
-    view_seqno = kvdb_kop_is_txn(os) ? 0 : atomic64_read(&p->ikdb_seqno);
+    err = ikvdb_kop_view_seqno(p, os, &view_seqno);
+    if (err)
+        return err;
 
     return ikvs_pfx_probe(kk->kk_ikvs, os, kt, view_seqno, res, kbuf, vbuf);
 }
 
 merr_t
-ikvdb_kvs_get(
+ikvdb_kvs_pfx_probe_batch(
     struct hse_kvs *        handle,
     struct hse_kvdb_opspec *os,
-    struct kvs_ktuple *     kt,
-    enum key_lookup_res *   res,
-    struct kvs_buf *        vbuf)
+    struct kvs_ktuple *     ktv,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        kbufv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt)
 {
     struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
     struct ikvdb_impl *p;
     u64                view_seqno;
+    merr_t             err;
 
     if (ev(!handle))
         return merr(EINVAL);
 
     p = kk->kk_parent;
 
-    view_seqno = kvdb_kop_is_txn(os) ? 0 : atomic64_read(&p->ikdb_seqno);
+    /* All prefixes in the batch are probed at the same view.
+     */
+    err = ikvdb_kop_view_seqno(p, os, &view_seqno);
+    if (err)
+        return err;
 
-    return ikvs_get(kk->kk_ikvs, os, kt, view_seqno, res, vbuf);
+    return ikvs_pfx_probe_batch(kk->kk_ikvs, os, ktv, view_seqno, resv, kbufv, vbufv, cnt);
 }
 
 merr_t
-ikvdb_kvs_del(struct hse_kvs *handle, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt)
+ikvdb_kvs_get(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    enum key_lookup_res *   res,
+    struct kvs_buf *        vbuf)
 {
     struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
-    struct ikvdb_impl *parent;
-    u64                del_seqno;
+    struct ikvdb_impl *p;
+    u64                view_seqno, lstart;
     merr_t             err;
 
     if (ev(!handle))
         return merr(EINVAL);
 
-    parent = kk->kk_parent;
-    if (ev(parent->ikdb_rdonly))
-        return merr(EROFS);
+    lstart = lathist_start(kk->kk_lathv[KVDB_KVS_LAT_GET]);
 
-    /* tombstone puts do not stop on block deletion failures. */
-    err = kvdb_health_check(
-        &parent->ikdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
-    if (ev(err))
+    p = kk->kk_parent;
+
+    err = ikvdb_kop_view_seqno(p, os, &view_seqno);
+    if (err)
         return err;
 
-    del_seqno = kvdb_kop_is_txn(os) ? 0 : HSE_SQNREF_SINGLE;
+    err = ikvs_get(kk->kk_ikvs, os, kt, view_seqno, res, vbuf);
 
-    err = ikvs_del(kk->kk_ikvs, os, kt, del_seqno);
-    if (ev(err))
+    lathist_record(kk->kk_lathv[KVDB_KVS_LAT_GET], lstart);
+
+    return err;
+}
+
+merr_t
+ikvdb_kvs_get_batch(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        vbufv,
+    unsigned int            cnt)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_impl *p;
+    u64                view_seqno;
+    merr_t             err;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    p = kk->kk_parent;
+
+    /* All keys in the batch are read at the same view.
+     */
+    err = ikvdb_kop_view_seqno(p, os, &view_seqno);
+    if (err)
         return err;
 
-    return 0;
+    return ikvs_get_batch(kk->kk_ikvs, os, ktv, view_seqno, resv, vbufv, cnt);
 }
 
 merr_t
-ikvdb_kvs_prefix_delete(
+ikvdb_kvs_get_lease(
     struct hse_kvs *        handle,
     struct hse_kvdb_opspec *os,
     struct kvs_ktuple *     kt,
-    size_t *                kvs_pfx_len)
+    enum key_lookup_res *   res,
+    struct kvs_vlease *     lease)
 {
     struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
-    struct ikvdb_impl *parent;
+    struct ikvdb_impl *p;
+    u64                view_seqno;
     merr_t             err;
-    u32                ct_pfx_len;
-    u64                pdel_seqno;
 
     if (ev(!handle))
         return merr(EINVAL);
 
-    parent = kk->kk_parent;
-    if (ev(parent->ikdb_rdonly))
-        return merr(EROFS);
+    p = kk->kk_parent;
 
-    ct_pfx_len = kk->kk_cparams->cp_pfx_len;
-    if (kvs_pfx_len)
-        *kvs_pfx_len = ct_pfx_len;
+    err = ikvdb_kop_view_seqno(p, os, &view_seqno);
+    if (err)
+        return err;
 
-    if (ev(!kt->kt_data || kt->kt_len != ct_pfx_len))
-        return merr(EINVAL);
-    if (ev(kt->kt_len == 0))
-        return merr(ENOENT);
+    return ikvs_get_lease(kk->kk_ikvs, os, kt, view_seqno, res, lease);
+}
 
-    pdel_seqno = kvdb_kop_is_txn(os) ? 0 : HSE_SQNREF_SINGLE;
+void
+ikvdb_kvs_lease_release(struct kvs_vlease *lease)
+{
+    ikvs_lease_release(lease);
+}
 
-    /* Prefix tombstone deletes all current keys with a matching prefix -
-     * those with a sequence number up to but excluding the current seqno.
-     * Insert prefix tombstone with a higher seqno. Use a higher sequence
-     * number to allow newer mutations (after prefix) to be distinguished.
+/**
+ * struct ikvdb_prefetch_work - a prefetch queued to ikdb_async_wq
+ * @ipw_work:   work struct
+ * @ipw_kk:     kvs to which the keys belong (holds a kk_refcnt ref)
+ * @ipw_seqno:  view seqno of the prefetch
+ * @ipw_cnt:    number of keys in @ipw_ktv
+ * @ipw_ktv:    keys, whose data follows the vector
+ */
+struct ikvdb_prefetch_work {
+    struct work_struct ipw_work;
+    struct kvdb_kvs *  ipw_kk;
+    u64                ipw_seqno;
+    u32                ipw_cnt;
+    struct kvs_ktuple  ipw_ktv[];
+};
+
+static void
+ikvdb_prefetch_worker(struct work_struct *work)
+{
+    struct ikvdb_prefetch_work *pw = container_of(work, struct ikvdb_prefetch_work, ipw_work);
+    struct kvdb_kvs *           kk = pw->ipw_kk;
+    struct ikvs *               ikvs = READ_ONCE(kk->kk_ikvs);
+
+    if (ikvs)
+        ikvs_prefetch(ikvs, pw->ipw_ktv, pw->ipw_seqno, pw->ipw_cnt);
+
+    atomic_dec(&kk->kk_refcnt);
+    free(pw);
+}
+
+merr_t
+ikvdb_kvs_prefetch(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    unsigned int            cnt)
+{
+    struct kvdb_kvs *           kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_prefetch_work *pw;
+    size_t                      sz;
+    char *                      kdata;
+    unsigned int                i;
+    u64                         seqno;
+    merr_t                      err;
+
+    if (ev(!handle || !ktv))
+        return merr(EINVAL);
+
+    /* A prefetch is only a hint, so a txn's private updates (which
+     * are in memory anyway) needn't be considered.
      */
-    err = ikvs_prefix_del(kk->kk_ikvs, os, kt, pdel_seqno);
-    if (ev(err))
+    err = ikvdb_kop_view_seqno(kk->kk_parent, kvdb_kop_is_txn(os) ? NULL : os, &seqno);
+    if (err)
         return err;
 
+    sz = sizeof(*pw) + cnt * sizeof(*ktv);
+    for (i = 0; i < cnt; ++i)
+        sz += ktv[i].kt_len;
+
+    pw = malloc(sz);
+    if (ev(!pw))
+        return merr(ENOMEM);
+
+    INIT_WORK(&pw->ipw_work, ikvdb_prefetch_worker);
+    pw->ipw_kk = kk;
+    pw->ipw_seqno = seqno;
+    pw->ipw_cnt = cnt;
+
+    kdata = (char *)(pw->ipw_ktv + cnt);
+
+    for (i = 0; i < cnt; ++i) {
+        memcpy(kdata, ktv[i].kt_data, ktv[i].kt_len);
+        kvs_ktuple_init_nohash(pw->ipw_ktv + i, kdata, ktv[i].kt_len);
+        kdata += ktv[i].kt_len;
+    }
+
+    /* ikvdb_kvs_close() clears kk_ikvs before it waits for kk_refcnt.
+     */
+    atomic_inc(&kk->kk_refcnt);
+    smp_mb();
+
+    if (ev(!kk->kk_ikvs)) {
+        atomic_dec(&kk->kk_refcnt);
+        free(pw);
+        return merr(EBADF);
+    }
+
+    if (ev(!queue_work(kk->kk_parent->ikdb_async_wq, &pw->ipw_work))) {
+        atomic_dec(&kk->kk_refcnt);
+        free(pw);
+        return merr(EBUG);
+    }
+
     return 0;
 }
 
-/*-  IKVDB Cursors --------------------------------------------------*/
+/**
+ * struct ikvdb_async_work - an async get or put queued to ikdb_async_wq
+ * @iaw_work:   work struct
+ * @iaw_kvs:    kvs to which the op applies
+ * @iaw_req:    caller's request
+ * @iaw_os:     private copy of the caller's opspec
+ * @iaw_osp:    &iaw_os if the caller supplied an opspec, otherwise NULL
+ * @iaw_put:    true if the op is a put
+ */
+struct ikvdb_async_work {
+    struct work_struct        iaw_work;
+    struct hse_kvs *          iaw_kvs;
+    struct hse_kvs_async_req *iaw_req;
+    struct hse_kvdb_opspec    iaw_os;
+    struct hse_kvdb_opspec *  iaw_osp;
+    bool                      iaw_put;
+};
 
-/*
- * IKVDB cursors allow iteration over a single KVS' c0, cN, and ctxn.
- * The normal life-cycle is create-iterate-destroy, where iterate has
- * several verbs: seek, read, bind, and update.  Cursors are single-threaded
- * and they are stateful.  These states are:
- *
- * 0 nil - cursor does not exist
+static void
+ikvdb_async_worker(struct work_struct *work)
+{
+    struct ikvdb_async_work * aw = container_of(work, struct ikvdb_async_work, iaw_work);
+    struct hse_kvs_async_req *req = aw->iaw_req;
+    struct kvs_ktuple         kt;
+    merr_t                    err;
+
+    kvs_ktuple_init_nohash(&kt, req->kar_key, req->kar_key_len);
+
+    if (aw->iaw_put) {
+        struct kvs_vtuple vt;
+
+        kvs_vtuple_init(&vt, req->kar_buf, req->kar_buf_len);
+
+        err = ikvdb_kvs_put(aw->iaw_kvs, aw->iaw_osp, &kt, &vt);
+    } else {
+        struct kvs_buf      vbuf;
+        enum key_lookup_res res;
+        void *              valbuf = req->kar_buf;
+
+        /* See hse_kvs_get() regarding a NULL valbuf of size zero.
+         */
+        if (!valbuf && req->kar_buf_len == 0)
+            valbuf = (void *)-1;
+
+        kvs_buf_init(&vbuf, valbuf, req->kar_buf_len);
+
+        err = ikvdb_kvs_get(aw->iaw_kvs, aw->iaw_osp, &kt, &res, &vbuf);
+        if (!err) {
+            req->kar_found = (res == FOUND_VAL);
+            req->kar_val_len = vbuf.b_len;
+
+            if (ev(res == FOUND_MULTIPLE))
+                err = merr(EPROTO);
+        }
+    }
+
+    req->kar_err = err;
+
+    /* The callback may free or reuse the request, so it must be
+     * the last access to it.
+     */
+    free(aw);
+    req->kar_cb(req);
+}
+
+merr_t
+ikvdb_kvs_async_submit(
+    struct hse_kvs *          handle,
+    struct hse_kvdb_opspec *  os,
+    struct hse_kvs_async_req *req,
+    bool                      put)
+{
+    struct kvdb_kvs *        kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_async_work *aw;
+
+    if (ev(!handle || !req || !req->kar_cb))
+        return merr(EINVAL);
+
+    /* A txn is bound to its caller's thread of control.
+     */
+    if (ev(kvdb_kop_is_txn(os)))
+        return merr(EINVAL);
+
+    aw = malloc(sizeof(*aw));
+    if (ev(!aw))
+        return merr(ENOMEM);
+
+    INIT_WORK(&aw->iaw_work, ikvdb_async_worker);
+    aw->iaw_kvs = handle;
+    aw->iaw_req = req;
+    aw->iaw_osp = NULL;
+    aw->iaw_put = put;
+
+    if (os) {
+        aw->iaw_os = *os;
+        aw->iaw_osp = &aw->iaw_os;
+    }
+
+    req->kar_found = false;
+    req->kar_val_len = 0;
+    req->kar_err = 0;
+
+    if (ev(!queue_work(kk->kk_parent->ikdb_async_wq, &aw->iaw_work))) {
+        free(aw);
+        return merr(EBUG);
+    }
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_del(struct hse_kvs *handle, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_impl *parent;
+    struct kvs_trace   trace;
+    u64                del_seqno, lstart;
+    merr_t             err;
+    bool               traced;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    lstart = lathist_start(kk->kk_lathv[KVDB_KVS_LAT_DEL]);
+
+    parent = kk->kk_parent;
+    if (ev(parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    /* tombstone puts do not stop on block deletion failures. */
+    err = kvdb_health_check(
+        &parent->ikdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
+    if (ev(err))
+        return err;
+
+    del_seqno = kvdb_kop_is_txn(os) ? 0 : HSE_SQNREF_SINGLE;
+
+    traced = ikvs_trace_begin(kk->kk_ikvs, &trace, KVS_TRACE_OP_DEL);
+
+    err = ikvs_del(kk->kk_ikvs, os, kt, del_seqno);
+
+    if (traced) {
+        trace.kt_hash = kt->kt_hash;
+        ikvs_trace_end(kk->kk_ikvs, &trace);
+    }
+
+    if (ev(err))
+        return err;
+
+    lathist_record(kk->kk_lathv[KVDB_KVS_LAT_DEL], lstart);
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_merge_register(struct hse_kvs *handle, kvs_merge_fn *fn)
+{
+    struct kvdb_kvs *kk = (struct kvdb_kvs *)handle;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    kk->kk_merge_fn = fn;
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_compact_filter_register(struct hse_kvs *handle, kvs_cfilter_fn *fn, void *arg)
+{
+    struct kvdb_kvs *kk = (struct kvdb_kvs *)handle;
+
+    if (ev(!handle || !kk->kk_ikvs))
+        return merr(EINVAL);
+
+    cn_cfilter_set(kvs_cn(kk->kk_ikvs), fn, arg);
+
+    return 0;
+}
+
+/* Size of the value buffer of ikvdb_kvs_index_cfilter() on its stack,
+ * larger values are read into a temporary allocation.
+ */
+#define IKVDB_INDEX_VBUF_SZ (1024)
+
+/* Compaction filter of a secondary index kvs (see ikvdb_kvs_index_put()),
+ * @arg is the indexed kvs.  An entry is dropped once the key it points to
+ * no longer has a value with the entry's index key at the horizon, which
+ * is at or past the seqno of the entry.  Lookup errors keep the entry.
+ */
+static int
+ikvdb_kvs_index_cfilter(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    struct kvdb_kvs *   kk = arg;
+    struct kvs_ktuple   kt;
+    struct kvs_buf      vbuf;
+    enum key_lookup_res res;
+    kvs_index_fn *      fn;
+    char                ikey[HSE_KVS_KLEN_MAX];
+    char                vstack[IKVDB_INDEX_VBUF_SZ];
+    void *              vmem = NULL;
+    size_t              ilen;
+    u64                 view;
+    int                 action = KVS_CFILTER_KEEP;
+    merr_t              err;
+
+    /* Not an entry made by ikvdb_kvs_index_put(). */
+    if (vlen > klen || memcmp(key + klen - vlen, val, vlen))
+        return KVS_CFILTER_KEEP;
+
+    /* ikvdb_kvs_close() clears kk_ikvs before it waits for kk_refcnt.
+     */
+    atomic_inc(&kk->kk_refcnt);
+    smp_mb();
+
+    fn = kk->kk_index_fn;
+    if (!kk->kk_ikvs || !fn)
+        goto out;
+
+    view = ikvdb_horizon(&kk->kk_parent->ikdb_handle);
+
+    kvs_ktuple_init_nohash(&kt, val, vlen);
+    kvs_buf_init(&vbuf, vstack, sizeof(vstack));
+
+    err = ikvs_get(kk->kk_ikvs, NULL, &kt, view, &res, &vbuf);
+    if (!err && res == FOUND_VAL && vbuf.b_len > vbuf.b_buf_sz) {
+        vmem = malloc(vbuf.b_len);
+        if (ev(!vmem))
+            goto out;
+
+        kvs_buf_init(&vbuf, vmem, vbuf.b_len);
+
+        err = ikvs_get(kk->kk_ikvs, NULL, &kt, view, &res, &vbuf);
+    }
+
+    if (ev(err) || res == FOUND_MULTIPLE)
+        goto out;
+
+    action = KVS_CFILTER_DROP;
+
+    if (res == FOUND_VAL && vbuf.b_len <= vbuf.b_buf_sz &&
+        !fn(kk->kk_index_arg, val, vlen, vbuf.b_buf, vbuf.b_len, ikey, sizeof(ikey), &ilen) &&
+        ilen == klen - vlen && !memcmp(ikey, key, ilen))
+        action = KVS_CFILTER_KEEP;
+
+out:
+    free(vmem);
+    atomic_dec(&kk->kk_refcnt);
+
+    return action;
+}
+
+merr_t
+ikvdb_kvs_index_register(
+    struct hse_kvs *handle,
+    struct hse_kvs *index,
+    kvs_index_fn *  fn,
+    void *          arg)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct kvdb_kvs *  ik = (struct kvdb_kvs *)index;
+    struct ikvdb_impl *p;
+    merr_t             err = 0;
+
+    if (ev(!handle || !kk->kk_ikvs))
+        return merr(EINVAL);
+
+    p = kk->kk_parent;
+
+    mutex_lock(&p->ikdb_lock);
+
+    if (fn) {
+        /* An index is neither indexed nor the index of another kvs.
+         */
+        if (ev(!ik || ik == kk || ik->kk_parent != p || !ik->kk_ikvs || ik->kk_index ||
+               kk->kk_index_of || (ik->kk_index_of && ik->kk_index_of != kk))) {
+            err = merr(EINVAL);
+            goto out;
+        }
+    }
+
+    ikvdb_kvs_index_unset(kk);
+
+    if (fn) {
+        kk->kk_index = ik;
+        kk->kk_index_arg = arg;
+        kk->kk_index_fn = fn;
+        ik->kk_index_of = kk;
+
+        cn_cfilter_set(kvs_cn(ik->kk_ikvs), ikvdb_kvs_index_cfilter, kk);
+    }
+
+out:
+    mutex_unlock(&p->ikdb_lock);
+
+    return err;
+}
+
+/* Fold @oper into the value of @kt by @fn, @len is the number of bytes
+ * written by the caller for the purpose of throttling.
+ */
+static merr_t
+ikvdb_kvs_fold(
+    struct kvdb_kvs *        kk,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn,
+    size_t                   len)
+{
+    struct ikvdb_impl *parent;
+    merr_t             err;
+    u64                start;
+
+    start = kvdb_kop_is_priority(os) ? 0 : get_time_ns();
+
+    parent = kk->kk_parent;
+    if (ev(parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    /* See ikvdb_kvs_put(). */
+    err = kvdb_health_check(
+        &parent->ikdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
+    if (ev(err))
+        return err;
+
+    err = ikvs_merge(kk->kk_ikvs, os, kt, oper, fn);
+    if (err) {
+        ev(merr_errno(err) != ECANCELED);
+        return err;
+    }
+
+    if (start > 0)
+        ikvdb_throttle(parent, kk, start, len);
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_merge(
+    struct hse_kvs *         handle,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper)
+{
+    struct kvdb_kvs *kk = (struct kvdb_kvs *)handle;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    if (ev(!kk->kk_merge_fn))
+        return merr(EINVAL);
+
+    return ikvdb_kvs_fold(kk, os, kt, oper, kk->kk_merge_fn, kt->kt_len + oper->vt_len);
+}
+
+merr_t
+ikvdb_kvs_patch(
+    struct hse_kvs *         handle,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    u64                      off,
+    const struct kvs_vtuple *vt)
+{
+    struct kvdb_kvs * kk = (struct kvdb_kvs *)handle;
+    struct kvs_vtuple oper;
+    struct kvs_patch  patch;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    patch.kp_off = off;
+    patch.kp_data = vt->vt_data;
+    patch.kp_len = vt->vt_len;
+
+    kvs_vtuple_init(&oper, &patch, sizeof(patch));
+
+    return ikvdb_kvs_fold(kk, os, kt, &oper, kvs_patch_merge, kt->kt_len + vt->vt_len);
+}
+
+merr_t
+ikvdb_kvs_write_batch(
+    struct ikvdb *          handle,
+    struct hse_kvdb_opspec *os,
+    struct hse_kvs **       kvsv,
+    struct kvs_wbatch_op *  opv,
+    unsigned int            opc)
+{
+    struct ikvdb_impl *self;
+    merr_t             err;
+    u64                start;
+    size_t             sz;
+    unsigned int       i;
+
+    start = kvdb_kop_is_priority(os) ? 0 : get_time_ns();
+
+    if (ev(!handle || !kvsv || !opv))
+        return merr(EINVAL);
+
+    self = ikvdb_h2r(handle);
+    if (ev(self->ikdb_rdonly))
+        return merr(EROFS);
+
+    err = kvdb_health_check(
+        &self->ikdb_health, KVDB_HEALTH_FLAG_ALL & ~KVDB_HEALTH_FLAG_DELBLKFAIL);
+    if (ev(err))
+        return err;
+
+    for (i = 0; i < opc; ++i) {
+        struct kvdb_kvs *kk = (struct kvdb_kvs *)kvsv[i];
+
+        if (ev(!kk || kk->kk_parent != self))
+            return merr(EINVAL);
+    }
+
+    /* Within a txn each op is buffered by the txn anyway, so there's
+     * nothing to amortize beyond the health check.
+     */
+    if (kvdb_kop_is_txn(os)) {
+        for (i = 0; i < opc; ++i) {
+            struct kvdb_kvs *     kk = (struct kvdb_kvs *)kvsv[i];
+            struct kvs_wbatch_op *op = opv + i;
+
+            if (op->wbo_tomb)
+                err = ikvs_del(kk->kk_ikvs, os, &op->wbo_kt, 0);
+            else
+                err = ikvs_put(kk->kk_ikvs, os, &op->wbo_kt, &op->wbo_vt, 0);
+            if (ev(err))
+                return err;
+        }
+
+        return 0;
+    }
+
+    for (i = sz = 0; i < opc; ++i) {
+        struct kvdb_kvs *     kk = (struct kvdb_kvs *)kvsv[i];
+        struct kvs_wbatch_op *op = opv + i;
+
+        err = ikvs_wbatch_prep(kk->kk_ikvs, op);
+        if (ev(err))
+            return err;
+
+        sz += op->wbo_kt.kt_len + (op->wbo_tomb ? 0 : op->wbo_vt.vt_len);
+    }
+
+    /* An atomic batch is published with one commit seqno, much like
+     * a txn that takes no write locks.
+     */
+    if (kvdb_kop_is_atomic(os))
+        err = kvdb_ctxn_set_write_batch(
+            self->ikdb_ctxn_set, self->ikdb_c0sk, &self->ikdb_seqno, opv, opc);
+    else
+        err = c0sk_write_batch(self->ikdb_c0sk, opv, opc, HSE_SQNREF_SINGLE);
+    if (err) {
+        ev(merr_errno(err) != ECANCELED);
+        return err;
+    }
+
+    if (start > 0)
+        ikvdb_throttle(self, NULL, start, sz);
+
+    return 0;
+}
+
+/* Length of the suffix of a chunk key, the generation and chunk index.
+ */
+#define IKVDB_STREAM_SFX_LEN (sizeof(u64) + sizeof(u32))
+
+/* Length of each chunk of a streamed value but the last.
+ */
+#define IKVDB_STREAM_CHUNK (HSE_KVS_VLEN_MAX)
+
+/**
+ * struct ikvdb_stream - a value being written by ikvdb_kvs_stream_write()
+ * @is_kvs:    kvs to which the value is written
+ * @is_os:     private copy of the caller's opspec
+ * @is_osp:    &is_os if the caller supplied an opspec, otherwise NULL
+ * @is_gen:    generation of the chunk keys
+ * @is_nchunk: number of chunks put so far
+ * @is_blen:   length of the data in @is_buf
+ * @is_klen:   length of the key
+ * @is_key:    key, followed by room for the suffix of a chunk key
+ * @is_buf:    chunk not yet put
+ */
+struct ikvdb_stream {
+    struct kvdb_kvs *       is_kvs;
+    struct hse_kvdb_opspec  is_os;
+    struct hse_kvdb_opspec *is_osp;
+    u64                     is_gen;
+    u32                     is_nchunk;
+    u32                     is_blen;
+    u32                     is_klen;
+    char                    is_key[HSE_KVS_KLEN_MAX];
+    char                    is_buf[IKVDB_STREAM_CHUNK];
+};
+
+/* Appends the suffix of chunk @idx of generation @gen to the key of
+ * length @klen in @key, which must have room for it.
+ */
+static void
+ikvdb_stream_key(char *key, size_t klen, u64 gen, u32 idx, struct kvs_ktuple *kt)
+{
+    __be64 bgen = cpu_to_be64(gen);
+    __be32 bidx = cpu_to_be32(idx);
+
+    memcpy(key + klen, &bgen, sizeof(bgen));
+    memcpy(key + klen + sizeof(bgen), &bidx, sizeof(bidx));
+
+    kvs_ktuple_init_nohash(kt, key, klen + IKVDB_STREAM_SFX_LEN);
+}
+
+/* Returns true if @val is the manifest of a streamed value.
+ */
+static bool
+ikvdb_stream_hdr_get(const void *val, size_t vlen, u64 *gen, u64 *len, u32 *chunk)
+{
+    struct kvdb_stream_omf omf;
+    u32                    crc;
+
+    if (vlen != sizeof(omf))
+        return false;
+
+    memcpy(&omf, val, sizeof(omf));
+
+    if (omf_ks_magic(&omf) != KVDB_STREAM_MAGIC || omf_ks_version(&omf) != KVDB_STREAM_VERSION)
+        return false;
+
+    crc = omf_ks_crc(&omf);
+    omf_set_ks_crc(&omf, 0);
+
+    if (crc != XXH32(&omf, sizeof(omf), 0) || omf_ks_chunk(&omf) == 0)
+        return false;
+
+    *gen = omf_ks_gen(&omf);
+    *len = omf_ks_len(&omf);
+    *chunk = omf_ks_chunk(&omf);
+
+    return true;
+}
+
+static void
+ikvdb_stream_hdr_set(struct kvdb_stream_omf *omf, u64 gen, u64 len)
+{
+    memset(omf, 0, sizeof(*omf));
+
+    omf_set_ks_magic(omf, KVDB_STREAM_MAGIC);
+    omf_set_ks_version(omf, KVDB_STREAM_VERSION);
+    omf_set_ks_chunk(omf, IKVDB_STREAM_CHUNK);
+    omf_set_ks_gen(omf, gen);
+    omf_set_ks_len(omf, len);
+    omf_set_ks_crc(omf, XXH32(omf, sizeof(*omf), 0));
+}
+
+/* Deletes chunks [0, @nchunk) of generation @gen of the key in @key.
+ */
+static void
+ikvdb_stream_chunks_del(
+    struct kvdb_kvs *       kk,
+    struct hse_kvdb_opspec *os,
+    char *                  key,
+    size_t                  klen,
+    u64                     gen,
+    u64                     nchunk)
+{
+    struct kvs_ktuple kt;
+    merr_t            err;
+    u64               i;
+
+    for (i = 0; i < nchunk; ++i) {
+        ikvdb_stream_key(key, klen, gen, i, &kt);
+
+        err = ikvdb_kvs_del((struct hse_kvs *)kk, os, &kt);
+        if (ev(err))
+            break;
+    }
+}
+
+merr_t
+ikvdb_kvs_stream_open(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    struct ikvdb_stream **  streamp)
+{
+    struct kvdb_kvs *    kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_stream *stream;
+
+    if (ev(!handle || !kt || !streamp))
+        return merr(EINVAL);
+
+    if (ev(kk->kk_parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    /* Chunks are put as the stream fills, well before the value is
+     * committed, which neither a txn nor a secondary index can track.
+     */
+    if (ev(kvdb_kop_is_txn(os) || kk->kk_index_fn))
+        return merr(EINVAL);
+
+    if (ev(kt->kt_len + IKVDB_STREAM_SFX_LEN > HSE_KVS_KLEN_MAX))
+        return merr(ENAMETOOLONG);
+
+    stream = malloc(sizeof(*stream));
+    if (ev(!stream))
+        return merr(ENOMEM);
+
+    stream->is_kvs = kk;
+    stream->is_osp = NULL;
+    if (os) {
+        stream->is_os = *os;
+        stream->is_osp = &stream->is_os;
+    }
+
+    stream->is_gen = atomic64_inc_return(&kk->kk_parent->ikdb_stream_gen);
+    stream->is_nchunk = 0;
+    stream->is_blen = 0;
+    stream->is_klen = kt->kt_len;
+    memcpy(stream->is_key, kt->kt_data, kt->kt_len);
+
+    *streamp = stream;
+
+    return 0;
+}
+
+static merr_t
+ikvdb_stream_flush(struct ikvdb_stream *stream)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    merr_t            err;
+
+    if (ev(stream->is_nchunk == U32_MAX))
+        return merr(EFBIG);
+
+    ikvdb_stream_key(stream->is_key, stream->is_klen, stream->is_gen, stream->is_nchunk, &kt);
+    kvs_vtuple_init(&vt, stream->is_buf, stream->is_blen);
+
+    err = ikvdb_kvs_put((struct hse_kvs *)stream->is_kvs, stream->is_osp, &kt, &vt);
+    if (ev(err))
+        return err;
+
+    stream->is_nchunk++;
+    stream->is_blen = 0;
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_stream_write(struct ikvdb_stream *stream, const void *data, size_t len)
+{
+    const char *src = data;
+    merr_t      err;
+    size_t      n;
+
+    if (ev(!stream || (len > 0 && !data)))
+        return merr(EINVAL);
+
+    /* A full chunk is put only once more data arrives, so that a value
+     * of at most one chunk is put under the key itself by commit.
+     */
+    while (len > 0) {
+        if (stream->is_blen == sizeof(stream->is_buf)) {
+            err = ikvdb_stream_flush(stream);
+            if (ev(err))
+                return err;
+        }
+
+        n = min_t(size_t, len, sizeof(stream->is_buf) - stream->is_blen);
+        memcpy(stream->is_buf + stream->is_blen, src, n);
+
+        stream->is_blen += n;
+        src += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_stream_commit(struct ikvdb_stream *stream)
+{
+    struct kvdb_stream_omf omf;
+    struct hse_kvdb_opspec aos;
+    struct kvs_wbatch_op   opv[2];
+    struct hse_kvs *       kvsv[2];
+    struct kvdb_kvs *      kk;
+    struct kvs_ktuple      kt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    u64                    ogen, olen;
+    u32                    ochunk;
+    bool                   old;
+    uint                   opc = 0;
+    merr_t                 err;
+
+    if (ev(!stream))
+        return merr(EINVAL);
+
+    kk = stream->is_kvs;
+
+    /* Remember the chunks of the value being replaced, if streamed.
+     */
+    kvs_ktuple_init_nohash(&kt, stream->is_key, stream->is_klen);
+    kvs_buf_init(&vbuf, &omf, sizeof(omf));
+
+    err = ikvdb_kvs_get((struct hse_kvs *)kk, stream->is_osp, &kt, &res, &vbuf);
+    if (ev(err))
+        return err;
+
+    old = res == FOUND_VAL && ikvdb_stream_hdr_get(&omf, vbuf.b_len, &ogen, &olen, &ochunk);
+
+    /* The last chunk and the manifest are published together, such that
+     * readers see either all or none of the new value.
+     */
+    if (stream->is_nchunk > 0) {
+        u64 len = (u64)stream->is_nchunk * IKVDB_STREAM_CHUNK + stream->is_blen;
+
+        ikvdb_stream_key(
+            stream->is_key, stream->is_klen, stream->is_gen, stream->is_nchunk, &opv[opc].wbo_kt);
+        kvs_vtuple_init(&opv[opc].wbo_vt, stream->is_buf, stream->is_blen);
+        opv[opc].wbo_tomb = false;
+        kvsv[opc++] = (struct hse_kvs *)kk;
+
+        ikvdb_stream_hdr_set(&omf, stream->is_gen, len);
+        kvs_vtuple_init(&opv[opc].wbo_vt, &omf, sizeof(omf));
+    } else {
+        kvs_vtuple_init(&opv[opc].wbo_vt, stream->is_buf, stream->is_blen);
+    }
+
+    kvs_ktuple_init_nohash(&opv[opc].wbo_kt, stream->is_key, stream->is_klen);
+    opv[opc].wbo_tomb = false;
+    kvsv[opc++] = (struct hse_kvs *)kk;
+
+    if (stream->is_osp)
+        aos = *stream->is_osp;
+    else
+        HSE_KVDB_OPSPEC_INIT(&aos);
+
+    aos.kop_flags |= HSE_KVDB_KOP_FLAG_ATOMIC;
+
+    err = ikvdb_kvs_write_batch(&kk->kk_parent->ikdb_handle, &aos, kvsv, opv, opc);
+    if (ev(err))
+        return err;
+
+    if (old) {
+        u64 onchunk = (olen + ochunk - 1) / ochunk;
+
+        ikvdb_stream_chunks_del(kk, stream->is_osp, stream->is_key, stream->is_klen, ogen, onchunk);
+    }
+
+    free(stream);
+
+    return 0;
+}
+
+void
+ikvdb_kvs_stream_abort(struct ikvdb_stream *stream)
+{
+    if (!stream)
+        return;
+
+    ikvdb_stream_chunks_del(
+        stream->is_kvs,
+        stream->is_osp,
+        stream->is_key,
+        stream->is_klen,
+        stream->is_gen,
+        stream->is_nchunk);
+
+    free(stream);
+}
+
+merr_t
+ikvdb_kvs_stream_read(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    u64                     off,
+    void *                  buf,
+    size_t                  buflen,
+    enum key_lookup_res *   res,
+    size_t *                rlen,
+    u64 *                   slen)
+{
+    struct kvs_vlease lease;
+    char              key[HSE_KVS_KLEN_MAX];
+    u64               gen, len, pos, pgen = 0;
+    u32               chunk;
+    size_t            n;
+    merr_t            err;
+
+    if (ev(!handle || !kt || (buflen > 0 && !buf) || !res || !rlen || !slen))
+        return merr(EINVAL);
+
+    if (ev(kt->kt_len + IKVDB_STREAM_SFX_LEN > sizeof(key)))
+        return merr(ENAMETOOLONG);
+
+    memcpy(key, kt->kt_data, kt->kt_len);
+
+again:
+    *rlen = 0;
+    *slen = 0;
+
+    err = ikvdb_kvs_get_lease(handle, os, kt, res, &lease);
+    if (ev(err) || *res != FOUND_VAL)
+        return err;
+
+    if (!ikvdb_stream_hdr_get(lease.vl_data, lease.vl_len, &gen, &len, &chunk)) {
+
+        /* Not streamed, read the range from the value itself.
+         */
+        *slen = lease.vl_len;
+        if (off < lease.vl_len) {
+            *rlen = min_t(u64, buflen, lease.vl_len - off);
+            memcpy(buf, (const char *)lease.vl_data + off, *rlen);
+        }
+
+        ikvdb_kvs_lease_release(&lease);
+        return 0;
+    }
+
+    ikvdb_kvs_lease_release(&lease);
+
+    /* A chunk missing from the generation of a manifest read twice is
+     * lost, rather than deleted by a commit which replaced the value.
+     */
+    if (ev(pgen == gen))
+        return merr(ENODATA);
+
+    *slen = len;
+
+    for (pos = off; pos < len && *rlen < buflen; pos += n) {
+        struct kvs_ktuple   ckt;
+        enum key_lookup_res cres;
+        u64                 coff = pos % chunk;
+
+        ikvdb_stream_key(key, kt->kt_len, gen, pos / chunk, &ckt);
+
+        err = ikvdb_kvs_get_lease(handle, os, &ckt, &cres, &lease);
+        if (ev(err))
+            return err;
+
+        if (cres != FOUND_VAL) {
+            pgen = gen;
+            goto again;
+        }
+
+        if (ev(coff >= lease.vl_len)) {
+            ikvdb_kvs_lease_release(&lease);
+            return merr(EPROTO);
+        }
+
+        n = min_t(u64, buflen - *rlen, lease.vl_len - coff);
+        memcpy((char *)buf + *rlen, (const char *)lease.vl_data + coff, n);
+
+        ikvdb_kvs_lease_release(&lease);
+
+        *rlen += n;
+    }
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_prefix_delete(
+    struct hse_kvs *        handle,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    size_t *                kvs_pfx_len)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_impl *parent;
+    merr_t             err;
+    u32                ct_pfx_len;
+    u64                pdel_seqno;
+
+    if (ev(!handle))
+        return merr(EINVAL);
+
+    parent = kk->kk_parent;
+    if (ev(parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    ct_pfx_len = kk->kk_cparams->cp_pfx_len;
+    if (kvs_pfx_len)
+        *kvs_pfx_len = ct_pfx_len;
+
+    if (ev(!kt->kt_data || kt->kt_len != ct_pfx_len))
+        return merr(EINVAL);
+    if (ev(kt->kt_len == 0))
+        return merr(ENOENT);
+
+    pdel_seqno = kvdb_kop_is_txn(os) ? 0 : HSE_SQNREF_SINGLE;
+
+    /* Prefix tombstone deletes all current keys with a matching prefix -
+     * those with a sequence number up to but excluding the current seqno.
+     * Insert prefix tombstone with a higher seqno. Use a higher sequence
+     * number to allow newer mutations (after prefix) to be distinguished.
+     */
+    err = ikvs_prefix_del(kk->kk_ikvs, os, kt, pdel_seqno);
+    if (ev(err))
+        return err;
+
+    return 0;
+}
+
+/**
+ * struct ikvdb_bulk - bulk load of a kvs
+ * @ib_kvs:  kvs
+ * @ib_bulk: cn bulk load
+ */
+struct ikvdb_bulk {
+    struct kvdb_kvs *ib_kvs;
+    struct cn_bulk * ib_bulk;
+};
+
+merr_t
+ikvdb_kvs_bulk_begin(struct hse_kvs *handle, struct ikvdb_bulk **bulkp)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_impl *parent;
+    struct ikvdb_bulk *bulk;
+    merr_t             err;
+    u64                seqno;
+
+    if (ev(!handle || !bulkp))
+        return merr(EINVAL);
+
+    parent = kk->kk_parent;
+    if (ev(parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    bulk = calloc(1, sizeof(*bulk));
+    if (ev(!bulk))
+        return merr(ENOMEM);
+
+    bulk->ib_kvs = kk;
+
+    err = ikvs_bulk_begin(kk->kk_ikvs);
+    if (ev(err)) {
+        free(bulk);
+        return err;
+    }
+
+    /* Reserve the seqno of the loaded values as a txn commit would, then
+     * with the kvs quiesced flush c0, so that everything that could have
+     * an older seqno is in cn before the loaded kvsets.
+     */
+    seqno = 1 + atomic64_fetch_add(2, &parent->ikdb_seqno);
+
+    err = ikvdb_sync_int(parent);
+    if (ev(err))
+        goto errout;
+
+    err = cn_bulk_create(kvs_cn(kk->kk_ikvs), seqno, &bulk->ib_bulk);
+    if (ev(err))
+        goto errout;
+
+    *bulkp = bulk;
+
+    return 0;
+
+errout:
+    ikvs_bulk_end(kk->kk_ikvs);
+    free(bulk);
+
+    return err;
+}
+
+merr_t
+ikvdb_kvs_bulk_put(struct ikvdb_bulk *bulk, struct kvs_ktuple *kt, const struct kvs_vtuple *vt)
+{
+    struct kvs_cparams *cp;
+
+    if (ev(!bulk || !kt || !vt || vt->vt_len < 0))
+        return merr(EINVAL);
+
+    /* See ikvs_put() regarding keys in a suffixed kvs. */
+    cp = bulk->ib_kvs->kk_cparams;
+    if (ev(cp->cp_sfx_len && kt->kt_len < cp->cp_sfx_len + cp->cp_pfx_len))
+        return merr(EINVAL);
+
+    return cn_bulk_add(bulk->ib_bulk, kt->kt_data, kt->kt_len, vt->vt_data, vt->vt_len);
+}
+
+merr_t
+ikvdb_kvs_bulk_end(struct ikvdb_bulk *bulk, bool commit)
+{
+    merr_t err = 0;
+
+    if (ev(!bulk))
+        return merr(EINVAL);
+
+    if (commit) {
+        err = cn_bulk_commit(bulk->ib_bulk);
+        if (ev(err))
+            hse_elog(
+                HSE_ERR "%s: bulk load of kvs %s failed: @@e",
+                err,
+                __func__,
+                bulk->ib_kvs->kk_name);
+    }
+
+    cn_bulk_destroy(bulk->ib_bulk);
+    ikvs_bulk_end(bulk->ib_kvs->kk_ikvs);
+    free(bulk);
+
+    return err;
+}
+
+merr_t
+ikvdb_kvs_attach(struct hse_kvs *handle, const char *const *dirv, uint dirc)
+{
+    struct kvdb_kvs *  kk = (struct kvdb_kvs *)handle;
+    struct ikvdb_impl *parent;
+    struct cn_attach * att = NULL;
+    merr_t             err;
+    u64                seqno, seqno_min, seqno_max;
+    uint               i;
+
+    if (ev(!handle || !dirv || !dirc))
+        return merr(EINVAL);
+
+    parent = kk->kk_parent;
+    if (ev(parent->ikdb_rdonly))
+        return merr(EROFS);
+
+    err = ikvs_bulk_begin(kk->kk_ikvs);
+    if (ev(err))
+        return err;
+
+    err = cn_attach_create(kvs_cn(kk->kk_ikvs), &att);
+    if (ev(err))
+        goto out;
+
+    for (i = 0; i < dirc && !err; i++)
+        err = cn_attach_add(att, dirv[i]);
+    if (ev(err))
+        goto out;
+
+    /* Advance the kvdb seqno past those of the kvsets and then flush c0,
+     * so that every mutation made since is newer than the kvsets and all
+     * those made before are in cn ahead of them.
+     */
+    cn_attach_seqno(att, &seqno_min, &seqno_max);
+
+    seqno = atomic64_read(&parent->ikdb_seqno);
+    while (seqno < seqno_max) {
+        u64 old = atomic64_cmpxchg(&parent->ikdb_seqno, seqno, seqno_max);
+
+        if (old == seqno)
+            break;
+        seqno = old;
+    }
+
+    err = ikvdb_sync_int(parent);
+    if (ev(err))
+        goto out;
+
+    err = cn_attach_commit(att);
+
+out:
+    if (err)
+        hse_elog(HSE_ERR "%s: attach to kvs %s failed: @@e", err, __func__, kk->kk_name);
+
+    cn_attach_destroy(att);
+    ikvs_bulk_end(kk->kk_ikvs);
+
+    return err;
+}
+
+merr_t
+ikvdb_ckpt_create(struct ikvdb *handle, struct cn_snap **ckptp)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+    struct cn *        cnv[HSE_KVS_COUNT_MAX];
+    const char *       namev[HSE_KVS_COUNT_MAX];
+    merr_t             err;
+    uint               cnc, i;
+
+    if (ev(!handle || !ckptp))
+        return merr(EINVAL);
+
+    /* Flush c0 so that the checkpoint holds everything put before it. */
+    if (!self->ikdb_rdonly) {
+        err = ikvdb_sync_int(self);
+        if (ev(err))
+            return err;
+    }
+
+    mutex_lock(&self->ikdb_lock);
+    for (i = cnc = 0; i < self->ikdb_kvs_cnt; i++) {
+        struct kvdb_kvs *kk = self->ikdb_kvs_vec[i];
+
+        if (kk && kk->kk_ikvs) {
+            cnv[cnc] = kvs_cn(kk->kk_ikvs);
+            namev[cnc] = kk->kk_name;
+            cnc++;
+        }
+    }
+
+    err = cn_snap_create(cnv, namev, cnc, ckptp);
+    mutex_unlock(&self->ikdb_lock);
+
+    return err;
+}
+
+merr_t
+ikvdb_ckpt_export(
+    struct cn_snap *ckpt,
+    const char *    dir,
+    struct cn_snap *base,
+    const char *    basedir)
+{
+    return cn_snap_export(ckpt, dir, base, basedir);
+}
+
+void
+ikvdb_ckpt_destroy(struct cn_snap *ckpt)
+{
+    cn_snap_destroy(ckpt);
+}
+
+/*-  IKVDB Cursors --------------------------------------------------*/
+
+/*
+ * IKVDB cursors allow iteration over a single KVS' c0, cN, and ctxn.
+ * The normal life-cycle is create-iterate-destroy, where iterate has
+ * several verbs: seek, read, bind, and update.  Cursors are single-threaded
+ * and they are stateful.  These states are:
+ *
+ * 0 nil - cursor does not exist
  * 1 use - cursor has been created, and is iteratable
  * 2 err - cursor is in error and must be destroyed
  * 3 txn - cursor is bound to a transaction
@@ -2450,17 +4579,20 @@ ikvdb_kvs_cursor_create(
     struct kvdb_ctxn *     bind = 0;
     struct hse_kvs_cursor *cur = 0;
     int                    reverse;
+    bool                   keys_only, direct;
     merr_t                 err;
     unsigned int           cursor_cnt;
-    u64                    vseq, tstart;
+    u64                    vseq, tstart, lstart;
     struct perfc_set *     pkvsl_pc;
 
     *cursorp = NULL;
 
     pkvsl_pc = ikvs_perfc_pkvsl(kk->kk_ikvs);
     tstart = perfc_lat_start(pkvsl_pc);
+    lstart = lathist_start(kk->kk_lathv[KVDB_KVS_LAT_CURSOR_CREATE]);
 
     reverse = false;
+    keys_only = direct = false;
     cursor_cnt = atomic_read(&ikvdb->ikdb_curcnt);
     if (ev(cursor_cnt >= ikvdb->ikdb_curcnt_max)) {
         hse_log(
@@ -2487,6 +4619,10 @@ ikvdb_kvs_cursor_create(
 
     if (os) {
         reverse = kvdb_kop_is_reverse(os);
+        keys_only = kvdb_kop_is_keys_only(os);
+        direct = kvdb_kop_is_direct(os);
+        if (ev(direct && reverse))
+            return merr(EINVAL);
         if (os->kop_txn)
             ctxn = kvdb_ctxn_h2h(os->kop_txn);
         if (kvdb_kop_is_bind_txn(os)) {
@@ -2497,10 +4633,17 @@ ikvdb_kvs_cursor_create(
     }
 
     vseq = HSE_SQNREF_UNDEFINED;
-    if (ctxn) {
+    if (kvdb_kop_is_seqno(os)) {
+        err = ikvdb_kop_seqno_check(ikvdb, os);
+        if (err)
+            return err;
+        vseq = os->kop_seqno;
+    } else if (ctxn) {
         err = kvdb_ctxn_get_view_seqno(ctxn, &vseq);
         if (ev(err))
             return err;
+    } else if (os && os->kop_snap) {
+        vseq = active_ctxn_set_view(os->kop_snap);
     }
 
     /* The initialization sequence is driven by the way the sequence
@@ -2514,7 +4657,7 @@ ikvdb_kvs_cursor_create(
      *  - initialize cursor
      * The failure path must unregister the cursor from kk_cursors.
      */
-    cur = ikvs_cursor_alloc(kk->kk_ikvs, prefix, pfx_len, reverse);
+    cur = ikvs_cursor_alloc(kk->kk_ikvs, prefix, pfx_len, reverse, keys_only, direct);
     if (ev(!cur))
         return merr(ENOMEM);
 
@@ -2546,6 +4689,7 @@ ikvdb_kvs_cursor_create(
     }
 
     perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_CREATE, tstart);
+    lathist_record(kk->kk_lathv[KVDB_KVS_LAT_CURSOR_CREATE], lstart);
 
     *cursorp = cur;
 
@@ -2584,11 +4728,18 @@ ikvdb_kvs_cursor_update(struct hse_kvs_cursor *cur, struct hse_kvdb_opspec *os)
     cur->kc_seq = HSE_SQNREF_UNDEFINED;
 
     ctxn = kvdb_kop_is_txn(os) ? kvdb_ctxn_h2h(os->kop_txn) : NULL;
-    if (ctxn) {
+    if (kvdb_kop_is_seqno(os)) {
+        err = ikvdb_kop_seqno_check(cur->kc_kvs->kk_parent, os);
+        if (err)
+            return err;
+        cur->kc_seq = os->kop_seqno;
+    } else if (ctxn) {
         /* this is a recoverable error */
         err = kvdb_ctxn_get_view_seqno(ctxn, &cur->kc_seq);
         if (ev(err))
             return err;
+    } else if (os && os->kop_snap) {
+        cur->kc_seq = active_ctxn_set_view(os->kop_snap);
     }
 
     bound = cur->kc_bind;
@@ -2669,15 +4820,120 @@ ikvdb_kvs_cursor_seek(
     const void *            limit,
     size_t                  limit_len,
     struct kvs_ktuple *     kt)
+{
+    merr_t err;
+    u64    tstart, lstart;
+
+    tstart = perfc_lat_start(cur->kc_pkvsl_pc);
+    lstart = lathist_start(cur->kc_kvs->kk_lathv[KVDB_KVS_LAT_CURSOR_SEEK]);
+
+    if (ev(kvdb_kop_is_txn(os)))
+        return merr(EINVAL);
+
+    if (ev(cur->kc_err)) {
+        if (ev(merr_errno(cur->kc_err) != EAGAIN))
+            return cur->kc_err;
+
+        cur->kc_err = ikvs_cursor_update(cur, cur->kc_seq);
+        if (ev(cur->kc_err))
+            return cur->kc_err;
+    }
+
+    if (cur->kc_bind) {
+        cur->kc_err = cursor_refresh(cur);
+        if (ev(cur->kc_err))
+            return cur->kc_err;
+    }
+
+    /* errors on seek are not fatal */
+    err = ikvs_cursor_seek(cur, key, (u32)len, limit, (u32)limit_len, kt);
+
+    perfc_lat_record(cur->kc_pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_SEEK, tstart);
+    lathist_record(cur->kc_kvs->kk_lathv[KVDB_KVS_LAT_CURSOR_SEEK], lstart);
+
+    return ev(err);
+}
+
+merr_t
+ikvdb_kvs_cursor_read(
+    struct hse_kvs_cursor * cur,
+    struct hse_kvdb_opspec *os,
+    const void **           key,
+    size_t *                key_len,
+    const void **           val,
+    size_t *                val_len,
+    bool *                  eof)
+{
+    struct kvs_kvtuple kvt;
+    merr_t             err;
+    u64                tstart, lstart;
+
+    tstart = perfc_lat_start(cur->kc_pkvsl_pc);
+    lstart = lathist_start(cur->kc_kvs->kk_lathv[KVDB_KVS_LAT_CURSOR_READ]);
+
+    if (ev(kvdb_kop_is_txn(os)))
+        return merr(EINVAL);
+
+    if (ev(cur->kc_err)) {
+        if (ev(merr_errno(cur->kc_err) != EAGAIN))
+            return cur->kc_err;
+
+        cur->kc_err = ikvs_cursor_update(cur, cur->kc_seq);
+        if (ev(cur->kc_err))
+            return cur->kc_err;
+    }
+
+    if (cur->kc_bind) {
+        cur->kc_err = cursor_refresh(cur);
+        if (ev(cur->kc_err))
+            return cur->kc_err;
+    }
+
+    err = ikvs_cursor_read(cur, &kvt, eof);
+    if (ev(err))
+        return err;
+    if (*eof)
+        return 0;
+
+    *key = kvt.kvt_key.kt_data;
+    *key_len = kvt.kvt_key.kt_len;
+    *val = kvt.kvt_value.vt_data;
+    *val_len = kvt.kvt_value.vt_len;
+
+    perfc_lat_record(
+        cur->kc_pkvsl_pc,
+        cur->kc_flags & HSE_KVDB_KOP_FLAG_REVERSE ? PERFC_LT_PKVSL_KVS_CURSOR_READREV
+                                                  : PERFC_LT_PKVSL_KVS_CURSOR_READFWD,
+        tstart);
+    lathist_record(cur->kc_kvs->kk_lathv[KVDB_KVS_LAT_CURSOR_READ], lstart);
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_cursor_read_many(
+    struct hse_kvs_cursor *    cur,
+    struct hse_kvdb_opspec *   os,
+    void *                     buf,
+    size_t                     buf_sz,
+    struct hse_kvs_cursor_rec *recv,
+    unsigned int               recc,
+    unsigned int *             nread,
+    bool *                     eof)
 {
     merr_t err;
     u64    tstart;
 
     tstart = perfc_lat_start(cur->kc_pkvsl_pc);
 
+    *nread = 0;
+
     if (ev(kvdb_kop_is_txn(os)))
         return merr(EINVAL);
 
+    /* The error and bind checks of ikvdb_kvs_cursor_read() are made
+     * once for the entire batch.
+     */
     if (ev(cur->kc_err)) {
         if (ev(merr_errno(cur->kc_err) != EAGAIN))
             return cur->kc_err;
@@ -2687,96 +4943,279 @@ ikvdb_kvs_cursor_seek(
             return cur->kc_err;
     }
 
-    if (cur->kc_bind) {
-        cur->kc_err = cursor_refresh(cur);
-        if (ev(cur->kc_err))
-            return cur->kc_err;
+    if (cur->kc_bind) {
+        cur->kc_err = cursor_refresh(cur);
+        if (ev(cur->kc_err))
+            return cur->kc_err;
+    }
+
+    err = ikvs_cursor_read_many(cur, buf, buf_sz, recv, recc, nread, eof);
+    if (ev(err))
+        return err;
+
+    perfc_lat_record(cur->kc_pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_READMANY, tstart);
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_cursor_destroy(struct hse_kvs_cursor *cur)
+{
+    struct perfc_set *pkvsl_pc;
+    u64               tstart;
+
+    if (!cur)
+        return 0;
+
+    pkvsl_pc = cur->kc_pkvsl_pc;
+    tstart = perfc_lat_start(pkvsl_pc);
+
+    cursor_unbind_txn(cur);
+
+    atomic_dec(cur->kc_cursor_cnt);
+    perfc_dec(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_CURCNT);
+
+    ikvs_cursor_free(cur);
+
+    perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_DESTROY, tstart);
+
+    return 0;
+}
+
+merr_t
+ikvdb_kvs_cursor_filter(
+    struct hse_kvs_cursor *cur,
+    kvs_pred_fn *          keyfn,
+    kvs_pred_fn *          valfn,
+    void *                 arg)
+{
+    if (ev(cur->kc_err && merr_errno(cur->kc_err) != EAGAIN))
+        return cur->kc_err;
+
+    return ikvs_cursor_pred(cur, keyfn, valfn, arg);
+}
+
+merr_t
+ikvdb_kvs_range_split(
+    struct hse_kvs *     handle,
+    const void *         pfx,
+    size_t               pfx_len,
+    u32                  rangec,
+    struct cn_split_key *keyv,
+    u32 *                keycp)
+{
+    struct kvdb_kvs *kk = (struct kvdb_kvs *)handle;
+
+    if (ev(!handle || !keyv || !keycp))
+        return merr(EINVAL);
+
+    return cn_range_split(kvs_cn(kk->kk_ikvs), pfx, pfx_len, rangec, keyv, keycp);
+}
+
+merr_t
+ikvdb_kvs_range_estimate(
+    struct hse_kvs *     handle,
+    const void *         lo,
+    size_t               lo_len,
+    const void *         hi,
+    size_t               hi_len,
+    struct cn_range_est *est)
+{
+    struct kvdb_kvs *kk = (struct kvdb_kvs *)handle;
+    u64              c0keys, c0bytes;
+    merr_t           err;
+
+    if (ev(!handle || !est))
+        return merr(EINVAL);
+
+    err = cn_range_estimate(kvs_cn(kk->kk_ikvs), lo, lo_len, hi, hi_len, est);
+    if (ev(err))
+        return err;
+
+    /* c0 does not keep counts per kvs, let alone per range, so all it
+     * can add is slack to the upper bounds.
+     */
+    c0sk_usage(kk->kk_parent->ikdb_c0sk, &c0keys, &c0bytes);
+
+    est->cre_keys_hi += c0keys;
+    est->cre_bytes_hi += c0bytes;
+
+    return 0;
+}
+
+/* Max number of ranges (and threads) of a parallel scan.
+ */
+#define IKVDB_PSCAN_MAX 64
+
+/**
+ * struct ikvdb_pscan_work - one range of a parallel scan
+ * @psw_work:    work struct for the scan workqueue
+ * @psw_kvs:     kvs to scan
+ * @psw_os:      opspec of the range's cursor
+ * @psw_pfx:     prefix of the range's cursor
+ * @psw_pfx_len: length of %psw_pfx
+ * @psw_lo:      first key of the range (NULL if none)
+ * @psw_hi:      first key past the range (NULL if none)
+ * @psw_fn:      callback for each key-value pair
+ * @psw_arg:     argument to %psw_fn
+ * @psw_stop:    set to stop all the ranges of the scan
+ * @psw_err:     status of the range
+ */
+struct ikvdb_pscan_work {
+    struct work_struct         psw_work;
+    struct hse_kvs *           psw_kvs;
+    struct hse_kvdb_opspec *   psw_os;
+    const void *               psw_pfx;
+    size_t                     psw_pfx_len;
+    const struct cn_split_key *psw_lo;
+    const struct cn_split_key *psw_hi;
+    kvs_scan_fn *              psw_fn;
+    void *                     psw_arg;
+    atomic_t *                 psw_stop;
+    merr_t                     psw_err;
+};
+
+static void
+ikvdb_kvs_pscan_work(struct work_struct *work)
+{
+    struct ikvdb_pscan_work *  psw = container_of(work, struct ikvdb_pscan_work, psw_work);
+    const struct cn_split_key *hi = psw->psw_hi;
+    struct hse_kvs_cursor *    cur;
+    const void *               key, *val;
+    size_t                     klen, vlen;
+    bool                       eof = false;
+    merr_t                     err;
+
+    err = ikvdb_kvs_cursor_create(psw->psw_kvs, psw->psw_os, psw->psw_pfx, psw->psw_pfx_len, &cur);
+    if (ev(err))
+        goto errout;
+
+    if (psw->psw_lo)
+        err = ikvdb_kvs_cursor_seek(
+            cur, psw->psw_os, psw->psw_lo->csk_key, psw->psw_lo->csk_len, NULL, 0, NULL);
+
+    while (!err && !atomic_read(psw->psw_stop)) {
+        err = ikvdb_kvs_cursor_read(cur, psw->psw_os, &key, &klen, &val, &vlen, &eof);
+        if (ev(err) || eof)
+            break;
+
+        if (hi && keycmp(key, klen, hi->csk_key, hi->csk_len) >= 0)
+            break;
+
+        if (psw->psw_fn(psw->psw_arg, key, klen, val, vlen)) {
+            err = merr(ECANCELED);
+            break;
+        }
     }
 
-    /* errors on seek are not fatal */
-    err = ikvs_cursor_seek(cur, key, (u32)len, limit, (u32)limit_len, kt);
+    ikvdb_kvs_cursor_destroy(cur);
 
-    perfc_lat_record(cur->kc_pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_SEEK, tstart);
+errout:
+    if (err)
+        atomic_set(psw->psw_stop, 1);
 
-    return ev(err);
+    psw->psw_err = err;
 }
 
 merr_t
-ikvdb_kvs_cursor_read(
-    struct hse_kvs_cursor * cur,
+ikvdb_kvs_scan_parallel(
+    struct hse_kvs *        handle,
     struct hse_kvdb_opspec *os,
-    const void **           key,
-    size_t *                key_len,
-    const void **           val,
-    size_t *                val_len,
-    bool *                  eof)
+    const void *            pfx,
+    size_t                  pfx_len,
+    u32                     threadc,
+    kvs_scan_fn *           fn,
+    void *                  arg)
 {
-    struct kvs_kvtuple kvt;
-    merr_t             err;
-    u64                tstart;
-
-    tstart = perfc_lat_start(cur->kc_pkvsl_pc);
+    struct kvdb_kvs *         kk = (struct kvdb_kvs *)handle;
+    struct hse_kvdb_snapshot *snap = NULL;
+    struct ikvdb_pscan_work * workv = NULL;
+    struct cn_split_key *     keyv = NULL;
+    struct workqueue_struct * wq;
+    struct hse_kvdb_opspec    opspec;
+    atomic_t                  stop;
+    u32                       keyc, i;
+    merr_t                    err;
+
+    if (ev(!handle || !fn || threadc == 0))
+        return merr(EINVAL);
 
-    if (ev(kvdb_kop_is_txn(os)))
+    /* A txn cannot be shared by the cursors of several threads.
+     */
+    if (ev(kvdb_kop_is_txn(os) || kvdb_kop_is_reverse(os) || kvdb_kop_is_bind_txn(os)))
         return merr(EINVAL);
 
-    if (ev(cur->kc_err)) {
-        if (ev(merr_errno(cur->kc_err) != EAGAIN))
-            return cur->kc_err;
+    threadc = min_t(u32, threadc, IKVDB_PSCAN_MAX);
 
-        cur->kc_err = ikvs_cursor_update(cur, cur->kc_seq);
-        if (ev(cur->kc_err))
-            return cur->kc_err;
+    if (os)
+        opspec = *os;
+    else
+        HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* All the ranges are read at one view, so the scan is as if by a
+     * single cursor.
+     */
+    if (!opspec.kop_snap && !kvdb_kop_is_seqno(&opspec)) {
+        err = ikvdb_snapshot_acquire(&kk->kk_parent->ikdb_handle, &snap);
+        if (ev(err))
+            return err;
+
+        opspec.kop_snap = snap;
     }
 
-    if (cur->kc_bind) {
-        cur->kc_err = cursor_refresh(cur);
-        if (ev(cur->kc_err))
-            return cur->kc_err;
+    workv = calloc(threadc, sizeof(*workv));
+    keyv = malloc(sizeof(*keyv) * threadc);
+    if (ev(!workv || !keyv)) {
+        err = merr(ENOMEM);
+        goto errout;
     }
 
-    err = ikvs_cursor_read(cur, &kvt, eof);
+    err = ikvdb_kvs_range_split(handle, pfx, pfx_len, threadc, keyv, &keyc);
     if (ev(err))
-        return err;
-    if (*eof)
-        return 0;
-
-    *key = kvt.kvt_key.kt_data;
-    *key_len = kvt.kvt_key.kt_len;
-    *val = kvt.kvt_value.vt_data;
-    *val_len = kvt.kvt_value.vt_len;
+        goto errout;
 
-    perfc_lat_record(
-        cur->kc_pkvsl_pc,
-        cur->kc_flags & HSE_KVDB_KOP_FLAG_REVERSE ? PERFC_LT_PKVSL_KVS_CURSOR_READREV
-                                                  : PERFC_LT_PKVSL_KVS_CURSOR_READFWD,
-        tstart);
+    wq = alloc_workqueue("kvs_pscan", 0, keyc + 1);
+    if (ev(!wq)) {
+        err = merr(ENOMEM);
+        goto errout;
+    }
 
-    return 0;
-}
+    atomic_set(&stop, 0);
 
-merr_t
-ikvdb_kvs_cursor_destroy(struct hse_kvs_cursor *cur)
-{
-    struct perfc_set *pkvsl_pc;
-    u64               tstart;
+    for (i = 0; i <= keyc; ++i) {
+        struct ikvdb_pscan_work *psw = workv + i;
 
-    if (!cur)
-        return 0;
+        psw->psw_kvs = handle;
+        psw->psw_os = &opspec;
+        psw->psw_pfx = pfx;
+        psw->psw_pfx_len = pfx_len;
+        psw->psw_lo = i > 0 ? keyv + i - 1 : NULL;
+        psw->psw_hi = i < keyc ? keyv + i : NULL;
+        psw->psw_fn = fn;
+        psw->psw_arg = arg;
+        psw->psw_stop = &stop;
 
-    pkvsl_pc = cur->kc_pkvsl_pc;
-    tstart = perfc_lat_start(pkvsl_pc);
+        INIT_WORK(&psw->psw_work, ikvdb_kvs_pscan_work);
+        queue_work(wq, &psw->psw_work);
+    }
 
-    cursor_unbind_txn(cur);
+    /* Wait for all the ranges to finish.
+     */
+    destroy_workqueue(wq);
 
-    atomic_dec(cur->kc_cursor_cnt);
-    perfc_dec(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_CURCNT);
+    /* Report the first failure other than a range stopped by another.
+     */
+    for (i = 0; i <= keyc && !err; ++i)
+        err = workv[i].psw_err;
 
-    ikvs_cursor_free(cur);
+errout:
+    free(keyv);
+    free(workv);
 
-    perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_CURSOR_DESTROY, tstart);
+    if (snap)
+        ikvdb_snapshot_release(&kk->kk_parent->ikdb_handle, snap);
 
-    return 0;
+    return err;
 }
 
 void
@@ -2815,6 +5254,36 @@ ikvdb_sync(struct ikvdb *handle)
     return c0skm_sync(self->ikdb_c0sk);
 }
 
+merr_t
+ikvdb_sync_ticket(struct ikvdb *handle, u64 *ticket)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+
+    if (self->ikdb_rdonly)
+        return merr(ev(EROFS));
+
+    if (!self->ikdb_c1)
+        return merr(ev(ENOTSUP));
+
+    *ticket = c0skm_ticket(self->ikdb_c0sk);
+
+    return 0;
+}
+
+merr_t
+ikvdb_sync_wait(struct ikvdb *handle, u64 ticket, int timeout_ms)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+
+    if (self->ikdb_rdonly)
+        return merr(ev(EROFS));
+
+    if (!self->ikdb_c1)
+        return merr(ev(ENOTSUP));
+
+    return c0skm_ticket_wait(self->ikdb_c0sk, ticket, timeout_ms);
+}
+
 merr_t
 ikvdb_flush(struct ikvdb *handle)
 {
@@ -2847,6 +5316,10 @@ ikvdb_horizon(struct ikvdb *handle)
 
     horizon = min_t(u64, b, c);
 
+    /* Keep the views of the last seqno_retain seqnos for reads by seqno.
+     */
+    horizon = min_t(u64, horizon, ikvdb_seqno_floor(self, a));
+
     perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_SEQNO, a);
     perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_CURHORIZON, horizon);
     perfc_set(&kvdb_metrics_pc, PERFC_BA_KVDBMETRICS_HORIZON, horizon);
@@ -2891,6 +5364,46 @@ ikvdb_txn_alloc(struct ikvdb *handle)
     return &ctxn->ctxn_handle;
 }
 
+merr_t
+ikvdb_snapshot_acquire(struct ikvdb *handle, struct hse_kvdb_snapshot **snap)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+    void *             cookie;
+    u64                view;
+    merr_t             err;
+
+    /* The active_ctxn_set entry is the snapshot: it sits in a per-cpu
+     * bucket, holds the view seqno and keeps the horizon from passing it.
+     */
+    err = active_ctxn_set_insert(self->ikdb_active_txn_set, &view, &cookie);
+    if (ev(err))
+        return err;
+
+    *snap = cookie;
+
+    return 0;
+}
+
+u64
+ikvdb_seqno_get(struct ikvdb *handle)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+
+    return atomic64_read(&self->ikdb_seqno);
+}
+
+void
+ikvdb_snapshot_release(struct ikvdb *handle, struct hse_kvdb_snapshot *snap)
+{
+    struct ikvdb_impl *self = ikvdb_h2r(handle);
+    u32                min_changed = 0;
+    u64                new_min = U64_MAX;
+
+    active_ctxn_set_remove(self->ikdb_active_txn_set, snap, &min_changed, &new_min);
+    if (min_changed)
+        kvdb_keylock_expire(self->ikdb_keylock, new_min);
+}
+
 void
 ikvdb_txn_free(struct ikvdb *handle, struct hse_kvdb_txn *txn)
 {
@@ -2923,6 +5436,9 @@ ikvdb_txn_begin(struct ikvdb *handle, struct hse_kvdb_txn *txn)
 {
     struct ikvdb_impl *self = ikvdb_h2r(handle);
     merr_t             err;
+    u64                lstart;
+
+    lstart = lathist_start(self->ikdb_txn_lathv[IKVDB_TXN_LAT_BEGIN]);
 
     perfc_inc(&self->ikdb_ctxn_op, PERFC_BA_CTXNOP_ACTIVE);
     perfc_inc(&self->ikdb_ctxn_op, PERFC_RA_CTXNOP_BEGIN);
@@ -2932,6 +5448,8 @@ ikvdb_txn_begin(struct ikvdb *handle, struct hse_kvdb_txn *txn)
     if (ev(err))
         perfc_dec(&self->ikdb_ctxn_op, PERFC_BA_CTXNOP_ACTIVE);
 
+    lathist_record(self->ikdb_txn_lathv[IKVDB_TXN_LAT_BEGIN], lstart);
+
     return err;
 }
 
@@ -2940,15 +5458,17 @@ ikvdb_txn_commit(struct ikvdb *handle, struct hse_kvdb_txn *txn)
 {
     struct ikvdb_impl *self = ikvdb_h2r(handle);
     merr_t             err;
-    u64                lstart;
+    u64                lstart, hstart;
 
     lstart = perfc_lat_startu(&self->ikdb_ctxn_op, PERFC_LT_CTXNOP_COMMIT);
+    hstart = lathist_start(self->ikdb_txn_lathv[IKVDB_TXN_LAT_COMMIT]);
     perfc_inc(&self->ikdb_ctxn_op, PERFC_RA_CTXNOP_COMMIT);
 
     err = kvdb_ctxn_commit(kvdb_ctxn_h2h(txn));
 
     perfc_dec(&self->ikdb_ctxn_op, PERFC_BA_CTXNOP_ACTIVE);
     perfc_lat_record(&self->ikdb_ctxn_op, PERFC_LT_CTXNOP_COMMIT, lstart);
+    lathist_record(self->ikdb_txn_lathv[IKVDB_TXN_LAT_COMMIT], hstart);
 
     return err;
 }
@@ -2957,12 +5477,16 @@ merr_t
 ikvdb_txn_abort(struct ikvdb *handle, struct hse_kvdb_txn *txn)
 {
     struct ikvdb_impl *self = ikvdb_h2r(handle);
+    u64                lstart;
+
+    lstart = lathist_start(self->ikdb_txn_lathv[IKVDB_TXN_LAT_ABORT]);
 
     perfc_inc(&self->ikdb_ctxn_op, PERFC_RA_CTXNOP_ABORT);
 
     kvdb_ctxn_abort(kvdb_ctxn_h2h(txn));
 
     perfc_dec(&self->ikdb_ctxn_op, PERFC_BA_CTXNOP_ACTIVE);
+    lathist_record(self->ikdb_txn_lathv[IKVDB_TXN_LAT_ABORT], lstart);
 
     return 0;
 }
@@ -3064,6 +5588,12 @@ kvdb_perfc_initialize(void)
         hse_log(HSE_ERR "cannot alloc kvdb metrics perf counters");
     else
         kvdb_perfc_register(&kvdb_metrics_pc);
+
+    if (perfc_ctrseti_alloc(
+            COMPNAME, "global", kvdb_memacct_perfc, PERFC_EN_MEMACCT, "memacct", &kvdb_memacct_pc))
+        hse_log(HSE_ERR "cannot alloc kvdb memory accounting perf counters");
+    else
+        kvdb_perfc_register(&kvdb_memacct_pc);
 }
 
 static void
@@ -3141,79 +5671,247 @@ log_dt(void)
                 err,
                 dt_out);
         }
-
-        flock(fd, LOCK_UN);
-        close(fd);
+
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+/* Called once by load() at program start or module load time.
+ */
+merr_t
+ikvdb_init(void)
+{
+    merr_t err;
+
+    kvdb_perfc_initialize();
+    kvs_init();
+
+    err = c0_init();
+    if (err)
+        goto errout;
+
+    err = cn_init();
+    if (err) {
+        c0_fini();
+        goto errout;
+    }
+
+errout:
+    if (err) {
+        kvs_fini();
+        log_dt();
+        kvdb_perfc_finish();
+    }
+
+    return err;
+}
+
+/* Called once by unload() at program termination or module unload time.
+ */
+void
+ikvdb_fini(void)
+{
+    cn_fini();
+    c0_fini();
+    log_dt();
+    kvs_fini();
+    kvdb_perfc_finish();
+}
+
+#define KVDB_EXPORT_FSIZE_MAX 0x100000000LL /* 4GB */
+
+/**
+ * KVDB_DUMP_CUR_VER - dump version understood by this binary
+ * @KVDB_DUMP_VER1: data files are a series of k-v pairs
+ * @KVDB_DUMP_VER2: data files are a series of chunks (struct kvdb_chunk_omf)
+ */
+#define KVDB_DUMP_VER1 1
+#define KVDB_DUMP_VER2 2
+#define KVDB_DUMP_CUR_VER KVDB_DUMP_VER2
+
+/* Export data is written in chunks of up to this many bytes of k-v pairs,
+ * compressed and checksummed individually.  A chunk always holds at least
+ * one k-v pair, so it must fit the largest one.
+ */
+#define KVDB_EXPORT_CHUNK_SZ (4u << 20)
+
+/* Maximum number of key ranges of a kvs exported in parallel.
+ */
+#define KVDB_EXPORT_RANGES_MAX (16)
+
+_Static_assert(
+    KVDB_EXPORT_CHUNK_SZ >=
+        sizeof(struct kvdb_kvmeta_omf) + HSE_KVS_KLEN_MAX + HSE_KVS_VLEN_MAX,
+    "export chunk too small for the largest k-v pair");
+
+/**
+ * ikvdb_kvs_import_recs() - put the k-v pairs of a buffer into a kvs
+ * @kvs: kvs
+ * @beg: first k-v pair
+ * @end: end of the buffer
+ * @cnt: (output) incremented by the number of k-v pairs put
+ *
+ * For each k-v pair, we import keylen, vlen, key and value.
+ */
+static merr_t
+ikvdb_kvs_import_recs(struct hse_kvs *kvs, const void *beg, const void *end, u64 *cnt)
+{
+    const struct kvdb_kvmeta_omf *kvmt;
+    struct hse_kvdb_opspec        opspec = { 0 };
+    struct kvs_ktuple             kt;
+    struct kvs_vtuple             vt;
+    const void *                  key, *val;
+    size_t                        klen, vlen;
+    merr_t                        err = 0;
+
+    while (beg < end) {
+        if (beg + sizeof(*kvmt) > end) {
+            err = merr(ev(EFAULT, HSE_ERR));
+            break;
+        }
+
+        kvmt = beg;
+        klen = omf_kvmt_klen(kvmt);
+        vlen = omf_kvmt_vlen(kvmt);
+        if (klen > HSE_KVS_KLEN_MAX) {
+            err = merr(ev(ENAMETOOLONG, HSE_ERR));
+            break;
+        }
+
+        if (klen == 0) {
+            err = merr(ev(ENOENT, HSE_ERR));
+            break;
+        }
+
+        if (vlen > HSE_KVS_VLEN_MAX) {
+            err = merr(ev(EMSGSIZE, HSE_ERR));
+            break;
+        }
+
+        beg += sizeof(*kvmt);
+        if (beg + klen + vlen > end) {
+            err = merr(ev(EFAULT, HSE_ERR));
+            break;
+        }
+
+        key = beg;
+        beg += klen;
+        val = beg;
+        beg += vlen;
+
+        kvs_ktuple_init_nohash(&kt, (void *)key, klen);
+        kvs_vtuple_init(&vt, (void *)val, vlen);
+
+        err = ikvdb_kvs_put(kvs, &opspec, &kt, &vt);
+        if (err) {
+            hse_elog(HSE_ERR "Failed to put key value pair, @@e", err);
+            break;
+        }
+        (*cnt)++;
     }
+
+    return err;
 }
 
-/* Called once by load() at program start or module load time.
+/**
+ * ikvdb_kvs_import_chunks() - verify, decompress and import the chunks
+ *                             of a data file
+ * @bak: import job
+ * @beg: first chunk
+ * @end: end of the data file
+ * @cnt: (output) incremented by the number of k-v pairs put
  */
-merr_t
-ikvdb_init(void)
+static merr_t
+ikvdb_kvs_import_chunks(struct kvdb_bak_work *bak, const void *beg, const void *end, u64 *cnt)
 {
-    merr_t err;
+    const struct kvdb_chunk_omf *chk;
+    const void *                 payload, *data;
+    void *                       buf;
+    uint                         comp, ulen, clen, len;
+    u64                          n;
+    merr_t                       err = 0;
+
+    buf = malloc(KVDB_EXPORT_CHUNK_SZ);
+    if (!buf)
+        return merr(ev(ENOMEM, HSE_ERR));
 
-    kvdb_perfc_initialize();
-    kvs_init();
+    while (beg < end) {
+        if (beg + sizeof(*chk) > end) {
+            err = merr(ev(EFAULT, HSE_ERR));
+            break;
+        }
 
-    err = c0_init();
-    if (err)
-        goto errout;
+        chk = beg;
+        comp = omf_chk_comp(chk);
+        ulen = omf_chk_ulen(chk);
+        clen = omf_chk_clen(chk);
+        payload = beg + sizeof(*chk);
 
-    err = cn_init();
-    if (err) {
-        c0_fini();
-        goto errout;
-    }
+        if (omf_chk_magic(chk) != KVDB_EXPORT_CHUNK_MAGIC || ulen > KVDB_EXPORT_CHUNK_SZ) {
+            err = merr(ev(EILSEQ, HSE_ERR));
+            break;
+        }
 
-errout:
-    if (err) {
-        kvs_fini();
-        log_dt();
-        kvdb_perfc_finish();
+        if (payload + clen > end) {
+            err = merr(ev(EFAULT, HSE_ERR));
+            break;
+        }
+
+        if (XXH32(payload, clen, 0) != omf_chk_crc(chk)) {
+            err = merr(ev(EILSEQ, HSE_ERR));
+            hse_elog(HSE_ERR "Corrupted chunk in %s, @@e", err, bak->bak_fname);
+            break;
+        }
+
+        data = payload;
+
+        if (comp == KVDB_EXPORT_COMP_LZ4) {
+            err = decompress_lz4(payload, clen, buf, KVDB_EXPORT_CHUNK_SZ, &len);
+            if (!err && len != ulen)
+                err = merr(EILSEQ);
+            if (ev(err))
+                break;
+
+            data = buf;
+        } else if (comp != KVDB_EXPORT_COMP_NONE || clen != ulen) {
+            err = merr(ev(EILSEQ, HSE_ERR));
+            break;
+        }
+
+        n = 0;
+        err = ikvdb_kvs_import_recs(bak->bak_kvs, data, data + ulen, &n);
+        *cnt += n;
+        if (err)
+            break;
+
+        if (n != omf_chk_kvcnt(chk)) {
+            err = merr(ev(EILSEQ, HSE_ERR));
+            break;
+        }
+
+        beg = payload + clen;
     }
 
-    return err;
-}
+    free(buf);
 
-/* Called once by unload() at program termination or module unload time.
- */
-void
-ikvdb_fini(void)
-{
-    cn_fini();
-    c0_fini();
-    log_dt();
-    kvs_fini();
-    kvdb_perfc_finish();
+    return err;
 }
 
-#define KVDB_EXPORT_FSIZE_MAX 0x100000000LL /* 4GB */
-
 /**
  * ikvdb_kvs_import: import k-v pairs from file
- *                   for each k-v pair, we import keylen, vlen, key and
- *                   value from the file
  * @work:
  */
 static void
 ikvdb_kvs_import(struct work_struct *work)
 {
-
-    struct kvdb_bak_work *  bak;
-    void *                  key = NULL, *val = NULL;
-    size_t                  klen, vlen;
-    int                     fd;
-    struct kvs_ktuple       kt;
-    struct kvs_vtuple       vt;
-    struct hse_kvdb_opspec  opspec = { 0 };
-    merr_t                  err = 0;
-    u64                     cnt = 0;
-    void *                  dbuf, *beg, *end;
-    u64                     fsize;
-    struct stat             st;
-    struct kvdb_kvmeta_omf *kvmt;
+    struct kvdb_bak_work *bak;
+    merr_t                err = 0;
+    u64                   cnt = 0;
+    int                   fd;
+    void *                dbuf;
+    u64                   fsize;
+    struct stat           st;
 
     bak = container_of(work, struct kvdb_bak_work, bak_work);
 
@@ -3223,6 +5921,10 @@ ikvdb_kvs_import(struct work_struct *work)
     }
 
     fsize = st.st_size;
+    if (fsize == 0) {
+        bak->bak_err = 0;
+        return;
+    }
 
     fd = open(bak->bak_fname, O_RDONLY, 0);
     if (fd == -1) {
@@ -3239,51 +5941,15 @@ ikvdb_kvs_import(struct work_struct *work)
         return;
     }
 
-    beg = dbuf;
-    end = dbuf + fsize;
+    /* The file is read once, front to back. */
+    madvise(dbuf, fsize, MADV_SEQUENTIAL);
 
     hse_log(HSE_DEBUG "Import start on %s", bak->bak_fname);
 
-    while (beg < end) {
-        kvmt = (struct kvdb_kvmeta_omf *)beg;
-        klen = omf_kvmt_klen(kvmt);
-        vlen = omf_kvmt_vlen(kvmt);
-        if (klen > HSE_KVS_KLEN_MAX) {
-            err = merr(ev(ENAMETOOLONG, HSE_ERR));
-            break;
-        }
-
-        if (klen == 0) {
-            err = merr(ev(ENOENT, HSE_ERR));
-            break;
-        }
-
-        if (vlen > HSE_KVS_VLEN_MAX) {
-            err = merr(ev(EMSGSIZE, HSE_ERR));
-            break;
-        }
-
-        beg += sizeof(*kvmt);
-        if (beg + klen + vlen > end) {
-            err = merr(ev(EFAULT, HSE_ERR));
-            break;
-        }
-
-        key = beg;
-        beg += klen;
-        val = beg;
-        beg += vlen;
-
-        kvs_ktuple_init_nohash(&kt, (void *)key, klen);
-        kvs_vtuple_init(&vt, (void *)val, vlen);
-
-        err = ikvdb_kvs_put(bak->bak_kvs, &opspec, &kt, &vt);
-        if (err) {
-            hse_elog(HSE_ERR "Failed to put key value pair, @@e", err);
-            break;
-        }
-        cnt++;
-    }
+    if (bak->bak_ver < KVDB_DUMP_VER2)
+        err = ikvdb_kvs_import_recs(bak->bak_kvs, dbuf, dbuf + fsize, &cnt);
+    else
+        err = ikvdb_kvs_import_chunks(bak, dbuf, dbuf + fsize, &cnt);
 
     munmap(dbuf, fsize);
     close(fd);
@@ -3294,13 +5960,6 @@ ikvdb_kvs_import(struct work_struct *work)
     bak->bak_err = err;
 }
 
-/**
- * KVDB_DUMP_CUR_VER - dump version understood by this binary
- * @KVDB_DUMP_VER1:
- */
-#define KVDB_DUMP_VER1 1
-#define KVDB_DUMP_CUR_VER KVDB_DUMP_VER1
-
 /**
  * ikvdb_import_toc() - import kvdb/kvs meta data from TOC file
  *                     TOC is in JSON format
@@ -3308,10 +5967,11 @@ ikvdb_kvs_import(struct work_struct *work)
  * @kvdb_cparams: kvdb create time parameters
  * @kvscnt: number of kvs in this kvdb
  * @kvsi: import meta data into kvsi structs
+ * @verp: (output) dump version, may be NULL
  *
  * An example of a TOC file in JSON format
  * {
- *      "version":      1,
+ *      "version":      2,
  *      "name":        "db1",
  *      "kvscnt":       1,
  *      "cndb_captgt":  0,
@@ -3323,7 +5983,11 @@ ikvdb_kvs_import(struct work_struct *work)
  *            "kvcnt":        1000000000,
  *            "pfx_len":      0,
  *            "fanout":       8,
- *            "kvs_ext01":    0
+ *            "kvs_ext01":    0,
+ *            "vcomp":        0,
+ *            "range":        0,
+ *            "ptlookup":     0,
+ *            "kfixed":       0
  *      }]
  * }
  */
@@ -3332,7 +5996,8 @@ ikvdb_import_toc(
     const char *         path,
     struct kvdb_cparams *kvdb_cparams,
     int *                kvscnt,
-    struct kvs_import *  kvsi)
+    struct kvs_import *  kvsi,
+    int *                verp)
 {
     FILE *      f;
     char *      buf, *cjson_str;
@@ -3429,6 +6094,9 @@ ikvdb_import_toc(
         goto errout;
     }
 
+    if (verp)
+        *verp = ver;
+
     name = cJSON_GetObjectItem(TOC, "name")->valuestring;
     strlcpy(mp_name, name, MPOOL_NAMESZ_MAX);
 
@@ -3476,7 +6144,7 @@ ikvdb_import_toc(
         hse_params_create(&kvsi[i].kvsi_params);
 
         kvsi[i].kvsi_fcnt = cJSON_GetObjectItem(kvs_json, "filecnt")->valueint;
-        kvsi[i].kvsi_kvcnt = cJSON_GetObjectItem(kvs_json, "kvcnt")->valueint;
+        kvsi[i].kvsi_kvcnt = cJSON_GetObjectItem(kvs_json, "kvcnt")->valuedouble;
 
         snprintf(
             val_buf, sizeof(val_buf), "%d", cJSON_GetObjectItem(kvs_json, "pfx_len")->valueint);
@@ -3500,6 +6168,45 @@ ikvdb_import_toc(
         err = hse_params_set(kvsi[i].kvsi_params, "kvs.kvs_ext01", val_buf);
         if (ev(err))
             goto errout;
+
+        /* Absent from TOCs exported before value compression existed. */
+        if (cJSON_GetObjectItem(kvs_json, "vcomp")) {
+            snprintf(
+                val_buf, sizeof(val_buf), "%d", cJSON_GetObjectItem(kvs_json, "vcomp")->valueint);
+            err = hse_params_set(kvsi[i].kvsi_params, "kvs.vcomp", val_buf);
+            if (ev(err))
+                goto errout;
+        }
+
+        if (cJSON_GetObjectItem(kvs_json, "range")) {
+            snprintf(
+                val_buf, sizeof(val_buf), "%d", cJSON_GetObjectItem(kvs_json, "range")->valueint);
+            err = hse_params_set(kvsi[i].kvsi_params, "kvs.range", val_buf);
+            if (ev(err))
+                goto errout;
+        }
+
+        if (cJSON_GetObjectItem(kvs_json, "ptlookup")) {
+            snprintf(
+                val_buf,
+                sizeof(val_buf),
+                "%d",
+                cJSON_GetObjectItem(kvs_json, "ptlookup")->valueint);
+            err = hse_params_set(kvsi[i].kvsi_params, "kvs.ptlookup", val_buf);
+            if (ev(err))
+                goto errout;
+        }
+
+        if (cJSON_GetObjectItem(kvs_json, "kfixed")) {
+            snprintf(
+                val_buf,
+                sizeof(val_buf),
+                "%d",
+                cJSON_GetObjectItem(kvs_json, "kfixed")->valueint);
+            err = hse_params_set(kvsi[i].kvsi_params, "kvs.kfixed", val_buf);
+            if (ev(err))
+                goto errout;
+        }
     }
 
 errout:
@@ -3511,7 +6218,7 @@ errout:
 merr_t
 ikvdb_import_kvdb_cparams(const char *path, struct kvdb_cparams *kvdb_cparams)
 {
-    return ikvdb_import_toc(path, kvdb_cparams, NULL, NULL);
+    return ikvdb_import_toc(path, kvdb_cparams, NULL, NULL, NULL);
 }
 
 merr_t
@@ -3528,13 +6235,14 @@ ikvdb_import(struct ikvdb *handle, const char *path)
     struct kvs_import *      kvsi;
     int                      total = 0;
     int                      len;
+    int                      ver = KVDB_DUMP_VER1;
 
     /* Import all the meta data required for this import from TOC file */
     kvsi = calloc(HSE_KVS_COUNT_MAX, sizeof(*kvsi));
     if (!kvsi)
         return merr(ev(ENOMEM, HSE_ERR));
 
-    err = ikvdb_import_toc(path, &kvdb_cparams, &kvscnt, kvsi);
+    err = ikvdb_import_toc(path, &kvdb_cparams, &kvscnt, kvsi, &ver);
     if (ev(err, HSE_ERR)) {
         hse_log(HSE_ERR "Failed to import TOC from path %s", path);
         free(kvsi);
@@ -3550,7 +6258,7 @@ ikvdb_import(struct ikvdb *handle, const char *path)
 
     /*
      * During kvdb export, the data in each kvs is dumped into multiple
-     * data files, 4GB each.
+     * data files, up to 4GB each, by as many workers as key ranges.
      * We will next create one workqueue job for each of these data files
      * and queue them into a workqueue
      */
@@ -3594,6 +6302,7 @@ ikvdb_import(struct ikvdb *handle, const char *path)
         if (kvsi[i].kvsi_kvcnt > 0) {
             for (j = 0; j < kvsi[i].kvsi_fcnt; j++) {
                 bak[job].bak_kvs = kvsi[i].kvsi_kvs;
+                bak[job].bak_ver = ver;
                 len = snprintf(
                     bak[job].bak_fname,
                     sizeof(bak[job].bak_fname),
@@ -3645,9 +6354,102 @@ errout:
 }
 
 /**
- * ikvdb_kvs_export(): worker function for exporting a kvs into
- *                     one or multiple data files, each data file
- *                     has a 4GB size limit
+ * ikvdb_export_chunk() - compress a chunk of k-v pairs and append it to
+ *                        the current data file, or to a new one if the
+ *                        current file exceeds the size limit
+ * @bak:   export job
+ * @fp:    (in/out) current data file, NULL if none
+ * @fsize: (in/out) size of the current data file
+ * @ubuf:  k-v pairs
+ * @ulen:  length of @ubuf
+ * @kvcnt: number of k-v pairs in @ubuf
+ * @cbuf:  buffer of compress_lz4_bound(KVDB_EXPORT_CHUNK_SZ) bytes
+ */
+static merr_t
+ikvdb_export_chunk(
+    struct kvdb_bak_work *bak,
+    FILE **               fp,
+    u64 *                 fsize,
+    const void *          ubuf,
+    uint                  ulen,
+    uint                  kvcnt,
+    void *                cbuf)
+{
+    struct kvdb_chunk_omf chk;
+    const void *          data = cbuf;
+    char                  fname[PATH_MAX];
+    uint                  clen, comp = KVDB_EXPORT_COMP_LZ4;
+    merr_t                err;
+    int                   fd, len;
+
+    if (!*fp || *fsize > KVDB_EXPORT_FSIZE_MAX) {
+        if (*fp) {
+            if (fclose(*fp))
+                return merr(ev(errno, HSE_ERR));
+            *fp = NULL;
+        }
+
+        /* Data files of a kvs are numbered in order of creation by
+         * all the workers exporting it.
+         */
+        len = snprintf(
+            fname, sizeof(fname), "%s_%d", bak->bak_fname, atomic_inc_return(bak->bak_fseq) - 1);
+        if (len >= sizeof(fname)) {
+            err = merr(EINVAL);
+            hse_elog(HSE_ERR "File name %s is truncated, @@e", err, fname);
+            return err;
+        }
+
+        fd = open(fname, O_CREAT | O_TRUNC | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            err = merr(errno);
+            hse_elog(HSE_ERR "Failed to open file %s, @@e", err, fname);
+            return err;
+        }
+
+        *fp = fdopen(fd, "w");
+        if (!*fp) {
+            close(fd);
+            err = merr(errno);
+            hse_elog(HSE_ERR "Failed to fdopen file %s, @@e", err, fname);
+            return err;
+        }
+
+        *fsize = 0;
+        bak->bak_fcnt++;
+    }
+
+    /* Store incompressible chunks as is. */
+    err = compress_lz4(ubuf, ulen, cbuf, compress_lz4_bound(KVDB_EXPORT_CHUNK_SZ), &clen);
+    if (ev(err) || clen >= ulen) {
+        data = ubuf;
+        clen = ulen;
+        comp = KVDB_EXPORT_COMP_NONE;
+    }
+
+    omf_set_chk_magic(&chk, KVDB_EXPORT_CHUNK_MAGIC);
+    omf_set_chk_comp(&chk, comp);
+    omf_set_chk_ulen(&chk, ulen);
+    omf_set_chk_clen(&chk, clen);
+    omf_set_chk_kvcnt(&chk, kvcnt);
+    omf_set_chk_crc(&chk, XXH32(data, clen, 0));
+
+    if (fwrite(&chk, sizeof(chk), 1, *fp) != 1 || fwrite(data, clen, 1, *fp) != 1) {
+        err = merr(EIO);
+        hse_elog(HSE_ERR "Failed to write to %s data files, @@e", err, bak->bak_fname);
+        return err;
+    }
+
+    *fsize += sizeof(chk) + clen;
+
+    return 0;
+}
+
+/**
+ * ikvdb_kvs_export(): worker function for exporting a key range of a kvs
+ *                     into one or multiple data files of compressed,
+ *                     checksummed chunks, each data file has a 4GB
+ *                     size limit
  * @work
  */
 static void
@@ -3656,89 +6458,171 @@ ikvdb_kvs_export(struct work_struct *work)
     struct kvdb_bak_work * bak;
     struct hse_kvs_cursor *cur;
     struct kvdb_kvmeta_omf kvmt;
+    struct kvs_ktuple      kt;
     const void *           key, *val;
     size_t                 klen, vlen;
     bool                   eof;
-    FILE *                 f = 0;
-    int                    fd;
-    u64                    fsize = -1;
-    int                    filecnt = 0;
-    char                   fname[PATH_MAX];
-    int                    len;
+    FILE *                 f = NULL;
+    u64                    fsize = 0;
+    void *                 ubuf, *cbuf;
+    uint                   ulen = 0, kvcnt = 0;
+    merr_t                 err;
 
     bak = container_of(work, struct kvdb_bak_work, bak_work);
-    bak->bak_err = 0;
+    bak->bak_fcnt = 0;
     bak->bak_kvcnt = 0;
 
-    cur = bak->bak_cur;
+    ubuf = malloc(KVDB_EXPORT_CHUNK_SZ);
+    cbuf = malloc(compress_lz4_bound(KVDB_EXPORT_CHUNK_SZ));
+    if (!ubuf || !cbuf) {
+        err = merr(ev(ENOMEM, HSE_ERR));
+        goto errout;
+    }
+
+    err = ikvdb_kvs_cursor_create(bak->bak_kvs, NULL, NULL, 0, &cur);
+    if (ev(err, HSE_ERR))
+        goto errout;
+
+    if (bak->bak_startlen) {
+        err = ikvdb_kvs_cursor_seek(cur, NULL, bak->bak_start, bak->bak_startlen, NULL, 0, &kt);
+        if (ev(err, HSE_ERR))
+            goto errout_cur;
+    }
 
     eof = false;
 
     while (true) {
-        /*
-         * Create a new data file, if the current one exceeds
-         * the size limit
-         */
-        if (fsize > KVDB_EXPORT_FSIZE_MAX) {
-            len = snprintf(fname, sizeof(fname), "%s_%d", bak->bak_fname, filecnt);
-
-            if (len >= sizeof(fname)) {
-                bak->bak_err = merr(EINVAL);
-                hse_elog(
-                    HSE_ERR "File name %s is truncated,"
-                            " @@e",
-                    bak->bak_err,
-                    fname);
-                break;
-            }
+        err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
+        if (ev(err, HSE_ERR))
+            break;
 
-            if (f) {
-                fclose(f);
-                f = NULL;
-            }
+        if (eof)
+            break;
 
-            fsize = 0;
-            filecnt++;
+        if (bak->bak_endlen && keycmp(key, klen, bak->bak_end, bak->bak_endlen) >= 0)
+            break;
 
-            fd = open(fname, O_CREAT | O_TRUNC | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
-            if (fd < 0) {
-                bak->bak_err = merr(errno);
-                hse_elog(HSE_ERR "Failed to open file %s, @@e", bak->bak_err, fname);
+        if (ulen + sizeof(kvmt) + klen + vlen > KVDB_EXPORT_CHUNK_SZ) {
+            err = ikvdb_export_chunk(bak, &f, &fsize, ubuf, ulen, kvcnt, cbuf);
+            if (err)
                 break;
-            }
-            f = fdopen(fd, "w");
-            if (!f) {
-                close(fd);
-                bak->bak_err = merr(errno);
-                hse_elog(HSE_ERR "Failed to fdopen file %s,@@e", bak->bak_err, fname);
-                break;
-            }
-        }
 
-        bak->bak_err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
-        if (ev(bak->bak_err, HSE_ERR))
-            break;
-
-        if (eof)
-            break;
+            ulen = kvcnt = 0;
+        }
 
         /* Convert kvmt to little endian, if needed */
         omf_set_kvmt_klen(&kvmt, klen);
         omf_set_kvmt_vlen(&kvmt, vlen);
-        fwrite(&kvmt, sizeof(kvmt), 1, f);
-        fwrite(key, sizeof(char), klen, f);
-        fwrite(val, sizeof(char), vlen, f);
+        memcpy(ubuf + ulen, &kvmt, sizeof(kvmt));
+        memcpy(ubuf + ulen + sizeof(kvmt), key, klen);
+        memcpy(ubuf + ulen + sizeof(kvmt) + klen, val, vlen);
+        ulen += sizeof(kvmt) + klen + vlen;
 
+        kvcnt++;
         bak->bak_kvcnt++;
-        fsize += klen + vlen + sizeof(klen) + sizeof(vlen);
     }
 
-    if (f)
-        fclose(f);
+    if (!err && kvcnt)
+        err = ikvdb_export_chunk(bak, &f, &fsize, ubuf, ulen, kvcnt, cbuf);
+
+    if (f && fclose(f) && !err)
+        err = merr(ev(errno, HSE_ERR));
+
+errout_cur:
+    ikvdb_kvs_cursor_destroy(cur);
+
+errout:
+    free(cbuf);
+    free(ubuf);
+
+    bak->bak_err = err;
+}
+
+/**
+ * ikvdb_export_split() - split the keys of a kvs into ranges to export
+ *                        in parallel
+ * @kvs:   kvs
+ * @bak:   export jobs, the bounds of the first @nr are set
+ * @nr:    maximum number of ranges
+ *
+ * The ranges split the span of the first byte at which the smallest and
+ * largest keys of the kvs differ, so keys with a long common prefix are
+ * still split.  The first range has no lower bound and the last range no
+ * upper bound, so keys added after the split are not missed.
+ *
+ * Return: the number of ranges, at least one
+ */
+static int
+ikvdb_export_split(struct hse_kvs *kvs, struct kvdb_bak_work *bak, int nr)
+{
+    struct hse_kvdb_opspec opspec;
+    struct hse_kvs_cursor *cur;
+    const void *           key, *val;
+    size_t                 klen, vlen;
+    u8                     minkey[HSE_KVS_KLEN_MAX], maxkey[HSE_KVS_KLEN_MAX];
+    size_t                 minlen = 0, maxlen = 0, pfxlen;
+    uint                   lo, hi, span;
+    bool                   eof;
+    merr_t                 err;
+    int                    i;
+
+    if (nr < 2)
+        return 1;
+
+    err = ikvdb_kvs_cursor_create(kvs, NULL, NULL, 0, &cur);
+    if (ev(err))
+        return 1;
+
+    err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
+    if (!err && !eof) {
+        memcpy(minkey, key, klen);
+        minlen = klen;
+    }
+    ikvdb_kvs_cursor_destroy(cur);
+
+    if (ev(err) || eof)
+        return 1;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_flags = HSE_KVDB_KOP_FLAG_REVERSE;
+
+    err = ikvdb_kvs_cursor_create(kvs, &opspec, NULL, 0, &cur);
+    if (ev(err))
+        return 1;
 
+    err = ikvdb_kvs_cursor_read(cur, &opspec, &key, &klen, &val, &vlen, &eof);
+    if (!err && !eof) {
+        memcpy(maxkey, key, klen);
+        maxlen = klen;
+    }
     ikvdb_kvs_cursor_destroy(cur);
 
-    bak->bak_fcnt = filecnt;
+    if (ev(err) || eof)
+        return 1;
+
+    for (pfxlen = 0; pfxlen < minlen && pfxlen < maxlen; ++pfxlen)
+        if (minkey[pfxlen] != maxkey[pfxlen])
+            break;
+
+    if (pfxlen >= maxlen)
+        return 1;
+
+    lo = pfxlen < minlen ? minkey[pfxlen] : 0;
+    hi = maxkey[pfxlen];
+    span = hi - lo + 1;
+    nr = min_t(uint, nr, span);
+
+    /* Range i starts at the common prefix followed by its first byte. */
+    for (i = 1; i < nr; ++i) {
+        memcpy(bak[i].bak_start, maxkey, pfxlen);
+        bak[i].bak_start[pfxlen] = lo + i * span / nr;
+        bak[i].bak_startlen = pfxlen + 1;
+
+        memcpy(bak[i - 1].bak_end, bak[i].bak_start, pfxlen + 1);
+        bak[i - 1].bak_endlen = pfxlen + 1;
+    }
+
+    return nr;
 }
 
 /**
@@ -3805,6 +6689,10 @@ ikvdb_export_toc(
         cJSON_AddNumberToObject(kvs, "pfx_pivot", kvs_cparams[i].cp_pfx_pivot);
         cJSON_AddNumberToObject(kvs, "fanout", kvs_cparams[i].cp_fanout);
         cJSON_AddNumberToObject(kvs, "kvs_ext01", kvs_cparams[i].cp_kvs_ext01);
+        cJSON_AddNumberToObject(kvs, "vcomp", kvs_cparams[i].cp_vcomp);
+        cJSON_AddNumberToObject(kvs, "range", kvs_cparams[i].cp_range);
+        cJSON_AddNumberToObject(kvs, "ptlookup", kvs_cparams[i].cp_ptlookup);
+        cJSON_AddNumberToObject(kvs, "kfixed", kvs_cparams[i].cp_kfixed);
         cJSON_AddItemToArray(KVSs, kvs);
     }
 
@@ -3862,10 +6750,9 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
     merr_t                   err;
     int                      i;
     struct hse_kvs *         kvs;
-    struct hse_kvs_cursor *  cur;
-    struct hse_kvdb_opspec   opspec = { 0 };
-    struct workqueue_struct *wq;
-    struct kvdb_bak_work *   bak;
+    struct workqueue_struct *wq = NULL;
+    struct kvdb_bak_work *   bak, *work;
+    atomic_t *               fseqv;
     time_t                   t;
     char                     pname[PATH_MAX];
     int                      rc;
@@ -3873,6 +6760,8 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
     char                     timestr[128];
     int                      done = 0;
     int                      len;
+    int                      nr, jobs = 0;
+    int                      j;
 
     if (access(path, W_OK)) {
         err = merr(errno);
@@ -3931,20 +6820,19 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
     if (count == 0)
         return 0;
 
-    bak = calloc(count, sizeof(*bak));
-    if (!bak) {
-        ikvdb_free_names(handle, kvsv);
-        return merr(ev(ENOMEM, HSE_ERR));
-    }
+    /* Each kvs is split into up to nr key ranges, exported in parallel. */
+    nr = clamp_t(int, num_online_cpus(), 1, KVDB_EXPORT_RANGES_MAX);
 
+    bak = calloc(count, sizeof(*bak));
+    work = calloc(count * nr, sizeof(*work));
+    fseqv = calloc(count, sizeof(*fseqv));
     kvs_cparams = calloc(count, sizeof(*kvs_cparams));
-    if (!kvs_cparams) {
-        free(bak);
-        ikvdb_free_names(handle, kvsv);
-        return merr(ev(ENOMEM, HSE_ERR));
+    if (!bak || !work || !fseqv || !kvs_cparams) {
+        err = merr(ev(ENOMEM, HSE_ERR));
+        goto errout;
     }
 
-    wq = alloc_workqueue("dbexport", 0, count);
+    wq = alloc_workqueue("dbexport", 0, clamp_t(int, num_online_cpus(), 1, WQ_MAX_ACTIVE));
     if (!wq) {
         err = merr(ENOMEM);
         hse_elog(HSE_ERR "Failed to alloc export workqueues, @@e", err);
@@ -3952,7 +6840,7 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
     }
 
     for (i = 0; i < count; i++) {
-        int n;
+        int n, ranges;
 
         err = ikvdb_kvs_open(handle, kvsv[i], 0, 0, &kvs);
         if (err) {
@@ -3965,17 +6853,14 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
         kvs_cparams[i].cp_fanout = ((struct kvdb_kvs *)kvs)->kk_cparams->cp_fanout;
         kvs_cparams[i].cp_kvs_ext01 =
             (((struct kvdb_kvs *)kvs)->kk_flags & CN_CFLAG_CAPPED) ? 1 : 0;
-
-        err = ikvdb_kvs_cursor_create(kvs, &opspec, NULL, 0, &cur);
-        if (err) {
-            hse_elog(
-                HSE_ERR "Failed to create cursor for kvdb"
-                        " %s kvs %s, @@e",
-                err,
-                kvdb->ikdb_mpname,
-                kvsv[i]);
-            goto errout;
-        }
+        kvs_cparams[i].cp_vcomp = (((struct kvdb_kvs *)kvs)->kk_flags & CN_CFLAG_VCOMP_LZ4)
+            ? VCOMP_ALGO_LZ4
+            : VCOMP_ALGO_NONE;
+        kvs_cparams[i].cp_range =
+            (((struct kvdb_kvs *)kvs)->kk_flags & CN_CFLAG_RANGE) ? 1 : 0;
+        kvs_cparams[i].cp_ptlookup =
+            (((struct kvdb_kvs *)kvs)->kk_flags & CN_CFLAG_PTLOOKUP) ? 1 : 0;
+        kvs_cparams[i].cp_kfixed = cn_cflags_kfixed(((struct kvdb_kvs *)kvs)->kk_flags);
 
         bak[i].bak_kvs = kvs;
         n = snprintf(bak[i].bak_fname, sizeof(bak[i].bak_fname), "%s/%s", pname, kvsv[i]);
@@ -3984,25 +6869,45 @@ ikvdb_export(struct ikvdb *handle, struct kvdb_cparams *kvdb_cparams, const char
             goto errout;
         }
 
-        bak[i].bak_cur = cur;
-        INIT_WORK(&bak[i].bak_work, ikvdb_kvs_export);
-        queue_work(wq, &bak[i].bak_work);
+        atomic_set(&fseqv[i], 0);
+
+        ranges = ikvdb_export_split(kvs, work + jobs, nr);
+
+        for (j = 0; j < ranges; j++, jobs++) {
+            work[jobs].bak_kvs = kvs;
+            work[jobs].bak_fseq = &fseqv[i];
+            strlcpy(work[jobs].bak_fname, bak[i].bak_fname, sizeof(work[jobs].bak_fname));
+
+            INIT_WORK(&work[jobs].bak_work, ikvdb_kvs_export);
+            queue_work(wq, &work[jobs].bak_work);
+        }
     }
 
 errout:
     /* Wait for all exporting jobs finish */
     destroy_workqueue(wq);
 
-    /* Check the status of all dump threads */
-    if (!err) {
-        for (i = 0; i < count; i++) {
-            if (bak[i].bak_err)
-                err = bak[i].bak_err;
-            else
-                done++;
+    /* Check the status of all dump threads, and sum up their
+     * results by kvs
+     */
+    for (j = 0; j < jobs; j++) {
+        i = work[j].bak_fseq - fseqv;
+
+        bak[i].bak_kvcnt += work[j].bak_kvcnt;
+
+        if (work[j].bak_err) {
+            if (!err)
+                err = work[j].bak_err;
+        } else {
+            done++;
         }
     }
 
+    for (i = 0; !err && i < count; i++)
+        bak[i].bak_fcnt = atomic_read(&fseqv[i]);
+
+    hse_log(HSE_DEBUG "%d out of %d export jobs have completed", done, jobs);
+
     /* Dump the export summary/meta data to TOC file */
     if (!err)
         err =
@@ -4010,6 +6915,8 @@ errout:
 
     ikvdb_free_names(handle, kvsv);
     free(kvs_cparams);
+    free(fseqv);
+    free(work);
     free(bak);
     return err;
 }
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/mutex.h>
+#include <hse_util/condvar.h>
+#include <hse_util/list.h>
+#include <hse_util/minmax.h>
+#include <hse_util/event_counter.h>
+
+#include <hse_ikvdb/io_sched.h>
+
+#define IOS_MCLASS_MAX (MP_MED_CAPACITY + 1)
+
+/* Virtual time advances by this much per byte of a class of weight 1.
+ */
+#define IOS_VT_SCALE (1024)
+
+/**
+ * struct ios_class - fixed properties of a class
+ * @ic_name:     name (REST)
+ * @ic_weight:   share of the queue when all classes are backlogged
+ * @ic_lat_ns:   deadline, relative to arrival
+ */
+static const struct ios_class {
+    const char *ic_name;
+    uint        ic_weight;
+    u64         ic_lat_ns;
+} ios_classv[IOS_CLASS_CNT] = {
+    [IOS_FG_READ] = { "fg_read", 8, 2 * NSEC_PER_SEC / 1000 },
+    [IOS_C1] = { "c1", 4, 5 * NSEC_PER_SEC / 1000 },
+    [IOS_INGEST] = { "ingest", 2, 50 * NSEC_PER_SEC / 1000 },
+    [IOS_COMPACT] = { "compact", 1, 500 * NSEC_PER_SEC / 1000 },
+};
+
+/**
+ * struct ios_waiter - an I/O waiting for admission (on the waiter's stack)
+ * @w_link:     link on its class' wait list
+ * @w_deadline: time by which it should be dispatched
+ * @w_vtag:     virtual start time, for fair queuing
+ * @w_cv:       signaled on admission
+ * @w_go:       admitted
+ */
+struct ios_waiter {
+    struct list_head w_link;
+    u64              w_deadline;
+    u64              w_vtag;
+    struct cv        w_cv;
+    bool             w_go;
+};
+
+/**
+ * struct ios_queue - per media class admission queue
+ * @q_lock:    protects all fields
+ * @q_busy:    I/Os in flight
+ * @q_waiters: I/Os waiting for admission
+ * @q_vtime:   virtual time, the tag of the last dispatched waiter
+ * @q_vlast:   tag of the last waiter enqueued, by class
+ * @q_waitv:   waiters in arrival order, by class
+ * @q_statsv:  activity, by class
+ */
+struct ios_queue {
+    struct mutex          q_lock;
+    uint                  q_busy;
+    uint                  q_waiters;
+    u64                   q_vtime;
+    u64                   q_vlast[IOS_CLASS_CNT];
+    struct list_head      q_waitv[IOS_CLASS_CNT];
+    struct io_sched_stats q_statsv[IOS_CLASS_CNT];
+} __aligned(SMP_CACHE_BYTES);
+
+/**
+ * struct io_sched - kvdb I/O scheduler
+ * @ios_qd:     I/Os in flight per media class
+ * @ios_latv:   deadlines, by class
+ * @ios_qv:     queues, by media class
+ */
+struct io_sched {
+    uint             ios_qd;
+    u64              ios_latv[IOS_CLASS_CNT];
+    struct ios_queue ios_qv[IOS_MCLASS_MAX];
+};
+
+static inline struct ios_queue *
+ios_queue(struct io_sched *ios, uint mclass)
+{
+    return ios->ios_qv + (mclass < IOS_MCLASS_MAX ? mclass : MP_MED_CAPACITY);
+}
+
+/* Pick the next waiter to dispatch: the one most overdue if any,
+ * else the one with the lowest virtual start time.  Classes are in
+ * order of decreasing weight, so ties go to the heavier class.
+ */
+static struct ios_waiter *
+ios_pick(struct ios_queue *q, u64 now)
+{
+    struct ios_waiter *late = NULL, *fair = NULL;
+    int                i;
+
+    for (i = 0; i < IOS_CLASS_CNT; ++i) {
+        struct ios_waiter *w;
+
+        w = list_first_entry_or_null(&q->q_waitv[i], struct ios_waiter, w_link);
+        if (!w)
+            continue;
+
+        if (w->w_deadline <= now && (!late || w->w_deadline < late->w_deadline))
+            late = w;
+
+        if (!fair || w->w_vtag < fair->w_vtag)
+            fair = w;
+    }
+
+    return late ?: fair;
+}
+
+void
+io_sched_enter(struct io_sched *ios, uint mclass, enum io_sched_class cls, size_t len)
+{
+    struct io_sched_stats *stats;
+    struct ios_waiter      w;
+    struct ios_queue *     q;
+    u64                    start, dt;
+
+    if (!ios)
+        return;
+
+    q = ios_queue(ios, mclass);
+    stats = q->q_statsv + cls;
+
+    mutex_lock(&q->q_lock);
+    stats->iss_ops++;
+    stats->iss_bytes += len;
+
+    if (q->q_busy < ios->ios_qd && !q->q_waiters) {
+        q->q_busy++;
+        mutex_unlock(&q->q_lock);
+        return;
+    }
+
+    start = get_time_ns();
+
+    w.w_deadline = start + ios->ios_latv[cls];
+    w.w_vtag = max(q->q_vtime, q->q_vlast[cls]);
+    w.w_go = false;
+    cv_init(&w.w_cv, "ios_wait");
+
+    q->q_vlast[cls] = w.w_vtag + len * IOS_VT_SCALE / ios_classv[cls].ic_weight;
+
+    list_add_tail(&w.w_link, &q->q_waitv[cls]);
+    q->q_waiters++;
+
+    while (!w.w_go)
+        cv_wait(&w.w_cv, &q->q_lock);
+
+    dt = get_time_ns() - start;
+    stats->iss_waits++;
+    stats->iss_wait_ns += dt;
+    if (dt > stats->iss_max_ns)
+        stats->iss_max_ns = dt;
+    mutex_unlock(&q->q_lock);
+
+    cv_destroy(&w.w_cv);
+}
+
+void
+io_sched_exit(struct io_sched *ios, uint mclass)
+{
+    struct ios_queue *q;
+
+    if (!ios)
+        return;
+
+    q = ios_queue(ios, mclass);
+
+    mutex_lock(&q->q_lock);
+    assert(q->q_busy > 0);
+    q->q_busy--;
+
+    /* The admitted I/O inherits the slot, so q_busy does not change. */
+    if (q->q_waiters && q->q_busy < ios->ios_qd) {
+        struct ios_waiter *w;
+
+        w = ios_pick(q, get_time_ns());
+
+        list_del(&w->w_link);
+        q->q_waiters--;
+        q->q_busy++;
+        q->q_vtime = max(q->q_vtime, w->w_vtag);
+
+        w->w_go = true;
+        cv_signal(&w->w_cv);
+    }
+    mutex_unlock(&q->q_lock);
+}
+
+void
+io_sched_stats(
+    struct io_sched *      ios,
+    uint                   mclass,
+    enum io_sched_class    cls,
+    struct io_sched_stats *stats)
+{
+    struct ios_queue *q = ios_queue(ios, mclass);
+
+    mutex_lock(&q->q_lock);
+    *stats = q->q_statsv[cls];
+    mutex_unlock(&q->q_lock);
+}
+
+const char *
+io_sched_class_name(enum io_sched_class cls)
+{
+    return cls < IOS_CLASS_CNT ? ios_classv[cls].ic_name : "invalid";
+}
+
+merr_t
+io_sched_create(uint qd, u64 fg_lat_ns, struct io_sched **iosp)
+{
+    struct io_sched *ios;
+    int              i, j;
+
+    if (ev(qd < 1 || qd > IO_SCHED_QD_MAX))
+        return merr(EINVAL);
+
+    ios = alloc_aligned(sizeof(*ios), SMP_CACHE_BYTES, GFP_KERNEL);
+    if (ev(!ios))
+        return merr(ENOMEM);
+
+    memset(ios, 0, sizeof(*ios));
+    ios->ios_qd = qd;
+
+    for (i = 0; i < IOS_CLASS_CNT; ++i)
+        ios->ios_latv[i] = ios_classv[i].ic_lat_ns;
+
+    if (fg_lat_ns)
+        ios->ios_latv[IOS_FG_READ] = fg_lat_ns;
+
+    for (i = 0; i < IOS_MCLASS_MAX; ++i) {
+        struct ios_queue *q = ios->ios_qv + i;
+
+        mutex_init(&q->q_lock);
+        for (j = 0; j < IOS_CLASS_CNT; ++j)
+            INIT_LIST_HEAD(&q->q_waitv[j]);
+    }
+
+    *iosp = ios;
+
+    return 0;
+}
+
+void
+io_sched_destroy(struct io_sched *ios)
+{
+    int i;
+
+    if (!ios)
+        return;
+
+    for (i = 0; i < IOS_MCLASS_MAX; ++i) {
+        assert(ios->ios_qv[i].q_busy == 0);
+        mutex_destroy(&ios->ios_qv[i].q_lock);
+    }
+
+    free_aligned(ios);
+}
@@ -14,6 +14,7 @@
 #include <hse_util/page.h>
 #include <hse_util/delay.h>
 #include <hse_util/event_counter.h>
+#include <hse_util/minmax.h>
 
 #include <hse_ikvdb/kvs.h>
 #include <hse_ikvdb/kvdb_ctxn.h>
@@ -38,13 +39,31 @@ struct kvdb_ctxn_set {
  * @ktn_txn_timeout:      max time to live (in msecs) after which txn is aborted
  * @ktn_tseqno_head:
  * @ktn_tseqno_tail:
+ * @ktn_group_lock:   protects ktn_group_pending
+ * @ktn_group_pending: merge commits waiting for a commit seqno
+ * @ktn_group_busy:   a leader is handing out commit seqnos
  * @ktn_list_mutex:   protects updates to list of allocated transactions
  * @ktn_alloc_list:   RCU list of allocated transactions
  * @ktn_pending:      transactions to be freed when reader thread finishes
  * @ktn_reading:      indicates whether the worker thread is reading the list
  * @ktn_queued:       has the worker thread been queued
  * @ktn_dwork:        delayed work struct
+ * @ktn_wheel_ns:     width of an expiry wheel slot
+ * @ktn_wheel_next:   first wheel tick not yet fully processed
+ * @ktn_wheel:        expiry wheel of active and idle transactions
  */
+#define KVDB_CTXN_WHEEL_SLOTS 256
+
+/**
+ * struct kvdb_ctxn_slot - one slot of the txn expiry wheel
+ * @kcs_lock:   protects kcs_list and the ctxn_wheel_slot of its members
+ * @kcs_list:   txns whose deadline falls in this slot (in any lap)
+ */
+struct kvdb_ctxn_slot {
+    spinlock_t       kcs_lock;
+    struct list_head kcs_list;
+} __aligned(SMP_CACHE_BYTES);
+
 struct kvdb_ctxn_set_impl {
     struct kvdb_ctxn_set     ktn_handle;
     struct workqueue_struct *ktn_wq;
@@ -55,16 +74,40 @@ struct kvdb_ctxn_set_impl {
 
     __aligned(SMP_CACHE_BYTES) atomic64_t ktn_tseqno_tail;
 
+    __aligned(SMP_CACHE_BYTES) spinlock_t ktn_group_lock;
+    struct list_head ktn_group_pending;
+    atomic_t         ktn_group_busy;
+
     __aligned(SMP_CACHE_BYTES) struct mutex ktn_list_mutex;
     struct cds_list_head ktn_alloc_list;
     struct list_head     ktn_pending;
     atomic_t             ktn_reading;
     bool                 ktn_queued;
     struct delayed_work  ktn_dwork;
+
+    u64                   ktn_wheel_ns;
+    u64                   ktn_wheel_next;
+    struct kvdb_ctxn_slot ktn_wheel[KVDB_CTXN_WHEEL_SLOTS];
 };
 
 #define kvdb_ctxn_set_h2r(handle) container_of(handle, struct kvdb_ctxn_set_impl, ktn_handle)
 
+/* Max number of groups a commit seqno leader serves before stepping down.
+ */
+#define KVDB_CTXN_GROUP_MAX 8
+
+/**
+ * struct kvdb_ctxn_waiter - a merge commit waiting for its commit seqno
+ * @kcw_link:   ktn_group_pending linkage
+ * @kcw_sn:     commit seqno, valid once kcw_done is set
+ * @kcw_done:   set by the leader that assigned kcw_sn
+ */
+struct kvdb_ctxn_waiter {
+    struct list_head kcw_link;
+    u64              kcw_sn;
+    atomic_t         kcw_done;
+};
+
 static inline void
 kvdb_ctxn_bind_putref(struct kvdb_ctxn_bind *bind)
 {
@@ -109,15 +152,163 @@ kvdb_ctxn_unlock(struct kvdb_ctxn_impl *ctxn)
     assert(old == 1);
 }
 
+/* The expiry worker takes the txn lock as 2 so that begin and free can
+ * tell it apart from a concurrent caller and wait it out.
+ */
+static __always_inline bool
+kvdb_ctxn_trylock_reaper(struct kvdb_ctxn_impl *ctxn)
+{
+    return atomic_cmpxchg(&ctxn->ctxn_lock, 0, 2) == 0;
+}
+
+static __always_inline void
+kvdb_ctxn_unlock_reaper(struct kvdb_ctxn_impl *ctxn)
+{
+    int old __maybe_unused;
+
+    old = atomic_cmpxchg(&ctxn->ctxn_lock, 2, 0);
+    assert(old == 2);
+}
+
+static __always_inline bool
+kvdb_ctxn_lock_wait_reaper(struct kvdb_ctxn_impl *ctxn)
+{
+    int old;
+
+    while ((old = atomic_cmpxchg(&ctxn->ctxn_lock, 0, 1)) != 0) {
+        if (old != 2)
+            return false;
+
+        __builtin_ia32_pause();
+    }
+
+    return true;
+}
+
+/* Active and idle transactions sit on a timer wheel, hashed by their
+ * deadline: txn_timeout after begin for an active txn, or after its
+ * last commit/abort for an idle one.  The worker thread only visits
+ * the slots whose time has come, so its cost is proportional to the
+ * number of txns that expire rather than to the number allocated.
+ */
+static void
+kvdb_ctxn_wheel_insert(struct kvdb_ctxn_impl *ctxn, u64 deadline)
+{
+    struct kvdb_ctxn_set_impl *ktn = kvdb_ctxn_set_h2r(ctxn->ctxn_kvdb_ctxn_set);
+    struct kvdb_ctxn_slot *    slot;
+
+    assert(!ctxn->ctxn_wheel_slot);
+
+    slot = ktn->ktn_wheel + (deadline / ktn->ktn_wheel_ns) % KVDB_CTXN_WHEEL_SLOTS;
+
+    spin_lock(&slot->kcs_lock);
+    ctxn->ctxn_deadline = deadline;
+    list_add_tail(&ctxn->ctxn_wheel_link, &slot->kcs_list);
+    ctxn->ctxn_wheel_slot = slot;
+    spin_unlock(&slot->kcs_lock);
+}
+
+static void
+kvdb_ctxn_wheel_remove(struct kvdb_ctxn_impl *ctxn)
+{
+    struct kvdb_ctxn_slot *slot;
+
+    /* The worker may take the txn off the wheel at any time, but
+     * nothing else moves it.
+     */
+    slot = READ_ONCE(ctxn->ctxn_wheel_slot);
+    if (!slot)
+        return;
+
+    spin_lock(&slot->kcs_lock);
+    if (ctxn->ctxn_wheel_slot == slot) {
+        list_del(&ctxn->ctxn_wheel_link);
+        ctxn->ctxn_wheel_slot = NULL;
+    }
+    spin_unlock(&slot->kcs_lock);
+}
+
+static void
+kvdb_ctxn_wheel_rearm(struct kvdb_ctxn_impl *ctxn, u64 now)
+{
+    struct kvdb_ctxn_set_impl *ktn = kvdb_ctxn_set_h2r(ctxn->ctxn_kvdb_ctxn_set);
+
+    kvdb_ctxn_wheel_remove(ctxn);
+    kvdb_ctxn_wheel_insert(ctxn, now + ktn->ktn_txn_timeout * 1000000UL);
+}
+
+static void
+kvdb_ctxn_abort_inner(struct kvdb_ctxn_impl *ctxn);
+
+/* An idle txn keeps its kvms for its next begin in ctxn_kvms_idle.
+ * Begin, free and the expiry worker each take it from there with an
+ * atomic exchange, so the worker can reclaim it without the txn lock
+ * and only one of them ever releases it.  Caller holds the txn lock.
+ */
+static void
+kvdb_ctxn_kvms_park(struct kvdb_ctxn_impl *ctxn)
+{
+    struct c0_kvmultiset *kvms;
+
+    kvms = atomic_ptr_exchange((void **)&ctxn->ctxn_kvms_idle, ctxn->ctxn_kvms);
+    ctxn->ctxn_kvms = NULL;
+
+    if (kvms)
+        c0kvms_putref(kvms);
+}
+
+static struct c0_kvmultiset *
+kvdb_ctxn_kvms_unpark(struct kvdb_ctxn_impl *ctxn)
+{
+    return atomic_ptr_exchange((void **)&ctxn->ctxn_kvms_idle, NULL);
+}
+
+/**
+ * kvdb_ctxn_expire() - abort an expired txn, or reclaim an idle one
+ * @ctxn: txn taken off the wheel by the worker thread
+ *
+ * The txn may have been used again since the worker took it off the
+ * wheel, in which case its deadline will have moved and we leave it be.
+ * Only an active txn is locked, an idle one may be begun or freed by
+ * its owner at any time.
+ */
+static void
+kvdb_ctxn_expire(struct kvdb_ctxn_impl *ctxn)
+{
+    struct c0_kvmultiset *kvms;
+
+    if (READ_ONCE(ctxn->ctxn_deadline) != ctxn->ctxn_reap_deadline ||
+        READ_ONCE(ctxn->ctxn_wheel_slot))
+        return;
+
+    if (seqnoref_to_state(READ_ONCE(ctxn->ctxn_seqref)) != KVDB_CTXN_ACTIVE) {
+        /* Idle for a whole txn_timeout, give back its kvms. */
+        kvms = kvdb_ctxn_kvms_unpark(ctxn);
+        if (kvms)
+            c0kvms_putref(kvms);
+        return;
+    }
+
+    if (!kvdb_ctxn_trylock_reaper(ctxn))
+        return;
+
+    if (ctxn->ctxn_deadline == ctxn->ctxn_reap_deadline && !ctxn->ctxn_wheel_slot &&
+        seqnoref_to_state(ctxn->ctxn_seqref) == KVDB_CTXN_ACTIVE) {
+        kvdb_ctxn_abort_inner(ctxn);
+        kvdb_ctxn_kvms_park(ctxn);
+    }
+
+    kvdb_ctxn_unlock_reaper(ctxn);
+}
+
 static void
 kvdb_ctxn_set_thread(struct work_struct *work)
 {
-    enum kvdb_ctxn_state       state;
     struct list_head           freelist, alist;
     struct kvdb_ctxn_impl *    ctxn = 0, *next = 0;
     struct kvdb_ctxn_set_impl *ktn;
-    u64                        now;
-    u64                        ttl_ns;
+    struct kvdb_ctxn_slot *    slot;
+    u64                        now, tick, last;
 
     INIT_LIST_HEAD(&alist);
 
@@ -125,22 +316,37 @@ kvdb_ctxn_set_thread(struct work_struct *work)
 
     atomic_set(&ktn->ktn_reading, 1);
 
-    /* Abort all active transactions that have expired. */
+    /* Take every txn whose deadline has passed off the wheel.  The
+     * current tick is revisited next time around, as it may hold
+     * deadlines that haven't passed yet.
+     */
     now = get_time_ns();
-    ttl_ns = ktn->ktn_txn_timeout * 1000000UL;
-    rcu_read_lock();
-    cds_list_for_each_entry_rcu(ctxn, &ktn->ktn_alloc_list, ctxn_alloc_link)
-    {
-        state = seqnoref_to_state(ctxn->ctxn_seqref);
-        if (state == KVDB_CTXN_ACTIVE) {
-            if (now > (ctxn->ctxn_begin_ts + ttl_ns))
-                list_add(&ctxn->ctxn_abort_link, &alist);
+    last = now / ktn->ktn_wheel_ns;
+
+    tick = ktn->ktn_wheel_next;
+    if (last - tick >= KVDB_CTXN_WHEEL_SLOTS)
+        tick = last - KVDB_CTXN_WHEEL_SLOTS + 1;
+
+    for (; tick <= last; ++tick) {
+        slot = ktn->ktn_wheel + tick % KVDB_CTXN_WHEEL_SLOTS;
+
+        spin_lock(&slot->kcs_lock);
+        list_for_each_entry_safe (ctxn, next, &slot->kcs_list, ctxn_wheel_link) {
+            if (ctxn->ctxn_deadline > now)
+                continue;
+
+            list_del(&ctxn->ctxn_wheel_link);
+            ctxn->ctxn_reap_deadline = ctxn->ctxn_deadline;
+            ctxn->ctxn_wheel_slot = NULL;
+            list_add_tail(&ctxn->ctxn_abort_link, &alist);
         }
+        spin_unlock(&slot->kcs_lock);
     }
-    rcu_read_unlock();
+
+    ktn->ktn_wheel_next = last;
 
     list_for_each_entry (ctxn, &alist, ctxn_abort_link)
-        kvdb_ctxn_abort(&ctxn->ctxn_inner_handle);
+        kvdb_ctxn_expire(ctxn);
 
     atomic_set(&ktn->ktn_reading, 0);
 
@@ -204,6 +410,8 @@ kvdb_ctxn_alloc(
         ctxn->ctxn_ingest_width = rp->txn_ingest_width;
         ctxn->ctxn_ingest_delay = rp->txn_ingest_delay;
         ctxn->ctxn_heap_sz = rp->txn_heap_sz;
+        ctxn->ctxn_occ = !!rp->txn_occ;
+        ctxn->ctxn_spill_max = rp->txn_spill_max;
     }
 
     mutex_lock(&kvdb_ctxn_set->ktn_list_mutex);
@@ -244,19 +452,38 @@ void
 kvdb_ctxn_free(struct kvdb_ctxn *handle)
 {
     struct kvdb_ctxn_impl *ctxn;
+    struct c0_kvmultiset * kvms;
 
     if (ev(!handle))
         return;
 
-    kvdb_ctxn_abort(handle);
-
     ctxn = kvdb_ctxn_h2r(handle);
 
+    /* Wait out the expiry worker rather than free the txn from under it. */
+    while (!kvdb_ctxn_lock_wait_reaper(ctxn))
+        __builtin_ia32_pause();
+
+    if (seqnoref_to_state(ctxn->ctxn_seqref) == KVDB_CTXN_ACTIVE)
+        kvdb_ctxn_abort_inner(ctxn);
+
+    kvdb_ctxn_kvms_park(ctxn);
+    kvdb_ctxn_wheel_remove(ctxn);
+
+    kvms = kvdb_ctxn_kvms_unpark(ctxn);
+    kvdb_ctxn_unlock(ctxn);
+
     assert(!ctxn->ctxn_bind);
     assert(!ctxn->ctxn_locks_handle);
 
-    if (ctxn->ctxn_kvms)
-        c0kvms_putref(ctxn->ctxn_kvms);
+    if (kvms)
+        c0kvms_putref(kvms);
+
+    free(ctxn->ctxn_wsetv);
+    ctxn->ctxn_wsetv = NULL;
+
+    assert(ctxn->ctxn_spillc == 0);
+    free(ctxn->ctxn_spillv);
+    ctxn->ctxn_spillv = NULL;
 
     kvdb_ctxn_set_remove(ctxn->ctxn_kvdb_ctxn_set, ctxn);
 }
@@ -303,6 +530,102 @@ kvdb_ctxn_enable_inserts(struct kvdb_ctxn_impl *ctxn)
     return 0;
 }
 
+/**
+ * kvdb_ctxn_spill() - set aside a full kvms and continue in a new one
+ * @ctxn: transaction whose ctxn_kvms is full
+ *
+ * A transaction whose write set outgrows txn_heap_sz moves on to a new
+ * kvms, up to txn_spill_max times.  The full kvmses keep their own priv
+ * seqref and stay private until commit, which flushes all of them to
+ * c0sk so that c0 ingest builds them into kvsets with the rest of the
+ * write set.
+ */
+static merr_t
+kvdb_ctxn_spill(struct kvdb_ctxn_impl *ctxn)
+{
+    struct kvdb_ctxn_spill *spill;
+    struct c0_kvmultiset *  kvms;
+    uintptr_t *             priv;
+    merr_t                  err;
+
+    if (ctxn->ctxn_spillc >= ctxn->ctxn_spill_max)
+        return merr(ENOMEM);
+
+    if (!ctxn->ctxn_spillv) {
+        ctxn->ctxn_spillv = calloc(ctxn->ctxn_spill_max, sizeof(*ctxn->ctxn_spillv));
+        if (ev(!ctxn->ctxn_spillv))
+            return merr(ENOMEM);
+    }
+
+    err = c0kvms_create(
+        ctxn->ctxn_ingest_width,
+        ctxn->ctxn_heap_sz,
+        ctxn->ctxn_ingest_delay,
+        ctxn->ctxn_kvdb_seq_addr,
+        !!c0sk_get_mhandle(ctxn->ctxn_c0sk),
+        &kvms);
+    if (ev(err))
+        return err;
+
+    priv = c0kvms_priv_alloc(kvms);
+    if (ev(!priv)) {
+        c0kvms_putref(kvms);
+        return merr(ENOMEM);
+    }
+
+    *priv = HSE_SQNREF_UNDEFINED;
+
+    spill = ctxn->ctxn_spillv + ctxn->ctxn_spillc++;
+    spill->ks_kvms = ctxn->ctxn_kvms;
+    spill->ks_seqref = ctxn->ctxn_seqref;
+
+    ctxn->ctxn_kvms = kvms;
+    ctxn->ctxn_seqref = HSE_REF_TO_SQNREF(priv);
+
+    return 0;
+}
+
+/**
+ * kvdb_ctxn_spill_flush() - flush the spilled kvmses to c0sk
+ * @ctxn: committing transaction
+ *
+ * Must be called before ctxn_kvms is flushed so that the kvmses land
+ * on the c0sk list oldest first.  A successful flush consumes the
+ * kvms's birth reference, so we take another one for the caller to
+ * drop in kvdb_ctxn_spill_release().
+ */
+static merr_t
+kvdb_ctxn_spill_flush(struct kvdb_ctxn_impl *ctxn)
+{
+    merr_t err;
+    u32    i;
+
+    for (i = 0; i < ctxn->ctxn_spillc; ++i) {
+        struct c0_kvmultiset *kvms = ctxn->ctxn_spillv[i].ks_kvms;
+
+        c0kvms_getref(kvms);
+
+        err = c0sk_flush(ctxn->ctxn_c0sk, kvms);
+        if (ev(err)) {
+            c0kvms_putref(kvms);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+static void
+kvdb_ctxn_spill_release(struct kvdb_ctxn_impl *ctxn)
+{
+    while (ctxn->ctxn_spillc > 0) {
+        struct kvdb_ctxn_spill *spill = ctxn->ctxn_spillv + --ctxn->ctxn_spillc;
+
+        c0kvms_priv_release(spill->ks_kvms);
+        c0kvms_putref(spill->ks_kvms);
+    }
+}
+
 merr_t
 kvdb_ctxn_begin(struct kvdb_ctxn *handle)
 {
@@ -310,7 +633,7 @@ kvdb_ctxn_begin(struct kvdb_ctxn *handle)
     enum kvdb_ctxn_state   state;
     merr_t                 err;
 
-    if (ev(!kvdb_ctxn_trylock(ctxn)))
+    if (ev(!kvdb_ctxn_lock_wait_reaper(ctxn)))
         return merr(EPROTO);
 
     state = seqnoref_to_state(ctxn->ctxn_seqref);
@@ -323,15 +646,22 @@ kvdb_ctxn_begin(struct kvdb_ctxn *handle)
 
     ctxn->ctxn_bind = 0;
     ctxn->ctxn_begin_ts = get_time_ns();
+    ctxn->ctxn_wsetc = 0;
+    assert(ctxn->ctxn_spillc == 0);
 
     err = active_ctxn_set_insert(
         ctxn->ctxn_active_set, &ctxn->ctxn_view_seqno, &ctxn->ctxn_active_set_cookie);
     if (ev(err))
         goto errout;
 
+    kvdb_ctxn_wheel_rearm(ctxn, ctxn->ctxn_begin_ts);
+
     ctxn->ctxn_can_insert = 0;
     ctxn->ctxn_seqref = HSE_SQNREF_UNDEFINED;
 
+    assert(!ctxn->ctxn_kvms);
+    ctxn->ctxn_kvms = kvdb_ctxn_kvms_unpark(ctxn);
+
     /* KVS Cursors need an always-consistent kvms state. */
     if (ctxn->ctxn_kvms)
         c0kvms_reset(ctxn->ctxn_kvms);
@@ -357,6 +687,8 @@ kvdb_ctxn_deactivate(struct kvdb_ctxn_impl *ctxn)
     active_ctxn_set_remove(ctxn->ctxn_active_set, cookie, &min_changed, &new_min);
     if (min_changed)
         kvdb_keylock_expire(ctxn->ctxn_kvdb_keylock, new_min);
+
+    kvdb_ctxn_wheel_rearm(ctxn, get_time_ns());
 }
 
 static void
@@ -405,6 +737,7 @@ kvdb_ctxn_abort_inner(struct kvdb_ctxn_impl *ctxn)
     kvdb_ctxn_deactivate(ctxn);
 
     c0kvms_priv_release(ctxn->ctxn_kvms);
+    kvdb_ctxn_spill_release(ctxn);
 }
 
 void
@@ -418,8 +751,10 @@ kvdb_ctxn_abort(struct kvdb_ctxn *handle)
 
     state = seqnoref_to_state(ctxn->ctxn_seqref);
 
-    if (state == KVDB_CTXN_ACTIVE)
+    if (state == KVDB_CTXN_ACTIVE) {
         kvdb_ctxn_abort_inner(ctxn);
+        kvdb_ctxn_kvms_park(ctxn);
+    }
 
     kvdb_ctxn_unlock(ctxn);
 }
@@ -474,6 +809,175 @@ kvdb_ctxn_merge(
     return err;
 }
 
+static int
+kvdb_ctxn_hash_cmp(const void *lhs, const void *rhs)
+{
+    u64 a = *(const u64 *)lhs;
+    u64 b = *(const u64 *)rhs;
+
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * kvdb_ctxn_occ_lock() - take the write locks of an occ transaction
+ * @ctxn: transaction, with ctxn_wsetc > 0
+ *
+ * The locks are taken in one batch, in hash order, with the same
+ * start seqno an eager transaction would have used.  Acquiring a lock
+ * fails if it is held by another transaction, or by one that committed
+ * after this transaction's view, which is exactly the write-write
+ * conflict check that eager locking performs at put time.
+ */
+static merr_t
+kvdb_ctxn_occ_lock(struct kvdb_ctxn_impl *ctxn)
+{
+    u64   *wsetv = ctxn->ctxn_wsetv;
+    u32    i;
+    merr_t err;
+
+    qsort(wsetv, ctxn->ctxn_wsetc, sizeof(*wsetv), kvdb_ctxn_hash_cmp);
+
+    for (i = 0; i < ctxn->ctxn_wsetc; ++i) {
+        if (i > 0 && wsetv[i] == wsetv[i - 1])
+            continue;
+
+        err = kvdb_keylock_lock(
+            ctxn->ctxn_kvdb_keylock, ctxn->ctxn_locks_handle, wsetv[i], ctxn->ctxn_view_seqno);
+        if (err)
+            return err;
+    }
+
+    ctxn->ctxn_wsetc = 0;
+
+    return 0;
+}
+
+/**
+ * kvdb_ctxn_key_hash() - get the keylock hash of a key
+ * @c0:  c0 of the kvs into which the key is put
+ * @kt:  key, with kt_hash set by the caller
+ *
+ * If the kvs has no suffix then kt_hash already covers the full key and
+ * is just mixed with the c0 hash rather than hashing the key again.
+ */
+static inline u64
+kvdb_ctxn_key_hash(struct c0 *c0, const struct kvs_ktuple *kt)
+{
+    if (c0_get_sfx_len(c0) == 0)
+        return hse_hash64_mix(kt->kt_hash, c0_hash_get(c0));
+
+    return key_hash64_seed(kt->kt_data, kt->kt_len, c0_hash_get(c0));
+}
+
+/**
+ * kvdb_ctxn_occ_add() - record a key hash in the write set of an occ txn
+ * @ctxn: transaction
+ * @hash: key hash, as it would be passed to kvdb_keylock_lock()
+ */
+static merr_t
+kvdb_ctxn_occ_add(struct kvdb_ctxn_impl *ctxn, u64 hash)
+{
+    if (ctxn->ctxn_wsetc >= ctxn->ctxn_wsetmax) {
+        u32  max = ctxn->ctxn_wsetmax ? ctxn->ctxn_wsetmax * 2 : 64;
+        u64 *v;
+
+        v = realloc(ctxn->ctxn_wsetv, max * sizeof(*v));
+        if (ev(!v))
+            return merr(ENOMEM);
+
+        ctxn->ctxn_wsetv = v;
+        ctxn->ctxn_wsetmax = max;
+    }
+
+    ctxn->ctxn_wsetv[ctxn->ctxn_wsetc++] = hash;
+
+    return 0;
+}
+
+/**
+ * kvdb_ctxn_commit_sn() - obtain a commit seqno for a merge commit
+ * @ctxn: committing transaction
+ *
+ * Commits that arrive while another is obtaining a seqno queue up
+ * behind it, and the leader hands the whole queue one commit seqno
+ * with a single fetch-add on the kvdb seqno, bracketed by a single
+ * tseqno head/tail pair.  The write sets of concurrent committers are
+ * disjoint (they hold their write locks), so sharing a commit seqno is
+ * indistinguishable from committing them back to back, and readers see
+ * the group become visible at once.  Under load this replaces one
+ * shared seqno and tseqno update per commit with one per group.
+ *
+ * The caller must hold its keylock list lock, so that each list still
+ * receives commit seqnos in order.
+ */
+static u64
+kvdb_ctxn_commit_sn(struct kvdb_ctxn_impl *ctxn)
+{
+    struct kvdb_ctxn_set_impl *ktn = kvdb_ctxn_set_h2r(ctxn->ctxn_kvdb_ctxn_set);
+    struct kvdb_ctxn_waiter    self, *w, *next;
+    struct list_head           batch;
+    bool                       leader;
+    u64                        sn;
+    int                        i;
+
+    atomic_set(&self.kcw_done, 0);
+
+    spin_lock(&ktn->ktn_group_lock);
+    list_add_tail(&self.kcw_link, &ktn->ktn_group_pending);
+    leader = !atomic_read(&ktn->ktn_group_busy);
+    if (leader)
+        atomic_set(&ktn->ktn_group_busy, 1);
+    spin_unlock(&ktn->ktn_group_lock);
+
+    while (!leader) {
+        if (atomic_read_acq(&self.kcw_done))
+            return self.kcw_sn;
+
+        /* The previous leader may have stepped down with us queued.
+         */
+        if (!atomic_read(&ktn->ktn_group_busy)) {
+            spin_lock(&ktn->ktn_group_lock);
+            leader = !atomic_read(&ktn->ktn_group_busy) && !atomic_read(&self.kcw_done);
+            if (leader)
+                atomic_set(&ktn->ktn_group_busy, 1);
+            spin_unlock(&ktn->ktn_group_lock);
+            continue;
+        }
+
+        __builtin_ia32_pause();
+    }
+
+    for (i = 0; i < KVDB_CTXN_GROUP_MAX || !atomic_read(&self.kcw_done); ++i) {
+        INIT_LIST_HEAD(&batch);
+
+        spin_lock(&ktn->ktn_group_lock);
+        list_splice_tail(&ktn->ktn_group_pending, &batch);
+        INIT_LIST_HEAD(&ktn->ktn_group_pending);
+        spin_unlock(&ktn->ktn_group_lock);
+
+        if (list_empty(&batch))
+            break;
+
+        atomic64_inc_acq(ctxn->ctxn_tseqno_head);
+        sn = 1 + atomic64_fetch_add_acq(2, ctxn->ctxn_kvdb_seq_addr);
+        atomic64_inc_rel(ctxn->ctxn_tseqno_tail);
+
+        /* A waiter may return (and its node vanish) as soon as its
+         * kcw_done is set.
+         */
+        list_for_each_entry_safe (w, next, &batch, kcw_link) {
+            w->kcw_sn = sn;
+            atomic_set_rel(&w->kcw_done, 1);
+        }
+    }
+
+    spin_lock(&ktn->ktn_group_lock);
+    atomic_set(&ktn->ktn_group_busy, 0);
+    spin_unlock(&ktn->ktn_group_lock);
+
+    return self.kcw_sn;
+}
+
 merr_t
 kvdb_ctxn_commit(struct kvdb_ctxn *handle)
 {
@@ -489,8 +993,9 @@ kvdb_ctxn_commit(struct kvdb_ctxn *handle)
     uintptr_t               ref;
     u64                     commit_sn;
     u64                     rsvd_sn;
-    u64                     head, tail;
+    u64                     head;
     int                     num_retries;
+    u32                     i;
 
     if (ev(!kvdb_ctxn_trylock(ctxn)))
         return merr(EPROTO);
@@ -517,18 +1022,32 @@ kvdb_ctxn_commit(struct kvdb_ctxn *handle)
 
         ctxn->ctxn_seqref = HSE_ORDNL_TO_SQNREF(ctxn->ctxn_view_seqno);
         kvdb_ctxn_deactivate(ctxn);
+        kvdb_ctxn_kvms_park(ctxn);
         kvdb_ctxn_unlock(ctxn);
 
         return 0;
     }
 
+    if (ctxn->ctxn_wsetc > 0) {
+        err = kvdb_ctxn_occ_lock(ctxn);
+        if (err) {
+            ev(merr_errno(err) != ECANCELED);
+            kvdb_ctxn_abort_inner(ctxn);
+            kvdb_ctxn_kvms_park(ctxn);
+            kvdb_ctxn_unlock(ctxn);
+            return err;
+        }
+    }
+
     /* Acquire a reference on the kvms so that it cannot be freed
      * before we update it via ctxn_seqno (which points into kvms
      * via the kvms priv ptr).
      */
     c0kvms_getref(ctxn->ctxn_kvms);
 
-    num_retries = 5;
+    /* A spilled write set is too large to merge, go straight to flush.
+     */
+    num_retries = ctxn->ctxn_spillc > 0 ? 0 : 5;
 
 retry:
     priv = NULL;
@@ -549,7 +1068,9 @@ retry:
          * increment head before calling flush.
          */
         atomic64_inc_acq(ctxn->ctxn_tseqno_head);
-        err = c0sk_flush(ctxn->ctxn_c0sk, ctxn->ctxn_kvms);
+        err = kvdb_ctxn_spill_flush(ctxn);
+        if (!err)
+            err = c0sk_flush(ctxn->ctxn_c0sk, ctxn->ctxn_kvms);
     }
 
     /* If there is an error at this point, we can neither publish nor
@@ -559,6 +1080,7 @@ retry:
         atomic64_inc(ctxn->ctxn_tseqno_tail);
         kvdb_ctxn_abort_inner(ctxn);
         c0kvms_putref(ctxn->ctxn_kvms);
+        kvdb_ctxn_kvms_park(ctxn);
         kvdb_ctxn_unlock(ctxn);
         return err;
     }
@@ -612,15 +1134,16 @@ retry:
 
     /* Hold the RCU read lock through the update to *priv to ensure
      * the current active kvms cannot reach the finalized state until
-     * after we release the lock.  Note that a ctxn_kvms that has been
+     * after we release the lock, unless it was frozen by c0 ingest in
+     * which case ingest waits on our priv reference before reading
+     * dst (see c0kvms_priv_wait()).  Note that a ctxn_kvms that has been
      * flushed is not subject to this constraint (it could still be
      * the active kvms, or it could be finalized and awaiting ingest).
      */
     rcu_read_lock();
     if (dst) {
         /* merge */
-        atomic64_inc_acq(ctxn->ctxn_tseqno_head);
-        commit_sn = 1 + atomic64_fetch_add_acq(2, ctxn->ctxn_kvdb_seq_addr);
+        commit_sn = kvdb_ctxn_commit_sn(ctxn);
 
         rsvd_sn = c0kvms_rsvd_sn_get(dst);
 
@@ -632,7 +1155,6 @@ retry:
         if (ev(first != dst || commit_sn < rsvd_sn)) {
             rcu_read_unlock();
 
-            atomic64_inc(ctxn->ctxn_tseqno_tail);
             kvdb_keylock_list_unlock(cookie);
             c0kvms_priv_release(dst);
             c0kvms_putref(dst);
@@ -642,7 +1164,7 @@ retry:
             goto retry;
         }
 
-        assert(!c0kvms_is_finalized(dst));
+        assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst));
     } else {
         /* flush */
         rsvd_sn = c0kvms_rsvd_sn_get(ctxn->ctxn_kvms);
@@ -660,7 +1182,10 @@ retry:
 
     ref = HSE_ORDNL_TO_SQNREF(commit_sn);
 
-    tail = atomic64_inc_rel(ctxn->ctxn_tseqno_tail);
+    /* A merge commit's tseqno pair was closed by its group leader.
+     */
+    if (!dst)
+        atomic64_inc_rel(ctxn->ctxn_tseqno_tail);
     head = atomic64_read(ctxn->ctxn_tseqno_head);
 
     locks = ctxn->ctxn_locks_handle;
@@ -682,17 +1207,20 @@ retry:
      * accomplish the same thing with a mutex, but this approach greatly
      * improves throughput of the above critical section vs a mutex.
      */
-    if (tail < head) {
-        while (atomic64_read(ctxn->ctxn_tseqno_tail) < head)
-            __builtin_ia32_pause();
-    }
+    while (atomic64_read(ctxn->ctxn_tseqno_tail) < head)
+        __builtin_ia32_pause();
+
     c0skm_set_tseqno(ctxn->ctxn_c0sk, commit_sn);
 
     /* This assignment through the pointer gives all the values
      * associated with this transaction an ordinal sequence
      * number. Each of those values has their own pointer to the
-     * ordinal value.
+     * ordinal value.  Spilled kvmses were flushed ahead of ctxn_kvms,
+     * so their rsvd_sn is no larger than commit_sn.
      */
+    for (i = 0; i < ctxn->ctxn_spillc; ++i)
+        *(uintptr_t *)ctxn->ctxn_spillv[i].ks_seqref = ref;
+
     *(uintptr_t *)ctxn->ctxn_seqref = ref;
 
     /* Once the indirect assignment has been performed the
@@ -710,7 +1238,7 @@ retry:
     if (dst) {
         *priv = ref;
 
-        assert(!c0kvms_is_finalized(dst));
+        assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst));
 
         c0kvms_priv_release(dst);
         c0kvms_putref(dst);
@@ -727,15 +1255,95 @@ retry:
 
     c0kvms_priv_release(ctxn->ctxn_kvms);
     c0kvms_putref(ctxn->ctxn_kvms);
+    kvdb_ctxn_spill_release(ctxn);
 
     if (!dst)
         ctxn->ctxn_kvms = 0;
 
+    kvdb_ctxn_kvms_park(ctxn);
     kvdb_ctxn_unlock(ctxn);
 
     return 0;
 }
 
+/* Max number of times an atomic write batch is retried in a new kvms.
+ */
+#define KVDB_CTXN_WBATCH_RETRIES 8
+
+merr_t
+kvdb_ctxn_set_write_batch(
+    struct kvdb_ctxn_set *      handle,
+    struct c0sk *               c0sk,
+    atomic64_t *                kvdb_seqno_addr,
+    const struct kvs_wbatch_op *opv,
+    u32                         opc)
+{
+    struct kvdb_ctxn_set_impl *ktn = kvdb_ctxn_set_h2r(handle);
+    struct c0_kvmultiset *     dst, *first;
+    uintptr_t *                priv;
+    u64                        commit_sn, rsvd_sn, head;
+    int                        num_retries;
+    merr_t                     err;
+
+    num_retries = KVDB_CTXN_WBATCH_RETRIES;
+
+retry:
+    priv = NULL;
+    dst = NULL;
+
+    /* The batch is inserted as if it were the write set of a merge
+     * commit, and it is published the same way, except that there are
+     * no write locks to queue.  Its values are thus transaction
+     * mutations, which c0kvmsm logs to c1 within a single c1 txn.
+     */
+    err = c0sk_write_batch_priv(c0sk, opv, opc, &dst, &priv);
+    if (err) {
+        if (merr_errno(err) == ENOMEM && num_retries-- > 0)
+            goto retry;
+
+        return err;
+    }
+
+    rcu_read_lock();
+    atomic64_inc_acq(&ktn->ktn_tseqno_head);
+    commit_sn = 1 + atomic64_fetch_add_acq(2, kvdb_seqno_addr);
+    atomic64_inc_rel(&ktn->ktn_tseqno_tail);
+
+    rsvd_sn = c0kvms_rsvd_sn_get(dst);
+
+    /* See kvdb_ctxn_commit() regarding dst and rsvd_sn.
+     */
+    first = c0sk_get_first_c0kvms(c0sk);
+    if (ev(first != dst || commit_sn < rsvd_sn)) {
+        rcu_read_unlock();
+
+        c0kvms_priv_release(dst);
+        c0kvms_putref(dst);
+
+        if (num_retries-- > 0)
+            goto retry;
+
+        return merr(ENOMEM);
+    }
+
+    head = atomic64_read(&ktn->ktn_tseqno_head);
+
+    while (atomic64_read(&ktn->ktn_tseqno_tail) < head)
+        __builtin_ia32_pause();
+
+    c0skm_set_tseqno(c0sk, commit_sn);
+
+    *priv = HSE_ORDNL_TO_SQNREF(commit_sn);
+
+    assert(!c0kvms_is_finalized(dst) || c0kvms_is_frozen(dst));
+
+    c0kvms_priv_release(dst);
+    c0kvms_putref(dst);
+    rcu_read_unlock();
+
+    return 0;
+}
+
 enum kvdb_ctxn_state
 kvdb_ctxn_get_state(struct kvdb_ctxn *handle)
 {
@@ -765,6 +1373,14 @@ kvdb_ctxn_get_kvms(struct kvdb_ctxn *handle)
     return ctxn ? ctxn->ctxn_kvms : 0;
 }
 
+bool
+kvdb_ctxn_spilled(struct kvdb_ctxn *handle)
+{
+    struct kvdb_ctxn_impl *ctxn = kvdb_ctxn_h2r(handle);
+
+    return ctxn && ctxn->ctxn_spillc > 0;
+}
+
 uintptr_t
 kvdb_ctxn_get_seqnoref(struct kvdb_ctxn *handle)
 {
@@ -781,7 +1397,7 @@ kvdb_ctxn_get_seqnoref(struct kvdb_ctxn *handle)
  *
  * Pre-Conditions at Entry:
  * ------------------------
- *  (1) The keylock table holding the hash is locked by the calling thread.
+ *  (1) The caller is within an RCU read-side critical section.
  *  (2) new_rock is a pointer to the kvdb_ctxn_impl that is attempting
  *      to acquire ownership of the hash.
  *  (3) Ownership of the hash is held by the lock collection pointed to by
@@ -796,16 +1412,15 @@ kvdb_ctxn_lock_inherit(
     struct kvdb_ctxn_locks *old_locks = (struct kvdb_ctxn_locks *)old_rock;
 
     /* The structure pointed to by "old_locks" cannot vanish during this
-     * call because of pre-condition (1) above. However, it is entirely
-     * possible that old_locks ref goes to 0 at any time and another
-     * thread is attempting to unlock the hash at any moment. This is
-     * protected against by updating the rock of the entry while we are
-     * holding off the other threads so that any "unlock" attempt on the
-     * part of the previous owner silently does nothing.
+     * call because of pre-condition (1) above, lock sets are freed via
+     * call_rcu(). However, it is entirely possible that old_locks ref
+     * goes to 0 at any time and another thread is attempting to unlock
+     * the hash at any moment. The keylock table handles this by moving
+     * the entry to the new rock with a CAS on the old rock, so that any
+     * "unlock" attempt on the part of the previous owner silently does
+     * nothing.
      */
 
-    /* release of lock (1) will handle the write memory barrier needed */
-
     /* Note that while old_locks holds the key lock its end seqno will
      * be U64_MAX and hence can never be inherited/transferred.
      */
@@ -843,10 +1458,13 @@ kvdb_ctxn_put(
      * cn kvs name) into the hash to avoid collisions of identical keys
      * being put into different kvs via independent transactions.
      */
-    hash = key_hash64_seed(kt->kt_data, kt->kt_len, c0_hash_get(c0));
+    hash = kvdb_ctxn_key_hash(c0, kt);
 
-    err = kvdb_keylock_lock(
-        ctxn->ctxn_kvdb_keylock, ctxn->ctxn_locks_handle, hash, ctxn->ctxn_view_seqno);
+    if (ctxn->ctxn_occ)
+        err = kvdb_ctxn_occ_add(ctxn, hash);
+    else
+        err = kvdb_keylock_lock(
+            ctxn->ctxn_kvdb_keylock, ctxn->ctxn_locks_handle, hash, ctxn->ctxn_view_seqno);
     if (err) {
         ev(merr_errno(err) != ECANCELED);
         goto errout;
@@ -858,6 +1476,11 @@ kvdb_ctxn_put(
     c0kvs = c0kvms_get_hashed_c0kvset(ctxn->ctxn_kvms, kt->kt_hash);
 
     err = c0kvs_put(c0kvs, c0_index(c0), kt, vt, ctxn->ctxn_seqref);
+    if (err && merr_errno(err) == ENOMEM && !kvdb_ctxn_spill(ctxn)) {
+        c0kvs = c0kvms_get_hashed_c0kvset(ctxn->ctxn_kvms, kt->kt_hash);
+
+        err = c0kvs_put(c0kvs, c0_index(c0), kt, vt, ctxn->ctxn_seqref);
+    }
 
 errout:
     kvdb_ctxn_unlock(ctxn);
@@ -865,6 +1488,49 @@ errout:
     return err;
 }
 
+/**
+ * kvdb_ctxn_get_local() - look up a key in one of the txn's kvmses
+ */
+static merr_t
+kvdb_ctxn_get_local(
+    struct c0_kvmultiset *   kvms,
+    uintptr_t                seqnoref,
+    struct c0 *              c0,
+    const struct kvs_ktuple *kt,
+    u64                      view_seqno,
+    enum key_lookup_res *    res,
+    struct kvs_buf *         vbuf)
+{
+    uintptr_t        rslt_seqnoref;
+    struct c0_kvset *c0kvs;
+    merr_t           err;
+
+    c0kvs = c0kvms_get_hashed_c0kvset(kvms, kt->kt_hash);
+
+    err = c0kvs_get(c0kvs, c0_index(c0), kt, view_seqno, seqnoref, res, vbuf, &rslt_seqnoref);
+
+    if (!err && *res == NOT_FOUND) {
+        uintptr_t pt_seqref;
+        u32       pfx_len = c0_get_pfx_len(c0);
+
+        /* check if there is a ptomb for the key */
+
+        c0kvs = c0kvms_ptomb_c0kvset_get(kvms);
+        if (pfx_len > 0 && kt->kt_len >= pfx_len) {
+            /* kvs is prefixed. Check for ptombs.
+             */
+            c0kvs_prefix_get(c0kvs, c0_index(c0), kt, view_seqno, pfx_len, &pt_seqref);
+
+            if (pt_seqref != HSE_ORDNL_TO_SQNREF(0)) {
+                vbuf->b_len = 0;
+                *res = FOUND_PTMB;
+            }
+        }
+    }
+
+    return err;
+}
+
 merr_t
 kvdb_ctxn_get(
     struct kvdb_ctxn *       handle,
@@ -874,12 +1540,12 @@ kvdb_ctxn_get(
     enum key_lookup_res *    res,
     struct kvs_buf *         vbuf)
 {
-    struct kvdb_ctxn_impl *ctxn = kvdb_ctxn_h2r(handle);
-    merr_t                 err;
-    u64                    view_seqno;
-    uintptr_t              seqnoref;
-    uintptr_t              rslt_seqnoref;
-    struct c0_kvset *      c0kvs;
+    struct kvdb_ctxn_impl * ctxn = kvdb_ctxn_h2r(handle);
+    struct kvdb_ctxn_spill *spill;
+    merr_t                  err;
+    u64                     view_seqno;
+    uintptr_t               seqnoref;
+    u32                     i;
 
     if (ev(!kvdb_ctxn_trylock(ctxn)))
         return merr(EPROTO);
@@ -893,28 +1559,14 @@ kvdb_ctxn_get(
     seqnoref = ctxn->ctxn_seqref;
 
     if (ctxn->ctxn_can_insert) {
-        /* first look in the kvdb_ctxn's private store */
-        c0kvs = c0kvms_get_hashed_c0kvset(ctxn->ctxn_kvms, kt->kt_hash);
+        /* first look in the kvdb_ctxn's private store, newest first */
+        err = kvdb_ctxn_get_local(ctxn->ctxn_kvms, seqnoref, c0, kt, view_seqno, res, vbuf);
 
-        err = c0kvs_get(c0kvs, c0_index(c0), kt, view_seqno, seqnoref, res, vbuf, &rslt_seqnoref);
+        for (i = ctxn->ctxn_spillc; !err && *res == NOT_FOUND && i > 0; --i) {
+            spill = ctxn->ctxn_spillv + i - 1;
 
-        if (!err && *res == NOT_FOUND) {
-            uintptr_t pt_seqref;
-            u32       pfx_len = c0_get_pfx_len(c0);
-
-            /* check if there is a ptomb for the key */
-
-            c0kvs = c0kvms_ptomb_c0kvset_get(ctxn->ctxn_kvms);
-            if (pfx_len > 0 && kt->kt_len >= pfx_len) {
-                /* kvs is prefixed. Check for ptombs.
-                 */
-                c0kvs_prefix_get(c0kvs, c0_index(c0), kt, view_seqno, pfx_len, &pt_seqref);
-
-                if (pt_seqref != HSE_ORDNL_TO_SQNREF(0)) {
-                    vbuf->b_len = 0;
-                    *res = FOUND_PTMB;
-                }
-            }
+            err = kvdb_ctxn_get_local(
+                spill->ks_kvms, spill->ks_seqref, c0, kt, view_seqno, res, vbuf);
         }
 
         /* if we got an error or found it, we're done */
@@ -956,10 +1608,13 @@ kvdb_ctxn_del(struct kvdb_ctxn *handle, struct c0 *c0, const struct kvs_ktuple *
     /* Always use the full key's hash (even when kvs is suffixed) for
      * maximum entropy.
      */
-    hash = key_hash64_seed(kt->kt_data, kt->kt_len, c0_hash_get(c0));
+    hash = kvdb_ctxn_key_hash(c0, kt);
 
-    err = kvdb_keylock_lock(
-        ctxn->ctxn_kvdb_keylock, ctxn->ctxn_locks_handle, hash, ctxn->ctxn_view_seqno);
+    if (ctxn->ctxn_occ)
+        err = kvdb_ctxn_occ_add(ctxn, hash);
+    else
+        err = kvdb_keylock_lock(
+            ctxn->ctxn_kvdb_keylock, ctxn->ctxn_locks_handle, hash, ctxn->ctxn_view_seqno);
     if (ev(err))
         goto errout;
 
@@ -969,6 +1624,11 @@ kvdb_ctxn_del(struct kvdb_ctxn *handle, struct c0 *c0, const struct kvs_ktuple *
     c0kvs = c0kvms_get_hashed_c0kvset(ctxn->ctxn_kvms, kt->kt_hash);
 
     err = c0kvs_del(c0kvs, c0_index(c0), kt, ctxn->ctxn_seqref);
+    if (err && merr_errno(err) == ENOMEM && !kvdb_ctxn_spill(ctxn)) {
+        c0kvs = c0kvms_get_hashed_c0kvset(ctxn->ctxn_kvms, kt->kt_hash);
+
+        err = c0kvs_del(c0kvs, c0_index(c0), kt, ctxn->ctxn_seqref);
+    }
 
 errout:
     kvdb_ctxn_unlock(ctxn);
@@ -976,6 +1636,47 @@ errout:
     return err;
 }
 
+/**
+ * kvdb_ctxn_pfx_probe_local() - probe one of the txn's kvmses
+ *
+ * Return: true if the probe is resolved and must not go any further
+ */
+static bool
+kvdb_ctxn_pfx_probe_local(
+    struct kvdb_ctxn_impl *  ctxn,
+    struct c0_kvmultiset *   kvms,
+    uintptr_t                seqnoref,
+    struct c0 *              c0,
+    const struct kvs_ktuple *kt,
+    enum key_lookup_res *    res,
+    struct query_ctx *       qctx,
+    struct kvs_buf *         kbuf,
+    struct kvs_buf *         vbuf,
+    merr_t *                 errp)
+{
+    uintptr_t        pt_seqref;
+    struct c0_kvset *pt_c0kvs;
+
+    *errp = c0kvms_pfx_probe(
+        kvms, c0_index(c0), kt, ctxn->ctxn_view_seqno, seqnoref, res, qctx, kbuf, vbuf, 0);
+    if (ev(*errp))
+        return true;
+
+    if (qctx->seen > 1)
+        return true;
+
+    if (likely(c0_get_pfx_len(c0) && kt->kt_len >= c0_get_pfx_len(c0))) {
+        /* Check if txn contains ptomb for query pfx */
+        pt_c0kvs = c0kvms_ptomb_c0kvset_get(kvms);
+        c0kvs_prefix_get(
+            pt_c0kvs, c0_index(c0), kt, ctxn->ctxn_view_seqno, c0_get_pfx_len(c0), &pt_seqref);
+        if (pt_seqref != HSE_ORDNL_TO_SQNREF(0))
+            return true; /* found a ptomb. Do not proceed. */
+    }
+
+    return false;
+}
+
 merr_t
 kvdb_ctxn_pfx_probe(
     struct kvdb_ctxn *       handle,
@@ -987,10 +1688,10 @@ kvdb_ctxn_pfx_probe(
     struct kvs_buf *         kbuf,
     struct kvs_buf *         vbuf)
 {
-    struct kvdb_ctxn_impl *ctxn = kvdb_ctxn_h2r(handle);
-    merr_t                 err;
-    uintptr_t              pt_seqref;
-    struct c0_kvset *      pt_c0kvs;
+    struct kvdb_ctxn_impl * ctxn = kvdb_ctxn_h2r(handle);
+    struct kvdb_ctxn_spill *spill;
+    merr_t                  err = 0;
+    u32                     i;
 
     if (ev(!kvdb_ctxn_trylock(ctxn)))
         return merr(EPROTO);
@@ -998,36 +1699,20 @@ kvdb_ctxn_pfx_probe(
     if (!ctxn->ctxn_can_insert)
         goto skip_txkvms;
 
-    /* Check txn's local mutations */
-    err = c0kvms_pfx_probe(
-        ctxn->ctxn_kvms,
-        c0_index(c0),
-        kt,
-        ctxn->ctxn_view_seqno,
-        ctxn->ctxn_seqref,
-        res,
-        qctx,
-        kbuf,
-        vbuf,
-        0);
-    if (ev(err)) {
+    /* Check txn's local mutations, newest first */
+    if (kvdb_ctxn_pfx_probe_local(
+            ctxn, ctxn->ctxn_kvms, ctxn->ctxn_seqref, c0, kt, res, qctx, kbuf, vbuf, &err)) {
         kvdb_ctxn_unlock(ctxn);
         return err;
     }
 
-    if (qctx->seen > 1) {
-        kvdb_ctxn_unlock(ctxn);
-        return 0;
-    }
+    for (i = ctxn->ctxn_spillc; i > 0; --i) {
+        spill = ctxn->ctxn_spillv + i - 1;
 
-    if (likely(c0_get_pfx_len(c0) && kt->kt_len >= c0_get_pfx_len(c0))) {
-        /* Check if txn contains ptomb for query pfx */
-        pt_c0kvs = c0kvms_ptomb_c0kvset_get(ctxn->ctxn_kvms);
-        c0kvs_prefix_get(
-            pt_c0kvs, c0_index(c0), kt, ctxn->ctxn_view_seqno, c0_get_pfx_len(c0), &pt_seqref);
-        if (pt_seqref != HSE_ORDNL_TO_SQNREF(0)) {
+        if (kvdb_ctxn_pfx_probe_local(
+                ctxn, spill->ks_kvms, spill->ks_seqref, c0, kt, res, qctx, kbuf, vbuf, &err)) {
             kvdb_ctxn_unlock(ctxn);
-            return 0; /* found a ptomb. Do not proceed. */
+            return err;
         }
     }
 
@@ -1066,6 +1751,11 @@ kvdb_ctxn_prefix_del(struct kvdb_ctxn *handle, struct c0 *c0, const struct kvs_k
 
     c0kvs = c0kvms_ptomb_c0kvset_get(ctxn->ctxn_kvms);
     err = c0kvs_prefix_del(c0kvs, c0_index(c0), kt, ctxn->ctxn_seqref);
+    if (err && merr_errno(err) == ENOMEM && !kvdb_ctxn_spill(ctxn)) {
+        c0kvs = c0kvms_ptomb_c0kvset_get(ctxn->ctxn_kvms);
+
+        err = c0kvs_prefix_del(c0kvs, c0_index(c0), kt, ctxn->ctxn_seqref);
+    }
 
 errout:
     kvdb_ctxn_unlock(ctxn);
@@ -1077,6 +1767,7 @@ merr_t
 kvdb_ctxn_set_create(struct kvdb_ctxn_set **handle_out, u64 txn_timeout_ms, u64 delay_msecs)
 {
     struct kvdb_ctxn_set_impl *ktn;
+    int                        i;
 
     *handle_out = 0;
 
@@ -1094,10 +1785,21 @@ kvdb_ctxn_set_create(struct kvdb_ctxn_set **handle_out, u64 txn_timeout_ms, u64
 
     atomic64_set(&ktn->ktn_tseqno_head, 0);
     atomic64_set(&ktn->ktn_tseqno_tail, 0);
+    spin_lock_init(&ktn->ktn_group_lock);
+    INIT_LIST_HEAD(&ktn->ktn_group_pending);
+    atomic_set(&ktn->ktn_group_busy, 0);
     atomic_set(&ktn->ktn_reading, 0);
     ktn->ktn_queued = false;
     ktn->ktn_txn_timeout = txn_timeout_ms;
     ktn->txn_wkth_delay = msecs_to_jiffies(delay_msecs);
+
+    ktn->ktn_wheel_ns = max_t(u64, delay_msecs, 1) * 1000000UL;
+    ktn->ktn_wheel_next = get_time_ns() / ktn->ktn_wheel_ns;
+
+    for (i = 0; i < KVDB_CTXN_WHEEL_SLOTS; ++i) {
+        spin_lock_init(&ktn->ktn_wheel[i].kcs_lock);
+        INIT_LIST_HEAD(&ktn->ktn_wheel[i].kcs_list);
+    }
     INIT_DELAYED_WORK(&ktn->ktn_dwork, kvdb_ctxn_set_thread);
 
     mutex_init(&ktn->ktn_list_mutex);
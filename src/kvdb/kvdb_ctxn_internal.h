@@ -8,6 +8,16 @@
 
 #include <hse_ikvdb/kvdb_ctxn.h>
 
+/**
+ * struct kvdb_ctxn_spill - a full transaction kvms awaiting commit
+ * @ks_kvms:    the kvms, with the txn's birth reference
+ * @ks_seqref:  seqref of the values in ks_kvms (a priv slot of ks_kvms)
+ */
+struct kvdb_ctxn_spill {
+    struct c0_kvmultiset *ks_kvms;
+    uintptr_t             ks_seqref;
+};
+
 /**
  * struct kvdb_ctxn_impl -
  * @ctxn_inner_handle:
@@ -15,6 +25,7 @@
  * @ctxn_view_seqno:          seqno at time of transaction begin call
  * @ctxn_c0sk:                address of underlying c0sk
  * @ctxn_kvms:                buffer which stores transaction data
+ * @ctxn_kvms_idle:           ctxn_kvms kept for reuse while the txn is idle
  * @ctxn_locks_handle:        container to store acquired write locks
  * @ctxn_kvdb_txn_set:        address of the KVDB txns struct
  * @ctxn_alloc_link:          used to queue onto KVDB allocated txn list
@@ -29,17 +40,30 @@
  * @ctxn_locks_cursor_sz:
  * @ctxn_can_insert:
  * @ctxn_cursor_alloc:
+ * @ctxn_occ:                 write locks are taken at commit (txn_occ)
+ * @ctxn_wsetv:               hashes of the keys written, if ctxn_occ
+ * @ctxn_wsetc:               number of hashes in ctxn_wsetv
+ * @ctxn_wsetmax:             capacity of ctxn_wsetv
+ * @ctxn_spillv:              full kvmses set aside by kvdb_ctxn_spill()
+ * @ctxn_spillc:              number of kvmses in ctxn_spillv
+ * @ctxn_spill_max:           capacity of ctxn_spillv (txn_spill_max)
+ * @ctxn_wheel_slot:          expiry wheel slot the txn is on, if any
+ * @ctxn_wheel_link:          expiry wheel slot linkage
+ * @ctxn_deadline:            abort (if active) or reclaim (if idle) time
+ * @ctxn_reap_deadline:       ctxn_deadline when the txn was taken off the wheel
  */
 struct kvdb_ctxn_impl {
     struct kvdb_ctxn        ctxn_inner_handle;
     atomic_t                ctxn_lock;
     u8                      ctxn_can_insert;
     u8                      ctxn_cursors_max;
+    u8                      ctxn_occ;
     uintptr_t               ctxn_seqref;
     struct kvdb_keylock *   ctxn_kvdb_keylock;
     struct kvdb_ctxn_locks *ctxn_locks_handle;
     u64                     ctxn_view_seqno;
     struct c0_kvmultiset *  ctxn_kvms;
+    struct c0_kvmultiset *  ctxn_kvms_idle;
     struct kvdb_ctxn_bind * ctxn_bind;
 
     __aligned(SMP_CACHE_BYTES) struct active_ctxn_set *ctxn_active_set;
@@ -53,11 +77,24 @@ struct kvdb_ctxn_impl {
     u32 ctxn_ingest_delay;
     u64 ctxn_heap_sz;
 
+    u64 *ctxn_wsetv;
+    u32  ctxn_wsetc;
+    u32  ctxn_wsetmax;
+
+    struct kvdb_ctxn_spill *ctxn_spillv;
+    u32                     ctxn_spillc;
+    u32                     ctxn_spill_max;
+
     __aligned(SMP_CACHE_BYTES) u64 ctxn_begin_ts;
     void *               ctxn_active_set_cookie;
     struct cds_list_head ctxn_alloc_link;
     struct list_head     ctxn_free_link;
     struct list_head     ctxn_abort_link;
+
+    struct kvdb_ctxn_slot *ctxn_wheel_slot;
+    struct list_head       ctxn_wheel_link;
+    u64                    ctxn_deadline;
+    u64                    ctxn_reap_deadline;
 };
 
 #define kvdb_ctxn_h2r(handle) container_of(handle, struct kvdb_ctxn_impl, ctxn_inner_handle)
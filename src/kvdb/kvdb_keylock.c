@@ -19,6 +19,7 @@
 
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/kvdb_ctxn.h>
+#include <hse_ikvdb/kvdb_perfc.h>
 
 #include <3rdparty/rbtree.h>
 
@@ -29,6 +30,8 @@
 #define KVDB_DLOCK_MAX 8 /* Must be power-of-2 */
 #define KVDB_LOCKS_SZ (16 * 1024 - SMP_CACHE_BYTES)
 
+#define KVDB_KEYLOCK_HOT_SAMPLE 8 /* sample one in this many conflicts */
+
 struct kvdb_keylock {
 };
 
@@ -54,6 +57,9 @@ struct kvdb_dlock {
  * @kl_num_entries:        max number of entries (across all tables)
  * @kl_entries_per_txn:    number of entries that can be locked by a txn
  * @kl_perfc_set:
+ * @kl_hot_lock:           protects kl_hotv[]
+ * @kl_hot_samp:           count of conflicts, drives sampling
+ * @kl_hotv:               most frequently conflicting lock hashes
  * @kl_keylock:            vector of ptrs to keylock objects
  */
 struct kvdb_keylock_impl {
@@ -64,7 +70,12 @@ struct kvdb_keylock_impl {
     u32              kl_entries_per_txn;
     u32              kl_num_tables;
     struct perfc_set kl_perfc_set;
-    struct keylock * kl_keylock[];
+
+    __aligned(SMP_CACHE_BYTES) spinlock_t kl_hot_lock;
+    atomic_t                kl_hot_samp;
+    struct kvdb_keylock_hot kl_hotv[KVDB_KEYLOCK_HOT_MAX];
+
+    struct keylock *kl_keylock[];
 };
 
 struct kvdb_ctxn_locks {
@@ -96,7 +107,9 @@ struct ctxn_locks_tree_entry {
  * @ctxn_locks_handle:       handle for kvdb_ctxn_locks struct
  * @ctxn_locks_link:         element to link onto the deferred_locks list
  * @ctxn_locks_magic:        used to detect use-after-free
+ * @ctxn_locks_rcu:          defers the free past concurrent keylock_lock()
  * @ctxn_locks_end_seqno:    end seqno of the transaction
+ * @ctxn_locks_start:        time of the first lock (if sampled for perfc)
  * @ctxn_locks_tree:         root of RB tree containing write locks
  * @ctxn_locks_cnt:          number of write locks in this container
  * @ctxn_locks_entryc:       current number of entries from entryv[] in use
@@ -108,6 +121,8 @@ struct kvdb_ctxn_locks_impl {
     struct list_head       ctxn_locks_link;
     volatile u64           ctxn_locks_end_seqno;
     uintptr_t              ctxn_locks_magic;
+    struct rcu_head        ctxn_locks_rcu;
+    u64                    ctxn_locks_start;
 
     __aligned(SMP_CACHE_BYTES) struct rb_root ctxn_locks_tree;
     u32 ctxn_locks_cnt;
@@ -149,6 +164,7 @@ kvdb_keylock_create(struct kvdb_keylock **handle_out, u32 num_tables, u64 num_en
     klock->kl_entries_per_txn = klock->kl_num_entries / 4;
     klock->kl_num_tables = num_tables;
     memset(&klock->kl_perfc_set, 0, sizeof(klock->kl_perfc_set));
+    spin_lock_init(&klock->kl_hot_lock);
 
     for (i = 0; i < KVDB_DLOCK_MAX; ++i) {
         mutex_init_adaptive(&klock->kl_dlockv[i].kd_lock);
@@ -218,6 +234,88 @@ kvdb_keylock_perfc_init(struct kvdb_keylock *handle, struct perfc_set *perfc_set
     memcpy(dst, perfc_set, sizeof(*dst));
 }
 
+/* Record a sampled conflict on %hash in the hot list, which is kept by
+ * the space-saving algorithm:  An untracked hash replaces the entry with
+ * the lowest count and inherits that count, so counts are upper bounds
+ * but the hottest hashes are retained.
+ */
+static void
+kvdb_keylock_hot_sample(struct kvdb_keylock_impl *klock, u64 hash)
+{
+    struct kvdb_keylock_hot *hot, *min;
+    int                      i;
+
+    if (atomic_inc_return(&klock->kl_hot_samp) % KVDB_KEYLOCK_HOT_SAMPLE)
+        return;
+
+    if (!spin_trylock(&klock->kl_hot_lock))
+        return;
+
+    min = hot = klock->kl_hotv;
+
+    for (i = 0; i < KVDB_KEYLOCK_HOT_MAX; ++i, ++hot) {
+        if (hot->kh_hash == hash)
+            break;
+
+        if (hot->kh_cnt < min->kh_cnt)
+            min = hot;
+    }
+
+    if (i == KVDB_KEYLOCK_HOT_MAX) {
+        hot = min;
+        hot->kh_hash = hash;
+    }
+
+    hot->kh_cnt++;
+
+    spin_unlock(&klock->kl_hot_lock);
+}
+
+static int
+kvdb_keylock_hot_cmp(const void *lhs, const void *rhs)
+{
+    const struct kvdb_keylock_hot *l = lhs;
+    const struct kvdb_keylock_hot *r = rhs;
+
+    if (l->kh_cnt != r->kh_cnt)
+        return l->kh_cnt < r->kh_cnt ? 1 : -1;
+
+    return 0;
+}
+
+u32
+kvdb_keylock_hot_get(struct kvdb_keylock *handle, struct kvdb_keylock_hot *hotv)
+{
+    struct kvdb_keylock_impl *klock = kvdb_keylock_h2r(handle);
+    u32                       hotc, i;
+
+    spin_lock(&klock->kl_hot_lock);
+    memcpy(hotv, klock->kl_hotv, sizeof(klock->kl_hotv));
+    spin_unlock(&klock->kl_hot_lock);
+
+    qsort(hotv, KVDB_KEYLOCK_HOT_MAX, sizeof(*hotv), kvdb_keylock_hot_cmp);
+
+    for (hotc = i = 0; i < KVDB_KEYLOCK_HOT_MAX; ++i)
+        hotc += (hotv[i].kh_cnt > 0);
+
+    return hotc;
+}
+
+/* Record the hold time and size of a lock set whose first lock was
+ * sampled, as it is released.
+ */
+static void
+kvdb_keylock_hold_record(struct kvdb_keylock_impl *klock, struct kvdb_ctxn_locks_impl *locks)
+{
+    if (!locks->ctxn_locks_start)
+        return;
+
+    perfc_lat_record(&klock->kl_perfc_set, PERFC_LT_CTXNOP_LOCK_HOLD, locks->ctxn_locks_start);
+    perfc_rec_sample(&klock->kl_perfc_set, PERFC_DI_CTXNOP_LOCKS, locks->ctxn_locks_cnt);
+
+    locks->ctxn_locks_start = 0;
+}
+
 void
 kvdb_keylock_list_lock(struct kvdb_keylock *handle, void **cookiep)
 {
@@ -293,6 +391,8 @@ kvdb_keylock_prune_own_locks(struct kvdb_keylock *kl_handle, struct kvdb_ctxn_lo
     klock = kvdb_keylock_h2r(kl_handle);
     locks = kvdb_ctxn_locks_h2r(locks_handle);
 
+    kvdb_keylock_hold_record(klock, locks);
+
     tree = &locks->ctxn_locks_tree;
     cnt = locks->ctxn_locks_cnt;
     freeme = NULL;
@@ -322,6 +422,7 @@ kvdb_keylock_prune_own_locks(struct kvdb_keylock *kl_handle, struct kvdb_ctxn_lo
         entry = freeme;
         freeme = *(void **)entry;
         kmem_cache_free(kvdb_ctxn_entry_cache, entry);
+        kvdb_memacct_free(KVDB_MEMACCT_TXN, sizeof(*entry));
     }
 
     locks->ctxn_locks_cnt = cnt;
@@ -426,6 +527,8 @@ kvdb_keylock_release_locks(struct kvdb_keylock *kl_handle, struct kvdb_ctxn_lock
     klock = kvdb_keylock_h2r(kl_handle);
     locks = kvdb_ctxn_locks_h2r(locks_handle);
 
+    kvdb_keylock_hold_record(klock, locks);
+
     tree = &locks->ctxn_locks_tree;
     cnt = locks->ctxn_locks_cnt;
     freeme = NULL;
@@ -449,6 +552,7 @@ kvdb_keylock_release_locks(struct kvdb_keylock *kl_handle, struct kvdb_ctxn_lock
         entry = freeme;
         freeme = *(void **)entry;
         kmem_cache_free(kvdb_ctxn_entry_cache, entry);
+        kvdb_memacct_free(KVDB_MEMACCT_TXN, sizeof(*entry));
     }
 
     assert(cnt == 0);
@@ -550,6 +654,8 @@ kvdb_keylock_lock(
         if (ev(!entry))
             return merr(ENOMEM);
 
+        kvdb_memacct_alloc(KVDB_MEMACCT_TXN, sizeof(*entry));
+
         entry->lte_kfree = true;
     }
 
@@ -561,6 +667,13 @@ kvdb_keylock_lock(
     if (!err) {
         perfc_inc(&klock->kl_perfc_set, PERFC_RA_CTXNOP_LOCK_DONE);
 
+        if (inherited)
+            perfc_inc(&klock->kl_perfc_set, PERFC_RA_CTXNOP_LOCK_INHERIT);
+
+        if (!ctxn_locks->ctxn_locks_cnt)
+            ctxn_locks->ctxn_locks_start =
+                perfc_lat_startu(&klock->kl_perfc_set, PERFC_LT_CTXNOP_LOCK_HOLD);
+
         /* The lock was acquired in this attempt. Add it to the
          * container of write locks.
          */
@@ -575,10 +688,15 @@ kvdb_keylock_lock(
     } else {
         perfc_inc(&klock->kl_perfc_set, PERFC_RA_CTXNOP_LOCK_FAILED);
 
-        if (entry->lte_kfree)
+        if (merr_errno(err) == ECANCELED)
+            kvdb_keylock_hot_sample(klock, hash);
+
+        if (entry->lte_kfree) {
             kmem_cache_free(kvdb_ctxn_entry_cache, entry);
-        else
+            kvdb_memacct_free(KVDB_MEMACCT_TXN, sizeof(*entry));
+        } else {
             ctxn_locks->ctxn_locks_entryc--;
+        }
     }
 
     return err;
@@ -611,12 +729,15 @@ kvdb_ctxn_locks_create(struct kvdb_ctxn_locks **locksp)
         return merr(ENOMEM);
     }
 
+    kvdb_memacct_alloc(KVDB_MEMACCT_TXN, KVDB_LOCKS_SZ);
+
     assert(impl->ctxn_locks_magic == ~(uintptr_t)impl);
 
     /* impl is initialized by kvdb_ctxn_locks_ctor().
      */
     impl->ctxn_locks_magic = (uintptr_t)impl;
     impl->ctxn_locks_end_seqno = U64_MAX;
+    impl->ctxn_locks_start = 0;
     impl->ctxn_locks_tree = RB_ROOT;
     impl->ctxn_locks_entryc = 0;
 
@@ -624,6 +745,17 @@ kvdb_ctxn_locks_create(struct kvdb_ctxn_locks **locksp)
     return 0;
 }
 
+static void
+kvdb_ctxn_locks_free(struct rcu_head *rh)
+{
+    struct kvdb_ctxn_locks_impl *impl;
+
+    impl = container_of(rh, struct kvdb_ctxn_locks_impl, ctxn_locks_rcu);
+
+    kmem_cache_free(kvdb_ctxn_locks_cache, impl);
+    kvdb_memacct_free(KVDB_MEMACCT_TXN, KVDB_LOCKS_SZ);
+}
+
 void
 kvdb_ctxn_locks_destroy(struct kvdb_ctxn_locks *handle)
 {
@@ -636,7 +768,10 @@ kvdb_ctxn_locks_destroy(struct kvdb_ctxn_locks *handle)
 
     impl->ctxn_locks_magic = ~(uintptr_t)impl;
 
-    kmem_cache_free(kvdb_ctxn_locks_cache, impl);
+    /* A keylock_lock() that found this lock set as the owner of a lock
+     * may still be asking kvdb_ctxn_lock_inherit() about it.
+     */
+    call_rcu(&impl->ctxn_locks_rcu, kvdb_ctxn_locks_free);
 }
 
 u64
@@ -682,6 +817,8 @@ kvdb_ctxn_locks_fini(void)
     if (atomic_dec_return(&kvdb_ctxn_locks_init_ref) > 0)
         return;
 
+    rcu_barrier();
+
     kmem_cache_destroy(kvdb_ctxn_locks_cache);
     kvdb_ctxn_locks_cache = NULL;
 
@@ -15,6 +15,18 @@ struct kvdb_ctxn_locks;
 
 /* MTF_MOCK_DECL(kvdb_keylock) */
 
+#define KVDB_KEYLOCK_HOT_MAX 16
+
+/**
+ * struct kvdb_keylock_hot - a frequently conflicting lock
+ * @kh_hash:  48-bit lock hash (see kvdb_keylock_lock())
+ * @kh_cnt:   sampled conflicts on the hash (an upper bound)
+ */
+struct kvdb_keylock_hot {
+    u64 kh_hash;
+    u64 kh_cnt;
+};
+
 merr_t
 kvdb_keylock_create(struct kvdb_keylock **handle_out, u32 num_tables, u64 num_entries);
 
@@ -32,6 +44,19 @@ kvdb_keylock_list_unlock(void *cookie);
 void
 kvdb_keylock_perfc_init(struct kvdb_keylock *handle_out, struct perfc_set *perfc_set);
 
+/**
+ * kvdb_keylock_hot_get() - retrieve the most frequently conflicting locks
+ * @handle: handle to the KVDB keylock
+ * @hotv:   vector of KVDB_KEYLOCK_HOT_MAX entries, sorted by decreasing count
+ *
+ * Conflicts are sampled, so the report is cheap to maintain but the
+ * counts are relative rather than exact.
+ *
+ * Return: number of valid entries in %hotv
+ */
+u32
+kvdb_keylock_hot_get(struct kvdb_keylock *handle, struct kvdb_keylock_hot *hotv);
+
 /* MTF_MOCK */
 merr_t
 kvdb_keylock_lock(
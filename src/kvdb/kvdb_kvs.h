@@ -9,10 +9,27 @@
 #include <hse_util/inttypes.h>
 #include <hse_util/list.h>
 #include <hse_util/mutex.h>
+#include <hse_util/atomic.h>
+#include <hse_util/token_bucket.h>
+
+#include <hse_ikvdb/tuple.h>
 
 struct ikvs;
 struct ikvdb_impl;
 struct kvdb_kvs;
+struct lathist;
+
+/* Operations whose latencies are recorded per kvs (kvdb rparam lat_hist).
+ */
+enum kvdb_kvs_lat {
+    KVDB_KVS_LAT_PUT,
+    KVDB_KVS_LAT_GET,
+    KVDB_KVS_LAT_DEL,
+    KVDB_KVS_LAT_CURSOR_CREATE,
+    KVDB_KVS_LAT_CURSOR_SEEK,
+    KVDB_KVS_LAT_CURSOR_READ,
+    KVDB_KVS_LAT_MAX
+};
 
 /**
  * struct kvdb_kvs - Describes a kvs in the kvdb - open or closed
@@ -22,6 +39,18 @@ struct kvdb_kvs;
  * @kk_cnid:         id of the cn associated with kvdb.
  * @kk_cparams:      cn's create-time parameters.
  * @kk_flags:        flags for cn.
+ * @kk_merge_fn:     merge callback
+ * @kk_index:        kvs of the secondary index maintained by puts, if any
+ * @kk_index_fn:     index key extractor (see ikvdb_kvs_index_register())
+ * @kk_index_arg:    argument of @kk_index_fn
+ * @kk_index_of:     kvs whose secondary index this kvs is, if any
+ * @kk_lathv:        latency histograms by operation, NULL if not recorded
+ * @kk_thr_weight:   share of the throttled put rate (kvs rparam
+ *                   throttle_weight)
+ * @kk_thr_rate_min: guaranteed put rate in bytes/sec, 0 if none
+ * @kk_thr_bytes:    bytes put since the last share update
+ * @kk_thr_tb:       paces the puts of the kvs at its share of the put rate
+ * @kk_thr_floor:    guarantees @kk_thr_rate_min
  * @kk_cursors_lock: lock to access the list.
  * @kk_cursors:      list of cursors currently traversing the cn tree.
  * @kk_refcnt:       count of current users of the instance. Used mainly to
@@ -34,6 +63,18 @@ struct kvdb_kvs {
     u64                 kk_cnid;
     struct kvs_cparams *kk_cparams;
     u32                 kk_flags;
+    kvs_merge_fn *      kk_merge_fn;
+    struct kvdb_kvs *   kk_index;
+    kvs_index_fn *      kk_index_fn;
+    void *              kk_index_arg;
+    struct kvdb_kvs *   kk_index_of;
+    struct lathist *    kk_lathv[KVDB_KVS_LAT_MAX];
+    u64                 kk_thr_weight;
+    u64                 kk_thr_rate_min;
+
+    __aligned(SMP_CACHE_BYTES) atomic64_t kk_thr_bytes;
+    struct tbkt kk_thr_tb;
+    struct tbkt kk_thr_floor;
 
     __aligned(SMP_CACHE_BYTES) struct mutex kk_cursors_lock;
     struct list_head kk_cursors;
@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/minmax.h>
+#include <hse_util/string.h>
+#include <hse_util/event_counter.h>
+
+#include "kvdb_memgov.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <limits.h>
+
+#define KVDB_MEMGOV_C0_PCT (50)
+#define KVDB_MEMGOV_CACHE_MIN (4ul << 20)
+#define KVDB_MEMGOV_SCALE_MIN (25)
+#define KVDB_MEMGOV_SCALE_RECOVER (5)
+
+/**
+ * struct kvdb_memgov - memory governor
+ * @mg_budget:   configured budget (bytes)
+ * @mg_psi_hi:   pressure at which to cut back (hundredths of a percent)
+ * @mg_scale:    percent of the budget currently in effect
+ * @mg_psi_path: memory.pressure file of our cgroup, empty if none
+ * @mg_hitv:     cache hits seen at the previous update, by slot
+ * @mg_basev:    limits in effect without pressure, by slot (no budget only)
+ */
+struct kvdb_memgov {
+    size_t mg_budget;
+    uint   mg_psi_hi;
+    uint   mg_scale;
+    char   mg_psi_path[PATH_MAX];
+    u64    mg_hitv[KVDB_MEMGOV_SLOTS_MAX];
+    size_t mg_basev[KVDB_MEMGOV_SLOTS_MAX];
+};
+
+/* Find the memory.pressure file of the calling process' cgroup (v2),
+ * else fall back to the system wide pressure.
+ */
+static void
+kvdb_memgov_psi_init(struct kvdb_memgov *mg)
+{
+    char  line[PATH_MAX];
+    FILE *fp;
+
+    mg->mg_psi_path[0] = '\0';
+
+    fp = fopen("/proc/self/cgroup", "r");
+    if (fp) {
+        while (fgets(line, sizeof(line), fp)) {
+            if (strncmp(line, "0::", 3))
+                continue;
+
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(
+                mg->mg_psi_path,
+                sizeof(mg->mg_psi_path),
+                "/sys/fs/cgroup%s/memory.pressure",
+                strcmp(line + 3, "/") ? line + 3 : "");
+            break;
+        }
+        fclose(fp);
+    }
+
+    if (mg->mg_psi_path[0] && !access(mg->mg_psi_path, R_OK))
+        return;
+
+    strlcpy(mg->mg_psi_path, "/proc/pressure/memory", sizeof(mg->mg_psi_path));
+    if (access(mg->mg_psi_path, R_OK))
+        mg->mg_psi_path[0] = '\0';
+}
+
+/* Return the "some avg10" memory pressure in hundredths of a percent.
+ */
+static uint
+kvdb_memgov_psi(struct kvdb_memgov *mg)
+{
+    uint  whole = 0, frac = 0;
+    FILE *fp;
+
+    if (!mg->mg_psi_path[0])
+        return 0;
+
+    fp = fopen(mg->mg_psi_path, "r");
+    if (ev(!fp))
+        return 0;
+
+    if (fscanf(fp, "some avg10=%u.%2u", &whole, &frac) != 2)
+        whole = frac = 0;
+    fclose(fp);
+
+    return whole * 100 + frac;
+}
+
+merr_t
+kvdb_memgov_create(size_t budget, uint psi_pct, struct kvdb_memgov **mgp)
+{
+    struct kvdb_memgov *mg;
+
+    if (ev(!mgp))
+        return merr(EINVAL);
+
+    mg = calloc(1, sizeof(*mg));
+    if (ev(!mg))
+        return merr(ENOMEM);
+
+    mg->mg_budget = budget;
+    mg->mg_psi_hi = psi_pct * 100;
+    mg->mg_scale = 100;
+
+    if (mg->mg_psi_hi)
+        kvdb_memgov_psi_init(mg);
+
+    *mgp = mg;
+
+    return 0;
+}
+
+void
+kvdb_memgov_destroy(struct kvdb_memgov *mg)
+{
+    free(mg);
+}
+
+/* Without a budget, scale each consumer's unpressured limit.  The c0 base
+ * is a decaying peak of its usage, as c0 has no limit of its own.  A cache
+ * base only grows, as the limit read back from a cache is the one applied
+ * by the previous update.
+ */
+static void
+kvdb_memgov_adapt(
+    struct kvdb_memgov *      mg,
+    struct kvdb_memgov_slot * slotv,
+    uint                      slotc,
+    struct kvdb_memgov_stats *stats)
+{
+    uint i;
+
+    for (i = 0; i < slotc; ++i) {
+        struct kvdb_memgov_slot *slot = slotv + i;
+        size_t *                 base = mg->mg_basev + i;
+
+        if (!slot->mgs_active) {
+            *base = 0;
+            continue;
+        }
+
+        stats->mgt_used += slot->mgs_used;
+
+        if (mg->mg_scale == 100) {
+            if (i == 0)
+                *base = max_t(size_t, *base - *base / 8, slot->mgs_used);
+            else
+                *base = max_t(size_t, *base, slot->mgs_limit);
+
+            slot->mgs_limit = (i == 0) ? 0 : *base;
+            continue;
+        }
+
+        slot->mgs_limit = *base / 100 * mg->mg_scale;
+    }
+}
+
+void
+kvdb_memgov_update(
+    struct kvdb_memgov *      mg,
+    struct kvdb_memgov_slot * slotv,
+    uint                      slotc,
+    struct kvdb_memgov_stats *stats)
+{
+    size_t budget, rest, floor, spread;
+    u64    weightv[KVDB_MEMGOV_SLOTS_MAX];
+    u64    weight;
+    uint   psi, n, i;
+
+    slotc = min_t(uint, slotc, KVDB_MEMGOV_SLOTS_MAX);
+
+    memset(stats, 0, sizeof(*stats));
+
+    /* Cut back by a quarter for as long as the pressure is high, and
+     * recover slowly once it is well below the threshold.
+     */
+    psi = kvdb_memgov_psi(mg);
+    if (mg->mg_psi_hi && psi >= mg->mg_psi_hi) {
+        mg->mg_scale -= mg->mg_scale / 4;
+        mg->mg_scale = max_t(uint, mg->mg_scale, KVDB_MEMGOV_SCALE_MIN);
+        stats->mgt_pressure = true;
+    } else if (psi < mg->mg_psi_hi / 4) {
+        mg->mg_scale = min_t(uint, mg->mg_scale + KVDB_MEMGOV_SCALE_RECOVER, 100);
+    }
+
+    stats->mgt_psi = psi;
+    stats->mgt_scale = mg->mg_scale;
+
+    if (!mg->mg_budget) {
+        kvdb_memgov_adapt(mg, slotv, slotc, stats);
+        return;
+    }
+
+    budget = mg->mg_budget / 100 * mg->mg_scale;
+    rest = budget;
+
+    if (slotc > 0 && slotv[0].mgs_active) {
+        slotv[0].mgs_limit = budget / 100 * KVDB_MEMGOV_C0_PCT;
+        rest -= slotv[0].mgs_limit;
+        stats->mgt_used += slotv[0].mgs_used;
+    }
+
+    /* Weigh each cache by its hits since the previous update.  A slot
+     * whose hit count went backwards was reused by another kvs.
+     */
+    weight = 0;
+    n = 0;
+
+    for (i = 1; i < slotc; ++i) {
+        struct kvdb_memgov_slot *slot = slotv + i;
+
+        if (!slot->mgs_active) {
+            mg->mg_hitv[i] = 0;
+            continue;
+        }
+
+        weightv[i] = slot->mgs_hits - (slot->mgs_hits < mg->mg_hitv[i] ? 0 : mg->mg_hitv[i]);
+        weightv[i] += 1;
+        mg->mg_hitv[i] = slot->mgs_hits;
+
+        weight += weightv[i];
+        stats->mgt_used += slot->mgs_used;
+        ++n;
+    }
+
+    if (n > 0) {
+        floor = min_t(size_t, KVDB_MEMGOV_CACHE_MIN, rest / n);
+        spread = rest - floor * n;
+
+        for (i = 1; i < slotc; ++i) {
+            struct kvdb_memgov_slot *slot = slotv + i;
+            size_t                   target;
+
+            if (!slot->mgs_active)
+                continue;
+
+            target = floor + (size_t)((double)spread * weightv[i] / weight);
+
+            /* A cache that does not fill half its limit would not
+             * make use of more memory.
+             */
+            if (slot->mgs_used < slot->mgs_limit / 2)
+                target = min_t(size_t, target, max_t(size_t, floor, slot->mgs_used * 2));
+
+            /* Grow gradually, but shrink at once to honor the budget.
+             */
+            if (target > slot->mgs_limit)
+                target = slot->mgs_limit + (target - slot->mgs_limit) / 4;
+
+            slot->mgs_limit = target;
+        }
+    }
+
+    stats->mgt_budget = budget;
+}
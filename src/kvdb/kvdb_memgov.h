@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVDB_MEMGOV_H
+#define HSE_KVDB_MEMGOV_H
+
+#include <hse/hse_limits.h>
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The memory governor divides a single memory budget (rparam mem_budget)
+ * among the memory consumers of a kvdb.  Slot 0 is the c0 ingest buffers,
+ * which get a fixed share of the budget.  The remaining slots are caches
+ * (one per kvs), which divide the rest of the budget in proportion to the
+ * hits each had since the previous update.  A cache that does not fill
+ * its limit is not given more.
+ *
+ * If the kvdb runs in a cgroup (or system) that reports memory pressure
+ * stall information (PSI), the budget in effect is cut back whenever the
+ * pressure exceeds rparam mem_psi_pct, and slowly restored once it has
+ * subsided.
+ *
+ * Without a budget (rparam mem_adapt) the governor only reacts to memory
+ * pressure: each consumer's limit is scaled down from what it was using
+ * (c0) or allowed (caches) before the pressure arose, and restored once
+ * the pressure has subsided.  A c0 limit of zero means "unlimited".
+ */
+
+struct kvdb_memgov;
+
+#define KVDB_MEMGOV_SLOTS_MAX (HSE_KVS_COUNT_MAX + 1)
+
+/**
+ * struct kvdb_memgov_slot - one memory consumer as seen by the governor
+ * @mgs_active: the slot has a consumer
+ * @mgs_used:   bytes in use
+ * @mgs_limit:  limit in bytes, updated by kvdb_memgov_update()
+ * @mgs_hits:   cumulative hits of a cache
+ */
+struct kvdb_memgov_slot {
+    bool   mgs_active;
+    size_t mgs_used;
+    size_t mgs_limit;
+    u64    mgs_hits;
+};
+
+/**
+ * struct kvdb_memgov_stats - state of the governor after an update
+ * @mgt_budget:   budget in effect (bytes)
+ * @mgt_used:     bytes used by all consumers
+ * @mgt_psi:      memory pressure (some avg10, in hundredths of a percent)
+ * @mgt_scale:    percent of the budget (or of the unpressured limits) in effect
+ * @mgt_pressure: the budget was cut back by the update
+ */
+struct kvdb_memgov_stats {
+    size_t mgt_budget;
+    size_t mgt_used;
+    uint   mgt_psi;
+    uint   mgt_scale;
+    bool   mgt_pressure;
+};
+
+/**
+ * kvdb_memgov_create() - create a memory governor
+ * @budget:  memory budget in bytes, 0 to only adapt to memory pressure
+ * @psi_pct: memory pressure (percent) at which to shrink, 0 to ignore
+ * @mgp:     (output) governor
+ */
+merr_t
+kvdb_memgov_create(size_t budget, uint psi_pct, struct kvdb_memgov **mgp);
+
+void
+kvdb_memgov_destroy(struct kvdb_memgov *mg);
+
+/**
+ * kvdb_memgov_update() - recompute the limits of all consumers
+ * @mg:    governor
+ * @slotv: vector of consumers, slot 0 is c0
+ * @slotc: number of slots in %slotv
+ * @stats: (output) state of the governor
+ *
+ * On return the mgs_limit of each active slot holds the limit the caller
+ * should apply.  If %stats->mgt_pressure is set the caller should also
+ * release memory that is not accounted for by any slot.
+ */
+void
+kvdb_memgov_update(
+    struct kvdb_memgov *      mg,
+    struct kvdb_memgov_slot * slotv,
+    uint                      slotc,
+    struct kvdb_memgov_stats *stats);
+
+#endif
@@ -97,4 +97,66 @@ struct kvdb_kvmeta_omf {
 
 OMF_SETGET(struct kvdb_kvmeta_omf, kvmt_klen, 64);
 OMF_SETGET(struct kvdb_kvmeta_omf, kvmt_vlen, 64);
+
+#define KVDB_EXPORT_CHUNK_MAGIC ((u32)0x6b766368) /* ascii "kvch" */
+
+#define KVDB_EXPORT_COMP_NONE 0
+#define KVDB_EXPORT_COMP_LZ4 1
+
+/** struct kvdb_chunk_omf() - header of a chunk of an export data file
+ * @chk_magic: KVDB_EXPORT_CHUNK_MAGIC
+ * @chk_comp:  compression of the payload (KVDB_EXPORT_COMP_*)
+ * @chk_ulen:  length of the payload after decompression
+ * @chk_clen:  length of the payload as stored
+ * @chk_kvcnt: number of k-v pairs in the chunk
+ * @chk_crc:   XXH32 of the payload as stored
+ *
+ * The payload is a series of k-v pairs, each a struct kvdb_kvmeta_omf
+ * followed by the key and the value.
+ */
+struct kvdb_chunk_omf {
+    __le32 chk_magic;
+    __le32 chk_comp;
+    __le32 chk_ulen;
+    __le32 chk_clen;
+    __le32 chk_kvcnt;
+    __le32 chk_crc;
+} __packed;
+
+OMF_SETGET(struct kvdb_chunk_omf, chk_magic, 32);
+OMF_SETGET(struct kvdb_chunk_omf, chk_comp, 32);
+OMF_SETGET(struct kvdb_chunk_omf, chk_ulen, 32);
+OMF_SETGET(struct kvdb_chunk_omf, chk_clen, 32);
+OMF_SETGET(struct kvdb_chunk_omf, chk_kvcnt, 32);
+OMF_SETGET(struct kvdb_chunk_omf, chk_crc, 32);
+
+#define KVDB_STREAM_MAGIC ((u32)0x6b767374) /* ascii "kvst" */
+#define KVDB_STREAM_VERSION 1
+
+/** struct kvdb_stream_omf() - value of a key written by a kvs stream
+ * @ks_magic:   KVDB_STREAM_MAGIC
+ * @ks_version: KVDB_STREAM_VERSION
+ * @ks_chunk:   length of each chunk but the last
+ * @ks_crc:     XXH32 of the manifest with @ks_crc zeroed
+ * @ks_gen:     generation of the chunk keys
+ * @ks_len:     length of the streamed value
+ *
+ * The streamed value is stored in chunk keys, each the key followed by
+ * the generation and the chunk index, both big-endian.
+ */
+struct kvdb_stream_omf {
+    __le32 ks_magic;
+    __le32 ks_version;
+    __le32 ks_chunk;
+    __le32 ks_crc;
+    __le64 ks_gen;
+    __le64 ks_len;
+} __packed;
+
+OMF_SETGET(struct kvdb_stream_omf, ks_magic, 32);
+OMF_SETGET(struct kvdb_stream_omf, ks_version, 32);
+OMF_SETGET(struct kvdb_stream_omf, ks_chunk, 32);
+OMF_SETGET(struct kvdb_stream_omf, ks_crc, 32);
+OMF_SETGET(struct kvdb_stream_omf, ks_gen, 64);
+OMF_SETGET(struct kvdb_stream_omf, ks_len, 64);
 #endif /* HSE_KVDB_KVDB_OMF_H */
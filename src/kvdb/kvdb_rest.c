@@ -13,14 +13,26 @@
 #include <hse_util/rest_api.h>
 #include <hse_util/spinlock.h>
 #include <hse_util/string.h>
+#include <hse_util/lathist.h>
+#include <hse_util/parse_num.h>
 
 #include <hse_ikvdb/ikvdb.h>
+#include <hse_ikvdb/c0sk.h>
 #include <hse_ikvdb/kvs.h>
 #include <hse_ikvdb/cn.h>
 #include <hse_ikvdb/cn_tree_view.h>
+#include <hse_ikvdb/kvs_trace.h>
+#include <hse_ikvdb/cn_kvdb.h>
+#include <hse_ikvdb/cn_evlog.h>
+#include <hse_ikvdb/cn_scache.h>
+#include <hse_ikvdb/cn_reclaim.h>
+#include <hse_ikvdb/cn_scrub.h>
+#include <hse_ikvdb/cn_reap.h>
+#include <hse_ikvdb/io_sched.h>
 
 #include "kvdb_rest.h"
 #include "kvdb_kvs.h"
+#include "kvdb_keylock.h"
 
 #include <stdarg.h>
 
@@ -178,6 +190,628 @@ rest_kvdb_compact_status(
 
     return 0;
 }
+static merr_t
+rest_kvdb_txn_hot(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct kvdb_keylock_hot hotv[KVDB_KEYLOCK_HOT_MAX];
+    struct kvdb_keylock *   klock;
+    size_t                  b, buf_off;
+    char *                  buf = info->buf;
+    size_t                  bufsz = info->buf_sz;
+    u32                     hotc, i;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    klock = ikvdb_get_keylock(context);
+    if (ev(!klock))
+        return merr(EINVAL);
+
+    hotc = kvdb_keylock_hot_get(klock, hotv);
+
+    buf_off = 0;
+    b = snprintf_append(buf, bufsz, &buf_off, "hot_locks:\n");
+    for (i = 0; i < hotc; ++i) {
+        b += snprintf_append(buf, bufsz, &buf_off, "  - hash: 0x%012lx\n", hotv[i].kh_hash);
+        b += snprintf_append(buf, bufsz, &buf_off, "    conflicts: %lu\n", hotv[i].kh_cnt);
+    }
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the cn event log, oldest first.  The optional argument
+ * "since" skips the events up to and including the given event number,
+ * so that a client can poll for new events.
+ */
+static merr_t
+rest_kvdb_cn_events(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_kvdb * cn_kvdb;
+    struct cn_event *evv;
+    struct rest_kv * kv;
+    size_t           b, buf_off;
+    char *           buf = info->buf;
+    size_t           bufsz = info->buf_sz;
+    u64              since = 0;
+    uint             evc, i;
+    merr_t           err;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    while ((kv = rest_kv_next(iter)) != NULL) {
+        if (strcmp(kv->key, "since") != 0)
+            return merr(ev(EINVAL));
+
+        err = parse_u64(kv->value, &since);
+        if (ev(err))
+            return err;
+    }
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb || !cn_kvdb->cnd_evlog))
+        return merr(EINVAL);
+
+    evv = malloc(CN_EVLOG_SZ * sizeof(*evv));
+    if (ev(!evv))
+        return merr(ENOMEM);
+
+    evc = cn_evlog_read(cn_kvdb->cnd_evlog, since, evv, CN_EVLOG_SZ);
+
+    rest_write_string(info->resp_fd, evc ? "events:\n" : "events: []\n");
+
+    for (i = 0; i < evc; ++i) {
+        const struct cn_event *cev = evv + i;
+
+        buf_off = 0;
+        b = snprintf_append(buf, bufsz, &buf_off, "  - seq: %lu\n", cev->ce_seq);
+        b += snprintf_append(buf, bufsz, &buf_off, "    time: %lu\n", cev->ce_time);
+        b += snprintf_append(
+            buf, bufsz, &buf_off, "    type: %s\n", cn_event_type2str(cev->ce_type));
+        b += snprintf_append(
+            buf, bufsz, &buf_off, "    rule: %s\n", cn_event_rule2str(cev->ce_rule));
+        b += snprintf_append(buf, bufsz, &buf_off, "    cnid: %lu\n", cev->ce_cnid);
+        b += snprintf_append(buf, bufsz, &buf_off, "    level: %u\n", cev->ce_level);
+        b += snprintf_append(buf, bufsz, &buf_off, "    offset: %u\n", cev->ce_offset);
+        b += snprintf_append(buf, bufsz, &buf_off, "    kvsets_in: %u\n", cev->ce_kvsets_in);
+        b += snprintf_append(buf, bufsz, &buf_off, "    kvsets_out: %u\n", cev->ce_kvsets_out);
+        b += snprintf_append(buf, bufsz, &buf_off, "    keys_in: %lu\n", cev->ce_keys_in);
+        b += snprintf_append(buf, bufsz, &buf_off, "    keys_out: %lu\n", cev->ce_keys_out);
+        b += snprintf_append(buf, bufsz, &buf_off, "    bytes_in: %lu\n", cev->ce_bytes_in);
+        b += snprintf_append(buf, bufsz, &buf_off, "    bytes_out: %lu\n", cev->ce_bytes_out);
+        b += snprintf_append(buf, bufsz, &buf_off, "    queue_ns: %lu\n", cev->ce_queue_ns);
+        b += snprintf_append(buf, bufsz, &buf_off, "    run_ns: %lu\n", cev->ce_run_ns);
+        b += snprintf_append(
+            buf, bufsz, &buf_off, "    throttle_ns: %lu\n", cev->ce_throttle_ns);
+        b += snprintf_append(buf, bufsz, &buf_off, "    token: %u\n", cev->ce_token);
+        b += snprintf_append(buf, bufsz, &buf_off, "    errno: %u\n", cev->ce_errno);
+
+        write(info->resp_fd, buf, b);
+    }
+
+    free(evv);
+
+    return 0;
+}
+
+/* GET returns the c0 ingest event log, oldest first, with the time each
+ * ingest spent in each stage.  The optional argument "since" skips the
+ * events up to and including the given event number.
+ */
+static merr_t
+rest_kvdb_c0_ingests(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct c0sk_ingest_event *evv;
+    struct rest_kv *          kv;
+    struct c0sk *             c0sk = NULL;
+    size_t                    b, buf_off;
+    char *                    buf = info->buf;
+    size_t                    bufsz = info->buf_sz;
+    u64                       since = 0;
+    uint                      evc, i, j;
+    merr_t                    err;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    while ((kv = rest_kv_next(iter)) != NULL) {
+        if (strcmp(kv->key, "since") != 0)
+            return merr(ev(EINVAL));
+
+        err = parse_u64(kv->value, &since);
+        if (ev(err))
+            return err;
+    }
+
+    ikvdb_get_c0sk(context, &c0sk);
+    if (ev(!c0sk))
+        return merr(EINVAL);
+
+    evv = malloc(C0SK_IEVLOG_SZ * sizeof(*evv));
+    if (ev(!evv))
+        return merr(ENOMEM);
+
+    evc = c0sk_ingest_events(c0sk, since, evv, C0SK_IEVLOG_SZ);
+
+    rest_write_string(info->resp_fd, evc ? "ingests:\n" : "ingests: []\n");
+
+    for (i = 0; i < evc; ++i) {
+        const struct c0sk_ingest_event *iev = evv + i;
+
+        buf_off = 0;
+        b = snprintf_append(buf, bufsz, &buf_off, "  - seq: %lu\n", iev->cie_seq);
+        b += snprintf_append(buf, bufsz, &buf_off, "    time: %lu\n", iev->cie_time);
+        b += snprintf_append(buf, bufsz, &buf_off, "    gen: %lu\n", iev->cie_gen);
+        b += snprintf_append(buf, bufsz, &buf_off, "    width: %u\n", iev->cie_width);
+        b += snprintf_append(buf, bufsz, &buf_off, "    kvms: %u\n", iev->cie_kvms);
+        b += snprintf_append(buf, bufsz, &buf_off, "    streams: %u\n", iev->cie_streams);
+        b += snprintf_append(buf, bufsz, &buf_off, "    kbytes: %lu\n", iev->cie_kbytes);
+        b += snprintf_append(buf, bufsz, &buf_off, "    vbytes: %lu\n", iev->cie_vbytes);
+        b += snprintf_append(buf, bufsz, &buf_off, "    errno: %u\n", iev->cie_errno);
+        b += snprintf_append(buf, bufsz, &buf_off, "    stages_ns:\n");
+
+        for (j = 0; j < C0SK_IST_MAX; ++j)
+            b += snprintf_append(
+                buf,
+                bufsz,
+                &buf_off,
+                "      %s: %lu\n",
+                c0sk_ingest_stage2str(j),
+                iev->cie_stagev[j]);
+
+        write(info->resp_fd, buf, b);
+    }
+
+    free(evv);
+
+    return 0;
+}
+
+/* GET returns the time spent in each phase of the open and close of the
+ * kvdb, and the work done by the phase in the unit of the phase.
+ */
+static merr_t
+rest_kvdb_startup(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct ikvdb_phase_stats phv[IKVDB_PH_MAX];
+    const char *             name, *unit;
+    size_t                   b, buf_off;
+    char *                   buf = info->buf;
+    size_t                   bufsz = info->buf_sz;
+    int                      i;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    ikvdb_phase_get(context, phv);
+
+    buf_off = 0;
+    b = snprintf_append(buf, bufsz, &buf_off, "phases:\n");
+
+    for (i = 0; i < IKVDB_PH_MAX; ++i) {
+        name = ikvdb_phase2str(i, &unit);
+
+        b += snprintf_append(buf, bufsz, &buf_off, "  %s:\n", name);
+        b += snprintf_append(buf, bufsz, &buf_off, "    us: %lu\n", phv[i].ips_ns / 1000);
+        if (unit)
+            b += snprintf_append(buf, bufsz, &buf_off, "    %s: %lu\n", unit, phv[i].ips_count);
+    }
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the occupancy and hit counts of the staging cache.
+ */
+static merr_t
+rest_kvdb_cn_scache(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_scache_usage usage;
+    struct cn_kvdb *       cn_kvdb;
+    size_t                 b, buf_off = 0;
+    char *                 buf = info->buf;
+    size_t                 bufsz = info->buf_sz;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    cn_scache_usage(cn_kvdb->cnd_scache, &usage);
+
+    b = snprintf_append(buf, bufsz, &buf_off, "enabled: %s\n", cn_kvdb->cnd_scache ? "yes" : "no");
+    b += snprintf_append(buf, bufsz, &buf_off, "size: %lu\n", usage.scu_size);
+    b += snprintf_append(buf, bufsz, &buf_off, "hits: %lu\n", usage.scu_hits);
+    b += snprintf_append(buf, bufsz, &buf_off, "misses: %lu\n", usage.scu_misses);
+    b += snprintf_append(buf, bufsz, &buf_off, "fills: %lu\n", usage.scu_fills);
+    b += snprintf_append(buf, bufsz, &buf_off, "evictions: %lu\n", usage.scu_evicts);
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the activity of the queue of mblocks to delete.
+ */
+static merr_t
+rest_kvdb_cn_reclaim(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_reclaim_usage usage;
+    struct cn_kvdb *        cn_kvdb;
+    size_t                  b, buf_off = 0;
+    char *                  buf = info->buf;
+    size_t                  bufsz = info->buf_sz;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    cn_reclaim_usage(cn_kvdb->cnd_reclaim, &usage);
+
+    b = snprintf_append(buf, bufsz, &buf_off, "enabled: %s\n", cn_kvdb->cnd_reclaim ? "yes" : "no");
+    b += snprintf_append(buf, bufsz, &buf_off, "queued: %lu\n", usage.cru_queued);
+    b += snprintf_append(buf, bufsz, &buf_off, "mblocks: %lu\n", usage.cru_mblocks);
+    b += snprintf_append(buf, bufsz, &buf_off, "bytes: %lu\n", usage.cru_bytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "batches: %lu\n", usage.cru_batches);
+    b += snprintf_append(buf, bufsz, &buf_off, "errors: %lu\n", usage.cru_errors);
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the activity of the background kvset verifier.
+ */
+static merr_t
+rest_kvdb_cn_scrub(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_scrub_stats stats;
+    struct cn_kvdb *      cn_kvdb;
+    size_t                b, buf_off = 0;
+    char *                buf = info->buf;
+    size_t                bufsz = info->buf_sz;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    cn_scrub_stats(cn_kvdb->cnd_scrub, &stats);
+
+    b = snprintf_append(buf, bufsz, &buf_off, "enabled: %s\n", cn_kvdb->cnd_scrub ? "yes" : "no");
+    b += snprintf_append(buf, bufsz, &buf_off, "kvsets: %lu\n", stats.css_kvsets);
+    b += snprintf_append(buf, bufsz, &buf_off, "bytes: %lu\n", stats.css_bytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "passes: %lu\n", stats.css_passes);
+    b += snprintf_append(buf, bufsz, &buf_off, "errors: %lu\n", stats.css_errors);
+
+    if (stats.css_errors) {
+        b += snprintf_append(buf, bufsz, &buf_off, "last_cnid: %lu\n", stats.css_last_cnid);
+        b += snprintf_append(buf, bufsz, &buf_off, "last_tag: %lu\n", stats.css_last_tag);
+    }
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the activity of the reaper of dropped kvses.
+ */
+static merr_t
+rest_kvdb_cn_reap(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_reap_stats stats;
+    struct cn_kvdb *     cn_kvdb;
+    size_t               b, buf_off = 0;
+    char *               buf = info->buf;
+    size_t               bufsz = info->buf_sz;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    cn_reap_stats(cn_kvdb->cnd_reap, &stats);
+
+    b = snprintf_append(buf, bufsz, &buf_off, "kvses: %lu\n", stats.crs_cns);
+    b += snprintf_append(buf, bufsz, &buf_off, "mblocks: %lu\n", stats.crs_mblocks);
+    b += snprintf_append(buf, bufsz, &buf_off, "bytes: %lu\n", stats.crs_bytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "errors: %lu\n", stats.crs_errors);
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the bytes of cn mblocks allocated in each lifetime class.
+ */
+static merr_t
+rest_kvdb_cn_mblock_life(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct cn_kvdb *cn_kvdb;
+    size_t          b = 0, buf_off = 0;
+    char *          buf = info->buf;
+    size_t          bufsz = info->buf_sz;
+    int             i;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    for (i = 0; i < MBLOCK_LIFE_CNT; ++i)
+        b += snprintf_append(
+            buf,
+            bufsz,
+            &buf_off,
+            "%s: %lu\n",
+            mblock_life_name(i),
+            atomic64_read(&cn_kvdb->cnd_life_alloc[i]));
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns, for each media class and I/O class, the I/Os admitted by
+ * the I/O scheduler and the time they waited for admission.
+ */
+static merr_t
+rest_kvdb_io_sched(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    static const char *const mcnamev[] = { "staging", "capacity" };
+
+    struct io_sched_stats stats;
+    struct cn_kvdb *      cn_kvdb;
+    size_t                b, buf_off = 0;
+    char *                buf = info->buf;
+    size_t                bufsz = info->buf_sz;
+    int                   i, j;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    cn_kvdb = ikvdb_get_cn_kvdb(context);
+    if (ev(!cn_kvdb))
+        return merr(EINVAL);
+
+    b = snprintf_append(buf, bufsz, &buf_off, "enabled: %s\n", cn_kvdb->cnd_ios ? "yes" : "no");
+
+    for (i = 0; cn_kvdb->cnd_ios && i < NELEM(mcnamev); ++i) {
+        b += snprintf_append(buf, bufsz, &buf_off, "%s:\n", mcnamev[i]);
+
+        for (j = 0; j < IOS_CLASS_CNT; ++j) {
+            io_sched_stats(cn_kvdb->cnd_ios, i, j, &stats);
+
+            b += snprintf_append(
+                buf,
+                bufsz,
+                &buf_off,
+                "  %s: { ops: %lu, bytes: %lu, waits: %lu, wait_ns: %lu, max_ns: %lu }\n",
+                io_sched_class_name(j),
+                stats.iss_ops,
+                stats.iss_bytes,
+                stats.iss_waits,
+                stats.iss_wait_ns,
+                stats.iss_max_ns);
+        }
+    }
+
+    write(info->resp_fd, buf, b);
+
+    return 0;
+}
+
+/* GET returns the operations saved by the flight recorder (i.e., those
+ * slower than their kvs' kvs_flight_us) of all threads, oldest first.
+ */
+static merr_t
+rest_kvdb_flight(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct kvs_trace *tracev;
+    uint              tracec, i;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    tracev = malloc(KVS_FLIGHT_DUMP_MAX * sizeof(*tracev));
+    if (ev(!tracev))
+        return merr(ENOMEM);
+
+    tracec = kvs_flight_read(tracev, KVS_FLIGHT_DUMP_MAX);
+
+    rest_write_string(info->resp_fd, tracec ? "flight:\n" : "flight: []\n");
+
+    for (i = 0; i < tracec; ++i)
+        write(info->resp_fd, info->buf, kvs_trace_fmt(tracev + i, info->buf, info->buf_sz));
+
+    free(tracev);
+
+    return 0;
+}
+
+/*---------------------------------------------------------------
+ * rest: latency histograms
+ */
+static const char *const rest_txn_lat_namev[IKVDB_TXN_LAT_MAX] = {
+    [IKVDB_TXN_LAT_BEGIN] = "txn_begin",
+    [IKVDB_TXN_LAT_COMMIT] = "txn_commit",
+    [IKVDB_TXN_LAT_ABORT] = "txn_abort",
+};
+
+static const char *const rest_kvs_lat_namev[KVDB_KVS_LAT_MAX] = {
+    [KVDB_KVS_LAT_PUT] = "put",
+    [KVDB_KVS_LAT_GET] = "get",
+    [KVDB_KVS_LAT_DEL] = "del",
+    [KVDB_KVS_LAT_CURSOR_CREATE] = "cursor_create",
+    [KVDB_KVS_LAT_CURSOR_SEEK] = "cursor_seek",
+    [KVDB_KVS_LAT_CURSOR_READ] = "cursor_read",
+};
+
+/* Emit the count, mean and percentiles (in nanoseconds) of each histogram
+ * over its current window.
+ */
+static merr_t
+rest_lathist_get(
+    struct conn_info * info,
+    struct lathist **  lathv,
+    const char *const *namev,
+    uint               lathc)
+{
+    struct lathist_snap *snap;
+    u64                  mean;
+    size_t               b, buf_off;
+    char *               buf = info->buf;
+    size_t               bufsz = info->buf_sz;
+    uint                 i;
+
+    snap = malloc(sizeof(*snap));
+    if (ev(!snap))
+        return merr(ENOMEM);
+
+    for (i = 0; i < lathc; ++i) {
+        if (!lathv[i])
+            continue;
+
+        memset(snap, 0, sizeof(*snap));
+        lathist_snap(lathv[i], snap);
+
+        mean = snap->lss_count ? snap->lss_sum / snap->lss_count : 0;
+
+        buf_off = 0;
+        b = snprintf_append(buf, bufsz, &buf_off, "%s:\n", namev[i]);
+        b += snprintf_append(
+            buf, bufsz, &buf_off, "  window_ms: %lu\n", snap->lss_window / 1000000);
+        b += snprintf_append(buf, bufsz, &buf_off, "  count: %lu\n", snap->lss_count);
+        b += snprintf_append(buf, bufsz, &buf_off, "  mean: %lu\n", mean);
+        b += snprintf_append(buf, bufsz, &buf_off, "  p50: %lu\n", lathist_snap_pct(snap, 50.0));
+        b += snprintf_append(buf, bufsz, &buf_off, "  p90: %lu\n", lathist_snap_pct(snap, 90.0));
+        b += snprintf_append(buf, bufsz, &buf_off, "  p99: %lu\n", lathist_snap_pct(snap, 99.0));
+        b += snprintf_append(buf, bufsz, &buf_off, "  p99.9: %lu\n", lathist_snap_pct(snap, 99.9));
+        b += snprintf_append(
+            buf, bufsz, &buf_off, "  p99.99: %lu\n", lathist_snap_pct(snap, 99.99));
+        b += snprintf_append(buf, bufsz, &buf_off, "  max: %lu\n", snap->lss_max);
+
+        write(info->resp_fd, buf, b);
+    }
+
+    free(snap);
+
+    return 0;
+}
+
+/* Start a new window for each histogram.
+ */
+static void
+rest_lathist_reset(struct lathist **lathv, uint lathc)
+{
+    uint i;
+
+    for (i = 0; i < lathc; ++i) {
+        if (lathv[i])
+            lathist_reset(lathv[i]);
+    }
+}
+
+static merr_t
+rest_kvdb_txn_lat_get(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    return rest_lathist_get(
+        info, ikvdb_get_txn_lathist(context), rest_txn_lat_namev, IKVDB_TXN_LAT_MAX);
+}
+
+static merr_t
+rest_kvdb_txn_lat_put(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    rest_lathist_reset(ikvdb_get_txn_lathist(context), IKVDB_TXN_LAT_MAX);
+
+    return 0;
+}
+
 merr_t
 kvdb_rest_register(const char *mp_name, void *kvdb)
 {
@@ -198,6 +832,87 @@ kvdb_rest_register(const char *mp_name, void *kvdb)
         rest_kvdb_compact_request,
         "mpool/%s/compact",
         mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status =
+        rest_url_register(kvdb, URL_FLAG_NONE, rest_kvdb_txn_hot, 0, "mpool/%s/txn/hot", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb,
+        URL_FLAG_NONE,
+        rest_kvdb_txn_lat_get,
+        rest_kvdb_txn_lat_put,
+        "mpool/%s/txn/latency",
+        mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_events, 0, "mpool/%s/cn/events", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_c0_ingests, 0, "mpool/%s/c0/ingests", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_startup, 0, "mpool/%s/startup", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_scache, 0, "mpool/%s/cn/scache", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_reclaim, 0, "mpool/%s/cn/reclaim", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_scrub, 0, "mpool/%s/cn/scrub", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_reap, 0, "mpool/%s/cn/reap", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvdb, URL_FLAG_NONE, rest_kvdb_cn_mblock_life, 0, "mpool/%s/cn/mblock_life", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status =
+        rest_url_register(kvdb, URL_FLAG_NONE, rest_kvdb_io_sched, 0, "mpool/%s/io_sched", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status =
+        rest_url_register(kvdb, URL_FLAG_NONE, rest_kvdb_flight, 0, "mpool/%s/flight", mp_name);
+
+    if (ev(status) && !err)
+        err = status;
+
     return err;
 }
 
@@ -307,6 +1022,17 @@ print_unit(
     yaml2fd(fd, yaml_field_fmt, yc, "nvblks", "%d", nvblks);
 }
 
+/* Access heat, decayed by half every minute (see kvset_get_metrics()).
+ */
+static void
+print_heat(struct kvset_metrics *m, int fd, struct yaml_context *yc)
+{
+    yaml2fd(fd, yaml_field_fmt, yc, "heat_probes", "%lu", m->heat_probes);
+    yaml2fd(fd, yaml_field_fmt, yc, "heat_hits", "%lu", m->heat_hits);
+    yaml2fd(fd, yaml_field_fmt, yc, "heat_seeks", "%lu", m->heat_seeks);
+    yaml2fd(fd, yaml_field_fmt, yc, "heat_bytes", "%lu", m->heat_bytes);
+}
+
 static void
 print_elem(
     const char *          who,
@@ -351,6 +1077,7 @@ print_elem(
                 ctx->num_vblks,
                 ctx->fd,
                 yc);
+            print_heat(m, ctx->fd, yc);
 
             if (ctx->list) {
                 yaml2fd(ctx->fd, yaml_start_element_type, yc, "kblks");
@@ -386,6 +1113,7 @@ print_elem(
                 ctx->node_vblks,
                 ctx->fd,
                 yc);
+            print_heat(m, ctx->fd, yc);
             yaml2fd(ctx->fd, yaml_end_element, yc);
             yaml2fd(ctx->fd, yaml_end_element_type, yc);
 
@@ -444,6 +1172,10 @@ print_tree(struct ctx *ctx, struct cn_node_loc *loc, struct kvset *kvset)
     ctx->node.num_vblocks += km.num_vblocks;
     ctx->node.tot_key_bytes += km.tot_key_bytes;
     ctx->node.tot_val_bytes += km.tot_val_bytes;
+    ctx->node.heat_probes += km.heat_probes;
+    ctx->node.heat_hits += km.heat_hits;
+    ctx->node.heat_seeks += km.heat_seeks;
+    ctx->node.heat_bytes += km.heat_bytes;
 
     ctx->total.num_keys += km.num_keys;
     ctx->total.num_tombstones += km.num_tombstones;
@@ -451,6 +1183,10 @@ print_tree(struct ctx *ctx, struct cn_node_loc *loc, struct kvset *kvset)
     ctx->total.num_vblocks += km.num_vblocks;
     ctx->total.tot_key_bytes += km.tot_key_bytes;
     ctx->total.tot_val_bytes += km.tot_val_bytes;
+    ctx->total.heat_probes += km.heat_probes;
+    ctx->total.heat_hits += km.heat_hits;
+    ctx->total.heat_seeks += km.heat_seeks;
+    ctx->total.heat_bytes += km.heat_bytes;
 
     print_elem("kvset", ctx, &km, loc, kvset);
 
@@ -518,6 +1254,7 @@ query_tree(struct kvdb_kvs *kvs, struct yaml_context *yc, int fd, bool list)
         ctx.tot_vblks,
         ctx.fd,
         yc);
+    print_heat(m, ctx.fd, yc);
 
     yaml2fd(
         ctx.fd,
@@ -529,6 +1266,19 @@ query_tree(struct kvdb_kvs *kvs, struct yaml_context *yc, int fd, bool list)
 
     yaml2fd(ctx.fd, yaml_field_fmt, yc, "nodes", "%u", ctx.tot_nodes);
 
+    /* Bytes of blooms and wbt index nodes pinned by cn_pin_lvl.
+     */
+    for (i = 0; i < CN_PIN_LVL_MAX; i++) {
+        u64 pinned = cn_get_pinned(cn, i);
+
+        if (pinned) {
+            char key[32];
+
+            snprintf(key, sizeof(key), "pinned_l%d", i);
+            yaml2fd(ctx.fd, yaml_field_fmt, yc, key, "%lu", pinned);
+        }
+    }
+
     yaml2fd(ctx.fd, yaml_end_element, yc);
 
     yaml2fd(ctx.fd, yaml_end_element, yc);
@@ -925,6 +1675,214 @@ done:
     return 0;
 }
 
+static merr_t
+rest_kvs_lat(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context,
+    bool              reset)
+{
+    struct kvdb_kvs *kvs = context;
+    merr_t           err = 0;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    /* The histograms are freed when the kvs is closed, which waits
+     * for our reference to be dropped.
+     */
+    atomic_inc(&kvs->kk_refcnt);
+    if (kvs->kk_ikvs) {
+        if (reset)
+            rest_lathist_reset(kvs->kk_lathv, KVDB_KVS_LAT_MAX);
+        else
+            err = rest_lathist_get(info, kvs->kk_lathv, rest_kvs_lat_namev, KVDB_KVS_LAT_MAX);
+    }
+    atomic_dec(&kvs->kk_refcnt);
+
+    return err;
+}
+
+static merr_t
+rest_kvs_lat_get(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    return rest_kvs_lat(path, info, url, iter, context, false);
+}
+
+static merr_t
+rest_kvs_lat_put(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    return rest_kvs_lat(path, info, url, iter, context, true);
+}
+
+static double
+rest_amp_ratio(u64 num, u64 den)
+{
+    return den ? (double)num / den : 0.0;
+}
+
+static void
+rest_kvs_amp_emit(int fd, const char *name, const struct cn_amp *amp, char *buf, size_t bufsz)
+{
+    size_t b, buf_off;
+    u64    wbytes;
+
+    wbytes = amp->ca_c1bytes + amp->ca_ingest + amp->ca_spill + amp->ca_kcompact +
+             amp->ca_kvcompact;
+
+    buf_off = 0;
+    b = snprintf_append(buf, bufsz, &buf_off, "%s:\n", name);
+    if (amp->ca_window)
+        b += snprintf_append(buf, bufsz, &buf_off, "  window_ns: %lu\n", amp->ca_window);
+    b += snprintf_append(buf, bufsz, &buf_off, "  user_bytes: %lu\n", amp->ca_ubytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "  c1_bytes: %lu\n", amp->ca_c1bytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "  ingest_bytes: %lu\n", amp->ca_ingest);
+    b += snprintf_append(buf, bufsz, &buf_off, "  spill_bytes: %lu\n", amp->ca_spill);
+    b += snprintf_append(buf, bufsz, &buf_off, "  kcompact_bytes: %lu\n", amp->ca_kcompact);
+    b += snprintf_append(buf, bufsz, &buf_off, "  kvcompact_bytes: %lu\n", amp->ca_kvcompact);
+    b += snprintf_append(buf, bufsz, &buf_off, "  compact_read_bytes: %lu\n", amp->ca_rbytes);
+    b += snprintf_append(buf, bufsz, &buf_off, "  gets: %lu\n", amp->ca_gets);
+    b += snprintf_append(buf, bufsz, &buf_off, "  kvsets_probed: %lu\n", amp->ca_kvsets);
+    b += snprintf_append(
+        buf, bufsz, &buf_off, "  write_amp: %.2f\n", rest_amp_ratio(wbytes, amp->ca_ubytes));
+    b += snprintf_append(
+        buf,
+        bufsz,
+        &buf_off,
+        "  read_amp_kvsets: %.2f\n",
+        rest_amp_ratio(amp->ca_kvsets, amp->ca_gets));
+    b += snprintf_append(
+        buf,
+        bufsz,
+        &buf_off,
+        "  read_amp_bytes: %.2f\n",
+        rest_amp_ratio(amp->ca_rbytes, amp->ca_ubytes));
+    b += snprintf_append(
+        buf,
+        bufsz,
+        &buf_off,
+        "  space_amp: %.2f\n",
+        rest_amp_ratio(amp->ca_alen, amp->ca_lgood));
+
+    write(fd, buf, b);
+}
+
+/* GET reports the cumulative and windowed amplification of a kvs,
+ * PUT starts a new window.
+ */
+static merr_t
+rest_kvs_amp(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context,
+    bool              reset)
+{
+    struct kvdb_kvs *kvs = context;
+    struct cn_amp    cum, win;
+    bool             valid = false;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    atomic_inc(&kvs->kk_refcnt);
+    if (kvs->kk_ikvs) {
+        struct cn *cn = kvs_cn(kvs->kk_ikvs);
+
+        if (reset)
+            cn_amp_reset(cn);
+        else
+            cn_amp_read(cn, &cum, &win);
+        valid = true;
+    }
+    atomic_dec(&kvs->kk_refcnt);
+
+    if (!valid || reset)
+        return 0;
+
+    cum.ca_window = 0;
+    rest_kvs_amp_emit(info->resp_fd, "cumulative", &cum, info->buf, info->buf_sz);
+    rest_kvs_amp_emit(info->resp_fd, "window", &win, info->buf, info->buf_sz);
+
+    return 0;
+}
+
+static merr_t
+rest_kvs_amp_get(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    return rest_kvs_amp(path, info, url, iter, context, false);
+}
+
+static merr_t
+rest_kvs_amp_put(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    return rest_kvs_amp(path, info, url, iter, context, true);
+}
+
+static merr_t
+rest_kvs_trace(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    struct kvdb_kvs *      kvs = context;
+    struct kvs_trace_ring *ring;
+    struct kvs_trace *     tracev;
+    uint                   tracec, i;
+
+    if (strcmp(path, url) != 0)
+        return merr(ev(E2BIG));
+
+    tracev = malloc(KVS_TRACE_RING_SZ * sizeof(*tracev));
+    if (ev(!tracev))
+        return merr(ENOMEM);
+
+    tracec = 0;
+
+    /* The ring is freed when the kvs is closed, which waits for our
+     * reference to be dropped.
+     */
+    atomic_inc(&kvs->kk_refcnt);
+    ring = kvs->kk_ikvs ? ikvs_trace_ring(kvs->kk_ikvs) : NULL;
+    if (ring)
+        tracec = kvs_trace_ring_read(ring, tracev, KVS_TRACE_RING_SZ);
+    atomic_dec(&kvs->kk_refcnt);
+
+    rest_write_string(info->resp_fd, tracec ? "traces:\n" : "traces: []\n");
+
+    for (i = 0; i < tracec; ++i)
+        write(info->resp_fd, info->buf, kvs_trace_fmt(tracev + i, info->buf, info->buf_sz));
+
+    free(tracev);
+
+    return 0;
+}
+
 merr_t
 kvs_rest_register(const char *mp_name, const char *kvs_name, void *kvs)
 {
@@ -935,13 +1893,49 @@ kvs_rest_register(const char *mp_name, const char *kvs_name, void *kvs)
         return merr(ev(EINVAL));
 
     status = rest_url_register(
-        kvs, URL_FLAG_NONE, rest_kvs_tree, 0, "mpool/%s/kvs/%s/cn/tree", mp_name, kvs_name);
+        kvs, URL_FLAG_HEAVY, rest_kvs_tree, 0, "mpool/%s/kvs/%s/cn/tree", mp_name, kvs_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvs,
+        URL_FLAG_BINVAL | URL_FLAG_HEAVY,
+        rest_kvs_curperf,
+        0,
+        "mpool/%s/kvs/%s/curperf",
+        mp_name,
+        kvs_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvs,
+        URL_FLAG_NONE,
+        rest_kvs_lat_get,
+        rest_kvs_lat_put,
+        "mpool/%s/kvs/%s/latency",
+        mp_name,
+        kvs_name);
 
     if (ev(status) && !err)
         err = status;
 
     status = rest_url_register(
-        kvs, URL_FLAG_BINVAL, rest_kvs_curperf, 0, "mpool/%s/kvs/%s/curperf", mp_name, kvs_name);
+        kvs, URL_FLAG_NONE, rest_kvs_trace, 0, "mpool/%s/kvs/%s/trace", mp_name, kvs_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_register(
+        kvs,
+        URL_FLAG_NONE,
+        rest_kvs_amp_get,
+        rest_kvs_amp_put,
+        "mpool/%s/kvs/%s/amp",
+        mp_name,
+        kvs_name);
 
     if (ev(status) && !err)
         err = status;
@@ -965,6 +1959,21 @@ kvs_rest_deregister(const char *mp_name, const char *kvs_name)
 
     status = rest_url_deregister("mpool/%s/kvs/%s/curperf", mp_name, kvs_name);
 
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_deregister("mpool/%s/kvs/%s/latency", mp_name, kvs_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_deregister("mpool/%s/kvs/%s/trace", mp_name, kvs_name);
+
+    if (ev(status) && !err)
+        err = status;
+
+    status = rest_url_deregister("mpool/%s/kvs/%s/amp", mp_name, kvs_name);
+
     if (ev(status) && !err)
         err = status;
 
@@ -15,6 +15,7 @@
 #include <hse_ikvdb/kvdb_rparams.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/c0_kvset.h>
+#include <hse_ikvdb/io_sched.h>
 
 #include <mpool/mpool.h>
 #include "kvdb_params.h"
@@ -59,6 +60,12 @@ kvdb_rparams_defaults(void)
         .c0_ingest_width = 0,
         .c0_mutex_pool_sz = 7,
         .c0_coalesce_sz = 2048,
+        .c0_affinity = 0,
+        .c0_index = 0,
+        .c0_hugepage = 0,
+        .c0_prefault = 0,
+        .c0_numa = 0,
+        .c0_autotune_mem = 0,
 
         .c0_throttle_async_ingest = 4,
         .c0_throttle_async_default = 16,
@@ -67,6 +74,9 @@ kvdb_rparams_defaults(void)
         .txn_ingest_delay = HSE_C0_INGEST_DELAY_DFLT,
         .txn_ingest_width = HSE_C0_INGEST_WIDTH_DFLT,
         .txn_timeout = 1000 * 60 * 5,
+        .txn_occ = 0,
+        .txn_spill_max = 8,
+        .seqno_retain = 0,
 
         .csched_policy = 3,
         .csched_debug_mask = 0,
@@ -75,27 +85,57 @@ kvdb_rparams_defaults(void)
         .csched_hi_th_pct = 0,
         .csched_leaf_pct = 0,
         .csched_vb_scatter_pct = 100,
+        .csched_tomb_pct = 50,
+        .csched_vgc_pct = 50,
+        .csched_tier_hot = 0,
+        .csched_vgc_burst_sz = 64,
+        .csched_vgc_rate_max = 128,
         .csched_qthreads = 0,
+        .csched_qthreads_max = 0,
+        .csched_slo_us = 0,
+        .csched_slo_pct = 9900,
         .csched_node_len_max = 0,
         .csched_rspill_params = 0,
         .csched_ispill_params = 0,
         .csched_leaf_comp_params = 0,
         .csched_leaf_len_params = 0,
         .csched_node_min_ttl = 17,
+        .csched_cpus = 0,
+        .csched_nice = 0,
+        .csched_ioprio = 0,
 
         .dur_enable = 1,
         .dur_intvl_ms = 500,
         .dur_throttle_enable = 1,
         .dur_buf_sz = 36700160, /* 35 MiB */
         .dur_vbb = 1,
+        .dur_compress = 0,
+        .dur_close_ckpt = 0,
         .dur_delay_pct = 30,
         .dur_throttle_lo_th = 90,
         .dur_throttle_hi_th = 150,
+        .dur_trees_lo = 2,
+        .dur_trees_hi = 8,
 
         .throttle_relax = 1,
         .throttle_debug = 0,
+        .throttle_rate_ctl = 1,
+        .throttle_assist_us = 0,
         .throttle_c0_hi_th = 1024 * 8,
 
+        .mem_budget = 0,
+        .mem_psi_pct = 10,
+        .mem_adapt = 1,
+        .lat_hist = 1,
+        .flight_signal = 0,
+        .cn_scache_mb = 0,
+        .cn_reclaim_mbps = 0,
+        .cn_scrub_mbps = 0,
+        .cn_scrub_period = 86400,
+        .cn_drop_mbps = 256,
+        .io_sched_qd = 0,
+        .io_sched_fg_us = 2000,
+
         .cn_mblk_sync_writes = 1,
 
         .log_lvl = HSE_LOG_PRI_DEFAULT,
@@ -104,6 +144,13 @@ kvdb_rparams_defaults(void)
         .cndb_entries = 0,
         .c0_maint_threads = HSE_C0_MAINT_THREADS_DFLT,
         .c0_ingest_threads = HSE_C0_INGEST_THREADS_DFLT,
+        .c0_ingest_streams = 1,
+        .async_threads = HSE_KVDB_ASYNC_THREADS_DFLT,
+        .c0_cpus = 0,
+        .cn_cpus = 0,
+        .dur_cpus = 0,
+        .maint_cpus = 0,
+        .optrace_keys = 0,
 
         .keylock_entries = 19997,
         .keylock_tables = 293,
@@ -137,6 +184,12 @@ static struct param_inst   kvdb_rp_table[] = {
     KVDB_PARAM_EXP(c0_ingest_delay, "max ingest coalesce delay (seconds)"),
     KVDB_PARAM_EXP(c0_ingest_width, "number of c0 trees in parallel (min 2)"),
     KVDB_PARAM_EXP(c0_coalesce_sz, "c0 ingest coalesce size in MiB"),
+    KVDB_PARAM_U32_EXP(c0_affinity, "merge txns into the committing cpu's c0 tree"),
+    KVDB_PARAM_U32_EXP(c0_index, "c0 index (0: bonsai tree, 1: adaptive radix tree)"),
+    KVDB_PARAM_U32_EXP(c0_hugepage, "c0 kvset arena pages (0: base, 1: 2MB, 2: 1GB)"),
+    KVDB_PARAM_U32_EXP(c0_prefault, "prefault c0 kvset arenas on the local numa node"),
+    KVDB_PARAM_U32_EXP(c0_numa, "home c0 kvsets round-robin on all numa nodes"),
+    KVDB_PARAM_EXP(c0_autotune_mem, "c0 ingest autotuner memory budget in MiB (0: disable)"),
 
     KVDB_PARAM_EXP(c0_throttle_async_ingest, "c0 throttle mem for ingest async io"),
     KVDB_PARAM_EXP(c0_throttle_async_default, "c0 throttle mem for async io"),
@@ -145,6 +198,9 @@ static struct param_inst   kvdb_rp_table[] = {
     KVDB_PARAM_EXP(txn_ingest_delay, "max ingest coalesce delay (seconds)"),
     KVDB_PARAM_EXP(txn_ingest_width, "number of txn trees in parallel"),
     KVDB_PARAM_EXP(txn_timeout, "transaction timeout (ms)"),
+    KVDB_PARAM_EXP(txn_occ, "defer txn write locks to commit"),
+    KVDB_PARAM_EXP(txn_spill_max, "max extra txn buffers before ENOMEM"),
+    KVDB_PARAM_EXP(seqno_retain, "number of recent seqnos readable by seqno (0: none)"),
 
     KVDB_PARAM_U32_EXP(csched_policy, "csched (compaction scheduler) policy"),
     KVDB_PARAM_EXP(csched_debug_mask, "csched debug (bit mask)"),
@@ -153,7 +209,13 @@ static struct param_inst   kvdb_rp_table[] = {
     KVDB_PARAM_EXP(csched_hi_th_pct, "csched hwm water mark percentage"),
     KVDB_PARAM_EXP(csched_leaf_pct, "csched percent data in leaves"),
     KVDB_PARAM_EXP(csched_vb_scatter_pct, "csched vblock scatter pct. in leaves"),
+    KVDB_PARAM_EXP(csched_tomb_pct, "csched tombstone pct. in nodes (100: disable)"),
+    KVDB_PARAM_EXP(csched_vgc_pct, "csched vblock garbage pct. in leaf kvsets (100: disable)"),
+    KVDB_PARAM_EXP(csched_tier_hot, "csched heat to move leaf kvsets to staging (0: disable)"),
     KVDB_PARAM_EXP(csched_qthreads, "csched queue threads"),
+    KVDB_PARAM_EXP(csched_qthreads_max, "csched queue threads autoscaling bounds (0: disable)"),
+    KVDB_PARAM_EXP(csched_slo_us, "csched get latency objective (usecs, 0: disable)"),
+    KVDB_PARAM_EXP(csched_slo_pct, "csched get latency objective percentile (x100)"),
     KVDB_PARAM_EXP(csched_node_len_max, "csched max kvsets per node"),
     KVDB_PARAM_EXP(csched_rspill_params, "root node spill params [min,max]"),
     KVDB_PARAM_EXP(csched_ispill_params, "internal node spill params [min,max]"),
@@ -161,21 +223,50 @@ static struct param_inst   kvdb_rp_table[] = {
     KVDB_PARAM_EXP(csched_leaf_len_params, "leaf length params [idlem,idlec,kvcompc,min,max]"),
     KVDB_PARAM_EXP(csched_wr_burst_sz, "csched write burst size"),
     KVDB_PARAM_EXP(csched_wr_rate_max, "csched write sustained rate limit"),
+    KVDB_PARAM_EXP(csched_vgc_burst_sz, "csched value gc write burst size (MiB)"),
+    KVDB_PARAM_EXP(csched_vgc_rate_max, "csched value gc write rate limit (MiB/s)"),
     KVDB_PARAM_EXP(csched_node_min_ttl, "Min. time-to-live for cN nodes (secs)"),
+    KVDB_PARAM_EXP(csched_cpus, "csched worker cpu mask (0: all cpus)"),
+    KVDB_PARAM_EXP(csched_nice, "csched worker nice value [0..19] (0: unchanged)"),
+    KVDB_PARAM_EXP(csched_ioprio, "csched worker io priority [class,level] (0: unchanged)"),
 
     KVDB_PARAM_EXP(dur_enable, "0: disable durability, 1:enable durability"),
     KVDB_PARAM(dur_intvl_ms, "durability lag in ms"),
     KVDB_PARAM_EXP(dur_buf_sz, "durability buffer size in bytes"),
     KVDB_PARAM_EXP(dur_vbb, "enable/disable vblock builder"),
+    KVDB_PARAM_EXP(dur_compress, "lz4 compress c1 kvbundles"),
+    KVDB_PARAM_EXP(dur_close_ckpt, "1: leave c0 in c1 at close rather than ingest it"),
     KVDB_PARAM_EXP(dur_delay_pct, "durability delay percent"),
     KVDB_PARAM_EXP(dur_throttle_lo_th, "low watermark for throttling in percentage"),
     KVDB_PARAM_EXP(dur_throttle_hi_th, "high watermark for throttling in percentage"),
     KVDB_PARAM_EXP(dur_throttle_enable, "enable durablity throttling"),
+    KVDB_PARAM_EXP(dur_trees_lo, "c1 trees kept allocated, and in use before throttling"),
+    KVDB_PARAM_EXP(dur_trees_hi, "c1 trees in use at which throttling is at its maximum"),
+    PARAM_INST_STRING(
+        kvdb_rp_ref.dur_pmem_path,
+        sizeof(kvdb_rp_ref.dur_pmem_path),
+        "dur_pmem_path",
+        "directory on a DAX file system for the durability logs of this kvdb"),
     KVDB_PARAM_U32_EXP(throttle_relax, "throttle relax"),
     KVDB_PARAM_U32_EXP(throttle_debug, "throttle debug"),
+    KVDB_PARAM_U32_EXP(throttle_rate_ctl, "pace puts at a controlled rate (0: sleep per put)"),
+    KVDB_PARAM_EXP(throttle_assist_us, "run a root spill for paced delays this long (usecs)"),
     KVDB_PARAM_EXP(throttle_sleep_min_ns, "nanosleep time overhead (nsecs)"),
     KVDB_PARAM_EXP(throttle_c0_hi_th, "throttle sensor: c0 high water mark (MiB)"),
 
+    KVDB_PARAM(mem_budget, "memory budget of c0 and kvs caches in MiB (0: disable)"),
+    KVDB_PARAM_EXP(mem_psi_pct, "memory pressure (%) at which to shrink the budget (0: ignore)"),
+    KVDB_PARAM_EXP(mem_adapt, "adapt to memory pressure without a budget"),
+    KVDB_PARAM_EXP(lat_hist, "record per-operation latency histograms"),
+    KVDB_PARAM_EXP(flight_signal, "signal on which to write the flight recorder to the sos log"),
+    KVDB_PARAM_EXP(cn_scache_mb, "staging media for caching capacity vblocks in MiB (0: disable)"),
+    KVDB_PARAM_EXP(cn_reclaim_mbps, "rate of deferred mblock deletes in MiB/s (0: no deferral)"),
+    KVDB_PARAM_EXP(cn_scrub_mbps, "rate of background kvset verification in MiB/s (0: disable)"),
+    KVDB_PARAM_EXP(cn_scrub_period, "minimum time between two verifications of a kvs (secs)"),
+    KVDB_PARAM_EXP(cn_drop_mbps, "rate of mblock deletes of dropped kvses in MiB/s (0: unpaced)"),
+    KVDB_PARAM_EXP(io_sched_qd, "I/Os in flight per media class (0: no I/O scheduler)"),
+    KVDB_PARAM_EXP(io_sched_fg_us, "I/O scheduler deadline of foreground reads (usecs)"),
+
     KVDB_PARAM_U32_EXP(cn_mblk_sync_writes, "use sync writes for cn mblocks"),
     KVDB_PARAM_U32(log_lvl, "log message verbosity. Range: 0 to 7."),
     KVDB_PARAM_EXP(log_squelch_ns, "drop messages repeated within nsec window"),
@@ -186,7 +277,19 @@ static struct param_inst   kvdb_rp_table[] = {
         "representation (0: let system choose)"),
     KVDB_PARAM_U32_EXP(c0_maint_threads, "max number of maintenance threads"),
     KVDB_PARAM_U32_EXP(c0_ingest_threads, "max number of c0 ingest threads"),
+    KVDB_PARAM_U32_EXP(c0_ingest_streams, "max number of parallel streams per c0 ingest"),
     KVDB_PARAM_U32_EXP(c0_mutex_pool_sz, "max locks in c0 ingest sync pool"),
+    KVDB_PARAM_U32_EXP(async_threads, "max number of async get/put threads"),
+    KVDB_PARAM_EXP(c0_cpus, "c0 ingest and maintenance thread cpu mask (0: all cpus)"),
+    KVDB_PARAM_EXP(cn_cpus, "cn I/O and maintenance thread cpu mask (0: all cpus)"),
+    KVDB_PARAM_EXP(dur_cpus, "c1 I/O thread cpu mask (0: all cpus)"),
+    KVDB_PARAM_EXP(maint_cpus, "kvdb maintenance and async thread cpu mask (0: all cpus)"),
+    KVDB_PARAM_EXP(optrace_keys, "save the keys in the operation trace, not only their hashes"),
+    PARAM_INST_STRING(
+        kvdb_rp_ref.optrace_path,
+        sizeof(kvdb_rp_ref.optrace_path),
+        "optrace_path",
+        "file to which to capture a trace of the kvs and txn operations"),
 
     KVDB_PARAM_U32_EXP(keylock_entries, "number of keylock entries in a table"),
     KVDB_PARAM_U32_EXP(keylock_tables, "number of keylock tables"),
@@ -203,12 +306,18 @@ static char const *const kvdb_rp_writable[] = {
     "throttle_debug",
     "csched_policy",
     "csched_qthreads",
+    "csched_qthreads_max",
+    "csched_slo_us",
+    "csched_slo_pct",
     "csched_node_len_max",
     "csched_samp_max",
     "csched_lo_th_pct",
     "csched_hi_th_pct",
     "csched_leaf_pct",
     "csched_vb_scatter_pct",
+    "csched_tomb_pct",
+    "csched_vgc_pct",
+    "csched_tier_hot",
     "csched_rspill_params",
     "csched_ispill_params",
     "csched_leaf_comp_params",
@@ -216,6 +325,8 @@ static char const *const kvdb_rp_writable[] = {
     "csched_debug_mask",
     "csched_wr_burst_sz",
     "csched_wr_rate_max",
+    "csched_vgc_burst_sz",
+    "csched_vgc_rate_max",
 };
 
 void
@@ -306,6 +417,37 @@ kvdb_rparams_validate(struct kvdb_rparams *params)
         return EINVAL;
     }
 
+    if (params->c0_index > 1) {
+        hse_log(HSE_ERR "c0_index must be 0 or 1");
+        return EINVAL;
+    }
+
+    if (params->c0_hugepage > 2) {
+        hse_log(HSE_ERR "c0_hugepage must be 0, 1 or 2");
+        return EINVAL;
+    }
+
+    if (params->mem_psi_pct > 100) {
+        hse_log(HSE_ERR "mem_psi_pct cannot be greater than 100");
+        return EINVAL;
+    }
+
+    if (params->csched_slo_pct < 1 || params->csched_slo_pct > 9999) {
+        hse_log(HSE_ERR "csched_slo_pct must be in the range [1, 9999]");
+        return EINVAL;
+    }
+
+    if (params->io_sched_qd > IO_SCHED_QD_MAX) {
+        hse_log(HSE_ERR "io_sched_qd cannot be greater than %d", IO_SCHED_QD_MAX);
+        return EINVAL;
+    }
+
+    if (params->c0_ingest_streams < 1 || params->c0_ingest_streams > HSE_C0_INGEST_STREAMS_MAX) {
+        hse_log(
+            HSE_ERR "c0_ingest_streams must be in the range [1, %d]", HSE_C0_INGEST_STREAMS_MAX);
+        return EINVAL;
+    }
+
     return 0;
 }
 
@@ -366,6 +508,10 @@ kvdb_rparams_add_to_dt(const char *mp_name, struct kvdb_rparams *p)
         char   param_name[DT_PATH_ELEMENT_LEN];
         int    wx;
 
+        /* Only numeric parameters are exported */
+        if (kvdb_rp_table[i].pi_type.param_str_to_val == get_string)
+            continue;
+
         get_param_name(i, param_name, sizeof(param_name));
 
         writable = false;
@@ -8,11 +8,17 @@
 #define _GNU_SOURCE /* for pthread_setname_np() */
 
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include <hse_util/platform.h>
 #include <hse_util/slab.h>
+#include <hse_util/barrier.h>
 #include <hse_util/condvar.h>
 #include <hse_util/mutex.h>
+#include <hse_util/spinlock.h>
 #include <hse_util/perfc.h>
 
 #include <hse_ikvdb/ikvdb.h>
@@ -43,6 +49,12 @@
 #define MONITOR_TIMEOUT_MS 250
 #define STATS_REPORT_PERIOD_MS 1000
 
+/* See linux/ioprio.h, glibc has no wrapper for ioprio_set() */
+#define STS_IOPRIO_WHO_PROCESS 1
+#define STS_IOPRIO_CLASS_SHIFT 13
+#define STS_IOPRIO_CLASS_MAX 3
+#define STS_IOPRIO_LEVEL_MAX 7
+
 /* A worker thread */
 struct sts_worker {
     struct sts *sts;
@@ -54,16 +66,43 @@ struct sts_worker {
 static void *
 sts_worker_main(void *rock);
 
-/* Scheduler queue */
+/* Scheduler queue
+ *
+ * Jobs are submitted without locks by pushing them onto @inbox, a LIFO
+ * of jobs linked through sj_next.  Workers move the inbox onto @jobs in
+ * submission order under @lock, which is only ever contended by workers.
+ * The queue's own workers take jobs from the head of @jobs while thieves
+ * steal from the tail.  @pending counts the jobs in @inbox and @jobs and
+ * lets workers look for work without taking any locks.
+ *
+ * Workers sleep on the @wcv of the queue they are bound to (the queue at
+ * index sts->qc for shared workers), @sleepers tells a submitter whether
+ * there is anybody to wake.
+ */
 struct sts_queue {
+    struct sts_job *inbox;
+    atomic_t        pending;
+    atomic_t        idle_workers;
+    atomic_t        sleepers;
+
+    spinlock_t       lock __aligned(SMP_CACHE_BYTES);
     struct list_head jobs;
-    atomic_t         idle_workers;
+
+    struct mutex     wlock __aligned(SMP_CACHE_BYTES);
+    struct cv        wcv;
     struct perfc_set qpc;
     struct sts *     sts;
 } __aligned(SMP_CACHE_BYTES);
 
 /**
  * struct sts - HSE scheduler used for cn tree ingest and compaction operations
+ *
+ * Queue numbers double as priorities, lower numbers are more urgent.
+ * A worker dedicated to queue i first serves queue i and then steals
+ * from the queues below i, most urgent first, that have no idle workers
+ * of their own.  Dedicated workers never steal from less urgent queues,
+ * so the workers reserved for a queue cannot be tied up by jobs of lower
+ * priority.  Shared workers serve all queues round-robin.
  */
 struct sts {
     pthread_t            mtid;  /* m=monitor thread id */
@@ -83,17 +122,11 @@ struct sts {
      */
     atomic_t wcnt_current[STS_QUEUES_MAX + 1];
 
-    uint rr_next;
+    atomic_t rr_next;
 
     struct sts_queue *qv;
-    struct cv         qcondvar;
-    struct mutex      qlock;
 };
 
-/* queue lock */
-#define q_lock(s) mutex_lock(&(s)->qlock)
-#define q_unlock(s) mutex_unlock(&(s)->qlock)
-
 /* monitor lock */
 #define m_lock(s) mutex_lock(&(s)->mlock)
 #define m_unlock(s) mutex_unlock(&(s)->mlock)
@@ -103,10 +136,20 @@ q_init(struct sts *self, struct sts_queue *q, uint qnum)
 {
     memset(q, 0, sizeof(*q));
 
+    spin_lock_init(&q->lock);
     INIT_LIST_HEAD(&q->jobs);
+    mutex_init(&q->wlock);
+    cv_init(&q->wcv, "sts_queue");
     q->sts = self;
 }
 
+static void
+q_fini(struct sts_queue *q)
+{
+    cv_destroy(&q->wcv);
+    mutex_destroy(&q->wlock);
+}
+
 static inline uint
 q_threads(u64 rparam, uint qnum)
 {
@@ -126,29 +169,66 @@ q_threads_set(struct sts *self, uint qnum, uint count)
     }
 }
 
-/* Caller must have queue lock */
-static struct sts_job *
-job_get(struct sts *self)
+static inline bool
+q_pending(struct sts_queue *q)
 {
-    struct sts_job *  job;
-    struct sts_queue *q;
-    uint              qnum, i;
+    return atomic_read(&q->pending) > 0;
+}
 
-    for (i = 0; i < self->qc; i++) {
-        qnum = (self->rr_next + i) % self->qc;
-        if (!list_empty(&self->qv[qnum].jobs))
-            goto found_job;
+/* Caller must have queue lock.  Moves submitted jobs onto the job list,
+ * reversing the inbox to restore submission order.
+ */
+static void
+q_drain(struct sts_queue *q)
+{
+    struct sts_job *head, *job;
+
+    head = q->inbox;
+    while (head && atomic_ptr_cmpxchg((void **)&q->inbox, head, NULL) != head)
+        head = q->inbox;
+
+    job = NULL;
+    while (head) {
+        struct sts_job *next = head->sj_next;
+
+        head->sj_next = job;
+        job = head;
+        head = next;
     }
 
-    return 0;
+    for (; job; job = job->sj_next)
+        list_add_tail(&job->sj_link, &q->jobs);
+}
 
-found_job:
-    q = &self->qv[qnum];
-    job = list_first_entry(&q->jobs, struct sts_job, sj_link);
+/* Caller must have queue lock */
+static void
+q_job_del(struct sts_queue *q, struct sts_job *job)
+{
     list_del(&job->sj_link);
+    atomic_dec(&q->pending);
     perfc_dec(&q->qpc, PERFC_BA_STS_QDEPTH);
+}
+
+/* Take the oldest job from a queue, or the newest if @steal is true */
+static struct sts_job *
+job_get(struct sts_queue *q, bool steal)
+{
+    struct sts_job *job = NULL;
+
+    if (!q_pending(q))
+        return NULL;
+
+    spin_lock(&q->lock);
+    q_drain(q);
+    if (!list_empty(&q->jobs)) {
+        if (steal)
+            job = list_last_entry(&q->jobs, struct sts_job, sj_link);
+        else
+            job = list_first_entry(&q->jobs, struct sts_job, sj_link);
+        q_job_del(q, job);
+    }
+    spin_unlock(&q->lock);
 
-    self->rr_next = (qnum + 1) < self->qc ? (qnum + 1) : 0;
     return job;
 }
 
@@ -165,12 +245,19 @@ job_find_tag(struct sts *self, struct sts_queue *q, u64 tag)
     return 0;
 }
 
-/* Caller must have queue lock */
+/* Lock-free push of a job onto a queue's inbox */
 static void
 job_put(struct sts_queue *q, struct sts_job *job)
 {
+    struct sts_job *head;
+
     perfc_inc(&q->qpc, PERFC_BA_STS_QDEPTH);
-    list_add_tail(&job->sj_link, &q->jobs);
+    atomic_inc(&q->pending);
+
+    do {
+        head = q->inbox;
+        job->sj_next = head;
+    } while (atomic_ptr_cmpxchg((void **)&q->inbox, head, job) != head);
 }
 
 static void
@@ -189,14 +276,11 @@ static void
 cancel_jobs_all(struct sts *self)
 {
     struct sts_job *job;
+    uint            i;
 
-    do {
-        q_lock(self);
-        job = job_get(self);
-        q_unlock(self);
-        if (job)
+    for (i = 0; i < self->qc; i++)
+        while ((job = job_get(self->qv + i, false)))
             cancel_job(job);
-    } while (job);
 }
 
 void
@@ -211,13 +295,12 @@ sts_cancel_jobs(struct sts *self, u64 tag)
         q = self->qv + i;
 
         do {
-            q_lock(self);
+            spin_lock(&q->lock);
+            q_drain(q);
             job = job_find_tag(self, q, tag);
-            if (job) {
-                list_del(&job->sj_link);
-                perfc_dec(&q->qpc, PERFC_BA_STS_QDEPTH);
-            }
-            q_unlock(self);
+            if (job)
+                q_job_del(q, job);
+            spin_unlock(&q->lock);
 
             if (job)
                 cancel_job(job);
@@ -281,6 +364,30 @@ sts_worker_surplus(struct sts *self, uint qnum)
     return workers - target;
 }
 
+/* Bind the calling thread to the csched_cpus rparam mask, if any.
+ */
+static void
+sts_set_cpus(struct sts *self, const char *name)
+{
+    struct kvdb_rparams *rp = self->rp;
+    cpu_set_t            cpus;
+    uint                 i;
+    int                  rc;
+
+    if (!rp->csched_cpus)
+        return;
+
+    CPU_ZERO(&cpus);
+    for (i = 0; i < 64; i++)
+        if (rp->csched_cpus & (1ul << i))
+            CPU_SET(i, &cpus);
+
+    rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (ev(rc))
+        hse_log(
+            HSE_WARNING "sts %s unable to set cpu mask 0x%lx: %d", name, rp->csched_cpus, rc);
+}
+
 static void *
 sts_monitor(void *rock)
 {
@@ -297,6 +404,7 @@ sts_monitor(void *rock)
     u64 dbg_wake_other = 0;
 
     pthread_setname_np(pthread_self(), "sts_mon");
+    sts_set_cpus(self, "monitor");
 
     while (true) {
 
@@ -446,9 +554,6 @@ sts_create(struct kvdb_rparams *rp, const char *name, uint nq, struct sts **hand
     mutex_init(&self->mlock);
     cv_init(&self->mcv, "sts_monitor");
 
-    mutex_init(&self->qlock);
-    cv_init(&self->qcondvar, "sts_queue");
-
     atomic_set(&self->state, SS_PAUSE);
     atomic_set(&self->spawned_workers, 0);
     atomic_set(&self->ready_workers, 0);
@@ -463,8 +568,8 @@ sts_create(struct kvdb_rparams *rp, const char *name, uint nq, struct sts **hand
         cv_destroy(&self->mcv);
         mutex_destroy(&self->mlock);
 
-        cv_destroy(&self->qcondvar);
-        mutex_destroy(&self->qlock);
+        for (i = 0; i <= nq; i++)
+            q_fini(self->qv + i);
 
         free_aligned(self->qv);
         free_aligned(self);
@@ -479,6 +584,8 @@ sts_create(struct kvdb_rparams *rp, const char *name, uint nq, struct sts **hand
 void
 sts_destroy(struct sts *self)
 {
+    uint i;
+
     if (!self)
         return;
 
@@ -491,8 +598,8 @@ sts_destroy(struct sts *self)
 
     sts_perfc_free_internal(self);
 
-    cv_destroy(&self->qcondvar);
-    mutex_destroy(&self->qlock);
+    for (i = 0; i <= self->qc; i++)
+        q_fini(self->qv + i);
 
     cv_destroy(&self->mcv);
     mutex_destroy(&self->mlock);
@@ -539,48 +646,179 @@ worker_run_slice(struct sts_worker *w, struct sts_queue *q, struct sts_job *job)
             (t1 - t0) / 1000000);
 }
 
-struct sts_queue *
-sts_qsel(struct sts *self, struct sts_worker *w, int *status)
+/* Decide whether a worker should exit, the worker count is decremented
+ * with a cmpxchg so that concurrent surplus workers don't all exit.
+ */
+static int
+sts_worker_state(struct sts *self, struct sts_worker *w)
 {
-    struct sts_queue *q;
+    atomic_t *wcnt = &self->wcnt_current[w->wqnum];
+    int       target = q_threads(self->rp->csched_qthreads, w->wqnum);
+    int       cur;
 
-    /* test and decrement of worker count must be done
-     * with q_lock held or else we end up with too many
-     * decrements.
-     */
-    if (sts_worker_surplus(self, w->wqnum) > 0) {
-        atomic_dec(&self->wcnt_current[w->wqnum]);
-        *status = SS_EXIT;
-        return 0;
+    while ((cur = atomic_read(wcnt)) > target) {
+        if (atomic_cmpxchg(wcnt, cur, cur - 1) == cur)
+            return SS_EXIT;
     }
 
-    *status = atomic_read(&self->state);
-    if (*status != SS_RUN)
-        return 0;
+    return atomic_read(&self->state);
+}
 
-    if (w->wqnum < self->qc) {
+/* Queues from which worker @w may steal are [0, n) */
+static inline uint
+sts_steal_limit(struct sts *self, struct sts_worker *w)
+{
+    return w->wqnum < self->qc ? w->wqnum : 0;
+}
 
-        /* Worker is bound to a queue */
-        q = &self->qv[w->wqnum];
-        if (list_empty(&q->jobs))
-            return 0;
+static bool
+sts_work_visible(struct sts *self, struct sts_worker *w)
+{
+    uint i;
+
+    if (w->wqnum == self->qc) {
+        for (i = 0; i < self->qc; i++)
+            if (q_pending(self->qv + i))
+                return true;
 
-        return q;
+        return false;
     }
 
-    /* Worker services all queues */
-    uint i;
-    uint rr = self->rr_next;
+    if (q_pending(self->qv + w->wqnum))
+        return true;
 
-    for (i = 0; i < self->qc; i++) {
-        q = &self->qv[(i + rr) % self->qc];
-        if (!list_empty(&q->jobs)) {
-            self->rr_next = (rr + 1) % self->qc;
-            return q;
+    for (i = 0; i < sts_steal_limit(self, w); i++)
+        if (q_pending(self->qv + i))
+            return true;
+
+    return false;
+}
+
+static struct sts_job *
+sts_job_select(struct sts *self, struct sts_worker *w, struct sts_queue **qp)
+{
+    struct sts_job *  job;
+    struct sts_queue *q;
+    uint              i, n;
+
+    if (w->wqnum == self->qc) {
+
+        /* Worker services all queues */
+        uint rr = atomic_inc_return(&self->rr_next);
+
+        for (i = 0; i < self->qc; i++) {
+            q = &self->qv[(i + rr) % self->qc];
+            job = job_get(q, false);
+            if (job) {
+                *qp = q;
+                return job;
+            }
         }
+
+        return NULL;
     }
 
-    return 0;
+    /* Worker is bound to a queue */
+    q = &self->qv[w->wqnum];
+    job = job_get(q, false);
+    if (job) {
+        *qp = q;
+        return job;
+    }
+
+    /* Steal from more urgent queues whose own workers are all busy */
+    n = sts_steal_limit(self, w);
+    for (i = 0; i < n; i++) {
+        q = self->qv + i;
+        if (atomic_read(&q->idle_workers) > 0)
+            continue;
+
+        job = job_get(q, true);
+        if (job) {
+            perfc_inc(&q->qpc, PERFC_RA_STS_STEALS);
+            *qp = q;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+/* Sleep until there may be work for @w.  The sleeper count is raised
+ * before rechecking for work and a submitter checks it after publishing
+ * its job, so one of the two always sees the other.
+ */
+static void
+sts_worker_wait(struct sts *self, struct sts_worker *w)
+{
+    struct sts_queue *wq = self->qv + w->wqnum;
+    int               rc __maybe_unused;
+
+    mutex_lock(&wq->wlock);
+    atomic_inc(&wq->sleepers);
+    smp_mb();
+
+    if (!sts_work_visible(self, w)) {
+        rc = cv_timedwait(&wq->wcv, &wq->wlock, JOB_GET_TIMEOUT_MS);
+        assert(rc == 0 || rc == ETIMEDOUT);
+    }
+
+    atomic_dec(&wq->sleepers);
+    mutex_unlock(&wq->wlock);
+}
+
+static bool
+sts_worker_wake(struct sts_queue *wq)
+{
+    if (atomic_read(&wq->sleepers) == 0)
+        return false;
+
+    mutex_lock(&wq->wlock);
+    cv_signal(&wq->wcv);
+    mutex_unlock(&wq->wlock);
+
+    return true;
+}
+
+/* Keep workers off the cpus and out of the way of the application
+ * threads as directed by the csched_cpus, csched_nice and csched_ioprio
+ * rparams.  Settings apply to workers as they start, failures are
+ * logged and otherwise ignored.
+ */
+static void
+sts_worker_isolate(struct sts_worker *w)
+{
+    struct kvdb_rparams *rp = w->sts->rp;
+    pid_t                tid = syscall(SYS_gettid);
+    int                  rc;
+
+    sts_set_cpus(w->sts, w->wname);
+
+    if (rp->csched_nice) {
+        int nice = min_t(ulong, rp->csched_nice, 19);
+
+        rc = setpriority(PRIO_PROCESS, tid, nice);
+        if (ev(rc))
+            hse_log(HSE_WARNING "sts/worker %s unable to set nice %d: %d", w->wname, nice, errno);
+    }
+
+    if (rp->csched_ioprio) {
+        uint class = (rp->csched_ioprio >> 8) & 0xff;
+        uint level = (rp->csched_ioprio >> 0) & 0xff;
+
+        class = min_t(uint, class, STS_IOPRIO_CLASS_MAX);
+        level = min_t(uint, level, STS_IOPRIO_LEVEL_MAX);
+
+        rc = syscall(
+            SYS_ioprio_set, STS_IOPRIO_WHO_PROCESS, tid, (class << STS_IOPRIO_CLASS_SHIFT) | level);
+        if (ev(rc))
+            hse_log(
+                HSE_WARNING "sts/worker %s unable to set io priority %u,%u: %d",
+                w->wname,
+                class,
+                level,
+                errno);
+    }
 }
 
 static void *
@@ -600,6 +838,7 @@ sts_worker_main(void *rock)
 
     pthread_detach(tid);
     pthread_setname_np(tid, w->wname);
+    sts_worker_isolate(w);
 
     if (csched_rp_dbg_worker(self->rp))
         hse_log(HSE_NOTICE "sts/worker %s initializing", w->wname);
@@ -619,41 +858,9 @@ sts_worker_main(void *rock)
         struct sts_job *  job = 0;
         struct sts_queue *q = 0;
 
-        q_lock(self);
-
-        while (true) {
-
-            int rc __maybe_unused;
-
-            q = sts_qsel(self, w, &state);
-            if (q) {
-                assert(!list_empty(&q->jobs));
-                job = list_first_entry(&q->jobs, struct sts_job, sj_link);
-                list_del(&job->sj_link);
-                perfc_dec(&q->qpc, PERFC_BA_STS_QDEPTH);
-                break;
-            }
-
-            if (state != SS_RUN)
-                break;
-
-            if (!idle) {
-                /* Must use 'w->wqnum' (instead of 'q') for
-                 * WORKERS_IDLE to correctly track idle shared
-                 * workers
-                 */
-                idle = true;
-                atomic_inc(idle_count);
-                perfc_inc(&self->qv[w->wqnum].qpc, PERFC_BA_STS_WORKERS_IDLE);
-            }
-
-            pthread_setname_np(tid, w->wname);
-
-            rc = cv_timedwait(&self->qcondvar, &self->qlock, JOB_GET_TIMEOUT_MS);
-            assert(rc == 0 || rc == ETIMEDOUT);
-        }
-
-        q_unlock(self);
+        state = sts_worker_state(self, w);
+        if (state == SS_RUN)
+            job = sts_job_select(self, w, &q);
 
         if (job) {
             if (idle) {
@@ -664,10 +871,35 @@ sts_worker_main(void *rock)
             }
 
             worker_run_slice(w, q, job);
+            continue;
         }
 
-        if (state == SS_PAUSE)
+        if (state == SS_PAUSE) {
             msleep(WORKER_PAUSE_SLEEP_MS);
+            continue;
+        }
+
+        if (state != SS_RUN)
+            break;
+
+        if (!idle) {
+            /* Must use 'w->wqnum' (instead of 'q') for
+             * WORKERS_IDLE to correctly track idle shared
+             * workers
+             */
+            idle = true;
+            atomic_inc(idle_count);
+            perfc_inc(&self->qv[w->wqnum].qpc, PERFC_BA_STS_WORKERS_IDLE);
+
+            pthread_setname_np(tid, w->wname);
+        }
+
+        sts_worker_wait(self, w);
+    }
+
+    if (idle) {
+        atomic_dec(idle_count);
+        perfc_dec(&self->qv[w->wqnum].qpc, PERFC_BA_STS_WORKERS_IDLE);
     }
 
     perfc_dec(&self->qv[w->wqnum].qpc, PERFC_BA_STS_WORKERS);
@@ -685,6 +917,7 @@ void
 sts_job_submit(struct sts *self, struct sts_job *job)
 {
     struct sts_queue *q = self->qv + job->sj_qnum;
+    uint              i;
 
     assert(job->sj_job_fn);
     assert(job->sj_qnum < self->qc);
@@ -694,10 +927,47 @@ sts_job_submit(struct sts *self, struct sts_job *job)
 
     job->sj_sts = self;
 
-    q_lock(self);
     job_put(q, job);
-    cv_signal(&self->qcondvar);
-    q_unlock(self);
+    smp_mb();
+
+    /* Wake one of the queue's own workers, else a shared worker,
+     * else a worker that may steal the job.
+     */
+    if (sts_worker_wake(q) || sts_worker_wake(self->qv + self->qc))
+        return;
+
+    for (i = job->sj_qnum + 1; i < self->qc; i++)
+        if (sts_worker_wake(self->qv + i))
+            break;
+}
+
+bool
+sts_job_assist(struct sts *self, uint qnum)
+{
+    struct sts_queue *q;
+    struct sts_job *  job;
+
+    if (qnum >= self->qc || atomic_read(&self->state) != SS_RUN)
+        return false;
+
+    q = self->qv + qnum;
+
+    job = job_get(q, false);
+    if (!job)
+        return false;
+
+    if (csched_rp_dbg_jobs(self->rp))
+        hse_log(HSE_NOTICE "sts/job %u qnum %u assisted", job->sj_id, qnum);
+
+    perfc_inc(&q->qpc, PERFC_RA_STS_ASSISTS);
+    perfc_inc(&q->qpc, PERFC_RA_STS_JOBS);
+    perfc_inc(&q->qpc, PERFC_BA_STS_JOBS_RUN);
+
+    job->sj_job_fn(job);
+
+    perfc_dec(&q->qpc, PERFC_BA_STS_JOBS_RUN);
+
+    return true;
 }
 
 void
@@ -740,10 +1010,17 @@ sts_wcnt_get_target(struct sts *self, uint qnum)
 uint
 sts_wcnt_get_idle(struct sts *self, uint qnum)
 {
-    int count = 0;
+    int  count = 0;
+    uint i;
 
-    if (qnum <= self->qc)
+    /* Idle shared workers, plus idle workers of the less urgent
+     * queues that may steal a job of queue @qnum.
+     */
+    if (qnum <= self->qc) {
         count = atomic_read(&self->qv[self->qc].idle_workers);
+        for (i = qnum + 1; i < self->qc; i++)
+            count += atomic_read(&self->qv[i].idle_workers);
+    }
 
     assert(count >= 0);
     return count < 0 ? 0 : (uint)count;
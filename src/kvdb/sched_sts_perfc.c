@@ -20,6 +20,9 @@ static struct perfc_name sts_perfc[] = {
 
     NE(PERFC_BA_STS_WORKERS, 3, "Workers", "workers"),
     NE(PERFC_BA_STS_WORKERS_IDLE, 3, "Idle Workers", "workers_idle"),
+
+    NE(PERFC_RA_STS_STEALS, 3, "Stolen jobs", "jobs_stolen"),
+    NE(PERFC_RA_STS_ASSISTS, 3, "Jobs run by assisting threads", "jobs_assisted"),
 };
 
 NE_CHECK(sts_perfc, PERFC_EN_STS, "sts perfc table/enum mismatch");
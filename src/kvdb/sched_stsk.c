@@ -29,6 +29,12 @@ sts_job_submit(struct sts *s, struct sts_job *job)
 {
 }
 
+bool
+sts_job_assist(struct sts *s, uint qnum)
+{
+    return false;
+}
+
 void
 sts_wcnt_set_target(struct sts *s, uint qnum, uint target)
 {
@@ -622,6 +622,1600 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, txn_del_test, test_pre, test_post)
     hse_params_destroy(params);
 }
 
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, get_batch_test, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    const char *           mpool = "mpool";
+    const char *           kvs = "kvs";
+    struct hse_params *    params;
+    merr_t                 err;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec opspec;
+    const int              nkeys = 8;
+    struct kvs_ktuple      ktv[nkeys];
+    struct kvs_buf         vbufv[nkeys];
+    enum key_lookup_res    resv[nkeys];
+    char                   kbuf[nkeys][16];
+    char                   buf[nkeys][100];
+    struct kvs_vtuple      vt;
+    int                    i;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, kvs, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, kvs, 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    /* Put only the even numbered keys, then look them all up at once.
+     */
+    vt.vt_data = "data";
+    vt.vt_len = strlen(vt.vt_data);
+
+    for (i = 0; i < nkeys; ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "key-%d", i);
+        kvs_ktuple_init(&ktv[i], kbuf[i], strlen(kbuf[i]));
+
+        if (i % 2 == 0) {
+            err = ikvdb_kvs_put(kvs_h, 0, &ktv[i], &vt);
+            ASSERT_EQ(0, err);
+        }
+
+        kvs_buf_init(&vbufv[i], buf[i], sizeof(buf[i]));
+    }
+
+    err = ikvdb_kvs_get_batch(kvs_h, &opspec, ktv, resv, vbufv, nkeys);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < nkeys; ++i) {
+        if (i % 2 == 0) {
+            ASSERT_EQ(FOUND_VAL, resv[i]);
+            ASSERT_EQ(vt.vt_len, vbufv[i].b_len);
+            ASSERT_EQ(0, memcmp(buf[i], vt.vt_data, vt.vt_len));
+        } else {
+            ASSERT_EQ(NOT_FOUND, resv[i]);
+        }
+    }
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, pfx_probe_batch_test, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    const char *           mpool = "mpool";
+    struct hse_params *    params;
+    merr_t                 err;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec opspec;
+    const int              npfx = 8;
+    struct kvs_ktuple      ktv[npfx];
+    struct kvs_buf         kbufv[npfx], vbufv[npfx];
+    enum key_lookup_res    resv[npfx];
+    char                   pfx[npfx][8];
+    char                   key[HSE_KVS_KLEN_MAX];
+    char                   kbuf[npfx][HSE_KVS_KLEN_MAX];
+    char                   vbuf[npfx][16];
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      vt;
+    int                    i, j;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* we want a valid c0/c0sk here, and a suffixed kvs with an empty cn */
+    mock_c0_unset();
+    mapi_inject(mapi_idx_cn_get_sfx_len, 8);
+    mapi_inject(mapi_idx_cn_pfx_probe_batch, 0);
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    /* Prefixes 4n have two keys, 4n+2 one key and the odd ones none.
+     * They are probed in reverse order to exercise the sort.
+     */
+    vt.vt_data = "data";
+    vt.vt_len = strlen(vt.vt_data);
+
+    for (i = 0; i < npfx; ++i) {
+        int k = npfx - 1 - i;
+
+        snprintf(pfx[k], sizeof(pfx[k]), "pfx%d", i);
+
+        for (j = 0; j < (i % 2 ? 0 : (i % 4 ? 1 : 2)); ++j) {
+            snprintf(key, sizeof(key), "pfx%dsuffix-%d", i, j);
+            kvs_ktuple_init(&kt, key, strlen(key));
+
+            err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+            ASSERT_EQ(0, err);
+        }
+
+        kvs_ktuple_init_nohash(&ktv[k], pfx[k], strlen(pfx[k]));
+        kvs_buf_init(&kbufv[k], kbuf[k], sizeof(kbuf[k]));
+        kvs_buf_init(&vbufv[k], vbuf[k], sizeof(vbuf[k]));
+    }
+
+    err = ikvdb_kvs_pfx_probe_batch(kvs_h, &opspec, ktv, resv, kbufv, vbufv, npfx);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < npfx; ++i) {
+        int k = npfx - 1 - i;
+
+        if (i % 2) {
+            ASSERT_EQ(NOT_FOUND, resv[k]);
+            continue;
+        }
+
+        ASSERT_EQ(i % 4 ? FOUND_VAL : FOUND_MULTIPLE, resv[k]);
+        ASSERT_EQ(0, memcmp(kbuf[k], pfx[k], strlen(pfx[k])));
+        ASSERT_EQ(vt.vt_len, vbufv[k].b_len);
+        ASSERT_EQ(0, memcmp(vbuf[k], vt.vt_data, vt.vt_len));
+    }
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+
+    mapi_inject_unset(mapi_idx_cn_pfx_probe_batch);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, write_batch_test, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    const char *           mpool = "mpool";
+    const char *           kvs = "kvs";
+    struct hse_params *    params;
+    merr_t                 err;
+    struct mpool *         ds = (struct mpool *)-1;
+    const int              nops = 8;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_wbatch_op   opv[nops];
+    struct hse_kvs *       kvsv[nops];
+    char                   kbuf[nops][16];
+    char                   buf[100];
+    struct kvs_ktuple      kt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    int                    i;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, kvs, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, kvs, 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    /* Put every key but key-6, whose slot instead deletes key-0
+     * after key-0 was put earlier in the same batch.
+     */
+    for (i = 0; i < nops; ++i) {
+        int k = (i == nops - 2) ? 0 : i;
+
+        snprintf(kbuf[i], sizeof(kbuf[i]), "key-%d", k);
+        kvs_ktuple_init_nohash(&opv[i].wbo_kt, kbuf[i], strlen(kbuf[i]));
+        kvs_vtuple_init(&opv[i].wbo_vt, "data", 4);
+        opv[i].wbo_tomb = (i == nops - 2);
+        kvsv[i] = kvs_h;
+    }
+
+    err = ikvdb_kvs_write_batch(h, NULL, kvsv, opv, nops);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < nops; ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "key-%d", i);
+        kvs_ktuple_init(&kt, kbuf[i], strlen(kbuf[i]));
+        kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+        err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+        ASSERT_EQ(0, err);
+
+        if (i == 0 || i == nops - 2) {
+            ASSERT_EQ(i ? NOT_FOUND : FOUND_TMB, res);
+        } else {
+            ASSERT_EQ(FOUND_VAL, res);
+            ASSERT_EQ(4, vbuf.b_len);
+        }
+    }
+
+    /* An atomic batch overwrites every key with one commit seqno.
+     */
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_flags |= HSE_KVDB_KOP_FLAG_ATOMIC;
+
+    for (i = 0; i < nops; ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "key-%d", i);
+        kvs_ktuple_init_nohash(&opv[i].wbo_kt, kbuf[i], strlen(kbuf[i]));
+        kvs_vtuple_init(&opv[i].wbo_vt, "datum", 5);
+        opv[i].wbo_tomb = false;
+    }
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, nops);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < nops; ++i) {
+        kvs_ktuple_init(&kt, kbuf[i], strlen(kbuf[i]));
+        kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+        err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(FOUND_VAL, res);
+        ASSERT_EQ(5, vbuf.b_len);
+    }
+
+    /* A kvs handle from another kvdb (or none at all) is rejected.
+     */
+    kvsv[3] = NULL;
+    err = ikvdb_kvs_write_batch(h, NULL, kvsv, opv, nops);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+static int wbatch_first_calls;
+
+/* Every second call comes from kvdb_ctxn_set_write_batch(), after the
+ * batch was inserted, so a stale kvms there makes every attempt of an
+ * atomic batch abandon its insert.
+ */
+static struct c0_kvmultiset *
+_c0sk_get_first_c0kvms(struct c0sk *handle)
+{
+    if (++wbatch_first_calls % 2 == 0)
+        return (void *)1;
+
+    return mtfm_c0sk_c0sk_get_first_c0kvms_getreal()(handle);
+}
+
+/* Return how many of the nops keys read back val.
+ */
+static int
+wbatch_check(struct hse_kvs *kvs_h, struct hse_kvdb_txn *txn, int nops, const char *val)
+{
+    struct hse_kvdb_opspec opspec;
+    struct kvs_ktuple      kt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    char                   kbuf[16], buf[100];
+    merr_t                 err;
+    int                    i, n = 0;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_txn = txn;
+
+    for (i = 0; i < nops; ++i) {
+        snprintf(kbuf, sizeof(kbuf), "key-%d", i);
+        kvs_ktuple_init(&kt, kbuf, strlen(kbuf));
+        kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+        err = ikvdb_kvs_get(kvs_h, txn ? &opspec : NULL, &kt, &res, &vbuf);
+        if (!err && res == FOUND_VAL && vbuf.b_len == strlen(val) &&
+            !memcmp(buf, val, vbuf.b_len))
+            ++n;
+    }
+
+    return n;
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, write_batch_atomic, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    struct hse_params *    params;
+    struct mpool *         ds = (struct mpool *)-1;
+    const int              nops = 8;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_wbatch_op   opv[nops];
+    struct hse_kvs *       kvsv[nops];
+    char                   kbuf[nops][16];
+    struct hse_kvdb_txn *  txn;
+    merr_t                 err;
+    int                    i;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_flags |= HSE_KVDB_KOP_FLAG_ATOMIC;
+
+    for (i = 0; i < nops; ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "key-%d", i);
+        kvs_ktuple_init_nohash(&opv[i].wbo_kt, kbuf[i], strlen(kbuf[i]));
+        kvs_vtuple_init(&opv[i].wbo_vt, "old", 3);
+        opv[i].wbo_tomb = false;
+        kvsv[i] = kvs_h;
+    }
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, nops);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(nops, wbatch_check(kvs_h, NULL, nops, "old"));
+
+    /* A txn that began before a batch sees none of it.
+     */
+    txn = ikvdb_txn_alloc(h);
+    ASSERT_NE(NULL, txn);
+
+    err = ikvdb_txn_begin(h, txn);
+    ASSERT_EQ(0, err);
+
+    /* A batch inserted in a kvms which is no longer the first one is
+     * abandoned and retried, the abandoned insert is never visible.
+     */
+    for (i = 0; i < nops; ++i)
+        kvs_vtuple_init(&opv[i].wbo_vt, "new", 3);
+
+    mapi_inject_once_ptr(mapi_idx_c0sk_get_first_c0kvms, 2, (void *)1);
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, nops);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(4, mapi_calls(mapi_idx_c0sk_get_first_c0kvms));
+
+    mapi_inject_unset(mapi_idx_c0sk_get_first_c0kvms);
+
+    ASSERT_EQ(nops, wbatch_check(kvs_h, NULL, nops, "new"));
+    ASSERT_EQ(nops, wbatch_check(kvs_h, txn, nops, "old"));
+
+    /* A batch which is abandoned on every retry fails, and none of it
+     * is visible.
+     */
+    for (i = 0; i < nops; ++i)
+        kvs_vtuple_init(&opv[i].wbo_vt, "lost", 4);
+
+    wbatch_first_calls = 0;
+    MOCK_SET(c0sk, _c0sk_get_first_c0kvms);
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, nops);
+    ASSERT_EQ(ENOMEM, merr_errno(err));
+    ASSERT_EQ(2 * 9, wbatch_first_calls);
+
+    MOCK_UNSET(c0sk, _c0sk_get_first_c0kvms);
+
+    ASSERT_EQ(nops, wbatch_check(kvs_h, NULL, nops, "new"));
+    ASSERT_EQ(nops, wbatch_check(kvs_h, txn, nops, "old"));
+
+    err = ikvdb_txn_abort(h, txn);
+    ASSERT_EQ(0, err);
+    ikvdb_txn_free(h, txn);
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, write_batch_atomic_efbig, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    struct hse_params *    params;
+    struct mpool *         ds = (struct mpool *)-1;
+    const int              nops = 300;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_wbatch_op   opv[nops];
+    struct hse_kvs *       kvsv[nops];
+    static char            val[HSE_KVS_VLEN_MAX];
+    char                   kbuf[4][16], buf[16];
+    struct kvs_ktuple      kt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    merr_t                 err;
+    int                    i;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_flags |= HSE_KVDB_KOP_FLAG_ATOMIC;
+
+    /* All the updates of one key go to the same c0kvset, and 300 MiB
+     * of them exceed the largest c0kvset.
+     */
+    for (i = 0; i < nops; ++i) {
+        kvs_ktuple_init_nohash(&opv[i].wbo_kt, "big", 3);
+        kvs_vtuple_init(&opv[i].wbo_vt, val, sizeof(val));
+        opv[i].wbo_tomb = false;
+        kvsv[i] = kvs_h;
+    }
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, nops);
+    ASSERT_EQ(EFBIG, merr_errno(err));
+
+    kvs_ktuple_init(&kt, "big", 3);
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(FOUND_VAL, res);
+
+    /* Values of the same size on distinct keys fit.
+     */
+    for (i = 0; i < NELEM(kbuf); ++i) {
+        snprintf(kbuf[i], sizeof(kbuf[i]), "big-%d", i);
+        kvs_ktuple_init_nohash(&opv[i].wbo_kt, kbuf[i], strlen(kbuf[i]));
+        kvs_vtuple_init(&opv[i].wbo_vt, val, sizeof(val));
+    }
+
+    err = ikvdb_kvs_write_batch(h, &opspec, kvsv, opv, NELEM(kbuf));
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < NELEM(kbuf); ++i) {
+        kvs_ktuple_init(&kt, kbuf[i], strlen(kbuf[i]));
+        kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+        err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(FOUND_VAL, res);
+        ASSERT_EQ(sizeof(val), vbuf.b_len);
+    }
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST(ikvdb_test, patch_merge)
+{
+    struct kvs_patch patch;
+    char             result[16];
+    size_t           rlen;
+    merr_t           err;
+
+    /* A patch within the value overwrites it in place.
+     */
+    patch.kp_off = 2;
+    patch.kp_data = "XY";
+    patch.kp_len = 2;
+
+    err = kvs_patch_merge("k", 1, "abcdef", 6, &patch, sizeof(patch), result, 0, &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(6, rlen);
+
+    err = kvs_patch_merge("k", 1, "abcdef", 6, &patch, sizeof(patch), result, rlen, &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(6, rlen);
+    ASSERT_EQ(0, memcmp(result, "abXYef", rlen));
+
+    /* A patch past the end zero-fills the gap, also without a value.
+     */
+    patch.kp_off = 5;
+    patch.kp_data = "Z";
+    patch.kp_len = 1;
+
+    err = kvs_patch_merge("k", 1, "abc", 3, &patch, sizeof(patch), result, sizeof(result), &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(6, rlen);
+    ASSERT_EQ(0, memcmp(result, "abc\0\0Z", rlen));
+
+    err = kvs_patch_merge("k", 1, NULL, 0, &patch, sizeof(patch), result, sizeof(result), &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(6, rlen);
+    ASSERT_EQ(0, memcmp(result, "\0\0\0\0\0Z", rlen));
+
+    /* An append writes at the end of the value.
+     */
+    patch.kp_off = KVS_PATCH_APPEND;
+    patch.kp_data = "de";
+    patch.kp_len = 2;
+
+    err = kvs_patch_merge("k", 1, "abc", 3, &patch, sizeof(patch), result, sizeof(result), &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(5, rlen);
+    ASSERT_EQ(0, memcmp(result, "abcde", rlen));
+
+    /* A result longer than HSE_KVS_VLEN_MAX is reported by its length,
+     * it is up to the caller to reject it.  An offset past the max is
+     * rejected at once.
+     */
+    patch.kp_off = HSE_KVS_VLEN_MAX;
+    patch.kp_data = "Z";
+    patch.kp_len = 1;
+
+    err = kvs_patch_merge("k", 1, "abc", 3, &patch, sizeof(patch), result, sizeof(result), &rlen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(HSE_KVS_VLEN_MAX + 1, rlen);
+
+    patch.kp_off = HSE_KVS_VLEN_MAX + 1;
+
+    err = kvs_patch_merge("k", 1, "abc", 3, &patch, sizeof(patch), result, sizeof(result), &rlen);
+    ASSERT_EQ(EMSGSIZE, merr_errno(err));
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, patch_txn, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    struct hse_params *    params;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      vt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    char                   buf[100];
+    merr_t                 err;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    kvs_ktuple_init(&kt, "key", 3);
+    kvs_vtuple_init(&vt, "abc", 3);
+
+    err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+    opspec.kop_txn = ikvdb_txn_alloc(h);
+    ASSERT_NE(NULL, opspec.kop_txn);
+
+    err = ikvdb_txn_begin(h, opspec.kop_txn);
+    ASSERT_EQ(0, err);
+
+    /* Within a txn the patch is applied to the value at the txn's view,
+     * and a later patch sees the txn's own update.
+     */
+    kvs_vtuple_init(&vt, "Z", 1);
+    err = ikvdb_kvs_patch(kvs_h, &opspec, &kt, 5, &vt);
+    ASSERT_EQ(0, err);
+
+    kvs_vtuple_init(&vt, "de", 2);
+    err = ikvdb_kvs_patch(kvs_h, &opspec, &kt, KVS_PATCH_APPEND, &vt);
+    ASSERT_EQ(0, err);
+
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, &opspec, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(8, vbuf.b_len);
+    ASSERT_EQ(0, memcmp(buf, "abc\0\0Zde", vbuf.b_len));
+
+    /* A result longer than HSE_KVS_VLEN_MAX fails and changes nothing.
+     */
+    kvs_vtuple_init(&vt, "Z", 1);
+    err = ikvdb_kvs_patch(kvs_h, &opspec, &kt, HSE_KVS_VLEN_MAX, &vt);
+    ASSERT_EQ(EMSGSIZE, merr_errno(err));
+
+    /* Others don't see the patches until the txn commits.
+     */
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(3, vbuf.b_len);
+
+    err = ikvdb_txn_commit(h, opspec.kop_txn);
+    ASSERT_EQ(0, err);
+
+    ikvdb_txn_free(h, opspec.kop_txn);
+    opspec.kop_txn = NULL;
+
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(8, vbuf.b_len);
+    ASSERT_EQ(0, memcmp(buf, "abc\0\0Zde", vbuf.b_len));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+/* Add a u64 operand to a u64 counter, a missing counter counts from 0. */
+static merr_t
+merge_add_u64(
+    const void *key,
+    size_t      klen,
+    const void *base,
+    size_t      blen,
+    const void *oper,
+    size_t      olen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    u64 sum = 0, inc;
+
+    if (olen != sizeof(inc) || (base && blen != sizeof(sum)))
+        return merr(EINVAL);
+
+    if (base)
+        memcpy(&sum, base, sizeof(sum));
+
+    memcpy(&inc, oper, sizeof(inc));
+    sum += inc;
+
+    *rlen = sizeof(sum);
+    if (rmax >= sizeof(sum))
+        memcpy(result, &sum, sizeof(sum));
+
+    return 0;
+}
+
+static u64
+merge_get_u64(struct hse_kvs *kvs_h, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt)
+{
+    enum key_lookup_res res;
+    struct kvs_buf      vbuf;
+    u64                 val;
+    merr_t              err;
+
+    kvs_buf_init(&vbuf, &val, sizeof(val));
+
+    err = ikvdb_kvs_get(kvs_h, os, kt, &res, &vbuf);
+    if (err || res != FOUND_VAL || vbuf.b_len != sizeof(val))
+        return U64_MAX;
+
+    return val;
+}
+
+static merr_t
+merge_inc_u64(struct hse_kvs *kvs_h, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt, u64 inc)
+{
+    struct kvs_vtuple vt;
+
+    kvs_vtuple_init(&vt, &inc, sizeof(inc));
+
+    return ikvdb_kvs_merge(kvs_h, os, kt, &vt);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, merge_counter, test_pre, test_post)
+{
+    struct ikvdb *     h = NULL;
+    struct hse_kvs *   kvs_h = NULL;
+    struct hse_params *params;
+    struct mpool *     ds = (struct mpool *)-1;
+    struct kvs_ktuple  kt;
+    struct kvs_vtuple  vt;
+    u64                val;
+    merr_t             err;
+    int                i;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init(&kt, "counter", 7);
+
+    /* No merge function yet. */
+    err = merge_inc_u64(kvs_h, NULL, &kt, 1);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = ikvdb_kvs_merge_register(kvs_h, merge_add_u64);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < 1000; i++) {
+        err = merge_inc_u64(kvs_h, NULL, &kt, 1);
+        ASSERT_EQ(0, err);
+    }
+
+    ASSERT_EQ(1000, merge_get_u64(kvs_h, NULL, &kt));
+
+    /* A merge is based on the newest put... */
+    val = 5;
+    kvs_vtuple_init(&vt, &val, sizeof(val));
+    err = ikvdb_kvs_put(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    err = merge_inc_u64(kvs_h, NULL, &kt, 2);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(7, merge_get_u64(kvs_h, NULL, &kt));
+
+    /* ...or starts afresh after a delete. */
+    err = ikvdb_kvs_del(kvs_h, NULL, &kt);
+    ASSERT_EQ(0, err);
+
+    err = merge_inc_u64(kvs_h, NULL, &kt, 3);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(3, merge_get_u64(kvs_h, NULL, &kt));
+
+    /* An error from the merge function changes nothing. */
+    kvs_vtuple_init(&vt, "x", 1);
+    err = ikvdb_kvs_merge(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+    ASSERT_EQ(3, merge_get_u64(kvs_h, NULL, &kt));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+struct merge_thread_arg {
+    struct hse_kvs *kvs_h;
+    int             count;
+    pthread_t       tid;
+};
+
+static void *
+merge_thread(void *arg)
+{
+    struct merge_thread_arg *mta = arg;
+    struct kvs_ktuple        kt;
+    merr_t                   err;
+    int                      i;
+
+    kvs_ktuple_init(&kt, "counter", 7);
+
+    for (i = 0; i < mta->count; i++) {
+        err = merge_inc_u64(mta->kvs_h, NULL, &kt, 1);
+        VERIFY_EQ_RET(0, err, 0);
+    }
+
+    return 0;
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, merge_concurrent, test_pre, test_post)
+{
+    const int               num_threads = 8;
+    struct merge_thread_arg mta[num_threads];
+    struct ikvdb *          h = NULL;
+    struct hse_kvs *        kvs_h = NULL;
+    struct hse_params *     params;
+    struct mpool *          ds = (struct mpool *)-1;
+    struct kvs_ktuple       kt;
+    merr_t                  err;
+    int                     i, rc;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_merge_register(kvs_h, merge_add_u64);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < num_threads; i++) {
+        mta[i].kvs_h = kvs_h;
+        mta[i].count = 2000;
+
+        rc = pthread_create(&mta[i].tid, 0, merge_thread, &mta[i]);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        rc = pthread_join(mta[i].tid, 0);
+        ASSERT_EQ(0, rc);
+    }
+
+    /* No increment is lost to a concurrent one. */
+    kvs_ktuple_init(&kt, "counter", 7);
+    ASSERT_EQ(num_threads * 2000, merge_get_u64(kvs_h, NULL, &kt));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, merge_rotation, test_pre_c0, test_post_c0)
+{
+    const int               num_threads = 4;
+    struct merge_thread_arg mta[num_threads];
+    struct c0sk *           c0sk;
+    struct ikvdb *          h = NULL;
+    struct hse_kvs *        kvs_h = NULL;
+    struct hse_params *     params;
+    struct mpool *          ds = (struct mpool *)-1;
+    struct kvs_ktuple       kt;
+    struct kvs_vtuple       vt;
+    u64                     val, gen;
+    merr_t                  err;
+    int                     i, rc;
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_merge_register(kvs_h, merge_add_u64);
+    ASSERT_EQ(0, err);
+
+    ikvdb_get_c0sk(h, &c0sk);
+
+    /* Keep the ingested kvmses readable, cn is mocked. */
+    MOCK_SET(c0sk_internal, _c0sk_release_multiset);
+
+    mapi_inject_unset(mapi_idx_cn_ingestv);
+    mapi_inject(mapi_idx_cn_ingestv, 0);
+
+    kvs_ktuple_init(&kt, "counter", 7);
+
+    val = 100;
+    kvs_vtuple_init(&vt, &val, sizeof(val));
+    err = ikvdb_kvs_put(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    /* The base of the first merge after each rotation is in an older
+     * kvms, not in the active one.
+     */
+    for (i = 0; i < 8; i++) {
+        err = c0sk_flush_current_multiset(c0sk_h2r(c0sk), 0, &gen);
+        ASSERT_EQ(0, err);
+
+        err = merge_inc_u64(kvs_h, NULL, &kt, 1);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(101 + i, merge_get_u64(kvs_h, NULL, &kt));
+    }
+
+    /* Merges racing rotations lose nothing either. */
+    for (i = 0; i < num_threads; i++) {
+        mta[i].kvs_h = kvs_h;
+        mta[i].count = 2000;
+
+        rc = pthread_create(&mta[i].tid, 0, merge_thread, &mta[i]);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < 8; i++) {
+        usleep(1000);
+
+        err = c0sk_flush_current_multiset(c0sk_h2r(c0sk), 0, &gen);
+        ASSERT_EQ(0, err);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        rc = pthread_join(mta[i].tid, 0);
+        ASSERT_EQ(0, rc);
+    }
+
+    ASSERT_EQ(108 + num_threads * 2000, merge_get_u64(kvs_h, NULL, &kt));
+
+    MOCK_UNSET(c0sk_internal, _c0sk_release_multiset);
+    release_deferred(c0sk);
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, merge_txn, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    struct hse_params *    params;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec os1, os2;
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      vt;
+    u64                    val;
+    merr_t                 err;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open("mpool", ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_merge_register(kvs_h, merge_add_u64);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init(&kt, "counter", 7);
+
+    val = 10;
+    kvs_vtuple_init(&vt, &val, sizeof(val));
+    err = ikvdb_kvs_put(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    HSE_KVDB_OPSPEC_INIT(&os1);
+    HSE_KVDB_OPSPEC_INIT(&os2);
+    os1.kop_txn = ikvdb_txn_alloc(h);
+    os2.kop_txn = ikvdb_txn_alloc(h);
+    ASSERT_NE(NULL, os1.kop_txn);
+    ASSERT_NE(NULL, os2.kop_txn);
+
+    /* A txn sees its own merges, others don't until it commits. */
+    err = ikvdb_txn_begin(h, os1.kop_txn);
+    ASSERT_EQ(0, err);
+
+    err = merge_inc_u64(kvs_h, &os1, &kt, 1);
+    ASSERT_EQ(0, err);
+    err = merge_inc_u64(kvs_h, &os1, &kt, 1);
+    ASSERT_EQ(0, err);
+
+    ASSERT_EQ(12, merge_get_u64(kvs_h, &os1, &kt));
+    ASSERT_EQ(10, merge_get_u64(kvs_h, NULL, &kt));
+
+    /* A merge conflicts like a put with an active txn... */
+    err = ikvdb_txn_begin(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+
+    err = merge_inc_u64(kvs_h, &os2, &kt, 1);
+    ASSERT_EQ(ECANCELED, merr_errno(err));
+
+    err = ikvdb_txn_abort(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+
+    /* ...and with one that committed after the txn's view. */
+    err = ikvdb_txn_begin(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_txn_commit(h, os1.kop_txn);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(12, merge_get_u64(kvs_h, NULL, &kt));
+
+    err = merge_inc_u64(kvs_h, &os2, &kt, 1);
+    ASSERT_EQ(ECANCELED, merr_errno(err));
+
+    err = ikvdb_txn_abort(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+
+    /* A txn begun after the commit merges on top of it. */
+    err = ikvdb_txn_begin(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+
+    err = merge_inc_u64(kvs_h, &os2, &kt, 5);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_txn_commit(h, os2.kop_txn);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(17, merge_get_u64(kvs_h, NULL, &kt));
+
+    ikvdb_txn_free(h, os1.kop_txn);
+    ikvdb_txn_free(h, os2.kop_txn);
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+/* Index a value by its first byte. */
+static int
+index_first_byte(
+    void *      arg,
+    const void *key,
+    size_t      klen,
+    const void *val,
+    size_t      vlen,
+    void *      ikey,
+    size_t      imax,
+    size_t *    ilen)
+{
+    if (vlen < 1 || imax < 1)
+        return 1;
+
+    memcpy(ikey, val, 1);
+    *ilen = 1;
+
+    return 0;
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, index_test, test_pre, test_post)
+{
+    struct ikvdb *      h = NULL;
+    struct hse_kvs *    kvs_h = NULL, *idx_h = NULL;
+    const char *        mpool = "mpool";
+    struct hse_params * params;
+    merr_t              err;
+    struct mpool *      ds = (struct mpool *)-1;
+    char                buf[100];
+    struct kvs_ktuple   kt;
+    struct kvs_vtuple   vt;
+    struct kvs_buf      vbuf;
+    enum key_lookup_res res;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+    err = ikvdb_kvs_make(h, "idx", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    err = ikvdb_kvs_open(h, "idx", 0, 0, &idx_h);
+    ASSERT_EQ(0, err);
+
+    /* A kvs cannot index itself, nor can an index be indexed. */
+    err = ikvdb_kvs_index_register(kvs_h, kvs_h, index_first_byte, NULL);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = ikvdb_kvs_index_register(kvs_h, idx_h, index_first_byte, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_index_register(idx_h, kvs_h, index_first_byte, NULL);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* A put writes the index entry, index key + key -> key. */
+    kvs_ktuple_init_nohash(&kt, "k1", 2);
+    kvs_vtuple_init(&vt, "red", 3);
+    err = ikvdb_kvs_put(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init(&kt, "rk1", 3);
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(idx_h, NULL, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(2, vbuf.b_len);
+    ASSERT_EQ(0, memcmp(buf, "k1", 2));
+
+    kvs_ktuple_init(&kt, "k1", 2);
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, NULL, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(3, vbuf.b_len);
+
+    /* Values without an index key are put without an entry. */
+    kvs_ktuple_init_nohash(&kt, "k2", 2);
+    kvs_vtuple_init(&vt, "", 0);
+    err = ikvdb_kvs_put(kvs_h, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    /* The index stays open while the kvs it indexes is. */
+    err = ikvdb_kvs_close(idx_h);
+    ASSERT_EQ(EBUSY, merr_errno(err));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_close(idx_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, get_lease_test, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    const char *           mpool = "mpool";
+    const char *           kvs = "kvs";
+    struct hse_params *    params;
+    merr_t                 err;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      vt;
+    struct kvs_vlease      lease;
+    enum key_lookup_res    res;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, kvs, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, kvs, 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    kvs_ktuple_init(&kt, "key", 3);
+    vt.vt_data = "data";
+    vt.vt_len = strlen(vt.vt_data);
+
+    err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    /* A value still in c0 is leased by way of a private copy.
+     */
+    err = ikvdb_kvs_get_lease(kvs_h, &opspec, &kt, &res, &lease);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(vt.vt_len, lease.vl_len);
+    ASSERT_EQ(0, memcmp(lease.vl_data, vt.vt_data, vt.vt_len));
+    ASSERT_EQ(NULL, lease.vl_pin);
+    ASSERT_NE(NULL, lease.vl_buf);
+
+    ikvdb_kvs_lease_release(&lease);
+    ASSERT_EQ(NULL, lease.vl_buf);
+
+    kvs_ktuple_init(&kt, "nokey", 5);
+    err = ikvdb_kvs_get_lease(kvs_h, &opspec, &kt, &res, &lease);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NOT_FOUND, res);
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, seqno_read_test, test_pre, test_post)
+{
+    struct ikvdb *         h = NULL;
+    struct hse_kvs *       kvs_h = NULL;
+    const char *           mpool = "mpool";
+    const char *           kvs = "kvs";
+    struct hse_params *    params;
+    merr_t                 err;
+    struct mpool *         ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec opspec;
+    struct kvs_ktuple      kt;
+    struct kvs_vtuple      vt;
+    struct kvs_buf         vbuf;
+    enum key_lookup_res    res;
+    char                   buf[16];
+    u64                    seqno;
+    int                    i;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = hse_params_set(params, "kvdb.seqno_retain", "4");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, kvs, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, kvs, 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    kvs_ktuple_init(&kt, "key", 3);
+    kvs_vtuple_init(&vt, "old", 3);
+
+    err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    seqno = ikvdb_seqno_get(h);
+
+    kvs_vtuple_init(&vt, "new", 3);
+    err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    /* A read by seqno sees the value as of that seqno.
+     */
+    opspec.kop_flags = HSE_KVDB_KOP_FLAG_SEQNO;
+    opspec.kop_seqno = seqno;
+
+    kvs_buf_init(&vbuf, buf, sizeof(buf));
+    err = ikvdb_kvs_get(kvs_h, &opspec, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(0, memcmp(buf, "old", 3));
+
+    opspec.kop_seqno = ikvdb_seqno_get(h);
+    err = ikvdb_kvs_get(kvs_h, &opspec, &kt, &res, &vbuf);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(0, memcmp(buf, "new", 3));
+
+    /* Not a seqno yet...
+     */
+    opspec.kop_seqno = ikvdb_seqno_get(h) + 1;
+    err = ikvdb_kvs_get(kvs_h, &opspec, &kt, &res, &vbuf);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* ...or no longer retained.
+     */
+    for (i = 0; i < 8; ++i) {
+        err = ikvdb_kvs_put(kvs_h, 0, &kt, &vt);
+        ASSERT_EQ(0, err);
+    }
+
+    opspec.kop_seqno = seqno;
+    err = ikvdb_kvs_get(kvs_h, &opspec, &kt, &res, &vbuf);
+    ASSERT_EQ(ESTALE, merr_errno(err));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, stream_test, test_pre, test_post)
+{
+    struct ikvdb *       h = NULL;
+    struct hse_kvs *     kvs_h = NULL;
+    const char *         mpool = "mpool";
+    struct hse_params *  params;
+    merr_t               err;
+    struct mpool *       ds = (struct mpool *)-1;
+    struct ikvdb_stream *stream;
+    struct kvs_ktuple    kt;
+    enum key_lookup_res  res;
+    size_t               vlen = 2 * HSE_KVS_VLEN_MAX + 100;
+    size_t               rlen, i;
+    u64                  slen;
+    char *               val, *buf;
+
+    val = malloc(vlen);
+    ASSERT_NE(NULL, val);
+    buf = malloc(vlen);
+    ASSERT_NE(NULL, buf);
+
+    for (i = 0; i < vlen; ++i)
+        val[i] = i % 251;
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_make(h, "kvs", NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, "kvs", 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init_nohash(&kt, "big", 3);
+
+    /* Write a value of three chunks in uneven pieces.
+     */
+    err = ikvdb_kvs_stream_open(kvs_h, NULL, &kt, &stream);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < vlen; i += 4096 + 7) {
+        err = ikvdb_kvs_stream_write(stream, val + i, min_t(size_t, 4096 + 7, vlen - i));
+        ASSERT_EQ(0, err);
+    }
+
+    /* Nothing is visible until the stream is committed.
+     */
+    err = ikvdb_kvs_stream_read(kvs_h, NULL, &kt, 0, buf, vlen, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NOT_FOUND, res);
+
+    err = ikvdb_kvs_stream_commit(stream);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_stream_read(kvs_h, NULL, &kt, 0, buf, vlen, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(vlen, slen);
+    ASSERT_EQ(vlen, rlen);
+    ASSERT_EQ(0, memcmp(buf, val, vlen));
+
+    /* A range which straddles two chunks.
+     */
+    err = ikvdb_kvs_stream_read(
+        kvs_h, NULL, &kt, HSE_KVS_VLEN_MAX - 10, buf, 20, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(20, rlen);
+    ASSERT_EQ(0, memcmp(buf, val + HSE_KVS_VLEN_MAX - 10, 20));
+
+    /* A range past the end.
+     */
+    err = ikvdb_kvs_stream_read(kvs_h, NULL, &kt, vlen, buf, 20, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(FOUND_VAL, res);
+    ASSERT_EQ(0, rlen);
+
+    /* An aborted stream leaves the value as is.
+     */
+    err = ikvdb_kvs_stream_open(kvs_h, NULL, &kt, &stream);
+    ASSERT_EQ(0, err);
+    err = ikvdb_kvs_stream_write(stream, val, vlen);
+    ASSERT_EQ(0, err);
+    ikvdb_kvs_stream_abort(stream);
+
+    err = ikvdb_kvs_stream_read(kvs_h, NULL, &kt, 0, buf, 10, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(vlen, slen);
+
+    /* A value of at most one chunk replaces the streamed value in place.
+     */
+    err = ikvdb_kvs_stream_open(kvs_h, NULL, &kt, &stream);
+    ASSERT_EQ(0, err);
+    err = ikvdb_kvs_stream_write(stream, "small", 5);
+    ASSERT_EQ(0, err);
+    err = ikvdb_kvs_stream_commit(stream);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_stream_read(kvs_h, NULL, &kt, 2, buf, vlen, &res, &rlen, &slen);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(5, slen);
+    ASSERT_EQ(3, rlen);
+    ASSERT_EQ(0, memcmp(buf, "all", 3));
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+    free(buf);
+    free(val);
+}
+
+static void
+async_test_cb(struct hse_kvs_async_req *req)
+{
+    atomic_inc(req->kar_arg);
+}
+
+MTF_DEFINE_UTEST_PREPOST(ikvdb_test, async_get_put_test, test_pre, test_post)
+{
+    struct ikvdb *           h = NULL;
+    struct hse_kvs *         kvs_h = NULL;
+    const char *             mpool = "mpool";
+    const char *             kvs = "kvs";
+    struct hse_params *      params;
+    merr_t                   err;
+    struct mpool *           ds = (struct mpool *)-1;
+    struct hse_kvdb_opspec   opspec;
+    struct hse_kvs_async_req req = {};
+    char                     buf[16];
+    atomic_t                 done;
+
+    HSE_KVDB_OPSPEC_INIT(&opspec);
+
+    /* we want a valid c0/c0sk here */
+    mock_c0_unset();
+
+    hse_params_create(&params);
+
+    err = hse_params_set(params, "kvdb.c0_diag_mode", "1");
+    ASSERT_EQ(err, 0);
+
+    err = ikvdb_open(mpool, ds, params, &h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, h);
+
+    err = ikvdb_kvs_make(h, kvs, NULL);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_open(h, kvs, 0, 0, &kvs_h);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, kvs_h);
+
+    atomic_set(&done, 0);
+
+    req.kar_cb = async_test_cb;
+    req.kar_arg = &done;
+    req.kar_key = "key";
+    req.kar_key_len = 3;
+    req.kar_buf = "data";
+    req.kar_buf_len = 4;
+
+    err = ikvdb_kvs_async_submit(kvs_h, &opspec, &req, true);
+    ASSERT_EQ(0, err);
+
+    while (atomic_read(&done) < 1)
+        usleep(1000);
+    ASSERT_EQ(0, req.kar_err);
+
+    req.kar_buf = buf;
+    req.kar_buf_len = sizeof(buf);
+
+    err = ikvdb_kvs_async_submit(kvs_h, NULL, &req, false);
+    ASSERT_EQ(0, err);
+
+    while (atomic_read(&done) < 2)
+        usleep(1000);
+    ASSERT_EQ(0, req.kar_err);
+    ASSERT_TRUE(req.kar_found);
+    ASSERT_EQ(4, req.kar_val_len);
+    ASSERT_EQ(0, memcmp(buf, "data", 4));
+
+    /* Async ops may not be part of a txn.
+     */
+    opspec.kop_txn = ikvdb_txn_alloc(h);
+    ASSERT_NE(0, opspec.kop_txn);
+
+    err = ikvdb_kvs_async_submit(kvs_h, &opspec, &req, false);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    ikvdb_txn_free(h, opspec.kop_txn);
+
+    err = ikvdb_kvs_close(kvs_h);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_close(h);
+    ASSERT_EQ(0, err);
+
+    hse_params_destroy(params);
+}
+
 struct tx_info {
     struct ikvdb *  kvdb;
     struct hse_kvs *kvs;
@@ -802,6 +2396,9 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, cursor_0, test_pre, test_post)
     const void *           key, *val;
     size_t                 klen, vlen;
     bool                   eof;
+    char                   buf[64];
+    struct hse_kvs_cursor_rec recv[4];
+    unsigned int           nread;
 
     HSE_KVDB_OPSPEC_INIT(&opspec);
 
@@ -842,6 +2439,12 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, cursor_0, test_pre, test_post)
     ASSERT_EQ(0, err);
     ASSERT_TRUE(eof);
 
+    nread = 1;
+    err = ikvdb_kvs_cursor_read_many(cur, 0, buf, sizeof(buf), recv, NELEM(recv), &nread, &eof);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, nread);
+    ASSERT_TRUE(eof);
+
     err = ikvdb_kvs_cursor_destroy(cur);
     ASSERT_EQ(0, err);
 
@@ -871,6 +2474,9 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, cursor_1, test_pre_c0, test_post_c0)
     merr_t                 err;
     bool                   eof;
     int                    i;
+    char                   buf[128];
+    struct hse_kvs_cursor_rec recv[8];
+    unsigned int           nread;
 
     struct kvdata {
         char *key;
@@ -947,6 +2553,106 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, cursor_1, test_pre_c0, test_post_c0)
     err = ikvdb_kvs_cursor_destroy(cur);
     ASSERT_EQ(0, err);
 
+    /* Test key-only scans: value lengths but no values */
+    opspec.kop_flags = HSE_KVDB_KOP_FLAG_KEYS_ONLY;
+
+    err = ikvdb_kvs_cursor_create(kvs_h, &opspec, 0, 0, &cur);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, cur);
+
+    for (i = 0;; ++i) {
+        err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
+        ASSERT_EQ(err, 0);
+        if (eof)
+            break;
+
+        ASSERT_LE(i, NELEM(sorted));
+
+        ASSERT_EQ(klen, strlen(sorted[i].key));
+        ASSERT_EQ(vlen, strlen(sorted[i].val));
+        ASSERT_EQ(0, memcmp(key, sorted[i].key, klen));
+        ASSERT_EQ(NULL, val);
+    }
+    ASSERT_EQ(i, NELEM(kvdata));
+
+    err = ikvdb_kvs_cursor_destroy(cur);
+    ASSERT_EQ(0, err);
+
+    opspec.kop_flags = 0;
+
+    /* Batch reads stop at the first pair that doesn't fit in the buffer
+     * and leave it to the next read.
+     */
+    err = ikvdb_kvs_cursor_create(kvs_h, &opspec, 0, 0, &cur);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_cursor_read_many(cur, 0, buf, 15, recv, NELEM(recv), &nread, &eof);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2, nread);
+    ASSERT_FALSE(eof);
+
+    for (i = 0; i < nread; ++i) {
+        ASSERT_EQ(strlen(sorted[i].key), recv[i].kcr_key_len);
+        ASSERT_EQ(0, memcmp(buf + recv[i].kcr_key_off, sorted[i].key, recv[i].kcr_key_len));
+        ASSERT_EQ(strlen(sorted[i].val), recv[i].kcr_val_len);
+        ASSERT_EQ(0, memcmp(buf + recv[i].kcr_val_off, sorted[i].val, recv[i].kcr_val_len));
+    }
+
+    err = ikvdb_kvs_cursor_read_many(cur, 0, buf, 5, recv, NELEM(recv), &nread, &eof);
+    ASSERT_EQ(EMSGSIZE, merr_errno(err));
+    ASSERT_EQ(0, nread);
+
+    err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
+    ASSERT_EQ(0, err);
+    ASSERT_FALSE(eof);
+    ASSERT_EQ(klen, strlen(sorted[2].key));
+    ASSERT_EQ(0, memcmp(key, sorted[2].key, klen));
+
+    err = ikvdb_kvs_cursor_read_many(cur, 0, buf, sizeof(buf), recv, NELEM(recv), &nread, &eof);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NELEM(sorted) - 3, nread);
+    ASSERT_FALSE(eof);
+
+    for (i = 0; i < nread; ++i) {
+        ASSERT_EQ(strlen(sorted[i + 3].key), recv[i].kcr_key_len);
+        ASSERT_EQ(0, memcmp(buf + recv[i].kcr_key_off, sorted[i + 3].key, recv[i].kcr_key_len));
+    }
+
+    err = ikvdb_kvs_cursor_read_many(cur, 0, buf, sizeof(buf), recv, NELEM(recv), &nread, &eof);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, nread);
+    ASSERT_TRUE(eof);
+
+    err = ikvdb_kvs_cursor_destroy(cur);
+    ASSERT_EQ(0, err);
+
+    /* Direct scans are forward only */
+    opspec.kop_flags = HSE_KVDB_KOP_FLAG_DIRECT | HSE_KVDB_KOP_FLAG_REVERSE;
+
+    err = ikvdb_kvs_cursor_create(kvs_h, &opspec, 0, 0, &cur);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    opspec.kop_flags = HSE_KVDB_KOP_FLAG_DIRECT;
+
+    err = ikvdb_kvs_cursor_create(kvs_h, &opspec, 0, 0, &cur);
+    ASSERT_EQ(0, err);
+
+    for (i = 0;; ++i) {
+        err = ikvdb_kvs_cursor_read(cur, 0, &key, &klen, &val, &vlen, &eof);
+        ASSERT_EQ(err, 0);
+        if (eof)
+            break;
+
+        ASSERT_LE(i, NELEM(sorted));
+        ASSERT_EQ(0, memcmp(key, sorted[i].key, klen));
+    }
+    ASSERT_EQ(i, NELEM(kvdata));
+
+    err = ikvdb_kvs_cursor_destroy(cur);
+    ASSERT_EQ(0, err);
+
+    opspec.kop_flags = 0;
+
     /* Test seek */
     err = ikvdb_kvs_cursor_create(kvs_h, &opspec, 0, 0, &cur);
     ASSERT_EQ(0, err);
@@ -1871,6 +3577,10 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, ikvdb_export_test, test_pre, test_post)
     char              kbuf[12];
     int               i;
     const int         LEN = 100000;
+    struct hse_kvs_cursor *cur;
+    const void *           key, *val;
+    size_t                 klen, vlen;
+    bool                   eof;
 
     hdl = NULL;
     kvs_h1 = kvs_h2 = NULL;
@@ -1949,6 +3659,29 @@ MTF_DEFINE_UTEST_PREPOST(ikvdb_test, ikvdb_export_test, test_pre, test_post)
     err = ikvdb_import(hdl, path_impt);
     ASSERT_EQ(err, 0);
 
+    /* Every k-v pair of every key range made it back. */
+    err = ikvdb_kvs_open(hdl, kvs_name1, 0, 0, &kvs_h1);
+    ASSERT_EQ(0, err);
+
+    err = ikvdb_kvs_cursor_create(kvs_h1, NULL, NULL, 0, &cur);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; true; i++) {
+        err = ikvdb_kvs_cursor_read(cur, NULL, &key, &klen, &val, &vlen, &eof);
+        ASSERT_EQ(0, err);
+        if (eof)
+            break;
+
+        sprintf(kbuf, "%06d", i);
+        ASSERT_EQ(strlen(kbuf) + 1, klen);
+        ASSERT_EQ(0, memcmp(kbuf, key, klen));
+        ASSERT_EQ(0, memcmp(kbuf, val, vlen));
+    }
+    ASSERT_EQ(LEN, i);
+
+    ikvdb_kvs_cursor_destroy(cur);
+    ikvdb_kvs_close(kvs_h1);
+
     ikvdb_close(hdl);
 
     hse_params_destroy(params);
@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/delay.h>
+
+#include <hse_ikvdb/io_sched.h>
+
+#include <pthread.h>
+
+struct io_sched *ios;
+
+static enum io_sched_class orderv[8];
+static atomic_t            orderc;
+
+struct waiter {
+    pthread_t           tid;
+    enum io_sched_class cls;
+};
+
+static void *
+waiter_main(void *arg)
+{
+    struct waiter *w = arg;
+
+    io_sched_enter(ios, MP_MED_CAPACITY, w->cls, 4096);
+    orderv[atomic_inc_return(&orderc) - 1] = w->cls;
+    io_sched_exit(ios, MP_MED_CAPACITY);
+
+    return NULL;
+}
+
+/* Start a thread that waits for admission, and wait until it is queued
+ * (an I/O is counted and queued under the same lock hold).
+ */
+static int
+waiter_start(struct waiter *w, enum io_sched_class cls)
+{
+    struct io_sched_stats stats;
+    u64                   ops;
+    int                   rc, i;
+
+    io_sched_stats(ios, MP_MED_CAPACITY, cls, &stats);
+    ops = stats.iss_ops;
+
+    w->cls = cls;
+
+    rc = pthread_create(&w->tid, NULL, waiter_main, w);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < 1000; ++i) {
+        io_sched_stats(ios, MP_MED_CAPACITY, cls, &stats);
+        if (stats.iss_ops > ops)
+            return 0;
+        usleep(1000);
+    }
+
+    return -1;
+}
+
+static int
+pre(struct mtf_test_info *lcl_ti)
+{
+    memset(orderv, 0, sizeof(orderv));
+    atomic_set(&orderc, 0);
+
+    return 0;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(io_sched)
+
+MTF_DEFINE_UTEST(io_sched, basic)
+{
+    struct io_sched_stats stats;
+    merr_t                err;
+
+    err = io_sched_create(0, 0, &ios);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = io_sched_create(IO_SCHED_QD_MAX + 1, 0, &ios);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    /* Without a scheduler I/Os are admitted immediately. */
+    io_sched_enter(NULL, MP_MED_STAGING, IOS_FG_READ, 4096);
+    io_sched_exit(NULL, MP_MED_STAGING);
+    io_sched_destroy(NULL);
+
+    err = io_sched_create(2, 0, &ios);
+    ASSERT_EQ(0, err);
+
+    io_sched_enter(ios, MP_MED_STAGING, IOS_FG_READ, 4096);
+    io_sched_enter(ios, MP_MED_STAGING, IOS_COMPACT, 8192);
+
+    /* Media classes are scheduled independently. */
+    io_sched_enter(ios, MP_MED_CAPACITY, IOS_C1, 512);
+    io_sched_exit(ios, MP_MED_CAPACITY);
+
+    io_sched_exit(ios, MP_MED_STAGING);
+    io_sched_exit(ios, MP_MED_STAGING);
+
+    io_sched_stats(ios, MP_MED_STAGING, IOS_FG_READ, &stats);
+    ASSERT_EQ(1, stats.iss_ops);
+    ASSERT_EQ(4096, stats.iss_bytes);
+    ASSERT_EQ(0, stats.iss_waits);
+
+    io_sched_stats(ios, MP_MED_STAGING, IOS_COMPACT, &stats);
+    ASSERT_EQ(1, stats.iss_ops);
+    ASSERT_EQ(8192, stats.iss_bytes);
+
+    io_sched_stats(ios, MP_MED_CAPACITY, IOS_C1, &stats);
+    ASSERT_EQ(1, stats.iss_ops);
+
+    ASSERT_STREQ("fg_read", io_sched_class_name(IOS_FG_READ));
+    ASSERT_STREQ("compact", io_sched_class_name(IOS_COMPACT));
+
+    io_sched_destroy(ios);
+}
+
+MTF_DEFINE_UTEST_PRE(io_sched, fair, pre)
+{
+    struct io_sched_stats stats;
+    struct waiter         wv[4];
+    merr_t                err;
+    int                   rc, i;
+
+    err = io_sched_create(1, 0, &ios);
+    ASSERT_EQ(0, err);
+
+    /* Hold the only slot while the waiters queue up, compactions first.
+     */
+    io_sched_enter(ios, MP_MED_CAPACITY, IOS_INGEST, 4096);
+
+    rc = waiter_start(&wv[0], IOS_COMPACT);
+    ASSERT_EQ(0, rc);
+    rc = waiter_start(&wv[1], IOS_COMPACT);
+    ASSERT_EQ(0, rc);
+    rc = waiter_start(&wv[2], IOS_C1);
+    ASSERT_EQ(0, rc);
+    rc = waiter_start(&wv[3], IOS_FG_READ);
+    ASSERT_EQ(0, rc);
+
+    io_sched_exit(ios, MP_MED_CAPACITY);
+
+    for (i = 0; i < 4; ++i)
+        pthread_join(wv[i].tid, NULL);
+
+    /* The compactions arrived first but go last: the second is behind
+     * in virtual time, and the first loses the tie to the higher weights.
+     * The foreground read and the c1 append may go in either order,
+     * depending on which of their deadlines passed first, if any.
+     */
+    ASSERT_EQ(4, atomic_read(&orderc));
+    ASSERT_NE(IOS_COMPACT, orderv[0]);
+    ASSERT_NE(IOS_COMPACT, orderv[1]);
+    ASSERT_NE(orderv[0], orderv[1]);
+    ASSERT_EQ(IOS_COMPACT, orderv[2]);
+    ASSERT_EQ(IOS_COMPACT, orderv[3]);
+
+    io_sched_stats(ios, MP_MED_CAPACITY, IOS_COMPACT, &stats);
+    ASSERT_EQ(2, stats.iss_ops);
+    ASSERT_EQ(2, stats.iss_waits);
+    ASSERT_GE(stats.iss_max_ns, stats.iss_wait_ns / 2);
+
+    io_sched_destroy(ios);
+}
+
+MTF_END_UTEST_COLLECTION(io_sched)
@@ -432,10 +432,13 @@ MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, basic_commit_proto, mapi_pre, mapi_post
 
 static merr_t g_flush_retcode;
 static u64    g_flush_reserved_seqno;
+static int    g_flush_cnt;
 
 static merr_t
 _c0sk_flush(struct c0sk *handle, struct c0_kvmultiset *new)
 {
+    g_flush_cnt++;
+
     if (new) {
         c0kvms_rsvd_sn_set(new, g_flush_reserved_seqno);
         _c0kvms_putref(new);
@@ -1170,6 +1173,135 @@ MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, txn_independence, mapi_pre, mapi_post)
     c0_close(c0a);
 }
 
+static struct kvdb_ctxn *
+occ_begin(
+    struct mtf_test_info *  lcl_ti,
+    struct kvdb_keylock *   klock,
+    atomic64_t *            kvdb_seq,
+    struct active_ctxn_set *acs,
+    bool                    occ)
+{
+    struct kvdb_ctxn *handle;
+    merr_t            err;
+
+    handle = kvdb_ctxn_alloc(klock, kvdb_seq, kvdb_ctxn_set, acs, NULL);
+    VERIFY_NE_RET(NULL, handle, NULL);
+
+    kvdb_ctxn_h2r(handle)->ctxn_occ = occ;
+
+    err = kvdb_ctxn_begin(handle);
+    VERIFY_EQ_RET(0, err, NULL);
+
+    return handle;
+}
+
+MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, txn_occ, mapi_pre, mapi_post)
+{
+    struct kvdb_ctxn *      occ, *eager;
+    struct active_ctxn_set *acs;
+    struct kvdb_keylock *   klock;
+    struct kvs_ktuple       kt, kt2;
+    struct kvs_vtuple       vt;
+    atomic64_t              kvdb_seq;
+    merr_t                  err;
+
+    /* Committed txns hand their locks to the keylock, so that a txn
+     * whose view predates the commit cannot take them.
+     */
+    mapi_inject_unset(mapi_idx_kvdb_keylock_lock);
+    mapi_inject_unset(mapi_idx_kvdb_keylock_list_lock);
+    mapi_inject_unset(mapi_idx_kvdb_keylock_list_unlock);
+    mapi_inject_unset(mapi_idx_kvdb_keylock_queue_locks);
+
+    err = kvdb_keylock_create(&klock, 16, 65536);
+    ASSERT_EQ(0, err);
+
+    atomic64_set(&kvdb_seq, 117UL);
+
+    err = active_ctxn_set_create(&acs, &kvdb_seq);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_set_create(&kvdb_ctxn_set, tn_timeout, tn_delay);
+    ASSERT_EQ(0, err);
+
+    kvs_ktuple_init(&kt, "occ", 3);
+    kvs_ktuple_init(&kt2, "occ2", 4);
+    kvs_vtuple_init(&vt, "val", 3);
+
+    /* An occ put takes no lock, so a concurrent eager txn gets it, and
+     * the occ txn fails at commit instead.
+     */
+    occ = occ_begin(lcl_ti, klock, &kvdb_seq, acs, true);
+    ASSERT_NE(NULL, occ);
+    eager = occ_begin(lcl_ti, klock, &kvdb_seq, acs, false);
+    ASSERT_NE(NULL, eager);
+
+    err = kvdb_ctxn_put(occ, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(1, kvdb_ctxn_h2r(occ)->ctxn_wsetc);
+
+    err = kvdb_ctxn_put(eager, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_commit(occ);
+    ASSERT_EQ(ECANCELED, merr_errno(err));
+    ASSERT_EQ(KVDB_CTXN_ABORTED, kvdb_ctxn_get_state(occ));
+
+    err = kvdb_ctxn_commit(eager);
+    ASSERT_EQ(0, err);
+
+    kvdb_ctxn_free(occ);
+    kvdb_ctxn_free(eager);
+
+    /* An occ txn also fails if the key was committed after its view.
+     */
+    occ = occ_begin(lcl_ti, klock, &kvdb_seq, acs, true);
+    ASSERT_NE(NULL, occ);
+    eager = occ_begin(lcl_ti, klock, &kvdb_seq, acs, false);
+    ASSERT_NE(NULL, eager);
+
+    err = kvdb_ctxn_put(occ, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_put(eager, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_commit(eager);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_commit(occ);
+    ASSERT_EQ(ECANCELED, merr_errno(err));
+    ASSERT_EQ(KVDB_CTXN_ABORTED, kvdb_ctxn_get_state(occ));
+
+    kvdb_ctxn_free(occ);
+    kvdb_ctxn_free(eager);
+
+    /* A txn that starts after that commit writes the key again, and the
+     * duplicate hashes in its write set take one lock.
+     */
+    occ = occ_begin(lcl_ti, klock, &kvdb_seq, acs, true);
+    ASSERT_NE(NULL, occ);
+
+    err = kvdb_ctxn_put(occ, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+    err = kvdb_ctxn_put(occ, NULL, &kt, &vt);
+    ASSERT_EQ(0, err);
+    err = kvdb_ctxn_del(occ, NULL, &kt2);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(3, kvdb_ctxn_h2r(occ)->ctxn_wsetc);
+
+    err = kvdb_ctxn_commit(occ);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, kvdb_ctxn_h2r(occ)->ctxn_wsetc);
+    ASSERT_EQ(KVDB_CTXN_COMMITTED, kvdb_ctxn_get_state(occ));
+
+    kvdb_ctxn_free(occ);
+
+    kvdb_ctxn_set_destroy(kvdb_ctxn_set);
+    active_ctxn_set_destroy(acs);
+    kvdb_keylock_destroy(klock);
+}
+
 MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, seq_state, mapi_pre, mapi_post)
 {
     enum hse_seqno_state state;
@@ -1477,4 +1609,326 @@ MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, kvdb_ctxn_test_merge, mapi_pre, mapi_po
     kvdb_keylock_destroy(klock);
 }
 
+MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, txn_idle_reclaim, mapi_pre, mapi_post)
+{
+    struct kvdb_ctxn_impl * ctxn;
+    struct active_ctxn_set *acs;
+    struct kvdb_keylock *   klock;
+    struct kvdb_ctxn *      handle;
+    struct kvs_ktuple       kt;
+    struct kvs_vtuple       vt;
+    char                    kbuf[100], vbuf[100];
+    struct c0 *             c0 = NULL; /* c0 is mocked */
+    u32                     delay_ms = 100;
+    atomic64_t              kvdb_seq;
+    merr_t                  err;
+
+    err = kvdb_keylock_create(&klock, 16, 65536);
+    ASSERT_EQ(0, err);
+
+    atomic64_set(&kvdb_seq, 117UL);
+
+    err = active_ctxn_set_create(&acs, &kvdb_seq);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_set_create(&kvdb_ctxn_set, delay_ms, delay_ms / 5);
+    ASSERT_EQ(0, err);
+
+    sprintf(kbuf, "c017snapple17");
+    kvs_ktuple_init(&kt, kbuf, 1 + strlen(kbuf));
+    vt.vt_data = vbuf;
+    vt.vt_len = sizeof(vbuf);
+
+    handle = kvdb_ctxn_alloc(klock, &kvdb_seq, kvdb_ctxn_set, acs, NULL);
+    ASSERT_NE(NULL, handle);
+    ctxn = kvdb_ctxn_h2r(handle);
+
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+    err = kvdb_ctxn_put(handle, c0, &kt, &vt);
+    ASSERT_EQ(0, err);
+    err = kvdb_ctxn_commit(handle);
+    ASSERT_EQ(0, err);
+
+    /* The merge succeeded so the txn keeps its kvms while idle. */
+    ASSERT_EQ(NULL, ctxn->ctxn_kvms);
+    ASSERT_NE(NULL, ctxn->ctxn_kvms_idle);
+
+    /* Reuse within txn_timeout hands the same kvms back. */
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+    ASSERT_NE(NULL, ctxn->ctxn_kvms);
+    ASSERT_EQ(NULL, ctxn->ctxn_kvms_idle);
+    kvdb_ctxn_abort(handle);
+    ASSERT_NE(NULL, ctxn->ctxn_kvms_idle);
+
+    usleep(1000 * delay_ms * 6);
+
+    /* Idle for a whole txn_timeout, the worker reclaimed it. */
+    ASSERT_EQ(NULL, READ_ONCE(ctxn->ctxn_kvms_idle));
+
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, ctxn->ctxn_kvms);
+    err = kvdb_ctxn_put(handle, c0, &kt, &vt);
+    ASSERT_EQ(0, err);
+    err = kvdb_ctxn_commit(handle);
+    ASSERT_EQ(0, err);
+
+    kvdb_ctxn_free(handle);
+
+    kvdb_ctxn_set_destroy(kvdb_ctxn_set);
+
+    active_ctxn_set_destroy(acs);
+    kvdb_keylock_destroy(klock);
+}
+
+struct reap_race_arg {
+    struct kvdb_keylock *   klock;
+    struct active_ctxn_set *acs;
+    atomic64_t *            kvdb_seq;
+    int                     thrd_num;
+};
+
+/* Begin, use and free txns whose timeout is so short that the expiry
+ * worker keeps aborting and reclaiming them underneath us.  Begin on
+ * a txn that is not active must never fail, whatever the worker does.
+ */
+void *
+reap_race_helper(void *arg)
+{
+    struct reap_race_arg *rr = arg;
+    struct kvdb_ctxn *    handle;
+    struct kvs_ktuple     kt;
+    struct kvs_vtuple     vt;
+    char                  kbuf[32], vbuf[32];
+    merr_t                err;
+    int                   i, j;
+
+    sprintf(kbuf, "reap%03d", rr->thrd_num);
+    kvs_ktuple_init(&kt, kbuf, 1 + strlen(kbuf));
+    vt.vt_data = vbuf;
+    vt.vt_len = sizeof(vbuf);
+
+    for (i = 0; i < 200; i++) {
+        handle = kvdb_ctxn_alloc(rr->klock, rr->kvdb_seq, kvdb_ctxn_set, rr->acs, NULL);
+        VERIFY_NE_RET(NULL, handle, 0);
+
+        for (j = 0; j < 8; j++) {
+            err = kvdb_ctxn_begin(handle);
+            VERIFY_EQ_RET(0, err, 0);
+
+            /* The worker may abort the txn at any point from here. */
+            kvdb_ctxn_put(handle, NULL, &kt, &vt);
+
+            if ((i + j) % 3)
+                usleep(rand() % 3000);
+
+            if ((i + j) % 2)
+                kvdb_ctxn_commit(handle);
+            else
+                kvdb_ctxn_abort(handle);
+
+            if ((i + j) % 4 == 0)
+                usleep(rand() % 3000);
+        }
+
+        if (i % 2)
+            VERIFY_EQ_RET(0, kvdb_ctxn_begin(handle), 0);
+
+        kvdb_ctxn_free(handle);
+    }
+
+    return 0;
+}
+
+MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, txn_reap_race, mapi_pre, mapi_post)
+{
+    const int               num_threads = 16;
+    pthread_t               thread_idv[num_threads];
+    struct reap_race_arg    argv[num_threads];
+    struct active_ctxn_set *acs;
+    struct kvdb_keylock *   klock;
+    atomic64_t              kvdb_seq;
+    merr_t                  err;
+    int                     i, rc;
+
+    err = kvdb_keylock_create(&klock, 16, 65536);
+    ASSERT_EQ(0, err);
+
+    atomic64_set(&kvdb_seq, 117UL);
+
+    err = active_ctxn_set_create(&acs, &kvdb_seq);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_set_create(&kvdb_ctxn_set, 1, 1);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < num_threads; i++) {
+        argv[i].klock = klock;
+        argv[i].acs = acs;
+        argv[i].kvdb_seq = &kvdb_seq;
+        argv[i].thrd_num = i;
+
+        rc = pthread_create(thread_idv + i, 0, reap_race_helper, &argv[i]);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        rc = pthread_join(thread_idv[i], 0);
+        ASSERT_EQ(0, rc);
+    }
+
+    kvdb_ctxn_set_destroy(kvdb_ctxn_set);
+
+    active_ctxn_set_destroy(acs);
+    kvdb_keylock_destroy(klock);
+}
+
+/* Put values into a txn whose keys all hash to the same c0kvset, so
+ * that it fills up after a few of them, until the put fails.  Returns
+ * the number of values put.
+ */
+static int
+spill_fill(struct mtf_test_info *lcl_ti, struct kvdb_ctxn *handle, u64 *keyv, int keyc)
+{
+    struct kvs_ktuple kt;
+    struct kvs_vtuple vt;
+    static char       vbuf[HSE_KVS_VLEN_MAX];
+    merr_t            err;
+    int               i;
+
+    kvs_vtuple_init(&vt, vbuf, sizeof(vbuf));
+
+    for (i = 0; i < keyc; i++) {
+        keyv[i] = i;
+        kvs_ktuple_init(&kt, &keyv[i], sizeof(keyv[i]));
+        kt.kt_hash = 0;
+
+        memset(vbuf, i, sizeof(vbuf));
+
+        err = kvdb_ctxn_put(handle, NULL, &kt, &vt);
+        if (err) {
+            VERIFY_EQ_RET(ENOMEM, merr_errno(err), -1);
+            break;
+        }
+    }
+
+    return i;
+}
+
+MTF_DEFINE_UTEST_PREPOST(kvdb_ctxn_test, txn_spill, mapi_pre, mapi_post)
+{
+    struct kvdb_ctxn_impl * ctxn;
+    struct active_ctxn_set *acs;
+    struct kvdb_keylock *   klock;
+    struct kvdb_ctxn *      handle;
+    struct kvs_ktuple       kt;
+    struct kvs_buf          vbuf;
+    enum key_lookup_res     res;
+    atomic64_t              kvdb_seq;
+    u64                     keyv[64];
+    char                    buf[8];
+    merr_t                  err;
+    int                     i, n, nospill;
+
+    err = kvdb_keylock_create(&klock, 16, 65536);
+    ASSERT_EQ(0, err);
+
+    atomic64_set(&kvdb_seq, 117UL);
+
+    err = active_ctxn_set_create(&acs, &kvdb_seq);
+    ASSERT_EQ(0, err);
+
+    err = kvdb_ctxn_set_create(&kvdb_ctxn_set, tn_timeout, tn_delay);
+    ASSERT_EQ(0, err);
+
+    /* Without txn_spill_max a full kvms fails the put. */
+    handle = kvdb_ctxn_alloc(klock, &kvdb_seq, kvdb_ctxn_set, acs, NULL);
+    ASSERT_NE(NULL, handle);
+
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+
+    nospill = spill_fill(lcl_ti, handle, keyv, NELEM(keyv));
+    ASSERT_GT(nospill, 1);
+    ASSERT_LT(nospill, NELEM(keyv));
+    ASSERT_FALSE(kvdb_ctxn_spilled(handle));
+
+    kvdb_ctxn_abort(handle);
+    kvdb_ctxn_free(handle);
+
+    /* With it, the txn moves on to new kvmses and holds about three
+     * times as much.  Each txn starts out with an empty kvms, an
+     * aborted txn's kvms is reused with the aborted values still in it.
+     */
+    handle = kvdb_ctxn_alloc(klock, &kvdb_seq, kvdb_ctxn_set, acs, NULL);
+    ASSERT_NE(NULL, handle);
+    ctxn = kvdb_ctxn_h2r(handle);
+    ctxn->ctxn_spill_max = 2;
+
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+
+    n = spill_fill(lcl_ti, handle, keyv, NELEM(keyv));
+    ASSERT_GE(n, 3 * (nospill - 1));
+    ASSERT_LT(n, NELEM(keyv));
+    ASSERT_TRUE(kvdb_ctxn_spilled(handle));
+    ASSERT_EQ(2, ctxn->ctxn_spillc);
+
+    /* Every value is found, wherever it was spilled. */
+    for (i = 0; i < n; i++) {
+        kvs_ktuple_init(&kt, &keyv[i], sizeof(keyv[i]));
+        kt.kt_hash = 0;
+        kvs_buf_init(&vbuf, buf, sizeof(buf));
+
+        err = kvdb_ctxn_get(handle, NULL, NULL, &kt, &res, &vbuf);
+        ASSERT_EQ(0, err);
+        ASSERT_EQ(FOUND_VAL, res);
+        ASSERT_EQ(HSE_KVS_VLEN_MAX, vbuf.b_len);
+        ASSERT_EQ((char)i, buf[0]);
+    }
+
+    /* Abort drops the spilled kvmses. */
+    kvdb_ctxn_abort(handle);
+    ASSERT_EQ(0, ctxn->ctxn_spillc);
+    ASSERT_FALSE(kvdb_ctxn_spilled(handle));
+    ASSERT_TRUE(HSE_SQNREF_ABORTED_P(ctxn->ctxn_seqref));
+    kvdb_ctxn_free(handle);
+
+    /* Commit flushes the spilled kvms, then the current one. */
+    handle = kvdb_ctxn_alloc(klock, &kvdb_seq, kvdb_ctxn_set, acs, NULL);
+    ASSERT_NE(NULL, handle);
+    ctxn = kvdb_ctxn_h2r(handle);
+    ctxn->ctxn_spill_max = 2;
+
+    err = kvdb_ctxn_begin(handle);
+    ASSERT_EQ(0, err);
+
+    n = spill_fill(lcl_ti, handle, keyv, nospill + nospill / 2);
+    ASSERT_EQ(nospill + nospill / 2, n);
+    ASSERT_EQ(1, ctxn->ctxn_spillc);
+
+    g_flush_cnt = 0;
+    g_flush_reserved_seqno = 1;
+    g_flush_retcode = 0;
+    MOCK_SET(c0sk, _c0sk_flush);
+
+    err = kvdb_ctxn_commit(handle);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2, g_flush_cnt);
+    ASSERT_EQ(0, ctxn->ctxn_spillc);
+    ASSERT_FALSE(kvdb_ctxn_spilled(handle));
+    ASSERT_TRUE(HSE_SQNREF_ORDNL_P(ctxn->ctxn_seqref));
+    ASSERT_EQ(KVDB_CTXN_COMMITTED, kvdb_ctxn_get_state(handle));
+
+    MOCK_UNSET(c0sk, _c0sk_flush);
+
+    kvdb_ctxn_free(handle);
+    kvdb_ctxn_set_destroy(kvdb_ctxn_set);
+
+    active_ctxn_set_destroy(acs);
+    kvdb_keylock_destroy(klock);
+}
+
 MTF_END_UTEST_COLLECTION(kvdb_ctxn_test);
@@ -148,6 +148,9 @@ test_pre(struct mtf_test_info *ti)
     mapi_inject(mapi_idx_cn_get_tree, 0);
 
     mapi_inject(mapi_idx_cndb_replay, 0);
+    mapi_inject(mapi_idx_cndb_replay_recs, 0);
+
+    mapi_inject(mapi_idx_cndb_cn_dropped, 0);
     mapi_inject(mapi_idx_cndb_cn_make, 0);
 
     mapi_inject(mapi_idx_kvset_get_num_kblocks, 1);
@@ -698,4 +701,22 @@ MTF_DEFINE_UTEST_PREPOST(kvdb_rest, kvdb_compact_test, test_pre, test_post)
     ASSERT_EQ(0, err);
 }
 
+MTF_DEFINE_UTEST_PREPOST(kvdb_rest, startup_test, test_pre, test_post)
+{
+    char   path[128];
+    char   buf[4096] = { 0 };
+    merr_t err;
+
+    snprintf(path, sizeof(path), "mpool/%s/startup", MP);
+
+    err = curl_get(path, sock, buf, sizeof(buf));
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, strncmp(buf, "phases:\n", 8));
+    ASSERT_NE(NULL, strstr(buf, "  cndb_replay:\n    us: "));
+    ASSERT_NE(NULL, strstr(buf, "  kvs_open:\n    us: "));
+
+    /* Two kvses were opened, see test_pre(). */
+    ASSERT_NE(NULL, strstr(buf, "    kvses: 2\n  c0_flush:"));
+}
+
 MTF_END_UTEST_COLLECTION(kvdb_rest)
@@ -42,6 +42,8 @@ general_pre(struct mtf_test_info *ti)
     mapi_inject(mapi_idx_kvdb_log_done, 0);
     mapi_inject(mapi_idx_kvdb_log_abort, 0);
     mapi_inject(mapi_idx_cndb_replay, 0);
+    mapi_inject(mapi_idx_cndb_replay_recs, 0);
+    mapi_inject(mapi_idx_cndb_cn_dropped, 0);
     mapi_inject(mapi_idx_cndb_cn_drop, 0);
 
     mapi_inject_ptr(mapi_idx_cndb_cn_cparams, &cp);
@@ -143,6 +143,12 @@ _c0_hash_get(struct c0 *handle)
     return m0 ? m0->hash : -1;
 }
 
+static u32
+_c0_get_sfx_len(struct c0 *handle)
+{
+    return 0;
+}
+
 static merr_t
 _c0_cursor_create(
     struct c0 *            handle,
@@ -411,6 +417,8 @@ _cn_cursor_create(
     struct cn *            cn,
     u64                    seqno,
     bool                   reverse,
+    bool                   keys_only,
+    bool                   direct,
     const void *           prefix,
     u32                    pfx_len,
     struct cursor_summary *summary,
@@ -533,6 +541,11 @@ _cn_cursor_active_kvsets(void *cursor, u32 *active, u32 *total)
     return 0;
 }
 
+static void
+_cn_cursor_pred(void *cursor, kvs_pred_fn *keyfn, kvs_pred_fn *valfn, void *arg)
+{
+}
+
 static merr_t
 _kvdb_log_replay(
     struct kvdb_log *log,
@@ -575,7 +588,11 @@ mock_cn_set()
     mapi_inject(mapi_idx_cn_make, 0);
     mapi_inject(mapi_idx_cn_ingestv, 0);
     mapi_inject(mapi_idx_cn_get_sfx_len, 0);
+    mapi_inject(mapi_idx_cn_get_ingest_dgen, 0);
+    mapi_inject(mapi_idx_cn_get_cfilter_gen, 0);
+    mapi_inject(mapi_idx_cn_get_ingest_seqno, 0);
     mapi_inject(mapi_idx_cn_periodic, 0);
+    mapi_inject(mapi_idx_cn_open_stats_get, 0);
 
     cp.cp_fanout = 8;
     mapi_inject_ptr(mapi_idx_cn_get_cparams, &cp);
@@ -597,6 +614,7 @@ mock_cn_set()
     MOCK_SET(cn_cursor, _cn_cursor_seek);
     MOCK_SET(cn_cursor, _cn_cursor_destroy);
     MOCK_SET(cn_cursor, _cn_cursor_active_kvsets);
+    MOCK_SET(cn_cursor, _cn_cursor_pred);
 }
 
 void
@@ -605,7 +623,11 @@ mock_cn_unset()
     mapi_inject_unset(mapi_idx_cn_make);
     mapi_inject_unset(mapi_idx_cn_ingestv);
     mapi_inject_unset(mapi_idx_cn_get_sfx_len);
+    mapi_inject_unset(mapi_idx_cn_get_ingest_dgen);
+    mapi_inject_unset(mapi_idx_cn_get_cfilter_gen);
+    mapi_inject_unset(mapi_idx_cn_get_ingest_seqno);
     mapi_inject_unset(mapi_idx_cn_periodic);
+    mapi_inject_unset(mapi_idx_cn_open_stats_get);
 
     mock_kvset_builder_unset();
 
@@ -624,6 +646,7 @@ mock_cn_unset()
     MOCK_UNSET(cn_cursor, _cn_cursor_seek);
     MOCK_UNSET(cn_cursor, _cn_cursor_destroy);
     MOCK_UNSET(cn_cursor, _cn_cursor_active_kvsets);
+    MOCK_UNSET(cn_cursor, _cn_cursor_pred);
 }
 
 void
@@ -633,6 +656,7 @@ mock_c0_set()
     MOCK_SET(c0, _c0_close);
     MOCK_SET(c0, _c0_index);
     MOCK_SET(c0, _c0_hash_get);
+    MOCK_SET(c0, _c0_get_sfx_len);
     MOCK_SET(c0, _c0_put);
     MOCK_SET(c0, _c0_get);
     MOCK_SET(c0, _c0_del);
@@ -653,6 +677,7 @@ mock_c0_unset()
     MOCK_UNSET(c0, _c0_close);
     MOCK_UNSET(c0, _c0_index);
     MOCK_UNSET(c0, _c0_hash_get);
+    MOCK_UNSET(c0, _c0_get_sfx_len);
     MOCK_UNSET(c0, _c0_put);
     MOCK_UNSET(c0, _c0_get);
     MOCK_UNSET(c0, _c0_del);
@@ -697,6 +722,7 @@ mock_kvdb_log_set()
 #endif
     mapi_inject(mapi_idx_cndb_make, 0);
     mapi_inject(mapi_idx_cndb_replay, 0);
+    mapi_inject(mapi_idx_cndb_replay_recs, 0);
 
     mapi_inject_unset(mapi_idx_kvdb_log_replay);
     MOCK_SET(kvdb_log, _kvdb_log_replay);
@@ -719,6 +745,7 @@ mock_kvdb_log_unset()
 #endif
     mapi_inject_unset(mapi_idx_cndb_make);
     mapi_inject_unset(mapi_idx_cndb_replay);
+    mapi_inject_unset(mapi_idx_cndb_replay_recs);
 
     MOCK_UNSET(kvdb_log, _kvdb_log_replay);
 }
@@ -732,6 +759,9 @@ mock_cndb_set()
     mapi_inject(mapi_idx_cndb_open, 0);
     mapi_inject(mapi_idx_cndb_close, 0);
     mapi_inject(mapi_idx_cndb_replay, 0);
+    mapi_inject(mapi_idx_cndb_replay_recs, 0);
+    mapi_inject(mapi_idx_cndb_cn_dropped, 0);
+    mapi_inject(mapi_idx_cndb_cn_purge, 0);
 
     mapi_inject(mapi_idx_cndb_txn_start, 0);
     mapi_inject(mapi_idx_cndb_txn_txc, 0);
@@ -755,6 +785,9 @@ mock_cndb_unset()
     mapi_inject_unset(mapi_idx_cndb_open);
     mapi_inject_unset(mapi_idx_cndb_close);
     mapi_inject_unset(mapi_idx_cndb_replay);
+    mapi_inject_unset(mapi_idx_cndb_replay_recs);
+    mapi_inject_unset(mapi_idx_cndb_cn_dropped);
+    mapi_inject_unset(mapi_idx_cndb_cn_purge);
 
     mapi_inject_unset(mapi_idx_cndb_txn_start);
     mapi_inject_unset(mapi_idx_cndb_txn_txc);
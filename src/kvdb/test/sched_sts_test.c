@@ -3,6 +3,8 @@
  * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
  */
 
+#define _GNU_SOURCE /* for pthread_getaffinity_np() */
+
 #include <hse_ut/framework.h>
 #include <hse_test_support/mock_api.h>
 #include <hse_test_support/mwc_rand.h>
@@ -10,6 +12,10 @@
 
 #include <hse_util/platform.h>
 
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
 #include <hse_ikvdb/kvdb_rparams.h>
 #include <hse_ikvdb/sched_sts.h>
 #include <hse_ikvdb/csched_rp.h>
@@ -518,6 +524,149 @@ MTF_DEFINE_UTEST_PRE(test, t_sts_pause, pre_test)
  *   - with or without destroy method
  *   - many fast jobs or few slow jobs
  */
+struct isolate_job {
+    struct sts_job sts_job;
+    atomic_t       done;
+    int            cpuc;
+    bool           cpu0;
+    int            nice;
+};
+
+static void
+isolate_handler(struct sts_job *sj)
+{
+    struct isolate_job *job = container_of(sj, struct isolate_job, sts_job);
+    cpu_set_t           cpus;
+
+    CPU_ZERO(&cpus);
+    if (!pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+        job->cpuc = CPU_COUNT(&cpus);
+        job->cpu0 = CPU_ISSET(0, &cpus);
+    }
+
+    job->nice = getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+    atomic_set(&job->done, 1);
+}
+
+/* Workers run on the cpus and at the nice value given by the rparams.
+ */
+MTF_DEFINE_UTEST_PRE(test, t_sts_isolate, pre_test)
+{
+    struct isolate_job job = {};
+    struct sts *       s;
+    merr_t             err;
+
+    rp->csched_qthreads = 0x01;
+    rp->csched_cpus = 0x1;
+    rp->csched_nice = 5;
+
+    err = test_sts_create("iso", 1, &s);
+    ASSERT_EQ(err, 0);
+
+    sts_job_init(&job.sts_job, isolate_handler, 0, 0, 0);
+    sts_job_submit(s, &job.sts_job);
+
+    err = atomic_read_timeout(&job.done, 1, 5 * 1000 * 1000);
+    ASSERT_EQ(err, 0);
+
+    ASSERT_EQ(job.cpuc, 1);
+    ASSERT_TRUE(job.cpu0);
+    ASSERT_EQ(job.nice, 5);
+
+    sts_destroy(s);
+}
+
+/* Idle workers steal jobs from more urgent queues, never from less
+ * urgent ones.
+ */
+MTF_DEFINE_UTEST_PRE(test, t_sts_steal, pre_test)
+{
+    struct job  j[4];
+    struct sts *s;
+    atomic_t    v0, v1;
+    merr_t      err;
+
+    rp->csched_qthreads = 0x0101;
+
+    err = test_sts_create("steal", 2, &s);
+    ASSERT_EQ(err, 0);
+
+    atomic_set(&v0, 0);
+    atomic_set(&v1, 0);
+
+    /* Block the worker of queue 0, its next job is stolen by the
+     * worker of queue 1.
+     */
+    jsubmit(s, jinit(&j[0], 0, 0, &v0, 1, 1));
+    while (!j[0].tid)
+        msleep(10);
+
+    jsubmit(s, jinit(&j[1], 0, 0, &v0, 0, 1));
+
+    err = atomic_read_timeout(&v0, 2, 5 * 1000 * 1000);
+    ASSERT_EQ(err, 0);
+    ASSERT_FALSE(pthread_equal(j[0].tid, j[1].tid));
+
+    /* Block the worker of queue 1, the worker of queue 0 leaves
+     * its next job alone.
+     */
+    jsubmit(s, jinit(&j[2], 1, 0, &v1, 1, 1));
+    while (!j[2].tid)
+        msleep(10);
+
+    jsubmit(s, jinit(&j[3], 1, 0, &v1, 0, 1));
+
+    msleep(200);
+    ASSERT_EQ(atomic_read(&v1), 0);
+
+    atomic_set(&v1, 1);
+
+    err = atomic_read_timeout(&v1, 3, 5 * 1000 * 1000);
+    ASSERT_EQ(err, 0);
+    ASSERT_TRUE(pthread_equal(j[2].tid, j[3].tid));
+
+    sts_destroy(s);
+}
+
+/* A queued job can be run on the calling thread.
+ */
+MTF_DEFINE_UTEST_PRE(test, t_sts_assist, pre_test)
+{
+    struct job  j;
+    struct sts *s;
+    atomic_t    v;
+    merr_t      err;
+    bool        ran;
+
+    /* No workers, so jobs stay queued until assisted. */
+    rp->csched_qthreads = 0;
+
+    err = sts_create(rp, "assist", 2, &s);
+    ASSERT_EQ(err, 0);
+
+    atomic_set(&v, 0);
+    jsubmit(s, jinit(&j, 1, 0, &v, 0, 1));
+
+    /* Not while paused, nor from an empty queue. */
+    ran = sts_job_assist(s, 1);
+    ASSERT_FALSE(ran);
+
+    sts_resume(s);
+
+    ran = sts_job_assist(s, 0);
+    ASSERT_FALSE(ran);
+
+    ran = sts_job_assist(s, 1);
+    ASSERT_TRUE(ran);
+    ASSERT_EQ(atomic_read(&v), 1);
+    ASSERT_TRUE(pthread_equal(j.tid, pthread_self()));
+
+    ran = sts_job_assist(s, 1);
+    ASSERT_FALSE(ran);
+
+    sts_destroy(s);
+}
+
 MTF_DEFINE_UTEST_PRE(test, t_sts_destroy, pre_test)
 {
     sts_destroy(0);
@@ -22,12 +22,23 @@ const int               sc = THROTTLE_SENSOR_CNT;
 struct throttle_sensor *sv[THROTTLE_SENSOR_CNT];
 struct kvdb_rparams     kvdb_rp;
 
+/* Most tests cover the sleep throttle rather than the rate controller. */
+static struct kvdb_rparams
+sleep_rparams(void)
+{
+    struct kvdb_rparams rp = kvdb_rparams_defaults();
+
+    rp.throttle_rate_ctl = 0;
+
+    return rp;
+}
+
 void
 init(void)
 {
     int i;
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
 
     t = &throttlebuf;
     throttle_init(t, &kvdb_rp);
@@ -59,7 +70,7 @@ MTF_DEFINE_UTEST_PRE(test, t_init, pre_test)
     throttle_perfc_fini();
 
     for (i = 0; i <= 1; i++) {
-        kvdb_rp = kvdb_rparams_defaults();
+        kvdb_rp = sleep_rparams();
 
         if (i == 1) {
             mapi_inject(mapi_idx_perfc_ctrseti_alloc, -1);
@@ -88,7 +99,7 @@ MTF_DEFINE_UTEST_PRE(test, t_basic, pre_test)
 {
     int i, sval;
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
 
     t = &throttlebuf;
     throttle_init(t, &kvdb_rp);
@@ -128,7 +139,7 @@ MTF_DEFINE_UTEST_PRE(test, t_dur_params, pre_test)
 {
     int i, sval;
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
     kvdb_rp.dur_throttle_lo_th = kvdb_rp.dur_throttle_hi_th = 50;
 
     t = &throttlebuf;
@@ -153,7 +164,7 @@ MTF_DEFINE_UTEST_PRE(test, t_dur_params, pre_test)
 
     throttle_fini(t);
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
     kvdb_rp.dur_throttle_enable = 0;
 
     throttle_init(t, &kvdb_rp);
@@ -173,7 +184,7 @@ MTF_DEFINE_UTEST_PRE(test, t_dur_params, pre_test)
 
     throttle_fini(t);
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
     kvdb_rp.dur_throttle_lo_th = 0;
 
     throttle_init(t, &kvdb_rp);
@@ -193,7 +204,7 @@ MTF_DEFINE_UTEST_PRE(test, t_dur_params, pre_test)
 
     throttle_fini(t);
 
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
     kvdb_rp.throttle_disable = 1;
 
     throttle_init(t, &kvdb_rp);
@@ -205,7 +216,7 @@ MTF_DEFINE_UTEST_PRE(test, t_dur_params, pre_test)
     throttle_fini(t);
 
     /* Set a slow throttle update rate */
-    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp = sleep_rparams();
     kvdb_rp.throttle_update_ns = 1000000UL * 5000UL;
 
     throttle_init(t, &kvdb_rp);
@@ -333,4 +344,143 @@ MTF_DEFINE_UTEST_PRE(test, t_coverage, pre_test)
     ASSERT_EQ(0, delay);
 }
 
+MTF_DEFINE_UTEST_PRE(test, t_rate, pre_test)
+{
+    u64  rate, prev;
+    long delay;
+    int  i;
+
+    kvdb_rp = kvdb_rparams_defaults();
+
+    t = &throttlebuf;
+    throttle_init(t, &kvdb_rp);
+    throttle_init_params(t, &kvdb_rp);
+
+    for (i = 0; i < sc; i++)
+        sv[i] = throttle_sensor(t, i);
+
+    /* The demand is measured on every put, but not paced at first. */
+    ASSERT_EQ(throttle_active(t), true);
+    ASSERT_EQ(throttle_delay(t), 0);
+    ASSERT_EQ(throttle(t, get_time_ns(), KMIN), 0);
+
+    /* Pacing starts once the sensors cross the set point. */
+    throttle_sensor_set(sv[THROTTLE_SENSOR_C0SK], 2 * THROTTLE_SENSOR_SCALE);
+    for (i = 0; i < 10 && !atomic64_read(&t->thr_rate); i++) {
+        atomic64_add(1ul << 30, &t->thr_rate_bytes);
+        throttle_update(t);
+    }
+
+    rate = atomic64_read(&t->thr_rate);
+    ASSERT_GT(rate, 0);
+
+    /* Saturated sensors steadily drive the rate down to its floor. */
+    for (i = 0; i < 1000; i++) {
+        prev = rate;
+        atomic64_add(1ul << 30, &t->thr_rate_bytes);
+        throttle_update(t);
+
+        rate = atomic64_read(&t->thr_rate);
+        ASSERT_LE(rate, prev);
+    }
+
+    ASSERT_EQ(rate, THROTTLE_RATE_MIN);
+    ASSERT_EQ(throttle_delay(t), NSEC_PER_SEC * 1024 / THROTTLE_RATE_MIN);
+
+    /* Puts beyond the burst are delayed. */
+    delay = throttle(t, get_time_ns(), 128 * 1024);
+    ASSERT_GT(delay, 0);
+
+    /* Low sensors let the rate recover... */
+    throttle_sensor_set(sv[THROTTLE_SENSOR_C0SK], 0);
+    for (i = 0; i < 20; i++) {
+        atomic64_add(1ul << 30, &t->thr_rate_bytes);
+        throttle_update(t);
+    }
+
+    ASSERT_GT(atomic64_read(&t->thr_rate), THROTTLE_RATE_MIN);
+
+    /* ...and pacing stops once the rate idles. */
+    for (i = 0; i < THROTTLE_RATE_RELEASE_CYCLES; i++)
+        throttle_update(t);
+
+    ASSERT_EQ(atomic64_read(&t->thr_rate), 0);
+    ASSERT_EQ(throttle_delay(t), 0);
+
+    throttle_fini(t);
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_tenant, pre_test)
+{
+    struct tbkt tb, floor;
+
+    kvdb_rp = kvdb_rparams_defaults();
+
+    t = &throttlebuf;
+    throttle_init(t, &kvdb_rp);
+    throttle_init_params(t, &kvdb_rp);
+
+    tbkt_init(&tb, 0, THROTTLE_RATE_MIN);
+    tbkt_init(&floor, 1 << 20, 1 << 20);
+
+    /* Tenants are not paced until the kvdb is. */
+    ASSERT_EQ(0, throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, NULL));
+
+    atomic64_set(&t->thr_rate, THROTTLE_RATE_MIN);
+
+    /* The floor lets a tenant through beyond its share... */
+    ASSERT_EQ(0, throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, &floor));
+
+    /* ...otherwise the share paces it. */
+    ASSERT_GT(throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, NULL), 0);
+
+    throttle_fini(t);
+}
+
+static int  assist_calls;
+static bool assist_work;
+
+static bool
+assist(void *arg)
+{
+    assist_calls++;
+
+    return assist_work;
+}
+
+MTF_DEFINE_UTEST_PRE(test, t_assist, pre_test)
+{
+    struct tbkt tb;
+
+    kvdb_rp = kvdb_rparams_defaults();
+    kvdb_rp.throttle_assist_us = 1;
+
+    t = &throttlebuf;
+    throttle_init(t, &kvdb_rp);
+    throttle_init_params(t, &kvdb_rp);
+    throttle_assist_set(t, assist, NULL);
+
+    atomic64_set(&t->thr_rate, THROTTLE_RATE_MIN);
+    tbkt_init(&tb, 0, THROTTLE_RATE_MIN);
+
+    /* A paced writer runs queued work instead of sleeping... */
+    assist_calls = 0;
+    assist_work = true;
+    ASSERT_GT(throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, NULL), 0);
+    ASSERT_EQ(1, assist_calls);
+
+    /* ...and sleeps if there is none. */
+    assist_work = false;
+    ASSERT_GT(throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, NULL), 0);
+    ASSERT_EQ(2, assist_calls);
+
+    /* Delays shorter than throttle_assist_us are just slept. */
+    t->thr_assist_ns = NSEC_PER_SEC;
+    ASSERT_GT(throttle_tenant(t, get_time_ns(), 128 * 1024, &tb, NULL), 0);
+    ASSERT_EQ(2, assist_calls);
+
+    throttle_assist_set(t, NULL, NULL);
+    throttle_fini(t);
+}
+
 MTF_END_UTEST_COLLECTION(test);
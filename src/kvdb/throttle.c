@@ -9,12 +9,14 @@
 #include <hse_util/logging.h>
 #include <hse_util/delay.h>
 #include <hse_util/perfc.h>
+#include <hse_util/usdt.h>
 
 #include <hse_ikvdb/throttle.h>
 #include <hse_ikvdb/throttle_perfc.h>
 #include <hse_ikvdb/ikvdb.h>
 #include <hse_ikvdb/kvdb_rparams.h>
 #include <hse_ikvdb/rparam_debug_flags.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include <hse/kvdb_perfc.h>
 
@@ -159,6 +161,18 @@ throttle_init_params(struct throttle *self, struct kvdb_rparams *rp)
     self->thr_state = THROTTLE_NO_CHANGE;
     self->thr_update_ms = rp->throttle_update_ns / 1000000;
 
+    self->thr_rate_ctl = rp->throttle_rate_ctl;
+    self->thr_assist_ns = rp->throttle_assist_us * 1000;
+    self->thr_nslpmin = rp->throttle_sleep_min_ns;
+    self->thr_rate_last = get_time_ns();
+    atomic64_set(&self->thr_rate, 0);
+    atomic64_set(&self->thr_rate_bytes, 0);
+    tbkt_init(&self->thr_rate_tb, 0, 0);
+
+    /* The rate controller starts unthrottled. */
+    if (self->thr_rate_ctl)
+        self->thr_delay_raw = 0;
+
     self->thr_inject_cycles = THROTTLE_INJECT_MS / self->thr_update_ms +
                               (THROTTLE_INJECT_MS % self->thr_update_ms ? 1 : 0);
 
@@ -185,8 +199,9 @@ throttle_init_params(struct throttle *self, struct kvdb_rparams *rp)
         time_ms / self->thr_update_ms + (time_ms % self->thr_update_ms ? 1 : 0);
 
     hse_log(
-        HSE_NOTICE "throttle init: delay %d u_ms %d rcycles %d"
+        HSE_NOTICE "throttle init: rate_ctl %u delay %d u_ms %d rcycles %d"
                    " icycles %d scycles %d dcycles %d",
+        self->thr_rate_ctl,
         self->thr_delay_raw,
         self->thr_update_ms,
         self->thr_reduce_cycles,
@@ -403,13 +418,13 @@ throttle_switch_state(struct throttle *self, enum throttle_state state, uint max
     }
 }
 
-void
-throttle_update(struct throttle *self)
+/* Read the sensors, returns the max of those that drive the throttle.
+ */
+static uint
+throttle_sensors(struct throttle *self)
 {
-    struct throttle_mavg *mavg = &self->thr_mavg;
-    uint                  max_val = 0;
-    int                   i, diff;
-    ulong                 debug = self->thr_rp->throttle_debug;
+    uint max_val = 0;
+    int  i;
 
     for (i = 0; i < THROTTLE_SENSOR_CNT; i++) {
         uint tmp = atomic_read(&self->thr_sensorv[i].ts_sensor);
@@ -445,6 +460,18 @@ throttle_update(struct throttle *self)
 
     perfc_rec_sample(&self->thr_sensor_perfc, PERFC_DI_THSR_MAX, max_val);
 
+    return max_val;
+}
+
+/* Adjust the sleep per put from the moving average of the sensors.
+ */
+static void
+throttle_sleep_update(struct throttle *self, uint max_val)
+{
+    struct throttle_mavg *mavg = &self->thr_mavg;
+    int                   diff;
+    ulong                 debug = self->thr_rp->throttle_debug;
+
     if (self->thr_skip_cnt > 0) {
         /*
          * Skip the read sensor values for thr_skip_cnt cycles.
@@ -559,8 +586,105 @@ throttle_update(struct throttle *self)
             }
         }
     }
+}
+
+/* Adjust the admitted put rate from the sensors.
+ *
+ * A PID controller in velocity form steers the filtered max sensor value
+ * to THROTTLE_RATE_SETPOINT.  Its output is a relative change of the rate,
+ * so that the gains hold whatever the rate, and it is limited to
+ * THROTTLE_RATE_STEP_MAX per-mille per update.  The velocity form keeps
+ * no integral to wind up, and the rate is further capped at twice the
+ * demand measured over the last update, so that the rate never runs away
+ * from writers that do not use it.  Pacing starts at the demand when the
+ * sensors cross the set point, and stops once the sensors are low and the
+ * cap has held the rate for THROTTLE_RATE_RELEASE_CYCLES updates.
+ */
+static void
+throttle_rate_update(struct throttle *self, uint max_val)
+{
+    u64  now, dt, bytes, demand, rate, cap;
+    long err, delta, step;
+    bool slack;
+
+    now = get_time_ns();
+    dt = now - self->thr_rate_last;
+    self->thr_rate_last = now;
+
+    bytes = atomic64_read(&self->thr_rate_bytes);
+    atomic64_sub(bytes, &self->thr_rate_bytes);
+    demand = dt ? bytes * NSEC_PER_SEC / dt : 0;
+
+    /* Smooth out sensor noise, mostly for the derivative term. */
+    self->thr_rate_meas = (3 * self->thr_rate_meas + max_val) / 4;
+
+    err = (long)self->thr_rate_meas - THROTTLE_RATE_SETPOINT;
+
+    rate = atomic64_read(&self->thr_rate);
+    if (!rate) {
+        if (err < 0)
+            return;
+
+        rate = max_t(u64, demand, THROTTLE_RATE_MIN);
+
+        self->thr_rate_err[0] = self->thr_rate_err[1] = err;
+        self->thr_rate_calm = 0;
+
+        tbkt_reinit(&self->thr_rate_tb, throttle_rate_burst(rate), rate);
+        atomic64_set(&self->thr_rate, rate);
+        return;
+    }
+
+    delta = THROTTLE_RATE_KP * (err - self->thr_rate_err[0]) + THROTTLE_RATE_KI * err +
+            THROTTLE_RATE_KD * (err - 2 * self->thr_rate_err[0] + self->thr_rate_err[1]);
+
+    self->thr_rate_err[1] = self->thr_rate_err[0];
+    self->thr_rate_err[0] = err;
+
+    step = -delta / THROTTLE_RATE_GAIN_DIV;
+    step = clamp_t(long, step, -THROTTLE_RATE_STEP_MAX, THROTTLE_RATE_STEP_MAX);
+
+    rate = rate * (1000 + step) / 1000;
+
+    cap = max_t(u64, 2 * demand, THROTTLE_RATE_MIN);
+    slack = rate >= cap;
+    rate = clamp_t(u64, rate, THROTTLE_RATE_MIN, cap);
+
+    if (slack && self->thr_rate_meas < THROTTLE_RATE_RELEASE) {
+        if (++self->thr_rate_calm >= THROTTLE_RATE_RELEASE_CYCLES) {
+            atomic64_set(&self->thr_rate, 0);
+            return;
+        }
+    } else {
+        self->thr_rate_calm = 0;
+    }
+
+    tbkt_adjust(&self->thr_rate_tb, throttle_rate_burst(rate), rate);
+    atomic64_set(&self->thr_rate, rate);
+}
+
+void
+throttle_update(struct throttle *self)
+{
+    uint  max_val;
+    ulong debug = self->thr_rp->throttle_debug;
+
+    max_val = throttle_sensors(self);
+
+    if (self->thr_rate_ctl) {
+        u64 rate;
+
+        throttle_rate_update(self, max_val);
+
+        /* Report the rate as the equivalent sleep per KiB. */
+        rate = atomic64_read(&self->thr_rate);
+        self->thr_delay_raw = rate ? max_t(u64, NSEC_PER_SEC * 1024 / rate, 1) : 0;
+    } else {
+        throttle_sleep_update(self, max_val);
+    }
 
     perfc_rec_sample(&self->thr_sleep_perfc, PERFC_DI_THR_SVAL, self->thr_delay_raw);
+    atomic_set(&kvs_flight_env.kfe_throttle, self->thr_delay_raw);
 
     if (debug & THROTTLE_DEBUG_DELAYV) {
         if (self->thr_cycles % 24000 == 0)
@@ -572,9 +696,10 @@ void
 throttle_debug(struct throttle *self)
 {
     hse_log(
-        HSE_NOTICE "throttle: delay %d min %d mavg %d cnt %d state %d"
+        HSE_NOTICE "throttle: delay %d rate %lu min %d mavg %d cnt %d state %d"
                    " sensors %d %d %d",
         self->thr_delay_raw,
+        (ulong)atomic64_read(&self->thr_rate),
         self->thr_delay_min,
         self->thr_mavg.tm_curr,
         self->thr_monitor_cnt,
@@ -584,6 +709,49 @@ throttle_debug(struct throttle *self)
         atomic_read(&self->thr_sensorv[2].ts_sensor));
 }
 
+/* Pace a put by @tb, which runs at the rate set by throttle_rate_update()
+ * or at a share of it.  The token bucket carries a deficit over to later
+ * puts, so sleeps shorter than the fixed overhead of nanosleep() are
+ * skipped without skewing the rate.
+ */
+static long
+throttle_pace(struct throttle *self, u32 len, struct tbkt *tb, struct tbkt *floor)
+{
+    long elapsed, now;
+    u64  delay;
+
+    atomic64_add(len, &self->thr_rate_bytes);
+
+    if (!atomic64_read(&self->thr_rate))
+        return 0;
+
+    delay = tbkt_request_floor(tb, floor, len);
+    if (delay <= self->thr_nslpmin)
+        return 0;
+
+    delay = min_t(u64, delay - self->thr_nslpmin, NSEC_PER_SEC - 1);
+
+    now = get_time_ns();
+
+    /* Rather than sleep through a long delay, spend it on the queued
+     * compaction work that is holding the rate down.  The work may take
+     * longer than the delay, its excess is simply not slept.
+     */
+    if (self->thr_assist && self->thr_assist_ns && delay >= self->thr_assist_ns &&
+        self->thr_assist(self->thr_assist_arg)) {
+        elapsed = get_time_ns() - now;
+        if (elapsed < delay)
+            tbkt_delay(delay - elapsed);
+    } else {
+        tbkt_delay(delay);
+    }
+
+    elapsed = get_time_ns() - now;
+    HSE_USDT(throttle_sleep, delay, elapsed);
+
+    return elapsed;
+}
+
 long
 throttle(struct throttle *self, u64 start, u32 len)
 {
@@ -593,6 +761,9 @@ throttle(struct throttle *self, u64 start, u32 len)
     u64  frac, calls, cycles;
     uint pct;
 
+    if (self->thr_rate_ctl)
+        return throttle_pace(self, len, &self->thr_rate_tb, NULL);
+
     target = (u64)self->thr_delay_raw * len / 1024;
 
     now = get_time_ns();
@@ -676,6 +847,7 @@ throttle(struct throttle *self, u64 start, u32 len)
      * as a percentage (scaled to 128).
      */
     elapsed = get_time_ns() - now;
+    HSE_USDT(throttle_sleep, delay, elapsed);
     frac = (delay * 128) / (elapsed | 1);
     if (frac > 128)
         frac = 128;
@@ -689,8 +861,28 @@ throttle(struct throttle *self, u64 start, u32 len)
     return elapsed;
 }
 
+void
+throttle_assist_set(struct throttle *self, throttle_assist_fn *fn, void *arg)
+{
+    self->thr_assist_arg = arg;
+    self->thr_assist = fn;
+}
+
+long
+throttle_tenant(struct throttle *self, u64 start, u32 len, struct tbkt *tb, struct tbkt *floor)
+{
+    if (!self->thr_rate_ctl)
+        return throttle(self, start, len);
+
+    return throttle_pace(self, len, tb, floor);
+}
+
 bool
 throttle_active(struct throttle *self)
 {
-    return (self->thr_rp->throttle_disable) ? false : (self->thr_delay_raw != 0);
+    if (self->thr_rp->throttle_disable)
+        return false;
+
+    /* The rate controller measures the demand on every put. */
+    return self->thr_rate_ctl || self->thr_delay_raw != 0;
 }
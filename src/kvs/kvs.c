@@ -17,6 +17,7 @@
 #include <hse_util/perfc.h>
 #include <hse_util/darray.h>
 #include <hse_util/timing.h>
+#include <hse_util/scratch.h>
 #include <hse_util/fmt.h>
 #include <hse_util/byteorder.h>
 #include <hse_util/slab.h>
@@ -32,8 +33,11 @@
 #include <hse_ikvdb/tuple.h>
 #include <hse_ikvdb/kvdb_health.h>
 #include <hse_ikvdb/cursor.h>
+#include <hse_ikvdb/kvdb_perfc.h>
+#include <hse_ikvdb/kvs_trace.h>
 
 #include "kvs_params.h"
+#include "kvs_vcache.h"
 
 struct mpool;
 
@@ -45,6 +49,20 @@ struct curcache {
     struct cache_bucket *cca_bkt_head;
 } __aligned(SMP_CACHE_BYTES);
 
+#define KVS_CURPOOL_MAX 16
+#define KVS_CURPOOL_SLOTS 4
+
+/* A curpool is a handful of cached cursors in front of the curcache,
+ * claimed and released with a cmpxchg on the slot's cursor ptr.  The
+ * tag and ttl words are hints for the lookup and the preen, and are
+ * allowed to be stale.
+ */
+struct curpool {
+    atomic64_t cp_tagv[KVS_CURPOOL_SLOTS];
+    atomic64_t cp_ttlv[KVS_CURPOOL_SLOTS];
+    atomic64_t cp_curv[KVS_CURPOOL_SLOTS];
+} __aligned(SMP_CACHE_BYTES);
+
 struct ikvs {
     uint             ikv_sfx_len;
     uint             ikv_pfx_len;
@@ -55,6 +73,15 @@ struct ikvs {
     struct perfc_set ikv_pkvsl_pc; /* Public kvs interfaces Lat. */
     struct perfc_set ikv_cc_pc;
     struct perfc_set ikv_cd_pc;
+    struct perfc_set ikv_vc_pc;
+
+    struct kvs_vcache *    ikv_vcache;
+    struct kvs_trace_ring *ikv_trace_ring;
+
+    /* non-zero while a bulk load is in progress, see ikvs_bulk_begin() */
+    atomic_t ikv_bulk;
+
+    struct curpool ikv_curpoolv[KVS_CURPOOL_MAX];
 
     __aligned(SMP_CACHE_BYTES) struct curcache ikv_curcachev[7];
     struct cache_bucket *ikv_curcache_bktmem;
@@ -99,7 +126,8 @@ struct perfc_name kvs_cc_perfc_op[] = {
     NE(PERFC_BA_CC_TOMB_SKIPLEN, 3, "Count of cursor c0 tombs skipped (len)", "c_c0_tombs_skipped"),
     NE(PERFC_BA_CC_TOMB_SPAN_ADD, 3, "Count of cursor c0 tombs added to span", "c_c0_tombs_add"),
     NE(PERFC_BA_CC_TOMB_SPAN_TIME, 3, "Tomb span build time since invalidate", "c_c0_tombspan_"
-                                                                               "time")
+                                                                               "time"),
+    NE(PERFC_BA_CC_RESTORE_POOL, 2, "Count of cursor restores from cpu pool", "c_restores_pool"),
 };
 
 NE_CHECK(kvs_cc_perfc_op, PERFC_EN_CC, "cursor cache perfc ops table/enum mismatch");
@@ -124,10 +152,22 @@ struct perfc_name kvs_cd_perfc_op[] = {
 
 NE_CHECK(kvs_cd_perfc_op, PERFC_EN_CD, "cursor dist perfc ops table/enum mismatch");
 
+struct perfc_name kvs_vc_perfc_op[] = {
+    NE(PERFC_BA_VC_HIT, 2, "Count of value cache hits", "v_hits"),
+    NE(PERFC_BA_VC_MISS, 2, "Count of value cache misses", "v_misses"),
+    NE(PERFC_BA_VC_INSERT, 3, "Count of value cache inserts", "v_inserts"),
+    NE(PERFC_BA_VC_EVICT, 3, "Count of value cache evictions", "v_evicts"),
+    NE(PERFC_BA_VC_INVAL, 3, "Count of value cache invalidates", "v_invals"),
+};
+
+NE_CHECK(kvs_vc_perfc_op, PERFC_EN_VC, "value cache perfc ops table/enum mismatch");
+
 /* "pkvsl" stands for Public KVS interface Latencies" */
 struct perfc_name kvs_pkvsl_perfc_op[] = {
     NE(PERFC_LT_PKVSL_KVS_PUT, 3, "kvs_put latency", "kvs_put_lat", 7),
     NE(PERFC_LT_PKVSL_KVS_GET, 3, "kvs_get latency", "kvs_get_lat", 7),
+    NE(PERFC_LT_PKVSL_KVS_GET_BATCH, 3, "kvs_get_batch latency", "kvs_get_batch_lat", 7),
+    NE(PERFC_LT_PKVSL_KVS_GET_LEASE, 3, "kvs_get_lease latency", "kvs_get_lease_lat", 7),
     NE(PERFC_LT_PKVSL_KVS_DEL, 3, "kvs_delete latency", "kvs_del_lat", 7),
 
     NE(PERFC_LT_PKVSL_KVS_PFX_PROBE, 3, "kvs_prefix_probe latency", "kvs_pfx_probe_lat"),
@@ -144,6 +184,10 @@ struct perfc_name kvs_pkvsl_perfc_op[] = {
        3,
        "kvs_cursor_read reverse latency",
        "kvs_cursor_readrev_lat"),
+    NE(PERFC_LT_PKVSL_KVS_CURSOR_READMANY,
+       3,
+       "kvs_cursor_read_many latency",
+       "kvs_cursor_readmany_lat"),
     NE(PERFC_LT_PKVSL_KVS_CURSOR_DESTROY,
        3,
        "kvs_cursor_destroy latency",
@@ -211,6 +255,9 @@ struct kvs_cursor_impl {
     u32                kci_seeklen;
     u32                kci_limit_len;
     void *             kci_limit;
+    kvs_pred_fn *      kci_pred_key;
+    kvs_pred_fn *      kci_pred_val;
+    void *             kci_pred_arg;
 
     struct kvs_kvtuple *kci_last; /* last tuple read */
     u8 *                kci_last_kbuf;
@@ -221,7 +268,10 @@ struct kvs_cursor_impl {
     u32 kci_seek : 2;
     u32 kci_peek : 1;
     u32 kci_reverse : 1;
-    u32 kci_unused : 15;
+    u32 kci_keys_only : 1;
+    u32 kci_direct : 1;
+    u32 kci_kfixed : 5;
+    u32 kci_unused : 8;
     u32 kci_pfx_len : 8;
 
     u64    kci_pfxhash;
@@ -242,6 +292,9 @@ kvs_destroy(struct ikvs *kvs);
 static void
 ikvs_cursor_reap(struct ikvs *kvs);
 
+static void
+ikvs_curpool_preen(struct ikvs *kvs, u64 now, uint *c0_retiredp, uint *cn_retiredp);
+
 void
 kvs_perfc_init(void)
 {
@@ -307,6 +360,10 @@ kvs_perfc_alloc(const char *mp_name, const char *kvs_name, struct ikvs *kvs)
             COMPNAME, dbname_buf, kvs_cd_perfc_op, PERFC_EN_CD, "set", &kvs->ikv_cd_pc))
         hse_log(HSE_ERR "cannot alloc kvs perf counters");
 
+    if (perfc_ctrseti_alloc(
+            COMPNAME, dbname_buf, kvs_vc_perfc_op, PERFC_EN_VC, "set", &kvs->ikv_vc_pc))
+        hse_log(HSE_ERR "cannot alloc kvs perf counters");
+
     /* Measure Public KVS interface Latencies */
     if (perfc_ctrseti_alloc(
             COMPNAME, dbname_buf, kvs_pkvsl_perfc_op, PERFC_EN_PKVSL, "set", &kvs->ikv_pkvsl_pc))
@@ -318,6 +375,7 @@ kvs_perfc_free(struct ikvs *ikvs)
 {
     perfc_ctrseti_free(&ikvs->ikv_cc_pc);
     perfc_ctrseti_free(&ikvs->ikv_cd_pc);
+    perfc_ctrseti_free(&ikvs->ikv_vc_pc);
     perfc_ctrseti_free(&ikvs->ikv_pkvsl_pc);
 }
 
@@ -331,6 +389,8 @@ kvs_perfc_free(struct ikvs *ikvs)
  *    kvs_create                 kvs_destroy
  *    cn_open                    cn_close
  *    c0_open                    c0_close
+ *    kvs_vcache_create          kvs_vcache_destroy
+ *    kvs_trace_ring_create      kvs_trace_ring_destroy
  *
  * [HSE_REVISIT]: Perhaps this arg list can be trimmed some ...
  */
@@ -396,10 +456,6 @@ kvs_open(
     ikvs->ikv_pfx_len = c0_get_pfx_len(ikvs->ikv_c0);
     ikvs->ikv_sfx_len = cn_get_sfx_len(ikvs->ikv_cn);
 
-    err = qctx_te_mem_init();
-    if (ev(err))
-        goto err_exit;
-
     ikvdb_get_c1(kvdb, &ikvs->ikv_c1);
 
     err = kvs_rparams_add_to_dt(mp_name, kvs_name, &ikvs->ikv_rp);
@@ -409,6 +465,26 @@ kvs_open(
 
     kvs_perfc_alloc(mp_name, kvs_name, ikvs);
 
+    /* Entries expire with wall time without any ingest to invalidate
+     * the value cache, so a kvs with a ttl does without it.
+     */
+    if (ikvs->ikv_rp.kvs_vcache_mb > 0 && !ikvs->ikv_rp.kvs_ttl) {
+        err = kvs_vcache_create(
+            ikvs->ikv_rp.kvs_vcache_mb << 20,
+            ikvs->ikv_rp.kvs_vcache_vmax,
+            &ikvs->ikv_vc_pc,
+            &ikvs->ikv_vcache);
+        if (ev(err)) {
+            kvs_perfc_free(ikvs);
+            goto err_exit;
+        }
+    }
+
+    /* Without a ring, traces are taken but not kept. */
+    err = kvs_trace_ring_create(&ikvs->ikv_trace_ring);
+    if (ev(err))
+        ikvs->ikv_trace_ring = NULL;
+
     kvdb_kvs_set_ikvs(kvs, ikvs);
 
     return 0;
@@ -469,6 +545,8 @@ kvs_close(struct ikvs *ikvs)
     if (err)
         hse_elog(HSE_ERR "%s: cn_close @@e", err, __func__);
 
+    kvs_vcache_destroy(ikvs->ikv_vcache);
+    kvs_trace_ring_destroy(ikvs->ikv_trace_ring);
     kvs_perfc_free(ikvs);
 
     err = kvs_rparams_remove_from_dt(ikvs->ikv_mpool_name, ikvs->ikv_kvs_name);
@@ -480,6 +558,27 @@ kvs_close(struct ikvs *ikvs)
     return err;
 }
 
+struct kvs_trace_ring *
+ikvs_trace_ring(struct ikvs *ikvs)
+{
+    return ikvs ? ikvs->ikv_trace_ring : NULL;
+}
+
+bool
+ikvs_trace_begin(struct ikvs *kvs, struct kvs_trace *trace, enum kvs_trace_op op)
+{
+    return kvs_trace_begin(
+        trace, op, kvs->ikv_rp.kvs_trace_sample, kvs->ikv_rp.kvs_flight_us * 1000);
+}
+
+void
+ikvs_trace_end(struct ikvs *kvs, struct kvs_trace *trace)
+{
+    trace->kt_cnid = cn_get_cnid(kvs->ikv_cn);
+
+    kvs_trace_end(trace, kvs->ikv_trace_ring, kvs->ikv_rp.kvs_flight_us * 1000);
+}
+
 struct perfc_set *
 ikvs_perfc_pkvsl(struct ikvs *ikvs)
 {
@@ -502,9 +601,12 @@ ikvs_put(
     struct c0 *c0 = kvs->ikv_c0;
     size_t     sfx_len;
     size_t     hashlen;
-    u64        tstart;
+    u64        tstart, sstart;
     merr_t     err;
 
+    if (ev(atomic_read(&kvs->ikv_bulk)))
+        return merr(EBUSY);
+
     tstart = perfc_lat_start(pkvsl_pc);
 
     sfx_len = kvs->ikv_sfx_len;
@@ -525,16 +627,234 @@ ikvs_put(
         return merr(EINVAL);
     }
 
+    sstart = kvs_trace_stage_start();
     if (unlikely(os && os->kop_txn))
         err = kvdb_ctxn_put(kvdb_ctxn_h2h(os->kop_txn), c0, kt, vt);
     else
         err = c0_put(c0, kt, vt, seqno);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
+
+    if (kvs->ikv_vcache)
+        kvs_vcache_invalidate(kvs->ikv_vcache, kt);
+
+    if (!err)
+        perfc_add(cn_get_amp_perfc(kvs->ikv_cn), PERFC_RA_CNAMP_UBYTES, kt->kt_len + vt->vt_len);
 
     perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_PUT, tstart);
 
     return err;
 }
 
+/* Merge within a txn by a get at the txn's view and a put of the result.
+ * The put fails with ECANCELED if another txn updated the key since the
+ * txn's view, so the result is never based on a stale value.
+ */
+static merr_t
+ikvs_merge_txn(
+    struct ikvs *            kvs,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn)
+{
+    enum key_lookup_res res;
+    struct kvs_vtuple   vt;
+    struct kvs_buf      vbuf;
+    const void *        bdata;
+    void *              buf = NULL, *result = NULL;
+    size_t              rlen, rmax = 0;
+    u32                 bufsz = 0;
+    merr_t              err;
+
+    while (1) {
+        kvs_buf_init(&vbuf, buf ?: (void *)-1, bufsz);
+
+        err = ikvs_get(kvs, os, kt, 0, &res, &vbuf);
+        if (ev(err))
+            goto out;
+
+        if (res != FOUND_VAL || vbuf.b_len <= bufsz)
+            break;
+
+        free(buf);
+        bufsz = vbuf.b_len;
+
+        buf = malloc(bufsz);
+        if (ev(!buf)) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+    }
+
+    bdata = NULL;
+    if (res == FOUND_VAL)
+        bdata = vbuf.b_len > 0 ? buf : "";
+
+    while (1) {
+        rlen = 0;
+        err = fn(kt->kt_data, kt->kt_len, bdata, bdata ? vbuf.b_len : 0, oper->vt_data,
+                 oper->vt_len, result, rmax, &rlen);
+        if (err || rlen <= rmax)
+            break;
+
+        if (ev(rlen > HSE_KVS_VLEN_MAX)) {
+            err = merr(EMSGSIZE);
+            goto out;
+        }
+
+        free(result);
+        rmax = rlen;
+
+        result = malloc(rmax);
+        if (ev(!result)) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+    }
+
+    if (!err) {
+        kvs_vtuple_init(&vt, result, rlen);
+
+        err = ikvs_put(kvs, os, kt, &vt, 0);
+    }
+
+out:
+    free(result);
+    free(buf);
+
+    return err;
+}
+
+merr_t
+kvs_patch_merge(
+    const void *key,
+    size_t      klen,
+    const void *base,
+    size_t      blen,
+    const void *oper,
+    size_t      olen,
+    void *      result,
+    size_t      rmax,
+    size_t *    rlen)
+{
+    const struct kvs_patch *patch = oper;
+    size_t                  off;
+
+    assert(olen == sizeof(*patch));
+
+    off = (patch->kp_off == KVS_PATCH_APPEND) ? blen : patch->kp_off;
+    if (ev(off > HSE_KVS_VLEN_MAX))
+        return merr(EMSGSIZE);
+
+    *rlen = max_t(size_t, blen, off + patch->kp_len);
+    if (*rlen > rmax)
+        return 0;
+
+    if (blen > 0)
+        memcpy(result, base, blen);
+    if (off > blen)
+        memset(result + blen, 0, off - blen);
+    memcpy(result + off, patch->kp_data, patch->kp_len);
+
+    return 0;
+}
+
+merr_t
+ikvs_merge(
+    struct ikvs *            kvs,
+    struct hse_kvdb_opspec * os,
+    struct kvs_ktuple *      kt,
+    const struct kvs_vtuple *oper,
+    kvs_merge_fn *           fn)
+{
+    size_t sfx_len;
+    merr_t err;
+
+    if (ev(atomic_read(&kvs->ikv_bulk)))
+        return merr(EBUSY);
+
+    sfx_len = kvs->ikv_sfx_len;
+
+    /* See ikvs_put() regarding keys in a suffixed kvs.
+     */
+    if (ev(sfx_len && kt->kt_len < sfx_len + kvs->ikv_pfx_len))
+        return merr(EINVAL);
+
+    if (os && os->kop_txn)
+        return ikvs_merge_txn(kvs, os, kt, oper, fn);
+
+    kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len - sfx_len);
+
+    err = c0_fold(kvs->ikv_c0, kt, oper, fn);
+
+    if (kvs->ikv_vcache)
+        kvs_vcache_invalidate(kvs->ikv_vcache, kt);
+
+    return err;
+}
+
+merr_t
+ikvs_wbatch_prep(struct ikvs *kvs, struct kvs_wbatch_op *op)
+{
+    struct kvs_ktuple *kt = &op->wbo_kt;
+    size_t             sfx_len;
+
+    if (ev(atomic_read(&kvs->ikv_bulk)))
+        return merr(EBUSY);
+
+    sfx_len = kvs->ikv_sfx_len;
+
+    /* See ikvs_put() regarding keys in a suffixed kvs.
+     */
+    if (ev(!op->wbo_tomb && sfx_len && kt->kt_len < sfx_len + kvs->ikv_pfx_len)) {
+        hse_log(
+            HSE_ERR "%s is a suffixed kvs. Keys must be at least "
+                    "pfx_len(%u) + sfx_len(%u) bytes long.",
+            kvs->ikv_kvs_name,
+            kvs->ikv_pfx_len,
+            kvs->ikv_sfx_len);
+        return merr(EINVAL);
+    }
+
+    kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len - sfx_len);
+    op->wbo_skidx = c0_index(kvs->ikv_c0);
+
+    if (kvs->ikv_vcache)
+        kvs_vcache_invalidate(kvs->ikv_vcache, kt);
+
+    return 0;
+}
+
+/* Read the cn ingest dgen and max ingested seqno that qualify value cache
+ * lookups and fills (see kvs_vcache.h).  Must be called before searching c0.
+ * Compactions that filter values move the dgen on too, both counts only
+ * ever grow so their sum changes whenever either does.
+ */
+static inline void
+ikvs_vcache_view(struct ikvs *kvs, u64 *dgen, u64 *hseqno)
+{
+    *dgen = cn_get_ingest_dgen(kvs->ikv_cn) + cn_get_cfilter_gen(kvs->ikv_cn);
+    smp_rmb();
+    *hseqno = cn_get_ingest_seqno(kvs->ikv_cn);
+}
+
+/* Cache only complete copies of values found in cn by views that see all
+ * of cn.
+ */
+static inline void
+ikvs_vcache_fill(
+    struct ikvs *            kvs,
+    const struct kvs_ktuple *kt,
+    u64                      dgen,
+    u64                      hseqno,
+    u64                      seqno,
+    enum key_lookup_res      res,
+    const struct kvs_buf *   vbuf)
+{
+    if (res == FOUND_VAL && seqno >= hseqno && vbuf->b_len <= vbuf->b_buf_sz)
+        kvs_vcache_insert(kvs->ikv_vcache, kt, dgen, seqno, vbuf->b_buf, vbuf->b_len);
+}
+
 merr_t
 ikvs_get(
     struct ikvs *           kvs,
@@ -548,33 +868,286 @@ ikvs_get(
     struct c0 *       c0 = kvs->ikv_c0;
     struct cn *       cn = kvs->ikv_cn;
     struct kvdb_ctxn *ctxn;
+    struct kvs_trace  trace;
     size_t            hashlen;
-    u64               tstart;
+    u64               tstart, sstart;
+    u64               dgen = 0, hseqno = 0;
     merr_t            err;
+    bool              traced;
 
     tstart = perfc_lat_start(pkvsl_pc);
+    traced = ikvs_trace_begin(kvs, &trace, KVS_TRACE_OP_GET);
 
     hashlen = kt->kt_len - kvs->ikv_sfx_len;
     kt->kt_hash = key_hash64(kt->kt_data, hashlen);
 
     ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
 
+    if (kvs->ikv_vcache)
+        ikvs_vcache_view(kvs, &dgen, &hseqno);
+
+    sstart = kvs_trace_stage_start();
     if (!ctxn)
         err = c0_get(c0, kt, seqno, 0, res, vbuf);
     else
         err = kvdb_ctxn_get(ctxn, c0, cn, kt, res, vbuf);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
+
+    if (!err && *res != NOT_FOUND && traced)
+        trace.kt_served = KVS_TRACE_STAGE_C0;
 
     if (!err && *res == NOT_FOUND) {
         if (ctxn) {
             err = kvdb_ctxn_get_view_seqno(ctxn, &seqno);
             if (ev(err))
-                return err;
+                goto out;
         }
 
-        err = cn_get(cn, kt, seqno, res, vbuf);
+        sstart = kvs_trace_stage_start();
+        if (kvs->ikv_vcache && kvs_vcache_get(kvs->ikv_vcache, kt, dgen, seqno, vbuf)) {
+            *res = FOUND_VAL;
+            kvs_trace_stage_end(KVS_TRACE_STAGE_VCACHE, sstart);
+
+            if (traced)
+                trace.kt_served = KVS_TRACE_STAGE_VCACHE;
+        } else {
+            kvs_trace_stage_end(KVS_TRACE_STAGE_VCACHE, sstart);
+
+            sstart = kvs_trace_stage_start();
+            err = cn_get(cn, kt, seqno, res, vbuf);
+            kvs_trace_stage_end(KVS_TRACE_STAGE_CN, sstart);
+
+            if (!err && *res != NOT_FOUND && traced)
+                trace.kt_served = KVS_TRACE_STAGE_CN;
+
+            if (!err && kvs->ikv_vcache)
+                ikvs_vcache_fill(kvs, kt, dgen, hseqno, seqno, *res, vbuf);
+        }
     }
 
     perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_GET, tstart);
+    perfc_inc(cn_get_amp_perfc(cn), PERFC_RA_CNAMP_GETS);
+
+out:
+    if (traced) {
+        trace.kt_res = *res;
+        trace.kt_hash = kt->kt_hash;
+        ikvs_trace_end(kvs, &trace);
+    }
+
+    return err;
+}
+
+merr_t
+ikvs_get_lease(
+    struct ikvs *           kvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     kt,
+    u64                     seqno,
+    enum key_lookup_res *   res,
+    struct kvs_vlease *     lease)
+{
+    struct perfc_set *pkvsl_pc = ikvs_perfc_pkvsl(kvs);
+    struct c0 *       c0 = kvs->ikv_c0;
+    struct cn *       cn = kvs->ikv_cn;
+    struct kvdb_ctxn *ctxn;
+    struct kvs_buf    vbuf;
+    size_t            hashlen;
+    u64               tstart;
+    merr_t            err;
+    void *            buf = NULL;
+    u32               bufsz = 0;
+
+    tstart = perfc_lat_start(pkvsl_pc);
+
+    memset(lease, 0, sizeof(*lease));
+
+    hashlen = kt->kt_len - kvs->ikv_sfx_len;
+    kt->kt_hash = key_hash64(kt->kt_data, hashlen);
+
+    ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
+
+    /* Values in c0 (or the txn) are not stable, so they are copied
+     * into a private buffer.  We learn the value length on the first
+     * pass (see the probe note in hse_kvs_get()), then retry with a
+     * buffer of sufficient size.
+     */
+    while (1) {
+        kvs_buf_init(&vbuf, buf ?: (void *)-1, bufsz);
+
+        if (!ctxn)
+            err = c0_get(c0, kt, seqno, 0, res, &vbuf);
+        else
+            err = kvdb_ctxn_get(ctxn, c0, cn, kt, res, &vbuf);
+
+        if (err || *res != FOUND_VAL || vbuf.b_len <= bufsz)
+            break;
+
+        free(buf);
+        bufsz = vbuf.b_len;
+
+        buf = malloc(bufsz);
+        if (ev(!buf)) {
+            err = merr(ENOMEM);
+            break;
+        }
+    }
+
+    if (!err && *res == FOUND_VAL) {
+        lease->vl_data = buf;
+        lease->vl_len = vbuf.b_len;
+        lease->vl_buf = buf;
+        buf = NULL;
+    }
+
+    free(buf);
+
+    if (!err && *res == NOT_FOUND) {
+        if (ctxn) {
+            err = kvdb_ctxn_get_view_seqno(ctxn, &seqno);
+            if (ev(err))
+                return err;
+        }
+
+        err = cn_get_lease(cn, kt, seqno, res, lease);
+    }
+
+    perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_GET_LEASE, tstart);
+
+    return err;
+}
+
+void
+ikvs_lease_release(struct kvs_vlease *lease)
+{
+    if (lease->vl_pin)
+        cn_lease_release(lease);
+
+    free(lease->vl_buf);
+    memset(lease, 0, sizeof(*lease));
+}
+
+void
+ikvs_prefetch(struct ikvs *kvs, struct kvs_ktuple *ktv, u64 seqno, u32 cnt)
+{
+    struct c0 *         c0 = kvs->ikv_c0;
+    struct cn *         cn = kvs->ikv_cn;
+    struct kvs_buf      vbuf;
+    enum key_lookup_res res;
+    merr_t              err;
+    u32                 i;
+
+    kvs_ktuple_hashv(ktv, cnt, kvs->ikv_sfx_len);
+
+    for (i = 0; i < cnt; ++i) {
+        struct kvs_ktuple *kt = ktv + i;
+
+        /* Probe c0 with an empty buffer, see hse_kvs_get().
+         */
+        kvs_buf_init(&vbuf, (void *)-1, 0);
+
+        err = c0_get(c0, kt, seqno, 0, &res, &vbuf);
+        if (ev(err) || res != NOT_FOUND)
+            continue;
+
+        err = cn_prefetch(cn, kt, seqno, &res);
+        ev(err);
+    }
+}
+
+merr_t
+ikvs_get_batch(
+    struct ikvs *           kvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    u64                     seqno,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt)
+{
+    struct perfc_set *pkvsl_pc = ikvs_perfc_pkvsl(kvs);
+    struct c0 *       c0 = kvs->ikv_c0;
+    struct cn *       cn = kvs->ikv_cn;
+    struct kvdb_ctxn *  ctxn;
+    struct scratch_mark mark;
+    u32 *               lookupv;
+    u32                 lookupc, i, j;
+    u64                 tstart;
+    u64                 dgen = 0, hseqno = 0;
+    merr_t              err = 0;
+
+    tstart = perfc_lat_start(pkvsl_pc);
+
+    scratch_save(&mark);
+
+    lookupv = scratch_alloc(cnt * sizeof(*lookupv), __alignof(*lookupv));
+    if (ev(!lookupv))
+        return merr(ENOMEM);
+
+    ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
+
+    if (kvs->ikv_vcache)
+        ikvs_vcache_view(kvs, &dgen, &hseqno);
+
+    /* Hash all the keys up front, the hash of each is then shared by c0,
+     * the txn and the cn bloom filters.
+     */
+    kvs_ktuple_hashv(ktv, cnt, kvs->ikv_sfx_len);
+
+    /* Resolve as many keys as possible from c0 (and the txn), and collect
+     * the misses so that cn can be searched for all of them in one pass.
+     */
+    for (i = lookupc = 0; i < cnt; ++i) {
+        struct kvs_ktuple *kt = ktv + i;
+
+        if (!ctxn)
+            err = c0_get(c0, kt, seqno, 0, resv + i, vbufv + i);
+        else
+            err = kvdb_ctxn_get(ctxn, c0, cn, kt, resv + i, vbufv + i);
+
+        if (ev(err))
+            goto out;
+
+        if (resv[i] == NOT_FOUND)
+            lookupv[lookupc++] = i;
+    }
+
+    if (lookupc > 0) {
+        if (ctxn) {
+            err = kvdb_ctxn_get_view_seqno(ctxn, &seqno);
+            if (ev(err))
+                goto out;
+        }
+
+        if (kvs->ikv_vcache) {
+            for (i = j = 0; i < lookupc; ++i) {
+                u32 k = lookupv[i];
+
+                if (kvs_vcache_get(kvs->ikv_vcache, ktv + k, dgen, seqno, vbufv + k))
+                    resv[k] = FOUND_VAL;
+                else
+                    lookupv[j++] = k;
+            }
+            lookupc = j;
+        }
+
+        if (lookupc > 0)
+            err = cn_get_batch(cn, ktv, seqno, resv, vbufv, lookupv, lookupc);
+
+        if (!err && kvs->ikv_vcache) {
+            for (i = 0; i < lookupc; ++i) {
+                u32 k = lookupv[i];
+
+                ikvs_vcache_fill(kvs, ktv + k, dgen, hseqno, seqno, resv[k], vbufv + k);
+            }
+        }
+    }
+
+out:
+    scratch_restore(&mark);
+
+    perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_GET_BATCH, tstart);
+    perfc_add(cn_get_amp_perfc(cn), PERFC_RA_CNAMP_GETS, cnt);
 
     return err;
 }
@@ -586,9 +1159,12 @@ ikvs_del(struct ikvs *kvs, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt, u6
     struct kvdb_ctxn *ctxn = 0;
     struct c0 *       c0 = kvs->ikv_c0;
     size_t            hashlen;
-    u64               tstart;
+    u64               tstart, sstart;
     merr_t            err;
 
+    if (ev(atomic_read(&kvs->ikv_bulk)))
+        return merr(EBUSY);
+
     tstart = perfc_lat_start(pkvsl_pc);
 
     hashlen = kt->kt_len - kvs->ikv_sfx_len;
@@ -597,10 +1173,15 @@ ikvs_del(struct ikvs *kvs, struct hse_kvdb_opspec *os, struct kvs_ktuple *kt, u6
     if (os && os->kop_txn)
         ctxn = kvdb_ctxn_h2h(os->kop_txn);
 
+    sstart = kvs_trace_stage_start();
     if (!ctxn)
         err = c0_del(c0, kt, seqno);
     else
         err = kvdb_ctxn_del(ctxn, c0, kt);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
+
+    if (kvs->ikv_vcache)
+        kvs_vcache_invalidate(kvs->ikv_vcache, kt);
 
     perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_DEL, tstart);
 
@@ -615,6 +1196,9 @@ ikvs_prefix_del(struct ikvs *kvs, struct hse_kvdb_opspec *os, struct kvs_ktuple
     u64               tstart;
     merr_t            err;
 
+    if (ev(atomic_read(&kvs->ikv_bulk)))
+        return merr(EBUSY);
+
     tstart = perfc_lat_start(pkvsl_pc);
 
     if (!kt->kt_hash)
@@ -633,6 +1217,21 @@ ikvs_prefix_del(struct ikvs *kvs, struct hse_kvdb_opspec *os, struct kvs_ktuple
     return ev(err);
 }
 
+merr_t
+ikvs_bulk_begin(struct ikvs *kvs)
+{
+    if (atomic_cmpxchg(&kvs->ikv_bulk, 0, 1) != 0)
+        return merr(ev(EBUSY));
+
+    return 0;
+}
+
+void
+ikvs_bulk_end(struct ikvs *kvs)
+{
+    atomic_set(&kvs->ikv_bulk, 0);
+}
+
 /*-  Prefix Probe -----------------------------------------------------*/
 
 merr_t
@@ -648,11 +1247,12 @@ ikvs_pfx_probe(
     struct perfc_set *pkvsl_pc = ikvs_perfc_pkvsl(kvs);
     struct c0 *       c0 = kvs->ikv_c0;
     struct cn *       cn = kvs->ikv_cn;
-    struct kvdb_ctxn *ctxn;
-    struct query_ctx  qctx;
-    u64               tstart;
-    merr_t            err;
-    int               i;
+    struct kvdb_ctxn *  ctxn;
+    struct query_ctx    qctx;
+    struct scratch_mark mark;
+    u64                 tstart;
+    merr_t              err;
+    int                 i;
 
     tstart = perfc_lat_start(pkvsl_pc);
 
@@ -663,55 +1263,207 @@ ikvs_pfx_probe(
     }
 
     qctx.qtype = QUERY_PROBE_PFX;
-    qctx.pos = qctx.ntombs = qctx.seen = 0;
+    qctx.ntombs = qctx.seen = 0;
+
+    for (i = 0; i < TT_WIDTH; i++)
+        qctx.tomb_tree[i] = RB_ROOT;
+
+    if (!kt->kt_hash)
+        kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len);
+
+    /* Everything allocated on behalf of the probe (e.g., tomb elems)
+     * comes from the thread's scratch arena and is released at once.
+     */
+    scratch_save(&mark);
+
+    ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
+    if (!ctxn)
+        err = c0_pfx_probe(c0, kt, seqno, 0, res, &qctx, kbuf, vbuf);
+    else
+        err = kvdb_ctxn_pfx_probe(ctxn, c0, cn, kt, res, &qctx, kbuf, vbuf);
+
+    if (*res == FOUND_PTMB || qctx.seen > 1)
+        goto done;
+
+    if (!err && (*res == FOUND_VAL || *res == NOT_FOUND)) {
+        if (ctxn)
+            err = kvdb_ctxn_get_view_seqno(ctxn, &seqno);
+
+        if (!err)
+            err = cn_pfx_probe(cn, kt, seqno, res, &qctx, kbuf, vbuf);
+    }
+
+done:
+    scratch_restore(&mark);
+
+    if (ev(err))
+        return err;
+
+    perfc_rec_sample(&kvs->ikv_cd_pc, PERFC_DI_CD_TOMBSPERPROBE, qctx.ntombs);
+
+    switch (qctx.seen) {
+        case 0:
+            *res = NOT_FOUND;
+            break;
+        case 1:
+            *res = FOUND_VAL;
+            break;
+        default:
+            *res = FOUND_MULTIPLE;
+    }
+
+    perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_PFX_PROBE, tstart);
+
+    return 0;
+}
+
+/**
+ * struct ikvs_pfx_ent - a prefix of a batched prefix probe
+ * @pe_kt:  prefix
+ * @pe_idx: index of the prefix in the caller's vectors
+ */
+struct ikvs_pfx_ent {
+    const struct kvs_ktuple *pe_kt;
+    u32                      pe_idx;
+};
+
+static int
+ikvs_pfx_ent_cmp(const void *lhs, const void *rhs)
+{
+    const struct kvs_ktuple *l = ((const struct ikvs_pfx_ent *)lhs)->pe_kt;
+    const struct kvs_ktuple *r = ((const struct ikvs_pfx_ent *)rhs)->pe_kt;
+
+    return keycmp(l->kt_data, l->kt_len, r->kt_data, r->kt_len);
+}
+
+merr_t
+ikvs_pfx_probe_batch(
+    struct ikvs *           kvs,
+    struct hse_kvdb_opspec *os,
+    struct kvs_ktuple *     ktv,
+    u64                     seqno,
+    enum key_lookup_res *   resv,
+    struct kvs_buf *        kbufv,
+    struct kvs_buf *        vbufv,
+    u32                     cnt)
+{
+    struct perfc_set *   pkvsl_pc = ikvs_perfc_pkvsl(kvs);
+    struct c0 *          c0 = kvs->ikv_c0;
+    struct cn *          cn = kvs->ikv_cn;
+    struct kvdb_ctxn *   ctxn;
+    struct query_ctx *   qctxv;
+    struct ikvs_pfx_ent *entv;
+    struct scratch_mark  mark;
+    u32 *                lookupv;
+    u32                  lookupc, i, j;
+    u64                  tstart;
+    merr_t               err = 0;
+
+    tstart = perfc_lat_start(pkvsl_pc);
+
+    if (ev(kvs->ikv_sfx_len == 0)) {
+        hse_log(HSE_ERR "Prefix probe not supported because kvs is "
+                        "not suffixed");
+        return merr(EINVAL);
+    }
+
+    /* The query contexts and their tomb elems live in the scratch arena
+     * for the duration of the batch, as for ikvs_pfx_probe().
+     */
+    scratch_save(&mark);
+
+    qctxv = scratch_alloc(cnt * sizeof(*qctxv), __alignof(*qctxv));
+    entv = scratch_alloc(cnt * sizeof(*entv), __alignof(*entv));
+    lookupv = scratch_alloc(cnt * sizeof(*lookupv), __alignof(*lookupv));
+    if (ev(!qctxv || !entv || !lookupv)) {
+        err = merr(ENOMEM);
+        goto out;
+    }
+
+    kvs_ktuple_hashv(ktv, cnt, 0);
+
+    for (i = 0; i < cnt; ++i) {
+        struct query_ctx * qctx = qctxv + i;
+        struct kvs_ktuple *kt = ktv + i;
+
+        qctx->qtype = QUERY_PROBE_PFX;
+        qctx->ntombs = qctx->seen = 0;
+
+        for (j = 0; j < TT_WIDTH; j++)
+            qctx->tomb_tree[j] = RB_ROOT;
+
+        entv[i].pe_kt = kt;
+        entv[i].pe_idx = i;
+    }
+
+    /* Probe in prefix order so that neighboring prefixes walk the same
+     * paths through c0 and the kvsets one after the other.
+     */
+    qsort(entv, cnt, sizeof(*entv), ikvs_pfx_ent_cmp);
+
+    for (i = 0; i < cnt; ++i)
+        lookupv[i] = entv[i].pe_idx;
+
+    ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
+    if (!ctxn) {
+        err = c0_pfx_probe_batch(c0, ktv, seqno, 0, resv, qctxv, kbufv, vbufv, lookupv, cnt);
+    } else {
+        for (i = 0; i < cnt && !err; ++i) {
+            u32 k = lookupv[i];
+
+            err = kvdb_ctxn_pfx_probe(
+                ctxn, c0, cn, ktv + k, resv + k, qctxv + k, kbufv + k, vbufv + k);
+        }
+    }
 
-    for (i = 0; i < TT_WIDTH; i++)
-        qctx.tomb_tree[i] = RB_ROOT;
+    if (ev(err))
+        goto out;
 
-    if (!kt->kt_hash)
-        kt->kt_hash = key_hash64(kt->kt_data, kt->kt_len);
+    /* Only the prefixes that c0 neither settled nor shadowed go on to cn.
+     */
+    for (i = lookupc = 0; i < cnt; ++i) {
+        u32 k = lookupv[i];
 
-    ctxn = (os && os->kop_txn) ? kvdb_ctxn_h2h(os->kop_txn) : 0;
-    if (!ctxn)
-        err = c0_pfx_probe(c0, kt, seqno, 0, res, &qctx, kbuf, vbuf);
-    else
-        err = kvdb_ctxn_pfx_probe(ctxn, c0, cn, kt, res, &qctx, kbuf, vbuf);
+        if (resv[k] == FOUND_PTMB || qctxv[k].seen > 1)
+            continue;
 
-    if (*res == FOUND_PTMB || qctx.seen > 1)
-        goto done;
+        if (resv[k] == FOUND_VAL || resv[k] == NOT_FOUND)
+            lookupv[lookupc++] = k;
+    }
 
-    if (!err && (*res == FOUND_VAL || *res == NOT_FOUND)) {
+    if (lookupc > 0) {
         if (ctxn) {
             err = kvdb_ctxn_get_view_seqno(ctxn, &seqno);
             if (ev(err))
-                return err;
+                goto out;
         }
 
-        err = cn_pfx_probe(cn, kt, seqno, res, &qctx, kbuf, vbuf);
+        err = cn_pfx_probe_batch(cn, ktv, seqno, resv, qctxv, kbufv, vbufv, lookupv, lookupc);
+        if (ev(err))
+            goto out;
     }
 
-    if (ev(err))
-        return err;
-
-    qctx_te_mem_reset();
-
-done:
-    perfc_rec_sample(&kvs->ikv_cd_pc, PERFC_DI_CD_TOMBSPERPROBE, qctx.ntombs);
-
-    switch (qctx.seen) {
-        case 0:
-            *res = NOT_FOUND;
-            break;
-        case 1:
-            *res = FOUND_VAL;
-            break;
-        default:
-            *res = FOUND_MULTIPLE;
+    for (i = 0; i < cnt; ++i) {
+        perfc_rec_sample(&kvs->ikv_cd_pc, PERFC_DI_CD_TOMBSPERPROBE, qctxv[i].ntombs);
+
+        switch (qctxv[i].seen) {
+            case 0:
+                resv[i] = NOT_FOUND;
+                break;
+            case 1:
+                resv[i] = FOUND_VAL;
+                break;
+            default:
+                resv[i] = FOUND_MULTIPLE;
+        }
     }
 
     perfc_lat_record(pkvsl_pc, PERFC_LT_PKVSL_KVS_PFX_PROBE, tstart);
 
-    return 0;
+out:
+    scratch_restore(&mark);
+
+    return err;
 }
 
 /*-  Cursor Support  --------------------------------------------------*/
@@ -914,6 +1666,8 @@ ikvs_maint_task(struct ikvs *kvs, u64 now)
     uint cn_retired = 0;
     int  i;
 
+    ikvs_curpool_preen(kvs, now, &c0_retired, &cn_retired);
+
     for (i = 0; i < NELEM(kvs->ikv_curcachev); ++i)
         ikvs_curcache_preen(kvs->ikv_curcachev + i, kvs, now, &c0_retired, &cn_retired);
 
@@ -925,6 +1679,56 @@ ikvs_maint_task(struct ikvs *kvs, u64 now)
     cn_periodic(kvs->ikv_cn, now);
 }
 
+void
+ikvs_cursor_cache_purge(struct ikvs *kvs)
+{
+    uint c0_retired = 0;
+    uint cn_retired = 0;
+    uint prev;
+    int  i;
+
+    ikvs_curpool_preen(kvs, U64_MAX, &c0_retired, &cn_retired);
+
+    /* A preen stops at the first bucket it empties.
+     */
+    for (i = 0; i < NELEM(kvs->ikv_curcachev); ++i) {
+        do {
+            prev = cn_retired;
+            ikvs_curcache_preen(kvs->ikv_curcachev + i, kvs, U64_MAX, &c0_retired, &cn_retired);
+        } while (cn_retired > prev);
+    }
+
+    if (c0_retired > 0)
+        perfc_add(&kvs->ikv_cc_pc, PERFC_BA_CC_RETIRE_C0, c0_retired);
+    if (cn_retired > 0)
+        perfc_add(&kvs->ikv_cc_pc, PERFC_BA_CC_RETIRE_CN, cn_retired);
+}
+
+bool
+ikvs_vcache_usage(struct ikvs *kvs, size_t *sizep, size_t *capp, u64 *hitsp, u64 *missesp)
+{
+    struct kvs_vcache_usage usage;
+
+    if (!kvs->ikv_vcache)
+        return false;
+
+    kvs_vcache_usage(kvs->ikv_vcache, &usage);
+
+    *sizep = usage.vcu_size;
+    *capp = usage.vcu_capacity;
+    *hitsp = usage.vcu_hits;
+    *missesp = usage.vcu_misses;
+
+    return true;
+}
+
+void
+ikvs_vcache_resize(struct ikvs *kvs, size_t capacity)
+{
+    if (kvs->ikv_vcache)
+        kvs_vcache_resize(kvs->ikv_vcache, capacity);
+}
+
 /*
  * for each node in tree: remove from tree, destroy cursor
  *
@@ -939,7 +1743,18 @@ ikvs_cursor_reap(struct ikvs *kvs)
 {
     struct curcache *cca;
     struct rb_node * node;
-    int              i;
+    int              i, j;
+
+    for (i = 0; i < NELEM(kvs->ikv_curpoolv); ++i) {
+        struct curpool *pool = kvs->ikv_curpoolv + i;
+
+        for (j = 0; j < KVS_CURPOOL_SLOTS; ++j) {
+            long old = atomic64_read(&pool->cp_curv[j]);
+
+            if (old && atomic64_cmpxchg(&pool->cp_curv[j], old, 0) == old)
+                ikvs_cursor_destroy(&((struct kvs_cursor_impl *)old)->kci_handle);
+        }
+    }
 
     for (i = 0; i < NELEM(kvs->ikv_curcachev); ++i) {
         cca = kvs->ikv_curcachev + i;
@@ -981,13 +1796,25 @@ ikvs_curcache_cmp(
     const struct kvs_cursor_impl *cur,
     const void *                  prefix,
     size_t                        pfx_len,
-    bool                          reverse)
+    bool                          reverse,
+    bool                          keys_only,
+    bool                          direct)
 {
     if (reverse && !cur->kci_reverse)
         return -1;
     else if (!reverse && cur->kci_reverse)
         return 1;
 
+    if (keys_only && !cur->kci_keys_only)
+        return -1;
+    else if (!keys_only && cur->kci_keys_only)
+        return 1;
+
+    if (direct && !cur->kci_direct)
+        return -1;
+    else if (!direct && cur->kci_direct)
+        return 1;
+
     if (prefix && !cur->kci_prefix)
         return -1;
     else if (!prefix && cur->kci_prefix)
@@ -1017,7 +1844,13 @@ ikvs_curcache_insert(struct curcache *cca, struct kvs_cursor_impl *cur)
         parent = *link;
         old = node2bucket(parent)->list;
 
-        rc = ikvs_curcache_cmp(old, cur->kci_prefix, cur->kci_pfx_len, cur->kci_reverse);
+        rc = ikvs_curcache_cmp(
+            old,
+            cur->kci_prefix,
+            cur->kci_pfx_len,
+            cur->kci_reverse,
+            cur->kci_keys_only,
+            cur->kci_direct);
         if (rc < 0)
             link = &(*link)->rb_left;
         else if (rc > 0)
@@ -1056,7 +1889,13 @@ ikvs_curcache_insert(struct curcache *cca, struct kvs_cursor_impl *cur)
 }
 
 static struct kvs_cursor_impl *
-ikvs_curcache_remove(struct curcache *cca, const void *prefix, size_t pfx_len, bool reverse)
+ikvs_curcache_remove(
+    struct curcache *cca,
+    const void *     prefix,
+    size_t           pfx_len,
+    bool             reverse,
+    bool             keys_only,
+    bool             direct)
 {
     struct rb_node *        node;
     struct kvs_cursor_impl *cur;
@@ -1072,7 +1911,7 @@ ikvs_curcache_remove(struct curcache *cca, const void *prefix, size_t pfx_len, b
         b = node2bucket(node);
         cur = b->list;
 
-        rc = ikvs_curcache_cmp(cur, prefix, pfx_len, reverse);
+        rc = ikvs_curcache_cmp(cur, prefix, pfx_len, reverse, keys_only, direct);
         if (rc < 0)
             node = node->rb_left;
         else if (rc > 0)
@@ -1098,6 +1937,155 @@ ikvs_curcache_remove(struct curcache *cca, const void *prefix, size_t pfx_len, b
     return cur;
 }
 
+static __always_inline u64
+ikvs_curpool_tag(u64 pfxhash, bool reverse, bool keys_only, bool direct)
+{
+    return (pfxhash & ~7ul) | (reverse << 2) | (keys_only << 1) | direct;
+}
+
+static __always_inline struct curpool *
+ikvs_curpool(struct ikvs *kvs)
+{
+    return kvs->ikv_curpoolv + raw_smp_processor_id() % NELEM(kvs->ikv_curpoolv);
+}
+
+/**
+ * ikvs_curpool_put() - cache a saved cursor in the calling cpu's pool
+ * @kvs:  kvs to which the cursor belongs
+ * @cur:  saved cursor (with its ttls set)
+ *
+ * Return: true if the pool took the cursor, false if the pool is full.
+ */
+static bool
+ikvs_curpool_put(struct ikvs *kvs, struct kvs_cursor_impl *cur)
+{
+    struct curpool *pool = ikvs_curpool(kvs);
+    u64             tag;
+    int             i;
+
+    tag = ikvs_curpool_tag(cur->kci_pfxhash, cur->kci_reverse, cur->kci_keys_only, cur->kci_direct);
+
+    for (i = 0; i < KVS_CURPOOL_SLOTS; ++i) {
+        if (atomic64_read(&pool->cp_curv[i]))
+            continue;
+
+        atomic64_set(&pool->cp_tagv[i], tag);
+        atomic64_set(&pool->cp_ttlv[i], min(cur->kci_cache.cc_c0_ttl, cur->kci_cache.cc_cn_ttl));
+
+        if (atomic64_cmpxchg(&pool->cp_curv[i], 0, (long)cur) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* Give a cursor taken from a curpool back to the curpool or else to the
+ * curcache, or destroy it if neither will take it.
+ */
+static void
+ikvs_curpool_putback(struct ikvs *kvs, struct kvs_cursor_impl *cur)
+{
+    if (ikvs_curpool_put(kvs, cur))
+        return;
+
+    cur = ikvs_curcache_insert(ikvs_td2cca(kvs, cur->kci_pfxhash), cur);
+    if (cur)
+        ikvs_cursor_destroy(&cur->kci_handle);
+}
+
+/**
+ * ikvs_curpool_get() - take a matching cursor from the calling cpu's pool
+ *
+ * Unlike the curcache this takes no lock.  A slot whose tag matches is
+ * claimed by swapping out its cursor, which is then checked against the
+ * request in full since the tag may be stale or collide.
+ */
+static struct kvs_cursor_impl *
+ikvs_curpool_get(
+    struct ikvs *kvs,
+    const void * prefix,
+    size_t       pfx_len,
+    u64          pfxhash,
+    bool         reverse,
+    bool         keys_only,
+    bool         direct)
+{
+    struct kvs_cursor_impl *cur;
+    struct curpool *        pool;
+    u64                     tag;
+    long                    old;
+    int                     i;
+
+    pool = ikvs_curpool(kvs);
+    tag = ikvs_curpool_tag(pfxhash, reverse, keys_only, direct);
+
+    for (i = 0; i < KVS_CURPOOL_SLOTS; ++i) {
+        if (atomic64_read(&pool->cp_tagv[i]) != tag)
+            continue;
+
+        old = atomic64_read(&pool->cp_curv[i]);
+        if (!old || atomic64_cmpxchg(&pool->cp_curv[i], old, 0) != old)
+            continue;
+
+        cur = (void *)old;
+
+        if (!ikvs_curcache_cmp(cur, prefix, pfx_len, reverse, keys_only, direct))
+            return cur;
+
+        ikvs_curpool_putback(kvs, cur);
+    }
+
+    return NULL;
+}
+
+/* Retire the expired resources of pooled cursors, as ikvs_curcache_preen()
+ * does for the curcache.  Only slots whose ttl hint has passed are claimed,
+ * so that the preen seldom makes a lookup miss.
+ */
+static void
+ikvs_curpool_preen(struct ikvs *kvs, u64 now, uint *c0_retiredp, uint *cn_retiredp)
+{
+    int i, j;
+
+    for (i = 0; i < NELEM(kvs->ikv_curpoolv); ++i) {
+        struct curpool *pool = kvs->ikv_curpoolv + i;
+
+        for (j = 0; j < KVS_CURPOOL_SLOTS; ++j) {
+            struct kvs_cursor_impl *cur;
+            long                    old;
+
+            if (now < atomic64_read(&pool->cp_ttlv[j]))
+                continue;
+
+            old = atomic64_read(&pool->cp_curv[j]);
+            if (!old || atomic64_cmpxchg(&pool->cp_curv[j], old, 0) != old)
+                continue;
+
+            cur = (void *)old;
+
+            if (now >= cur->kci_cache.cc_cn_ttl) {
+                ikvs_cursor_destroy(&cur->kci_handle);
+                ++*c0_retiredp;
+                ++*cn_retiredp;
+                continue;
+            }
+
+            if (now >= cur->kci_cache.cc_c0_ttl && cur->kci_c0cur) {
+                cur->kci_cache.cc_c0_ttl = U64_MAX;
+                c0_cursor_destroy(cur->kci_c0cur);
+                cur->kci_c0cur = 0;
+                ++*c0_retiredp;
+            }
+
+            /* Preening runs on another cpu, so put it back where it was.
+             */
+            atomic64_set(&pool->cp_ttlv[j], cur->kci_cache.cc_cn_ttl);
+            if (atomic64_cmpxchg(&pool->cp_curv[j], 0, old) != 0)
+                ikvs_curpool_putback(kvs, cur);
+        }
+    }
+}
+
 static void
 ikvs_cursor_reset(struct kvs_cursor_impl *cursor, int bit)
 {
@@ -1118,7 +2106,14 @@ ikvs_cursor_reset(struct kvs_cursor_impl *cursor, int bit)
 }
 
 static struct kvs_cursor_impl *
-ikvs_cursor_restore(struct ikvs *kvs, const void *prefix, size_t pfx_len, u64 pfxhash, bool reverse)
+ikvs_cursor_restore(
+    struct ikvs *kvs,
+    const void * prefix,
+    size_t       pfx_len,
+    u64          pfxhash,
+    bool         reverse,
+    bool         keys_only,
+    bool         direct)
 {
     struct kvs_cursor_impl *cur;
     struct curcache *       cca;
@@ -1126,10 +2121,15 @@ ikvs_cursor_restore(struct ikvs *kvs, const void *prefix, size_t pfx_len, u64 pf
 
     tstart = perfc_lat_startu(&kvs->ikv_cd_pc, PERFC_LT_CD_RESTORE);
 
-    cca = ikvs_td2cca(kvs, pfxhash);
-    cur = ikvs_curcache_remove(cca, prefix, pfx_len, reverse);
-    if (!cur)
-        return NULL;
+    cur = ikvs_curpool_get(kvs, prefix, pfx_len, pfxhash, reverse, keys_only, direct);
+    if (cur) {
+        perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_RESTORE_POOL);
+    } else {
+        cca = ikvs_td2cca(kvs, pfxhash);
+        cur = ikvs_curcache_remove(cca, prefix, pfx_len, reverse, keys_only, direct);
+        if (!cur)
+            return NULL;
+    }
 
     perfc_lat_record(cur->kci_cd_pc, PERFC_LT_CD_RESTORE, tstart);
 
@@ -1256,8 +2256,12 @@ ikvs_cursor_save(struct kvs_cursor_impl *cur)
     cur->kci_cache.cc_cn_ttl = now + cn_age * 1048576;
     cur->kci_cache.cc_c0_ttl = now + c0_age * 1048576;
 
-    cca = ikvs_td2cca(kvs, cur->kci_pfxhash);
-    cur = ikvs_curcache_insert(cca, cur);
+    if (ikvs_curpool_put(kvs, cur)) {
+        cur = NULL;
+    } else {
+        cca = ikvs_td2cca(kvs, cur->kci_pfxhash);
+        cur = ikvs_curcache_insert(cca, cur);
+    }
 
     /*
      * NB: it is unsafe to use cur after the unlock, because
@@ -1276,7 +2280,13 @@ discard:
 }
 
 struct hse_kvs_cursor *
-ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool reverse)
+ikvs_cursor_alloc(
+    struct ikvs *kvs,
+    const void * prefix,
+    size_t       pfx_len,
+    bool         reverse,
+    bool         keys_only,
+    bool         direct)
 {
     struct kvs_cursor_impl *cur;
     size_t                  len;
@@ -1284,7 +2294,7 @@ ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool rev
 
     pfxhash = (prefix && pfx_len > 0) ? key_hash64(prefix, pfx_len) : 0;
 
-    cur = ikvs_cursor_restore(kvs, prefix, pfx_len, pfxhash, reverse);
+    cur = ikvs_cursor_restore(kvs, prefix, pfx_len, pfxhash, reverse, keys_only, direct);
     if (cur) {
         perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_RESTORE);
 
@@ -1296,6 +2306,9 @@ ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool rev
          */
         ikvs_cursor_reset(cur, BIT_BOTH);
 
+        if (cur->kci_pred_key || cur->kci_pred_val)
+            ikvs_cursor_pred(&cur->kci_handle, NULL, NULL, NULL);
+
         return &cur->kci_handle;
     }
 
@@ -1305,6 +2318,8 @@ ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool rev
     if (ev(!cur))
         return NULL;
 
+    kvdb_memacct_alloc(KVDB_MEMACCT_CURSOR, kmem_cache_size(kvs_cursor_zone));
+
     memset(cur, 0, sizeof(*cur));
     if (kvs->ikv_rp.kvs_debug & 16)
         cur->kci_cc_pc = &kvs->ikv_cc_pc;
@@ -1313,6 +2328,7 @@ ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool rev
     cur->kci_kvs = kvs;
     cur->kci_pfx_len = pfx_len;
     cur->kci_pfxhash = pfxhash;
+    cur->kci_kfixed = cn_cflags_kfixed(cn_get_flags(kvs->ikv_cn));
     if (prefix)
         memcpy(cur->kci_prefix, prefix, pfx_len);
 
@@ -1330,6 +2346,8 @@ ikvs_cursor_alloc(struct ikvs *kvs, const void *prefix, size_t pfx_len, bool rev
         memset(cur->kci_prefix + pfx_len, 0xFF, HSE_KVS_KLEN_MAX - pfx_len);
 
     cur->kci_reverse = reverse;
+    cur->kci_keys_only = keys_only;
+    cur->kci_direct = direct;
 
     perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_ALLOC);
 
@@ -1386,8 +2404,8 @@ ikvs_cursor_tombs_update(struct kvs_cursor_impl *cur, u32 flags)
         perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_TOMB_FLUSH);
 }
 
-merr_t
-ikvs_cursor_init(struct hse_kvs_cursor *cursor)
+static merr_t
+ikvs_cursor_init_impl(struct hse_kvs_cursor *cursor)
 {
     struct kvs_cursor_impl *cur = cursor_h2r(cursor);
     struct ikvs *           kvs = cur->kci_kvs;
@@ -1399,7 +2417,7 @@ ikvs_cursor_init(struct hse_kvs_cursor *cursor)
     bool                    updated;
     struct kvs_ktuple       kt_min, kt_max;
     struct kvs_ktuple *     tmin = 0, *tmax = 0;
-    u64                     tstart;
+    u64                     tstart, sstart;
 
     /* no context: update must seek to beginning */
     cur->kci_last = 0;
@@ -1416,6 +2434,7 @@ ikvs_cursor_init(struct hse_kvs_cursor *cursor)
         perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_INIT_CREATE_C0);
 
         tstart = perfc_lat_start(cur->kci_cd_pc);
+        sstart = kvs_trace_stage_start();
         err = c0_cursor_create(
             c0,
             seqno,
@@ -1424,6 +2443,7 @@ ikvs_cursor_init(struct hse_kvs_cursor *cursor)
             cur->kci_pfx_len,
             &cur->kci_summary,
             &cur->kci_c0cur);
+        kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
         perfc_lat_record(cur->kci_cd_pc, PERFC_LT_CD_CREATE_C0, tstart);
 
         cur->kci_tombs.kct_start = U64_MAX;
@@ -1446,7 +2466,9 @@ ikvs_cursor_init(struct hse_kvs_cursor *cursor)
         }
 
         tstart = perfc_lat_start(cur->kci_cd_pc);
+        sstart = kvs_trace_stage_start();
         err = c0_cursor_update(cur->kci_c0cur, seqno, tmin, tmax, &flags);
+        kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
         perfc_lat_record(cur->kci_cd_pc, PERFC_LT_CD_UPDATE_C0, tstart);
 
         if (flags & CURSOR_FLAG_SEQNO_CHANGE)
@@ -1467,18 +2489,24 @@ ikvs_cursor_init(struct hse_kvs_cursor *cursor)
         perfc_inc(cur->kci_cc_pc, PERFC_BA_CC_INIT_CREATE_CN);
 
         tstart = perfc_lat_start(cur->kci_cd_pc);
+        sstart = kvs_trace_stage_start();
         err = cn_cursor_create(
             cn,
             seqno,
             cur->kci_reverse,
+            cur->kci_keys_only,
+            cur->kci_direct,
             cur->kci_prefix,
             cur->kci_pfx_len,
             &cur->kci_summary,
             &cur->kci_cncur);
+        kvs_trace_stage_end(KVS_TRACE_STAGE_CN, sstart);
         perfc_lat_record(cur->kci_cd_pc, PERFC_LT_CD_CREATE_CN, tstart);
     } else {
         tstart = perfc_lat_start(cur->kci_cd_pc);
+        sstart = kvs_trace_stage_start();
         err = cn_cursor_update(cur->kci_cncur, seqno, &updated);
+        kvs_trace_stage_end(KVS_TRACE_STAGE_CN, sstart);
         perfc_lat_record(cur->kci_cd_pc, PERFC_LT_CD_UPDATE_CN, tstart);
 
         if (updated)
@@ -1500,6 +2528,23 @@ error:
     return err;
 }
 
+merr_t
+ikvs_cursor_init(struct hse_kvs_cursor *cursor)
+{
+    struct kvs_cursor_impl *cur = cursor_h2r(cursor);
+    struct ikvs *           kvs = cur->kci_kvs;
+    struct kvs_trace        trace;
+    merr_t                  err;
+
+    if (!ikvs_trace_begin(kvs, &trace, KVS_TRACE_OP_CURSOR_INIT))
+        return ikvs_cursor_init_impl(cursor);
+
+    err = ikvs_cursor_init_impl(cursor);
+    ikvs_trace_end(kvs, &trace);
+
+    return err;
+}
+
 void
 ikvs_cursor_tombspan_check(struct hse_kvs_cursor *handle)
 {
@@ -1559,6 +2604,7 @@ ikvs_cursor_destroy(struct hse_kvs_cursor *handle)
         cn_cursor_destroy(cursor->kci_cncur);
 
     kmem_cache_free(kvs_cursor_zone, cursor);
+    kvdb_memacct_free(KVDB_MEMACCT_CURSOR, kmem_cache_size(kvs_cursor_zone));
 }
 
 merr_t
@@ -1665,8 +2711,8 @@ ikvs_cursor_update(struct hse_kvs_cursor *handle, u64 seqno)
     return 0;
 }
 
-merr_t
-ikvs_cursor_seek(
+static merr_t
+ikvs_cursor_seek_impl(
     struct hse_kvs_cursor *handle,
     const void *           key,
     u32                    len,
@@ -1681,7 +2727,7 @@ ikvs_cursor_seek(
     void *                   kmin, *kmax;
     u32                      kmin_len, kmax_len, cn_klen;
     const void *             cnkey;
-    u64                      tstart;
+    u64                      tstart, sstart;
     u32                      active, total;
 
     if (limit_len > HSE_KVS_KLEN_MAX)
@@ -1759,8 +2805,10 @@ ikvs_cursor_seek(
     }
 
     tstart = perfc_lat_start(cursor->kci_cd_pc);
+    sstart = kvs_trace_stage_start();
     cursor->kci_err = c0_cursor_seek(
         cursor->kci_c0cur, key, len, handle->kc_filter.kcf_maxkey ? &handle->kc_filter : 0, 0);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_C0, sstart);
 
     if (ev(cursor->kci_err)) {
         if (merr_errno(cursor->kci_err) == EAGAIN)
@@ -1777,12 +2825,14 @@ ikvs_cursor_seek(
      */
 
     tstart = perfc_lat_start(cursor->kci_cd_pc);
+    sstart = kvs_trace_stage_start();
     cursor->kci_err = cn_cursor_seek(
         cursor->kci_cncur,
         cnkey,
         cn_klen,
         handle->kc_filter.kcf_maxkey ? &handle->kc_filter : 0,
         0);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_CN, sstart);
 
     if (ev(cursor->kci_err))
         return cursor->kci_err;
@@ -1844,6 +2894,29 @@ ikvs_cursor_seek(
     return 0;
 }
 
+merr_t
+ikvs_cursor_seek(
+    struct hse_kvs_cursor *handle,
+    const void *           key,
+    u32                    len,
+    const void *           limit,
+    u32                    limit_len,
+    struct kvs_ktuple *    kt)
+{
+    struct kvs_cursor_impl *cursor = (void *)handle;
+    struct ikvs *           kvs = cursor->kci_kvs;
+    struct kvs_trace        trace;
+    merr_t                  err;
+
+    if (!ikvs_trace_begin(kvs, &trace, KVS_TRACE_OP_CURSOR_SEEK))
+        return ikvs_cursor_seek_impl(handle, key, len, limit, limit_len, kt);
+
+    err = ikvs_cursor_seek_impl(handle, key, len, limit, limit_len, kt);
+    ikvs_trace_end(kvs, &trace);
+
+    return err;
+}
+
 static inline int
 pfx_cmp(struct kvs_cursor_impl *cursor)
 {
@@ -1857,11 +2930,12 @@ pfx_cmp(struct kvs_cursor_impl *cursor)
 static inline int
 cursor_cmp(struct kvs_cursor_impl *cursor)
 {
-    return keycmp(
+    return keycmp_fixed(
         cursor->kci_c0kv.kvt_key.kt_data,
         cursor->kci_c0kv.kvt_key.kt_len,
         cursor->kci_cnkv.kvt_key.kt_data,
-        cursor->kci_cnkv.kvt_key.kt_len);
+        cursor->kci_cnkv.kvt_key.kt_len,
+        cursor->kci_kfixed);
 }
 
 static merr_t
@@ -2092,11 +3166,52 @@ ikvs_cursor_replenish(struct kvs_cursor_impl *cursor, bool *eofp)
 }
 
 merr_t
-ikvs_cursor_read(struct hse_kvs_cursor *handle, struct kvs_kvtuple *kvt, bool *eofp)
+ikvs_cursor_pred(struct hse_kvs_cursor *handle, kvs_pred_fn *keyfn, kvs_pred_fn *valfn, void *arg)
 {
     struct kvs_cursor_impl *cursor = (void *)handle;
-    int                     oready;
-    int                     rc;
+
+    if (ev(valfn && cursor->kci_keys_only))
+        return merr(EINVAL);
+
+    cursor->kci_pred_key = keyfn;
+    cursor->kci_pred_val = valfn;
+    cursor->kci_pred_arg = arg;
+
+    if (cursor->kci_cncur)
+        cn_cursor_pred(cursor->kci_cncur, keyfn, valfn, arg);
+
+    return 0;
+}
+
+static bool
+ikvs_cursor_pred_match(struct kvs_cursor_impl *cursor, struct kvs_kvtuple *kvt)
+{
+    const void *key = kvt->kvt_key.kt_data;
+    size_t      klen = kvt->kvt_key.kt_len;
+    size_t      vlen = kvt->kvt_value.vt_len;
+
+    if (cursor->kci_pred_key && !cursor->kci_pred_key(cursor->kci_pred_arg, key, klen, NULL, vlen))
+        return false;
+
+    if (cursor->kci_pred_val &&
+        !cursor->kci_pred_val(cursor->kci_pred_arg, key, klen, kvt->kvt_value.vt_data, vlen))
+        return false;
+
+    return true;
+}
+
+/* Read the next pair, @oreadyp is set to the ready state from before the
+ * pair was consumed so that the caller can leave it unread.
+ */
+static merr_t
+ikvs_cursor_read_pair(
+    struct kvs_cursor_impl *cursor,
+    struct kvs_kvtuple *    kvt,
+    bool *                  eofp,
+    int *                   oreadyp)
+{
+    int oready;
+    int rc;
 
     if (ev(cursor->kci_err)) {
         if (ev(merr_errno(cursor->kci_err) != EAGAIN))
@@ -2105,6 +3220,7 @@ ikvs_cursor_read(struct hse_kvs_cursor *handle, struct kvs_kvtuple *kvt, bool *e
         cursor->kci_err = 0;
     }
 
+again:
     if (cursor->kci_ready != BIT_BOTH)
         cursor->kci_err = ikvs_cursor_replenish(cursor, eofp);
     else
@@ -2177,15 +3293,101 @@ ikvs_cursor_read(struct hse_kvs_cursor *handle, struct kvs_kvtuple *kvt, bool *e
 
     *kvt = *cursor->kci_last;
 
+    /* cn never resolves values for a key-only cursor, hide c0's too */
+    if (cursor->kci_keys_only)
+        kvt->kvt_value.vt_data = NULL;
+
+    /* cn runs the predicates in its merge loop, so only pairs from c0
+     * are filtered here.  A rejected pair is consumed even by a peek.
+     */
+    if (unlikely(cursor->kci_pred_key || cursor->kci_pred_val) && rc <= 0 &&
+        !ikvs_cursor_pred_match(cursor, kvt))
+        goto again;
+
     /* see comments in seek; do not change data state if peek */
     if (cursor->kci_peek) {
         cursor->kci_peek = 0;
         cursor->kci_ready = oready;
     }
 
+    *oreadyp = oready;
+
     return 0;
 }
 
+merr_t
+ikvs_cursor_read(struct hse_kvs_cursor *handle, struct kvs_kvtuple *kvt, bool *eofp)
+{
+    int oready;
+
+    return ikvs_cursor_read_pair((void *)handle, kvt, eofp, &oready);
+}
+
+merr_t
+ikvs_cursor_read_many(
+    struct hse_kvs_cursor *    handle,
+    void *                     buf,
+    size_t                     bufsz,
+    struct hse_kvs_cursor_rec *recv,
+    u32                        recc,
+    u32 *                      nread,
+    bool *                     eofp)
+{
+    struct kvs_cursor_impl *cursor = (void *)handle;
+    struct kvs_kvtuple      kvt;
+    size_t                  off = 0;
+    merr_t                  err = 0;
+    int                     oready;
+    u32                     n;
+
+    *eofp = false;
+
+    for (n = 0; n < recc; ++n) {
+        struct hse_kvs_cursor_rec *rec = recv + n;
+        size_t                     need;
+
+        err = ikvs_cursor_read_pair(cursor, &kvt, eofp, &oready);
+        if (ev(err) || *eofp)
+            break;
+
+        /* Key-only cursors store no value bytes in buf.  A pair that
+         * doesn't fit is left unread, as by a peek.
+         */
+        need = kvt.kvt_key.kt_len;
+        if (!cursor->kci_keys_only)
+            need += kvt.kvt_value.vt_len;
+
+        if (need > bufsz - off) {
+            cursor->kci_ready = oready;
+            cursor->kci_summary.util--;
+            break;
+        }
+
+        rec->kcr_key_off = off;
+        rec->kcr_key_len = kvt.kvt_key.kt_len;
+        memcpy(buf + off, kvt.kvt_key.kt_data, rec->kcr_key_len);
+        off += rec->kcr_key_len;
+
+        rec->kcr_val_off = off;
+        rec->kcr_val_len = kvt.kvt_value.vt_len;
+        if (!cursor->kci_keys_only) {
+            memcpy(buf + off, kvt.kvt_value.vt_data, rec->kcr_val_len);
+            off += rec->kcr_val_len;
+        }
+    }
+
+    /* Don't report EOF until the caller has consumed every pair.
+     */
+    if (n > 0)
+        *eofp = false;
+    else if (!err && !*eofp && recc > 0)
+        err = merr(EMSGSIZE);
+
+    *nread = n;
+
+    return err;
+}
+
 #undef bit_on
 
 static merr_t
@@ -8,6 +8,7 @@
 #include <hse_util/config.h>
 #include <hse_util/param.h>
 #include <hse_util/event_counter.h>
+#include <hse_util/compression.h>
 
 #include <hse/hse_limits.h>
 
@@ -30,6 +31,16 @@ static struct param_inst  kvs_cp_table[] = {
         "first level to spill with full hash (0=root)"),
     PARAM_INST_U32_EXP(kvs_cp_ref.cp_kvs_ext01, "kvs_ext01", "kvs_ext01"),
     PARAM_INST_U32(kvs_cp_ref.cp_sfx_len, "sfx_len", "Key suffix length"),
+    PARAM_INST_U32(kvs_cp_ref.cp_vcomp, "vcomp", "value compression (0=none, 1=lz4)"),
+    PARAM_INST_U32(kvs_cp_ref.cp_range, "range", "partition cN tree by key (0=hash, 1=range)"),
+    PARAM_INST_U32(
+        kvs_cp_ref.cp_ptlookup,
+        "ptlookup",
+        "hash index kblocks of a point-lookup-only kvs (0=no, 1=yes)"),
+    PARAM_INST_U32(
+        kvs_cp_ref.cp_kfixed,
+        "kfixed",
+        "length of all keys, compared as big-endian integers (0=variable, 8, 16)"),
     PARAM_INST_END
 };
 
@@ -52,6 +63,10 @@ kvs_cparams_defaults(void)
                                  .cp_pfx_len = 0,
                                  .cp_pfx_pivot = 2, /* only used when pfx_len > 0 */
                                  .cp_kvs_ext01 = 0,
+                                 .cp_vcomp = VCOMP_ALGO_NONE,
+                                 .cp_range = 0,
+                                 .cp_ptlookup = 0,
+                                 .cp_kfixed = 0,
                                  .cp_cpmagic = CPARAMS_MAGIC };
 
     return params;
@@ -146,6 +161,47 @@ kvs_cparams_validate(struct kvs_cparams *cparams)
         return EINVAL;
     }
 
+    /* Validate value compression algorithm */
+    if (cparams->cp_vcomp > VCOMP_ALGO_MAX) {
+        hse_log(
+            HSE_ERR "Invalid KVS value compression (%u),"
+                    " cannot be greater than %u",
+            cparams->cp_vcomp,
+            VCOMP_ALGO_MAX);
+        return EINVAL;
+    }
+
+    /* Range partitioning splits the tree on whole keys, suffixed
+     * keys must instead share a leaf with their siblings.
+     */
+    if (cparams->cp_range > 1 || (cparams->cp_range && cparams->cp_sfx_len)) {
+        hse_log(
+            HSE_ERR "Invalid KVS range (%u) for suffix length (%u),"
+                    " must be 0 or 1 and 0 if sfx_len is set",
+            cparams->cp_range,
+            cparams->cp_sfx_len);
+        return EINVAL;
+    }
+
+    /* The kblock hash index is keyed by the hash of the whole key, which
+     * lookups in a suffixed kvs do not have.
+     */
+    if (cparams->cp_ptlookup > 1 || (cparams->cp_ptlookup && cparams->cp_sfx_len)) {
+        hse_log(
+            HSE_ERR "Invalid KVS ptlookup (%u) for suffix length (%u),"
+                    " must be 0 or 1 and 0 if sfx_len is set",
+            cparams->cp_ptlookup,
+            cparams->cp_sfx_len);
+        return EINVAL;
+    }
+
+    if (cparams->cp_kfixed != 0 && cparams->cp_kfixed != 8 && cparams->cp_kfixed != 16) {
+        hse_log(
+            HSE_ERR "Invalid KVS fixed key length (%u), must be 0, 8 or 16",
+            cparams->cp_kfixed);
+        return EINVAL;
+    }
+
     return 0;
 }
 
@@ -11,6 +11,8 @@
 #include <hse_util/param.h>
 #include <hse_util/rest_api.h>
 
+#include <hse/hse_limits.h>
+
 #include <hse_ikvdb/kvs_rparams.h>
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/c0_kvset.h>
@@ -39,6 +41,12 @@ kvs_rparams_defaults(void)
 {
     struct kvs_rparams k = {
         .kvs_debug = 0,
+        .kvs_vcache_mb = 0,
+        .kvs_vcache_vmax = 1024,
+        .kvs_trace_sample = 0,
+        .kvs_flight_us = 10000,
+        .kvs_ttl = 0,
+        .kvs_durable = 1,
 
         .cn_maint_disable = 0,
         .cn_diag_mode = 0,
@@ -47,13 +55,25 @@ kvs_rparams_defaults(void)
         .cn_bloom_prob = 10000,
         .cn_bloom_capped = 0,
         .cn_bloom_preload = 0,
+        .cn_bloom_pfx = 0,
+        .cn_bloom_batch = 0,
 
         .cn_node_size_lo = 20 * 1024,
         .cn_node_size_hi = 28 * 1024,
+        .cn_size_ratio = 4,
 
         .cn_compact_vblk_ra = 256 * 1024,
+        .cn_compact_vblk_qd = 4,
+        .cn_compact_direct = 0,
+        .cn_compact_noreuse = 0,
+        .cn_compact_subc = 1,
         .cn_compact_kblk_ra = 512 * 1024,
         .cn_compact_vra = 128 * 1024,
+        .cn_compact_ckpt_mb = 4096,
+        .cn_compact_weight = 100,
+        .cn_compact_rate_min = 0,
+        .throttle_weight = 100,
+        .throttle_rate_min = 0,
 
         .c0_cursor_ttl = 1000,
 
@@ -64,8 +84,14 @@ kvs_rparams_defaults(void)
         .cn_cursor_vra = 8 * 1024,
         .cn_cursor_kra = 0,
         .cn_cursor_seq = 0,
+        .cn_cursor_noreuse = 0,
 
         .cn_mcache_wbt = 0,
+        .cn_icache_mb = 0,
+        .cn_pin_lvl = 0,
+        .cn_pin_mb = 1024,
+        .cn_mcache_thp = 0,
+        .cn_mcache_populate = 0,
         .cn_mcache_vmin = 256,
         .cn_mcache_vmax = 4096,
 
@@ -81,13 +107,20 @@ kvs_rparams_defaults(void)
 
         .cn_compaction_debug = 0,
         .cn_media_class = MP_MED_STAGING,
+        .cn_kblk_mclass_map = CN_MCLASS_MAP_UNSET,
+        .cn_vblk_mclass_map = CN_MCLASS_MAP_UNSET,
         .cn_io_threads = 13,
+        .cn_lazy_open = 0,
         .cn_maint_delay = 100,
         .cn_close_wait = 0,
 
         .cn_verify = 0,
         .cn_kcachesz = 1024 * 1024,
+        .cn_kblk_model = 1,
         .kblock_size_mb = 32,
+        .kblock_fcode = 0,
+        .kblock_lcomp_lvl = 0,
+        .kblock_ival_max = CN_SMALL_VALUE_THRESHOLD,
         .vblock_size_mb = 32,
 
         .capped_evict_ttl = 120,
@@ -111,15 +144,31 @@ kvs_rparams_defaults(void)
 static struct kvs_rparams kvs_rp_ref;
 static struct param_inst  kvs_rp_table[] = {
     KVS_PARAM_EXP(kvs_debug, "enable kvs debugging"),
+    KVS_PARAM_EXP(kvs_vcache_mb, "hot value cache size (MiB), 0 to disable, unused with kvs_ttl"),
+    KVS_PARAM_EXP(kvs_vcache_vmax, "max length of a value in the value cache"),
+    KVS_PARAM_EXP(kvs_trace_sample, "trace one in this many gets and cursor ops, 0 to disable"),
+    KVS_PARAM_EXP(kvs_flight_us, "record ops slower than this (usecs) in the flight recorder, 0 to disable"),
+    KVS_PARAM_EXP(kvs_ttl, "time-to-live (secs) of the entries ingested into cn, 0=none"),
+    KVS_PARAM_EXP(kvs_durable, "0: skip c1, a crash loses what was not ingested into cn"),
 
     KVS_PARAM_EXP(c0_cursor_ttl, "cached c0 cursor time-to-live (ms)"),
 
     KVS_PARAM_EXP(cn_node_size_lo, "low end of max node size range (MiB)"),
     KVS_PARAM_EXP(cn_node_size_hi, "high end of max node size range (MiB)"),
+    KVS_PARAM_EXP(cn_size_ratio, "size ratio of hybrid csched tiers and levels"),
 
     KVS_PARAM_EXP(cn_compact_vblk_ra, "compaction vblk read-ahead (bytes)"),
+    KVS_PARAM_EXP(cn_compact_vblk_qd, "concurrent reads per compaction vblk read-ahead"),
+    KVS_PARAM_EXP(cn_compact_direct, "root spills read mblocks instead of mcache maps"),
+    KVS_PARAM_EXP(cn_compact_noreuse, "mcache compactions release the pages they consumed"),
+    KVS_PARAM_EXP(cn_compact_subc, "max concurrent key-range subcompactions per kcompaction"),
     KVS_PARAM_EXP(cn_compact_vra, "compaction vblk read-ahead via mcache"),
     KVS_PARAM_EXP(cn_compact_kblk_ra, "compaction kblk read-ahead (bytes)"),
+    KVS_PARAM_EXP(cn_compact_ckpt_mb, "spill output (MiB) between spill checkpoints, 0=off"),
+    KVS_PARAM_EXP(cn_compact_weight, "share of compaction workers relative to other kvs [1..1000]"),
+    KVS_PARAM_EXP(cn_compact_rate_min, "guaranteed compaction write rate (MiB/s), 0=none"),
+    KVS_PARAM_EXP(throttle_weight, "share of the throttled put rate vs. other kvs [1..1000]"),
+    KVS_PARAM_EXP(throttle_rate_min, "guaranteed put rate while throttled (MiB/s), 0=none"),
 
     KVS_PARAM_EXP(cn_capped_ttl, "cn cursor cache TTL (ms) for capped kvs"),
     KVS_PARAM_EXP(cn_capped_vra, "capped cursor vblk madvise-ahead (bytes)"),
@@ -128,11 +177,20 @@ static struct param_inst  kvs_rp_table[] = {
     KVS_PARAM_EXP(cn_cursor_vra, "cursor vblk madvise-ahead (bytes)"),
     KVS_PARAM_EXP(cn_cursor_kra, "cursor kblk madvise-ahead (boolean)"),
     KVS_PARAM_EXP(cn_cursor_seq, "optimize cn_tree for longer sequential cursor accesses"),
+    KVS_PARAM_EXP(cn_cursor_noreuse, "cursors release the pages they consumed (boolean)"),
 
     KVS_PARAM_EXP(
         cn_mcache_wbt,
         "eagerly cache wbt nodes"
         " (1:internal, 2:leaves, 3:both)"),
+    KVS_PARAM_EXP(cn_icache_mb, "wbt index node cache size (MiB), 0 to disable"),
+    KVS_PARAM_EXP(cn_pin_lvl, "pin blooms and wbt index nodes of this many cn levels"),
+    KVS_PARAM_EXP(cn_pin_mb, "max memory (MiB) pinned per cn by cn_pin_lvl"),
+    KVS_PARAM_EXP(cn_mcache_thp, "advise transparent huge pages for kblock maps (boolean)"),
+    KVS_PARAM_EXP(
+        cn_mcache_populate,
+        "populate index regions of new kvsets"
+        " (1:blooms and wbt internal nodes, 2:plus wbt leaves)"),
 
     KVS_PARAM_EXP(
         cn_mcache_vminlvl,
@@ -152,7 +210,10 @@ static struct param_inst  kvs_rp_table[] = {
 
     KVS_PARAM_EXP(cn_diag_mode, "enable/disable cn diag mode"),
     KVS_PARAM_EXP(cn_maint_disable, "disable cn maintenance"),
-    KVS_PARAM_EXP(cn_bloom_create, "enable bloom creation"),
+    KVS_PARAM_EXP(
+        cn_bloom_create,
+        "control bloom creation"
+        " (0:off, 1:k-probe, 2:split-block)"),
     KVS_PARAM_EXP(
         cn_bloom_lookup,
         "control bloom lookup"
@@ -160,19 +221,28 @@ static struct param_inst  kvs_rp_table[] = {
     KVS_PARAM_EXP(cn_bloom_prob, "bloom create probability"),
     KVS_PARAM_EXP(cn_bloom_capped, "bloom create probability (capped kvs)"),
     KVS_PARAM_EXP(cn_bloom_preload, "preload mcache bloom filters"),
+    KVS_PARAM_EXP(cn_bloom_pfx, "add tree prefixes to bloom filters"),
+    KVS_PARAM_EXP(cn_bloom_batch, "batch bloom probes in nodes with this many kvsets (0=off)"),
 
     KVS_PARAM_EXP(cn_compaction_debug, "cn compaction debug flags"),
     KVS_PARAM_EXP(cn_maint_delay, "ms of delay between checks when idle"),
     KVS_PARAM_EXP(cn_media_class, "preferred media class for all of cn"),
+    KVS_PARAM_EXP(cn_kblk_mclass_map, "cn levels whose kblocks go to capacity (bit n: level n)"),
+    KVS_PARAM_EXP(cn_vblk_mclass_map, "cn levels whose vblocks go to capacity (bit n: level n)"),
     KVS_PARAM_EXP(cn_io_threads, "number of cn mblock i/o threads"),
+    KVS_PARAM_EXP(cn_lazy_open, "map vblocks of restored kvsets on first access"),
     KVS_PARAM_EXP(
         cn_close_wait,
         "force close to wait until all active"
         " compactions have completed"),
 
     KVS_PARAM_EXP(cn_verify, "verify kvsets as they are created"),
-    KVS_PARAM_EXP(cn_kcachesz, "max per-kvset key cache size (in bytes)"),
+    KVS_PARAM_EXP(cn_kcachesz, "obsolete, kblock min/max keys are always cached"),
+    KVS_PARAM_EXP(cn_kblk_model, "predict the kblock to search in large kvsets"),
     KVS_PARAM_EXP(kblock_size_mb, "preferred kblock size (in MiB)"),
+    KVS_PARAM_EXP(kblock_fcode, "front-code keys in kblock leaf nodes"),
+    KVS_PARAM_EXP(kblock_lcomp_lvl, "compress kblock leaf nodes from this cn level down (0=off)"),
+    KVS_PARAM_EXP(kblock_ival_max, "max length of values stored inline in kblocks"),
     KVS_PARAM_EXP(vblock_size_mb, "preferred vblock size (in MiB)"),
 
     KVS_PARAM_EXP(capped_evict_ttl, "capped vblock TTL (seconds)"),
@@ -192,6 +262,7 @@ static struct param_inst  kvs_rp_table[] = {
 
 static char const *const kvs_rp_writable[] = {
     "kvs_debug", "cn_mcache_vmax", "cn_compaction_debug", "cn_maint_disable", "cn_compact_kblk_ra",
+    "kvs_trace_sample", "kvs_flight_us",
 };
 
 void
@@ -288,6 +359,16 @@ kvs_rparams_validate(struct kvs_rparams *params)
         return merr_errno(merr(ev(EINVAL)));
     }
 
+    if (params->cn_size_ratio < 2 || params->cn_size_ratio > 32) {
+        hse_log(HSE_ERR "cn_size_ratio must be in the range [2, 32]");
+        return merr_errno(merr(ev(EINVAL)));
+    }
+
+    if (params->cn_bloom_create > 2) {
+        hse_log(HSE_ERR "cn_bloom_create must be 0, 1 or 2");
+        return merr_errno(merr(ev(EINVAL)));
+    }
+
     if (params->cn_maint_delay < 20) {
         hse_log(HSE_ERR "cn_maint_delay must be greater than 20ms");
         return merr_errno(merr(ev(EINVAL)));
@@ -304,6 +385,14 @@ kvs_rparams_validate(struct kvs_rparams *params)
         return merr_errno(merr(ev(EINVAL)));
     }
 
+    if (params->kblock_ival_max > CN_IVAL_MAX) {
+        hse_log(
+            HSE_ERR "kblock_ival_max(%lu) must not exceed %u",
+            (ulong)params->kblock_ival_max,
+            CN_IVAL_MAX);
+        return merr_errno(merr(ev(EINVAL)));
+    }
+
     sz = params->vblock_size_mb << 20;
     if (sz < VBLOCK_MIN_SIZE || sz > VBLOCK_MAX_SIZE) {
         hse_log(
@@ -336,6 +425,14 @@ kvs_rparams_validate(struct kvs_rparams *params)
         return merr_errno(merr(ev(EINVAL)));
     }
 
+    if (params->kvs_vcache_vmax > HSE_KVS_VLEN_MAX) {
+        hse_log(
+            HSE_ERR "kvs_vcache_vmax(%lu) must not exceed %u",
+            (ulong)params->kvs_vcache_vmax,
+            HSE_KVS_VLEN_MAX);
+        return merr_errno(merr(ev(EINVAL)));
+    }
+
     if (!params->vblock_asyncio_ctxswi) {
         hse_log(HSE_ERR "vblock asyncio context switch cannot be zero");
         return merr_errno(merr(ev(EINVAL)));
@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/minmax.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/mutex.h>
+#include <hse_util/barrier.h>
+#include <hse_util/list.h>
+#include <hse_util/printbuf.h>
+#include <hse_util/event_counter.h>
+
+#include <hse_ikvdb/kvs_trace.h>
+#include <hse_ikvdb/tuple.h>
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+/**
+ * struct kvs_trace_ring - most recent traces of a kvs
+ * @ktr_lock:   protects all fields
+ * @ktr_head:   number of traces ever saved
+ * @ktr_tracev: traces, %ktr_head modulo KVS_TRACE_RING_SZ is the next slot
+ */
+struct kvs_trace_ring {
+    spinlock_t       ktr_lock;
+    u64              ktr_head;
+    struct kvs_trace ktr_tracev[KVS_TRACE_RING_SZ];
+};
+
+/**
+ * struct kvs_flight_slot - one slot of a flight recorder ring
+ * @kfs_seq:   number of the trace in the slot, 0 while it is being written
+ * @kfs_trace: trace
+ */
+struct kvs_flight_slot {
+    atomic64_t       kfs_seq;
+    struct kvs_trace kfs_trace;
+};
+
+/**
+ * struct kvs_flight_ring - flight recorder ring of one thread
+ * @kfr_link:  link on kvs_flight_list
+ * @kfr_owned: true while the ring belongs to a live thread
+ * @kfr_head:  number of traces ever saved (written by the owner only)
+ * @kfr_slotv: traces, %kfr_head modulo KVS_FLIGHT_RING_SZ is the next slot
+ *
+ * The owner saves traces without locking.  Readers validate each slot
+ * by reading its sequence number before and after copying the trace.
+ * The ring of an exited thread is kept (so that its traces can still be
+ * read) and is reused by the next thread that needs one.
+ */
+struct kvs_flight_ring {
+    struct list_head       kfr_link;
+    atomic_t               kfr_owned;
+    u64                    kfr_head;
+    struct kvs_flight_slot kfr_slotv[KVS_FLIGHT_RING_SZ];
+};
+
+__thread struct kvs_trace *kvs_trace_cur;
+struct kvs_flight_env      kvs_flight_env;
+
+static __thread ulong                   kvs_trace_tick;
+static __thread long                    kvs_trace_minflt;
+static __thread long                    kvs_trace_majflt;
+static __thread struct kvs_flight_ring *kvs_flight_ring;
+
+static DEFINE_MUTEX(kvs_flight_lock);
+static struct list_head kvs_flight_list = { &kvs_flight_list, &kvs_flight_list };
+static pthread_once_t kvs_flight_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  kvs_flight_key;
+static int            kvs_flight_key_rc;
+
+merr_t
+kvs_trace_ring_create(struct kvs_trace_ring **ringp)
+{
+    struct kvs_trace_ring *ring;
+
+    ring = calloc(1, sizeof(*ring));
+    if (ev(!ring))
+        return merr(ENOMEM);
+
+    spin_lock_init(&ring->ktr_lock);
+
+    *ringp = ring;
+
+    return 0;
+}
+
+void
+kvs_trace_ring_destroy(struct kvs_trace_ring *ring)
+{
+    free(ring);
+}
+
+uint
+kvs_trace_ring_read(struct kvs_trace_ring *ring, struct kvs_trace *tracev, uint tracec)
+{
+    u64  first;
+    uint i, n;
+
+    spin_lock(&ring->ktr_lock);
+    n = min_t(u64, ring->ktr_head, min_t(uint, tracec, KVS_TRACE_RING_SZ));
+    first = ring->ktr_head - n;
+
+    for (i = 0; i < n; ++i)
+        tracev[i] = ring->ktr_tracev[(first + i) % KVS_TRACE_RING_SZ];
+    spin_unlock(&ring->ktr_lock);
+
+    return n;
+}
+
+static void
+kvs_flight_dtor(void *arg)
+{
+    struct kvs_flight_ring *ring = arg;
+
+    atomic_set(&ring->kfr_owned, 0);
+}
+
+static void
+kvs_flight_key_create(void)
+{
+    kvs_flight_key_rc = pthread_key_create(&kvs_flight_key, kvs_flight_dtor);
+}
+
+/* Get a ring for the calling thread, preferably one left by an exited
+ * thread.
+ */
+static struct kvs_flight_ring *
+kvs_flight_ring_get(void)
+{
+    struct kvs_flight_ring *ring;
+
+    pthread_once(&kvs_flight_once, kvs_flight_key_create);
+    if (ev(kvs_flight_key_rc))
+        return NULL;
+
+    mutex_lock(&kvs_flight_lock);
+    list_for_each_entry (ring, &kvs_flight_list, kfr_link) {
+        if (atomic_cmpxchg(&ring->kfr_owned, 0, 1) == 0)
+            goto found;
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if (ev(!ring)) {
+        mutex_unlock(&kvs_flight_lock);
+        return NULL;
+    }
+
+    atomic_set(&ring->kfr_owned, 1);
+    list_add_tail(&ring->kfr_link, &kvs_flight_list);
+
+found:
+    mutex_unlock(&kvs_flight_lock);
+
+    if (ev(pthread_setspecific(kvs_flight_key, ring))) {
+        atomic_set(&ring->kfr_owned, 0);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static void
+kvs_flight_save(const struct kvs_trace *trace)
+{
+    struct kvs_flight_ring *ring = kvs_flight_ring;
+    struct kvs_flight_slot *slot;
+    u64                     seq;
+
+    if (unlikely(!ring)) {
+        ring = kvs_flight_ring = kvs_flight_ring_get();
+        if (!ring)
+            return;
+    }
+
+    seq = ++ring->kfr_head;
+    slot = ring->kfr_slotv + seq % KVS_FLIGHT_RING_SZ;
+
+    atomic64_set(&slot->kfs_seq, 0);
+    smp_wmb();
+    slot->kfs_trace = *trace;
+    smp_wmb();
+    atomic64_set(&slot->kfs_seq, seq);
+}
+
+static int
+kvs_trace_cmp(const void *lhs, const void *rhs)
+{
+    const struct kvs_trace *l = lhs;
+    const struct kvs_trace *r = rhs;
+
+    return (l->kt_time > r->kt_time) - (l->kt_time < r->kt_time);
+}
+
+uint
+kvs_flight_read(struct kvs_trace *tracev, uint tracec)
+{
+    struct kvs_flight_ring *ring;
+    struct kvs_flight_slot *slot;
+    struct kvs_trace        trace, tmp;
+    uint                    n, i, j;
+    u64                     seq;
+
+    n = 0;
+
+    mutex_lock(&kvs_flight_lock);
+    list_for_each_entry (ring, &kvs_flight_list, kfr_link) {
+        for (i = 0; i < KVS_FLIGHT_RING_SZ; ++i) {
+            slot = ring->kfr_slotv + i;
+
+            seq = atomic64_read(&slot->kfs_seq);
+            smp_rmb();
+            trace = slot->kfs_trace;
+            smp_rmb();
+
+            if (!seq || seq != atomic64_read(&slot->kfs_seq))
+                continue;
+
+            if (n < tracec) {
+                tracev[n++] = trace;
+                continue;
+            }
+
+            /* %tracev is full, keep the newest %tracec traces.
+             */
+            for (j = 0; j < n; ++j) {
+                if (tracev[j].kt_time < trace.kt_time) {
+                    tmp = tracev[j];
+                    tracev[j] = trace;
+                    trace = tmp;
+                }
+            }
+        }
+    }
+    mutex_unlock(&kvs_flight_lock);
+
+    qsort(tracev, n, sizeof(*tracev), kvs_trace_cmp);
+
+    return n;
+}
+
+bool
+kvs_trace_begin(struct kvs_trace *trace, enum kvs_trace_op op, ulong sample, ulong flight_ns)
+{
+    struct rusage ru;
+    bool          sampled;
+
+    if (kvs_trace_cur)
+        return false;
+
+    sampled = sample && !(++kvs_trace_tick % sample);
+    if (likely(!sampled && !flight_ns))
+        return false;
+
+    memset(trace, 0, sizeof(*trace));
+    trace->kt_op = op;
+    trace->kt_served = KVS_TRACE_STAGE_MAX;
+    trace->kt_sampled = sampled;
+
+    if (sampled && !getrusage(RUSAGE_THREAD, &ru)) {
+        kvs_trace_minflt = ru.ru_minflt;
+        kvs_trace_majflt = ru.ru_majflt;
+    }
+
+    trace->kt_time = get_time_ns();
+    kvs_trace_cur = trace;
+
+    return true;
+}
+
+void
+kvs_trace_end(struct kvs_trace *trace, struct kvs_trace_ring *ring, ulong flight_ns)
+{
+    struct rusage ru;
+
+    assert(kvs_trace_cur == trace);
+
+    kvs_trace_cur = NULL;
+    trace->kt_total = get_time_ns() - trace->kt_time;
+
+    if (flight_ns && trace->kt_total >= flight_ns) {
+        trace->kt_ingests = atomic_read(&kvs_flight_env.kfe_ingests);
+        trace->kt_comps = atomic_read(&kvs_flight_env.kfe_comps);
+        trace->kt_throttle = atomic_read(&kvs_flight_env.kfe_throttle);
+    }
+
+    if (trace->kt_sampled) {
+        if (!getrusage(RUSAGE_THREAD, &ru)) {
+            trace->kt_minflt = ru.ru_minflt - kvs_trace_minflt;
+            trace->kt_majflt = ru.ru_majflt - kvs_trace_majflt;
+        }
+
+        if (ring) {
+            spin_lock(&ring->ktr_lock);
+            ring->ktr_tracev[ring->ktr_head++ % KVS_TRACE_RING_SZ] = *trace;
+            spin_unlock(&ring->ktr_lock);
+        }
+    }
+
+    if (flight_ns && trace->kt_total >= flight_ns)
+        kvs_flight_save(trace);
+}
+
+static const char *
+kvs_trace_res2str(u8 res)
+{
+    switch (res) {
+        case NOT_FOUND:
+            return "not_found";
+        case FOUND_VAL:
+            return "found_val";
+        case FOUND_TMB:
+            return "found_tomb";
+        case FOUND_PTMB:
+            return "found_ptomb";
+        case FOUND_MULTIPLE:
+            return "found_multiple";
+    }
+
+    return "none";
+}
+
+size_t
+kvs_trace_fmt(const struct kvs_trace *t, char *buf, size_t bufsz)
+{
+    static const char *const opv[] = { "get", "cursor_init", "cursor_seek", "put", "del" };
+    static const char *const stagev[] = { "c0", "vcache", "cn", "throttle", "none" };
+
+    size_t b, buf_off;
+
+    buf_off = 0;
+    b = snprintf_append(buf, bufsz, &buf_off, "  - op: %s\n", opv[t->kt_op]);
+    if (t->kt_op == KVS_TRACE_OP_GET) {
+        b += snprintf_append(buf, bufsz, &buf_off, "    served: %s\n", stagev[t->kt_served]);
+        b += snprintf_append(buf, bufsz, &buf_off, "    res: %s\n", kvs_trace_res2str(t->kt_res));
+    }
+    b += snprintf_append(buf, bufsz, &buf_off, "    time: %lu\n", t->kt_time);
+    b += snprintf_append(buf, bufsz, &buf_off, "    cnid: %lu\n", t->kt_cnid);
+    if (t->kt_hash)
+        b += snprintf_append(buf, bufsz, &buf_off, "    hash: 0x%lx\n", t->kt_hash);
+    b += snprintf_append(buf, bufsz, &buf_off, "    total_ns: %lu\n", t->kt_total);
+    b += snprintf_append(
+        buf, bufsz, &buf_off, "    c0_ns: %lu\n", t->kt_stagev[KVS_TRACE_STAGE_C0]);
+    b += snprintf_append(
+        buf, bufsz, &buf_off, "    vcache_ns: %lu\n", t->kt_stagev[KVS_TRACE_STAGE_VCACHE]);
+    b += snprintf_append(
+        buf, bufsz, &buf_off, "    cn_ns: %lu\n", t->kt_stagev[KVS_TRACE_STAGE_CN]);
+    b += snprintf_append(
+        buf, bufsz, &buf_off, "    throttle_ns: %lu\n", t->kt_stagev[KVS_TRACE_STAGE_THROTTLE]);
+    b += snprintf_append(buf, bufsz, &buf_off, "    c0_kvms: %u\n", t->kt_c0kvms);
+    b += snprintf_append(buf, bufsz, &buf_off, "    c0_neg: %u\n", t->kt_c0_neg);
+    b += snprintf_append(buf, bufsz, &buf_off, "    cn_nodes: %u\n", t->kt_cnnodes);
+    b += snprintf_append(buf, bufsz, &buf_off, "    kvsets: %u\n", t->kt_kvsets);
+    b += snprintf_append(buf, bufsz, &buf_off, "    bloom_neg: %u\n", t->kt_bloom_neg);
+    b += snprintf_append(buf, bufsz, &buf_off, "    bloom_pos: %u\n", t->kt_bloom_pos);
+    b += snprintf_append(buf, bufsz, &buf_off, "    bloom_fp: %u\n", t->kt_bloom_fp);
+
+    b += snprintf_append(buf, bufsz, &buf_off, "    ingests: %u\n", t->kt_ingests);
+    b += snprintf_append(buf, bufsz, &buf_off, "    comps: %u\n", t->kt_comps);
+    b += snprintf_append(buf, bufsz, &buf_off, "    throttle: %u\n", t->kt_throttle);
+
+    /* Page faults are not counted in flight traces.
+     */
+    if (t->kt_sampled) {
+        b += snprintf_append(buf, bufsz, &buf_off, "    minflt: %u\n", t->kt_minflt);
+        b += snprintf_append(buf, bufsz, &buf_off, "    majflt: %u\n", t->kt_majflt);
+    }
+
+    return b;
+}
@@ -0,0 +1,389 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse/kvdb_perfc.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/slab.h>
+#include <hse_util/list.h>
+#include <hse_util/log2.h>
+#include <hse_util/minmax.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/perfc.h>
+
+#include <hse_ikvdb/tuple.h>
+
+#include "kvs_vcache.h"
+
+#define KVS_VCACHE_SHARDS (16)
+
+/**
+ * struct vc_entry - a cached value
+ * @ve_next:  next entry in hash chain
+ * @ve_lru:   shard lru linkage
+ * @ve_hash:  key hash (kt_hash)
+ * @ve_dgen:  cn ingest dgen at fill
+ * @ve_seqno: view seqno of the lookup that filled this entry
+ * @ve_klen:  key length
+ * @ve_vlen:  value length
+ * @ve_data:  key followed by value
+ */
+struct vc_entry {
+    struct vc_entry *ve_next;
+    struct list_head ve_lru;
+    u64              ve_hash;
+    u64              ve_dgen;
+    u64              ve_seqno;
+    u32              ve_klen;
+    u32              ve_vlen;
+    char             ve_data[];
+};
+
+struct vc_shard {
+    spinlock_t        vs_lock;
+    size_t            vs_size;
+    u64               vs_hits;
+    u64               vs_misses;
+    struct list_head  vs_lru;
+    struct vc_entry **vs_bktv;
+} __aligned(SMP_CACHE_BYTES);
+
+struct kvs_vcache {
+    size_t            vc_shard_cap;
+    u32               vc_vmax;
+    u32               vc_bktmask;
+    struct perfc_set *vc_pc;
+    struct vc_shard   vc_shardv[KVS_VCACHE_SHARDS];
+};
+
+static inline struct vc_shard *
+vc_shard(struct kvs_vcache *vc, u64 hash)
+{
+    return vc->vc_shardv + ((hash >> 32) % KVS_VCACHE_SHARDS);
+}
+
+static inline size_t
+vc_entry_size(const struct vc_entry *ve)
+{
+    return sizeof(*ve) + ve->ve_klen + ve->ve_vlen;
+}
+
+/* Find the chain link that refers to the entry for the given key.
+ * Caller must hold the shard lock.
+ */
+static struct vc_entry **
+vc_find(struct kvs_vcache *vc, struct vc_shard *vs, const struct kvs_ktuple *kt)
+{
+    struct vc_entry **pp;
+
+    pp = vs->vs_bktv + (kt->kt_hash & vc->vc_bktmask);
+
+    for (; *pp; pp = &(*pp)->ve_next) {
+        struct vc_entry *ve = *pp;
+
+        if (ve->ve_hash == kt->kt_hash && ve->ve_klen == kt->kt_len &&
+            !memcmp(ve->ve_data, kt->kt_data, kt->kt_len))
+            break;
+    }
+
+    return pp;
+}
+
+/* Unlink the entry referred to by @pp.  Caller must hold the shard lock.
+ */
+static struct vc_entry *
+vc_unlink(struct vc_shard *vs, struct vc_entry **pp)
+{
+    struct vc_entry *ve = *pp;
+
+    *pp = ve->ve_next;
+    list_del(&ve->ve_lru);
+    vs->vs_size -= vc_entry_size(ve);
+
+    return ve;
+}
+
+static void
+vc_free_chain(struct vc_entry *ve)
+{
+    while (ve) {
+        struct vc_entry *next = ve->ve_next;
+
+        free(ve);
+        ve = next;
+    }
+}
+
+/* Unlink least recently used entries other than @keep until the shard
+ * fits its capacity, and chain them onto *@victims.  Caller must hold
+ * the shard lock.
+ */
+static u64
+vc_evict(struct kvs_vcache *vc, struct vc_shard *vs, struct vc_entry *keep, struct vc_entry **victims)
+{
+    struct vc_entry *old;
+    u64              evicted = 0;
+
+    while (vs->vs_size > vc->vc_shard_cap && !list_empty(&vs->vs_lru)) {
+        struct kvs_ktuple vkt;
+
+        old = list_last_entry(&vs->vs_lru, struct vc_entry, ve_lru);
+        if (old == keep)
+            break;
+
+        vkt.kt_data = old->ve_data;
+        vkt.kt_len = old->ve_klen;
+        vkt.kt_hash = old->ve_hash;
+
+        old = vc_unlink(vs, vc_find(vc, vs, &vkt));
+        old->ve_next = *victims;
+        *victims = old;
+        ++evicted;
+    }
+
+    return evicted;
+}
+
+merr_t
+kvs_vcache_create(size_t capacity, u32 vmax, struct perfc_set *pc, struct kvs_vcache **vcp)
+{
+    struct kvs_vcache *vc;
+    size_t             nbkts;
+    int                i;
+
+    if (ev(!vcp || !capacity))
+        return merr(EINVAL);
+
+    *vcp = NULL;
+
+    vc = alloc_aligned(sizeof(*vc), __alignof(*vc), GFP_KERNEL);
+    if (ev(!vc))
+        return merr(ENOMEM);
+
+    memset(vc, 0, sizeof(*vc));
+    vc->vc_shard_cap = capacity / KVS_VCACHE_SHARDS;
+    vc->vc_vmax = vmax;
+    vc->vc_pc = pc;
+
+    /* Size the hash tables for roughly one entry per bucket given
+     * entries of a few hundred bytes.
+     */
+    nbkts = roundup_pow_of_two(max_t(size_t, vc->vc_shard_cap / 256, 64));
+    vc->vc_bktmask = nbkts - 1;
+
+    for (i = 0; i < KVS_VCACHE_SHARDS; ++i) {
+        struct vc_shard *vs = vc->vc_shardv + i;
+
+        spin_lock_init(&vs->vs_lock);
+        INIT_LIST_HEAD(&vs->vs_lru);
+
+        vs->vs_bktv = calloc(nbkts, sizeof(*vs->vs_bktv));
+        if (ev(!vs->vs_bktv)) {
+            kvs_vcache_destroy(vc);
+            return merr(ENOMEM);
+        }
+    }
+
+    *vcp = vc;
+
+    return 0;
+}
+
+void
+kvs_vcache_destroy(struct kvs_vcache *vc)
+{
+    int i;
+
+    if (!vc)
+        return;
+
+    for (i = 0; i < KVS_VCACHE_SHARDS; ++i) {
+        struct vc_shard *vs = vc->vc_shardv + i;
+        struct vc_entry *ve, *next;
+
+        list_for_each_entry_safe (ve, next, &vs->vs_lru, ve_lru)
+            free(ve);
+
+        free(vs->vs_bktv);
+    }
+
+    free_aligned(vc);
+}
+
+bool
+kvs_vcache_get(
+    struct kvs_vcache *      vc,
+    const struct kvs_ktuple *kt,
+    u64                      dgen,
+    u64                      seqno,
+    struct kvs_buf *         vbuf)
+{
+    struct vc_shard * vs = vc_shard(vc, kt->kt_hash);
+    struct vc_entry **pp, *ve, *stale = NULL;
+    bool              hit = false;
+
+    spin_lock(&vs->vs_lock);
+    pp = vc_find(vc, vs, kt);
+    ve = *pp;
+
+    if (ve) {
+        if (ve->ve_dgen < dgen) {
+            stale = vc_unlink(vs, pp);
+            stale->ve_next = NULL;
+        } else if (ve->ve_dgen == dgen && seqno >= ve->ve_seqno) {
+            u32 copylen = min_t(u32, ve->ve_vlen, vbuf->b_buf_sz);
+
+            if (copylen > 0)
+                memcpy(vbuf->b_buf, ve->ve_data + ve->ve_klen, copylen);
+            vbuf->b_len = ve->ve_vlen;
+
+            list_del(&ve->ve_lru);
+            list_add(&ve->ve_lru, &vs->vs_lru);
+            hit = true;
+        }
+    }
+
+    if (hit)
+        ++vs->vs_hits;
+    else
+        ++vs->vs_misses;
+    spin_unlock(&vs->vs_lock);
+
+    vc_free_chain(stale);
+
+    perfc_inc(vc->vc_pc, hit ? PERFC_BA_VC_HIT : PERFC_BA_VC_MISS);
+
+    return hit;
+}
+
+void
+kvs_vcache_insert(
+    struct kvs_vcache *      vc,
+    const struct kvs_ktuple *kt,
+    u64                      dgen,
+    u64                      seqno,
+    const void *             val,
+    u32                      vlen)
+{
+    struct vc_shard * vs = vc_shard(vc, kt->kt_hash);
+    struct vc_entry **pp, *ve, *old, *victims = NULL;
+    u64               evicted = 0;
+
+    if (vlen > vc->vc_vmax)
+        return;
+
+    ve = malloc(sizeof(*ve) + kt->kt_len + vlen);
+    if (ev(!ve))
+        return;
+
+    ve->ve_hash = kt->kt_hash;
+    ve->ve_dgen = dgen;
+    ve->ve_seqno = seqno;
+    ve->ve_klen = kt->kt_len;
+    ve->ve_vlen = vlen;
+    memcpy(ve->ve_data, kt->kt_data, kt->kt_len);
+    if (vlen > 0)
+        memcpy(ve->ve_data + kt->kt_len, val, vlen);
+
+    spin_lock(&vs->vs_lock);
+    pp = vc_find(vc, vs, kt);
+    if (*pp) {
+        old = *pp;
+
+        /* Keep the existing entry if it is of a newer dgen, or if it
+         * serves at least as many views as the new one.
+         */
+        if (old->ve_dgen > dgen || (old->ve_dgen == dgen && old->ve_seqno <= seqno)) {
+            spin_unlock(&vs->vs_lock);
+            free(ve);
+            return;
+        }
+
+        old = vc_unlink(vs, pp);
+        old->ve_next = victims;
+        victims = old;
+    }
+
+    ve->ve_next = vs->vs_bktv[kt->kt_hash & vc->vc_bktmask];
+    vs->vs_bktv[kt->kt_hash & vc->vc_bktmask] = ve;
+    list_add(&ve->ve_lru, &vs->vs_lru);
+    vs->vs_size += vc_entry_size(ve);
+
+    evicted = vc_evict(vc, vs, ve, &victims);
+    spin_unlock(&vs->vs_lock);
+
+    vc_free_chain(victims);
+
+    perfc_inc(vc->vc_pc, PERFC_BA_VC_INSERT);
+    if (evicted)
+        perfc_add(vc->vc_pc, PERFC_BA_VC_EVICT, evicted);
+}
+
+void
+kvs_vcache_invalidate(struct kvs_vcache *vc, const struct kvs_ktuple *kt)
+{
+    struct vc_shard * vs = vc_shard(vc, kt->kt_hash);
+    struct vc_entry **pp, *ve = NULL;
+
+    spin_lock(&vs->vs_lock);
+    pp = vc_find(vc, vs, kt);
+    if (*pp) {
+        ve = vc_unlink(vs, pp);
+        ve->ve_next = NULL;
+    }
+    spin_unlock(&vs->vs_lock);
+
+    if (ve) {
+        free(ve);
+        perfc_inc(vc->vc_pc, PERFC_BA_VC_INVAL);
+    }
+}
+
+void
+kvs_vcache_usage(struct kvs_vcache *vc, struct kvs_vcache_usage *usage)
+{
+    int i;
+
+    memset(usage, 0, sizeof(*usage));
+    usage->vcu_capacity = vc->vc_shard_cap * KVS_VCACHE_SHARDS;
+
+    for (i = 0; i < KVS_VCACHE_SHARDS; ++i) {
+        struct vc_shard *vs = vc->vc_shardv + i;
+
+        spin_lock(&vs->vs_lock);
+        usage->vcu_size += vs->vs_size;
+        usage->vcu_hits += vs->vs_hits;
+        usage->vcu_misses += vs->vs_misses;
+        spin_unlock(&vs->vs_lock);
+    }
+}
+
+void
+kvs_vcache_resize(struct kvs_vcache *vc, size_t capacity)
+{
+    u64 evicted = 0;
+    int i;
+
+    /* The hash tables keep the size they were created with, a larger
+     * capacity just lengthens the chains.
+     */
+    vc->vc_shard_cap = max_t(size_t, capacity / KVS_VCACHE_SHARDS, 1);
+
+    for (i = 0; i < KVS_VCACHE_SHARDS; ++i) {
+        struct vc_shard *vs = vc->vc_shardv + i;
+        struct vc_entry *victims = NULL;
+
+        spin_lock(&vs->vs_lock);
+        evicted += vc_evict(vc, vs, NULL, &victims);
+        spin_unlock(&vs->vs_lock);
+
+        vc_free_chain(victims);
+    }
+
+    if (evicted)
+        perfc_add(vc->vc_pc, PERFC_BA_VC_EVICT, evicted);
+}
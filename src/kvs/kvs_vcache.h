@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_KVS_KVS_VCACHE_H
+#define HSE_KVS_KVS_VCACHE_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+struct kvs_ktuple;
+struct kvs_buf;
+struct perfc_set;
+
+/* The value cache holds copies of values recently retrieved from cn so that
+ * repeated gets of hot keys need not descend the cn tree.  It caches only cn
+ * results, and is consulted only after c0 has missed.
+ *
+ * Each entry is tagged with the cn ingest dgen at which it was filled and the
+ * view seqno of the lookup that filled it.  An entry is served only if cn has
+ * not ingested since, and only to views at least as new as the fill view.  The
+ * caller must only fill entries for views at or above the max seqno ingested
+ * into cn (see cn_get_ingest_seqno()), so that any such view would have found
+ * the same value in cn.  The caller also advances the dgen it passes in when
+ * cn commits a compaction whose filter dropped or replaced values (see
+ * cn_get_cfilter_gen()).
+ */
+struct kvs_vcache;
+
+/**
+ * struct kvs_vcache_usage - value cache occupancy and effectiveness
+ * @vcu_capacity: max bytes of keys and values
+ * @vcu_size:     bytes of keys and values currently cached
+ * @vcu_hits:     lookups served since create
+ * @vcu_misses:   lookups not served since create
+ */
+struct kvs_vcache_usage {
+    size_t vcu_capacity;
+    size_t vcu_size;
+    u64    vcu_hits;
+    u64    vcu_misses;
+};
+
+/**
+ * kvs_vcache_create() - create a value cache
+ * @capacity: max bytes of keys and values to cache
+ * @vmax:     max length of a cacheable value
+ * @pc:       perf counter set (PERFC_EN_VC), may be NULL
+ * @vcp:      (output) value cache handle
+ */
+merr_t
+kvs_vcache_create(size_t capacity, u32 vmax, struct perfc_set *pc, struct kvs_vcache **vcp);
+
+/**
+ * kvs_vcache_destroy() - release a value cache and all its entries
+ * @vc: value cache handle
+ */
+void
+kvs_vcache_destroy(struct kvs_vcache *vc);
+
+/**
+ * kvs_vcache_get() - look up a key in the value cache
+ * @vc:    value cache handle
+ * @kt:    key (kt_hash must be valid)
+ * @dgen:  cn ingest dgen read before the c0 lookup
+ * @seqno: view seqno
+ * @vbuf:  (output) value, copied as by cn_get()
+ *
+ * Return: true if the value was found and copied into @vbuf
+ */
+bool
+kvs_vcache_get(
+    struct kvs_vcache *      vc,
+    const struct kvs_ktuple *kt,
+    u64                      dgen,
+    u64                      seqno,
+    struct kvs_buf *         vbuf);
+
+/**
+ * kvs_vcache_insert() - add or replace a value in the value cache
+ * @vc:    value cache handle
+ * @kt:    key (kt_hash must be valid)
+ * @dgen:  cn ingest dgen read before the c0 lookup
+ * @seqno: view seqno of the cn lookup that produced @val
+ * @val:   value
+ * @vlen:  length of @val
+ *
+ * Values longer than the cache's vmax are ignored.
+ */
+void
+kvs_vcache_insert(
+    struct kvs_vcache *      vc,
+    const struct kvs_ktuple *kt,
+    u64                      dgen,
+    u64                      seqno,
+    const void *             val,
+    u32                      vlen);
+
+/**
+ * kvs_vcache_invalidate() - remove a key from the value cache
+ * @vc: value cache handle
+ * @kt: key (kt_hash must be valid)
+ */
+void
+kvs_vcache_invalidate(struct kvs_vcache *vc, const struct kvs_ktuple *kt);
+
+/**
+ * kvs_vcache_usage() - report the occupancy and hit counts of the cache
+ * @vc:    value cache handle
+ * @usage: (output) usage
+ */
+void
+kvs_vcache_usage(struct kvs_vcache *vc, struct kvs_vcache_usage *usage);
+
+/**
+ * kvs_vcache_resize() - change the capacity of the cache
+ * @vc:       value cache handle
+ * @capacity: new max bytes of keys and values
+ *
+ * Shrinking evicts least recently used entries right away.
+ */
+void
+kvs_vcache_resize(struct kvs_vcache *vc, size_t capacity);
+
+#endif
@@ -3,8 +3,7 @@
  * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
  */
 
-#include <hse_util/page.h>
-#include <hse_util/slab.h>
+#include <hse_util/scratch.h>
 #include <hse_util/keycmp.h>
 #include <hse_util/byteorder.h>
 #include <hse_util/assert.h>
@@ -12,109 +11,13 @@
 
 #include <hse_ikvdb/query_ctx.h>
 
-pthread_key_t tomb_thread_key;
-
-/**
- * struct te_mem - Memory for tomb elems
- * @pglist:  list of all pages that constitute this memory.
- * @curr_pg: current page in use.
- */
-struct te_mem {
-    void *pglist;
-    void *curr_pg;
-};
-
-/**
- * struct te_page_hdr - Header at the beginning of each page in the memory
- *                      region's page list
- * @next: pointer to the next page header.
+/* Tomb elems live in the calling thread's scratch arena, and are released
+ * en masse by the caller when the query completes (see ikvs_pfx_probe()).
  */
-struct te_page_hdr {
-    struct te_page_hdr *next;
-};
-
-void
-qctx_thread_dtor(void *mem)
-{
-    struct te_mem *     tem = mem;
-    struct te_page_hdr *hdr;
-
-    hdr = tem->pglist;
-    while (hdr) {
-        struct te_page_hdr *next = hdr->next;
-
-        free_page((unsigned long)hdr);
-        hdr = next;
-    }
-
-    free(tem);
-}
-
 static struct tomb_elem *
-alloc_tomb_mem(struct query_ctx *qctx, size_t bytes)
+alloc_tomb_mem(size_t bytes)
 {
-    struct tomb_elem *  te;
-    size_t              sz = sizeof(*te) + bytes;
-    struct te_mem *     ptr;
-    struct te_page_hdr *hdr;
-    unsigned int        min_offset = (sizeof(*hdr) + 0x0f) & (~0x0e);
-
-    ptr = pthread_getspecific(tomb_thread_key);
-
-    if (qctx->pos < min_offset)
-        qctx->pos = min_offset;
-
-    if (!ptr) {
-        int rc;
-
-        ptr = malloc(sizeof(*ptr));
-        if (!ptr)
-            return 0;
-
-        ptr->pglist = (void *)__get_free_page(GFP_KERNEL);
-        if (!ptr->pglist) {
-            free(ptr);
-            return 0;
-        }
-
-        ptr->curr_pg = ptr->pglist;
-        hdr = ptr->curr_pg;
-        hdr->next = 0;
-        qctx->pos = min_offset;
-
-        rc = pthread_setspecific(tomb_thread_key, ptr);
-        if (ev(rc)) {
-            free_page((unsigned long)ptr->pglist);
-            free(ptr);
-            return 0;
-        }
-
-    } else if (qctx->pos + sz > PAGE_SIZE) {
-        hdr = ptr->curr_pg;
-        if (hdr->next) {
-            /* The there is a cached page that can be used */
-            hdr = hdr->next;
-        } else {
-            /* No more cached pages. Allocate and use a new page */
-            void *mem;
-
-            mem = (void *)__get_free_page(GFP_KERNEL);
-            if (!mem)
-                return 0;
-
-            hdr->next = mem;
-            hdr = mem;
-            hdr->next = 0;
-        }
-
-        ptr->curr_pg = hdr;
-        qctx->pos = min_offset;
-    }
-
-    te = (void *)(ptr->curr_pg + qctx->pos);
-    qctx->pos += (sz + 0x08) & ~0x07;
-
-    return te;
+    return scratch_alloc(sizeof(struct tomb_elem) + bytes, __alignof(struct tomb_elem));
 }
 
 static __always_inline int
@@ -176,7 +79,7 @@ qctx_tomb_insert(struct query_ctx *qctx, const void *sfx, size_t sfx_len)
     } else {
         struct tomb_elem *te;
 
-        te = alloc_tomb_mem(qctx, sfx_len);
+        te = alloc_tomb_mem(sfx_len);
         if (ev(!te))
             return merr(ENOMEM);
 
@@ -226,23 +129,3 @@ qctx_tomb_seen(struct query_ctx *qctx, const void *sfx, size_t sfx_len)
 
     return false;
 }
-
-merr_t
-qctx_te_mem_init(void)
-{
-    int rc;
-
-    rc = pthread_key_create(&tomb_thread_key, &qctx_thread_dtor);
-    return merr(ev(rc));
-}
-
-void
-qctx_te_mem_reset(void)
-{
-    struct te_mem *ptr;
-
-    /* reset current page pointer for use by the next call */
-    ptr = pthread_getspecific(tomb_thread_key);
-    if (ptr)
-        ptr->curr_pg = ptr->pglist;
-}
@@ -86,6 +86,74 @@ MTF_DEFINE_UTEST(kvs_cparams, validate)
     err = kvs_cparams_validate(&kvs_cp);
     ASSERT_EQ(merr_errno(err), EINVAL);
 
+    /* range partitioning */
+    char *argv5[] = { "range=1" };
+    int   argc5 = sizeof(argv5) / sizeof(*argv5);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc5, argv5, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(kvs_cp.cp_range, 1);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(err, 0);
+
+    /* range partitioning of suffixed keys */
+    char *argv6[] = { "range=1", "sfx_len=4" };
+    int   argc6 = sizeof(argv6) / sizeof(*argv6);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc6, argv6, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(merr_errno(err), EINVAL);
+
+    /* point-lookup-only */
+    char *argv7[] = { "ptlookup=1" };
+    int   argc7 = sizeof(argv7) / sizeof(*argv7);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc7, argv7, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(kvs_cp.cp_ptlookup, 1);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(err, 0);
+
+    /* point-lookup-only with suffixed keys */
+    char *argv8[] = { "ptlookup=1", "sfx_len=4" };
+    int   argc8 = sizeof(argv8) / sizeof(*argv8);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc8, argv8, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(merr_errno(err), EINVAL);
+
+    /* fixed length keys */
+    char *argv9[] = { "kfixed=16" };
+    int   argc9 = sizeof(argv9) / sizeof(*argv9);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc9, argv9, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(kvs_cp.cp_kfixed, 16);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(err, 0);
+
+    char *argv10[] = { "kfixed=12" };
+    int   argc10 = sizeof(argv10) / sizeof(*argv10);
+
+    next = 0;
+    kvs_cp = kvs_cparams_defaults();
+    err = kvs_cparams_parse(argc10, argv10, &kvs_cp, &next);
+    ASSERT_EQ(err, 0);
+    err = kvs_cparams_validate(&kvs_cp);
+    ASSERT_EQ(merr_errno(err), EINVAL);
+
     /* NULL arg */
     err = kvs_cparams_validate(NULL);
     ASSERT_EQ(merr_errno(err), EINVAL);
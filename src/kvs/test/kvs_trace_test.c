@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/time.h>
+
+#include <hse_ikvdb/kvs_trace.h>
+
+#include <pthread.h>
+
+MTF_BEGIN_UTEST_COLLECTION(kvs_trace)
+
+MTF_DEFINE_UTEST(kvs_trace, sample)
+{
+    struct kvs_trace_ring *ring;
+    struct kvs_trace       trace, tracev[KVS_TRACE_RING_SZ];
+    merr_t                 err;
+    uint                   n, i;
+
+    err = kvs_trace_ring_create(&ring);
+    ASSERT_EQ(err, 0);
+
+    ASSERT_FALSE(kvs_trace_begin(&trace, KVS_TRACE_OP_GET, 0, 0));
+    ASSERT_EQ(NULL, kvs_trace_cur);
+
+    /* Every operation is traced when the sample rate is 1, and the
+     * layers below record into the current trace.
+     */
+    ASSERT_TRUE(kvs_trace_begin(&trace, KVS_TRACE_OP_GET, 1, 0));
+    ASSERT_EQ(&trace, kvs_trace_cur);
+
+    KVS_TRACE_INC(kt_kvsets);
+    KVS_TRACE_ADD(kt_kvsets, 2);
+    kvs_trace_stage_end(KVS_TRACE_STAGE_CN, kvs_trace_stage_start());
+
+    kvs_trace_end(&trace, ring, 0);
+    ASSERT_EQ(NULL, kvs_trace_cur);
+
+    KVS_TRACE_INC(kt_kvsets);
+    ASSERT_EQ(3, trace.kt_kvsets);
+
+    n = kvs_trace_ring_read(ring, tracev, NELEM(tracev));
+    ASSERT_EQ(1, n);
+    ASSERT_EQ(3, tracev[0].kt_kvsets);
+    ASSERT_EQ(KVS_TRACE_STAGE_MAX, tracev[0].kt_served);
+
+    /* One in four operations is traced, and the ring keeps the newest.
+     */
+    for (i = 0; i < 4 * (KVS_TRACE_RING_SZ + 10); ++i) {
+        if (kvs_trace_begin(&trace, KVS_TRACE_OP_CURSOR_SEEK, 4, 0)) {
+            trace.kt_c0kvms = i;
+            kvs_trace_end(&trace, ring, 0);
+        }
+    }
+
+    n = kvs_trace_ring_read(ring, tracev, NELEM(tracev));
+    ASSERT_EQ(KVS_TRACE_RING_SZ, n);
+    for (i = 1; i < n; ++i)
+        ASSERT_EQ(tracev[i - 1].kt_c0kvms + 4, tracev[i].kt_c0kvms);
+
+    kvs_trace_ring_destroy(ring);
+}
+
+static void *
+flight_thread(void *arg)
+{
+    struct kvs_trace trace;
+    int              i;
+
+    /* Every operation is traced, only the slow ones are saved.
+     */
+    for (i = 0; i < 2 * KVS_FLIGHT_RING_SZ; ++i) {
+        if (!kvs_trace_begin(&trace, KVS_TRACE_OP_PUT, 0, NSEC_PER_SEC))
+            return (void *)1;
+
+        trace.kt_cnid = (uintptr_t)arg;
+        trace.kt_hash = i;
+        if (i % 2)
+            trace.kt_time -= 2 * NSEC_PER_SEC;
+
+        kvs_trace_end(&trace, NULL, NSEC_PER_SEC);
+    }
+
+    return NULL;
+}
+
+MTF_DEFINE_UTEST(kvs_trace, flight)
+{
+    struct kvs_trace *tracev;
+    pthread_t         tidv[4];
+    uint              n, i, j;
+    void *            ret;
+    int               rc;
+
+    tracev = malloc(KVS_FLIGHT_DUMP_MAX * sizeof(*tracev));
+    ASSERT_NE(NULL, tracev);
+
+    atomic_set(&kvs_flight_env.kfe_comps, 3);
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_create(tidv + i, NULL, flight_thread, (void *)(uintptr_t)(i + 1));
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_join(tidv[i], &ret);
+        ASSERT_EQ(0, rc);
+        ASSERT_EQ(NULL, ret);
+    }
+
+    /* The rings of exited threads can still be read.  Each thread saved
+     * one ring's worth of slow operations.
+     */
+    n = kvs_flight_read(tracev, KVS_FLIGHT_DUMP_MAX);
+    ASSERT_EQ(NELEM(tidv) * KVS_FLIGHT_RING_SZ, n);
+
+    for (i = 0; i < n; ++i) {
+        ASSERT_EQ(KVS_TRACE_OP_PUT, tracev[i].kt_op);
+        ASSERT_EQ(1, tracev[i].kt_hash % 2);
+        ASSERT_GE(tracev[i].kt_total, NSEC_PER_SEC);
+        ASSERT_EQ(3, tracev[i].kt_comps);
+        ASSERT_FALSE(tracev[i].kt_sampled);
+        if (i > 0)
+            ASSERT_LE(tracev[i - 1].kt_time, tracev[i].kt_time);
+    }
+
+    /* Only the newest are kept when the output is too small.
+     */
+    j = kvs_flight_read(tracev, 10);
+    ASSERT_EQ(10, j);
+    for (i = 1; i < j; ++i)
+        ASSERT_LE(tracev[i - 1].kt_time, tracev[i].kt_time);
+
+    /* A new thread reuses the ring of an exited thread.
+     */
+    rc = pthread_create(tidv, NULL, flight_thread, (void *)(uintptr_t)1);
+    ASSERT_EQ(0, rc);
+    rc = pthread_join(tidv[0], NULL);
+    ASSERT_EQ(0, rc);
+
+    ASSERT_EQ(n, kvs_flight_read(tracev, KVS_FLIGHT_DUMP_MAX));
+
+    atomic_set(&kvs_flight_env.kfe_comps, 0);
+    free(tracev);
+}
+
+MTF_END_UTEST_COLLECTION(kvs_trace)
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+#include <hse_util/hse_err.h>
+
+#include <hse_ikvdb/tuple.h>
+#include <hse_ikvdb/key_hash.h>
+
+#include "../kvs_vcache.h"
+
+static void
+make_key(struct kvs_ktuple *kt, char *buf, size_t bufsz, int i)
+{
+    int len;
+
+    len = snprintf(buf, bufsz, "key%06d", i);
+    kvs_ktuple_init(kt, buf, len);
+}
+
+MTF_BEGIN_UTEST_COLLECTION(kvs_vcache)
+
+MTF_DEFINE_UTEST(kvs_vcache, basic)
+{
+    struct kvs_vcache *vc;
+    struct kvs_ktuple  kt;
+    struct kvs_buf     vbuf;
+    char               kbuf[32], val[64];
+    bool               hit;
+    merr_t             err;
+
+    err = kvs_vcache_create(0, 128, NULL, &vc);
+    ASSERT_NE(err, 0);
+
+    err = kvs_vcache_create(1 << 20, 128, NULL, &vc);
+    ASSERT_EQ(err, 0);
+
+    make_key(&kt, kbuf, sizeof(kbuf), 1);
+    kvs_buf_init(&vbuf, val, sizeof(val));
+
+    hit = kvs_vcache_get(vc, &kt, 1, 10, &vbuf);
+    ASSERT_FALSE(hit);
+
+    kvs_vcache_insert(vc, &kt, 1, 10, "value1", 6);
+
+    hit = kvs_vcache_get(vc, &kt, 1, 10, &vbuf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(vbuf.b_len, 6);
+    ASSERT_EQ(0, memcmp(val, "value1", 6));
+
+    /* Newer views hit, older views miss. */
+    hit = kvs_vcache_get(vc, &kt, 1, 11, &vbuf);
+    ASSERT_TRUE(hit);
+    hit = kvs_vcache_get(vc, &kt, 1, 9, &vbuf);
+    ASSERT_FALSE(hit);
+
+    /* Short buffers are filled as far as possible. */
+    kvs_buf_init(&vbuf, val, 2);
+    hit = kvs_vcache_get(vc, &kt, 1, 10, &vbuf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(vbuf.b_len, 6);
+
+    /* An ingest (new dgen) retires the entry. */
+    kvs_buf_init(&vbuf, val, sizeof(val));
+    hit = kvs_vcache_get(vc, &kt, 2, 10, &vbuf);
+    ASSERT_FALSE(hit);
+    hit = kvs_vcache_get(vc, &kt, 1, 10, &vbuf);
+    ASSERT_FALSE(hit);
+
+    /* Fills from an older dgen do not displace newer entries, while
+     * fills from a newer dgen replace older entries.
+     */
+    kvs_vcache_insert(vc, &kt, 2, 10, "value1", 6);
+    kvs_vcache_insert(vc, &kt, 1, 10, "value0", 6);
+    hit = kvs_vcache_get(vc, &kt, 2, 10, &vbuf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(0, memcmp(val, "value1", 6));
+
+    kvs_vcache_insert(vc, &kt, 3, 12, "value2", 6);
+    hit = kvs_vcache_get(vc, &kt, 3, 12, &vbuf);
+    ASSERT_TRUE(hit);
+    ASSERT_EQ(0, memcmp(val, "value2", 6));
+
+    kvs_vcache_invalidate(vc, &kt);
+    hit = kvs_vcache_get(vc, &kt, 3, 12, &vbuf);
+    ASSERT_FALSE(hit);
+
+    /* Values longer than vmax are not cached. */
+    kvs_vcache_insert(vc, &kt, 3, 12, val, 129);
+    hit = kvs_vcache_get(vc, &kt, 3, 12, &vbuf);
+    ASSERT_FALSE(hit);
+
+    kvs_vcache_destroy(vc);
+}
+
+MTF_DEFINE_UTEST(kvs_vcache, evict)
+{
+    struct kvs_vcache *vc;
+    struct kvs_ktuple  kt;
+    struct kvs_buf     vbuf;
+    char               kbuf[32], val[64];
+    int                i, hits;
+    merr_t             err;
+
+    /* Small enough that most of the inserts below must be evicted. */
+    err = kvs_vcache_create(64 * 1024, 64, NULL, &vc);
+    ASSERT_EQ(err, 0);
+
+    memset(val, 'v', sizeof(val));
+
+    for (i = 0; i < 10000; ++i) {
+        make_key(&kt, kbuf, sizeof(kbuf), i);
+        kvs_vcache_insert(vc, &kt, 1, 1, val, sizeof(val));
+    }
+
+    kvs_buf_init(&vbuf, val, sizeof(val));
+
+    for (i = hits = 0; i < 10000; ++i) {
+        make_key(&kt, kbuf, sizeof(kbuf), i);
+        hits += kvs_vcache_get(vc, &kt, 1, 1, &vbuf);
+    }
+
+    ASSERT_GT(hits, 0);
+    ASSERT_LT(hits, 10000);
+
+    /* The most recent insert is always retained. */
+    make_key(&kt, kbuf, sizeof(kbuf), 9999);
+    ASSERT_TRUE(kvs_vcache_get(vc, &kt, 1, 1, &vbuf));
+
+    kvs_vcache_destroy(vc);
+}
+
+MTF_END_UTEST_COLLECTION(kvs_vcache);
@@ -27,11 +27,46 @@
 #include "../c1/c1_diag.h"
 #include "../c1/c1_omf_internal.h"
 
+#include "mdc_scan.h"
+
 BullseyeCoverageSaveOff static char *prog;
 static bool                          verbose;
 static bool                          ascii_fmt;
 static bool                          dump_key;
 static bool                          dump_value;
+static bool                          summary;
+
+static struct mdc_scan_range cnid_range;
+static struct mdc_scan_range seqno_range;
+static struct mdc_scan_range txid_range;
+
+struct c1log_cn {
+    u64 cnid;
+    u64 keys;
+    u64 vals;
+};
+
+/* The records and tuples counted by -s, after the filters. */
+static struct {
+    u64             jrnlv[C1_TYPE_END];
+    u64             kvlogs;
+    u64             kvbs;
+    u64             txns;
+    u64             keys;
+    u64             keybytes;
+    u64             vals;
+    u64             valbytes;
+    u64             tombs;
+    u64             mblkvals;
+    u64             seqno_min;
+    u64             seqno_max;
+    u64             txid_min;
+    u64             txid_max;
+    bool            seqno_set;
+    bool            txid_set;
+    uint            cnc;
+    struct c1log_cn cnv[HSE_KVS_COUNT_MAX];
+} sum;
 
 static void
 fatal(const char *fmt, ...)
@@ -61,16 +96,108 @@ usage(char *prog, bool verbose)
 {
     printf(
         "usage: %s [options] kvdb\n"
-        "-A  dump key/value in binary format\n"
-        "-h  print this help message\n"
-        "-K  dump key\n"
-        "-V  dump value(s)\n"
-        "-v  verbose output\n",
+        "-A                dump key/value in binary format\n"
+        "-C cnid[-cnid]    only keys of these cnids\n"
+        "-h                print this help message\n"
+        "-K                dump key\n"
+        "-S seqno[-seqno]  only values and txns with these seqnos\n"
+        "-s                print a JSON summary instead of the records\n"
+        "-T txid[-txid]    only kv bundles and txns of these transactions\n"
+        "-V                dump value(s)\n"
+        "-v                verbose output\n"
+        "\n"
+        "A range may be open on either side, e.g. -S 1000- or -T -42.\n",
         prog);
 
     return 1;
 }
 
+static void
+summary_seqno(u64 seqno)
+{
+    if (!sum.seqno_set || seqno < sum.seqno_min)
+        sum.seqno_min = seqno;
+    if (!sum.seqno_set || seqno > sum.seqno_max)
+        sum.seqno_max = seqno;
+    sum.seqno_set = true;
+}
+
+static void
+summary_txid(u64 txid)
+{
+    if (!sum.txid_set || txid < sum.txid_min)
+        sum.txid_min = txid;
+    if (!sum.txid_set || txid > sum.txid_max)
+        sum.txid_max = txid;
+    sum.txid_set = true;
+}
+
+static struct c1log_cn *
+summary_cn(u64 cnid)
+{
+    uint i;
+
+    for (i = 0; i < sum.cnc; i++)
+        if (sum.cnv[i].cnid == cnid)
+            return sum.cnv + i;
+
+    if (sum.cnc == NELEM(sum.cnv))
+        return NULL;
+
+    sum.cnv[sum.cnc].cnid = cnid;
+
+    return sum.cnv + sum.cnc++;
+}
+
+static void
+summary_print(void)
+{
+    static const char *jrnlv[C1_TYPE_END] = {
+        [C1_TYPE_VERSION] = "version", [C1_TYPE_INFO] = "info",         [C1_TYPE_DESC] = "desc",
+        [C1_TYPE_INGEST] = "ingest",   [C1_TYPE_COMPLETE] = "complete", [C1_TYPE_RESET] = "reset",
+        [C1_TYPE_CLOSE] = "close",
+    };
+    const char *sep = "";
+    uint        i;
+
+    printf("{\"journal\": {");
+    for (i = 0; i < NELEM(jrnlv); i++) {
+        if (jrnlv[i]) {
+            printf("%s\"%s\": %lu", sep, jrnlv[i], sum.jrnlv[i]);
+            sep = ", ";
+        }
+    }
+
+    printf(
+        "}, \"kvlogs\": %lu, \"kvbs\": %lu, \"txns\": %lu, \"keys\": %lu"
+        ", \"key_bytes\": %lu, \"values\": %lu, \"value_bytes\": %lu"
+        ", \"tombs\": %lu, \"mblock_values\": %lu, \"seqno_min\": %lu"
+        ", \"seqno_max\": %lu, \"txid_min\": %lu, \"txid_max\": %lu, \"cns\": [",
+        sum.kvlogs,
+        sum.kvbs,
+        sum.txns,
+        sum.keys,
+        sum.keybytes,
+        sum.vals,
+        sum.valbytes,
+        sum.tombs,
+        sum.mblkvals,
+        sum.seqno_min,
+        sum.seqno_max,
+        sum.txid_min,
+        sum.txid_max);
+
+    for (i = 0; i < sum.cnc; i++)
+        printf(
+            "%s{\"cnid\": %lu, \"keys\": %lu, \"values\": %lu}",
+            i ? ", " : "",
+            sum.cnv[i].cnid,
+            sum.cnv[i].keys,
+            sum.cnv[i].vals);
+
+    printf("]}\n");
+}
+
 static void
 print_line(char *fmt, ...)
 {
@@ -223,6 +350,12 @@ c1log_journal_replay_cb(struct c1 *c1, u32 cmd, void *rec, void *rec2)
 
     err = 0;
 
+    if (summary) {
+        if (cmd < NELEM(sum.jrnlv))
+            sum.jrnlv[cmd]++;
+        return 0;
+    }
+
     switch (cmd) {
         case C1_TYPE_VERSION:
             err = c1log_journal_version(c1, rec);
@@ -270,6 +403,11 @@ c1log_log_replay_kvlog(struct c1 *c1, char *kvlomf, u64 oid)
     if (ev(err))
         return err;
 
+    if (summary) {
+        sum.kvlogs++;
+        return 0;
+    }
+
     printf(
         "c1 log kvlog oid 0x%lx MDC oid 0x%lx-0x%lx "
         "tree_ver 0x%lx gen 0x%lx size %ld\n",
@@ -294,6 +432,16 @@ c1log_log_replay_txn(struct c1 *c1, char *omf)
     if (ev(err))
         return err;
 
+    if (!mdc_scan_range_match(&txid_range, ttxn.c1txn_id) ||
+        !mdc_scan_range_match(&seqno_range, ttxn.c1txn_kvseqno))
+        return 0;
+
+    if (summary) {
+        sum.txns++;
+        summary_txid(ttxn.c1txn_id);
+        return 0;
+    }
+
     printf(
         "c1 log txn seqno 0x%lx gen 0x%lx txnid 0x%lx "
         "kvseqno 0x%lx mutno 0x%lx cmd 0x%lx flag 0x%lx\n",
@@ -327,7 +475,7 @@ c1_log_print_kvtuple(char *data, u64 len, bool ascii)
 }
 
 static merr_t
-c1_log_print_ktuple(char *kvtomf, struct c1_kvtuple_meta *kvtm, u16 ver)
+c1_log_print_ktuple(char *kvtomf, struct c1_kvtuple_meta *kvtm, u16 ver, bool *show)
 {
     char * key;
     merr_t err;
@@ -336,7 +484,9 @@ c1_log_print_ktuple(char *kvtomf, struct c1_kvtuple_meta *kvtm, u16 ver)
     if (ev(err))
         return err;
 
-    if (!verbose)
+    *show = mdc_scan_range_match(&cnid_range, kvtm->c1kvm_cnid);
+
+    if (!verbose || !*show || summary)
         return 0;
 
     printf(
@@ -443,7 +593,7 @@ c1_log_get_mblk_value(struct c1 *c1, char *omf, struct c1log_mblk *mblk, char **
 }
 
 static merr_t
-c1_log_print_vtuple(struct c1 *c1, u64 n, char *vtomf, struct c1_vtuple_meta *vtm)
+c1_log_print_vtuple(struct c1 *c1, u64 n, char *vtomf, struct c1_vtuple_meta *vtm, bool *show)
 {
     struct c1log_mblk  mblk = {};
     struct c1log_mblk *mblkp;
@@ -455,7 +605,9 @@ c1_log_print_vtuple(struct c1 *c1, u64 n, char *vtomf, struct c1_vtuple_meta *vt
     if (ev(err))
         return err;
 
-    if (!verbose)
+    *show = *show && mdc_scan_range_match(&seqno_range, vtm->c1vm_seqno);
+
+    if (!verbose || !*show || summary)
         return 0;
 
     printf(
@@ -499,7 +651,9 @@ c1_log_replay_kvtuple(struct c1 *c1, void **nextkey)
 {
     struct c1_kvtuple_meta kvtm;
     struct c1_vtuple_meta  vtm;
+    struct c1log_cn *      cn = NULL;
 
+    bool   keyshow, show;
     char * kvtomf;
     char * vtomf;
     u64    i;
@@ -512,13 +666,22 @@ c1_log_replay_kvtuple(struct c1 *c1, void **nextkey)
         return merr(EINVAL);
     }
 
-    c1_log_print_ktuple(kvtomf, &kvtm, c1->c1_version);
+    c1_log_print_ktuple(kvtomf, &kvtm, c1->c1_version, &keyshow);
 
     if (kvtm.c1kvm_sign != C1_KEY_MAGIC) {
         printf("Invalid ktuple signature\n");
         return merr(EINVAL);
     }
 
+    if (summary && keyshow) {
+        sum.keys++;
+        sum.keybytes += kvtm.c1kvm_klen;
+
+        cn = summary_cn(kvtm.c1kvm_cnid);
+        if (cn)
+            cn->keys++;
+    }
+
     value = kvtm.c1kvm_data + kvtm.c1kvm_klen;
 
     for (i = 0; i < kvtm.c1kvm_vcount; i++) {
@@ -526,13 +689,24 @@ c1_log_replay_kvtuple(struct c1 *c1, void **nextkey)
 
         vtomf = value;
 
-        c1_log_print_vtuple(c1, i, vtomf, &vtm);
+        show = keyshow;
+        c1_log_print_vtuple(c1, i, vtomf, &vtm, &show);
 
         if (vtm.c1vm_vlen && (vtm.c1vm_sign != C1_VAL_MAGIC)) {
             printf("Invalid vtuple signature\n");
             return merr(EINVAL);
         }
 
+        if (summary && show) {
+            sum.vals++;
+            sum.valbytes += vtm.c1vm_vlen;
+            sum.tombs += vtm.c1vm_tomb ? 1 : 0;
+            sum.mblkvals += vtm.c1vm_logtype == C1_LOG_MBLOCK ? 1 : 0;
+            summary_seqno(vtm.c1vm_seqno);
+            if (cn)
+                cn->vals++;
+        }
+
         err = c1_record_type2len(C1_TYPE_VT, c1->c1_version, &len);
         if (ev(err))
             return err;
@@ -568,7 +742,15 @@ c1log_log_replay_kvb(struct c1 *c1, char *kvbomf, void *data)
     if (ev(err))
         return err;
 
-    if (verbose) {
+    if (!mdc_scan_range_match(&txid_range, kvb.c1kvb_txnid))
+        return 0;
+
+    if (summary) {
+        sum.kvbs++;
+        summary_txid(kvb.c1kvb_txnid);
+    }
+
+    if (verbose && !summary) {
         printf(
             " c1 log tree_ver 0x%lx gen 0x%x txnid 0x%lx "
             "keycount %ld mutno 0x%lx size %ld "
@@ -595,7 +777,7 @@ c1log_log_replay_kvb(struct c1 *c1, char *kvbomf, void *data)
             return err;
     }
 
-    if (verbose)
+    if (verbose && !summary)
         printf("\n");
 
     return 0;
@@ -644,8 +826,23 @@ main(int argc, char **argv)
 
     prog = (prog = strrchr(argv[0], '/')) ? prog + 1 : argv[0];
 
-    while ((c = getopt(argc, argv, "?hvKVA")) != -1) {
+    while ((c = getopt(argc, argv, "?hvAC:KS:sT:V")) != -1) {
         switch (c) {
+            case 'C':
+                if (mdc_scan_range_parse(optarg, &cnid_range))
+                    fatal("invalid cnid range '%s'", optarg);
+                break;
+            case 'S':
+                if (mdc_scan_range_parse(optarg, &seqno_range))
+                    fatal("invalid seqno range '%s'", optarg);
+                break;
+            case 's':
+                summary = true;
+                break;
+            case 'T':
+                if (mdc_scan_range_parse(optarg, &txid_range))
+                    fatal("invalid txid range '%s'", optarg);
+                break;
             case 'v':
                 verbose = true;
                 break;
@@ -709,10 +906,11 @@ main(int argc, char **argv)
     if (err)
       fatal("cannot open c1 : %s", merr_strinfo(err, errbuf, sizeof(errbuf), 0));
 
-    printf(
-        "c1 cndb ingestid 0x%lx kvdb_seqno 0x%lx\n",
-        (unsigned long)ingestid,
-        (unsigned long)c1_get_kvdb_seqno(c1));
+    if (!summary)
+        printf(
+            "c1 cndb ingestid 0x%lx kvdb_seqno 0x%lx\n",
+            (unsigned long)ingestid,
+            (unsigned long)c1_get_kvdb_seqno(c1));
 
     err = c1_diag_replay_journal(c1, c1log_journal_replay_cb);
     if (err)
@@ -722,6 +920,9 @@ main(int argc, char **argv)
     if (err)
       fatal("cannot replay c1 tree : %s", merr_strinfo(err, errbuf, sizeof(errbuf), 0));
 
+    if (summary)
+        summary_print();
+
     c1_log_put_mblk_value(c1, &last_mblk);
 
     c1_close(c1);
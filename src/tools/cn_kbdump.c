@@ -15,6 +15,8 @@
 #include <hse_util/fmt.h>
 #include <hse_util/bloom_filter.h>
 
+#include <hse/hse_limits.h>
+
 #include <mpool/mpool.h>
 
 /* [HSE_REVISIT] - Why are these includes not </> style? */
@@ -53,6 +55,26 @@ size_t        bh_bktsz;
 #define pgoff(x) ((x)*PAGE_SIZE)
 #define off2addr(x, off) (void *)(((char *)(x)) + (off))
 
+/* Pages used by the leaf nodes of a wbtree, which are packed behind an
+ * offset table if they are compressed.
+ */
+static uint
+wbt_leaf_pgc(const struct wbt_hdr_omf *wbt_hdr)
+{
+    if (omf_wbt_version(wbt_hdr) >= WBT_TREE_VERSION8)
+        return omf_wbt_leaf_pgc(wbt_hdr);
+
+    return omf_wbt_leaf_cnt(wbt_hdr);
+}
+
+/* Page number of the first kmd page relative to the start of a wbtree.
+ */
+static uint
+wbt_kmd_pg(const struct wbt_hdr_omf *wbt_hdr)
+{
+    return wbt_leaf_pgc(wbt_hdr) + omf_wbt_root(wbt_hdr) + 1 - omf_wbt_leaf_cnt(wbt_hdr);
+}
+
 /* --------------------------------------------------
  * formatters
  */
@@ -207,7 +229,7 @@ print_kblk(struct blk *blk)
         omf_kbh_blm_hlen(p),
         omf_kbh_blm_doff_pg(p),
         omf_kbh_blm_dlen_pg(p));
-    printf("    kmd: start_pg %u\n", omf_kbh_wbt_doff_pg(p) + omf_wbt_root(wbt_hdr) + 1);
+    printf("    kmd: start_pg %u\n", omf_kbh_wbt_doff_pg(p) + wbt_kmd_pg(wbt_hdr));
     printf(
         "    keymin: off %u len %u key %s\n",
         omf_kbh_min_koff(p),
@@ -420,6 +442,7 @@ val_get_next(void *kmd, size_t *off, struct kmd_vref *vref)
 {
     const void *vdata;
     u32         vlen;
+    u32         ulen;
 
     vref->vbidx = vref->vboff = vref->vlen = 0;
 
@@ -441,10 +464,26 @@ val_get_next(void *kmd, size_t *off, struct kmd_vref *vref)
                 vref->vboff,
                 vref->vlen);
             break;
+        case vtype_cval:
+            /* vlen is the length of the stored (compressed) data */
+            kmd_cval(kmd, off, &vref->vbidx, &vref->vboff, &ulen, &vref->vlen);
+            snprintf(
+                vref->vinfo,
+                sizeof(vref->vinfo),
+                "type=cv %u/%u/%u ulen %u",
+                vref->vbidx,
+                vref->vboff,
+                vref->vlen,
+                ulen);
+            break;
         case vtype_ival:
             kmd_ival(kmd, off, &vdata, &vlen);
             snprintf(vref->vinfo, sizeof(vref->vinfo), "type=iv %u", vlen);
             break;
+        case vtype_lival:
+            kmd_lival(kmd, off, &vdata, &vlen);
+            snprintf(vref->vinfo, sizeof(vref->vinfo), "type=liv %u", vlen);
+            break;
         case vtype_zval:
             strlcpy(vref->vinfo, "type=zv", sizeof(vref->vinfo));
             break;
@@ -524,9 +563,23 @@ print_wbt_node(void *h, uint version, void *kmd, int pgno, int root)
             uint   j, cnt, lfe_kmd, koff, klen;
 
             struct kmd_vref vref;
-
-            version < WBT_TREE_VERSION5 ? wbt4_lfe_key(h, le, &kdata, &klen)
-                                        : wbt_lfe_key(h, le, &kdata, &klen);
+            char            kbuf[HSE_KVS_KLEN_MAX];
+
+            if (version < WBT_TREE_VERSION5) {
+                wbt4_lfe_key(h, le, &kdata, &klen);
+            } else if (version < WBT_TREE_VERSION7) {
+                wbt_lfe_key(h, le, &kdata, &klen);
+            } else {
+                const void *sfx;
+                uint        sfx_len;
+
+                /* Show front-coded keys in full (less the node prefix) */
+                wbt_lfe_sfx(h, le, true, &sfx, &sfx_len, &kdata, &klen);
+                memcpy(kbuf, sfx, sfx_len);
+                memcpy(kbuf + sfx_len, kdata, klen);
+                kdata = kbuf;
+                klen += sfx_len;
+            }
 
             koff = omf_lfe_koff(le);
             lfe_kmd = wbt_lfe_kmd(h, le);
@@ -600,22 +653,35 @@ print_wbt_node(void *h, uint version, void *kmd, int pgno, int root)
 }
 
 void
-print_wbt_nodes(void *kblk, void *kmd, int root, bool ptomb)
+print_wbt_nodes(void *kblk, struct wbt_hdr_omf *wbt_hdr, void *kmd, int root, bool ptomb)
 {
     struct wbt_node_hdr_omf *wbn;
-    struct wbt_hdr_omf *     wbt_hdr = off2addr(kblk, omf_kbh_wbt_hoff(kblk));
     int                      terse = !opt.klen;
     int                      i, pgno;
     uint                     magic, omagic = 0;
+    int                      leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+    uint                     inode_pg = wbt_leaf_pgc(wbt_hdr) - leaf_cnt;
+    bool                     lcomp = omf_wbt_version(wbt_hdr) >= WBT_TREE_VERSION8;
+    char                     lbuf[PAGE_SIZE] __aligned(PAGE_SIZE);
+    void *                   rgn;
+
+    rgn = kblk + pgoff(ptomb ? omf_kbh_pt_doff_pg(kblk) : omf_kbh_wbt_doff_pg(kblk));
 
     if (terse)
         printf("wbt node list:");
 
     for (i = pgno = 0; pgno <= root; ++pgno, ++i) {
-        if (ptomb)
-            wbn = kblk + pgoff(pgno + omf_kbh_pt_doff_pg(kblk));
-        else
-            wbn = kblk + pgoff(pgno + omf_kbh_wbt_doff_pg(kblk));
+        if (lcomp && pgno < leaf_cnt) {
+            uint off = wbt8_leaf_off(rgn, pgno);
+
+            wbn = (void *)lbuf;
+            if (wbt8_leaf_decode(rgn + off, wbt8_leaf_off(rgn, pgno + 1) - off, lbuf)) {
+                printf("\ncannot decompress leaf node %d\n", pgno);
+                continue;
+            }
+        } else {
+            wbn = rgn + pgoff(pgno + (pgno < leaf_cnt ? 0 : inode_pg));
+        }
 
         if (!terse) {
             print_wbt_node(wbn, omf_wbt_version(wbt_hdr), kmd, pgno, root);
@@ -643,7 +709,7 @@ print_wbt34(void *wbt_hdr, void *kblk, bool ptomb)
     u8 *kmd;
 
     wbt_doff = ptomb ? omf_kbh_pt_doff_pg(kblk) : omf_kbh_wbt_doff_pg(kblk);
-    kmd = kblk + pgoff(wbt_doff + omf_wbt_root(wbt_hdr) + 1);
+    kmd = kblk + pgoff(wbt_doff + wbt_kmd_pg(wbt_hdr));
 
     printf(
         "    wbthdr: magic 0x%08x  ver %d  root %d  leaf1 %d  nleaf %d "
@@ -656,14 +722,17 @@ print_wbt34(void *wbt_hdr, void *kblk, bool ptomb)
         omf_wbt_kmd_pgc(wbt_hdr));
 
     if ((opt.verbose || opt.klen) && omf_wbt_kmd_pgc(wbt_hdr) > 0)
-        print_wbt_nodes(kblk, kmd, omf_wbt_root(wbt_hdr), ptomb);
+        print_wbt_nodes(kblk, wbt_hdr, kmd, omf_wbt_root(wbt_hdr), ptomb);
 }
 
 void
 print_wbt(void *wbt_hdr, void *kblk, bool ptomb)
 {
     switch (wbt_hdr_version(wbt_hdr)) {
-        case WBT_TREE_VERSION:
+        case WBT_TREE_VERSION8:
+        case WBT_TREE_VERSION7:
+        case WBT_TREE_VERSION6:
+        case WBT_TREE_VERSION5:
             print_wbt34(wbt_hdr, kblk, ptomb);
             break;
         case WBT_TREE_VERSION3:
@@ -0,0 +1,781 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/*
+ * cn_kbstat - report how the space of a kvs's kblocks and vblocks is used
+ *
+ * Walks the cn tree of a kvs (as cn_metrics does), reads each kvset's
+ * mblocks (as cn_kbdump does), and reports per tree level:
+ *
+ *   - logical key bytes, the bytes the current wbtree format stores for
+ *     them, and the bytes ideal front coding within a kblock would store
+ *   - leaf node bytes, stored and if lz4 compressed
+ *   - kmd bytes per key
+ *   - bloom bits per key and the false positive rate measured by probing
+ *     a key not in the kblock for each key in the kblock
+ *   - immediate vs vblock values, and the garbage (unreferenced) fraction
+ *     of the vblocks
+ *   - the lz4 compressibility of (a sample of) the vblock values
+ *   - what larger inline (immediate) value thresholds would move from the
+ *     vblocks into the kblocks
+ */
+
+#include <hse_ikvdb/cn.h>
+#include <hse_ikvdb/limits.h>
+#include <hse_ikvdb/ikvdb.h>
+#include <hse_ikvdb/omf_kmd.h>
+#include <hse_ikvdb/tuple.h>
+
+#include <../cn/cn_tree.h>
+#include <../cn/cn_tree_internal.h>
+#include <../cn/cn_tree_iter.h>
+#include <../cn/kvset.h>
+#include <../cn/omf.h>
+#include <../cn/wbt_internal.h>
+#include <../cn/bloom_reader.h>
+
+#include <hse/hse.h>
+#include <hse/hse_limits.h>
+
+#include <hse_util/compression.h>
+
+#include <mpool/mpool.h>
+
+#include <sysexits.h>
+
+const char *progname;
+
+#define KBS_LEVEL_MAX 16
+
+/* Inline value thresholds whose effect is projected.
+ */
+static const uint inl_thrv[] = { 64, 128, 256, 512, 1024 };
+
+struct options {
+    const char *mpool;
+    const char *kvs;
+    uint        sample;
+    bool        values;
+};
+
+struct options opt;
+
+/**
+ * struct kbs_stats - space usage of the kvsets of one tree level
+ */
+struct kbs_stats {
+    u64 kvsets;
+    u64 kblks;
+    u64 vblks;
+    u64 keys;
+    u64 tombs;
+    u64 key_bytes;    /* logical, i.e. full key lengths */
+    u64 key_stored;   /* as stored by the wbtree format */
+    u64 key_fcoded;   /* with ideal front coding within a kblock */
+    u64 leaf_raw;     /* leaf nodes, uncompressed */
+    u64 leaf_stored;  /* leaf nodes, as stored */
+    u64 leaf_lz;      /* leaf nodes, if lz4 compressed */
+    u64 kmd_bytes;
+    u64 blm_bits;
+    u64 blm_keys;
+    u64 blm_probes;
+    u64 blm_hits;
+    u64 ival_cnt;
+    u64 ival_bytes;
+    u64 vref_cnt;
+    u64 vref_bytes;   /* vblock bytes referenced (compressed if so) */
+    u64 cval_cnt;
+    u64 cval_ulen;
+    u64 cval_clen;
+    u64 vblk_bytes;
+    u64 lz_cnt;       /* sampled uncompressed vblock values */
+    u64 lz_in;
+    u64 lz_out;
+    u64 inl_cnt[NELEM(inl_thrv)];
+    u64 inl_bytes[NELEM(inl_thrv)];
+};
+
+struct ctx {
+    struct mpool *   ds;
+    struct kbs_stats levelv[KBS_LEVEL_MAX];
+    uint             levelc;
+    u64              nvalues;
+    void *           lzbuf;
+    uint             lzbufsz;
+};
+
+void
+usage(void)
+{
+    printf("usage: %s [options] mpool kvs\n", progname);
+
+    printf("-c      read vblocks and measure lz4 compressibility of values\n"
+           "-h      show this help list\n"
+           "-s N    with -c, compress one in every N values (default: 16)\n"
+           "\n");
+}
+
+void
+syntax(const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "%s: %s, use -h for help\n", progname, msg);
+}
+
+void
+fatal(merr_t err, char *fmt, ...)
+{
+    struct merr_info info;
+    char             msg[256];
+    va_list          ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "%s: %s: %s\n", progname, msg, merr_info(err, &info));
+    exit(1);
+}
+
+void
+process_options(int argc, char *argv[])
+{
+    char *end;
+    int   c;
+
+    while ((c = getopt(argc, argv, ":chs:")) != -1) {
+        switch (c) {
+            case 'c':
+                opt.values = true;
+                break;
+            case 'h':
+                usage();
+                exit(0);
+            case 's':
+                errno = 0;
+                opt.sample = strtoul(optarg, &end, 0);
+                if (errno || *end || !opt.sample) {
+                    syntax("invalid sample rate '%s'", optarg);
+                    exit(EX_USAGE);
+                }
+                break;
+
+            case '?':
+                syntax("invalid option -%c", optopt);
+                exit(EX_USAGE);
+
+            case ':':
+                syntax("option -%c requires a parameter", optopt);
+                exit(EX_USAGE);
+
+            default:
+                syntax("option -%c ignored\n", c);
+                break;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 2) {
+        syntax("insufficient arguments for mandatory parameters");
+        exit(EX_USAGE);
+    } else if (argc > 2) {
+        syntax("extraneous arguments detected");
+        exit(EX_USAGE);
+    }
+
+    opt.mpool = argv[0];
+    opt.kvs = argv[1];
+}
+
+/* --------------------------------------------------
+ * mblock reader
+ */
+
+static void *
+read_mblock(struct mpool *ds, u64 id, size_t *lenp)
+{
+    struct mblock_props props;
+    struct iovec        iov;
+    size_t              off, len, meg = 1024 * 1024;
+    void *              buf;
+    u64                 handle;
+    merr_t              err;
+
+    err = mpool_mblock_find_get(ds, id, &handle, &props);
+    if (err)
+        fatal(err, "mblookup 0x%lx", id);
+
+    len = props.mpr_write_len;
+    if (posix_memalign(&buf, PAGE_SIZE, len))
+        fatal(merr(ENOMEM), "alloc for mblk 0x%lx, len %zu", id, len);
+
+    /* Read in 1MiB pieces, as cn_kbdump does. */
+    for (off = 0; off < len; off += meg) {
+        iov.iov_base = buf + off;
+        iov.iov_len = min_t(size_t, meg, len - off);
+
+        err = mpool_mblock_read(ds, handle, &iov, 1, off);
+        if (err)
+            fatal(err, "mblkread 0x%lx, off %zu", id, off);
+    }
+
+    mpool_mblock_put(ds, handle);
+
+    *lenp = len;
+
+    return buf;
+}
+
+/* --------------------------------------------------
+ * kblock analysis
+ */
+
+static uint
+kbs_leaf_pgc(const struct wbt_hdr_omf *wbt_hdr)
+{
+    if (omf_wbt_version(wbt_hdr) >= WBT_TREE_VERSION8)
+        return omf_wbt_leaf_pgc(wbt_hdr);
+
+    return omf_wbt_leaf_cnt(wbt_hdr);
+}
+
+static uint
+kbs_kmd_pg(const struct wbt_hdr_omf *wbt_hdr)
+{
+    return kbs_leaf_pgc(wbt_hdr) + omf_wbt_root(wbt_hdr) + 1 - omf_wbt_leaf_cnt(wbt_hdr);
+}
+
+static uint
+lcp(const u8 *a, uint alen, const u8 *b, uint blen)
+{
+    uint i, n = min_t(uint, alen, blen);
+
+    for (i = 0; i < n && a[i] == b[i]; ++i)
+        ;
+
+    return i;
+}
+
+static uint
+lz_size(struct ctx *c, const void *src, uint len)
+{
+    uint   bound = compress_lz4_bound(len);
+    uint   clen;
+    merr_t err;
+
+    if (bound > c->lzbufsz) {
+        free(c->lzbuf);
+        c->lzbufsz = roundup_pow_of_two(bound);
+        c->lzbuf = malloc(c->lzbufsz);
+        if (!c->lzbuf)
+            fatal(merr(ENOMEM), "alloc lz4 buffer");
+    }
+
+    err = compress_lz4(src, len, c->lzbuf, c->lzbufsz, &clen);
+
+    return (err || clen > len) ? len : clen;
+}
+
+/* Account the values of one key, return the number of kmd bytes they use.
+ */
+static size_t
+kbs_values(
+    struct ctx *      c,
+    struct kbs_stats *s,
+    const void *      kmd,
+    size_t            off,
+    void **           vblkv,
+    uint              vblkc)
+{
+    const void *   vdata;
+    enum kmd_vtype vtype;
+    size_t         start = off;
+    uint           cnt, vbidx, vboff, vlen, ulen, i, j;
+    u64            seq;
+
+    cnt = kmd_count(kmd, &off);
+
+    for (i = 0; i < cnt; ++i) {
+        kmd_type_seq(kmd, &off, &vtype, &seq);
+
+        switch (vtype) {
+            case vtype_val:
+                kmd_val(kmd, &off, &vbidx, &vboff, &vlen);
+                s->vref_cnt++;
+                s->vref_bytes += vlen;
+
+                for (j = 0; j < NELEM(inl_thrv); ++j) {
+                    if (vlen <= inl_thrv[j]) {
+                        s->inl_cnt[j]++;
+                        s->inl_bytes[j] += vlen;
+                    }
+                }
+
+                if (vblkv && vbidx < vblkc && c->nvalues++ % opt.sample == 0) {
+                    s->lz_cnt++;
+                    s->lz_in += vlen;
+                    s->lz_out += lz_size(c, vblkv[vbidx] + PAGE_SIZE + vboff, vlen);
+                }
+                break;
+
+            case vtype_cval:
+                kmd_cval(kmd, &off, &vbidx, &vboff, &ulen, &vlen);
+                s->vref_cnt++;
+                s->vref_bytes += vlen;
+                s->cval_cnt++;
+                s->cval_ulen += ulen;
+                s->cval_clen += vlen;
+                break;
+
+            case vtype_ival:
+                kmd_ival(kmd, &off, &vdata, &vlen);
+                s->ival_cnt++;
+                s->ival_bytes += vlen;
+                break;
+
+            case vtype_lival:
+                kmd_lival(kmd, &off, &vdata, &vlen);
+                s->ival_cnt++;
+                s->ival_bytes += vlen;
+                break;
+
+            case vtype_zval:
+                s->ival_cnt++;
+                break;
+
+            case vtype_tomb:
+            case vtype_ptomb:
+                s->tombs++;
+                break;
+
+            default:
+                /* Unknown value type, cannot parse the rest. */
+                return off - start;
+        }
+    }
+
+    return off - start;
+}
+
+static void
+kbs_kblock(struct ctx *c, struct kbs_stats *s, void *kblk, size_t kblen, void **vblkv, uint vblkc)
+{
+    struct wbt_hdr_omf *  wbt_hdr = kblk + omf_kbh_wbt_hoff(kblk);
+    struct bloom_hdr_omf *blm_hdr = kblk + omf_kbh_blm_hoff(kblk);
+    struct bloom_desc     bd = { 0 };
+    const u8 *            bitmap = NULL;
+    char                  lbuf[PAGE_SIZE] __aligned(PAGE_SIZE);
+    u8                    key[HSE_KVS_KLEN_MAX + 1], prev[HSE_KVS_KLEN_MAX];
+    uint                  prevlen = 0;
+    uint                  version, leaf_cnt, pgno, i;
+    void *                rgn, *kmd;
+    bool                  lcomp;
+
+    if (omf_kbh_magic(kblk) != KBLOCK_HDR_MAGIC)
+        return;
+
+    s->kblks++;
+    s->keys += omf_kbh_entries(kblk);
+
+    if (omf_bh_magic(blm_hdr) == BLOOM_OMF_MAGIC && omf_bh_bitmapsz(blm_hdr) &&
+        (omf_kbh_blm_doff_pg(kblk) + omf_kbh_blm_dlen_pg(kblk)) * PAGE_SIZE <= kblen) {
+        bd.bd_modulus = omf_bh_modulus(blm_hdr);
+        bd.bd_bktshift = omf_bh_bktshift(blm_hdr);
+        bd.bd_n_hashes = omf_bh_n_hashes(blm_hdr);
+        bd.bd_rotl = omf_bh_rotl(blm_hdr);
+        bd.bd_bktmask = (1u << bd.bd_bktshift) - 1;
+        bd.bd_split = omf_bh_version(blm_hdr) == BLOOM_OMF_VERSION5;
+
+        bitmap = kblk + omf_kbh_blm_doff_pg(kblk) * PAGE_SIZE;
+        s->blm_bits += (u64)omf_bh_bitmapsz(blm_hdr) * CHAR_BIT;
+        s->blm_keys += omf_kbh_entries(kblk);
+    }
+
+    if (!omf_wbt_kmd_pgc(wbt_hdr))
+        return;
+
+    version = omf_wbt_version(wbt_hdr);
+    leaf_cnt = omf_wbt_leaf_cnt(wbt_hdr);
+    lcomp = version >= WBT_TREE_VERSION8;
+
+    rgn = kblk + omf_kbh_wbt_doff_pg(kblk) * PAGE_SIZE;
+    kmd = rgn + kbs_kmd_pg(wbt_hdr) * PAGE_SIZE;
+
+    s->leaf_raw += (u64)leaf_cnt * PAGE_SIZE;
+    if (lcomp)
+        s->leaf_stored += wbt8_leaf_off(rgn, leaf_cnt) - wbt8_leaf_off(rgn, 0);
+    else
+        s->leaf_stored += (u64)leaf_cnt * PAGE_SIZE;
+
+    for (pgno = 0; pgno < leaf_cnt; ++pgno) {
+        struct wbt_lfe_omf *le;
+        void *              node;
+        const void *        pfx;
+        uint                hdr_sz, pfx_len, nkeys;
+
+        if (lcomp) {
+            uint off = wbt8_leaf_off(rgn, pgno);
+            uint clen = wbt8_leaf_off(rgn, pgno + 1) - off;
+
+            if (wbt8_leaf_decode(rgn + off, clen, lbuf))
+                continue;
+
+            node = lbuf;
+            s->leaf_lz += min_t(uint, clen, PAGE_SIZE);
+        } else {
+            node = rgn + pgno * PAGE_SIZE;
+            s->leaf_lz += lz_size(c, node, PAGE_SIZE);
+        }
+
+        if (omf_wbn_magic(node) != WBT_LFE_NODE_MAGIC)
+            continue;
+
+        hdr_sz = version < WBT_TREE_VERSION5 ? sizeof(struct wbt4_node_hdr_omf)
+                                             : sizeof(struct wbt_node_hdr_omf);
+        pfx_len = version < WBT_TREE_VERSION5 ? 0 : omf_wbn_pfx_len(node);
+        pfx = node + hdr_sz;
+        le = node + hdr_sz + pfx_len;
+        nkeys = omf_wbn_num_keys(node);
+
+        /* The node prefix is stored once per node. */
+        s->key_stored += pfx_len;
+
+        for (i = 0; i < nkeys; ++i, ++le) {
+            const void *      sfx1 = NULL, *sfx2;
+            uint              sfx1_len = 0, sfx2_len, klen, stored;
+            struct kvs_ktuple kt;
+
+            if (version < WBT_TREE_VERSION5) {
+                wbt4_lfe_key(node, le, &sfx2, &sfx2_len);
+                stored = sfx2_len;
+            } else if (version < WBT_TREE_VERSION7) {
+                wbt_lfe_key(node, le, &sfx2, &sfx2_len);
+                stored = sfx2_len;
+            } else {
+                wbt_lfe_sfx(node, le, true, &sfx1, &sfx1_len, &sfx2, &sfx2_len);
+                stored = sfx2_len + sizeof(u16);
+            }
+
+            memcpy(key, pfx, pfx_len);
+            if (sfx1_len)
+                memcpy(key + pfx_len, sfx1, sfx1_len);
+            memcpy(key + pfx_len + sfx1_len, sfx2, sfx2_len);
+            klen = pfx_len + sfx1_len + sfx2_len;
+
+            s->key_bytes += klen;
+            s->key_stored += stored;
+
+            /* Ideal front coding stores the suffix past the longest
+             * common prefix with the previous key, plus its length.
+             */
+            s->key_fcoded += klen - lcp(prev, prevlen, key, klen) + sizeof(u16);
+            memcpy(prev, key, klen);
+            prevlen = klen;
+
+            s->kmd_bytes += kbs_values(c, s, kmd, wbt_lfe_kmd(node, le), vblkv, vblkc);
+
+            /* Probe for a key that is not in the kblock. */
+            if (bitmap) {
+                if (klen < HSE_KVS_KLEN_MAX)
+                    key[klen++] = 0xff;
+                else
+                    key[klen - 1] ^= 0x5a;
+
+                kvs_ktuple_init(&kt, key, klen);
+                s->blm_probes++;
+                s->blm_hits += bloom_reader_buffer_lookup(&bd, bitmap, &kt);
+            }
+        }
+    }
+}
+
+static int
+kbs_walk_callback(
+    void *               rock,
+    struct cn_tree *     tree,
+    struct cn_tree_node *node,
+    struct cn_node_loc * loc,
+    struct kvset *       kvset)
+{
+    struct ctx *      c = rock;
+    struct kbs_stats *s;
+    void **           vblkv = NULL;
+    uint              vblkc, kblkc, i;
+
+    if (!node || !kvset)
+        return 0;
+
+    s = c->levelv + min_t(uint, loc->node_level, KBS_LEVEL_MAX - 1);
+    c->levelc = max_t(uint, c->levelc, min_t(uint, loc->node_level, KBS_LEVEL_MAX - 1) + 1);
+
+    kblkc = kvset_get_num_kblocks(kvset);
+    vblkc = kvset_get_num_vblocks(kvset);
+
+    s->kvsets++;
+    s->vblks += vblkc;
+
+    for (i = 0; i < vblkc; ++i)
+        s->vblk_bytes += kvset_get_nth_vblock_len(kvset, i);
+
+    if (opt.values && vblkc) {
+        vblkv = calloc(vblkc, sizeof(*vblkv));
+        if (!vblkv)
+            fatal(merr(ENOMEM), "alloc vblock vector");
+
+        for (i = 0; i < vblkc; ++i) {
+            size_t len;
+
+            vblkv[i] = read_mblock(c->ds, kvset_get_nth_vblock_id(kvset, i), &len);
+        }
+    }
+
+    for (i = 0; i < kblkc; ++i) {
+        size_t len;
+        void * kblk;
+
+        kblk = read_mblock(c->ds, kvset_get_nth_kblock_id(kvset, i), &len);
+        kbs_kblock(c, s, kblk, len, vblkv, vblkv ? vblkc : 0);
+        free(kblk);
+    }
+
+    if (vblkv) {
+        for (i = 0; i < vblkc; ++i)
+            free(vblkv[i]);
+        free(vblkv);
+    }
+
+    return 0;
+}
+
+/* --------------------------------------------------
+ * report
+ */
+
+/* Format a byte count or count in human readable form.
+ */
+static const char *
+hf(char *buf, size_t bufsz, u64 val)
+{
+    static const char sfx[] = " kmgtp";
+    double            v = val;
+    uint              i = 0;
+
+    while (v >= 1024 && i < sizeof(sfx) - 2) {
+        v /= 1024;
+        ++i;
+    }
+
+    if (i == 0)
+        snprintf(buf, bufsz, "%lu", val);
+    else
+        snprintf(buf, bufsz, "%.1f%c", v, sfx[i]);
+
+    return buf;
+}
+
+#define HF(_buf, _val) hf((_buf), sizeof(_buf), (_val))
+
+static double
+pct(u64 num, u64 den)
+{
+    return den ? num * 100.0 / den : 0;
+}
+
+static void
+kbs_report(const char *name, const struct kbs_stats *s)
+{
+    char b1[32], b2[32], b3[32], b4[32], b5[32], b6[32];
+    uint j;
+
+    printf(
+        "%s: kvsets %lu  kblocks %lu  vblocks %lu  keys %s  tombs %s\n",
+        name,
+        s->kvsets,
+        s->kblks,
+        s->vblks,
+        HF(b1, s->keys),
+        HF(b2, s->tombs));
+
+    if (!s->keys)
+        return;
+
+    printf(
+        "  keys      logical %s  stored %s (%.1f%%)  front-coded %s (%.1f%%)\n",
+        HF(b1, s->key_bytes),
+        HF(b2, s->key_stored),
+        pct(s->key_stored, s->key_bytes),
+        HF(b3, s->key_fcoded),
+        pct(s->key_fcoded, s->key_bytes));
+
+    printf(
+        "  leaves    raw %s  stored %s (%.1f%%)  lz4 %s (%.1f%%)\n",
+        HF(b1, s->leaf_raw),
+        HF(b2, s->leaf_stored),
+        pct(s->leaf_stored, s->leaf_raw),
+        HF(b3, s->leaf_lz),
+        pct(s->leaf_lz, s->leaf_raw));
+
+    printf(
+        "  kmd       %s (%.1f per key, %.1f less immediate values)\n",
+        HF(b1, s->kmd_bytes),
+        (double)s->kmd_bytes / s->keys,
+        (double)(s->kmd_bytes - s->ival_bytes) / s->keys);
+
+    if (s->blm_keys)
+        printf(
+            "  bloom     %.1f bits/key  fpr %.3f%% (%lu of %lu probes)\n",
+            (double)s->blm_bits / s->blm_keys,
+            pct(s->blm_hits, s->blm_probes),
+            s->blm_hits,
+            s->blm_probes);
+    else
+        printf("  bloom     none\n");
+
+    printf(
+        "  values    immediate %s (%s)  vblock %s (%s)  compressed %s (%s -> %s)\n",
+        HF(b1, s->ival_cnt),
+        HF(b2, s->ival_bytes),
+        HF(b3, s->vref_cnt),
+        HF(b4, s->vref_bytes),
+        HF(b5, s->cval_cnt),
+        HF(b6, s->cval_ulen),
+        HF(b1, s->cval_clen));
+
+    printf(
+        "  vblocks   %s  referenced %s  garbage %.1f%%\n",
+        HF(b1, s->vblk_bytes),
+        HF(b2, s->vref_bytes),
+        s->vblk_bytes > s->vref_bytes ? pct(s->vblk_bytes - s->vref_bytes, s->vblk_bytes) : 0);
+
+    if (s->lz_cnt)
+        printf(
+            "  lz4       %lu values sampled: %s -> %s (%.1f%%)\n",
+            s->lz_cnt,
+            HF(b1, s->lz_in),
+            HF(b2, s->lz_out),
+            pct(s->lz_out, s->lz_in));
+
+    for (j = 0; j < NELEM(inl_thrv); ++j) {
+        if (!s->inl_cnt[j])
+            continue;
+
+        printf(
+            "  inline<=%-4u %s values (%.1f%% of vblock values), %s moved to kblocks\n",
+            inl_thrv[j],
+            HF(b1, s->inl_cnt[j]),
+            pct(s->inl_cnt[j], s->vref_cnt),
+            HF(b2, s->inl_bytes[j]));
+    }
+}
+
+static void
+kbs_add(struct kbs_stats *to, const struct kbs_stats *from)
+{
+    const u64 *src = (const u64 *)from;
+    u64 *      dst = (u64 *)to;
+    size_t     i;
+
+    for (i = 0; i < sizeof(*to) / sizeof(u64); ++i)
+        dst[i] += src[i];
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *       errmsg = NULL;
+    struct hse_params *params = NULL;
+    struct kbs_stats   total = { 0 };
+    struct ctx         ctx = { 0 };
+    struct cn *        cn = NULL;
+    struct hse_kvdb *  kd = NULL;
+    struct hse_kvs *   kvs = NULL;
+    uint64_t           rc;
+    uint               i;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opt.sample = 16;
+    process_options(argc, argv);
+
+    rc = hse_kvdb_init();
+    if (rc) {
+        errmsg = "kvdb_init";
+        goto done;
+    }
+
+    hse_params_create(&params);
+
+    hse_params_set(params, "kvdb.rdonly", "1");
+    hse_params_set(params, "kvs.cn_diag_mode", "1");
+    hse_params_set(params, "kvs.cn_maint_disable", "1");
+
+    rc = hse_kvdb_open(opt.mpool, params, &kd);
+    if (rc) {
+        errmsg = "kvdb_open";
+        goto done;
+    }
+
+    rc = hse_kvdb_kvs_open(kd, opt.kvs, params, &kvs);
+    if (rc) {
+        errmsg = "kvs_open";
+        goto done;
+    }
+
+    cn = ikvdb_kvs_get_cn(kvs);
+    if (!cn) {
+        errmsg = "cn_open";
+        rc = merr(EBUG);
+        goto done;
+    }
+
+    ctx.ds = cn_get_dataset(cn);
+
+    cn_tree_preorder_walk(cn_get_tree(cn), KVSET_ORDER_NEWEST_FIRST, kbs_walk_callback, &ctx);
+
+    for (i = 0; i < ctx.levelc; ++i) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level %u", i);
+        kbs_report(name, ctx.levelv + i);
+        kbs_add(&total, ctx.levelv + i);
+        printf("\n");
+    }
+
+    kbs_report("total", &total);
+
+done:
+    free(ctx.lzbuf);
+
+    if (kvs)
+        hse_kvdb_kvs_close(kvs);
+
+    if (kd)
+        hse_kvdb_close(kd);
+
+    if (errmsg) {
+        char errbuf[1000];
+
+        hse_err_to_string(rc, errbuf, sizeof(errbuf), 0);
+        fprintf(stderr, "Error: %s failed: %s\n", errmsg, errbuf);
+    }
+
+    hse_params_destroy(params);
+
+    if (rc)
+        return EX_SOFTWARE;
+
+    hse_kvdb_fini();
+
+    return 0;
+}
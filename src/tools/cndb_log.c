@@ -5,11 +5,17 @@
 
 /*
  * cndb_log - read and interpret a cndb log
+ *
+ * The log is read in order and its records are decoded and formatted in
+ * parallel by mdc_scan().  The filters on cnid and txid apply to each
+ * record, the filter on seqno selects the transactions whose tx record
+ * has a seqno in the range and so is applied in log order, at emit time.
  */
 
 #include <hse_util/slab.h>
 #include <hse_util/assert.h>
 #include <hse_util/log2.h>
+#include <hse_util/parse_num.h>
 
 #include <hse_ikvdb/limits.h>
 #include <hse_ikvdb/ikvdb.h>
@@ -22,18 +28,88 @@
 #include "../cn/cndb_omf.h"
 #include "../cn/cndb_internal.h"
 
+#include "mdc_scan.h"
+
 #include <sysexits.h>
 #include <libgen.h>
 
 #define BUF_SZ ((25 * 1024)) /* Initial buffer size */
 
+#define THREADS_MAX (64)
+
 const char *progname;
 
-static int fileoff;
-static int ignore;
 static int check;
 static int status;
 
+struct opts {
+    bool                  json;
+    bool                  summary;
+    uint                  threads;
+    struct mdc_scan_range cnid;
+    struct mdc_scan_range txid;
+    struct mdc_scan_range seqno;
+};
+
+static struct opts opts;
+
+/**
+ * struct cndb_log_rec - a record as decoded for the emit stage
+ * @clr_type:    record type
+ * @clr_len:     record length, header included
+ * @clr_match:   record passed the cnid and txid filters
+ * @clr_unknown: record type is unknown
+ * @clr_txid:    txid, if clr_hastxid
+ * @clr_cnid:    cnid, if clr_hascnid
+ * @clr_seqno:   seqno of a tx record
+ * @clr_kblks:   kblocks of a txc record
+ * @clr_vblks:   vblocks of a txc record
+ * @clr_dblks:   mblocks of a txd record
+ * @clr_ackd:    ack record is an ack-D
+ */
+struct cndb_log_rec {
+    u32  clr_type;
+    u32  clr_len;
+    bool clr_match;
+    bool clr_unknown;
+    bool clr_hastxid;
+    bool clr_hascnid;
+    bool clr_ackd;
+    u64  clr_txid;
+    u64  clr_cnid;
+    u64  clr_seqno;
+    u32  clr_kblks;
+    u32  clr_vblks;
+    u32  clr_dblks;
+};
+
+struct cndb_log_cn {
+    u64 clc_cnid;
+    u64 clc_kvsets;
+    u64 clc_kblks;
+    u64 clc_vblks;
+    u64 clc_txm;
+    u64 clc_kvsets_del;
+    u64 clc_mblks_del;
+    u64 clc_ackd;
+};
+
+struct cndb_log_summary {
+    u64                 cls_recs;
+    u64                 cls_bytes;
+    u64                 cls_unknown;
+    u64                 cls_typev[CNDB_TYPE_META + 1];
+    u64                 cls_txid_min;
+    u64                 cls_txid_max;
+    u64                 cls_seqno_min;
+    u64                 cls_seqno_max;
+    bool                cls_txid_set;
+    bool                cls_seqno_set;
+    struct cndb_log_cn *cls_cnv;
+    uint                cls_cnc;
+    uint                cls_cnmax;
+};
+
 struct tool_info {
     const char *  mp;
     char *        buf;
@@ -42,10 +118,26 @@ struct tool_info {
 
     char *           rpath;
     char *           wpath;
-    FILE *           fp; /* only for writing */
-    int              fd; /* only for reading */
+    FILE *           fp;   /* only for writing */
+    int              fd;   /* only for reading */
+    off_t            roff; /* only for reading */
+    u32              cndb_version;
     struct cndb *    cndb;
     struct hse_kvdb *kvdbh;
+
+    /* txids of the transactions selected by the seqno filter, sorted */
+    u64 *txidv;
+    uint txidc;
+    uint txidmax;
+
+    struct cndb_log_summary sum;
+};
+
+static const char *typenamev[] = {
+    [CNDB_TYPE_VERSION] = "ver", [CNDB_TYPE_INFO] = "info", [CNDB_TYPE_INFOD] = "infod",
+    [CNDB_TYPE_TX] = "tx",       [CNDB_TYPE_ACK] = "ack",   [CNDB_TYPE_NAK] = "nak",
+    [CNDB_TYPE_TXC] = "txc",     [CNDB_TYPE_TXM] = "txm",   [CNDB_TYPE_TXD] = "txd",
+    [CNDB_TYPE_META] = "meta",
 };
 
 void
@@ -73,16 +165,27 @@ syntax(const char *fmt, ...)
 void
 usage(void)
 {
-    static const char msg[] = "usage: %s [-r file]\n"
-                              "usage: %s [-w file] kvdb\n"
-                              "-c       check integrity\n"
-                              "-i       ignore errors\n"
-                              "-r file  read from file\n"
-                              "-w file  write raw data from input to file\n"
-                              "kvdb   name of the kvdb\n"
-                              "\n";
-
-    printf(msg, progname, progname);
+    static const char msg[] =
+        "usage: %s [options] -r file\n"
+        "usage: %s [options] [-w file] kvdb\n"
+        "-C cnid[-cnid]    only records of these cnids\n"
+        "-c                check integrity\n"
+        "-i                ignore errors\n"
+        "-j                print the records as JSON, one per line\n"
+        "-r file           read from file\n"
+        "-S seqno[-seqno]  only records of the transactions with these seqnos\n"
+        "-s                print a JSON summary of the records instead of the records\n"
+        "-T txid[-txid]    only records of these transactions\n"
+        "-t threads        decode threads (default: %u)\n"
+        "-w file           write raw data from input to file\n"
+        "kvdb   name of the kvdb\n"
+        "\n"
+        "A range may be open on either side, e.g. -S 1000- or -T -42.\n"
+        "Records that are not part of a transaction (ver, info, meta) are\n"
+        "dropped by the -S and -T filters, and by -C but for info records.\n"
+        "\n";
+
+    printf(msg, progname, progname, opts.threads);
 }
 
 /* get a pointer to cndb */
@@ -103,39 +206,99 @@ open_kvdb_and_cndb(struct tool_info *ti)
 /* Functions to interpret the cndb log ------------- */
 
 static void
-print_ver(struct tool_info *ti, union cndb_mtu *mtu)
+print_hdr(struct mdc_scan_out *o, u64 off, const char *type)
+{
+    if (opts.json)
+        mdc_scan_printf(o, "{\"off\": %lu, \"type\": \"%s\"", off, type);
+    else
+        mdc_scan_printf(o, "%04lx: %-6s ", off, type);
+}
+
+static void
+print_blks(struct mdc_scan_out *o, const char *name, const u64 *blkv, u32 blkc)
+{
+    int i;
+
+    if (opts.json) {
+        mdc_scan_printf(o, ", \"%s\": [", name);
+        for (i = 0; i < blkc; i++)
+            mdc_scan_printf(o, "%s\"0x%08lx\"", i ? ", " : "", blkv[i]);
+        mdc_scan_printf(o, "]");
+        return;
+    }
+
+    for (i = 0; i < blkc; i++)
+        mdc_scan_printf(o, "0x%08lx ", blkv[i]);
+}
+
+static void
+print_ver(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_ver *mtv = &(mtu->v);
 
-    printf("%04x: ", fileoff);
-    printf(
-        "%-6s magic 0x%08x version %u captgt %lu\n",
-        "ver",
-        mtv->mtv_magic,
-        mtv->mtv_version,
-        (ulong)mtv->mtv_captgt);
+    print_hdr(o, off, "ver");
+
+    if (opts.json)
+        mdc_scan_printf(
+            o,
+            ", \"magic\": %u, \"version\": %u, \"captgt\": %lu}\n",
+            mtv->mtv_magic,
+            mtv->mtv_version,
+            (ulong)mtv->mtv_captgt);
+    else
+        mdc_scan_printf(
+            o,
+            "magic 0x%08x version %u captgt %lu\n",
+            mtv->mtv_magic,
+            mtv->mtv_version,
+            (ulong)mtv->mtv_captgt);
 }
 
 static void
-print_meta(struct tool_info *ti, union cndb_mtu *mtu)
+print_meta(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_meta *mte = &(mtu->e);
 
-    printf("%04x: ", fileoff);
-    printf("%-6s seqno %lu\n", "meta", mte->mte_seqno_max);
+    print_hdr(o, off, "meta");
+
+    if (opts.json)
+        mdc_scan_printf(o, ", \"seqno\": %lu}\n", mte->mte_seqno_max);
+    else
+        mdc_scan_printf(o, "seqno %lu\n", mte->mte_seqno_max);
 }
 
 static void
-print_info(struct tool_info *ti, union cndb_mtu *mtu)
+print_info(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_info *mti = &(mtu->i);
     int               i;
 
-    printf("%04x: ", fileoff);
-    printf(
-        "%-6s cnid %lu fanout %u prefix %u sfx_len %u pivot %u"
+    print_hdr(o, off, "info");
+
+    if (opts.json) {
+        mdc_scan_printf(
+            o,
+            ", \"cnid\": %lu, \"fanout\": %u, \"prefix\": %u, \"sfx_len\": %u"
+            ", \"pivot\": %u, \"flags\": %u, \"metasz\": %lu, \"name\": ",
+            mti->mti_cnid,
+            mti->mti_fanout_bits,
+            mti->mti_prefix_len,
+            mti->mti_sfx_len,
+            mti->mti_prefix_pivot,
+            mti->mti_flags,
+            (ulong)mti->mti_metasz);
+        mdc_scan_json_str(o, mti->mti_name);
+        mdc_scan_printf(o, ", \"meta\": \"");
+        for (i = 0; i < mti->mti_metasz; i++)
+            mdc_scan_printf(o, "%02x", (unsigned char)mti->mti_meta[i]);
+        mdc_scan_printf(o, "\"}\n");
+        return;
+    }
+
+    mdc_scan_printf(
+        o,
+        "cnid %lu fanout %u prefix %u sfx_len %u pivot %u"
         " flags 0x%x metasz %lu name %s meta",
-        "info",
         mti->mti_cnid,
         mti->mti_fanout_bits,
         mti->mti_prefix_len,
@@ -146,21 +309,37 @@ print_info(struct tool_info *ti, union cndb_mtu *mtu)
         mti->mti_name);
 
     for (i = 0; i < mti->mti_metasz; i++)
-        printf(" 0x%02x", (unsigned char)mti->mti_meta[i]);
+        mdc_scan_printf(o, " 0x%02x", (unsigned char)mti->mti_meta[i]);
 
-    printf("\n");
+    mdc_scan_printf(o, "\n");
 }
 
 static void
-print_infod(struct tool_info *ti, union cndb_mtu *mtu)
+print_infod(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_info *mti = &(mtu->i);
 
-    printf("%04x: ", fileoff);
-    printf(
-        "%-6s cnid %lu fanout %u prefix %u pivot %u"
+    print_hdr(o, off, "infod");
+
+    if (opts.json) {
+        mdc_scan_printf(
+            o,
+            ", \"cnid\": %lu, \"fanout\": %u, \"prefix\": %u, \"pivot\": %u"
+            ", \"flags\": %u, \"name\": ",
+            mti->mti_cnid,
+            mti->mti_fanout_bits,
+            mti->mti_prefix_len,
+            mti->mti_prefix_pivot,
+            mti->mti_flags);
+        mdc_scan_json_str(o, mti->mti_name);
+        mdc_scan_printf(o, "}\n");
+        return;
+    }
+
+    mdc_scan_printf(
+        o,
+        "cnid %lu fanout %u prefix %u pivot %u"
         " flags 0x%x name %s\n",
-        "infod",
         mti->mti_cnid,
         mti->mti_fanout_bits,
         mti->mti_prefix_len,
@@ -170,37 +349,55 @@ print_infod(struct tool_info *ti, union cndb_mtu *mtu)
 }
 
 static void
-print_tx(struct tool_info *ti, union cndb_mtu *mtu)
+print_tx(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_tx *mtx = &(mtu->x);
 
-    printf("%04x: ", fileoff);
-    printf(
-        "%-6s %lu seq %lu ingestid %lu nc %u nd %u ",
-        "tx",
+    print_hdr(o, off, "tx");
+
+    mdc_scan_printf(
+        o,
+        opts.json ? ", \"txid\": %lu, \"seqno\": %lu, \"ingestid\": %lu, \"nc\": %u, \"nd\": %u}\n"
+                  : "%lu seq %lu ingestid %lu nc %u nd %u \n",
         mtx->mtx_id,
         mtx->mtx_seqno,
         mtx->mtx_ingestid,
         mtx->mtx_nc,
         mtx->mtx_nd);
-    printf("\n");
 }
 
 static void
-print_txc(struct tool_info *ti, union cndb_mtu *mtu)
+print_txc(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_txc *mtc = &(mtu->c);
     u64 *            mblk;
-    int              i;
 
-    printf("%04x: ", fileoff);
-    printf("%-6s %lu ", "txc", mtc->mtc_id);
+    print_hdr(o, off, "txc");
+
+    mblk = (void *)(mtc + 1); /* beginning of kblk list */
+
+    if (opts.json) {
+        mdc_scan_printf(
+            o,
+            ", \"txid\": %lu, \"tag\": %lu, \"cnid\": %lu, \"keepvbc\": %u",
+            mtc->mtc_id,
+            mtc->mtc_tag,
+            mtc->mtc_cnid,
+            mtc->mtc_keepvbc);
+        print_blks(o, "kblks", mblk, mtc->mtc_kcnt);
+        print_blks(o, "vblks", mblk + mtc->mtc_kcnt, mtc->mtc_vcnt);
+        mdc_scan_printf(o, "}\n");
+        return;
+    }
+
     /* [HSE_REVISIT] either remove so-called meta-blocks (nm)
      * or implement them.  Until then, print 0 for nm so that
      * this output matches what cndblog2c.awk expects
      */
-    printf(
-        "tag %lu cnid %lu keepvbc %u nk %d nv %d nm %d ids ",
+    mdc_scan_printf(
+        o,
+        "%lu tag %lu cnid %lu keepvbc %u nk %d nv %d nm %d ids ",
+        mtc->mtc_id,
         mtc->mtc_tag,
         mtc->mtc_cnid,
         mtc->mtc_keepvbc,
@@ -208,28 +405,28 @@ print_txc(struct tool_info *ti, union cndb_mtu *mtu)
         mtc->mtc_vcnt,
         0);
 
-    mblk = (void *)(mtc + 1); /* beginning of kblk list */
-    for (i = 0; i < mtc->mtc_kcnt; i++)
-        printf("0x%08lx ", mblk[i]);
-    printf("/ ");
-
-    mblk = &mblk[mtc->mtc_kcnt]; /* beginning of vblk list */
-    for (i = 0; i < mtc->mtc_vcnt; i++)
-        printf("0x%08lx ", mblk[i]);
+    print_blks(o, NULL, mblk, mtc->mtc_kcnt);
+    mdc_scan_printf(o, "/ ");
+    print_blks(o, NULL, mblk + mtc->mtc_kcnt, mtc->mtc_vcnt);
 
-    printf("\n");
+    mdc_scan_printf(o, "\n");
 }
 
 static void
-print_txm(struct tool_info *ti, union cndb_mtu *mtu)
+print_txm(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_txm *mtm = &(mtu->m);
 
-    printf("%04x: ", fileoff);
-    printf("%-6s %lu ", "txm", mtm->mtm_id);
-    printf(
-        "tag %lu cnid %lu dgen %lu loc %u,%u vused %lu compc %u "
-        "scatter %u",
+    print_hdr(o, off, "txm");
+
+    mdc_scan_printf(
+        o,
+        opts.json ? ", \"txid\": %lu, \"tag\": %lu, \"cnid\": %lu, \"dgen\": %lu"
+                    ", \"level\": %u, \"offset\": %u, \"vused\": %lu, \"compc\": %u"
+                    ", \"scatter\": %u}\n"
+                  : "%lu tag %lu cnid %lu dgen %lu loc %u,%u vused %lu compc %u "
+                    "scatter %u\n",
+        mtm->mtm_id,
         mtm->mtm_tag,
         mtm->mtm_cnid,
         mtm->mtm_dgen,
@@ -238,193 +435,553 @@ print_txm(struct tool_info *ti, union cndb_mtu *mtu)
         mtm->mtm_vused,
         mtm->mtm_compc,
         mtm->mtm_scatter);
-    printf("\n");
 }
 
 static void
-print_txd(struct tool_info *ti, union cndb_mtu *mtu)
+print_txd(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_txd *mtd = &(mtu->d);
     u64 *            mblk;
-    int              i;
 
-    printf("%04x: ", fileoff);
-    printf("%-6s %lu ", "txd", mtd->mtd_id);
-    printf("tag %lu cnid %lu nb %d ids ", mtd->mtd_tag, mtd->mtd_cnid, mtd->mtd_n_oids);
+    print_hdr(o, off, "txd");
+
     mblk = (void *)(mtd + 1); /* start of mblock list */
-    for (i = 0; i < mtd->mtd_n_oids; i++)
-        printf("0x%08lx ", mblk[i]);
-    printf("\n");
+
+    if (opts.json) {
+        mdc_scan_printf(
+            o,
+            ", \"txid\": %lu, \"tag\": %lu, \"cnid\": %lu",
+            mtd->mtd_id,
+            mtd->mtd_tag,
+            mtd->mtd_cnid);
+        print_blks(o, "mblks", mblk, mtd->mtd_n_oids);
+        mdc_scan_printf(o, "}\n");
+        return;
+    }
+
+    mdc_scan_printf(
+        o,
+        "%lu tag %lu cnid %lu nb %d ids ",
+        mtd->mtd_id,
+        mtd->mtd_tag,
+        mtd->mtd_cnid,
+        mtd->mtd_n_oids);
+    print_blks(o, NULL, mblk, mtd->mtd_n_oids);
+    mdc_scan_printf(o, "\n");
 }
 
 static void
-print_ack(struct tool_info *ti, union cndb_mtu *mtu)
+print_ack(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_ack *mta = &(mtu->a);
-    const char *     a;
 
-    printf("%04x: ", fileoff);
-    a = mta->mta_type == CNDB_ACK_TYPE_C ? "ack-C" : "ack-D";
-    printf("%-6s %lu tag %lu cnid %lu\n", a, mta->mta_txid, mta->mta_tag, mta->mta_cnid);
+    print_hdr(o, off, mta->mta_type == CNDB_ACK_TYPE_C ? "ack-C" : "ack-D");
+
+    mdc_scan_printf(
+        o,
+        opts.json ? ", \"txid\": %lu, \"tag\": %lu, \"cnid\": %lu}\n" : "%lu tag %lu cnid %lu\n",
+        mta->mta_txid,
+        mta->mta_tag,
+        mta->mta_cnid);
 }
 
 static void
-print_nak(struct tool_info *ti, union cndb_mtu *mtu)
+print_nak(struct mdc_scan_out *o, u64 off, union cndb_mtu *mtu)
 {
     struct cndb_nak *mtn = &(mtu->n);
 
-    printf("%04x: ", fileoff);
-    printf("%-6s %lu\n", "nak", mtn->mtn_txid);
+    print_hdr(o, off, "nak");
+
+    mdc_scan_printf(o, opts.json ? ", \"txid\": %lu}\n" : "%lu\n", mtn->mtn_txid);
 }
 
-int
-eread(int fd, char *buf, int len)
+static void
+print_unknown(struct mdc_scan_out *o, u64 off, struct cndb_hdr_omf *hdr)
 {
-    int rc;
+    if (opts.json)
+        mdc_scan_printf(
+            o,
+            "{\"off\": %lu, \"type\": %u, \"len\": %u, \"error\": \"unknown type\"}\n",
+            off,
+            omf_cnhdr_type(hdr),
+            omf_cnhdr_len(hdr));
+    else
+        mdc_scan_printf(
+            o,
+            "%04lx: unknown type 0x%08x len %d\n",
+            off,
+            omf_cnhdr_type(hdr),
+            omf_cnhdr_len(hdr));
+}
 
-    rc = read(fd, buf, len);
-    if (rc < 0)
-        fatal("read", merr(ev(errno)));
-    if (rc && rc != len)
-        fatal("read", merr(ev(EIO)));
+static void
+print_mtu(struct mdc_scan_out *o, u64 off, u32 type, union cndb_mtu *mtu)
+{
+    switch (type) {
+        case CNDB_TYPE_VERSION:
+            print_ver(o, off, mtu);
+            break;
+        case CNDB_TYPE_META:
+            print_meta(o, off, mtu);
+            break;
+        case CNDB_TYPE_INFO:
+            print_info(o, off, mtu);
+            break;
+        case CNDB_TYPE_INFOD:
+            print_infod(o, off, mtu);
+            break;
+        case CNDB_TYPE_TX:
+            print_tx(o, off, mtu);
+            break;
+        case CNDB_TYPE_ACK:
+            print_ack(o, off, mtu);
+            break;
+        case CNDB_TYPE_NAK:
+            print_nak(o, off, mtu);
+            break;
+        case CNDB_TYPE_TXC:
+            print_txc(o, off, mtu);
+            break;
+        case CNDB_TYPE_TXM:
+            print_txm(o, off, mtu);
+            break;
+        case CNDB_TYPE_TXD:
+            print_txd(o, off, mtu);
+            break;
+    }
+}
 
-    return rc;
+/* Fill in the ids and counts of a record that the emit stage needs.
+ */
+static void
+rec_init(struct cndb_log_rec *rec, union cndb_mtu *mtu)
+{
+    switch (rec->clr_type) {
+        case CNDB_TYPE_INFO:
+        case CNDB_TYPE_INFOD:
+            rec->clr_cnid = mtu->i.mti_cnid;
+            rec->clr_hascnid = true;
+            break;
+        case CNDB_TYPE_TX:
+            rec->clr_txid = mtu->x.mtx_id;
+            rec->clr_seqno = mtu->x.mtx_seqno;
+            rec->clr_hastxid = true;
+            break;
+        case CNDB_TYPE_ACK:
+            rec->clr_txid = mtu->a.mta_txid;
+            rec->clr_hastxid = true;
+            rec->clr_ackd = mtu->a.mta_type == CNDB_ACK_TYPE_D;
+            if (rec->clr_ackd) {
+                rec->clr_cnid = mtu->a.mta_cnid;
+                rec->clr_hascnid = true;
+            }
+            break;
+        case CNDB_TYPE_NAK:
+            rec->clr_txid = mtu->n.mtn_txid;
+            rec->clr_hastxid = true;
+            break;
+        case CNDB_TYPE_TXC:
+            rec->clr_txid = mtu->c.mtc_id;
+            rec->clr_cnid = mtu->c.mtc_cnid;
+            rec->clr_kblks = mtu->c.mtc_kcnt;
+            rec->clr_vblks = mtu->c.mtc_vcnt;
+            rec->clr_hastxid = rec->clr_hascnid = true;
+            break;
+        case CNDB_TYPE_TXM:
+            rec->clr_txid = mtu->m.mtm_id;
+            rec->clr_cnid = mtu->m.mtm_cnid;
+            rec->clr_hastxid = rec->clr_hascnid = true;
+            break;
+        case CNDB_TYPE_TXD:
+            rec->clr_txid = mtu->d.mtd_id;
+            rec->clr_cnid = mtu->d.mtd_cnid;
+            rec->clr_dblks = mtu->d.mtd_n_oids;
+            rec->clr_hastxid = rec->clr_hascnid = true;
+            break;
+    }
+
+    rec->clr_match = true;
+
+    if (opts.cnid.msr_set)
+        rec->clr_match = rec->clr_hascnid && mdc_scan_range_match(&opts.cnid, rec->clr_cnid);
+
+    if (opts.txid.msr_set && rec->clr_match)
+        rec->clr_match = rec->clr_hastxid && mdc_scan_range_match(&opts.txid, rec->clr_txid);
 }
 
-merr_t
-read_rec(struct tool_info *ti, size_t *len)
+/* Decode and format a record for the emit stage, runs on the decode threads.
+ */
+static void
+cndb_log_decode(
+    void *               arg,
+    const void *         buf,
+    size_t               len,
+    u64                  off,
+    void *               priv,
+    struct mdc_scan_out *o)
 {
-    int                  rc1, rc2;
+    struct tool_info *   ti = arg;
+    struct cndb_log_rec *rec = priv;
+    struct cndb_hdr_omf *hdr = (void *)buf;
+    union cndb_mtu *     mtu;
     merr_t               err;
-    struct cndb_hdr_omf *h = (void *)ti->buf;
 
-    /* If a read path has NOT been provided, read from the cndb mdc, else
-     * read from file
-     */
-    if (!ti->rpath) {
-        err = mpool_mdc_read(ti->cndb->cndb_mdc, ti->buf, ti->bufsz, len);
-        if (merr_errno(err) == EOVERFLOW) {
-            hse_log(HSE_INFO "bufsz:%lu, reclen:%lu\n", ti->bufsz, *len);
-            ti->bufsz = *len;
-            ti->buf = realloc(ti->buf, ti->bufsz);
-            if (!ti->buf)
-                return merr(ENOMEM);
+    rec->clr_type = omf_cnhdr_type(hdr);
+    rec->clr_len = len;
+
+    err = cndb_record_unpack(ti->cndb_version, hdr, &mtu);
+    if (err) {
+        char errbuf[300];
+
+        rec->clr_match = true;
+        if (opts.summary)
+            return;
 
-            memset(ti->buf, 0, ti->bufsz);
-            err = mpool_mdc_read(ti->cndb->cndb_mdc, ti->buf, ti->bufsz, len);
+        merr_strerror(err, errbuf, sizeof(errbuf));
+
+        if (opts.json) {
+            mdc_scan_printf(o, "{\"off\": %lu, \"type\": %u, \"error\": ", off, rec->clr_type);
+            mdc_scan_json_str(o, errbuf);
+            mdc_scan_printf(o, "}\n");
+        } else {
+            mdc_scan_printf(
+                o, "%04lx: error unpacking record type %d: %s\n", off, rec->clr_type, errbuf);
         }
-        return err;
+        return;
     }
 
-    /* Read one record from the file */
-    rc1 = eread(ti->fd, ti->buf, sizeof(*h));
+    if (!mtu || rec->clr_type >= NELEM(typenamev) || !typenamev[rec->clr_type]) {
+        rec->clr_match = true;
+        rec->clr_unknown = true;
+        if (!opts.summary)
+            print_unknown(o, off, hdr);
+        free(mtu);
+        return;
+    }
 
-    if (ti->bufsz < omf_cnhdr_len(h) + sizeof(*h)) {
-        /* Resize buffer if it's not sufficiently sized */
-        ti->bufsz = omf_cnhdr_len(h) + sizeof(*h);
-        ti->buf = realloc(ti->buf, ti->bufsz);
-        if (!ti->buf)
-            return merr(ENOMEM);
+    rec_init(rec, mtu);
+
+    if (rec->clr_match && !opts.summary)
+        print_mtu(o, off, rec->clr_type, mtu);
+
+    free(mtu);
+}
+
+static bool
+txid_find(struct tool_info *ti, u64 txid, uint *idx)
+{
+    uint lo = 0, hi = ti->txidc;
+
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+
+        if (ti->txidv[mid] < txid)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    rc2 = eread(ti->fd, ti->buf + sizeof(h), omf_cnhdr_len(h));
+    *idx = lo;
+
+    return lo < ti->txidc && ti->txidv[lo] == txid;
+}
+
+/* Transactions mostly come in txid order, so most adds are appends.
+ */
+static merr_t
+txid_add(struct tool_info *ti, u64 txid)
+{
+    uint idx;
+
+    if (txid_find(ti, txid, &idx))
+        return 0;
+
+    if (ti->txidc == ti->txidmax) {
+        uint  max = ti->txidmax ? ti->txidmax * 2 : 1024;
+        u64 *txidv;
+
+        txidv = realloc(ti->txidv, max * sizeof(*txidv));
+        if (!txidv)
+            return merr(ENOMEM);
+
+        ti->txidv = txidv;
+        ti->txidmax = max;
+    }
 
-    *len = rc1 + rc2;
+    memmove(ti->txidv + idx + 1, ti->txidv + idx, (ti->txidc - idx) * sizeof(*ti->txidv));
+    ti->txidv[idx] = txid;
+    ti->txidc++;
 
     return 0;
 }
 
-void
-printbuf(struct tool_info *ti, u32 cndb_version, struct cndb_hdr_omf *hdr)
+static struct cndb_log_cn *
+summary_cn(struct cndb_log_summary *sum, u64 cnid)
 {
-    merr_t          err;
-    union cndb_mtu *mtu;
-    u32             type;
+    struct cndb_log_cn *cn;
+    uint                i;
 
-    type = omf_cnhdr_type(hdr);
-    err = cndb_record_unpack(cndb_version, hdr, &mtu);
-    if (err) {
-        char errbuf[300];
+    /* A kvdb has a handful of kvses, a linear search is cheap. */
+    for (i = 0; i < sum->cls_cnc; i++)
+        if (sum->cls_cnv[i].clc_cnid == cnid)
+            return sum->cls_cnv + i;
 
-        merr_strerror(err, errbuf, sizeof(errbuf));
+    if (sum->cls_cnc == sum->cls_cnmax) {
+        uint max = sum->cls_cnmax ? sum->cls_cnmax * 2 : 16;
 
-        printf("%04x: ", fileoff);
-        printf("error unpacking record type %d: %s\n", type, errbuf);
+        cn = realloc(sum->cls_cnv, max * sizeof(*cn));
+        if (!cn)
+            return NULL;
 
-        free(mtu);
-        return;
+        sum->cls_cnv = cn;
+        sum->cls_cnmax = max;
     }
 
-    switch (type) {
-        case CNDB_TYPE_VERSION:
-            print_ver(ti, mtu);
-            break;
-        case CNDB_TYPE_META:
-            print_meta(ti, mtu);
-            break;
-        case CNDB_TYPE_INFO:
-            print_info(ti, mtu);
-            break;
-        case CNDB_TYPE_INFOD:
-            print_infod(ti, mtu);
-            break;
-        case CNDB_TYPE_TX:
-            print_tx(ti, mtu);
-            break;
-        case CNDB_TYPE_ACK:
-            print_ack(ti, mtu);
-            break;
-        case CNDB_TYPE_NAK:
-            print_nak(ti, mtu);
-            break;
+    cn = sum->cls_cnv + sum->cls_cnc++;
+    memset(cn, 0, sizeof(*cn));
+    cn->clc_cnid = cnid;
+
+    return cn;
+}
+
+static merr_t
+summary_add(struct cndb_log_summary *sum, const struct cndb_log_rec *rec)
+{
+    struct cndb_log_cn *cn = NULL;
+
+    sum->cls_recs++;
+    sum->cls_bytes += rec->clr_len;
+
+    if (rec->clr_unknown || rec->clr_type >= NELEM(sum->cls_typev)) {
+        sum->cls_unknown++;
+        return 0;
+    }
+
+    sum->cls_typev[rec->clr_type]++;
+
+    if (rec->clr_hastxid) {
+        if (!sum->cls_txid_set || rec->clr_txid < sum->cls_txid_min)
+            sum->cls_txid_min = rec->clr_txid;
+        if (!sum->cls_txid_set || rec->clr_txid > sum->cls_txid_max)
+            sum->cls_txid_max = rec->clr_txid;
+        sum->cls_txid_set = true;
+    }
+
+    if (rec->clr_type == CNDB_TYPE_TX) {
+        if (!sum->cls_seqno_set || rec->clr_seqno < sum->cls_seqno_min)
+            sum->cls_seqno_min = rec->clr_seqno;
+        if (!sum->cls_seqno_set || rec->clr_seqno > sum->cls_seqno_max)
+            sum->cls_seqno_max = rec->clr_seqno;
+        sum->cls_seqno_set = true;
+    }
+
+    if (rec->clr_hascnid) {
+        cn = summary_cn(sum, rec->clr_cnid);
+        if (!cn)
+            return merr(ENOMEM);
+    }
+
+    switch (rec->clr_type) {
         case CNDB_TYPE_TXC:
-            print_txc(ti, mtu);
+            cn->clc_kvsets++;
+            cn->clc_kblks += rec->clr_kblks;
+            cn->clc_vblks += rec->clr_vblks;
             break;
         case CNDB_TYPE_TXM:
-            print_txm(ti, mtu);
+            cn->clc_txm++;
             break;
         case CNDB_TYPE_TXD:
-            print_txd(ti, mtu);
+            cn->clc_kvsets_del++;
+            cn->clc_mblks_del += rec->clr_dblks;
+            break;
+        case CNDB_TYPE_ACK:
+            if (cn)
+                cn->clc_ackd++;
             break;
-        default:
-            printf("%04x: ", fileoff);
-            printf("unknown type 0x%08x len %d\n", omf_cnhdr_type(hdr), omf_cnhdr_len(hdr));
-            status = 1;
     }
-    free(mtu);
+
+    return 0;
+}
+
+static void
+summary_print(struct cndb_log_summary *sum)
+{
+    struct cndb_log_cn *cn;
+    uint                i;
+
+    printf("{\"records\": %lu, \"bytes\": %lu, \"types\": {", sum->cls_recs, sum->cls_bytes);
+
+    for (i = 0; i < NELEM(sum->cls_typev); i++)
+        if (typenamev[i])
+            printf("%s\"%s\": %lu", i > 1 ? ", " : "", typenamev[i], sum->cls_typev[i]);
+
+    printf(
+        "}, \"unknown\": %lu, \"txid_min\": %lu, \"txid_max\": %lu"
+        ", \"seqno_min\": %lu, \"seqno_max\": %lu, \"cns\": [",
+        sum->cls_unknown,
+        sum->cls_txid_min,
+        sum->cls_txid_max,
+        sum->cls_seqno_min,
+        sum->cls_seqno_max);
+
+    for (i = 0; i < sum->cls_cnc; i++) {
+        cn = sum->cls_cnv + i;
+
+        printf(
+            "%s{\"cnid\": %lu, \"kvsets\": %lu, \"kblks\": %lu, \"vblks\": %lu"
+            ", \"txm\": %lu, \"kvsets_del\": %lu, \"mblks_del\": %lu, \"ack_d\": %lu}",
+            i ? ", " : "",
+            cn->clc_cnid,
+            cn->clc_kvsets,
+            cn->clc_kblks,
+            cn->clc_vblks,
+            cn->clc_txm,
+            cn->clc_kvsets_del,
+            cn->clc_mblks_del,
+            cn->clc_ackd);
+    }
+
+    printf("]}\n");
+}
+
+/* Emit a decoded record, in log order.
+ */
+static merr_t
+cndb_log_emit(void *arg, const void *priv, const char *text, size_t len)
+{
+    const struct cndb_log_rec *rec = priv;
+    struct tool_info *         ti = arg;
+    merr_t                     err;
+    uint                       idx;
+
+    if (opts.seqno.msr_set) {
+        if (rec->clr_type == CNDB_TYPE_TX && mdc_scan_range_match(&opts.seqno, rec->clr_seqno)) {
+            err = txid_add(ti, rec->clr_txid);
+            if (err)
+                return err;
+        }
+
+        if (!rec->clr_hastxid || !txid_find(ti, rec->clr_txid, &idx))
+            return 0;
+    }
+
+    if (!rec->clr_match)
+        return 0;
+
+    if (rec->clr_unknown)
+        status = 1;
+
+    if (opts.summary)
+        return summary_add(&ti->sum, rec);
+
+    if (len && fwrite(text, 1, len, stdout) != len)
+        return merr(EIO);
+
+    return 0;
+}
+
+int
+eread(int fd, char *buf, int len, off_t off)
+{
+    int rc;
+
+    rc = pread(fd, buf, len, off);
+    if (rc < 0)
+        fatal("read", merr(ev(errno)));
+    if (rc && rc != len)
+        fatal("read", merr(ev(EIO)));
+
+    return rc;
+}
+
+/* Read the next record from the cndb mdc or, with -r, from the file.  The
+ * version of the log is noted here, as the records are read in order.
+ */
+static merr_t
+cndb_log_read(void *arg, void *buf, size_t bufsz, size_t *len)
+{
+    struct tool_info *   ti = arg;
+    struct cndb_hdr_omf *h = buf;
+    merr_t               err;
+    int                  rc;
+
+    /* If a read path has NOT been provided, read from the cndb mdc, else
+     * read from file
+     */
+    if (!ti->rpath) {
+        err = mpool_mdc_read(ti->cndb->cndb_mdc, buf, bufsz, len);
+        if (err)
+            return err;
+    } else {
+        struct cndb_hdr_omf hdr;
+
+        /* Read one record from the file */
+        rc = eread(ti->fd, (char *)&hdr, sizeof(hdr), ti->roff);
+        if (!rc) {
+            *len = 0;
+            return 0;
+        }
+
+        *len = sizeof(hdr) + omf_cnhdr_len(&hdr);
+        if (*len > bufsz)
+            return merr(EOVERFLOW);
+
+        memcpy(buf, &hdr, sizeof(hdr));
+        eread(ti->fd, buf + sizeof(hdr), omf_cnhdr_len(&hdr), ti->roff + sizeof(hdr));
+
+        ti->roff += *len;
+    }
+
+    if (*len && omf_cnhdr_type(h) == CNDB_TYPE_VERSION)
+        ti->cndb_version = omf_cnver_version(buf);
+
+    return 0;
 }
 
 merr_t
 print_cndb_log(struct tool_info *ti)
 {
+    struct mdc_scan_ops ops = {
+        .mso_privsz = sizeof(struct cndb_log_rec),
+        .mso_read = cndb_log_read,
+        .mso_decode = cndb_log_decode,
+        .mso_emit = cndb_log_emit,
+    };
     merr_t err;
-    u32    cndb_version = 0;
 
-    while (1) {
-        struct cndb_hdr_omf *hdr;
-        size_t               len = 0;
+    err = mdc_scan(&ops, ti, opts.threads);
 
-        /* Read from source(file or mdc) */
-        err = read_rec(ti, &len);
-        if (!len || err)
-            break;
+    if (opts.summary)
+        summary_print(&ti->sum);
 
-        if (ti->fp) {
-            /* write to file instead of stdout */
-            fwrite(ti->buf, 1, len, ti->fp);
-            continue;
-        }
+    return err;
+}
 
-        hdr = (void *)ti->buf;
+/* Copy the raw records from the input to the -w file.
+ */
+merr_t
+copy_cndb_log(struct tool_info *ti)
+{
+    merr_t err;
+    size_t len;
 
-        assert(omf_cnhdr_len(hdr) + sizeof(*hdr) == len);
+    while (1) {
+        err = cndb_log_read(ti, ti->buf, ti->bufsz, &len);
+        if (merr_errno(err) == EOVERFLOW) {
+            hse_log(HSE_INFO "bufsz:%lu, reclen:%lu\n", ti->bufsz, len);
+            free(ti->buf);
+            ti->bufsz = len;
+            ti->buf = malloc(ti->bufsz);
+            if (!ti->buf)
+                return merr(ENOMEM);
 
-        if (omf_cnhdr_type(hdr) == CNDB_TYPE_VERSION)
-            cndb_version = omf_cnver_version((struct cndb_ver_omf *)ti->buf);
+            err = cndb_log_read(ti, ti->buf, ti->bufsz, &len);
+        }
 
-        printbuf(ti, cndb_version, hdr);
+        if (!len || err)
+            break;
 
-        fileoff += sizeof(*hdr) + omf_cnhdr_len(hdr);
+        fwrite(ti->buf, 1, len, ti->fp);
     }
 
     return err;
@@ -441,11 +998,47 @@ close_all(struct tool_info *ti)
         close(ti->fd);
 
     free(ti->buf);
+    free(ti->txidv);
+    free(ti->sum.cls_cnv);
+}
+
+/* Print a record of the replayed log, in check mode.
+ */
+static void
+printbuf(struct mdc_scan_out *o, u64 off, u32 cndb_version, struct cndb_hdr_omf *hdr)
+{
+    merr_t          err;
+    union cndb_mtu *mtu;
+    u32             type;
+
+    type = omf_cnhdr_type(hdr);
+    err = cndb_record_unpack(cndb_version, hdr, &mtu);
+    if (err) {
+        char errbuf[300];
+
+        merr_strerror(err, errbuf, sizeof(errbuf));
+        mdc_scan_printf(o, "%04lx: error unpacking record type %d: %s\n", off, type, errbuf);
+    } else if (!mtu || type >= NELEM(typenamev) || !typenamev[type]) {
+        print_unknown(o, off, hdr);
+        status = 1;
+    } else {
+        print_mtu(o, off, type, mtu);
+    }
+
+    free(mtu);
+}
+
+static void
+out_flush(struct mdc_scan_out *o)
+{
+    fwrite(o->mso_buf, 1, o->mso_len, stdout);
+    o->mso_len = 0;
 }
 
 static merr_t
 replay_log(struct tool_info *ti)
 {
+    struct mdc_scan_out  out = {};
     merr_t               err = 0;
     struct cndb_hdr_omf *hdr = NULL;
     size_t               hdrsz = 65536;
@@ -453,6 +1046,7 @@ replay_log(struct tool_info *ti)
     int                  i;
     u64                  seqno;
     u64                  ingestid;
+    u64                  fileoff;
     u32                  cndb_version;
     union cndb_mtu *     mtu;
 
@@ -487,7 +1081,7 @@ replay_log(struct tool_info *ti)
         free(mtu);
         return err;
     }
-    print_ver(ti, mtu);
+    print_ver(&out, fileoff, mtu);
     free(mtu);
     fileoff += len;
 
@@ -515,13 +1109,15 @@ replay_log(struct tool_info *ti)
 
         err = cndb_record_unpack(CNDB_VERSION, &inf->hdr, &mtu);
         if (err) {
+            out_flush(&out);
             printf("error unpacking info record %d\n", merr_errno(err));
             free(mtu);
             free(hdr);
+            mdc_scan_out_fini(&out);
             return err;
         }
 
-        print_info(ti, mtu);
+        print_info(&out, fileoff, mtu);
         free(mtu);
 
         fileoff += cn->cn_cbufsz;
@@ -532,15 +1128,19 @@ replay_log(struct tool_info *ti)
         if (ev(err))
             break;
 
-        printbuf(ti, CNDB_VERSION, hdr);
+        printbuf(&out, fileoff, CNDB_VERSION, hdr);
         fileoff += sizeof(*hdr) + omf_cnhdr_len(hdr);
         memset(hdr, 0, hdrsz);
     }
 
-    printf("------ unrecoverable txns:\n");
+    out_flush(&out);
+
+    if (!opts.json)
+        printf("------ unrecoverable txns:\n");
 
     for (i = 0; !err && i < ti->cndb->cndb_workc; i++) {
         if (ti->cndb->cndb_workv[i] == NULL) {
+            out_flush(&out);
             printf("work item %d/%lu is NULL!\n", i, (ulong)ti->cndb->cndb_workc);
             continue;
         }
@@ -548,16 +1148,28 @@ replay_log(struct tool_info *ti)
         if (ev(err))
             break;
 
-        printbuf(ti, CNDB_VERSION, hdr);
+        printbuf(&out, fileoff, CNDB_VERSION, hdr);
         fileoff += sizeof(*hdr) + omf_cnhdr_len(hdr);
         memset(hdr, 0, hdrsz);
     }
 
+    out_flush(&out);
+    mdc_scan_out_fini(&out);
+
     free(hdr);
 
     return err;
 }
 
+static void
+range_parse(const char *name, const char *str, struct mdc_scan_range *range)
+{
+    if (mdc_scan_range_parse(str, range)) {
+        syntax("invalid %s range '%s'", name, str);
+        exit(EX_USAGE);
+    }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -573,8 +1185,14 @@ main(int argc, char **argv)
     hse_logging_control.mlc_cur_pri = HSE_DEBUG;
     hse_openlog(progname, 0);
 
-    while ((c = getopt(argc, argv, ":chir:w:")) != -1) {
+    opts.threads = clamp_t(long, sysconf(_SC_NPROCESSORS_ONLN), 1, 8);
+
+    while ((c = getopt(argc, argv, ":C:chijr:S:sT:t:w:")) != -1) {
         switch (c) {
+            case 'C':
+                range_parse("cnid", optarg, &opts.cnid);
+                break;
+
             case 'c':
                 check = 1;
                 break;
@@ -584,13 +1202,37 @@ main(int argc, char **argv)
                 exit(0);
 
             case 'i':
-                ignore = 1;
+                /* Errors are printed and the log read on, always. */
+                break;
+
+            case 'j':
+                opts.json = true;
                 break;
 
             case 'r':
                 ti.rpath = optarg;
                 break;
 
+            case 'S':
+                range_parse("seqno", optarg, &opts.seqno);
+                break;
+
+            case 's':
+                opts.summary = true;
+                break;
+
+            case 'T':
+                range_parse("txid", optarg, &opts.txid);
+                break;
+
+            case 't':
+                if (parse_uint(optarg, &opts.threads) || !opts.threads ||
+                    opts.threads > THREADS_MAX) {
+                    syntax("invalid thread count '%s' (1 to %u)", optarg, THREADS_MAX);
+                    exit(EX_USAGE);
+                }
+                break;
+
             case 'w':
                 ti.wpath = optarg;
                 break;
@@ -612,6 +1254,11 @@ main(int argc, char **argv)
     argc -= optind;
     argv += optind;
 
+    if (check && (opts.summary || opts.cnid.msr_set || opts.txid.msr_set || opts.seqno.msr_set)) {
+        syntax("-c cannot be used with -s, -C, -S or -T");
+        exit(EX_USAGE);
+    }
+
     /* Output: if wpath was provided, write raw data to file instead of
      * formatting to stdout
      */
@@ -656,6 +1303,8 @@ main(int argc, char **argv)
         err = replay_log(&ti);
 
         ti.buf = NULL; /* avoid double-free */
+    } else if (ti.fp) {
+        err = copy_cndb_log(&ti);
     } else {
         err = print_cndb_log(&ti);
     }
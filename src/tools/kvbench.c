@@ -0,0 +1,598 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/* kvbench - multi-threaded put/get/cursor/delete microbenchmarks
+ *
+ * Each phase runs a fixed number of operations spread over the worker
+ * threads against a scratch kvs of a real kvdb, and prints one line of
+ * JSON with its throughput and latency percentiles so that results can
+ * be compared from build to build.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/lathist.h>
+#include <hse_util/minmax.h>
+#include <hse_util/parse_num.h>
+
+#include <hse_test_support/key_generation.h>
+#include <hse_test_support/mwc_rand.h>
+
+#include <hse/hse.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sysexits.h>
+
+enum kvb_phase {
+    KVB_PUT,
+    KVB_GET,
+    KVB_CURSOR,
+    KVB_DEL,
+    KVB_PHASE_MAX
+};
+
+enum kvb_dist {
+    KVB_DIST_SEQ,
+    KVB_DIST_UNIFORM,
+    KVB_DIST_ZIPF,
+};
+
+static const char *const kvb_phasev[] = { "put", "get", "cursor", "del" };
+static const char *const kvb_distv[] = { "seq", "uniform", "zipf" };
+
+/**
+ * struct kvb_zipf - zipfian key index generator (Gray et al., as in YCSB)
+ */
+struct kvb_zipf {
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half_pow_theta;
+};
+
+struct kvb_opts {
+    u64           keys;
+    u64           ops;
+    uint          threads;
+    uint          klen;
+    uint          vlen_min;
+    uint          vlen_max;
+    uint          cursor_reads;
+    enum kvb_dist dist;
+    bool          phasev[KVB_PHASE_MAX];
+    bool          keep;
+    const char *  kvs_name;
+};
+
+/**
+ * struct kvb_worker - state of one worker thread
+ * @kw_tid:   thread id
+ * @kw_id:    thread index
+ * @kw_phase: phase being run
+ * @kw_ops:   operations completed
+ * @kw_found: gets that found their key, records read by cursors
+ * @kw_err:   first error, if any
+ * @kw_mwc:   random number generator
+ */
+struct kvb_worker {
+    pthread_t       kw_tid;
+    uint            kw_id;
+    enum kvb_phase  kw_phase;
+    u64             kw_ops;
+    u64             kw_found;
+    hse_err_t       kw_err;
+    struct mwc_rand kw_mwc;
+};
+
+static const char *          progname;
+static struct kvb_opts       opts;
+static struct hse_kvs *      kvb_kvs;
+static struct key_generator *kvb_kg;
+static struct kvb_zipf       kvb_zipf;
+static struct lathist *      kvb_lh;
+
+static void
+fatal(hse_err_t err, const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (err) {
+        char errbuf[128];
+
+        hse_err_to_string(err, errbuf, sizeof(errbuf), NULL);
+        fprintf(stderr, "%s: %s: %s\n", progname, msg, errbuf);
+    } else {
+        fprintf(stderr, "%s: %s\n", progname, msg);
+    }
+
+    exit(EX_SOFTWARE);
+}
+
+static void
+usage(void)
+{
+    printf(
+        "usage: %s [options] <kvdb> [param=value ...]\n"
+        "-c reads   records read per cursor seek (default: %u)\n"
+        "-d dist    key distribution: seq, uniform or zipf (default: %s)\n"
+        "-h         print this help list\n"
+        "-K         keep the kvs (default: drop it at exit)\n"
+        "-k klen    key length (default: %u)\n"
+        "-n keys    size of the key space (default: %lu)\n"
+        "-o ops     operations per phase (default: keys)\n"
+        "-p phases  comma separated list from put,get,cursor,del (default: all)\n"
+        "-s kvs     kvs name (default: %s)\n"
+        "-t thrds   worker threads (default: %u)\n"
+        "-v vlen    value length, or min-max for uniformly random lengths (default: %u)\n"
+        "\n"
+        "Each phase prints one line of JSON on stdout.  Params are passed to\n"
+        "hse_params_set(), e.g. kvs.kvs_vcache_mb=256.\n",
+        progname,
+        opts.cursor_reads,
+        kvb_distv[opts.dist],
+        opts.klen,
+        opts.keys,
+        opts.kvs_name,
+        opts.threads,
+        opts.vlen_min);
+}
+
+static double
+kvb_rand_double(struct mwc_rand *mwc)
+{
+    return (mwc_rand64(mwc) >> 11) * (1.0 / (1ul << 53));
+}
+
+static void
+kvb_zipf_init(struct kvb_zipf *z, u64 n, double theta)
+{
+    double zeta2;
+    u64    i;
+
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->half_pow_theta = 1.0 + pow(0.5, theta);
+
+    z->zetan = 0;
+    for (i = 1; i <= n; ++i)
+        z->zetan += 1.0 / pow(i, theta);
+
+    zeta2 = 1.0 + 1.0 / pow(2, theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static u64
+kvb_zipf_next(struct kvb_zipf *z, struct mwc_rand *mwc, u64 n)
+{
+    double u = kvb_rand_double(mwc);
+    double uz = u * z->zetan;
+    u64    idx;
+
+    if (uz < 1.0)
+        idx = 0;
+    else if (uz < z->half_pow_theta)
+        idx = 1;
+    else
+        idx = n * pow(z->eta * u - z->eta + 1.0, z->alpha);
+
+    /* Scatter the hot indexes over the key space.
+     */
+    return (min_t(u64, idx, n - 1) * 0x9e3779b97f4a7c15ul) % n;
+}
+
+/* Index of the i-th key of a worker's share of the phase.
+ */
+static u64
+kvb_key_index(struct kvb_worker *w, u64 i)
+{
+    switch (opts.dist) {
+        case KVB_DIST_SEQ:
+            return (w->kw_id * (opts.ops / opts.threads) + i) % opts.keys;
+        case KVB_DIST_UNIFORM:
+            return mwc_rand64(&w->kw_mwc) % opts.keys;
+        case KVB_DIST_ZIPF:
+            return kvb_zipf_next(&kvb_zipf, &w->kw_mwc, opts.keys);
+    }
+
+    return 0;
+}
+
+static uint
+kvb_vlen(struct kvb_worker *w)
+{
+    if (opts.vlen_min == opts.vlen_max)
+        return opts.vlen_min;
+
+    return mwc_rand_range32(&w->kw_mwc, opts.vlen_min, opts.vlen_max + 1);
+}
+
+static hse_err_t
+kvb_op(struct kvb_worker *w, struct hse_kvs_cursor *cur, u8 *key, u8 *val)
+{
+    const void *kdata, *vdata;
+    size_t      klen, vlen;
+    hse_err_t   err = 0;
+    bool        found, eof;
+    uint        i;
+
+    switch (w->kw_phase) {
+        case KVB_PUT:
+            return hse_kvs_put(kvb_kvs, NULL, key, opts.klen, val, kvb_vlen(w));
+
+        case KVB_GET:
+            err = hse_kvs_get(kvb_kvs, NULL, key, opts.klen, &found, val, opts.vlen_max, &vlen);
+            w->kw_found += (!err && found);
+            return err;
+
+        case KVB_CURSOR:
+            err = hse_kvs_cursor_seek(cur, NULL, key, opts.klen, NULL, NULL);
+            for (i = 0; !err && i < opts.cursor_reads; ++i) {
+                err = hse_kvs_cursor_read(cur, NULL, &kdata, &klen, &vdata, &vlen, &eof);
+                if (err || eof)
+                    break;
+
+                w->kw_found++;
+            }
+            return err;
+
+        case KVB_DEL:
+            return hse_kvs_delete(kvb_kvs, NULL, key, opts.klen);
+
+        case KVB_PHASE_MAX:
+            break;
+    }
+
+    return 0;
+}
+
+static void *
+kvb_worker_main(void *arg)
+{
+    struct kvb_worker *    w = arg;
+    struct hse_kvs_cursor *cur = NULL;
+    u64                    ops, i, start;
+    u8 *                   key, *val;
+    hse_err_t              err;
+
+    key = malloc(opts.klen);
+    val = malloc(opts.vlen_max + 1);
+    if (!key || !val) {
+        w->kw_err = ENOMEM;
+        goto out;
+    }
+
+    memset(val, 'a' + w->kw_id % 26, opts.vlen_max + 1);
+
+    if (w->kw_phase == KVB_CURSOR) {
+        err = hse_kvs_cursor_create(kvb_kvs, NULL, NULL, 0, &cur);
+        if (err) {
+            w->kw_err = err;
+            goto out;
+        }
+    }
+
+    ops = opts.ops / opts.threads;
+    if (w->kw_id < opts.ops % opts.threads)
+        ++ops;
+
+    for (i = 0; i < ops; ++i) {
+        get_key(kvb_kg, key, kvb_key_index(w, i));
+
+        start = get_time_ns();
+        err = kvb_op(w, cur, key, val);
+        lathist_add(kvb_lh, get_time_ns() - start);
+
+        if (err) {
+            w->kw_err = err;
+            break;
+        }
+
+        w->kw_ops++;
+    }
+
+    if (cur)
+        hse_kvs_cursor_destroy(cur);
+
+out:
+    free(val);
+    free(key);
+
+    return NULL;
+}
+
+static void
+kvb_run(enum kvb_phase phase)
+{
+    struct lathist_snap *snap;
+    struct kvb_worker *  workerv;
+    u64                  start, ns, ops, found;
+    hse_err_t            err;
+    uint                 i;
+    int                  rc;
+
+    workerv = calloc(opts.threads, sizeof(*workerv));
+    snap = calloc(1, sizeof(*snap));
+    if (!workerv || !snap)
+        fatal(0, "out of memory");
+
+    lathist_reset(kvb_lh);
+
+    start = get_time_ns();
+
+    for (i = 0; i < opts.threads; ++i) {
+        struct kvb_worker *w = workerv + i;
+
+        w->kw_id = i;
+        w->kw_phase = phase;
+        mwc_rand_init(&w->kw_mwc, (u32)(start + i * 7919));
+
+        rc = pthread_create(&w->kw_tid, NULL, kvb_worker_main, w);
+        if (rc)
+            fatal(0, "pthread_create: %s", strerror(rc));
+    }
+
+    ops = found = 0;
+    err = 0;
+
+    for (i = 0; i < opts.threads; ++i) {
+        struct kvb_worker *w = workerv + i;
+
+        pthread_join(w->kw_tid, NULL);
+
+        ops += w->kw_ops;
+        found += w->kw_found;
+        if (!err)
+            err = w->kw_err;
+    }
+
+    ns = get_time_ns() - start;
+
+    lathist_snap(kvb_lh, snap);
+
+    printf(
+        "{\"phase\":\"%s\",\"dist\":\"%s\",\"threads\":%u,\"keys\":%lu,\"klen\":%u,"
+        "\"vlen_min\":%u,\"vlen_max\":%u,\"ops\":%lu,\"found\":%lu,\"errno\":%d,"
+        "\"secs\":%.6f,\"ops_per_sec\":%.1f,"
+        "\"lat_ns\":{\"avg\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"p99.9\":%lu,"
+        "\"p99.99\":%lu,\"max\":%lu}}\n",
+        kvb_phasev[phase],
+        kvb_distv[opts.dist],
+        opts.threads,
+        opts.keys,
+        opts.klen,
+        opts.vlen_min,
+        opts.vlen_max,
+        ops,
+        found,
+        hse_err_to_errno(err),
+        ns / 1e9,
+        ns ? ops * 1e9 / ns : 0.0,
+        snap->lss_count ? snap->lss_sum / snap->lss_count : 0,
+        lathist_snap_pct(snap, 50.0),
+        lathist_snap_pct(snap, 90.0),
+        lathist_snap_pct(snap, 99.0),
+        lathist_snap_pct(snap, 99.9),
+        lathist_snap_pct(snap, 99.99),
+        snap->lss_max);
+    fflush(stdout);
+
+    free(snap);
+    free(workerv);
+
+    if (err)
+        fatal(err, "%s phase failed", kvb_phasev[phase]);
+}
+
+static void
+kvb_parse_phases(const char *str)
+{
+    char *dup, *tok, *next;
+    int   i;
+
+    memset(opts.phasev, 0, sizeof(opts.phasev));
+
+    dup = strdup(str);
+    if (!dup)
+        fatal(0, "out of memory");
+
+    for (next = dup; (tok = strsep(&next, ","));) {
+        for (i = 0; i < KVB_PHASE_MAX; ++i)
+            if (!strcmp(tok, kvb_phasev[i]))
+                break;
+
+        if (i == KVB_PHASE_MAX)
+            fatal(0, "invalid phase '%s', use -h for help", tok);
+
+        opts.phasev[i] = true;
+    }
+
+    free(dup);
+}
+
+static u64
+kvb_parse_num(const char *str, const char *what)
+{
+    u64    val;
+    merr_t err;
+
+    err = parse_u64(str, &val);
+    if (err)
+        fatal(0, "invalid %s '%s', use -h for help", what, str);
+
+    return val;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct hse_params *params;
+    struct hse_kvdb *  kvdb;
+    const char *       mpname;
+    hse_err_t          err;
+    merr_t             merr;
+    char *             sep;
+    int                c, i;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opts.keys = 1000 * 1000;
+    opts.threads = 8;
+    opts.klen = 16;
+    opts.vlen_min = opts.vlen_max = 100;
+    opts.cursor_reads = 16;
+    opts.dist = KVB_DIST_SEQ;
+    opts.kvs_name = "kvbench";
+    for (i = 0; i < KVB_PHASE_MAX; ++i)
+        opts.phasev[i] = true;
+
+    while (-1 != (c = getopt(argc, argv, ":c:d:hKk:n:o:p:s:t:v:"))) {
+        switch (c) {
+            case 'c':
+                opts.cursor_reads = kvb_parse_num(optarg, "cursor reads");
+                break;
+
+            case 'd':
+                for (i = 0; i < NELEM(kvb_distv); ++i)
+                    if (!strcmp(optarg, kvb_distv[i]))
+                        break;
+                if (i == NELEM(kvb_distv))
+                    fatal(0, "invalid distribution '%s', use -h for help", optarg);
+                opts.dist = i;
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'K':
+                opts.keep = true;
+                break;
+
+            case 'k':
+                opts.klen = kvb_parse_num(optarg, "key length");
+                break;
+
+            case 'n':
+                opts.keys = kvb_parse_num(optarg, "key count");
+                break;
+
+            case 'o':
+                opts.ops = kvb_parse_num(optarg, "op count");
+                break;
+
+            case 'p':
+                kvb_parse_phases(optarg);
+                break;
+
+            case 's':
+                opts.kvs_name = optarg;
+                break;
+
+            case 't':
+                opts.threads = kvb_parse_num(optarg, "thread count");
+                break;
+
+            case 'v':
+                sep = strchr(optarg, '-');
+                if (sep)
+                    *sep++ = '\0';
+                opts.vlen_min = kvb_parse_num(optarg, "value length");
+                opts.vlen_max = sep ? kvb_parse_num(sep, "value length") : opts.vlen_min;
+                break;
+
+            case ':':
+                fatal(0, "option -%c requires an argument, use -h for help", optopt);
+                break;
+
+            default:
+                fatal(0, "invalid option -%c, use -h for help", optopt);
+                break;
+        }
+    }
+
+    if (optind >= argc)
+        fatal(0, "missing kvdb name, use -h for help");
+
+    mpname = argv[optind++];
+
+    if (!opts.ops)
+        opts.ops = opts.keys;
+
+    if (!opts.keys || !opts.threads || !opts.klen || opts.vlen_min > opts.vlen_max)
+        fatal(0, "invalid key count, thread count, key or value length");
+
+    kvb_kg = create_key_generator(opts.keys, opts.klen);
+    if (!kvb_kg)
+        fatal(0, "cannot generate %lu keys of %u bytes", opts.keys, opts.klen);
+
+    if (opts.dist == KVB_DIST_ZIPF)
+        kvb_zipf_init(&kvb_zipf, opts.keys, 0.99);
+
+    merr = lathist_create(&kvb_lh);
+    if (merr)
+        fatal(0, "cannot create latency histogram");
+
+    err = hse_kvdb_init();
+    if (err)
+        fatal(err, "hse_kvdb_init");
+
+    err = hse_params_create(&params);
+    if (err)
+        fatal(err, "hse_params_create");
+
+    for (; optind < argc; ++optind) {
+        sep = strchr(argv[optind], '=');
+        if (!sep)
+            fatal(0, "invalid param '%s', use -h for help", argv[optind]);
+
+        *sep++ = '\0';
+
+        err = hse_params_set(params, argv[optind], sep);
+        if (err)
+            fatal(err, "hse_params_set %s", argv[optind]);
+    }
+
+    err = hse_kvdb_open(mpname, params, &kvdb);
+    if (err)
+        fatal(err, "hse_kvdb_open %s", mpname);
+
+    err = hse_kvdb_kvs_make(kvdb, opts.kvs_name, params);
+    if (err && hse_err_to_errno(err) != EEXIST)
+        fatal(err, "hse_kvdb_kvs_make %s", opts.kvs_name);
+
+    err = hse_kvdb_kvs_open(kvdb, opts.kvs_name, params, &kvb_kvs);
+    if (err)
+        fatal(err, "hse_kvdb_kvs_open %s", opts.kvs_name);
+
+    for (i = 0; i < KVB_PHASE_MAX; ++i)
+        if (opts.phasev[i])
+            kvb_run(i);
+
+    hse_kvdb_kvs_close(kvb_kvs);
+
+    if (!opts.keep) {
+        err = hse_kvdb_kvs_drop(kvdb, opts.kvs_name);
+        if (err)
+            fatal(err, "hse_kvdb_kvs_drop %s", opts.kvs_name);
+    }
+
+    hse_kvdb_close(kvdb);
+    hse_params_destroy(params);
+    hse_kvdb_fini();
+
+    lathist_destroy(kvb_lh);
+    destroy_key_generator(kvb_kg);
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/* kvdb_startup - measure the open and close of a kvdb, phase by phase
+ *
+ * kvdb_startup optionally loads a kvdb with a synthetic dataset, and then
+ * closes and reopens it a number of times, printing for each cycle a line
+ * of JSON with the wall clock time of the open (kvdb and kvses) and of
+ * the close, and the time and count of each phase of both as reported by
+ * ikvdb_phase_get() once the kvdb is closed.
+ *
+ * The shape of the dataset sets the work of the phases: each flush of
+ * the load creates at least one kvset per kvs (more with a small
+ * kvdb.c0_heap_sz), so the number of keys between flushes sets the number
+ * of kvsets and of cndb records replayed at open, and the value length
+ * the number of vblocks.  With kvdb.dur_close_ckpt=1, c0 is left in c1 at
+ * close and the next open replays it.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/parse_num.h>
+
+#include <hse_ikvdb/ikvdb.h>
+
+#include <hse/hse.h>
+
+#include <endian.h>
+#include <getopt.h>
+#include <sysexits.h>
+
+#define KVS_MAX (64)
+
+struct opts {
+    uint cycles;
+    bool drop;
+    u64  flush;
+    uint kvsc;
+    uint vlen;
+    u64  keys;
+};
+
+static const char *       progname;
+static const char *       mpname;
+static struct opts        opts;
+static struct hse_params *params;
+static struct hse_kvdb *  kvdb;
+static struct hse_kvs *   kvsv[KVS_MAX];
+
+static void
+fatal(hse_err_t err, const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (err) {
+        char errbuf[128];
+
+        hse_err_to_string(err, errbuf, sizeof(errbuf), NULL);
+        fprintf(stderr, "%s: %s: %s\n", progname, msg, errbuf);
+    } else {
+        fprintf(stderr, "%s: %s\n", progname, msg);
+    }
+
+    exit(EX_SOFTWARE);
+}
+
+static void
+usage(void)
+{
+    printf(
+        "usage: %s [options] <kvdb> [param=value ...]\n"
+        "-c cycles  close and reopen cycles (default: %u)\n"
+        "-D         drop the kvses at exit\n"
+        "-f keys    flush the kvdb every keys keys per kvs (default: 0, never)\n"
+        "-h         print this help list\n"
+        "-k kvses   kvses to open, created if they do not exist (default: %u)\n"
+        "-l vlen    value length of the keys loaded (default: %u)\n"
+        "-n keys    keys to load into each kvs before the first cycle (default: 0)\n"
+        "\n"
+        "Params are passed to hse_params_set(), e.g. kvdb.dur_close_ckpt=1 to\n"
+        "measure c1 replay.  Example, about 1000 kvsets per kvs:\n"
+        "\n"
+        "  %s -k 4 -n 100000000 -f 100000 mp1\n",
+        progname,
+        opts.cycles,
+        opts.kvsc,
+        opts.vlen,
+        progname);
+}
+
+/* Open the kvdb and its kvses, return the time it took (ns).
+ */
+static u64
+startup_open(void)
+{
+    hse_err_t err;
+    char      name[32];
+    u64       tstart;
+    uint      i;
+
+    tstart = get_time_ns();
+
+    err = hse_kvdb_open(mpname, params, &kvdb);
+    if (err)
+        fatal(err, "hse_kvdb_open %s", mpname);
+
+    for (i = 0; i < opts.kvsc; i++) {
+        snprintf(name, sizeof(name), "startup%02u", i);
+
+        err = hse_kvdb_kvs_open(kvdb, name, params, &kvsv[i]);
+        if (hse_err_to_errno(err) == ENOENT) {
+            err = hse_kvdb_kvs_make(kvdb, name, params);
+            if (err)
+                fatal(err, "hse_kvdb_kvs_make %s", name);
+
+            err = hse_kvdb_kvs_open(kvdb, name, params, &kvsv[i]);
+        }
+
+        if (err)
+            fatal(err, "hse_kvdb_kvs_open %s", name);
+    }
+
+    return get_time_ns() - tstart;
+}
+
+/* Close the kvdb and its kvses, return the time it took (ns).
+ */
+static u64
+startup_close(void)
+{
+    hse_err_t err;
+    u64       tstart;
+    uint      i;
+
+    tstart = get_time_ns();
+
+    for (i = 0; i < opts.kvsc; i++) {
+        err = hse_kvdb_kvs_close(kvsv[i]);
+        if (err)
+            fatal(err, "hse_kvdb_kvs_close");
+    }
+
+    err = hse_kvdb_close(kvdb);
+    if (err)
+        fatal(err, "hse_kvdb_close %s", mpname);
+
+    kvdb = NULL;
+
+    return get_time_ns() - tstart;
+}
+
+/* Put opts.keys keys into each kvs, round robin, flushing the kvdb every
+ * opts.flush keys per kvs.
+ */
+static void
+startup_load(void)
+{
+    hse_err_t err;
+    char *    vbuf;
+    u64       key, tstart;
+    uint      i;
+
+    vbuf = malloc(opts.vlen + 1);
+    if (!vbuf)
+        fatal(0, "out of memory");
+
+    for (i = 0; i < opts.vlen; i++)
+        vbuf[i] = 'a' + i % 26;
+
+    tstart = get_time_ns();
+
+    for (key = 0; key < opts.keys; key++) {
+        u64 kbuf = htobe64(key);
+
+        for (i = 0; i < opts.kvsc; i++) {
+            err = hse_kvs_put(kvsv[i], NULL, &kbuf, sizeof(kbuf), vbuf, opts.vlen);
+            if (err)
+                fatal(err, "hse_kvs_put");
+        }
+
+        if (opts.flush && (key + 1) % opts.flush == 0) {
+            err = hse_kvdb_flush(kvdb);
+            if (err)
+                fatal(err, "hse_kvdb_flush");
+        }
+    }
+
+    free(vbuf);
+
+    printf(
+        "{\"phase\": \"load\", \"kvses\": %u, \"keys\": %lu, \"vlen\": %u, \"load_ms\": %lu}\n",
+        opts.kvsc,
+        opts.keys,
+        opts.vlen,
+        (get_time_ns() - tstart) / 1000000);
+}
+
+static void
+startup_report(uint cycle, u64 open_ns, u64 close_ns, const struct ikvdb_phase_stats *phv)
+{
+    const char *name, *unit;
+    int         i;
+
+    printf(
+        "{\"phase\": \"cycle\", \"cycle\": %u, \"open_ms\": %lu, \"close_ms\": %lu",
+        cycle,
+        open_ns / 1000000,
+        close_ns / 1000000);
+
+    for (i = 0; i < IKVDB_PH_MAX; i++) {
+        name = ikvdb_phase2str(i, &unit);
+
+        printf(", \"%s_us\": %lu", name, phv[i].ips_ns / 1000);
+        if (unit)
+            printf(", \"%s_%s\": %lu", name, unit, phv[i].ips_count);
+    }
+
+    printf("}\n");
+    fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct ikvdb_phase_stats phv[IKVDB_PH_MAX];
+    hse_err_t                err;
+    merr_t                   merr;
+    u64                      open_ns, close_ns;
+    char *                   sep;
+    uint                     i;
+    int                      c;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opts.cycles = 3;
+    opts.kvsc = 1;
+    opts.vlen = 100;
+
+    while (-1 != (c = getopt(argc, argv, ":c:Df:hk:l:n:"))) {
+        switch (c) {
+            case 'c':
+                merr = parse_uint(optarg, &opts.cycles);
+                if (merr || !opts.cycles)
+                    fatal(0, "invalid cycle count '%s', use -h for help", optarg);
+                break;
+
+            case 'D':
+                opts.drop = true;
+                break;
+
+            case 'f':
+                merr = parse_u64(optarg, &opts.flush);
+                if (merr)
+                    fatal(0, "invalid flush interval '%s', use -h for help", optarg);
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'k':
+                merr = parse_uint(optarg, &opts.kvsc);
+                if (merr || !opts.kvsc || opts.kvsc > KVS_MAX)
+                    fatal(0, "invalid kvs count '%s' (1 to %u)", optarg, KVS_MAX);
+                break;
+
+            case 'l':
+                merr = parse_uint(optarg, &opts.vlen);
+                if (merr || opts.vlen > HSE_KVS_VLEN_MAX)
+                    fatal(0, "invalid value length '%s', use -h for help", optarg);
+                break;
+
+            case 'n':
+                merr = parse_u64(optarg, &opts.keys);
+                if (merr)
+                    fatal(0, "invalid key count '%s', use -h for help", optarg);
+                break;
+
+            case ':':
+                fatal(0, "option -%c requires an argument, use -h for help", optopt);
+                break;
+
+            default:
+                fatal(0, "invalid option -%c, use -h for help", optopt);
+                break;
+        }
+    }
+
+    if (optind >= argc)
+        fatal(0, "missing kvdb name, use -h for help");
+
+    mpname = argv[optind++];
+
+    err = hse_kvdb_init();
+    if (err)
+        fatal(err, "hse_kvdb_init");
+
+    err = hse_params_create(&params);
+    if (err)
+        fatal(err, "hse_params_create");
+
+    for (; optind < argc; ++optind) {
+        sep = strchr(argv[optind], '=');
+        if (!sep)
+            fatal(0, "invalid param '%s', use -h for help", argv[optind]);
+
+        *sep++ = '\0';
+
+        err = hse_params_set(params, argv[optind], sep);
+        if (err)
+            fatal(err, "hse_params_set %s", argv[optind]);
+    }
+
+    startup_open();
+
+    if (opts.keys)
+        startup_load();
+
+    startup_close();
+
+    /* The phases of the last kvdb closed cover both its open and close.
+     */
+    for (i = 0; i < opts.cycles; i++) {
+        open_ns = startup_open();
+        close_ns = startup_close();
+
+        ikvdb_phase_get(NULL, phv);
+
+        startup_report(i, open_ns, close_ns, phv);
+    }
+
+    if (opts.drop) {
+        char name[32];
+
+        err = hse_kvdb_open(mpname, params, &kvdb);
+        if (err)
+            fatal(err, "hse_kvdb_open %s", mpname);
+
+        for (i = 0; i < opts.kvsc; i++) {
+            snprintf(name, sizeof(name), "startup%02u", i);
+
+            err = hse_kvdb_kvs_drop(kvdb, name);
+            if (err)
+                fatal(err, "hse_kvdb_kvs_drop %s", name);
+        }
+
+        hse_kvdb_close(kvdb);
+    }
+
+    hse_params_destroy(params);
+    hse_kvdb_fini();
+
+    return 0;
+}
@@ -0,0 +1,618 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/* kvtune - search kvdb and kvs params for a workload, emit a profile
+ *
+ * kvtune runs a benchmark command (kvbench, kvycsb, optrace_replay, or
+ * anything else that takes trailing param=value arguments and prints
+ * lines of JSON) once per candidate configuration, scores each run by a
+ * metric of its output, and writes the best configuration found as a
+ * workload profile that hse_params_from_file() (wp.c) can load.
+ *
+ * The search space is a list of params, each with candidate values, the
+ * first of which is its starting point.  The search is a coordinate
+ * descent: each param in turn is tried at each of its values with the
+ * others held at their best so far, and passes repeat until one makes no
+ * improvement larger than the noise margin, or the time budget runs out.
+ * Configurations already run are not run again.
+ *
+ * The score of a run is the sum of all the values of the metric in its
+ * output when maximizing (e.g., ops_per_sec over the phases of kvbench),
+ * and their largest value when minimizing (e.g., the worst p99 latency).
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/parse_num.h>
+#include <hse_util/timing.h>
+
+#include <ctype.h>
+#include <getopt.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <sysexits.h>
+
+#define KVT_VAL_MAX (16)
+#define KVT_PARAM_MAX (64)
+
+/**
+ * struct kvt_param - a param of the search space
+ * @kp_key:  param, as given to hse_params_set(), e.g. kvdb.c0_heap_sz
+ * @kp_valv: candidate values, the first is the starting point
+ * @kp_valc: number of values
+ */
+struct kvt_param {
+    char *kp_key;
+    char *kp_valv[KVT_VAL_MAX];
+    uint  kp_valc;
+};
+
+/**
+ * struct kvt_trial - a configuration that was run
+ * @kt_idxv:  index of the value of each param
+ * @kt_score: score, NAN if the benchmark failed
+ */
+struct kvt_trial {
+    u8     kt_idxv[KVT_PARAM_MAX];
+    double kt_score;
+};
+
+struct kvt_opts {
+    const char *metric;
+    bool        minimize;
+    double      margin_pct;
+    u64         budget;
+    uint        trials_max;
+    uint        repeat;
+    const char *output;
+    bool        verbose;
+};
+
+/* The default search space: c0 sizing, cn compaction thresholds, bloom
+ * filters and readahead.  The first value of each is (or stands for) its
+ * default.
+ */
+static const char *const kvt_space_dflt[] = {
+    "kvdb.c0_heap_sz=0,67108864,134217728,268435456",
+    "kvdb.c0_ingest_width=0,16,32",
+    "kvdb.csched_lo_th_pct=0,15,40",
+    "kvdb.csched_hi_th_pct=0,60,90",
+    "kvdb.csched_leaf_pct=0,80,95",
+    "kvs.cn_bloom_prob=10000,1000,100000",
+    "kvs.cn_bloom_preload=0,1",
+    "kvs.cn_cursor_vra=8192,0,65536,262144",
+    "kvs.cn_compact_vra=131072,65536,524288",
+};
+
+static const char *     progname;
+static struct kvt_opts  opts;
+static struct kvt_param kvt_paramv[KVT_PARAM_MAX];
+static uint             kvt_paramc;
+static struct kvt_trial kvt_trialv[1024];
+static uint             kvt_trialc;
+static char **          kvt_cmdv;
+static uint             kvt_cmdc;
+static u64              kvt_start;
+static u64              kvt_trial_ns;
+
+static void
+fatal(const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "%s: %s\n", progname, msg);
+
+    exit(EX_SOFTWARE);
+}
+
+static void
+usage(void)
+{
+    printf(
+        "usage: %s [options] -- <benchmark> [args ...]\n"
+        "-b secs    time budget (default: %lu)\n"
+        "-e pct     improvement below which a change is noise (default: %.1f)\n"
+        "-f file    search space, one key=value[,value ...] per line\n"
+        "-h         print this help list\n"
+        "-m metric  json field to score runs by, with :max or :min (default: %s:max)\n"
+        "-n trials  maximum benchmark runs (default: %u)\n"
+        "-o file    write the profile to file (default: stdout)\n"
+        "-p param   add key=value[,value ...] to the search space\n"
+        "-r count   runs per configuration, scored by their median (default: %u)\n"
+        "-v         print the output of each run on stderr\n"
+        "\n"
+        "The benchmark is run with one param=value argument per param of the\n"
+        "search space appended, and must start from the same state each time,\n"
+        "e.g. kvbench (which drops its kvs) or optrace_replay -D.  Without -f\n"
+        "or -p, the space covers c0 sizing, csched thresholds, blooms and\n"
+        "readahead.  Example:\n"
+        "\n"
+        "  %s -b 7200 -o ycsb_a.yml -- kvycsb -w load,a -n 10000000 mp1\n",
+        progname,
+        opts.budget,
+        opts.margin_pct,
+        opts.metric,
+        opts.trials_max,
+        opts.repeat,
+        progname);
+}
+
+static void
+kvt_param_add(const char *spec)
+{
+    struct kvt_param *p;
+    char *            dup, *val, *tok;
+    uint              i;
+
+    dup = strdup(spec);
+    if (!dup)
+        fatal("out of memory");
+
+    val = strchr(dup, '=');
+    if (!val || val == dup || !val[1])
+        fatal("invalid search space entry '%s', use -h for help", spec);
+
+    *val++ = '\0';
+
+    /* A param given again replaces its earlier values. */
+    for (i = 0; i < kvt_paramc; i++)
+        if (!strcmp(kvt_paramv[i].kp_key, dup))
+            break;
+
+    if (i == KVT_PARAM_MAX)
+        fatal("more than %u params in the search space", KVT_PARAM_MAX);
+
+    p = kvt_paramv + i;
+    if (i == kvt_paramc)
+        kvt_paramc++;
+    else
+        free(p->kp_key);
+
+    p->kp_key = dup;
+    p->kp_valc = 0;
+
+    while ((tok = strsep(&val, ","))) {
+        if (!*tok)
+            continue;
+
+        if (p->kp_valc == KVT_VAL_MAX)
+            fatal("more than %u values for %s", KVT_VAL_MAX, dup);
+
+        p->kp_valv[p->kp_valc++] = tok;
+    }
+
+    if (!p->kp_valc)
+        fatal("no values for %s", dup);
+}
+
+static void
+kvt_space_load(const char *path)
+{
+    char  line[1024], *s, *e;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        fatal("cannot open %s: %s", path, strerror(errno));
+
+    while (fgets(line, sizeof(line), fp)) {
+        s = line + strspn(line, " \t");
+        e = s + strcspn(s, "#\r\n");
+
+        while (e > s && isspace(e[-1]))
+            --e;
+        *e = '\0';
+
+        if (*s)
+            kvt_param_add(s);
+    }
+
+    fclose(fp);
+}
+
+/* Score the output of a run, NAN if the metric is missing. */
+static double
+kvt_score(const char *out)
+{
+    char   pat[128];
+    double score = NAN, v;
+    char * end;
+    size_t n;
+
+    n = snprintf(pat, sizeof(pat), "\"%s\":", opts.metric);
+    if (n >= sizeof(pat))
+        fatal("metric name too long");
+
+    while ((out = strstr(out, pat))) {
+        out += n;
+
+        v = strtod(out, &end);
+        if (end == out)
+            continue;
+
+        if (isnan(score))
+            score = v;
+        else if (opts.minimize)
+            score = fmax(score, v);
+        else
+            score += v;
+    }
+
+    return score;
+}
+
+/* Run the benchmark with the params of @idxv, return its score. */
+static double
+kvt_run(const u8 *idxv)
+{
+    char *  out = NULL;
+    size_t  outsz = 0, outlen = 0;
+    double  score;
+    int     pfd[2], status;
+    ssize_t cc;
+    pid_t   pid;
+    uint    i;
+
+    for (i = 0; i < kvt_paramc; i++) {
+        const struct kvt_param *p = kvt_paramv + i;
+        char *                  arg;
+
+        free(kvt_cmdv[kvt_cmdc + i]);
+
+        if (-1 == asprintf(&arg, "%s=%s", p->kp_key, p->kp_valv[idxv[i]]))
+            fatal("out of memory");
+
+        kvt_cmdv[kvt_cmdc + i] = arg;
+    }
+
+    if (pipe(pfd))
+        fatal("pipe: %s", strerror(errno));
+
+    fflush(stderr);
+
+    pid = fork();
+    if (pid == -1)
+        fatal("fork: %s", strerror(errno));
+
+    if (pid == 0) {
+        dup2(pfd[1], STDOUT_FILENO);
+        close(pfd[0]);
+        close(pfd[1]);
+
+        execvp(kvt_cmdv[0], kvt_cmdv);
+        fprintf(stderr, "%s: cannot run %s: %s\n", progname, kvt_cmdv[0], strerror(errno));
+        _exit(EX_UNAVAILABLE);
+    }
+
+    close(pfd[1]);
+
+    do {
+        if (outsz - outlen < 4096) {
+            outsz = max_t(size_t, outsz * 2, 64 * 1024);
+            out = realloc(out, outsz);
+            if (!out)
+                fatal("out of memory");
+        }
+
+        cc = read(pfd[0], out + outlen, outsz - outlen - 1);
+        if (cc > 0)
+            outlen += cc;
+    } while (cc > 0 || (cc == -1 && errno == EINTR));
+
+    close(pfd[0]);
+    out[outlen] = '\0';
+
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+
+    if (opts.verbose)
+        fputs(out, stderr);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        score = kvt_score(out);
+    } else {
+        fprintf(stderr, "%s: benchmark failed (status 0x%x)\n", progname, status);
+        score = NAN;
+    }
+
+    free(out);
+
+    return score;
+}
+
+static int
+kvt_cmp_double(const void *lhs, const void *rhs)
+{
+    double l = *(const double *)lhs, r = *(const double *)rhs;
+
+    return (l > r) - (l < r);
+}
+
+static bool
+kvt_budget_left(void)
+{
+    u64 now = get_time_ns();
+
+    if (kvt_trialc == NELEM(kvt_trialv) || kvt_trialc >= opts.trials_max)
+        return false;
+
+    /* Do not start a trial that would likely overrun the budget. */
+    return now + kvt_trial_ns <= kvt_start + opts.budget * NSEC_PER_SEC;
+}
+
+/* Score a configuration, running it unless it already was. */
+static double
+kvt_eval(const u8 *idxv)
+{
+    struct kvt_trial *t;
+    double            scorev[16];
+    u64               start;
+    uint              i, n;
+
+    for (i = 0; i < kvt_trialc; i++)
+        if (!memcmp(kvt_trialv[i].kt_idxv, idxv, kvt_paramc))
+            return kvt_trialv[i].kt_score;
+
+    start = get_time_ns();
+
+    for (n = 0; n < opts.repeat; n++) {
+        scorev[n] = kvt_run(idxv);
+        if (isnan(scorev[n]))
+            break;
+    }
+
+    t = kvt_trialv + kvt_trialc++;
+    memcpy(t->kt_idxv, idxv, kvt_paramc);
+
+    if (n < opts.repeat) {
+        t->kt_score = NAN;
+    } else {
+        qsort(scorev, n, sizeof(scorev[0]), kvt_cmp_double);
+        t->kt_score = scorev[n / 2];
+    }
+
+    kvt_trial_ns = get_time_ns() - start;
+
+    fprintf(
+        stderr,
+        "%s: trial %u (%.1fs): %s %g",
+        progname,
+        kvt_trialc,
+        kvt_trial_ns / 1e9,
+        opts.metric,
+        t->kt_score);
+    for (i = 0; i < kvt_paramc; i++)
+        if (idxv[i])
+            fprintf(stderr, " %s=%s", kvt_paramv[i].kp_key, kvt_paramv[i].kp_valv[idxv[i]]);
+    fprintf(stderr, "\n");
+
+    return t->kt_score;
+}
+
+/* True if @score beats @best by more than the noise margin. */
+static bool
+kvt_better(double score, double best)
+{
+    double margin;
+
+    if (isnan(score))
+        return false;
+    if (isnan(best))
+        return true;
+
+    margin = fabs(best) * opts.margin_pct / 100;
+
+    return opts.minimize ? score < best - margin : score > best + margin;
+}
+
+static void
+kvt_profile_write(const u8 *idxv, double base, double best)
+{
+    FILE *fp = stdout;
+    char  map[128];
+    bool  donev[KVT_PARAM_MAX] = {};
+    uint  i, j;
+
+    if (opts.output) {
+        fp = fopen(opts.output, "w");
+        if (!fp)
+            fatal("cannot create %s: %s", opts.output, strerror(errno));
+    }
+
+    fprintf(fp, "# Workload profile generated by %s\n", progname);
+    fprintf(fp, "# Benchmark:");
+    for (i = 0; i < kvt_cmdc; i++)
+        fprintf(fp, " %s", kvt_cmdv[i]);
+    fprintf(
+        fp, "\n# %s: %g (starting point: %g), %u trials\n", opts.metric, best, base, kvt_trialc);
+    fprintf(fp, "\napiVersion: 1\n");
+
+    /* One mapping per kvdb, kvs or named kvs, as wp.c expects. */
+    for (i = 0; i < kvt_paramc; i++) {
+        const char *key = kvt_paramv[i].kp_key, *dot;
+
+        if (donev[i])
+            continue;
+
+        dot = strrchr(key, '.');
+        if (!dot || dot - key >= sizeof(map))
+            fatal("invalid param '%s'", key);
+
+        snprintf(map, sizeof(map), "%.*s", (int)(dot - key), key);
+        fprintf(fp, "%s:\n", map);
+
+        for (j = i; j < kvt_paramc; j++) {
+            key = kvt_paramv[j].kp_key;
+            dot = strrchr(key, '.');
+
+            if (donev[j] || dot - key != strlen(map) || strncmp(key, map, dot - key))
+                continue;
+
+            fprintf(fp, "  %s: %s\n", dot + 1, kvt_paramv[j].kp_valv[idxv[j]]);
+            donev[j] = true;
+        }
+    }
+
+    if (fp != stdout)
+        fclose(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+    u8     cur[KVT_PARAM_MAX] = {}, cand[KVT_PARAM_MAX];
+    double base, best, score;
+    char * sep;
+    bool   improved;
+    uint   i, v, bestv;
+    int    c;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opts.metric = "ops_per_sec";
+    opts.margin_pct = 2;
+    opts.budget = 3600;
+    opts.trials_max = 200;
+    opts.repeat = 1;
+
+    while (-1 != (c = getopt(argc, argv, "+:b:e:f:hm:n:o:p:r:v"))) {
+        switch (c) {
+            case 'b':
+                if (parse_u64(optarg, &opts.budget) || !opts.budget)
+                    fatal("invalid budget '%s', use -h for help", optarg);
+                break;
+
+            case 'e':
+                opts.margin_pct = strtod(optarg, &sep);
+                if (sep == optarg || *sep || opts.margin_pct < 0)
+                    fatal("invalid margin '%s', use -h for help", optarg);
+                break;
+
+            case 'f':
+                kvt_space_load(optarg);
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'm':
+                sep = strchr(optarg, ':');
+                if (sep) {
+                    *sep++ = '\0';
+                    if (strcmp(sep, "min") && strcmp(sep, "max"))
+                        fatal("invalid metric direction '%s', use -h for help", sep);
+                    opts.minimize = !strcmp(sep, "min");
+                }
+                opts.metric = optarg;
+                break;
+
+            case 'n':
+                if (parse_uint(optarg, &opts.trials_max) || !opts.trials_max)
+                    fatal("invalid trial count '%s', use -h for help", optarg);
+                break;
+
+            case 'o':
+                opts.output = optarg;
+                break;
+
+            case 'p':
+                kvt_param_add(optarg);
+                break;
+
+            case 'r':
+                if (parse_uint(optarg, &opts.repeat) || !opts.repeat || opts.repeat > 16)
+                    fatal("invalid repeat count '%s', use -h for help", optarg);
+                break;
+
+            case 'v':
+                opts.verbose = true;
+                break;
+
+            case ':':
+                fatal("option -%c requires an argument, use -h for help", optopt);
+                break;
+
+            default:
+                fatal("invalid option -%c, use -h for help", optopt);
+                break;
+        }
+    }
+
+    if (optind >= argc)
+        fatal("missing benchmark command, use -h for help");
+
+    if (!kvt_paramc)
+        for (i = 0; i < NELEM(kvt_space_dflt); i++)
+            kvt_param_add(kvt_space_dflt[i]);
+
+    /* The benchmark's arguments, then one per param, then NULL. */
+    kvt_cmdc = argc - optind;
+    kvt_cmdv = calloc(kvt_cmdc + kvt_paramc + 1, sizeof(*kvt_cmdv));
+    if (!kvt_cmdv)
+        fatal("out of memory");
+
+    for (i = 0; i < kvt_cmdc; i++)
+        kvt_cmdv[i] = argv[optind + i];
+
+    kvt_start = get_time_ns();
+
+    base = best = kvt_eval(cur);
+    if (isnan(base))
+        fatal("the starting point failed or its output has no '%s'", opts.metric);
+
+    do {
+        improved = false;
+
+        for (i = 0; i < kvt_paramc; i++) {
+            bestv = cur[i];
+
+            for (v = 0; v < kvt_paramv[i].kp_valc; v++) {
+                if (v == cur[i])
+                    continue;
+
+                if (!kvt_budget_left())
+                    goto done;
+
+                memcpy(cand, cur, sizeof(cand));
+                cand[i] = v;
+
+                score = kvt_eval(cand);
+                if (kvt_better(score, best)) {
+                    best = score;
+                    bestv = v;
+                }
+            }
+
+            if (bestv != cur[i]) {
+                cur[i] = bestv;
+                improved = true;
+            }
+        }
+    } while (improved);
+
+done:
+    fprintf(
+        stderr,
+        "%s: best %s %g, starting point %g (%+.1f%%)\n",
+        progname,
+        opts.metric,
+        best,
+        base,
+        base ? (best - base) * 100 / fabs(base) : 0.0);
+
+    kvt_profile_write(cur, base, best);
+
+    for (i = 0; i < kvt_paramc; i++)
+        free(kvt_cmdv[kvt_cmdc + i]);
+    free(kvt_cmdv);
+
+    return 0;
+}
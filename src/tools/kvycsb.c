@@ -0,0 +1,701 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/* kvycsb - native YCSB-style load generator
+ *
+ * Opens a kvdb with the params of a workload profile (e.g. one of the
+ * config/native_ycsb_*.yml files, parsed by hse_params_from_file()) and
+ * runs the YCSB core workloads against a kvs of it:
+ *
+ *   load  insert all records
+ *   a     50% read, 50% update              zipfian
+ *   b     95% read,  5% update              zipfian
+ *   c    100% read                          zipfian
+ *   d     95% read,  5% insert              latest
+ *   e     95% scan,  5% insert              zipfian
+ *   f     50% read, 50% read-modify-write   zipfian
+ *
+ * Each workload prints one line of JSON with its throughput and the
+ * latency percentiles of each of its operations.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/atomic.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/lathist.h>
+#include <hse_util/minmax.h>
+#include <hse_util/parse_num.h>
+
+#include <hse_test_support/key_generation.h>
+#include <hse_test_support/mwc_rand.h>
+
+#include <hse/hse.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sysexits.h>
+
+enum kvy_op {
+    KVY_READ,
+    KVY_UPDATE,
+    KVY_INSERT,
+    KVY_SCAN,
+    KVY_RMW,
+    KVY_OP_MAX
+};
+
+enum kvy_dist {
+    KVY_DIST_SEQ,
+    KVY_DIST_ZIPF,
+    KVY_DIST_LATEST,
+};
+
+static const char *const kvy_opv[] = { "read", "update", "insert", "scan", "rmw" };
+static const char *const kvy_distv[] = { "seq", "zipfian", "latest" };
+
+/**
+ * struct kvy_workload - operation mix of a workload
+ * @wl_name: workload name
+ * @wl_pct:  percentage of each operation
+ * @wl_dist: distribution of the keys of reads, updates and scans
+ */
+struct kvy_workload {
+    const char *  wl_name;
+    uint          wl_pct[KVY_OP_MAX];
+    enum kvy_dist wl_dist;
+};
+
+static const struct kvy_workload kvy_workloadv[] = {
+    { "load", { [KVY_INSERT] = 100 }, KVY_DIST_SEQ },
+    { "a", { [KVY_READ] = 50, [KVY_UPDATE] = 50 }, KVY_DIST_ZIPF },
+    { "b", { [KVY_READ] = 95, [KVY_UPDATE] = 5 }, KVY_DIST_ZIPF },
+    { "c", { [KVY_READ] = 100 }, KVY_DIST_ZIPF },
+    { "d", { [KVY_READ] = 95, [KVY_INSERT] = 5 }, KVY_DIST_LATEST },
+    { "e", { [KVY_SCAN] = 95, [KVY_INSERT] = 5 }, KVY_DIST_ZIPF },
+    { "f", { [KVY_READ] = 50, [KVY_RMW] = 50 }, KVY_DIST_ZIPF },
+};
+
+#define KVY_WORKLOAD_MAX NELEM(kvy_workloadv)
+
+/**
+ * struct kvy_zipf - zipfian rank generator (Gray et al., as in YCSB)
+ */
+struct kvy_zipf {
+    double alpha;
+    double zetan;
+    double eta;
+    double half_pow_theta;
+};
+
+struct kvy_opts {
+    u64         records;
+    u64         ops;
+    uint        threads;
+    uint        klen;
+    uint        vlen;
+    uint        scan_max;
+    double      theta;
+    bool        workloadv[KVY_WORKLOAD_MAX];
+    bool        keep;
+    const char *kvs_name;
+    const char *profile;
+};
+
+/**
+ * struct kvy_worker - state of one worker thread
+ * @kw_tid:   thread id
+ * @kw_id:    thread index
+ * @kw_wl:    workload being run
+ * @kw_ops:   operations completed
+ * @kw_found: reads that found their key, records read by scans
+ * @kw_err:   first error, if any
+ * @kw_mwc:   random number generator
+ */
+struct kvy_worker {
+    pthread_t                  kw_tid;
+    uint                       kw_id;
+    const struct kvy_workload *kw_wl;
+    u64                        kw_ops;
+    u64                        kw_found;
+    hse_err_t                  kw_err;
+    struct mwc_rand            kw_mwc;
+};
+
+static const char *          progname;
+static struct kvy_opts       opts;
+static struct hse_kvs *      kvy_kvs;
+static struct key_generator *kvy_kg;
+static struct kvy_zipf       kvy_zipf;
+static struct lathist *      kvy_lhv[KVY_OP_MAX];
+static atomic64_t            kvy_insert_next;
+static atomic64_t            kvy_inserted;
+
+static void
+fatal(hse_err_t err, const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (err) {
+        char errbuf[128];
+
+        hse_err_to_string(err, errbuf, sizeof(errbuf), NULL);
+        fprintf(stderr, "%s: %s: %s\n", progname, msg, errbuf);
+    } else {
+        fprintf(stderr, "%s: %s\n", progname, msg);
+    }
+
+    exit(EX_SOFTWARE);
+}
+
+static void
+usage(void)
+{
+    printf(
+        "usage: %s [options] <kvdb> [param=value ...]\n"
+        "-h         print this help list\n"
+        "-K         keep the kvs (default: drop it at exit)\n"
+        "-k klen    key length (default: %u)\n"
+        "-l len     maximum records read per scan (default: %u)\n"
+        "-n recs    records inserted by the load workload (default: %lu)\n"
+        "-o ops     operations per run workload (default: recs)\n"
+        "-s kvs     kvs name (default: %s)\n"
+        "-t thrds   worker threads (default: %u)\n"
+        "-v vlen    value length (default: %u)\n"
+        "-w wls     comma separated list from load,a,b,c,d,e,f (default: all)\n"
+        "-y file    workload profile, e.g. config/native_ycsb_abcdf_run.yml\n"
+        "-z theta   zipfian constant (default: %.2f)\n"
+        "\n"
+        "Workloads run in the order listed above, each printing one line of\n"
+        "JSON on stdout.  Run workloads expect the kvs to hold recs records,\n"
+        "either from a load in the same run or from an earlier run with -K.\n"
+        "Params are applied after the profile with hse_params_set(), e.g.\n"
+        "kvs.kvs_vcache_mb=256.\n",
+        progname,
+        opts.klen,
+        opts.scan_max,
+        opts.records,
+        opts.kvs_name,
+        opts.threads,
+        opts.vlen,
+        opts.theta);
+}
+
+static double
+kvy_rand_double(struct mwc_rand *mwc)
+{
+    return (mwc_rand64(mwc) >> 11) * (1.0 / (1ul << 53));
+}
+
+static void
+kvy_zipf_init(struct kvy_zipf *z, u64 n, double theta)
+{
+    double zeta2;
+    u64    i;
+
+    z->alpha = 1.0 / (1.0 - theta);
+    z->half_pow_theta = 1.0 + pow(0.5, theta);
+
+    z->zetan = 0;
+    for (i = 1; i <= n; ++i)
+        z->zetan += 1.0 / pow(i, theta);
+
+    zeta2 = 1.0 + 1.0 / pow(2, theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+/* Rank in [0, n) of the next item, rank 0 being the most popular.
+ */
+static u64
+kvy_zipf_rank(struct kvy_zipf *z, struct mwc_rand *mwc, u64 n)
+{
+    double u = kvy_rand_double(mwc);
+    double uz = u * z->zetan;
+    u64    rank;
+
+    if (uz < 1.0)
+        rank = 0;
+    else if (uz < z->half_pow_theta)
+        rank = 1;
+    else
+        rank = n * pow(z->eta * u - z->eta + 1.0, z->alpha);
+
+    return min_t(u64, rank, n - 1);
+}
+
+/* Index of the record read, updated or scanned by the next operation.  As
+ * in YCSB, zipfian ranks are scattered over the records so that the hot
+ * records are not adjacent, while "latest" favors the newest inserts.
+ */
+static u64
+kvy_key_index(struct kvy_worker *w)
+{
+    u64 n = atomic64_read(&kvy_inserted);
+    u64 rank;
+
+    rank = kvy_zipf_rank(&kvy_zipf, &w->kw_mwc, opts.records);
+
+    if (w->kw_wl->wl_dist == KVY_DIST_LATEST)
+        return n - 1 - min_t(u64, rank, n - 1);
+
+    return (rank * 0x9e3779b97f4a7c15ul) % opts.records;
+}
+
+static enum kvy_op
+kvy_next_op(struct kvy_worker *w)
+{
+    uint pct = mwc_rand32(&w->kw_mwc) % 100;
+    uint i;
+
+    for (i = 0; i < KVY_OP_MAX; ++i) {
+        if (pct < w->kw_wl->wl_pct[i])
+            return i;
+        pct -= w->kw_wl->wl_pct[i];
+    }
+
+    return KVY_READ;
+}
+
+static hse_err_t
+kvy_scan(struct kvy_worker *w, const u8 *key)
+{
+    struct hse_kvs_cursor *cur;
+    const void *           kdata, *vdata;
+    size_t                 klen, vlen;
+    hse_err_t              err;
+    bool                   eof;
+    uint                   i, len;
+
+    len = mwc_rand_range32(&w->kw_mwc, 1, opts.scan_max + 1);
+
+    err = hse_kvs_cursor_create(kvy_kvs, NULL, NULL, 0, &cur);
+    if (err)
+        return err;
+
+    err = hse_kvs_cursor_seek(cur, NULL, key, opts.klen, NULL, NULL);
+    for (i = 0; !err && i < len; ++i) {
+        err = hse_kvs_cursor_read(cur, NULL, &kdata, &klen, &vdata, &vlen, &eof);
+        if (err || eof)
+            break;
+
+        w->kw_found++;
+    }
+
+    hse_kvs_cursor_destroy(cur);
+
+    return err;
+}
+
+static hse_err_t
+kvy_op(struct kvy_worker *w, enum kvy_op op, u8 *key, u8 *val)
+{
+    hse_err_t err;
+    size_t    vlen;
+    bool      found;
+
+    switch (op) {
+        case KVY_READ:
+            err = hse_kvs_get(kvy_kvs, NULL, key, opts.klen, &found, val, opts.vlen, &vlen);
+            w->kw_found += (!err && found);
+            return err;
+
+        case KVY_UPDATE:
+        case KVY_INSERT:
+            return hse_kvs_put(kvy_kvs, NULL, key, opts.klen, val, opts.vlen);
+
+        case KVY_SCAN:
+            return kvy_scan(w, key);
+
+        case KVY_RMW:
+            err = hse_kvs_get(kvy_kvs, NULL, key, opts.klen, &found, val, opts.vlen, &vlen);
+            if (err)
+                return err;
+
+            w->kw_found += found;
+            val[0]++;
+
+            return hse_kvs_put(kvy_kvs, NULL, key, opts.klen, val, opts.vlen);
+
+        case KVY_OP_MAX:
+            break;
+    }
+
+    return 0;
+}
+
+static void *
+kvy_worker_main(void *arg)
+{
+    struct kvy_worker *w = arg;
+    enum kvy_op        op;
+    u64                ops, i, idx, start;
+    u8 *               key, *val;
+    hse_err_t          err;
+
+    key = malloc(opts.klen);
+    val = malloc(opts.vlen);
+    if (!key || !val) {
+        w->kw_err = ENOMEM;
+        goto out;
+    }
+
+    memset(val, 'a' + w->kw_id % 26, opts.vlen);
+
+    ops = (w->kw_wl->wl_dist == KVY_DIST_SEQ) ? opts.records : opts.ops;
+    ops = ops / opts.threads + (w->kw_id < ops % opts.threads);
+
+    for (i = 0; i < ops; ++i) {
+        op = kvy_next_op(w);
+
+        /* Inserts claim the next record index up front, but are only
+         * counted in kvy_inserted (and so seen by the "latest" distribution)
+         * once they complete.
+         */
+        if (op == KVY_INSERT)
+            idx = (w->kw_wl->wl_dist == KVY_DIST_SEQ) ? w->kw_id + i * opts.threads
+                                                      : atomic64_fetch_add(1, &kvy_insert_next);
+        else
+            idx = kvy_key_index(w);
+
+        get_key(kvy_kg, key, idx);
+
+        start = get_time_ns();
+        err = kvy_op(w, op, key, val);
+        lathist_add(kvy_lhv[op], get_time_ns() - start);
+
+        if (err) {
+            w->kw_err = err;
+            break;
+        }
+
+        if (op == KVY_INSERT && w->kw_wl->wl_dist != KVY_DIST_SEQ)
+            atomic64_inc(&kvy_inserted);
+
+        w->kw_ops++;
+    }
+
+out:
+    free(val);
+    free(key);
+
+    return NULL;
+}
+
+static void
+kvy_run(const struct kvy_workload *wl)
+{
+    struct lathist_snap *snap;
+    struct kvy_worker *  workerv;
+    u64                  start, ns, ops, found;
+    hse_err_t            err;
+    const char *         sep;
+    uint                 i;
+    int                  rc;
+
+    workerv = calloc(opts.threads, sizeof(*workerv));
+    snap = calloc(1, sizeof(*snap));
+    if (!workerv || !snap)
+        fatal(0, "out of memory");
+
+    for (i = 0; i < KVY_OP_MAX; ++i)
+        lathist_reset(kvy_lhv[i]);
+
+    start = get_time_ns();
+
+    for (i = 0; i < opts.threads; ++i) {
+        struct kvy_worker *w = workerv + i;
+
+        w->kw_id = i;
+        w->kw_wl = wl;
+        mwc_rand_init(&w->kw_mwc, (u32)(start + i * 7919));
+
+        rc = pthread_create(&w->kw_tid, NULL, kvy_worker_main, w);
+        if (rc)
+            fatal(0, "pthread_create: %s", strerror(rc));
+    }
+
+    ops = found = 0;
+    err = 0;
+
+    for (i = 0; i < opts.threads; ++i) {
+        struct kvy_worker *w = workerv + i;
+
+        pthread_join(w->kw_tid, NULL);
+
+        ops += w->kw_ops;
+        found += w->kw_found;
+        if (!err)
+            err = w->kw_err;
+    }
+
+    ns = get_time_ns() - start;
+
+
+    printf(
+        "{\"workload\":\"%s\",\"dist\":\"%s\",\"profile\":\"%s\",\"threads\":%u,"
+        "\"records\":%lu,\"klen\":%u,\"vlen\":%u,\"ops\":%lu,\"found\":%lu,\"errno\":%d,"
+        "\"secs\":%.6f,\"ops_per_sec\":%.1f,\"lat_ns\":{",
+        wl->wl_name,
+        kvy_distv[wl->wl_dist],
+        opts.profile ?: "",
+        opts.threads,
+        opts.records,
+        opts.klen,
+        opts.vlen,
+        ops,
+        found,
+        hse_err_to_errno(err),
+        ns / 1e9,
+        ns ? ops * 1e9 / ns : 0.0);
+
+    for (sep = "", i = 0; i < KVY_OP_MAX; ++i) {
+        if (!wl->wl_pct[i])
+            continue;
+
+        lathist_snap(kvy_lhv[i], snap);
+
+        printf(
+            "%s\"%s\":{\"count\":%lu,\"avg\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,"
+            "\"p99.9\":%lu,\"p99.99\":%lu,\"max\":%lu}",
+            sep,
+            kvy_opv[i],
+            snap->lss_count,
+            snap->lss_count ? snap->lss_sum / snap->lss_count : 0,
+            lathist_snap_pct(snap, 50.0),
+            lathist_snap_pct(snap, 90.0),
+            lathist_snap_pct(snap, 99.0),
+            lathist_snap_pct(snap, 99.9),
+            lathist_snap_pct(snap, 99.99),
+            snap->lss_max);
+        sep = ",";
+    }
+
+    printf("}}\n");
+    fflush(stdout);
+
+    free(snap);
+    free(workerv);
+
+    if (err)
+        fatal(err, "workload %s failed", wl->wl_name);
+}
+
+static void
+kvy_parse_workloads(const char *str)
+{
+    char *dup, *tok, *next;
+    int   i;
+
+    memset(opts.workloadv, 0, sizeof(opts.workloadv));
+
+    dup = strdup(str);
+    if (!dup)
+        fatal(0, "out of memory");
+
+    for (next = dup; (tok = strsep(&next, ","));) {
+        for (i = 0; i < KVY_WORKLOAD_MAX; ++i)
+            if (!strcasecmp(tok, kvy_workloadv[i].wl_name))
+                break;
+
+        if (i == KVY_WORKLOAD_MAX)
+            fatal(0, "invalid workload '%s', use -h for help", tok);
+
+        opts.workloadv[i] = true;
+    }
+
+    free(dup);
+}
+
+static u64
+kvy_parse_num(const char *str, const char *what)
+{
+    u64    val;
+    merr_t err;
+
+    err = parse_u64(str, &val);
+    if (err)
+        fatal(0, "invalid %s '%s', use -h for help", what, str);
+
+    return val;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct hse_params *params;
+    struct hse_kvdb *  kvdb;
+    const char *       mpname;
+    hse_err_t          err;
+    merr_t             merr;
+    char *             sep;
+    int                c, i;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opts.records = 1000 * 1000;
+    opts.threads = 8;
+    opts.klen = 24;
+    opts.vlen = 1000;
+    opts.scan_max = 100;
+    opts.theta = 0.99;
+    opts.kvs_name = "kvycsb";
+    for (i = 0; i < KVY_WORKLOAD_MAX; ++i)
+        opts.workloadv[i] = true;
+
+    while (-1 != (c = getopt(argc, argv, ":hKk:l:n:o:s:t:v:w:y:z:"))) {
+        switch (c) {
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'K':
+                opts.keep = true;
+                break;
+
+            case 'k':
+                opts.klen = kvy_parse_num(optarg, "key length");
+                break;
+
+            case 'l':
+                opts.scan_max = kvy_parse_num(optarg, "scan length");
+                break;
+
+            case 'n':
+                opts.records = kvy_parse_num(optarg, "record count");
+                break;
+
+            case 'o':
+                opts.ops = kvy_parse_num(optarg, "op count");
+                break;
+
+            case 's':
+                opts.kvs_name = optarg;
+                break;
+
+            case 't':
+                opts.threads = kvy_parse_num(optarg, "thread count");
+                break;
+
+            case 'v':
+                opts.vlen = kvy_parse_num(optarg, "value length");
+                break;
+
+            case 'w':
+                kvy_parse_workloads(optarg);
+                break;
+
+            case 'y':
+                opts.profile = optarg;
+                break;
+
+            case 'z':
+                opts.theta = strtod(optarg, &sep);
+                if (*sep || opts.theta <= 0 || opts.theta >= 1)
+                    fatal(0, "invalid zipfian constant '%s', use -h for help", optarg);
+                break;
+
+            case ':':
+                fatal(0, "option -%c requires an argument, use -h for help", optopt);
+                break;
+
+            default:
+                fatal(0, "invalid option -%c, use -h for help", optopt);
+                break;
+        }
+    }
+
+    if (optind >= argc)
+        fatal(0, "missing kvdb name, use -h for help");
+
+    mpname = argv[optind++];
+
+    if (!opts.ops)
+        opts.ops = opts.records;
+
+    if (!opts.records || !opts.threads || !opts.klen || !opts.vlen || !opts.scan_max)
+        fatal(0, "invalid record count, thread count, key, value or scan length");
+
+    /* Leave room for the inserts of workloads d and e.
+     */
+    kvy_kg = create_key_generator(opts.records + opts.ops, opts.klen);
+    if (!kvy_kg)
+        fatal(0, "cannot generate %lu keys of %u bytes", opts.records, opts.klen);
+
+    kvy_zipf_init(&kvy_zipf, opts.records, opts.theta);
+    atomic64_set(&kvy_insert_next, opts.records);
+    atomic64_set(&kvy_inserted, opts.records);
+
+    for (i = 0; i < KVY_OP_MAX; ++i) {
+        merr = lathist_create(&kvy_lhv[i]);
+        if (merr)
+            fatal(0, "cannot create latency histogram");
+    }
+
+    err = hse_kvdb_init();
+    if (err)
+        fatal(err, "hse_kvdb_init");
+
+    err = hse_params_create(&params);
+    if (err)
+        fatal(err, "hse_params_create");
+
+    if (opts.profile) {
+        err = hse_params_from_file(params, opts.profile);
+        if (err)
+            fatal(err, "cannot apply profile %s", opts.profile);
+    }
+
+    for (; optind < argc; ++optind) {
+        sep = strchr(argv[optind], '=');
+        if (!sep)
+            fatal(0, "invalid param '%s', use -h for help", argv[optind]);
+
+        *sep++ = '\0';
+
+        err = hse_params_set(params, argv[optind], sep);
+        if (err)
+            fatal(err, "hse_params_set %s", argv[optind]);
+    }
+
+    err = hse_kvdb_open(mpname, params, &kvdb);
+    if (err)
+        fatal(err, "hse_kvdb_open %s", mpname);
+
+    err = hse_kvdb_kvs_make(kvdb, opts.kvs_name, params);
+    if (err && hse_err_to_errno(err) != EEXIST)
+        fatal(err, "hse_kvdb_kvs_make %s", opts.kvs_name);
+
+    err = hse_kvdb_kvs_open(kvdb, opts.kvs_name, params, &kvy_kvs);
+    if (err)
+        fatal(err, "hse_kvdb_kvs_open %s", opts.kvs_name);
+
+    for (i = 0; i < KVY_WORKLOAD_MAX; ++i)
+        if (opts.workloadv[i])
+            kvy_run(kvy_workloadv + i);
+
+    hse_kvdb_kvs_close(kvy_kvs);
+
+    if (!opts.keep) {
+        err = hse_kvdb_kvs_drop(kvdb, opts.kvs_name);
+        if (err)
+            fatal(err, "hse_kvdb_kvs_drop %s", opts.kvs_name);
+    }
+
+    hse_kvdb_close(kvdb);
+    hse_params_destroy(params);
+    hse_kvdb_fini();
+
+    for (i = 0; i < KVY_OP_MAX; ++i)
+        lathist_destroy(kvy_lhv[i]);
+    destroy_key_generator(kvy_kg);
+
+    return 0;
+}
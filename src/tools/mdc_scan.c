@@ -0,0 +1,379 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/parse_num.h>
+#include <hse_util/workqueue.h>
+
+#include "mdc_scan.h"
+
+/* A batch ends at whichever of these limits it reaches first.  cndb
+ * records are a few hundred bytes, so a batch is about a thousand of them.
+ */
+#define MDC_SCAN_BATCH_RECS  (1024)
+#define MDC_SCAN_BATCH_BYTES (1024 * 1024)
+#define MDC_SCAN_BUFSZ_MIN   (8192)
+
+/**
+ * struct mdc_scan_rec - a record of a batch
+ * @msr_off:    offset of the record in msb_data
+ * @msr_len:    length of the record
+ * @msr_logoff: offset of the record in the log
+ * @msr_outoff: offset of its output in msb_out
+ * @msr_outlen: length of its output
+ */
+struct mdc_scan_rec {
+    size_t msr_off;
+    size_t msr_len;
+    u64    msr_logoff;
+    size_t msr_outoff;
+    size_t msr_outlen;
+};
+
+struct mdc_scan_batch {
+    struct work_struct         msb_work;
+    const struct mdc_scan_ops *msb_ops;
+    void *                     msb_arg;
+    char *                     msb_data;
+    size_t                     msb_datalen;
+    size_t                     msb_datasz;
+    struct mdc_scan_rec *      msb_recv;
+    char *                     msb_privv;
+    uint                       msb_recc;
+    struct mdc_scan_out        msb_out;
+};
+
+merr_t
+mdc_scan_range_parse(const char *str, struct mdc_scan_range *range)
+{
+    const char *p = str;
+    char *      end;
+    merr_t      err;
+
+    range->msr_lo = 0;
+    range->msr_hi = U64_MAX;
+
+    if (*p != '-') {
+        err = parse_u64_range(p, &end, 0, U64_MAX, &range->msr_lo);
+        if (err)
+            return err;
+
+        p = end;
+        if (*p == '\0')
+            range->msr_hi = range->msr_lo;
+    }
+
+    if (*p == '-' && *++p != '\0') {
+        err = parse_u64_range(p, NULL, 0, U64_MAX, &range->msr_hi);
+        if (err)
+            return err;
+    } else if (*p != '\0') {
+        return merr(EINVAL);
+    }
+
+    if (range->msr_lo > range->msr_hi)
+        return merr(EINVAL);
+
+    range->msr_set = true;
+
+    return 0;
+}
+
+static merr_t
+mdc_scan_out_grow(struct mdc_scan_out *out, size_t need)
+{
+    size_t sz;
+    char * buf;
+
+    sz = max_t(size_t, out->mso_bufsz * 2, out->mso_len + need);
+    sz = max_t(size_t, sz, 4096);
+
+    buf = realloc(out->mso_buf, sz);
+    if (!buf)
+        return merr(ENOMEM);
+
+    out->mso_buf = buf;
+    out->mso_bufsz = sz;
+
+    return 0;
+}
+
+void
+mdc_scan_printf(struct mdc_scan_out *out, const char *fmt, ...)
+{
+    va_list ap;
+    size_t  avail;
+    int     n;
+
+    while (1) {
+        avail = out->mso_bufsz - out->mso_len;
+
+        va_start(ap, fmt);
+        n = vsnprintf(out->mso_buf ? out->mso_buf + out->mso_len : NULL, avail, fmt, ap);
+        va_end(ap);
+
+        if (n < 0 || n < avail) {
+            out->mso_len += max(n, 0);
+            return;
+        }
+
+        out->mso_err = mdc_scan_out_grow(out, n + 1);
+        if (out->mso_err)
+            return;
+    }
+}
+
+void
+mdc_scan_json_str(struct mdc_scan_out *out, const char *str)
+{
+    const char *p;
+
+    mdc_scan_printf(out, "\"");
+
+    for (p = str; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            mdc_scan_printf(out, "\\%c", *p);
+        else if ((unsigned char)*p < 0x20)
+            mdc_scan_printf(out, "\\u%04x", (unsigned char)*p);
+        else
+            mdc_scan_printf(out, "%c", *p);
+    }
+
+    mdc_scan_printf(out, "\"");
+}
+
+void
+mdc_scan_out_fini(struct mdc_scan_out *out)
+{
+    free(out->mso_buf);
+    memset(out, 0, sizeof(*out));
+}
+
+static merr_t
+mdc_scan_batch_grow(struct mdc_scan_batch *b, size_t need)
+{
+    size_t sz;
+    char * data;
+
+    sz = max_t(size_t, b->msb_datasz * 2, b->msb_datalen + need);
+
+    data = realloc(b->msb_data, sz);
+    if (!data)
+        return merr(ENOMEM);
+
+    b->msb_data = data;
+    b->msb_datasz = sz;
+
+    return 0;
+}
+
+/* Read records into the batch until it is full or the log ends.  The
+ * records read before an error are kept, they are decoded and emitted
+ * before the error is returned.
+ */
+static merr_t
+mdc_scan_batch_read(struct mdc_scan_batch *b, u64 *logoff, bool *eof)
+{
+    const struct mdc_scan_ops *ops = b->msb_ops;
+    struct mdc_scan_rec *      rec;
+    size_t                     len;
+    merr_t                     err;
+
+    while (b->msb_recc < MDC_SCAN_BATCH_RECS && b->msb_datalen < MDC_SCAN_BATCH_BYTES) {
+        if (b->msb_datasz - b->msb_datalen < MDC_SCAN_BUFSZ_MIN) {
+            err = mdc_scan_batch_grow(b, MDC_SCAN_BUFSZ_MIN);
+            if (err)
+                return err;
+        }
+
+        len = 0;
+        err = ops->mso_read(
+            b->msb_arg, b->msb_data + b->msb_datalen, b->msb_datasz - b->msb_datalen, &len);
+
+        if (merr_errno(err) == EOVERFLOW) {
+            err = mdc_scan_batch_grow(b, len);
+            if (err)
+                return err;
+
+            err = ops->mso_read(
+                b->msb_arg, b->msb_data + b->msb_datalen, b->msb_datasz - b->msb_datalen, &len);
+        }
+
+        if (err)
+            return err;
+
+        if (!len) {
+            *eof = true;
+            break;
+        }
+
+        rec = b->msb_recv + b->msb_recc++;
+        rec->msr_off = b->msb_datalen;
+        rec->msr_len = len;
+        rec->msr_logoff = *logoff;
+
+        b->msb_datalen += len;
+        *logoff += len;
+    }
+
+    return 0;
+}
+
+static void
+mdc_scan_batch_decode(struct mdc_scan_batch *b)
+{
+    const struct mdc_scan_ops *ops = b->msb_ops;
+    struct mdc_scan_rec *      rec;
+    uint                       i;
+
+    memset(b->msb_privv, 0, b->msb_recc * ops->mso_privsz);
+
+    for (i = 0; i < b->msb_recc; i++) {
+        rec = b->msb_recv + i;
+        rec->msr_outoff = b->msb_out.mso_len;
+
+        if (ops->mso_decode)
+            ops->mso_decode(
+                b->msb_arg,
+                b->msb_data + rec->msr_off,
+                rec->msr_len,
+                rec->msr_logoff,
+                b->msb_privv + i * ops->mso_privsz,
+                &b->msb_out);
+
+        rec->msr_outlen = b->msb_out.mso_len - rec->msr_outoff;
+    }
+}
+
+static void
+mdc_scan_batch_worker(struct work_struct *work)
+{
+    mdc_scan_batch_decode(container_of(work, struct mdc_scan_batch, msb_work));
+}
+
+/* Emit the records of a decoded batch in order and empty it.  Without an
+ * emit callback the output of the records goes to stdout.
+ */
+static merr_t
+mdc_scan_batch_emit(struct mdc_scan_batch *b)
+{
+    const struct mdc_scan_ops *ops = b->msb_ops;
+    struct mdc_scan_rec *      rec;
+    merr_t                     err = 0;
+    uint                       i;
+
+    if (b->msb_out.mso_err)
+        return b->msb_out.mso_err;
+
+    if (!ops->mso_emit) {
+        if (b->msb_out.mso_len)
+            fwrite(b->msb_out.mso_buf, 1, b->msb_out.mso_len, stdout);
+    } else {
+        for (i = 0; i < b->msb_recc && !err; i++) {
+            rec = b->msb_recv + i;
+
+            err = ops->mso_emit(
+                b->msb_arg,
+                b->msb_privv + i * ops->mso_privsz,
+                b->msb_out.mso_buf + rec->msr_outoff,
+                rec->msr_outlen);
+        }
+    }
+
+    b->msb_recc = 0;
+    b->msb_datalen = 0;
+    b->msb_out.mso_len = 0;
+
+    return err;
+}
+
+merr_t
+mdc_scan(const struct mdc_scan_ops *ops, void *arg, uint threads)
+{
+    struct workqueue_struct *wq = NULL;
+    struct mdc_scan_batch *  batchv, *round;
+    merr_t                   err = 0, rerr = 0;
+    uint                     roundc, batchc[2] = { 0, 0 };
+    uint                     cur, i;
+    bool                     eof = false;
+    u64                      logoff = 0;
+
+    roundc = max_t(uint, threads, 1);
+
+    batchv = calloc(2 * roundc, sizeof(*batchv));
+    if (!batchv)
+        return merr(ENOMEM);
+
+    for (i = 0; i < 2 * roundc; i++) {
+        struct mdc_scan_batch *b = batchv + i;
+
+        INIT_WORK(&b->msb_work, mdc_scan_batch_worker);
+        b->msb_ops = ops;
+        b->msb_arg = arg;
+        b->msb_recv = malloc(MDC_SCAN_BATCH_RECS * sizeof(*b->msb_recv));
+        b->msb_privv = malloc(MDC_SCAN_BATCH_RECS * max_t(size_t, ops->mso_privsz, 1));
+        if (!b->msb_recv || !b->msb_privv) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+    }
+
+    if (threads > 1) {
+        wq = alloc_workqueue("mdc_scan", 0, threads);
+        if (!wq) {
+            err = merr(ENOMEM);
+            goto out;
+        }
+    }
+
+    /* Read a round of batches while the threads decode the previous one,
+     * then emit the previous round and hand the new one to the threads.
+     */
+    for (cur = 0;; cur = !cur) {
+        round = batchv + cur * roundc;
+
+        for (i = 0; i < roundc && !eof; i++) {
+            rerr = mdc_scan_batch_read(round + i, &logoff, &eof);
+            if (rerr)
+                eof = true;
+
+            if (round[i].msb_recc)
+                batchc[cur]++;
+        }
+
+        if (wq)
+            flush_workqueue(wq);
+
+        for (i = 0; i < batchc[!cur] && !err; i++)
+            err = mdc_scan_batch_emit(batchv + !cur * roundc + i);
+
+        batchc[!cur] = 0;
+
+        if (err || !batchc[cur])
+            break;
+
+        for (i = 0; i < batchc[cur]; i++) {
+            if (wq)
+                queue_work(wq, &round[i].msb_work);
+            else
+                mdc_scan_batch_decode(round + i);
+        }
+    }
+
+out:
+    if (wq)
+        destroy_workqueue(wq);
+
+    for (i = 0; i < 2 * roundc; i++) {
+        free(batchv[i].msb_data);
+        free(batchv[i].msb_recv);
+        free(batchv[i].msb_privv);
+        mdc_scan_out_fini(&batchv[i].msb_out);
+    }
+
+    free(batchv);
+
+    return err ?: rerr;
+}
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_TOOLS_MDC_SCAN_H
+#define HSE_TOOLS_MDC_SCAN_H
+
+#include <hse_util/platform.h>
+#include <hse_util/hse_err.h>
+
+/* mdc_scan - the record decoding layer of the mdc diagnostic tools
+ *
+ * An MDC can only be read one record at a time, in order.  What makes a
+ * dump of a large log slow is the decoding and formatting of each record,
+ * so mdc_scan() reads the records in batches and hands the batches to a
+ * pool of threads which decode and format them into per-batch buffers.
+ * The output of the batches is then emitted in log order by the calling
+ * thread, which also keeps whatever state spans records (filters on a
+ * transaction, summaries).  The next round of batches is read while the
+ * current one is being decoded.
+ */
+
+/**
+ * struct mdc_scan_range - an inclusive range of u64, for filters
+ * @msr_lo:  lowest value in the range
+ * @msr_hi:  highest value in the range
+ * @msr_set: range was set, an unset range matches every value
+ */
+struct mdc_scan_range {
+    u64  msr_lo;
+    u64  msr_hi;
+    bool msr_set;
+};
+
+/**
+ * mdc_scan_range_parse() - parse "N", "N-M", "N-" or "-M" into a range
+ */
+merr_t
+mdc_scan_range_parse(const char *str, struct mdc_scan_range *range);
+
+static inline bool
+mdc_scan_range_match(const struct mdc_scan_range *range, u64 val)
+{
+    return !range->msr_set || (val >= range->msr_lo && val <= range->msr_hi);
+}
+
+/**
+ * struct mdc_scan_out - a growable output buffer
+ * @mso_err: set if the buffer could not grow, the output is truncated
+ */
+struct mdc_scan_out {
+    char * mso_buf;
+    size_t mso_len;
+    size_t mso_bufsz;
+    merr_t mso_err;
+};
+
+void
+mdc_scan_printf(struct mdc_scan_out *out, const char *fmt, ...) __printf(2, 3);
+
+/**
+ * mdc_scan_json_str() - append @str as a quoted and escaped JSON string
+ */
+void
+mdc_scan_json_str(struct mdc_scan_out *out, const char *str);
+
+void
+mdc_scan_out_fini(struct mdc_scan_out *out);
+
+/**
+ * mdc_scan_read_fn - read the next record into @buf
+ * @arg:   argument given to mdc_scan()
+ * @buf:   buffer to read into
+ * @bufsz: size of @buf
+ * @len:   (output) length of the record, 0 at the end of the log
+ *
+ * If the record does not fit, return merr(EOVERFLOW) with the length of
+ * the record in @len, the read is retried with a buffer that fits.
+ */
+typedef merr_t
+mdc_scan_read_fn(void *arg, void *buf, size_t bufsz, size_t *len);
+
+/**
+ * mdc_scan_decode_fn - decode a record, called in parallel on many records
+ * @arg:  argument given to mdc_scan()
+ * @rec:  the record
+ * @len:  its length
+ * @off:  its offset in the log
+ * @priv: per-record scratch of mdc_scan_ops.mso_privsz bytes, zeroed,
+ *        handed to mdc_scan_emit_fn with the output of this record
+ * @out:  output buffer to format the record into
+ */
+typedef void
+mdc_scan_decode_fn(
+    void *               arg,
+    const void *         rec,
+    size_t               len,
+    u64                  off,
+    void *               priv,
+    struct mdc_scan_out *out);
+
+/**
+ * mdc_scan_emit_fn - emit a decoded record, called in log order
+ * @arg:  argument given to mdc_scan()
+ * @priv: the record scratch filled in by mdc_scan_decode_fn
+ * @text: the output of mdc_scan_decode_fn for this record
+ * @len:  length of @text
+ *
+ * An error stops the scan and is returned by mdc_scan().
+ */
+typedef merr_t
+mdc_scan_emit_fn(void *arg, const void *priv, const char *text, size_t len);
+
+struct mdc_scan_ops {
+    size_t              mso_privsz;
+    mdc_scan_read_fn *  mso_read;
+    mdc_scan_decode_fn *mso_decode;
+    mdc_scan_emit_fn *  mso_emit;
+};
+
+/**
+ * mdc_scan() - read, decode and emit every record of a log
+ * @ops:     the callbacks, without @mso_emit the output of the records is
+ *           written to stdout
+ * @arg:     argument to the callbacks
+ * @threads: decode threads, 0 or 1 to decode in the calling thread
+ */
+merr_t
+mdc_scan(const struct mdc_scan_ops *ops, void *arg, uint threads);
+
+#endif
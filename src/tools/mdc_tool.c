@@ -18,6 +18,8 @@
 #include "../kvdb/kvdb_kvs.h"
 #include "../cn/cndb_omf.h"
 
+#include "mdc_scan.h"
+
 #include <sysexits.h>
 #include <libgen.h>
 
@@ -58,6 +60,72 @@ dump(char *buf, size_t sz)
     return 0;
 }
 
+struct summary {
+    u64 records;
+    u64 bytes;
+    u64 len_min;
+    u64 len_max;
+};
+
+static struct summary summary;
+
+static merr_t
+summary_read(void *arg, void *buf, size_t bufsz, size_t *len)
+{
+    return mpool_mdc_read(arg, buf, bufsz, len);
+}
+
+static void
+summary_decode(
+    void *               arg,
+    const void *         rec,
+    size_t               len,
+    u64                  off,
+    void *               priv,
+    struct mdc_scan_out *out)
+{
+    *(size_t *)priv = len;
+}
+
+static merr_t
+summary_emit(void *arg, const void *priv, const char *text, size_t textlen)
+{
+    size_t len = *(const size_t *)priv;
+
+    if (!summary.records || len < summary.len_min)
+        summary.len_min = len;
+    summary.len_max = max_t(u64, summary.len_max, len);
+    summary.bytes += len;
+    summary.records++;
+
+    return 0;
+}
+
+/* Read the whole MDC and print the count and size of its records.
+ */
+merr_t
+summarize(struct mpool_mdc *mdc)
+{
+    struct mdc_scan_ops ops = {
+        .mso_privsz = sizeof(size_t),
+        .mso_read = summary_read,
+        .mso_decode = summary_decode,
+        .mso_emit = summary_emit,
+    };
+    merr_t err;
+
+    err = mdc_scan(&ops, mdc, 0);
+
+    printf(
+        "{\"records\": %lu, \"bytes\": %lu, \"len_min\": %lu, \"len_max\": %lu}\n",
+        summary.records,
+        summary.bytes,
+        summary.len_min,
+        summary.len_max);
+
+    return err;
+}
+
 /*
  * MDC open and close dance
  */
@@ -100,6 +168,7 @@ usage(void)
     static const char msg[] = "usage: %s [options] mpool dataset [oid1 oid2]\n"
                               "-h       this help list\n"
                               "-i       ignore errors\n"
+                              "-s       print a JSON summary of the records\n"
                               "-w file  write raw MDC data to file\n"
                               "mpool    name of the mpool\n"
                               "dataset  name of the dataset\n";
@@ -115,6 +184,7 @@ main(int argc, char **argv)
     FILE *            fp;
     merr_t            err;
     int               ignore;
+    bool              sum;
     int               c;
 
     u64 oid1 = 0, oid2 = 0;
@@ -130,8 +200,9 @@ main(int argc, char **argv)
 
     wpath = 0;
     ignore = 0;
+    sum = false;
 
-    while ((c = getopt(argc, argv, ":hiw:")) != -1) {
+    while ((c = getopt(argc, argv, ":hisw:")) != -1) {
         switch (c) {
             case 'h':
                 usage();
@@ -141,6 +212,10 @@ main(int argc, char **argv)
                 ignore = 1;
                 break;
 
+            case 's':
+                sum = true;
+                break;
+
             case 'w':
                 wpath = optarg;
                 break;
@@ -193,6 +268,11 @@ main(int argc, char **argv)
 
     eopen_mdc(ds, oid1, oid2, &mdc);
 
+    if (sum) {
+        err = summarize(mdc);
+        goto fini;
+    }
+
     for (;;) {
         size_t len;
 
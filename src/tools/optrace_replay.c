@@ -0,0 +1,739 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/* optrace_replay - re-drive an operation trace against a kvdb
+ *
+ * The trace is captured by a kvdb opened with the rparam optrace_path
+ * (see hse_ikvdb/optrace.h).  Each thread of the traced application is
+ * replayed by a thread of its own (or, with -t, the traced threads are
+ * spread over fewer replay threads), which issues its operations at their
+ * traced times, scaled by the speed factor.  Operations that fall behind
+ * their time are issued as soon as possible and counted as late.
+ *
+ * Keys are those of the trace if it was captured with optrace_keys set,
+ * otherwise synthesized from their hashes: such keys have the traced
+ * lengths and are equal where the traced keys were, but do not share
+ * their order nor their prefixes.  Values have the traced lengths.
+ *
+ * Results are printed as one line of JSON per operation type, followed
+ * by a summary line.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/lathist.h>
+#include <hse_util/minmax.h>
+#include <hse_util/parse_num.h>
+
+#include <hse_ikvdb/optrace.h>
+
+#include <hse/hse.h>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sysexits.h>
+
+#define ORP_TXN_MAX (64)
+#define ORP_LATE_NS (1000 * 1000)
+
+static const char *const orp_opv[] = {
+    "kvs_open", "put", "get", "del", "pfx_del", "txn_begin", "txn_commit", "txn_abort",
+};
+
+struct orp_txn {
+    u64                  ot_id;
+    struct hse_kvdb_txn *ot_txn;
+};
+
+/**
+ * struct orp_worker - state of one replay thread
+ * @rw_tid:      thread id
+ * @rw_offv:     offsets in the trace of the records to replay
+ * @rw_offc:     number of records to replay
+ * @rw_offmax:   capacity of %rw_offv
+ * @rw_opsv:     operations replayed, by type
+ * @rw_errsv:    operations that failed, by type
+ * @rw_late:     operations issued more than ORP_LATE_NS after their time
+ * @rw_lag_max:  largest delay of an operation past its time (ns)
+ * @rw_mismatch: gets whose outcome differs from the traced one
+ * @rw_err:      first error, if any
+ * @rw_txnv:     transactions in progress, by traced id
+ * @rw_vbuf:     buffer for the values of gets
+ */
+struct orp_worker {
+    pthread_t      rw_tid;
+    u64 *          rw_offv;
+    u64            rw_offc;
+    u64            rw_offmax;
+    u64            rw_opsv[OPTRACE_OP_MAX];
+    u64            rw_errsv[OPTRACE_OP_MAX];
+    u64            rw_late;
+    u64            rw_lag_max;
+    u64            rw_mismatch;
+    hse_err_t      rw_err;
+    struct orp_txn rw_txnv[ORP_TXN_MAX];
+    void *         rw_vbuf;
+};
+
+struct orp_opts {
+    double speed;
+    uint   threads;
+    bool   info;
+    bool   drop;
+};
+
+static const char *     progname;
+static struct orp_opts  opts;
+static const char *     orp_trace;
+static size_t           orp_tracesz;
+static size_t           orp_traceend;
+static struct hse_kvdb *orp_kvdb;
+static struct hse_kvs * orp_kvsv[OPTRACE_KVS_MAX];
+static const char *     orp_kvs_namev[OPTRACE_KVS_MAX];
+static uint             orp_kvsc;
+static uint             orp_thread_max;
+static u64              orp_recs;
+static u64              orp_opsv[OPTRACE_OP_MAX];
+static u64              orp_time_max;
+static size_t           orp_vlen_max;
+static void *           orp_vbuf;
+static u64              orp_start;
+static struct lathist * orp_lhv[OPTRACE_OP_MAX];
+
+static void
+fatal(hse_err_t err, const char *fmt, ...)
+{
+    char    msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (err) {
+        char errbuf[128];
+
+        hse_err_to_string(err, errbuf, sizeof(errbuf), NULL);
+        fprintf(stderr, "%s: %s: %s\n", progname, msg, errbuf);
+    } else {
+        fprintf(stderr, "%s: %s\n", progname, msg);
+    }
+
+    exit(EX_SOFTWARE);
+}
+
+static void
+usage(void)
+{
+    printf(
+        "usage: %s [options] <trace> <kvdb> [param=value ...]\n"
+        "       %s -i <trace>\n"
+        "-D         drop the kvses of the trace at exit\n"
+        "-h         print this help list\n"
+        "-i         print a summary of the trace and exit\n"
+        "-s speed   speed relative to the trace, 0 for as fast as possible (default: 1)\n"
+        "-t thrds   replay threads (default: one per traced thread)\n"
+        "\n"
+        "The kvses of the trace are created in <kvdb> if they do not exist.\n"
+        "Params are passed to hse_params_set(), e.g. kvs.pfx_len=8.\n",
+        progname,
+        progname);
+}
+
+static const struct optrace_rec *
+orp_rec(u64 off)
+{
+    return (const void *)(orp_trace + off);
+}
+
+static const void *
+orp_rec_key(const struct optrace_rec *rec)
+{
+    return (rec->or_flags & OPTRACE_RF_KEY) ? rec + 1 : NULL;
+}
+
+/* Map the trace, check its header and find where its valid records end.
+ * A trace whose writer died may end in a partial record.
+ */
+static void
+orp_trace_load(const char *path)
+{
+    const struct optrace_hdr *hdr;
+    const struct optrace_rec *rec;
+    struct stat               st;
+    size_t                    off, len;
+    int                       fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st))
+        fatal(merr(errno), "cannot open %s", path);
+
+    if (st.st_size < sizeof(*hdr))
+        fatal(0, "%s is not a trace", path);
+
+    orp_tracesz = st.st_size;
+    orp_trace = mmap(NULL, orp_tracesz, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (orp_trace == MAP_FAILED)
+        fatal(merr(errno), "cannot map %s", path);
+
+    close(fd);
+
+    hdr = (const void *)orp_trace;
+    if (hdr->oh_magic != OPTRACE_MAGIC)
+        fatal(0, "%s is not a trace, or was captured on a host of another byte order", path);
+
+    if (hdr->oh_version != OPTRACE_VERSION || hdr->oh_recsz != sizeof(*rec))
+        fatal(0, "%s: unsupported trace version %u", path, hdr->oh_version);
+
+    for (off = sizeof(*hdr); off + sizeof(*rec) <= orp_tracesz; off += len) {
+        rec = orp_rec(off);
+
+        len = optrace_rec_len(rec);
+        if (off + len > orp_tracesz || rec->or_op >= OPTRACE_OP_MAX || !rec->or_thread)
+            break;
+
+        if (rec->or_op == OPTRACE_OP_KVS_OPEN) {
+            char *name;
+            uint  i;
+
+            if (!orp_rec_key(rec) || rec->or_kvs != orp_kvsc)
+                break;
+
+            name = strndup(orp_rec_key(rec), rec->or_klen);
+            if (!name)
+                fatal(0, "out of memory");
+
+            /* A kvs opened again shares the name, and later the handle,
+             * of its first open.
+             */
+            for (i = 0; i < orp_kvsc; i++) {
+                if (!strcmp(orp_kvs_namev[i], name)) {
+                    free(name);
+                    name = (char *)orp_kvs_namev[i];
+                    break;
+                }
+            }
+
+            orp_kvs_namev[orp_kvsc++] = name;
+        } else if (rec->or_op <= OPTRACE_OP_PFX_DEL && rec->or_kvs >= orp_kvsc) {
+            break;
+        }
+
+        orp_recs++;
+        orp_opsv[rec->or_op]++;
+        orp_thread_max = max_t(uint, orp_thread_max, rec->or_thread);
+        orp_time_max = max_t(u64, orp_time_max, rec->or_time);
+        orp_vlen_max = max_t(size_t, orp_vlen_max, rec->or_vlen);
+    }
+
+    orp_traceend = off;
+    if (orp_traceend < orp_tracesz)
+        fprintf(
+            stderr,
+            "%s: %s: ignoring %zu bytes of truncated or invalid records\n",
+            progname,
+            path,
+            orp_tracesz - orp_traceend);
+}
+
+static void
+orp_trace_info(const char *path)
+{
+    const struct optrace_hdr *hdr = (const void *)orp_trace;
+    uint                      i;
+
+    printf(
+        "{\"trace\":\"%s\",\"start_ns\":%lu,\"keys\":%s,\"records\":%lu,\"secs\":%.6f,"
+        "\"threads\":%u,\"kvs\":[",
+        path,
+        hdr->oh_start,
+        (hdr->oh_flags & OPTRACE_F_KEYS) ? "true" : "false",
+        orp_recs,
+        orp_time_max / 1e9,
+        orp_thread_max);
+
+    for (i = 0; i < orp_kvsc; i++)
+        printf("%s\"%s\"", i ? "," : "", orp_kvs_namev[i]);
+
+    printf("],\"ops\":{");
+
+    for (i = 0; i < OPTRACE_OP_MAX; i++)
+        printf("%s\"%s\":%lu", i ? "," : "", orp_opv[i], orp_opsv[i]);
+
+    printf("}}\n");
+}
+
+/* Spread the records over the replay threads, by traced thread. */
+static void
+orp_trace_split(struct orp_worker *workerv)
+{
+    const struct optrace_rec *rec;
+    struct orp_worker *       w;
+    size_t                    off;
+
+    for (off = sizeof(struct optrace_hdr); off < orp_traceend; off += optrace_rec_len(rec)) {
+        rec = orp_rec(off);
+        if (rec->or_op == OPTRACE_OP_KVS_OPEN)
+            continue;
+
+        w = workerv + (rec->or_thread - 1) % opts.threads;
+
+        if (w->rw_offc == w->rw_offmax) {
+            w->rw_offmax = max_t(u64, w->rw_offmax * 2, 1024);
+            w->rw_offv = realloc(w->rw_offv, w->rw_offmax * sizeof(*w->rw_offv));
+            if (!w->rw_offv)
+                fatal(0, "out of memory");
+        }
+
+        w->rw_offv[w->rw_offc++] = off;
+    }
+}
+
+/* Wait for the time of @rec, or note how late it is. */
+static void
+orp_wait(struct orp_worker *w, const struct optrace_rec *rec)
+{
+    struct timespec ts;
+    u64             due, now;
+
+    if (opts.speed <= 0)
+        return;
+
+    due = orp_start + (u64)(rec->or_time / opts.speed);
+    now = get_time_ns();
+
+    if (now < due) {
+        ts.tv_sec = due / NSEC_PER_SEC;
+        ts.tv_nsec = due % NSEC_PER_SEC;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+        return;
+    }
+
+    if (now - due > ORP_LATE_NS)
+        w->rw_late++;
+
+    w->rw_lag_max = max_t(u64, w->rw_lag_max, now - due);
+}
+
+static struct orp_txn *
+orp_txn_find(struct orp_worker *w, u64 id)
+{
+    uint i;
+
+    for (i = 0; i < ORP_TXN_MAX; i++)
+        if (w->rw_txnv[i].ot_id == id)
+            return w->rw_txnv + i;
+
+    return NULL;
+}
+
+static hse_err_t
+orp_txn_op(struct orp_worker *w, const struct optrace_rec *rec)
+{
+    struct orp_txn *t;
+    hse_err_t       err;
+
+    if (rec->or_op == OPTRACE_OP_TXN_BEGIN) {
+        t = orp_txn_find(w, 0);
+        if (!t)
+            return merr(ENOSPC);
+
+        t->ot_txn = hse_kvdb_txn_alloc(orp_kvdb);
+        if (!t->ot_txn)
+            return merr(ENOMEM);
+
+        err = hse_kvdb_txn_begin(orp_kvdb, t->ot_txn);
+        if (err) {
+            hse_kvdb_txn_free(orp_kvdb, t->ot_txn);
+            return err;
+        }
+
+        t->ot_id = rec->or_txn;
+        return 0;
+    }
+
+    /* The transaction began before the trace was started. */
+    t = orp_txn_find(w, rec->or_txn);
+    if (!t)
+        return 0;
+
+    if (rec->or_op == OPTRACE_OP_TXN_COMMIT)
+        err = hse_kvdb_txn_commit(orp_kvdb, t->ot_txn);
+    else
+        err = hse_kvdb_txn_abort(orp_kvdb, t->ot_txn);
+
+    hse_kvdb_txn_free(orp_kvdb, t->ot_txn);
+    t->ot_txn = NULL;
+    t->ot_id = 0;
+
+    return err;
+}
+
+static hse_err_t
+orp_kvs_op(struct orp_worker *w, const struct optrace_rec *rec)
+{
+    struct hse_kvdb_opspec os;
+    struct hse_kvs *       kvs = orp_kvsv[rec->or_kvs];
+    struct orp_txn *       t;
+    const void *           key;
+    char                   kbuf[HSE_KVS_KLEN_MAX];
+    size_t                 vlen, i;
+    hse_err_t              err = 0;
+    bool                   found;
+
+    HSE_KVDB_OPSPEC_INIT(&os);
+
+    if (rec->or_txn) {
+        t = orp_txn_find(w, rec->or_txn);
+        if (t)
+            os.kop_txn = t->ot_txn;
+    }
+
+    key = orp_rec_key(rec);
+    if (!key) {
+        u64 hash = htobe64(rec->or_hash);
+
+        for (i = 0; i < rec->or_klen; i += sizeof(hash))
+            memcpy(kbuf + i, &hash, min_t(size_t, sizeof(hash), rec->or_klen - i));
+        key = kbuf;
+    }
+
+    switch (rec->or_op) {
+        case OPTRACE_OP_PUT:
+            err = hse_kvs_put(kvs, &os, key, rec->or_klen, orp_vbuf, rec->or_vlen);
+            break;
+
+        case OPTRACE_OP_GET:
+            err = hse_kvs_get(
+                kvs, &os, key, rec->or_klen, &found, w->rw_vbuf, orp_vlen_max, &vlen);
+            if (!err && found != !!(rec->or_flags & OPTRACE_RF_FOUND))
+                w->rw_mismatch++;
+            break;
+
+        case OPTRACE_OP_DEL:
+            err = hse_kvs_delete(kvs, &os, key, rec->or_klen);
+            break;
+
+        case OPTRACE_OP_PFX_DEL:
+            err = hse_kvs_prefix_delete(kvs, &os, key, rec->or_klen, NULL);
+            break;
+
+        default:
+            break;
+    }
+
+    return err;
+}
+
+static void *
+orp_worker_main(void *arg)
+{
+    const struct optrace_rec *rec;
+    struct orp_worker *       w = arg;
+    hse_err_t                 err;
+    u64                       i, start;
+
+    w->rw_vbuf = malloc(orp_vlen_max);
+    if (!w->rw_vbuf) {
+        w->rw_err = merr(ENOMEM);
+        return NULL;
+    }
+
+    for (i = 0; i < w->rw_offc; i++) {
+        rec = orp_rec(w->rw_offv[i]);
+
+        orp_wait(w, rec);
+
+        start = lathist_start(orp_lhv[rec->or_op]);
+
+        if (rec->or_op >= OPTRACE_OP_TXN_BEGIN)
+            err = orp_txn_op(w, rec);
+        else
+            err = orp_kvs_op(w, rec);
+
+        lathist_record(orp_lhv[rec->or_op], start);
+
+        w->rw_opsv[rec->or_op]++;
+        if (err) {
+            w->rw_errsv[rec->or_op]++;
+            if (!w->rw_err)
+                w->rw_err = err;
+        }
+    }
+
+    /* Transactions the trace left in progress. */
+    for (i = 0; i < ORP_TXN_MAX; i++) {
+        if (w->rw_txnv[i].ot_txn) {
+            hse_kvdb_txn_abort(orp_kvdb, w->rw_txnv[i].ot_txn);
+            hse_kvdb_txn_free(orp_kvdb, w->rw_txnv[i].ot_txn);
+        }
+    }
+
+    free(w->rw_vbuf);
+
+    return NULL;
+}
+
+static void
+orp_replay(void)
+{
+    struct lathist_snap *snap;
+    struct orp_worker *  workerv;
+    u64                  opsv[OPTRACE_OP_MAX] = {}, errsv[OPTRACE_OP_MAX] = {};
+    u64                  ns, late, lag_max, mismatch;
+    hse_err_t            err;
+    uint                 i, j;
+    int                  rc;
+
+    workerv = calloc(opts.threads, sizeof(*workerv));
+    snap = calloc(1, sizeof(*snap));
+    if (!workerv || !snap)
+        fatal(0, "out of memory");
+
+    orp_trace_split(workerv);
+
+    orp_start = get_time_ns();
+
+    for (i = 0; i < opts.threads; ++i) {
+        rc = pthread_create(&workerv[i].rw_tid, NULL, orp_worker_main, workerv + i);
+        if (rc)
+            fatal(0, "pthread_create: %s", strerror(rc));
+    }
+
+    late = lag_max = mismatch = 0;
+    err = 0;
+
+    for (i = 0; i < opts.threads; ++i) {
+        struct orp_worker *w = workerv + i;
+
+        pthread_join(w->rw_tid, NULL);
+
+        for (j = 0; j < OPTRACE_OP_MAX; j++) {
+            opsv[j] += w->rw_opsv[j];
+            errsv[j] += w->rw_errsv[j];
+        }
+
+        late += w->rw_late;
+        lag_max = max_t(u64, lag_max, w->rw_lag_max);
+        mismatch += w->rw_mismatch;
+        if (!err)
+            err = w->rw_err;
+
+        free(w->rw_offv);
+    }
+
+    ns = get_time_ns() - orp_start;
+
+    for (j = 0; j < OPTRACE_OP_MAX; j++) {
+        if (!opsv[j])
+            continue;
+
+        lathist_snap(orp_lhv[j], snap);
+
+        printf(
+            "{\"op\":\"%s\",\"ops\":%lu,\"errors\":%lu,\"ops_per_sec\":%.1f,"
+            "\"lat_ns\":{\"avg\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"p99.9\":%lu,"
+            "\"p99.99\":%lu,\"max\":%lu}}\n",
+            orp_opv[j],
+            opsv[j],
+            errsv[j],
+            ns ? opsv[j] * 1e9 / ns : 0.0,
+            snap->lss_count ? snap->lss_sum / snap->lss_count : 0,
+            lathist_snap_pct(snap, 50.0),
+            lathist_snap_pct(snap, 90.0),
+            lathist_snap_pct(snap, 99.0),
+            lathist_snap_pct(snap, 99.9),
+            lathist_snap_pct(snap, 99.99),
+            snap->lss_max);
+    }
+
+    printf(
+        "{\"speed\":%g,\"threads\":%u,\"secs\":%.6f,\"trace_secs\":%.6f,\"late\":%lu,"
+        "\"lag_max_ns\":%lu,\"get_mismatch\":%lu,\"errno\":%d}\n",
+        opts.speed,
+        opts.threads,
+        ns / 1e9,
+        orp_time_max / 1e9,
+        late,
+        lag_max,
+        mismatch,
+        hse_err_to_errno(err));
+    fflush(stdout);
+
+    free(snap);
+    free(workerv);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct hse_params *params;
+    const char *       mpname, *path;
+    hse_err_t          err;
+    merr_t             merr;
+    char *             sep, *end;
+    uint               i, j;
+    int                c;
+
+    progname = strrchr(argv[0], '/');
+    progname = progname ? progname + 1 : argv[0];
+
+    opts.speed = 1;
+
+    while (-1 != (c = getopt(argc, argv, ":Dhis:t:"))) {
+        switch (c) {
+            case 'D':
+                opts.drop = true;
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'i':
+                opts.info = true;
+                break;
+
+            case 's':
+                errno = 0;
+                opts.speed = strtod(optarg, &end);
+                if (errno || end == optarg || *end || opts.speed < 0)
+                    fatal(0, "invalid speed '%s', use -h for help", optarg);
+                break;
+
+            case 't':
+                merr = parse_uint(optarg, &opts.threads);
+                if (merr || !opts.threads)
+                    fatal(0, "invalid thread count '%s', use -h for help", optarg);
+                break;
+
+            case ':':
+                fatal(0, "option -%c requires an argument, use -h for help", optopt);
+                break;
+
+            default:
+                fatal(0, "invalid option -%c, use -h for help", optopt);
+                break;
+        }
+    }
+
+    if (optind >= argc)
+        fatal(0, "missing trace, use -h for help");
+
+    path = argv[optind++];
+
+    orp_trace_load(path);
+
+    if (opts.info) {
+        orp_trace_info(path);
+        return 0;
+    }
+
+    if (optind >= argc)
+        fatal(0, "missing kvdb name, use -h for help");
+
+    mpname = argv[optind++];
+
+    if (!opts.threads)
+        opts.threads = max_t(uint, orp_thread_max, 1);
+
+    orp_vlen_max = max_t(size_t, orp_vlen_max, 1);
+    orp_vbuf = malloc(orp_vlen_max);
+    if (!orp_vbuf)
+        fatal(0, "out of memory");
+
+    for (i = 0; i < orp_vlen_max; i++)
+        ((char *)orp_vbuf)[i] = 'a' + i % 26;
+
+    for (i = 0; i < OPTRACE_OP_MAX; i++) {
+        merr = lathist_create(&orp_lhv[i]);
+        if (merr)
+            fatal(0, "cannot create latency histogram");
+    }
+
+    err = hse_kvdb_init();
+    if (err)
+        fatal(err, "hse_kvdb_init");
+
+    err = hse_params_create(&params);
+    if (err)
+        fatal(err, "hse_params_create");
+
+    for (; optind < argc; ++optind) {
+        sep = strchr(argv[optind], '=');
+        if (!sep)
+            fatal(0, "invalid param '%s', use -h for help", argv[optind]);
+
+        *sep++ = '\0';
+
+        err = hse_params_set(params, argv[optind], sep);
+        if (err)
+            fatal(err, "hse_params_set %s", argv[optind]);
+    }
+
+    err = hse_kvdb_open(mpname, params, &orp_kvdb);
+    if (err)
+        fatal(err, "hse_kvdb_open %s", mpname);
+
+    for (i = 0; i < orp_kvsc; i++) {
+        const char *name = orp_kvs_namev[i];
+
+        for (j = 0; j < i; j++)
+            if (orp_kvs_namev[j] == name)
+                break;
+
+        if (j < i) {
+            orp_kvsv[i] = orp_kvsv[j];
+            continue;
+        }
+
+        err = hse_kvdb_kvs_make(orp_kvdb, name, params);
+        if (err && hse_err_to_errno(err) != EEXIST)
+            fatal(err, "hse_kvdb_kvs_make %s", name);
+
+        err = hse_kvdb_kvs_open(orp_kvdb, name, params, &orp_kvsv[i]);
+        if (err)
+            fatal(err, "hse_kvdb_kvs_open %s", name);
+    }
+
+    orp_replay();
+
+    for (i = 0; i < orp_kvsc; i++) {
+        const char *name = orp_kvs_namev[i];
+
+        for (j = 0; j < i; j++)
+            if (orp_kvs_namev[j] == name)
+                break;
+
+        if (j < i)
+            continue;
+
+        hse_kvdb_kvs_close(orp_kvsv[i]);
+
+        if (opts.drop) {
+            err = hse_kvdb_kvs_drop(orp_kvdb, name);
+            if (err)
+                fatal(err, "hse_kvdb_kvs_drop %s", name);
+        }
+    }
+
+    hse_kvdb_close(orp_kvdb);
+    hse_params_destroy(params);
+    hse_kvdb_fini();
+
+    for (i = 0; i < OPTRACE_OP_MAX; i++)
+        lathist_destroy(orp_lhv[i]);
+
+    free(orp_vbuf);
+    munmap((void *)orp_trace, orp_tracesz);
+
+    return 0;
+}
@@ -11,6 +11,13 @@
 #include <hse_util/compiler.h>
 #include <hse_util/inttypes.h>
 #include <hse_util/bitmap.h>
+#include <hse_util/byteorder.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* [HSE_REVISIT] This block bloom implementation is less of an abstraction
  * than it is a loose collection of parts from which a client may construct
@@ -34,6 +41,23 @@ _Static_assert(BF_BKTSHIFT >= 9 && BF_BKTSHIFT <= 15, "BF_BKTSHIFT is too large
 
 _Static_assert(BF_ROTL >= 1 && BF_ROTL <= 63, "BF_ROTL is too large or too small");
 
+/* A split-block bloom bucket is one cache line comprised of BF_SPLIT_LANES
+ * 64-bit little-endian lanes.  Each element sets exactly one bit in every
+ * lane, the bit for lane i being selected by multiplying the upper 32 bits
+ * of the element's hash by the ith salt.  A lookup is therefore a single
+ * cache line load followed by a branch-free mask compare, which maps
+ * directly onto AVX2 or NEON.
+ */
+#define BF_SPLIT_LANES (8)
+#define BF_SPLIT_BKTSHIFT (9)
+#define BF_SPLIT_SALT                                                                  \
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, \
+        0x9efc4947u, 0x5c6bfb31u
+
+_Static_assert(
+    (BF_SPLIT_LANES * 64) == (1u << BF_SPLIT_BKTSHIFT),
+    "BF_SPLIT_BKTSHIFT does not match BF_SPLIT_LANES");
+
 struct bf_bithash_desc {
     u32 bhd_bits_per_elt;
     u32 bhd_num_hashes;
@@ -47,6 +71,7 @@ struct bloom_filter {
     u32 bf_bktshift;
     u32 bf_bktmask;
     u32 bf_rotl;
+    u32 bf_split;
 };
 
 struct bloom_filter_stats {
@@ -158,6 +183,99 @@ bf_populate(const struct bloom_filter *bf, u64 hash)
         hse_bitmap_set32(bitmap, bf_hash2bit(&hash, rotl, mask));
 }
 
+/**
+ * bf_split_lane() - determine bit offset of %hash within lane %i
+ * @hash:       hash used to select the bucket
+ * @salt:       salt for lane %i
+ */
+static __always_inline u32
+bf_split_lane(u64 hash, u32 salt)
+{
+    return ((u32)(hash >> 32) * salt) >> 26;
+}
+
+/**
+ * bf_split_lookup() - check to see if hash is in a split-block bucket
+ * @hash:       hash used to select the bucket
+ * @bitmap:     base byte address of the bucket (8-byte aligned)
+ *
+ * Return:
+ *     Returns %true if every lane in the bucket has the bit
+ *     selected by %hash set, otherwise returns %false.
+ */
+static __always_inline bool
+bf_split_lookup(u64 hash, const u8 *bitmap)
+{
+    static const u32 saltv[BF_SPLIT_LANES] __aligned(32) = { BF_SPLIT_SALT };
+
+#if defined(__AVX2__)
+    __m256i bitv, one, lo, hi;
+
+    bitv = _mm256_load_si256((const void *)saltv);
+    bitv = _mm256_mullo_epi32(_mm256_set1_epi32(hash >> 32), bitv);
+    bitv = _mm256_srli_epi32(bitv, 26);
+
+    one = _mm256_set1_epi64x(1);
+    lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bitv)));
+    hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bitv, 1)));
+
+    return _mm256_testc_si256(_mm256_loadu_si256((const void *)bitmap), lo) &
+           _mm256_testc_si256(_mm256_loadu_si256((const void *)(bitmap + 32)), hi);
+#elif defined(__ARM_NEON)
+    const u64 *lanev = (const u64 *)bitmap;
+    uint32x4_t hashv, a, b;
+    uint64x2_t one, miss;
+
+    hashv = vdupq_n_u32(hash >> 32);
+    a = vshrq_n_u32(vmulq_u32(hashv, vld1q_u32(saltv)), 26);
+    b = vshrq_n_u32(vmulq_u32(hashv, vld1q_u32(saltv + 4)), 26);
+
+    one = vdupq_n_u64(1);
+
+#define BF_SPLIT_MISS(_bitv, _i) \
+    vbicq_u64(vshlq_u64(one, vreinterpretq_s64_u64(vmovl_u32(_bitv))), vld1q_u64(lanev + (_i)))
+
+    miss = BF_SPLIT_MISS(vget_low_u32(a), 0);
+    miss = vorrq_u64(miss, BF_SPLIT_MISS(vget_high_u32(a), 2));
+    miss = vorrq_u64(miss, BF_SPLIT_MISS(vget_low_u32(b), 4));
+    miss = vorrq_u64(miss, BF_SPLIT_MISS(vget_high_u32(b), 6));
+
+#undef BF_SPLIT_MISS
+
+    return !(vgetq_lane_u64(miss, 0) | vgetq_lane_u64(miss, 1));
+#else
+    const u64 *lanev = (const u64 *)bitmap;
+    u64        miss = 0;
+    int        i;
+
+    for (i = 0; i < BF_SPLIT_LANES; ++i)
+        miss |= (1ul << bf_split_lane(hash, saltv[i])) & ~le64_to_cpu(lanev[i]);
+
+    return !miss;
+#endif
+}
+
+/**
+ * bf_split_populate() - populate a split-block bucket with given %hash
+ * @hash:       hash used to select the bucket
+ *
+ * Bits are set bytewise so that each lane is little-endian on media
+ * regardless of host byte order.
+ */
+static __always_inline void
+bf_split_populate(const struct bloom_filter *bf, u64 hash)
+{
+    static const u32 saltv[BF_SPLIT_LANES] = { BF_SPLIT_SALT };
+
+    u8 *bitmap = bf->bf_bitmap;
+    int i;
+
+    bitmap += bf_hash2bkt(hash, bf->bf_modulus, BF_SPLIT_BKTSHIFT);
+
+    for (i = 0; i < BF_SPLIT_LANES; ++i)
+        hse_bitmap_set32(bitmap + i * sizeof(u64), bf_split_lane(hash, saltv[i]));
+}
+
 struct bf_bithash_desc
 bf_compute_bithash_est(u32 probability);
 
@@ -175,6 +293,20 @@ bf_filter_init(
     u8 *                   storage,
     size_t                 storage_sz);
 
+/**
+ * bf_filter_init_split() - initialize a split-block bloom filter
+ *
+ * Same as bf_filter_init(), but subsequent inserts populate the
+ * filter using the split-block layout (see bf_split_lookup()).
+ */
+void
+bf_filter_init_split(
+    struct bloom_filter *  filter,
+    struct bf_bithash_desc desc,
+    u32                    exp_elmts,
+    u8 *                   storage,
+    size_t                 storage_sz);
+
 void
 bf_filter_insert_by_hash(struct bloom_filter *filter, u64 hash);
 
@@ -32,6 +32,19 @@ enum bonsai_alloc_mode {
     HSE_ALLOC_CURSOR = 1,
 };
 
+/**
+ * enum bonsai_index - the index used to find keys in a bonsai tree
+ * @BN_INDEX_BONSAI: balanced binary tree of bonsai nodes
+ * @BN_INDEX_ART:    adaptive radix tree over the (skidx, key) bytes
+ *
+ * Either index maintains the same ordered k/v list (br_kv), so iterators
+ * and callers of the bn_find*() family see no difference.
+ */
+enum bonsai_index {
+    BN_INDEX_BONSAI = 0,
+    BN_INDEX_ART = 1,
+};
+
 enum bonsai_ior_code {
     B_IOR_INSERTED = 1,
     B_IOR_REPLACED = 2,
@@ -95,14 +108,14 @@ struct bonsai_val {
  * struct bonsai_sval - input value argument
  * @bsv_val:      pointer to value data
  * @bsv_seqnoref: sequence number reference
- * @bsv_unused:   client's private value (unused)
+ * @bsv_staged:   value copy prepared by bn_val_stage() (may be NULL)
  * @bsv_vlen:     value length
  */
 struct bonsai_sval {
-    void *       bsv_val;
-    uintptr_t    bsv_seqnoref;
-    unsigned int bsv_unused;
-    u32          bsv_vlen;
+    void *             bsv_val;
+    uintptr_t          bsv_seqnoref;
+    struct bonsai_val *bsv_staged;
+    u32                bsv_vlen;
 };
 
 #define BKV_FLAG_PTOMB 0x01
@@ -247,6 +260,9 @@ struct bonsai_client {
 /**
  * struct bonsai_root - bonsai tree parameters
  * @br_root:      pointer to the root of bonsai_tree
+ * @br_art:       pointer to the root of the radix tree (BN_INDEX_ART)
+ * @br_art_free:  radix tree nodes retired by growth (BN_INDEX_ART)
+ * @br_index:     index in use, see enum bonsai_index
  * @br_kv:        a circular k/v list, next=head, prev=tail
  * @br_lcp:       longest common prefix between min/max keys
  * @br_chkbounds: safe to perfom a bounds check
@@ -256,12 +272,17 @@ struct bonsai_client {
  */
 struct bonsai_root {
     struct bonsai_node * br_root;
+    void *               br_art;
+    void *               br_art_free;
+    enum bonsai_index    br_index;
     struct bonsai_kv     br_kv;
     unsigned int         br_lcp;
     bool                 br_chkbounds;
     struct bonsai_client br_client;
 };
 
+#define BN_SAMPLE_MAX (32)
+
 /**
  * bn_create() - Initialize tree and client info.
  * @allocator: root of the tree
@@ -393,6 +414,34 @@ bn_find_pfx_GT(struct bonsai_root *tree, const struct bonsai_skey *skey, struct
 bool
 bn_findLE(struct bonsai_root *tree, const struct bonsai_skey *skey, struct bonsai_kv **kv);
 
+/**
+ * bn_set_index() - select the index used by an empty bonsai tree
+ * @tree:  bonsai tree instance
+ * @index: BN_INDEX_BONSAI or BN_INDEX_ART
+ *
+ * The tree must be empty (i.e., newly created or reset).  The choice
+ * persists across bn_reset().
+ */
+void
+bn_set_index(struct bonsai_root *tree, enum bonsai_index index);
+
+/**
+ * bn_sample() - sample keys that roughly partition a tree into equal ranges
+ * @tree: bonsai tree instance
+ * @kvv:  (output) vector of sampled kvs, in key order
+ * @kvc:  max number of kvs to sample (BN_SAMPLE_MAX at most)
+ *
+ * Samples are drawn from the top levels of the bonsai index, or from a walk
+ * of the kv list for the art index.  Trees with fewer than @kvc keys yield
+ * fewer samples.
+ *
+ * - Caller must hold rcu_read_lock() across this call and while looking at kvv.
+ *
+ * Return: the number of kvs sampled
+ */
+uint
+bn_sample(struct bonsai_root *tree, struct bonsai_kv **kvv, uint kvc);
+
 /**
  * bn_traverse() - In-order tree traversal for debugging purposes.
  * @tree: bonsai tree instance
@@ -497,9 +546,32 @@ bn_sval_init(void *val, u32 vlen, uintptr_t seqnoref, struct bonsai_sval *sval)
     sval->bsv_val = val;
     sval->bsv_vlen = vlen;
     sval->bsv_seqnoref = seqnoref;
-    sval->bsv_unused = 0;
+    sval->bsv_staged = NULL;
 }
 
+/**
+ * bn_val_stage_sz() - size of the memory required to stage a value
+ * @vlen:  value length
+ */
+static inline size_t
+bn_val_stage_sz(u32 vlen)
+{
+    return sizeof(struct bonsai_val) + vlen;
+}
+
+/**
+ * bn_val_stage() - copy a value into client memory ahead of its insertion
+ * @mem:  at least bn_val_stage_sz() bytes from the tree's allocator
+ * @sval: value to stage
+ *
+ * Allows the client to copy a value outside of whatever lock serializes
+ * its tree updates.  The staged value is consumed by the next call to
+ * bn_insert_or_replace() with @sval, in lieu of allocating and copying
+ * the value from within the tree update.
+ */
+void
+bn_val_stage(void *mem, struct bonsai_sval *sval);
+
 static inline s32
 bn_kv_cmp(const void *lhs, const void *rhs)
 {
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_UTIL_COMPRESSION_H
+#define HSE_UTIL_COMPRESSION_H
+
+#include <hse_util/inttypes.h>
+#include <hse_util/hse_err.h>
+
+/* Value compression algorithms, as selected by the "vcomp" kvs cparam.
+ */
+enum vcomp_algo {
+    VCOMP_ALGO_NONE = 0,
+    VCOMP_ALGO_LZ4 = 1,
+    VCOMP_ALGO_MAX = VCOMP_ALGO_LZ4,
+};
+
+/**
+ * compress_lz4_bound() - max compressed length of an input of @len bytes
+ */
+uint
+compress_lz4_bound(uint len);
+
+/**
+ * compress_lz4() - lz4 compress a buffer
+ * @src:     data to compress
+ * @src_len: length of @src
+ * @dst:     output buffer
+ * @dst_cap: size of @dst
+ * @dst_len: (output) length of the compressed data
+ *
+ * Return: EFBIG if the compressed data does not fit in @dst, which cannot
+ * happen if @dst_cap is at least compress_lz4_bound(@src_len).
+ */
+merr_t
+compress_lz4(const void *src, uint src_len, void *dst, uint dst_cap, uint *dst_len);
+
+/**
+ * decompress_lz4() - lz4 decompress a buffer
+ * @src:     compressed data
+ * @src_len: length of @src
+ * @dst:     output buffer
+ * @dst_cap: size of @dst
+ * @dst_len: (output) length of the decompressed data
+ *
+ * If @dst is too small to hold the entire output then only its first
+ * @dst_cap bytes are produced.
+ *
+ * Return: EILSEQ if @src is not valid lz4 data.
+ */
+merr_t
+decompress_lz4(const void *src, uint src_len, void *dst, uint dst_cap, uint *dst_len);
+
+#endif
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_PLATFORM_CRC32C_H
+#define HSE_PLATFORM_CRC32C_H
+
+#include <hse_util/inttypes.h>
+
+/**
+ * crc32c() - compute or extend a CRC32C (Castagnoli) checksum
+ * @crc:  checksum of the preceding data, or 0 to start a new checksum
+ * @buf:  data
+ * @len:  length of @buf
+ *
+ * Uses the SSE4.2 or ARMv8 crc32c instructions if the cpu has them,
+ * a table driven implementation otherwise.
+ */
+u32
+crc32c(u32 crc, const void *buf, size_t len);
+
+/* Table driven crc32c(), exposed for testing. */
+u32
+crc32c_sw(u32 crc, const void *buf, size_t len);
+
+#endif
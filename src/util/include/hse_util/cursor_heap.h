@@ -13,6 +13,10 @@
  * A Cursor Heap (cheap) is a memory range from which items can be allocated
  * via a cursor.  The cursor starts at offset 0, and moves forward as items
  * are allocated.
+ *
+ * A cheap may optionally place a leading arena of its range on huge pages
+ * (see cheap_create_ext()).  The arena is populated when the cheap is
+ * created and remains resident until the cheap is destroyed.
  */
 
 #include <hse_util/base.h>
@@ -25,6 +29,17 @@
 #define CHEAP_POISON_SZ (SMP_CACHE_BYTES * 2)
 #endif
 
+/* Arena flags for cheap_create_ext()
+ */
+#define CHEAP_F_HUGE2M   (0x01u) /* back the arena with 2MB hugetlb pages */
+#define CHEAP_F_HUGE1G   (0x02u) /* back the arena with 1GB hugetlb pages */
+#define CHEAP_F_PREFAULT (0x04u) /* fault in the arena at create time */
+#define CHEAP_F_LOCAL    (0x08u) /* prefer the creating cpu's numa node */
+#define CHEAP_F_NODE     (0x10u) /* prefer the numa node given by CHEAP_F_NODEID() */
+
+#define CHEAP_F_NODEID(_node) (CHEAP_F_NODE | ((uint)(_node) << 24))
+#define CHEAP_F_NODEOF(_flags) ((_flags) >> 24)
+
 /* Everything in this structure is opaque to callers (but not really,
  * because the cheap unit tests need access to the implementation).
  */
@@ -36,6 +51,9 @@ struct cheap {
     u64       base;
     u64       brk;
     void *    mem;
+    size_t    maplen;
+    size_t    arena;
+    u32       flags;
     uintptr_t magic;
 };
 
@@ -49,6 +67,52 @@ struct cheap {
 struct cheap *
 cheap_create(size_t alignment, size_t size);
 
+/**
+ * cheap_create_ext() - Create a cursor heap with a huge page arena
+ * @alignment:  Alignment for cheap_alloc() (must be a power of 2 from 0 to 64)
+ * @size:       Maximum size of the heap (in bytes)
+ * @arena:      Size of the leading arena of the heap (in bytes)
+ * @flags:      CHEAP_F_* flags describing the arena
+ *
+ * The arena is rounded down to a multiple of the requested huge page size.
+ * If hugetlb pages cannot be reserved for it the arena falls back to base
+ * pages advised for transparent huge pages, in which case CHEAP_F_HUGE2M
+ * and CHEAP_F_HUGE1G are cleared from the cheap's flags (see cheap_hugetlb()).
+ * cheap_trim() never releases pages within the arena.
+ *
+ * If CHEAP_F_NODE is given then the whole heap (not just its arena)
+ * prefers the numa node encoded in %flags by CHEAP_F_NODEID().
+ *
+ * Return: Returns a ptr to a struct cheap if successful, otherwise NULL.
+ */
+struct cheap *
+cheap_create_ext(size_t alignment, size_t size, size_t arena, uint flags);
+
+/**
+ * cheap_numa_nodes() - return the number of numa nodes cheaps may prefer
+ *
+ * Return: One more than the highest node in the task's allowed memory
+ * nodes, or 1 if that cannot be determined.
+ */
+uint
+cheap_numa_nodes(void);
+
+/**
+ * cheap_pool_init() - enable the pool of idle cheap regions
+ *
+ * Cheaps without CHEAP_F_HUGE*, CHEAP_F_LOCAL and CHEAP_F_NODE arenas are
+ * thereafter returned to a pool by cheap_destroy() and created from it
+ * by cheap_create_ext().  Idle regions are unmapped after a few seconds.
+ */
+merr_t
+cheap_pool_init(void);
+
+/**
+ * cheap_pool_fini() - disable the pool and unmap all idle regions
+ */
+void
+cheap_pool_fini(void);
+
 /**
  * cheap_destroy() - destroy a cheap
  * @h:  the cheap to destroy
@@ -143,6 +207,16 @@ cheap_memalign(struct cheap *h, size_t alignment, size_t size);
 size_t
 cheap_used(struct cheap *h);
 
+/**
+ * cheap_hugetlb() - return true if the cheap has a hugetlb-backed arena
+ * @h:  ptr to a cheap
+ */
+static inline bool
+cheap_hugetlb(const struct cheap *h)
+{
+    return h->flags & (CHEAP_F_HUGE2M | CHEAP_F_HUGE1G);
+}
+
 /**
  * cheap_avail() - return remaining free space
  * @h:  ptr to a cheap
@@ -57,7 +57,7 @@ typedef enum {
      DT_PATH_SEPARATOR_CNT)
 
 /* Operations */
-enum { DT_OP_INVALID, DT_OP_EMIT, DT_OP_SET, DT_OP_COUNT, DT_OP_LOG };
+enum { DT_OP_INVALID, DT_OP_EMIT, DT_OP_SET, DT_OP_COUNT, DT_OP_LOG, DT_OP_VISIT };
 
 /* Flags */
 #define DT_FLAGS_IN_TREE 0x1
@@ -92,10 +92,23 @@ struct dt_set_parameters {
     dt_field_t field;
 };
 
+typedef size_t(dt_visit_handler_t)(struct dt_element *, void *);
+
+/**
+ * struct dt_visit_parameters - parameters of DT_OP_VISIT
+ * @visit: called with the tree locked for each element operated on
+ * @arg:   passed to @visit
+ */
+struct dt_visit_parameters {
+    dt_visit_handler_t *visit;
+    void *              arg;
+};
+
 union dt_iterate_parameters {
-    struct yaml_context *     yc;
-    struct dt_set_parameters *dsp;
-    int                       log_level;
+    struct yaml_context *       yc;
+    struct dt_set_parameters *  dsp;
+    struct dt_visit_parameters *dvp;
+    int                         log_level;
 };
 
 /* The real definition of struct dt_tree is in data_tree.c */
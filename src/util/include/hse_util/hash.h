@@ -54,4 +54,33 @@ hse_hash64v(const void *data1, size_t len1, const void *data2, size_t len2)
     return hse_hash64v_seed(data1, len1, data2, len2, HSE_HASH_SEED64);
 }
 
+/**
+ * hse_hash64x4() - hash four inputs of the same length at once
+ * @datav:  four ptrs to the inputs
+ * @len:    length of each input
+ * @seed:   hash seed
+ * @hashv:  four hashes, each equal to hse_hash64_seed() of its input
+ */
+void
+hse_hash64x4(const void *const *datav, size_t len, u64 seed, u64 *hashv);
+
+/**
+ * hse_hash64_mix() - derive a seeded hash from an existing 64-bit hash
+ *
+ * The result is distinct for distinct seeds and is fully avalanched,
+ * so it can stand in for rehashing the input with @seed.
+ */
+static __always_inline u64
+hse_hash64_mix(u64 hash, u64 seed)
+{
+    hash ^= seed;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
 #endif
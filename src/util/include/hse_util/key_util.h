@@ -9,6 +9,7 @@
 #include <hse_util/inttypes.h>
 #include <hse_util/minmax.h>
 #include <hse_util/assert.h>
+#include <hse_util/keycmp.h>
 
 #define KI_DLEN_MAX (sizeof(struct key_immediate) - 4)
 
@@ -306,4 +307,75 @@ key2kobj(struct key_obj *kobj, const void *kdata, size_t klen)
     return kobj;
 }
 
+/**
+ * key_obj_word() - eight bytes of a key as an integer
+ * @kobj: key object
+ * @off:  offset of the bytes in the key
+ *
+ * The bytes are read as a big-endian integer, zero padded, such that keys
+ * whose integers differ are ordered as their integers are.
+ */
+static __always_inline u64
+key_obj_word(const struct key_obj *kobj, uint off)
+{
+    const u8 *pfx = kobj->ko_pfx, *sfx = kobj->ko_sfx;
+    uint      pfx_len = kobj->ko_pfx_len;
+    u64       x = 0;
+    uint      i, j;
+
+    if (off + sizeof(x) <= pfx_len)
+        return keycmp_word(pfx + off);
+
+    if (off >= pfx_len && off - pfx_len + sizeof(x) <= kobj->ko_sfx_len)
+        return keycmp_word(sfx + off - pfx_len);
+
+    /* The bytes straddle the prefix and suffix, or the end of the key. */
+    for (i = 0; i < sizeof(x); ++i) {
+        j = off + i;
+        x <<= 8;
+
+        if (j < pfx_len)
+            x |= pfx[j];
+        else if (j - pfx_len < kobj->ko_sfx_len)
+            x |= sfx[j - pfx_len];
+    }
+
+    return x;
+}
+
+/**
+ * key_obj_pfx64() - first eight bytes of a key as an integer
+ * @kobj: key object
+ */
+static __always_inline u64
+key_obj_pfx64(const struct key_obj *kobj)
+{
+    return key_obj_word(kobj, 0);
+}
+
+/**
+ * key_obj_cmp_fixed() - key_obj_cmp() specialized for keys of a fixed length
+ * @ko1:    key object 1
+ * @ko2:    key object 2
+ * @kfixed: fixed key length (0, 8 or 16), see keycmp_fixed()
+ */
+static __always_inline int
+key_obj_cmp_fixed(const struct key_obj *ko1, const struct key_obj *ko2, uint kfixed)
+{
+    uint off;
+    int  rc;
+
+    if (kfixed && key_obj_len(ko1) == kfixed && key_obj_len(ko2) == kfixed) {
+        for (off = 0; off < kfixed; off += sizeof(u64)) {
+            rc = keycmp_u64(key_obj_word(ko1, off), key_obj_word(ko2, off));
+            if (rc)
+                return rc;
+        }
+
+        return 0;
+    }
+
+    return key_obj_cmp(ko1, ko2);
+}
+
 #endif
@@ -8,6 +8,7 @@
 
 #include <hse_util/base.h>
 #include <hse_util/inttypes.h>
+#include <hse_util/byteorder.h>
 
 /*
  * Return value:
@@ -32,6 +33,62 @@ keycmp(const void *key1, u32 len1, const void *key2, u32 len2)
     return rc == 0 ? len1 - len2 : rc;
 }
 
+/* Load eight bytes of a key as a big-endian integer, such that integers
+ * compare as the bytes would.
+ */
+static __always_inline u64
+keycmp_word(const void *key)
+{
+    u64 x;
+
+    memcpy(&x, key, sizeof(x));
+
+    return be64_to_cpu(x);
+}
+
+static __always_inline int
+keycmp_u64(u64 x, u64 y)
+{
+    return (x > y) - (x < y);
+}
+
+/*
+ * keycmp_fixed() - keycmp() specialized for keys of a fixed length
+ * @kfixed: fixed key length (0, 8 or 16), see the kfixed kvs cparam
+ *
+ * Keys of @kfixed bytes are compared one word at a time instead of by
+ * memcmp().  Keys of any other length (e.g., prefixes) fall back to
+ * keycmp(), so the result is always that of keycmp().  @kfixed is meant
+ * to be invariant at a call site, so that the switch is well predicted.
+ */
+static __always_inline int
+keycmp_fixed(const void *key1, u32 len1, const void *key2, u32 len2, u32 kfixed)
+{
+    int rc;
+
+    switch (kfixed) {
+    case 8:
+        if (likely(len1 == 8 && len2 == 8))
+            return keycmp_u64(keycmp_word(key1), keycmp_word(key2));
+        break;
+
+    case 16:
+        if (likely(len1 == 16 && len2 == 16)) {
+            rc = keycmp_u64(keycmp_word(key1), keycmp_word(key2));
+            if (rc)
+                return rc;
+
+            return keycmp_u64(keycmp_word(key1 + 8), keycmp_word(key2 + 8));
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return keycmp(key1, len1, key2, len2);
+}
+
 /*
  * Return value:
  *   0            : pfx is a prefix of key.
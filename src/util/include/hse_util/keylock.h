@@ -37,6 +37,11 @@ keylock_create(u64 num_ents, keylock_cb_fn *cb_fun, struct keylock **handle_out)
  *
  * Note:  Only the least significant 48 bits of %hash are used
  * to uniquely identify the lock.
+ *
+ * The table is lock-free, keylock_cb_fn() is called without any table
+ * lock held but within an RCU read-side critical section.  A rock that
+ * may be passed to it as the current owner must not be freed until an
+ * RCU grace period after it released (or lost) all its locks.
  */
 merr_t
 keylock_lock(
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_UTIL_LATHIST_H
+#define HSE_UTIL_LATHIST_H
+
+#include <hse_util/arch.h>
+#include <hse_util/compiler.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+#include <hse_util/timing.h>
+
+/* A latency histogram records operation latencies (in nanoseconds) into
+ * log-linear buckets: each power-of-two range is split into LATHIST_SUB_CNT
+ * equal sub-buckets, so a bucket's width is at most 1/LATHIST_SUB_CNT of
+ * its lower bound (values below LATHIST_SUB_CNT are recorded exactly).
+ * Unlike the perfc distribution counters, whose buckets are fixed at
+ * creation, the relative error is the same from microseconds to seconds,
+ * which makes high percentiles (p99.9, p99.99) meaningful.
+ *
+ * Recording spreads over per-cpu slots and never takes a lock.  A snapshot
+ * merges the slots, and snapshots of several histograms may be merged in
+ * turn.  A reset starts a new measurement window; records that race with
+ * a reset may land in either window.
+ */
+
+#define LATHIST_SUB_BITS (4)
+#define LATHIST_SUB_CNT (1u << LATHIST_SUB_BITS)
+#define LATHIST_EXP_MAX (40)
+#define LATHIST_BKT_MAX ((LATHIST_EXP_MAX - LATHIST_SUB_BITS + 1) * LATHIST_SUB_CNT)
+
+struct lathist;
+
+/**
+ * struct lathist_snap - merged contents of one or more histograms
+ * @lss_bktv:   counts by bucket
+ * @lss_count:  number of samples
+ * @lss_sum:    sum of all samples (ns)
+ * @lss_max:    largest sample (ns)
+ * @lss_window: length of the measurement window (ns)
+ */
+struct lathist_snap {
+    u64 lss_bktv[LATHIST_BKT_MAX];
+    u64 lss_count;
+    u64 lss_sum;
+    u64 lss_max;
+    u64 lss_window;
+};
+
+/**
+ * lathist_create() - create a latency histogram
+ * @lhp: (output) histogram
+ */
+merr_t
+lathist_create(struct lathist **lhp);
+
+void
+lathist_destroy(struct lathist *lh);
+
+/**
+ * lathist_add() - record one sample
+ * @lh: histogram
+ * @ns: latency in nanoseconds
+ */
+void
+lathist_add(struct lathist *lh, u64 ns);
+
+/**
+ * lathist_reset() - discard all samples and start a new window
+ * @lh: histogram
+ */
+void
+lathist_reset(struct lathist *lh);
+
+/**
+ * lathist_snap() - merge a histogram into a snapshot
+ * @lh:   histogram
+ * @snap: snapshot, zeroed by the caller before the first merge
+ *
+ * The window of a merged snapshot is the longest of its histograms.
+ */
+void
+lathist_snap(struct lathist *lh, struct lathist_snap *snap);
+
+/**
+ * lathist_snap_diff() - the samples recorded between two snapshots
+ * @diff: (output) samples in @snap but not in @prev, may be @prev
+ * @snap: snapshot
+ * @prev: earlier snapshot of the same histograms
+ *
+ * Buckets that shrank (e.g., across a reset) count as empty.  The max of
+ * @diff is that of @snap, an upper bound of the samples in between.
+ */
+void
+lathist_snap_diff(
+    struct lathist_snap *      diff,
+    const struct lathist_snap *snap,
+    const struct lathist_snap *prev);
+
+/**
+ * lathist_snap_pct() - compute a percentile from a snapshot
+ * @snap: snapshot
+ * @pct:  percentile (0.0 to 100.0)
+ *
+ * Return: the largest latency within the bucket that holds the requested
+ * percentile (never more than the largest sample), 0 if no samples
+ */
+u64
+lathist_snap_pct(const struct lathist_snap *snap, double pct);
+
+/**
+ * lathist_start() - start a measurement
+ * @lh: histogram, may be NULL
+ *
+ * Return: the current time in nanoseconds, 0 if %lh is NULL
+ */
+static __always_inline u64
+lathist_start(struct lathist *lh)
+{
+    return lh ? get_time_ns() : 0;
+}
+
+/**
+ * lathist_record() - record the latency of a measurement
+ * @lh:    histogram, may be NULL
+ * @start: value returned by lathist_start()
+ */
+static __always_inline void
+lathist_record(struct lathist *lh, u64 start)
+{
+    if (lh && start)
+        lathist_add(lh, get_time_ns() - start);
+}
+
+#endif
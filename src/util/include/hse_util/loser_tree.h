@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_PLATFORM_LOSER_TREE_H
+#define HSE_PLATFORM_LOSER_TREE_H
+
+#include <hse_util/inttypes.h>
+#include <hse_util/hse_err.h>
+#include <hse_util/element_source.h>
+
+/* A loser tree merges the sorted streams of up to max_width element sources
+ * into one.  Each pop replays a single leaf-to-root path, which takes one
+ * comparison per level instead of the two a binary heap needs to sift down.
+ *
+ * If a prefix function is given, the tree caches the prefix of every source's
+ * current element and compares the cached prefixes before it calls the
+ * compare function, such that the (usually expensive) compare function runs
+ * only on a prefix tie.  A prefix function must map elements to integers
+ * ordered as the elements are, i.e., pfx(a) < pfx(b) must imply a < b.
+ *
+ * Elements that compare equal come out in source order, the element of the
+ * lowest numbered source first, as they do from a bin_heap2.
+ */
+struct loser_tree;
+
+typedef int
+loser_tree_compare_fn(const void *a, const void *b);
+
+typedef u64
+loser_tree_pfx_fn(const void *elt);
+
+/**
+ * struct lt_leaf - a leaf of a loser tree
+ * @ll_data: current element of @ll_es, NULL if @ll_es is exhausted
+ * @ll_pfx:  cached prefix of @ll_data
+ * @ll_es:   element source
+ */
+struct lt_leaf {
+    void *                 ll_data;
+    u64                    ll_pfx;
+    struct element_source *ll_es;
+};
+
+/**
+ * struct loser_tree - tournament tree of element sources
+ * @lt_width:     number of leaves
+ * @lt_max_width: max number of leaves
+ * @lt_cmp:       element compare function
+ * @lt_pfx:       element prefix function, may be NULL
+ * @lt_node:      lt_node[0] is the winning leaf, lt_node[i] for i > 0 is the
+ *                leaf that lost the match at internal node i
+ * @lt_leafv:     leaves, in source order
+ */
+struct loser_tree {
+    u32                    lt_width;
+    u32                    lt_max_width;
+    loser_tree_compare_fn *lt_cmp;
+    loser_tree_pfx_fn *    lt_pfx;
+    u32 *                  lt_node;
+    struct lt_leaf         lt_leafv[];
+};
+
+/**
+ * loser_tree_create() - create a loser tree
+ * @max_width: max number of element sources
+ * @cmp:       returns a negative value if a is to be popped before b
+ * @pfx:       element prefix function, may be NULL
+ * @lt_out:    (output) loser tree
+ */
+merr_t
+loser_tree_create(
+    u32                    max_width,
+    loser_tree_compare_fn *cmp,
+    loser_tree_pfx_fn *    pfx,
+    struct loser_tree **   lt_out);
+
+void
+loser_tree_destroy(struct loser_tree *lt);
+
+/**
+ * loser_tree_prepare() - load the first element of each source
+ * @lt:    loser tree
+ * @width: number of element sources
+ * @es:    element sources, newest first, NULL entries are skipped
+ *
+ * Sources are numbered by their position in @es, which is also stored in
+ * each source's es_sort.
+ */
+merr_t
+loser_tree_prepare(struct loser_tree *lt, u32 width, struct element_source *es[]);
+
+/**
+ * loser_tree_width() - number of sources that are not yet exhausted
+ * @lt: loser tree, may be NULL
+ */
+u32
+loser_tree_width(struct loser_tree *lt);
+
+/**
+ * loser_tree_pop() - return the least element and advance its source
+ * @lt:   loser tree
+ * @item: (output) least element
+ *
+ * As with bin_heap2_pop(), @item may be overwritten by the source's next
+ * element, so a caller that needs it must copy it from loser_tree_peek().
+ *
+ * Return: false if all sources are exhausted
+ */
+bool
+loser_tree_pop(struct loser_tree *lt, void **item);
+
+/**
+ * loser_tree_refetch() - reload the current element of a repositioned source
+ * @lt:   loser tree
+ * @leaf: source number
+ *
+ * The caller must call loser_tree_rebuild() after it has refetched all the
+ * sources it repositioned and before it pops or peeks again.
+ */
+void
+loser_tree_refetch(struct loser_tree *lt, u32 leaf);
+
+/**
+ * loser_tree_rebuild() - replay all matches of the tree
+ * @lt: loser tree
+ */
+void
+loser_tree_rebuild(struct loser_tree *lt);
+
+static __always_inline bool
+loser_tree_peek(struct loser_tree *lt, void **item)
+{
+    *item = lt->lt_width ? lt->lt_leafv[lt->lt_node[0]].ll_data : NULL;
+
+    return *item;
+}
+
+#endif
@@ -12,4 +12,8 @@
 #define MADV_FREE MADV_DONTNEED
 #endif
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
 #endif
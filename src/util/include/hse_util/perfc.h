@@ -15,16 +15,12 @@
 
 /* MTF_MOCK_DECL(perfc) */
 
-/* PERFC_PCV_MAX    max per-cpu values per counter
+/* PERFC_PCV_MAX    max per-cpu values (shards) per counter
  * PERFC_IVL_MAX    max bounds in a distribution counter
- * PERFC_BKT_MAX    max buckets in a distribution counter
- * PERFC_GRP_MAX    max bucket groups distribution counter
  * PERFC_PCT_SCALE  power-of-two scaling factor for pdi_pct
  */
 #define PERFC_PCV_MAX (32)
 #define PERFC_IVL_MAX (PERFC_PCV_MAX - 1)
-#define PERFC_GRP_MAX (sizeof(struct perfc_val) / sizeof(struct perfc_bkt))
-#define PERFC_BKT_MAX (PERFC_GRP_MAX * (PERFC_IVL_MAX + 1))
 #define PERFC_PCT_SCALE (128)
 
 struct perfc_ivl;
@@ -63,6 +59,22 @@ perfc_shutdown(void);
 int
 perfc_cleanup(const char *component);
 
+/**
+ * perfc_om_emit() - render counter sets in the OpenMetrics text format
+ * @path:     data tree path of the counter sets (e.g., PERFC_ROOT_PATH)
+ * @families: comma separated counter families to emit (case insensitive),
+ *            NULL or "" for all
+ * @bufp:     (output) NUL terminated text, to be freed by the caller
+ * @lenp:     (output) length of the text
+ *
+ * Only enabled counters are emitted.  Basic counters are gauges, rate
+ * counters are counters, simple latency counters are summaries, and
+ * distribution and latency counters are histograms.  Each sample is
+ * labeled with the component, kvdb, kvs and counter set of its counter.
+ */
+merr_t
+perfc_om_emit(const char *path, const char *families, char **bufp, size_t *lenp);
+
 /**
  * perfc_ivl_create() - create a dis/lat counter interval object
  * @boundc:   number of elements in boundv[]
@@ -371,52 +383,55 @@ struct perfc_name {
  * @pcv_vadd:   used by perfc_inc, perfc_add
  * @pcv_vsub:   used by perfc_dec, perfc_sub
  *
- * perc_ctr_hdr contains a per-cpu vector of perfc_val objects.
- * This struct is cacheline aligned so as to prevent false sharing,
- * but note that perfc_bkt leverages this fact to use the space
- * that is otherwise wasted by basic and rate counters.
+ * perc_ctr_hdr contains a per-cpu vector of perfc_val objects, each
+ * in its own cacheline so that updates from different cpus never
+ * contend.  The values are summed only when the counter is read.
  */
 struct perfc_val {
     atomic64_t pcv_vadd;
     atomic64_t pcv_vsub;
-} __aligned(SMP_CACHE_BYTES / 2);
+} __aligned(SMP_CACHE_BYTES);
 
 /**
- * struct perfc_bkt - per-node data for distribution counters
+ * struct perfc_bkt - distribution counter bucket
  * @pcv_vadd:   sum of samples for this bucket
  * @pcv_hits:   number of sample in this bucket
- *
- * perc_ctr_hdr contains a vector of perfc_bkt objects which are
- * accessed by sub groups of cpus.  The performance hit due to
- * false-sharing between buckets within a group is eclipsed by
- * the performance improvement obtained by the reduction of
- * cacheline thrashing between cpus.
  */
 struct perfc_bkt {
     atomic64_t pcb_vadd;
     atomic64_t pcb_hits;
 };
 
+/**
+ * struct perfc_dis_shard - per-cpu data for distribution counters
+ * @pds_min:    minimum value recorded by this shard
+ * @pds_max:    maximum value recorded by this shard
+ * @pds_bktv:   buckets of the distribution
+ *
+ * Each distribution counter has a vector of shards, one per cpu (modulo
+ * PERFC_PCV_MAX), which are merged only when the counter is read.
+ */
+struct perfc_dis_shard {
+    u64              pds_min;
+    u64              pds_max;
+    struct perfc_bkt pds_bktv[PERFC_IVL_MAX + 1];
+} __aligned(SMP_CACHE_BYTES);
+
 /**
  * struct perfc_ctr_hdr - per counter data
  * @pch_type:       counter type (basic, rate, distribution, ...)
  * @pch_flags:      counter flags
  * @pch_val:        per-cpu values for basic and rate counters
- * @pch_bkt:        distribution counter bucket data (per-cpu node)
  *
  * For basic and rate counters there is one pch_val[] per cpu (modulo
- * PERFC_PCV_MAX).  For distribution counters each pch_val[] object
- * constitutes one bucket in the distribution.
+ * PERFC_PCV_MAX).
  */
 struct perfc_ctr_hdr {
     enum perfc_type pch_type;
     u32             pch_flags;
     u32             pch_prio;
 
-    union {
-        struct perfc_val pch_val[PERFC_PCV_MAX];
-        struct perfc_bkt pch_bktv[PERFC_BKT_MAX];
-    } __aligned(SMP_CACHE_BYTES);
+    struct perfc_val pch_val[PERFC_PCV_MAX];
 };
 
 /**
@@ -446,8 +461,9 @@ struct perfc_rate {
 /**
  * struct perfc_dis - distribution/latency counter
  * @pdi_hdr:    base counter object
- * @pdi_min:    overall minimum value in distribution
- * @pdi_max:    overall maximum value in distribution
+ * @pdi_pct:    sampling rate (scaled by PERFC_PCT_SCALE)
+ * @pdi_shardc: number of shards in %pdi_shardv
+ * @pdi_shardv: per-cpu shards, allocated with the counter set instance
  * @pdi_ivl:    distribution bucket bounds
  *
  * perfc_dis "is-a" perfc_ctr_hdr.
@@ -455,8 +471,8 @@ struct perfc_rate {
 struct perfc_dis {
     struct perfc_ctr_hdr    pdi_hdr; /* Must be first field */
     u32                     pdi_pct;
-    u64                     pdi_min;
-    u64                     pdi_max;
+    u32                     pdi_shardc;
+    struct perfc_dis_shard *pdi_shardv;
     const struct perfc_ivl *pdi_ivl;
 };
 
@@ -588,6 +604,16 @@ perfc_dis_record_impl(struct perfc_dis *dis, u64 sample);
 #define perfc_rec_lat perfc_lat_record
 #define perfc_rec_sample perfc_dis_record
 
+/**
+ * perfc_cpu() - index of the calling cpu's shard of a counter
+ * @shardc:  number of shards of the counter
+ */
+static __always_inline uint
+perfc_cpu(uint shardc)
+{
+    return raw_smp_processor_id() % shardc;
+}
+
 /* [HSE_REVISIT] Add unit tests for all these predicates...
  */
 BullseyeCoverageSaveOff
@@ -723,7 +749,7 @@ perfc_sl_record(struct perfc_set *pcs, const u32 cidx, const u64 start)
 
     val = get_time_ns() - start;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(val, &hdr->pch_val[cpu].pcv_vadd); /* sum */
     atomic64_inc(&hdr->pch_val[cpu].pcv_vsub);      /* hitcnt */
 }
@@ -783,7 +809,7 @@ perfc_inc(struct perfc_set *pcs, const u32 cidx)
     if (!pcsi)
         return;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(1, &pcsi->pcs_ctrv[cidx].hdr.pch_val[cpu].pcv_vadd);
 }
 
@@ -799,7 +825,7 @@ perfc_dec(struct perfc_set *pcs, const u32 cidx)
     if (!pcsi)
         return;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(1, &pcsi->pcs_ctrv[cidx].hdr.pch_val[cpu].pcv_vsub);
 }
 
@@ -815,7 +841,7 @@ perfc_add(struct perfc_set *pcs, const u32 cidx, const u64 val)
     if (!pcsi)
         return;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(val, &pcsi->pcs_ctrv[cidx].hdr.pch_val[cpu].pcv_vadd);
 }
 
@@ -831,7 +857,7 @@ perfc_add2(struct perfc_set *pcs, const u32 cidx1, const u64 val1, const u32 cid
     if (!pcsi)
         return;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(val1, &pcsi->pcs_ctrv[cidx1].hdr.pch_val[cpu].pcv_vadd);
 
     if (pcs->ps_bitmap & (1ull << cidx2))
@@ -850,10 +876,31 @@ perfc_sub(struct perfc_set *pcs, const u32 cidx, const u64 val)
     if (!pcsi)
         return;
 
-    cpu = (raw_smp_processor_id() / 2) % PERFC_PCV_MAX;
+    cpu = perfc_cpu(PERFC_PCV_MAX);
     atomic64_add(val, &pcsi->pcs_ctrv[cidx].hdr.pch_val[cpu].pcv_vsub);
 }
 
+/* Read the value of a basic counter, summed over all cpus.
+ */
+static inline u64
+perfc_read(struct perfc_set *pcs, const u32 cidx)
+{
+    struct perfc_seti *pcsi;
+    u64                vadd = 0, vsub = 0;
+    int                i;
+
+    pcsi = perfc_ison(pcs, cidx);
+    if (!pcsi)
+        return 0;
+
+    for (i = 0; i < PERFC_PCV_MAX; ++i) {
+        vadd += atomic64_read(&pcsi->pcs_ctrv[cidx].hdr.pch_val[i].pcv_vadd);
+        vsub += atomic64_read(&pcsi->pcs_ctrv[cidx].hdr.pch_val[i].pcv_vsub);
+    }
+
+    return (vadd > vsub) ? vadd - vsub : 0;
+}
+
 BullseyeCoverageRestore
 
     extern struct perfc_ivl *perfc_di_ivl;
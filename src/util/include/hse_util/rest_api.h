@@ -14,16 +14,20 @@
 #define REST_SOCK_ROOT "/var/run/mpool"
 #define REST_URL_LEN_MAX PATH_MAX
 
+/* URL_FLAG_HEAVY marks handlers that are expensive to run (e.g., full dumps
+ * of large structures), of which the server runs only a few at a time.
+ */
 enum rest_url_flags {
     URL_FLAG_NONE = 0,
     URL_FLAG_BINVAL = 1,
+    URL_FLAG_HEAVY = 2,
 };
 
 struct kv_iter;
 
 /**
  * struct conn_info -
- * @resp_fd: write response to this fd
+ * @resp_fd: write response to this fd (writes never wait for the client)
  * @data:    uploaded data, if any
  * @data_sz: size of data
  * @buf:     ptr to a buffer that will exist for the duration of this session
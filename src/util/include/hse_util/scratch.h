@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_UTIL_SCRATCH_H
+#define HSE_UTIL_SCRATCH_H
+
+#include <hse_util/hse_err.h>
+#include <hse_util/inttypes.h>
+
+/* The scratch arena is a per-thread bump allocator for short-lived
+ * allocations made on behalf of a single operation (e.g., a get or
+ * a prefix probe).  An operation saves the arena's position on entry
+ * and restores it on exit, which releases everything allocated in
+ * between.  Save/restore pairs may nest.
+ *
+ * The arena grows geometrically as needed, and whenever it is fully
+ * released its chunks are coalesced so that in steady state every
+ * operation is served from a single chunk without calling malloc.
+ * The arena is freed when the thread exits.
+ */
+
+/**
+ * struct scratch_mark - a position within the calling thread's arena
+ * @sm_chunk: chunk at the time of the save (opaque)
+ * @sm_off:   offset into %sm_chunk
+ */
+struct scratch_mark {
+    void * sm_chunk;
+    size_t sm_off;
+};
+
+/**
+ * scratch_alloc() - allocate memory from the calling thread's arena
+ * @sz:    number of bytes
+ * @align: alignment (a power of two no greater than PAGE_SIZE)
+ *
+ * The memory remains valid until the thread restores a mark saved
+ * before the allocation.
+ *
+ * Return: ptr to memory, or NULL if out of memory
+ */
+void *
+scratch_alloc(size_t sz, size_t align);
+
+/**
+ * scratch_save() - remember the current position of the arena
+ * @mark: (output) position
+ */
+void
+scratch_save(struct scratch_mark *mark);
+
+/**
+ * scratch_restore() - release all allocations made since a save
+ * @mark: position from scratch_save() by the calling thread
+ */
+void
+scratch_restore(const struct scratch_mark *mark);
+
+/**
+ * scratch_init() - prepare for the release of arenas at thread exit
+ */
+merr_t
+scratch_init(void);
+
+/**
+ * scratch_fini() - free the calling thread's arena
+ */
+void
+scratch_fini(void);
+
+#endif
@@ -54,6 +54,7 @@ static __always_inline u64
 #endif /* GCC_VERSION */
 
 #define VGETCPU_CPU_MASK 0xfff
+#define VGETCPU_NODE_SHIFT 12
 #define GDT_ENTRY_PER_CPU 15
 #define __PER_CPU_SEG (GDT_ENTRY_PER_CPU * 8 + 3)
 
@@ -62,7 +63,7 @@ static __always_inline u64
  * [HSE_REVISIT] Use RDPID if available (see __getcpu()).
  */
 static __always_inline unsigned int
-raw_smp_processor_id(void)
+raw_smp_processor_aux(void)
 {
     uint64_t aux;
 
@@ -75,7 +76,21 @@ raw_smp_processor_id(void)
     asm volatile("rdtscp" : "=a"(rax), "=d"(rdx), "=c"(aux) : :);
 #endif
 
-    return aux & VGETCPU_CPU_MASK;
+    return aux;
+}
+
+static __always_inline unsigned int
+raw_smp_processor_id(void)
+{
+    return raw_smp_processor_aux() & VGETCPU_CPU_MASK;
+}
+
+/* Linux keeps the numa node of each cpu in the bits above the cpu id.
+ */
+static __always_inline unsigned int
+raw_smp_processor_node(void)
+{
+    return raw_smp_processor_aux() >> VGETCPU_NODE_SHIFT;
 }
 
 #define smp_processor_id() raw_smp_processor_id()
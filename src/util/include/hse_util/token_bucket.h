@@ -7,17 +7,22 @@
 #define HSE_PLATFORM_TOKEN_BUCKET_H
 
 #include <hse_util/inttypes.h>
+#include <hse_util/hse_err.h>
 #include <hse_util/spinlock.h>
 
 /* MTF_MOCK_DECL(token_bucket) */
 
+struct tbkt_pcpu;
+
 struct tbkt {
-    spinlock_t tb_lock;
-    u64        tb_refill_time;
-    u64        tb_balance;
-    u64        tb_burst;
-    u64        tb_rate;
-    u64        tb_dt_max;
+    spinlock_t        tb_lock;
+    u64               tb_refill_time;
+    u64               tb_balance;
+    u64               tb_burst;
+    u64               tb_rate;
+    u64               tb_dt_max;
+    u64               tb_batch;
+    struct tbkt_pcpu *tb_pcpu;
 };
 
 /* MTF_MOCK */
@@ -28,10 +33,46 @@ tbkt_init(struct tbkt *tb, u64 burst, u64 rate);
 void
 tbkt_reinit(struct tbkt *tb, u64 burst, u64 rate);
 
+/* tbkt_pcpu_alloc() - serve requests of @tb from per-cpu token batches
+ *
+ * Small requests are then served without the bucket lock, from a batch
+ * of at most @batch tokens (and at most 1/16th of the burst) that a cpu
+ * slot takes from the bucket ahead of time.  The rate is never exceeded,
+ * tokens held by the slots are paid for, but they are only available to
+ * requests on their cpu.  On failure @tb keeps working without batches.
+ * Call tbkt_pcpu_free() before @tb is freed or initialized again.
+ */
+/* MTF_MOCK */
+merr_t
+tbkt_pcpu_alloc(struct tbkt *tb, u64 batch);
+
+/* MTF_MOCK */
+void
+tbkt_pcpu_free(struct tbkt *tb);
+
+/* tbkt_adjust() - change the burst and rate of @tb, keeping its balance
+ *
+ * Unlike tbkt_reinit(), a deficit carries over, so that frequent rate
+ * changes neither forgive nor lose the delays already owed.
+ */
+/* MTF_MOCK */
+void
+tbkt_adjust(struct tbkt *tb, u64 burst, u64 rate);
+
 /* MTF_MOCK */
 u64
 tbkt_request(struct tbkt *tb, u64 tokens);
 
+/* tbkt_request_floor() - request tokens from @tb, guaranteed a minimum rate
+ *
+ * Requests that @tb would delay go through without delay while @floor has
+ * tokens for them.  @floor (may be NULL) guarantees its rate to a subset
+ * of the users of @tb, their tokens are still taken from @tb.
+ */
+/* MTF_MOCK */
+u64
+tbkt_request_floor(struct tbkt *tb, struct tbkt *floor, u64 tokens);
+
 /* MTF_MOCK */
 void
 tbkt_delay(u64 nsec);
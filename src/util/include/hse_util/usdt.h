@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef HSE_PLATFORM_USDT_H
+#define HSE_PLATFORM_USDT_H
+
+/* USDT (user-level statically defined tracing) probes for bpftrace, perf
+ * and systemtap, e.g.:
+ *
+ *   bpftrace -e 'usdt:libhse_kvdb.so:hse:c0sk_get { @ns = hist(arg4); }'
+ *
+ * A probe compiles to a nop plus an ELF note, and is built only when
+ * <sys/sdt.h> was found (HSE_HAVE_SDT).  Each probe has a semaphore, which
+ * the tracer raises while the probe is attached, so that arguments that
+ * cost something to compute (latencies in particular) are computed only
+ * when someone is listening:
+ *
+ *   start = HSE_USDT_START(c0sk_get);
+ *   ...
+ *   if (start)
+ *       HSE_USDT(c0sk_get, skidx, kt->kt_len, view_seq, *res, get_time_ns() - start);
+ *
+ * Latencies are in nanoseconds.  Probes are declared here and their
+ * semaphores are defined in usdt.c.
+ */
+
+#ifdef HSE_HAVE_SDT
+
+#include <hse_util/compiler.h>
+#include <hse_util/timing.h>
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define HSE_USDT_SEMAPHORE(_name) hse_##_name##_semaphore
+
+#define HSE_USDT_ENABLED(_name) unlikely(HSE_USDT_SEMAPHORE(_name))
+
+#define HSE_USDT_START(_name) (HSE_USDT_ENABLED(_name) ? get_time_ns() : 0)
+
+#define HSE_USDT(_name, ...) STAP_PROBEV(hse, _name, ##__VA_ARGS__)
+
+#else
+
+#define HSE_USDT_ENABLED(_name) (false)
+
+#define HSE_USDT_START(_name) (0ul)
+
+#define HSE_USDT(_name, ...) \
+    do {                     \
+    } while (0)
+
+#endif /* HSE_HAVE_SDT */
+
+#define HSE_USDT_DECLARE(_name) extern unsigned short HSE_USDT_SEMAPHORE(_name)
+
+/* hse:c0sk_put(skidx, klen, vlen, seqnoref, lat)
+ * hse:c0sk_get(skidx, klen, view_seq, res, lat)
+ * hse:cn_tree_lookup(cnid, klen, seq, res, kvsets, lat)
+ * hse:kvset_lookup(dgen, klen, seq, res, lat)
+ * hse:c0sk_ingest_start(gen, queue_lat)
+ * hse:c0sk_ingest_end(gen, err, c0_vlen, c1_vlen, lat)
+ * hse:cn_comp_start(cnid, action, rule, level, offset, kvsets)
+ * hse:cn_comp_end(cnid, action, level, offset, err, lat)
+ * hse:c1_sync(err, lat)
+ * hse:throttle_sleep(delay, lat)
+ *
+ * res is an enum key_lookup_res, action an enum cn_action, rule an enum
+ * cn_comp_rule and err an errno.
+ */
+#ifdef HSE_HAVE_SDT
+HSE_USDT_DECLARE(c0sk_put);
+HSE_USDT_DECLARE(c0sk_get);
+HSE_USDT_DECLARE(cn_tree_lookup);
+HSE_USDT_DECLARE(kvset_lookup);
+HSE_USDT_DECLARE(c0sk_ingest_start);
+HSE_USDT_DECLARE(c0sk_ingest_end);
+HSE_USDT_DECLARE(cn_comp_start);
+HSE_USDT_DECLARE(cn_comp_end);
+HSE_USDT_DECLARE(c1_sync);
+HSE_USDT_DECLARE(throttle_sleep);
+#endif
+
+#endif
@@ -77,6 +77,17 @@ alloc_workqueue(
 void
 destroy_workqueue(struct workqueue_struct *wq);
 
+/**
+ * workqueue_set_cpus() - bind the worker threads of a workqueue to cpus
+ * @wq:   workqueue
+ * @cpus: mask of the first 64 cpus (0: leave the threads unbound)
+ *
+ * Meant to be called right after alloc_workqueue(), failures are logged
+ * and otherwise ignored.
+ */
+void
+workqueue_set_cpus(struct workqueue_struct *wq, u64 cpus);
+
 /**
  * flush_workqueue()
  * @wq: workqueue
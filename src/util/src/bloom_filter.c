@@ -149,6 +149,7 @@ bf_filter_init(
     filter->bf_bktshift = BF_BKTSHIFT;
     filter->bf_bktmask = (1u << BF_BKTSHIFT) - 1;
     filter->bf_rotl = BF_ROTL;
+    filter->bf_split = 0;
     filter->bf_bitmap = storage;
     filter->bf_bitmapsz = storage_sz;
     filter->bf_modulus = bf_size2bits(storage_sz);
@@ -161,10 +162,33 @@ bf_filter_init(
     assert(filter->bf_modulus > (storage_sz - PAGE_SIZE) << BYTE_SHIFT);
 }
 
+void
+bf_filter_init_split(
+    struct bloom_filter *  filter,
+    struct bf_bithash_desc desc,
+    u32                    exp_elmts,
+    u8 *                   storage,
+    size_t                 storage_sz)
+{
+    bf_filter_init(filter, desc, exp_elmts, storage, storage_sz);
+
+    /* Every element sets one bit per lane, so the number of hashes
+     * is fixed by the bucket geometry rather than by %desc.
+     */
+    filter->bf_n_hashes = BF_SPLIT_LANES;
+    filter->bf_bktshift = BF_SPLIT_BKTSHIFT;
+    filter->bf_bktmask = (1u << BF_SPLIT_BKTSHIFT) - 1;
+    filter->bf_rotl = 0;
+    filter->bf_split = 1;
+}
+
 void
 bf_filter_insert_by_hash(struct bloom_filter *bf, u64 hash)
 {
-    bf_populate(bf, hash);
+    if (bf->bf_split)
+        bf_split_populate(bf, hash);
+    else
+        bf_populate(bf, hash);
 }
 
 void
@@ -172,6 +196,12 @@ bf_filter_insert_by_hashv(struct bloom_filter *bf, u64 *keyv, u32 keyc)
 {
     int i;
 
+    if (bf->bf_split) {
+        for (i = 0; i < keyc; ++i)
+            bf_split_populate(bf, keyv[i]);
+        return;
+    }
+
     for (i = 0; i < keyc; ++i)
         bf_populate(bf, keyv[i]);
 }
@@ -4,27 +4,28 @@
  */
 
 #include <hse_util/event_counter.h>
+#include <hse_util/log2.h>
 
 #include "bonsai_tree_pvt.h"
 
 #define BN_INSERT_FLAG_RIGHT 1
 #define BN_INSERT_FLAG_TOMB 2
 
-static inline struct bonsai_node *
-bn_update(
+struct bonsai_kv *
+bn_kv_update(
     struct bonsai_root *      tree,
-    struct bonsai_node *      node,
+    struct bonsai_kv *        kv,
     const struct bonsai_sval *sval,
-    u32                       flags)
+    bool                      tomb)
 {
     struct bonsai_val *  v;
     struct bonsai_val *  oldv;
     enum bonsai_ior_code code;
 
     /* Invalidate the tombspan, if any. */
-    if (unlikely(!(flags & BN_INSERT_FLAG_TOMB) && node->bn_kv->bkv_tomb)) {
-        node->bn_kv->bkv_tomb->bkv_tomb = NULL;
-        node->bn_kv->bkv_tomb = NULL;
+    if (unlikely(!tomb && kv->bkv_tomb)) {
+        kv->bkv_tomb->bkv_tomb = NULL;
+        kv->bkv_tomb = NULL;
     }
 
     v = bn_val_alloc(tree, sval);
@@ -34,14 +35,67 @@ bn_update(
     SET_IOR_REPORADD(code);
     oldv = NULL;
 
-    tree->br_client.bc_iorcb(tree->br_client.bc_rock, &code, node->bn_kv, v, &oldv);
+    tree->br_client.bc_iorcb(tree->br_client.bc_rock, &code, kv, v, &oldv);
 
     if (IS_IOR_REP(code)) {
         if (oldv)
             bn_val_free(tree, oldv);
     }
 
-    return node;
+    return kv;
+}
+
+void
+bn_kv_link(struct bonsai_root *tree, struct bonsai_kv *kv, struct bonsai_kv *prev, bool tomb)
+{
+    enum bonsai_ior_code code;
+    struct bonsai_kv *   head, *prev_span, *next_span;
+
+    kv->bkv_next = prev->bkv_next;
+    kv->bkv_prev = prev;
+
+    /* [HSE_REVISIT]: Need to add a comment here */
+    smp_mb();
+    kv->bkv_next->bkv_prev = kv;
+    kv->bkv_prev->bkv_next = kv;
+
+    /* Get the tail end of the tombspans for prev and next nodes. */
+    prev_span = kv->bkv_prev->bkv_tomb;
+    next_span = kv->bkv_next->bkv_tomb;
+
+    if (unlikely(prev_span && (prev_span->bkv_flags & BKV_FLAG_TOMB_HEAD)))
+        prev_span = prev_span->bkv_tomb;
+
+    if (unlikely(next_span && (next_span->bkv_flags & BKV_FLAG_TOMB_HEAD)))
+        next_span = next_span->bkv_tomb;
+
+    if (tomb) {
+        if (unlikely(prev_span)) {
+            head = prev_span->bkv_tomb;
+            assert(head->bkv_flags & BKV_FLAG_TOMB_HEAD);
+            assert(head->bkv_tomb);
+
+            /* Extend the tombspan to the right */
+            if (prev_span != next_span)
+                head->bkv_tomb = kv;
+
+            kv->bkv_tomb = head;
+        } else {
+            /* Start a new tomb span */
+            head = kv;
+            head->bkv_flags |= BKV_FLAG_TOMB_HEAD;
+            head->bkv_tomb = kv;
+        }
+    } else if (unlikely(prev_span && (prev_span == next_span))) {
+        /* This put invalidates a tomb span */
+        head = prev_span->bkv_tomb;
+        assert(head->bkv_flags & BKV_FLAG_TOMB_HEAD);
+        assert(head->bkv_tomb);
+        head->bkv_tomb = NULL;
+    }
+
+    SET_IOR_INS(code);
+    tree->br_client.bc_iorcb(tree->br_client.bc_rock, &code, kv, NULL, NULL);
 }
 
 static struct bonsai_node *
@@ -52,84 +106,52 @@ bn_insert_impl(
     const void *                key,
     const struct bonsai_sval *  sval,
     struct bonsai_kv *          parent,
-    u32                         flags)
+    u32                         flags,
+    uint                        lo,
+    uint                        hi)
 {
     struct bonsai_node *ins;
+    uint                lcp = 0;
     s32                 res;
 
     if (!node) {
-        enum bonsai_ior_code code;
-        struct bonsai_kv *   head, *prev_span, *next_span;
+        struct bonsai_kv *prev;
 
         node = bn_node_alloc(tree, key_imm, key, sval);
         if (ev(!node))
             return NULL;
 
-        if (flags & BN_INSERT_FLAG_RIGHT) {
-            node->bn_kv->bkv_next = parent->bkv_next;
-            node->bn_kv->bkv_prev = parent;
-        } else {
-            node->bn_kv->bkv_next = parent;
-            node->bn_kv->bkv_prev = parent->bkv_prev;
-        }
-
-        /* [HSE_REVISIT]: Need to add a comment here */
-        smp_mb();
-        node->bn_kv->bkv_next->bkv_prev = node->bn_kv;
-        node->bn_kv->bkv_prev->bkv_next = node->bn_kv;
-
-        /* Get the tail end of the tombspans for prev and next nodes. */
-        prev_span = node->bn_kv->bkv_prev->bkv_tomb;
-        next_span = node->bn_kv->bkv_next->bkv_tomb;
-
-        if (unlikely(prev_span && (prev_span->bkv_flags & BKV_FLAG_TOMB_HEAD)))
-            prev_span = prev_span->bkv_tomb;
-
-        if (unlikely(next_span && (next_span->bkv_flags & BKV_FLAG_TOMB_HEAD)))
-            next_span = next_span->bkv_tomb;
-
-        if (flags & BN_INSERT_FLAG_TOMB) {
-            if (unlikely(prev_span)) {
-                head = prev_span->bkv_tomb;
-                assert(head->bkv_flags & BKV_FLAG_TOMB_HEAD);
-                assert(head->bkv_tomb);
-
-                /* Extend the tombspan to the right */
-                if (prev_span != next_span)
-                    head->bkv_tomb = node->bn_kv;
-
-                node->bn_kv->bkv_tomb = head;
-            } else {
-                /* Start a new tomb span */
-                head = node->bn_kv;
-                head->bkv_flags |= BKV_FLAG_TOMB_HEAD;
-                head->bkv_tomb = node->bn_kv;
-            }
-        } else if (unlikely(prev_span && (prev_span == next_span))) {
-            /* This put invalidates a tomb span */
-            head = prev_span->bkv_tomb;
-            assert(head->bkv_flags & BKV_FLAG_TOMB_HEAD);
-            assert(head->bkv_tomb);
-            head->bkv_tomb = NULL;
-        }
+        prev = (flags & BN_INSERT_FLAG_RIGHT) ? parent : parent->bkv_prev;
 
-        SET_IOR_INS(code);
-        tree->br_client.bc_iorcb(tree->br_client.bc_rock, &code, node->bn_kv, NULL, NULL);
+        bn_kv_link(tree, node->bn_kv, prev, flags & BN_INSERT_FLAG_TOMB);
 
         return node;
     }
 
+    /* Every key in the subtree lies between the nodes bounding it, and
+     * so shares at least min(lo, hi) leading bytes with the search key.
+     */
     res = key_immediate_cmp(key_imm, &node->bn_key_imm);
     if (res == S32_MIN)
-        res = inner_key_cmp(
-            key + key_imm->ki_dlen,
-            key_imm->ki_klen - key_imm->ki_dlen,
-            node->bn_kv->bkv_key + node->bn_key_imm.ki_dlen,
-            node->bn_key_imm.ki_klen - node->bn_key_imm.ki_dlen);
+        res = bn_keycmp_lcp(
+            key,
+            key_imm->ki_klen,
+            node->bn_kv->bkv_key,
+            node->bn_key_imm.ki_klen,
+            max_t(uint, KI_DLEN_MAX, min_t(uint, lo, hi)),
+            &lcp);
 
     if (res < 0) {
         ins = bn_insert_impl(
-            tree, node->bn_left, key_imm, key, sval, node->bn_kv, flags & ~BN_INSERT_FLAG_RIGHT);
+            tree,
+            node->bn_left,
+            key_imm,
+            key,
+            sval,
+            node->bn_kv,
+            flags & ~BN_INSERT_FLAG_RIGHT,
+            lo,
+            lcp);
         if (ev(!ins))
             return NULL;
 
@@ -138,7 +160,15 @@ bn_insert_impl(
 
     if (res > 0) {
         ins = bn_insert_impl(
-            tree, node->bn_right, key_imm, key, sval, node->bn_kv, flags | BN_INSERT_FLAG_RIGHT);
+            tree,
+            node->bn_right,
+            key_imm,
+            key,
+            sval,
+            node->bn_kv,
+            flags | BN_INSERT_FLAG_RIGHT,
+            lcp,
+            hi);
         if (ev(!ins))
             return NULL;
 
@@ -147,7 +177,7 @@ bn_insert_impl(
 
     assert(res == 0);
 
-    return bn_update(tree, node, sval, flags);
+    return bn_kv_update(tree, node->bn_kv, sval, flags & BN_INSERT_FLAG_TOMB) ? node : NULL;
 }
 
 static inline struct bonsai_kv *
@@ -198,7 +228,7 @@ bn_find_impl(struct bonsai_root *tree, const struct bonsai_skey *skey, enum bons
     const void *                key;
 
     uint klen;
-    uint lcp;
+    uint lcp, lo, hi, nlcp;
     s32  res;
 
     ki = &skey->bsk_key_imm;
@@ -244,13 +274,19 @@ bn_find_impl(struct bonsai_root *tree, const struct bonsai_skey *skey, enum bons
     }
 
 search:
-    key += lcp;
-    klen -= lcp;
-
     node = BONSAI_RCU_DEREF_POINTER(tree->br_root);
     mnode = NULL;
 
+    /* lo and hi track the lcp of the search key with the nearest nodes
+     * to its left and right on the path so far.  All the keys below the
+     * current node lie between those two, and so share at least the
+     * lesser of the two lcps with the search key.
+     */
+    lo = hi = 0;
+
     while (node) {
+        nlcp = 0;
+
         res = key_immediate_cmp(ki, &node->bn_key_imm);
         if (unlikely(res == S32_MIN)) {
             assert(node->bn_key_imm.ki_klen >= lcp);
@@ -258,8 +294,13 @@ search:
             /* At this point we are assured that both keys'
              * ki_dlen are greater than KI_DLEN_MAX.
              */
-            res = inner_key_cmp(
-                key, klen, node->bn_kv->bkv_key + lcp, node->bn_key_imm.ki_klen - lcp);
+            res = bn_keycmp_lcp(
+                key,
+                klen,
+                node->bn_kv->bkv_key,
+                node->bn_key_imm.ki_klen,
+                max_t(uint, lcp, min_t(uint, lo, hi)),
+                &nlcp);
         }
 
         if (unlikely(res == 0))
@@ -269,16 +310,27 @@ search:
             if (unlikely(mtype == B_MATCH_GE))
                 mnode = node;
             node = node->bn_left;
+            hi = nlcp;
         } else {
             if (unlikely(mtype == B_MATCH_LE))
                 mnode = node;
             node = node->bn_right;
+            lo = nlcp;
         }
     }
 
     return mnode ? mnode->bn_kv : NULL;
 }
 
+static inline struct bonsai_kv *
+bn_find_kv(struct bonsai_root *tree, const struct bonsai_skey *skey, enum bonsai_match_type mtype)
+{
+    if (tree->br_index == BN_INDEX_ART)
+        return bn_art_find(tree, skey, mtype);
+
+    return bn_find_impl(tree, skey, mtype);
+}
+
 static void
 _bn_teardown(struct bonsai_root *tree, struct bonsai_node *node)
 {
@@ -345,11 +397,14 @@ bn_insert_or_replace(
     struct bonsai_node *newroot;
     u32                 flags;
 
+    if (tree->br_index == BN_INDEX_ART)
+        return bn_art_insert(tree, skey, sval, is_tomb);
+
     oldroot = tree->br_root;
     flags = is_tomb ? BN_INSERT_FLAG_TOMB : 0;
 
-    newroot =
-        bn_insert_impl(tree, oldroot, &skey->bsk_key_imm, skey->bsk_key, sval, &tree->br_kv, flags);
+    newroot = bn_insert_impl(
+        tree, oldroot, &skey->bsk_key_imm, skey->bsk_key, sval, &tree->br_kv, flags, 0, 0);
     if (ev(!newroot))
         return merr(ENOMEM);
 
@@ -365,7 +420,7 @@ bn_find(struct bonsai_root *tree, const struct bonsai_skey *skey, struct bonsai_
 
     assert(kv);
 
-    lkv = bn_find_impl(tree, skey, B_MATCH_EQ);
+    lkv = bn_find_kv(tree, skey, B_MATCH_EQ);
     if (lkv) {
         *kv = lkv;
         return true;
@@ -381,7 +436,7 @@ bn_findGE(struct bonsai_root *tree, const struct bonsai_skey *skey, struct bonsa
 
     assert(kv);
 
-    lkv = bn_find_impl(tree, skey, B_MATCH_GE);
+    lkv = bn_find_kv(tree, skey, B_MATCH_GE);
     if (lkv) {
         *kv = lkv;
         return true;
@@ -397,7 +452,7 @@ bn_findLE(struct bonsai_root *tree, const struct bonsai_skey *skey, struct bonsa
 
     assert(kv);
 
-    lkv = bn_find_impl(tree, skey, B_MATCH_LE);
+    lkv = bn_find_kv(tree, skey, B_MATCH_LE);
     if (lkv) {
         *kv = lkv;
         return true;
@@ -413,7 +468,10 @@ bn_find_pfx_GT(struct bonsai_root *tree, const struct bonsai_skey *skey, struct
 
     assert(kv);
 
-    lkv = bn_find_next_pfx(tree, skey);
+    if (tree->br_index == BN_INDEX_ART)
+        lkv = bn_art_find_pfx_gt(tree, skey);
+    else
+        lkv = bn_find_next_pfx(tree, skey);
     if (lkv) {
         *kv = lkv;
         return true;
@@ -430,7 +488,7 @@ bn_skiptombs_GE(struct bonsai_root *tree, const struct bonsai_skey *skey, struct
 
     assert(kv);
 
-    lkv = bn_find_impl(tree, skey, B_MATCH_GE);
+    lkv = bn_find_kv(tree, skey, B_MATCH_GE);
     if (!lkv)
         return false;
 
@@ -479,6 +537,9 @@ bn_destroy(struct bonsai_root *tree)
     _bn_teardown(tree, root);
     rcu_barrier();
 
+    if (tree->br_index == BN_INDEX_ART)
+        bn_art_teardown(tree);
+
     if (tree->br_client.bc_fn_active != (void *)-1) {
         bn_node_free(tree, NULL);
         rcu_barrier();
@@ -510,6 +571,77 @@ bn_traverse(struct bonsai_root *tree)
     _bn_traverse(root);
 }
 
+static void
+bn_sample_impl(struct bonsai_node *node, int depth, struct bonsai_kv **kvv, uint *kvcp)
+{
+    if (!node || depth < 0)
+        return;
+
+    bn_sample_impl(BONSAI_RCU_DEREF_POINTER(node->bn_left), depth - 1, kvv, kvcp);
+    kvv[(*kvcp)++] = node->bn_kv;
+    bn_sample_impl(BONSAI_RCU_DEREF_POINTER(node->bn_right), depth - 1, kvv, kvcp);
+}
+
+uint
+bn_sample(struct bonsai_root *tree, struct bonsai_kv **kvv, uint kvc)
+{
+    struct bonsai_kv *tmpv[BN_SAMPLE_MAX * 8];
+    struct bonsai_kv *kv;
+    uint              n, i, j;
+
+    kvc = min_t(uint, kvc, BN_SAMPLE_MAX);
+    if (!kvc)
+        return 0;
+
+    n = 0;
+
+    if (tree->br_index == BN_INDEX_ART) {
+        /* The art index has no notion of balance, so count the keys
+         * and then pick every (n / (kvc + 1))'th key from the list.
+         */
+        for (kv = rcu_dereference(tree->br_kv.bkv_next); kv != &tree->br_kv;
+             kv = rcu_dereference(kv->bkv_next))
+            ++n;
+
+        if (n <= kvc)
+            kvc = n;
+
+        kv = rcu_dereference(tree->br_kv.bkv_next);
+
+        for (i = j = 0; j < kvc; kv = rcu_dereference(kv->bkv_next), ++i) {
+            if (i == (u64)(j + 1) * n / (kvc + 1))
+                kvv[j++] = kv;
+        }
+
+        return kvc;
+    }
+
+    /* The in-order nodes of the top levels of a balanced tree divide
+     * it into roughly equal ranges.  Collect up to 8 * kvc of them and
+     * pick evenly spaced samples from those.
+     */
+    bn_sample_impl(BONSAI_RCU_DEREF_POINTER(tree->br_root), ilog2(kvc) + 2, tmpv, &n);
+
+    if (n <= kvc) {
+        memcpy(kvv, tmpv, n * sizeof(*kvv));
+        return n;
+    }
+
+    for (j = 0; j < kvc; ++j)
+        kvv[j] = tmpv[(j + 1) * n / (kvc + 1)];
+
+    return kvc;
+}
+
+void
+bn_set_index(struct bonsai_root *tree, enum bonsai_index index)
+{
+    assert(tree->br_kv.bkv_next == &tree->br_kv);
+    assert(!tree->br_root && !tree->br_art);
+
+    tree->br_index = index;
+}
+
 void
 bn_reset(struct bonsai_root *tree)
 {
@@ -518,6 +650,8 @@ bn_reset(struct bonsai_root *tree)
     client = &tree->br_client;
 
     BONSAI_RCU_ASSIGN_POINTER(tree->br_root, NULL);
+    BONSAI_RCU_ASSIGN_POINTER(tree->br_art, NULL);
+    tree->br_art_free = NULL;
 
     tree->br_kv.bkv_prev = &tree->br_kv;
     tree->br_kv.bkv_next = &tree->br_kv;
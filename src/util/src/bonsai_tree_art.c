@@ -0,0 +1,867 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+/*
+ * Adaptive radix tree (ART) index for bonsai trees.
+ *
+ * The ART indexes the same bonsai_kv objects as the binary bonsai tree,
+ * keyed by the two byte skidx (big-endian) followed by the key bytes, so
+ * that byte-wise radix order matches bn_kv_cmp() order.  The ordered k/v
+ * list (br_kv) is maintained exactly as for the binary tree, so iterators
+ * are oblivious to the index in use.
+ *
+ * Concurrency follows the bonsai tree rules: a single updater (serialized
+ * by the caller) and any number of rcu readers.  Updates never modify a
+ * node in a way a reader could observe half-done:
+ *
+ *   - N4/N16 children are appended (key and child are written before the
+ *     child count is bumped), so the keys of those nodes are unsorted;
+ *   - N48 children are written before their index byte, N256 children
+ *     are single pointer stores;
+ *   - growing a node, splitting a compressed path, or expanding a leaf
+ *     builds new nodes which are then published with a single pointer
+ *     store into the parent.
+ *
+ * Nodes replaced by publication are retired rather than freed.  With the
+ * cheap allocator they are reclaimed with the cheap, otherwise they are
+ * freed by bn_art_teardown().
+ *
+ * Child slots hold either a node pointer or a tagged bonsai_kv pointer
+ * (leaf).  A key that ends exactly at a node (i.e., is a proper prefix of
+ * the other keys under that node) is held in the node's an_end slot.
+ */
+
+#include <hse_util/event_counter.h>
+
+#include "bonsai_tree_pvt.h"
+
+#define ART_PFX_MAX (10)
+#define ART_LEAF (1ul)
+
+enum art_type {
+    ART_N4 = 1,
+    ART_N16 = 2,
+    ART_N48 = 3,
+    ART_N256 = 4,
+};
+
+/**
+ * struct art_node - common node header
+ * @an_end:    kv whose key ends at this node (if any)
+ * @an_free:   retired node list linkage
+ * @an_plen:   length of the compressed path (prefix)
+ * @an_type:   node type (enum art_type)
+ * @an_nchild: number of children
+ * @an_pfx:    first ART_PFX_MAX bytes of the compressed path
+ *
+ * Prefix bytes beyond ART_PFX_MAX are read from any kv under the node.
+ */
+struct art_node {
+    struct bonsai_kv *an_end;
+    struct art_node * an_free;
+    u32               an_plen;
+    u8                an_type;
+    u8                an_nchild;
+    u8                an_pfx[ART_PFX_MAX];
+};
+
+struct art_node4 {
+    struct art_node hdr;
+    u8              keys[4];
+    void *          child[4];
+};
+
+struct art_node16 {
+    struct art_node hdr;
+    u8              keys[16];
+    void *          child[16];
+};
+
+struct art_node48 {
+    struct art_node hdr;
+    u8              index[256];
+    void *          child[48];
+};
+
+struct art_node256 {
+    struct art_node hdr;
+    void *          child[256];
+};
+
+/**
+ * struct art_key - radix view of a key
+ * @ak_key:   key bytes
+ * @ak_klen:  key length
+ * @ak_skidx: kvs index
+ * @ak_len:   radix key length (ak_klen + 2)
+ */
+struct art_key {
+    const u8 *ak_key;
+    u32       ak_klen;
+    u32       ak_skidx;
+    u32       ak_len;
+};
+
+static inline bool
+art_is_leaf(const void *p)
+{
+    return (uintptr_t)p & ART_LEAF;
+}
+
+static inline struct bonsai_kv *
+art_leaf(const void *p)
+{
+    return (void *)((uintptr_t)p & ~ART_LEAF);
+}
+
+static inline void *
+art_mkleaf(struct bonsai_kv *kv)
+{
+    return (void *)((uintptr_t)kv | ART_LEAF);
+}
+
+static inline void
+art_key_init(struct art_key *ak, const void *key, u32 klen, u32 skidx)
+{
+    ak->ak_key = key;
+    ak->ak_klen = klen;
+    ak->ak_skidx = skidx;
+    ak->ak_len = klen + 2;
+}
+
+static inline void
+art_key_init_kv(struct art_key *ak, const struct bonsai_kv *kv)
+{
+    art_key_init(ak, kv->bkv_key, kv->bkv_key_imm.ki_klen, key_immediate_index(&kv->bkv_key_imm));
+}
+
+static inline u8
+art_kbyte(const struct art_key *ak, u32 i)
+{
+    if (likely(i > 1))
+        return ak->ak_key[i - 2];
+
+    return i ? ak->ak_skidx & 0xff : ak->ak_skidx >> 8;
+}
+
+/* Compare a search key to the key of a kv in bn_kv_cmp() order.  If @pfx
+ * is true, the kv's key is first truncated to the length of the search
+ * key (i.e., the search key is treated as a prefix).
+ */
+static inline int
+art_key_cmp(const struct art_key *ak, const struct bonsai_kv *kv, bool pfx)
+{
+    u32 skidx = key_immediate_index(&kv->bkv_key_imm);
+    u32 klen = kv->bkv_key_imm.ki_klen;
+
+    if (ak->ak_skidx != skidx)
+        return ak->ak_skidx < skidx ? -1 : 1;
+
+    if (pfx && klen > ak->ak_klen)
+        klen = ak->ak_klen;
+
+    return inner_key_cmp(ak->ak_key, ak->ak_klen, kv->bkv_key, klen);
+}
+
+static inline void *
+art_child(const struct art_node *n, u8 b)
+{
+    const struct art_node4 *  n4;
+    const struct art_node16 * n16;
+    const struct art_node48 * n48;
+    const struct art_node256 *n256;
+    uint                      i, cnt;
+
+    switch (n->an_type) {
+    case ART_N4:
+        n4 = (const void *)n;
+        cnt = READ_ONCE(n->an_nchild);
+        for (i = 0; i < cnt; ++i)
+            if (n4->keys[i] == b)
+                return BONSAI_RCU_DEREF_POINTER(n4->child[i]);
+        break;
+
+    case ART_N16:
+        n16 = (const void *)n;
+        cnt = READ_ONCE(n->an_nchild);
+        for (i = 0; i < cnt; ++i)
+            if (n16->keys[i] == b)
+                return BONSAI_RCU_DEREF_POINTER(n16->child[i]);
+        break;
+
+    case ART_N48:
+        n48 = (const void *)n;
+        i = READ_ONCE(n48->index[b]);
+        if (i)
+            return BONSAI_RCU_DEREF_POINTER(n48->child[i - 1]);
+        break;
+
+    case ART_N256:
+        n256 = (const void *)n;
+        return BONSAI_RCU_DEREF_POINTER(n256->child[b]);
+    }
+
+    return NULL;
+}
+
+/* Return the address of the child slot for byte @b, or NULL.  Updater only.
+ */
+static void **
+art_child_slot(struct art_node *n, u8 b)
+{
+    struct art_node4 *  n4;
+    struct art_node16 * n16;
+    struct art_node48 * n48;
+    struct art_node256 *n256;
+    uint                i;
+
+    switch (n->an_type) {
+    case ART_N4:
+        n4 = (void *)n;
+        for (i = 0; i < n->an_nchild; ++i)
+            if (n4->keys[i] == b)
+                return &n4->child[i];
+        break;
+
+    case ART_N16:
+        n16 = (void *)n;
+        for (i = 0; i < n->an_nchild; ++i)
+            if (n16->keys[i] == b)
+                return &n16->child[i];
+        break;
+
+    case ART_N48:
+        n48 = (void *)n;
+        if (n48->index[b])
+            return &n48->child[n48->index[b] - 1];
+        break;
+
+    case ART_N256:
+        n256 = (void *)n;
+        if (n256->child[b])
+            return &n256->child[b];
+        break;
+    }
+
+    return NULL;
+}
+
+/* Return the child with the greatest key byte less than @lim (lim <= 256).
+ */
+static void *
+art_child_lt(const struct art_node *n, uint lim)
+{
+    const struct art_node4 *  n4;
+    const struct art_node16 * n16;
+    const struct art_node48 * n48;
+    const struct art_node256 *n256;
+    const u8 *                keys;
+    void *const *             childv;
+    uint                      i, cnt, best;
+
+    switch (n->an_type) {
+    case ART_N4:
+    case ART_N16:
+        if (n->an_type == ART_N4) {
+            n4 = (const void *)n;
+            keys = n4->keys;
+            childv = n4->child;
+        } else {
+            n16 = (const void *)n;
+            keys = n16->keys;
+            childv = n16->child;
+        }
+
+        cnt = READ_ONCE(n->an_nchild);
+        best = cnt;
+        for (i = 0; i < cnt; ++i)
+            if (keys[i] < lim && (best == cnt || keys[i] > keys[best]))
+                best = i;
+
+        return (best < cnt) ? BONSAI_RCU_DEREF_POINTER(childv[best]) : NULL;
+
+    case ART_N48:
+        n48 = (const void *)n;
+        while (lim-- > 0) {
+            i = READ_ONCE(n48->index[lim]);
+            if (i)
+                return BONSAI_RCU_DEREF_POINTER(n48->child[i - 1]);
+        }
+        break;
+
+    case ART_N256:
+        n256 = (const void *)n;
+        while (lim-- > 0) {
+            void *child = BONSAI_RCU_DEREF_POINTER(n256->child[lim]);
+
+            if (child)
+                return child;
+        }
+        break;
+    }
+
+    return NULL;
+}
+
+/* Return the greatest kv under @p.
+ */
+static struct bonsai_kv *
+art_max(const void *p)
+{
+    while (!art_is_leaf(p)) {
+        const struct art_node *n = p;
+
+        p = art_child_lt(n, 256);
+        if (!p)
+            return BONSAI_RCU_DEREF_POINTER(n->an_end);
+    }
+
+    return art_leaf(p);
+}
+
+/* Return any kv under @n (used to recover prefix bytes beyond ART_PFX_MAX).
+ */
+static const struct bonsai_kv *
+art_any(const struct art_node *n)
+{
+    const struct bonsai_kv *kv = BONSAI_RCU_DEREF_POINTER(n->an_end);
+
+    return kv ?: art_max(n);
+}
+
+/* Return byte @i of the compressed path of @n, which begins at @depth.
+ */
+static u8
+art_pfx_byte(const struct art_node *n, u32 depth, u32 i)
+{
+    struct art_key lk;
+
+    if (i < ART_PFX_MAX)
+        return n->an_pfx[i];
+
+    art_key_init_kv(&lk, art_any(n));
+
+    return art_kbyte(&lk, depth + i);
+}
+
+/* Return the number of bytes of the compressed path of @n that match @ak
+ * at @depth.
+ */
+static u32
+art_pfx_match(const struct art_node *n, const struct art_key *ak, u32 depth)
+{
+    struct art_key lk;
+    u32            max, i;
+
+    max = min_t(u32, n->an_plen, ak->ak_len - depth);
+
+    for (i = 0; i < min_t(u32, max, ART_PFX_MAX); ++i)
+        if (n->an_pfx[i] != art_kbyte(ak, depth + i))
+            return i;
+
+    if (i < max) {
+        art_key_init_kv(&lk, art_any(n));
+
+        for (; i < max; ++i)
+            if (art_kbyte(&lk, depth + i) != art_kbyte(ak, depth + i))
+                break;
+    }
+
+    return i;
+}
+
+/* Return the greatest kv under @p whose key is <= @ak (or, if @pfx, whose
+ * key truncated to the length of @ak is <= @ak).
+ */
+static struct bonsai_kv *
+art_find_le(const void *p, const struct art_key *ak, u32 depth, bool pfx)
+{
+    const struct art_node *n;
+    struct bonsai_kv *     kv;
+    const void *           child;
+    u32                    m;
+    u8                     b;
+
+    if (!p)
+        return NULL;
+
+    if (art_is_leaf(p)) {
+        kv = art_leaf(p);
+
+        return art_key_cmp(ak, kv, pfx) >= 0 ? kv : NULL;
+    }
+
+    n = p;
+    m = art_pfx_match(n, ak, depth);
+
+    if (m < n->an_plen) {
+        /* Either the search key ends within the compressed path, in
+         * which case it is a prefix of all keys under n, or it differs
+         * from the path at byte m.
+         */
+        if (depth + m == ak->ak_len)
+            return pfx ? art_max(n) : NULL;
+
+        return art_kbyte(ak, depth + m) > art_pfx_byte(n, depth, m) ? art_max(n) : NULL;
+    }
+
+    depth += n->an_plen;
+
+    if (depth == ak->ak_len)
+        return pfx ? art_max(n) : BONSAI_RCU_DEREF_POINTER(n->an_end);
+
+    b = art_kbyte(ak, depth);
+
+    child = art_child(n, b);
+    if (child) {
+        kv = art_find_le(child, ak, depth + 1, pfx);
+        if (kv)
+            return kv;
+    }
+
+    child = art_child_lt(n, b);
+    if (child)
+        return art_max(child);
+
+    return BONSAI_RCU_DEREF_POINTER(n->an_end);
+}
+
+static struct bonsai_kv *
+art_find_eq(const void *p, const struct art_key *ak)
+{
+    struct bonsai_kv *kv;
+    u32               depth = 0;
+
+    /* Optimistic descent: compressed paths are skipped without comparison
+     * and the full key is compared only once at the end.
+     */
+    while (p) {
+        const struct art_node *n;
+
+        if (art_is_leaf(p)) {
+            kv = art_leaf(p);
+
+            return art_key_cmp(ak, kv, false) ? NULL : kv;
+        }
+
+        n = p;
+        depth += n->an_plen;
+
+        if (depth >= ak->ak_len) {
+            if (depth > ak->ak_len)
+                return NULL;
+
+            kv = BONSAI_RCU_DEREF_POINTER(n->an_end);
+
+            return (kv && !art_key_cmp(ak, kv, false)) ? kv : NULL;
+        }
+
+        p = art_child(n, art_kbyte(ak, depth++));
+    }
+
+    return NULL;
+}
+
+static void *
+art_node_alloc(struct bonsai_root *tree, enum art_type type)
+{
+    static const size_t sizev[] = {
+        [ART_N4] = sizeof(struct art_node4),
+        [ART_N16] = sizeof(struct art_node16),
+        [ART_N48] = sizeof(struct art_node48),
+        [ART_N256] = sizeof(struct art_node256),
+    };
+    struct art_node *n;
+
+    n = bn_alloc_impl(tree->br_client.bc_allocator, sizev[type]);
+    if (ev(!n))
+        return NULL;
+
+    memset(n, 0, sizev[type]);
+    n->an_type = type;
+
+    return n;
+}
+
+static void
+art_node_retire(struct bonsai_root *tree, struct art_node *n)
+{
+    n->an_free = tree->br_art_free;
+    tree->br_art_free = n;
+}
+
+/* Set the compressed path of @n to the @len bytes of @src starting at @depth.
+ */
+static void
+art_pfx_set(struct art_node *n, const struct art_key *src, u32 depth, u32 len)
+{
+    u32 i;
+
+    n->an_plen = len;
+
+    for (i = 0; i < min_t(u32, len, ART_PFX_MAX); ++i)
+        n->an_pfx[i] = art_kbyte(src, depth + i);
+}
+
+/* Add a child to a node that has room for it.  The child is made visible
+ * to readers only once fully written.
+ */
+static void
+art_add_child(struct art_node *n, u8 b, void *child)
+{
+    struct art_node4 *  n4;
+    struct art_node16 * n16;
+    struct art_node48 * n48;
+    struct art_node256 *n256;
+    uint                i;
+
+    switch (n->an_type) {
+    case ART_N4:
+        n4 = (void *)n;
+        n4->keys[n->an_nchild] = b;
+        n4->child[n->an_nchild] = child;
+        break;
+
+    case ART_N16:
+        n16 = (void *)n;
+        n16->keys[n->an_nchild] = b;
+        n16->child[n->an_nchild] = child;
+        break;
+
+    case ART_N48:
+        n48 = (void *)n;
+        i = n->an_nchild;
+        n48->child[i] = child;
+        smp_wmb();
+        n48->index[b] = i + 1;
+        break;
+
+    case ART_N256:
+        n256 = (void *)n;
+        BONSAI_RCU_ASSIGN_POINTER(n256->child[b], child);
+        break;
+    }
+
+    smp_wmb();
+    n->an_nchild++;
+}
+
+static inline bool
+art_is_full(const struct art_node *n)
+{
+    static const uint capv[] = {
+        [ART_N4] = 4,
+        [ART_N16] = 16,
+        [ART_N48] = 48,
+        [ART_N256] = 256,
+    };
+
+    return n->an_nchild >= capv[n->an_type];
+}
+
+/* Copy @n into a new node of @type (same or larger) with the same path
+ * and children.
+ */
+static struct art_node *
+art_node_copy(struct bonsai_root *tree, const struct art_node *n, enum art_type type)
+{
+    const struct art_node4 *  n4;
+    const struct art_node16 * n16;
+    const struct art_node48 * n48;
+    const struct art_node256 *n256;
+    struct art_node *         nn;
+    uint                      i;
+
+    nn = art_node_alloc(tree, type);
+    if (ev(!nn))
+        return NULL;
+
+    nn->an_end = n->an_end;
+    nn->an_plen = n->an_plen;
+    memcpy(nn->an_pfx, n->an_pfx, sizeof(nn->an_pfx));
+
+    switch (n->an_type) {
+    case ART_N4:
+        n4 = (const void *)n;
+        for (i = 0; i < n->an_nchild; ++i)
+            art_add_child(nn, n4->keys[i], n4->child[i]);
+        break;
+
+    case ART_N16:
+        n16 = (const void *)n;
+        for (i = 0; i < n->an_nchild; ++i)
+            art_add_child(nn, n16->keys[i], n16->child[i]);
+        break;
+
+    case ART_N48:
+        n48 = (const void *)n;
+        for (i = 0; i < 256; ++i)
+            if (n48->index[i])
+                art_add_child(nn, i, n48->child[n48->index[i] - 1]);
+        break;
+
+    case ART_N256:
+        n256 = (const void *)n;
+        for (i = 0; i < 256; ++i)
+            if (n256->child[i])
+                art_add_child(nn, i, n256->child[i]);
+        break;
+    }
+
+    return nn;
+}
+
+/* Place @kv (whose key is @ak) either at the end slot or as a child of
+ * the new, unpublished node @n.
+ */
+static void
+art_place(struct art_node *n, const struct art_key *ak, u32 depth, struct bonsai_kv *kv)
+{
+    if (depth == ak->ak_len)
+        n->an_end = kv;
+    else
+        art_add_child(n, art_kbyte(ak, depth), art_mkleaf(kv));
+}
+
+/* Insert @kv, which must not already be indexed, into the subtree referred
+ * to by @slot.
+ */
+static merr_t
+art_insert(struct bonsai_root *tree, void **slot, const struct art_key *ak, struct bonsai_kv *kv)
+{
+    u32 depth = 0;
+
+    while (1) {
+        struct art_node *n, *nn, *nc;
+        void **          child;
+        void *           p = *slot;
+        u32              m;
+
+        if (!p) {
+            BONSAI_RCU_ASSIGN_POINTER(*slot, art_mkleaf(kv));
+            return 0;
+        }
+
+        if (art_is_leaf(p)) {
+            struct bonsai_kv *lkv = art_leaf(p);
+            struct art_key    lk;
+            u32               max;
+
+            /* Expand the leaf into a node holding both keys.
+             */
+            art_key_init_kv(&lk, lkv);
+            max = min_t(u32, lk.ak_len, ak->ak_len);
+
+            for (m = depth; m < max; ++m)
+                if (art_kbyte(&lk, m) != art_kbyte(ak, m))
+                    break;
+
+            nn = art_node_alloc(tree, ART_N4);
+            if (ev(!nn))
+                return merr(ENOMEM);
+
+            art_pfx_set(nn, ak, depth, m - depth);
+            art_place(nn, &lk, m, lkv);
+            art_place(nn, ak, m, kv);
+
+            BONSAI_RCU_ASSIGN_POINTER(*slot, nn);
+            return 0;
+        }
+
+        n = p;
+        m = art_pfx_match(n, ak, depth);
+
+        if (m < n->an_plen) {
+            struct art_key lk;
+
+            /* Split the compressed path at byte m: the new node takes
+             * the first m bytes, and a copy of n the rest after the
+             * byte on which the two differ.
+             */
+            art_key_init_kv(&lk, art_any(n));
+
+            nn = art_node_alloc(tree, ART_N4);
+            if (ev(!nn))
+                return merr(ENOMEM);
+
+            nc = art_node_copy(tree, n, n->an_type);
+            if (ev(!nc))
+                return merr(ENOMEM);
+
+            art_pfx_set(nn, ak, depth, m);
+            art_pfx_set(nc, &lk, depth + m + 1, n->an_plen - m - 1);
+
+            art_add_child(nn, art_kbyte(&lk, depth + m), nc);
+            art_place(nn, ak, depth + m, kv);
+
+            BONSAI_RCU_ASSIGN_POINTER(*slot, nn);
+            art_node_retire(tree, n);
+            return 0;
+        }
+
+        depth += n->an_plen;
+
+        if (depth == ak->ak_len) {
+            assert(!n->an_end);
+            BONSAI_RCU_ASSIGN_POINTER(n->an_end, kv);
+            return 0;
+        }
+
+        child = art_child_slot(n, art_kbyte(ak, depth));
+        if (child) {
+            slot = child;
+            ++depth;
+            continue;
+        }
+
+        if (!art_is_full(n)) {
+            art_add_child(n, art_kbyte(ak, depth), art_mkleaf(kv));
+            return 0;
+        }
+
+        /* Grow the node, then publish the copy with the new child.
+         */
+        nn = art_node_copy(tree, n, n->an_type + 1);
+        if (ev(!nn))
+            return merr(ENOMEM);
+
+        art_add_child(nn, art_kbyte(ak, depth), art_mkleaf(kv));
+
+        BONSAI_RCU_ASSIGN_POINTER(*slot, nn);
+        art_node_retire(tree, n);
+        return 0;
+    }
+}
+
+merr_t
+bn_art_insert(
+    struct bonsai_root *      tree,
+    const struct bonsai_skey *skey,
+    const struct bonsai_sval *sval,
+    bool                      tomb)
+{
+    const struct key_immediate *ki = &skey->bsk_key_imm;
+    struct bonsai_kv *          kv, *prev;
+    struct art_key              ak;
+    merr_t                      err;
+
+    art_key_init(&ak, skey->bsk_key, ki->ki_klen, key_immediate_index(ki));
+
+    kv = art_find_eq(tree->br_art, &ak);
+    if (kv)
+        return bn_kv_update(tree, kv, sval, tomb) ? 0 : merr(ENOMEM);
+
+    kv = bn_kv_alloc(tree, ki, skey->bsk_key, sval);
+    if (ev(!kv))
+        return merr(ENOMEM);
+
+    /* Link the new kv into the k/v list before it is published in the
+     * index, as readers that find it there may follow its links.
+     */
+    prev = art_find_le(tree->br_art, &ak, 0, false);
+
+    bn_kv_link(tree, kv, prev ?: &tree->br_kv, tomb);
+
+    err = art_insert(tree, &tree->br_art, &ak, kv);
+
+    return ev(err);
+}
+
+struct bonsai_kv *
+bn_art_find(struct bonsai_root *tree, const struct bonsai_skey *skey, enum bonsai_match_type mtype)
+{
+    const struct key_immediate *ki = &skey->bsk_key_imm;
+    struct bonsai_kv *          kv, *next;
+    struct art_key              ak;
+    void *                      root;
+
+    art_key_init(&ak, skey->bsk_key, ki->ki_klen, key_immediate_index(ki));
+    root = BONSAI_RCU_DEREF_POINTER(tree->br_art);
+
+    if (mtype == B_MATCH_EQ)
+        return art_find_eq(root, &ak);
+
+    kv = art_find_le(root, &ak, 0, false);
+    if (mtype == B_MATCH_LE)
+        return kv;
+
+    if (kv && !art_key_cmp(&ak, kv, false))
+        return kv;
+
+    next = (kv ?: &tree->br_kv)->bkv_next;
+
+    return (next == &tree->br_kv) ? NULL : next;
+}
+
+struct bonsai_kv *
+bn_art_find_pfx_gt(struct bonsai_root *tree, const struct bonsai_skey *skey)
+{
+    const struct key_immediate *ki = &skey->bsk_key_imm;
+    struct bonsai_kv *          kv, *next;
+    struct art_key              ak;
+
+    art_key_init(&ak, skey->bsk_key, ki->ki_klen, key_immediate_index(ki));
+
+    kv = art_find_le(BONSAI_RCU_DEREF_POINTER(tree->br_art), &ak, 0, true);
+
+    next = (kv ?: &tree->br_kv)->bkv_next;
+
+    return (next == &tree->br_kv) ? NULL : next;
+}
+
+static void
+art_teardown(struct bonsai_root *tree, void *p)
+{
+    struct art_node *n = p;
+    uint             b;
+
+    if (!p || art_is_leaf(p))
+        return;
+
+    for (b = 0; b < 256; ++b) {
+        void **child = art_child_slot(n, b);
+
+        if (child)
+            art_teardown(tree, *child);
+    }
+
+    bn_free(tree, n);
+}
+
+void
+bn_art_teardown(struct bonsai_root *tree)
+{
+    struct bonsai_kv *kv, *next;
+    struct art_node * n;
+
+    /* Nodes and kvs are reclaimed along with the cheap.
+     */
+    if (tree->br_client.bc_allocator)
+        return;
+
+    art_teardown(tree, tree->br_art);
+    tree->br_art = NULL;
+
+    while ((n = tree->br_art_free)) {
+        tree->br_art_free = n->an_free;
+        bn_free(tree, n);
+    }
+
+    for (kv = tree->br_kv.bkv_next; kv != &tree->br_kv; kv = next) {
+        struct bonsai_val *val, *vnext;
+
+        next = kv->bkv_next;
+
+        for (val = kv->bkv_values; val; val = vnext) {
+            vnext = val->bv_next;
+            bn_free(tree, val);
+        }
+
+        bn_free(tree, kv);
+    }
+
+    tree->br_kv.bkv_next = &tree->br_kv;
+    tree->br_kv.bkv_prev = &tree->br_kv;
+}
@@ -75,6 +75,92 @@ bn_val_alloc(struct bonsai_root *tree, const struct bonsai_sval *sval);
 void
 bn_val_free(struct bonsai_root *tree, struct bonsai_val *val);
 
+/**
+ * bn_kv_alloc() - allocate and initialize a bonsai_kv with its first value
+ * @tree:    bonsai tree instance
+ * @key_imm: key immediate
+ * @key:     key
+ * @sval:    first value
+ *
+ * Return: new bonsai_kv, or NULL on allocation failure
+ */
+struct bonsai_kv *
+bn_kv_alloc(
+    struct bonsai_root *        tree,
+    const struct key_immediate *key_imm,
+    const void *                key,
+    const struct bonsai_sval *  sval);
+
+/**
+ * bn_kv_link() - link a new kv into the ordered k/v list
+ * @tree: bonsai tree instance
+ * @kv:   new bonsai_kv
+ * @prev: the kv that will precede @kv (&tree->br_kv if @kv is the min)
+ * @tomb: %true if @kv is a tombstone
+ *
+ * Maintains the tombspans and issues the IOR_INS callback.
+ */
+void
+bn_kv_link(struct bonsai_root *tree, struct bonsai_kv *kv, struct bonsai_kv *prev, bool tomb);
+
+/**
+ * bn_kv_update() - add a value to an existing kv
+ * @tree: bonsai tree instance
+ * @kv:   existing bonsai_kv
+ * @sval: value to add or replace
+ * @tomb: %true if @sval is a tombstone
+ *
+ * Return: @kv, or NULL on allocation failure
+ */
+struct bonsai_kv *
+bn_kv_update(
+    struct bonsai_root *      tree,
+    struct bonsai_kv *        kv,
+    const struct bonsai_sval *sval,
+    bool                      tomb);
+
+/**
+ * bn_art_insert() - insert or replace a key in the radix tree index
+ * @tree:  bonsai tree instance
+ * @skey:  key
+ * @sval:  value
+ * @tomb:  %true if @sval is a tombstone
+ */
+merr_t
+bn_art_insert(
+    struct bonsai_root *      tree,
+    const struct bonsai_skey *skey,
+    const struct bonsai_sval *sval,
+    bool                      tomb);
+
+/**
+ * bn_art_find() - find a key in the radix tree index
+ * @tree:  bonsai tree instance
+ * @skey:  key
+ * @mtype: B_MATCH_EQ, B_MATCH_GE or B_MATCH_LE
+ *
+ * Return: matching kv, or NULL if none
+ */
+struct bonsai_kv *
+bn_art_find(struct bonsai_root *tree, const struct bonsai_skey *skey, enum bonsai_match_type mtype);
+
+/**
+ * bn_art_find_pfx_gt() - find the first key greater than all keys with prefix
+ * @tree:  bonsai tree instance
+ * @skey:  prefix
+ *
+ * Return: matching kv, or NULL if none
+ */
+struct bonsai_kv *
+bn_art_find_pfx_gt(struct bonsai_root *tree, const struct bonsai_skey *skey);
+
+/**
+ * bn_art_teardown() - free the radix tree index and all kvs (malloc mode)
+ * @tree:  bonsai tree instance
+ */
+void
+bn_art_teardown(struct bonsai_root *tree);
+
 /**
  * bn_alloc_impl() -
  * @allocator: cheap allocator instance
@@ -133,6 +219,61 @@ bn_balance_tree(
     const void *                key,
     enum bonsai_update_lr       lr);
 
+/**
+ * bn_keycmp_lcp() - compare two keys beyond a known common prefix
+ * @key0:  first key
+ * @klen0: length of @key0
+ * @key1:  second key
+ * @klen1: length of @key1
+ * @start: number of leading bytes known to be equal in both keys
+ * @lcpp:  (output) length of the longest common prefix of the two keys
+ *
+ * Compares eight bytes at a time and locates the first differing byte
+ * from the xor of the mismatched words, so that a descent can carry the
+ * lcp of the search key with its bounding nodes and skip those bytes at
+ * the next level.
+ *
+ * Return: < 0, 0 or > 0 as for inner_key_cmp()
+ */
+static __always_inline int
+bn_keycmp_lcp(
+    const void *key0,
+    uint        klen0,
+    const void *key1,
+    uint        klen1,
+    uint        start,
+    uint *      lcpp)
+{
+    const u8 *k0 = key0;
+    const u8 *k1 = key1;
+    uint      len = min_t(uint, klen0, klen1);
+    uint      i = start;
+
+    for (; i + sizeof(u64) <= len; i += sizeof(u64)) {
+        u64 w0, w1;
+
+        memcpy(&w0, k0 + i, sizeof(w0));
+        memcpy(&w1, k1 + i, sizeof(w1));
+
+        if (w0 != w1) {
+            i += __builtin_ctzll(w0 ^ w1) / 8; /* little-endian */
+            *lcpp = i;
+            return k0[i] < k1[i] ? -1 : 1;
+        }
+    }
+
+    for (; i < len; ++i) {
+        if (k0[i] != k1[i]) {
+            *lcpp = i;
+            return k0[i] < k1[i] ? -1 : 1;
+        }
+    }
+
+    *lcpp = len;
+
+    return (int)klen0 - (int)klen1;
+}
+
 /**
  * bn_height_max() -
  * @a:
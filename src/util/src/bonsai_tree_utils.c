@@ -217,19 +217,10 @@ bn_val_free(struct bonsai_root *tree, struct bonsai_val *val)
     }
 }
 
-struct bonsai_val *
-bn_val_alloc(struct bonsai_root *tree, const struct bonsai_sval *sval)
+static void
+bn_val_init(struct bonsai_val *v, const struct bonsai_sval *sval)
 {
-    struct bonsai_val *v;
-    size_t             sz;
-    u32                vlen;
-
-    vlen = sval->bsv_vlen;
-    sz = sizeof(*v) + vlen;
-
-    v = bn_alloc(tree, sz);
-    if (ev(!v))
-        return NULL;
+    u32 vlen = sval->bsv_vlen;
 
     v->bv_next = NULL;
     v->bv_free = NULL;
@@ -242,6 +233,28 @@ bn_val_alloc(struct bonsai_root *tree, const struct bonsai_sval *sval)
 
     if (vlen > 0)
         memcpy(v->bv_value, sval->bsv_val, vlen);
+}
+
+void
+bn_val_stage(void *mem, struct bonsai_sval *sval)
+{
+    bn_val_init(mem, sval);
+    sval->bsv_staged = mem;
+}
+
+struct bonsai_val *
+bn_val_alloc(struct bonsai_root *tree, const struct bonsai_sval *sval)
+{
+    struct bonsai_val *v;
+
+    if (sval->bsv_staged)
+        return sval->bsv_staged;
+
+    v = bn_alloc(tree, bn_val_stage_sz(sval->bsv_vlen));
+    if (ev(!v))
+        return NULL;
+
+    bn_val_init(v, sval);
 
     return v;
 }
@@ -322,6 +335,21 @@ bn_node_make(
     return node;
 }
 
+struct bonsai_kv *
+bn_kv_alloc(
+    struct bonsai_root *        tree,
+    const struct key_immediate *key_imm,
+    const void *                key,
+    const struct bonsai_sval *  sval)
+{
+    struct bonsai_kv *kv = NULL;
+    merr_t            err;
+
+    err = bn_kv_init(tree, key_imm, key, sval, &kv);
+
+    return ev(err) ? NULL : kv;
+}
+
 struct bonsai_node *
 bn_node_alloc(
     struct bonsai_root *        tree,
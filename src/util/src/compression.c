@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <lz4.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/compression.h>
+
+uint
+compress_lz4_bound(uint len)
+{
+    return LZ4_compressBound(len);
+}
+
+merr_t
+compress_lz4(const void *src, uint src_len, void *dst, uint dst_cap, uint *dst_len)
+{
+    int len;
+
+    len = LZ4_compress_default(src, dst, src_len, dst_cap);
+    if (ev(len <= 0))
+        return merr(EFBIG);
+
+    *dst_len = len;
+
+    return 0;
+}
+
+merr_t
+decompress_lz4(const void *src, uint src_len, void *dst, uint dst_cap, uint *dst_len)
+{
+    int len;
+
+    len = LZ4_decompress_safe_partial(src, dst, src_len, dst_cap, dst_cap);
+    if (ev(len < 0))
+        return merr(EILSEQ);
+
+    *dst_len = len;
+
+    return 0;
+}
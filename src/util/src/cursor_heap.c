@@ -9,31 +9,339 @@
 #include <hse_util/page.h>
 #include <hse_util/mman.h>
 #include <hse_util/minmax.h>
+#include <hse_util/log2.h>
 #include <hse_util/event_counter.h>
+#include <hse_util/spinlock.h>
+#include <hse_util/timer.h>
 #include <hse_util/cursor_heap.h>
 
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+/* Cheaps whose memory has no special placement are not unmapped when
+ * destroyed but kept in a pool of idle regions, bucketed by the log2 of
+ * their size in 2MB units, from which cheaps of the same size are created.
+ * Pooled regions retain up to CHEAP_POOL_KEEP bytes of resident (zeroed)
+ * pages, and a timer unmaps regions that have been idle for CHEAP_POOL_IDLE
+ * seconds.  This spares high-churn users the mmap/munmap calls, which
+ * contend on the process' VM lock, and most of the page faults.
+ */
+#define CHEAP_POOL_CLASSES (16)
+#define CHEAP_POOL_DEPTH (8)
+#define CHEAP_POOL_KEEP (256ul << 10)
+#define CHEAP_POOL_IDLE (5)
+
+/**
+ * struct cheap_pool_ent - an idle region, stored at the base of the region
+ * @pe_next:   next (older) region in the bucket
+ * @pe_maplen: length of the region
+ * @pe_jif:    jiffies when the region was pooled
+ */
+struct cheap_pool_ent {
+    struct cheap_pool_ent *pe_next;
+    size_t                 pe_maplen;
+    unsigned long          pe_jif;
+};
+
+struct cheap_pool_bkt {
+    spinlock_t             pb_lock;
+    struct cheap_pool_ent *pb_head;
+    uint                   pb_cnt;
+} __aligned(SMP_CACHE_BYTES);
+
+static struct cheap_pool_bkt cheap_poolv[CHEAP_POOL_CLASSES];
+static struct timer_list     cheap_pool_timer;
+static volatile bool         cheap_pool_enabled;
+
+static struct cheap_pool_bkt *
+cheap_pool_bkt(size_t maplen)
+{
+    uint idx = ilog2(maplen >> 21);
+
+    return (idx < CHEAP_POOL_CLASSES) ? cheap_poolv + idx : NULL;
+}
+
+static void *
+cheap_pool_get(size_t maplen)
+{
+    struct cheap_pool_ent *ent, **pp;
+    struct cheap_pool_bkt *bkt;
+
+    bkt = cheap_pool_bkt(maplen);
+    if (!bkt || !cheap_pool_enabled)
+        return NULL;
+
+    spin_lock(&bkt->pb_lock);
+    for (pp = &bkt->pb_head; (ent = *pp); pp = &ent->pe_next) {
+        if (ent->pe_maplen == maplen) {
+            *pp = ent->pe_next;
+            bkt->pb_cnt--;
+            break;
+        }
+    }
+    spin_unlock(&bkt->pb_lock);
+
+    if (ent)
+        memset(ent, 0, sizeof(*ent));
+
+    return ent;
+}
+
+/* Zero the leading pages of the region that were used, such that a cheap
+ * created from the pool is indistinguishable from a fresh mapping, and
+ * release the rest.  Pages beyond the cheap's brk may have been released
+ * by cheap_trim() with MADV_FREE and so still hold data, hence the rest
+ * of the region is released with MADV_DONTNEED in full.
+ */
+static bool
+cheap_pool_put(struct cheap *h)
+{
+    struct cheap_pool_ent *ent = h->mem;
+    struct cheap_pool_bkt *bkt;
+    size_t                 maplen, used, keep;
+
+    if (!cheap_pool_enabled || h->flags & ~CHEAP_F_PREFAULT)
+        return false;
+
+    maplen = h->maplen;
+
+    bkt = cheap_pool_bkt(maplen);
+    if (!bkt || bkt->pb_cnt >= CHEAP_POOL_DEPTH)
+        return false;
+
+    used = max_t(u64, h->brk, PAGE_ALIGN(h->cursorp)) - (u64)h->mem;
+    keep = min_t(size_t, used, max_t(size_t, CHEAP_POOL_KEEP, h->arena));
+    keep = min_t(size_t, keep, maplen);
+
+    if (keep < maplen && ev(madvise(h->mem + keep, maplen - keep, MADV_DONTNEED)))
+        return false;
+
+    memset(ent, 0, keep);
+
+    ent->pe_maplen = maplen;
+    ent->pe_jif = jiffies;
+
+    spin_lock(&bkt->pb_lock);
+    if (bkt->pb_cnt < CHEAP_POOL_DEPTH) {
+        ent->pe_next = bkt->pb_head;
+        bkt->pb_head = ent;
+        bkt->pb_cnt++;
+        ent = NULL;
+    }
+    spin_unlock(&bkt->pb_lock);
+
+    return !ent;
+}
+
+/* Unmap the regions that have been idle for at least %idle jiffies.
+ * Regions are pushed at the head, so the idle ones are at the tail.
+ */
+static void
+cheap_pool_trim(unsigned long idle)
+{
+    struct cheap_pool_ent *ent, *next, **pp;
+    int                    i;
+
+    for (i = 0; i < CHEAP_POOL_CLASSES; ++i) {
+        struct cheap_pool_bkt *bkt = cheap_poolv + i;
+
+        spin_lock(&bkt->pb_lock);
+        for (pp = &bkt->pb_head; (ent = *pp); pp = &ent->pe_next) {
+            if (jiffies - ent->pe_jif >= idle)
+                break;
+        }
+        *pp = NULL;
+
+        for (next = ent; next; next = next->pe_next)
+            bkt->pb_cnt--;
+        spin_unlock(&bkt->pb_lock);
+
+        for (; ent; ent = next) {
+            next = ent->pe_next;
+            munmap(ent, ent->pe_maplen);
+        }
+    }
+}
+
+static void
+cheap_pool_timer_cb(unsigned long arg)
+{
+    cheap_pool_trim(CHEAP_POOL_IDLE * HZ);
+
+    if (cheap_pool_enabled) {
+        cheap_pool_timer.expires = jiffies + HZ;
+        add_timer(&cheap_pool_timer);
+    }
+}
+
+merr_t
+cheap_pool_init(void)
+{
+    int i;
+
+    for (i = 0; i < CHEAP_POOL_CLASSES; ++i)
+        spin_lock_init(&cheap_poolv[i].pb_lock);
+
+    cheap_pool_enabled = true;
+
+    setup_timer(&cheap_pool_timer, cheap_pool_timer_cb, 0);
+    cheap_pool_timer.expires = jiffies + HZ;
+    add_timer(&cheap_pool_timer);
+
+    return 0;
+}
+
+void
+cheap_pool_fini(void)
+{
+    if (!cheap_pool_enabled)
+        return;
+
+    cheap_pool_enabled = false;
+    del_timer(&cheap_pool_timer);
+
+    cheap_pool_trim(0);
+}
+
 static void *
-alloc_lazy(size_t size)
+alloc_lazy(size_t size, size_t align)
 {
-    void *mem;
+    void * mem, *base;
+    size_t head;
 
     /* Use MAP_PRIVATE so that cheap_trim() can release pages.
      */
-    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    base = mmap(NULL, size + align, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    if (!align)
+        return base;
+
+    /* Trim the excess to leave a range aligned to the huge page size.
+     */
+    mem = PTR_ALIGN(base, align);
+    head = (size_t)(mem - base);
+
+    if (head > 0)
+        munmap(base, head);
+    munmap(mem + size, align - head);
 
-    return (mem == MAP_FAILED) ? NULL : mem;
+    return mem;
 }
 
 static void
 free_lazy(struct cheap *h)
 {
-    munmap(h->mem, ALIGN(h->size, PAGE_SIZE));
+    if (cheap_pool_put(h))
+        return;
+
+    munmap(h->mem, h->maplen);
+}
+
+/* Replace the arena's base pages with hugetlb pages, which are reserved
+ * by the mmap.  If none are available the arena is left on base pages
+ * advised for transparent huge pages.
+ *
+ * Return: 0 if the arena is on hugetlb pages, ENOMEM if it is on base
+ * pages, or EFAULT if the arena could not be restored.
+ */
+static int
+alloc_arena_huge(void *mem, size_t len, size_t hugesz)
+{
+    int   prot = PROT_READ | PROT_WRITE;
+    int   flags = MAP_ANON | MAP_PRIVATE | MAP_FIXED;
+    void *addr;
+
+    addr = mmap(mem, len, prot, flags | MAP_HUGETLB | (ilog2(hugesz) << MAP_HUGE_SHIFT), -1, 0);
+    if (addr == mem)
+        return 0;
+
+    /* Restore the range in case the failed mapping unmapped it.
+     */
+    addr = mmap(mem, len, prot, flags, -1, 0);
+    if (ev(addr != mem))
+        return EFAULT;
+
+    madvise(mem, len, MADV_HUGEPAGE);
+
+    return ENOMEM;
+}
+
+/* Populate the arena from the calling thread, optionally preferring its
+ * numa node over the task's memory policy.
+ */
+static void
+alloc_arena_prefault(void *mem, size_t len, size_t pgsz, uint flags)
+{
+    size_t off;
+    long   rc;
+
+    if ((flags & CHEAP_F_LOCAL) && !(flags & CHEAP_F_NODE)) {
+        /* An empty nodemask with MPOL_PREFERRED selects local allocation.
+         */
+        rc = syscall(SYS_mbind, mem, len, MPOL_PREFERRED, NULL, 0, 0);
+        ev(rc);
+    }
+
+    for (off = 0; off < len; off += pgsz)
+        *(volatile char *)(mem + off) = 0;
+}
+
+/* Prefer the given numa node for all pages of the heap that have yet to
+ * be faulted in (including those that cheap_trim() later releases).
+ */
+static void
+alloc_lazy_bind(void *mem, size_t len, uint node)
+{
+    unsigned long mask[2] = {};
+    long          rc;
+
+    if (ev(node >= sizeof(mask) * 8))
+        return;
+
+    mask[node / 64] = 1ul << (node % 64);
+
+    rc = syscall(SYS_mbind, mem, len, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0);
+    ev(rc);
+}
+
+uint
+cheap_numa_nodes(void)
+{
+    static uint   nodes;
+    unsigned long mask[2] = {};
+    long          rc;
+    int           i;
+
+    if (nodes)
+        return nodes;
+
+    rc = syscall(SYS_get_mempolicy, NULL, mask, sizeof(mask) * 8, NULL, MPOL_F_MEMS_ALLOWED);
+    if (ev(rc))
+        return (nodes = 1);
+
+    for (i = NELEM(mask) - 1; i >= 0; --i) {
+        if (mask[i]) {
+            nodes = i * 64 + 64 - __builtin_clzl(mask[i]);
+            break;
+        }
+    }
+
+    return (nodes = max_t(uint, nodes, 1));
 }
 
 struct cheap *
 cheap_create(size_t alignment, size_t size)
+{
+    return cheap_create_ext(alignment, size, 0, 0);
+}
+
+struct cheap *
+cheap_create_ext(size_t alignment, size_t size, size_t arena, uint flags)
 {
     struct cheap *h = NULL;
+    size_t        hugesz;
     void *        mem;
 
     if (alignment < 2)
@@ -48,17 +356,60 @@ cheap_create(size_t alignment, size_t size)
      */
     size = ALIGN(size, 2u << 20);
 
-    mem = alloc_lazy(size);
+    hugesz = 0;
+    if (flags & CHEAP_F_HUGE1G)
+        hugesz = 1ul << 30;
+    else if (flags & CHEAP_F_HUGE2M)
+        hugesz = 2ul << 20;
+
+    /* The arena need not be backed by huge pages, in which case it is
+     * merely prefaulted and/or kept resident.
+     */
+    arena = min_t(size_t, arena, size);
+    arena = hugesz ? (arena & ~(hugesz - 1)) : PAGE_ALIGN(arena);
+    if (!arena || !flags) {
+        flags &= ~(CHEAP_F_HUGE2M | CHEAP_F_HUGE1G | CHEAP_F_PREFAULT | CHEAP_F_LOCAL);
+        arena = hugesz = 0;
+    }
+
+    mem = NULL;
+    if (!hugesz && !(flags & ~CHEAP_F_PREFAULT))
+        mem = cheap_pool_get(size);
+    if (!mem)
+        mem = alloc_lazy(size, hugesz);
     if (mem) {
         size_t halign = ALIGN(sizeof(*h), SMP_CACHE_BYTES);
         size_t color = (get_cycles() >> 2) % 4;
         size_t offset = SMP_CACHE_BYTES * color;
+        int    rc = 0;
+
+        if (hugesz)
+            rc = alloc_arena_huge(mem, arena, hugesz);
+
+        if (rc) {
+            flags &= ~(CHEAP_F_HUGE2M | CHEAP_F_HUGE1G);
+            hugesz = 0;
+
+            if (ev(rc != ENOMEM)) {
+                munmap(mem, size);
+                return NULL;
+            }
+        }
+
+        if (flags & CHEAP_F_NODE)
+            alloc_lazy_bind(mem, size, CHEAP_F_NODEOF(flags));
+
+        if (flags & CHEAP_F_PREFAULT)
+            alloc_arena_prefault(mem, arena, hugesz ?: PAGE_SIZE, flags);
 
         /* Offset the base of the cheap by a pseudo-random number of
          * cache lines in effort to ameliorate cache conflict misses.
          */
         h = mem + offset;
         h->mem = mem;
+        h->maplen = size;
+        h->arena = arena;
+        h->flags = flags;
         h->magic = (uintptr_t)h;
         h->alignment = alignment;
         h->size = size - offset - halign - CHEAP_POISON_SZ;
@@ -115,6 +466,7 @@ cheap_trim(struct cheap *h, size_t rss)
         h->brk = PAGE_ALIGN(h->cursorp);
 
     rss = max(PAGE_ALIGN(rss), PAGE_SIZE);
+    rss = max(rss, h->arena);
 
     if (rss < h->cursorp - h->base)
         rss = PAGE_ALIGN(h->cursorp - h->base);
@@ -599,6 +599,11 @@ dt_iterate_cmd(
                 }
                 break;
 
+            case DT_OP_VISIT:
+                if (dip && dip->dvp && ((selector != NULL && selector(dte)) || selector == NULL))
+                    count += dip->dvp->visit(dte, dip->dvp->arg);
+                break;
+
             case DT_OP_COUNT:
                 if (dte->dte_ops->count &&
                     ((selector != NULL && selector(dte)) ||
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/byteorder.h>
+#include <hse_util/hash.h>
+
+/*
+ * hse_hash64x4() is XXH64 run over four inputs in lockstep.  Each step of
+ * the algorithm is applied to all four lanes before moving on to the next,
+ * so the multiply chains of the lanes are independent and can be issued
+ * back to back (or vectorized by the compiler where 64-bit multiplies are
+ * available), rather than each hash waiting on the latency of its own
+ * chain.  The result of each lane is identical to hse_hash64_seed().
+ */
+
+#define HX_PRIME64_1 11400714785074694791ULL
+#define HX_PRIME64_2 14029467366897019727ULL
+#define HX_PRIME64_3 1609587929392839161ULL
+#define HX_PRIME64_4 9650029242287828579ULL
+#define HX_PRIME64_5 2870177450012600261ULL
+
+#define HX_LANES 4
+
+static __always_inline u64
+hx_rotl64(u64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static __always_inline u64
+hx_read64(const u8 *p)
+{
+    u64 v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return le64_to_cpu(v);
+}
+
+static __always_inline u32
+hx_read32(const u8 *p)
+{
+    u32 v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return le32_to_cpu(v);
+}
+
+static __always_inline u64
+hx_round(u64 acc, u64 input)
+{
+    acc += input * HX_PRIME64_2;
+    acc = hx_rotl64(acc, 31);
+
+    return acc * HX_PRIME64_1;
+}
+
+static __always_inline u64
+hx_merge(u64 h, u64 v)
+{
+    h ^= hx_round(0, v);
+
+    return h * HX_PRIME64_1 + HX_PRIME64_4;
+}
+
+void
+hse_hash64x4(const void *const *datav, size_t len, u64 seed, u64 *hashv)
+{
+    const u8 *p[HX_LANES];
+    u64       h[HX_LANES];
+    size_t    off = 0;
+    int       i;
+
+    for (i = 0; i < HX_LANES; ++i)
+        p[i] = datav[i];
+
+    if (len >= 32) {
+        u64 v1[HX_LANES], v2[HX_LANES], v3[HX_LANES], v4[HX_LANES];
+
+        for (i = 0; i < HX_LANES; ++i) {
+            v1[i] = seed + HX_PRIME64_1 + HX_PRIME64_2;
+            v2[i] = seed + HX_PRIME64_2;
+            v3[i] = seed;
+            v4[i] = seed - HX_PRIME64_1;
+        }
+
+        do {
+            for (i = 0; i < HX_LANES; ++i) {
+                v1[i] = hx_round(v1[i], hx_read64(p[i] + off));
+                v2[i] = hx_round(v2[i], hx_read64(p[i] + off + 8));
+                v3[i] = hx_round(v3[i], hx_read64(p[i] + off + 16));
+                v4[i] = hx_round(v4[i], hx_read64(p[i] + off + 24));
+            }
+            off += 32;
+        } while (off + 32 <= len);
+
+        for (i = 0; i < HX_LANES; ++i) {
+            h[i] = hx_rotl64(v1[i], 1) + hx_rotl64(v2[i], 7);
+            h[i] += hx_rotl64(v3[i], 12) + hx_rotl64(v4[i], 18);
+            h[i] = hx_merge(h[i], v1[i]);
+            h[i] = hx_merge(h[i], v2[i]);
+            h[i] = hx_merge(h[i], v3[i]);
+            h[i] = hx_merge(h[i], v4[i]);
+        }
+    } else {
+        for (i = 0; i < HX_LANES; ++i)
+            h[i] = seed + HX_PRIME64_5;
+    }
+
+    for (i = 0; i < HX_LANES; ++i)
+        h[i] += len;
+
+    for (; off + 8 <= len; off += 8) {
+        for (i = 0; i < HX_LANES; ++i) {
+            h[i] ^= hx_round(0, hx_read64(p[i] + off));
+            h[i] = hx_rotl64(h[i], 27) * HX_PRIME64_1 + HX_PRIME64_4;
+        }
+    }
+
+    if (off + 4 <= len) {
+        for (i = 0; i < HX_LANES; ++i) {
+            h[i] ^= (u64)hx_read32(p[i] + off) * HX_PRIME64_1;
+            h[i] = hx_rotl64(h[i], 23) * HX_PRIME64_2 + HX_PRIME64_3;
+        }
+        off += 4;
+    }
+
+    for (; off < len; ++off) {
+        for (i = 0; i < HX_LANES; ++i) {
+            h[i] ^= p[i][off] * HX_PRIME64_5;
+            h[i] = hx_rotl64(h[i], 11) * HX_PRIME64_1;
+        }
+    }
+
+    for (i = 0; i < HX_LANES; ++i) {
+        h[i] ^= h[i] >> 33;
+        h[i] *= HX_PRIME64_2;
+        h[i] ^= h[i] >> 29;
+        h[i] *= HX_PRIME64_3;
+        h[i] ^= h[i] >> 32;
+
+        hashv[i] = h[i];
+    }
+}
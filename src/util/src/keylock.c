@@ -8,32 +8,62 @@
 #include <hse_util/platform.h>
 #include <hse_util/hash.h>
 #include <hse_util/slab.h>
+#include <hse_util/rcu.h>
 #include <hse_util/keylock.h>
 
+/*
+ * The keylock table is an open addressed, linearly probed hash table of
+ * two-word slots.  The key word holds the hash of the lock and is only
+ * ever written once, from empty to claimed.  The owner word holds the
+ * rock of the lock holder, or KLE_FREE if the slot is claimed but not
+ * held.  Acquire and release are thus a single CAS on the owner word of
+ * the slot, and lookups never need to lock anything.
+ *
+ * Released slots keep their hash so that a later acquire of the same
+ * hash reuses them.  They are only returned to the empty state by a
+ * sweep, which runs once probes get too long or the table is full.  A
+ * sweep needs the table to itself: it raises kli_sweep and waits for
+ * the per-cpu active counts to drain, lockers that see kli_sweep wait
+ * for it on kli_sweep_mtx.
+ */
+
 struct keylock {
 };
 
 #define keylock_h2r(handle) container_of(handle, struct keylock_impl, kli_handle)
 
+#define KLE_FREE ((long)-1)
+#define KLE_USED (1ul << 63)
+#define KLE_HASH(_hash) ((_hash) | KLE_USED)
+
+#define KEYLOCK_ACTIVE_MAX 16
+#define KEYLOCK_PROBE_MIN 32
+
 struct keylock_entry {
-    u64                     kle_hash : 48;
-    u64                     kle_plen : 16;
-    struct keylock_cb_rock *kle_rock;
+    atomic64_t kle_hash;
+    atomic64_t kle_rock;
 };
 
+struct keylock_active {
+    atomic_t kla_cnt;
+} __aligned(SMP_CACHE_BYTES);
+
 struct keylock_impl {
     struct keylock kli_handle;
     u64            kli_num_entries;
     keylock_cb_fn *kli_cb_func;
+    u32            kli_probe_max;
+    u32            kli_max_probe_len;
+    u32            kli_max_occupied;
+    atomic64_t     kli_collisions;
+    atomic64_t     kli_table_full;
 
-    __aligned(SMP_CACHE_BYTES) struct mutex kli_kmutex;
-    struct keylock_stats kli_stats;
-    struct keylock_entry kli_entries[];
-};
+    __aligned(SMP_CACHE_BYTES) atomic_t kli_sweep;
+    struct mutex kli_sweep_mtx;
 
-static const struct keylock_entry EMPTY_ENTRY = {.kle_rock = (void *)-1 };
-
-#define NONEMPTY_ENTRY(_entry) ((_entry)->kle_rock != (void *)-1)
+    struct keylock_active kli_activev[KEYLOCK_ACTIVE_MAX];
+    struct keylock_entry  kli_entries[];
+};
 
 static bool
 keylock_cb_func(u64 start_seq, struct keylock_cb_rock *rock1, struct keylock_cb_rock **new_rock)
@@ -61,12 +91,13 @@ keylock_create(u64 num_ents, keylock_cb_fn *cb_func, struct keylock **handle_out
 
     memset(table, 0, sz);
     table->kli_num_entries = num_ents;
+    table->kli_probe_max = max_t(u32, num_ents / 16, KEYLOCK_PROBE_MIN);
 
     for (i = 0; i < num_ents; ++i)
-        table->kli_entries[i] = EMPTY_ENTRY;
+        atomic64_set(&table->kli_entries[i].kle_rock, KLE_FREE);
 
     table->kli_cb_func = cb_func ? cb_func : keylock_cb_func;
-    mutex_init_adaptive(&table->kli_kmutex);
+    mutex_init_adaptive(&table->kli_sweep_mtx);
 
     *handle_out = &table->kli_handle;
 
@@ -83,210 +114,310 @@ keylock_destroy(struct keylock *handle)
 
     table = keylock_h2r(handle);
 
-    mutex_destroy(&table->kli_kmutex);
+    mutex_destroy(&table->kli_sweep_mtx);
 
     free_aligned(table);
 }
 
-merr_t
-keylock_lock(
-    struct keylock *        handle,
-    u64                     hash,
-    u64                     start_seq,
-    struct keylock_cb_rock *rock,
-    bool *                  inherited)
+static atomic_t *
+keylock_enter(struct keylock_impl *table)
 {
-    struct keylock_impl * table = keylock_h2r(handle);
-    struct keylock_entry  entry, *curr;
-    struct keylock_stats *stats;
-    u32                   max_entries;
-    bool                  displaced, full;
+    atomic_t *active;
 
-    max_entries = table->kli_num_entries;
+    while (1) {
+        active = &table->kli_activev[raw_smp_processor_id() % KEYLOCK_ACTIVE_MAX].kla_cnt;
 
-    hash = (hash << 16) >> 16;
-    curr = table->kli_entries + (hash % max_entries);
-    __builtin_prefetch(curr);
+        atomic_inc(active);
+        smp_mb();
 
-    entry.kle_plen = 0;
-    entry.kle_hash = hash;
-    entry.kle_rock = rock;
+        if (likely(!atomic_read(&table->kli_sweep)))
+            return active;
 
-    stats = &table->kli_stats;
-    displaced = false;
+        atomic_dec(active);
 
-    mutex_lock(&table->kli_kmutex);
+        mutex_lock(&table->kli_sweep_mtx);
+        mutex_unlock(&table->kli_sweep_mtx);
+    }
+}
 
-    full = stats->kls_num_occupied == max_entries;
+static void
+keylock_leave(atomic_t *active)
+{
+    atomic_dec_rel(active);
+}
 
-    while (NONEMPTY_ENTRY(curr)) {
-        if (!displaced && hash == curr->kle_hash) {
-            struct keylock_cb_rock *old = curr->kle_rock;
-            struct keylock_cb_rock *new = rock;
+/**
+ * keylock_sweep() - return released slots to the empty state
+ * @table: keylock table, the caller must not be inside keylock_enter()
+ *
+ * Empties every slot that is not held and then moves the held entries
+ * back to the front of their probe sequences.
+ */
+static void
+keylock_sweep(struct keylock_impl *table)
+{
+    struct keylock_entry *entries = table->kli_entries;
+    u64                   n = table->kli_num_entries;
+    u64                   i, j, start, freed;
+    long                  hash, rock;
+    int                   k;
+
+    if (!mutex_trylock(&table->kli_sweep_mtx)) {
+        mutex_lock(&table->kli_sweep_mtx);
+        mutex_unlock(&table->kli_sweep_mtx);
+        return;
+    }
 
-            /* Should only be considering this for the 1st hash */
-            assert(hash == entry.kle_hash);
+    atomic_set(&table->kli_sweep, 1);
+    smp_mb();
 
-            /* Does the caller already hold the lock? */
-            if (old == rock) {
-                mutex_unlock(&table->kli_kmutex);
-                *inherited = false;
-                return 0;
-            }
+    for (k = 0; k < KEYLOCK_ACTIVE_MAX; ++k) {
+        while (atomic_read_acq(&table->kli_activev[k].kla_cnt))
+            __builtin_ia32_pause();
+    }
 
-            /* Can the caller inherit the lock? */
-            if (table->kli_cb_func(start_seq, old, &new)) {
-                curr->kle_rock = new;
-                mutex_unlock(&table->kli_kmutex);
-                *inherited = true;
-                return 0;
-            }
+    start = n;
+    freed = 0;
 
-            /* Lock held by another transaction, cannot inherit */
-            stats->kls_collisions++;
-            mutex_unlock(&table->kli_kmutex);
+    for (i = 0; i < n; ++i) {
+        if (atomic64_read(&entries[i].kle_rock) != KLE_FREE)
+            continue;
 
-            return merr_once(ECANCELED);
+        if (atomic64_read(&entries[i].kle_hash)) {
+            atomic64_set(&entries[i].kle_hash, 0);
+            ++freed;
         }
 
-        /* If the probe len of the current entry is higher, swap it
-         * with the current key. Robin Hood hashing reduces variance
-         * of searches.
-         */
-        if (curr->kle_plen < entry.kle_plen) {
-            struct keylock_entry tmp;
+        if (start == n)
+            start = i;
+    }
 
-            /* The lock doesn't exist in the table. If the table is
-             * full, exit. No room to insert a new entry.
-             */
-            if (unlikely(full)) {
-                stats->kls_table_full++;
-                mutex_unlock(&table->kli_kmutex);
+    /* Reinsert the held entries in probe order from an empty slot, so
+     * that each one lands at or before its current position.
+     */
+    for (i = 1; start < n && i < n; ++i) {
+        struct keylock_entry *curr = entries + (start + i) % n;
 
-                return merr(ev(ECANCELED));
-            }
+        hash = atomic64_read(&curr->kle_hash);
+        if (!hash)
+            continue;
 
-            tmp = *curr;
-            *curr = entry;
-            entry = tmp;
+        rock = atomic64_read(&curr->kle_rock);
+        atomic64_set(&curr->kle_hash, 0);
+        atomic64_set(&curr->kle_rock, KLE_FREE);
 
-            displaced = true;
-        }
+        j = (hash & ~KLE_USED) % n;
+        while (atomic64_read(&entries[j].kle_hash))
+            j = (j + 1) % n;
 
-        entry.kle_plen += 1;
-        curr = table->kli_entries + ((entry.kle_hash + entry.kle_plen) % max_entries);
+        atomic64_set(&entries[j].kle_hash, hash);
+        atomic64_set(&entries[j].kle_rock, rock);
     }
 
-    /* Insert a new entry in the hash table */
-    assert(!NONEMPTY_ENTRY(curr) && !full);
-    assert(curr->kle_plen == 0);
-    assert(entry.kle_plen < table->kli_num_entries);
-
-    *curr = entry;
+    /* Back off if the table is mostly held, so that long probes over
+     * live entries do not sweep over and over.
+     */
+    if (freed < n / 8)
+        table->kli_probe_max = min_t(u64, table->kli_probe_max * 2, n);
+    else
+        table->kli_probe_max = max_t(u32, n / 16, KEYLOCK_PROBE_MIN);
+
+    smp_mb();
+    atomic_set(&table->kli_sweep, 0);
+    mutex_unlock(&table->kli_sweep_mtx);
+}
 
-    assert(stats->kls_num_occupied < table->kli_num_entries);
-    stats->kls_num_occupied++;
+/**
+ * keylock_probe() - find the slot of %hash, or claim one for it
+ * @table: keylock table
+ * @hash:  48-bit lock hash
+ * @claim: claim an empty slot if %hash is not in the table
+ * @plenp: probe length to the slot, or to the end of the search
+ *
+ * Return: the slot, or NULL if not found (or the table is full).
+ */
+static struct keylock_entry *
+keylock_probe(struct keylock_impl *table, u64 hash, bool claim, u32 *plenp)
+{
+    struct keylock_entry *curr;
+    u64                   n = table->kli_num_entries;
+    u64                   index = hash % n;
+    long                  want = KLE_HASH(hash);
+    long                  cur;
+    u32                   plen;
+
+    for (plen = 0; plen < n; ++plen) {
+        curr = table->kli_entries + index;
+
+        cur = atomic64_read(&curr->kle_hash);
+        if (!cur) {
+            if (!claim)
+                break;
+
+            cur = atomic64_cmpxchg(&curr->kle_hash, 0, want);
+            if (!cur)
+                cur = want;
+        }
 
-    if (entry.kle_plen > stats->kls_max_probe_len)
-        stats->kls_max_probe_len = entry.kle_plen;
-    if (stats->kls_num_occupied > stats->kls_max_occupied)
-        stats->kls_max_occupied = stats->kls_num_occupied;
+        if (cur == want) {
+            *plenp = plen;
+            return curr;
+        }
 
-    mutex_unlock(&table->kli_kmutex);
+        if (++index == n)
+            index = 0;
+    }
 
-    *inherited = false;
+    *plenp = plen;
 
-    return 0;
+    return NULL;
 }
 
-void
-keylock_unlock(struct keylock *handle, u64 hash, struct keylock_cb_rock *rock)
+merr_t
+keylock_lock(
+    struct keylock *        handle,
+    u64                     hash,
+    u64                     start_seq,
+    struct keylock_cb_rock *rock,
+    bool *                  inherited)
 {
-    struct keylock_impl *table = keylock_h2r(handle);
-    u64                  plen = 0, index, free;
+    struct keylock_impl *   table = keylock_h2r(handle);
+    struct keylock_cb_rock *new;
+    struct keylock_entry *  curr;
+    atomic_t *              active;
+    bool                    swept = false;
+    long                    old;
+    u32                     plen;
 
     hash = (hash << 16) >> 16;
-    index = (hash + plen) % table->kli_num_entries;
+    *inherited = false;
 
-    mutex_lock(&table->kli_kmutex);
+retry:
+    active = keylock_enter(table);
 
-    while (table->kli_entries[index].kle_hash != hash &&
-           table->kli_entries[index].kle_plen >= plen) {
-        plen++;
-        index++;
-        if (index == table->kli_num_entries)
-            index = 0;
+    curr = keylock_probe(table, hash, true, &plen);
+
+    if (!curr || plen > table->kli_probe_max) {
+        if (!swept) {
+            keylock_leave(active);
+            keylock_sweep(table);
+            swept = true;
+            goto retry;
+        }
+
+        if (!curr) {
+            keylock_leave(active);
+            atomic64_inc(&table->kli_table_full);
+
+            return merr(ev(ECANCELED));
+        }
     }
 
-    /* Check that the caller really holds the lock. If the lock was
-     * inherited before the deferred lock set's ref count reaches 0,
-     * then the lock isn't really held by the caller so we just return.
-     * Verify that the hash is the same i.e. has not been removed previously
-     * by another thread that owns the lock.
+    if (plen > table->kli_max_probe_len)
+        table->kli_max_probe_len = plen;
+
+    /* The rock in the owner word may be freed once it no longer holds
+     * the lock, so the callback must run within an RCU read-side
+     * critical section.
      */
-    if (table->kli_entries[index].kle_rock != rock || table->kli_entries[index].kle_hash != hash) {
-        mutex_unlock(&table->kli_kmutex);
+    rcu_read_lock();
 
-        return;
-    }
+    old = KLE_FREE;
+    while (1) {
+        old = atomic64_cmpxchg(&curr->kle_rock, old, (long)rock);
+        if (old == KLE_FREE)
+            break;
+
+        /* Does the caller already hold the lock? */
+        if (old == (long)rock)
+            break;
+
+        /* Can the caller inherit the lock? */
+        new = rock;
+        if (!table->kli_cb_func(start_seq, (struct keylock_cb_rock *)old, &new)) {
+            rcu_read_unlock();
+            keylock_leave(active);
+
+            /* Lock held by another transaction, cannot inherit */
+            atomic64_inc(&table->kli_collisions);
 
-    table->kli_entries[index] = EMPTY_ENTRY;
-    table->kli_stats.kls_num_occupied--;
-
-    free = index;
-    index++;
-    if (index == table->kli_num_entries)
-        index = 0;
-    plen = 1;
-
-    while (table->kli_entries[index].kle_plen) {
-        if (table->kli_entries[index].kle_plen >= plen) {
-            table->kli_entries[free] = table->kli_entries[index];
-            table->kli_entries[free].kle_plen -= plen;
-            table->kli_entries[index] = EMPTY_ENTRY;
-            free = index;
-            plen = 0;
+            return merr_once(ECANCELED);
         }
 
-        plen++;
-        index++;
-        if (index == table->kli_num_entries)
-            index = 0;
+        if (atomic64_cmpxchg(&curr->kle_rock, old, (long)new) == old) {
+            *inherited = true;
+            break;
+        }
+
+        old = KLE_FREE;
     }
 
-    mutex_unlock(&table->kli_kmutex);
+    rcu_read_unlock();
+    keylock_leave(active);
+
+    return 0;
+}
+
+void
+keylock_unlock(struct keylock *handle, u64 hash, struct keylock_cb_rock *rock)
+{
+    struct keylock_impl * table = keylock_h2r(handle);
+    struct keylock_entry *curr;
+    atomic_t *            active;
+    u32                   plen;
+
+    hash = (hash << 16) >> 16;
+
+    active = keylock_enter(table);
+
+    /* If the lock was inherited before the deferred lock set's ref count
+     * reached 0, then the lock isn't really held by the caller and the
+     * CAS fails, so we just return.
+     */
+    curr = keylock_probe(table, hash, false, &plen);
+    if (curr)
+        atomic64_cmpxchg(&curr->kle_rock, (long)rock, KLE_FREE);
+
+    keylock_leave(active);
 }
 
 void
 keylock_search(struct keylock *handle, u64 hash, u64 *pos)
 {
-    struct keylock_impl *table = keylock_h2r(handle);
-    u64                  plen = 0, index;
+    struct keylock_impl * table = keylock_h2r(handle);
+    struct keylock_entry *curr;
+    atomic_t *            active;
+    u32                   plen;
 
     hash = (hash << 16) >> 16;
-    index = (hash + plen) % table->kli_num_entries;
     *pos = table->kli_num_entries;
 
-    mutex_lock(&table->kli_kmutex);
-
-    while (NONEMPTY_ENTRY(&table->kli_entries[index]) &&
-           table->kli_entries[index].kle_plen >= plen) {
-        if (table->kli_entries[index].kle_hash == hash) {
-            *pos = index;
-            break;
-        }
+    active = keylock_enter(table);
 
-        plen++;
-        index++;
-        if (index == table->kli_num_entries)
-            index = 0;
-    }
+    curr = keylock_probe(table, hash, false, &plen);
+    if (curr && atomic64_read(&curr->kle_rock) != KLE_FREE)
+        *pos = curr - table->kli_entries;
 
-    mutex_unlock(&table->kli_kmutex);
+    keylock_leave(active);
 }
 
 void
 keylock_query_stats(struct keylock *handle, struct keylock_stats *stats)
 {
-    memcpy(stats, &(keylock_h2r(handle)->kli_stats), sizeof(*stats));
+    struct keylock_impl *table = keylock_h2r(handle);
+    u64                  i;
+    u32                  cnt = 0;
+
+    for (i = 0; i < table->kli_num_entries; ++i)
+        if (atomic64_read(&table->kli_entries[i].kle_rock) != KLE_FREE)
+            ++cnt;
+
+    if (cnt > table->kli_max_occupied)
+        table->kli_max_occupied = cnt;
+
+    stats->kls_num_occupied = cnt;
+    stats->kls_max_occupied = table->kli_max_occupied;
+    stats->kls_max_probe_len = table->kli_max_probe_len;
+    stats->kls_collisions = atomic64_read(&table->kli_collisions);
+    stats->kls_table_full = atomic64_read(&table->kli_table_full);
 }
@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/atomic.h>
+#include <hse_util/log2.h>
+#include <hse_util/minmax.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/lathist.h>
+
+#define LATHIST_SLOTS (8)
+
+/**
+ * struct lathist_slot - samples recorded by a subset of the cpus
+ * @ls_sum:  sum of the samples (ns)
+ * @ls_max:  largest sample (ns)
+ * @ls_bktv: counts by bucket
+ */
+struct lathist_slot {
+    atomic64_t ls_sum;
+    atomic64_t ls_max;
+    atomic64_t ls_bktv[LATHIST_BKT_MAX];
+} __aligned(SMP_CACHE_BYTES);
+
+/**
+ * struct lathist - latency histogram
+ * @lh_start: time at which the current window began (ns)
+ * @lh_slotv: per-cpu slots
+ */
+struct lathist {
+    atomic64_t          lh_start;
+    struct lathist_slot lh_slotv[LATHIST_SLOTS];
+};
+
+static inline uint
+lathist_bkt(u64 ns)
+{
+    uint exp;
+
+    if (ns < LATHIST_SUB_CNT)
+        return ns;
+
+    exp = ilog2(ns);
+    if (exp >= LATHIST_EXP_MAX)
+        return LATHIST_BKT_MAX - 1;
+
+    return (exp - LATHIST_SUB_BITS + 1) * LATHIST_SUB_CNT +
+           ((ns >> (exp - LATHIST_SUB_BITS)) & (LATHIST_SUB_CNT - 1));
+}
+
+/* Return the largest value that falls into the given bucket.
+ */
+static inline u64
+lathist_bkt_hi(uint bkt)
+{
+    uint grp = bkt / LATHIST_SUB_CNT;
+    uint sub = bkt % LATHIST_SUB_CNT;
+
+    if (grp == 0)
+        return bkt;
+
+    return ((u64)(LATHIST_SUB_CNT + sub + 1) << (grp - 1)) - 1;
+}
+
+merr_t
+lathist_create(struct lathist **lhp)
+{
+    struct lathist *lh;
+
+    if (ev(!lhp))
+        return merr(EINVAL);
+
+    lh = alloc_aligned(sizeof(*lh), __alignof(*lh), 0);
+    if (ev(!lh))
+        return merr(ENOMEM);
+
+    memset(lh, 0, sizeof(*lh));
+    atomic64_set(&lh->lh_start, get_time_ns());
+
+    *lhp = lh;
+
+    return 0;
+}
+
+void
+lathist_destroy(struct lathist *lh)
+{
+    free_aligned(lh);
+}
+
+void
+lathist_add(struct lathist *lh, u64 ns)
+{
+    struct lathist_slot *slot;
+    u64                  max;
+
+    slot = lh->lh_slotv + (raw_smp_processor_id() / 2) % LATHIST_SLOTS;
+
+    atomic64_inc(&slot->ls_bktv[lathist_bkt(ns)]);
+    atomic64_add(ns, &slot->ls_sum);
+
+    max = atomic64_read(&slot->ls_max);
+    while (ns > max) {
+        u64 old = atomic64_cmpxchg(&slot->ls_max, max, ns);
+
+        if (old == max)
+            break;
+        max = old;
+    }
+}
+
+void
+lathist_reset(struct lathist *lh)
+{
+    int i, j;
+
+    atomic64_set(&lh->lh_start, get_time_ns());
+
+    for (i = 0; i < LATHIST_SLOTS; ++i) {
+        struct lathist_slot *slot = lh->lh_slotv + i;
+
+        for (j = 0; j < LATHIST_BKT_MAX; ++j)
+            atomic64_set(&slot->ls_bktv[j], 0);
+
+        atomic64_set(&slot->ls_sum, 0);
+        atomic64_set(&slot->ls_max, 0);
+    }
+}
+
+void
+lathist_snap(struct lathist *lh, struct lathist_snap *snap)
+{
+    u64 window;
+    int i, j;
+
+    for (i = 0; i < LATHIST_SLOTS; ++i) {
+        struct lathist_slot *slot = lh->lh_slotv + i;
+
+        for (j = 0; j < LATHIST_BKT_MAX; ++j) {
+            u64 cnt = atomic64_read(&slot->ls_bktv[j]);
+
+            snap->lss_bktv[j] += cnt;
+            snap->lss_count += cnt;
+        }
+
+        snap->lss_sum += atomic64_read(&slot->ls_sum);
+        snap->lss_max = max_t(u64, snap->lss_max, atomic64_read(&slot->ls_max));
+    }
+
+    window = get_time_ns() - atomic64_read(&lh->lh_start);
+    snap->lss_window = max_t(u64, snap->lss_window, window);
+}
+
+void
+lathist_snap_diff(
+    struct lathist_snap *      diff,
+    const struct lathist_snap *snap,
+    const struct lathist_snap *prev)
+{
+    u64 count = 0;
+    int i;
+
+    for (i = 0; i < LATHIST_BKT_MAX; ++i) {
+        u64 cnt = snap->lss_bktv[i];
+
+        cnt = cnt > prev->lss_bktv[i] ? cnt - prev->lss_bktv[i] : 0;
+        diff->lss_bktv[i] = cnt;
+        count += cnt;
+    }
+
+    diff->lss_count = count;
+    diff->lss_sum = snap->lss_sum > prev->lss_sum ? snap->lss_sum - prev->lss_sum : 0;
+    diff->lss_max = snap->lss_max;
+    diff->lss_window =
+        snap->lss_window > prev->lss_window ? snap->lss_window - prev->lss_window : 0;
+}
+
+u64
+lathist_snap_pct(const struct lathist_snap *snap, double pct)
+{
+    u64 rank, cnt;
+    int i;
+
+    if (!snap->lss_count)
+        return 0;
+
+    pct = clamp_t(double, pct, 0.0, 100.0);
+
+    rank = (u64)(snap->lss_count * pct / 100.0 + 0.5);
+    rank = clamp_t(u64, rank, 1, snap->lss_count);
+
+    cnt = 0;
+    for (i = 0; i < LATHIST_BKT_MAX; ++i) {
+        cnt += snap->lss_bktv[i];
+        if (cnt >= rank)
+            return min_t(u64, lathist_bkt_hi(i), snap->lss_max);
+    }
+
+    return snap->lss_max;
+}
@@ -59,8 +59,7 @@ struct hse_logging_infrastructure hse_logging_inf = {
     .mli_json_buf = 0,  /* buffer to accumulate json elements         */
     .mli_active = 0,    /* has the logging been initialized           */
     .mli_opened = 0,    /* has the logging been "opened"              */
-    .mli_async =
-        {.al_wq = NULL, .al_cons = 0, .al_nb = 0, .al_entries = NULL, .al_th_working = false }
+    .mli_async = {.al_wq = NULL, .al_cons = 0, .al_entries = NULL }
 };
 
 struct hse_log_code {
@@ -102,26 +101,55 @@ _hse_fmt(char *buf, size_t buflen, const char *fmt, ...)
         buf[copylen] = 0;
 }
 
+/**
+ * _hse_log_async_emit() - wrap a message in the log json payload and log it
+ * @async:    async logging state
+ * @priority: priority of the log message
+ * @msg:      text of the message
+ *
+ * Produces the same payload as finalize_log_structure() does for a message
+ * without hse conversion specifiers, but on the consumer thread.
+ */
+static void
+_hse_log_async_emit(struct hse_log_async *async, s32 priority, const char *msg)
+{
+    struct json_context jc = { 0 };
+
+    jc.json_buf = async->al_json_buf;
+    jc.json_buf_sz = MAX_STRUCTURED_DATA_LENGTH;
+
+    json_element_start(&jc, NULL);
+
+    json_element_field(&jc, "type", "%s", "log");
+    json_element_field(&jc, "hse_logver", "%s", HSE_LOGGING_VER);
+    json_element_field(&jc, "hse_version", "%s", hse_version);
+    json_element_field(&jc, "hse_branch", "%s", hse_branch);
+
+    json_element_start(&jc, "content");
+    json_element_field(&jc, "msg", "%s", msg);
+    json_element_end(&jc);
+    json_element_end(&jc);
+
+    hse_slog_emit(priority, "@cee:%s\n", jc.json_buf);
+}
+
 /**
  * _hse_consume_one_async() - log one entry of the circular buffer.
+ * @async: async logging state
  * @entry: entry in the circular buffer that needs to be logged.
  *
  * Locking: no lock held because this entry in the circular buffer can only
  *      be changed by this thread at the moment.
  */
 static void
-_hse_consume_one_async(struct hse_log_async_entry *entry)
+_hse_consume_one_async(struct hse_log_async *async, struct hse_log_async_entry *entry)
 {
-    u32 source_file_len;
-
-    source_file_len = strlen(entry->ae_buf);
-    if (source_file_len >= (sizeof(entry->ae_buf) - 2))
-        /* No room to place anything behind the source file name. */
-        return;
-
     entry->ae_buf[sizeof(entry->ae_buf) - 1] = 0;
 
-    hse_slog_emit(entry->ae_priority, "@cee:%s\n", entry->ae_buf + source_file_len + 1);
+    if (entry->ae_cee)
+        hse_slog_emit(entry->ae_priority, "@cee:%s\n", entry->ae_buf);
+    else
+        _hse_log_async_emit(async, entry->ae_priority, entry->ae_buf);
 }
 
 /**
@@ -130,41 +158,62 @@ _hse_consume_one_async(struct hse_log_async_entry *entry)
  *
  * Process the log messages that were posted in the circular buffer
  * until the circular buffer is empty.
- * It offloads the processing and actual logging of the log messages.
+ * It offloads the formatting and actual logging of the log messages.
  * The posting of log messages in the circular buffer is done via
- * hse_alog() which can safely be called from interrupt context.
+ * hse_alog() which never blocks.
  */
 static void
 _hse_log_async_cons_th(struct work_struct *wstruct)
 {
     struct hse_log_async *      async;
     struct hse_log_async_entry *entry;
-    unsigned long               flags = 0;
+    char                        msg[64];
+    long                        dropped;
     u32                         loop = 0;
 
     async = container_of(wstruct, struct hse_log_async, al_wstruct);
 
     /* Process all the log messages in the circular buffer.
      */
-    spin_lock_irqsave(&async->al_lock, flags);
-
-    while (async->al_nb > 0) {
+    while (1) {
         entry = async->al_entries + async->al_cons % MAX_LOGGING_ASYNC_ENTRIES;
-        spin_unlock_irqrestore(&async->al_lock, flags);
 
-        _hse_consume_one_async(entry);
+        if (atomic64_read_acq(&entry->ae_seq) != async->al_cons + 1) {
+            dropped = atomic64_read(&async->al_dropped);
+            if (dropped != async->al_dropped_seen) {
+                snprintf(
+                    msg, sizeof(msg), "%ld log messages dropped",
+                    dropped - async->al_dropped_seen);
+                _hse_log_async_emit(async, HSE_WARNING_VAL, msg);
+                async->al_dropped_seen = dropped;
+            }
+
+            /* A producer that published an entry after the check
+             * above but saw al_th_working still set relies on us
+             * to consume it, so look again after retiring.
+             */
+            atomic_set(&async->al_th_working, 0);
+            smp_mb();
+
+            if (atomic64_read_acq(&entry->ae_seq) != async->al_cons + 1)
+                break;
+
+            if (atomic_cmpxchg(&async->al_th_working, 0, 1) != 0)
+                break;
+
+            continue;
+        }
+
+        _hse_consume_one_async(async, entry);
+
+        /* Release the entry to the producers of the next lap. */
+        atomic64_fetch_add_rel(MAX_LOGGING_ASYNC_ENTRIES - 1, &entry->ae_seq);
+        async->al_cons++;
 
         /* Don't hog the cpu. */
         if ((++loop % 128) == 0)
             msleep(100);
-
-        spin_lock_irqsave(&async->al_lock, flags);
-        async->al_cons++;
-        async->al_nb--;
     }
-
-    async->al_th_working = false;
-    spin_unlock_irqrestore(&async->al_lock, flags);
 }
 
 merr_t
@@ -175,6 +224,7 @@ hse_logging_init(void)
     char **name_buf = 0, **value_buf = 0;
     void * async_entries = NULL;
     merr_t err;
+    int    i;
 
     struct workqueue_struct *wq = NULL;
     struct hse_log_async *   async;
@@ -237,7 +287,10 @@ hse_logging_init(void)
         goto out_err;
     }
 
-    async_entries = malloc(sizeof(struct hse_log_async_entry) * MAX_LOGGING_ASYNC_ENTRIES);
+    /* The consumer's scratch buffer follows the entries. */
+    async_entries = malloc(
+        sizeof(struct hse_log_async_entry) * MAX_LOGGING_ASYNC_ENTRIES +
+        MAX_STRUCTURED_DATA_LENGTH);
     if (!async_entries) {
         backstop_log("init_hse_logging() failed to allocate "
                      "async entries");
@@ -269,8 +322,17 @@ hse_logging_init(void)
     hse_logging_inf.mli_value_buf = value_buf;
     async = &(hse_logging_inf.mli_async);
     async->al_entries = async_entries;
+    async->al_json_buf = (char *)(async->al_entries + MAX_LOGGING_ASYNC_ENTRIES);
+    for (i = 0; i < MAX_LOGGING_ASYNC_ENTRIES; i++)
+        atomic64_set(&async->al_entries[i].ae_seq, i);
+    atomic64_set(&async->al_head, 0);
+    atomic64_set(&async->al_dropped, 0);
+    async->al_dropped_seen = 0;
+    async->al_cons = 0;
+    atomic_set(&async->al_th_working, 0);
+    atomic_set(&async->al_refs, 0);
+    INIT_WORK(&async->al_wstruct, _hse_log_async_cons_th);
     async->al_wq = wq;
-    spin_lock_init(&async->al_lock);
     hse_logging_inf.mli_active = 1;
 
     hse_logging_control.mlc_cur_pri = HSE_LOG_PRI_DEFAULT;
@@ -370,7 +432,6 @@ hse_logging_fini(void)
 {
     struct workqueue_struct *wq;
     struct hse_log_async *   async;
-    unsigned long            flags;
 
     spin_lock(&hse_logging_lock);
     hse_logging_control.mlc_cur_pri = -1;
@@ -379,13 +440,16 @@ hse_logging_fini(void)
 
     async = &hse_logging_inf.mli_async;
 
-    flags = 0;
-    spin_lock_irqsave(&async->al_lock, flags);
     wq = async->al_wq;
     async->al_wq = NULL;
-    spin_unlock_irqrestore(&async->al_lock, flags);
+    smp_mb();
+
+    /* Wait for producers posting to the circular buffer, and then
+     * for the async logging consumer thread to exit.
+     */
+    while (atomic_read(&async->al_refs) > 0)
+        msleep(1);
 
-    /* Wait for the async logging consumer thread to exit. */
     destroy_workqueue(wq);
 
     spin_lock(&hse_logging_lock);
@@ -414,8 +478,8 @@ hse_logging_fini(void)
      */
     free(async->al_entries);
     async->al_entries = NULL;
+    async->al_json_buf = NULL;
     async->al_cons = 0;
-    async->al_nb = 0;
 
     hse_logging_inf.mli_active = 0;
     hse_logging_inf.mli_opened = 0;
@@ -466,140 +530,111 @@ _hse_closelog(void)
 }
 
 /*
- * _hse_log_post_vasync() - post the log message in a circular buffer.
- * @source_file: source file of the logging site
- * @source_line: line number of the logging site
- * @priority: priority of the log message
- * @fmt_string: the platform-specific format string
- * @args: variable-length argument list
+ * _hse_log_async_claim() - claim the next free entry of the circular buffer
+ * @async: async logging state
  *
- * Locking: can be called from interrupt handler => can't block.
+ * Return: the claimed entry, or NULL if the circular buffer is full.
  */
-static void
-_hse_log_post_vasync(
-    const char *source_file,
-    s32         source_line,
-    s32         priority,
-    const char *fmt_string,
-    va_list     args)
+static struct hse_log_async_entry *
+_hse_log_async_claim(struct hse_log_async *async)
 {
-    struct hse_log_async *      async;
     struct hse_log_async_entry *entry;
-    unsigned long               flags = 0;
-    bool                        start;
-    char *                      buf;
+    long                        pos, seq, old;
 
-    async = &(hse_logging_inf.mli_async);
+    pos = atomic64_read(&async->al_head);
 
-    spin_lock_irqsave(&async->al_lock, flags);
-    if (async->al_nb == MAX_LOGGING_ASYNC_ENTRIES || !async->al_wq) {
-        /* Circular buffer full. */
-        spin_unlock_irqrestore(&async->al_lock, flags);
-        ev(ENOENT);
-        return;
-    }
-
-    /* Next free entry */
-    entry = async->al_entries + (async->al_cons + async->al_nb) % MAX_LOGGING_ASYNC_ENTRIES;
-
-    buf = entry->ae_buf;
-    buf[0] = 0;
-    entry->ae_source_line = source_line;
-    entry->ae_priority = priority;
-
-    /*
-     * Place the source file name at the beginning of the entry buffer
-     * and place a 0 behind.
-     */
-    strncat(buf, (source_file == NULL) ? "" : source_file, sizeof(entry->ae_buf) - 1);
+    while (1) {
+        entry = async->al_entries + pos % MAX_LOGGING_ASYNC_ENTRIES;
+        seq = atomic64_read_acq(&entry->ae_seq);
 
-    /* Move behind the 0 */
-    buf += strlen(buf) + 1;
+        if (seq < pos)
+            return NULL; /* Not yet consumed on the previous lap. */
 
-    /*
-     * If source_file fills up entry->ae_buf completely, vsnprintf()
-     * does nothing.
-     */
-    vsnprintf(buf, sizeof(entry->ae_buf) - (buf - entry->ae_buf), fmt_string, args);
+        if (seq == pos) {
+            old = atomic64_cmpxchg(&async->al_head, pos, pos + 1);
+            if (old == pos)
+                return entry;
 
-    async->al_nb++;
+            pos = old;
+            continue;
+        }
 
-    /* Start the consumer thread if it is not already working. */
-    start = !async->al_th_working;
-    if (start)
-        async->al_th_working = true;
-    spin_unlock_irqrestore(&async->al_lock, flags);
-
-    if (start) {
-        INIT_WORK(&async->al_wstruct, _hse_log_async_cons_th);
-        queue_work(async->al_wq, &async->al_wstruct);
+        /* Another producer claimed this entry, catch up. */
+        pos = atomic64_read(&async->al_head);
     }
 }
 
 /*
- * _hse_log_post_async() - post the log message as json payload
- * in a circular buffer.
- * @source_file: source file of the logging site
+ * _hse_log_post_vasync() - post the log message in a circular buffer.
  * @source_line: line number of the logging site
  * @priority: priority of the log message
- * @payload: fixed length payload
+ * @cee: true if the formatted message is a complete json payload
+ * @fmt_string: the platform-specific format string
+ * @args: variable-length argument list
+ *
+ * Only the message text is formatted by the caller, the consumer thread
+ * does the rest.  If the circular buffer is full, the message is dropped
+ * and counted.
  *
- * Locking: can be called from interrupt handler => can't block.
+ * Locking: lock-free, never blocks.
  */
 static void
-_hse_log_post_async(const char *source_file, s32 source_line, s32 priority, char *payload)
+_hse_log_post_vasync(s32 source_line, s32 priority, bool cee, const char *fmt_string, va_list args)
 {
     struct hse_log_async *      async;
     struct hse_log_async_entry *entry;
-    unsigned long               flags = 0;
-    bool                        start;
-    char *                      buf;
+    struct workqueue_struct *   wq;
 
     async = &(hse_logging_inf.mli_async);
 
-    spin_lock_irqsave(&async->al_lock, flags);
-    if (async->al_nb == MAX_LOGGING_ASYNC_ENTRIES || !async->al_wq) {
+    atomic_inc_acq(&async->al_refs);
+
+    wq = async->al_wq;
+    if (!wq)
+        goto out;
+
+    entry = _hse_log_async_claim(async);
+    if (!entry) {
         /* Circular buffer full. */
-        spin_unlock_irqrestore(&async->al_lock, flags);
+        atomic64_inc(&async->al_dropped);
         ev(ENOENT);
-        return;
+        goto out;
     }
 
-    /* Next free entry */
-    entry = async->al_entries + (async->al_cons + async->al_nb) % MAX_LOGGING_ASYNC_ENTRIES;
-
-    buf = entry->ae_buf;
-    buf[0] = 0;
     entry->ae_source_line = source_line;
     entry->ae_priority = priority;
+    entry->ae_cee = cee;
+    vsnprintf(entry->ae_buf, sizeof(entry->ae_buf), fmt_string, args);
 
-    /*
-     * Place the source file name at the beginning of the entry buffer
-     * and place a 0 behind.
-     */
-    strncat(buf, (source_file == NULL) ? "" : source_file, sizeof(entry->ae_buf) - 1);
+    /* Publish the entry to the consumer. */
+    atomic64_inc_rel(&entry->ae_seq);
 
-    /* Move behind the 0 */
-    buf += strlen(buf) + 1;
+    /* Start the consumer thread if it is not already working. */
+    smp_mb();
+    if (!atomic_read(&async->al_th_working) && !atomic_cmpxchg(&async->al_th_working, 0, 1))
+        queue_work(wq, &async->al_wstruct);
 
-    /*
-     * If source_file fills up entry->ae_buf completely, vsnprintf()
-     * does nothing.
-     */
-    snprintf(buf, sizeof(entry->ae_buf) - (buf - entry->ae_buf), "%s", payload);
+out:
+    atomic_dec_rel(&async->al_refs);
+}
 
-    async->al_nb++;
+/*
+ * _hse_log_post_async() - post the log message in a circular buffer.
+ * @source_line: line number of the logging site
+ * @priority: priority of the log message
+ * @cee: true if the formatted message is a complete json payload
+ * @fmt_string: the platform-specific format string
+ *
+ * Locking: lock-free, never blocks.
+ */
+static void
+_hse_log_post_async(s32 source_line, s32 priority, bool cee, const char *fmt_string, ...)
+{
+    va_list args;
 
-    /* Start the consumer thread if it is not already working. */
-    start = !async->al_th_working;
-    if (start)
-        async->al_th_working = true;
-    spin_unlock_irqrestore(&async->al_lock, flags);
-
-    if (start) {
-        INIT_WORK(&async->al_wstruct, _hse_log_async_cons_th);
-        queue_work(async->al_wq, &async->al_wstruct);
-    }
+    va_start(args, fmt_string);
+    _hse_log_post_vasync(source_line, priority, cee, fmt_string, args);
+    va_end(args);
 }
 
 /*
@@ -645,6 +680,16 @@ _hse_log(
     if (priority > hse_logging_control.mlc_cur_pri)
         return;
 
+    /* Messages without hse conversion specifiers need no scratch space,
+     * only their text is formatted here and they bypass the lock.
+     */
+    if (async && !hse_args) {
+        va_start(args, hse_args);
+        _hse_log_post_vasync(source_line, priority, false, fmt_string, args);
+        va_end(args);
+        return;
+    }
+
     spin_lock_irqsave(&hse_logging_lock, flags);
 
     if (priority > hse_logging_control.mlc_cur_pri)
@@ -1153,7 +1198,7 @@ finalize_log_structure(
     json_element_end(&jc);
 
     if (async)
-        _hse_log_post_async(source_file, source_line, priority, jc.json_buf);
+        _hse_log_post_async(source_line, priority, true, "%s", jc.json_buf);
     else
         hse_slog_emit(priority, "@cee:%s\n", jc.json_buf);
 }
@@ -1368,7 +1413,7 @@ hse_slog_internal(int priority, const char *fmt, ...)
         buf = hse_logging_inf.mli_fmt_buf;
     }
 
-    _hse_log_post_vasync("_hse_slog", 1, priority, buf, payload);
+    _hse_log_post_vasync(1, priority, true, buf, payload);
 
     spin_unlock_irqrestore(&hse_logging_lock, flags);
     va_end(payload);
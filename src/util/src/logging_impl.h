@@ -8,6 +8,8 @@
 
 #include <hse_util/logging.h>
 #include <hse_util/inttypes.h>
+#include <hse_util/arch.h>
+#include <hse_util/atomic.h>
 #include <hse_util/workqueue.h>
 #include <hse_util/mutex.h>
 #include <hse_util/spinlock.h>
@@ -25,7 +27,8 @@
  *      If the async log messages are posted faster then the consumer thread
  *      hse_log_async_cons_th() can consume them, the max capacity of the
  *      circular buffer is reached (MAX_LOGGING_ASYNC_ENTRIES). Beyond that,
- *      new async log messages are dropped.
+ *      new async log messages are dropped and counted, and the consumer
+ *      logs the number of messages dropped once it catches up.
  */
 #define MAX_LOGGING_ASYNC_ENTRIES 256
 
@@ -85,43 +88,57 @@ enum std_length_modifier {
 /**
  * struct hse_log_async_entry - an asynchronous log message in the circular
  * buffer.
+ * @ae_seq: ring position at which the entry may next be claimed by a
+ *      producer (pos), or consumed (pos + 1) once the producer has
+ *      filled it in.
  * @ae_source_line:
  * @ae_priority:
- * @ae_buf: The format is: <source filename>0<string>
- *      with "string" 0 terminated. While is should not happen, string may be
- *      empty or not be there at all if <source filename> it too big.
- *      "string" is logged by the async log consumer thread with a format %s.
+ * @ae_cee: ae_buf is a complete json payload, otherwise it is the text
+ *      of the message which the consumer wraps in the log json payload.
+ * @ae_buf: 0 terminated string, logged by the async log consumer thread.
  */
 struct hse_log_async_entry {
-    s32  ae_source_line;
-    s32  ae_priority;
-    char ae_buf[MAX_STRUCTURED_DATA_LENGTH];
+    atomic64_t ae_seq;
+    s32        ae_source_line;
+    s32        ae_priority;
+    bool       ae_cee;
+    char       ae_buf[MAX_STRUCTURED_DATA_LENGTH];
 };
 
 /**
- * struct hse_log_async - allow to log from interrupt context.
+ * struct hse_log_async - allow to log without blocking.
  *      The log messages are only stored in a circular buffer attached to
  *      structure. The thread _hse_log_async_cons_th() process them later.
+ *      Producers claim entries with a cmpxchg on @al_head and publish them
+ *      by advancing the entry's sequence number, so posting a message never
+ *      takes a lock nor waits for the consumer.
+ * @al_wq:
  * @al_wstruct:
- * @al_lock: must be a spinlock because used from interrupt context.
- *      Protect the fields below.
- * @al_th_working: true if the async log consumer thread is working.
- * @al_cons: always increasing and rolling integer.
+ * @al_th_working: 1 if the async log consumer thread is working (or has
+ *      been queued to work).
+ * @al_refs: number of producers accessing the circular buffer.
+ * @al_cons: always increasing integer.
  *      al_cons%MAX_LOGGING_ASYNC_ENTRIES is the index in al_entries[]
  *      where the next entry to consume is located.
  *      Only changed by the thread _hse_log_async_cons_th().
- * @al_nb: 0 <= al_nb <= MAX_LOGGING_ASYNC_ENTRIES. Number on entries
- *      in al_entries[] ready to be consumed.
+ * @al_dropped_seen: value of @al_dropped last reported by the consumer.
+ * @al_json_buf: scratch buffer of the consumer thread.
  * @al_entries: circular buffer of log messages.
+ * @al_head: ring position of the next entry to be claimed by a producer.
+ * @al_dropped: number of messages dropped because the buffer was full.
  */
 struct hse_log_async {
     struct workqueue_struct *   al_wq;
     struct work_struct          al_wstruct;
-    spinlock_t                  al_lock;
-    bool                        al_th_working;
-    u32                         al_cons;
-    u32                         al_nb;
+    atomic_t                    al_th_working;
+    atomic_t                    al_refs;
+    u64                         al_cons;
+    long                        al_dropped_seen;
+    char *                      al_json_buf;
     struct hse_log_async_entry *al_entries;
+
+    atomic64_t al_head __aligned(SMP_CACHE_BYTES);
+    atomic64_t al_dropped;
 };
 
 struct hse_logging_infrastructure {
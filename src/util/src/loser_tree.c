@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/arch.h>
+#include <hse_util/assert.h>
+#include <hse_util/alloc.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/loser_tree.h>
+
+/* The leaves of a tree of width n are the virtual nodes n..2n-1, such that
+ * leaf i is node n + i and the parent of node j is node j / 2.  Internal
+ * nodes 1..n-1 hold the loser of the match played there and node 0 holds
+ * the overall winner.
+ */
+
+/* Return true if leaf a wins its match against leaf b.  An exhausted source
+ * loses to every other source.
+ */
+static __always_inline bool
+lt_beats(struct loser_tree *lt, u32 a, u32 b)
+{
+    const struct lt_leaf *la = lt->lt_leafv + a;
+    const struct lt_leaf *lb = lt->lt_leafv + b;
+    int                   rc;
+
+    if (unlikely(!la->ll_data || !lb->ll_data))
+        return la->ll_data || (!lb->ll_data && a < b);
+
+    if (la->ll_pfx != lb->ll_pfx)
+        return la->ll_pfx < lb->ll_pfx;
+
+    rc = lt->lt_cmp(la->ll_data, lb->ll_data);
+
+    return rc ? rc < 0 : a < b;
+}
+
+static __always_inline void
+lt_fetch(struct loser_tree *lt, u32 leaf)
+{
+    struct lt_leaf *ll = lt->lt_leafv + leaf;
+
+    if (!ll->ll_es || !ll->ll_es->es_get_next(ll->ll_es, &ll->ll_data))
+        ll->ll_data = NULL;
+    else if (lt->lt_pfx)
+        ll->ll_pfx = lt->lt_pfx(ll->ll_data);
+}
+
+/* Play the matches of the subtree rooted at the given node and return
+ * the winning leaf.
+ */
+static u32
+lt_build(struct loser_tree *lt, u32 node)
+{
+    u32 a, b;
+
+    if (node >= lt->lt_width)
+        return node - lt->lt_width;
+
+    a = lt_build(lt, 2 * node);
+    b = lt_build(lt, 2 * node + 1);
+
+    if (lt_beats(lt, a, b)) {
+        lt->lt_node[node] = b;
+        return a;
+    }
+
+    lt->lt_node[node] = a;
+    return b;
+}
+
+merr_t
+loser_tree_create(
+    u32                    max_width,
+    loser_tree_compare_fn *cmp,
+    loser_tree_pfx_fn *    pfx,
+    struct loser_tree **   lt_out)
+{
+    struct loser_tree *lt;
+    size_t             sz;
+
+    if (ev(!lt_out || !cmp || max_width == 0))
+        return merr(EINVAL);
+
+    sz = sizeof(*lt) + max_width * sizeof(lt->lt_leafv[0]);
+
+    lt = alloc_aligned(sz + max_width * sizeof(*lt->lt_node), SMP_CACHE_BYTES, GFP_KERNEL);
+    if (ev(!lt))
+        return merr(ENOMEM);
+
+    memset(lt, 0, sz);
+    lt->lt_max_width = max_width;
+    lt->lt_cmp = cmp;
+    lt->lt_pfx = pfx;
+    lt->lt_node = (void *)lt + sz;
+
+    *lt_out = lt;
+
+    return 0;
+}
+
+void
+loser_tree_destroy(struct loser_tree *lt)
+{
+    free_aligned(lt);
+}
+
+merr_t
+loser_tree_prepare(struct loser_tree *lt, u32 width, struct element_source *es[])
+{
+    u32 i;
+
+    if (ev(width > lt->lt_max_width))
+        return merr(EOVERFLOW);
+
+    lt->lt_width = width;
+    if (width == 0)
+        return 0;
+
+    for (i = 0; i < width; ++i) {
+        lt->lt_leafv[i].ll_es = es[i];
+        lt->lt_leafv[i].ll_pfx = 0;
+        if (es[i])
+            es[i]->es_sort = i;
+
+        lt_fetch(lt, i);
+    }
+
+    lt->lt_node[0] = lt_build(lt, 1);
+
+    return 0;
+}
+
+u32
+loser_tree_width(struct loser_tree *lt)
+{
+    u32 i, n = 0;
+
+    if (!lt)
+        return 0;
+
+    for (i = 0; i < lt->lt_width; ++i)
+        n += !!lt->lt_leafv[i].ll_data;
+
+    return n;
+}
+
+void
+loser_tree_refetch(struct loser_tree *lt, u32 leaf)
+{
+    assert(leaf < lt->lt_width);
+
+    lt_fetch(lt, leaf);
+}
+
+void
+loser_tree_rebuild(struct loser_tree *lt)
+{
+    if (lt->lt_width > 0)
+        lt->lt_node[0] = lt_build(lt, 1);
+}
+
+bool
+loser_tree_pop(struct loser_tree *lt, void **item)
+{
+    u32 winner, node, tmp;
+
+    if (!loser_tree_peek(lt, item))
+        return false;
+
+    winner = lt->lt_node[0];
+    lt_fetch(lt, winner);
+
+    /* Replay the path from the winner's leaf to the root, where at each
+     * node the incoming leaf plays the loser of the previous match.
+     */
+    for (node = (lt->lt_width + winner) / 2; node > 0; node /= 2) {
+        if (lt_beats(lt, lt->lt_node[node], winner)) {
+            tmp = lt->lt_node[node];
+            lt->lt_node[node] = winner;
+            winner = tmp;
+        }
+    }
+
+    lt->lt_node[0] = winner;
+
+    return true;
+}
@@ -17,6 +17,9 @@
 
 #include <3rdparty/rbtree.h>
 
+#include <ctype.h>
+#include <stdarg.h>
+
 #define PERFC_PRIO_MIN 1
 #define PERFC_PRIO_MAX 4
 
@@ -77,8 +80,7 @@ perfc_ctrseti_clear(struct perfc_seti *seti)
             case PERFC_TYPE_DI:
             case PERFC_TYPE_LT:
                 dis = &seti->pcs_ctrv[cidx].dis;
-                dis->pdi_min = 0;
-                dis->pdi_max = 0;
+                memset(dis->pdi_shardv, 0, sizeof(*dis->pdi_shardv) * dis->pdi_shardc);
                 break;
 
             case PERFC_TYPE_SL:
@@ -187,6 +189,28 @@ perfc_ra_emit(struct perfc_rate *rate, struct yaml_context *yc)
     }
 }
 
+/**
+ * perfc_dis_bkt_read() - sum one bucket of a distribution over all cpus
+ * @dis:   distribution counter
+ * @bkt:   bucket index
+ * @sum:   (output) sum of the samples in the bucket
+ * @hits:  (output) number of samples in the bucket
+ */
+static void
+perfc_dis_bkt_read(const struct perfc_dis *dis, uint bkt, ulong *sum, ulong *hits)
+{
+    uint i;
+
+    *sum = *hits = 0;
+
+    for (i = 0; i < dis->pdi_shardc; ++i) {
+        const struct perfc_bkt *b = dis->pdi_shardv[i].pds_bktv + bkt;
+
+        *sum += atomic64_read(&b->pcb_vadd);
+        *hits += atomic64_read(&b->pcb_hits);
+    }
+}
+
 static void
 perfc_di_emit(struct perfc_dis *dis, struct yaml_context *yc)
 {
@@ -194,6 +218,7 @@ perfc_di_emit(struct perfc_dis *dis, struct yaml_context *yc)
 
     size_t valoff, avgoff, hitoff, bktoff;
     ulong  samples, avg, sum, bound;
+    ulong  min, max;
     char   valstr[(PERFC_IVL_MAX + 1) * 12];
     char   hitstr[(PERFC_IVL_MAX + 1) * 12];
     char   avgstr[(PERFC_IVL_MAX + 1) * 12];
@@ -205,18 +230,10 @@ perfc_di_emit(struct perfc_dis *dis, struct yaml_context *yc)
     samples = sum = bound = 0;
 
     for (i = 0; i < ivl->ivl_cnt + 1; ++i) {
-        struct perfc_bkt *bkt;
-        ulong             hits, val, largest;
-        int               width = 3;
+        ulong hits, val, largest;
+        int   width = 3;
 
-        bkt = dis->pdi_hdr.pch_bktv + i;
-        hits = val = 0;
-
-        for (j = 0; j < PERFC_GRP_MAX; ++j) {
-            val += atomic64_read(&bkt->pcb_vadd);
-            hits += atomic64_read(&bkt->pcb_hits);
-            bkt += PERFC_IVL_MAX + 1;
-        }
+        perfc_dis_bkt_read(dis, i, &val, &hits);
 
         avg = (hits > 0) ? val / hits : 0;
 
@@ -245,10 +262,21 @@ perfc_di_emit(struct perfc_dis *dis, struct yaml_context *yc)
      */
     yaml_element_field(yc, "distribution", valstr);
 
-    u64_to_string(valstr, sizeof(valstr), dis->pdi_min);
+    min = max = 0;
+
+    for (j = 0; j < dis->pdi_shardc; ++j) {
+        const struct perfc_dis_shard *shard = dis->pdi_shardv + j;
+
+        if (shard->pds_min > 0 && (min == 0 || shard->pds_min < min))
+            min = shard->pds_min;
+        if (shard->pds_max > max)
+            max = shard->pds_max;
+    }
+
+    u64_to_string(valstr, sizeof(valstr), min);
     yaml_element_field(yc, "min", valstr);
 
-    u64_to_string(valstr, sizeof(valstr), dis->pdi_max);
+    u64_to_string(valstr, sizeof(valstr), max);
     yaml_element_field(yc, "max", valstr);
 
     avg = (samples > 0) ? sum / samples : 0;
@@ -687,17 +715,20 @@ perfc_ctrseti_alloc(
     const char *             ctrseti_name,
     struct perfc_set *       setp)
 {
-    struct perfc_seti *seti;
-    struct dt_element *dte;
-    char               path[DT_PATH_LEN];
-    char               family[DT_PATH_LEN] = "";
-    u32                err = 0;
-    const char *       famptr;
-    size_t             sz;
-    char *             meaning;
-    u32                famlen;
-    u32                type;
-    u32                i;
+    struct perfc_dis_shard *shardv;
+    struct perfc_seti *     seti;
+    struct dt_element *     dte;
+    char                    path[DT_PATH_LEN];
+    char                    family[DT_PATH_LEN] = "";
+    u32                     err = 0;
+    const char *            famptr;
+    size_t                  sz, ctrsz;
+    char *                  meaning;
+    u32                     famlen;
+    u32                     type;
+    u32                     shardc;
+    u32                     disc;
+    u32                     i;
 
     assert(setp);
 
@@ -720,12 +751,18 @@ perfc_ctrseti_alloc(
      * '_' character.
      *
      */
+    disc = 0;
+
     for (i = 0; i < ctrc; i++) {
         const char *name = ctrv[i].pcn_name;
 
-        if (ev(perfc_ctr_name2type(name) == PERFC_TYPE_INVAL))
+        type = perfc_ctr_name2type(name);
+        if (ev(type == PERFC_TYPE_INVAL))
             return merr(EINVAL);
 
+        if (type == PERFC_TYPE_DI || type == PERFC_TYPE_LT)
+            ++disc;
+
         /* family name is after PERFC_XX_ */
         famptr = name + strlen(PERFC_CTR_IDX_END);
 
@@ -788,9 +825,13 @@ perfc_ctrseti_alloc(
 
     /* Allocate the counter set instance in one big chunk so that addresses
      * of individual counters can be determined via computation rather than
-     * indirection via a series of pointers.
+     * indirection via a series of pointers.  The per-cpu shards of the
+     * distribution counters follow the counters.
      */
-    sz = sizeof(*seti) + sizeof(seti->pcs_ctrv[0]) * ctrc;
+    shardc = clamp_t(u32, num_online_cpus(), 1, PERFC_PCV_MAX);
+
+    ctrsz = ALIGN(sizeof(*seti) + sizeof(seti->pcs_ctrv[0]) * ctrc, SMP_CACHE_BYTES);
+    sz = ctrsz + sizeof(*shardv) * shardc * disc;
 
     seti = alloc_aligned(sz, __alignof(*seti), GFP_KERNEL);
     if (ev(!seti)) {
@@ -806,6 +847,8 @@ perfc_ctrseti_alloc(
     seti->pcs_ctrnamev = ctrv;
     seti->pcs_ctrc = ctrc;
 
+    shardv = (void *)seti + ctrsz;
+
     /* For each counter in the set, initialize the counter according
      * to the counter type.
      */
@@ -836,6 +879,9 @@ perfc_ctrseti_alloc(
 
             dis->pdi_pct = entry->pcn_samplepct * PERFC_PCT_SCALE / 100;
             dis->pdi_ivl = ivl;
+            dis->pdi_shardc = shardc;
+            dis->pdi_shardv = shardv;
+            shardv += shardc;
         }
     }
 
@@ -904,21 +950,21 @@ perfc_ctrseti_invalidate_handle(struct perfc_set *set)
     dt_iterate_cmd(dt_data_tree, DT_OP_SET, dsp.path, &dip, 0, 0, 0);
 }
 
-_Static_assert(sizeof(struct perfc_val) >= sizeof(struct perfc_bkt), "sizeof perfc_bkt too large");
-
 static __always_inline void
 perfc_latdis_record(struct perfc_dis *dis, u64 sample)
 {
-    struct perfc_bkt *bkt;
-    u32               i;
+    struct perfc_dis_shard *shard;
+    struct perfc_bkt *      bkt;
+    u32                     i;
+
+    shard = dis->pdi_shardv + perfc_cpu(dis->pdi_shardc);
 
-    if (sample > dis->pdi_max)
-        dis->pdi_max = sample;
-    else if ((sample < dis->pdi_min) || (dis->pdi_min == 0))
-        dis->pdi_min = sample;
+    if (sample > shard->pds_max)
+        shard->pds_max = sample;
+    else if ((sample < shard->pds_min) || (shard->pds_min == 0))
+        shard->pds_min = sample;
 
-    bkt = dis->pdi_hdr.pch_bktv;
-    bkt += ((raw_smp_processor_id() / 4) % PERFC_GRP_MAX) * (PERFC_IVL_MAX + 1);
+    bkt = shard->pds_bktv;
 
     /* Index into ivl_map[] with ilog2(sample) to skip buckets whose bounds
      * are smaller than sample.  Note that we constrain sample to produce an
@@ -970,6 +1016,388 @@ perfc_cleanup(const char *component)
     return count;
 }
 
+/* OpenMetrics exposition of the counter sets (see perfc_om_emit()).
+ *
+ * The counter set instances under the given path are visited with the data
+ * tree locked, and the samples of each enabled counter are rendered into a
+ * record.  The records are then sorted by counter name so that the samples
+ * of a metric are contiguous (as the format requires) and are emitted after
+ * the metric's TYPE and HELP lines.
+ */
+
+/**
+ * struct perfc_om_rec - samples of one counter of one counter set instance
+ * @por_pcn:  counter name and description
+ * @por_type: enum perfc_type
+ * @por_seq:  visit order, makes the sort stable
+ * @por_off:  offset of the samples in the text buffer
+ * @por_len:  length of the samples
+ */
+struct perfc_om_rec {
+    const struct perfc_name *por_pcn;
+    u32                      por_type;
+    u32                      por_seq;
+    size_t                   por_off;
+    size_t                   por_len;
+};
+
+/**
+ * struct perfc_om - state of an OpenMetrics emission
+ * @po_families: comma separated families to emit, NULL for all
+ * @po_buf:      text buffer
+ * @po_bufsz:    size of %po_buf
+ * @po_off:      length of the text in %po_buf
+ * @po_recv:     records
+ * @po_recc:     number of records
+ * @po_recmax:   capacity of %po_recv
+ * @po_err:      first error
+ */
+struct perfc_om {
+    const char *         po_families;
+    char *               po_buf;
+    size_t               po_bufsz;
+    size_t               po_off;
+    struct perfc_om_rec *po_recv;
+    u32                  po_recc;
+    u32                  po_recmax;
+    merr_t               po_err;
+};
+
+static __printf(2, 3) void
+perfc_om_printf(struct perfc_om *om, const char *fmt, ...)
+{
+    va_list ap;
+    size_t  avail;
+    char *  buf;
+    int     n;
+
+    if (om->po_err)
+        return;
+
+    while (1) {
+        avail = om->po_bufsz - om->po_off;
+
+        va_start(ap, fmt);
+        n = vsnprintf(om->po_buf + om->po_off, avail, fmt, ap);
+        va_end(ap);
+
+        if (n < avail)
+            break;
+
+        buf = realloc(om->po_buf, om->po_bufsz * 2 + n);
+        if (ev(!buf)) {
+            om->po_err = merr(ENOMEM);
+            return;
+        }
+
+        om->po_buf = buf;
+        om->po_bufsz = om->po_bufsz * 2 + n;
+    }
+
+    om->po_off += n;
+}
+
+/* Append a copy of the text at offset %off in the buffer.
+ */
+static void
+perfc_om_copy(struct perfc_om *om, size_t off, size_t len)
+{
+    char *buf;
+
+    if (om->po_err)
+        return;
+
+    if (om->po_off + len >= om->po_bufsz) {
+        buf = realloc(om->po_buf, om->po_bufsz * 2 + len);
+        if (ev(!buf)) {
+            om->po_err = merr(ENOMEM);
+            return;
+        }
+
+        om->po_buf = buf;
+        om->po_bufsz = om->po_bufsz * 2 + len;
+    }
+
+    memcpy(om->po_buf + om->po_off, om->po_buf + off, len);
+    om->po_off += len;
+}
+
+/* Metric names are the counter names less their "PERFC_<type>_" prefix,
+ * in lower case and prefixed with "hse_" (e.g., PERFC_LT_PKVSL_KVS_PUT is
+ * hse_pkvsl_kvs_put).
+ */
+static void
+perfc_om_name(const struct perfc_name *pcn, char *buf, size_t bufsz)
+{
+    const char *src = pcn->pcn_name + strlen(PERFC_CTR_IDX_END);
+    size_t      i;
+
+    i = strlcpy(buf, "hse_", bufsz);
+
+    for (; *src && i < bufsz - 1; ++src)
+        buf[i++] = tolower(*src);
+    buf[i] = '\000';
+}
+
+/* Counter set instances live at /data/perfc/<component>/<name>/<family>/<set>,
+ * where <name> is "<kvdb>", "<kvdb>:<kvs>" or "global".  Render that as the
+ * labels component, kvdb, kvs and set.
+ */
+static void
+perfc_om_labels(struct perfc_seti *seti, char *buf, size_t bufsz)
+{
+    char  path[DT_PATH_LEN];
+    char *comp, *name, *kvs, *end;
+    int   n;
+
+    buf[0] = '\000';
+
+    strlcpy(path, seti->pcs_path + strlen(PERFC_ROOT_PATH "/"), sizeof(path));
+
+    comp = path;
+    name = strchr(comp, '/');
+    end = strrchr(path, '/');
+    if (!name)
+        return;
+
+    *name++ = '\000';
+
+    /* Strip "/<family>/<set>", <name> may itself contain slashes.
+     */
+    while (end > name && *--end != '/')
+        ;
+    if (end > name)
+        *end = '\000';
+
+    n = snprintf(buf, bufsz, "component=\"%s\"", comp);
+
+    if (strcmp(name, "global")) {
+        kvs = strchr(name, ':');
+        if (kvs)
+            *kvs++ = '\000';
+
+        n += snprintf(buf + n, bufsz - min_t(size_t, n, bufsz), ",kvdb=\"%s\"", name);
+        if (kvs)
+            n += snprintf(buf + n, bufsz - min_t(size_t, n, bufsz), ",kvs=\"%s\"", kvs);
+    }
+
+    snprintf(buf + n, bufsz - min_t(size_t, n, bufsz), ",set=\"%s\"", seti->pcs_ctrseti_name);
+}
+
+static bool
+perfc_om_family_match(const char *families, const char *family)
+{
+    size_t len = strlen(family);
+
+    while (families && *families) {
+        if (!strncasecmp(families, family, len) &&
+            (families[len] == ',' || families[len] == '\000'))
+            return true;
+
+        families = strchr(families, ',');
+        if (families)
+            ++families;
+    }
+
+    return false;
+}
+
+static void
+perfc_om_samples(struct perfc_om *om, union perfc_ctru *ctr, const char *name, const char *labels)
+{
+    struct perfc_ctr_hdr *hdr = &ctr->hdr;
+    const struct perfc_ivl *ivl;
+    u64                     vadd, vsub, hits, sum;
+    int                     i;
+
+    switch (hdr->pch_type) {
+        case PERFC_TYPE_BA:
+            _gather_values(hdr, &vadd, &vsub);
+            perfc_om_printf(om, "%s{%s} %lu\n", name, labels, vadd > vsub ? vadd - vsub : 0);
+            break;
+
+        case PERFC_TYPE_RA:
+            _gather_values(hdr, &vadd, &vsub);
+            perfc_om_printf(om, "%s_total{%s} %lu\n", name, labels, vadd > vsub ? vadd - vsub : 0);
+            break;
+
+        case PERFC_TYPE_SL:
+            _gather_values(hdr, &vadd, &vsub);
+            perfc_om_printf(om, "%s_sum{%s} %lu\n", name, labels, vadd);
+            perfc_om_printf(om, "%s_count{%s} %lu\n", name, labels, vsub);
+            break;
+
+        case PERFC_TYPE_DI:
+        case PERFC_TYPE_LT:
+            ivl = ctr->dis.pdi_ivl;
+            hits = sum = 0;
+
+            /* Bucket i holds the samples less than ivl_bound[i] that are
+             * not in a lower bucket, the last bucket holds the rest.
+             */
+            for (i = 0; i < ivl->ivl_cnt + 1; ++i) {
+                ulong bktsum, bkthits;
+
+                perfc_dis_bkt_read(&ctr->dis, i, &bktsum, &bkthits);
+                sum += bktsum;
+                hits += bkthits;
+
+                if (i < ivl->ivl_cnt)
+                    perfc_om_printf(
+                        om, "%s_bucket{%s,le=\"%lu\"} %lu\n", name, labels, ivl->ivl_bound[i], hits);
+                else
+                    perfc_om_printf(om, "%s_bucket{%s,le=\"+Inf\"} %lu\n", name, labels, hits);
+            }
+
+            perfc_om_printf(om, "%s_sum{%s} %lu\n", name, labels, sum);
+            perfc_om_printf(om, "%s_count{%s} %lu\n", name, labels, hits);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static size_t
+perfc_om_visit(struct dt_element *dte, void *arg)
+{
+    struct perfc_om *   om = arg;
+    struct perfc_seti * seti;
+    struct perfc_om_rec *rec;
+    char                labels[DT_PATH_LEN * 2];
+    char                name[DT_PATH_LEN];
+    u32                 cidx;
+
+    if (dte->dte_type != DT_TYPE_PERFC || om->po_err)
+        return 0;
+
+    seti = dte->dte_data;
+    if (!seti->pcs_handle)
+        return 0;
+
+    if (om->po_families && !perfc_om_family_match(om->po_families, seti->pcs_famname))
+        return 0;
+
+    perfc_om_labels(seti, labels, sizeof(labels));
+
+    for (cidx = 0; cidx < seti->pcs_ctrc; ++cidx) {
+        if (!(seti->pcs_handle->ps_bitmap & (1ul << cidx)))
+            continue;
+
+        if (om->po_recc >= om->po_recmax) {
+            rec = realloc(om->po_recv, sizeof(*rec) * (om->po_recmax * 2 + 64));
+            if (ev(!rec)) {
+                om->po_err = merr(ENOMEM);
+                return 0;
+            }
+
+            om->po_recv = rec;
+            om->po_recmax = om->po_recmax * 2 + 64;
+        }
+
+        rec = om->po_recv + om->po_recc;
+        rec->por_pcn = seti->pcs_ctrnamev + cidx;
+        rec->por_type = seti->pcs_ctrv[cidx].hdr.pch_type;
+        rec->por_seq = om->po_recc;
+        rec->por_off = om->po_off;
+
+        perfc_om_name(rec->por_pcn, name, sizeof(name));
+        perfc_om_samples(om, seti->pcs_ctrv + cidx, name, labels);
+
+        rec->por_len = om->po_off - rec->por_off;
+        ++om->po_recc;
+    }
+
+    return 1;
+}
+
+static int
+perfc_om_rec_cmp(const void *lhs, const void *rhs)
+{
+    const struct perfc_om_rec *l = lhs;
+    const struct perfc_om_rec *r = rhs;
+    int                        rc;
+
+    rc = strcmp(l->por_pcn->pcn_name, r->por_pcn->pcn_name);
+
+    return rc ?: (l->por_seq < r->por_seq ? -1 : 1);
+}
+
+merr_t
+perfc_om_emit(const char *path, const char *families, char **bufp, size_t *lenp)
+{
+    static const char *const typev[] = {
+        [PERFC_TYPE_BA] = "gauge",     [PERFC_TYPE_RA] = "counter",
+        [PERFC_TYPE_DI] = "histogram", [PERFC_TYPE_LT] = "histogram",
+        [PERFC_TYPE_SL] = "summary",
+    };
+
+    struct dt_visit_parameters  dvp;
+    union dt_iterate_parameters dip = {.dvp = &dvp };
+    struct perfc_om             om = { 0 };
+    const struct perfc_name *   prev = NULL;
+    char                        name[DT_PATH_LEN];
+    char *                      buf;
+    size_t                      off;
+    u32                         i;
+
+    om.po_families = (families && *families) ? families : NULL;
+    om.po_bufsz = 64 * 1024;
+    om.po_buf = malloc(om.po_bufsz);
+    if (ev(!om.po_buf))
+        return merr(ENOMEM);
+
+    dvp.visit = perfc_om_visit;
+    dvp.arg = &om;
+
+    dt_iterate_cmd(dt_data_tree, DT_OP_VISIT, path, &dip, NULL, NULL, NULL);
+
+    if (om.po_err)
+        goto errout;
+
+    qsort(om.po_recv, om.po_recc, sizeof(*om.po_recv), perfc_om_rec_cmp);
+
+    /* Emit the sorted samples after the text of the unsorted ones,
+     * then move them to the front of the buffer.
+     */
+    off = om.po_off;
+
+    for (i = 0; i < om.po_recc; ++i) {
+        struct perfc_om_rec *rec = om.po_recv + i;
+
+        if (rec->por_pcn != prev && (!prev || strcmp(rec->por_pcn->pcn_name, prev->pcn_name))) {
+            perfc_om_name(rec->por_pcn, name, sizeof(name));
+            perfc_om_printf(&om, "# TYPE %s %s\n", name, typev[rec->por_type]);
+            perfc_om_printf(&om, "# HELP %s %s\n", name, rec->por_pcn->pcn_desc);
+        }
+        prev = rec->por_pcn;
+
+        perfc_om_copy(&om, rec->por_off, rec->por_len);
+    }
+
+    perfc_om_printf(&om, "# EOF\n");
+
+    if (om.po_err)
+        goto errout;
+
+    buf = om.po_buf;
+    memmove(buf, buf + off, om.po_off - off);
+    buf[om.po_off - off] = '\000';
+
+    *bufp = buf;
+    *lenp = om.po_off - off;
+
+    free(om.po_recv);
+
+    return 0;
+
+errout:
+    free(om.po_recv);
+    free(om.po_buf);
+
+    return om.po_err;
+}
+
 #if defined(HSE_UNIT_TEST_MODE) && HSE_UNIT_TEST_MODE == 1
 #include "perfc_ut_impl.i"
 #endif /* HSE_UNIT_TEST_MODE */
@@ -15,6 +15,7 @@
 #include <hse_util/program_name.h>
 #include <hse_util/rest_api.h>
 #include <hse_util/slab.h>
+#include <hse_util/scratch.h>
 
 #include "logging_impl.h"
 #include "logging_util.h"
@@ -124,8 +125,17 @@ hse_platform_init(void)
     if (err)
         goto errout;
 
+    err = scratch_init();
+    if (err)
+        goto errout;
+
+    err = cheap_pool_init();
+    if (err)
+        goto errout;
+
     rest_init();
-    rest_url_register(0, 0, rest_dt_get, rest_dt_put, "data"); /* for dt */
+    rest_url_register(0, URL_FLAG_HEAVY, rest_dt_get, rest_dt_put, "data"); /* for dt */
+    rest_url_register(0, URL_FLAG_HEAVY, rest_metrics_get, NULL, "metrics");
     rest_url_register(0, 0, kmc_rest_get, NULL, "kmc");
 
     /* We only need the name pointer, the error is superfluous */
@@ -153,6 +163,8 @@ void
 hse_platform_fini(void)
 {
     rest_destroy();
+    cheap_pool_fini();
+    scratch_fini();
     kmem_cache_fini();
     perfc_shutdown();
     hse_timer_fini();
@@ -3,7 +3,7 @@
  * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
  */
 
-#define _GNU_SOURCE /* for ppoll() */
+#define _GNU_SOURCE /* for ppoll() and memfd_create() */
 
 #include <hse_util/platform.h>
 #include <hse_util/minmax.h>
@@ -13,12 +13,14 @@
 
 #include <hse_util/rest_api.h>
 #include <hse_util/spinlock.h>
+#include <hse_util/mutex.h>
 #include <hse_util/string.h>
 #include <hse_util/version.h>
 #include <hse_util/table.h>
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include <sys/select.h>
 #include <poll.h>
@@ -28,6 +30,13 @@
 #define MAX_SESSIONS (SESSIONS_PER_THREAD * NUM_THREADS)
 #define WQ_THREADS 5
 
+/* Bounds on the handlers in flight: requests beyond HANDLERS_MAX, or beyond
+ * HEAVY_MAX for handlers registered with URL_FLAG_HEAVY, are turned away
+ * with 429 rather than queued behind them.
+ */
+#define HANDLERS_MAX (WQ_THREADS * 2)
+#define HEAVY_MAX 1
+
 #ifndef MHD_HTTP_NOT_ACCEPTABLE
 #define MHD_HTTP_NOT_ACCEPTABLE MHD_HTTP_METHOD_NOT_ACCEPTABLE
 #endif
@@ -68,13 +77,15 @@ struct thread_arg {
     struct kv_iter     iter;
     struct conn_info * ci;
     int                op;
-    atomic_t           busy;
+    bool               heavy;
 };
 
 /**
  * struct session - identifies one client session/request
- * @resp_pipe:   Pipe for communication between url handler function (get/put)
- *               and the rest server's response callback (rest_response_cb)
+ * @resp_fd:     Memory file to which the url handler function (get/put)
+ *               writes its response, and from which the rest server's
+ *               response callback (rest_response_cb) streams it
+ * @conn:        MHD connection of the session
  * @response:    MHD response object
  * @targ:        argument to url handler thread
  * @enqueued:    whether work was enqueued
@@ -82,18 +93,34 @@ struct thread_arg {
  * @refcnt:      reference count
  * @slot:        ptr to session table slot
  * @magic:       used for sanity checking
+ * @lock:        serializes @done and @suspended
+ * @done:        the response is complete
+ * @suspended:   the connection is suspended waiting for the response
+ * @cancel:      the client went away, the handler may stop writing
  * @buf:         Scratch space for handlers to use for the session duration
+ *
+ * Handlers write to a memory file rather than to the client so that a slow
+ * (or stalled) client never blocks a handler, and thereby never extends
+ * the time for which a handler holds locks or references.  The response
+ * callback streams what has been written so far, and suspends the
+ * connection when it has caught up with a handler that is still running.
+ * The connection is resumed by the handler's next write or completion.
  */
 struct session {
-    int                  resp_pipe[2];
-    struct MHD_Response *response;
-    struct thread_arg    targ;
-    int                  enqueued;
-    struct conn_info     ci;
-    atomic_t             refcnt;
-    struct session **    slot;
-    void *               magic;
-    char                 buf[4096];
+    int                    resp_fd;
+    struct MHD_Connection *conn;
+    struct MHD_Response *  response;
+    struct thread_arg      targ;
+    int                    enqueued;
+    struct conn_info       ci;
+    atomic_t               refcnt;
+    struct session **      slot;
+    void *                 magic;
+    struct mutex           lock;
+    bool                   done;
+    bool                   suspended;
+    atomic_t               cancel;
+    char                   buf[4096];
 };
 
 struct rest {
@@ -105,6 +132,9 @@ struct rest {
 
     __aligned(SMP_CACHE_BYTES) struct workqueue_struct *url_hdlr_wq;
     struct MHD_Daemon *monitor_daemon;
+    atomic_t           handlers;
+    atomic_t           heavy;
+    bool               stopping;
 
     int  sockfd;
     char sock_name[PATH_MAX];
@@ -112,6 +142,9 @@ struct rest {
 
 static struct rest rest;
 
+/* Session whose handler is running on the calling thread, if any. */
+static __thread struct session *rest_session_cur;
+
 /* [HSE_REVISIT] This lib is designed to work under the constraint that a process
  * will have only one KVDB open at a time.
  */
@@ -440,18 +473,33 @@ rest_session_release(struct session *s)
     }
 
     /* To ensure that we don't close a re-purposed desciptor
-     * this is the only place that we close the descriptors
-     * we opened in rest_session_close().
+     * this is the only place that we close the descriptor
+     * we opened in rest_session_create().
      */
-    rc = close(s->resp_pipe[0]);
-    assert(rc == 0 || errno != EBADF);
-
-    rc = close(s->resp_pipe[1]);
-    assert(rc == 0 || errno != EBADF);
+    if (s->resp_fd != -1) {
+        rc = close(s->resp_fd);
+        assert(rc == 0 || errno != EBADF);
+    }
 
+    mutex_destroy(&s->lock);
     free(s);
 }
 
+/* Resume the connection if it is waiting for more of the response.
+ */
+static void
+rest_session_kick(struct session *s, bool done)
+{
+    mutex_lock(&s->lock);
+    if (done)
+        s->done = true;
+    if (s->suspended) {
+        s->suspended = false;
+        MHD_resume_connection(s->conn);
+    }
+    mutex_unlock(&s->lock);
+}
+
 static struct url_desc *
 get_url_desc(const char *path)
 {
@@ -488,23 +536,29 @@ static void
 url_handler(struct work_struct *w)
 {
     struct thread_arg *ta = container_of(w, struct thread_arg, work);
+    struct session *   s = container_of(ta, struct session, targ);
     struct url_desc *  ud = ta->udesc;
     merr_t             err;
 
+    rest_session_cur = s;
+
     if (ta->op == URL_GET)
         err = ud->get_handler(ta->path, ta->ci, ud->name, &ta->iter, ud->context);
     else
         err = ud->put_handler(ta->path, ta->ci, ud->name, &ta->iter, ud->context);
 
-    shutdown(ta->ci->resp_fd, SHUT_RDWR);
+    rest_session_cur = NULL;
     atomic_dec(&ud->refcnt);
 
+    if (ta->heavy)
+        atomic_dec(&rest.heavy);
+    atomic_dec(&rest.handlers);
+
     if (ev(err))
         hse_elog(HSE_WARNING "rest: handler failed: @@e", err);
 
-    atomic_set(&ta->busy, 0);
-
-    rest_session_release(container_of(ta, struct session, targ));
+    rest_session_kick(s, true);
+    rest_session_release(s);
 }
 
 static int
@@ -609,55 +663,60 @@ rest_response_free(void *cls)
 static ssize_t
 rest_response_cb(void *cls, uint64_t pos, char *buf, size_t max)
 {
-    struct timespec tv = {.tv_sec = 10 };
     struct session *s = cls;
-    struct pollfd   pfdv[1];
-    sigset_t        mask;
+    bool            done;
     ssize_t         cc;
-    int             fd, n;
 
     assert(s->magic == s);
 
-    fd = s->resp_pipe[0];
-
-    cc = read(fd, buf, max);
+    cc = pread(s->resp_fd, buf, max, pos);
     if (cc > 0)
         return cc;
-    if (cc == 0)
-        return MHD_CONTENT_READER_END_OF_STREAM;
+    if (ev(cc == -1))
+        return MHD_CONTENT_READER_END_WITH_ERROR;
 
-    pfdv[0].fd = fd;
-    pfdv[0].events = POLLIN;
+    /* Caught up with the handler.  Rather than wait for it here (and
+     * hold up the other connections served by this thread), suspend
+     * the connection until the handler writes more or completes.
+     */
+    mutex_lock(&s->lock);
+    done = s->done;
+    if (!done && !rest.stopping) {
+        cc = pread(s->resp_fd, buf, max, pos);
+        if (cc == 0) {
+            s->suspended = true;
+            MHD_suspend_connection(s->conn);
+        }
+    }
+    mutex_unlock(&s->lock);
 
-    sigfillset(&mask);
+    if (!done) {
+        if (rest.stopping || cc == -1)
+            return MHD_CONTENT_READER_END_WITH_ERROR;
 
-    n = ppoll(pfdv, 1, &tv, &mask);
-    if (ev(n == -1))
-        return MHD_CONTENT_READER_END_WITH_ERROR;
+        return cc;
+    }
 
-    cc = read(fd, buf, max);
+    /* The handler may have written more before it completed. */
+    cc = pread(s->resp_fd, buf, max, pos);
     if (cc > 0)
         return cc;
 
-    return MHD_CONTENT_READER_END_OF_STREAM;
+    return cc ? MHD_CONTENT_READER_END_WITH_ERROR : MHD_CONTENT_READER_END_OF_STREAM;
 }
 
 static struct session *
-rest_session_create(void)
+rest_session_create(struct MHD_Connection *conn)
 {
-    int             i, ret;
-    int             flags;
+    int             i;
     struct session *tmp;
 
     tmp = calloc(1, sizeof(*tmp));
     if (ev(!tmp))
         return NULL;
 
-    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, tmp->resp_pipe);
-    if (ev(ret == -1)) {
-        free(tmp);
-        return NULL;
-    }
+    mutex_init(&tmp->lock);
+    tmp->conn = conn;
 
     /* A session is born with a reference which will be released
      * by rest_session_complete().
@@ -666,21 +725,8 @@ rest_session_create(void)
     tmp->enqueued = false;
     tmp->magic = tmp;
 
-    /* the two ends of the pipe must be non-blocking */
-    flags = fcntl(tmp->resp_pipe[0], F_GETFL);
-    if (ev(flags < 0))
-        goto err;
-
-    ret = fcntl(tmp->resp_pipe[0], F_SETFL, flags | O_NONBLOCK);
-    if (ev(ret < 0))
-        goto err;
-
-    flags = fcntl(tmp->resp_pipe[1], F_GETFL);
-    if (ev(flags < 0))
-        goto err;
-
-    ret = fcntl(tmp->resp_pipe[1], F_SETFL, flags | O_NONBLOCK);
-    if (ev(ret < 0))
+    tmp->resp_fd = memfd_create("hse_rest", MFD_CLOEXEC);
+    if (ev(tmp->resp_fd == -1))
         goto err;
 
     spin_lock(&rest.sessions_lock);
@@ -727,7 +773,7 @@ webserver_response(
         /* The first call is only to establish a connection.
          * Create a new session to hold session-specific info
          */
-        session = rest_session_create();
+        session = rest_session_create(connection);
         if (ev(!session))
             return MHD_NO;
 
@@ -751,7 +797,7 @@ webserver_response(
     }
 
     session = *ptr;
-    write_fd = session->resp_pipe[1];
+    write_fd = session->resp_fd;
 
     if (strncmp(request_pfx, url, request_pfx_len) == 0) {
         const char *suffix = ".sock";
@@ -803,7 +849,7 @@ webserver_response(
                 version);
             write(write_fd, session->buf, bytes);
             http_status = MHD_HTTP_OK;
-            shutdown(write_fd, SHUT_RDWR);
+            session->done = true;
             goto respond;
         }
 
@@ -812,7 +858,7 @@ webserver_response(
             http_status = MHD_HTTP_OK;
             gen_help_msg(&bytes, session->buf, sizeof(session->buf));
             write(write_fd, session->buf, bytes);
-            shutdown(write_fd, SHUT_RDWR);
+            session->done = true;
         }
 
         goto respond;
@@ -839,7 +885,7 @@ webserver_response(
 
     session->ci.data = upload_data;
     session->ci.data_sz = upload_data_size;
-    session->ci.resp_fd = session->resp_pipe[1];
+    session->ci.resp_fd = session->resp_fd;
     session->ci.buf = session->buf;
     session->ci.buf_sz = sizeof(session->buf);
 
@@ -857,18 +903,33 @@ webserver_response(
         goto respond;
     }
 
+    /* Expensive handlers (e.g., full dumps of large structures) are
+     * limited so that they can neither occupy all the handler threads
+     * nor pile up behind each other.
+     */
+    session->targ.heavy = udesc->url_flags & URL_FLAG_HEAVY;
+
+    if (atomic_inc_return(&rest.handlers) > HANDLERS_MAX) {
+        atomic_dec(&rest.handlers);
+        http_status = MHD_HTTP_TOO_MANY_REQUESTS;
+        goto respond;
+    }
+
+    if (session->targ.heavy && atomic_inc_return(&rest.heavy) > HEAVY_MAX) {
+        atomic_dec(&rest.heavy);
+        atomic_dec(&rest.handlers);
+        http_status = MHD_HTTP_TOO_MANY_REQUESTS;
+        goto respond;
+    }
+
     /* Acquire a reference for url_handler(), will be released
      * by url_handler().
      */
     atomic_inc(&session->refcnt);
-    atomic_set(&session->targ.busy, 1);
 
     INIT_WORK(&session->targ.work, url_handler);
     session->enqueued = queue_work(rest.url_hdlr_wq, &session->targ.work);
-    if (session->enqueued)
-        http_status = MHD_HTTP_OK;
-    else
-        http_status = MHD_HTTP_TOO_MANY_REQUESTS;
+    assert(session->enqueued);
 
 respond:
     if (udesc && (http_status != MHD_HTTP_OK))
@@ -879,11 +940,11 @@ respond:
 
         gen_help_msg(&bytes, session->buf, sizeof(session->buf));
         write(write_fd, session->buf, bytes);
-        shutdown(write_fd, SHUT_RDWR);
-        if (udesc)
-            atomic_dec(&udesc->refcnt);
     }
 
+    if (!session->enqueued)
+        session->done = true;
+
     if (ev(err))
         hse_elog(HSE_ERR "rest api internal error: @@e", err);
 
@@ -909,7 +970,7 @@ rest_session_complete(
 
     if (s->enqueued) {
         if (ev(toe != MHD_REQUEST_TERMINATED_COMPLETED_OK))
-            shutdown(s->resp_pipe[0], SHUT_RDWR);
+            atomic_set(&s->cancel, 1);
     }
 
     rest_session_release(s);
@@ -989,8 +1050,15 @@ rest_server_start(const char *fmt)
      * MHD_OPTION_NOTIFY_COMPLETED : specify a callback function to be
      * called upon successful exit/completion of request
      */
+    rest.stopping = false;
+    atomic_set(&rest.handlers, 0);
+    atomic_set(&rest.heavy, 0);
+
+    /* MHD_USE_SUSPEND_RESUME : let response callbacks park connections
+     * whose handlers have yet to produce more output (see session).
+     */
     rest.monitor_daemon = MHD_start_daemon(
-        MHD_USE_EPOLL_INTERNALLY_LINUX_ONLY | MHD_USE_DEBUG,
+        MHD_USE_EPOLL_INTERNALLY_LINUX_ONLY | MHD_USE_SUSPEND_RESUME | MHD_USE_DEBUG,
         0,
         NULL,
         NULL,
@@ -1030,6 +1098,23 @@ rest_server_stop(void)
         return;
 
     unlink(rest.sock_name);
+
+    /* MHD cannot be stopped with connections suspended, and the response
+     * callbacks must not suspend them again once they are resumed.
+     */
+    rest.stopping = true;
+
+    spin_lock(&rest.sessions_lock);
+    for (i = 0; i < MAX_SESSIONS; ++i) {
+        struct session *s = rest.sessions[i];
+
+        if (s) {
+            atomic_set(&s->cancel, 1);
+            rest_session_kick(s, false);
+        }
+    }
+    spin_unlock(&rest.sessions_lock);
+
     MHD_stop_daemon(rest.monitor_daemon);
 
     for (tries = 0; tries < 3; ++tries) {
@@ -1038,7 +1123,7 @@ rest_server_stop(void)
             struct session *s = rest.sessions[i];
 
             if (s) {
-                shutdown(s->resp_pipe[1], SHUT_RDWR);
+                atomic_set(&s->cancel, 1);
                 ++nbusy;
             }
         }
@@ -1064,11 +1149,26 @@ ssize_t
 rest_write_safe(int fd, const char *buf, size_t sz)
 {
     struct timespec tv = {.tv_sec = 10 };
+    struct session *s = rest_session_cur;
     struct pollfd   pfdv[1];
     sigset_t        mask;
     ssize_t         cc, nwr;
     int             n;
 
+    /* A handler writing to its own session's response never blocks,
+     * it only needs to wake up the connection if it is waiting.
+     */
+    if (s && s->resp_fd == fd) {
+        if (atomic_read(&s->cancel))
+            return -1;
+
+        nwr = write(fd, buf, sz);
+        if (nwr > 0)
+            rest_session_kick(s, false);
+
+        return nwr;
+    }
+
     pfdv[0].fd = fd;
     pfdv[0].events = POLLOUT;
 
@@ -10,6 +10,7 @@
 #include <hse_util/event_counter.h>
 
 #include <hse_util/data_tree.h>
+#include <hse_util/perfc.h>
 #include <hse_util/rest_api.h>
 #include <hse_util/spinlock.h>
 #include <hse_util/string.h>
@@ -149,3 +150,44 @@ rest_dt_get(
 
     return 0;
 }
+
+/* OpenMetrics exposition of the perf counters: GET metrics[/<path>]
+ * [?family=<name>[,<name>...]] emits the counter sets under
+ * /data/perfc[/<path>], optionally restricted to the given families.
+ */
+merr_t
+rest_metrics_get(
+    const char *      path,
+    struct conn_info *info,
+    const char *      url,
+    struct kv_iter *  iter,
+    void *            context)
+{
+    char            dtpath[DT_PATH_LEN];
+    const char *    families = NULL;
+    struct rest_kv *kv;
+    size_t          len, n;
+    char *          buf;
+    merr_t          err;
+
+    while ((kv = rest_kv_next(iter)) != 0) {
+        if (strcmp(kv->key, "family"))
+            return merr(ev(EINVAL));
+
+        families = kv->value;
+    }
+
+    path += strlen(url);
+    n = snprintf(dtpath, sizeof(dtpath), "%s%s", PERFC_ROOT_PATH, path);
+    if (ev(n >= sizeof(dtpath)))
+        return merr(ENAMETOOLONG);
+
+    err = perfc_om_emit(dtpath, families, &buf, &len);
+    if (ev(err))
+        return err;
+
+    rest_write_safe(info->resp_fd, buf, len);
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/platform.h>
+#include <hse_util/alloc.h>
+#include <hse_util/page.h>
+#include <hse_util/minmax.h>
+#include <hse_util/event_counter.h>
+#include <hse_util/scratch.h>
+
+#include <pthread.h>
+
+#define SCRATCH_HDRSZ (64)
+#define SCRATCH_CHUNK_MIN (64ul << 10)
+#define SCRATCH_KEEP_MAX (4ul << 20)
+
+/**
+ * struct scratch_chunk - header of one contiguous region of an arena
+ * @sc_next: next (larger) chunk
+ * @sc_size: size of the chunk including this header
+ */
+struct scratch_chunk {
+    struct scratch_chunk *sc_next;
+    size_t                sc_size;
+};
+
+/**
+ * struct scratch - per-thread arena
+ * @s_head:   first chunk
+ * @s_cur:    chunk from which the next allocation is tried
+ * @s_off:    offset of the free space in %s_cur
+ * @s_total:  size of all chunks
+ * @s_hint:   size of the next chunk after the arena was coalesced
+ * @s_keyset: the thread exit destructor has been registered
+ */
+struct scratch {
+    struct scratch_chunk *s_head;
+    struct scratch_chunk *s_cur;
+    size_t                s_off;
+    size_t                s_total;
+    size_t                s_hint;
+    bool                  s_keyset;
+};
+
+static pthread_once_t          scratch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t           scratch_key;
+static int                     scratch_key_rc;
+static __thread struct scratch scratch_tls;
+
+static void
+scratch_free_chunks(struct scratch *s)
+{
+    struct scratch_chunk *c, *next;
+
+    for (c = s->s_head; c; c = next) {
+        next = c->sc_next;
+        free_aligned(c);
+    }
+
+    s->s_head = s->s_cur = NULL;
+    s->s_off = 0;
+    s->s_total = 0;
+}
+
+static void
+scratch_dtor(void *arg)
+{
+    scratch_free_chunks(arg);
+}
+
+static void
+scratch_key_create(void)
+{
+    scratch_key_rc = pthread_key_create(&scratch_key, scratch_dtor);
+}
+
+static void *
+scratch_grow(struct scratch *s, struct scratch_chunk *tail, size_t sz, size_t align)
+{
+    struct scratch_chunk *c;
+    size_t                off, size;
+
+    off = ALIGN(SCRATCH_HDRSZ, align);
+
+    size = max_t(size_t, SCRATCH_CHUNK_MIN, max_t(size_t, s->s_total, s->s_hint));
+    while (size < off + sz)
+        size *= 2;
+
+    c = alloc_aligned(size, PAGE_SIZE, 0);
+    if (ev(!c))
+        return NULL;
+
+    /* Register the arena for release at thread exit.
+     */
+    if (!s->s_keyset) {
+        pthread_once(&scratch_once, scratch_key_create);
+
+        if (!ev(scratch_key_rc))
+            s->s_keyset = !ev(pthread_setspecific(scratch_key, s));
+    }
+
+    c->sc_next = NULL;
+    c->sc_size = size;
+
+    if (tail)
+        tail->sc_next = c;
+    else
+        s->s_head = c;
+
+    s->s_total += size;
+    s->s_hint = 0;
+    s->s_cur = c;
+    s->s_off = off + sz;
+
+    return (char *)c + off;
+}
+
+void *
+scratch_alloc(size_t sz, size_t align)
+{
+    struct scratch *      s = &scratch_tls;
+    struct scratch_chunk *c = s->s_cur;
+    size_t                off;
+
+    assert(align > 0 && align <= PAGE_SIZE && !(align & (align - 1)));
+
+    if (!c)
+        return scratch_grow(s, NULL, sz, align);
+
+    off = ALIGN(s->s_off, align);
+
+    while (off + sz > c->sc_size) {
+        if (!c->sc_next)
+            return scratch_grow(s, c, sz, align);
+
+        c = c->sc_next;
+        off = ALIGN(SCRATCH_HDRSZ, align);
+    }
+
+    s->s_cur = c;
+    s->s_off = off + sz;
+
+    return (char *)c + off;
+}
+
+void
+scratch_save(struct scratch_mark *mark)
+{
+    struct scratch *s = &scratch_tls;
+
+    mark->sm_chunk = s->s_cur;
+    mark->sm_off = s->s_off;
+
+    if (s->s_cur == s->s_head && s->s_off <= SCRATCH_HDRSZ)
+        mark->sm_chunk = NULL;
+}
+
+void
+scratch_restore(const struct scratch_mark *mark)
+{
+    struct scratch *s = &scratch_tls;
+
+    if (mark->sm_chunk) {
+        s->s_cur = mark->sm_chunk;
+        s->s_off = mark->sm_off;
+        return;
+    }
+
+    /* The arena is empty.  If it has outgrown a single chunk then free
+     * it all and allocate one chunk large enough for all on next use.
+     */
+    if (s->s_head && (s->s_head->sc_next || s->s_total > SCRATCH_KEEP_MAX)) {
+        s->s_hint = min_t(size_t, s->s_total, SCRATCH_KEEP_MAX);
+        scratch_free_chunks(s);
+        return;
+    }
+
+    s->s_cur = s->s_head;
+    s->s_off = s->s_head ? SCRATCH_HDRSZ : 0;
+}
+
+merr_t
+scratch_init(void)
+{
+    pthread_once(&scratch_once, scratch_key_create);
+
+    return merr(ev(scratch_key_rc));
+}
+
+void
+scratch_fini(void)
+{
+    scratch_free_chunks(&scratch_tls);
+}
@@ -30,6 +30,17 @@
  * In general, the large size of the chunk and relatively small size of the
  * chunk header means that for typical allocation sizes the maximum potential
  * memory overhead is well less than 0.8 percent.
+ *
+ * Chunks are owned by the NUMA node of the CPU which created them, and
+ * their pages are bound to that node.  Each per-CPU bucket belongs to
+ * one node and only takes slabs from its node's chunks, so that items
+ * are always allocated from node-local memory.
+ *
+ * In front of the per-CPU buckets sits a per-CPU magazine, a small stack
+ * of free items.  kmem_cache_alloc() and kmem_cache_free() normally only
+ * pop or push the magazine of the calling CPU.  The magazine is refilled
+ * from and drained to the slabs in bulk, under a single acquisition of
+ * the bucket lock.
  */
 
 #define _GNU_SOURCE /* for mremap() */
@@ -50,6 +61,10 @@
 #include <hse_util/rest_api.h>
 #include <hse_util/page.h>
 #include <hse_util/slab.h>
+#include <hse_util/cursor_heap.h>
+
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #define MAX_NUMNODES 4
 
@@ -68,6 +83,14 @@
 #define KMC_PCPU_MIN (4)
 #define KMC_PCPU_MAX (32)
 
+/* KMC_MAG_MAX          max number of items in a per-cpu magazine
+ * KMC_MAG_MIN          min magazine size worth caching items for
+ * KMC_MAG_CPUS_MAX     max number of per-cpu magazines per cache
+ */
+#define KMC_MAG_MAX (30)
+#define KMC_MAG_MIN (4)
+#define KMC_MAG_CPUS_MAX (256)
+
 #define kmc_slab_first(_head) list_first_entry_or_null((_head), struct kmc_slab, slab_entry)
 
 #define kmc_slab_foreach(_slab, _next, _head) \
@@ -128,15 +151,18 @@ struct kmc_slab {
 /**
  * struct kmc_node - perf-numa-node chunk management
  * @node_lock:      protects all node_* fields
+ * @node_id:        NUMA node to which the chunks' memory is bound
  * @node_nchunks:   total number of chunks allocated to this node
  * @node_partial:   list of chunks with one or more free slabs
  * @node_full:      list of chunks with no free slabs
  *
- * A node is a cache of NUMA-node affined chunks of memory.
- * In practice, NUMA-node affinity is not guaranteed.
+ * A node is a cache of NUMA-node affined chunks of memory.  The memory
+ * of each chunk is bound to the node with a preferred policy, so pages
+ * come from another node only when the node is out of memory.
  */
 struct kmc_node {
     spinlock_t       node_lock;
+    uint             node_id;
     uint             node_nchunks;
     struct list_head node_partial;
     struct list_head node_full;
@@ -175,25 +201,49 @@ struct kmc_chunk {
 /**
  * struct kmc_pcpu - per-cpu slab management lists
  * @pcpu_lock:      protects all list accesses
+ * @pcpu_node:      node from which this bucket obtains slabs
  * @pcpu_partial:   list of slabs with one or more free items
  * @pcpu_empty:     list of slabs with all items free
  * @pcpu_full:      list of slabs with no items free
  *
  * Per-cpu buckets contain three lists of slabs affined to a given
- * set of CPUS.  Empty slabs that have not been recently allocated
- * from are removed from the bucket and returned to their chunk by
- * the reaper.
+ * set of CPUS, all of which are on the bucket's node.  Empty slabs
+ * that have not been recently allocated from are removed from the
+ * bucket and returned to their chunk by the reaper.
  */
 struct kmc_pcpu {
     spinlock_t       pcpu_lock;
+    struct kmc_node *pcpu_node;
     struct list_head pcpu_partial;
     struct list_head pcpu_empty;
     struct list_head pcpu_full;
 } __aligned(SMP_CACHE_BYTES);
 
+/**
+ * struct kmc_mag - per-cpu magazine of free items
+ * @mag_busy:   set while a thread operates on the magazine
+ * @mag_cnt:    number of items in mag_objv[]
+ * @mag_objv:   stack of free (constructed) items
+ *
+ * Userland threads may be preempted or migrated at any time, so a
+ * magazine is claimed with a cmpxchg on its own cache line.  In the
+ * steady state that line never leaves the CPU.  A claim never waits,
+ * if the magazine is busy the caller goes to the per-cpu bucket.
+ */
+struct kmc_mag {
+    atomic_t mag_busy;
+    uint     mag_cnt;
+    void *   mag_objv[KMC_MAG_MAX];
+} __aligned(SMP_CACHE_BYTES);
+
 /**
  * struct kmem_cache - a zone of uniformly sized parcels of memory
  * @zone_pcpuc:         count of per-cpu objects (zone_pcpuv[])
+ * @zone_pcpun:         count of per-cpu objects per node
+ * @zone_nodec:         count of nodes over which zone_pcpuv[] is spread
+ * @zone_magc:          count of per-cpu magazines (zone_magv[])
+ * @zone_magmax:        max number of items per magazine
+ * @zone_magv:          per-cpu magazines (NULL if items are too large)
  * @zone_isize:         caller specified item size
  * @zone_iasz:          item size aligned to zone_item_align
  * @zone_ialign:        caller specified item alignemnt
@@ -216,6 +266,11 @@ struct kmc_pcpu {
  */
 struct kmem_cache {
     uint zone_pcpuc;
+    uint zone_pcpun;
+    uint zone_nodec;
+    uint zone_magc;
+    uint zone_magmax;
+    struct kmc_mag *zone_magv;
     uint zone_isize;
     uint zone_ialign;
     uint zone_iasz;
@@ -251,6 +306,7 @@ static struct {
     struct list_head kmc_zones;
     int              kmc_nzones;
 
+    uint            kmc_nodec;
     struct kmc_node kmc_nodev[MAX_NUMNODES];
 } kmc __aligned(SMP_CACHE_BYTES);
 
@@ -293,6 +349,63 @@ kmc_pcpu_unlock(struct kmc_pcpu *pcpu)
     spin_unlock(&pcpu->pcpu_lock);
 }
 
+/* Select the calling cpu's bucket from among those of its node.
+ */
+static __always_inline struct kmc_pcpu *
+kmc_pcpu_get(struct kmem_cache *zone)
+{
+    uint aux = raw_smp_processor_aux();
+    uint cpu = aux & VGETCPU_CPU_MASK;
+    uint node = (aux >> VGETCPU_NODE_SHIFT) % zone->zone_nodec;
+
+    return zone->zone_pcpuv + node * zone->zone_pcpun + (cpu / 2) % zone->zone_pcpun;
+}
+
+static __always_inline bool
+kmc_mag_trylock(struct kmc_mag *mag)
+{
+    return !atomic_read(&mag->mag_busy) && !atomic_cmpxchg(&mag->mag_busy, 0, 1);
+}
+
+static __always_inline void
+kmc_mag_unlock(struct kmc_mag *mag)
+{
+    atomic_set_rel(&mag->mag_busy, 0);
+}
+
+/* Claim the calling cpu's magazine, or return NULL if the zone has
+ * no magazines or the magazine is in use.
+ */
+static __always_inline struct kmc_mag *
+kmc_mag_get(struct kmem_cache *zone)
+{
+    struct kmc_mag *mag;
+
+    if (!zone->zone_magv)
+        return NULL;
+
+    mag = zone->zone_magv + raw_smp_processor_id() % zone->zone_magc;
+
+    return kmc_mag_trylock(mag) ? mag : NULL;
+}
+
+/* Prefer the chunk's node for all of the chunk's pages.
+ */
+static void
+kmc_chunk_bind(void *mem, size_t len, uint node)
+{
+    unsigned long mask[2] = {};
+    long          rc;
+
+    if (kmc.kmc_nodec < 2 || ev(node >= sizeof(mask) * 8))
+        return;
+
+    mask[node / 64] = 1ul << (node % 64);
+
+    rc = syscall(SYS_mbind, mem, len, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0);
+    ev(rc);
+}
+
 struct kmc_chunk *
 kmc_chunk_create(struct kmem_cache *zone, struct kmc_node *node)
 {
@@ -365,10 +478,13 @@ kmc_chunk_create(struct kmem_cache *zone, struct kmc_node *node)
         mprotect(base, (size_t)(mem - base), PROT_NONE);
     ev(1);
 
-/* Initialize the chunk header, which is placed at the end
-     * of the chunk.
+/* Bind the chunk to its node before the chunk header faults
+     * in the first page, then initialize the chunk header, which
+     * is placed at the end of the chunk.
      */
 chunk_init:
+    kmc_chunk_bind(mem, chunksz, node->node_id);
+
     chunk = mem + chunksz - sizeof(*chunk);
     chunk->ch_magic = chunk;
     chunk->ch_hugecnt = hugecnt;
@@ -428,7 +544,7 @@ kmc_slab_mprotect(struct kmc_slab *slab, int prot)
 }
 
 struct kmc_slab *
-kmc_slab_alloc(struct kmem_cache *zone, int flags)
+kmc_slab_alloc(struct kmem_cache *zone, struct kmc_pcpu *pcpu, int flags)
 {
     struct kmc_chunk *chunk;
     struct kmc_slab * slab;
@@ -436,8 +552,7 @@ kmc_slab_alloc(struct kmem_cache *zone, int flags)
     char *            item;
     int               i;
 
-    i = (raw_smp_processor_id() / zone->zone_pcpuc);
-    node = kmc.kmc_nodev + (i % MAX_NUMNODES);
+    node = pcpu->pcpu_node;
 
     kmc_node_lock(node);
     chunk = kmc_chunk_first(&node->node_partial);
@@ -590,69 +705,108 @@ kmc_slab_ffs(struct kmc_slab *slab)
     return -1;
 }
 
-void *
-kmem_cache_alloc(struct kmem_cache *zone, gfp_t flags)
+/**
+ * kmc_pcpu_getv() - allocate up to n items from a per-cpu bucket
+ * @zone:   kmem cache
+ * @pcpu:   per-cpu bucket, locked by the caller
+ * @objv:   vector to receive the items
+ * @n:      number of items wanted
+ * @flags:  gfp flags
+ *
+ * The bucket lock is dropped and reacquired to obtain a new slab.
+ *
+ * Return: the number of items allocated, less than %n only if
+ * a new slab could not be obtained.
+ */
+static uint
+kmc_pcpu_getv(struct kmem_cache *zone, struct kmc_pcpu *pcpu, void **objv, uint n, gfp_t flags)
 {
-    struct kmc_pcpu *pcpu;
     struct kmc_slab *slab;
-    void *           mem;
+    uint             cnt;
     int              idx;
 
-    assert(zone);
-    assert(zone->zone_magic == zone);
+    for (cnt = 0; cnt < n; ++cnt) {
+        slab = kmc_slab_first(&pcpu->pcpu_partial);
+        if (!slab) {
+            slab = kmc_slab_first(&pcpu->pcpu_empty);
+            if (!slab) {
+                kmc_pcpu_unlock(pcpu);
 
-    idx = (raw_smp_processor_id() / 2) % zone->zone_pcpuc;
-    pcpu = zone->zone_pcpuv + idx;
+                slab = kmc_slab_alloc(zone, pcpu, flags);
 
-    kmc_pcpu_lock(pcpu);
-    while (1) {
-        slab = kmc_slab_first(&pcpu->pcpu_partial);
-        if (slab)
-            break;
+                kmc_pcpu_lock(pcpu);
+                if (!slab)
+                    break;
+
+                list_add(&slab->slab_entry, &pcpu->pcpu_empty);
+                slab->slab_pcpu = pcpu;
+            }
 
-        slab = kmc_slab_first(&pcpu->pcpu_empty);
-        if (slab) {
             list_del(&slab->slab_entry);
             list_add(&slab->slab_entry, &pcpu->pcpu_partial);
             slab->slab_list = &pcpu->pcpu_partial;
-            break;
         }
-        kmc_pcpu_unlock(pcpu);
 
-        slab = kmc_slab_alloc(zone, flags);
+        assert(slab->slab_magic == slab);
+        assert(slab->slab_iused < slab->slab_imax);
+        assert(slab->slab_chunk->ch_magic == slab->slab_chunk);
 
-        kmc_pcpu_lock(pcpu);
-        if (slab) {
-            list_add(&slab->slab_entry, &pcpu->pcpu_empty);
-            slab->slab_list = &pcpu->pcpu_empty;
-            slab->slab_pcpu = pcpu;
+        idx = kmc_slab_ffs(slab);
+
+        assert(idx >= 0);
+        assert(idx < slab->slab_imax);
+        assert(isset(slab->slab_bitmap, idx));
+
+        clrbit(slab->slab_bitmap, idx);
+        ++slab->slab_zalloc;
+
+        if (++slab->slab_iused >= slab->slab_imax) {
+            list_del(&slab->slab_entry);
+            list_add(&slab->slab_entry, &pcpu->pcpu_full);
+            slab->slab_list = &pcpu->pcpu_full;
+            slab->slab_bmidx = 0;
         }
+
+        objv[cnt] = (char *)slab->slab_base + idx * zone->zone_iasz;
     }
 
-    assert(slab->slab_magic == slab);
-    assert(slab->slab_iused < slab->slab_imax);
-    assert(slab->slab_chunk->ch_magic == slab->slab_chunk);
+    return cnt;
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *zone, gfp_t flags)
+{
+    struct kmc_pcpu *pcpu;
+    struct kmc_mag * mag;
+    void *           mem;
 
-    idx = kmc_slab_ffs(slab);
+    assert(zone);
+    assert(zone->zone_magic == zone);
 
-    assert(idx >= 0);
-    assert(idx < slab->slab_imax);
-    assert(isset(slab->slab_bitmap, idx));
+    mem = NULL;
 
-    clrbit(slab->slab_bitmap, idx);
-    ++slab->slab_zalloc;
+    mag = kmc_mag_get(zone);
+    if (mag) {
+        if (mag->mag_cnt == 0) {
+            pcpu = kmc_pcpu_get(zone);
 
-    if (++slab->slab_iused >= slab->slab_imax) {
-        list_del(&slab->slab_entry);
-        list_add(&slab->slab_entry, &pcpu->pcpu_full);
-        slab->slab_list = &pcpu->pcpu_full;
-        slab->slab_bmidx = 0;
-    }
-    kmc_pcpu_unlock(pcpu);
+            kmc_pcpu_lock(pcpu);
+            mag->mag_cnt = kmc_pcpu_getv(zone, pcpu, mag->mag_objv, zone->zone_magmax / 2, flags);
+            kmc_pcpu_unlock(pcpu);
+        }
+
+        if (mag->mag_cnt > 0)
+            mem = mag->mag_objv[--mag->mag_cnt];
+        kmc_mag_unlock(mag);
+    } else {
+        pcpu = kmc_pcpu_get(zone);
 
-    mem = (char *)slab->slab_base + idx * zone->zone_iasz;
+        kmc_pcpu_lock(pcpu);
+        kmc_pcpu_getv(zone, pcpu, &mem, 1, flags);
+        kmc_pcpu_unlock(pcpu);
+    }
 
-    if (flags & __GFP_ZERO)
+    if (mem && (flags & __GFP_ZERO))
         memset(mem, 0, zone->zone_isize);
 
     return mem;
@@ -707,44 +861,99 @@ kmc_addr2slab(struct kmem_cache *zone, void *mem, uint *idxp)
     return slab;
 }
 
-void
-kmem_cache_free(struct kmem_cache *zone, void *mem)
+/**
+ * kmc_putv() - return items to the slabs from which they were allocated
+ * @zone:   kmem cache
+ * @objv:   vector of items
+ * @n:      number of items
+ *
+ * Consecutive items from the same per-cpu bucket are returned under
+ * one acquisition of the bucket lock.
+ */
+static void
+kmc_putv(struct kmem_cache *zone, void **objv, uint n)
 {
+    struct kmc_pcpu *locked = NULL;
     struct kmc_slab *slab;
     struct kmc_pcpu *pcpu;
-    uint             idx;
+    uint             idx, i;
+
+    for (i = 0; i < n; ++i) {
+        slab = kmc_addr2slab(zone, objv[i], &idx);
+        if (!slab)
+            continue;
+
+        assert(slab->slab_magic == slab);
+
+        pcpu = slab->slab_pcpu;
+        if (pcpu != locked) {
+            if (locked)
+                kmc_pcpu_unlock(locked);
+            kmc_pcpu_lock(pcpu);
+            locked = pcpu;
+        }
+
+        assert(isclr(slab->slab_bitmap, idx));
+        setbit(slab->slab_bitmap, idx);
+        ++slab->slab_zfree;
+
+        if (--slab->slab_iused > 0) {
+            if (slab->slab_list != &pcpu->pcpu_partial) {
+                list_del(&slab->slab_entry);
+                list_add_tail(&slab->slab_entry, &pcpu->pcpu_partial);
+                slab->slab_list = &pcpu->pcpu_partial;
+            }
+        } else {
+            if (slab != kmc_slab_first(&pcpu->pcpu_partial)) {
+                list_del(&slab->slab_entry);
+                list_add(&slab->slab_entry, &pcpu->pcpu_empty);
+                slab->slab_list = &pcpu->pcpu_empty;
+                slab->slab_expired = false;
+            }
+        }
+    }
+
+    if (locked)
+        kmc_pcpu_unlock(locked);
+}
+
+/* Return the newest n items of a locked magazine to their slabs.
+ */
+static void
+kmc_mag_drain(struct kmem_cache *zone, struct kmc_mag *mag, uint n)
+{
+    n = min_t(uint, n, mag->mag_cnt);
+
+    mag->mag_cnt -= n;
+    kmc_putv(zone, mag->mag_objv + mag->mag_cnt, n);
+}
+
+void
+kmem_cache_free(struct kmem_cache *zone, void *mem)
+{
+    struct kmc_mag *mag;
+    uint            idx;
 
     assert(zone);
     assert(zone->zone_magic == zone);
 
-    slab = kmc_addr2slab(zone, mem, &idx);
-    if (!slab)
+    /* Validate the address now rather than when the item
+     * eventually leaves the magazine.
+     */
+    if (!kmc_addr2slab(zone, mem, &idx))
         return;
 
-    assert(slab->slab_magic == slab);
-
-    pcpu = slab->slab_pcpu;
+    mag = kmc_mag_get(zone);
+    if (!mag) {
+        kmc_putv(zone, &mem, 1);
+        return;
+    }
 
-    kmc_pcpu_lock(pcpu);
-    assert(isclr(slab->slab_bitmap, idx));
-    setbit(slab->slab_bitmap, idx);
-    ++slab->slab_zfree;
+    if (mag->mag_cnt >= zone->zone_magmax)
+        kmc_mag_drain(zone, mag, zone->zone_magmax / 2);
 
-    if (--slab->slab_iused > 0) {
-        if (slab->slab_list != &pcpu->pcpu_partial) {
-            list_del(&slab->slab_entry);
-            list_add_tail(&slab->slab_entry, &pcpu->pcpu_partial);
-            slab->slab_list = &pcpu->pcpu_partial;
-        }
-    } else {
-        if (slab != kmc_slab_first(&pcpu->pcpu_partial)) {
-            list_del(&slab->slab_entry);
-            list_add(&slab->slab_entry, &pcpu->pcpu_empty);
-            slab->slab_list = &pcpu->pcpu_empty;
-            slab->slab_expired = false;
-        }
-    }
-    kmc_pcpu_unlock(pcpu);
+    mag->mag_objv[mag->mag_cnt++] = mem;
+    kmc_mag_unlock(mag);
 }
 
 static void
@@ -762,6 +971,18 @@ kmc_reaper(struct work_struct *work)
 
     INIT_LIST_HEAD(&expired);
 
+    /* Return the items cached in idle magazines to their slabs so
+     * that the slabs can empty out.  Busy magazines are skipped.
+     */
+    for (i = 0; zone->zone_magv && i < zone->zone_magc; ++i) {
+        struct kmc_mag *mag = zone->zone_magv + i;
+
+        if (mag->mag_cnt > 0 && kmc_mag_trylock(mag)) {
+            kmc_mag_drain(zone, mag, mag->mag_cnt);
+            kmc_mag_unlock(mag);
+        }
+    }
+
     /* Examine each per-cpu cache and free all slabs that
      * haven't been used since the last time we checked.
      */
@@ -792,7 +1013,7 @@ kmc_reaper(struct work_struct *work)
     kmc_slab_foreach(slab, next, &expired) kmc_slab_free(zone, slab);
 
     if (zone == kmc.kmc_pagecache) {
-        for (i = 0; i < MAX_NUMNODES; ++i) {
+        for (i = 0; i < kmc.kmc_nodec; ++i) {
             struct kmc_node * node = kmc.kmc_nodev + i;
             struct kmc_chunk *chunk;
 
@@ -823,7 +1044,7 @@ kmem_cache_create(const char *name, size_t size, size_t align, ulong flags, void
     struct kmem_cache *zone;
 
     size_t slab_sz, zone_sz, iasz;
-    uint   pcpuc, i;
+    uint   pcpuc, nodec, magmax, i;
     ulong  delay;
 
     assert(kmc.kmc_wq);
@@ -843,6 +1064,9 @@ kmem_cache_create(const char *name, size_t size, size_t align, ulong flags, void
         return NULL;
 
     pcpuc = clamp_t(uint, num_online_cpus() / 4, KMC_PCPU_MIN, KMC_PCPU_MAX);
+    nodec = min_t(uint, kmc.kmc_nodec, pcpuc);
+    pcpuc = (pcpuc / nodec) * nodec;
+
     zone_sz = sizeof(*zone) + sizeof(zone->zone_pcpuv[0]) * pcpuc;
     zone_sz = ALIGN(zone_sz, SMP_CACHE_BYTES);
 
@@ -852,6 +1076,8 @@ kmem_cache_create(const char *name, size_t size, size_t align, ulong flags, void
 
     memset(zone, 0, sizeof(*zone));
     zone->zone_pcpuc = pcpuc;
+    zone->zone_pcpun = pcpuc / nodec;
+    zone->zone_nodec = nodec;
     zone->zone_isize = size;
     zone->zone_iasz = iasz;
     zone->zone_ialign = align;
@@ -863,10 +1089,24 @@ kmem_cache_create(const char *name, size_t size, size_t align, ulong flags, void
     spin_lock_init(&zone->zone_lock);
     strlcpy(zone->zone_name, name, sizeof(zone->zone_name));
 
+    /* Magazines would hold too much memory idle for large items.
+     */
+    magmax = min_t(size_t, slab_sz / (iasz * 4), KMC_MAG_MAX);
+    if (magmax >= KMC_MAG_MIN) {
+        zone->zone_magc = min_t(uint, num_conf_cpus(), KMC_MAG_CPUS_MAX);
+        zone->zone_magv = alloc_aligned(
+            sizeof(*zone->zone_magv) * zone->zone_magc, __alignof(*zone->zone_magv), GFP_KERNEL);
+        if (zone->zone_magv) {
+            memset(zone->zone_magv, 0, sizeof(*zone->zone_magv) * zone->zone_magc);
+            zone->zone_magmax = magmax;
+        }
+    }
+
     for (i = 0; i < pcpuc; ++i) {
         struct kmc_pcpu *pcpu = zone->zone_pcpuv + i;
 
         spin_lock_init(&pcpu->pcpu_lock);
+        pcpu->pcpu_node = kmc.kmc_nodev + i / zone->zone_pcpun;
         INIT_LIST_HEAD(&pcpu->pcpu_partial);
         INIT_LIST_HEAD(&pcpu->pcpu_full);
         INIT_LIST_HEAD(&pcpu->pcpu_empty);
@@ -904,6 +1144,9 @@ kmem_cache_destroy(struct kmem_cache *zone)
     while (!cancel_delayed_work(&zone->zone_dwork))
         usleep(1000);
 
+    for (i = 0; zone->zone_magv && i < zone->zone_magc; ++i)
+        kmc_mag_drain(zone, zone->zone_magv + i, KMC_MAG_MAX);
+
     for (i = 0; i < zone->zone_pcpuc; ++i) {
         struct kmc_pcpu *pcpu = zone->zone_pcpuv + i;
 
@@ -924,6 +1167,7 @@ kmem_cache_destroy(struct kmem_cache *zone)
     }
 
     zone->zone_magic = (void *)0xdeadbeef;
+    free_aligned(zone->zone_magv);
     free_aligned(zone);
 }
 
@@ -952,9 +1196,11 @@ kmem_cache_init(void)
     INIT_LIST_HEAD(&kmc.kmc_zones);
     kmc.kmc_nzones = 0;
     kmc.kmc_huge_max = 32;
+    kmc.kmc_nodec = min_t(uint, cheap_numa_nodes(), MAX_NUMNODES);
 
     for (i = 0; i < MAX_NUMNODES; ++i) {
         spin_lock_init(&kmc.kmc_nodev[i].node_lock);
+        kmc.kmc_nodev[i].node_id = i;
         kmc.kmc_nodev[i].node_nchunks = 0;
         INIT_LIST_HEAD(&kmc.kmc_nodev[i].node_partial);
         INIT_LIST_HEAD(&kmc.kmc_nodev[i].node_full);
@@ -5,6 +5,9 @@
 
 #define MTF_MOCK_IMPL_token_bucket
 
+#include <hse_util/platform.h>
+#include <hse_util/atomic.h>
+#include <hse_util/minmax.h>
 #include <hse_util/timing.h>
 #include <hse_util/timer.h>
 #include <hse_util/delay.h>
@@ -12,6 +15,13 @@
 
 /* MTF_MOCK_DECL(token_bucket) */
 
+#define TBKT_PCPU_MAX 16
+
+/* Tokens taken from the bucket by a cpu slot, not yet used. */
+struct tbkt_pcpu {
+    atomic64_t tp_credit;
+} __aligned(SMP_CACHE_BYTES);
+
 static void
 tbkt_init_impl(struct tbkt *self, u64 burst, u64 rate)
 {
@@ -35,8 +45,107 @@ tbkt_init(struct tbkt *self, u64 burst, u64 rate)
 void
 tbkt_reinit(struct tbkt *self, u64 burst, u64 rate)
 {
+    uint i;
+
     spin_lock(&self->tb_lock);
     tbkt_init_impl(self, burst, rate);
+
+    /* The new bucket starts full, batches of the old one are dropped. */
+    for (i = 0; self->tb_pcpu && i < TBKT_PCPU_MAX; i++)
+        atomic64_set(&self->tb_pcpu[i].tp_credit, 0);
+    spin_unlock(&self->tb_lock);
+}
+
+merr_t
+tbkt_pcpu_alloc(struct tbkt *self, u64 batch)
+{
+    struct tbkt_pcpu *pcv;
+    uint              i;
+
+    pcv = alloc_aligned(sizeof(*pcv) * TBKT_PCPU_MAX, SMP_CACHE_BYTES, GFP_KERNEL);
+    if (ev(!pcv))
+        return merr(ENOMEM);
+
+    for (i = 0; i < TBKT_PCPU_MAX; i++)
+        atomic64_set(&pcv[i].tp_credit, 0);
+
+    spin_lock(&self->tb_lock);
+    self->tb_batch = batch;
+    self->tb_pcpu = pcv;
+    spin_unlock(&self->tb_lock);
+
+    return 0;
+}
+
+void
+tbkt_pcpu_free(struct tbkt *self)
+{
+    free_aligned(self->tb_pcpu);
+    self->tb_pcpu = NULL;
+    self->tb_batch = 0;
+}
+
+/* Take tokens from the batch of a cpu slot, without the bucket lock. */
+static bool
+tbkt_pcpu_take(struct tbkt_pcpu *pc, u64 request)
+{
+    long credit, old;
+
+    credit = atomic64_read(&pc->tp_credit);
+
+    while (credit > 0 && (u64)credit >= request) {
+        old = atomic64_cmpxchg(&pc->tp_credit, credit, credit - request);
+        if (old == credit)
+            return true;
+
+        credit = old;
+    }
+
+    return false;
+}
+
+/* Caller must hold tb_lock.  Returns the balance refilled based on
+ * elapsed time.  If too much time has passed, balance equals burst.
+ */
+static u64
+tbkt_refill(struct tbkt *self, u64 now)
+{
+    u64 balance, dt;
+    u64 refill, refill_max;
+
+    balance = self->tb_burst;
+    dt = now - self->tb_refill_time;
+    if (dt < self->tb_dt_max) {
+        refill = self->tb_rate * dt / NSEC_PER_SEC;
+        refill_max = self->tb_burst - self->tb_balance;
+        if (refill < refill_max)
+            balance = self->tb_balance + refill;
+    }
+
+    return balance;
+}
+
+void
+tbkt_adjust(struct tbkt *self, u64 burst, u64 rate)
+{
+    u64 now;
+
+    spin_lock(&self->tb_lock);
+
+    now = get_time_ns();
+    self->tb_balance = tbkt_refill(self, now);
+    self->tb_refill_time = now;
+
+    /* A credit is capped at the new burst, a deficit is kept as is
+     * (see tbkt_request()).
+     */
+    if (self->tb_balance <= self->tb_burst && self->tb_balance > burst)
+        self->tb_balance = burst;
+
+    self->tb_burst = burst;
+    self->tb_rate = rate;
+    self->tb_dt_max = rate ? U64_MAX / rate : U64_MAX;
+
     spin_unlock(&self->tb_lock);
 }
 
@@ -46,26 +155,35 @@ tbkt_reinit(struct tbkt *self, u64 burst, u64 rate)
 u64
 tbkt_request(struct tbkt *self, u64 request)
 {
-    u64 dt, now;
-    u64 burst, rate, balance, deficit;
-    u64 refill, refill_max;
+    struct tbkt_pcpu *pc = NULL;
+    u64               now, batch = 0;
+    u64               burst, rate, balance, deficit;
 
     if (self->tb_rate == 0)
         return 0;
 
+    if (self->tb_pcpu) {
+        pc = self->tb_pcpu + raw_smp_processor_id() % TBKT_PCPU_MAX;
+        if (tbkt_pcpu_take(pc, request))
+            return 0;
+    }
+
     spin_lock(&self->tb_lock);
 
-    /* Balance refill based on elapsed time.  If too much time is
-     * has passed, balance will equal burst.
-     */
-    balance = self->tb_burst;
     now = get_time_ns();
-    dt = now - self->tb_refill_time;
-    if (dt < self->tb_dt_max) {
-        refill = self->tb_rate * dt / NSEC_PER_SEC;
-        refill_max = self->tb_burst - self->tb_balance;
-        if (refill < refill_max)
-            balance = self->tb_balance + refill;
+    balance = tbkt_refill(self, now);
+
+    /* Take a batch for the cpu slot along with the request only if the
+     * bucket has the tokens for both, so that batches never add to the
+     * delays.  A batch is at most 1/16th of the burst, which bounds the
+     * tokens stranded in the slots.
+     */
+    if (pc) {
+        batch = min_t(u64, self->tb_batch, self->tb_burst / TBKT_PCPU_MAX);
+        if (request < batch && balance <= self->tb_burst && request + batch <= balance)
+            request += batch;
+        else
+            batch = 0;
     }
 
     /* Update balance for request.
@@ -86,6 +204,9 @@ tbkt_request(struct tbkt *self, u64 request)
 
     spin_unlock(&self->tb_lock);
 
+    if (batch)
+        atomic64_add(batch, &pc->tp_credit);
+
     if (balance < burst)
         return 0;
 
@@ -97,6 +218,48 @@ tbkt_request(struct tbkt *self, u64 request)
     return (deficit / rate) * NSEC_PER_SEC;
 }
 
+/* Take tokens from @self only if it has them, so that @self never runs
+ * a deficit on behalf of requests it does not let through.
+ */
+static bool
+tbkt_take(struct tbkt *self, u64 request)
+{
+    u64  now, balance;
+    bool taken;
+
+    if (self->tb_rate == 0)
+        return false;
+
+    spin_lock(&self->tb_lock);
+
+    now = get_time_ns();
+    balance = tbkt_refill(self, now);
+
+    taken = request <= balance && balance <= self->tb_burst;
+    if (taken)
+        balance -= request;
+
+    self->tb_balance = balance;
+    self->tb_refill_time = now;
+
+    spin_unlock(&self->tb_lock);
+
+    return taken;
+}
+
+u64
+tbkt_request_floor(struct tbkt *self, struct tbkt *floor, u64 request)
+{
+    u64 delay;
+
+    delay = tbkt_request(self, request);
+
+    if (delay && floor && tbkt_take(floor, request))
+        delay = 0;
+
+    return delay;
+}
+
 void
 tbkt_delay(u64 nsec)
 {
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_util/usdt.h>
+
+#ifdef HSE_HAVE_SDT
+
+/* The tracer finds a probe's semaphore by the address recorded in the
+ * probe's note, and expects it in the .probes section.
+ */
+#define HSE_USDT_DEFINE(_name) \
+    unsigned short HSE_USDT_SEMAPHORE(_name) __attribute__((section(".probes")))
+
+HSE_USDT_DEFINE(c0sk_put);
+HSE_USDT_DEFINE(c0sk_get);
+HSE_USDT_DEFINE(cn_tree_lookup);
+HSE_USDT_DEFINE(kvset_lookup);
+HSE_USDT_DEFINE(c0sk_ingest_start);
+HSE_USDT_DEFINE(c0sk_ingest_end);
+HSE_USDT_DEFINE(cn_comp_start);
+HSE_USDT_DEFINE(cn_comp_end);
+HSE_USDT_DEFINE(c1_sync);
+HSE_USDT_DEFINE(throttle_sleep);
+
+#endif
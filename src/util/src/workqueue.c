@@ -6,6 +6,8 @@
 #define _GNU_SOURCE /* for pthread_setname_np() */
 
 #include <hse_util/assert.h>
+#include <hse_util/atomic.h>
+#include <hse_util/barrier.h>
 #include <hse_util/mutex.h>
 #include <hse_util/condvar.h>
 #include <hse_util/minmax.h>
@@ -16,6 +18,28 @@
 #include <signal.h>
 #include <pthread.h>
 
+/* Number of slots in a workqueue's lock-free ring (must be a power of 2).
+ * Work is queued on the locked pending list when the ring is full.
+ */
+#define WQ_RING_SLOTS (1024)
+
+/* Value of work->entry.next while work is claimed but not yet on a list.
+ */
+#define WQ_CLAIMED ((struct list_head *)-1)
+
+/**
+ * struct wq_slot - workqueue ring slot
+ * @wqs_seq:    slot sequence number
+ * @wqs_work:   work stored in the slot
+ *
+ * A slot at ring position pos is free for a producer when @wqs_seq equals
+ * pos, and holds work for a consumer when @wqs_seq equals pos + 1.
+ */
+struct wq_slot {
+    u64                 wqs_seq;
+    struct work_struct *wqs_work;
+};
+
 /**
  * struct wq_priv - worker thread private data
  * @wqp_barid:  ID of most recently processed barrier
@@ -42,7 +66,17 @@ struct wq_priv {
  * @wq_delayed:     list of work to be dispatched in the future
  * @wq_name:        workqueue name (see pthread_setname_np())
  * @wq_base:        base of workqueue memory allocation for free()
+ * @wq_sleepers:    number of worker threads waiting on @wq_idle
+ * @wq_enq:         ring position of the next producer
+ * @wq_deq:         ring position of the next consumer
+ * @wq_ring:        lock-free multi-producer/multi-consumer ring of work
  * @wq_priv:        flexible array of worker thread private data structs
+ *
+ * queue_work() claims a work item with a cmpxchg on its list entry and
+ * then publishes it in @wq_ring without taking @wq_lock, which is only
+ * acquired to wake a sleeping worker.  Delayed work, flush barriers and
+ * work that doesn't fit in the ring go on @wq_pending under @wq_lock.
+ * Workers drain the ring before looking at @wq_pending.
  */
 struct workqueue_struct {
     struct mutex     wq_lock;
@@ -57,7 +91,13 @@ struct workqueue_struct {
     struct list_head wq_delayed;
     char             wq_name[16];
     void *           wq_base;
-    struct wq_priv   wq_priv[];
+    atomic_t         wq_sleepers;
+
+    u64 wq_enq __aligned(SMP_CACHE_BYTES);
+    u64 wq_deq __aligned(SMP_CACHE_BYTES);
+
+    struct wq_slot wq_ring[WQ_RING_SLOTS] __aligned(SMP_CACHE_BYTES);
+    struct wq_priv wq_priv[];
 };
 
 static void
@@ -101,6 +141,9 @@ alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...)
     INIT_LIST_HEAD(&wq->wq_pending);
     INIT_LIST_HEAD(&wq->wq_delayed);
 
+    for (i = 0; i < WQ_RING_SLOTS; i++)
+        wq->wq_ring[i].wqs_seq = i;
+
     wq->wq_tdmax = max_active;
     wq->wq_tdcnt = max_active;
     wq->wq_refcnt = max_active;
@@ -124,6 +167,34 @@ alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...)
     return wq;
 }
 
+void
+workqueue_set_cpus(struct workqueue_struct *wq, u64 cpus)
+{
+    cpu_set_t cpuset;
+    int       i, rc;
+
+    if (ev(!wq) || !cpus)
+        return;
+
+    CPU_ZERO(&cpuset);
+    for (i = 0; i < 64; i++)
+        if (cpus & (1ul << i))
+            CPU_SET(i, &cpuset);
+
+    for (i = 0; i < wq->wq_tdmax; i++) {
+        rc = pthread_setaffinity_np(wq->wq_priv[i].wqp_tid, sizeof(cpuset), &cpuset);
+        if (ev(rc)) {
+            hse_log(
+                HSE_WARNING "%s: %s unable to set cpu mask 0x%lx: %d",
+                __func__,
+                wq->wq_name,
+                (ulong)cpus,
+                rc);
+            break;
+        }
+    }
+}
+
 void
 destroy_workqueue(struct workqueue_struct *wq)
 {
@@ -149,6 +220,7 @@ destroy_workqueue(struct workqueue_struct *wq)
 
     assert(list_empty(&wq->wq_pending));
     assert(list_empty(&wq->wq_delayed));
+    assert(wq->wq_enq == wq->wq_deq);
     assert(wq->wq_tdcnt == 0);
     mutex_unlock(&wq->wq_lock);
 
@@ -165,12 +237,108 @@ work_pending(const struct work_struct *work)
     return !list_empty(&work->entry);
 }
 
+/* Claim idle work for enqueueing, fails if the work is already pending.
+ */
+static __always_inline bool
+work_claim(struct work_struct *work)
+{
+    return atomic_ptr_cmpxchg((void **)&work->entry.next, &work->entry, WQ_CLAIMED) ==
+           &work->entry;
+}
+
 static __always_inline struct work_struct *
 workqueue_first(struct workqueue_struct *wq)
 {
     return list_first_entry_or_null(&wq->wq_pending, struct work_struct, entry);
 }
 
+/**
+ * wq_ring_put() - append claimed work to the ring
+ * @wq:     ptr to workqueue
+ * @work:   claimed work
+ *
+ * Return: false if the ring is full
+ */
+static bool
+wq_ring_put(struct workqueue_struct *wq, struct work_struct *work)
+{
+    struct wq_slot *slot;
+    u64             pos, seq;
+
+    pos = __atomic_load_n(&wq->wq_enq, __ATOMIC_RELAXED);
+
+    while (1) {
+        slot = wq->wq_ring + (pos % WQ_RING_SLOTS);
+        seq = __atomic_load_n(&slot->wqs_seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(
+                    &wq->wq_enq, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((s64)(seq - pos) < 0) {
+            return false;
+        } else {
+            pos = __atomic_load_n(&wq->wq_enq, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->wqs_work = work;
+    __atomic_store_n(&slot->wqs_seq, pos + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * wq_ring_get() - remove the oldest work from the ring
+ * @wq:     ptr to workqueue
+ *
+ * A slot claimed by a producer that has not yet published its work is
+ * waited for rather than reported as empty, so that an empty ring means
+ * all work queued before the call has been taken by a worker.
+ *
+ * Return: work, or NULL if the ring is empty
+ */
+static struct work_struct *
+wq_ring_get(struct workqueue_struct *wq)
+{
+    struct work_struct *work;
+    struct wq_slot *    slot;
+    u64                 pos, seq;
+
+    pos = __atomic_load_n(&wq->wq_deq, __ATOMIC_RELAXED);
+
+    while (1) {
+        slot = wq->wq_ring + (pos % WQ_RING_SLOTS);
+        seq = __atomic_load_n(&slot->wqs_seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos + 1) {
+            if (__atomic_compare_exchange_n(
+                    &wq->wq_deq, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((s64)(seq - (pos + 1)) < 0) {
+            if (__atomic_load_n(&wq->wq_enq, __ATOMIC_ACQUIRE) == pos)
+                return NULL;
+
+            __builtin_ia32_pause();
+            pos = __atomic_load_n(&wq->wq_deq, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&wq->wq_deq, __ATOMIC_RELAXED);
+        }
+    }
+
+    work = slot->wqs_work;
+    __atomic_store_n(&slot->wqs_seq, pos + WQ_RING_SLOTS, __ATOMIC_RELEASE);
+
+    return work;
+}
+
+static __always_inline bool
+wq_ring_empty(struct workqueue_struct *wq)
+{
+    return __atomic_load_n(&wq->wq_enq, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&wq->wq_deq, __ATOMIC_ACQUIRE);
+}
+
 #pragma push_macro("queue_work_locked")
 #undef queue_work_locked
 
@@ -182,7 +350,7 @@ queue_work_locked(struct workqueue_struct *wq, struct work_struct *work)
 
     assert(wq->wq_tdcnt > 0);
 
-    enqueued = !work_pending(work);
+    enqueued = work_claim(work);
     if (enqueued)
         list_add_tail(&work->entry, &wq->wq_pending);
 
@@ -209,8 +377,10 @@ flush_barrier(struct work_struct *work)
  * @wq:     ptr to workqueue
  *
  * Append a barrier work item to the pending list to prevent work
- * appended after the barrier from being dispatched until all work
- * ahead of the barrier has completed.
+ * appended to the pending list after the barrier from being dispatched
+ * until all work ahead of the barrier has completed.  Workers only visit
+ * the barrier after finding the ring empty, so work queued in the ring
+ * before the barrier has also completed once all workers have visited.
  */
 void
 flush_workqueue(struct workqueue_struct *wq)
@@ -273,15 +443,31 @@ worker_thread(void *arg)
 
     pthread_setname_np(priv->wqp_tid, wq->wq_name);
 
-    mutex_lock(&wq->wq_lock);
-
     while (1) {
+        work = wq_ring_get(wq);
+        if (work) {
+            INIT_LIST_HEAD(&work->entry);
+            work->func(work);
+            continue;
+        }
+
+        mutex_lock(&wq->wq_lock);
+
         work = workqueue_first(wq);
         if (!work) {
-            if (wq->wq_shutdown)
+            if (wq->wq_shutdown && wq_ring_empty(wq))
                 break;
 
-            cv_wait(&wq->wq_idle, &wq->wq_lock);
+            /* A producer that fills the ring checks for sleepers
+             * after publishing its work, so one of us sees the other.
+             */
+            atomic_inc(&wq->wq_sleepers);
+            smp_mb();
+            if (wq_ring_empty(wq))
+                cv_wait(&wq->wq_idle, &wq->wq_lock);
+            atomic_dec(&wq->wq_sleepers);
+
+            mutex_unlock(&wq->wq_lock);
             continue;
         }
 
@@ -290,8 +476,6 @@ worker_thread(void *arg)
             mutex_unlock(&wq->wq_lock);
 
             work->func(work);
-
-            mutex_lock(&wq->wq_lock);
             continue;
         }
 
@@ -310,6 +494,7 @@ worker_thread(void *arg)
          */
         if (barrier->wqb_visitors < wq->wq_tdcnt) {
             cv_wait(&wq->wq_barrier, &wq->wq_lock);
+            mutex_unlock(&wq->wq_lock);
             continue;
         }
 
@@ -318,6 +503,7 @@ worker_thread(void *arg)
          */
         list_del_init(&work->entry);
         cv_broadcast(&wq->wq_barrier);
+        mutex_unlock(&wq->wq_lock);
     }
 
     --wq->wq_tdcnt;
@@ -335,15 +521,26 @@ worker_thread(void *arg)
 bool
 queue_work(struct workqueue_struct *wq, struct work_struct *work)
 {
-    bool enqueued;
+    if (!work_claim(work))
+        return false;
 
-    mutex_lock(&wq->wq_lock);
-    enqueued = queue_work_locked(wq, work);
-    if (enqueued)
+    if (!wq_ring_put(wq, work)) {
+        mutex_lock(&wq->wq_lock);
+        list_add_tail(&work->entry, &wq->wq_pending);
         cv_signal(&wq->wq_idle);
-    mutex_unlock(&wq->wq_lock);
+        mutex_unlock(&wq->wq_lock);
 
-    return enqueued;
+        return true;
+    }
+
+    smp_mb();
+    if (atomic_read(&wq->wq_sleepers) > 0) {
+        mutex_lock(&wq->wq_lock);
+        cv_signal(&wq->wq_idle);
+        mutex_unlock(&wq->wq_lock);
+    }
+
+    return true;
 }
 
 /* delayed_work_timer_fn() - delayed work timer callback
@@ -392,7 +589,7 @@ queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork, unsi
     expires = jiffies + delay;
 
     mutex_lock(&wq->wq_lock);
-    pending = work_pending(&dwork->work);
+    pending = !work_claim(&dwork->work);
     if (!pending) {
         list_add_tail(&dwork->work.entry, &wq->wq_delayed);
         dwork->timer.expires = expires;
@@ -446,13 +643,15 @@ workqueue_dump(struct workqueue_struct *wq)
     int                  i, n;
 
     hse_log(
-        HSE_ERR "%s(%p) name %s, refcnt %d, tdcnt %u, tdmax %u",
+        HSE_ERR "%s(%p) name %s, refcnt %d, tdcnt %u, tdmax %u, ring %lu/%lu",
         __func__,
         wq,
         wq->wq_name,
         wq->wq_refcnt,
         wq->wq_tdcnt,
-        wq->wq_tdmax);
+        wq->wq_tdmax,
+        (ulong)wq->wq_deq,
+        (ulong)wq->wq_enq);
 
     for (i = 0; i < wq->wq_tdmax; ++i) {
         struct wq_priv *priv = wq->wq_priv + i;
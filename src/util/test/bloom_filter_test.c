@@ -139,6 +139,67 @@ MTF_DEFINE_UTEST(bloom_filter_basic, BasicInsert)
     }
 }
 
+MTF_DEFINE_UTEST(bloom_filter_basic, SplitInsert)
+{
+    struct bf_bithash_desc desc;
+    struct bloom_filter    f;
+    u8 *                   bits;
+    u32                    n_elts;
+    u32                    i, n, prob;
+    u64                    hash;
+    char                   buf[100];
+
+    n_elts = 10000;
+
+    for (prob = 1000; prob < 90000; prob += 1773) {
+        u32    fpc = 0;
+        size_t sz;
+
+        desc = bf_compute_bithash_est(prob);
+
+        sz = ALIGN(n_elts * desc.bhd_bits_per_elt, PAGE_SIZE);
+        bits = alloc_aligned(sz, PAGE_SIZE, 0);
+        ASSERT_NE(NULL, bits);
+
+        memset(bits, 0, sz);
+        bf_filter_init_split(&f, desc, n_elts, bits, sz);
+
+        ASSERT_EQ(1, f.bf_split);
+        ASSERT_EQ(BF_SPLIT_LANES, f.bf_n_hashes);
+        ASSERT_EQ(BF_SPLIT_BKTSHIFT, f.bf_bktshift);
+
+        for (i = 0; i < n_elts; ++i) {
+            n = sprintf(buf, "%x:%d", i, i);
+            hash = hse_hash64(buf, n);
+            bf_filter_insert_by_hash(&f, hash);
+        }
+
+        for (i = 0; i < n_elts; ++i) {
+            const u8 *bitmap = bits;
+            bool      hit;
+
+            n = sprintf(buf, "%x:%d", i, i);
+            hash = hse_hash64(buf, n);
+
+            bitmap += bf_hash2bkt(hash, f.bf_modulus, f.bf_bktshift);
+
+            hit = bf_split_lookup(hash, bitmap);
+            ASSERT_TRUE(hit);
+
+            bitmap = bits + bf_hash2bkt(~hash, f.bf_modulus, f.bf_bktshift);
+
+            hit = bf_split_lookup(~hash, bitmap);
+            if (hit)
+                ++fpc;
+        }
+
+        /* Split-block filters trade a little accuracy for speed. */
+        ASSERT_LE(fpc, (2 * prob * n_elts) / 1000000);
+
+        free_aligned(bits);
+    }
+}
+
 MTF_DEFINE_UTEST(bloom_filter_basic, RepeatableBasic)
 {
     const char *buf1 = "The cow jumped over the moon";
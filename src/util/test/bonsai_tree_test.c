@@ -1161,6 +1161,132 @@ bonsai_basic_test(enum bonsai_alloc_mode allocm, struct mtf_test_info *lcl_ti)
     cheap = NULL;
 }
 
+/* Insert keys with long shared prefixes (including keys that are prefixes
+ * of other keys) into a radix-indexed tree and a reference bonsai tree, then
+ * verify that both produce the same ordered k/v list and the same results
+ * for every type of lookup.
+ */
+void
+bonsai_art_test(enum bonsai_alloc_mode allocm, struct mtf_test_info *lcl_ti)
+{
+    const char *        pfx = "common/prefix/of/many/keys/";
+    const int           LEN = 64 * 1024;
+    struct bonsai_root *tree, *ref;
+    struct bonsai_skey  skey = { 0 };
+    struct bonsai_sval  sval = { 0 };
+    struct bonsai_kv *  kv, *rkv, *end, *rend;
+    char                kbuf[64];
+    uintptr_t           seqnoref;
+    int                 i, n, klen;
+    merr_t              err;
+    bool                found, rfound;
+
+    init_tree(&tree, allocm);
+    bn_set_index(tree, BN_INDEX_ART);
+
+    err = bn_create(NULL, 64 * MB, bonsai_client_insert_callback, NULL, &ref);
+    ASSERT_EQ(0, err);
+
+    xrand_init(LEN);
+    seqnoref = HSE_ORDNL_TO_SQNREF(1);
+
+    for (i = 0; i < LEN; ++i) {
+        u64 r = xrand();
+
+        klen = snprintf(kbuf, sizeof(kbuf), "%s%lx", pfx, (ulong)(r >> 40));
+        klen -= (r & 7) ? 0 : (r >> 8) % 8;
+
+        bn_skey_init(kbuf, klen, (r >> 4) & 1, &skey);
+        bn_sval_init(kbuf, klen, seqnoref, &sval);
+
+        err = bn_insert_or_replace(tree, &skey, &sval, (r & 15) == 3);
+        ASSERT_EQ(0, err);
+
+        err = bn_insert_or_replace(ref, &skey, &sval, (r & 15) == 3);
+        ASSERT_EQ(0, err);
+    }
+
+    rcu_read_lock();
+
+    /* Both k/v lists must hold the same keys in the same order.
+     */
+    end = &tree->br_kv;
+    rend = &ref->br_kv;
+    n = 0;
+
+    for (kv = end->bkv_next, rkv = rend->bkv_next; rkv != rend; ++n) {
+        ASSERT_NE(end, kv);
+        ASSERT_EQ(0, bn_kv_cmp(kv, rkv));
+
+        if (kv->bkv_next != end)
+            ASSERT_LT(bn_kv_cmp(kv, kv->bkv_next), 0);
+
+        kv = kv->bkv_next;
+        rkv = rkv->bkv_next;
+    }
+    ASSERT_EQ(end, kv);
+    ASSERT_GT(n, 0);
+
+    for (kv = end->bkv_next; kv != end; kv = kv->bkv_next) {
+        u16 skidx = key_immediate_index(&kv->bkv_key_imm);
+
+        klen = kv->bkv_key_imm.ki_klen;
+
+        bn_skey_init(kv->bkv_key, klen, skidx, &skey);
+        found = bn_find(tree, &skey, &rkv);
+        ASSERT_TRUE(found);
+        ASSERT_EQ(kv, rkv);
+
+        /* Probe between this key and its successor, and with each of
+         * its prefixes.
+         */
+        memcpy(kbuf, kv->bkv_key, klen);
+        kbuf[klen] = 0;
+
+        bn_skey_init(kbuf, klen + 1, skidx, &skey);
+        found = bn_find(tree, &skey, &rkv);
+        rfound = bn_find(ref, &skey, &rkv);
+        ASSERT_EQ(rfound, found);
+
+        for (i = klen + 1; i > 0; i -= 5) {
+            struct bonsai_kv *a = NULL, *b = NULL;
+
+            bn_skey_init(kbuf, i, skidx, &skey);
+
+            found = bn_findGE(tree, &skey, &a);
+            rfound = bn_findGE(ref, &skey, &b);
+            ASSERT_EQ(rfound, found);
+            if (found)
+                ASSERT_EQ(0, bn_kv_cmp(a, b));
+
+            found = bn_findLE(tree, &skey, &a);
+            rfound = bn_findLE(ref, &skey, &b);
+            ASSERT_EQ(rfound, found);
+            if (found)
+                ASSERT_EQ(0, bn_kv_cmp(a, b));
+
+            found = bn_find_pfx_GT(tree, &skey, &a);
+            rfound = bn_find_pfx_GT(ref, &skey, &b);
+            ASSERT_EQ(rfound, found);
+            if (found)
+                ASSERT_EQ(0, bn_kv_cmp(a, b));
+
+            found = bn_skiptombs_GE(tree, &skey, &a);
+            rfound = bn_skiptombs_GE(ref, &skey, &b);
+            ASSERT_EQ(rfound, found);
+            if (found)
+                ASSERT_EQ(0, bn_kv_cmp(a, b));
+        }
+    }
+
+    rcu_read_unlock();
+
+    bn_destroy(ref);
+    bn_destroy(tree);
+    cheap_destroy(cheap);
+    cheap = NULL;
+}
+
 /* Update each value of a single multi-valued key many times, then verify
  * the final result.
  */
@@ -1229,6 +1355,65 @@ bonsai_update_test(enum bonsai_alloc_mode allocm, struct mtf_test_info *lcl_ti)
     cheap = NULL;
 }
 
+/*
+ * Insert and update a key with values staged by the client via
+ * bn_val_stage() and verify the tree adopts the staged copies.
+ */
+void
+bonsai_stage_test(enum bonsai_alloc_mode allocm, struct mtf_test_info *lcl_ti)
+{
+    struct bonsai_root *tree;
+    struct bonsai_skey  skey = { 0 };
+    struct bonsai_sval  sval = { 0 };
+    struct bonsai_kv *  kv = NULL;
+    struct bonsai_val * v;
+    merr_t              err;
+    bool                found;
+    u64                 key, value;
+    void *              mem;
+    int                 i;
+
+    init_tree(&tree, allocm);
+
+    key = 0xfeedface;
+    bn_skey_init(&key, sizeof(key), 7, &skey);
+
+    for (i = 1; i <= 3; ++i) {
+        value = i * 1000;
+        bn_sval_init(&value, sizeof(value), HSE_ORDNL_TO_SQNREF(i), &sval);
+
+        if (allocm == HSE_ALLOC_CURSOR)
+            mem = cheap_malloc(cheap, bn_val_stage_sz(sizeof(value)));
+        else
+            mem = malloc(bn_val_stage_sz(sizeof(value)));
+        ASSERT_NE(NULL, mem);
+
+        bn_val_stage(mem, &sval);
+        ASSERT_EQ(mem, sval.bsv_staged);
+
+        /* The staged copy must not depend on the caller's buffer. */
+        value = 0;
+
+        rcu_read_lock();
+        err = bn_insert_or_replace(tree, &skey, &sval, false);
+        ASSERT_EQ(0, err);
+
+        found = bn_find(tree, &skey, &kv);
+        ASSERT_EQ(true, found);
+
+        v = findValue(kv, i, 0);
+        ASSERT_EQ(mem, v);
+        ASSERT_EQ(sizeof(value), v->bv_vlen);
+        memcpy(&value, v->bv_value, sizeof(value));
+        ASSERT_EQ(i * 1000, value);
+        rcu_read_unlock();
+    }
+
+    bn_destroy(tree);
+    cheap_destroy(cheap);
+    cheap = NULL;
+}
+
 void
 bonsai_original_test(enum bonsai_alloc_mode allocm, struct mtf_test_info *lcl_ti)
 {
@@ -1391,12 +1576,24 @@ MTF_DEFINE_UTEST_PREPOST(bonsai_tree_test, tombspan, no_fail_pre, no_fail_post)
     bonsai_tombspan_test(HSE_ALLOC_MALLOC, lcl_ti);
 }
 
+MTF_DEFINE_UTEST_PREPOST(bonsai_tree_test, art, no_fail_pre, no_fail_post)
+{
+    bonsai_art_test(HSE_ALLOC_CURSOR, lcl_ti);
+    bonsai_art_test(HSE_ALLOC_MALLOC, lcl_ti);
+}
+
 MTF_DEFINE_UTEST_PREPOST(bonsai_tree_test, update, no_fail_pre, no_fail_post)
 {
     bonsai_update_test(HSE_ALLOC_CURSOR, lcl_ti);
     bonsai_update_test(HSE_ALLOC_MALLOC, lcl_ti);
 }
 
+MTF_DEFINE_UTEST_PREPOST(bonsai_tree_test, stage, no_fail_pre, no_fail_post)
+{
+    bonsai_stage_test(HSE_ALLOC_CURSOR, lcl_ti);
+    bonsai_stage_test(HSE_ALLOC_MALLOC, lcl_ti);
+}
+
 MTF_DEFINE_UTEST_PREPOST(bonsai_tree_test, original, no_fail_pre, no_fail_post)
 {
     bonsai_original_test(HSE_ALLOC_CURSOR, lcl_ti);
@@ -1661,4 +1858,38 @@ MTF_DEFINE_UTEST(bonsai_tree_test, bn_kv_cmp_test)
     max_cmp("ab", false, "ab", true, 1);
 }
 
+MTF_DEFINE_UTEST(bonsai_tree_test, bn_keycmp_lcp_test)
+{
+    u8   k0[64], k1[64];
+    uint len0, len1, start, lcp, exp;
+    int  i, rc, exprc;
+
+    xrand_init(time(NULL));
+
+    for (i = 0; i < 100000; ++i) {
+        len0 = xrand() % sizeof(k0);
+        len1 = xrand() % sizeof(k1);
+
+        memset(k0, 'x', sizeof(k0));
+        memset(k1, 'x', sizeof(k1));
+
+        /* Differ at a random offset, or not at all. */
+        exp = xrand() % (sizeof(k0) + 16);
+        if (exp < min_t(uint, len0, len1))
+            k1[exp] = (xrand() & 1) ? 'w' : 'y';
+
+        for (exp = 0; exp < min_t(uint, len0, len1) && k0[exp] == k1[exp]; ++exp)
+            ;
+
+        start = exp ? xrand() % (exp + 1) : 0;
+
+        exprc = inner_key_cmp(k0, len0, k1, len1);
+        rc = bn_keycmp_lcp(k0, len0, k1, len1, start, &lcp);
+
+        ASSERT_EQ(exp, lcp);
+        ASSERT_EQ(exprc < 0, rc < 0);
+        ASSERT_EQ(exprc > 0, rc > 0);
+    }
+}
+
 MTF_END_UTEST_COLLECTION(bonsai_tree_test);
@@ -5,6 +5,7 @@
 
 #include <hse_util/page.h>
 #include <hse_util/cursor_heap.h>
+#include <hse_util/timer.h>
 
 #include "cheap_testlib.h"
 
@@ -497,4 +498,150 @@ MTF_DEFINE_UTEST(cheap_test, cheap_test_trim)
     cheap_destroy(h);
 }
 
+/* Verify cheap_create_ext() arenas are prefaulted and survive cheap_trim(). */
+MTF_DEFINE_UTEST(cheap_test, cheap_test_arena)
+{
+    size_t        maxpg = 256;
+    unsigned char vec[maxpg];
+    size_t        sz, hugesz;
+    struct cheap *h;
+    void *        p;
+
+    h = cheap_create_ext(0, maxpg * PAGE_SIZE, (maxpg / 2) * PAGE_SIZE, CHEAP_F_PREFAULT);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ((maxpg / 2) * PAGE_SIZE, h->arena);
+    ASSERT_FALSE(cheap_hugetlb(h));
+
+    /* After create the whole arena should be resident.
+     */
+    sz = rss(h, maxpg, vec);
+    ASSERT_EQ(sz, (maxpg / 2) * PAGE_SIZE);
+
+    p = cheap_malloc(h, (maxpg - 1) * PAGE_SIZE);
+    ASSERT_NE(NULL, p);
+    memset(p, 0xa5, (maxpg - 1) * PAGE_SIZE);
+
+    cheap_reset(h, 0);
+
+#if MADV_FREE == MADV_DONTNEED
+
+    /* Trimming must not release pages within the arena.
+     */
+    cheap_trim(h, 0);
+    sz = rss(h, maxpg, vec);
+    ASSERT_EQ(sz, (maxpg / 2) * PAGE_SIZE);
+
+#endif
+
+    cheap_destroy(h);
+
+    /* An arena smaller than one huge page is not created.
+     */
+    hugesz = 2ul << 20;
+
+    h = cheap_create_ext(0, hugesz * 2, hugesz / 2, CHEAP_F_HUGE2M);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ(0, h->arena);
+    ASSERT_EQ(0, h->flags);
+    cheap_destroy(h);
+
+    /* Hugetlb pages may not be available, in which case the arena
+     * falls back to base pages.
+     */
+    h = cheap_create_ext(0, hugesz * 2, hugesz, CHEAP_F_HUGE2M | CHEAP_F_PREFAULT);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ(hugesz, h->arena);
+    ASSERT_TRUE(IS_ALIGNED((uintptr_t)h->mem, hugesz));
+
+    if (!cheap_hugetlb(h))
+        ASSERT_EQ(CHEAP_F_PREFAULT, h->flags);
+
+    p = cheap_malloc(h, hugesz + hugesz / 2);
+    ASSERT_NE(NULL, p);
+    memset(p, 0xa5, hugesz + hugesz / 2);
+
+    cheap_destroy(h);
+}
+
+/* Verify CHEAP_F_NODEID() is retained with or without an arena. */
+MTF_DEFINE_UTEST(cheap_test, cheap_test_node)
+{
+    size_t        sz = 4ul << 20;
+    struct cheap *h;
+    uint          node;
+    void *        p;
+
+    node = cheap_numa_nodes();
+    ASSERT_GE(node, 1);
+    --node;
+
+    h = cheap_create_ext(0, sz, sz / 2, CHEAP_F_NODEID(node) | CHEAP_F_PREFAULT);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ(sz / 2, h->arena);
+    ASSERT_TRUE(h->flags & CHEAP_F_NODE);
+    ASSERT_EQ(node, CHEAP_F_NODEOF(h->flags));
+
+    p = cheap_malloc(h, sz - PAGE_SIZE);
+    ASSERT_NE(NULL, p);
+    memset(p, 0xa5, sz - PAGE_SIZE);
+    cheap_destroy(h);
+
+    h = cheap_create_ext(0, sz, 0, CHEAP_F_NODEID(node) | CHEAP_F_PREFAULT);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ(0, h->arena);
+    ASSERT_EQ(CHEAP_F_NODEID(node), h->flags);
+    ASSERT_FALSE(cheap_hugetlb(h));
+    cheap_destroy(h);
+}
+
+/* Destroyed cheaps are pooled and reused by cheaps of the same size,
+ * which find their memory zeroed as if freshly mapped.
+ */
+MTF_DEFINE_UTEST(cheap_test, pool_reuse)
+{
+    size_t        sz = 8ul << 20;
+    struct cheap *h, *h2;
+    void *        mem;
+    char *        p;
+    merr_t        err;
+    size_t        i;
+
+    err = hse_timer_init();
+    ASSERT_EQ(0, err);
+
+    err = cheap_pool_init();
+    ASSERT_EQ(0, err);
+
+    h = cheap_create(8, sz);
+    ASSERT_NE(NULL, h);
+    mem = h->mem;
+
+    p = cheap_malloc(h, sz / 2);
+    ASSERT_NE(NULL, p);
+    memset(p, 0xa5, sz / 2);
+    cheap_trim(h, PAGE_SIZE);
+    cheap_destroy(h);
+
+    h = cheap_create(8, sz);
+    ASSERT_NE(NULL, h);
+    ASSERT_EQ(mem, h->mem);
+
+    p = cheap_malloc(h, sz / 2);
+    ASSERT_NE(NULL, p);
+    for (i = 0; i < sz / 2; i += 512)
+        ASSERT_EQ(0, p[i]);
+
+    /* A cheap of another size is not created from the pool.
+     */
+    h2 = cheap_create(8, sz * 2);
+    ASSERT_NE(NULL, h2);
+    ASSERT_NE(h->mem, h2->mem);
+    cheap_destroy(h2);
+
+    cheap_destroy(h);
+
+    cheap_pool_fini();
+    hse_timer_fini();
+}
+
 MTF_END_UTEST_COLLECTION(cheap_test)
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/crc32c.h>
+
+MTF_MODULE_UNDER_TEST(hse_platform);
+
+MTF_BEGIN_UTEST_COLLECTION(crc32c_test);
+
+MTF_DEFINE_UTEST(crc32c_test, check_value)
+{
+    const char *str = "123456789";
+
+    ASSERT_EQ(0xe3069283, crc32c(0, str, strlen(str)));
+    ASSERT_EQ(0xe3069283, crc32c_sw(0, str, strlen(str)));
+    ASSERT_EQ(0, crc32c(0, str, 0));
+}
+
+MTF_DEFINE_UTEST(crc32c_test, hw_matches_sw)
+{
+    u8     buf[4096 + 8];
+    size_t off, len;
+    u32    crc;
+    int    i;
+
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = i * 7 + 3;
+
+    /* Every alignment and a range of lengths, in one piece and
+     * extended in two pieces.
+     */
+    for (off = 0; off < 8; ++off) {
+        for (len = 0; len <= 4096; len += 61) {
+            crc = crc32c_sw(0, buf + off, len);
+
+            ASSERT_EQ(crc, crc32c(0, buf + off, len));
+            ASSERT_EQ(crc, crc32c(crc32c(0, buf + off, len / 2), buf + off + len / 2, len - len / 2));
+        }
+    }
+
+    crc = crc32c(0, buf, 4096);
+    buf[100] ^= 1;
+    ASSERT_NE(crc, crc32c(0, buf, 4096));
+}
+
+MTF_END_UTEST_COLLECTION(crc32c_test)
@@ -152,4 +152,53 @@ MTF_DEFINE_UTEST(hash_test, split_key_test)
     }
 }
 
+MTF_DEFINE_UTEST(hash_test, hash64x4)
+{
+    const void *datav[4];
+    u8          buf[4][128];
+    u64         hashv[4];
+    size_t      len;
+    int         i, j;
+
+    for (i = 0; i < 4; ++i)
+        for (j = 0; j < sizeof(buf[i]); ++j)
+            buf[i][j] = i * 131 + j * 7;
+
+    /* Unaligned inputs of every length from empty through several
+     * stripes must hash exactly as they do one at a time.
+     */
+    for (i = 0; i < 4; ++i)
+        datav[i] = buf[i] + i;
+
+    for (len = 0; len <= sizeof(buf[0]) - 4; ++len) {
+        hse_hash64x4(datav, len, HSE_HASH_SEED64, hashv);
+
+        for (i = 0; i < 4; ++i) {
+            ASSERT_EQ(hse_hash64(datav[i], len), hashv[i]);
+
+            if (i > 0 && len > 0)
+                ASSERT_NE(hashv[0], hashv[i]);
+        }
+
+        hse_hash64x4(datav, len, 1234, hashv);
+
+        for (i = 0; i < 4; ++i)
+            ASSERT_EQ(hse_hash64_seed(datav[i], len, 1234), hashv[i]);
+    }
+}
+
+MTF_DEFINE_UTEST(hash_test, hash64_mix)
+{
+    const char str[] = "read me";
+    u64        h = hse_hash64(str, sizeof(str));
+    u64        seed;
+
+    ASSERT_EQ(hse_hash64_mix(h, 1), hse_hash64_mix(h, 1));
+
+    for (seed = 0; seed < 1024; ++seed) {
+        ASSERT_NE(hse_hash64_mix(h, seed), hse_hash64_mix(h, seed + 1));
+        ASSERT_NE(hse_hash64_mix(h, seed), hse_hash64_mix(h + 1, seed));
+    }
+}
+
 MTF_END_UTEST_COLLECTION(hash_test)
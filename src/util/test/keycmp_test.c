@@ -6,6 +6,7 @@
 #include <hse_ut/framework.h>
 
 #include <hse_util/keycmp.h>
+#include <hse_util/key_util.h>
 #include <hse_util/hse_err.h>
 
 MTF_MODULE_UNDER_TEST(hse_platform);
@@ -65,4 +66,50 @@ MTF_DEFINE_UTEST(keycmp_test, prefix)
     ASSERT_TRUE(rc > 0);
 }
 
+static int
+sign(int rc)
+{
+    return (rc > 0) - (rc < 0);
+}
+
+MTF_DEFINE_UTEST(keycmp_test, fixed)
+{
+    unsigned char  key1[16], key2[16];
+    struct key_obj ko1, ko2;
+    u64            x = 0x9e3779b97f4a7c15ull;
+    uint           kfixed, len1, len2, split;
+    int            i, j, rc;
+
+    for (i = 0; i < 10000; ++i) {
+        for (j = 0; j < sizeof(key1); ++j) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+
+            /* Few distinct bytes so that keys often share a prefix. */
+            key1[j] = x & 3;
+            key2[j] = (x >> 8) & 3;
+        }
+
+        kfixed = (i % 3) * 8;
+        len1 = (i % 5) ? kfixed : i % 17;
+        len2 = (i % 7) ? kfixed : i % 13;
+        split = i % (len1 + 1);
+
+        rc = keycmp(key1, len1, key2, len2);
+
+        ASSERT_EQ(sign(rc), sign(keycmp_fixed(key1, len1, key2, len2, kfixed)));
+        ASSERT_EQ(0, keycmp_fixed(key1, len1, key1, len1, kfixed));
+
+        ko1.ko_pfx = key1;
+        ko1.ko_pfx_len = split;
+        ko1.ko_sfx = key1 + split;
+        ko1.ko_sfx_len = len1 - split;
+        key2kobj(&ko2, key2, len2);
+
+        ASSERT_EQ(sign(rc), sign(key_obj_cmp_fixed(&ko1, &ko2, kfixed)));
+        ASSERT_EQ(0, key_obj_cmp_fixed(&ko1, &ko1, kfixed));
+    }
+}
+
 MTF_END_UTEST_COLLECTION(keycmp_test)
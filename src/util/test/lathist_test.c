@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/lathist.h>
+
+#include <pthread.h>
+
+MTF_MODULE_UNDER_TEST(lathist_test);
+
+MTF_BEGIN_UTEST_COLLECTION(lathist_test);
+
+/* Small values are exact, larger ones are within one sub-bucket.
+ */
+MTF_DEFINE_UTEST(lathist_test, lathist_test_pct)
+{
+    struct lathist_snap snap;
+    struct lathist *    lh;
+    u64                 v, i;
+    merr_t              err;
+
+    err = lathist_create(&lh);
+    ASSERT_EQ(0, err);
+
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+    ASSERT_EQ(0, snap.lss_count);
+    ASSERT_EQ(0, lathist_snap_pct(&snap, 99.0));
+
+    for (i = 1; i <= 10; ++i)
+        lathist_add(lh, i);
+
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+    ASSERT_EQ(10, snap.lss_count);
+    ASSERT_EQ(55, snap.lss_sum);
+    ASSERT_EQ(10, snap.lss_max);
+    ASSERT_EQ(5, lathist_snap_pct(&snap, 50.0));
+    ASSERT_EQ(10, lathist_snap_pct(&snap, 100.0));
+
+    lathist_reset(lh);
+
+    /* 1000 samples from 1us to 1ms.
+     */
+    for (i = 1; i <= 1000; ++i)
+        lathist_add(lh, i * 1000);
+
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+    ASSERT_EQ(1000, snap.lss_count);
+    ASSERT_EQ(1000 * 1000, snap.lss_max);
+
+    v = lathist_snap_pct(&snap, 50.0);
+    ASSERT_GE(v, 500 * 1000);
+    ASSERT_LE(v, 500 * 1000 + 500 * 1000 / LATHIST_SUB_CNT);
+
+    v = lathist_snap_pct(&snap, 99.0);
+    ASSERT_GE(v, 990 * 1000);
+    ASSERT_LE(v, 1000 * 1000);
+
+    /* Samples beyond the range land in the last bucket.
+     */
+    lathist_add(lh, U64_MAX);
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+    ASSERT_EQ(1001, snap.lss_count);
+    ASSERT_EQ(1, snap.lss_bktv[LATHIST_BKT_MAX - 1]);
+
+    lathist_destroy(lh);
+}
+
+/* Snapshots of several histograms merge.
+ */
+MTF_DEFINE_UTEST(lathist_test, lathist_test_merge)
+{
+    struct lathist_snap snap;
+    struct lathist *    lhv[2];
+    merr_t              err;
+    int                 i;
+
+    for (i = 0; i < NELEM(lhv); ++i) {
+        err = lathist_create(lhv + i);
+        ASSERT_EQ(0, err);
+    }
+
+    lathist_add(lhv[0], 100);
+    lathist_add(lhv[1], 100000);
+
+    memset(&snap, 0, sizeof(snap));
+    for (i = 0; i < NELEM(lhv); ++i)
+        lathist_snap(lhv[i], &snap);
+
+    ASSERT_EQ(2, snap.lss_count);
+    ASSERT_EQ(100000, snap.lss_max);
+    ASSERT_LE(lathist_snap_pct(&snap, 50.0), 100 + 100 / LATHIST_SUB_CNT);
+    ASSERT_EQ(100000, lathist_snap_pct(&snap, 100.0));
+
+    for (i = 0; i < NELEM(lhv); ++i)
+        lathist_destroy(lhv[i]);
+}
+
+/* The difference of two snapshots holds only the samples in between.
+ */
+MTF_DEFINE_UTEST(lathist_test, lathist_test_diff)
+{
+    struct lathist_snap prev, snap;
+    struct lathist *    lh;
+    merr_t              err;
+    int                 i;
+
+    err = lathist_create(&lh);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < 100; ++i)
+        lathist_add(lh, 1000000);
+
+    memset(&prev, 0, sizeof(prev));
+    lathist_snap(lh, &prev);
+
+    for (i = 0; i < 100; ++i)
+        lathist_add(lh, 1000);
+
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+
+    lathist_snap_diff(&prev, &snap, &prev);
+    ASSERT_EQ(100, prev.lss_count);
+    ASSERT_EQ(100 * 1000, prev.lss_sum);
+    ASSERT_LE(lathist_snap_pct(&prev, 99.0), 1000 + 1000 / LATHIST_SUB_CNT);
+
+    /* A reset in between leaves no negative counts.
+     */
+    lathist_reset(lh);
+    lathist_add(lh, 10);
+
+    memset(&prev, 0, sizeof(prev));
+    lathist_snap(lh, &prev);
+
+    lathist_snap_diff(&prev, &prev, &snap);
+    ASSERT_EQ(1, prev.lss_count);
+    ASSERT_EQ(10, lathist_snap_pct(&prev, 99.0));
+
+    lathist_destroy(lh);
+}
+
+static void *
+lathist_test_thread(void *arg)
+{
+    struct lathist *lh = arg;
+    int             i;
+
+    for (i = 0; i < 10000; ++i)
+        lathist_add(lh, i);
+
+    return NULL;
+}
+
+/* No samples are lost to concurrent recording.
+ */
+MTF_DEFINE_UTEST(lathist_test, lathist_test_threads)
+{
+    struct lathist_snap snap;
+    struct lathist *    lh;
+    pthread_t           tidv[8];
+    merr_t              err;
+    int                 i, rc;
+
+    err = lathist_create(&lh);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_create(tidv + i, NULL, lathist_test_thread, lh);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_join(tidv[i], NULL);
+        ASSERT_EQ(0, rc);
+    }
+
+    memset(&snap, 0, sizeof(snap));
+    lathist_snap(lh, &snap);
+    ASSERT_EQ(NELEM(tidv) * 10000, snap.lss_count);
+    ASSERT_EQ(9999, snap.lss_max);
+
+    lathist_destroy(lh);
+}
+
+MTF_END_UTEST_COLLECTION(lathist_test);
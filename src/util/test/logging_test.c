@@ -604,8 +604,9 @@ MTF_DEFINE_UTEST(hse_logging_test, Test_hse_logprio_name_to_val)
 
 MTF_DEFINE_UTEST(hse_logging_test, Test_hse_alog)
 {
-    merr_t rc;
-    int    i;
+    struct hse_log_async *async;
+    merr_t                rc;
+    int                   i;
 
     hse_logging_fini();
     rc = hse_logging_init();
@@ -628,6 +629,14 @@ MTF_DEFINE_UTEST(hse_logging_test, Test_hse_alog)
      */
     sleep(2);
 
+    /* Everything posted was either consumed or counted as dropped. */
+    async = &hse_logging_inf.mli_async;
+    ASSERT_EQ(atomic64_read(&async->al_head), async->al_cons);
+    ASSERT_EQ(
+        MAX_LOGGING_ASYNC_ENTRIES + 20,
+        async->al_cons + atomic64_read(&async->al_dropped));
+    ASSERT_EQ(0, atomic_read(&async->al_th_working));
+
     /* Post 10 new messages, these ones shpuld show and not be discarded. */
     for (i = 0; i < 10; i++)
         hse_alog(HSE_ERR "Test %s %d", "test after overflow", i);
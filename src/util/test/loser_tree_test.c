@@ -0,0 +1,310 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/loser_tree.h>
+#include <hse_util/element_source.h>
+
+#include "sample_element_source.h"
+
+#define getval(x) (*(x)&0xffffff)
+#define getsrc(x) (*(x) >> 24)
+
+static uint cmp_calls;
+
+static int
+u32_cmp(const void *a, const void *b)
+{
+    const u32 a_val = getval((const u32 *)a);
+    const u32 b_val = getval((const u32 *)b);
+
+    ++cmp_calls;
+
+    return (a_val > b_val) - (a_val < b_val);
+}
+
+static u64
+u32_pfx_exact(const void *a)
+{
+    return getval((const u32 *)a);
+}
+
+static u64
+u32_pfx_coarse(const void *a)
+{
+    return getval((const u32 *)a) >> 10;
+}
+
+/* Pop everything and verify that it comes out in order, returning the
+ * number of elements popped.
+ */
+static int
+drain(struct mtf_test_info *lcl_ti, struct loser_tree *lt)
+{
+    u32 *item, last = 0;
+    int  n = 0;
+
+    while (loser_tree_pop(lt, (void **)&item)) {
+        ASSERT_LE_RET(last, getval(item), -1);
+        last = getval(item);
+        ++n;
+    }
+
+    return n;
+}
+
+MTF_BEGIN_UTEST_COLLECTION(loser_tree_test);
+
+MTF_DEFINE_UTEST(loser_tree_test, t_create)
+{
+    struct loser_tree *lt;
+    merr_t             err;
+
+    err = loser_tree_create(7, u32_cmp, NULL, &lt);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(0, loser_tree_width(lt));
+    loser_tree_destroy(lt);
+
+    err = loser_tree_create(0, u32_cmp, NULL, &lt);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = loser_tree_create(7, NULL, NULL, &lt);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    err = loser_tree_create(7, u32_cmp, NULL, NULL);
+    ASSERT_EQ(EINVAL, merr_errno(err));
+
+    ASSERT_EQ(0, loser_tree_width(NULL));
+}
+
+MTF_DEFINE_UTEST(loser_tree_test, t_merge)
+{
+    const u32 WIDTH = 17;
+    const u32 ELTS = 1123;
+
+    loser_tree_pfx_fn *    pfxv[] = { NULL, u32_pfx_coarse, u32_pfx_exact };
+    struct loser_tree *    lt;
+    struct sample_es *     es[WIDTH];
+    struct element_source *handles[WIDTH];
+    merr_t                 err;
+    int                    i, j, n;
+    u32                    width;
+
+    for (j = 0; j < NELEM(pfxv); ++j) {
+
+        /* Every width from one to WIDTH, so as to cover trees that are
+         * not complete.
+         */
+        for (width = 1; width <= WIDTH; ++width) {
+            for (i = 0; i < width; ++i) {
+                err = sample_es_create(&es[i], ELTS, SES_RANDOM);
+                ASSERT_EQ(0, err);
+                sample_es_sort(es[i]);
+                handles[i] = sample_es_get_es_handle(es[i]);
+            }
+
+            err = loser_tree_create(WIDTH, u32_cmp, pfxv[j], &lt);
+            ASSERT_EQ(0, err);
+
+            err = loser_tree_prepare(lt, width, handles);
+            ASSERT_EQ(0, err);
+            ASSERT_EQ(width, loser_tree_width(lt));
+
+            n = drain(lcl_ti, lt);
+            ASSERT_EQ(width * ELTS, n);
+            ASSERT_EQ(0, loser_tree_width(lt));
+
+            loser_tree_destroy(lt);
+
+            for (i = 0; i < width; ++i)
+                sample_es_destroy(es[i]);
+        }
+    }
+}
+
+MTF_DEFINE_UTEST(loser_tree_test, t_dups)
+{
+    const u32 WIDTH = 5;
+
+    struct loser_tree *    lt;
+    struct sample_es *     es[WIDTH];
+    struct element_source *handles[WIDTH];
+    u32 *                  item;
+    merr_t                 err;
+    int                    i;
+    u32                    last, src;
+
+    /* Identical keys in every source must come out in source order. */
+    for (i = 0; i < WIDTH; ++i) {
+        err = sample_es_create_srcid(&es[i], 1123, 0, i, SES_LINEAR);
+        ASSERT_EQ(0, err);
+        handles[i] = sample_es_get_es_handle(es[i]);
+    }
+
+    err = loser_tree_create(WIDTH, u32_cmp, u32_pfx_coarse, &lt);
+    ASSERT_EQ(0, err);
+
+    err = loser_tree_prepare(lt, WIDTH, handles);
+    ASSERT_EQ(0, err);
+
+    last = 0;
+    src = 0;
+    while (loser_tree_pop(lt, (void **)&item)) {
+        if (getval(item) != last) {
+            ASSERT_EQ(last + 1, getval(item));
+            ASSERT_EQ(WIDTH, src);
+            src = 0;
+        }
+
+        ASSERT_EQ(src, getsrc(item));
+        last = getval(item);
+        ++src;
+    }
+
+    ASSERT_EQ(1122, last);
+    ASSERT_EQ(WIDTH, src);
+
+    loser_tree_destroy(lt);
+
+    for (i = 0; i < WIDTH; ++i)
+        sample_es_destroy(es[i]);
+}
+
+MTF_DEFINE_UTEST(loser_tree_test, t_pfx)
+{
+    const u32 WIDTH = 8;
+
+    struct loser_tree *    lt;
+    struct sample_es *     es[WIDTH];
+    struct element_source *handles[WIDTH];
+    merr_t                 err;
+    int                    i, n;
+
+    /* Distinct keys with exact prefixes never need the compare function. */
+    for (i = 0; i < WIDTH; ++i) {
+        err = sample_es_create_srcid(&es[i], 100, i * 100, 0, SES_LINEAR);
+        ASSERT_EQ(0, err);
+        handles[i] = sample_es_get_es_handle(es[i]);
+    }
+
+    err = loser_tree_create(WIDTH, u32_cmp, u32_pfx_exact, &lt);
+    ASSERT_EQ(0, err);
+
+    cmp_calls = 0;
+
+    err = loser_tree_prepare(lt, WIDTH, handles);
+    ASSERT_EQ(0, err);
+
+    n = drain(lcl_ti, lt);
+    ASSERT_EQ(WIDTH * 100, n);
+    ASSERT_EQ(0, cmp_calls);
+
+    loser_tree_destroy(lt);
+
+    for (i = 0; i < WIDTH; ++i)
+        sample_es_destroy(es[i]);
+}
+
+MTF_DEFINE_UTEST(loser_tree_test, t_prepare)
+{
+    const u32 WIDTH = 6;
+
+    struct loser_tree *    lt;
+    struct sample_es *     es[WIDTH];
+    struct element_source *handles[WIDTH];
+    merr_t                 err;
+    void *                 item;
+    int                    i, n;
+
+    for (i = 0; i < WIDTH; ++i) {
+        err = sample_es_create_srcid(&es[i], i % 3 ? 10 : 1, i * 10, 0, SES_LINEAR);
+        ASSERT_EQ(0, err);
+        handles[i] = sample_es_get_es_handle(es[i]);
+
+        /* Leave every third source empty. */
+        if (i % 3 == 0)
+            handles[i]->es_get_next(handles[i], &item);
+    }
+
+    err = loser_tree_create(WIDTH - 1, u32_cmp, NULL, &lt);
+    ASSERT_EQ(0, err);
+
+    err = loser_tree_prepare(lt, WIDTH, handles);
+    ASSERT_EQ(EOVERFLOW, merr_errno(err));
+
+    err = loser_tree_prepare(lt, 0, handles);
+    ASSERT_EQ(0, err);
+    ASSERT_FALSE(loser_tree_peek(lt, &item));
+    ASSERT_FALSE(loser_tree_pop(lt, &item));
+    ASSERT_EQ(NULL, item);
+
+    /* Empty and missing sources are skipped. */
+    handles[1] = NULL;
+
+    err = loser_tree_prepare(lt, WIDTH - 1, handles);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(2, loser_tree_width(lt));
+
+    n = drain(lcl_ti, lt);
+    ASSERT_EQ(20, n);
+
+    loser_tree_destroy(lt);
+
+    for (i = 0; i < WIDTH; ++i)
+        sample_es_destroy(es[i]);
+}
+
+MTF_DEFINE_UTEST(loser_tree_test, t_refetch)
+{
+    const u32 WIDTH = 4;
+
+    struct loser_tree *    lt;
+    struct sample_es *     es[WIDTH];
+    struct element_source *handles[WIDTH];
+    merr_t                 err;
+    void *                 item;
+    int                    i, n;
+
+    for (i = 0; i < WIDTH; ++i) {
+        err = sample_es_create_srcid(&es[i], 100, 0, i, SES_LINEAR);
+        ASSERT_EQ(0, err);
+        handles[i] = sample_es_get_es_handle(es[i]);
+    }
+
+    err = loser_tree_create(WIDTH, u32_cmp, u32_pfx_coarse, &lt);
+    ASSERT_EQ(0, err);
+
+    err = loser_tree_prepare(lt, WIDTH, handles);
+    ASSERT_EQ(0, err);
+
+    for (i = 0; i < 10; ++i)
+        ASSERT_TRUE(loser_tree_pop(lt, &item));
+
+    /* Move the last source 50 elements past its current element, and
+     * exhaust the one before it.
+     */
+    for (i = 0; i < 50; ++i)
+        ASSERT_TRUE(handles[WIDTH - 1]->es_get_next(handles[WIDTH - 1], &item));
+    while (handles[WIDTH - 2]->es_get_next(handles[WIDTH - 2], &item))
+        ;
+
+    loser_tree_refetch(lt, WIDTH - 1);
+    loser_tree_refetch(lt, WIDTH - 2);
+    loser_tree_rebuild(lt);
+    ASSERT_EQ(WIDTH - 1, loser_tree_width(lt));
+
+    /* The first two sources resume at 3, the last one at 53. */
+    n = drain(lcl_ti, lt);
+    ASSERT_EQ(2 * 97 + 47, n);
+
+    loser_tree_destroy(lt);
+
+    for (i = 0; i < WIDTH; ++i)
+        sample_es_destroy(es[i]);
+}
+
+MTF_END_UTEST_COLLECTION(loser_tree_test);
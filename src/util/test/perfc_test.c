@@ -391,4 +391,106 @@ MTF_DEFINE_UTEST(perfc, perfc_rollup)
     perfc_ctrseti_free(&perfc_rollup_pc);
 }
 
+MTF_DEFINE_UTEST(perfc, perfc_om)
+{
+    enum perfc_om_sidx { PERFC_BA_OMTEST_GAUGE, PERFC_RA_OMTEST_OPS, PERFC_EN_OMTEST };
+    struct perfc_name perfc_om_op[] = {
+        NE(PERFC_BA_OMTEST_GAUGE, 1, "omtest gauge", "gauge"),
+        NE(PERFC_RA_OMTEST_OPS, 1, "omtest ops", "ops"),
+    };
+    struct perfc_name ctrnames = { 0 };
+
+    struct perfc_set setv[2], other;
+    char *           text, *p;
+    size_t           len;
+    merr_t           err;
+
+    ctrnames.pcn_name = "PERFC_BA_OTHER_TEST";
+    ctrnames.pcn_desc = "other";
+    ctrnames.pcn_prio = 1;
+
+    err = perfc_ctrseti_alloc("omc", "mp:kvs1", perfc_om_op, PERFC_EN_OMTEST, "set", setv);
+    ASSERT_EQ(0, err);
+    err = perfc_ctrseti_alloc("omc", "mp:kvs2", perfc_om_op, PERFC_EN_OMTEST, "set", setv + 1);
+    ASSERT_EQ(0, err);
+    err = perfc_ctrseti_alloc("omc", "mp", &ctrnames, 1, "set", &other);
+    ASSERT_EQ(0, err);
+
+    perfc_set(setv, PERFC_BA_OMTEST_GAUGE, 7);
+    perfc_add(setv + 1, PERFC_RA_OMTEST_OPS, 42);
+    perfc_set(&other, 0, 3);
+
+    err = perfc_om_emit(PERFC_ROOT_PATH, NULL, &text, &len);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(len, strlen(text));
+    printf("%s", text);
+
+    /* The samples of a metric follow its (only) TYPE line.
+     */
+    p = strstr(text, "# TYPE hse_omtest_gauge gauge\n");
+    ASSERT_NE(NULL, p);
+    ASSERT_EQ(NULL, strstr(p + 1, "# TYPE hse_omtest_gauge"));
+    p = strstr(p, "hse_omtest_gauge{component=\"omc\",kvdb=\"mp\",kvs=\"kvs1\",set=\"set\"} 7\n");
+    ASSERT_NE(NULL, p);
+    p = strstr(p, "hse_omtest_gauge{component=\"omc\",kvdb=\"mp\",kvs=\"kvs2\",set=\"set\"} 0\n");
+    ASSERT_NE(NULL, p);
+
+    ASSERT_NE(NULL, strstr(text, "# TYPE hse_omtest_ops counter\n"));
+    ASSERT_NE(NULL, strstr(text, "hse_omtest_ops_total{component=\"omc\",kvdb=\"mp\",kvs=\"kvs2\""));
+    ASSERT_NE(NULL, strstr(text, "hse_other_test{component=\"omc\",kvdb=\"mp\",set=\"set\"} 3\n"));
+    ASSERT_EQ(0, strcmp(text + len - strlen("# EOF\n"), "# EOF\n"));
+    free(text);
+
+    err = perfc_om_emit(PERFC_ROOT_PATH, "other", &text, &len);
+    ASSERT_EQ(0, err);
+    ASSERT_EQ(NULL, strstr(text, "hse_omtest"));
+    ASSERT_NE(NULL, strstr(text, "hse_other_test{"));
+    free(text);
+
+    perfc_ctrseti_free(&other);
+    perfc_ctrseti_free(setv + 1);
+    perfc_ctrseti_free(setv);
+}
+
+MTF_DEFINE_UTEST(perfc, perfc_dis_shards)
+{
+    struct perfc_name ctrnames = { 0 };
+    struct perfc_seti *seti;
+    struct perfc_dis * dis;
+    struct perfc_set   set;
+    char *             text;
+    size_t             len;
+    merr_t             err;
+    int                i;
+
+    ctrnames.pcn_name = "PERFC_DI_DTEST_VAL";
+    ctrnames.pcn_desc = "dtest";
+    ctrnames.pcn_prio = 1;
+    ctrnames.pcn_samplepct = 100;
+
+    err = perfc_ctrseti_alloc("dsc", "mp", &ctrnames, 1, "set", &set);
+    ASSERT_EQ(0, err);
+
+    /* The shards follow the counters in the counter set instance. */
+    seti = set.ps_seti;
+    dis = &seti->pcs_ctrv[0].dis;
+    ASSERT_GE(dis->pdi_shardc, 1);
+    ASSERT_LE(dis->pdi_shardc, PERFC_PCV_MAX);
+    ASSERT_GE((void *)dis->pdi_shardv, (void *)(seti->pcs_ctrv + 1));
+    ASSERT_EQ(0, (uintptr_t)dis->pdi_shardv % SMP_CACHE_BYTES);
+
+    for (i = 1; i <= 100; ++i)
+        perfc_dis_record(&set, 0, i);
+
+    err = perfc_om_emit(PERFC_ROOT_PATH, "dtest", &text, &len);
+    ASSERT_EQ(0, err);
+#define DTEST_LABELS "{component=\"dsc\",kvdb=\"mp\",set=\"set\"}"
+    ASSERT_NE(NULL, strstr(text, "hse_dtest_val_sum" DTEST_LABELS " 5050\n"));
+    ASSERT_NE(NULL, strstr(text, "hse_dtest_val_count" DTEST_LABELS " 100\n"));
+#undef DTEST_LABELS
+    free(text);
+
+    perfc_ctrseti_free(&set);
+}
+
 MTF_END_UTEST_COLLECTION(perfc)
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#include <hse_ut/framework.h>
+
+#include <hse_util/platform.h>
+#include <hse_util/page.h>
+#include <hse_util/scratch.h>
+
+#include <pthread.h>
+
+static int
+scratch_test_pre(struct mtf_test_info *ti)
+{
+    return scratch_init() ? -1 : 0;
+}
+
+static int
+scratch_test_post(struct mtf_test_info *ti)
+{
+    scratch_fini();
+
+    return 0;
+}
+
+MTF_MODULE_UNDER_TEST(scratch_test);
+
+MTF_BEGIN_UTEST_COLLECTION_PREPOST(scratch_test, scratch_test_pre, scratch_test_post);
+
+/* Allocations are aligned, disjoint, and reused after a restore.
+ */
+MTF_DEFINE_UTEST(scratch_test, scratch_test_basic)
+{
+    struct scratch_mark mark;
+    void *              p, *q, *r;
+    size_t              align;
+
+    scratch_save(&mark);
+
+    for (align = 1; align <= PAGE_SIZE; align *= 2) {
+        p = scratch_alloc(3, align);
+        ASSERT_NE(NULL, p);
+        ASSERT_EQ(0, (uintptr_t)p & (align - 1));
+        memset(p, 0xaa, 3);
+    }
+
+    p = scratch_alloc(100, 8);
+    q = scratch_alloc(100, 8);
+    ASSERT_NE(NULL, p);
+    ASSERT_NE(NULL, q);
+    ASSERT_TRUE((char *)q >= (char *)p + 100 || (char *)p >= (char *)q + 100);
+
+    scratch_restore(&mark);
+
+    /* The first allocation after a full restore is served from the
+     * same memory.
+     */
+    scratch_save(&mark);
+    p = scratch_alloc(64, 64);
+    scratch_restore(&mark);
+
+    scratch_save(&mark);
+    q = scratch_alloc(64, 64);
+    scratch_restore(&mark);
+
+    ASSERT_EQ(p, q);
+
+    /* Nested marks release only their own allocations.
+     */
+    scratch_save(&mark);
+    p = scratch_alloc(64, 8);
+    {
+        struct scratch_mark inner;
+
+        scratch_save(&inner);
+        q = scratch_alloc(64, 8);
+        scratch_restore(&inner);
+    }
+    r = scratch_alloc(64, 8);
+    ASSERT_EQ(q, r);
+    ASSERT_NE(p, r);
+    scratch_restore(&mark);
+}
+
+/* Allocations larger than a chunk grow the arena, after which the
+ * arena is coalesced such that the same load fits into one chunk.
+ */
+MTF_DEFINE_UTEST(scratch_test, scratch_test_grow)
+{
+    struct scratch_mark mark;
+    char *              v[32];
+    int                 i, j;
+
+    for (j = 0; j < 3; ++j) {
+        scratch_save(&mark);
+
+        for (i = 0; i < NELEM(v); ++i) {
+            v[i] = scratch_alloc(16 * 1024, 16);
+            ASSERT_NE(NULL, v[i]);
+            memset(v[i], i, 16 * 1024);
+        }
+
+        for (i = 0; i < NELEM(v); ++i)
+            ASSERT_EQ((char)i, v[i][16 * 1024 - 1]);
+
+        if (j > 0) {
+            for (i = 1; i < NELEM(v); ++i)
+                ASSERT_EQ(v[i - 1] + 16 * 1024, v[i]);
+        }
+
+        scratch_restore(&mark);
+    }
+
+    scratch_save(&mark);
+    v[0] = scratch_alloc(8ul << 20, PAGE_SIZE);
+    ASSERT_NE(NULL, v[0]);
+    memset(v[0], 0, 8ul << 20);
+    scratch_restore(&mark);
+}
+
+static void *
+scratch_test_thread(void *arg)
+{
+    struct scratch_mark mark;
+    int                 i;
+
+    for (i = 0; i < 1000; ++i) {
+        scratch_save(&mark);
+        if (!scratch_alloc(i * 64, 8))
+            return (void *)-1;
+        scratch_restore(&mark);
+    }
+
+    return NULL;
+}
+
+/* Each thread has its own arena, which is released when it exits.
+ */
+MTF_DEFINE_UTEST(scratch_test, scratch_test_threads)
+{
+    pthread_t tidv[8];
+    void *    rval;
+    int       i, rc;
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_create(tidv + i, NULL, scratch_test_thread, NULL);
+        ASSERT_EQ(0, rc);
+    }
+
+    for (i = 0; i < NELEM(tidv); ++i) {
+        rc = pthread_join(tidv[i], &rval);
+        ASSERT_EQ(0, rc);
+        ASSERT_EQ(NULL, rval);
+    }
+}
+
+MTF_END_UTEST_COLLECTION(scratch_test);
@@ -125,4 +125,90 @@ MTF_DEFINE_UTEST(test, t_token_bucket)
     }
 }
 
+MTF_DEFINE_UTEST(test, t_token_bucket_floor)
+{
+    struct tbkt tb, floor;
+    u64         delay;
+
+    tbkt_init(&tb, 0, 1 * M);
+    tbkt_init(&floor, 1 * M, 1 * K);
+
+    /* Requests go through while the floor has tokens... */
+    delay = tbkt_request_floor(&tb, &floor, 512 * K);
+    ASSERT_EQ(delay, 0);
+    delay = tbkt_request_floor(&tb, &floor, 512 * K);
+    ASSERT_EQ(delay, 0);
+
+    /* ...and are delayed by the shared bucket once it has none. */
+    delay = tbkt_request_floor(&tb, &floor, 512 * K);
+    ASSERT_GT(delay, 0);
+
+    /* No floor, no guarantee. */
+    delay = tbkt_request_floor(&tb, NULL, 1 * K);
+    ASSERT_GT(delay, 0);
+}
+
+MTF_DEFINE_UTEST(test, t_token_bucket_adjust)
+{
+    struct tbkt tb;
+    u64         delay;
+
+    tbkt_init(&tb, 0, 1 * M);
+
+    /* Owe one second at 1 MiB/s... */
+    delay = tbkt_request(&tb, 1 * M);
+    ASSERT_GT(delay, NSEC_PER_SEC / 2);
+
+    /* ...which is half a second at 2 MiB/s. */
+    tbkt_adjust(&tb, 0, 2 * M);
+    delay = tbkt_request(&tb, 0);
+    ASSERT_GT(delay, NSEC_PER_SEC / 4);
+    ASSERT_LE(delay, NSEC_PER_SEC / 2 + NSEC_PER_SEC / 10);
+
+    /* A credit is capped at the new burst. */
+    tbkt_init(&tb, 1 * M, 1 * M);
+    tbkt_adjust(&tb, 1 * K, 1 * M);
+    delay = tbkt_request(&tb, 1 * K);
+    ASSERT_EQ(delay, 0);
+    delay = tbkt_request(&tb, 1 * M);
+    ASSERT_GT(delay, NSEC_PER_SEC / 2);
+}
+
+MTF_DEFINE_UTEST(test, t_token_bucket_pcpu)
+{
+    struct tbkt tb;
+    u64         delay, taken;
+    merr_t      err;
+    int         i;
+
+    /* At 1 token/sec the bucket does not refill during the test. */
+    tbkt_init(&tb, 1 * M, 1);
+    err = tbkt_pcpu_alloc(&tb, 4 * K);
+    ASSERT_EQ(err, 0);
+
+    for (i = 0; i < 1000; i++) {
+        delay = tbkt_request(&tb, 100);
+        ASSERT_EQ(delay, 0);
+    }
+
+    /* The batches are paid for by the bucket, and bounded. */
+    taken = 1 * M - tb.tb_balance;
+    ASSERT_GE(taken, 1000 * 100);
+    ASSERT_LE(taken, 1000 * 100 + 16 * 4 * K);
+
+    /* Requests no batch can serve are delayed as before. */
+    delay = tbkt_request(&tb, 1 * M);
+    ASSERT_GT(delay, 0);
+
+    /* A new bucket drops the batches of the old one. */
+    tbkt_reinit(&tb, 1 * M, 1);
+    delay = tbkt_request(&tb, 1 * M);
+    ASSERT_EQ(delay, 0);
+    delay = tbkt_request(&tb, 1);
+    ASSERT_GT(delay, 0);
+
+    tbkt_pcpu_free(&tb);
+    ASSERT_EQ(tb.tb_pcpu, NULL);
+}
+
 MTF_END_UTEST_COLLECTION(test);
@@ -897,4 +897,83 @@ MTF_DEFINE_UTEST(workqueue_test, requeue)
     free(workv);
 }
 
+/* Test that work which doesn't fit in the lock-free ring spills to
+ * the pending list and still runs exactly once.
+ */
+MTF_DEFINE_UTEST(workqueue_test, overflow)
+{
+    struct workqueue_struct *wq;
+
+    struct mywork *workv;
+    const int      workmax = 5000;
+    bool           b;
+    int            i;
+
+    workv = calloc(workmax, sizeof(*workv));
+    ASSERT_TRUE(workv != NULL);
+
+    atomic_set(&counter, 0);
+
+    wq = alloc_workqueue(__func__, 0, 1);
+    ASSERT_TRUE(wq);
+
+    for (i = 0; i < workmax; ++i) {
+        INIT_WORK(&workv[i].wstruct, requeue_cb);
+        b = queue_work(wq, &workv[i].wstruct);
+        ASSERT_TRUE(b);
+    }
+
+    b = queue_work(wq, &workv[workmax - 1].wstruct);
+    ASSERT_FALSE(b);
+
+    atomic_set(&counter, 1);
+    flush_workqueue(wq);
+
+    for (i = 0; i < workmax; ++i)
+        ASSERT_EQ(workv[i].counter, 1);
+
+    destroy_workqueue(wq);
+    free(workv);
+}
+
+struct cpus_work {
+    struct work_struct cw_work;
+    cpu_set_t          cw_cpus;
+    int                cw_rc;
+};
+
+static void
+cpus_worker(struct work_struct *work)
+{
+    struct cpus_work *cw = container_of(work, struct cpus_work, cw_work);
+
+    cw->cw_rc = pthread_getaffinity_np(pthread_self(), sizeof(cw->cw_cpus), &cw->cw_cpus);
+}
+
+MTF_DEFINE_UTEST(workqueue_test, set_cpus)
+{
+    struct workqueue_struct *wq;
+    struct cpus_work         cw;
+
+    wq = alloc_workqueue("test", 0, 2);
+    ASSERT_TRUE(wq);
+
+    /* A zero mask leaves the workers alone... */
+    workqueue_set_cpus(wq, 0);
+
+    /* ...otherwise they only run on the cpus of the mask. */
+    workqueue_set_cpus(wq, 0x1);
+
+    memset(&cw, 0, sizeof(cw));
+    INIT_WORK(&cw.cw_work, cpus_worker);
+    queue_work(wq, &cw.cw_work);
+    flush_workqueue(wq);
+
+    ASSERT_EQ(0, cw.cw_rc);
+    ASSERT_EQ(1, CPU_COUNT(&cw.cw_cpus));
+    ASSERT_TRUE(CPU_ISSET(0, &cw.cw_cpus));
+
+    destroy_workqueue(wq);
+}
+
 MTF_END_UTEST_COLLECTION(workqueue_test)
@@ -1,5 +1,7 @@
 package org.micron.hse;
 
+import java.nio.ByteBuffer;
+
 public class API {
 
 	public static void loadLibrary() {
@@ -60,6 +62,50 @@ public class API {
 		return this.read(nativeHandle);
 	}
 
+	/* Direct ByteBuffer variants: keys and values are passed to and
+	 * from the native library by address, without copies through the
+	 * Java heap.  All buffers must be allocated with allocateDirect().
+	 */
+	public int putDirect(ByteBuffer key, int keyLen, ByteBuffer value,
+			     int valueLen) throws HSEGenException {
+		return this.putDirect(nativeHandle, key, keyLen, value,
+				      valueLen);
+	}
+
+	/* Returns the full length of the value (truncated to the capacity
+	 * of valBuf), or -1 if the key was not found.
+	 */
+	public int getDirect(ByteBuffer key, int keyLen, ByteBuffer valBuf)
+			     throws HSEGenException {
+		return this.getDirect(nativeHandle, key, keyLen, valBuf);
+	}
+
+	/* Returns the full key and value lengths packed as
+	 * (keyLen << 32 | valueLen).
+	 */
+	public long readDirect(ByteBuffer keyBuf, ByteBuffer valBuf)
+			       throws HSEGenException, HSEEOFException {
+		return this.readDirect(nativeHandle, keyBuf, valBuf);
+	}
+
+	/* Batches are packed records with native-order int lengths, see
+	 * hsejni.c:
+	 *   putBatch:        { klen, vlen, key, value } ...
+	 *   getBatch keys:   { klen, key } ...
+	 *   getBatch values: { vlen (-1 if not found), value } ...
+	 * getBatch() returns the number of results stored in valBuf.
+	 */
+	public int putBatch(ByteBuffer batch, int batchLen, int count)
+			    throws HSEGenException {
+		return this.putBatch(nativeHandle, batch, batchLen, count);
+	}
+
+	public int getBatch(ByteBuffer keys, int keysLen, int count,
+			    ByteBuffer valBuf) throws HSEGenException {
+		return this.getBatch(nativeHandle, keys, keysLen, count,
+				     valBuf);
+	}
+
 	private long nativeHandle;
 
 	// JNI functions
@@ -94,4 +140,22 @@ public class API {
 
 	public native byte[] read(long handle)
 				  throws HSEGenException, HSEEOFException;
+
+	public native int putDirect(long handle, ByteBuffer key, int keyLen,
+				    ByteBuffer value, int valueLen)
+				    throws HSEGenException;
+
+	public native int getDirect(long handle, ByteBuffer key, int keyLen,
+				    ByteBuffer valBuf) throws HSEGenException;
+
+	public native long readDirect(long handle, ByteBuffer keyBuf,
+				      ByteBuffer valBuf)
+				      throws HSEGenException, HSEEOFException;
+
+	public native int putBatch(long handle, ByteBuffer batch, int batchLen,
+				   int count) throws HSEGenException;
+
+	public native int getBatch(long handle, ByteBuffer keys, int keysLen,
+				   int count, ByteBuffer valBuf)
+				   throws HSEGenException;
 }
@@ -637,3 +637,296 @@ Java_org_micron_hse_API_read(JNIEnv *env, jobject jobj, jlong handle)
 errout:
     return jRetVal;
 }
+
+/*
+ * Direct ByteBuffer variants.  The native address of each buffer is passed
+ * straight to the hse API, so keys and values are neither copied into nor
+ * out of the Java heap, and no Java objects are allocated per call.
+ */
+
+static void *
+direct_buf(JNIEnv *env, jobject buf, jlong len, const char *what)
+{
+    char  msg[128];
+    void *addr;
+    jlong cap;
+
+    addr = buf ? (*env)->GetDirectBufferAddress(env, buf) : NULL;
+    if (!addr) {
+        snprintf(msg, sizeof(msg), "%s: not a direct buffer", what);
+        throw_gen_exception(env, msg);
+        return NULL;
+    }
+
+    cap = (*env)->GetDirectBufferCapacity(env, buf);
+    if (len < 0 || len > cap) {
+        snprintf(msg, sizeof(msg), "%s: length %ld exceeds capacity %ld", what, len, cap);
+        throw_gen_exception(env, msg);
+        return NULL;
+    }
+
+    return addr;
+}
+
+JNIEXPORT jint JNICALL
+               Java_org_micron_hse_API_putDirect(
+    JNIEnv *env,
+    jobject jobj,
+    jlong   handle,
+    jobject key,
+    jint    keyLen,
+    jobject value,
+    jint    valueLen)
+{
+    void *   keyA, *valueA;
+    uint64_t rc;
+
+    keyA = direct_buf(env, key, keyLen, "putDirect key");
+    if (!keyA)
+        return -1;
+
+    valueA = direct_buf(env, value, valueLen, "putDirect value");
+    if (!valueA)
+        return -1;
+
+    rc = hse_kvs_put((void *)handle, NULL, keyA, keyLen, valueA, valueLen);
+    if (rc) {
+        char msg[128];
+        int  n;
+
+        n = snprintf(msg, sizeof(msg), "hse_kvs_put: keyL=%d valueL=%d: ", keyLen, valueLen);
+        strerror_r(hse_err_to_errno(rc), msg + n, sizeof(msg) - n);
+
+        throw_gen_exception(env, msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Returns the length of the value, which was truncated if it exceeds the
+ * capacity of valBuf, or -1 if the key was not found.
+ */
+JNIEXPORT jint JNICALL
+               Java_org_micron_hse_API_getDirect(
+    JNIEnv *env,
+    jobject jobj,
+    jlong   handle,
+    jobject key,
+    jint    keyLen,
+    jobject valBuf)
+{
+    void *   keyA, *valA;
+    jlong    valCap;
+    bool     found;
+    size_t   vlen;
+    uint64_t rc;
+
+    keyA = direct_buf(env, key, keyLen, "getDirect key");
+    if (!keyA)
+        return -1;
+
+    valA = direct_buf(env, valBuf, 0, "getDirect value");
+    if (!valA)
+        return -1;
+
+    valCap = (*env)->GetDirectBufferCapacity(env, valBuf);
+
+    rc = hse_kvs_get((void *)handle, NULL, keyA, keyLen, &found, valA, valCap, &vlen);
+    if (rc) {
+        throw_err(env, "hse_kvs_get", rc);
+        return -1;
+    }
+
+    return found ? vlen : -1;
+}
+
+/* Copies the next key and value of the cursor into keyBuf and valBuf
+ * (truncating each to the capacity of its buffer) and returns their
+ * full lengths packed as (klen << 32 | vlen).
+ */
+JNIEXPORT jlong JNICALL
+               Java_org_micron_hse_API_readDirect(
+    JNIEnv *env,
+    jobject jobj,
+    jlong   handle,
+    jobject keyBuf,
+    jobject valBuf)
+{
+    const void *kdata, *vdata;
+    void *      keyA, *valA;
+    size_t      klen, vlen;
+    jlong       kcap, vcap;
+    bool        eof;
+    uint64_t    rc;
+
+    if (cursor == NULL) {
+        throw_gen_exception(env, "No active cursor; not created?");
+        return -1;
+    }
+
+    keyA = direct_buf(env, keyBuf, 0, "readDirect key");
+    if (!keyA)
+        return -1;
+
+    valA = direct_buf(env, valBuf, 0, "readDirect value");
+    if (!valA)
+        return -1;
+
+    rc = hse_kvs_cursor_read(cursor, NULL, &kdata, &klen, &vdata, &vlen, &eof);
+    if (rc) {
+        throw_err(env, "hse_kvs_cursor_read", rc);
+        return -1;
+    }
+
+    if (eof) {
+        throw_eof_exception(env);
+        return -1;
+    }
+
+    kcap = (*env)->GetDirectBufferCapacity(env, keyBuf);
+    vcap = (*env)->GetDirectBufferCapacity(env, valBuf);
+
+    memcpy(keyA, kdata, klen < kcap ? klen : kcap);
+    memcpy(valA, vdata, vlen < vcap ? vlen : vcap);
+
+    return ((jlong)klen << 32) | (vlen & 0xffffffffu);
+}
+
+/*
+ * Batched entry points, so that one JNI transition covers many operations.
+ * Records are packed back to back with lengths as native-endian 32-bit
+ * integers (i.e., the Java side must use ByteOrder.nativeOrder()):
+ *
+ *   putBatch() input:   { u32 klen, u32 vlen, key[klen], value[vlen] } ...
+ *   getBatch() input:   { u32 klen, key[klen] } ...
+ *   getBatch() output:  { s32 vlen, value[vlen] } ...  (vlen -1 if not found)
+ */
+
+JNIEXPORT jint JNICALL
+               Java_org_micron_hse_API_putBatch(
+    JNIEnv *env,
+    jobject jobj,
+    jlong   handle,
+    jobject batch,
+    jint    batchLen,
+    jint    count)
+{
+    const char *p, *end;
+    uint32_t    klen, vlen;
+    uint64_t    rc;
+    int         i;
+
+    p = direct_buf(env, batch, batchLen, "putBatch");
+    if (!p)
+        return -1;
+
+    end = p + batchLen;
+
+    for (i = 0; i < count; ++i) {
+        if (end - p < 2 * sizeof(uint32_t))
+            break;
+
+        memcpy(&klen, p, sizeof(klen));
+        memcpy(&vlen, p + sizeof(klen), sizeof(vlen));
+        p += 2 * sizeof(uint32_t);
+
+        if (end - p < (size_t)klen + vlen)
+            break;
+
+        rc = hse_kvs_put((void *)handle, NULL, p, klen, p + klen, vlen);
+        if (rc) {
+            char msg[128];
+            int  n;
+
+            n = snprintf(msg, sizeof(msg), "hse_kvs_put: record %d: ", i);
+            strerror_r(hse_err_to_errno(rc), msg + n, sizeof(msg) - n);
+
+            throw_gen_exception(env, msg);
+            return -1;
+        }
+
+        p += klen + vlen;
+    }
+
+    if (i < count) {
+        throw_gen_exception(env, "putBatch: batch truncated");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Returns the number of keys whose results were stored in valBuf.  This is
+ * less than count if valBuf filled up, in which case the vlen of the first
+ * unstored result (if room remains for it) tells the caller how much space
+ * that value requires.
+ */
+JNIEXPORT jint JNICALL
+               Java_org_micron_hse_API_getBatch(
+    JNIEnv *env,
+    jobject jobj,
+    jlong   handle,
+    jobject keys,
+    jint    keysLen,
+    jint    count,
+    jobject valBuf)
+{
+    const char *kp, *kend;
+    char *      vp, *vend;
+    uint32_t    klen;
+    int32_t     rlen;
+    bool        found;
+    size_t      vlen;
+    uint64_t    rc;
+    int         i;
+
+    kp = direct_buf(env, keys, keysLen, "getBatch keys");
+    if (!kp)
+        return -1;
+
+    vp = direct_buf(env, valBuf, 0, "getBatch values");
+    if (!vp)
+        return -1;
+
+    kend = kp + keysLen;
+    vend = vp + (*env)->GetDirectBufferCapacity(env, valBuf);
+
+    for (i = 0; i < count; ++i) {
+        if (kend - kp < sizeof(klen))
+            break;
+
+        memcpy(&klen, kp, sizeof(klen));
+        kp += sizeof(klen);
+
+        if (kend - kp < klen)
+            break;
+
+        if (vend - vp < sizeof(rlen))
+            return i;
+
+        rc = hse_kvs_get(
+            (void *)handle, NULL, kp, klen, &found,
+            vp + sizeof(rlen), vend - vp - sizeof(rlen), &vlen);
+        if (rc) {
+            throw_err(env, "hse_kvs_get", rc);
+            return -1;
+        }
+
+        rlen = found ? vlen : -1;
+        memcpy(vp, &rlen, sizeof(rlen));
+
+        if (found && vlen > vend - vp - sizeof(rlen))
+            return i;
+
+        vp += sizeof(rlen) + (found ? vlen : 0);
+        kp += klen;
+    }
+
+    if (i < count) {
+        throw_gen_exception(env, "getBatch: keys truncated");
+        return -1;
+    }
+
+    return i;
+}